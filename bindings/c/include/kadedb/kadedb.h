@@ -1,6 +1,8 @@
 #ifndef KADEDB_C_API_H
 #define KADEDB_C_API_H
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -307,7 +309,19 @@ typedef struct KadeDB_Storage KadeDB_Storage;
 // Opaque ResultSet cursor for simple row iteration
 typedef struct KadeDB_ResultSet KadeDB_ResultSet;
 
-// Create/destroy storage instance
+// Opaque parsed KadeQL statement with optional parameters
+typedef struct KadeDB_Statement KadeDB_Statement;
+
+// Opaque pull-based cursor over a running KadeQL SELECT
+typedef struct KadeDB_Query KadeDB_Query;
+
+// Opaque cancellation flag for asynchronous queries
+typedef struct KadeDB_CancelToken KadeDB_CancelToken;
+
+// Create/destroy storage instance. A storage may be shared by several
+// threads: the engine locks internally (writers to one table take turns,
+// readers run on snapshots), so calls do not serialize on the handle.
+// Result sets and queries are for one thread at a time.
 KadeDB_Storage *KadeDB_CreateStorage();
 void KadeDB_DestroyStorage(KadeDB_Storage *storage);
 
@@ -321,12 +335,147 @@ int KadeDB_CreateTable(KadeDB_Storage *storage, const char *table,
 int KadeDB_InsertRow(KadeDB_Storage *storage, const char *table,
                      const KDB_RowView *row);
 
-// Execute a very basic query string. Supported form:
+// Insert rows[0..count) in one call. The batch is all or nothing: every row
+// is validated and checked against the table's unique columns (and the
+// other rows) before any is inserted, and readers see the rows appear
+// together. Returns 1 on success; 0 on error (nothing inserted)
+int KadeDB_InsertRows(KadeDB_Storage *storage, const char *table,
+                      const KDB_RowView *rows, unsigned long long count);
+
+// Execute a KadeQL SELECT through the parser and query executor, so
+// projections and WHERE clauses are evaluated in the engine, e.g.
 //   "SELECT * FROM <table>"
-// Returns a result set cursor or NULL on error/unsupported query
+//   "SELECT id, name FROM users WHERE age > 30 AND active = true"
+//   "SELECT ts, value FROM readings ORDER BY ts DESC LIMIT 50 OFFSET 100"
+// ORDER BY with LIMIT keeps only the requested page while scanning.
+// Parsed queries are cached per storage, keyed by their text with whitespace
+// collapsed, so repeating a query skips the parser.
+// Returns a result set cursor or NULL on error or for non-SELECT statements
 KadeDB_ResultSet *KadeDB_ExecuteQuery(KadeDB_Storage *storage,
                                       const char *query);
 
+// Keyset pagination of a KadeQL SELECT with ORDER BY and no LIMIT or
+// OFFSET, e.g. "SELECT * FROM readings ORDER BY ts DESC": returns its first
+// page_size rows after the page that produced page_token (NULL or "" for
+// the first page). Instead of skipping the rows before the page as OFFSET
+// does, a page seeks an ordered index on the first ORDER BY column, and
+// rows written between pages are neither repeated nor skipped. The table
+// needs a primary key; the ORDER BY and primary key columns must be NOT
+// NULL.
+// - next_token: optional buffer receiving the next page's token ("" after
+// the last page)
+// - next_token_len: size in bytes of next_token
+// - next_token_required: if non-NULL, set to the token's byte length
+// (including terminating NUL); a larger value than next_token_len means
+// next_token was truncated and cannot be used
+// Returns a result set cursor or NULL on error (including an invalid token)
+KadeDB_ResultSet *KadeDB_ExecuteQueryPage(
+    KadeDB_Storage *storage, const char *query, unsigned long long page_size,
+    const char *page_token, char *next_token,
+    unsigned long long next_token_len,
+    unsigned long long *next_token_required);
+
+// Parse a KadeQL statement once for repeated execution. Placeholders are
+// written `?` (numbered left to right) or `$1`, `$2`, ... and may appear
+// wherever a literal may, e.g.
+//   "SELECT * FROM readings WHERE sensor = ? AND ts >= ?"
+//   "INSERT INTO readings VALUES ($1, $2, $3)"
+// Returns NULL on a syntax error. The statement may outlive later cache
+// evictions and must be released with KadeDB_DestroyStatement.
+KadeDB_Statement *KadeDB_Prepare(KadeDB_Storage *storage, const char *query);
+
+// Number of parameter values KadeDB_ExecutePrepared expects; -1 if stmt is
+// NULL
+int KadeDB_Statement_ParameterCount(const KadeDB_Statement *stmt);
+
+// Bind params[0..count) to $1..$count and execute any statement type. DML
+// returns a one-row result with the "affected" count. Only INTEGER, FLOAT
+// and STRING values can be bound. Returns NULL on error, including a count
+// that differs from KadeDB_Statement_ParameterCount.
+KadeDB_ResultSet *KadeDB_ExecutePrepared(KadeDB_Storage *storage,
+                                         KadeDB_Statement *stmt,
+                                         const KDB_Value *params, int count);
+
+void KadeDB_DestroyStatement(KadeDB_Statement *stmt);
+
+// Streaming queries. KadeDB_Query_Open starts a KadeQL SELECT (without
+// parameters) on a background thread that produces rows from the query
+// plan in batches of `batch_rows` (0: 1024), e.g.
+//   KadeDB_Query *q = KadeDB_Query_Open(st, "SELECT * FROM events", 4096);
+//   KadeDB_ResultSet *batch;
+//   while ((batch = KadeDB_Query_FetchBatch(q)) != NULL) {
+//     while (KadeDB_ResultSet_NextRow(batch)) { ... }
+//     KadeDB_DestroyResultSet(batch);
+//   }
+//   KadeDB_Query_Close(q);
+// Rows reach the caller while the scan is still running, and at most two
+// batches are buffered ahead of it, so a slow consumer pauses the scan
+// instead of growing memory. Open returns once the first batch is ready
+// (or the query finished), and returns NULL on a syntax error, a non-SELECT
+// statement or a failure before the first batch. Scans read the snapshot
+// taken when they start, so the storage may be used (and written) while a
+// query is open; close every query before destroying it.
+
+KadeDB_Query *KadeDB_Query_Open(KadeDB_Storage *storage, const char *query,
+                                unsigned long long batch_rows);
+
+// Next batch as a result set of at most batch_rows rows, read with the
+// KadeDB_ResultSet functions and released with KadeDB_DestroyResultSet. A
+// query without rows yields one empty batch carrying its columns. Returns
+// NULL when the query is exhausted or failed (see KadeDB_Query_GetLastError).
+KadeDB_ResultSet *KadeDB_Query_FetchBatch(KadeDB_Query *query);
+
+// Error that ended the query early, or NULL if none; pointer is valid until
+// the query is closed
+const char *KadeDB_Query_GetLastError(KadeDB_Query *query);
+
+// Stop the query (ending its scan if still running) and free it
+void KadeDB_Query_Close(KadeDB_Query *query);
+
+// Asynchronous queries. The statement runs on the engine's worker pool and
+// the call returns at once, so one caller thread can keep many queries in
+// flight. On completion `callback` runs on a pool thread with `user_data`
+// and either a result set (owned by the callback, released with
+// KadeDB_DestroyResultSet) and a NULL error, or a NULL result and an error
+// message valid only during the call. The callback must not block on other
+// queries and must not destroy the storage, which waits for its queries in
+// flight before it is freed, e.g.
+//   static void done(void *ud, KadeDB_ResultSet *rs, const char *err) {
+//     ... hand rs or err to the waiting task, e.g. wake its future ...
+//   }
+//   KadeDB_ExecuteQueryAsync(st, "SELECT * FROM events", NULL, done, ud);
+typedef void (*KadeDB_QueryCallback)(void *user_data, KadeDB_ResultSet *result,
+                                     const char *error);
+
+// Cancellation tokens end a query that has not started yet, or a running
+// SELECT between two of its batches, with the error "Query cancelled".
+// Statements that already write run to completion. A token may be shared by
+// several queries and destroyed while they are still running.
+KadeDB_CancelToken *KadeDB_CancelToken_Create(void);
+void KadeDB_CancelToken_Cancel(KadeDB_CancelToken *token);
+// 1 once the token was cancelled, else 0
+int KadeDB_CancelToken_IsCancelled(const KadeDB_CancelToken *token);
+void KadeDB_CancelToken_Destroy(KadeDB_CancelToken *token);
+
+// Run a KadeQL SELECT like KadeDB_ExecuteQuery, without blocking; `token`
+// may be NULL. Returns 1 once the query is queued; on 0 (NULL arguments, a
+// syntax error or a non-SELECT statement) the callback is never called.
+int KadeDB_ExecuteQueryAsync(KadeDB_Storage *storage, const char *query,
+                             KadeDB_CancelToken *token,
+                             KadeDB_QueryCallback callback, void *user_data);
+
+// Bind and run any prepared statement like KadeDB_ExecutePrepared, without
+// blocking; values that cannot be bound are reported to the callback.
+// Parameters are copied before the call returns. Returns 1 once the
+// statement is queued; on 0 (NULL arguments or a count that differs from
+// KadeDB_Statement_ParameterCount) the callback is never called.
+int KadeDB_ExecutePreparedAsync(KadeDB_Storage *storage,
+                                KadeDB_Statement *stmt,
+                                const KDB_Value *params, int count,
+                                KadeDB_CancelToken *token,
+                                KadeDB_QueryCallback callback,
+                                void *user_data);
+
 // ResultSet iteration utilities
 // Move to next row; returns 1 when a row is available, 0 when no more rows
 int KadeDB_ResultSet_NextRow(KadeDB_ResultSet *rs);
@@ -353,6 +502,37 @@ long long KadeDB_ResultSet_GetInt64(KadeDB_ResultSet *rs, int column, int *ok);
 double KadeDB_ResultSet_GetDouble(KadeDB_ResultSet *rs, int column, int *ok);
 int KadeDB_ResultSet_GetBool(KadeDB_ResultSet *rs, int column, int *ok);
 
+// Columnar reads: copy one column of rows [first_row, first_row + max),
+// clipped to the row count, into caller buffers in a single call; the
+// cursor is not moved. Cells convert as in the typed getters above. When
+// nulls is non-NULL, nulls[i] is set to 1 for a null cell (its value slot
+// is 0) and to 0 otherwise; without it, null cells are an error. Return the
+// number of rows copied, or -1 on error (see KadeDB_ResultSet_GetLastError).
+long long KadeDB_ResultSet_FetchColumnInt64(KadeDB_ResultSet *rs, int column,
+                                            unsigned long long first_row,
+                                            int64_t *out, uint8_t *nulls,
+                                            unsigned long long max);
+long long KadeDB_ResultSet_FetchColumnDouble(KadeDB_ResultSet *rs, int column,
+                                             unsigned long long first_row,
+                                             double *out, uint8_t *nulls,
+                                             unsigned long long max);
+// out[i] is 1 or 0
+long long KadeDB_ResultSet_FetchColumnBool(KadeDB_ResultSet *rs, int column,
+                                           unsigned long long first_row,
+                                           uint8_t *out, uint8_t *nulls,
+                                           unsigned long long max);
+// Strings, laid out as in Arrow: the bytes of row i are
+// buf[offsets[i], offsets[i + 1]), without terminators, so offsets needs
+// room for max + 1 entries. String cells are copied as stored, other cells
+// as their text form, and null cells are empty. Rows are copied whole while
+// they fit in buf_size bytes, so fewer rows than requested are returned when
+// buf fills up; out_needed (optional) receives the bytes all requested rows
+// take.
+long long KadeDB_ResultSet_FetchColumnString(
+    KadeDB_ResultSet *rs, int column, unsigned long long first_row,
+    uint64_t *offsets, char *buf, unsigned long long buf_size, uint8_t *nulls,
+    unsigned long long max, unsigned long long *out_needed);
+
 // Returns last error string for this ResultSet, or NULL if none; pointer is
 // valid until the next API call on the same ResultSet
 const char *KadeDB_ResultSet_GetLastError(KadeDB_ResultSet *rs);
@@ -387,6 +567,16 @@ int KadeDB_DropTable(KadeDB_Storage *storage, const char *table);
 // error.
 int KadeDB_TruncateTable(KadeDB_Storage *storage, const char *table);
 
+// Estimated bytes held by a table's live rows, written to out_bytes.
+// Returns 1 on success; 0 if the table does not exist.
+int KadeDB_TableMemoryUsage(KadeDB_Storage *storage, const char *table,
+                            unsigned long long *out_bytes);
+
+// Memory budget of a table in bytes, 0 for none: inserts and updates that
+// would exceed it fail. Returns 1 on success; 0 if the table does not exist.
+int KadeDB_SetTableMemoryBudget(KadeDB_Storage *storage, const char *table,
+                                unsigned long long bytes);
+
 // List tables as a delimited single-line string (e.g., comma-separated).
 // - delimiter: character to separate names (e.g., ',')
 // - out_buf/out_buf_len: optional output buffer; may be NULL to query required
@@ -397,6 +587,335 @@ int KadeDB_ListTables_ToCSV(KadeDB_Storage *storage, char delimiter,
                             char *out_buf, unsigned long long out_buf_len,
                             unsigned long long *out_required_len);
 
+// ---------- Engine metrics ----------
+
+// Totals of one engine operation since start-up or the last
+// KadeDB_Metrics_Reset. Latencies are in nanoseconds, to within about 6%.
+typedef struct KadeDB_OperationMetrics {
+  unsigned long long calls;
+  unsigned long long errors;
+  unsigned long long rows_scanned;
+  unsigned long long rows_returned;
+  unsigned long long lock_wait_ns;
+  unsigned long long bytes_allocated;
+  unsigned long long latency_sum_ns;
+  unsigned long long latency_p50_ns;
+  unsigned long long latency_p99_ns;
+  unsigned long long latency_max_ns;
+} KadeDB_OperationMetrics;
+
+// Fill *out with the metrics of one operation, named as in the Prometheus
+// labels: storage "relational", "document", "timeseries", "graph" or
+// "kadeql", and an operation of it such as "insert" or "range_query".
+// Returns 1 on success; 0 for an unknown pair.
+int KadeDB_Metrics_Get(const char *storage, const char *operation,
+                       KadeDB_OperationMetrics *out);
+
+// All engine metrics in the Prometheus text exposition format, with the same
+// buffer convention as KadeDB_ListTables_ToCSV. Returns 1 on success.
+int KadeDB_Metrics_ToPrometheus(char *out_buf, unsigned long long out_buf_len,
+                                unsigned long long *out_required_len);
+
+// Start every metric from zero again
+void KadeDB_Metrics_Reset();
+
+// Turn recording on (nonzero, the default) or off
+void KadeDB_Metrics_SetEnabled(int enabled);
+
+// ---------- Slow query log ----------
+
+// Log every KadeQL statement taking at least `micros` microseconds
+// (negative: stop logging, the default). The log is read with
+// KadeDB_ExecuteQuery as the table "kadedb_slow_queries".
+void KadeDB_SlowQueryLog_SetThreshold(long long micros);
+
+// Keep at most `capacity` entries (at least 1), dropping the oldest
+void KadeDB_SlowQueryLog_SetCapacity(unsigned long long capacity);
+
+// Drop every entry
+void KadeDB_SlowQueryLog_Clear();
+
+// ---------- Tracing ----------
+
+// A finished, sampled span. Ids follow W3C Trace Context (a 128-bit trace
+// id in two halves, 64-bit span ids); parent_span_id is 0 for a root. The
+// pointers are valid during the callback only.
+typedef struct KadeDB_SpanData {
+  unsigned long long trace_id_high;
+  unsigned long long trace_id_low;
+  unsigned long long span_id;
+  unsigned long long parent_span_id;
+  const char *name; // "kadeql.parse", "storage.relational.scan", ...
+  long long start_unix_ns;
+  unsigned long long duration_ns;
+  int error;
+  int attribute_count;
+  const char *const *attribute_keys;
+  const char *const *attribute_values;
+} KadeDB_SpanData;
+
+// Receives each span on the thread that ended it; it must be thread-safe
+typedef void (*KadeDB_SpanCallback)(void *user_data,
+                                    const KadeDB_SpanData *span);
+
+// Export spans to `callback` (NULL: stop tracing, the default)
+void KadeDB_Trace_SetExporter(KadeDB_SpanCallback callback, void *user_data);
+
+// Share of new traces sampled, in [0, 1] (default 1). Traces continuing a
+// traceparent follow its sampled flag.
+void KadeDB_Trace_SetSampleRatio(double ratio);
+
+// Make the W3C `traceparent` ("00-<trace id>-<span id>-<flags>") the parent
+// of the spans this thread starts from now on, including those of the
+// queries it submits with KadeDB_ExecuteQueryAsync. NULL or "" clears it.
+// Returns 1 on success; 0 for a malformed traceparent (the parent is then
+// cleared).
+int KadeDB_Trace_SetParent(const char *traceparent);
+
+// Caller-side span, such as the serialization of a result by a binding.
+// Spans started after it on this thread are its children until it ends;
+// end it on the same thread, innermost first. Returns NULL when no
+// exporter is set (ending NULL is a no-op).
+typedef struct KadeDB_Span KadeDB_Span;
+KadeDB_Span *KadeDB_Trace_StartSpan(const char *name);
+void KadeDB_Trace_EndSpan(KadeDB_Span *span);
+
+// ---------- Arrow C data interface ----------
+
+// The standard Arrow C data interface structures, guarded so that Arrow's
+// own headers (or nanoarrow) may define them instead
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  const char *format;
+  const char *name;
+  const char *metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema **children;
+  struct ArrowSchema *dictionary;
+  void (*release)(struct ArrowSchema *);
+  void *private_data;
+};
+
+struct ArrowArray {
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void **buffers;
+  struct ArrowArray **children;
+  struct ArrowArray *dictionary;
+  void (*release)(struct ArrowArray *);
+  void *private_data;
+};
+
+#endif // ARROW_C_DATA_INTERFACE
+
+// Export all rows of a result set (the cursor is not moved) as one Arrow
+// record batch: a struct array with one child per column (Integer -> int64,
+// Float -> float64, String -> utf8, Boolean -> boolean). The caller owns
+// both structures and must call their release callbacks; they stay valid
+// after the result set is destroyed. Returns 1 on success; 0 on error (see
+// KadeDB_ResultSet_GetLastError).
+int KadeDB_ResultSet_ExportArrow(KadeDB_ResultSet *rs,
+                                 struct ArrowSchema *out_schema,
+                                 struct ArrowArray *out_array);
+
+// Insert the rows of an Arrow record batch (struct array) into an existing
+// table, matching columns by name. Both structures are consumed (released)
+// whether or not the import succeeds. out_rows, when non-NULL, is set to the
+// rows inserted. Returns 1 on success; 0 on error.
+int KadeDB_ImportArrow(KadeDB_Storage *storage, const char *table,
+                       struct ArrowSchema *schema, struct ArrowArray *array,
+                       unsigned long long *out_rows);
+
+// ---------- Replication ----------
+
+// Log shipping to read replicas. On the leader a shipper per follower
+// follows a write-ahead log file and cuts it into segments: runs of
+// consecutive records as one binary blob. A follower applies them in order
+// to its storage with a replica and serves reads from it within a staleness
+// bound, e.g.
+//   leader:   KadeDB_WalShipper_Next(sh, &data, &len, &first, &last, &tail)
+//             ... send the five values to the follower ...
+//   follower: KadeDB_Replica_Apply(rep, data, len, first, last, tail);
+//             rs = KadeDB_Replica_ExecuteQuery(rep, "SELECT ...", 500);
+typedef struct KadeDB_WalShipper KadeDB_WalShipper;
+typedef struct KadeDB_Replica KadeDB_Replica;
+
+// Ship the log at `wal_path` from the record after `after_lsn` (the
+// follower's KadeDB_Replica_AppliedLsn) in segments of about
+// `max_segment_bytes` (0: 1 MiB), LZ4-compressed when `compress` is
+// nonzero. A missing file is an empty log until it is created.
+// Returns NULL on error.
+KadeDB_WalShipper *KadeDB_WalShipper_Open(const char *wal_path,
+                                          unsigned long long after_lsn,
+                                          unsigned long long max_segment_bytes,
+                                          int compress);
+
+// Cut the segment of the records written since the previous one:
+// *out_data/*out_len (valid until the next call), records
+// *out_first_lsn..*out_last_lsn (none, first = last + 1, for a heartbeat),
+// and *out_tail set to 1 when the log had no later record. Returns 1 on
+// success; 0 on error (see KadeDB_WalShipper_GetLastError).
+int KadeDB_WalShipper_Next(KadeDB_WalShipper *shipper,
+                           const unsigned char **out_data,
+                           unsigned long long *out_len,
+                           unsigned long long *out_first_lsn,
+                           unsigned long long *out_last_lsn, int *out_tail);
+
+// Error of the last failed call, or NULL if none
+const char *KadeDB_WalShipper_GetLastError(KadeDB_WalShipper *shipper);
+
+void KadeDB_WalShipper_Close(KadeDB_WalShipper *shipper);
+
+// Apply a leader's segments to `storage`, which must not be written
+// otherwise and must outlive the replica. `applied_lsn` is the last record
+// it already holds (0 for an empty storage). Records of the document,
+// time-series and graph engines go to in-memory storages of the replica.
+KadeDB_Replica *KadeDB_Replica_Create(KadeDB_Storage *storage,
+                                      unsigned long long applied_lsn);
+
+// Apply one segment, as returned by KadeDB_WalShipper_Next; it must follow
+// KadeDB_Replica_AppliedLsn. Returns 1 on success; 0 on error (see
+// KadeDB_Replica_GetLastError). After a record fails to apply the replica
+// refuses further segments and reads and must be rebuilt.
+int KadeDB_Replica_Apply(KadeDB_Replica *replica, const unsigned char *data,
+                         unsigned long long len, unsigned long long first_lsn,
+                         unsigned long long last_lsn, int tail);
+
+unsigned long long KadeDB_Replica_AppliedLsn(KadeDB_Replica *replica);
+
+// Milliseconds since the replica last held every record of its leader, or
+// -1 before it first caught up
+long long KadeDB_Replica_StalenessMillis(KadeDB_Replica *replica);
+
+// KadeDB_ExecuteQuery on the replica's storage, provided that it is within
+// `max_staleness_ms` of its leader; NULL otherwise (see
+// KadeDB_Replica_GetLastError)
+KadeDB_ResultSet *KadeDB_Replica_ExecuteQuery(
+    KadeDB_Replica *replica, const char *query,
+    unsigned long long max_staleness_ms);
+
+// Error of the last failed call, or NULL if none
+const char *KadeDB_Replica_GetLastError(KadeDB_Replica *replica);
+
+void KadeDB_Replica_Destroy(KadeDB_Replica *replica);
+
+// ---------- Distributed queries ----------
+
+// Scatter-gather over a table split across nodes. The coordinator plans a
+// SELECT into a fragment (KadeQL) that every node runs on its share of the
+// table, and merges the nodes' encoded results into the query's result:
+//   coordinator: q = KadeDB_DistributedQuery_Plan("SELECT ...");
+//                ... send KadeDB_DistributedQuery_Fragment(q) to the nodes
+//   node:        rs = KadeDB_ExecuteQuery(storage, fragment);
+//                KadeDB_ResultSet_EncodeFragment(rs, 1, &data, &len);
+//                ... send data/len back ...
+//   coordinator: rs = KadeDB_DistributedQuery_Merge(q, datas, lens, n);
+typedef struct KadeDB_DistributedQuery KadeDB_DistributedQuery;
+
+// Plan `query`, a single-table SELECT. Returns NULL when it does not parse
+// or cannot be distributed (JOINs, parameters, FIRST/LAST without an order
+// key, ORDER BY a column outside the select list).
+KadeDB_DistributedQuery *KadeDB_DistributedQuery_Plan(const char *query);
+
+// The KadeQL each node runs; valid until the query is destroyed
+const char *
+KadeDB_DistributedQuery_Fragment(const KadeDB_DistributedQuery *query);
+
+// Merge `count` encoded fragment results (results[i] of lens[i] bytes)
+// into the query's result. Returns NULL on error (see
+// KadeDB_DistributedQuery_GetLastError).
+KadeDB_ResultSet *KadeDB_DistributedQuery_Merge(
+    KadeDB_DistributedQuery *query, const unsigned char *const *results,
+    const unsigned long long *lens, unsigned long long count);
+
+// Run the query over `count` local storages as the nodes, their fragments
+// in parallel, and merge. Returns NULL on error (see
+// KadeDB_DistributedQuery_GetLastError).
+KadeDB_ResultSet *
+KadeDB_DistributedQuery_Execute(KadeDB_DistributedQuery *query,
+                                KadeDB_Storage *const *nodes,
+                                unsigned long long count);
+
+// Error of the last failed call, or NULL if none
+const char *
+KadeDB_DistributedQuery_GetLastError(KadeDB_DistributedQuery *query);
+
+void KadeDB_DistributedQuery_Destroy(KadeDB_DistributedQuery *query);
+
+// A node's result of a fragment as exchanged with the coordinator (all
+// rows, as one binary row batch, LZ4-compressed when `compress` is
+// nonzero): *out_data/*out_len stay valid until the next call on `rs` or
+// its destruction. Returns 1 on success; 0 on error.
+int KadeDB_ResultSet_EncodeFragment(KadeDB_ResultSet *rs, int compress,
+                                    const unsigned char **out_data,
+                                    unsigned long long *out_len);
+
+// ---------- Change data capture ----------
+
+// Subscriptions to the rows written to a table, in place of polling it with
+// queries, e.g.
+//   KadeDB_EnableChangeCapture(st, 0);
+//   KadeDB_Subscription *sub = KadeDB_Subscribe(st, "vitals", NULL);
+//   KadeDB_ResultSet *changes;
+//   while ((changes = KadeDB_Subscription_Poll(sub, 1000, 500)) != NULL) {
+//     while (KadeDB_ResultSet_NextRow(changes)) { ... }
+//     KadeDB_DestroyResultSet(changes);
+//   }
+//   KadeDB_Subscription_Close(sub);
+// Changes are kept in a ring shared by the storage's subscriptions. Writers
+// never wait for a subscription: one that falls more than the ring's
+// capacity behind ends instead, and must read the table again and
+// resubscribe.
+typedef struct KadeDB_Subscription KadeDB_Subscription;
+
+// Capture every write to the storage's tables from now on, in a ring of
+// `capacity` changes (0: 65536). Has no effect once enabled. Returns 1 on
+// success; 0 on error.
+int KadeDB_EnableChangeCapture(KadeDB_Storage *storage,
+                               unsigned long long capacity);
+
+// Subscribe to the changes of `table` from now on, only to the rows
+// matching where_predicate when non-NULL (an update when its old or new row
+// does). Returns NULL if the table does not exist or change capture is not
+// enabled.
+KadeDB_Subscription *KadeDB_Subscribe(KadeDB_Storage *storage,
+                                      const char *table,
+                                      const KDB_Predicate *where_predicate);
+
+// The next changes, at most max_changes (0: no limit), waiting up to
+// wait_ms while there are none, as a result set with columns seq INTEGER,
+// change STRING (INSERT, UPDATE, DELETE, TRUNCATE or DROP) and then the
+// table's columns: the new row of an insert or update, the old row of a
+// delete, NULLs otherwise. An empty result set means nothing changed in
+// time. Returns NULL once the subscription ended (see
+// KadeDB_Subscription_GetLastError): after its DROP, after it fell behind,
+// or after KadeDB_Subscription_Cancel.
+KadeDB_ResultSet *KadeDB_Subscription_Poll(KadeDB_Subscription *sub,
+                                           unsigned long long max_changes,
+                                           unsigned long long wait_ms);
+
+// Seq of the last change considered; changes published after it
+unsigned long long KadeDB_Subscription_Position(KadeDB_Subscription *sub);
+unsigned long long KadeDB_Subscription_Lag(KadeDB_Subscription *sub);
+
+// Why the subscription ended, or NULL if it has not
+const char *KadeDB_Subscription_GetLastError(KadeDB_Subscription *sub);
+
+// End the subscription from any thread, waking a blocked poll
+void KadeDB_Subscription_Cancel(KadeDB_Subscription *sub);
+
+void KadeDB_Subscription_Close(KadeDB_Subscription *sub);
+
 #ifdef __cplusplus
 }
 #endif
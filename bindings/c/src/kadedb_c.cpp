@@ -1,18 +1,35 @@
 #include "kadedb/kadedb.h"
 #include "kadedb/version.h"
 
+#include "kadedb/arrow.h"
+#include "kadedb/async_executor.h"
+#include "kadedb/change_feed.h"
+#include "kadedb/distributed.h"
+#include "kadedb/kadeql.h"
+#include "kadedb/metrics.h"
+#include "kadedb/prepared_statement.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/replication.h"
 #include "kadedb/result.h"
 #include "kadedb/schema.h"
+#include "kadedb/slow_query_log.h"
 #include "kadedb/storage.h"
+#include "kadedb/tracing.h"
 #include "kadedb/value.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 using namespace kadedb;
 
@@ -551,6 +568,78 @@ using namespace kadedb;
 
 static ColumnType to_cpp_column_type(KDB_ColumnType t);
 
+namespace {
+
+// The C rows streamed as ResultRows, converted one at a time into `row`
+struct CRowSource {
+  std::vector<std::string> names;
+  std::vector<ColumnType> types;
+  const KDB_RowView *rows;
+  size_t columns;
+  ResultRow row;
+
+  CRowSource(const char *const *column_names, const KDB_ColumnType *ctypes,
+             unsigned long long column_count, const KDB_RowView *rowViews)
+      : rows(rowViews), columns(static_cast<size_t>(column_count)) {
+    names.reserve(columns);
+    types.reserve(columns);
+    for (size_t i = 0; i < columns; ++i) {
+      names.emplace_back(column_names && column_names[i]
+                             ? std::string(column_names[i])
+                             : std::string());
+      types.emplace_back(ctypes ? to_cpp_column_type(ctypes[i])
+                                : ColumnType::Null);
+    }
+  }
+
+  const ResultRow &operator()(size_t r) {
+    const auto &rv = rows[r];
+    std::vector<std::unique_ptr<Value>> vals;
+    vals.reserve(columns);
+    for (size_t c = 0; c < columns; ++c) {
+      if (c < rv.count)
+        vals.emplace_back(from_c_value(rv.values[c]));
+      else
+        vals.emplace_back(ValueFactory::createNull());
+    }
+    row = ResultRow(std::move(vals));
+    return row;
+  }
+};
+
+// Copies streamed output into the caller's buffer, truncated to
+// out_buf_len - 1 bytes, while counting the full length
+struct CBufferSink {
+  char *buf;
+  unsigned long long cap; // bytes available before the NUL
+  unsigned long long written = 0;
+  unsigned long long total = 0;
+
+  CBufferSink(char *out_buf, unsigned long long out_buf_len)
+      : buf(out_buf_len ? out_buf : nullptr),
+        cap(out_buf && out_buf_len ? out_buf_len - 1ULL : 0ULL) {}
+
+  void operator()(const char *data, size_t size) {
+    total += size;
+    const unsigned long long n = std::min<unsigned long long>(
+        cap - written, static_cast<unsigned long long>(size));
+    if (n) {
+      std::memcpy(buf + written, data, static_cast<size_t>(n));
+      written += n;
+    }
+  }
+
+  int finish(unsigned long long *out_required_len) {
+    if (out_required_len)
+      *out_required_len = total + 1ULL;
+    if (buf)
+      buf[written] = '\0';
+    return 1;
+  }
+};
+
+} // namespace
+
 extern "C" int KadeDB_Result_ToCSVEx(
     const char *const *column_names, const KDB_ColumnType *types,
     unsigned long long column_count, const KDB_RowView *rows,
@@ -558,47 +647,16 @@ extern "C" int KadeDB_Result_ToCSVEx(
     int always_quote, char quote_char, char *out_buf,
     unsigned long long out_buf_len, unsigned long long *out_required_len) {
   try {
-    // Build ResultSet
-    std::vector<std::string> cols;
-    cols.reserve(static_cast<size_t>(column_count));
-    for (unsigned long long i = 0; i < column_count; ++i) {
-      cols.emplace_back(column_names && column_names[i]
-                            ? std::string(column_names[i])
-                            : std::string());
-    }
-    std::vector<ColumnType> ctypes;
-    ctypes.reserve(static_cast<size_t>(column_count));
-    for (unsigned long long i = 0; i < column_count; ++i) {
-      ctypes.emplace_back(types ? to_cpp_column_type(types[i])
-                                : ColumnType::Null);
-    }
-    ResultSet rs(std::move(cols), std::move(ctypes));
-    for (unsigned long long r = 0; r < row_count; ++r) {
-      const auto &rv = rows[r];
-      std::vector<std::unique_ptr<Value>> vals;
-      vals.reserve(static_cast<size_t>(column_count));
-      for (unsigned long long c = 0; c < column_count; ++c) {
-        if (c < rv.count)
-          vals.emplace_back(from_c_value(rv.values[c]));
-        else
-          vals.emplace_back(ValueFactory::createNull());
-      }
-      rs.addRow(ResultRow(std::move(vals)));
-    }
-
-    std::string s =
-        rs.toCSV(delimiter, include_header != 0, always_quote != 0, quote_char);
-    unsigned long long need = static_cast<unsigned long long>(s.size()) + 1ULL;
-    if (out_required_len)
-      *out_required_len = need;
-    if (!out_buf || out_buf_len == 0)
-      return 1;
-    // Write up to out_buf_len - 1 and NUL-terminate
-    unsigned long long ncopy =
-        (need <= out_buf_len) ? (need - 1ULL) : (out_buf_len - 1ULL);
-    std::memcpy(out_buf, s.data(), static_cast<size_t>(ncopy));
-    out_buf[ncopy] = '\0';
-    return 1;
+    // Streamed straight into out_buf: neither a ResultSet nor the whole text
+    // is built
+    CRowSource source(column_names, types, column_count, rows);
+    CBufferSink sink(out_buf, out_buf_len);
+    writeCSV(
+        source.names, source.types, static_cast<size_t>(row_count),
+        [&](size_t r) -> const ResultRow & { return source(r); },
+        [&](const char *data, size_t size) { sink(data, size); }, delimiter,
+        include_header != 0, always_quote != 0, quote_char);
+    return sink.finish(out_required_len);
   } catch (...) {
     return 0;
   }
@@ -625,46 +683,16 @@ extern "C" int KadeDB_Result_ToJSONEx(
     char *out_buf, unsigned long long out_buf_len,
     unsigned long long *out_required_len) {
   try {
-    // Build ResultSet
-    std::vector<std::string> cols;
-    cols.reserve(static_cast<size_t>(column_count));
-    for (unsigned long long i = 0; i < column_count; ++i) {
-      cols.emplace_back(column_names && column_names[i]
-                            ? std::string(column_names[i])
-                            : std::string());
-    }
-    std::vector<ColumnType> ctypes;
-    ctypes.reserve(static_cast<size_t>(column_count));
-    for (unsigned long long i = 0; i < column_count; ++i) {
-      ctypes.emplace_back(types ? to_cpp_column_type(types[i])
-                                : ColumnType::Null);
-    }
-    ResultSet rs(std::move(cols), std::move(ctypes));
-    for (unsigned long long r = 0; r < row_count; ++r) {
-      const auto &rv = rows[r];
-      std::vector<std::unique_ptr<Value>> vals;
-      vals.reserve(static_cast<size_t>(column_count));
-      for (unsigned long long c = 0; c < column_count; ++c) {
-        if (c < rv.count)
-          vals.emplace_back(from_c_value(rv.values[c]));
-        else
-          vals.emplace_back(ValueFactory::createNull());
-      }
-      rs.addRow(ResultRow(std::move(vals)));
-    }
+    CRowSource source(column_names, types, column_count, rows);
+    CBufferSink sink(out_buf, out_buf_len);
     if (indent < 0)
       indent = 0;
-    std::string s = rs.toJSON(include_metadata != 0, indent);
-    unsigned long long need = static_cast<unsigned long long>(s.size()) + 1ULL;
-    if (out_required_len)
-      *out_required_len = need;
-    if (!out_buf || out_buf_len == 0)
-      return 1;
-    unsigned long long ncopy =
-        (need <= out_buf_len) ? (need - 1ULL) : (out_buf_len - 1ULL);
-    std::memcpy(out_buf, s.data(), static_cast<size_t>(ncopy));
-    out_buf[ncopy] = '\0';
-    return 1;
+    writeJSON(
+        source.names, source.types, static_cast<size_t>(row_count),
+        [&](size_t r) -> const ResultRow & { return source(r); },
+        [&](const char *data, size_t size) { sink(data, size); },
+        include_metadata != 0, indent);
+    return sink.finish(out_required_len);
   } catch (...) {
     return 0;
   }
@@ -757,9 +785,29 @@ extern "C" int KadeDB_Paginate_Bounds(unsigned long long total_rows,
 
 // ---------------- Minimal Relational Storage C ABI ----------------
 
+// The engine synchronizes itself (catalog lock, per-table writer lock,
+// MVCC snapshots for readers), so calls on one storage run concurrently
 struct KadeDB_Storage {
   InMemoryRelationalStorage impl;
-  std::mutex mtx;
+  // Parsed queries by normalized text, shared by ExecuteQuery and Prepare
+  kadeql::StatementCache statements;
+  // Asynchronous queries whose callback has not returned yet
+  std::mutex async_mtx;
+  std::condition_variable async_cv;
+  size_t async_in_flight = 0;
+
+  ~KadeDB_Storage() {
+    std::unique_lock<std::mutex> lock(async_mtx);
+    async_cv.wait(lock, [&] { return async_in_flight == 0; });
+  }
+};
+
+struct KadeDB_CancelToken {
+  CancellationToken impl;
+};
+
+struct KadeDB_Statement {
+  std::shared_ptr<kadeql::PreparedStatement> impl;
 };
 
 struct KadeDB_ResultSet {
@@ -785,89 +833,405 @@ extern "C" int KadeDB_CreateTable(KadeDB_Storage *storage, const char *table,
                                   const KDB_TableSchema *schema) {
   if (!storage || !table || !schema)
     return 0;
-  std::lock_guard<std::mutex> lock(storage->mtx);
   Status st = storage->impl.createTable(std::string{table}, schema->impl);
   return st.ok() ? 1 : 0;
 }
 
-extern "C" int KadeDB_InsertRow(KadeDB_Storage *storage, const char *table,
-                                const KDB_RowView *row) {
-  if (!storage || !table || !row)
-    return 0;
-  Row r(static_cast<size_t>(row->count));
-  for (unsigned long long i = 0; i < row->count; ++i) {
-    const KDB_Value &v = row->values[i];
+// Row of the view's values; KDB_VAL_NULL cells are null
+static Row to_cpp_row(const KDB_RowView &view) {
+  Row r(static_cast<size_t>(view.count));
+  for (unsigned long long i = 0; i < view.count; ++i) {
+    const KDB_Value &v = view.values[i];
     if (v.type == KDB_VAL_NULL)
       r.set(static_cast<size_t>(i), nullptr);
     else
       r.set(static_cast<size_t>(i), from_c_value(v));
   }
-  std::lock_guard<std::mutex> lock(storage->mtx);
-  Status st = storage->impl.insertRow(std::string{table}, r);
+  return r;
+}
+
+extern "C" int KadeDB_InsertRow(KadeDB_Storage *storage, const char *table,
+                                const KDB_RowView *row) {
+  if (!storage || !table || !row)
+    return 0;
+  Status st = storage->impl.insertRow(std::string{table}, to_cpp_row(*row));
   return st.ok() ? 1 : 0;
 }
 
-// very small SELECT parser: supports only "SELECT * FROM <table>"
-// (case-insensitive)
-static std::string parse_select_star_from(const char *query) {
-  if (!query)
-    return {};
-  // trim leading spaces
-  const char *p = query;
-  while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
-    ++p;
-  auto tolower_str = [](const std::string &s) {
-    std::string o;
-    o.reserve(s.size());
-    for (char c : s)
-      o.push_back(static_cast<char>(::tolower(static_cast<unsigned char>(c))));
-    return o;
-  };
-  std::string s = tolower_str(p);
-  const std::string prefix = "select * from ";
-  if (s.rfind(prefix, 0) != 0)
-    return {};
-  std::string rest = s.substr(prefix.size());
-  // trim trailing semicolon/spaces
-  while (!rest.empty() &&
-         (rest.back() == ' ' || rest.back() == '\t' || rest.back() == '\n' ||
-          rest.back() == '\r' || rest.back() == ';'))
-    rest.pop_back();
-  // original case table name: extract from original query at equivalent
-  // position
-  size_t off = static_cast<size_t>(p - query) + prefix.size();
-  std::string table = std::string(query + off, query + off + rest.size());
-  // trim trailing whitespace in original
-  while (!table.empty() &&
-         (table.back() == ' ' || table.back() == '\t' || table.back() == '\n' ||
-          table.back() == '\r' || table.back() == ';'))
-    table.pop_back();
-  return table;
+extern "C" int KadeDB_InsertRows(KadeDB_Storage *storage, const char *table,
+                                 const KDB_RowView *rows,
+                                 unsigned long long count) {
+  if (!storage || !table || (count > 0 && !rows))
+    return 0;
+  try {
+    std::vector<Row> batch;
+    batch.reserve(static_cast<size_t>(count));
+    for (unsigned long long i = 0; i < count; ++i)
+      batch.push_back(to_cpp_row(rows[i]));
+    return storage->impl.insertRows(std::string{table}, batch).ok() ? 1 : 0;
+  } catch (...) {
+    return 0;
+  }
+}
+
+// Run a prepared statement and wrap its result
+static KadeDB_ResultSet *
+execute_prepared(KadeDB_Storage *storage, const kadeql::PreparedStatement &ps,
+                 const std::vector<std::unique_ptr<Value>> &params) {
+  kadeql::QueryExecutor exec(storage->impl);
+  auto res = ps.execute(exec, params);
+  if (!res.hasValue())
+    return nullptr;
+  auto *out = new KadeDB_ResultSet{};
+  out->impl = std::make_unique<ResultSet>(std::move(res.value()));
+  out->cursor = static_cast<size_t>(-1);
+  return out;
 }
 
 extern "C" KadeDB_ResultSet *KadeDB_ExecuteQuery(KadeDB_Storage *storage,
                                                  const char *query) {
   if (!storage || !query)
     return nullptr;
-  std::string table = parse_select_star_from(query);
-  if (table.empty())
+  try {
+    auto ps = storage->statements.prepare(query);
+    if (!ps.hasValue() ||
+        ps.value()->statement().type() != kadeql::StatementType::SELECT)
+      return nullptr;
+    return execute_prepared(storage, *ps.value(), {});
+  } catch (...) {
     return nullptr;
-  auto res = ([&]() {
-    std::lock_guard<std::mutex> lock(storage->mtx);
-    return storage->impl.select(table, /*columns*/ {}, /*where*/ std::nullopt);
-  })();
-  if (!res.hasValue())
+  }
+}
+
+extern "C" KadeDB_ResultSet *KadeDB_ExecuteQueryPage(
+    KadeDB_Storage *storage, const char *query, unsigned long long page_size,
+    const char *page_token, char *next_token,
+    unsigned long long next_token_len,
+    unsigned long long *next_token_required) {
+  if (!storage || !query)
     return nullptr;
   try {
+    auto ps = storage->statements.prepare(query);
+    if (!ps.hasValue())
+      return nullptr;
+    kadeql::QueryExecutor exec(storage->impl);
+    auto page = ps.value()->executePage(exec, {},
+                                        static_cast<size_t>(page_size),
+                                        page_token ? page_token : "");
+    if (!page.hasValue())
+      return nullptr;
+    const std::string &token = page.value().nextToken;
+    const unsigned long long need =
+        static_cast<unsigned long long>(token.size()) + 1ULL;
+    if (next_token_required)
+      *next_token_required = need;
+    if (next_token && next_token_len > 0) {
+      const size_t ncopy =
+          static_cast<size_t>(std::min(need, next_token_len) - 1ULL);
+      std::memcpy(next_token, token.data(), ncopy);
+      next_token[ncopy] = '\0';
+    }
     auto *out = new KadeDB_ResultSet{};
-    out->impl = std::make_unique<ResultSet>(std::move(res.value()));
+    out->impl = std::make_unique<ResultSet>(std::move(page.value().rows));
+    return out;
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+extern "C" KadeDB_Statement *KadeDB_Prepare(KadeDB_Storage *storage,
+                                            const char *query) {
+  if (!storage || !query)
+    return nullptr;
+  try {
+    auto ps = storage->statements.prepare(query);
+    if (!ps.hasValue())
+      return nullptr;
+    return new KadeDB_Statement{ps.value()};
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+extern "C" int KadeDB_Statement_ParameterCount(const KadeDB_Statement *stmt) {
+  if (!stmt || !stmt->impl)
+    return -1;
+  return static_cast<int>(stmt->impl->parameterCount());
+}
+
+extern "C" KadeDB_ResultSet *KadeDB_ExecutePrepared(KadeDB_Storage *storage,
+                                                    KadeDB_Statement *stmt,
+                                                    const KDB_Value *params,
+                                                    int count) {
+  if (!storage || !stmt || !stmt->impl || count < 0 || (count > 0 && !params))
+    return nullptr;
+  try {
+    std::vector<std::unique_ptr<Value>> values;
+    values.reserve(static_cast<size_t>(count));
+    for (int i = 0; i < count; ++i)
+      values.push_back(params[i].type == KDB_VAL_NULL
+                           ? nullptr
+                           : from_c_value(params[i]));
+    return execute_prepared(storage, *stmt->impl, values);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+extern "C" void KadeDB_DestroyStatement(KadeDB_Statement *stmt) {
+  delete stmt;
+}
+
+// A SELECT running on its own thread, handing batches to the consumer
+// through a bounded queue
+struct KadeDB_Query {
+  static constexpr size_t kDefaultBatchRows = 1024;
+  static constexpr size_t kReadAhead = 2; // batches buffered ahead
+
+  size_t batch_rows = kDefaultBatchRows;
+  std::thread producer;
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::deque<std::unique_ptr<ResultSet>> ready;
+  std::unique_ptr<ResultSet> pending; // batch being filled by the producer
+  bool emitted = false;               // a batch has been queued
+  bool finished = false;
+  bool cancelled = false;
+  std::string error;
+
+  // Queue `pending`, waiting while the consumer is kReadAhead batches
+  // behind; false once the query is closed
+  bool emit(std::unique_lock<std::mutex> &lock) {
+    cv.wait(lock, [&] { return cancelled || ready.size() < kReadAhead; });
+    if (cancelled)
+      return false;
+    ready.push_back(std::move(pending));
+    emitted = true;
+    cv.notify_all();
+    return true;
+  }
+
+  // Producer: run the statement, regrouping the plan's batches into
+  // batch_rows-row result sets
+  void run(KadeDB_Storage *storage,
+           std::shared_ptr<kadeql::PreparedStatement> ps) {
+    Status st;
+    try {
+      kadeql::QueryExecutor exec(storage->impl);
+      RelationalStorage::BatchSink sink = [&](RowBatch &batch) {
+        std::unique_lock<std::mutex> lock(mtx);
+        if (!pending)
+          pending = std::make_unique<ResultSet>(batch.columnNames,
+                                                batch.columnTypes);
+        for (auto &row : batch.rows) {
+          pending->addRow(ResultRow(std::move(row)));
+          if (pending->rowCount() < batch_rows)
+            continue;
+          auto next = std::make_unique<ResultSet>(pending->columnNames(),
+                                                  pending->columnTypes());
+          if (!emit(lock))
+            return false;
+          pending = std::move(next);
+        }
+        return !cancelled;
+      };
+      st = exec.execute(ps->statement(), sink);
+    } catch (const std::exception &e) {
+      st = Status::Internal(e.what());
+    } catch (...) {
+      st = Status::Internal("query failed");
+    }
+    std::unique_lock<std::mutex> lock(mtx);
+    if (!st.ok())
+      error = st.message();
+    else if (pending && (pending->rowCount() > 0 || !emitted))
+      emit(lock);
+    finished = true;
+    cv.notify_all();
+  }
+};
+
+extern "C" KadeDB_Query *KadeDB_Query_Open(KadeDB_Storage *storage,
+                                           const char *query,
+                                           unsigned long long batch_rows) {
+  if (!storage || !query)
+    return nullptr;
+  try {
+    auto ps = storage->statements.prepare(query);
+    if (!ps.hasValue() || ps.value()->parameterCount() != 0 ||
+        ps.value()->statement().type() != kadeql::StatementType::SELECT)
+      return nullptr;
+    auto q = std::make_unique<KadeDB_Query>();
+    if (batch_rows)
+      q->batch_rows = static_cast<size_t>(batch_rows);
+    KadeDB_Query *raw = q.get();
+    q->producer = std::thread(
+        [raw, storage, stmt = ps.takeValue()] { raw->run(storage, stmt); });
+    // Report failures to plan or start the scan here rather than at the
+    // first fetch
+    bool failed;
+    {
+      std::unique_lock<std::mutex> lock(q->mtx);
+      q->cv.wait(lock, [&] { return !q->ready.empty() || q->finished; });
+      failed = q->ready.empty() && !q->error.empty();
+    }
+    if (failed) {
+      q->producer.join();
+      return nullptr;
+    }
+    return q.release();
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+extern "C" KadeDB_ResultSet *KadeDB_Query_FetchBatch(KadeDB_Query *query) {
+  if (!query)
+    return nullptr;
+  try {
+    std::unique_lock<std::mutex> lock(query->mtx);
+    query->cv.wait(lock,
+                   [&] { return !query->ready.empty() || query->finished; });
+    if (query->ready.empty())
+      return nullptr;
+    auto *out = new KadeDB_ResultSet{};
+    out->impl = std::move(query->ready.front());
     out->cursor = static_cast<size_t>(-1);
+    query->ready.pop_front();
+    query->cv.notify_all();
     return out;
   } catch (...) {
     return nullptr;
   }
 }
 
+extern "C" const char *KadeDB_Query_GetLastError(KadeDB_Query *query) {
+  if (!query)
+    return nullptr;
+  std::lock_guard<std::mutex> lock(query->mtx);
+  return query->error.empty() ? nullptr : query->error.c_str();
+}
+
+extern "C" void KadeDB_Query_Close(KadeDB_Query *query) {
+  if (!query)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(query->mtx);
+    query->cancelled = true;
+  }
+  query->cv.notify_all();
+  if (query->producer.joinable())
+    query->producer.join();
+  delete query;
+}
+
+extern "C" KadeDB_CancelToken *KadeDB_CancelToken_Create(void) {
+  try {
+    return new KadeDB_CancelToken{};
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+extern "C" void KadeDB_CancelToken_Cancel(KadeDB_CancelToken *token) {
+  if (token)
+    token->impl.cancel();
+}
+
+extern "C" int
+KadeDB_CancelToken_IsCancelled(const KadeDB_CancelToken *token) {
+  return token && token->impl.cancelled() ? 1 : 0;
+}
+
+extern "C" void KadeDB_CancelToken_Destroy(KadeDB_CancelToken *token) {
+  delete token;
+}
+
+// Queue `ps` on the shared pool; the callback gets the result set or the
+// error, and the storage counts the query until the callback returns
+static int execute_async(KadeDB_Storage *storage,
+                         std::shared_ptr<kadeql::PreparedStatement> ps,
+                         std::vector<std::unique_ptr<Value>> params,
+                         KadeDB_CancelToken *token,
+                         KadeDB_QueryCallback callback, void *user_data) {
+  {
+    std::lock_guard<std::mutex> lock(storage->async_mtx);
+    ++storage->async_in_flight;
+  }
+  auto done = [storage, callback, user_data](Result<ResultSet> res) {
+    try {
+      if (res.hasValue()) {
+        auto *out = new KadeDB_ResultSet{};
+        out->impl = std::make_unique<ResultSet>(res.takeValue());
+        out->cursor = static_cast<size_t>(-1);
+        callback(user_data, out, nullptr);
+      } else {
+        const std::string &msg = res.status().message();
+        callback(user_data, nullptr,
+                 msg.empty() ? "query failed" : msg.c_str());
+      }
+    } catch (...) {
+      callback(user_data, nullptr, "query failed");
+    }
+    // Notify under the lock: the storage may be freed once it is released
+    std::lock_guard<std::mutex> lock(storage->async_mtx);
+    --storage->async_in_flight;
+    storage->async_cv.notify_all();
+  };
+  try {
+    kadeql::AsyncQueryExecutor(storage->impl)
+        .executeAsync(std::move(ps), std::move(params), std::move(done),
+                      token ? token->impl : CancellationToken());
+    return 1;
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(storage->async_mtx);
+    --storage->async_in_flight;
+    storage->async_cv.notify_all();
+    return 0;
+  }
+}
+
+extern "C" int KadeDB_ExecuteQueryAsync(KadeDB_Storage *storage,
+                                        const char *query,
+                                        KadeDB_CancelToken *token,
+                                        KadeDB_QueryCallback callback,
+                                        void *user_data) {
+  if (!storage || !query || !callback)
+    return 0;
+  try {
+    auto ps = storage->statements.prepare(query);
+    if (!ps.hasValue() ||
+        ps.value()->statement().type() != kadeql::StatementType::SELECT)
+      return 0;
+    return execute_async(storage, ps.takeValue(), {}, token, callback,
+                         user_data);
+  } catch (...) {
+    return 0;
+  }
+}
+
+extern "C" int KadeDB_ExecutePreparedAsync(
+    KadeDB_Storage *storage, KadeDB_Statement *stmt, const KDB_Value *params,
+    int count, KadeDB_CancelToken *token, KadeDB_QueryCallback callback,
+    void *user_data) {
+  if (!storage || !stmt || !stmt->impl || !callback || count < 0 ||
+      (count > 0 && !params) ||
+      static_cast<size_t>(count) != stmt->impl->parameterCount())
+    return 0;
+  try {
+    std::vector<std::unique_ptr<Value>> values;
+    values.reserve(static_cast<size_t>(count));
+    for (int i = 0; i < count; ++i)
+      values.push_back(params[i].type == KDB_VAL_NULL
+                           ? nullptr
+                           : from_c_value(params[i]));
+    return execute_async(storage, stmt->impl, std::move(values), token,
+                         callback, user_data);
+  } catch (...) {
+    return 0;
+  }
+}
+
 extern "C" int KadeDB_ResultSet_NextRow(KadeDB_ResultSet *rs) {
   if (!rs || !rs->impl)
     return 0;
@@ -1024,6 +1388,206 @@ extern "C" int KadeDB_ResultSet_GetBool(KadeDB_ResultSet *rs, int column,
   return 0;
 }
 
+using RowIterator = std::vector<ResultRow>::const_iterator;
+
+// Validate a columnar read and resolve rows [first_row, first_row + max)
+// of `column`, clipped to the result, as iterators; false (with last_error
+// set) for a bad column
+static bool fetch_range(KadeDB_ResultSet *rs, int column,
+                        unsigned long long first_row, unsigned long long max,
+                        size_t &col, RowIterator &begin,
+                        RowIterator &end) {
+  if (column < 0 ||
+      static_cast<size_t>(column) >= rs->impl->columnCount()) {
+    rs->last_error = "column index out of range";
+    return false;
+  }
+  col = static_cast<size_t>(column);
+  const size_t rows = rs->impl->rowCount();
+  const size_t first = first_row < rows ? static_cast<size_t>(first_row)
+                                        : rows;
+  const size_t n = std::min<unsigned long long>(max, rows - first);
+  begin = rs->impl->begin() + static_cast<std::ptrdiff_t>(first);
+  end = begin + static_cast<std::ptrdiff_t>(n);
+  return true;
+}
+
+static bool is_null_cell(const Value *v) {
+  return !v || v->type() == ValueType::Null;
+}
+
+// Copy one fixed-width column into `out` through `get`
+template <typename T, typename Get>
+static long long fetch_column(KadeDB_ResultSet *rs, int column,
+                              unsigned long long first_row, T *out,
+                              uint8_t *nulls, unsigned long long max,
+                              Get get) {
+  if (!rs || !rs->impl)
+    return -1;
+  rs->last_error.clear();
+  size_t col = 0;
+  RowIterator begin, end;
+  if (!fetch_range(rs, column, first_row, max, col, begin, end))
+    return -1;
+  if (begin != end && !out) {
+    rs->last_error = "output buffer is NULL";
+    return -1;
+  }
+  try {
+    size_t i = 0;
+    for (auto it = begin; it != end; ++it, ++i) {
+      const Value *v = it->values()[col].get();
+      const bool null = is_null_cell(v);
+      if (null && !nulls) {
+        rs->last_error = "null cell without a null buffer";
+        return -1;
+      }
+      if (nulls)
+        nulls[i] = null ? 1 : 0;
+      out[i] = null ? T{} : get(*v);
+    }
+    return static_cast<long long>(i);
+  } catch (const std::exception &e) {
+    rs->last_error = e.what();
+  } catch (...) {
+    rs->last_error = "unknown error";
+  }
+  return -1;
+}
+
+extern "C" long long
+KadeDB_ResultSet_FetchColumnInt64(KadeDB_ResultSet *rs, int column,
+                                  unsigned long long first_row, int64_t *out,
+                                  uint8_t *nulls, unsigned long long max) {
+  return fetch_column(rs, column, first_row, out, nulls, max,
+                      [](const Value &v) { return v.asInt(); });
+}
+
+extern "C" long long
+KadeDB_ResultSet_FetchColumnDouble(KadeDB_ResultSet *rs, int column,
+                                   unsigned long long first_row, double *out,
+                                   uint8_t *nulls, unsigned long long max) {
+  return fetch_column(rs, column, first_row, out, nulls, max,
+                      [](const Value &v) { return v.asFloat(); });
+}
+
+extern "C" long long
+KadeDB_ResultSet_FetchColumnBool(KadeDB_ResultSet *rs, int column,
+                                 unsigned long long first_row, uint8_t *out,
+                                 uint8_t *nulls, unsigned long long max) {
+  return fetch_column(rs, column, first_row, out, nulls, max,
+                      [](const Value &v) -> uint8_t {
+                        return v.asBool() ? 1 : 0;
+                      });
+}
+
+extern "C" long long KadeDB_ResultSet_FetchColumnString(
+    KadeDB_ResultSet *rs, int column, unsigned long long first_row,
+    uint64_t *offsets, char *buf, unsigned long long buf_size, uint8_t *nulls,
+    unsigned long long max, unsigned long long *out_needed) {
+  if (!rs || !rs->impl)
+    return -1;
+  rs->last_error.clear();
+  size_t col = 0;
+  RowIterator begin, end;
+  if (!fetch_range(rs, column, first_row, max, col, begin, end))
+    return -1;
+  if (!offsets || (buf_size > 0 && !buf)) {
+    rs->last_error = "output buffer is NULL";
+    return -1;
+  }
+  try {
+    offsets[0] = 0;
+    unsigned long long needed = 0;
+    size_t copied = 0;
+    bool full = false;
+    std::string text;
+    for (auto it = begin; it != end; ++it) {
+      const Value *v = it->values()[col].get();
+      const bool null = is_null_cell(v);
+      const char *data = nullptr;
+      size_t size = 0;
+      if (!null) {
+        const std::string &str =
+            v->type() == ValueType::String ? v->asString()
+                                           : (text = v->toString());
+        data = str.data();
+        size = str.size();
+      }
+      needed += size;
+      if (full || needed > buf_size) {
+        full = true;
+        if (!out_needed)
+          break;
+        continue;
+      }
+      if (size)
+        std::memcpy(buf + offsets[copied], data, size);
+      if (nulls)
+        nulls[copied] = null ? 1 : 0;
+      offsets[copied + 1] = offsets[copied] + size;
+      ++copied;
+    }
+    if (out_needed)
+      *out_needed = needed;
+    return static_cast<long long>(copied);
+  } catch (const std::exception &e) {
+    rs->last_error = e.what();
+  } catch (...) {
+    rs->last_error = "unknown error";
+  }
+  return -1;
+}
+
+extern "C" int KadeDB_ResultSet_ExportArrow(KadeDB_ResultSet *rs,
+                                            struct ArrowSchema *out_schema,
+                                            struct ArrowArray *out_array) {
+  if (!rs || !rs->impl)
+    return 0;
+  rs->last_error.clear();
+  tracing::Span span("ffi.serialize");
+  if (span.recording())
+    span.setAttribute("kadedb.format", "arrow");
+  try {
+    Status st = exportArrow(*rs->impl, out_schema, out_array);
+    if (!st.ok()) {
+      span.fail();
+      rs->last_error = st.message();
+      return 0;
+    }
+    return 1;
+  } catch (const std::exception &e) {
+    rs->last_error = e.what();
+  } catch (...) {
+    rs->last_error = "unknown error";
+  }
+  return 0;
+}
+
+extern "C" int KadeDB_ImportArrow(KadeDB_Storage *storage, const char *table,
+                                  struct ArrowSchema *schema,
+                                  struct ArrowArray *array,
+                                  unsigned long long *out_rows) {
+  if (!storage || !table) {
+    // Consumed even when rejected
+    if (array && array->release)
+      array->release(array);
+    if (schema && schema->release)
+      schema->release(schema);
+    return 0;
+  }
+  try {
+    auto res = importArrow(schema, array, storage->impl, std::string{table});
+    if (!res.hasValue())
+      return 0;
+    if (out_rows)
+      *out_rows = static_cast<unsigned long long>(res.value());
+    return 1;
+  } catch (...) {
+    return 0;
+  }
+}
+
 extern "C" const char *KadeDB_ResultSet_GetLastError(KadeDB_ResultSet *rs) {
   if (!rs)
     return nullptr;
@@ -1056,10 +1620,7 @@ extern "C" int KadeDB_UpdateRows(KadeDB_Storage *storage, const char *table,
     asg.emplace(std::string{a.column}, std::move(av));
   }
   auto where = to_cpp_predicate(where_predicate);
-  auto res = ([&]() {
-    std::lock_guard<std::mutex> lock(storage->mtx);
-    return storage->impl.updateRows(std::string{table}, asg, where);
-  })();
+  auto res = storage->impl.updateRows(std::string{table}, asg, where);
   if (!res.hasValue())
     return 0;
   if (out_updated)
@@ -1073,10 +1634,7 @@ extern "C" int KadeDB_DeleteRows(KadeDB_Storage *storage, const char *table,
   if (!storage || !table)
     return 0;
   auto where = to_cpp_predicate(where_predicate);
-  auto res = ([&]() {
-    std::lock_guard<std::mutex> lock(storage->mtx);
-    return storage->impl.deleteRows(std::string{table}, where);
-  })();
+  auto res = storage->impl.deleteRows(std::string{table}, where);
   if (!res.hasValue())
     return 0;
   if (out_deleted)
@@ -1087,7 +1645,6 @@ extern "C" int KadeDB_DeleteRows(KadeDB_Storage *storage, const char *table,
 extern "C" int KadeDB_DropTable(KadeDB_Storage *storage, const char *table) {
   if (!storage || !table)
     return 0;
-  std::lock_guard<std::mutex> lock(storage->mtx);
   Status st = storage->impl.dropTable(std::string{table});
   return st.ok() ? 1 : 0;
 }
@@ -1096,22 +1653,39 @@ extern "C" int KadeDB_TruncateTable(KadeDB_Storage *storage,
                                     const char *table) {
   if (!storage || !table)
     return 0;
-  std::lock_guard<std::mutex> lock(storage->mtx);
   Status st = storage->impl.truncateTable(std::string{table});
   return st.ok() ? 1 : 0;
 }
 
+extern "C" int KadeDB_TableMemoryUsage(KadeDB_Storage *storage,
+                                       const char *table,
+                                       unsigned long long *out_bytes) {
+  if (!storage || !table || !out_bytes)
+    return 0;
+  auto res = storage->impl.memoryUsage(std::string{table});
+  if (!res.hasValue())
+    return 0;
+  *out_bytes = static_cast<unsigned long long>(res.value());
+  return 1;
+}
+
+extern "C" int KadeDB_SetTableMemoryBudget(KadeDB_Storage *storage,
+                                           const char *table,
+                                           unsigned long long bytes) {
+  if (!storage || !table)
+    return 0;
+  Status st = storage->impl.setMemoryBudget(std::string{table},
+                                            static_cast<size_t>(bytes));
+  return st.ok() ? 1 : 0;
+}
+
 extern "C" int KadeDB_ListTables_ToCSV(KadeDB_Storage *storage, char delimiter,
                                        char *out_buf,
                                        unsigned long long out_buf_len,
                                        unsigned long long *out_required_len) {
   if (!storage)
     return 0;
-  std::vector<std::string> names;
-  {
-    std::lock_guard<std::mutex> lock(storage->mtx);
-    names = storage->impl.listTables();
-  }
+  const std::vector<std::string> names = storage->impl.listTables();
   // Build delimited string
   size_t total = 0;
   for (size_t i = 0; i < names.size(); ++i) {
@@ -1144,3 +1718,535 @@ extern "C" int KadeDB_ListTables_ToCSV(KadeDB_Storage *storage, char delimiter,
   out_buf[written] = '\0';
   return 1;
 }
+
+// ---------- Engine metrics ----------
+
+extern "C" int KadeDB_Metrics_Get(const char *storage, const char *operation,
+                                  KadeDB_OperationMetrics *out) {
+  if (!storage || !operation || !out)
+    return 0;
+  for (const auto &m : metrics::snapshot()) {
+    if (std::strcmp(metrics::storageName(m.op), storage) != 0 ||
+        std::strcmp(metrics::operationName(m.op), operation) != 0)
+      continue;
+    out->calls = m.calls;
+    out->errors = m.errors;
+    out->rows_scanned = m.rowsScanned;
+    out->rows_returned = m.rowsReturned;
+    out->lock_wait_ns = m.lockWaitNs;
+    out->bytes_allocated = m.bytesAllocated;
+    out->latency_sum_ns = m.latency.sumNs();
+    out->latency_p50_ns = m.latency.percentileNs(50);
+    out->latency_p99_ns = m.latency.percentileNs(99);
+    out->latency_max_ns = m.latency.maxNs();
+    return 1;
+  }
+  return 0;
+}
+
+extern "C" int
+KadeDB_Metrics_ToPrometheus(char *out_buf, unsigned long long out_buf_len,
+                            unsigned long long *out_required_len) {
+  std::string text;
+  try {
+    text = metrics::toPrometheus();
+  } catch (...) {
+    return 0;
+  }
+  const unsigned long long need =
+      static_cast<unsigned long long>(text.size()) + 1ULL;
+  if (out_required_len)
+    *out_required_len = need;
+  if (!out_buf || out_buf_len == 0)
+    return 1;
+  const size_t ncopy = static_cast<size_t>(std::min(need, out_buf_len) - 1ULL);
+  std::memcpy(out_buf, text.data(), ncopy);
+  out_buf[ncopy] = '\0';
+  return 1;
+}
+
+extern "C" void KadeDB_Metrics_Reset() { metrics::reset(); }
+
+extern "C" void KadeDB_Metrics_SetEnabled(int enabled) {
+  metrics::setEnabled(enabled != 0);
+}
+
+extern "C" void KadeDB_SlowQueryLog_SetThreshold(long long micros) {
+  if (micros < 0)
+    SlowQueryLog::shared().disable();
+  else
+    SlowQueryLog::shared().setThreshold(std::chrono::microseconds(micros));
+}
+
+extern "C" void KadeDB_SlowQueryLog_SetCapacity(unsigned long long capacity) {
+  SlowQueryLog::shared().setCapacity(static_cast<size_t>(capacity));
+}
+
+extern "C" void KadeDB_SlowQueryLog_Clear() { SlowQueryLog::shared().clear(); }
+
+// ---------- Tracing ----------
+
+struct KadeDB_Span {
+  explicit KadeDB_Span(const char *name) : span(name) {}
+  tracing::Span span;
+};
+
+extern "C" void KadeDB_Trace_SetExporter(KadeDB_SpanCallback callback,
+                                         void *user_data) {
+  if (!callback) {
+    tracing::setExporter(nullptr);
+    return;
+  }
+  tracing::setExporter([callback, user_data](const tracing::SpanRecord &r) {
+    std::vector<const char *> keys, values;
+    keys.reserve(r.attributes.size());
+    values.reserve(r.attributes.size());
+    for (const auto &kv : r.attributes) {
+      keys.push_back(kv.first.c_str());
+      values.push_back(kv.second.c_str());
+    }
+    KadeDB_SpanData d{};
+    d.trace_id_high = r.context.traceIdHigh;
+    d.trace_id_low = r.context.traceIdLow;
+    d.span_id = r.context.spanId;
+    d.parent_span_id = r.parentSpanId;
+    d.name = r.name.c_str();
+    d.start_unix_ns = r.startUnixNs;
+    d.duration_ns = r.durationNs;
+    d.error = r.error ? 1 : 0;
+    d.attribute_count = static_cast<int>(keys.size());
+    d.attribute_keys = keys.data();
+    d.attribute_values = values.data();
+    callback(user_data, &d);
+  });
+}
+
+extern "C" void KadeDB_Trace_SetSampleRatio(double ratio) {
+  tracing::setSampleRatio(ratio);
+}
+
+extern "C" int KadeDB_Trace_SetParent(const char *traceparent) {
+  if (!traceparent || !*traceparent) {
+    tracing::setCurrent({});
+    return 1;
+  }
+  auto ctx = tracing::parseTraceparent(traceparent);
+  tracing::setCurrent(ctx ? *ctx : tracing::SpanContext{});
+  return ctx ? 1 : 0;
+}
+
+extern "C" KadeDB_Span *KadeDB_Trace_StartSpan(const char *name) {
+  if (!name || !tracing::active())
+    return nullptr;
+  try {
+    return new KadeDB_Span(name);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+extern "C" void KadeDB_Trace_EndSpan(KadeDB_Span *span) { delete span; }
+
+// ---------- Replication ----------
+
+struct KadeDB_WalShipper {
+  std::unique_ptr<WalShipper> impl;
+  std::string segment; // data of the last segment cut
+  std::string error;
+};
+
+struct KadeDB_Replica {
+  KadeDB_Storage *storage;
+  InMemoryDocumentStorage doc;
+  InMemoryTimeSeriesStorage ts;
+  InMemoryGraphStorage graph;
+  std::unique_ptr<Replica> impl;
+  std::mutex mtx; // guards error
+  std::string error;
+
+  void fail(const std::string &msg) {
+    std::lock_guard<std::mutex> lock(mtx);
+    error = msg;
+  }
+};
+
+extern "C" KadeDB_WalShipper *
+KadeDB_WalShipper_Open(const char *wal_path, unsigned long long after_lsn,
+                       unsigned long long max_segment_bytes, int compress) {
+  if (!wal_path)
+    return nullptr;
+  try {
+    ShipOptions options;
+    if (max_segment_bytes)
+      options.maxSegmentBytes = static_cast<size_t>(max_segment_bytes);
+    options.compression = compress ? Codec::Lz4 : Codec::None;
+    auto shipper = WalShipper::open(wal_path, after_lsn, options);
+    if (!shipper.hasValue())
+      return nullptr;
+    auto *out = new KadeDB_WalShipper;
+    out->impl = shipper.takeValue();
+    return out;
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+extern "C" int KadeDB_WalShipper_Next(KadeDB_WalShipper *shipper,
+                                      const unsigned char **out_data,
+                                      unsigned long long *out_len,
+                                      unsigned long long *out_first_lsn,
+                                      unsigned long long *out_last_lsn,
+                                      int *out_tail) {
+  if (!shipper || !out_data || !out_len || !out_first_lsn || !out_last_lsn ||
+      !out_tail)
+    return 0;
+  try {
+    auto seg = shipper->impl->next();
+    if (!seg.hasValue()) {
+      shipper->error = seg.status().message();
+      return 0;
+    }
+    WalSegment s = seg.takeValue();
+    shipper->segment = std::move(s.data);
+    shipper->error.clear();
+    *out_data =
+        reinterpret_cast<const unsigned char *>(shipper->segment.data());
+    *out_len = shipper->segment.size();
+    *out_first_lsn = s.firstLsn;
+    *out_last_lsn = s.lastLsn;
+    *out_tail = s.tail ? 1 : 0;
+    return 1;
+  } catch (const std::exception &e) {
+    shipper->error = e.what();
+    return 0;
+  }
+}
+
+extern "C" const char *
+KadeDB_WalShipper_GetLastError(KadeDB_WalShipper *shipper) {
+  if (!shipper || shipper->error.empty())
+    return nullptr;
+  return shipper->error.c_str();
+}
+
+extern "C" void KadeDB_WalShipper_Close(KadeDB_WalShipper *shipper) {
+  delete shipper;
+}
+
+extern "C" KadeDB_Replica *
+KadeDB_Replica_Create(KadeDB_Storage *storage, unsigned long long applied_lsn) {
+  if (!storage)
+    return nullptr;
+  try {
+    auto *out = new KadeDB_Replica;
+    out->storage = storage;
+    out->impl = std::make_unique<Replica>(
+        WalTargets{&storage->impl, &out->doc, &out->ts, &out->graph},
+        applied_lsn);
+    return out;
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+extern "C" int KadeDB_Replica_Apply(KadeDB_Replica *replica,
+                                    const unsigned char *data,
+                                    unsigned long long len,
+                                    unsigned long long first_lsn,
+                                    unsigned long long last_lsn, int tail) {
+  if (!replica || (!data && len))
+    return 0;
+  try {
+    WalSegment seg;
+    seg.firstLsn = first_lsn;
+    seg.lastLsn = last_lsn;
+    seg.tail = tail != 0;
+    if (len)
+      seg.data.assign(reinterpret_cast<const char *>(data),
+                      static_cast<size_t>(len));
+    Status st = replica->impl->apply(seg);
+    replica->fail(st.ok() ? std::string() : st.message());
+    return st.ok() ? 1 : 0;
+  } catch (const std::exception &e) {
+    replica->fail(e.what());
+    return 0;
+  }
+}
+
+extern "C" unsigned long long
+KadeDB_Replica_AppliedLsn(KadeDB_Replica *replica) {
+  return replica ? replica->impl->appliedLsn() : 0;
+}
+
+extern "C" long long KadeDB_Replica_StalenessMillis(KadeDB_Replica *replica) {
+  if (!replica)
+    return -1;
+  auto lag = replica->impl->staleness();
+  return lag ? static_cast<long long>(lag->count()) : -1;
+}
+
+extern "C" KadeDB_ResultSet *
+KadeDB_Replica_ExecuteQuery(KadeDB_Replica *replica, const char *query,
+                            unsigned long long max_staleness_ms) {
+  if (!replica || !query)
+    return nullptr;
+  Status st = replica->impl->checkStaleness(
+      std::chrono::milliseconds(static_cast<long long>(max_staleness_ms)));
+  if (!st.ok()) {
+    replica->fail(st.message());
+    return nullptr;
+  }
+  KadeDB_ResultSet *rs = KadeDB_ExecuteQuery(replica->storage, query);
+  replica->fail(rs ? std::string() : "Query failed: " + std::string(query));
+  return rs;
+}
+
+extern "C" const char *KadeDB_Replica_GetLastError(KadeDB_Replica *replica) {
+  if (!replica)
+    return nullptr;
+  std::lock_guard<std::mutex> lock(replica->mtx);
+  return replica->error.empty() ? nullptr : replica->error.c_str();
+}
+
+extern "C" void KadeDB_Replica_Destroy(KadeDB_Replica *replica) {
+  delete replica;
+}
+
+// ---------- Distributed queries ----------
+
+struct KadeDB_DistributedQuery {
+  std::shared_ptr<kadeql::DistributedQuery> impl;
+  std::mutex mtx; // guards error
+  std::string error;
+
+  void fail(const std::string &msg) {
+    std::lock_guard<std::mutex> lock(mtx);
+    error = msg;
+  }
+};
+
+// Wrap a merged result, or record its error
+static KadeDB_ResultSet *merged(KadeDB_DistributedQuery *query,
+                                Result<ResultSet> res) {
+  if (!res.hasValue()) {
+    query->fail(res.status().message());
+    return nullptr;
+  }
+  query->fail(std::string());
+  auto *out = new KadeDB_ResultSet{};
+  out->impl = std::make_unique<ResultSet>(res.takeValue());
+  return out;
+}
+
+extern "C" KadeDB_DistributedQuery *
+KadeDB_DistributedQuery_Plan(const char *query) {
+  if (!query)
+    return nullptr;
+  try {
+    auto plan = kadeql::DistributedQuery::plan(query);
+    if (!plan.hasValue())
+      return nullptr;
+    auto *out = new KadeDB_DistributedQuery;
+    out->impl = plan.takeValue();
+    return out;
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+extern "C" const char *
+KadeDB_DistributedQuery_Fragment(const KadeDB_DistributedQuery *query) {
+  return query ? query->impl->fragment().c_str() : nullptr;
+}
+
+extern "C" KadeDB_ResultSet *KadeDB_DistributedQuery_Merge(
+    KadeDB_DistributedQuery *query, const unsigned char *const *results,
+    const unsigned long long *lens, unsigned long long count) {
+  if (!query || (count > 0 && (!results || !lens)))
+    return nullptr;
+  try {
+    std::vector<std::string> parts;
+    parts.reserve(static_cast<size_t>(count));
+    for (unsigned long long i = 0; i < count; ++i) {
+      if (!results[i] && lens[i])
+        return nullptr;
+      parts.emplace_back(reinterpret_cast<const char *>(results[i]),
+                         static_cast<size_t>(lens[i]));
+    }
+    return merged(query, query->impl->merge(parts));
+  } catch (const std::exception &e) {
+    query->fail(e.what());
+    return nullptr;
+  }
+}
+
+extern "C" KadeDB_ResultSet *
+KadeDB_DistributedQuery_Execute(KadeDB_DistributedQuery *query,
+                                KadeDB_Storage *const *nodes,
+                                unsigned long long count) {
+  if (!query || (count > 0 && !nodes))
+    return nullptr;
+  try {
+    std::vector<kadeql::FragmentRunner> runners;
+    for (unsigned long long i = 0; i < count; ++i) {
+      KadeDB_Storage *node = nodes[i];
+      if (!node)
+        return nullptr;
+      runners.push_back([node](const std::string &fragment) {
+        kadeql::QueryExecutor exec(node->impl);
+        return kadeql::executeFragment(exec, fragment);
+      });
+    }
+    return merged(query, query->impl->execute(runners));
+  } catch (const std::exception &e) {
+    query->fail(e.what());
+    return nullptr;
+  }
+}
+
+extern "C" const char *
+KadeDB_DistributedQuery_GetLastError(KadeDB_DistributedQuery *query) {
+  if (!query)
+    return nullptr;
+  std::lock_guard<std::mutex> lock(query->mtx);
+  return query->error.empty() ? nullptr : query->error.c_str();
+}
+
+extern "C" void
+KadeDB_DistributedQuery_Destroy(KadeDB_DistributedQuery *query) {
+  delete query;
+}
+
+extern "C" int KadeDB_ResultSet_EncodeFragment(KadeDB_ResultSet *rs,
+                                               int compress,
+                                               const unsigned char **out_data,
+                                               unsigned long long *out_len) {
+  if (!rs || !rs->impl || !out_data || !out_len)
+    return 0;
+  try {
+    rs->scratch = kadeql::encodeFragmentResult(
+        *rs->impl, compress ? Codec::Lz4 : Codec::None);
+    *out_data = reinterpret_cast<const unsigned char *>(rs->scratch.data());
+    *out_len = rs->scratch.size();
+    return 1;
+  } catch (const std::exception &e) {
+    rs->last_error = e.what();
+    return 0;
+  }
+}
+
+// ---- Change data capture ----
+
+struct KadeDB_Subscription {
+  std::unique_ptr<ChangeSubscription> impl;
+  std::vector<std::string> columns; // of the table
+  std::vector<ColumnType> types;
+  std::string error;
+};
+
+extern "C" int KadeDB_EnableChangeCapture(KadeDB_Storage *storage,
+                                          unsigned long long capacity) {
+  if (!storage)
+    return 0;
+  try {
+    storage->impl.enableChangeCapture(
+        capacity ? static_cast<size_t>(capacity)
+                 : ChangeFeed::kDefaultCapacity);
+    return 1;
+  } catch (...) {
+    return 0;
+  }
+}
+
+extern "C" KadeDB_Subscription *
+KadeDB_Subscribe(KadeDB_Storage *storage, const char *table,
+                 const KDB_Predicate *where_predicate) {
+  if (!storage || !table)
+    return nullptr;
+  try {
+    auto schema = storage->impl.getTableSchema(table);
+    if (!schema.hasValue())
+      return nullptr;
+    auto sub = storage->impl.subscribeChanges(
+        table, to_cpp_predicate(where_predicate));
+    if (!sub.hasValue())
+      return nullptr;
+    auto *out = new KadeDB_Subscription;
+    out->impl = std::move(sub.value());
+    for (const auto &c : schema.value().columns()) {
+      out->columns.push_back(c.name);
+      out->types.push_back(c.type);
+    }
+    return out;
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+extern "C" KadeDB_ResultSet *
+KadeDB_Subscription_Poll(KadeDB_Subscription *sub,
+                         unsigned long long max_changes,
+                         unsigned long long wait_ms) {
+  if (!sub)
+    return nullptr;
+  try {
+    auto events = sub->impl->poll(
+        static_cast<size_t>(max_changes),
+        std::chrono::milliseconds(static_cast<long long>(wait_ms)));
+    if (!events.hasValue()) {
+      sub->error = events.status().message();
+      return nullptr;
+    }
+    std::vector<std::string> names{"seq", "change"};
+    std::vector<ColumnType> types{ColumnType::Integer, ColumnType::String};
+    names.insert(names.end(), sub->columns.begin(), sub->columns.end());
+    types.insert(types.end(), sub->types.begin(), sub->types.end());
+    auto rs = std::make_unique<ResultSet>(std::move(names), std::move(types));
+    for (const auto &e : events.value()) {
+      std::vector<std::unique_ptr<Value>> cells;
+      cells.push_back(
+          ValueFactory::createInteger(static_cast<int64_t>(e->seq)));
+      cells.push_back(ValueFactory::createString(changeKindName(e->kind)));
+      const auto &image = e->after ? e->after : e->before;
+      if (image) {
+        for (auto &cell : image->toRow().release())
+          cells.push_back(std::move(cell));
+      } else {
+        cells.resize(cells.size() + sub->columns.size());
+      }
+      rs->addRow(ResultRow(std::move(cells)));
+    }
+    auto *out = new KadeDB_ResultSet{};
+    out->impl = std::move(rs);
+    return out;
+  } catch (const std::exception &e) {
+    sub->error = e.what();
+    return nullptr;
+  }
+}
+
+extern "C" unsigned long long
+KadeDB_Subscription_Position(KadeDB_Subscription *sub) {
+  return sub ? sub->impl->position() : 0;
+}
+
+extern "C" unsigned long long
+KadeDB_Subscription_Lag(KadeDB_Subscription *sub) {
+  return sub ? sub->impl->lag() : 0;
+}
+
+extern "C" const char *
+KadeDB_Subscription_GetLastError(KadeDB_Subscription *sub) {
+  if (!sub || sub->error.empty())
+    return nullptr;
+  return sub->error.c_str();
+}
+
+extern "C" void KadeDB_Subscription_Cancel(KadeDB_Subscription *sub) {
+  if (sub)
+    sub->impl->cancel();
+}
+
+extern "C" void KadeDB_Subscription_Close(KadeDB_Subscription *sub) {
+  delete sub;
+}
@@ -871,9 +871,12 @@ int kadedb_get_memory_info(KDB_MemoryInfo *info) {
 
   // Use the memory debug counters from the Value system
   info->total_allocated = memdebug::allocCountInteger() +
+                          memdebug::allocCountFloat() +
+                          memdebug::allocCountString() +
                           memdebug::allocCountBoolean() +
                           memdebug::allocCountNull();
   info->total_freed = memdebug::freeCountInteger() +
+                      memdebug::freeCountFloat() + memdebug::freeCountString() +
                       memdebug::freeCountBoolean() + memdebug::freeCountNull();
   info->current_usage = info->total_allocated - info->total_freed;
   info->peak_usage = info->current_usage; // Simplified - actual peak tracking
@@ -886,6 +889,10 @@ void kadedb_print_memory_stats() {
   printf("=== KadeDB Memory Statistics ===\n");
   printf("Integer allocations: %zu, frees: %zu\n",
          memdebug::allocCountInteger(), memdebug::freeCountInteger());
+  printf("Float allocations: %zu, frees: %zu\n", memdebug::allocCountFloat(),
+         memdebug::freeCountFloat());
+  printf("String allocations: %zu, frees: %zu\n",
+         memdebug::allocCountString(), memdebug::freeCountString());
   printf("Boolean allocations: %zu, frees: %zu\n",
          memdebug::allocCountBoolean(), memdebug::freeCountBoolean());
   printf("Null allocations: %zu, frees: %zu\n", memdebug::allocCountNull(),
@@ -893,10 +900,12 @@ void kadedb_print_memory_stats() {
 }
 
 int kadedb_check_resource_leaks() {
-  size_t total_alloc = memdebug::allocCountInteger() +
-                       memdebug::allocCountBoolean() +
-                       memdebug::allocCountNull();
+  size_t total_alloc =
+      memdebug::allocCountInteger() + memdebug::allocCountFloat() +
+      memdebug::allocCountString() + memdebug::allocCountBoolean() +
+      memdebug::allocCountNull();
   size_t total_free = memdebug::freeCountInteger() +
+                      memdebug::freeCountFloat() + memdebug::freeCountString() +
                       memdebug::freeCountBoolean() + memdebug::freeCountNull();
   return (total_alloc != total_free) ? 1 : 0;
 }
@@ -0,0 +1,124 @@
+#include "kadedb/kadedb.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+// What one callback saw; each query has its own, so callbacks running on
+// different workers never share one
+typedef struct {
+  int calls;
+  long long rows;
+  long long first;
+  char error[128];
+} Outcome;
+
+static void on_done(void *user_data, KadeDB_ResultSet *rs, const char *error) {
+  Outcome *out = (Outcome *)user_data;
+  ++out->calls;
+  if (error) {
+    assert(rs == NULL);
+    strncpy(out->error, error, sizeof(out->error) - 1);
+    return;
+  }
+  assert(rs != NULL);
+  while (KadeDB_ResultSet_NextRow(rs)) {
+    int ok = 0;
+    long long id = KadeDB_ResultSet_GetInt64(rs, 0, &ok);
+    assert(ok);
+    if (out->rows++ == 0)
+      out->first = id;
+  }
+  KadeDB_DestroyResultSet(rs);
+}
+
+static KadeDB_Storage *make_storage(void) {
+  KadeDB_Storage *st = KadeDB_CreateStorage();
+  assert(st != NULL);
+  KDB_TableSchema *schema = KadeDB_TableSchema_Create();
+  KDB_TableColumnEx idcol = {"id", KDB_COL_INTEGER, 0, 1, NULL};
+  assert(KadeDB_TableSchema_AddColumn(schema, &idcol) == 1);
+  assert(KadeDB_CreateTable(st, "events", schema) == 1);
+  KadeDB_TableSchema_Destroy(schema);
+  for (long long id = 0; id < 1000; ++id) {
+    KDB_Value v;
+    v.type = KDB_VAL_INTEGER;
+    v.as.i64 = id;
+    KDB_RowView row = {&v, 1};
+    assert(KadeDB_InsertRow(st, "events", &row) == 1);
+  }
+  return st;
+}
+
+int main() {
+  printf("=== C ABI Async Query Test ===\n");
+  assert(KadeDB_Initialize() == 1);
+  KadeDB_Storage *st = make_storage();
+
+  Outcome all[8];
+  memset(all, 0, sizeof(all));
+  for (int i = 0; i < 8; ++i)
+    assert(KadeDB_ExecuteQueryAsync(st, "SELECT id FROM events WHERE id >= 10",
+                                    NULL, on_done, &all[i]) == 1);
+
+  KadeDB_Statement *ps =
+      KadeDB_Prepare(st, "SELECT id FROM events WHERE id > ?");
+  assert(ps != NULL);
+  KDB_Value param;
+  param.type = KDB_VAL_INTEGER;
+  param.as.i64 = 990;
+  Outcome bound;
+  memset(&bound, 0, sizeof(bound));
+  assert(KadeDB_ExecutePreparedAsync(st, ps, &param, 1, NULL, on_done,
+                                     &bound) == 1);
+  // A value of the wrong type is reported to the callback
+  KDB_Value flag;
+  flag.type = KDB_VAL_BOOLEAN;
+  flag.as.boolean = 1;
+  Outcome badBind;
+  memset(&badBind, 0, sizeof(badBind));
+  assert(KadeDB_ExecutePreparedAsync(st, ps, &flag, 1, NULL, on_done,
+                                     &badBind) == 1);
+  // A parameter count mismatch is refused up front
+  assert(KadeDB_ExecutePreparedAsync(st, ps, NULL, 0, NULL, on_done,
+                                     &badBind) == 0);
+
+  // A token cancelled before the query starts ends it
+  KadeDB_CancelToken *token = KadeDB_CancelToken_Create();
+  assert(token != NULL && KadeDB_CancelToken_IsCancelled(token) == 0);
+  KadeDB_CancelToken_Cancel(token);
+  assert(KadeDB_CancelToken_IsCancelled(token) == 1);
+  Outcome cancelled;
+  memset(&cancelled, 0, sizeof(cancelled));
+  assert(KadeDB_ExecuteQueryAsync(st, "SELECT id FROM events", token, on_done,
+                                  &cancelled) == 1);
+  // The query holds its own reference to the token's state
+  KadeDB_CancelToken_Destroy(token);
+
+  // Refused without a callback: bad arguments, syntax errors, non-SELECTs
+  Outcome refused;
+  memset(&refused, 0, sizeof(refused));
+  assert(KadeDB_ExecuteQueryAsync(NULL, "SELECT id FROM events", NULL,
+                                  on_done, &refused) == 0);
+  assert(KadeDB_ExecuteQueryAsync(st, "SELECT id FROM events", NULL, NULL,
+                                  NULL) == 0);
+  assert(KadeDB_ExecuteQueryAsync(st, "SELEC id", NULL, on_done, &refused) ==
+         0);
+  assert(KadeDB_ExecuteQueryAsync(st, "DELETE FROM events", NULL, on_done,
+                                  &refused) == 0);
+  KadeDB_DestroyStatement(ps);
+
+  // Destroying the storage waits for every callback to return
+  KadeDB_DestroyStorage(st);
+  for (int i = 0; i < 8; ++i)
+    assert(all[i].calls == 1 && all[i].rows == 990 && all[i].first == 10 &&
+           all[i].error[0] == '\0');
+  assert(bound.calls == 1 && bound.rows == 9 && bound.first == 991);
+  assert(badBind.calls == 1 && badBind.rows == 0 && badBind.error[0] != '\0');
+  assert(cancelled.calls == 1 && cancelled.rows == 0 &&
+         strcmp(cancelled.error, "Query cancelled") == 0);
+  assert(refused.calls == 0);
+
+  KadeDB_Shutdown();
+  printf("All async query tests passed!\n");
+  return 0;
+}
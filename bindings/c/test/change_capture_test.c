@@ -0,0 +1,110 @@
+#include "kadedb/kadedb.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+static KDB_Value make_int(long long v) {
+  KDB_Value x;
+  x.type = KDB_VAL_INTEGER;
+  x.as.i64 = v;
+  return x;
+}
+
+static void insert(KadeDB_Storage *st, long long id, long long hr) {
+  KDB_Value vals[2];
+  vals[0] = make_int(id);
+  vals[1] = make_int(hr);
+  KDB_RowView row = {vals, 2};
+  assert(KadeDB_InsertRow(st, "vitals", &row) == 1);
+}
+
+static long long get_int(KadeDB_ResultSet *rs, int column) {
+  int ok = 0;
+  long long v = KadeDB_ResultSet_GetInt64(rs, column, &ok);
+  assert(ok);
+  return v;
+}
+
+int main() {
+  printf("=== C ABI Change Capture Test ===\n");
+  assert(KadeDB_Initialize() == 1);
+
+  // vitals(id, hr)
+  KadeDB_Storage *st = KadeDB_CreateStorage();
+  KDB_TableSchema *schema = KadeDB_TableSchema_Create();
+  KDB_TableColumnEx idcol = {"id", KDB_COL_INTEGER, 0, 1, NULL};
+  KDB_TableColumnEx hrcol = {"hr", KDB_COL_INTEGER, 1, 0, NULL};
+  assert(KadeDB_TableSchema_AddColumn(schema, &idcol) == 1);
+  assert(KadeDB_TableSchema_AddColumn(schema, &hrcol) == 1);
+  assert(KadeDB_CreateTable(st, "vitals", schema) == 1);
+  KadeDB_TableSchema_Destroy(schema);
+
+  assert(KadeDB_Subscribe(st, "vitals", NULL) == NULL);
+  assert(KadeDB_EnableChangeCapture(st, 0) == 1);
+  assert(KadeDB_Subscribe(st, "missing", NULL) == NULL);
+  KadeDB_Subscription *all = KadeDB_Subscribe(st, "vitals", NULL);
+  KDB_Predicate high = {"hr", KDB_OP_GT, make_int(100)};
+  KadeDB_Subscription *alarms = KadeDB_Subscribe(st, "vitals", &high);
+  assert(all != NULL && alarms != NULL);
+
+  // Nothing yet: an empty batch after the wait
+  KadeDB_ResultSet *rs = KadeDB_Subscription_Poll(all, 0, 10);
+  assert(rs != NULL && KadeDB_ResultSet_NextRow(rs) == 0);
+  assert(KadeDB_ResultSet_ColumnCount(rs) == 4);
+  assert(strcmp(KadeDB_ResultSet_GetColumnName(rs, 1), "change") == 0);
+  assert(strcmp(KadeDB_ResultSet_GetColumnName(rs, 3), "hr") == 0);
+  KadeDB_DestroyResultSet(rs);
+
+  insert(st, 1, 80);
+  insert(st, 2, 120);
+  KDB_Predicate one = {"id", KDB_OP_EQ, make_int(1)};
+  unsigned long long deleted = 0;
+  assert(KadeDB_DeleteRows(st, "vitals", &one, &deleted) == 1);
+  assert(KadeDB_Subscription_Lag(all) == 3);
+
+  // At most two changes per batch
+  rs = KadeDB_Subscription_Poll(all, 2, 0);
+  assert(rs != NULL);
+  assert(KadeDB_ResultSet_NextRow(rs) == 1);
+  assert(get_int(rs, 0) == 1);
+  assert(strcmp(KadeDB_ResultSet_GetString(rs, 1), "\"INSERT\"") == 0);
+  assert(get_int(rs, 2) == 1 && get_int(rs, 3) == 80);
+  assert(KadeDB_ResultSet_NextRow(rs) == 1);
+  assert(get_int(rs, 2) == 2);
+  assert(KadeDB_ResultSet_NextRow(rs) == 0);
+  KadeDB_DestroyResultSet(rs);
+  rs = KadeDB_Subscription_Poll(all, 0, 0);
+  assert(KadeDB_ResultSet_NextRow(rs) == 1);
+  assert(strcmp(KadeDB_ResultSet_GetString(rs, 1), "\"DELETE\"") == 0);
+  assert(get_int(rs, 2) == 1);
+  KadeDB_DestroyResultSet(rs);
+  assert(KadeDB_Subscription_Position(all) == 3);
+
+  // The filtered subscription only sees hr > 100
+  rs = KadeDB_Subscription_Poll(alarms, 0, 0);
+  assert(KadeDB_ResultSet_NextRow(rs) == 1);
+  assert(get_int(rs, 2) == 2);
+  assert(KadeDB_ResultSet_NextRow(rs) == 0);
+  KadeDB_DestroyResultSet(rs);
+
+  // The drop is the last change; the subscription then ends
+  assert(KadeDB_DropTable(st, "vitals") == 1);
+  rs = KadeDB_Subscription_Poll(all, 0, 0);
+  assert(KadeDB_ResultSet_NextRow(rs) == 1);
+  assert(strcmp(KadeDB_ResultSet_GetString(rs, 1), "\"DROP\"") == 0);
+  KadeDB_DestroyResultSet(rs);
+  assert(KadeDB_Subscription_GetLastError(all) == NULL);
+  assert(KadeDB_Subscription_Poll(all, 0, 0) == NULL);
+  assert(strstr(KadeDB_Subscription_GetLastError(all), "dropped") != NULL);
+
+  KadeDB_Subscription_Cancel(alarms);
+  assert(KadeDB_Subscription_Poll(alarms, 0, 0) == NULL);
+  assert(strstr(KadeDB_Subscription_GetLastError(alarms), "cancelled") !=
+         NULL);
+
+  KadeDB_Subscription_Close(all);
+  KadeDB_Subscription_Close(alarms);
+  KadeDB_DestroyStorage(st);
+  printf("All C ABI change capture tests passed!\n");
+  return 0;
+}
@@ -85,6 +85,63 @@ int main() {
   assert(count_rows == 2);
   KadeDB_DestroyResultSet(rs);
 
+  // KadeQL SELECTs: ordering and paging; other statements are rejected
+  rs = KadeDB_ExecuteQuery(st, "SELECT name FROM users ORDER BY id DESC "
+                               "LIMIT 1");
+  assert(rs != NULL);
+  assert(KadeDB_ResultSet_NextRow(rs) == 1);
+  assert(strstr(KadeDB_ResultSet_GetString(rs, 0), "carol") != NULL);
+  assert(KadeDB_ResultSet_NextRow(rs) == 0);
+  KadeDB_DestroyResultSet(rs);
+  // WHERE and projections are evaluated by the engine
+  rs = KadeDB_ExecuteQuery(st, "SELECT id FROM users WHERE name = 'carol'");
+  assert(rs != NULL);
+  assert(KadeDB_ResultSet_ColumnCount(rs) == 1);
+  assert(KadeDB_ResultSet_NextRow(rs) == 1);
+  int ok = 0;
+  assert(KadeDB_ResultSet_GetInt64(rs, 0, &ok) == 2 && ok);
+  assert(KadeDB_ResultSet_NextRow(rs) == 0);
+  KadeDB_DestroyResultSet(rs);
+  rs = KadeDB_ExecuteQuery(st, "SELECT * FROM users WHERE id > 5");
+  assert(rs != NULL);
+  assert(KadeDB_ResultSet_NextRow(rs) == 0);
+  KadeDB_DestroyResultSet(rs);
+  assert(KadeDB_ExecuteQuery(st, "DELETE FROM users") == NULL);
+  assert(KadeDB_ExecuteQuery(st, "SELECT * FROM users LIMIT") == NULL);
+
+  // Prepared statements: bind per execution, any statement type
+  KadeDB_Statement *ins =
+      KadeDB_Prepare(st, "INSERT INTO users (id, name) VALUES (?, ?)");
+  assert(ins != NULL && KadeDB_Statement_ParameterCount(ins) == 2);
+  {
+    KDB_Value vals[2];
+    vals[0] = make_int(3);
+    vals[1] = make_str("dave");
+    rs = KadeDB_ExecutePrepared(st, ins, vals, 2);
+    assert(rs != NULL);
+    KadeDB_DestroyResultSet(rs);
+    assert(KadeDB_ExecutePrepared(st, ins, vals, 1) == NULL);
+  }
+  KadeDB_DestroyStatement(ins);
+  KadeDB_Statement *byId =
+      KadeDB_Prepare(st, "SELECT name FROM users WHERE id = $1");
+  assert(byId != NULL && KadeDB_Statement_ParameterCount(byId) == 1);
+  {
+    KDB_Value id = make_int(3);
+    rs = KadeDB_ExecutePrepared(st, byId, &id, 1);
+    assert(rs != NULL && KadeDB_ResultSet_NextRow(rs) == 1);
+    assert(strstr(KadeDB_ResultSet_GetString(rs, 0), "dave") != NULL);
+    KadeDB_DestroyResultSet(rs);
+    id = make_int(2);
+    rs = KadeDB_ExecutePrepared(st, byId, &id, 1);
+    assert(rs != NULL && KadeDB_ResultSet_NextRow(rs) == 1);
+    assert(strstr(KadeDB_ResultSet_GetString(rs, 0), "carol") != NULL);
+    KadeDB_DestroyResultSet(rs);
+  }
+  KadeDB_DestroyStatement(byId);
+  assert(KadeDB_Prepare(st, "SELECT * FROM users WHERE id = ? AND x = $1") ==
+         NULL);
+
   // Delete where id == 2
   KDB_Predicate pred2;
   pred2.column = "id";
@@ -102,6 +159,49 @@ int main() {
   assert(KadeDB_ResultSet_NextRow(rs) == 0);
   KadeDB_DestroyResultSet(rs);
 
+  // Batch inserts are all or nothing
+  {
+    KDB_Value vals[3][2];
+    KDB_RowView rows[3];
+    const char *names[3] = {"dave", "erin", "frank"};
+    for (int i = 0; i < 3; ++i) {
+      vals[i][0] = make_int(10 + i);
+      vals[i][1] = make_str(names[i]);
+      rows[i].values = vals[i];
+      rows[i].count = 2;
+    }
+    vals[2][0] = make_int(10); // same id as the first row
+    assert(KadeDB_InsertRows(st, "users", rows, 3) == 0);
+    assert(KadeDB_InsertRows(st, "users", rows, 2) == 1);
+    assert(KadeDB_InsertRows(st, "users", NULL, 0) == 1);
+    assert(KadeDB_InsertRows(st, "users", NULL, 1) == 0);
+    assert(KadeDB_InsertRows(st, "nope", rows, 2) == 0);
+    rs = KadeDB_ExecuteQuery(st, "SELECT id FROM users WHERE id >= 10");
+    assert(rs != NULL);
+    int batch_rows = 0;
+    while (KadeDB_ResultSet_NextRow(rs))
+      ++batch_rows;
+    assert(batch_rows == 2);
+    KadeDB_DestroyResultSet(rs);
+  }
+
+  // Memory accounting and budgets
+  {
+    unsigned long long bytes = 0;
+    assert(KadeDB_TableMemoryUsage(st, "users", &bytes) == 1 && bytes > 0);
+    assert(KadeDB_TableMemoryUsage(st, "nope", &bytes) == 0);
+    assert(KadeDB_SetTableMemoryBudget(st, "users", bytes) == 1);
+    KDB_Value vals[2] = {make_int(20), make_str("gina")};
+    KDB_RowView row = {vals, 2};
+    assert(KadeDB_InsertRow(st, "users", &row) == 0);
+    assert(KadeDB_InsertRows(st, "users", &row, 1) == 0);
+    assert(KadeDB_SetTableMemoryBudget(st, "users", 0) == 1);
+    assert(KadeDB_InsertRow(st, "users", &row) == 1);
+    unsigned long long after = 0;
+    assert(KadeDB_TableMemoryUsage(st, "users", &after) == 1);
+    assert(after > bytes);
+  }
+
   // Drop table
   assert(KadeDB_DropTable(st, "users") == 1);
 
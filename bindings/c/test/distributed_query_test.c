@@ -0,0 +1,103 @@
+#include "kadedb/kadedb.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+static KDB_Value make_int(long long v) {
+  KDB_Value x;
+  x.type = KDB_VAL_INTEGER;
+  x.as.i64 = v;
+  return x;
+}
+static KDB_Value make_str(const char *s) {
+  KDB_Value x;
+  x.type = KDB_VAL_STRING;
+  x.as.str = s;
+  return x;
+}
+
+// visits(id, ward) with rows i = first, first + step, ... below 30
+static KadeDB_Storage *make_node(int first, int step) {
+  KadeDB_Storage *st = KadeDB_CreateStorage();
+  KDB_TableSchema *schema = KadeDB_TableSchema_Create();
+  KDB_TableColumnEx idcol = {"id", KDB_COL_INTEGER, 0, 1, NULL};
+  KDB_TableColumnEx wardcol = {"ward", KDB_COL_STRING, 0, 0, NULL};
+  assert(KadeDB_TableSchema_AddColumn(schema, &idcol) == 1);
+  assert(KadeDB_TableSchema_AddColumn(schema, &wardcol) == 1);
+  assert(KadeDB_CreateTable(st, "visits", schema) == 1);
+  KadeDB_TableSchema_Destroy(schema);
+  for (int i = first; i < 30; i += step) {
+    KDB_Value vals[2];
+    vals[0] = make_int(i);
+    vals[1] = make_str(i % 3 == 0 ? "a" : "b");
+    KDB_RowView row = {vals, 2};
+    assert(KadeDB_InsertRow(st, "visits", &row) == 1);
+  }
+  return st;
+}
+
+int main() {
+  printf("=== C ABI Distributed Query Test ===\n");
+  assert(KadeDB_Initialize() == 1);
+  KadeDB_Storage *nodes[2] = {make_node(0, 2), make_node(1, 2)};
+
+  assert(KadeDB_DistributedQuery_Plan("SELECT * FROM a JOIN b ON a.x = b.x") ==
+         NULL);
+  KadeDB_DistributedQuery *q = KadeDB_DistributedQuery_Plan(
+      "SELECT ward, COUNT(*) AS n FROM visits GROUP BY ward ORDER BY ward");
+  assert(q != NULL);
+  const char *fragment = KadeDB_DistributedQuery_Fragment(q);
+  assert(strstr(fragment, "GROUP BY") != NULL);
+
+  // Over the wire: each node encodes its fragment's result
+  const unsigned char *parts[2];
+  unsigned long long lens[2];
+  KadeDB_ResultSet *partial[2];
+  for (int i = 0; i < 2; ++i) {
+    partial[i] = KadeDB_ExecuteQuery(nodes[i], fragment);
+    assert(partial[i] != NULL);
+    assert(KadeDB_ResultSet_EncodeFragment(partial[i], i, &parts[i],
+                                           &lens[i]) == 1);
+  }
+  KadeDB_ResultSet *rs = KadeDB_DistributedQuery_Merge(q, parts, lens, 2);
+  assert(rs != NULL);
+  assert(KadeDB_DistributedQuery_GetLastError(q) == NULL);
+  assert(strcmp(KadeDB_ResultSet_GetColumnName(rs, 1), "n") == 0);
+  assert(KadeDB_ResultSet_NextRow(rs) == 1);
+  int ok = 0;
+  assert(strstr(KadeDB_ResultSet_GetString(rs, 0), "a") != NULL);
+  assert(KadeDB_ResultSet_GetInt64(rs, 1, &ok) == 10 && ok);
+  assert(KadeDB_ResultSet_NextRow(rs) == 1);
+  assert(strstr(KadeDB_ResultSet_GetString(rs, 0), "b") != NULL);
+  assert(KadeDB_ResultSet_GetInt64(rs, 1, &ok) == 20 && ok);
+  assert(KadeDB_ResultSet_NextRow(rs) == 0);
+  KadeDB_DestroyResultSet(rs);
+
+  // A truncated result is refused with a message
+  lens[1] -= 1;
+  assert(KadeDB_DistributedQuery_Merge(q, parts, lens, 2) == NULL);
+  assert(KadeDB_DistributedQuery_GetLastError(q) != NULL);
+  for (int i = 0; i < 2; ++i)
+    KadeDB_DestroyResultSet(partial[i]);
+  KadeDB_DistributedQuery_Destroy(q);
+
+  // In process: the storages are the nodes
+  q = KadeDB_DistributedQuery_Plan(
+      "SELECT id FROM visits ORDER BY id DESC LIMIT 3");
+  assert(q != NULL);
+  rs = KadeDB_DistributedQuery_Execute(q, nodes, 2);
+  assert(rs != NULL);
+  for (long long id = 29; id > 26; --id) {
+    assert(KadeDB_ResultSet_NextRow(rs) == 1);
+    assert(KadeDB_ResultSet_GetInt64(rs, 0, &ok) == id && ok);
+  }
+  assert(KadeDB_ResultSet_NextRow(rs) == 0);
+  KadeDB_DestroyResultSet(rs);
+  KadeDB_DistributedQuery_Destroy(q);
+
+  KadeDB_DestroyStorage(nodes[0]);
+  KadeDB_DestroyStorage(nodes[1]);
+  KadeDB_Shutdown();
+  printf("All C ABI distributed query tests passed!\n");
+  return 0;
+}
@@ -0,0 +1,88 @@
+#include "kadedb/kadedb.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main() {
+  printf("=== C ABI Metrics Test ===\n");
+  assert(KadeDB_Initialize() == 1);
+  KadeDB_Metrics_Reset();
+  KadeDB_Storage *st = KadeDB_CreateStorage();
+  assert(st != NULL);
+
+  KDB_TableSchema *schema = KadeDB_TableSchema_Create();
+  KDB_TableColumnEx idcol = {"id", KDB_COL_INTEGER, 0, 1, NULL};
+  assert(KadeDB_TableSchema_AddColumn(schema, &idcol) == 1);
+  assert(KadeDB_CreateTable(st, "t", schema) == 1);
+  KadeDB_TableSchema_Destroy(schema);
+  for (long long id = 0; id < 100; ++id) {
+    KDB_Value v;
+    v.type = KDB_VAL_INTEGER;
+    v.as.i64 = id;
+    KDB_RowView row = {&v, 1};
+    assert(KadeDB_InsertRow(st, "t", &row) == 1);
+  }
+  KadeDB_ResultSet *rs =
+      KadeDB_ExecuteQuery(st, "SELECT id FROM t WHERE id < 10");
+  assert(rs != NULL);
+  KadeDB_DestroyResultSet(rs);
+
+  KadeDB_OperationMetrics m;
+  assert(KadeDB_Metrics_Get("relational", "insert", &m) == 1);
+  assert(m.calls == 100 && m.errors == 0 && m.rows_returned == 100);
+  assert(m.latency_sum_ns > 0 && m.latency_p50_ns <= m.latency_p99_ns &&
+         m.latency_p99_ns <= m.latency_max_ns);
+  assert(m.bytes_allocated > 0);
+  assert(KadeDB_Metrics_Get("kadeql", "execute", &m) == 1);
+  assert(m.calls == 1 && m.rows_returned == 10);
+  assert(KadeDB_Metrics_Get("relational", "nope", &m) == 0);
+
+  // Size query, then the text; a short buffer is truncated, not overrun
+  unsigned long long need = 0;
+  assert(KadeDB_Metrics_ToPrometheus(NULL, 0, &need) == 1 && need > 1);
+  char *text = (char *)malloc(need + 64);
+  assert(KadeDB_Metrics_ToPrometheus(text, need + 64, NULL) == 1);
+  assert(strstr(text, "kadedb_operations_total{storage=\"relational\","
+                      "operation=\"insert\"}") != NULL);
+  char small[8];
+  assert(KadeDB_Metrics_ToPrometheus(small, sizeof(small), NULL) == 1);
+  assert(strlen(small) == sizeof(small) - 1);
+  free(text);
+
+  // Nothing is recorded while disabled
+  KadeDB_Metrics_Reset();
+  KadeDB_Metrics_SetEnabled(0);
+  assert(KadeDB_TruncateTable(st, "t") == 1);
+  rs = KadeDB_ExecuteQuery(st, "SELECT id FROM t");
+  assert(rs != NULL);
+  KadeDB_DestroyResultSet(rs);
+  KadeDB_Metrics_SetEnabled(1);
+  assert(KadeDB_Metrics_Get("kadeql", "execute", &m) == 1 && m.calls == 0);
+
+  // Slow query log: with a zero threshold every statement is logged
+  KadeDB_SlowQueryLog_SetThreshold(0);
+  rs = KadeDB_ExecuteQuery(st, "SELECT id FROM t WHERE id = 7");
+  assert(rs != NULL);
+  KadeDB_DestroyResultSet(rs);
+  KadeDB_SlowQueryLog_SetThreshold(-1);
+  rs = KadeDB_ExecuteQuery(st, "SELECT fingerprint, rows_returned FROM "
+                               "kadedb_slow_queries");
+  assert(rs != NULL);
+  assert(KadeDB_ResultSet_NextRow(rs) == 1);
+  assert(strstr(KadeDB_ResultSet_GetString(rs, 0),
+                "SELECT id FROM t WHERE (id = ?)") != NULL);
+  int ok = 0;
+  assert(KadeDB_ResultSet_GetInt64(rs, 1, &ok) == 0 && ok);
+  assert(KadeDB_ResultSet_NextRow(rs) == 0);
+  KadeDB_DestroyResultSet(rs);
+  KadeDB_SlowQueryLog_Clear();
+  rs = KadeDB_ExecuteQuery(st, "SELECT id FROM kadedb_slow_queries");
+  assert(rs != NULL && KadeDB_ResultSet_NextRow(rs) == 0);
+  KadeDB_DestroyResultSet(rs);
+
+  KadeDB_DestroyStorage(st);
+  KadeDB_Shutdown();
+  printf("All C ABI metrics tests passed.\n");
+  return 0;
+}
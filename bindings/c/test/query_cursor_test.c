@@ -0,0 +1,141 @@
+#include "kadedb/kadedb.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+static KDB_Value make_int(long long v) {
+  KDB_Value x;
+  x.type = KDB_VAL_INTEGER;
+  x.as.i64 = v;
+  return x;
+}
+
+static void insert(KadeDB_Storage *st, long long id) {
+  KDB_Value vals[2];
+  vals[0] = make_int(id);
+  vals[1] = make_int(id % 10);
+  KDB_RowView row = {vals, 2};
+  assert(KadeDB_InsertRow(st, "events", &row) == 1);
+}
+
+// Drain `q`, checking that every batch holds at most `batch_rows` rows and
+// that the first column counts up from `first` by `step`; returns the rows
+static long long drain(KadeDB_Query *q, unsigned long long batch_rows,
+                       long long first, long long step) {
+  long long rows = 0;
+  KadeDB_ResultSet *batch;
+  while ((batch = KadeDB_Query_FetchBatch(q)) != NULL) {
+    long long in_batch = 0;
+    while (KadeDB_ResultSet_NextRow(batch)) {
+      int ok = 0;
+      assert(KadeDB_ResultSet_GetInt64(batch, 0, &ok) == first + rows * step);
+      assert(ok);
+      ++rows;
+      ++in_batch;
+    }
+    assert(in_batch > 0 && (unsigned long long)in_batch <= batch_rows);
+    KadeDB_DestroyResultSet(batch);
+  }
+  assert(KadeDB_Query_GetLastError(q) == NULL);
+  return rows;
+}
+
+int main() {
+  printf("=== C ABI Streaming Query Test ===\n");
+  assert(KadeDB_Initialize() == 1);
+  KadeDB_Storage *st = KadeDB_CreateStorage();
+  assert(st != NULL);
+
+  KDB_TableSchema *schema = KadeDB_TableSchema_Create();
+  KDB_TableColumnEx idcol = {"id", KDB_COL_INTEGER, 0, 1, NULL};
+  KDB_TableColumnEx bucketcol = {"bucket", KDB_COL_INTEGER, 0, 0, NULL};
+  assert(KadeDB_TableSchema_AddColumn(schema, &idcol) == 1);
+  assert(KadeDB_TableSchema_AddColumn(schema, &bucketcol) == 1);
+  assert(KadeDB_TableSchema_SetPrimaryKey(schema, "id") == 1);
+  assert(KadeDB_CreateTable(st, "events", schema) == 1);
+  KadeDB_TableSchema_Destroy(schema);
+  for (long long id = 0; id < 10000; ++id)
+    insert(st, id);
+
+  // Filtered, projected rows arrive in batches of the requested size
+  KadeDB_Query *q =
+      KadeDB_Query_Open(st, "SELECT id FROM events WHERE id >= 100", 1000);
+  assert(q != NULL);
+  assert(drain(q, 1000, 100, 1) == 9900);
+  assert(KadeDB_Query_FetchBatch(q) == NULL);
+  KadeDB_Query_Close(q);
+
+  // Blocking operators stream their output too
+  q = KadeDB_Query_Open(
+      st, "SELECT id FROM events WHERE bucket = 3 ORDER BY id DESC", 64);
+  assert(q != NULL);
+  assert(drain(q, 64, 9993, -10) == 1000);
+  KadeDB_Query_Close(q);
+
+  // The storage stays usable while a query is open, and closing a query
+  // early stops its scan
+  q = KadeDB_Query_Open(st, "SELECT * FROM events", 10);
+  assert(q != NULL);
+  KadeDB_ResultSet *batch = KadeDB_Query_FetchBatch(q);
+  assert(batch != NULL && KadeDB_ResultSet_ColumnCount(batch) == 2);
+  KadeDB_DestroyResultSet(batch);
+  insert(st, 10000);
+  KadeDB_Query_Close(q);
+  q = KadeDB_Query_Open(st, "SELECT id FROM events WHERE id > 9990", 0);
+  assert(q != NULL);
+  assert(drain(q, 1024, 9991, 1) == 10);
+  KadeDB_Query_Close(q);
+
+  // No rows: one empty batch with the columns
+  q = KadeDB_Query_Open(st, "SELECT id, bucket FROM events WHERE id < 0", 0);
+  assert(q != NULL);
+  batch = KadeDB_Query_FetchBatch(q);
+  assert(batch != NULL);
+  assert(KadeDB_ResultSet_ColumnCount(batch) == 2);
+  assert(strcmp(KadeDB_ResultSet_GetColumnName(batch, 1), "bucket") == 0);
+  assert(KadeDB_ResultSet_NextRow(batch) == 0);
+  KadeDB_DestroyResultSet(batch);
+  assert(KadeDB_Query_FetchBatch(q) == NULL);
+  KadeDB_Query_Close(q);
+
+  // Keyset pages pick up after the previous page's last row
+  {
+    char token[256] = "";
+    unsigned long long need = 0;
+    long long seen = 0, pages = 0;
+    do {
+      KadeDB_ResultSet *page = KadeDB_ExecuteQueryPage(
+          st, "SELECT id FROM events WHERE bucket = 3 ORDER BY id DESC", 300,
+          token, token, sizeof token, &need);
+      assert(page != NULL && need <= sizeof token);
+      while (KadeDB_ResultSet_NextRow(page)) {
+        int ok = 0;
+        assert(KadeDB_ResultSet_GetInt64(page, 0, &ok) == 9993 - seen * 10);
+        ++seen;
+      }
+      KadeDB_DestroyResultSet(page);
+      ++pages;
+    } while (token[0] != '\0');
+    assert(seen == 1000 && pages == 4);
+    assert(KadeDB_ExecuteQueryPage(st, "SELECT id FROM events ORDER BY id", 10,
+                                   "zz", NULL, 0, NULL) == NULL);
+    assert(KadeDB_ExecuteQueryPage(st, "SELECT id FROM events ORDER BY id "
+                                       "LIMIT 5",
+                                   10, NULL, NULL, 0, NULL) == NULL);
+  }
+
+  // Rejected statements and failures before the first batch
+  assert(KadeDB_Query_Open(st, "SELECT * FROM", 0) == NULL);
+  assert(KadeDB_Query_Open(st, "DELETE FROM events", 0) == NULL);
+  assert(KadeDB_Query_Open(st, "SELECT * FROM events WHERE id = ?", 0) ==
+         NULL);
+  assert(KadeDB_Query_Open(st, "SELECT * FROM missing", 0) == NULL);
+  assert(KadeDB_Query_Open(NULL, "SELECT * FROM events", 0) == NULL);
+  assert(KadeDB_Query_FetchBatch(NULL) == NULL);
+  KadeDB_Query_Close(NULL);
+
+  KadeDB_DestroyStorage(st);
+  KadeDB_Shutdown();
+  printf("✓ Streaming query test passed\n");
+  return 0;
+}
@@ -0,0 +1,70 @@
+#include "kadedb/kadedb.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static void sleep_ms(long ms) {
+  struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+  nanosleep(&ts, NULL);
+}
+
+int main() {
+  printf("=== C ABI Replication Test ===\n");
+  assert(KadeDB_Initialize() == 1);
+
+  // No log yet: the leader has no records, so segments are heartbeats
+  const char *path = "kadedb_c_replication_test_missing.log";
+  remove(path);
+  KadeDB_WalShipper *sh = KadeDB_WalShipper_Open(path, 0, 0, 1);
+  assert(sh != NULL);
+  const unsigned char *data = NULL;
+  unsigned long long len = 0, first = 0, last = 0;
+  int tail = 0;
+  assert(KadeDB_WalShipper_Next(sh, &data, &len, &first, &last, &tail) == 1);
+  assert(first == 1 && last == 0 && tail == 1 && len > 0);
+  assert(KadeDB_WalShipper_GetLastError(sh) == NULL);
+
+  KadeDB_Storage *st = KadeDB_CreateStorage();
+  KadeDB_Replica *rep = KadeDB_Replica_Create(st, 0);
+  assert(rep != NULL);
+  assert(KadeDB_Replica_StalenessMillis(rep) == -1);
+  assert(KadeDB_Replica_ExecuteQuery(rep, "SELECT * FROM kadedb_slow_queries",
+                                     60000) == NULL);
+  assert(strstr(KadeDB_Replica_GetLastError(rep), "caught up") != NULL);
+
+  assert(KadeDB_Replica_Apply(rep, data, len, first, last, tail) == 1);
+  assert(KadeDB_Replica_AppliedLsn(rep) == 0);
+  assert(KadeDB_Replica_StalenessMillis(rep) >= 0);
+  KadeDB_ResultSet *rs =
+      KadeDB_Replica_ExecuteQuery(rep, "SELECT * FROM kadedb_slow_queries",
+                                  60000);
+  assert(rs != NULL);
+  KadeDB_DestroyResultSet(rs);
+
+  // Past the bound reads are refused until the next heartbeat
+  sleep_ms(20);
+  assert(KadeDB_Replica_ExecuteQuery(rep, "SELECT * FROM kadedb_slow_queries",
+                                     5) == NULL);
+  assert(strstr(KadeDB_Replica_GetLastError(rep), "behind") != NULL);
+  assert(KadeDB_WalShipper_Next(sh, &data, &len, &first, &last, &tail) == 1);
+  assert(KadeDB_Replica_Apply(rep, data, len, first, last, tail) == 1);
+  rs = KadeDB_Replica_ExecuteQuery(rep, "SELECT * FROM kadedb_slow_queries",
+                                   5);
+  assert(rs != NULL);
+  KadeDB_DestroyResultSet(rs);
+
+  // Segments out of order or that do not decode are refused
+  assert(KadeDB_Replica_Apply(rep, data, len, 5, 4, 1) == 0);
+  assert(KadeDB_Replica_Apply(rep, (const unsigned char *)"junk", 4, 1, 0,
+                              1) == 0);
+  assert(KadeDB_Replica_GetLastError(rep) != NULL);
+  assert(KadeDB_Replica_AppliedLsn(rep) == 0);
+
+  KadeDB_Replica_Destroy(rep);
+  KadeDB_DestroyStorage(st);
+  KadeDB_WalShipper_Close(sh);
+  KadeDB_Shutdown();
+  printf("All C ABI replication tests passed!\n");
+  return 0;
+}
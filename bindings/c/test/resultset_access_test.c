@@ -1,6 +1,7 @@
 #include "kadedb/kadedb.h"
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 
 static KDB_Value make_int(long long v) {
   KDB_Value x;
@@ -81,8 +82,124 @@ int main() {
   assert(KadeDB_ResultSet_Reset(rs) == 1);
   assert(KadeDB_ResultSet_NextRow(rs) == 1);
 
+  // Arrow export, then import into a second table of the same schema
+  struct ArrowSchema aschema;
+  struct ArrowArray aarray;
+  assert(KadeDB_ResultSet_ExportArrow(rs, &aschema, &aarray) == 1);
+  assert(strcmp(aschema.format, "+s") == 0 && aarray.length == 1);
+  assert(aarray.n_children == 3 && aarray.children[0]->n_buffers == 2);
+  assert(((const int64_t *)aarray.children[0]->buffers[1])[0] == 42);
+  assert(KadeDB_CreateTable(st, "users_copy", schema) == 1);
+  unsigned long long imported = 0;
+  assert(KadeDB_ImportArrow(st, "users_copy", &aschema, &aarray, &imported) ==
+         1);
+  assert(imported == 1 && aarray.release == NULL && aschema.release == NULL);
+  KadeDB_ResultSet *copy = KadeDB_ExecuteQuery(st, "SELECT * FROM users_copy");
+  assert(copy && KadeDB_ResultSet_NextRow(copy) == 1);
+  assert(strcmp(KadeDB_ResultSet_GetString(copy, 1), "\"alice\"") == 0);
+  KadeDB_DestroyResultSet(copy);
+
   KadeDB_DestroyResultSet(rs);
   KadeDB_TableSchema_Destroy(schema);
+
+  // Columnar fetches: scores (id, score FLOAT nullable, tag STRING nullable)
+  schema = KadeDB_TableSchema_Create();
+  KDB_TableColumnEx scorecol = {"score", KDB_COL_FLOAT, 1, 0, NULL};
+  KDB_TableColumnEx tagcol = {"tag", KDB_COL_STRING, 1, 0, NULL};
+  assert(KadeDB_TableSchema_AddColumn(schema, &idcol) == 1);
+  assert(KadeDB_TableSchema_AddColumn(schema, &scorecol) == 1);
+  assert(KadeDB_TableSchema_AddColumn(schema, &tagcol) == 1);
+  assert(KadeDB_CreateTable(st, "scores", schema) == 1);
+  KadeDB_TableSchema_Destroy(schema);
+  const char *tags[] = {"a", "bb", "", "dddd"};
+  for (int i = 0; i < 100; ++i) {
+    KDB_Value vals[3];
+    vals[0] = make_int(i);
+    vals[1].type = i % 5 == 0 ? KDB_VAL_NULL : KDB_VAL_FLOAT;
+    vals[1].as.f64 = i * 0.5;
+    vals[2] = i % 7 == 0 ? make_int(0) : make_str(tags[i % 4]);
+    if (i % 7 == 0)
+      vals[2].type = KDB_VAL_NULL;
+    KDB_RowView row = {vals, 3};
+    assert(KadeDB_InsertRow(st, "scores", &row) == 1);
+  }
+  rs = KadeDB_ExecuteQuery(st, "SELECT * FROM scores ORDER BY id");
+  assert(rs);
+  {
+    int64_t ids[128];
+    double scores[128];
+    uint8_t nulls[128], flags[128];
+    assert(KadeDB_ResultSet_FetchColumnInt64(rs, 0, 0, ids, NULL, 128) == 100);
+    for (int i = 0; i < 100; ++i)
+      assert(ids[i] == i);
+    // Pages and conversions; the cursor does not move
+    assert(KadeDB_ResultSet_FetchColumnInt64(rs, 0, 90, ids, NULL, 64) == 10);
+    assert(ids[0] == 90 && ids[9] == 99);
+    assert(KadeDB_ResultSet_FetchColumnInt64(rs, 0, 100, ids, NULL, 8) == 0);
+    assert(KadeDB_ResultSet_FetchColumnDouble(rs, 1, 10, scores, nulls, 20) ==
+           20);
+    for (int i = 0; i < 20; ++i) {
+      assert(nulls[i] == ((10 + i) % 5 == 0));
+      assert(scores[i] == (nulls[i] ? 0.0 : (10 + i) * 0.5));
+    }
+    assert(KadeDB_ResultSet_FetchColumnBool(rs, 0, 0, flags, NULL, 3) == 3);
+    assert(flags[0] == 0 && flags[1] == 1 && flags[2] == 1);
+    assert(KadeDB_ResultSet_NextRow(rs) == 1);
+    int ok = 0;
+    assert(KadeDB_ResultSet_GetInt64(rs, 0, &ok) == 0 && ok);
+
+    // Errors: a bad column, nulls without a null buffer, no conversion
+    assert(KadeDB_ResultSet_FetchColumnInt64(rs, 3, 0, ids, NULL, 1) == -1);
+    assert(KadeDB_ResultSet_GetLastError(rs) != NULL);
+    assert(KadeDB_ResultSet_FetchColumnDouble(rs, 1, 0, scores, NULL, 1) ==
+           -1);
+    assert(KadeDB_ResultSet_FetchColumnInt64(rs, 2, 1, ids, nulls, 1) == -1);
+    assert(KadeDB_ResultSet_FetchColumnInt64(NULL, 0, 0, ids, NULL, 1) == -1);
+
+    // Strings: Arrow-style offsets, stopping at the last row that fits
+    uint64_t offsets[129];
+    char text[512];
+    unsigned long long need = 0;
+    assert(KadeDB_ResultSet_FetchColumnString(rs, 2, 0, offsets, NULL, 0,
+                                              nulls, 100, &need) == 1);
+    assert(offsets[1] == 0 && nulls[0] == 1); // row 0: null, zero bytes
+    long long got = KadeDB_ResultSet_FetchColumnString(
+        rs, 2, 0, offsets, text, sizeof(text), nulls, 100, NULL);
+    assert(got == 100 && offsets[100] == need);
+    for (int i = 0; i < 100; ++i) {
+      const char *want = i % 7 == 0 ? "" : tags[i % 4];
+      assert(nulls[i] == (i % 7 == 0));
+      assert(offsets[i + 1] - offsets[i] == strlen(want));
+      assert(memcmp(text + offsets[i], want, strlen(want)) == 0);
+    }
+    got = KadeDB_ResultSet_FetchColumnString(rs, 2, 0, offsets, text, 4,
+                                             NULL, 100, &need);
+    assert(got == 3 && offsets[3] == 2 && memcmp(text, "bb", 2) == 0);
+    // Other types as text
+    assert(KadeDB_ResultSet_FetchColumnString(rs, 0, 12, offsets, text,
+                                              sizeof(text), NULL, 1,
+                                              NULL) == 1);
+    assert(offsets[1] == 2 && memcmp(text, "12", 2) == 0);
+  }
+  KadeDB_DestroyResultSet(rs);
   KadeDB_DestroyStorage(st);
+
+  // Export helpers: full length reported even when the buffer truncates
+  const char *cols[] = {"id", "name"};
+  KDB_ColumnType types[] = {KDB_COL_INTEGER, KDB_COL_STRING};
+  KDB_Value cells[] = {make_int(7), make_str("x,y")};
+  KDB_RowView views[] = {{cells, 2}};
+  char buf[64], small[6];
+  unsigned long long need = 0;
+  assert(KadeDB_Result_ToCSV(cols, types, 2, views, 1, ',', 1, NULL, 0,
+                             &need) == 1);
+  assert(need == strlen("id,name\n7,\"x,y\"\n") + 1);
+  assert(KadeDB_Result_ToCSV(cols, types, 2, views, 1, ',', 1, buf,
+                             sizeof(buf), NULL) == 1);
+  assert(strcmp(buf, "id,name\n7,\"x,y\"\n") == 0);
+  assert(KadeDB_Result_ToJSON(cols, types, 2, views, 1, 0, small,
+                              sizeof(small), &need) == 1);
+  assert(strcmp(small, "[{\"id") == 0);
+  assert(need == strlen("[{\"id\":7,\"name\":\"x,y\"}]") + 1);
   return 0;
 }
@@ -0,0 +1,103 @@
+#include "kadedb/kadedb.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_SPANS 64
+
+typedef struct {
+  char name[48];
+  unsigned long long trace_id_low, span_id, parent_span_id;
+  int error;
+  char table[16];
+} SeenSpan;
+
+static SeenSpan g_spans[MAX_SPANS];
+static int g_count = 0;
+
+static void on_span(void *user_data, const KadeDB_SpanData *span) {
+  assert(user_data == (void *)g_spans);
+  assert(g_count < MAX_SPANS);
+  SeenSpan *s = &g_spans[g_count++];
+  memset(s, 0, sizeof(*s));
+  snprintf(s->name, sizeof(s->name), "%s", span->name);
+  s->trace_id_low = span->trace_id_low;
+  s->span_id = span->span_id;
+  s->parent_span_id = span->parent_span_id;
+  s->error = span->error;
+  for (int i = 0; i < span->attribute_count; ++i)
+    if (strcmp(span->attribute_keys[i], "kadedb.table") == 0)
+      snprintf(s->table, sizeof(s->table), "%s", span->attribute_values[i]);
+}
+
+static const SeenSpan *find(const char *name) {
+  for (int i = 0; i < g_count; ++i)
+    if (strcmp(g_spans[i].name, name) == 0)
+      return &g_spans[i];
+  return NULL;
+}
+
+static void on_done(void *user_data, KadeDB_ResultSet *rs, const char *error) {
+  (void)error;
+  *(int *)user_data = rs != NULL;
+  if (rs)
+    KadeDB_DestroyResultSet(rs);
+}
+
+int main() {
+  printf("=== C ABI Tracing Test ===\n");
+  assert(KadeDB_Initialize() == 1);
+  KadeDB_Storage *st = KadeDB_CreateStorage();
+  assert(st != NULL);
+  KDB_TableSchema *schema = KadeDB_TableSchema_Create();
+  KDB_TableColumnEx idcol = {"id", KDB_COL_INTEGER, 0, 1, NULL};
+  assert(KadeDB_TableSchema_AddColumn(schema, &idcol) == 1);
+  assert(KadeDB_CreateTable(st, "t", schema) == 1);
+  KadeDB_TableSchema_Destroy(schema);
+
+  // Not tracing: no spans, no handles
+  assert(KadeDB_Trace_StartSpan("idle") == NULL);
+  KadeDB_Trace_EndSpan(NULL);
+
+  KadeDB_Trace_SetExporter(on_span, g_spans);
+  KadeDB_Trace_SetSampleRatio(1.0);
+  assert(KadeDB_Trace_SetParent("not a traceparent") == 0);
+  assert(KadeDB_Trace_SetParent(
+             "00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01") == 1);
+
+  // The caller's span encloses the engine's
+  KadeDB_Span *request = KadeDB_Trace_StartSpan("client.request");
+  assert(request != NULL);
+  KadeDB_ResultSet *rs = KadeDB_ExecuteQuery(st, "SELECT id FROM t");
+  assert(rs != NULL);
+  KadeDB_DestroyResultSet(rs);
+  KadeDB_Trace_EndSpan(request);
+
+  const SeenSpan *client = find("client.request");
+  const SeenSpan *execute = find("kadeql.execute");
+  const SeenSpan *scan = find("storage.relational.scan");
+  assert(client && execute && scan && find("kadeql.parse"));
+  assert(client->trace_id_low == 0x8448eb211c80319cull);
+  assert(client->parent_span_id == 0xb7ad6b7169203331ull);
+  assert(execute->parent_span_id == client->span_id);
+  assert(scan->parent_span_id == execute->span_id);
+  assert(strcmp(scan->table, "t") == 0 && !scan->error);
+
+  // Async queries continue the submitting thread's trace
+  g_count = 0;
+  int ok = 0;
+  assert(KadeDB_ExecuteQueryAsync(st, "SELECT id FROM t WHERE id > 1", NULL,
+                                  on_done, &ok) == 1);
+  assert(KadeDB_Trace_SetParent(NULL) == 1);
+  // Destroying the storage waits for the query
+  KadeDB_DestroyStorage(st);
+  assert(ok == 1);
+  execute = find("kadeql.execute");
+  assert(execute && execute->parent_span_id == 0xb7ad6b7169203331ull);
+
+  KadeDB_Trace_SetExporter(NULL, NULL);
+  assert(KadeDB_Trace_StartSpan("idle") == NULL);
+  KadeDB_Shutdown();
+  printf("All C ABI tracing tests passed.\n");
+  return 0;
+}
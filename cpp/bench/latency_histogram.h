@@ -0,0 +1,89 @@
+#pragma once
+
+// Latency histogram for the macro benchmark drivers, in the manner of
+// HdrHistogram: log-linear buckets with 64 to 128 sub-buckets per power of
+// two, so every recorded value is kept within 1/64 (about 1.6%) of its
+// true value from one nanosecond up to centuries, in a fixed 30 KiB.
+// Each worker records into its own histogram; they are merged afterwards.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "kadedb/metrics.h" // LogBuckets
+
+namespace kadedb {
+namespace bench {
+
+class LatencyHistogram {
+public:
+  // Record one latency in nanoseconds
+  void record(uint64_t ns) {
+    ++counts_[Buckets::bucketOf(ns)];
+    ++total_;
+    max_ = std::max(max_, ns);
+    min_ = std::min(min_, ns);
+  }
+
+  void merge(const LatencyHistogram &other) {
+    for (size_t i = 0; i < kBuckets; ++i)
+      counts_[i] += other.counts_[i];
+    total_ += other.total_;
+    max_ = std::max(max_, other.max_);
+    min_ = std::min(min_, other.min_);
+  }
+
+  uint64_t count() const { return total_; }
+  uint64_t max() const { return total_ ? max_ : 0; }
+  uint64_t min() const { return total_ ? min_ : 0; }
+
+  // Smallest recorded value with at least `p` percent of values at or
+  // below it, to the bucket's precision (the bucket's highest value)
+  uint64_t percentile(double p) const {
+    if (total_ == 0)
+      return 0;
+    const double want = std::max(1.0, p / 100.0 * static_cast<double>(total_));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      seen += counts_[i];
+      if (static_cast<double>(seen) >= want)
+        return std::min(Buckets::highestIn(i), max_);
+    }
+    return max_;
+  }
+
+  // One row of a latency table, in microseconds:
+  // name, count, p50, p95, p99, p99.9, max
+  void print(std::ostream &os, const std::string &name) const {
+    auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    os << "  " << std::left << std::setw(22) << name << std::right
+       << std::setw(10) << count() << std::fixed << std::setprecision(1)
+       << std::setw(11) << us(percentile(50)) << std::setw(11)
+       << us(percentile(95)) << std::setw(11) << us(percentile(99))
+       << std::setw(11) << us(percentile(99.9)) << std::setw(12) << us(max())
+       << "\n";
+  }
+
+  static void printHeader(std::ostream &os) {
+    os << "  " << std::left << std::setw(22) << "operation" << std::right
+       << std::setw(10) << "count" << std::setw(11) << "p50 us"
+       << std::setw(11) << "p95 us" << std::setw(11) << "p99 us"
+       << std::setw(11) << "p99.9 us" << std::setw(12) << "max us" << "\n";
+  }
+
+private:
+  // The engine's bucket math at 128 sub-buckets below 2^7
+  using Buckets = metrics::LogBuckets<7>;
+  static constexpr size_t kBuckets = Buckets::kCount;
+
+  std::array<uint64_t, kBuckets> counts_{};
+  uint64_t total_ = 0;
+  uint64_t max_ = 0;
+  uint64_t min_ = UINT64_MAX;
+};
+
+} // namespace bench
+} // namespace kadedb
@@ -0,0 +1,55 @@
+#include "micro_fixtures.h"
+
+#include "kadedb/index.h"
+
+using namespace kadedb;
+using namespace kadedb::bench;
+
+static std::string docKey(int64_t i) { return "doc" + std::to_string(i); }
+
+// N documents put into an empty collection
+static void BM_DocumentPut(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  const std::vector<Document> docs = documents(n);
+  for (auto _ : state) {
+    state.PauseTiming();
+    InMemoryDocumentStorage ds;
+    (void)ds.createCollection("c", std::nullopt);
+    state.ResumeTiming();
+    for (int64_t i = 0; i < n; ++i)
+      if (failed(state, ds.put("c", docKey(i), docs[i])))
+        return;
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_DocumentPut)->Apply(sizes)->Unit(benchmark::kMillisecond);
+
+// age < 10 (a tenth of N documents), without and with an ordered index on
+// age (second argument 0/1)
+static void BM_DocumentQuery(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  InMemoryDocumentStorage ds;
+  (void)ds.createCollection("c", std::nullopt);
+  std::vector<Document> docs = documents(n);
+  for (int64_t i = 0; i < n; ++i)
+    (void)ds.put("c", docKey(i), std::move(docs[i]));
+  if (state.range(1) && failed(state, ds.createIndex("c", "age",
+                                                     IndexType::Ordered)))
+    return;
+  DocPredicate p;
+  p.field = "age";
+  p.op = DocPredicate::Op::Lt;
+  p.rhs = ValueFactory::createInteger(10);
+  const std::optional<DocPredicate> where = std::move(p);
+  for (auto _ : state) {
+    auto res = ds.query("c", {}, where);
+    if (failed(state, res.status()))
+      return;
+    benchmark::DoNotOptimize(res.value().size());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_DocumentQuery)
+    ->ArgsProduct({{1000, 10000, 100000}, {0, 1}})
+    ->ArgNames({"docs", "indexed"})
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,135 @@
+#include "micro_fixtures.h"
+
+#include "kadedb/kadedb.h"
+
+#include <cmath>
+
+using namespace kadedb::bench;
+
+// The relational fixture's table through the C API, for the cost the
+// binding adds on top of the engine
+namespace {
+
+struct FfiTable {
+  KadeDB_Storage *storage = KadeDB_CreateStorage();
+
+  FfiTable() {
+    KDB_TableSchema *schema = KadeDB_TableSchema_Create();
+    const KDB_TableColumnEx cols[] = {
+        {"id", KDB_COL_INTEGER, 0, 1, nullptr},
+        {"x", KDB_COL_INTEGER, 0, 0, nullptr},
+        {"y", KDB_COL_FLOAT, 0, 0, nullptr},
+        {"name", KDB_COL_STRING, 0, 0, nullptr},
+    };
+    for (const auto &col : cols)
+      KadeDB_TableSchema_AddColumn(schema, &col);
+    KadeDB_TableSchema_SetPrimaryKey(schema, "id");
+    KadeDB_CreateTable(storage, "t", schema);
+    KadeDB_TableSchema_Destroy(schema);
+  }
+  ~FfiTable() { KadeDB_DestroyStorage(storage); }
+  FfiTable(const FfiTable &) = delete;
+  FfiTable &operator=(const FfiTable &) = delete;
+};
+
+// C views of n rows; `names` owns the strings they point at
+struct FfiRows {
+  std::vector<std::string> names;
+  std::vector<KDB_Value> values;
+  std::vector<KDB_RowView> rows;
+
+  explicit FfiRows(int64_t n) {
+    const std::vector<kadedb::Row> src = relationalRows(n);
+    names.reserve(src.size());
+    values.reserve(src.size() * 4);
+    for (const auto &row : src) {
+      names.push_back(row.at(3).asString());
+      KDB_Value v[4];
+      v[0].type = KDB_VAL_INTEGER;
+      v[0].as.i64 = row.at(0).asInt();
+      v[1].type = KDB_VAL_INTEGER;
+      v[1].as.i64 = row.at(1).asInt();
+      v[2].type = KDB_VAL_FLOAT;
+      v[2].as.f64 = row.at(2).asFloat();
+      v[3].type = KDB_VAL_STRING;
+      v[3].as.str = names.back().c_str();
+      values.insert(values.end(), v, v + 4);
+    }
+    for (size_t i = 0; i < src.size(); ++i)
+      rows.push_back(KDB_RowView{&values[i * 4], 4});
+  }
+};
+
+} // namespace
+
+// N rows inserted as one KadeDB_InsertRows() batch
+static void BM_FfiInsertRows(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  const FfiRows rows(n);
+  for (auto _ : state) {
+    state.PauseTiming();
+    FfiTable t;
+    state.ResumeTiming();
+    if (!KadeDB_InsertRows(t.storage, "t", rows.rows.data(),
+                           rows.rows.size())) {
+      state.SkipWithError("KadeDB_InsertRows failed");
+      return;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_FfiInsertRows)->Apply(sizes)->Unit(benchmark::kMillisecond);
+
+// A filtered query whose tenth of N rows is read back cell by cell
+static void BM_FfiQueryRoundTrip(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  FfiTable t;
+  const FfiRows rows(n);
+  KadeDB_InsertRows(t.storage, "t", rows.rows.data(), rows.rows.size());
+  for (auto _ : state) {
+    KadeDB_ResultSet *rs =
+        KadeDB_ExecuteQuery(t.storage, "SELECT id, y FROM t WHERE x < 100000");
+    if (!rs) {
+      state.SkipWithError("KadeDB_ExecuteQuery failed");
+      return;
+    }
+    long long sum = 0;
+    int ok = 0;
+    while (KadeDB_ResultSet_NextRow(rs))
+      sum += KadeDB_ResultSet_GetInt64(rs, 0, &ok) +
+             std::lround(KadeDB_ResultSet_GetDouble(rs, 1, &ok));
+    benchmark::DoNotOptimize(sum);
+    KadeDB_DestroyResultSet(rs);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_FfiQueryRoundTrip)->Apply(sizes)->Unit(benchmark::kMicrosecond);
+
+// A prepared point lookup with its id bound per call
+static void BM_FfiPreparedPoint(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  FfiTable t;
+  const FfiRows rows(n);
+  KadeDB_InsertRows(t.storage, "t", rows.rows.data(), rows.rows.size());
+  KadeDB_Statement *stmt =
+      KadeDB_Prepare(t.storage, "SELECT * FROM t WHERE id = ?");
+  if (!stmt) {
+    state.SkipWithError("KadeDB_Prepare failed");
+    return;
+  }
+  KDB_Value param;
+  param.type = KDB_VAL_INTEGER;
+  param.as.i64 = 0;
+  for (auto _ : state) {
+    param.as.i64 = (param.as.i64 + 7919) % n;
+    KadeDB_ResultSet *rs = KadeDB_ExecutePrepared(t.storage, stmt, &param, 1);
+    if (!rs) {
+      state.SkipWithError("KadeDB_ExecutePrepared failed");
+      break;
+    }
+    benchmark::DoNotOptimize(KadeDB_ResultSet_NextRow(rs));
+    KadeDB_DestroyResultSet(rs);
+  }
+  KadeDB_DestroyStatement(stmt);
+}
+BENCHMARK(BM_FfiPreparedPoint)->Apply(sizes);
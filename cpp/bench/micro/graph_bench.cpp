@@ -0,0 +1,48 @@
+#include "micro_fixtures.h"
+
+using namespace kadedb;
+using namespace kadedb::bench;
+
+// Full traversal from node 0 of a graph of N nodes and 4N edges
+static void BM_GraphBfs(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  InMemoryGraphStorage gs;
+  fillGraph(gs, n);
+  for (auto _ : state) {
+    auto res = gs.bfs("g", 0, 0);
+    if (failed(state, res.status()))
+      return;
+    benchmark::DoNotOptimize(res.value().size());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_GraphBfs)->Apply(sizes)->Unit(benchmark::kMicrosecond);
+
+// The same traversal over the CSR snapshot
+static void BM_GraphParallelBfs(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  InMemoryGraphStorage gs;
+  fillGraph(gs, n);
+  for (auto _ : state) {
+    auto res = gs.parallelBfs("g", 0);
+    if (failed(state, res.status()))
+      return;
+    benchmark::DoNotOptimize(res.value().size());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_GraphParallelBfs)->Apply(sizes)->Unit(benchmark::kMicrosecond);
+
+// Fewest-edge path between the first and last node
+static void BM_GraphShortestPath(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  InMemoryGraphStorage gs;
+  fillGraph(gs, n);
+  for (auto _ : state) {
+    auto res = gs.shortestPath("g", 0, n - 1);
+    if (failed(state, res.status()))
+      return;
+    benchmark::DoNotOptimize(res.value().size());
+  }
+}
+BENCHMARK(BM_GraphShortestPath)->Apply(sizes)->Unit(benchmark::kMicrosecond);
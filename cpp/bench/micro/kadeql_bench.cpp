@@ -0,0 +1,78 @@
+#include "micro_fixtures.h"
+
+#include "kadedb/kadeql.h"
+#include "kadedb/prepared_statement.h"
+#include "kadedb/query_executor.h"
+
+using namespace kadedb;
+using namespace kadedb::bench;
+
+static const char *const kQuery =
+    "SELECT id, y FROM t WHERE x < 100000 AND name != 'name_7' "
+    "ORDER BY y DESC LIMIT 10";
+
+// Tokenize and parse one statement into its AST
+static void BM_KadeqlParse(benchmark::State &state) {
+  const std::string query = kQuery;
+  for (auto _ : state) {
+    auto stmt = kadeql::parseQuery(query);
+    benchmark::DoNotOptimize(stmt.get());
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(query.size()));
+}
+BENCHMARK(BM_KadeqlParse);
+
+// Plan the parsed statement without running it (EXPLAIN) over N rows
+static void BM_KadeqlPlan(benchmark::State &state) {
+  InMemoryRelationalStorage rel;
+  fillRelational(rel, state.range(0));
+  kadeql::QueryExecutor exec(rel);
+  auto stmt = kadeql::parseQuery(std::string("EXPLAIN ") + kQuery);
+  for (auto _ : state) {
+    auto res = exec.execute(*stmt);
+    if (failed(state, res.status()))
+      return;
+    benchmark::DoNotOptimize(res.value().rowCount());
+  }
+}
+BENCHMARK(BM_KadeqlPlan)->Apply(sizes);
+
+// Run the parsed statement over N rows
+static void BM_KadeqlExecute(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  InMemoryRelationalStorage rel;
+  fillRelational(rel, n);
+  kadeql::QueryExecutor exec(rel);
+  auto stmt = kadeql::parseQuery(kQuery);
+  for (auto _ : state) {
+    auto res = exec.execute(*stmt);
+    if (failed(state, res.status()))
+      return;
+    benchmark::DoNotOptimize(res.value().rowCount());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_KadeqlExecute)->Apply(sizes)->Unit(benchmark::kMicrosecond);
+
+// A prepared point lookup with its id bound per execution
+static void BM_KadeqlPreparedPoint(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  InMemoryRelationalStorage rel;
+  fillRelational(rel, n);
+  kadeql::QueryExecutor exec(rel);
+  auto ps = kadeql::PreparedStatement::prepare("SELECT * FROM t WHERE id = ?");
+  if (failed(state, ps.status()))
+    return;
+  std::vector<std::unique_ptr<Value>> params(1);
+  int64_t id = 0;
+  for (auto _ : state) {
+    params[0] = ValueFactory::createInteger(id);
+    id = (id + 7919) % n;
+    auto res = ps.value()->execute(exec, params);
+    if (failed(state, res.status()))
+      return;
+    benchmark::DoNotOptimize(res.value().rowCount());
+  }
+}
+BENCHMARK(BM_KadeqlPreparedPoint)->Apply(sizes);
@@ -0,0 +1,147 @@
+#pragma once
+
+// Data shared by the microbenchmarks: the same seeded tables, series and
+// graphs every run, so numbers from two builds compare.
+
+#include "kadedb/graph/storage.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/value.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace kadedb {
+namespace bench {
+
+// Seed of every generated data set
+constexpr uint64_t kSeed = 42;
+
+// Data sizes the size-parameterized benchmarks run at
+inline void sizes(benchmark::internal::Benchmark *b) {
+  b->RangeMultiplier(10)->Range(1000, 100000);
+}
+
+// Table "t" (id INTEGER PRIMARY KEY, x INTEGER, y FLOAT, name STRING) with
+// x uniform in [0, 1000000)
+inline TableSchema relationalSchema() {
+  Column id{"id", ColumnType::Integer, false, true, {}};
+  Column x{"x", ColumnType::Integer, false, false, {}};
+  Column y{"y", ColumnType::Float, false, false, {}};
+  Column name{"name", ColumnType::String, false, false, {}};
+  return TableSchema({id, x, y, name}, std::optional<std::string>("id"));
+}
+
+inline std::vector<Row> relationalRows(int64_t n) {
+  std::mt19937_64 rng(kSeed);
+  std::uniform_int_distribution<int64_t> xd(0, 999999);
+  std::uniform_real_distribution<double> yd(0.0, 1.0);
+  std::vector<Row> rows;
+  rows.reserve(static_cast<size_t>(n));
+  for (int64_t i = 0; i < n; ++i) {
+    Row r(4);
+    r.set(0, ValueFactory::createInteger(i));
+    r.set(1, ValueFactory::createInteger(xd(rng)));
+    r.set(2, ValueFactory::createFloat(yd(rng)));
+    r.set(3, ValueFactory::createString("name_" + std::to_string(i % 1000)));
+    rows.push_back(std::move(r));
+  }
+  return rows;
+}
+
+inline void fillRelational(InMemoryRelationalStorage &rel, int64_t n) {
+  (void)rel.createTable("t", relationalSchema());
+  (void)rel.insertRows("t", relationalRows(n));
+}
+
+// x < limit: a tenth of the rows per 100000
+inline Predicate xBelow(int64_t limit) {
+  Predicate p;
+  p.kind = Predicate::Kind::Comparison;
+  p.column = "x";
+  p.op = Predicate::Op::Lt;
+  p.rhs = ValueFactory::createInteger(limit);
+  return p;
+}
+
+// Documents {age INTEGER in [0, 100), city STRING, score FLOAT}
+inline std::vector<Document> documents(int64_t n) {
+  std::mt19937_64 rng(kSeed);
+  std::uniform_int_distribution<int64_t> age(0, 99);
+  std::uniform_real_distribution<double> score(0.0, 100.0);
+  std::vector<Document> docs;
+  docs.reserve(static_cast<size_t>(n));
+  for (int64_t i = 0; i < n; ++i) {
+    Document d;
+    d["age"] = ValueFactory::createInteger(age(rng));
+    d["city"] = ValueFactory::createString("city_" + std::to_string(i % 50));
+    d["score"] = ValueFactory::createFloat(score(rng));
+    docs.push_back(std::move(d));
+  }
+  return docs;
+}
+
+// Series "s" (timestamp, value FLOAT) at one point per second
+constexpr int64_t kBaseTs = 1700000000;
+
+inline TimeSeriesSchema seriesSchema() {
+  TimeSeriesSchema s("timestamp", TimeGranularity::Seconds);
+  s.addValueColumn(Column{"value", ColumnType::Float, false, false, {}});
+  return s;
+}
+
+inline std::vector<Row> seriesRows(int64_t n) {
+  std::mt19937_64 rng(kSeed);
+  std::uniform_real_distribution<double> vd(0.0, 1.0);
+  std::vector<Row> rows;
+  rows.reserve(static_cast<size_t>(n));
+  for (int64_t i = 0; i < n; ++i) {
+    Row r(2);
+    r.set(0, ValueFactory::createInteger(kBaseTs + i));
+    r.set(1, ValueFactory::createFloat(vd(rng)));
+    rows.push_back(std::move(r));
+  }
+  return rows;
+}
+
+inline void fillSeries(InMemoryTimeSeriesStorage &ts, int64_t n) {
+  (void)ts.createSeries("s", seriesSchema(), TimePartition::Hourly);
+  (void)ts.appendBatch("s", seriesRows(n));
+}
+
+// Graph "g" of n nodes and 4n random edges
+inline void fillGraph(InMemoryGraphStorage &gs, int64_t n) {
+  (void)gs.createGraph("g");
+  for (NodeId i = 0; i < n; ++i) {
+    Node node;
+    node.id = i;
+    (void)gs.putNode("g", node);
+  }
+  std::mt19937_64 rng(kSeed);
+  std::uniform_int_distribution<NodeId> pick(0, n - 1);
+  for (EdgeId e = 0; e < 4 * n; ++e) {
+    Edge edge;
+    edge.id = e;
+    edge.from = pick(rng);
+    edge.to = pick(rng);
+    edge.type = "LINK";
+    (void)gs.putEdge("g", edge);
+  }
+}
+
+// Ends the benchmark with the failure's message
+inline bool failed(benchmark::State &state, const Status &st) {
+  if (st.ok())
+    return false;
+  state.SkipWithError(st.message().c_str());
+  return true;
+}
+
+} // namespace bench
+} // namespace kadedb
@@ -0,0 +1,115 @@
+#include "micro_fixtures.h"
+
+#include <unordered_map>
+
+using namespace kadedb;
+using namespace kadedb::bench;
+
+// N rows one insertRow() at a time into an empty table
+static void BM_RelationalInsert(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  const std::vector<Row> rows = relationalRows(n);
+  for (auto _ : state) {
+    state.PauseTiming();
+    InMemoryRelationalStorage rel;
+    (void)rel.createTable("t", relationalSchema());
+    state.ResumeTiming();
+    for (const Row &row : rows)
+      if (failed(state, rel.insertRow("t", row)))
+        return;
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_RelationalInsert)->Apply(sizes)->Unit(benchmark::kMillisecond);
+
+// N rows as one insertRows() batch
+static void BM_RelationalInsertBatch(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  const std::vector<Row> rows = relationalRows(n);
+  for (auto _ : state) {
+    state.PauseTiming();
+    InMemoryRelationalStorage rel;
+    (void)rel.createTable("t", relationalSchema());
+    state.ResumeTiming();
+    if (failed(state, rel.insertRows("t", rows)))
+      return;
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_RelationalInsertBatch)
+    ->Apply(sizes)
+    ->Unit(benchmark::kMillisecond);
+
+// Filtered full scan keeping a tenth of N rows
+static void BM_RelationalSelect(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  InMemoryRelationalStorage rel;
+  fillRelational(rel, n);
+  const std::optional<Predicate> where = xBelow(100000);
+  for (auto _ : state) {
+    auto res = rel.select("t", {}, where);
+    if (failed(state, res.status()))
+      return;
+    benchmark::DoNotOptimize(res.value().rowCount());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_RelationalSelect)->Apply(sizes)->Unit(benchmark::kMicrosecond);
+
+// Point lookup of one id through the primary key
+static void BM_RelationalSelectPoint(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  InMemoryRelationalStorage rel;
+  fillRelational(rel, n);
+  Predicate p;
+  p.column = "id";
+  p.op = Predicate::Op::Eq;
+  p.rhs = ValueFactory::createInteger(n / 2);
+  const std::optional<Predicate> where = std::move(p);
+  for (auto _ : state) {
+    auto res = rel.select("t", {}, where);
+    if (failed(state, res.status()))
+      return;
+    benchmark::DoNotOptimize(res.value().rowCount());
+  }
+}
+BENCHMARK(BM_RelationalSelectPoint)->Apply(sizes);
+
+// Constant assignment to a tenth of N rows
+static void BM_RelationalUpdate(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  InMemoryRelationalStorage rel;
+  fillRelational(rel, n);
+  const std::optional<Predicate> where = xBelow(100000);
+  std::unordered_map<std::string, AssignmentValue> set;
+  set["y"].constant = ValueFactory::createFloat(0.5);
+  for (auto _ : state) {
+    auto res = rel.updateRows("t", set, where);
+    if (failed(state, res.status()))
+      return;
+    benchmark::DoNotOptimize(res.value());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_RelationalUpdate)->Apply(sizes)->Unit(benchmark::kMicrosecond);
+
+// Deleting half of N rows; the table is refilled untimed between runs
+static void BM_RelationalDelete(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  const std::vector<Row> rows = relationalRows(n);
+  InMemoryRelationalStorage rel;
+  (void)rel.createTable("t", relationalSchema());
+  const std::optional<Predicate> where = xBelow(500000);
+  for (auto _ : state) {
+    state.PauseTiming();
+    (void)rel.truncateTable("t");
+    (void)rel.insertRows("t", rows);
+    state.ResumeTiming();
+    auto res = rel.deleteRows("t", where);
+    if (failed(state, res.status()))
+      return;
+    benchmark::DoNotOptimize(res.value());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_RelationalDelete)->Apply(sizes)->Unit(benchmark::kMicrosecond);
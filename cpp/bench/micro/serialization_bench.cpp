@@ -0,0 +1,51 @@
+#include "micro_fixtures.h"
+
+#include "kadedb/serialization.h"
+
+#include <sstream>
+
+using namespace kadedb;
+using namespace kadedb::bench;
+
+// One row through the binary stream format and back
+static void BM_SerializationRowRoundTrip(benchmark::State &state) {
+  const Row row = std::move(relationalRows(1)[0]);
+  for (auto _ : state) {
+    std::ostringstream os;
+    bin::writeRow(row, os);
+    std::istringstream is(os.str());
+    Row back = bin::readRow(is);
+    benchmark::DoNotOptimize(back.size());
+  }
+}
+BENCHMARK(BM_SerializationRowRoundTrip);
+
+// N rows as one columnar batch and back
+static void BM_SerializationRowBatchRoundTrip(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  const std::vector<Row> rows = relationalRows(n);
+  std::string buf;
+  for (auto _ : state) {
+    buf.clear();
+    bin::writeRowBatch(rows, buf);
+    std::vector<Row> back = bin::readRowBatch(buf.data(), buf.size());
+    benchmark::DoNotOptimize(back.size());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.counters["bytes_per_row"] =
+      static_cast<double>(buf.size()) / static_cast<double>(n);
+}
+BENCHMARK(BM_SerializationRowBatchRoundTrip)
+    ->Apply(sizes)
+    ->Unit(benchmark::kMicrosecond);
+
+// One document through JSON and back
+static void BM_SerializationDocumentJson(benchmark::State &state) {
+  const Document doc = std::move(documents(1)[0]);
+  for (auto _ : state) {
+    std::string json = json::toJson(doc);
+    Document back = json::documentFromJson(json);
+    benchmark::DoNotOptimize(back.size());
+  }
+}
+BENCHMARK(BM_SerializationDocumentJson);
@@ -0,0 +1,57 @@
+#include "micro_fixtures.h"
+
+using namespace kadedb;
+using namespace kadedb::bench;
+
+// N points appended one at a time to an empty series
+static void BM_TimeSeriesAppend(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  const std::vector<Row> rows = seriesRows(n);
+  for (auto _ : state) {
+    state.PauseTiming();
+    InMemoryTimeSeriesStorage ts;
+    (void)ts.createSeries("s", seriesSchema(), TimePartition::Hourly);
+    state.ResumeTiming();
+    for (const Row &row : rows)
+      if (failed(state, ts.append("s", row)))
+        return;
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_TimeSeriesAppend)->Apply(sizes)->Unit(benchmark::kMillisecond);
+
+// The middle half of a series of N points
+static void BM_TimeSeriesRangeQuery(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  InMemoryTimeSeriesStorage ts;
+  fillSeries(ts, n);
+  for (auto _ : state) {
+    auto res =
+        ts.rangeQuery("s", {}, kBaseTs + n / 4, kBaseTs + 3 * n / 4, {});
+    if (failed(state, res.status()))
+      return;
+    benchmark::DoNotOptimize(res.value().rowCount());
+  }
+  state.SetItemsProcessed(state.iterations() * (n / 2));
+}
+BENCHMARK(BM_TimeSeriesRangeQuery)
+    ->Apply(sizes)
+    ->Unit(benchmark::kMicrosecond);
+
+// Per-minute averages over the whole series of N points
+static void BM_TimeSeriesAggregate(benchmark::State &state) {
+  const int64_t n = state.range(0);
+  InMemoryTimeSeriesStorage ts;
+  fillSeries(ts, n);
+  for (auto _ : state) {
+    auto res = ts.aggregate("s", "value", TimeAggregation::Avg, kBaseTs,
+                            kBaseTs + n, 60, TimeGranularity::Seconds, {});
+    if (failed(state, res.status()))
+      return;
+    benchmark::DoNotOptimize(res.value().rowCount());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_TimeSeriesAggregate)
+    ->Apply(sizes)
+    ->Unit(benchmark::kMicrosecond);
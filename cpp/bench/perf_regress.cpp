@@ -0,0 +1,394 @@
+// Performance regression harness: runs the query_bench scenarios over a
+// fixed matrix of table sizes, writes the results as a JSON baseline and
+// compares a run against an earlier baseline.
+//
+//   kadedb_perf_regress [--rows=1000000,10000000] [--repetitions=5]
+//                       [--out=FILE] [--baseline=FILE] [--threshold=0.10]
+//                       [--cpu=N]
+//
+// A baseline holds one JSON document (KadeDB's json::toJson format) per
+// line: a "meta" line describing the machine, then one line per scenario
+// with its throughput (rows per second, from the median run) and p99
+// latency (milliseconds per sample). With --baseline the exit status is 1
+// when a scenario's throughput dropped or its p99 grew by more than the
+// threshold (a fraction), 2 on bad arguments or files, 0 otherwise.
+//
+// --cpu pins the process to one CPU (Linux). The frequency governor cannot
+// be changed without privileges, so it is only recorded and a warning is
+// printed unless it is "performance".
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "kadedb/kadeql.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/schema.h"
+#include "kadedb/serialization.h"
+#include "kadedb/storage.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/value.h"
+
+using namespace kadedb;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Rows generated and inserted per timed chunk
+constexpr int64_t kChunkRows = 4096;
+constexpr int64_t kBaseTs = 1700000000;
+
+struct Options {
+  std::vector<int64_t> rows{1000000, 10000000};
+  int repetitions = 5;
+  std::string out;
+  std::string baseline;
+  double threshold = 0.10;
+  int cpu = -1;
+};
+
+struct Measurement {
+  std::string name;
+  int64_t rows = 0;
+  double throughput = 0; // rows per second
+  double p99Ms = 0;
+};
+
+template <class Fun> double timeMs(Fun &&f) {
+  const auto start = Clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+double median(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  const size_t mid = v.size() / 2;
+  return v.size() % 2 ? v[mid] : (v[mid - 1] + v[mid]) / 2;
+}
+
+// Nearest-rank percentile
+double percentile(std::vector<double> v, double p) {
+  std::sort(v.begin(), v.end());
+  size_t rank = static_cast<size_t>(p / 100.0 * v.size() + 0.999999);
+  rank = std::min(std::max<size_t>(rank, 1), v.size());
+  return v[rank - 1];
+}
+
+[[noreturn]] void fail(const std::string &what) {
+  std::cerr << "kadedb_perf_regress: " << what << "\n";
+  std::exit(2);
+}
+
+void check(const Status &st, const char *what) {
+  if (!st.ok())
+    fail(std::string(what) + " failed: " + st.message());
+}
+
+bool parseOptions(int argc, char **argv, Options &opt) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const size_t eq = arg.find('=');
+    const std::string key = arg.substr(0, eq);
+    const std::string val = eq == std::string::npos ? "" : arg.substr(eq + 1);
+    try {
+      if (key == "--rows") {
+        opt.rows.clear();
+        std::stringstream ss(val);
+        for (std::string item; std::getline(ss, item, ',');)
+          opt.rows.push_back(std::stoll(item));
+      } else if (key == "--repetitions") {
+        opt.repetitions = std::stoi(val);
+      } else if (key == "--out") {
+        opt.out = val;
+      } else if (key == "--baseline") {
+        opt.baseline = val;
+      } else if (key == "--threshold") {
+        opt.threshold = std::stod(val);
+      } else if (key == "--cpu") {
+        opt.cpu = std::stoi(val);
+      } else {
+        return false;
+      }
+    } catch (...) {
+      return false;
+    }
+  }
+  if (opt.rows.empty() || opt.repetitions < 1 || opt.threshold < 0)
+    return false;
+  for (int64_t n : opt.rows)
+    if (n < 1)
+      return false;
+  return true;
+}
+
+// Current frequency governor of `cpu`, or "unknown"
+std::string governor(int cpu) {
+  std::ifstream in("/sys/devices/system/cpu/cpu" +
+                   std::to_string(std::max(cpu, 0)) +
+                   "/cpufreq/scaling_governor");
+  std::string g;
+  if (!(in >> g))
+    return "unknown";
+  return g;
+}
+
+void pinToCpu(int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) != 0)
+    fail("cannot pin to CPU " + std::to_string(cpu));
+#else
+  (void)cpu;
+  std::cerr << "warning: --cpu is only supported on Linux; not pinned\n";
+#endif
+}
+
+TableSchema relSchema() {
+  Column id{"id", ColumnType::Integer, false, true, {}};
+  Column x{"x", ColumnType::Integer, false, false, {}};
+  Column y{"y", ColumnType::Float, false, false, {}};
+  return TableSchema({id, x, y}, std::optional<std::string>("id"));
+}
+
+TimeSeriesSchema tsSchema() {
+  TimeSeriesSchema s("timestamp", TimeGranularity::Seconds);
+  s.addValueColumn(Column{"value", ColumnType::Float, false, false, {}});
+  return s;
+}
+
+Measurement fromSamples(const std::string &scenario, int64_t rows,
+                        double totalMs, const std::vector<double> &samples) {
+  Measurement m;
+  m.name = scenario + "/" + std::to_string(rows);
+  m.rows = rows;
+  m.throughput = totalMs > 0 ? rows / (totalMs / 1000.0) : 0;
+  m.p99Ms = percentile(samples, 99);
+  return m;
+}
+
+// A query over all `rows` rows, run `reps` times: throughput from the
+// median run, p99 over the runs
+template <class Fun>
+Measurement repeated(const std::string &scenario, int64_t rows, int reps,
+                     Fun &&run) {
+  std::vector<double> samples;
+  for (int r = 0; r < reps; ++r)
+    samples.push_back(timeMs(run));
+  return fromSamples(scenario, rows, median(samples), samples);
+}
+
+void runMatrix(int64_t n, int reps, std::vector<Measurement> &out) {
+  std::mt19937_64 rng(42);
+  std::uniform_int_distribution<int64_t> xd(0, 1000000);
+  std::uniform_real_distribution<double> yd(0.0, 1.0);
+
+  // ---- Relational: chunked insert, filtered select, computed update ----
+  {
+    InMemoryRelationalStorage rel;
+    check(rel.createTable("t", relSchema()), "createTable");
+    std::vector<double> samples;
+    double total = 0;
+    for (int64_t i = 0; i < n; i += kChunkRows) {
+      std::vector<Row> chunk;
+      for (int64_t j = i; j < std::min(n, i + kChunkRows); ++j) {
+        Row r(3);
+        r.set(0, ValueFactory::createInteger(j));
+        r.set(1, ValueFactory::createInteger(xd(rng)));
+        r.set(2, ValueFactory::createFloat(yd(rng)));
+        chunk.push_back(std::move(r));
+      }
+      const double ms =
+          timeMs([&] { check(rel.insertRows("t", chunk), "insertRows"); });
+      samples.push_back(ms);
+      total += ms;
+    }
+    out.push_back(fromSamples("relational.insert", n, total, samples));
+
+    Predicate pred;
+    pred.column = "x";
+    pred.op = Predicate::Op::Lt;
+    pred.rhs = ValueFactory::createInteger(100000); // ~10% selectivity
+    const std::optional<Predicate> where = std::move(pred);
+    out.push_back(repeated("relational.select", n, reps, [&] {
+      auto res = rel.select("t", {}, where);
+      check(res.status(), "select");
+    }));
+
+    kadeql::QueryExecutor exec(rel);
+    auto update = kadeql::parseQuery("UPDATE t SET y = y * 1.1 + x");
+    out.push_back(repeated("relational.update", n, reps, [&] {
+      check(exec.execute(*update).status(), "update");
+    }));
+  }
+
+  // ---- Time series: chunked append, full range, per-minute sum ----
+  {
+    InMemoryTimeSeriesStorage ts;
+    check(ts.createSeries("s", tsSchema(), TimePartition::Hourly),
+          "createSeries");
+    std::vector<double> samples;
+    double total = 0;
+    for (int64_t i = 0; i < n; i += kChunkRows) {
+      std::vector<Row> chunk;
+      for (int64_t j = i; j < std::min(n, i + kChunkRows); ++j) {
+        Row r(2);
+        r.set(0, ValueFactory::createInteger(kBaseTs + j));
+        r.set(1, ValueFactory::createFloat(yd(rng)));
+        chunk.push_back(std::move(r));
+      }
+      const double ms =
+          timeMs([&] { check(ts.appendBatch("s", chunk), "appendBatch"); });
+      samples.push_back(ms);
+      total += ms;
+    }
+    out.push_back(fromSamples("timeseries.append", n, total, samples));
+
+    out.push_back(repeated("timeseries.range", n, reps, [&] {
+      check(ts.rangeQuery("s", {}, kBaseTs, kBaseTs + n, std::nullopt)
+                .status(),
+            "rangeQuery");
+    }));
+    out.push_back(repeated("timeseries.aggregate", n, reps, [&] {
+      check(ts.aggregate("s", "value", TimeAggregation::Sum, kBaseTs,
+                         kBaseTs + n, 60, TimeGranularity::Seconds,
+                         std::nullopt)
+                .status(),
+            "aggregate");
+    }));
+  }
+}
+
+void writeResults(const std::string &path, const Options &opt,
+                  const std::string &gov,
+                  const std::vector<Measurement> &results) {
+  std::ofstream os(path);
+  if (!os)
+    fail("cannot write " + path);
+  Document meta;
+  meta["kind"] = ValueFactory::createString("meta");
+  meta["repetitions"] = ValueFactory::createInteger(opt.repetitions);
+  meta["cpu"] = ValueFactory::createInteger(opt.cpu);
+  meta["governor"] = ValueFactory::createString(gov);
+  os << json::toJson(meta) << "\n";
+  for (const auto &m : results) {
+    Document d;
+    d["kind"] = ValueFactory::createString("result");
+    d["name"] = ValueFactory::createString(m.name);
+    d["rows"] = ValueFactory::createInteger(m.rows);
+    d["throughput"] = ValueFactory::createFloat(m.throughput);
+    d["p99_ms"] = ValueFactory::createFloat(m.p99Ms);
+    os << json::toJson(d) << "\n";
+  }
+  if (!os)
+    fail("cannot write " + path);
+}
+
+std::map<std::string, Measurement> readBaseline(const std::string &path) {
+  std::ifstream in(path);
+  if (!in)
+    fail("cannot read " + path);
+  std::map<std::string, Measurement> out;
+  size_t lineNo = 0;
+  for (std::string line; std::getline(in, line);) {
+    ++lineNo;
+    if (line.empty())
+      continue;
+    try {
+      Document d = json::documentFromJson(line);
+      auto kind = d.find("kind");
+      if (kind == d.end() || !kind->second ||
+          kind->second->asString() != "result")
+        continue;
+      Measurement m;
+      m.name = d.at("name")->asString();
+      m.rows = d.at("rows")->asInt();
+      m.throughput = d.at("throughput")->asFloat();
+      m.p99Ms = d.at("p99_ms")->asFloat();
+      out[m.name] = m;
+    } catch (const std::exception &e) {
+      fail(path + ":" + std::to_string(lineNo) + ": " + e.what());
+    }
+  }
+  return out;
+}
+
+// Print each scenario next to its baseline; true when any regressed
+bool compare(const std::map<std::string, Measurement> &baseline,
+             const std::vector<Measurement> &results, double threshold) {
+  bool regressed = false;
+  std::cout << "\nComparison against baseline (threshold " << std::fixed
+            << std::setprecision(1) << threshold * 100 << "%):\n";
+  for (const auto &m : results) {
+    auto it = baseline.find(m.name);
+    std::cout << "  " << std::left << std::setw(34) << m.name << std::right;
+    if (it == baseline.end()) {
+      std::cout << " new\n";
+      continue;
+    }
+    const Measurement &b = it->second;
+    const double dThroughput =
+        b.throughput > 0 ? m.throughput / b.throughput - 1 : 0;
+    const double dP99 = b.p99Ms > 0 ? m.p99Ms / b.p99Ms - 1 : 0;
+    const bool bad = dThroughput < -threshold || dP99 > threshold;
+    regressed = regressed || bad;
+    std::cout << std::showpos << " throughput " << std::setw(7)
+              << dThroughput * 100 << "%  p99 " << std::setw(7) << dP99 * 100
+              << "%" << std::noshowpos << (bad ? "  REGRESSION" : "")
+              << "\n";
+  }
+  return regressed;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options opt;
+  if (!parseOptions(argc, argv, opt)) {
+    std::cerr << "usage: kadedb_perf_regress [--rows=N[,N...]] "
+                 "[--repetitions=N] [--out=FILE] [--baseline=FILE] "
+                 "[--threshold=F] [--cpu=N]\n";
+    return 2;
+  }
+  if (opt.cpu >= 0)
+    pinToCpu(opt.cpu);
+  const std::string gov = governor(opt.cpu);
+  if (gov != "performance")
+    std::cerr << "warning: CPU frequency governor is '" << gov
+              << "', not 'performance'; results may be noisy\n";
+
+  std::vector<Measurement> results;
+  for (int64_t n : opt.rows)
+    runMatrix(n, opt.repetitions, results);
+
+  std::cout << "KadeDB perf regression (" << opt.repetitions
+            << " repetitions, governor " << gov << ")\n";
+  for (const auto &m : results)
+    std::cout << "  " << std::left << std::setw(34) << m.name << std::right
+              << std::fixed << std::setprecision(0) << std::setw(14)
+              << m.throughput << " rows/s  p99 " << std::setprecision(2)
+              << std::setw(10) << m.p99Ms << " ms\n";
+
+  if (!opt.out.empty())
+    writeResults(opt.out, opt, gov, results);
+  if (!opt.baseline.empty() &&
+      compare(readBaseline(opt.baseline), results, opt.threshold))
+    return 1;
+  return 0;
+}
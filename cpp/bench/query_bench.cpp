@@ -6,6 +6,8 @@
 #include <string>
 #include <vector>
 
+#include "kadedb/kadeql.h"
+#include "kadedb/query_executor.h"
 #include "kadedb/schema.h"
 #include "kadedb/storage.h"
 #include "kadedb/timeseries/storage.h"
@@ -97,11 +99,24 @@ int main(int argc, char **argv) {
     (void)sink;
   });
 
+  // Computed assignment over every row (compiled expression per row)
+  kadeql::QueryExecutor exec(rel);
+  auto update = kadeql::parseQuery("UPDATE t SET y = y * 1.1 + x");
+  double ms_update_rel = time_ms([&]() {
+    auto res = exec.execute(*update);
+    if (!res.hasValue()) {
+      std::cerr << "update failed: " << res.status().message() << "\n";
+      std::exit(1);
+    }
+  });
+
   std::cout << "Relational:\n";
   std::cout << "  insert ms: " << std::fixed << std::setprecision(2)
             << ms_insert_rel << "\n";
   std::cout << "  select  ms: " << std::fixed << std::setprecision(2)
-            << ms_select_rel << "\n\n";
+            << ms_select_rel << "\n";
+  std::cout << "  update  ms: " << std::fixed << std::setprecision(2)
+            << ms_update_rel << "\n\n";
 
   // ---- Time-series range + aggregation ----
   InMemoryTimeSeriesStorage ts;
@@ -188,6 +188,69 @@ int main() {
   std::cout << "  Binary   ser: " << r_b_ser << ", de: " << r_b_de << "\n";
   std::cout << "  JSON     ser: " << r_j_ser << ", de: " << r_j_de << "\n\n";
 
+  // Rows one at a time vs. one columnar batch
+  std::vector<Row> batch;
+  for (size_t i = 0; i < N; ++i)
+    batch.push_back(sampleRow());
+  double rs_b_ser = time_ms(iters, [&]() {
+    std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+    for (auto &row : batch)
+      bin::writeRow(row, ss);
+  });
+  double rs_b_de = time_ms(iters, [&]() {
+    std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+    for (auto &row : batch)
+      bin::writeRow(row, ss);
+    ss.seekg(0);
+    for (size_t i = 0; i < batch.size(); ++i)
+      (void)bin::readRow(ss);
+  });
+  double rb_ser = time_ms(iters, [&]() {
+    std::string buf;
+    bin::writeRowBatch(batch, buf);
+  });
+  double rb_de = time_ms(iters, [&]() {
+    std::string buf;
+    bin::writeRowBatch(batch, buf);
+    (void)bin::readRowBatch(buf.data(), buf.size());
+  });
+
+  std::cout << "Rows (N per iter):\n";
+  std::cout << "  Row-wise ser: " << rs_b_ser << ", de: " << rs_b_de << "\n";
+  std::cout << "  Batch    ser: " << rb_ser << ", de: " << rb_de << "\n\n";
+
+  // Documents: a string per call vs. one reused buffer
+  std::vector<Document> docs(N);
+  for (size_t i = 0; i < N; ++i) {
+    docs[i]["id"] = ValueFactory::createInteger(static_cast<int64_t>(i));
+    docs[i]["name"] = ValueFactory::createString("patient \"" +
+                                                 std::to_string(i) + "\"");
+    docs[i]["score"] = ValueFactory::createFloat(i * 0.37);
+    docs[i]["active"] = ValueFactory::createBoolean(i % 2 == 0);
+    docs[i]["note"] = nullptr;
+  }
+  std::vector<std::string> d_json;
+  double d_ser = time_ms(iters, [&]() {
+    d_json.clear();
+    for (auto &d : docs)
+      d_json.push_back(json::toJson(d));
+  });
+  std::string d_buf;
+  double d_app = time_ms(iters, [&]() {
+    for (auto &d : docs) {
+      d_buf.clear();
+      json::appendJson(d, d_buf);
+    }
+  });
+  double d_de = time_ms(iters, [&]() {
+    for (auto &s : d_json)
+      (void)json::documentFromJson(s);
+  });
+
+  std::cout << "Documents (N per iter):\n";
+  std::cout << "  JSON     ser: " << d_ser << ", append: " << d_app
+            << ", de: " << d_de << "\n\n";
+
   // TableSchema
   TableSchema ts = sampleTableSchema();
   double ts_b_ser = time_ms(iters * 1000, [&]() {
@@ -0,0 +1,412 @@
+// TSBS-style macro benchmark: ingests a generated use case into one series
+// from several threads at once, then runs the use case's query suite from
+// several threads and reports throughput and latency percentiles.
+//
+//   kadedb_tsbs_bench [--use-case=devops|iot] [--scale=100] [--hours=6]
+//                     [--interval=10] [--batch=1000] [--workers=N]
+//                     [--queries=100] [--seed=42]
+//
+// devops: `scale` hosts reporting the ten cpu metrics of TSBS's cpu-only
+//   data set every `interval` seconds, tagged by hostname. Queries:
+//     single-groupby-1-1-1  max usage_user per minute, one host, one hour
+//     cpu-max-all-1         max of every metric per hour, one host, 8 hours
+//     high-cpu-1            readings of one host with usage_user > 90
+//     lastpoint             every reading of the last interval
+// iot: `scale` trucks in ten fleets reporting position, speed, fuel and
+//   load, tagged by truck name and fleet. Queries:
+//     last-loc              readings of one truck in the last five minutes
+//     low-fuel              readings of one fleet with fuel_state < 0.1
+//     avg-load              average load per hour of one fleet
+//     daily-activity        moving readings per hour of one fleet
+//
+// Workers each own a share of the hosts or trucks and append their
+// readings in time order, `batch` rows per appendBatch() call.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/value.h"
+
+#include "latency_histogram.h"
+
+using namespace kadedb;
+using kadedb::bench::LatencyHistogram;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int64_t kStartTs = 1451606400; // 2016-01-01, as TSBS starts
+constexpr int kFleets = 10;
+
+struct Options {
+  std::string useCase = "devops";
+  int64_t scale = 100;
+  int64_t hours = 6;
+  int64_t interval = 10;
+  size_t batch = 1000;
+  size_t workers = std::max(1u, std::thread::hardware_concurrency());
+  int64_t queries = 100;
+  uint64_t seed = 42;
+
+  int64_t endTs() const { return kStartTs + hours * 3600; }
+  int64_t steps() const { return hours * 3600 / interval; }
+};
+
+// One generated data set: the series, how to make a row of a source at a
+// step, and the query suite
+struct UseCase {
+  std::string series;
+  TimeSeriesSchema schema;
+  std::function<Row(int64_t source, int64_t ts, std::mt19937_64 &)> row;
+  std::vector<std::pair<std::string,
+                        std::function<Status(std::mt19937_64 &)>>>
+      queries;
+};
+
+Predicate compare(const std::string &column, Predicate::Op op,
+                  std::unique_ptr<Value> rhs) {
+  Predicate p;
+  p.column = column;
+  p.op = op;
+  p.rhs = std::move(rhs);
+  return p;
+}
+
+Predicate both(Predicate a, Predicate b) {
+  Predicate p;
+  p.kind = Predicate::Kind::And;
+  p.children.push_back(std::move(a));
+  p.children.push_back(std::move(b));
+  return p;
+}
+
+std::string hostName(int64_t i) { return "host_" + std::to_string(i); }
+std::string truckName(int64_t i) { return "truck_" + std::to_string(i); }
+std::string fleetName(int64_t i) { return "fleet_" + std::to_string(i); }
+
+// Random start of a `span`-second window inside the data set (its start
+// when the data set is shorter)
+int64_t windowStart(const Options &opt, int64_t span, std::mt19937_64 &rng) {
+  const int64_t room = opt.endTs() - span - kStartTs;
+  if (room <= 0)
+    return kStartTs;
+  return kStartTs + static_cast<int64_t>(rng() % static_cast<uint64_t>(room));
+}
+
+const char *const kCpuMetrics[] = {
+    "usage_user",   "usage_system",  "usage_idle",  "usage_nice",
+    "usage_iowait", "usage_irq",     "usage_softirq", "usage_steal",
+    "usage_guest",  "usage_guest_nice"};
+
+UseCase devops(InMemoryTimeSeriesStorage &ts, const Options &opt) {
+  UseCase uc;
+  uc.series = "cpu";
+  uc.schema = TimeSeriesSchema("timestamp", TimeGranularity::Seconds);
+  uc.schema.addTagColumn(
+      Column{"hostname", ColumnType::String, true, false, {}});
+  for (const char *m : kCpuMetrics)
+    uc.schema.addValueColumn(Column{m, ColumnType::Float, true, false, {}});
+
+  uc.row = [](int64_t host, int64_t t, std::mt19937_64 &rng) {
+    Row r(12);
+    r.set(0, ValueFactory::createInteger(t));
+    r.set(1, ValueFactory::createString(hostName(host)));
+    std::uniform_real_distribution<double> pct(0.0, 100.0);
+    for (size_t i = 0; i < 10; ++i)
+      r.set(i + 2, ValueFactory::createFloat(pct(rng)));
+    return r;
+  };
+
+  auto host = [&opt](std::mt19937_64 &rng) {
+    return ValueFactory::createString(
+        hostName(static_cast<int64_t>(rng() % opt.scale)));
+  };
+  uc.queries.emplace_back(
+      "single-groupby-1-1-1", [&ts, &opt, host](std::mt19937_64 &rng) {
+        const int64_t from = windowStart(opt, 3600, rng);
+        return ts
+            .aggregate("cpu", "usage_user", TimeAggregation::Max, from,
+                       from + 3600, 60, TimeGranularity::Seconds,
+                       compare("hostname", Predicate::Op::Eq, host(rng)))
+            .status();
+      });
+  uc.queries.emplace_back(
+      "cpu-max-all-1", [&ts, &opt, host](std::mt19937_64 &rng) {
+        const int64_t from = windowStart(opt, 8 * 3600, rng);
+        const std::optional<Predicate> where =
+            compare("hostname", Predicate::Op::Eq, host(rng));
+        for (const char *m : kCpuMetrics) {
+          Status st = ts.aggregate("cpu", m, TimeAggregation::Max, from,
+                                   from + 8 * 3600, 3600,
+                                   TimeGranularity::Seconds, where)
+                          .status();
+          if (!st.ok())
+            return st;
+        }
+        return Status::OK();
+      });
+  uc.queries.emplace_back(
+      "high-cpu-1", [&ts, &opt, host](std::mt19937_64 &rng) {
+        return ts
+            .rangeQuery(
+                "cpu", {}, kStartTs, opt.endTs(),
+                both(compare("hostname", Predicate::Op::Eq, host(rng)),
+                     compare("usage_user", Predicate::Op::Gt,
+                             ValueFactory::createFloat(90.0))))
+            .status();
+      });
+  uc.queries.emplace_back("lastpoint", [&ts, &opt](std::mt19937_64 &) {
+    return ts
+        .rangeQuery("cpu", {}, opt.endTs() - opt.interval, opt.endTs(),
+                    std::nullopt)
+        .status();
+  });
+  return uc;
+}
+
+UseCase iot(InMemoryTimeSeriesStorage &ts, const Options &opt) {
+  UseCase uc;
+  uc.series = "readings";
+  uc.schema = TimeSeriesSchema("timestamp", TimeGranularity::Seconds);
+  uc.schema.addTagColumn(Column{"name", ColumnType::String, true, false, {}});
+  uc.schema.addTagColumn(Column{"fleet", ColumnType::String, true, false, {}});
+  for (const char *m : {"latitude", "longitude", "velocity", "fuel_state",
+                        "current_load"})
+    uc.schema.addValueColumn(Column{m, ColumnType::Float, true, false, {}});
+
+  uc.row = [](int64_t truck, int64_t t, std::mt19937_64 &rng) {
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    Row r(8);
+    r.set(0, ValueFactory::createInteger(t));
+    r.set(1, ValueFactory::createString(truckName(truck)));
+    r.set(2, ValueFactory::createString(fleetName(truck % kFleets)));
+    r.set(3, ValueFactory::createFloat(unit(rng) * 180.0 - 90.0));
+    r.set(4, ValueFactory::createFloat(unit(rng) * 360.0 - 180.0));
+    r.set(5, ValueFactory::createFloat(unit(rng) < 0.2 ? 0.0
+                                                        : unit(rng) * 100.0));
+    r.set(6, ValueFactory::createFloat(unit(rng)));
+    r.set(7, ValueFactory::createFloat(unit(rng)));
+    return r;
+  };
+
+  auto fleet = [](std::mt19937_64 &rng) {
+    return ValueFactory::createString(
+        fleetName(static_cast<int64_t>(rng() % kFleets)));
+  };
+  uc.queries.emplace_back("last-loc", [&ts, &opt](std::mt19937_64 &rng) {
+    return ts
+        .rangeQuery("readings", {"timestamp", "latitude", "longitude"},
+                    opt.endTs() - 300, opt.endTs(),
+                    compare("name", Predicate::Op::Eq,
+                            ValueFactory::createString(truckName(
+                                static_cast<int64_t>(rng() % opt.scale)))))
+        .status();
+  });
+  uc.queries.emplace_back("low-fuel", [&ts, &opt, fleet](std::mt19937_64 &rng) {
+    return ts
+        .rangeQuery("readings", {}, kStartTs, opt.endTs(),
+                    both(compare("fleet", Predicate::Op::Eq, fleet(rng)),
+                         compare("fuel_state", Predicate::Op::Lt,
+                                 ValueFactory::createFloat(0.1))))
+        .status();
+  });
+  uc.queries.emplace_back("avg-load", [&ts, &opt, fleet](std::mt19937_64 &rng) {
+    return ts
+        .aggregate("readings", "current_load", TimeAggregation::Avg, kStartTs,
+                   opt.endTs(), 3600, TimeGranularity::Seconds,
+                   compare("fleet", Predicate::Op::Eq, fleet(rng)))
+        .status();
+  });
+  uc.queries.emplace_back(
+      "daily-activity", [&ts, &opt, fleet](std::mt19937_64 &rng) {
+        return ts
+            .aggregate("readings", "velocity", TimeAggregation::Count,
+                       kStartTs, opt.endTs(), 3600, TimeGranularity::Seconds,
+                       both(compare("fleet", Predicate::Op::Eq, fleet(rng)),
+                            compare("velocity", Predicate::Op::Gt,
+                                    ValueFactory::createFloat(1.0))))
+            .status();
+      });
+  return uc;
+}
+
+bool parseOptions(int argc, char **argv, Options &opt) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const size_t eq = arg.find('=');
+    const std::string key = arg.substr(0, eq);
+    const std::string val = eq == std::string::npos ? "" : arg.substr(eq + 1);
+    try {
+      if (key == "--use-case")
+        opt.useCase = val;
+      else if (key == "--scale")
+        opt.scale = std::stoll(val);
+      else if (key == "--hours")
+        opt.hours = std::stoll(val);
+      else if (key == "--interval")
+        opt.interval = std::stoll(val);
+      else if (key == "--batch")
+        opt.batch = std::stoul(val);
+      else if (key == "--workers")
+        opt.workers = std::stoul(val);
+      else if (key == "--queries")
+        opt.queries = std::stoll(val);
+      else if (key == "--seed")
+        opt.seed = std::stoull(val);
+      else
+        return false;
+    } catch (...) {
+      return false;
+    }
+  }
+  return (opt.useCase == "devops" || opt.useCase == "iot") && opt.scale > 0 &&
+         opt.hours > 0 && opt.interval > 0 && opt.batch > 0 &&
+         opt.workers > 0 && opt.queries >= 0;
+}
+
+double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+uint64_t nanosSince(Clock::time_point start) {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                           start)
+          .count());
+}
+
+void ingest(InMemoryTimeSeriesStorage &ts, const UseCase &uc,
+            const Options &opt) {
+  std::vector<LatencyHistogram> hist(opt.workers);
+  std::atomic<int64_t> rows{0};
+  std::atomic<int64_t> failures{0};
+  const auto start = Clock::now();
+  std::vector<std::thread> workers;
+  for (size_t w = 0; w < opt.workers; ++w)
+    workers.emplace_back([&, w] {
+      std::mt19937_64 rng(opt.seed + w);
+      std::vector<Row> batch;
+      auto flush = [&] {
+        const auto t0 = Clock::now();
+        if (!ts.appendBatch(uc.series, batch).ok())
+          failures.fetch_add(1, std::memory_order_relaxed);
+        hist[w].record(nanosSince(t0));
+        rows.fetch_add(static_cast<int64_t>(batch.size()),
+                       std::memory_order_relaxed);
+        batch.clear();
+      };
+      for (int64_t step = 0; step < opt.steps(); ++step)
+        for (int64_t s = static_cast<int64_t>(w); s < opt.scale;
+             s += static_cast<int64_t>(opt.workers)) {
+          batch.push_back(uc.row(s, kStartTs + step * opt.interval, rng));
+          if (batch.size() == opt.batch)
+            flush();
+        }
+      if (!batch.empty())
+        flush();
+    });
+  for (auto &th : workers)
+    th.join();
+  const double secs = secondsSince(start);
+
+  const size_t metrics = uc.schema.valueColumns().size();
+  std::cout << "\nIngest: " << rows.load() << " rows ("
+            << rows.load() * static_cast<int64_t>(metrics) << " metrics) in "
+            << std::fixed << std::setprecision(2) << secs << " s, "
+            << std::setprecision(0) << rows.load() / secs << " rows/s, "
+            << rows.load() * static_cast<double>(metrics) / secs
+            << " metrics/s";
+  if (failures.load() > 0)
+    std::cout << ", " << failures.load() << " batches failed";
+  std::cout << "\n";
+  LatencyHistogram merged;
+  for (const auto &h : hist)
+    merged.merge(h);
+  LatencyHistogram::printHeader(std::cout);
+  merged.print(std::cout, "appendBatch");
+}
+
+void querySuite(const UseCase &uc, const Options &opt) {
+  const size_t kinds = uc.queries.size();
+  const int64_t total = opt.queries * static_cast<int64_t>(kinds);
+  std::vector<std::vector<LatencyHistogram>> hist(
+      opt.workers, std::vector<LatencyHistogram>(kinds));
+  std::atomic<int64_t> next{0};
+  std::atomic<int64_t> failures{0};
+  const auto start = Clock::now();
+  std::vector<std::thread> workers;
+  for (size_t w = 0; w < opt.workers; ++w)
+    workers.emplace_back([&, w] {
+      std::mt19937_64 rng(opt.seed * 7919 + w);
+      for (int64_t i; (i = next.fetch_add(1)) < total;) {
+        const size_t kind = static_cast<size_t>(i) % kinds;
+        const auto t0 = Clock::now();
+        if (!uc.queries[kind].second(rng).ok())
+          failures.fetch_add(1, std::memory_order_relaxed);
+        hist[w][kind].record(nanosSince(t0));
+      }
+    });
+  for (auto &th : workers)
+    th.join();
+  const double secs = secondsSince(start);
+
+  std::cout << "\nQueries: " << total << " in " << std::fixed
+            << std::setprecision(2) << secs << " s, " << std::setprecision(1)
+            << total / secs << " queries/s";
+  if (failures.load() > 0)
+    std::cout << ", " << failures.load() << " failed";
+  std::cout << "\n";
+  LatencyHistogram::printHeader(std::cout);
+  for (size_t kind = 0; kind < kinds; ++kind) {
+    LatencyHistogram merged;
+    for (const auto &h : hist)
+      merged.merge(h[kind]);
+    merged.print(std::cout, uc.queries[kind].first);
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options opt;
+  if (!parseOptions(argc, argv, opt)) {
+    std::cerr << "usage: kadedb_tsbs_bench [--use-case=devops|iot] "
+                 "[--scale=N] [--hours=N] [--interval=SECONDS] [--batch=N] "
+                 "[--workers=N] [--queries=N] [--seed=N]\n";
+    return 2;
+  }
+
+  InMemoryTimeSeriesStorage ts;
+  UseCase uc = opt.useCase == "iot" ? iot(ts, opt) : devops(ts, opt);
+  // Workers interleave their batches, so readings may arrive up to a batch
+  // of steps late
+  uc.schema.setLatenessSeconds(
+      static_cast<uint64_t>(opt.interval) *
+      (opt.batch * opt.workers / static_cast<size_t>(opt.scale) + 2));
+  Status st = ts.createSeries(uc.series, uc.schema, TimePartition::Hourly);
+  if (!st.ok()) {
+    std::cerr << "createSeries failed: " << st.message() << "\n";
+    return 1;
+  }
+
+  std::cout << "KadeDB TSBS bench: " << opt.useCase << ", scale "
+            << opt.scale << ", " << opt.hours << " h at " << opt.interval
+            << " s, " << opt.workers << " workers\n";
+  ingest(ts, uc, opt);
+  querySuite(uc, opt);
+  return 0;
+}
@@ -0,0 +1,455 @@
+// YCSB-style macro benchmark: loads a table of records, then runs one of
+// the core workloads from several threads at once and reports throughput
+// and latency percentiles per operation.
+//
+//   kadedb_ycsb_bench [--store=relational|document] [--workload=A..F|all]
+//                     [--records=100000] [--operations=100000]
+//                     [--threads=N] [--fields=10] [--field-length=100]
+//                     [--seed=42]
+//
+// Workloads (as in YCSB's core package):
+//   A  50% read, 50% update            (zipfian keys)
+//   B  95% read, 5% update             (zipfian keys)
+//   C  100% read                       (zipfian keys)
+//   D  95% read, 5% insert             (latest keys)
+//   E  95% scan of 1-100 keys, 5% insert
+//   F  50% read, 50% read-modify-write (zipfian keys)
+//
+// Records have an integer key and `fields` strings field0..fieldN-1. On
+// the document store each record is a document under "user<key>" that
+// also carries its key, indexed so that scans are range queries.
+//
+// Workloads run in order on the same data. A latest-key read in D may
+// pick a key whose insert is still in flight on another thread; it is
+// reported among the failed operations.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "kadedb/index.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include "latency_histogram.h"
+
+using namespace kadedb;
+using kadedb::bench::LatencyHistogram;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  std::string store = "relational";
+  std::string workload = "A";
+  int64_t records = 100000;
+  int64_t operations = 100000;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  int fields = 10;
+  int fieldLength = 100;
+  uint64_t seed = 42;
+};
+
+enum class Op { Read, Update, Insert, Scan, ReadModifyWrite };
+constexpr size_t kOpCount = 5;
+const char *const kOpNames[kOpCount] = {"READ", "UPDATE", "INSERT", "SCAN",
+                                        "READ-MODIFY-WRITE"};
+
+// Operation mix of a workload, in percent, and how keys are drawn
+struct Workload {
+  char name;
+  int read, update, insert, scan, rmw;
+  bool latest; // keys near the newest insert instead of zipfian
+};
+
+const Workload kWorkloads[] = {
+    {'A', 50, 50, 0, 0, 0, false}, {'B', 95, 5, 0, 0, 0, false},
+    {'C', 100, 0, 0, 0, 0, false}, {'D', 95, 0, 5, 0, 0, true},
+    {'E', 0, 0, 5, 95, 0, false},  {'F', 50, 0, 0, 0, 50, false},
+};
+
+// Zipfian ranks over [0, n) with YCSB's constant 0.99 (Gray et al.,
+// "Quickly generating billion-record synthetic databases"); the zeta
+// constants are computed once and shared by every thread's generator
+class Zipfian {
+public:
+  explicit Zipfian(uint64_t n, double theta = 0.99) : n_(n), theta_(theta) {
+    for (uint64_t i = 1; i <= n; ++i)
+      zetan_ += 1.0 / std::pow(static_cast<double>(i), theta);
+    const double zeta2 = 1.0 + 1.0 / std::pow(2.0, theta);
+    alpha_ = 1.0 / (1.0 - theta);
+    eta_ = (1.0 - std::pow(2.0 / static_cast<double>(n), 1.0 - theta)) /
+           (1.0 - zeta2 / zetan_);
+  }
+
+  template <class Rng> uint64_t next(Rng &rng) const {
+    const double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+    const double uz = u * zetan_;
+    if (uz < 1.0)
+      return 0;
+    if (uz < 1.0 + std::pow(0.5, theta_))
+      return std::min<uint64_t>(1, n_ - 1);
+    const double r = static_cast<double>(n_) *
+                     std::pow(eta_ * u - eta_ + 1.0, alpha_);
+    return std::min<uint64_t>(static_cast<uint64_t>(r), n_ - 1);
+  }
+
+private:
+  uint64_t n_;
+  double theta_;
+  double zetan_ = 0;
+  double alpha_ = 0;
+  double eta_ = 0;
+};
+
+// FNV-1a, spreading zipfian ranks over the key space so the popular keys
+// are not all adjacent (YCSB's scrambled zipfian)
+uint64_t scramble(uint64_t v) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (int i = 0; i < 8; ++i) {
+    h ^= (v >> (i * 8)) & 0xFF;
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+std::string randomField(std::mt19937_64 &rng, int length) {
+  std::string s(static_cast<size_t>(length), ' ');
+  for (char &c : s)
+    c = static_cast<char>('a' + rng() % 26);
+  return s;
+}
+
+// The operations a workload needs, over one of the storage engines
+class Store {
+public:
+  virtual ~Store() = default;
+  virtual Status insert(int64_t key, std::vector<std::string> fields) = 0;
+  virtual Status read(int64_t key) = 0;
+  virtual Status update(int64_t key, int field, std::string value) = 0;
+  virtual Status scan(int64_t key, int64_t count) = 0;
+};
+
+Predicate keyCompare(const std::string &column, Predicate::Op op,
+                     int64_t key) {
+  Predicate p;
+  p.column = column;
+  p.op = op;
+  p.rhs = ValueFactory::createInteger(key);
+  return p;
+}
+
+class RelationalStore final : public Store {
+public:
+  explicit RelationalStore(int fields) : fields_(fields) {
+    std::vector<Column> cols{{"key", ColumnType::Integer, false, true, {}}};
+    for (int i = 0; i < fields; ++i)
+      cols.push_back(Column{"field" + std::to_string(i), ColumnType::String,
+                            false, false, {}});
+    (void)rel_.createTable("usertable",
+                           TableSchema(cols, std::string("key")));
+  }
+
+  Status insert(int64_t key, std::vector<std::string> fields) override {
+    Row r(static_cast<size_t>(fields_) + 1);
+    r.set(0, ValueFactory::createInteger(key));
+    for (int i = 0; i < fields_; ++i)
+      r.set(static_cast<size_t>(i) + 1,
+            ValueFactory::createString(std::move(fields[i])));
+    return rel_.insertRow("usertable", r);
+  }
+  Status read(int64_t key) override {
+    return rel_
+        .select("usertable", {}, keyCompare("key", Predicate::Op::Eq, key))
+        .status();
+  }
+  Status update(int64_t key, int field, std::string value) override {
+    std::unordered_map<std::string, AssignmentValue> set;
+    set["field" + std::to_string(field)].constant =
+        ValueFactory::createString(std::move(value));
+    return rel_
+        .updateRows("usertable", set,
+                    keyCompare("key", Predicate::Op::Eq, key))
+        .status();
+  }
+  Status scan(int64_t key, int64_t count) override {
+    Predicate range;
+    range.kind = Predicate::Kind::And;
+    range.children.push_back(keyCompare("key", Predicate::Op::Ge, key));
+    range.children.push_back(
+        keyCompare("key", Predicate::Op::Lt, key + count));
+    return rel_.select("usertable", {}, std::move(range)).status();
+  }
+
+private:
+  InMemoryRelationalStorage rel_;
+  int fields_;
+};
+
+class DocumentStore final : public Store {
+public:
+  explicit DocumentStore(int fields) : fields_(fields) {
+    (void)docs_.createCollection("usertable", std::nullopt);
+    (void)docs_.createIndex("usertable", "key", IndexType::Ordered);
+  }
+
+  Status insert(int64_t key, std::vector<std::string> fields) override {
+    Document d;
+    d["key"] = ValueFactory::createInteger(key);
+    for (int i = 0; i < fields_; ++i)
+      d["field" + std::to_string(i)] =
+          ValueFactory::createString(std::move(fields[i]));
+    return docs_.put("usertable", docKey(key), std::move(d));
+  }
+  Status read(int64_t key) override {
+    return docs_.get("usertable", docKey(key)).status();
+  }
+  // Documents are replaced whole, so an update reads the record first
+  Status update(int64_t key, int field, std::string value) override {
+    auto doc = docs_.get("usertable", docKey(key));
+    if (!doc.hasValue())
+      return doc.status();
+    Document d = doc.takeValue();
+    d["field" + std::to_string(field)] =
+        ValueFactory::createString(std::move(value));
+    return docs_.put("usertable", docKey(key), std::move(d));
+  }
+  Status scan(int64_t key, int64_t count) override {
+    DocPredicate lo;
+    lo.field = "key";
+    lo.op = DocPredicate::Op::Ge;
+    lo.rhs = ValueFactory::createInteger(key);
+    DocPredicate hi;
+    hi.field = "key";
+    hi.op = DocPredicate::Op::Lt;
+    hi.rhs = ValueFactory::createInteger(key + count);
+    DocPredicate range;
+    range.kind = DocPredicate::Kind::And;
+    range.children.push_back(std::move(lo));
+    range.children.push_back(std::move(hi));
+    return docs_.query("usertable", {}, std::move(range)).status();
+  }
+
+private:
+  static std::string docKey(int64_t key) {
+    return "user" + std::to_string(key);
+  }
+
+  InMemoryDocumentStorage docs_;
+  int fields_;
+};
+
+bool parseOptions(int argc, char **argv, Options &opt) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const size_t eq = arg.find('=');
+    const std::string key = arg.substr(0, eq);
+    const std::string val = eq == std::string::npos ? "" : arg.substr(eq + 1);
+    try {
+      if (key == "--store")
+        opt.store = val;
+      else if (key == "--workload")
+        opt.workload = val;
+      else if (key == "--records")
+        opt.records = std::stoll(val);
+      else if (key == "--operations")
+        opt.operations = std::stoll(val);
+      else if (key == "--threads")
+        opt.threads = std::stoul(val);
+      else if (key == "--fields")
+        opt.fields = std::stoi(val);
+      else if (key == "--field-length")
+        opt.fieldLength = std::stoi(val);
+      else if (key == "--seed")
+        opt.seed = std::stoull(val);
+      else
+        return false;
+    } catch (...) {
+      return false;
+    }
+  }
+  return (opt.store == "relational" || opt.store == "document") &&
+         opt.records > 0 && opt.operations >= 0 && opt.threads > 0 &&
+         opt.fields > 0 && opt.fieldLength >= 0;
+}
+
+std::unique_ptr<Store> makeStore(const Options &opt) {
+  if (opt.store == "document")
+    return std::make_unique<DocumentStore>(opt.fields);
+  return std::make_unique<RelationalStore>(opt.fields);
+}
+
+std::vector<std::string> randomRecord(std::mt19937_64 &rng,
+                                      const Options &opt) {
+  std::vector<std::string> fields;
+  for (int i = 0; i < opt.fields; ++i)
+    fields.push_back(randomField(rng, opt.fieldLength));
+  return fields;
+}
+
+// Load phase: every thread inserts its share of the initial records
+void load(Store &store, const Options &opt) {
+  const auto start = Clock::now();
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < opt.threads; ++t)
+    workers.emplace_back([&, t] {
+      std::mt19937_64 rng(opt.seed + t);
+      for (int64_t k = static_cast<int64_t>(t); k < opt.records;
+           k += static_cast<int64_t>(opt.threads))
+        (void)store.insert(k, randomRecord(rng, opt));
+    });
+  for (auto &w : workers)
+    w.join();
+  const double secs =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  std::cout << "Loaded " << opt.records << " records into " << opt.store
+            << " storage in " << std::fixed << std::setprecision(2) << secs
+            << " s (" << std::setprecision(0) << opt.records / secs
+            << " records/s)\n";
+}
+
+void run(Store &store, const Options &opt, const Workload &w,
+         std::atomic<int64_t> &nextKey, const Zipfian &zipf) {
+  std::vector<std::array<LatencyHistogram, kOpCount>> hist(opt.threads);
+  std::atomic<int64_t> failures{0};
+  const auto start = Clock::now();
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < opt.threads; ++t)
+    workers.emplace_back([&, t] {
+      std::mt19937_64 rng(opt.seed * 7919 + t + static_cast<size_t>(w.name));
+      std::uniform_int_distribution<int> pct(0, 99);
+      std::uniform_int_distribution<int> field(0, opt.fields - 1);
+      std::uniform_int_distribution<int64_t> scanLen(1, 100);
+      const int64_t ops =
+          opt.operations / static_cast<int64_t>(opt.threads) +
+          (static_cast<int64_t>(t) <
+                   opt.operations % static_cast<int64_t>(opt.threads)
+               ? 1
+               : 0);
+      for (int64_t i = 0; i < ops; ++i) {
+        const int64_t loaded = nextKey.load(std::memory_order_relaxed);
+        const int64_t rank = static_cast<int64_t>(zipf.next(rng));
+        const int64_t key =
+            w.latest ? std::max<int64_t>(0, loaded - 1 - rank)
+                     : static_cast<int64_t>(scramble(rank) % opt.records);
+        int p = pct(rng);
+        Op op;
+        if ((p -= w.read) < 0)
+          op = Op::Read;
+        else if ((p -= w.update) < 0)
+          op = Op::Update;
+        else if ((p -= w.insert) < 0)
+          op = Op::Insert;
+        else if ((p -= w.scan) < 0)
+          op = Op::Scan;
+        else
+          op = Op::ReadModifyWrite;
+
+        // Inputs are generated before the clock starts
+        std::vector<std::string> record;
+        std::string value;
+        if (op == Op::Insert)
+          record = randomRecord(rng, opt);
+        else if (op == Op::Update || op == Op::ReadModifyWrite)
+          value = randomField(rng, opt.fieldLength);
+        const int64_t len = scanLen(rng);
+        const int f = field(rng);
+
+        const auto t0 = Clock::now();
+        Status st;
+        switch (op) {
+        case Op::Read:
+          st = store.read(key);
+          break;
+        case Op::Update:
+          st = store.update(key, f, std::move(value));
+          break;
+        case Op::Insert:
+          st = store.insert(nextKey.fetch_add(1), std::move(record));
+          break;
+        case Op::Scan:
+          st = store.scan(key, len);
+          break;
+        case Op::ReadModifyWrite:
+          st = store.read(key);
+          if (st.ok())
+            st = store.update(key, f, std::move(value));
+          break;
+        }
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            Clock::now() - t0)
+                            .count();
+        hist[t][static_cast<size_t>(op)].record(static_cast<uint64_t>(ns));
+        if (!st.ok())
+          failures.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  for (auto &th : workers)
+    th.join();
+  const double secs =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::cout << "\nWorkload " << w.name << " (" << opt.threads
+            << " threads): " << opt.operations << " operations in "
+            << std::fixed << std::setprecision(2) << secs << " s, "
+            << std::setprecision(0) << opt.operations / secs << " ops/s";
+  if (failures.load() > 0)
+    std::cout << ", " << failures.load() << " failed";
+  std::cout << "\n";
+  LatencyHistogram::printHeader(std::cout);
+  for (size_t op = 0; op < kOpCount; ++op) {
+    LatencyHistogram merged;
+    for (const auto &h : hist)
+      merged.merge(h[op]);
+    if (merged.count() > 0)
+      merged.print(std::cout, kOpNames[op]);
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options opt;
+  if (!parseOptions(argc, argv, opt)) {
+    std::cerr << "usage: kadedb_ycsb_bench [--store=relational|document] "
+                 "[--workload=A..F|all] [--records=N] [--operations=N] "
+                 "[--threads=N] [--fields=N] [--field-length=N] "
+                 "[--seed=N]\n";
+    return 2;
+  }
+  std::vector<Workload> selected;
+  for (const Workload &w : kWorkloads)
+    if (opt.workload == "all" || opt.workload == std::string(1, w.name) ||
+        opt.workload == std::string(1, static_cast<char>(w.name + 32)))
+      selected.push_back(w);
+  if (selected.empty()) {
+    std::cerr << "unknown workload '" << opt.workload << "'\n";
+    return 2;
+  }
+
+  std::cout << "KadeDB YCSB bench: " << opt.records << " records of "
+            << opt.fields << "x" << opt.fieldLength << " bytes, "
+            << opt.threads << " threads\n";
+  auto store = makeStore(opt);
+  load(*store, opt);
+  // Workloads run one after another on the same data, as YCSB runs them,
+  // so D and E see the records inserted before them
+  std::atomic<int64_t> nextKey{opt.records};
+  const Zipfian zipf(static_cast<uint64_t>(opt.records));
+  for (const Workload &w : selected)
+    run(*store, opt, w, nextKey, zipf);
+  return 0;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+#include "kadedb/cancellation.h"
+#include "kadedb/status.h"
+
+namespace kadedb {
+namespace kadeql {
+
+struct AdmissionOptions {
+  // Estimated rows read above which a query is heavy
+  double heavyRows = 100000;
+  // Heavy queries running at once; later ones queue in arrival order
+  size_t maxHeavy = 2;
+};
+
+/**
+ * Admission control for queries sharing a process.
+ *
+ * Each SELECT is admitted before its plan runs, by the rows its scans are
+ * estimated to read (see QueryExecutor::setAdmissionController()). Light
+ * queries, e.g. point lookups through an index, take the priority lane:
+ * they are admitted at once, whatever is running. Heavy ones take one of
+ * maxHeavy slots and wait, first come first served, while all are in use,
+ * so analytic scans cannot crowd out OLTP traffic on the same cores. A
+ * wait ends early with StatusCode::Cancelled when the query's token is
+ * cancelled or its deadline passes.
+ */
+class AdmissionController {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit AdmissionController(AdmissionOptions options = {})
+      : options_(options) {}
+  AdmissionController(const AdmissionController &) = delete;
+  AdmissionController &operator=(const AdmissionController &) = delete;
+
+  /** A query's place in the controller, given back when destroyed. */
+  class Ticket {
+  public:
+    Ticket() = default;
+    Ticket(Ticket &&other) noexcept : owner_(other.owner_) {
+      other.owner_ = nullptr;
+    }
+    Ticket &operator=(Ticket &&other) noexcept;
+    ~Ticket() { release(); }
+
+    bool heavy() const { return owner_ != nullptr; }
+    void release();
+
+  private:
+    friend class AdmissionController;
+    explicit Ticket(AdmissionController *owner) : owner_(owner) {}
+    AdmissionController *owner_ = nullptr; // set while holding a heavy slot
+  };
+
+  // Admit a query estimated to read `estimatedRows` rows (std::nullopt:
+  // unknown, taken as heavy), waiting for a slot if it is heavy
+  Result<Ticket> admit(std::optional<double> estimatedRows,
+                       const CancellationToken *token = nullptr,
+                       std::optional<Clock::time_point> deadline = {});
+
+  const AdmissionOptions &options() const { return options_; }
+  // Heavy queries running, and waiting for a slot
+  size_t running() const;
+  size_t queued() const;
+  // Queries admitted through each lane, and waits that ended without a slot
+  uint64_t admittedLight() const;
+  uint64_t admittedHeavy() const;
+  uint64_t rejected() const;
+
+private:
+  void releaseSlot();
+
+  const AdmissionOptions options_;
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  size_t running_ = 0;
+  // Waiting heavy queries by arrival number, oldest first: the front one
+  // takes the next free slot
+  std::deque<uint64_t> waiting_;
+  uint64_t arrivals_ = 0;
+  uint64_t admittedLight_ = 0;
+  uint64_t admittedHeavy_ = 0;
+  uint64_t rejected_ = 0;
+};
+
+} // namespace kadeql
+} // namespace kadedb
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "kadedb/result.h"              // ResultSet
+#include "kadedb/status.h"              // Status, Result<T>
+#include "kadedb/storage.h"             // RelationalStorage
+#include "kadedb/timeseries/storage.h" // TimeSeriesStorage
+
+// Structures of the Arrow C data interface, guarded as the specification
+// asks so that they may be defined by several headers
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+extern "C" {
+
+struct ArrowSchema {
+  const char *format;
+  const char *name;
+  const char *metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema **children;
+  struct ArrowSchema *dictionary;
+  void (*release)(struct ArrowSchema *);
+  void *private_data;
+};
+
+struct ArrowArray {
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void **buffers;
+  struct ArrowArray **children;
+  struct ArrowArray *dictionary;
+  void (*release)(struct ArrowArray *);
+  void *private_data;
+};
+
+} // extern "C"
+
+#endif // ARROW_C_DATA_INTERFACE
+
+namespace kadedb {
+
+/**
+ * Arrow interchange through the C data interface: record batches are
+ * passed as an ArrowSchema and ArrowArray pair describing a struct ("+s")
+ * with one child per column, so pyarrow, DuckDB, Polars etc. can take them
+ * over without Arrow being a dependency of KadeDB.
+ *
+ * Column types map as Integer <-> int64 ("l"), Float <-> float64 ("g"),
+ * String <-> utf8 ("u", or large utf8 "U" past 2 GiB of text), Boolean <->
+ * boolean ("b") and Null <-> null ("n"). Null cells are the validity
+ * bitmap.
+ */
+
+/**
+ * Export `rs` as one record batch. Both structures are filled in and own
+ * their buffers until their release callbacks run; `rs` may be destroyed
+ * right away. A Null-typed column takes the type of its first non-null
+ * cell. Integer cells of Float columns are widened.
+ * @return Status::InvalidArgument if a column mixes other types
+ */
+Status exportArrow(const ResultSet &rs, ArrowSchema *schema,
+                   ArrowArray *array);
+
+/**
+ * Insert the rows of an Arrow record batch into an existing table, matching
+ * columns by name; table columns missing from the batch are null. Integer
+ * types of any width, timestamps, dates, float16/32/64, utf8, large utf8,
+ * boolean and null columns are accepted. Rows go through insertRow(), so
+ * the table's constraints apply; rows before a failing one stay inserted.
+ *
+ * `schema` and `array` are consumed: both are released before returning,
+ * also on errors.
+ * @return the number of rows inserted; Status::NotFound for an unknown
+ *         table; Status::InvalidArgument for an unknown column or
+ *         unsupported Arrow type; otherwise the error of the failing
+ *         insertRow(), prefixed with its row number
+ */
+Result<size_t> importArrow(ArrowSchema *schema, ArrowArray *array,
+                           RelationalStorage &storage,
+                           const std::string &table);
+
+/**
+ * Append the rows of an Arrow record batch to an existing series, matching
+ * columns by name (the timestamp column is required). A batch holding the
+ * timestamp as 64-bit integers or timestamps and exactly the series' value
+ * columns as float64, without nulls, is handed to appendColumns() as
+ * pointers into the Arrow buffers, with no per-row conversion; any other
+ * batch is converted to rows for appendBatch().
+ *
+ * `schema` and `array` are consumed as by the relational importArrow().
+ * @return the number of rows appended; errors as for the relational
+ *         importArrow(), with those of appendColumns()/appendBatch()
+ */
+Result<size_t> importArrow(ArrowSchema *schema, ArrowArray *array,
+                           TimeSeriesStorage &storage,
+                           const std::string &series);
+
+} // namespace kadedb
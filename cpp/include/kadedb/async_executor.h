@@ -0,0 +1,92 @@
+#pragma once
+
+#include "kadedb/admission.h"
+#include "kadedb/cancellation.h"
+#include "kadedb/prepared_statement.h"
+#include "kadedb/result.h"
+#include "kadedb/status.h"
+#include "kadedb/storage.h"
+#include "kadedb/thread_pool.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/value.h"
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace kadedb {
+namespace kadeql {
+
+/**
+ * Runs KadeQL statements on a ThreadPool instead of the calling thread, so
+ * a caller can keep many queries in flight without a thread per query.
+ *
+ * Each execution gets its own QueryExecutor on a pool worker. The result
+ * arrives through a std::future or a callback, which runs on the worker
+ * and must not block on another query of the same pool. A cancelled token
+ * ends a query that has not started, and a running SELECT at its next
+ * check (see QueryExecutor::setCancellationToken); the result is then
+ * StatusCode::Cancelled. So does the timeout, counted from when the query
+ * starts on a worker. Statements that already write run to completion.
+ *
+ * Example:
+ *
+ * ```cpp
+ * AsyncQueryExecutor async(storage);
+ * auto done = async.executeAsync("SELECT * FROM t WHERE id > 10");
+ * Result<ResultSet> rs = done.get();
+ * ```
+ *
+ * The storage engines must outlive every query in flight.
+ */
+class AsyncQueryExecutor {
+public:
+  using Callback = std::function<void(Result<ResultSet>)>;
+  using Params = std::vector<std::unique_ptr<Value>>;
+
+  explicit AsyncQueryExecutor(RelationalStorage &storage,
+                              ThreadPool &pool = ThreadPool::shared())
+      : storage_(&storage), pool_(&pool) {}
+  // SELECTs may also read the series of `timeseries` (see QueryExecutor)
+  AsyncQueryExecutor(RelationalStorage &storage, TimeSeriesStorage &timeseries,
+                     ThreadPool &pool = ThreadPool::shared())
+      : storage_(&storage), timeseries_(&timeseries), pool_(&pool) {}
+
+  // Deadline of each query (0: none) and the controller admitting its
+  // SELECTs; see the QueryExecutor setters of the same names
+  void setTimeout(std::chrono::milliseconds timeout) { timeout_ = timeout; }
+  void setAdmissionController(AdmissionController &admission) {
+    admission_ = &admission;
+  }
+
+  // Run `statement` with `params` bound (see PreparedStatement::execute)
+  std::future<Result<ResultSet>>
+  executeAsync(std::shared_ptr<const PreparedStatement> statement,
+               Params params = {}, CancellationToken token = {}) const;
+  // Parse `query` on the calling thread, then run it; a syntax error is
+  // the future's result
+  std::future<Result<ResultSet>>
+  executeAsync(const std::string &query, CancellationToken token = {}) const;
+  // Same as the first overload, handing the result to `done` instead
+  void executeAsync(std::shared_ptr<const PreparedStatement> statement,
+                    Params params, Callback done,
+                    CancellationToken token = {}) const;
+
+private:
+  // Body of one execution on a worker
+  Result<ResultSet> run(const PreparedStatement &statement,
+                        const Params &params,
+                        const CancellationToken &token) const;
+
+  RelationalStorage *storage_;
+  TimeSeriesStorage *timeseries_ = nullptr;
+  ThreadPool *pool_;
+  std::chrono::milliseconds timeout_{0};
+  AdmissionController *admission_ = nullptr;
+};
+
+} // namespace kadeql
+} // namespace kadedb
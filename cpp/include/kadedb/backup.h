@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "kadedb/status.h" // Status, Result<T>
+#include "kadedb/wal.h"    // WalTargets
+
+namespace kadedb {
+
+/**
+ * Online backups: a copy of every table, collection, series and graph of
+ * running storages, taken while writes continue.
+ *
+ * A backup is a write-ahead log file that recreates the storages: per
+ * table its createTable and one insertRow per row, per collection its
+ * createCollection and one putDocument per document, per series its
+ * createSeries and appendRows batches, per graph its createGraph, nodes
+ * and edges. Record bodies are the bin:: encodings, and restoreBackup()
+ * is a parallel replayWal() of the file.
+ *
+ * Each target is copied as of one moment, without blocking its writers
+ * for the duration of the backup: tables are read from an MVCC snapshot
+ * by scan(), collections through query(), series through scan() and
+ * graphs through contents(), each of which InMemory storages take under a
+ * single read lock. Different targets are copied at different moments,
+ * so writes that span several targets may be seen in part. Secondary
+ * indexes and continuous aggregates are not part of a backup and must be
+ * created again after a restore.
+ */
+
+/**
+ * Backup settings.
+ *  - maxBytesPerSecond: cap on the average write rate, so a backup does
+ *    not starve the service of I/O bandwidth (0: unthrottled). The writer
+ *    sleeps after each chunk until the bytes so far fit the cap.
+ *  - chunkBytes: bytes buffered per write to the output
+ *  - compression: codec of the log frames (Codec::Lz4High for backups
+ *    kept or shipped between sites, Codec::Lz4 when backup CPU matters)
+ */
+struct BackupOptions {
+  uint64_t maxBytesPerSecond = 0;
+  size_t chunkBytes = size_t{1} << 20;
+  Codec compression = Codec::None;
+};
+
+struct BackupStats {
+  uint64_t records = 0; // log records written
+  uint64_t bytes = 0;   // file size, header included
+};
+
+/**
+ * Write a backup of the non-null storages of `sources` to `out`.
+ * @return Status::Internal if `out` fails; otherwise the error of the
+ *         first failing storage read
+ */
+/** @ingroup WalAPI */
+Result<BackupStats> writeBackup(std::ostream &out, const WalTargets &sources,
+                                const BackupOptions &options = {});
+
+/**
+ * Write a backup to `path`, replacing it atomically (the file is written
+ * beside it, synced and renamed).
+ * @return Status::Internal on I/O errors; otherwise as the stream overload
+ */
+/** @ingroup WalAPI */
+Result<BackupStats> writeBackup(const std::string &path,
+                                const WalTargets &sources,
+                                const BackupOptions &options = {});
+
+/**
+ * Load the backup at `path` into `targets`, which should be empty, with
+ * `threads` workers as for replayWal() (replayWalFile()).
+ * @return the number of records applied; Status::NotFound if the file is
+ *         missing; Status::InvalidArgument if it is not a complete backup;
+ *         otherwise the first failing record's error
+ */
+/** @ingroup WalAPI */
+Result<uint64_t> restoreBackup(const std::string &path,
+                               const WalTargets &targets, size_t threads = 0);
+
+} // namespace kadedb
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "kadedb/status.h"
+
+namespace kadedb {
+
+/**
+ * A cancellation request shared by every copy of a token. Work checks it
+ * at safe points and ends early with StatusCode::Cancelled.
+ */
+class CancellationToken {
+public:
+  CancellationToken() : flag_(std::make_shared<std::atomic<bool>>(false)) {}
+
+  void cancel() const { flag_->store(true, std::memory_order_relaxed); }
+  bool cancelled() const { return flag_->load(std::memory_order_relaxed); }
+
+private:
+  std::shared_ptr<std::atomic<bool>> flag_;
+};
+
+/**
+ * Cooperative interruption of the work a thread does for one query.
+ *
+ * While a scope is active on a thread, long loops on that thread (storage
+ * scans every few thousand rows, query plans between batches) call check()
+ * and stop with the Status it returns when that is not OK, e.g. Cancelled
+ * once the query is cancelled or past its deadline. Scopes nest; check()
+ * consults every active one. Outside any scope check() is always OK.
+ */
+class InterruptScope {
+public:
+  explicit InterruptScope(std::function<Status()> check);
+  ~InterruptScope();
+  InterruptScope(const InterruptScope &) = delete;
+  InterruptScope &operator=(const InterruptScope &) = delete;
+
+  static Status check();
+
+private:
+  std::function<Status()> check_;
+  InterruptScope *previous_;
+};
+
+} // namespace kadedb
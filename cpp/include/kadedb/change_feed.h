@@ -0,0 +1,158 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "kadedb/schema.h" // InlineRow, Document
+#include "kadedb/status.h" // Status, Result<T>
+
+namespace kadedb {
+
+/**
+ * @defgroup ChangeDataCaptureAPI Change data capture
+ * @brief Subscriptions to the writes committed to an in-memory storage.
+ *
+ * A storage with change capture enabled publishes one ChangeEvent per row
+ * or document it writes to its ChangeFeed, a bounded in-memory ring.
+ * Subscribers read the ring through their own cursor instead of polling
+ * select() or rangeQuery().
+ */
+
+/**
+ * One committed change to a table, collection or series.
+ *  - Insert: `after` (rows) or `afterDoc` (documents) is set
+ *  - Update: both the before and after images are set
+ *  - Delete: the before image is set
+ *  - Truncate: every row of `target` was removed; no images
+ *  - Drop: `target` was dropped; no images and no later events for it
+ * Relational and time-series events carry rows, in the target's column
+ * order; document events carry `key` and documents.
+ */
+struct ChangeEvent {
+  enum class Kind { Insert, Update, Delete, Truncate, Drop };
+
+  uint64_t seq = 0; // stamped by ChangeFeed::publish(), from 1
+  Kind kind = Kind::Insert;
+  std::string target;
+  std::string key;
+  std::optional<InlineRow> before;
+  std::optional<InlineRow> after;
+  std::optional<Document> beforeDoc;
+  std::optional<Document> afterDoc;
+};
+
+// INSERT, UPDATE, DELETE, TRUNCATE or DROP
+const char *changeKindName(ChangeEvent::Kind kind);
+
+class ChangeSubscription;
+
+/**
+ * The ring of the last `capacity` events published by a storage.
+ *
+ * Writers publish under their own write locks, so events of one target are
+ * in commit order; publishing never waits for subscribers. Each
+ * subscription keeps its own cursor: a slow subscriber holds back nobody
+ * and, once the events it has not read are evicted, is told so rather than
+ * silently skipping them.
+ */
+/** @ingroup ChangeDataCaptureAPI */
+class ChangeFeed : public std::enable_shared_from_this<ChangeFeed> {
+public:
+  // Events a storage's feed holds unless enableChangeCapture() says
+  static constexpr size_t kDefaultCapacity = 65536;
+  // Events a subscription filters per lock of the ring
+  static constexpr size_t kPollChunk = 256;
+
+  // `capacity` >= 1 events
+  explicit ChangeFeed(size_t capacity) : capacity_(capacity ? capacity : 1) {}
+
+  size_t capacity() const { return capacity_; }
+
+  // Stamp and append `events` in order, evicting the oldest events beyond
+  // capacity(), and wake waiting subscribers
+  void publish(std::vector<ChangeEvent> events);
+  void publish(ChangeEvent event);
+
+  // Sequence number of the last event published (0: none yet)
+  uint64_t lastSeq() const;
+
+  /**
+   * A subscription to the events published from now on for `target` (all
+   * targets when empty) for which `filter` (when set) returns true. The
+   * filter runs on the polling thread. A subscription to one target ends
+   * with the target's Drop event.
+   */
+  std::unique_ptr<ChangeSubscription>
+  subscribe(std::string target,
+            std::function<bool(const ChangeEvent &)> filter = nullptr);
+
+private:
+  friend class ChangeSubscription;
+
+  const size_t capacity_;
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  std::deque<std::shared_ptr<const ChangeEvent>> ring_;
+  uint64_t lastSeq_ = 0; // seq of ring_.back()
+};
+
+/**
+ * One subscriber's cursor into a ChangeFeed. Events are shared with the
+ * ring and other subscribers, hence const. A subscription is used by one
+ * thread at a time, except cancel().
+ */
+/** @ingroup ChangeDataCaptureAPI */
+class ChangeSubscription {
+public:
+  using Events = std::vector<std::shared_ptr<const ChangeEvent>>;
+
+  /**
+   * Up to `maxEvents` (0: no limit) matching events after the last one
+   * returned, in seq order. Waits up to `wait` while there is none; an
+   * empty result means none arrived in time.
+   * @return Status::ResourceExhausted once events the subscription had not
+   *         read were evicted from the ring (it must resynchronize, e.g.
+   *         select() again and resubscribe); Status::NotFound after it
+   *         returned its target's Drop event; Status::Cancelled after
+   *         cancel()
+   */
+  Result<Events> poll(size_t maxEvents,
+                      std::chrono::milliseconds wait =
+                          std::chrono::milliseconds::zero());
+
+  // End the subscription, waking a poll() blocked in another thread
+  void cancel();
+
+  // Seq of the last event read, matching or not (every event up to it has
+  // been considered)
+  uint64_t position() const { return position_; }
+
+  // Events published after position(), matching or not
+  uint64_t lag() const;
+
+private:
+  friend class ChangeFeed;
+  ChangeSubscription(std::shared_ptr<ChangeFeed> feed, std::string target,
+                     std::function<bool(const ChangeEvent &)> filter,
+                     uint64_t position)
+      : feed_(std::move(feed)), target_(std::move(target)),
+        filter_(std::move(filter)), position_(position) {}
+
+  std::shared_ptr<ChangeFeed> feed_;
+  std::string target_;
+  std::function<bool(const ChangeEvent &)> filter_;
+  uint64_t position_;
+  bool dropped_ = false;
+  bool cancelled_ = false; // guarded by feed_->mtx_
+};
+
+} // namespace kadedb
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "kadedb/compression.h" // Codec
+#include "kadedb/status.h"      // Status, Result<T>
+#include "kadedb/storage.h"     // RelationalStorage, InMemoryRelationalStorage
+
+namespace kadedb {
+
+/**
+ * Checkpoint files: a snapshot of a RelationalStorage that a restart maps
+ * read-only instead of re-inserting every row.
+ *
+ * Layout (integers in host byte order):
+ *  - page 0: serialization_constants::MAGIC and VERSION, the WAL sequence
+ *    number the snapshot covers, and the offset, size and checksum of the
+ *    directory
+ *  - per table, groups of up to kCheckpointGroupRows rows stored as one
+ *    block per column, each starting on a kCheckpointPageBytes boundary:
+ *    [u64 checksum][u32 rows][u32 Codec][u64 string bytes], a type tag
+ *    per cell, an 8-byte slot per cell (integer, double bits, boolean, or
+ *    string offset and length) and the string bytes. A compressed block
+ *    stores the u64 size of its compressed tags, slots and strings, then
+ *    those bytes.
+ *  - the directory: per table its name, schema (bin::writeTableSchema),
+ *    row count and the offset and size of each block
+ *
+ * Only table contents are stored: secondary indexes are not part of the
+ * snapshot and must be created again after a restart.
+ */
+constexpr size_t kCheckpointGroupRows = 65536;
+constexpr size_t kCheckpointPageBytes = 4096;
+
+/**
+ * Write every table of `storage` to a checkpoint at `path`, replacing it
+ * atomically (the file is written beside it, synced and renamed). The
+ * storage must hold exactly the first `walLsn` records of its log, so take
+ * the checkpoint while writers are paused. Blocks are compressed with
+ * `codec` where that shrinks them (Codec::Lz4High suits checkpoints, which
+ * are written once and read on restart).
+ * @return Status::Internal on I/O errors
+ */
+Status writeCheckpoint(const std::string &path, RelationalStorage &storage,
+                       uint64_t walLsn = 0, Codec codec = Codec::None);
+
+/**
+ * A RelationalStorage served from a memory-mapped checkpoint.
+ *
+ * open() reads only the header and directory, so tables are queryable at
+ * once and their pages fault in as scans touch them; each block's checksum
+ * is verified the first time it is read. Compressed blocks are decoded by
+ * each scan, and only for the columns it reads. The first write to a
+ * checkpointed table copies it into an in-memory table, which serves it
+ * from then on; new tables live in memory from the start. Restart is
+ * therefore open() then replayWal() of the log tail after walLsn(), which
+ * only loads the tables the tail writes to.
+ *
+ * Thread-safe like InMemoryRelationalStorage. Scans and selects of
+ * checkpointed tables return Status::Internal when a block fails its
+ * checksum.
+ */
+/** @ingroup WalAPI */
+class CheckpointStorage final : public RelationalStorage {
+public:
+  /**
+   * Map the checkpoint at `path`.
+   * @return Status::NotFound if the file is missing;
+   *         Status::InvalidArgument if it is not a KadeDB checkpoint or its
+   *         directory is corrupt; Status::Internal on I/O errors
+   */
+  static Result<std::unique_ptr<CheckpointStorage>>
+  open(const std::string &path);
+
+  ~CheckpointStorage() override;
+
+  CheckpointStorage(const CheckpointStorage &) = delete;
+  CheckpointStorage &operator=(const CheckpointStorage &) = delete;
+
+  // Log sequence number the checkpoint covers: replay the records after it
+  uint64_t walLsn() const { return walLsn_; }
+  // Tables still served from the checkpoint, i.e. never written since
+  std::vector<std::string> mappedTables() const;
+
+  Status createTable(const std::string &table,
+                     const TableSchema &schema) override;
+  Status insertRow(const std::string &table, const Row &row) override;
+  Result<ResultSet> select(const std::string &table,
+                           const std::vector<std::string> &columns,
+                           const std::optional<Predicate> &where) override;
+  Status scan(const std::string &table, const std::vector<std::string> &columns,
+              const std::optional<Predicate> &where, const BatchSink &sink,
+              size_t batchRows) override;
+  std::vector<std::string> listTables() const override;
+  Result<TableSchema> getTableSchema(const std::string &table) override;
+  std::optional<size_t>
+  estimateRowCount(const std::string &table) const override;
+  std::optional<size_t>
+  estimateScanCost(const std::string &table,
+                   const std::optional<Predicate> &where) const override;
+  std::shared_ptr<const TableStatistics>
+  getTableStatistics(const std::string &table) const override;
+  std::string
+  explainAccess(const std::string &table,
+                const std::optional<Predicate> &where) const override;
+  std::optional<uint64_t>
+  tableVersion(const std::string &table) const override;
+  Status dropTable(const std::string &table) override;
+  Result<size_t> deleteRows(const std::string &table,
+                            const std::optional<Predicate> &where) override;
+  Result<size_t> updateRows(
+      const std::string &table,
+      const std::unordered_map<std::string, AssignmentValue> &assignments,
+      const std::optional<Predicate> &where) override;
+  Result<size_t> updateRowsWith(const std::string &table,
+                                const RowUpdater &updater,
+                                const std::optional<Predicate> &where) override;
+  Status
+  updateRows(const std::string &table,
+             const std::unordered_map<std::string, std::unique_ptr<Value>>
+                 &assignments,
+             const std::optional<Predicate> &where) override;
+  Status truncateTable(const std::string &table) override;
+  Status createIndex(const std::string &table, const std::string &column,
+                     IndexType type) override;
+
+private:
+  struct Block {
+    uint64_t offset = 0;
+    uint64_t bytes = 0;
+  };
+  struct Group {
+    uint32_t rows = 0;
+    std::vector<Block> blocks; // one per column
+    // 0 = unchecked, 1 = verified, 2 = corrupt; shared by all columns
+    std::unique_ptr<std::atomic<uint8_t>> state;
+  };
+  struct MappedTable {
+    std::string name;
+    TableSchema schema;
+    uint64_t rows = 0;
+    std::vector<Group> groups;
+    // Never written while mapped: one data version for its lifetime
+    uint64_t version = nextDataVersion();
+    // Serializes moving the table to memory_; `gone` once it moved or was
+    // dropped
+    std::mutex mtx;
+    bool gone = false;
+  };
+
+  CheckpointStorage(const char *base, size_t size, uint64_t walLsn);
+  Status parseDirectory(uint64_t offset, uint64_t size);
+  std::shared_ptr<MappedTable> findMapped(const std::string &table) const;
+  Status verifyGroup(const MappedTable &t, const Group &g) const;
+  // Point `block` at column `column` of `g` in the plain layout, which for
+  // a compressed block is decoded into `buf`
+  Status loadBlock(const MappedTable &t, const Group &g, size_t column,
+                   std::string &buf, const char *&block) const;
+  // Copy a checkpointed table into memory_ before it is written
+  Status materialize(const std::string &table);
+  Status scanMapped(const MappedTable &t,
+                    const std::vector<std::string> &columns,
+                    const std::optional<Predicate> &where,
+                    const BatchSink &sink, size_t batchRows) const;
+
+  const char *base_;
+  const size_t size_;
+  const uint64_t walLsn_;
+  mutable std::shared_mutex mtx_; // guards mapped_
+  std::unordered_map<std::string, std::shared_ptr<MappedTable>> mapped_;
+  InMemoryRelationalStorage memory_;
+};
+
+} // namespace kadedb
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "kadedb/page_allocator.h"
+#include "kadedb/result.h"
+#include "kadedb/schema.h"
+#include "kadedb/status.h"
+#include "kadedb/storage.h"
+#include "kadedb/string_dictionary.h"
+#include "kadedb/zone_map.h"
+
+namespace kadedb {
+
+/**
+ * Column-oriented in-memory implementation of RelationalStorage.
+ *
+ * Each column is stored as a typed contiguous vector instead of a vector of
+ * heap-allocated Values per row:
+ *  - Integer: std::vector<int64_t>
+ *  - Float:   std::vector<double>
+ *  - String:  per-row dictionary codes while the column holds at most
+ *             kMaxDictionaryEntries distinct values, then per-row offset
+ *             and length into a single character arena
+ *  - Boolean: 64-bit word bitmap
+ *  - Null:    no payload (only the null bitmap is meaningful)
+ *
+ * Every column additionally carries a validity bitmap (bit set = value
+ * present). Cells stored as nullptr in the incoming Row are recorded as
+ * invalid and returned as nullptr from select(), mirroring
+ * InMemoryRelationalStorage.
+ *
+ * Predicates are compiled once per query (columns resolved, rhs converted
+ * to the column's physical type) and evaluated column-at-a-time over
+ * batches of scan::kBatchRows rows into selection bitmaps, using the typed
+ * kernels from scan_kernels.h. Scans over a single column touch only that
+ * column's memory, and skip the blocks of ColumnVector::kZoneRows rows
+ * whose zone maps rule the predicate out.
+ *
+ * Semantics follow InMemoryRelationalStorage (same Status codes and
+ * uniqueness rules). One difference: Integer values inserted into a Float
+ * column are stored (and returned) as FloatValue.
+ */
+/** @ingroup StorageAPI */
+class ColumnarRelationalStorage final : public RelationalStorage {
+public:
+  ColumnarRelationalStorage() = default;
+  ~ColumnarRelationalStorage() override = default;
+
+  Status createTable(const std::string &table,
+                     const TableSchema &schema) override;
+  Status insertRow(const std::string &table, const Row &row) override;
+  // All or nothing, as insertInlineRows(): every row is converted to column
+  // cells, validated and checked for unique conflicts (among themselves
+  // too) before any is appended
+  Status insertRows(const std::string &table,
+                    const std::vector<Row> &rows) override;
+  Result<ResultSet> select(const std::string &table,
+                           const std::vector<std::string> &columns,
+                           const std::optional<Predicate> &where) override;
+  std::vector<std::string> listTables() const override;
+  Result<TableSchema> getTableSchema(const std::string &table) override;
+  std::optional<size_t>
+  estimateRowCount(const std::string &table) const override;
+  std::shared_ptr<const TableStatistics>
+  getTableStatistics(const std::string &table) const override;
+  // Always "columnar scan": predicates run as column-at-a-time kernels
+  std::string
+  explainAccess(const std::string &table,
+                const std::optional<Predicate> &where) const override;
+  Status dropTable(const std::string &table) override;
+  Result<size_t> deleteRows(const std::string &table,
+                            const std::optional<Predicate> &where) override;
+  Result<size_t> updateRows(
+      const std::string &table,
+      const std::unordered_map<std::string, AssignmentValue> &assignments,
+      const std::optional<Predicate> &where) override;
+  Result<size_t> updateRowsWith(const std::string &table,
+                                const RowUpdater &updater,
+                                const std::optional<Predicate> &where) override;
+  Status
+  updateRows(const std::string &table,
+             const std::unordered_map<std::string, std::unique_ptr<Value>>
+                 &assignments,
+             const std::optional<Predicate> &where) override;
+  Status truncateTable(const std::string &table) override;
+  // Accepted for interface compatibility; predicates are always evaluated
+  // by column-at-a-time scans, which this layout already optimizes.
+  Status createIndex(const std::string &table, const std::string &column,
+                     IndexType type) override;
+
+  /**
+   * Typed contiguous storage for a single column. Exposed for callers that
+   * want to scan raw column memory (e.g. vectorized or GPU kernels).
+   */
+  struct ColumnVector {
+    // Distinct strings a column keeps as dictionary codes
+    static constexpr size_t kMaxDictionaryEntries = 1 << 16;
+
+    ColumnType type = ColumnType::Null;
+    size_t size = 0;
+    // Per-row arrays are placed by the page policy (page_allocator.h)
+    PageVector<uint64_t> validity; // bit i set => row i has a value
+    PageVector<int64_t> ints;
+    PageVector<double> floats;
+    // Dictionary form: row i is strDict.at(strCodes[i]) (absent cells hold
+    // the code of ""). Entries left stale by updates and deletes are
+    // dropped when the column is compacted. A column that outgrows the
+    // dictionary moves to the arena form for good.
+    bool strDictEncoded = true;
+    PageVector<uint32_t> strCodes;
+    StringDictionary strDict;
+    // Arena form: row i's bytes are strArena[strOffsets[i], +strLengths[i]).
+    // Updates overwrite in place when the new value fits, otherwise append;
+    // stale bytes (strGarbage) are reclaimed once they outweigh the live
+    // ones.
+    PageVector<size_t> strOffsets;
+    PageVector<size_t> strLengths;
+    std::string strArena;
+    size_t strGarbage = 0;
+    PageVector<uint64_t> bools;
+    // Zone map per block of kZoneRows rows: bounds and absent count of
+    // every cell stored in the block. Overwrites only widen a zone;
+    // compact() rebuilds them.
+    static constexpr size_t kZoneRows = 4096;
+    std::vector<ColumnZone> zones;
+
+    bool isValid(size_t i) const {
+      return (validity[i >> 6] >> (i & 63)) & 1u;
+    }
+    bool boolAt(size_t i) const { return (bools[i >> 6] >> (i & 63)) & 1u; }
+    size_t strLength(size_t i) const {
+      return strDictEncoded ? strDict.at(strCodes[i]).size() : strLengths[i];
+    }
+    const char *strData(size_t i) const {
+      return strDictEncoded ? strDict.at(strCodes[i]).data()
+                            : strArena.data() + strOffsets[i];
+    }
+
+    void append(const Value *v);
+    // append() of a cell already in its unboxed form (empty: absent)
+    void append(const InlineValue &v);
+    // Overwrite row i in place
+    void set(size_t i, const Value *v);
+    std::unique_ptr<Value> get(size_t i) const;
+    void clear();
+    // Keep only rows whose keep[i] != 0 (stable order)
+    void compact(const std::vector<uint8_t> &keep);
+    // Rewrite the string arena without stale bytes
+    void compactArena();
+    // Move a dictionary-encoded column to the arena form
+    void dropDictionary();
+    // Widen the zone of row i by the cell stored there
+    void addToZone(size_t i);
+  };
+
+  /**
+   * insertRows() of rows given as InlineValue cells in schema order, as the
+   * typed tables of typed_table.h produce them: validated, checked for
+   * uniqueness (within the batch too) and appended under one lock, without
+   * boxing a Value per cell. Either every row is inserted or none is.
+   */
+  Status insertInlineRows(const std::string &table,
+                          const std::vector<InlineRow> &rows);
+
+  // The columns of a table as readColumns() lends them out
+  struct ColumnsView {
+    const ColumnVector *columns = nullptr; // schema order
+    // Physical rows, deleted ones included
+    size_t rows = 0;
+    const std::vector<uint64_t> *deleted = nullptr;
+
+    bool isLive(size_t r) const {
+      return (r >> 6) >= deleted->size() ||
+             !(((*deleted)[r >> 6] >> (r & 63)) & 1u);
+    }
+  };
+  /**
+   * Call `fn` with the raw columns of `table` while holding the storage
+   * lock, so the view stays consistent; `fn` must not call back into the
+   * storage.
+   * @return Status::NotFound for an unknown table
+   */
+  Status readColumns(const std::string &table,
+                     const std::function<void(const ColumnsView &)> &fn) const;
+
+private:
+  struct TableData {
+    TableSchema schema;
+    CompiledValidator validator; // of `schema`, for inserts and updates
+    std::vector<ColumnVector> columns;
+    // Physical rows, including deleted ones not yet compacted away
+    size_t rowCount = 0;
+    // Tombstones: bit r set => row r is deleted. Columns are compacted once
+    // deleted rows outnumber live ones, so deletes cost O(matches) amortized.
+    std::vector<uint64_t> deleted;
+    size_t deletedCount = 0;
+    // Per unique column: set of value keys currently present (index aligned
+    // with schema columns; empty for non-unique columns)
+    std::vector<std::unordered_set<std::string>> uniqueKeys;
+    // Columns declared via createIndex (bookkeeping only)
+    std::unordered_set<size_t> indexedColumns;
+    // Planner statistics of the live rows
+    StatisticsCollector stats;
+    // Process-unique table id, and a counter bumped whenever column data
+    // changes; together they key device copies of the columns
+    uint64_t id = 0;
+    uint64_t version = 0;
+  };
+
+  static TableData makeTable(const TableSchema &schema);
+  static Row materializeRow(const TableData &td, size_t r);
+  static void appendRow(TableData &td, const Row &row);
+  static void appendRow(TableData &td, const InlineRow &row);
+  static bool isDeleted(const TableData &td, size_t r);
+  static void compactTable(TableData &td);
+  static void clearTable(TableData &td);
+  // Recollect statistics from the live rows once removals skewed them
+  static void refreshStatistics(TableData &td);
+  static std::string checkUniqueOnInsert(const TableData &td, const Row &row);
+  // Selection bitmap over physical rows (bit r set => live row r matches)
+  static std::vector<uint64_t> evalMask(const TableData &td,
+                                        const std::optional<Predicate> &where);
+  Result<size_t> applyRowUpdates(TableData &td,
+                                 const std::vector<uint64_t> &sel,
+                                 const RowUpdater &updater);
+
+  std::unordered_map<std::string, TableData> tables_;
+  mutable metrics::ProfiledMutex<std::mutex> mtx_{metrics::LockSite::Columnar};
+};
+
+} // namespace kadedb
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace kadedb {
+
+/**
+ * Block compression for the bulk binary format, write-ahead logs and
+ * checkpoints.
+ *
+ * Both codecs write the LZ4 block format (so liblz4's LZ4_decompress_safe
+ * reads their output) from a built-in encoder, with no library to link:
+ *  - Lz4: greedy single-probe matching, for hot paths such as log frames;
+ *    compresses at several hundred MB/s
+ *  - Lz4High: chained match search for the longest match, for cold data
+ *    such as checkpoints; an order of magnitude slower to compress, about
+ *    20% smaller, and as fast to decompress
+ *
+ * A dictionary is a prefix the data may copy from, which lets small
+ * payloads (single rows or documents) compress; the same dictionary must
+ * be given to decompress(). Only its last 64 KiB are within reach.
+ */
+enum class Codec : uint8_t { None = 0, Lz4 = 1, Lz4High = 2 };
+
+namespace codec {
+
+constexpr size_t kDefaultDictionaryBytes = 16 * 1024;
+
+// Whether `v` names a Codec
+inline bool isCodec(uint8_t v) {
+  return v <= static_cast<uint8_t>(Codec::Lz4High);
+}
+
+// Largest compressed size of `n` bytes
+size_t compressBound(size_t n);
+
+// Append `n` bytes at `data` compressed with `codec` to `out`. Codec::None
+// appends them unchanged.
+void compress(Codec codec, const char *data, size_t n, std::string &out,
+              std::string_view dict = {});
+
+// Decode `n` compressed bytes into exactly `rawSize` bytes at `dst`; false
+// if the input is corrupt or does not decode to `rawSize` bytes. Never
+// reads or writes out of bounds.
+bool decompress(const char *data, size_t n, char *dst, size_t rawSize,
+                std::string_view dict = {});
+
+/**
+ * A dictionary of up to `maxBytes` built from typical payloads, such as
+ * the values of the string columns a table or log holds: the byte strings
+ * shared by the most samples, most frequent last (closest to the data).
+ * Empty when nothing recurs.
+ */
+std::string trainDictionary(const std::vector<std::string> &samples,
+                            size_t maxBytes = kDefaultDictionaryBytes);
+
+} // namespace codec
+} // namespace kadedb
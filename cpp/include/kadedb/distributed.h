@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "kadedb/compression.h" // Codec
+#include "kadedb/kadeql_ast.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/result.h"
+#include "kadedb/status.h" // Status, Result<T>
+
+namespace kadedb {
+namespace kadeql {
+
+/**
+ * @defgroup DistributedQueryAPI Distributed queries
+ * @brief Scatter-gather execution of KadeQL over tables split across nodes.
+ *
+ * A coordinator plans a SELECT into a fragment, itself KadeQL, that every
+ * node runs on its share of the table: the scan, WHERE and the partial
+ * aggregates (or ORDER BY with LIMIT + OFFSET rows for a top-K). Each node
+ * returns its rows as one binary row batch, and the coordinator merges the
+ * batches: it finishes the aggregates, applies HAVING, then the ORDER BY,
+ * LIMIT and OFFSET of the query. The transport (e.g. the gRPC
+ * FragmentService) carries fragments and batches as opaque text and bytes.
+ */
+
+/**
+ * One node's fragment result as exchanged between nodes: the columns as a
+ * table schema (bin::writeTableSchema, typed by the values they hold) then
+ * the rows as one row batch (bin::writeRowBatch) compressed with `codec`.
+ */
+/** @ingroup DistributedQueryAPI */
+std::string encodeFragmentResult(const ResultSet &rs,
+                                 Codec codec = Codec::None);
+
+/**
+ * Run `fragment` (DistributedQuery::fragment()) with `executor` and encode
+ * its result.
+ * @return the statement's error, or Status::InvalidArgument if it is not a
+ *         SELECT
+ */
+/** @ingroup DistributedQueryAPI */
+Result<std::string> executeFragment(QueryExecutor &executor,
+                                    const std::string &fragment,
+                                    Codec codec = Codec::None);
+
+/**
+ * Runs a fragment on one node and returns its encoded result, e.g. through
+ * executeFragment() locally or a remote call. Must not throw.
+ */
+using FragmentRunner =
+    std::function<Result<std::string>(const std::string &fragment)>;
+
+/**
+ * A SELECT split into per-node fragments and the merge of their results.
+ *
+ * Only single-table SELECTs are distributed. Aggregates split into
+ * partials: COUNT and SUM are summed, MIN and MAX folded again, AVG
+ * carried as a SUM and a COUNT, and FIRST/LAST (with an explicit order
+ * key) carried with the MIN/MAX of that key. GROUP BY keys and TIME_BUCKET
+ * group both stages. Without ORDER BY, groups come out in bucket order
+ * (when bucketed), otherwise in no particular order, and plain rows in
+ * node order.
+ *
+ * Example:
+ *
+ * ```cpp
+ * auto q = DistributedQuery::plan(
+ *     "SELECT ward, COUNT(*) AS n FROM patients GROUP BY ward");
+ * auto rs = q.value()->execute({node1, node2, node3});
+ * ```
+ *
+ * A plan is immutable; any number of threads may execute or merge it.
+ */
+/** @ingroup DistributedQueryAPI */
+class DistributedQuery {
+public:
+  /**
+   * Plan `query`, a single-table SELECT.
+   * @return Status::InvalidArgument for syntax errors and for statements
+   *         that cannot be distributed: other than SELECT, with JOINs or
+   *         parameters, FIRST/LAST without an order key, approximate
+   *         aggregates, window functions, or ORDER BY a column outside the
+   *         select list
+   */
+  static Result<std::shared_ptr<DistributedQuery>>
+  plan(const std::string &query);
+  static Result<std::shared_ptr<DistributedQuery>>
+  plan(const SelectStatement &select);
+
+  // KadeQL every node runs on its share of the table
+  const std::string &fragment() const { return fragment_; }
+  // KadeQL the coordinator runs over the gathered rows, in order: each
+  // reads the output of the previous one (table __stage<i>); none when the
+  // rows are only concatenated
+  const std::vector<std::string> &mergeStages() const { return stageText_; }
+
+  /**
+   * Combine the nodes' encoded fragment results into the query's result.
+   * @return Status::InvalidArgument for results that do not decode or
+   *         disagree in their columns; errors of the merge stages
+   */
+  Result<ResultSet> merge(const std::vector<std::string> &results) const;
+
+  /**
+   * Run fragment() on every node in parallel, then merge() the results.
+   * @return the first node's error, if any; otherwise as merge()
+   */
+  Result<ResultSet> execute(const std::vector<FragmentRunner> &nodes) const;
+
+private:
+  DistributedQuery() = default;
+
+  std::string fragment_;
+  std::vector<std::string> stageText_;
+  std::vector<std::unique_ptr<Statement>> stages_;
+  // Names of the result's columns, replacing the stages' internal ones
+  // (empty: keep them)
+  std::vector<std::string> outputNames_;
+};
+
+} // namespace kadeql
+} // namespace kadedb
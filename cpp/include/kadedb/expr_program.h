@@ -0,0 +1,89 @@
+#pragma once
+
+#include "kadedb/kadeql_ast.h"
+#include "kadedb/result.h"
+#include "kadedb/schema.h"
+#include "kadedb/status.h"
+#include "kadedb/value.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace kadedb {
+namespace kadeql {
+
+/**
+ * A KadeQL expression compiled against one input schema into register
+ * bytecode, so rows are evaluated without walking the AST.
+ *
+ * compile() resolves identifiers to column positions and literals to typed
+ * constants once, then flattens the tree in post-order: every node writes
+ * one register and reads the registers of its children. Registers are typed
+ * slots (int, float, bool, string reference or null), so arithmetic and
+ * comparisons on numbers take direct fast paths, strings are read from the
+ * cells in place, and a Value is only allocated for the result of run().
+ *
+ * Results, null semantics and error messages match the AST interpreter:
+ * every child is evaluated before its parent, errors surface from run() at
+ * the node that raised them (unknown identifiers only once a row is
+ * evaluated), and `/` always yields Float. The register file is reused
+ * between calls, so one program must not run on several threads at once.
+ */
+class ExprProgram {
+public:
+  using Cells = std::vector<std::unique_ptr<Value>>;
+
+  // Compile `expr` for rows laid out as `schema`; never fails
+  static ExprProgram compile(const Expression *expr, const TableSchema &schema);
+
+  // Evaluate against one row of cells (nullptr = null)
+  Result<std::unique_ptr<Value>> run(const Cells &row) const;
+
+  // Instructions in the program
+  size_t size() const { return code_.size(); }
+
+private:
+  enum class Op : uint8_t {
+    Column,  // a = column
+    Const,   // a = constant
+    Not,     // a = operand
+    Binary,  // a, b = operands
+    Between, // a = value, b = lower, c = upper
+    Error    // a = error
+  };
+  struct Instr {
+    Op op = Op::Error;
+    BinaryExpression::Operator bop = BinaryExpression::Operator::EQUALS;
+    uint32_t a = 0, b = 0, c = 0;
+  };
+  // One register; `str` points into a cell, a constant or `own`
+  struct Slot {
+    ValueType type = ValueType::Null;
+    bool b = false;
+    int64_t i = 0;
+    double f = 0;
+    const std::string *str = nullptr;
+    std::string own;
+  };
+
+  uint32_t emit(const Expression *expr, const TableSchema &schema);
+  Status binary(const Instr &in, Slot &out) const;
+  static int compareSlots(const Slot &l, const Slot &r);
+  static std::string stringify(const Slot &s);
+  static std::unique_ptr<Value> toValue(const Slot &s);
+
+  std::vector<Instr> code_; // instruction k writes register k
+  std::vector<Slot> consts_;
+  std::vector<Status> errors_;
+  mutable std::vector<Slot> regs_;
+};
+
+// Column of an identifier in `schema`, or TableSchema::npos. Joined rows
+// name columns "qualifier.column"; an unqualified name matches the one
+// such column (several: npos).
+size_t findColumnRef(const TableSchema &schema, const std::string &name);
+
+} // namespace kadeql
+} // namespace kadedb
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "kadedb/status.h" // Status
+
+namespace kadedb {
+
+/**
+ * @defgroup FileIO Asynchronous file I/O
+ * Positioned reads, writes and syncs of the durability layer (WAL appends,
+ * checkpoint blocks, recovery reads), issued without blocking the thread
+ * that queues them.
+ * @{
+ */
+
+enum class IoBackend {
+  Auto,   // Uring where the kernel allows it, else Threads
+  Uring,  // Linux io_uring: one system call submits a whole batch
+  Threads // blocking calls on the queue's own threads
+};
+
+/** One positioned transfer, or a sync of everything before it */
+struct IoOp {
+  enum class Kind : uint8_t { Read, Write, Sync };
+  Kind kind = Kind::Write;
+  int fd = -1;
+  char *data = nullptr; // destination of a Read, source of a Write
+  size_t bytes = 0;
+  uint64_t offset = 0;
+
+  static IoOp read(int fd, char *data, size_t bytes, uint64_t offset) {
+    return IoOp{Kind::Read, fd, data, bytes, offset};
+  }
+  static IoOp write(int fd, const char *data, size_t bytes, uint64_t offset) {
+    return IoOp{Kind::Write, fd, const_cast<char *>(data), bytes, offset};
+  }
+  // fdatasync of `fd` (fsync on macOS)
+  static IoOp sync(int fd) { return IoOp{Kind::Sync, fd, nullptr, 0, 0}; }
+};
+
+/**
+ * A queue of batches of IoOps.
+ *
+ * submit() starts a batch and returns at once; wait() blocks until it is
+ * done. The reads and writes of a batch run concurrently, and a Sync runs
+ * once every op before it in the batch has completed, so [write, sync]
+ * is an append that is durable when wait() returns. With io_uring a lone
+ * write and its sync go to the kernel linked, in one system call. Short
+ * transfers are continued, and a Read past the end of the file fails.
+ *
+ * The buffers of a batch must stay valid until its wait() returns. Every
+ * submitted batch must be waited for before the queue is destroyed.
+ * Thread-safe.
+ */
+class IoQueue {
+public:
+  // Up to `depth` ops in flight at once
+  explicit IoQueue(IoBackend backend = IoBackend::Auto, size_t depth = 64);
+  ~IoQueue();
+  IoQueue(const IoQueue &) = delete;
+  IoQueue &operator=(const IoQueue &) = delete;
+
+  // Uring or Threads: what Auto, or a Uring the kernel refused, became
+  IoBackend backend() const { return backend_; }
+
+  // Start `ops`; errors name `path`
+  uint64_t submit(std::vector<IoOp> ops, const std::string &path);
+  /**
+   * Block until batch `ticket` is done.
+   * @return Status::Internal with the first failed op's error
+   */
+  Status wait(uint64_t ticket);
+  // submit() then wait()
+  Status run(std::vector<IoOp> ops, const std::string &path) {
+    return wait(submit(std::move(ops), path));
+  }
+
+private:
+  struct Batch;
+  struct Slot;
+  struct Ring;
+
+  // Hand ready_ to the backend while fewer than depth_ ops are in flight
+  void pump();
+  // Process finished ops, blocking for at least one if `block`
+  void reap(bool block);
+  void complete(Slot *slot, long res);
+  // Queue the next ops of `b`, or finish it
+  void advance(Batch &b);
+  void threadLoop();
+
+  IoBackend backend_;
+  const size_t depth_;
+  std::unique_ptr<Ring> ring_;
+
+  std::mutex mtx_; // guards everything below but the thread backend's own
+  std::vector<std::unique_ptr<Batch>> batches_;
+  std::deque<Slot *> ready_;
+  size_t inflight_ = 0;
+  uint64_t nextTicket_ = 1;
+
+  // Threads backend: ops to run and finished ones
+  std::mutex threadMtx_;
+  std::condition_variable todoCv_;
+  std::condition_variable doneCv_;
+  std::deque<Slot *> todo_;
+  std::vector<std::pair<Slot *, long>> done_;
+  bool stop_ = false;
+  std::vector<std::thread> threads_;
+};
+
+namespace fileio {
+
+// Alignment of the buffers, offsets and sizes of O_DIRECT transfers
+constexpr size_t kDirectAlign = 4096;
+
+/**
+ * The first `size` bytes of `fd` into `out`, as concurrent reads of
+ * `chunkBytes` on `queue`.
+ * @return Status::Internal on I/O errors, naming `path`
+ */
+Status readFile(IoQueue &queue, int fd, uint64_t size, const std::string &path,
+                std::string &out, size_t chunkBytes = size_t{1} << 20);
+
+/**
+ * Open `path` for writing with O_DIRECT where the file system supports it,
+ * creating or truncating it; `direct`, if given, tells which way it was
+ * opened. Writes to a direct descriptor must be aligned to kDirectAlign.
+ * @return the descriptor, or -1 with errno set
+ */
+int openDirect(const std::string &path, bool *direct = nullptr);
+
+} // namespace fileio
+
+/** @} */
+
+} // namespace kadedb
@@ -5,6 +5,8 @@
 #include <string>
 #include <vector>
 
+#include "kadedb/status.h"
+
 namespace kadedb {
 
 struct GpuStatus {
@@ -21,12 +23,43 @@ struct GpuScanSpec {
 
   enum class Op { Eq, Ne, Lt, Le, Gt, Ge };
   Op op = Op::Eq;
+
+  // When set, the device copy of `column` is kept in
+  // defaultGpuColumnCache() under this key, and reused while cacheVersion
+  // is unchanged
+  std::string cacheKey;
+  uint64_t cacheVersion = 0;
+};
+
+// Transfer break-even model for offloading a scan: the device pays a fixed
+// launch cost and moves the input over the bus, the CPU streams it from
+// memory on every hardware thread
+struct GpuOffloadModel {
+  double launchSeconds = 30e-6;      // allocation, launch and sync
+  double busBytesPerSecond = 12e9;   // pageable host-to-device copies
+  double cpuBytesPerSecond = 4e9;    // one core scanning a column
+  size_t minRows = size_t{1} << 20;  // never offload below this
 };
 
-// Returns indices of rows that match the predicate.
-// This is a placeholder API: initial implementation uses CPU fallback.
+// True when the model expects the device to finish a scan of `rows` rows
+// of `bytesPerRow` input bytes first
+bool gpuOffloadPays(size_t rows, size_t bytesPerRow,
+                    const GpuOffloadModel &model = {});
+
+// True when device kernels are built and a device is present, and the
+// offload pays
+bool gpuShouldOffload(size_t rows, size_t bytesPerRow,
+                      const GpuOffloadModel &model = {});
+
+// Returns indices of rows that match the predicate, on the device when
+// gpuShouldOffload() holds and on CPU threads otherwise
 std::vector<size_t> gpuScanFilterInt64(const GpuScanSpec &spec);
 
+// Selection bitmap of `spec` computed on the device: bit i of out[i / 64]
+// is set when row i matches; `out` holds (count + 63) / 64 words. Fails
+// with FailedPrecondition when the build has no device kernels.
+Status gpuCompareInt64(const GpuScanSpec &spec, uint64_t *out);
+
 struct GpuTimeBucketAggSpec {
   const int64_t *timestamps = nullptr;
   const double *values = nullptr;
@@ -43,6 +76,11 @@ struct GpuTimeBucketAggResult {
   std::vector<int64_t> count;
 };
 
+// Sum and count of the values in [startInclusive, endExclusive) per bucket
+// of `bucketWidth` from startInclusive, in bucket order. Offloaded as
+// gpuScanFilterInt64 is; on the CPU, ascending timestamps take the SIMD
+// bucket kernel (scan::bucketAggregate) and others are hashed on worker
+// threads.
 GpuTimeBucketAggResult gpuTimeBucketSumCount(const GpuTimeBucketAggSpec &spec);
 
 } // namespace kadedb
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "kadedb/gpu_transfer.h"
+#include "kadedb/status.h"
+
+namespace kadedb {
+
+/**
+ * Device-resident copies of host columns, so that repeated scans of an
+ * unchanged column do not cross the bus again.
+ *
+ * Entries are keyed by name (e.g. a table id and column) and tagged with
+ * the version of the host data they copy: acquiring a key at another
+ * version uploads it again. The least recently used entries are evicted to
+ * keep the resident bytes within the budget. Uploads are double-buffered
+ * through two pinned staging buffers, each with its own stream, so the
+ * host fills one while the other is being copied.
+ *
+ * Acquired copies are shared: an evicted or replaced entry is freed once
+ * its last user releases it. The memory operations default to
+ * gpu_transfer.h and can be replaced, e.g. by host memory in tests.
+ * Thread-safe.
+ */
+class GpuColumnCache {
+public:
+  struct MemoryOps {
+    std::function<Status(void *&, size_t)> mallocDevice;
+    std::function<Status(void *)> freeDevice;
+    std::function<Status(void *&, size_t)> mallocPinned;
+    std::function<Status(void *)> freePinned;
+    std::function<Status(GpuStreamHandle &)> streamCreate;
+    std::function<Status(GpuStreamHandle)> streamDestroy;
+    std::function<Status(void *, const void *, size_t, GpuStreamHandle)>
+        copyToDevice;
+    std::function<Status(GpuStreamHandle)> synchronize;
+  };
+  // The gpu_transfer.h operations
+  static MemoryOps deviceOps();
+
+  struct Stats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t entries = 0;
+    size_t residentBytes = 0;
+  };
+
+  static constexpr size_t kDefaultStagingBytes = size_t{4} << 20;
+
+  explicit GpuColumnCache(size_t budgetBytes,
+                          size_t stagingBytes = kDefaultStagingBytes,
+                          MemoryOps ops = deviceOps());
+  ~GpuColumnCache();
+
+  GpuColumnCache(const GpuColumnCache &) = delete;
+  GpuColumnCache &operator=(const GpuColumnCache &) = delete;
+
+  // Device copy of the `bytes` bytes at `host`, cached under `key` at
+  // `version`. Fails with FailedPrecondition when `bytes` exceeds the
+  // budget, or with the error of the memory operations.
+  Result<std::shared_ptr<const void>> acquire(const std::string &key,
+                                              uint64_t version,
+                                              const void *host, size_t bytes);
+
+  // Drop the entry of `key`, if any
+  void invalidate(const std::string &key);
+  void clear();
+
+  size_t budget() const;
+  // Change the budget, evicting entries above the new one
+  void setBudget(size_t budgetBytes);
+
+  Stats stats() const;
+
+private:
+  struct Entry {
+    std::string key;
+    uint64_t version = 0;
+    size_t bytes = 0;
+    std::shared_ptr<const void> device;
+  };
+  // Pinned buffer and its stream
+  struct Staging {
+    void *buffer = nullptr;
+    GpuStreamHandle stream = nullptr;
+  };
+
+  Status upload(void *device, const void *host, size_t bytes);
+  Status ensureStaging();
+  void evictTo(size_t bytes);
+  void erase(std::list<Entry>::iterator it);
+
+  MemoryOps ops_;
+  size_t budget_;
+  size_t stagingBytes_;
+  mutable std::mutex mtx_;
+  std::list<Entry> lru_; // most recently used first
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+  Staging staging_[2];
+  bool stagingReady_ = false;
+  Stats stats_;
+};
+
+// Process-wide cache of the GPU kernels (gpu.h); the budget defaults to
+// 1 GiB, or KADEDB_GPU_CACHE_BYTES when set
+GpuColumnCache &defaultGpuColumnCache();
+
+} // namespace kadedb
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "kadedb/graph/storage.h"
+#include "kadedb/value.h"
+
+namespace kadedb {
+
+/**
+ * Graphs held in memory in a compact encoding, for graphs too large for
+ * InMemoryGraphStorage (about 400 bytes per edge with properties and
+ * labels).
+ *
+ * Nodes get dense 32-bit slots, reused after erases. Each node's out- and
+ * in-edges are kept as one byte string of lists sorted by (neighbor slot,
+ * edge id): varint slot deltas and zigzag varint edge id deltas, plus an
+ * interned type id for out-edges. New entries are appended to an
+ * unsorted tail, which is sorted into the lists once it outgrows 1/8 of
+ * them, so inserts stay amortized O(1).
+ * Edge types and labels are interned, and a node's or edge's labels are
+ * one id of an interned label set. Properties live in side tables, one
+ * column per property name, so edges without properties pay nothing for
+ * them. Edge ids lead to their source slot through delta-coded sorted
+ * blocks (about 6 bytes per edge).
+ *
+ * A random graph of 50k nodes and 800k typed edges then takes about 26
+ * bytes per edge, locator included. The trade-off is in lookups: getEdge
+ * decodes its source's out-list, getNode/getEdge gather properties from
+ * every column, and erasing an edge re-encodes the lists of both
+ * endpoints. Neighbors are listed by ascending slot, followed by the
+ * unsorted tail, not in insertion order. Label and property indexes and
+ * CSR snapshots are not supported. Otherwise the behavior matches
+ * InMemoryGraphStorage.
+ */
+class CompactGraphStorage final : public GraphStorage {
+public:
+  CompactGraphStorage() = default;
+  ~CompactGraphStorage() override = default;
+
+  Status createGraph(const std::string &graph) override;
+  Status dropGraph(const std::string &graph) override;
+  std::vector<std::string> listGraphs() const override;
+
+  Result<Node> getNode(const std::string &graph, NodeId id) const override;
+  Status putNode(const std::string &graph, const Node &node) override;
+  Status eraseNode(const std::string &graph, NodeId id) override;
+
+  Result<Edge> getEdge(const std::string &graph, EdgeId id) const override;
+  Status putEdge(const std::string &graph, const Edge &edge) override;
+  Status eraseEdge(const std::string &graph, EdgeId id) override;
+
+  Result<std::vector<EdgeId>> edgeIdsOut(const std::string &graph,
+                                         NodeId from) const override;
+  Result<std::vector<EdgeId>> edgeIdsIn(const std::string &graph,
+                                        NodeId to) const override;
+  Result<std::vector<NodeId>> neighborsOut(const std::string &graph,
+                                           NodeId from) const override;
+  Result<std::vector<NodeId>> neighborsIn(const std::string &graph,
+                                          NodeId to) const override;
+
+  Result<std::vector<NodeId>> bfs(const std::string &graph, NodeId start,
+                                  size_t maxNodes) const override;
+  Result<std::vector<NodeId>> dfs(const std::string &graph, NodeId start,
+                                  size_t maxNodes) const override;
+
+  Result<GraphContents> contents(const std::string &graph) const override;
+
+  // Approximate heap bytes held by the graph, allocator overhead excluded
+  Result<size_t> memoryBytes(const std::string &graph) const;
+
+private:
+  using Slot = uint32_t;
+
+  // One adjacency entry: the node at the other end, the edge and, for
+  // out-edges, its interned type
+  struct Entry {
+    Slot node;
+    EdgeId edge;
+    uint32_t type;
+    bool operator<(const Entry &o) const {
+      return node != o.node ? node < o.node : edge < o.edge;
+    }
+  };
+  struct NodeRecord {
+    NodeId id = 0;
+    uint32_t labelSet = 0;
+    uint32_t outCount = 0; // entries, tail included
+    uint32_t inCount = 0;
+    uint32_t tailCount = 0; // unsorted entries after the sorted lists
+    // bytes: [0, outEnd) sorted out-list, [outEnd, inEnd) sorted in-list,
+    // then the tail
+    uint32_t outEnd = 0;
+    uint32_t inEnd = 0;
+    std::vector<uint8_t> bytes;
+  };
+
+  // Strings to small ids, in order of first use
+  class Interner {
+  public:
+    uint32_t intern(const std::string &s);
+    const std::string &name(uint32_t id) const { return names_[id]; }
+    size_t memoryBytes() const;
+
+  private:
+    std::vector<std::string> names_;
+    std::unordered_map<std::string, uint32_t> ids_;
+  };
+
+  // Edge id -> source slot. Ids are sorted in blocks of kBlock: the first
+  // id of each block in full, the rest as varint deltas, with the slots in
+  // a parallel array. New ids wait in an unsorted tail, erased ones leave
+  // an npos slot, and both are folded in by a rebuild once they outgrow a
+  // fraction of the arrays.
+  class EdgeLocator {
+  public:
+    static constexpr Slot npos = UINT32_MAX;
+    Slot find(EdgeId id) const;
+    void insert(EdgeId id, Slot from);
+    void erase(EdgeId id);
+    size_t memoryBytes() const;
+
+  private:
+    static constexpr size_t kBlock = 64;
+    // Position of `id` in the sorted arrays, or SIZE_MAX
+    size_t position(EdgeId id) const;
+    void merge();
+
+    std::vector<EdgeId> blockFirst_;
+    std::vector<uint32_t> blockOffset_; // into deltas_
+    std::vector<uint8_t> deltas_;
+    std::vector<Slot> from_; // npos once erased
+    size_t erased_ = 0;
+    std::unordered_map<EdgeId, Slot> tail_;
+  };
+
+  struct GraphData {
+    std::vector<NodeRecord> records;
+    std::vector<Slot> freeSlots;
+    std::unordered_map<NodeId, Slot> slots;
+    EdgeLocator edges;
+    Interner types;
+    Interner labels;
+    // Interned label sets (sorted label ids); set 0 is empty
+    std::vector<std::vector<uint32_t>> labelSets{{}};
+    std::map<std::vector<uint32_t>, uint32_t> labelSetIds{{{}, 0}};
+    std::unordered_map<EdgeId, uint32_t> edgeLabelSets; // non-empty only
+    // property name -> id -> value
+    std::unordered_map<std::string, std::unordered_map<NodeId, InlineValue>>
+        nodeColumns;
+    std::unordered_map<std::string, std::unordered_map<EdgeId, InlineValue>>
+        edgeColumns;
+    mutable metrics::ProfiledMutex<std::shared_mutex> mtx{
+        metrics::LockSite::CompactGraphData};
+  };
+
+  std::shared_ptr<GraphData> findGraph(const std::string &graph) const;
+  static const NodeRecord *record(const GraphData &g, NodeId id);
+  static uint32_t internLabels(GraphData &g,
+                               const std::unordered_set<std::string> &labels);
+  static std::unordered_set<std::string> labelsOf(const GraphData &g,
+                                                  uint32_t set);
+  // fn(Entry) for each out- or in-entry of `r`
+  template <typename Fn>
+  static void forEachEntry(const NodeRecord &r, bool out, const Fn &fn);
+  static void addEntry(NodeRecord &r, bool out, const Entry &e);
+  static void removeEntry(NodeRecord &r, bool out, EdgeId edge);
+  // Sort the tail into the lists
+  static void flush(NodeRecord &r);
+  static void store(NodeRecord &r, std::vector<Entry> &out,
+                    std::vector<Entry> &in);
+  // Drops edge `id` (source slot `from`) from both endpoints and the side
+  // tables
+  static void unlinkEdge(GraphData &g, EdgeId id, Slot from);
+
+  std::unordered_map<std::string, std::shared_ptr<GraphData>> graphs_;
+  // Guards the graphs_ catalog only; graph contents are guarded by each
+  // GraphData::mtx
+  mutable metrics::ProfiledMutex<std::shared_mutex> mtx_{
+      metrics::LockSite::CompactGraphCatalog};
+};
+
+} // namespace kadedb
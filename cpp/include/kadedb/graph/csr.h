@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "kadedb/graph/schema.h"
+#include "kadedb/page_allocator.h"
+
+namespace kadedb {
+
+/**
+ * Immutable compressed sparse row (CSR) copy of a graph's adjacency, for
+ * read-heavy traversals.
+ *
+ * Nodes are renumbered densely in id order. The out-edges of node i are
+ * the slots [outOffset(i), outOffset(i + 1)) of the target and edge id
+ * arrays, in the order the adjacency index lists them; in-edges likewise.
+ * A hop is then two array reads instead of two hash lookups.
+ */
+class CsrGraph {
+public:
+  using Index = uint32_t;
+  static constexpr Index npos = std::numeric_limits<Index>::max();
+
+  // Dense indices of the nodes at the other end of a node's edges
+  struct Neighbors {
+    const Index *first = nullptr;
+    const Index *last = nullptr;
+    const Index *begin() const { return first; }
+    const Index *end() const { return last; }
+    size_t size() const { return static_cast<size_t>(last - first); }
+    bool empty() const { return first == last; }
+  };
+
+  CsrGraph() = default;
+
+  // Snapshot of `nodes` (any order) and their edges. Edges listed by
+  // `outAdj`/`inAdj` that are missing from `edges`, or whose other end is
+  // not among `nodes`, are skipped.
+  static CsrGraph build(const std::vector<NodeId> &nodes,
+                        const std::unordered_map<EdgeId, Edge> &edges,
+                        const AdjacencyIndex &outAdj,
+                        const AdjacencyIndex &inAdj);
+  // Snapshot of `nodes` (any order) and `edges`, each node's out- and
+  // in-edges in the order of `edges`, for bulk loads without an adjacency
+  // index. Edges with an end not among `nodes` are skipped. Endpoints are
+  // resolved by `threads` workers (0: one per hardware thread), then each
+  // direction is counting-sorted on a thread of its own.
+  static CsrGraph build(const std::vector<NodeId> &nodes,
+                        const std::vector<Edge> &edges, size_t threads = 0);
+
+  size_t nodeCount() const { return ids_.size(); }
+  size_t edgeCount() const { return outTargets_.size(); }
+
+  NodeId id(Index i) const { return ids_[i]; }
+  // Dense index of node `id`, or npos
+  Index indexOf(NodeId id) const;
+
+  Neighbors out(Index i) const { return range(outOffsets_, outTargets_, i); }
+  Neighbors in(Index i) const { return range(inOffsets_, inTargets_, i); }
+  // Edge ids parallel to out(i) and in(i)
+  const EdgeId *outEdges(Index i) const {
+    return outEdges_.data() + outOffsets_[i];
+  }
+  const EdgeId *inEdges(Index i) const {
+    return inEdges_.data() + inOffsets_[i];
+  }
+  // First slot of node i's out- and in-edges
+  uint64_t outOffset(Index i) const { return outOffsets_[i]; }
+  uint64_t inOffset(Index i) const { return inOffsets_[i]; }
+  size_t outDegree(Index i) const {
+    return outOffsets_[i + 1] - outOffsets_[i];
+  }
+  size_t inDegree(Index i) const { return inOffsets_[i + 1] - inOffsets_[i]; }
+
+  // Frontier steps taken by breadthFirst()
+  struct BfsStats {
+    size_t levels = 0;
+    size_t topDownSteps = 0;
+    size_t bottomUpSteps = 0;
+  };
+
+  // Nodes reachable from `source` over out-edges, in order of depth and
+  // then index (ascending id), stopping at the first depth that reaches
+  // `maxNodes` (0: no limit) and truncated to it.
+  //
+  // Level-synchronous over `threads` workers (0: one per hardware thread)
+  // with a visited bitmap. Each step is top-down (the frontier's out-edges)
+  // or, while the frontier's edges outnumber the unexplored ones / alpha,
+  // bottom-up (unvisited nodes look for a parent among their in-edges).
+  std::vector<Index> breadthFirst(Index source, size_t maxNodes = 0,
+                                  size_t threads = 0,
+                                  BfsStats *stats = nullptr) const;
+
+  // Weakly connected components: label[i] is the smallest index in the
+  // component of node i, ignoring edge direction. Edges are united
+  // concurrently by `threads` workers (0: one per hardware thread) with a
+  // lock-free union-find that links the larger root under the smaller.
+  std::vector<Index> weakComponents(size_t threads = 0) const;
+  // Strongly connected components: label[i] == label[j] exactly when nodes
+  // i and j reach each other
+  std::vector<Index> strongComponents() const;
+
+  // PageRank by pull iterations: each node sums rank / out-degree over its
+  // in-edges, so every worker writes only its own slots. Dangling nodes
+  // spread their rank evenly. Stops after `iterations` rounds or once the
+  // L1 change of a round drops below `tolerance`; ranks sum to 1.
+  std::vector<double> pageRank(double damping = 0.85, size_t iterations = 20,
+                               double tolerance = 1e-9,
+                               size_t threads = 0) const;
+  // Triangles of the underlying undirected simple graph (direction,
+  // parallel edges and self-loops ignored). Each node keeps the sorted
+  // neighbors ranked above it by degree, and a triangle is counted once by
+  // intersecting the lists at either end of its lowest-ranked edge.
+  uint64_t triangleCount(size_t threads = 0) const;
+
+  size_t memoryBytes() const;
+
+private:
+  static Neighbors range(const PageVector<uint64_t> &offsets,
+                         const PageVector<Index> &targets, Index i) {
+    return Neighbors{targets.data() + offsets[i],
+                     targets.data() + offsets[i + 1]};
+  }
+
+  // Arrays placed by the page policy (page_allocator.h)
+  PageVector<NodeId> ids_; // ascending
+  // Ids are ids_[0] + i: indexOf() is a subtraction
+  bool contiguous_ = true;
+  PageVector<uint64_t> outOffsets_{0};
+  PageVector<Index> outTargets_;
+  PageVector<EdgeId> outEdges_;
+  PageVector<uint64_t> inOffsets_{0};
+  PageVector<Index> inTargets_;
+  PageVector<EdgeId> inEdges_;
+};
+
+} // namespace kadedb
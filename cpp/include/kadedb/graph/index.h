@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "kadedb/index.h" // IndexType
+#include "kadedb/value.h"
+
+namespace kadedb {
+
+// Property predicates behind graph lookups. Numbers compare with numbers and
+// other values with values of their own type; Null and NaN match nothing.
+bool propertyEquals(const Value *property, const Value &value);
+// lower <= property <= upper; nullptr bounds are open
+bool propertyInRange(const Value *property, const Value *lower,
+                     const Value *upper);
+
+/**
+ * Secondary index over one property of a graph's nodes or edges, mapping
+ * values to ids.
+ *
+ * Numbers are keyed as doubles, so Integer and Float values that compare
+ * equal share a key; the ids under a key are kept ascending. Missing, Null
+ * and NaN properties are not indexed, as they match no lookup. Lookups
+ * return ascending candidate ids, a superset of the matches (integers past
+ * 2^53 may share a key), so callers re-check each candidate. lookupRange
+ * returns std::nullopt for Hash indexes.
+ */
+class PropertyIndex {
+public:
+  using Id = int64_t;
+
+  explicit PropertyIndex(IndexType type) : type_(type) {}
+
+  IndexType type() const { return type_; }
+
+  // Add or remove the entry for `id`, whose property is `value` (nullptr
+  // when absent)
+  void insert(const Value *value, Id id);
+  void erase(const Value *value, Id id);
+
+  std::vector<Id> lookupEq(const Value &value) const;
+  std::optional<std::vector<Id>> lookupRange(const Value *lower,
+                                             const Value *upper) const;
+
+private:
+  struct KeyHash {
+    size_t operator()(const InlineValue &v) const;
+  };
+
+  static std::optional<InlineValue> key(const Value *v);
+
+  IndexType type_;
+  std::unordered_map<InlineValue, std::vector<Id>, KeyHash> hash_;
+  std::map<InlineValue, std::vector<Id>> ordered_;
+};
+
+} // namespace kadedb
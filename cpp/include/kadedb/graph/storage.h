@@ -1,19 +1,32 @@
 #pragma once
 
 #include <cstddef>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <optional>
+#include <shared_mutex>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "kadedb/graph/csr.h"
+#include "kadedb/graph/index.h"
 #include "kadedb/graph/schema.h"
+#include "kadedb/memory.h"
+#include "kadedb/profiled_mutex.h"
 #include "kadedb/result.h"
 #include "kadedb/status.h"
 
 namespace kadedb {
 
+// Copies of every node and edge of a graph, each ascending by id
+struct GraphContents {
+  std::vector<Node> nodes;
+  std::vector<Edge> edges;
+};
+
 class GraphStorage {
 public:
   virtual ~GraphStorage() = default;
@@ -30,6 +43,14 @@ public:
   virtual Status putEdge(const std::string &graph, const Edge &edge) = 0;
   virtual Status eraseEdge(const std::string &graph, EdgeId id) = 0;
 
+  // Batch puts, with the outcome of putNode()/putEdge() of each in turn.
+  // Implementations may apply a batch all or nothing. The defaults put one
+  // at a time and stop at the first failure.
+  virtual Status putNodes(const std::string &graph,
+                          const std::vector<Node> &nodes);
+  virtual Status putEdges(const std::string &graph,
+                          const std::vector<Edge> &edges);
+
   // Neighbor lookups
   virtual Result<std::vector<EdgeId>> edgeIdsOut(const std::string &graph,
                                                  NodeId from) const = 0;
@@ -40,16 +61,152 @@ public:
   virtual Result<std::vector<NodeId>> neighborsIn(const std::string &graph,
                                                   NodeId to) const = 0;
 
+  // Visitors over stored nodes and edges without copying them. `fn` may run
+  // under the storage's read lock, so it must not call back into the
+  // storage. The defaults copy through the lookups above.
+  enum class Direction { Out, In };
+  virtual Status withNode(const std::string &graph, NodeId id,
+                          const std::function<void(const Node &)> &fn) const;
+  virtual Status withEdge(const std::string &graph, EdgeId id,
+                          const std::function<void(const Edge &)> &fn) const;
+  // fn(neighbor) for the far end of each out- or in-edge of `id`, in the
+  // order of neighborsOut()/neighborsIn()
+  virtual Status forEachNeighbor(const std::string &graph, NodeId id,
+                                 const std::function<void(NodeId)> &fn,
+                                 Direction dir = Direction::Out) const;
+  // fn(edge) for each out- or in-edge of `id`, in the order of
+  // edgeIdsOut()/edgeIdsIn()
+  virtual Status forEachEdge(const std::string &graph, NodeId id,
+                             const std::function<void(const Edge &)> &fn,
+                             Direction dir = Direction::Out) const;
+
   // Basic traversal
   virtual Result<std::vector<NodeId>>
   bfs(const std::string &graph, NodeId start, size_t maxNodes = 0) const = 0;
   virtual Result<std::vector<NodeId>>
   dfs(const std::string &graph, NodeId start, size_t maxNodes = 0) const = 0;
+
+  // Nodes reachable from `start` in order of depth, ascending id within a
+  // depth: the same nodes per depth as bfs(), for reachability over large
+  // graphs. Implementations may spread each depth over `threads` workers
+  // (0: one per hardware thread). The default expands one depth at a time
+  // through neighborsOut().
+  virtual Result<std::vector<NodeId>> parallelBfs(const std::string &graph,
+                                                  NodeId start,
+                                                  size_t maxNodes = 0,
+                                                  size_t threads = 0) const;
+
+  // Which edges a filtered traversal follows and which nodes it enters.
+  // Edge types match case-insensitively, as in MATCH; a node is entered
+  // when it carries any of `nodeLabels`. Empty lists admit everything.
+  struct TraversalFilter {
+    std::vector<std::string> edgeTypes;
+    std::vector<std::string> nodeLabels;
+    // Hops from the start, 0 for no limit
+    size_t maxDepth = 0;
+    Direction direction = Direction::Out;
+  };
+
+  // Nodes reached from `start` over the edges and nodes `filter` admits,
+  // checked while expanding; the start comes first whatever its labels.
+  // filteredBfs() lists them in order of depth, ascending id within a
+  // depth, as parallelBfs() does, stopping at the first depth that reaches
+  // `maxNodes` (0: no limit) and truncated to it. filteredDfs() lists them
+  // in the order of dfs(), a node's depth being that of the path the
+  // search first reaches it by. The defaults read forEachEdge() and, for
+  // labels, withNode().
+  virtual Result<std::vector<NodeId>>
+  filteredBfs(const std::string &graph, NodeId start,
+              const TraversalFilter &filter, size_t maxNodes = 0) const;
+  virtual Result<std::vector<NodeId>>
+  filteredDfs(const std::string &graph, NodeId start,
+              const TraversalFilter &filter, size_t maxNodes = 0) const;
+  // For each of `starts`, the nodes filteredBfs() reaches from it other
+  // than itself, ascending id: with `filter.maxDepth` k, the k-hop
+  // neighborhoods of many nodes at once. Implementations may spread the
+  // starts over `threads` workers (0: one per hardware thread). The
+  // default runs filteredBfs() per start.
+  virtual Result<std::vector<std::vector<NodeId>>>
+  neighborhoods(const std::string &graph, const std::vector<NodeId> &starts,
+                const TraversalFilter &filter, size_t threads = 0) const;
+
+  // A path with the fewest edges from `from` to `to` over out-edges, both
+  // ends included; empty when `to` is unreachable. The default searches
+  // from both ends, out-edges forward and in-edges backward, always
+  // expanding the smaller frontier by one depth.
+  virtual Result<std::vector<NodeId>>
+  shortestPath(const std::string &graph, NodeId from, NodeId to) const;
+  // Whether `to` is reachable from `from` over out-edges. The default runs
+  // shortestPath().
+  virtual Result<bool> reachable(const std::string &graph, NodeId from,
+                                 NodeId to) const;
+
+  // Immutable CSR copy of the graph's current adjacency, for analytics
+  // kernels (PageRank, components, triangles). The default reports it
+  // unsupported.
+  virtual Result<std::shared_ptr<const CsrGraph>>
+  snapshot(const std::string &graph) const;
+
+  // Every node and edge of the graph, e.g. for backups. Implementations
+  // copy them under one read lock, so every edge joins two copied nodes.
+  // The default reads the nodes and edges of snapshot() through
+  // getNode()/getEdge(), skipping those erased meanwhile and edges whose
+  // ends were: each copy is current, but not all from the same moment.
+  virtual Result<GraphContents> contents(const std::string &graph) const;
+
+  // Label and property lookups, ids ascending. Property matches follow
+  // propertyEquals()/propertyInRange(). Indexes only speed lookups up: a
+  // lookup without one scans. The defaults report them unsupported.
+  virtual Result<std::vector<NodeId>>
+  nodesWithLabel(const std::string &graph, const std::string &label) const;
+  virtual Status createNodeIndex(const std::string &graph,
+                                 const std::string &property, IndexType type);
+  virtual Status dropNodeIndex(const std::string &graph,
+                               const std::string &property);
+  virtual Status createEdgeIndex(const std::string &graph,
+                                 const std::string &property, IndexType type);
+  virtual Status dropEdgeIndex(const std::string &graph,
+                               const std::string &property);
+  virtual Result<std::vector<NodeId>> findNodes(const std::string &graph,
+                                                const std::string &property,
+                                                const Value &value) const;
+  // lower <= property <= upper; nullptr bounds are open
+  virtual Result<std::vector<NodeId>>
+  findNodesInRange(const std::string &graph, const std::string &property,
+                   const Value *lower, const Value *upper) const;
+  virtual Result<std::vector<EdgeId>> findEdges(const std::string &graph,
+                                                const std::string &property,
+                                                const Value &value) const;
+  virtual Result<std::vector<EdgeId>>
+  findEdgesInRange(const std::string &graph, const std::string &property,
+                   const Value *lower, const Value *upper) const;
 };
 
+/**
+ * Graphs held in memory: nodes and edges in hash maps, with an adjacency
+ * index of edge ids per node. Edges are appended to their lists; erasing
+ * one moves the last id of each list into its slot, so erases take O(1)
+ * and lists keep insertion order only until their first erase.
+ *
+ * Traversals (bfs, dfs, neighborsOut/neighborsIn) read a CsrGraph snapshot
+ * of the adjacency. Writes do not rebuild it: they mark the nodes whose
+ * edges changed, and traversals read those nodes, and nodes added since,
+ * from the adjacency index instead. The next traversal rebuilds the
+ * snapshot once the writes since the last build reach
+ * max(snapshotRebuildWrites, edges / 8).
+ *
+ * putNodes()/putEdges() apply a batch under one lock, all or nothing.
+ * putEdges() into a graph without edges builds the snapshot straight from
+ * the batch and the adjacency index from the snapshot, instead of
+ * appending edge by edge.
+ */
 class InMemoryGraphStorage final : public GraphStorage {
 public:
-  InMemoryGraphStorage() = default;
+  static constexpr size_t kDefaultSnapshotRebuildWrites = 4096;
+
+  explicit InMemoryGraphStorage(
+      size_t snapshotRebuildWrites = kDefaultSnapshotRebuildWrites)
+      : snapshotRebuildWrites_(snapshotRebuildWrites) {}
   ~InMemoryGraphStorage() override = default;
 
   Status createGraph(const std::string &graph) override;
@@ -64,6 +221,14 @@ public:
   Status putEdge(const std::string &graph, const Edge &edge) override;
   Status eraseEdge(const std::string &graph, EdgeId id) override;
 
+  // Endpoints and the memory budget are checked for the whole batch before
+  // anything is stored. A later duplicate id in a batch replaces an earlier
+  // one, as separate puts would.
+  Status putNodes(const std::string &graph,
+                  const std::vector<Node> &nodes) override;
+  Status putEdges(const std::string &graph,
+                  const std::vector<Edge> &edges) override;
+
   Result<std::vector<EdgeId>> edgeIdsOut(const std::string &graph,
                                          NodeId from) const override;
   Result<std::vector<EdgeId>> edgeIdsIn(const std::string &graph,
@@ -73,22 +238,184 @@ public:
   Result<std::vector<NodeId>> neighborsIn(const std::string &graph,
                                           NodeId to) const override;
 
+  Status withNode(const std::string &graph, NodeId id,
+                  const std::function<void(const Node &)> &fn) const override;
+  Status withEdge(const std::string &graph, EdgeId id,
+                  const std::function<void(const Edge &)> &fn) const override;
+  Status forEachNeighbor(const std::string &graph, NodeId id,
+                         const std::function<void(NodeId)> &fn,
+                         Direction dir = Direction::Out) const override;
+  Status forEachEdge(const std::string &graph, NodeId id,
+                     const std::function<void(const Edge &)> &fn,
+                     Direction dir = Direction::Out) const override;
+
   Result<std::vector<NodeId>> bfs(const std::string &graph, NodeId start,
                                   size_t maxNodes) const override;
   Result<std::vector<NodeId>> dfs(const std::string &graph, NodeId start,
                                   size_t maxNodes) const override;
+  // CsrGraph::breadthFirst() over an up-to-date snapshot, rebuilt first if
+  // the graph changed since the last build
+  Result<std::vector<NodeId>> parallelBfs(const std::string &graph,
+                                          NodeId start, size_t maxNodes = 0,
+                                          size_t threads = 0) const override;
+  // Over the snapshot and overlay like bfs(), comparing the interned edge
+  // types of the snapshot and the label lists of the graph; neighborhoods()
+  // shares one snapshot among the workers
+  Result<std::vector<NodeId>>
+  filteredBfs(const std::string &graph, NodeId start,
+              const TraversalFilter &filter,
+              size_t maxNodes = 0) const override;
+  Result<std::vector<NodeId>>
+  filteredDfs(const std::string &graph, NodeId start,
+              const TraversalFilter &filter,
+              size_t maxNodes = 0) const override;
+  Result<std::vector<std::vector<NodeId>>>
+  neighborhoods(const std::string &graph, const std::vector<NodeId> &starts,
+                const TraversalFilter &filter,
+                size_t threads = 0) const override;
+  // Answered by the component labels of the snapshot while it is up to
+  // date: different weak components are unreachable, a shared strong
+  // component is reachable. Otherwise searches as the default does.
+  Result<bool> reachable(const std::string &graph, NodeId from,
+                         NodeId to) const override;
+
+  // Labels are always indexed; property indexes are kept up to date by
+  // every write once created
+  Result<std::vector<NodeId>>
+  nodesWithLabel(const std::string &graph,
+                 const std::string &label) const override;
+  Status createNodeIndex(const std::string &graph, const std::string &property,
+                         IndexType type) override;
+  Status dropNodeIndex(const std::string &graph,
+                       const std::string &property) override;
+  Status createEdgeIndex(const std::string &graph, const std::string &property,
+                         IndexType type) override;
+  Status dropEdgeIndex(const std::string &graph,
+                       const std::string &property) override;
+  Result<std::vector<NodeId>> findNodes(const std::string &graph,
+                                        const std::string &property,
+                                        const Value &value) const override;
+  Result<std::vector<NodeId>>
+  findNodesInRange(const std::string &graph, const std::string &property,
+                   const Value *lower, const Value *upper) const override;
+  Result<std::vector<EdgeId>> findEdges(const std::string &graph,
+                                        const std::string &property,
+                                        const Value &value) const override;
+  Result<std::vector<EdgeId>>
+  findEdgesInRange(const std::string &graph, const std::string &property,
+                   const Value *lower, const Value *upper) const override;
+
+  // Rebuilt first if any write happened since the last build
+  Result<std::shared_ptr<const CsrGraph>>
+  snapshot(const std::string &graph) const override;
+  Result<GraphContents> contents(const std::string &graph) const override;
+
+  // Estimated bytes of a graph's nodes, edges and adjacency lists (not its
+  // indexes or snapshot); NotFound if it does not exist
+  Result<size_t> memoryUsage(const std::string &graph) const;
+  // Budget for memoryUsage(), 0 for none: puts that would exceed it fail
+  // with ResourceExhausted
+  Status setMemoryBudget(const std::string &graph, size_t bytes);
 
 private:
+  // A CSR snapshot and the nodes whose out- or in-edges changed since it
+  // was built (bits by dense index). Writers update it in place under the
+  // exclusive graph lock; readers only share it.
+  struct Components {
+    std::vector<CsrGraph::Index> weak;
+    std::vector<CsrGraph::Index> strong;
+  };
+  // Edge::type of every snapshot edge as an interned id, parallel to the
+  // CSR's out- and in-edge slots
+  struct EdgeTypes;
+  struct Snapshot {
+    std::shared_ptr<const CsrGraph> csr;
+    std::vector<uint64_t> dirtyOut;
+    std::vector<uint64_t> dirtyIn;
+    size_t writes = 0;
+    // Labels of csr, computed on first use under GraphData::snapshotMtx
+    mutable std::shared_ptr<const Components> components;
+    // Edge types of csr, interned likewise by the first typed traversal
+    mutable std::shared_ptr<const EdgeTypes> edgeTypes;
+  };
+
   struct GraphData {
     std::unordered_map<NodeId, Node> nodes;
     std::unordered_map<EdgeId, Edge> edges;
     // adjacency: node -> edge ids
     AdjacencyIndex outAdj;
     AdjacencyIndex inAdj;
+    // Position of each edge in its outAdj and inAdj lists: erasing an edge
+    // moves the last id of each list into its slot instead of shifting it
+    struct EdgeSlots {
+      size_t out;
+      size_t in;
+    };
+    std::unordered_map<EdgeId, EdgeSlots> slots;
+    // label -> ids of the nodes carrying it, ascending
+    std::unordered_map<std::string, std::vector<NodeId>> labels;
+    std::unordered_map<std::string, PropertyIndex> nodeIndexes;
+    std::unordered_map<std::string, PropertyIndex> edgeIndexes;
+    // Bytes of the nodes, edges and adjacency, kept by every write
+    MemoryAccount memory;
+    // Per-graph reader/writer lock: shared for lookups and traversals,
+    // exclusive for mutations
+    mutable metrics::ProfiledMutex<std::shared_mutex> mtx{
+        metrics::LockSite::GraphData};
+    // Built by the first traversal that needs it; snapshotMtx serializes
+    // builders, which hold mtx shared
+    mutable std::shared_ptr<Snapshot> snap;
+    mutable metrics::ProfiledMutex<std::mutex> snapshotMtx{
+        metrics::LockSite::GraphSnapshot};
   };
+  // Adjacency of a snapshot patched by the writes since it was built
+  class OverlayView;
+  // A filtered traversal over an OverlayView, its types and labels
+  // resolved once for any number of starts
+  class FilteredWalk;
+
+  std::shared_ptr<GraphData> findGraph(const std::string &graph) const;
+  // The snapshot to traverse, rebuilt when `exact` and out of date or when
+  // the writes since it was built reach the threshold; g.mtx held shared
+  std::shared_ptr<const Snapshot> snapshotOf(const GraphData &g,
+                                             bool exact) const;
+  static std::shared_ptr<const Components>
+  componentsOf(const GraphData &g, const Snapshot &snap);
+  static std::shared_ptr<const EdgeTypes> edgeTypesOf(const GraphData &g,
+                                                      const Snapshot &snap);
+  // filteredBfs() or filteredDfs()
+  Result<std::vector<NodeId>> traverseFiltered(const std::string &graph,
+                                               NodeId start,
+                                               const TraversalFilter &filter,
+                                               size_t maxNodes,
+                                               bool depthFirst) const;
+  // Record a write for the snapshot: an edge from `from` to `to` added or
+  // removed, or node `id` added or erased; g.mtx held exclusively
+  static void noteEdgeWrite(GraphData &g, NodeId from, NodeId to);
+  static void noteNodeWrite(GraphData &g, NodeId id);
+  // Append `e` to the adjacency lists of its endpoints, or remove it in O(1)
+  static void linkEdge(GraphData &g, const Edge &e);
+  static void unlinkEdge(GraphData &g, const Edge &e);
+  // Store a node or an edge whose endpoints exist, within the budget
+  // checked by the caller; g.mtx held exclusively
+  static void storeNode(GraphData &g, const Node &node);
+  static void storeEdge(GraphData &g, const Edge &edge);
+  // putEdges() into a graph without edges: the snapshot is built from
+  // `edges` (unique ids, endpoints existing) and the adjacency index from
+  // the snapshot; g.mtx held exclusively
+  static void loadEdges(GraphData &g, const std::vector<Edge> &edges);
+  // Keep labels and property indexes in step with a node or edge going
+  // from `before` to `after` (nullptr when absent)
+  static void reindexNode(GraphData &g, const Node *before, const Node *after);
+  static void reindexEdge(GraphData &g, const Edge *before, const Edge *after);
+
+  size_t snapshotRebuildWrites_;
 
-  std::unordered_map<std::string, GraphData> graphs_;
-  mutable std::mutex mtx_;
+  std::unordered_map<std::string, std::shared_ptr<GraphData>> graphs_;
+  // Guards the graphs_ catalog only; graph contents are guarded by each
+  // GraphData::mtx
+  mutable metrics::ProfiledMutex<std::shared_mutex> mtx_{
+      metrics::LockSite::GraphCatalog};
 };
 
 } // namespace kadedb
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "kadedb/roaring.h"
+#include "kadedb/schema.h"
+#include "kadedb/value.h"
+
+namespace kadedb {
+
+/**
+ * Physical layout of a single-column secondary index.
+ *  - Hash:    O(1) equality lookups
+ *  - Ordered: O(log n) equality lookups and range scans
+ *  - Bitmap:  one compressed bitmap of rows per distinct value, for
+ *             low-cardinality columns; equality and range lookups, and
+ *             AND/OR/NOT predicate trees over bitmap-indexed columns
+ *             resolve as bitmap intersections, unions and complements
+ *             before any row is read
+ */
+enum class IndexType { Hash, Ordered, Bitmap };
+
+/**
+ * Single-column secondary index mapping cell values to row positions.
+ *
+ * Keys are normalized per column type (Integer cells in a Float column are
+ * keyed as doubles) so that equal values under Value::compare() share a key.
+ * Absent cells are not indexed, matching the rule that comparisons against a
+ * missing value never match.
+ *
+ * Lookups return candidate row positions in ascending order. Candidates are
+ * a superset of the exact matches (range bounds are treated inclusively), so
+ * callers must re-check the predicate on each candidate. A lookup returns
+ * std::nullopt when the index cannot answer it (e.g. an rhs type that does
+ * not match the column, or NaN cells), in which case callers fall back to a
+ * full scan.
+ *
+ * A Bitmap index keeps a RoaringBitmap of positions per key, so positions
+ * must fit in 32 bits; a larger position degrades the index.
+ */
+class ColumnIndex {
+public:
+  ColumnIndex(IndexType type, ColumnType columnType);
+
+  IndexType type() const { return type_; }
+  ColumnType columnType() const { return columnType_; }
+
+  // Add a cell stored at row position `pos`
+  void insert(const InlineValue &cell, size_t pos);
+  void clear();
+  // Rebuild from scratch; positions are indices into `rows`
+  void rebuild(const std::vector<InlineRow> &rows, size_t column);
+
+  // Candidate positions for cell == rhs
+  std::optional<std::vector<size_t>> lookupEq(const Value &rhs) const;
+  // Candidate positions for lower <= cell <= upper; nullptr means unbounded.
+  // Only supported by Ordered indexes.
+  std::optional<std::vector<size_t>> lookupRange(const Value *lower,
+                                                 const Value *upper) const;
+
+  // Ordered indexes only: visit the positions of the cells between the
+  // bounds (inclusive, nullptr unbounded) in key order, descending when
+  // `descending`, and the positions of one key ascending; `visit` returns
+  // false to stop. False, visiting nothing, when the index cannot answer
+  // or keys could not be ordered exactly (an Integer cell of a Float
+  // column past 2^53).
+  bool forEachOrdered(const Value *lower, const Value *upper,
+                      bool descending,
+                      const std::function<bool(size_t)> &visit) const;
+
+  // Bitmap indexes only: positions of the cells equal to `rhs`, as for
+  // bitmapRange()
+  std::optional<RoaringBitmap> bitmapEq(const Value &rhs, bool &exact) const;
+  // Bitmap indexes only: positions of the cells between the bounds, where
+  // nullptr is unbounded and an open bound excludes itself; nullopt as for
+  // the lookups. `exact` tells whether the bitmap holds exactly the
+  // matching positions among those indexed, rather than a superset.
+  std::optional<RoaringBitmap> bitmapRange(const Value *lower, bool lowerOpen,
+                                           const Value *upper, bool upperOpen,
+                                           bool &exact) const;
+  // Bitmap indexes only: positions of the indexed (present) cells
+  const RoaringBitmap &presentBitmap() const { return present_; }
+
+private:
+  struct KeyHash {
+    size_t operator()(const InlineValue &v) const;
+  };
+  struct KeyEq {
+    bool operator()(const InlineValue &a, const InlineValue &b) const {
+      return a.compare(b) == 0;
+    }
+  };
+  struct KeyLess {
+    bool operator()(const InlineValue &a, const InlineValue &b) const {
+      return a.compare(b) < 0;
+    }
+  };
+
+  // Map a cell or lookup value into this index's key space
+  std::optional<InlineValue> normalizeCell(const InlineValue &cell) const;
+  std::optional<InlineValue> normalizeLookup(const Value &v) const;
+
+  IndexType type_;
+  ColumnType columnType_;
+  // Set when a cell could not be keyed (e.g. NaN); lookups then decline
+  bool degraded_ = false;
+  // Set when distinct cells may share a key: an Integer cell of a Float
+  // column past 2^53
+  bool lossy_ = false;
+  std::unordered_map<InlineValue, std::vector<size_t>, KeyHash, KeyEq> hash_;
+  std::map<InlineValue, std::vector<size_t>, KeyLess> ordered_;
+  std::map<InlineValue, RoaringBitmap, KeyLess> bitmaps_;
+  RoaringBitmap present_;
+};
+
+/**
+ * Secondary index over one field of a document collection, mapping field
+ * values to document keys.
+ *
+ * Documents are schemaless: a field may hold values of any type, and
+ * document predicates order values of different types by type. Numbers are
+ * keyed as doubles, so Integer and Float values that compare equal share a
+ * key. Missing fields and fields without a value are not indexed, as they
+ * match nothing.
+ *
+ * Lookups return candidate keys in no particular order. Candidates are a
+ * superset of the exact matches (range bounds are inclusive, and integers
+ * past 2^53 may share a key), so callers must re-check the predicate on
+ * each. A lookup returns std::nullopt when the index cannot answer it: a
+ * Null or NaN operand, NaN values among the numbers, a range over a field
+ * that also holds values of other types, or a range on a Hash index.
+ *
+ * A Bitmap index keys documents by their DocOrdinals number instead and
+ * answers through bitmapRange() alone; its key lookups decline.
+ */
+class FieldIndex {
+public:
+  // Points at the document key held by the owning container, which must
+  // stay put while indexed
+  using Key = const std::string *;
+
+  explicit FieldIndex(IndexType type) : type_(type) {}
+
+  IndexType type() const { return type_; }
+
+  // Add or remove the entry for `key`, whose field is `value` (empty when
+  // absent); Bitmap indexes record the document's `ordinal` instead
+  void insert(const InlineValue &value, Key key, uint32_t ordinal);
+  void erase(const InlineValue &value, Key key, uint32_t ordinal);
+
+  // Candidate keys for field == rhs
+  std::optional<std::vector<Key>> lookupEq(const Value &rhs) const;
+  // Candidate keys for lower <= field <= upper; nullptr means unbounded
+  std::optional<std::vector<Key>> lookupRange(const Value *lower,
+                                              const Value *upper) const;
+
+  // Bitmap indexes only: ordinals of the documents whose field equals
+  // `rhs`, as for bitmapRange()
+  std::optional<RoaringBitmap> bitmapEq(const Value &rhs, bool &exact) const;
+  // Bitmap indexes only: ordinals of the documents whose field lies between
+  // the bounds, where nullptr is unbounded and an open bound excludes
+  // itself; nullopt when the index cannot answer, as for the lookups.
+  // `exact` tells whether the bitmap holds exactly the matches.
+  std::optional<RoaringBitmap> bitmapRange(const Value *lower, bool lowerOpen,
+                                           const Value *upper, bool upperOpen,
+                                           bool &exact) const;
+  // Bitmap indexes only: ordinals of the documents holding the field with
+  // a value, the ones a comparison can match
+  const RoaringBitmap &valuedBitmap() const { return valued_; }
+
+private:
+  struct KeyHash {
+    size_t operator()(const InlineValue &v) const;
+  };
+  struct KeyEq {
+    bool operator()(const InlineValue &a, const InlineValue &b) const {
+      return a.compare(b) == 0;
+    }
+  };
+  struct KeyLess {
+    bool operator()(const InlineValue &a, const InlineValue &b) const {
+      return a.compare(b) < 0;
+    }
+  };
+  // Null, numbers, strings and booleans each order apart from the rest
+  enum Class { kNull, kNumber, kString, kBoolean, kClasses };
+
+  static Class classOf(ValueType t);
+  // Index key of a non-null, non-NaN value
+  static InlineValue key(const InlineValue &v);
+  static bool isNaN(const InlineValue &v);
+  // Whether every indexed value is comparable with an operand of class `c`
+  bool onlyClass(Class c) const;
+  // Index keys of the bounds of a range over the indexed values; false
+  // when the index cannot answer it
+  bool rangeKeys(const Value *lower, const Value *upper,
+                 std::optional<InlineValue> &lo,
+                 std::optional<InlineValue> &hi) const;
+
+  IndexType type_;
+  size_t counts_[kClasses] = {};
+  size_t nanCount_ = 0;
+  // Integers past 2^53, which may share a key with other numbers
+  size_t wideCount_ = 0;
+  std::unordered_map<InlineValue, std::vector<Key>, KeyHash, KeyEq> hash_;
+  std::map<InlineValue, std::vector<Key>, KeyLess> ordered_;
+  std::map<InlineValue, RoaringBitmap, KeyLess> bitmaps_;
+  RoaringBitmap valued_;
+};
+
+/**
+ * Dense numbering of the documents of a collection, shared by its Bitmap
+ * field indexes so that their bitmaps combine. Numbers of erased documents
+ * are reused, keeping the bitmaps dense.
+ */
+class DocOrdinals {
+public:
+  using Key = FieldIndex::Key;
+
+  // Number of `key`, assigning the next free one on first use
+  uint32_t assign(Key key);
+  // Release the number of an erased document
+  void release(Key key);
+  uint32_t of(Key key) const { return ordinals_.at(key); }
+  Key key(uint32_t ordinal) const { return keys_[ordinal]; }
+  // Numbers currently assigned
+  const RoaringBitmap &all() const { return all_; }
+  void clear();
+
+private:
+  std::unordered_map<Key, uint32_t> ordinals_;
+  std::vector<Key> keys_;
+  std::vector<uint32_t> free_;
+  RoaringBitmap all_;
+};
+
+} // namespace kadedb
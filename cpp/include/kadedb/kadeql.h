@@ -34,6 +34,8 @@
  *
  * Supported SQL subset:
  * - SELECT statements with column lists and WHERE clauses
+ * - Inner and LEFT equi-joins: FROM a JOIN b ON a.x = b.y
+ * - GROUP BY expressions with aggregates and a HAVING condition
  * - INSERT statements with VALUES
  * - Basic comparison operators (=, !=, <, >, <=, >=)
  * - Logical operators (AND, OR)
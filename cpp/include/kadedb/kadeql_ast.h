@@ -1,8 +1,13 @@
 #pragma once
 
+#include <cstddef>
+#include <deque>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -15,18 +20,73 @@ class SelectStatement;
 class InsertStatement;
 class UpdateStatement;
 class DeleteStatement;
+class ExplainStatement;
 class Expression;
 class UnaryExpression;
 class BinaryExpression;
 class BetweenExpression;
 class IdentifierExpression;
 class LiteralExpression;
+class ParameterExpression;
 class FunctionCallExpression;
 
 /**
  * Statement type discriminator
  */
-enum class StatementType { SELECT, INSERT, UPDATE, DELETE };
+enum class StatementType { SELECT, INSERT, UPDATE, DELETE, EXPLAIN };
+
+/**
+ * Memory for the expression nodes of one statement, released all at once.
+ *
+ * While an AstArena::Scope is active on a thread, the expression nodes
+ * created on it are carved out of that scope's arena, and identifiers are
+ * interned there, so parsing does not go to the allocator once per node.
+ * Deleting such a node only runs its destructor. A Statement created in
+ * the scope keeps the arena alive, so the tree is freed with it.
+ */
+class AstArena {
+public:
+  AstArena() = default;
+  AstArena(const AstArena &) = delete;
+  AstArena &operator=(const AstArena &) = delete;
+
+  // `size` bytes aligned like operator new; valid until the arena dies
+  void *allocate(size_t size);
+  // One stable copy of `text` per arena
+  const std::string &intern(std::string_view text);
+
+  size_t bytesAllocated() const { return bytes_; }
+  size_t internedCount() const { return interned_.size(); }
+
+  /**
+   * Makes `arena` the one this thread's nodes come from until destroyed;
+   * scopes nest
+   */
+  class Scope {
+  public:
+    explicit Scope(std::shared_ptr<AstArena> arena);
+    ~Scope();
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    std::shared_ptr<AstArena> arena_;
+    Scope *previous_;
+    friend class AstArena;
+  };
+
+  // The arena of the innermost active scope on this thread, if any
+  static const std::shared_ptr<AstArena> *active();
+
+private:
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  char *next_ = nullptr;
+  char *end_ = nullptr;
+  size_t chunk_size_ = 0;
+  size_t bytes_ = 0;
+  std::deque<std::string> strings_;
+  std::unordered_map<std::string_view, const std::string *> interned_;
+};
 
 /**
  * Base class for all AST nodes
@@ -35,6 +95,10 @@ class ASTNode {
 public:
   virtual ~ASTNode() = default;
   virtual std::string toString() const = 0;
+
+  // From the active AstArena when there is one, else from the heap
+  static void *operator new(size_t size);
+  static void operator delete(void *p);
 };
 
 /**
@@ -83,23 +147,54 @@ public:
 
   std::string toString() const override;
 
+protected:
+  void setValue(Value value) { value_ = std::move(value); }
+
 private:
   Value value_;
 };
 
+/**
+ * Statement parameter placeholder: `?` (numbered left to right) or `$n`.
+ *
+ * A parameter is a literal whose value is bound before each execution (see
+ * PreparedStatement), so every consumer of literals accepts it unchanged.
+ * Before binding it holds the integer 0.
+ */
+class ParameterExpression : public LiteralExpression {
+public:
+  // `index` is 0-based ($1 has index 0)
+  explicit ParameterExpression(size_t index)
+      : LiteralExpression(int64_t{0}), index_(index) {}
+
+  size_t getIndex() const { return index_; }
+  void bind(Value value) { setValue(std::move(value)); }
+
+  std::string toString() const override;
+
+private:
+  size_t index_;
+};
+
 /**
  * Identifier expression (column names, table names)
+ *
+ * The name is interned in the active AstArena; outside one the node keeps
+ * its own copy.
  */
 class IdentifierExpression : public Expression {
 public:
-  explicit IdentifierExpression(const std::string &name) : name_(name) {}
+  explicit IdentifierExpression(const std::string &name);
+  IdentifierExpression(const IdentifierExpression &) = delete;
+  IdentifierExpression &operator=(const IdentifierExpression &) = delete;
 
-  const std::string &getName() const { return name_; }
+  const std::string &getName() const { return *name_; }
 
-  std::string toString() const override { return name_; }
+  std::string toString() const override { return *name_; }
 
 private:
-  std::string name_;
+  std::string owned_;
+  const std::string *name_;
 };
 
 class BinaryExpression : public Expression {
@@ -164,11 +259,13 @@ private:
  */
 class FunctionCallExpression : public Expression {
 public:
+  // The name is interned like an identifier's
   FunctionCallExpression(std::string name,
-                         std::vector<std::unique_ptr<Expression>> args)
-      : name_(std::move(name)), args_(std::move(args)) {}
+                         std::vector<std::unique_ptr<Expression>> args);
+  FunctionCallExpression(const FunctionCallExpression &) = delete;
+  FunctionCallExpression &operator=(const FunctionCallExpression &) = delete;
 
-  const std::string &getName() const { return name_; }
+  const std::string &getName() const { return *name_; }
   const std::vector<std::unique_ptr<Expression>> &getArgs() const {
     return args_;
   }
@@ -176,7 +273,8 @@ public:
   std::string toString() const override;
 
 private:
-  std::string name_;
+  std::string owned_;
+  const std::string *name_;
   std::vector<std::unique_ptr<Expression>> args_;
 };
 
@@ -200,14 +298,56 @@ struct SelectItem {
   std::string toString() const;
 };
 
+/**
+ * ORDER BY key: a column name (legacy mode: any table column; expression
+ * mode: an output column or alias) and its direction
+ */
+struct OrderByItem {
+  std::string column;
+  bool descending = false;
+
+  std::string toString() const;
+};
+
+/**
+ * `[INNER | LEFT [OUTER]] JOIN table [[AS] alias] ON cond` of a SELECT.
+ * `cond` is an AND of equalities between a column of this table and a column
+ * of a table joined before it; columns are referenced as `alias.column` (or
+ * unqualified when the name is unique among the joined tables).
+ */
+struct JoinClause {
+  enum class Type { Inner, Left };
+
+  Type type = Type::Inner;
+  std::string table;
+  std::string alias; // empty: the table name qualifies its columns
+  std::unique_ptr<Expression> on;
+
+  std::string toString() const;
+};
+
 /**
  * Base class for all statements
+ *
+ * A statement created while an AstArena::Scope is active holds that arena,
+ * which therefore outlives every node of the statement. Statements
+ * themselves always live on the heap.
  */
 class Statement : public ASTNode {
 public:
+  Statement();
   virtual ~Statement() = default;
   /** Return the concrete statement type */
   virtual StatementType type() const = 0;
+
+  /** The arena of this statement's nodes, nullptr if it has none */
+  const AstArena *arena() const { return arena_.get(); }
+
+  static void *operator new(size_t size) { return ::operator new(size); }
+  static void operator delete(void *p) { ::operator delete(p); }
+
+private:
+  std::shared_ptr<AstArena> arena_;
 };
 
 /**
@@ -246,6 +386,35 @@ public:
   const std::string &getTableName() const { return table_name_; }
   const Expression *getWhereClause() const { return where_clause_.get(); }
 
+  // FROM alias (empty: none) and JOIN clauses in source order
+  const std::string &getTableAlias() const { return table_alias_; }
+  const std::vector<JoinClause> &getJoins() const { return joins_; }
+  void setTableAlias(std::string alias) { table_alias_ = std::move(alias); }
+  void setJoins(std::vector<JoinClause> joins) { joins_ = std::move(joins); }
+
+  // GROUP BY keys (empty: no GROUP BY) and the HAVING condition (nullptr:
+  // none); both imply expression mode
+  const std::vector<std::unique_ptr<Expression>> &getGroupBy() const {
+    return group_by_;
+  }
+  const Expression *getHaving() const { return having_.get(); }
+  void setGroupBy(std::vector<std::unique_ptr<Expression>> group_by) {
+    group_by_ = std::move(group_by);
+  }
+  void setHaving(std::unique_ptr<Expression> having) {
+    having_ = std::move(having);
+  }
+
+  // ORDER BY keys (empty: unordered) and LIMIT/OFFSET (no LIMIT: all rows)
+  const std::vector<OrderByItem> &getOrderBy() const { return order_by_; }
+  const std::optional<size_t> &getLimit() const { return limit_; }
+  size_t getOffset() const { return offset_; }
+  void setOrderBy(std::vector<OrderByItem> order_by) {
+    order_by_ = std::move(order_by);
+  }
+  void setLimit(std::optional<size_t> limit) { limit_ = limit; }
+  void setOffset(size_t offset) { offset_ = offset; }
+
   std::string toString() const override;
   StatementType type() const override { return StatementType::SELECT; }
 
@@ -255,6 +424,13 @@ private:
   std::unique_ptr<Expression> where_clause_;
   std::vector<SelectItem> select_items_; // expression mode
   bool expression_mode_ = false;
+  std::string table_alias_;
+  std::vector<JoinClause> joins_;
+  std::vector<std::unique_ptr<Expression>> group_by_;
+  std::unique_ptr<Expression> having_;
+  std::vector<OrderByItem> order_by_;
+  std::optional<size_t> limit_;
+  size_t offset_ = 0;
 };
 
 /**
@@ -262,10 +438,23 @@ private:
  */
 class InsertStatement : public Statement {
 public:
+  /**
+   * ON CONFLICT (column) DO NOTHING | DO UPDATE SET col = expr, ...: what
+   * to do with a row whose key is already taken. In the SET expressions a
+   * bare column is the stored row's and `excluded.col` the proposed row's.
+   */
+  struct OnConflict {
+    std::string column;
+    bool doNothing = false;
+    std::vector<std::pair<std::string, std::unique_ptr<Expression>>>
+        assignments;
+  };
+
   InsertStatement(std::string table_name, std::vector<std::string> columns,
-                  std::vector<std::vector<std::unique_ptr<Expression>>> values)
+                  std::vector<std::vector<std::unique_ptr<Expression>>> values,
+                  std::optional<OnConflict> on_conflict = std::nullopt)
       : table_name_(std::move(table_name)), columns_(std::move(columns)),
-        values_(std::move(values)) {}
+        values_(std::move(values)), on_conflict_(std::move(on_conflict)) {}
 
   const std::string &getTableName() const { return table_name_; }
   const std::vector<std::string> &getColumns() const { return columns_; }
@@ -273,6 +462,10 @@ public:
   getValues() const {
     return values_;
   }
+  // nullptr for a plain INSERT
+  const OnConflict *getOnConflict() const {
+    return on_conflict_ ? &*on_conflict_ : nullptr;
+  }
 
   std::string toString() const override;
   StatementType type() const override { return StatementType::INSERT; }
@@ -281,6 +474,7 @@ private:
   std::string table_name_;
   std::vector<std::string> columns_;
   std::vector<std::vector<std::unique_ptr<Expression>>> values_;
+  std::optional<OnConflict> on_conflict_;
 };
 
 /**
@@ -330,6 +524,27 @@ private:
   std::unique_ptr<Expression> where_clause_;
 };
 
+/**
+ * EXPLAIN [ANALYZE] statement AST node. EXPLAIN reports the plan chosen for
+ * the wrapped statement without running it; EXPLAIN ANALYZE runs it and
+ * also reports what every stage of the plan did.
+ */
+class ExplainStatement : public Statement {
+public:
+  ExplainStatement(std::unique_ptr<Statement> statement, bool analyze)
+      : statement_(std::move(statement)), analyze_(analyze) {}
+
+  const Statement &getStatement() const { return *statement_; }
+  bool isAnalyze() const { return analyze_; }
+
+  std::string toString() const override;
+  StatementType type() const override { return StatementType::EXPLAIN; }
+
+private:
+  std::unique_ptr<Statement> statement_;
+  bool analyze_;
+};
+
 /**
  * Exception class for parse errors
  */
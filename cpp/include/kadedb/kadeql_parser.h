@@ -16,7 +16,11 @@ namespace kadeql {
  *
  * Grammar (simplified):
  * statement := select_statement | insert_statement
- * select_statement := SELECT column_list FROM table_name [WHERE expression]
+ * select_statement := SELECT column_list FROM from_clause [WHERE expression]
+ *                     [GROUP BY expression_list] [HAVING expression]
+ * from_clause := table_name [[AS] alias]
+ *                ([INNER | LEFT [OUTER]] JOIN table_name [[AS] alias]
+ *                 ON expression)*
  * insert_statement := INSERT INTO table_name [(column_list)] VALUES value_list
  * column_list := identifier | '*' | identifier (',' identifier)*
  * value_list := '(' expression_list ')' (',' '(' expression_list ')')*
@@ -25,10 +29,14 @@ namespace kadeql {
  * logical_or := logical_and (OR logical_and)*
  * logical_and := comparison (AND comparison)*
  * comparison := primary (('=' | '!=' | '<' | '>' | '<=' | '>=') primary)*
- * primary := identifier | string_literal | number_literal | '(' expression ')'
+ * primary := identifier | string_literal | number_literal | parameter
+ *            | '(' expression ')'
  */
 class KadeQLParser {
 public:
+  // Highest accepted `$n`
+  static constexpr unsigned long long kMaxParameters = 65535;
+
   /**
    * Constructor
    */
@@ -42,13 +50,32 @@ public:
    */
   std::unique_ptr<Statement> parse(const std::string &query);
 
+  /**
+   * Parameter placeholders of the last parsed statement, in source order.
+   * The nodes are owned by that statement. `?` placeholders are numbered
+   * left to right; `$n` placeholders may repeat; the two styles cannot be
+   * mixed in one statement.
+   */
+  const std::vector<ParameterExpression *> &parameters() const {
+    return parameters_;
+  }
+
 private:
   std::unique_ptr<Tokenizer> tokenizer_;
   Token current_token_;
+  std::vector<ParameterExpression *> parameters_;
+  size_t positional_ = 0; // `?` seen so far
+  bool numbered_ = false; // any `$n` seen
 
   // Core parsing methods
   std::unique_ptr<Statement> parseStatement();
   std::unique_ptr<SelectStatement> parseSelectStatement();
+  void parseFromClause(std::string &table, std::string &alias,
+                       std::vector<JoinClause> &joins);
+  std::string parseTableAlias();
+  void parseGroupByHaving(std::vector<std::unique_ptr<Expression>> &group_by,
+                          std::unique_ptr<Expression> &having);
+  void parseOrderByLimit(SelectStatement &select);
   std::unique_ptr<InsertStatement> parseInsertStatement();
   std::unique_ptr<UpdateStatement> parseUpdateStatement();
   std::unique_ptr<DeleteStatement> parseDeleteStatement();
@@ -71,12 +98,18 @@ private:
   std::vector<std::string> parseIdentifierList();
   std::vector<std::vector<std::unique_ptr<Expression>>> parseValuesList();
   std::vector<std::unique_ptr<Expression>> parseExpressionList();
+  // col = expr (, col = expr)* of UPDATE ... SET and DO UPDATE SET
+  std::vector<std::pair<std::string, std::unique_ptr<Expression>>>
+  parseAssignments();
 
   // Token management
   void advance();
   bool match(TokenType type);
   bool check(TokenType type) const;
   Token consume(TokenType type, const std::string &message);
+  // Non-reserved words (CONFLICT, DO, NOTHING) arrive as identifiers and
+  // stay usable as names; consumes `word` if it is next, in any case
+  bool matchWord(std::string_view word);
 
   // Error handling
   void error(const std::string &message);
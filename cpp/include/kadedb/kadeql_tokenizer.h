@@ -1,6 +1,8 @@
 #pragma once
 
+#include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -24,11 +26,27 @@ enum class TokenType {
   NOT,
   BETWEEN,
   AS,
+  ORDER,
+  BY,
+  ASC,
+  DESC,
+  LIMIT,
+  OFFSET,
+  JOIN,
+  INNER,
+  LEFT,
+  OUTER,
+  ON,
+  GROUP,
+  HAVING,
+  EXPLAIN,
+  ANALYZE,
 
   // Identifiers and literals
-  IDENTIFIER,
+  IDENTIFIER, // name or qualified table.column
   STRING_LITERAL,
   NUMBER_LITERAL,
+  PARAMETER, // ? (positional) or $n (numbered, 1-based)
 
   // Operators
   EQUALS,        // =
@@ -58,17 +76,23 @@ enum class TokenType {
 
 /**
  * Token structure containing type, value, and position information
+ *
+ * `value` views the tokenizer's input, so a token is valid only while the
+ * string it was read from is. String literals with escapes are the one
+ * exception: their unescaped text is owned by the token itself.
  */
 struct Token {
   TokenType type;
-  std::string value;
+  std::string_view value;
   size_t line;
   size_t column;
   size_t position; // Absolute position in input
+  // Unescaped text that `value` views, for literals with escapes
+  std::shared_ptr<const std::string> decoded;
 
   Token() : type(TokenType::UNKNOWN), line(1), column(1), position(0) {}
 
-  Token(TokenType t, const std::string &v, size_t l, size_t c, size_t p)
+  Token(TokenType t, std::string_view v, size_t l, size_t c, size_t p)
       : type(t), value(v), line(l), column(c), position(p) {}
 
   bool operator==(const Token &other) const {
@@ -81,14 +105,22 @@ struct Token {
 /**
  * Tokenizer class for KadeQL lexical analysis
  * Converts input query strings into a sequence of tokens
+ *
+ * The input is not copied: tokens view it, and keywords are recognized
+ * case-insensitively in place, so reading a token allocates nothing.
  */
 class Tokenizer {
 public:
   /**
    * Constructor
-   * @param input The KadeQL query string to tokenize
+   * @param input The KadeQL query string to tokenize; it must outlive the
+   *              tokenizer and the tokens read from it
    */
-  explicit Tokenizer(const std::string &input);
+  explicit Tokenizer(std::string_view input);
+  explicit Tokenizer(const char *input)
+      : Tokenizer(std::string_view(input)) {}
+  // Tokens would outlive a temporary input
+  explicit Tokenizer(std::string &&input) = delete;
 
   /**
    * Get the next token from the input
@@ -125,17 +157,19 @@ public:
    */
   static std::string tokenTypeToString(TokenType type);
 
+  /**
+   * The keyword `word` spells in any letter case, or IDENTIFIER
+   */
+  static TokenType keywordType(std::string_view word);
+
 private:
-  std::string input_;
+  std::string_view input_;
   size_t current_pos_;
   size_t current_line_;
   size_t current_column_;
   Token peeked_token_;
   bool has_peeked_;
 
-  // Keyword mapping
-  static const std::unordered_map<std::string, TokenType> keywords_;
-
   // Helper methods
   char currentChar() const;
   char peekChar(size_t offset = 1) const;
@@ -149,8 +183,9 @@ private:
   bool isDigit(char c) const;
   bool isAlphaNumeric(char c) const;
   bool isWhitespace(char c) const;
-  Token makeToken(TokenType type, const std::string &value) const;
-  Token makeToken(TokenType type, char value) const;
+  // A token of the input consumed since `start`
+  Token makeToken(TokenType type, size_t start, size_t line,
+                  size_t column) const;
 };
 
 } // namespace kadeql
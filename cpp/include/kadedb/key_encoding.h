@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "kadedb/value.h"
+
+namespace kadedb {
+
+/**
+ * Order-preserving (normalized) key encoding: the bytewise order of encoded
+ * keys is the order of Value::compare() on the values, so keys compare with
+ * memcmp and need no decoding. Encodings are self-delimiting and none is a
+ * prefix of another, so they concatenate into composite keys that sort
+ * field by field, and inverting a field's bytes reverses its order.
+ *  - absent cell (nullptr): 0x00, before everything else
+ *  - NullValue: 0x01
+ *  - Integer, Float: 0x02, the value as a double in 8 big-endian bytes,
+ *    then 2 bytes of exact remainder: the integer minus its double (only
+ *    nonzero beyond 2^53), so distinct integers never share a key and 2
+ *    and 2.0 do
+ *  - String: 0x03, the bytes with 0x00 escaped as 0x00 0xFF, then 0x00 0x01
+ *  - Boolean: 0x04 then 0x00 or 0x01
+ * -0.0 encodes as 0.0 and every NaN as one NaN, after +infinity.
+ * Value::compare() holds NaN equal to every number and an integer beyond
+ * 2^53 equal to the double nearest it; the encoding orders these totally
+ * instead.
+ */
+namespace keycode {
+
+// Bytes of a number's encoding up to its exact remainder
+constexpr size_t kNumberPrefixBytes = 1 + 8;
+
+void appendValue(std::string &out, const Value *v);
+/**
+ * Sort-key field for ORDER BY and GROUP BY: absent cells and NullValue are
+ * one key, before every value; other values encode as appendValue(). With
+ * `descending` the field's bytes are inverted, putting nulls last.
+ */
+void appendSortKey(std::string &out, const Value *v, bool descending = false);
+/**
+ * The encoding of `v` with numbers cut to kNumberPrefixBytes: the key range
+ * [bound, prefixEnd(bound)) covers the key of every value equal to `v`
+ * under Value::compare() (NaN aside), and possibly a few more.
+ */
+void appendBound(std::string &out, const Value *v);
+// The String encoding of `s`
+void appendString(std::string &out, std::string_view s);
+void appendU32(std::string &out, uint32_t v);
+void appendU64(std::string &out, uint64_t v);
+// Sign-flipped, so that negative integers sort first
+void appendI64(std::string &out, int64_t v);
+// Big-endian integers at the start of `in` (caller ensures the size)
+uint32_t readU32(std::string_view in);
+uint64_t readU64(std::string_view in);
+int64_t readI64(std::string_view in);
+// Smallest key greater than every key starting with `prefix` (empty when
+// there is none, i.e. `prefix` is all 0xFF)
+std::string prefixEnd(std::string_view prefix);
+
+} // namespace keycode
+
+} // namespace kadedb
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "kadedb/key_encoding.h"
+#include "kadedb/status.h" // Status, Result<T>
+#include "kadedb/value.h"
+
+namespace kadedb {
+
+/**
+ * @defgroup KeyValueAPI Key-value stores
+ * @brief Ordered byte-string stores under the persistent storages.
+ *
+ * A KeyValueStore keeps keys in bytewise order within named column
+ * families, applies batches of writes atomically and iterates a family in
+ * key order from any position. RocksDbRelationalStorage and
+ * RocksDbDocumentStorage are written against it; RocksDB provides the
+ * durable implementation and InMemoryKeyValueStore a volatile one.
+ */
+
+/**
+ * Writes applied together by KeyValueStore::write(): either every one or
+ * none. Later writes to a key win over earlier ones in the same batch.
+ */
+/** @ingroup KeyValueAPI */
+struct WriteBatch {
+  struct Op {
+    std::string family;
+    std::string key;
+    std::optional<std::string> value; // std::nullopt: erase the key
+  };
+
+  void put(std::string family, std::string key, std::string value) {
+    ops.push_back(Op{std::move(family), std::move(key), std::move(value)});
+  }
+  void erase(std::string family, std::string key) {
+    ops.push_back(Op{std::move(family), std::move(key), std::nullopt});
+  }
+  bool empty() const { return ops.empty(); }
+
+  std::vector<Op> ops;
+};
+
+/**
+ * Cursor over one column family in key order. Starts unpositioned: call
+ * seek() first. key() and value() are valid until the next call.
+ */
+/** @ingroup KeyValueAPI */
+class KeyValueIterator {
+public:
+  virtual ~KeyValueIterator() = default;
+
+  // Position at the first key >= `target`
+  virtual void seek(std::string_view target) = 0;
+  virtual bool valid() const = 0;
+  // Caller must ensure valid()
+  virtual void next() = 0;
+  virtual std::string_view key() const = 0;
+  virtual std::string_view value() const = 0;
+  // An I/O or corruption error that ended the iteration early
+  virtual Status status() const = 0;
+};
+
+/** @ingroup KeyValueAPI */
+class KeyValueStore {
+public:
+  virtual ~KeyValueStore() = default;
+
+  // Create column family `family`; Status::OK when it already exists
+  virtual Status createFamily(const std::string &family) = 0;
+  // Drop `family` and its keys; Status::OK when it does not exist
+  virtual Status dropFamily(const std::string &family) = 0;
+  virtual std::vector<std::string> listFamilies() const = 0;
+
+  /**
+   * Value stored under `key` in `family`.
+   * @return Status::NotFound when the family or key is missing
+   */
+  virtual Result<std::string> get(const std::string &family,
+                                  std::string_view key) const = 0;
+
+  /**
+   * Apply `batch` atomically.
+   * @return Status::NotFound, writing nothing, when it names a missing
+   *         family
+   */
+  virtual Status write(const WriteBatch &batch) = 0;
+
+  /**
+   * Iterator over `family`. It sees writes made while it is open, but no
+   * write may drop the family under it.
+   * @return Status::NotFound when the family is missing
+   */
+  virtual Result<std::unique_ptr<KeyValueIterator>>
+  newIterator(const std::string &family) const = 0;
+};
+
+/**
+ * Volatile KeyValueStore: one std::map per column family. Iterators hold
+ * no lock between calls; each step re-seeks past the last key returned.
+ */
+/** @ingroup KeyValueAPI */
+class InMemoryKeyValueStore final : public KeyValueStore {
+public:
+  Status createFamily(const std::string &family) override;
+  Status dropFamily(const std::string &family) override;
+  std::vector<std::string> listFamilies() const override;
+  Result<std::string> get(const std::string &family,
+                          std::string_view key) const override;
+  Status write(const WriteBatch &batch) override;
+  Result<std::unique_ptr<KeyValueIterator>>
+  newIterator(const std::string &family) const override;
+
+private:
+  class Iterator;
+  using Family = std::map<std::string, std::string, std::less<>>;
+
+  std::unordered_map<std::string, std::shared_ptr<Family>> families_;
+  mutable std::shared_mutex mtx_;
+};
+
+/**
+ * Open (creating if missing) the RocksDB database at `path` with all of its
+ * column families.
+ * @return Status::FailedPrecondition when kadedb_core was built without
+ *         RocksDB (KADEDB_WITH_ROCKSDB); Status::Internal when RocksDB fails
+ *         to open the database
+ */
+Result<std::shared_ptr<KeyValueStore>>
+openRocksDbStore(const std::string &path);
+
+} // namespace kadedb
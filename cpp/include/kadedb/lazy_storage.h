@@ -0,0 +1,650 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "kadedb/graph/storage.h"      // GraphStorage
+#include "kadedb/status.h"             // Status, Result<T>
+#include "kadedb/storage.h"            // Relational/DocumentStorage
+#include "kadedb/timeseries/storage.h" // TimeSeriesStorage
+#include "kadedb/wal.h"                // LazyReplay
+
+namespace kadedb {
+
+namespace lazy_detail {
+
+// What a call returns when its target failed to replay: the error where
+// the result can carry one, else an empty value
+template <class T> struct Failed {
+  static T of(const Status &) { return T{}; }
+};
+template <> struct Failed<Status> {
+  static Status of(const Status &st) { return st; }
+};
+template <class T> struct Failed<Result<T>> {
+  static Result<T> of(const Status &st) { return Result<T>::err(st); }
+};
+
+// `call` once `replay` has loaded `target`
+template <class F>
+auto gated(LazyReplay &replay, WalEngine engine, const std::string &target,
+           F &&call) -> decltype(call()) {
+  Status st = replay.load(engine, target);
+  if (!st.ok())
+    return Failed<decltype(call())>::of(st);
+  return call();
+}
+
+} // namespace lazy_detail
+
+/**
+ * The Lazy* storages wrap the storages a LazyReplay replays into: every
+ * call on a table, collection, series or graph first loads its log
+ * records, so requests on targets that are replayed already run at once
+ * and others wait for their own target only. Listings include the targets
+ * the log creates before they load; queries across series by tag load
+ * every series. A target whose records failed to replay reports that
+ * error on every call.
+ *
+ * To restart: open the LazyReplay, wrap the storages in Lazy* storages,
+ * reopen the log and put the Logged* storages over the Lazy* ones.
+ */
+/** @ingroup WalAPI */
+class LazyRelationalStorage final : public RelationalStorage {
+public:
+  LazyRelationalStorage(RelationalStorage &base, LazyReplay &replay)
+      : base_(base), replay_(replay) {}
+
+  Status createTable(const std::string &table,
+                     const TableSchema &schema) override {
+    return gate(table, [&] { return base_.createTable(table, schema); });
+  }
+  Status insertRow(const std::string &table, const Row &row) override {
+    return gate(table, [&] { return base_.insertRow(table, row); });
+  }
+  Status insertRows(const std::string &table,
+                    const std::vector<Row> &rows) override {
+    return gate(table, [&] { return base_.insertRows(table, rows); });
+  }
+  Result<UpsertCounts>
+  upsertRows(const std::string &table, const std::vector<Row> &rows,
+             const UpsertMerger &merge = nullptr) override {
+    return gate(table, [&] { return base_.upsertRows(table, rows, merge); });
+  }
+  Result<ResultSet>
+  select(const std::string &table, const std::vector<std::string> &columns,
+         const std::optional<Predicate> &where = std::nullopt) override {
+    return gate(table, [&] { return base_.select(table, columns, where); });
+  }
+  Status scan(const std::string &table, const std::vector<std::string> &columns,
+              const std::optional<Predicate> &where, const BatchSink &sink,
+              size_t batchRows = kDefaultBatchRows) override {
+    return gate(table, [&] {
+      return base_.scan(table, columns, where, sink, batchRows);
+    });
+  }
+  Status scanOrdered(const std::string &table,
+                     const std::vector<std::string> &columns,
+                     const std::optional<Predicate> &where,
+                     const ScanOrder &order, const BatchSink &sink,
+                     size_t batchRows = kDefaultBatchRows) override {
+    return gate(table, [&] {
+      return base_.scanOrdered(table, columns, where, order, sink, batchRows);
+    });
+  }
+  std::vector<std::string> listTables() const override {
+    return replay_.listed(WalEngine::Relational,
+                          [&] { return base_.listTables(); });
+  }
+  Result<TableSchema> getTableSchema(const std::string &table) override {
+    return gate(table, [&] { return base_.getTableSchema(table); });
+  }
+  std::optional<size_t>
+  estimateRowCount(const std::string &table) const override {
+    return gate(table, [&] { return base_.estimateRowCount(table); });
+  }
+  std::optional<size_t>
+  estimateScanCost(const std::string &table,
+                   const std::optional<Predicate> &where) const override {
+    return gate(table, [&] { return base_.estimateScanCost(table, where); });
+  }
+  std::shared_ptr<const TableStatistics>
+  getTableStatistics(const std::string &table) const override {
+    return gate(table, [&] { return base_.getTableStatistics(table); });
+  }
+  std::string explainAccess(const std::string &table,
+                            const std::optional<Predicate> &where)
+      const override {
+    return gate(table, [&] { return base_.explainAccess(table, where); });
+  }
+  std::string explainOrderedAccess(const std::string &table,
+                                   const std::optional<Predicate> &where,
+                                   const ScanOrder &order) const override {
+    return gate(table, [&] {
+      return base_.explainOrderedAccess(table, where, order);
+    });
+  }
+  std::optional<uint64_t>
+  tableVersion(const std::string &table) const override {
+    return gate(table, [&] { return base_.tableVersion(table); });
+  }
+  Result<std::unique_ptr<ChangeSubscription>>
+  subscribeChanges(const std::string &table,
+                   const std::optional<Predicate> &where = std::nullopt)
+      override {
+    return gate(table, [&] { return base_.subscribeChanges(table, where); });
+  }
+  Status dropTable(const std::string &table) override {
+    return gate(table, [&] { return base_.dropTable(table); });
+  }
+  Result<size_t>
+  deleteRows(const std::string &table,
+             const std::optional<Predicate> &where = std::nullopt) override {
+    return gate(table, [&] { return base_.deleteRows(table, where); });
+  }
+  Result<size_t> updateRows(
+      const std::string &table,
+      const std::unordered_map<std::string, AssignmentValue> &assignments,
+      const std::optional<Predicate> &where = std::nullopt) override {
+    return gate(table,
+                [&] { return base_.updateRows(table, assignments, where); });
+  }
+  Result<size_t>
+  updateRowsWith(const std::string &table, const RowUpdater &updater,
+                 const std::optional<Predicate> &where = std::nullopt)
+      override {
+    return gate(table,
+                [&] { return base_.updateRowsWith(table, updater, where); });
+  }
+  Status
+  updateRows(const std::string &table,
+             const std::unordered_map<std::string, std::unique_ptr<Value>>
+                 &assignments,
+             const std::optional<Predicate> &where = std::nullopt) override {
+    return gate(table,
+                [&] { return base_.updateRows(table, assignments, where); });
+  }
+  Status truncateTable(const std::string &table) override {
+    return gate(table, [&] { return base_.truncateTable(table); });
+  }
+  Status createIndex(const std::string &table, const std::string &column,
+                     IndexType type) override {
+    return gate(table,
+                [&] { return base_.createIndex(table, column, type); });
+  }
+
+private:
+  template <class F>
+  auto gate(const std::string &table, F &&call) const -> decltype(call()) {
+    return lazy_detail::gated(replay_, WalEngine::Relational, table, call);
+  }
+
+  RelationalStorage &base_;
+  LazyReplay &replay_;
+};
+
+/** @ingroup WalAPI */
+class LazyDocumentStorage final : public DocumentStorage {
+public:
+  LazyDocumentStorage(DocumentStorage &base, LazyReplay &replay)
+      : base_(base), replay_(replay) {}
+
+  Status createCollection(
+      const std::string &collection,
+      const std::optional<DocumentSchema> &schema = std::nullopt) override {
+    return gate(collection,
+                [&] { return base_.createCollection(collection, schema); });
+  }
+  Status dropCollection(const std::string &collection) override {
+    return gate(collection, [&] { return base_.dropCollection(collection); });
+  }
+  std::vector<std::string> listCollections() const override {
+    return replay_.listed(WalEngine::Document,
+                          [&] { return base_.listCollections(); });
+  }
+  Status put(const std::string &collection, const std::string &key,
+             const Document &doc) override {
+    return gate(collection, [&] { return base_.put(collection, key, doc); });
+  }
+  Status put(const std::string &collection, const std::string &key,
+             Document &&doc) override {
+    return gate(collection,
+                [&] { return base_.put(collection, key, std::move(doc)); });
+  }
+  Result<Document> get(const std::string &collection,
+                       const std::string &key) override {
+    return gate(collection, [&] { return base_.get(collection, key); });
+  }
+  Status erase(const std::string &collection, const std::string &key) override {
+    return gate(collection, [&] { return base_.erase(collection, key); });
+  }
+  Status patch(const std::string &collection, const std::string &key,
+               const std::vector<DocUpdate> &ops) override {
+    return gate(collection, [&] { return base_.patch(collection, key, ops); });
+  }
+  Result<size_t> updateWhere(const std::string &collection,
+                             const std::optional<DocPredicate> &where,
+                             const std::vector<DocUpdate> &ops) override {
+    return gate(collection,
+                [&] { return base_.updateWhere(collection, where, ops); });
+  }
+  Result<size_t> count(const std::string &collection) const override {
+    return gate(collection, [&] { return base_.count(collection); });
+  }
+  Result<std::optional<DocumentSchema>>
+  getCollectionSchema(const std::string &collection) const override {
+    return gate(collection,
+                [&] { return base_.getCollectionSchema(collection); });
+  }
+  Result<std::unique_ptr<ChangeSubscription>>
+  subscribeChanges(const std::string &collection) override {
+    return gate(collection,
+                [&] { return base_.subscribeChanges(collection); });
+  }
+  Result<std::vector<std::pair<std::string, Document>>>
+  query(const std::string &collection, const std::vector<std::string> &fields,
+        const std::optional<DocPredicate> &where = std::nullopt) override {
+    return gate(collection,
+                [&] { return base_.query(collection, fields, where); });
+  }
+  Status queryVisit(const std::string &collection,
+                    const std::vector<std::string> &fields,
+                    const std::optional<DocPredicate> &where,
+                    const DocumentVisitor &fn) override {
+    return gate(collection, [&] {
+      return base_.queryVisit(collection, fields, where, fn);
+    });
+  }
+  Status createIndex(const std::string &collection, const std::string &field,
+                     IndexType type) override {
+    return gate(collection,
+                [&] { return base_.createIndex(collection, field, type); });
+  }
+
+private:
+  template <class F>
+  auto gate(const std::string &collection, F &&call) const
+      -> decltype(call()) {
+    return lazy_detail::gated(replay_, WalEngine::Document, collection, call);
+  }
+
+  DocumentStorage &base_;
+  LazyReplay &replay_;
+};
+
+/** @ingroup WalAPI */
+class LazyTimeSeriesStorage final : public TimeSeriesStorage {
+public:
+  LazyTimeSeriesStorage(TimeSeriesStorage &base, LazyReplay &replay)
+      : base_(base), replay_(replay) {}
+
+  Status createSeries(const std::string &series, const TimeSeriesSchema &schema,
+                      TimePartition partition = TimePartition::Hourly)
+      override {
+    return gate(series, [&] {
+      return base_.createSeries(series, schema, partition);
+    });
+  }
+  Status dropSeries(const std::string &series) override {
+    return gate(series, [&] { return base_.dropSeries(series); });
+  }
+  std::vector<std::string> listSeries() const override {
+    return replay_.listed(WalEngine::TimeSeries,
+                          [&] { return base_.listSeries(); });
+  }
+  Status append(const std::string &series, const Row &row) override {
+    return gate(series, [&] { return base_.append(series, row); });
+  }
+  Status appendBatch(const std::string &series,
+                     const std::vector<Row> &rows) override {
+    return gate(series, [&] { return base_.appendBatch(series, rows); });
+  }
+  Status appendColumns(const std::string &series, const int64_t *ts,
+                       const double *const *values, size_t n) override {
+    return gate(series,
+                [&] { return base_.appendColumns(series, ts, values, n); });
+  }
+  Result<ResultSet>
+  rangeQuery(const std::string &series, const std::vector<std::string> &columns,
+             int64_t startInclusive, int64_t endExclusive,
+             const std::optional<Predicate> &where = std::nullopt) override {
+    return gate(series, [&] {
+      return base_.rangeQuery(series, columns, startInclusive, endExclusive,
+                              where);
+    });
+  }
+  Status scan(const std::string &series,
+              const std::vector<std::string> &columns, int64_t startInclusive,
+              int64_t endExclusive, const std::optional<Predicate> &where,
+              const RelationalStorage::BatchSink &sink,
+              size_t batchRows = RelationalStorage::kDefaultBatchRows)
+      override {
+    return gate(series, [&] {
+      return base_.scan(series, columns, startInclusive, endExclusive, where,
+                        sink, batchRows);
+    });
+  }
+  Result<TimeSeriesSchema>
+  getSeriesSchema(const std::string &series) const override {
+    return gate(series, [&] { return base_.getSeriesSchema(series); });
+  }
+  Result<TimePartition>
+  getSeriesPartition(const std::string &series) const override {
+    return gate(series, [&] { return base_.getSeriesPartition(series); });
+  }
+  Result<ResultSet>
+  aggregate(const std::string &series, const std::string &valueColumn,
+            TimeAggregation agg, int64_t startInclusive, int64_t endExclusive,
+            int64_t bucketWidth, TimeGranularity bucketGranularity,
+            const std::optional<Predicate> &where = std::nullopt,
+            double quantile = 0.5) override {
+    return gate(series, [&] {
+      return base_.aggregate(series, valueColumn, agg, startInclusive,
+                             endExclusive, bucketWidth, bucketGranularity,
+                             where, quantile);
+    });
+  }
+  Result<ResultSet>
+  window(const std::string &series, const std::string &valueColumn,
+         TimeWindowFunction fn, int64_t startInclusive, int64_t endExclusive,
+         int64_t width, TimeGranularity widthGranularity,
+         const std::optional<Predicate> &where = std::nullopt) override {
+    return gate(series, [&] {
+      return base_.window(series, valueColumn, fn, startInclusive,
+                          endExclusive, width, widthGranularity, where);
+    });
+  }
+  Status createContinuousAggregate(const std::string &series,
+                                   const std::string &valueColumn,
+                                   int64_t bucketWidth,
+                                   TimeGranularity bucketGranularity,
+                                   bool sketches = false) override {
+    return gate(series, [&] {
+      return base_.createContinuousAggregate(series, valueColumn, bucketWidth,
+                                             bucketGranularity, sketches);
+    });
+  }
+  Status dropContinuousAggregate(const std::string &series,
+                                 const std::string &valueColumn,
+                                 int64_t bucketWidth,
+                                 TimeGranularity bucketGranularity) override {
+    return gate(series, [&] {
+      return base_.dropContinuousAggregate(series, valueColumn, bucketWidth,
+                                           bucketGranularity);
+    });
+  }
+  Result<std::vector<TimeBucketStats>>
+  continuousAggregate(const std::string &series,
+                      const std::string &valueColumn, int64_t bucketSeconds,
+                      int64_t startSec, int64_t endSec) override {
+    return gate(series, [&] {
+      return base_.continuousAggregate(series, valueColumn, bucketSeconds,
+                                       startSec, endSec);
+    });
+  }
+  Result<std::vector<std::vector<TimeBucketStats>>>
+  bucketStats(const std::string &series,
+              const std::vector<std::string> &valueColumns,
+              int64_t startInclusive, int64_t endExclusive,
+              int64_t bucketWidth, const std::optional<Predicate> &where,
+              bool sketches = false) override {
+    return gate(series, [&] {
+      return base_.bucketStats(series, valueColumns, startInclusive,
+                               endExclusive, bucketWidth, where, sketches);
+    });
+  }
+  std::optional<uint64_t>
+  seriesVersion(const std::string &series) const override {
+    return gate(series, [&] { return base_.seriesVersion(series); });
+  }
+  Result<std::unique_ptr<ChangeSubscription>>
+  subscribeChanges(const std::string &series,
+                   const std::optional<Predicate> &where = std::nullopt)
+      override {
+    return gate(series, [&] { return base_.subscribeChanges(series, where); });
+  }
+  Result<std::vector<std::string>>
+  findSeriesByTags(const TagFilter &tags) const override {
+    return gateAll([&] { return base_.findSeriesByTags(tags); });
+  }
+  Result<ResultSet>
+  rangeQueryByTags(const TagFilter &tags,
+                   const std::vector<std::string> &columns,
+                   int64_t startInclusive, int64_t endExclusive,
+                   const std::optional<Predicate> &where = std::nullopt)
+      override {
+    return gateAll([&] {
+      return base_.rangeQueryByTags(tags, columns, startInclusive,
+                                    endExclusive, where);
+    });
+  }
+  Result<ResultSet>
+  aggregateByTags(const TagFilter &tags, const std::string &valueColumn,
+                  TimeAggregation agg, int64_t startInclusive,
+                  int64_t endExclusive, int64_t bucketWidth,
+                  TimeGranularity bucketGranularity,
+                  const std::optional<Predicate> &where = std::nullopt,
+                  double quantile = 0.5) override {
+    return gateAll([&] {
+      return base_.aggregateByTags(tags, valueColumn, agg, startInclusive,
+                                   endExclusive, bucketWidth,
+                                   bucketGranularity, where, quantile);
+    });
+  }
+
+private:
+  template <class F>
+  auto gate(const std::string &series, F &&call) const -> decltype(call()) {
+    return lazy_detail::gated(replay_, WalEngine::TimeSeries, series, call);
+  }
+  // Tags may match any series, so all of them load first
+  template <class F> auto gateAll(F &&call) const -> decltype(call()) {
+    Status st = replay_.loadAll(WalEngine::TimeSeries);
+    if (!st.ok())
+      return lazy_detail::Failed<decltype(call())>::of(st);
+    return call();
+  }
+
+  TimeSeriesStorage &base_;
+  LazyReplay &replay_;
+};
+
+/** @ingroup WalAPI */
+class LazyGraphStorage final : public GraphStorage {
+public:
+  LazyGraphStorage(GraphStorage &base, LazyReplay &replay)
+      : base_(base), replay_(replay) {}
+
+  Status createGraph(const std::string &graph) override {
+    return gate(graph, [&] { return base_.createGraph(graph); });
+  }
+  Status dropGraph(const std::string &graph) override {
+    return gate(graph, [&] { return base_.dropGraph(graph); });
+  }
+  std::vector<std::string> listGraphs() const override {
+    return replay_.listed(WalEngine::Graph, [&] { return base_.listGraphs(); });
+  }
+  Result<Node> getNode(const std::string &graph, NodeId id) const override {
+    return gate(graph, [&] { return base_.getNode(graph, id); });
+  }
+  Status putNode(const std::string &graph, const Node &node) override {
+    return gate(graph, [&] { return base_.putNode(graph, node); });
+  }
+  Status eraseNode(const std::string &graph, NodeId id) override {
+    return gate(graph, [&] { return base_.eraseNode(graph, id); });
+  }
+  Result<Edge> getEdge(const std::string &graph, EdgeId id) const override {
+    return gate(graph, [&] { return base_.getEdge(graph, id); });
+  }
+  Status putEdge(const std::string &graph, const Edge &edge) override {
+    return gate(graph, [&] { return base_.putEdge(graph, edge); });
+  }
+  Status eraseEdge(const std::string &graph, EdgeId id) override {
+    return gate(graph, [&] { return base_.eraseEdge(graph, id); });
+  }
+  Status putNodes(const std::string &graph,
+                  const std::vector<Node> &nodes) override {
+    return gate(graph, [&] { return base_.putNodes(graph, nodes); });
+  }
+  Status putEdges(const std::string &graph,
+                  const std::vector<Edge> &edges) override {
+    return gate(graph, [&] { return base_.putEdges(graph, edges); });
+  }
+  Result<std::vector<EdgeId>> edgeIdsOut(const std::string &graph,
+                                         NodeId from) const override {
+    return gate(graph, [&] { return base_.edgeIdsOut(graph, from); });
+  }
+  Result<std::vector<EdgeId>> edgeIdsIn(const std::string &graph,
+                                        NodeId to) const override {
+    return gate(graph, [&] { return base_.edgeIdsIn(graph, to); });
+  }
+  Result<std::vector<NodeId>> neighborsOut(const std::string &graph,
+                                           NodeId from) const override {
+    return gate(graph, [&] { return base_.neighborsOut(graph, from); });
+  }
+  Result<std::vector<NodeId>> neighborsIn(const std::string &graph,
+                                          NodeId to) const override {
+    return gate(graph, [&] { return base_.neighborsIn(graph, to); });
+  }
+  Status withNode(const std::string &graph, NodeId id,
+                  const std::function<void(const Node &)> &fn) const override {
+    return gate(graph, [&] { return base_.withNode(graph, id, fn); });
+  }
+  Status withEdge(const std::string &graph, EdgeId id,
+                  const std::function<void(const Edge &)> &fn) const override {
+    return gate(graph, [&] { return base_.withEdge(graph, id, fn); });
+  }
+  Status forEachNeighbor(const std::string &graph, NodeId id,
+                         const std::function<void(NodeId)> &fn,
+                         Direction dir = Direction::Out) const override {
+    return gate(graph,
+                [&] { return base_.forEachNeighbor(graph, id, fn, dir); });
+  }
+  Status forEachEdge(const std::string &graph, NodeId id,
+                     const std::function<void(const Edge &)> &fn,
+                     Direction dir = Direction::Out) const override {
+    return gate(graph, [&] { return base_.forEachEdge(graph, id, fn, dir); });
+  }
+  Result<std::vector<NodeId>> bfs(const std::string &graph, NodeId start,
+                                  size_t maxNodes = 0) const override {
+    return gate(graph, [&] { return base_.bfs(graph, start, maxNodes); });
+  }
+  Result<std::vector<NodeId>> dfs(const std::string &graph, NodeId start,
+                                  size_t maxNodes = 0) const override {
+    return gate(graph, [&] { return base_.dfs(graph, start, maxNodes); });
+  }
+  Result<std::vector<NodeId>> parallelBfs(const std::string &graph,
+                                          NodeId start, size_t maxNodes = 0,
+                                          size_t threads = 0) const override {
+    return gate(graph, [&] {
+      return base_.parallelBfs(graph, start, maxNodes, threads);
+    });
+  }
+  Result<std::vector<NodeId>>
+  filteredBfs(const std::string &graph, NodeId start,
+              const TraversalFilter &filter,
+              size_t maxNodes = 0) const override {
+    return gate(graph, [&] {
+      return base_.filteredBfs(graph, start, filter, maxNodes);
+    });
+  }
+  Result<std::vector<NodeId>>
+  filteredDfs(const std::string &graph, NodeId start,
+              const TraversalFilter &filter,
+              size_t maxNodes = 0) const override {
+    return gate(graph, [&] {
+      return base_.filteredDfs(graph, start, filter, maxNodes);
+    });
+  }
+  Result<std::vector<std::vector<NodeId>>>
+  neighborhoods(const std::string &graph, const std::vector<NodeId> &starts,
+                const TraversalFilter &filter,
+                size_t threads = 0) const override {
+    return gate(graph, [&] {
+      return base_.neighborhoods(graph, starts, filter, threads);
+    });
+  }
+  Result<std::vector<NodeId>> shortestPath(const std::string &graph,
+                                           NodeId from,
+                                           NodeId to) const override {
+    return gate(graph, [&] { return base_.shortestPath(graph, from, to); });
+  }
+  Result<bool> reachable(const std::string &graph, NodeId from,
+                         NodeId to) const override {
+    return gate(graph, [&] { return base_.reachable(graph, from, to); });
+  }
+  Result<std::shared_ptr<const CsrGraph>>
+  snapshot(const std::string &graph) const override {
+    return gate(graph, [&] { return base_.snapshot(graph); });
+  }
+  Result<GraphContents> contents(const std::string &graph) const override {
+    return gate(graph, [&] { return base_.contents(graph); });
+  }
+  Result<std::vector<NodeId>>
+  nodesWithLabel(const std::string &graph,
+                 const std::string &label) const override {
+    return gate(graph, [&] { return base_.nodesWithLabel(graph, label); });
+  }
+  Status createNodeIndex(const std::string &graph, const std::string &property,
+                         IndexType type) override {
+    return gate(graph,
+                [&] { return base_.createNodeIndex(graph, property, type); });
+  }
+  Status dropNodeIndex(const std::string &graph,
+                       const std::string &property) override {
+    return gate(graph, [&] { return base_.dropNodeIndex(graph, property); });
+  }
+  Status createEdgeIndex(const std::string &graph, const std::string &property,
+                         IndexType type) override {
+    return gate(graph,
+                [&] { return base_.createEdgeIndex(graph, property, type); });
+  }
+  Status dropEdgeIndex(const std::string &graph,
+                       const std::string &property) override {
+    return gate(graph, [&] { return base_.dropEdgeIndex(graph, property); });
+  }
+  Result<std::vector<NodeId>> findNodes(const std::string &graph,
+                                        const std::string &property,
+                                        const Value &value) const override {
+    return gate(graph,
+                [&] { return base_.findNodes(graph, property, value); });
+  }
+  Result<std::vector<NodeId>>
+  findNodesInRange(const std::string &graph, const std::string &property,
+                   const Value *lower, const Value *upper) const override {
+    return gate(graph, [&] {
+      return base_.findNodesInRange(graph, property, lower, upper);
+    });
+  }
+  Result<std::vector<EdgeId>> findEdges(const std::string &graph,
+                                        const std::string &property,
+                                        const Value &value) const override {
+    return gate(graph,
+                [&] { return base_.findEdges(graph, property, value); });
+  }
+  Result<std::vector<EdgeId>>
+  findEdgesInRange(const std::string &graph, const std::string &property,
+                   const Value *lower, const Value *upper) const override {
+    return gate(graph, [&] {
+      return base_.findEdgesInRange(graph, property, lower, upper);
+    });
+  }
+
+private:
+  template <class F>
+  auto gate(const std::string &graph, F &&call) const -> decltype(call()) {
+    return lazy_detail::gated(replay_, WalEngine::Graph, graph, call);
+  }
+
+  GraphStorage &base_;
+  LazyReplay &replay_;
+};
+
+} // namespace kadedb
@@ -0,0 +1,453 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "kadedb/graph/storage.h"      // GraphStorage
+#include "kadedb/storage.h"            // Relational/DocumentStorage
+#include "kadedb/timeseries/storage.h" // TimeSeriesStorage
+#include "kadedb/wal.h"                // WriteAheadLog, WalRecord
+
+namespace kadedb {
+
+/**
+ * Orders logged mutations: run() applies a mutation and, when it succeeds,
+ * queues its record under a lock per target name, so the records of one
+ * table, collection, series or graph reach the log in the order their
+ * mutations took effect (the order replay needs). It then waits for the
+ * record to become durable outside that lock, where concurrent writers
+ * share one sync.
+ */
+/** @ingroup WalAPI */
+class WalSequencer {
+public:
+  explicit WalSequencer(WriteAheadLog &wal) : wal_(wal) {}
+
+  Status run(const std::string &target, const std::function<Status()> &apply,
+             const std::function<WalRecord()> &record);
+
+  WriteAheadLog &wal() const { return wal_; }
+
+private:
+  static constexpr size_t kStripes = 64;
+  WriteAheadLog &wal_;
+  std::array<std::mutex, kStripes> stripes_;
+};
+
+/**
+ * The Logged* storages wrap a storage and a WriteAheadLog: reads are
+ * forwarded, and every successful mutation is logged and reported only once
+ * its record is durable. A mutation that fails is not logged. A log error
+ * is reported after the mutation was applied in memory; the log then
+ * refuses every later record, so the storage should be rebuilt from it.
+ *
+ * To restart, replayWal() the log into fresh storages, then wrap them over
+ * the reopened log. A relational storage can instead start from a
+ * CheckpointStorage and replay only the records after its walLsn().
+ */
+/** @ingroup WalAPI */
+class LoggedRelationalStorage final : public RelationalStorage {
+public:
+  LoggedRelationalStorage(RelationalStorage &base, WriteAheadLog &wal)
+      : base_(base), seq_(wal) {}
+
+  Status createTable(const std::string &table,
+                     const TableSchema &schema) override;
+  Status insertRow(const std::string &table, const Row &row) override;
+  // Applied as one batch by the wrapped storage and logged as one record,
+  // so a failing batch is neither half applied nor logged
+  Status insertRows(const std::string &table,
+                    const std::vector<Row> &rows) override;
+  Status dropTable(const std::string &table) override;
+  Result<size_t>
+  deleteRows(const std::string &table,
+             const std::optional<Predicate> &where = std::nullopt) override;
+  Result<size_t> updateRows(
+      const std::string &table,
+      const std::unordered_map<std::string, AssignmentValue> &assignments,
+      const std::optional<Predicate> &where = std::nullopt) override;
+  // Logged as the updated rows, which replay hands out in the order the
+  // storage visits the matching rows
+  Result<size_t>
+  updateRowsWith(const std::string &table, const RowUpdater &updater,
+                 const std::optional<Predicate> &where = std::nullopt) override;
+  Status
+  updateRows(const std::string &table,
+             const std::unordered_map<std::string, std::unique_ptr<Value>>
+                 &assignments,
+             const std::optional<Predicate> &where = std::nullopt) override;
+  Status truncateTable(const std::string &table) override;
+  Status createIndex(const std::string &table, const std::string &column,
+                     IndexType type) override;
+
+  Result<ResultSet>
+  select(const std::string &table, const std::vector<std::string> &columns,
+         const std::optional<Predicate> &where = std::nullopt) override {
+    return base_.select(table, columns, where);
+  }
+  Status scan(const std::string &table, const std::vector<std::string> &columns,
+              const std::optional<Predicate> &where, const BatchSink &sink,
+              size_t batchRows = kDefaultBatchRows) override {
+    return base_.scan(table, columns, where, sink, batchRows);
+  }
+  std::vector<std::string> listTables() const override {
+    return base_.listTables();
+  }
+  Result<TableSchema> getTableSchema(const std::string &table) override {
+    return base_.getTableSchema(table);
+  }
+  std::optional<size_t>
+  estimateRowCount(const std::string &table) const override {
+    return base_.estimateRowCount(table);
+  }
+  std::optional<size_t>
+  estimateScanCost(const std::string &table,
+                   const std::optional<Predicate> &where) const override {
+    return base_.estimateScanCost(table, where);
+  }
+  std::shared_ptr<const TableStatistics>
+  getTableStatistics(const std::string &table) const override {
+    return base_.getTableStatistics(table);
+  }
+  std::string explainAccess(const std::string &table,
+                            const std::optional<Predicate> &where)
+      const override {
+    return base_.explainAccess(table, where);
+  }
+  std::optional<uint64_t>
+  tableVersion(const std::string &table) const override {
+    return base_.tableVersion(table);
+  }
+  Result<std::unique_ptr<ChangeSubscription>>
+  subscribeChanges(const std::string &table,
+                   const std::optional<Predicate> &where = std::nullopt)
+      override {
+    return base_.subscribeChanges(table, where);
+  }
+
+private:
+  RelationalStorage &base_;
+  WalSequencer seq_;
+};
+
+/** @ingroup WalAPI */
+class LoggedDocumentStorage final : public DocumentStorage {
+public:
+  LoggedDocumentStorage(DocumentStorage &base, WriteAheadLog &wal)
+      : base_(base), seq_(wal) {}
+
+  Status createCollection(
+      const std::string &collection,
+      const std::optional<DocumentSchema> &schema = std::nullopt) override;
+  Status dropCollection(const std::string &collection) override;
+  Status put(const std::string &collection, const std::string &key,
+             const Document &doc) override;
+  Status put(const std::string &collection, const std::string &key,
+             Document &&doc) override;
+  Status erase(const std::string &collection, const std::string &key) override;
+  Status createIndex(const std::string &collection, const std::string &field,
+                     IndexType type) override;
+
+  std::vector<std::string> listCollections() const override {
+    return base_.listCollections();
+  }
+  Result<Document> get(const std::string &collection,
+                       const std::string &key) override {
+    return base_.get(collection, key);
+  }
+  Result<size_t> count(const std::string &collection) const override {
+    return base_.count(collection);
+  }
+  Result<std::optional<DocumentSchema>>
+  getCollectionSchema(const std::string &collection) const override {
+    return base_.getCollectionSchema(collection);
+  }
+  Result<std::unique_ptr<ChangeSubscription>>
+  subscribeChanges(const std::string &collection) override {
+    return base_.subscribeChanges(collection);
+  }
+  Result<std::vector<std::pair<std::string, Document>>>
+  query(const std::string &collection, const std::vector<std::string> &fields,
+        const std::optional<DocPredicate> &where = std::nullopt) override {
+    return base_.query(collection, fields, where);
+  }
+  Status queryVisit(const std::string &collection,
+                    const std::vector<std::string> &fields,
+                    const std::optional<DocPredicate> &where,
+                    const DocumentVisitor &fn) override {
+    return base_.queryVisit(collection, fields, where, fn);
+  }
+
+private:
+  DocumentStorage &base_;
+  WalSequencer seq_;
+};
+
+/** @ingroup WalAPI */
+class LoggedTimeSeriesStorage final : public TimeSeriesStorage {
+public:
+  LoggedTimeSeriesStorage(TimeSeriesStorage &base, WriteAheadLog &wal)
+      : base_(base), seq_(wal) {}
+
+  Status createSeries(const std::string &series, const TimeSeriesSchema &schema,
+                      TimePartition partition = TimePartition::Hourly) override;
+  Status dropSeries(const std::string &series) override;
+  Status append(const std::string &series, const Row &row) override;
+  Status appendBatch(const std::string &series,
+                     const std::vector<Row> &rows) override;
+  Status appendColumns(const std::string &series, const int64_t *ts,
+                       const double *const *values, size_t n) override;
+  Status createContinuousAggregate(const std::string &series,
+                                   const std::string &valueColumn,
+                                   int64_t bucketWidth,
+                                   TimeGranularity bucketGranularity,
+                                   bool sketches = false) override;
+  Status dropContinuousAggregate(const std::string &series,
+                                 const std::string &valueColumn,
+                                 int64_t bucketWidth,
+                                 TimeGranularity bucketGranularity) override;
+
+  std::vector<std::string> listSeries() const override {
+    return base_.listSeries();
+  }
+  Result<ResultSet>
+  rangeQuery(const std::string &series, const std::vector<std::string> &columns,
+             int64_t startInclusive, int64_t endExclusive,
+             const std::optional<Predicate> &where = std::nullopt) override {
+    return base_.rangeQuery(series, columns, startInclusive, endExclusive,
+                            where);
+  }
+  Status scan(const std::string &series,
+              const std::vector<std::string> &columns, int64_t startInclusive,
+              int64_t endExclusive, const std::optional<Predicate> &where,
+              const RelationalStorage::BatchSink &sink,
+              size_t batchRows = RelationalStorage::kDefaultBatchRows)
+      override {
+    return base_.scan(series, columns, startInclusive, endExclusive, where,
+                      sink, batchRows);
+  }
+  Result<TimeSeriesSchema>
+  getSeriesSchema(const std::string &series) const override {
+    return base_.getSeriesSchema(series);
+  }
+  Result<TimePartition>
+  getSeriesPartition(const std::string &series) const override {
+    return base_.getSeriesPartition(series);
+  }
+  Result<ResultSet>
+  aggregate(const std::string &series, const std::string &valueColumn,
+            TimeAggregation agg, int64_t startInclusive, int64_t endExclusive,
+            int64_t bucketWidth, TimeGranularity bucketGranularity,
+            const std::optional<Predicate> &where = std::nullopt,
+            double quantile = 0.5) override {
+    return base_.aggregate(series, valueColumn, agg, startInclusive,
+                           endExclusive, bucketWidth, bucketGranularity,
+                           where, quantile);
+  }
+  Result<std::vector<TimeBucketStats>>
+  continuousAggregate(const std::string &series,
+                      const std::string &valueColumn, int64_t bucketSeconds,
+                      int64_t startSec, int64_t endSec) override {
+    return base_.continuousAggregate(series, valueColumn, bucketSeconds,
+                                     startSec, endSec);
+  }
+  Result<std::vector<std::vector<TimeBucketStats>>>
+  bucketStats(const std::string &series,
+              const std::vector<std::string> &valueColumns,
+              int64_t startInclusive, int64_t endExclusive,
+              int64_t bucketWidth, const std::optional<Predicate> &where,
+              bool sketches = false) override {
+    return base_.bucketStats(series, valueColumns, startInclusive,
+                             endExclusive, bucketWidth, where, sketches);
+  }
+  std::optional<uint64_t>
+  seriesVersion(const std::string &series) const override {
+    return base_.seriesVersion(series);
+  }
+  Result<std::unique_ptr<ChangeSubscription>>
+  subscribeChanges(const std::string &series,
+                   const std::optional<Predicate> &where = std::nullopt)
+      override {
+    return base_.subscribeChanges(series, where);
+  }
+  Result<std::vector<std::string>>
+  findSeriesByTags(const TagFilter &tags) const override {
+    return base_.findSeriesByTags(tags);
+  }
+  Result<ResultSet>
+  rangeQueryByTags(const TagFilter &tags,
+                   const std::vector<std::string> &columns,
+                   int64_t startInclusive, int64_t endExclusive,
+                   const std::optional<Predicate> &where = std::nullopt)
+      override {
+    return base_.rangeQueryByTags(tags, columns, startInclusive, endExclusive,
+                                  where);
+  }
+  Result<ResultSet>
+  aggregateByTags(const TagFilter &tags, const std::string &valueColumn,
+                  TimeAggregation agg, int64_t startInclusive,
+                  int64_t endExclusive, int64_t bucketWidth,
+                  TimeGranularity bucketGranularity,
+                  const std::optional<Predicate> &where = std::nullopt,
+                  double quantile = 0.5) override {
+    return base_.aggregateByTags(tags, valueColumn, agg, startInclusive,
+                                 endExclusive, bucketWidth, bucketGranularity,
+                                 where, quantile);
+  }
+
+private:
+  TimeSeriesStorage &base_;
+  WalSequencer seq_;
+};
+
+/** @ingroup WalAPI */
+class LoggedGraphStorage final : public GraphStorage {
+public:
+  LoggedGraphStorage(GraphStorage &base, WriteAheadLog &wal)
+      : base_(base), seq_(wal) {}
+
+  Status createGraph(const std::string &graph) override;
+  Status dropGraph(const std::string &graph) override;
+  Status putNode(const std::string &graph, const Node &node) override;
+  Status eraseNode(const std::string &graph, NodeId id) override;
+  Status putEdge(const std::string &graph, const Edge &edge) override;
+  Status eraseEdge(const std::string &graph, EdgeId id) override;
+  Status createNodeIndex(const std::string &graph, const std::string &property,
+                         IndexType type) override;
+  Status dropNodeIndex(const std::string &graph,
+                       const std::string &property) override;
+  Status createEdgeIndex(const std::string &graph, const std::string &property,
+                         IndexType type) override;
+  Status dropEdgeIndex(const std::string &graph,
+                       const std::string &property) override;
+
+  std::vector<std::string> listGraphs() const override {
+    return base_.listGraphs();
+  }
+  Result<Node> getNode(const std::string &graph, NodeId id) const override {
+    return base_.getNode(graph, id);
+  }
+  Result<Edge> getEdge(const std::string &graph, EdgeId id) const override {
+    return base_.getEdge(graph, id);
+  }
+  Result<std::vector<EdgeId>> edgeIdsOut(const std::string &graph,
+                                         NodeId from) const override {
+    return base_.edgeIdsOut(graph, from);
+  }
+  Result<std::vector<EdgeId>> edgeIdsIn(const std::string &graph,
+                                        NodeId to) const override {
+    return base_.edgeIdsIn(graph, to);
+  }
+  Result<std::vector<NodeId>> neighborsOut(const std::string &graph,
+                                           NodeId from) const override {
+    return base_.neighborsOut(graph, from);
+  }
+  Result<std::vector<NodeId>> neighborsIn(const std::string &graph,
+                                          NodeId to) const override {
+    return base_.neighborsIn(graph, to);
+  }
+  Status withNode(const std::string &graph, NodeId id,
+                  const std::function<void(const Node &)> &fn) const override {
+    return base_.withNode(graph, id, fn);
+  }
+  Status withEdge(const std::string &graph, EdgeId id,
+                  const std::function<void(const Edge &)> &fn) const override {
+    return base_.withEdge(graph, id, fn);
+  }
+  Status forEachNeighbor(const std::string &graph, NodeId id,
+                         const std::function<void(NodeId)> &fn,
+                         Direction dir = Direction::Out) const override {
+    return base_.forEachNeighbor(graph, id, fn, dir);
+  }
+  Status forEachEdge(const std::string &graph, NodeId id,
+                     const std::function<void(const Edge &)> &fn,
+                     Direction dir = Direction::Out) const override {
+    return base_.forEachEdge(graph, id, fn, dir);
+  }
+  Result<std::vector<NodeId>> bfs(const std::string &graph, NodeId start,
+                                  size_t maxNodes = 0) const override {
+    return base_.bfs(graph, start, maxNodes);
+  }
+  Result<std::vector<NodeId>> dfs(const std::string &graph, NodeId start,
+                                  size_t maxNodes = 0) const override {
+    return base_.dfs(graph, start, maxNodes);
+  }
+  Result<std::vector<NodeId>> parallelBfs(const std::string &graph,
+                                          NodeId start, size_t maxNodes = 0,
+                                          size_t threads = 0) const override {
+    return base_.parallelBfs(graph, start, maxNodes, threads);
+  }
+  Result<std::vector<NodeId>>
+  filteredBfs(const std::string &graph, NodeId start,
+              const TraversalFilter &filter,
+              size_t maxNodes = 0) const override {
+    return base_.filteredBfs(graph, start, filter, maxNodes);
+  }
+  Result<std::vector<NodeId>>
+  filteredDfs(const std::string &graph, NodeId start,
+              const TraversalFilter &filter,
+              size_t maxNodes = 0) const override {
+    return base_.filteredDfs(graph, start, filter, maxNodes);
+  }
+  Result<std::vector<std::vector<NodeId>>>
+  neighborhoods(const std::string &graph, const std::vector<NodeId> &starts,
+                const TraversalFilter &filter,
+                size_t threads = 0) const override {
+    return base_.neighborhoods(graph, starts, filter, threads);
+  }
+  Result<std::vector<NodeId>> shortestPath(const std::string &graph,
+                                           NodeId from,
+                                           NodeId to) const override {
+    return base_.shortestPath(graph, from, to);
+  }
+  Result<bool> reachable(const std::string &graph, NodeId from,
+                         NodeId to) const override {
+    return base_.reachable(graph, from, to);
+  }
+  Result<std::shared_ptr<const CsrGraph>>
+  snapshot(const std::string &graph) const override {
+    return base_.snapshot(graph);
+  }
+  Result<GraphContents> contents(const std::string &graph) const override {
+    return base_.contents(graph);
+  }
+  Result<std::vector<NodeId>>
+  nodesWithLabel(const std::string &graph,
+                 const std::string &label) const override {
+    return base_.nodesWithLabel(graph, label);
+  }
+  Result<std::vector<NodeId>> findNodes(const std::string &graph,
+                                        const std::string &property,
+                                        const Value &value) const override {
+    return base_.findNodes(graph, property, value);
+  }
+  Result<std::vector<NodeId>>
+  findNodesInRange(const std::string &graph, const std::string &property,
+                   const Value *lower, const Value *upper) const override {
+    return base_.findNodesInRange(graph, property, lower, upper);
+  }
+  Result<std::vector<EdgeId>> findEdges(const std::string &graph,
+                                        const std::string &property,
+                                        const Value &value) const override {
+    return base_.findEdges(graph, property, value);
+  }
+  Result<std::vector<EdgeId>>
+  findEdgesInRange(const std::string &graph, const std::string &property,
+                   const Value *lower, const Value *upper) const override {
+    return base_.findEdgesInRange(graph, property, lower, upper);
+  }
+
+private:
+  GraphStorage &base_;
+  WalSequencer seq_;
+};
+
+} // namespace kadedb
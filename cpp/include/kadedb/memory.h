@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+#include "kadedb/schema.h"
+#include "kadedb/status.h"
+
+namespace kadedb {
+
+/**
+ * @defgroup Memory Memory accounting
+ * Each in-memory container (table, collection, series, graph) keeps a
+ * running estimate of the bytes its data holds, updated by the writes
+ * that change it, so reading it is O(1). Sizes are estimates: stored
+ * objects, their cells and out-of-line strings, and a fixed charge per
+ * hash map entry, but not allocator overhead or spare capacity.
+ *
+ * A container may be given a budget. A write that would take it past its
+ * budget fails with StatusCode::ResourceExhausted and changes nothing,
+ * unless the container evicts data to make room (BudgetPolicy).
+ * @{
+ */
+
+// What a write that would exceed a budget does
+enum class BudgetPolicy {
+  Reject,     // fail it with ResourceExhausted
+  EvictOldest // drop the oldest data until the container fits
+};
+
+/** Bytes held by one container, and its budget. */
+class MemoryAccount {
+public:
+  size_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+  // 0: unlimited
+  size_t budget() const { return budget_.load(std::memory_order_relaxed); }
+  void setBudget(size_t bytes) {
+    budget_.store(bytes, std::memory_order_relaxed);
+  }
+  // Whether `more` bytes fit within the budget. Writers serialize on
+  // their container, so a check and the add that follows it do not race.
+  bool fits(size_t more) const {
+    const size_t b = budget();
+    return b == 0 || bytes() + more <= b;
+  }
+  bool over() const { return !fits(0); }
+
+  void add(size_t n) { bytes_.fetch_add(n, std::memory_order_relaxed); }
+  void sub(size_t n) { bytes_.fetch_sub(n, std::memory_order_relaxed); }
+  void set(size_t n) { bytes_.store(n, std::memory_order_relaxed); }
+
+private:
+  std::atomic<size_t> bytes_{0};
+  std::atomic<size_t> budget_{0};
+};
+
+namespace memory {
+
+// Fixed charge for one entry of a node-based hash map or tree
+constexpr size_t kMapEntryBytes = 4 * sizeof(void *);
+
+// One InlineValue cell and its out-of-line string, if any
+size_t valueBytes(const InlineValue &v);
+// A Value object and its string
+size_t valueBytes(const Value *v);
+// Cells of `row`
+size_t rowBytes(const InlineRow &row);
+// Entries, field names and values of `doc`
+size_t documentBytes(const Document &doc);
+
+// ResourceExhausted naming the container, its bytes and budget
+Status budgetExceeded(const std::string &kind, const std::string &name,
+                      const MemoryAccount &account, size_t more);
+
+} // namespace memory
+
+/** @} */
+
+} // namespace kadedb
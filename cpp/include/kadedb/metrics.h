@@ -0,0 +1,251 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "kadedb/profiled_mutex.h"
+#include "kadedb/status.h"
+
+namespace kadedb {
+namespace metrics {
+
+/**
+ * @defgroup Metrics Engine metrics
+ * Built-in counters and latency histograms of the storage engines and the
+ * KadeQL executor. Every thread records into its own cells without
+ * read-modify-write atomics or locks; snapshot() sums the cells of all
+ * threads (and of threads that have exited) under the registry lock.
+ * Recording is on by default and costs two clock reads per operation;
+ * setEnabled(false) turns it into a flag test.
+ * @{
+ */
+
+/** Operations the engines time, named `<storage>_<operation>`. */
+enum class Operation : uint8_t {
+  RelationalInsert,
+  RelationalSelect,
+  RelationalUpdate,
+  RelationalDelete,
+  RelationalUpsert,
+  DocumentPut,
+  DocumentGet,
+  DocumentErase,
+  DocumentQuery,
+  DocumentPatch,
+  TimeSeriesAppend,
+  TimeSeriesRangeQuery,
+  TimeSeriesAggregate,
+  GraphRead,
+  GraphWrite,
+  GraphTraversal,
+  KadeqlExecute,
+};
+constexpr size_t kOperationCount =
+    static_cast<size_t>(Operation::KadeqlExecute) + 1;
+
+// "relational", "document", "timeseries", "graph" or "kadeql"
+const char *storageName(Operation op);
+// "insert", "select", "range_query", ...
+const char *operationName(Operation op);
+
+/**
+ * Log-linear buckets in the manner of HdrHistogram: 2^(SubBits-1) to
+ * 2^SubBits sub-buckets per power of two, so a value is kept within
+ * 1/2^(SubBits-1) of its true value over the whole uint64_t range.
+ */
+template <unsigned SubBits> struct LogBuckets {
+  static constexpr unsigned kSubBits = SubBits;
+  static constexpr size_t kHalf = size_t{1} << (kSubBits - 1);
+  static constexpr size_t kCount = (64 - kSubBits + 1) * kHalf + kHalf;
+
+  // Values below 2^kSubBits have a bucket each; above, the top kSubBits
+  // bits of a value select its bucket within its power of two
+  static size_t bucketOf(uint64_t v) {
+    if (v < (uint64_t{1} << kSubBits))
+      return static_cast<size_t>(v);
+    unsigned msb = 63;
+    while (!(v >> msb))
+      --msb;
+    const unsigned shift = msb - (kSubBits - 1);
+    return shift * kHalf + static_cast<size_t>(v >> shift);
+  }
+  // Highest value that falls into `bucket`
+  static uint64_t highestIn(size_t bucket) {
+    if (bucket < (size_t{1} << kSubBits))
+      return bucket;
+    const size_t shift = bucket / kHalf - 1;
+    const uint64_t mantissa = bucket - shift * kHalf;
+    return ((mantissa + 1) << shift) - 1;
+  }
+};
+
+/**
+ * Buckets of the engine latency histograms: 16 to 32 sub-buckets per
+ * power of two, so a value is kept within 1/16 (about 6%) of its true
+ * value from one nanosecond up, in 976 buckets.
+ */
+using LatencyBuckets = LogBuckets<5>;
+
+/** Latency distribution of one operation, in nanoseconds. */
+class LatencySnapshot {
+public:
+  uint64_t count() const { return count_; }
+  uint64_t sumNs() const { return sumNs_; }
+  // Highest value of the highest non-empty bucket (0 when empty)
+  uint64_t maxNs() const;
+  // Smallest value with at least `p` percent of the samples at or below
+  // it, to bucket precision (0 when empty)
+  uint64_t percentileNs(double p) const;
+
+private:
+  friend class Registry;
+  std::array<uint64_t, LatencyBuckets::kCount> counts_{};
+  uint64_t count_ = 0;
+  uint64_t sumNs_ = 0;
+};
+
+/** Totals of one operation since start-up or the last reset(). */
+struct OperationMetrics {
+  Operation op = Operation::RelationalInsert;
+  uint64_t calls = 0;
+  uint64_t errors = 0; // calls that returned a non-OK Status
+  uint64_t rowsScanned = 0;  // rows, documents, points or nodes examined
+  uint64_t rowsReturned = 0; // ... and the ones returned or written
+  uint64_t lockWaitNs = 0;   // time blocked on storage locks
+  // Value storage requested on the calling thread during the operation,
+  // plus the estimated footprint of the rows it stored
+  uint64_t bytesAllocated = 0;
+  LatencySnapshot latency;
+};
+
+/**
+ * Totals of one lock site since start-up or the last reset(), recorded only
+ * in builds with KADEDB_LOCK_PROFILING.
+ */
+struct LockSiteMetrics {
+  LockSite site = LockSite::RelationalCatalog;
+  uint64_t acquisitions = 0;       // exclusive and shared
+  uint64_t sharedAcquisitions = 0; // ... of which shared
+  uint64_t contended = 0;          // acquisitions that had to wait
+  uint64_t waitNs = 0;
+  uint64_t maxWaitNs = 0;
+  uint64_t holdNs = 0; // exclusive holds only
+  uint64_t maxHoldNs = 0;
+};
+
+// Whether operations are being recorded (default: yes)
+bool enabled();
+void setEnabled(bool on);
+
+// One entry per Operation, in enum order
+std::vector<OperationMetrics> snapshot();
+// One entry per LockSite, in enum order; empty unless kLockProfiling
+std::vector<LockSiteMetrics> lockSnapshot();
+// Both snapshots in the Prometheus text exposition format (version 0.0.4)
+std::string toPrometheus();
+// Start every counter and histogram, lock sites included, from zero again
+void reset();
+
+/**
+ * Records one operation on the calling thread: its latency from
+ * construction to destruction and whatever the code it runs adds through
+ * the static helpers below, which charge the innermost open scope (and do
+ * nothing outside one). Scopes nest; an outer scope's latency, bytes and
+ * rows scanned include those of the scopes inside it.
+ */
+class OperationScope {
+public:
+  explicit OperationScope(Operation op);
+  ~OperationScope();
+  OperationScope(const OperationScope &) = delete;
+  OperationScope &operator=(const OperationScope &) = delete;
+
+  // Count the operation as failed
+  void fail() { failed_ = true; }
+  // Rows scanned so far, by this scope and the scopes closed inside it
+  uint64_t rowsScanned() const { return scanned_; }
+
+  static void addRows(size_t scanned, size_t returned);
+  static void addBytes(size_t bytes);
+  static void addLockWait(uint64_t ns);
+
+private:
+  Operation op_;
+  bool active_;
+  bool failed_ = false;
+  OperationScope *outer_ = nullptr;
+  std::chrono::steady_clock::time_point start_;
+  uint64_t startBytes_ = 0;
+  uint64_t scanned_ = 0, returned_ = 0, lockWaitNs_ = 0, bytes_ = 0;
+};
+
+namespace detail {
+inline bool failed(const Status &st) { return !st.ok(); }
+template <typename T> bool failed(const T &res) { return !res.hasValue(); }
+inline uint64_t elapsedNs(std::chrono::steady_clock::time_point t0) {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - t0)
+          .count());
+}
+} // namespace detail
+
+// Runs fn() as operation `op`, counting a non-OK Status or Result it
+// returns as an error
+template <typename F> auto measure(Operation op, F &&fn) -> decltype(fn()) {
+  OperationScope scope(op);
+  auto out = fn();
+  if (detail::failed(out))
+    scope.fail();
+  return out;
+}
+
+/**
+ * Exclusive lock guard that charges the time spent blocked to the current
+ * OperationScope. An uncontended lock costs one try_lock and no clock
+ * reads.
+ */
+template <typename Mutex> class TimedLock {
+public:
+  explicit TimedLock(Mutex &m) : m_(m) {
+    if (m_.try_lock())
+      return;
+    const auto t0 = std::chrono::steady_clock::now();
+    m_.lock();
+    OperationScope::addLockWait(detail::elapsedNs(t0));
+  }
+  ~TimedLock() { m_.unlock(); }
+  TimedLock(const TimedLock &) = delete;
+  TimedLock &operator=(const TimedLock &) = delete;
+
+private:
+  Mutex &m_;
+};
+
+/** Shared (reader) counterpart of TimedLock. */
+template <typename Mutex> class TimedSharedLock {
+public:
+  explicit TimedSharedLock(Mutex &m) : m_(m) {
+    if (m_.try_lock_shared())
+      return;
+    const auto t0 = std::chrono::steady_clock::now();
+    m_.lock_shared();
+    OperationScope::addLockWait(detail::elapsedNs(t0));
+  }
+  ~TimedSharedLock() { m_.unlock_shared(); }
+  TimedSharedLock(const TimedSharedLock &) = delete;
+  TimedSharedLock &operator=(const TimedSharedLock &) = delete;
+
+private:
+  Mutex &m_;
+};
+
+/** @} */
+
+} // namespace metrics
+} // namespace kadedb
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "kadedb/schema.h"   // InlineRow
+#include "kadedb/zone_map.h" // ZoneMap
+
+namespace kadedb {
+
+// Commit version (logical timestamp). Every committed write gets the next
+// version; version 0 precedes all commits.
+using Version = uint64_t;
+constexpr Version kMaxVersion = std::numeric_limits<Version>::max();
+
+/**
+ * One stored version of a row, visible to snapshots in [begin, end).
+ *
+ * `row` and `begin` are immutable once the version is published to readers.
+ * `end` is stamped by the writer that supersedes or deletes the row while
+ * readers may be inspecting it, hence atomic.
+ */
+struct RowVersion {
+  InlineRow row;
+  Version begin = 0;
+  mutable std::atomic<Version> end{kMaxVersion};
+
+  bool visibleAt(Version snapshot) const {
+    return begin <= snapshot &&
+           snapshot < end.load(std::memory_order_acquire);
+  }
+  // Not yet superseded or deleted
+  bool live() const {
+    return end.load(std::memory_order_acquire) == kMaxVersion;
+  }
+};
+
+/**
+ * Append-only, chunked store of row versions.
+ *
+ * Versions live in fixed-size chunks that never move, so a position stays
+ * valid for as long as any store referencing its chunk is alive. Stores are
+ * shared with readers through std::shared_ptr, and the single writer never
+ * mutates a published chunk list: when a chunk must be added it appends to a
+ * copy (grow()) that shares the existing chunks. Readers only access
+ * positions below the size that was published to them.
+ *
+ * Each full chunk also has a zone map of every version appended to it,
+ * built as they are appended and fixed once the chunk fills, so scans can
+ * skip chunks their predicate cannot match.
+ */
+class RowVersionStore {
+public:
+  static constexpr size_t kChunkRows = 1024;
+
+  // Number of appended versions (writer side; readers use their snapshot)
+  size_t size() const { return size_; }
+  const RowVersion &at(size_t pos) const {
+    return chunks_[pos / kChunkRows][pos % kChunkRows];
+  }
+  RowVersion &at(size_t pos) {
+    return chunks_[pos / kChunkRows][pos % kChunkRows];
+  }
+
+  // True when the next append() needs a new chunk
+  bool full() const { return size_ == chunks_.size() * kChunkRows; }
+  // Appends possible before the store is full()
+  size_t room() const { return chunks_.size() * kChunkRows - size_; }
+  // Copy of this store with room for at least `rows` more appends (one
+  // more empty chunk by default); existing chunks shared
+  std::shared_ptr<RowVersionStore> grow(size_t rows = 1) const;
+  // Append a version and return its position. Requires !full().
+  size_t append(InlineRow row, Version begin);
+  // Zone map of chunk `chunk` once it is full, else nullptr. Readers ask
+  // only for chunks that were full in their snapshot.
+  const ZoneMap *zone(size_t chunk) const { return zones_[chunk].get(); }
+
+private:
+  std::vector<std::shared_ptr<RowVersion[]>> chunks_;
+  // One slot per chunk, aligned with chunks_; set when the chunk fills
+  std::vector<std::shared_ptr<const ZoneMap>> zones_;
+  // Zone map of the chunk being filled (writer only)
+  ZoneMap filling_;
+  size_t size_ = 0;
+};
+
+/**
+ * Read snapshot of a table: the versions in store positions [0, size) that
+ * are visible at `version`. Holding the snapshot keeps them alive.
+ */
+struct RowSnapshot {
+  std::shared_ptr<const RowVersionStore> store;
+  size_t size = 0;
+  Version version = 0;
+};
+
+} // namespace kadedb
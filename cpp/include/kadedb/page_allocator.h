@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <vector>
+
+namespace kadedb {
+
+/**
+ * @defgroup Pages Page placement of storage arrays
+ * The large contiguous arrays of the storages (column vectors, CSR
+ * snapshots) are allocated through PageAllocator. Blocks below
+ * memory::kPageBlockBytes come from operator new as before. Larger ones
+ * are mapped on their own, aligned to 2 MiB, so the policy below can back
+ * them with huge pages and place them on NUMA nodes:
+ *  - HugePages::Transparent advises the kernel to use transparent huge
+ *    pages for them; HugePages::Explicit maps them from the reserved
+ *    hugetlbfs pool, falling back to transparent pages when it runs out
+ *  - NumaPlacement::Interleave spreads their pages over every node, so
+ *    data one ingest thread wrote is read at the same cost by scans on
+ *    every socket; FirstTouch leaves each page on the node of the thread
+ *    that first writes it
+ * Where the system has no huge pages or a single node, the hints are
+ * skipped and the blocks are plain mappings.
+ * @{
+ */
+
+enum class HugePages { Off, Transparent, Explicit };
+enum class NumaPlacement { FirstTouch, Interleave };
+
+struct PagePolicy {
+  HugePages hugePages = HugePages::Transparent;
+  NumaPlacement placement = NumaPlacement::Interleave;
+};
+
+namespace memory {
+
+// Smallest block mapped on its own: one huge page
+constexpr size_t kPageBlockBytes = size_t{2} << 20;
+
+// Policy for the blocks mapped after the call; process-wide
+void setPagePolicy(const PagePolicy &policy);
+PagePolicy pagePolicy();
+
+// NUMA nodes of the machine, numbered densely from 0 (1 without NUMA),
+// the node the calling thread runs on, and the CPUs of node `node`
+size_t numaNodes();
+size_t currentNumaNode();
+std::vector<size_t> numaCpus(size_t node);
+// Keep the calling thread on the CPUs of `node`; false if it cannot
+bool bindThreadToNode(size_t node);
+
+// `bytes` of storage under the current policy; throws std::bad_alloc.
+// releasePages() takes the same size back.
+void *allocatePages(size_t bytes);
+void releasePages(void *p, size_t bytes) noexcept;
+
+// Bytes currently in blocks mapped on their own, and those of them
+// taken from the explicit huge page pool
+size_t mappedBytes();
+size_t hugePageBytes();
+
+} // namespace memory
+
+/** std allocator over memory::allocatePages() */
+template <typename T> class PageAllocator {
+public:
+  using value_type = T;
+
+  PageAllocator() noexcept = default;
+  template <typename U> PageAllocator(const PageAllocator<U> &) noexcept {}
+
+  T *allocate(size_t n) {
+    if (n > std::numeric_limits<size_t>::max() / sizeof(T))
+      throw std::bad_array_new_length();
+    return static_cast<T *>(memory::allocatePages(n * sizeof(T)));
+  }
+  void deallocate(T *p, size_t n) noexcept {
+    memory::releasePages(p, n * sizeof(T));
+  }
+
+  friend bool operator==(const PageAllocator &, const PageAllocator &) {
+    return true;
+  }
+  friend bool operator!=(const PageAllocator &, const PageAllocator &) {
+    return false;
+  }
+};
+
+// A storage array placed by the page policy
+template <typename T> using PageVector = std::vector<T, PageAllocator<T>>;
+
+/** @} */
+
+} // namespace kadedb
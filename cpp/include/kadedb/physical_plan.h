@@ -0,0 +1,706 @@
+#pragma once
+
+#include "kadedb/kadeql_ast.h"
+#include "kadedb/result.h"
+#include "kadedb/schema.h"
+#include "kadedb/statistics.h" // HyperLogLog, TDigest
+#include "kadedb/storage.h"
+#include "kadedb/timeseries/window.h"
+#include "kadedb/tracing.h"
+#include "kadedb/value.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace kadedb {
+namespace kadeql {
+
+/**
+ * Push-based physical operators for KadeQL SELECT.
+ *
+ * A PhysicalPlan streams batches from RelationalStorage::scan() into a chain
+ * of operators; each operator pushes its output batches to the next one and
+ * the last operator collects the ResultSet. Streaming operators (Filter,
+ * Project, Limit) forward batch by batch, so peak memory is one batch plus
+ * the state of blocking operators (HashAggregate, Sort), which emit on
+ * finish() and spill past a memory budget (SpillOptions). Once an operator
+ * reports done(), the scan stops early.
+ */
+
+// One row of cells in column order (nullptr = null)
+using Cells = std::vector<std::unique_ptr<Value>>;
+
+// Evaluates an expression against one row of the given schema
+using ExprEvaluator = std::function<Result<std::unique_ptr<Value>>(
+    const Expression *expr, const TableSchema &schema, const Cells &row)>;
+
+// Typed hash-key cell: Float cells with integral values are stored as
+// Integer so 2 and 2.0 are one key; monostate is null
+using KeyPart =
+    std::variant<std::monostate, int64_t, double, std::string, bool>;
+using RowKey = std::vector<KeyPart>;
+struct RowKeyHash {
+  size_t operator()(const RowKey &key) const;
+};
+KeyPart keyPart(const Value *v);
+
+// Strict weak order of rows
+using RowLess = std::function<bool(const Cells &, const Cells &)>;
+
+// Estimated heap footprint of one row: its cell pointers and Values
+size_t cellsBytes(const Cells &row);
+
+/**
+ * Memory budget of a plan's blocking operators. An operator whose state
+ * would grow past `memoryBudget` moves it to temporary files and finishes
+ * from them: Sort writes sorted runs and merges them, HashAggregate and
+ * HashJoin split their input into `partitions` files by key hash and
+ * process one partition at a time (grace hashing), partitioning again
+ * when a partition is itself too large.
+ */
+struct SpillOptions {
+  size_t memoryBudget = 0; // bytes per operator; 0: never spill
+  std::string directory;   // empty: the system temporary directory
+  size_t partitions = 16;  // files per partitioning pass
+};
+
+/**
+ * A temporary file of rows, written in bulk binary row batches
+ * (bin::writeRowBatch) and then read back once, in order. Appended rows
+ * are buffered into batches of kBatchRows. The file is removed when the
+ * SpillFile is destroyed.
+ */
+class SpillFile {
+public:
+  static constexpr size_t kBatchRows = 256;
+
+  // A new empty file in `directory` (empty: the system temporary directory)
+  static Result<std::unique_ptr<SpillFile>>
+  create(const std::string &directory);
+  ~SpillFile();
+  SpillFile(const SpillFile &) = delete;
+  SpillFile &operator=(const SpillFile &) = delete;
+
+  // Append one row; the rows of a file must have one width
+  Status append(Cells row);
+  // Next batch of at most kBatchRows rows into `rows`, empty at the end;
+  // the first read ends writing
+  Status read(std::vector<Cells> &rows);
+
+  size_t rows() const { return rows_; }
+  size_t bytes() const { return bytes_; } // encoded size
+
+private:
+  SpillFile(std::FILE *file, std::string path)
+      : file_(file), path_(std::move(path)) {}
+  Status flush();
+
+  std::FILE *file_;
+  std::string path_; // empty: removed by the system on close
+  std::vector<Cells> pending_;
+  std::string buf_;
+  bool reading_ = false;
+  size_t rows_ = 0, bytes_ = 0;
+};
+
+/**
+ * Sorted runs of one operator, oldest first. Whenever kMergeFanIn runs of
+ * one level accumulate they are merged into one run of the next level, so
+ * an operator keeps few files open and rewrites each row once per level.
+ */
+class SpillRuns {
+public:
+  static constexpr size_t kMergeFanIn = 64;
+
+  // Append `run`, sorted by `less` like the others; merged runs are new
+  // files in `directory`
+  Status add(std::unique_ptr<SpillFile> run, const RowLess &less,
+             const std::string &directory);
+  bool empty() const { return files_.empty(); }
+  size_t rows() const;
+  std::vector<std::unique_ptr<SpillFile>> &files() { return files_; }
+  void clear();
+
+private:
+  std::vector<std::unique_ptr<SpillFile>> files_;
+  std::vector<size_t> levels_; // of files_, non-increasing
+};
+
+class PhysicalOperator {
+public:
+  virtual ~PhysicalOperator() = default;
+
+  // Input column metadata; called once before the first push()
+  virtual Status open(const std::vector<std::string> &names,
+                      const std::vector<ColumnType> &types) = 0;
+  // Consume one batch; cells may be moved out of `rows`
+  virtual Status push(std::vector<Cells> &rows) = 0;
+  // End of input: flush buffered rows and finish downstream
+  virtual Status finish() { return next_ ? next_->finish() : Status::OK(); }
+  // True once further input cannot change the plan's output
+  virtual bool done() const { return next_ && next_->done(); }
+  // Operator name and a one-line description for EXPLAIN; after a run the
+  // description may include what the operator saw
+  virtual std::string name() const { return "Operator"; }
+  virtual std::string detail() const { return {}; }
+
+  void setNext(PhysicalOperator *next) { next_ = next; }
+  // Budget of an operator that can spill; set before open()
+  void setSpillOptions(const SpillOptions &options) { spill_ = options; }
+
+protected:
+  // Push buffered rows downstream in scan-sized batches until done()
+  Status pushInBatches(std::vector<Cells> &rows);
+
+  // Merge the sorted `runs`, then the sorted rows of `tail`, as one
+  // sequence ordered by `less` (ties keep the earlier run first), and push
+  // it downstream like pushInBatches(), keeping the first `width` cells of
+  // each row. The runs are consumed.
+  Status pushMerged(SpillRuns &runs, std::vector<Cells> tail,
+                    const RowLess &less, size_t width = SIZE_MAX);
+
+  PhysicalOperator *next_ = nullptr;
+  SpillOptions spill_;
+};
+
+// Keeps rows matching a predicate bound to the input columns
+class FilterOperator final : public PhysicalOperator {
+public:
+  explicit FilterOperator(const Predicate &pred) : pred_(pred) {}
+
+  Status open(const std::vector<std::string> &names,
+              const std::vector<ColumnType> &types) override;
+  Status push(std::vector<Cells> &rows) override;
+  std::string name() const override { return "Filter"; }
+  std::string detail() const override { return pred_.toString(); }
+
+private:
+  const Predicate &pred_;
+  TableSchema schema_;
+  BoundPredicate bound_;
+};
+
+// Keeps rows for which an expression evaluates to true; null and false
+// drop the row (WHERE conditions storage cannot evaluate, HAVING)
+class ExprFilterOperator final : public PhysicalOperator {
+public:
+  ExprFilterOperator(const Expression *cond, ExprEvaluator eval)
+      : cond_(cond), eval_(std::move(eval)) {}
+
+  Status open(const std::vector<std::string> &names,
+              const std::vector<ColumnType> &types) override;
+  Status push(std::vector<Cells> &rows) override;
+  std::string name() const override { return "ExprFilter"; }
+  std::string detail() const override { return cond_->toString(); }
+
+private:
+  const Expression *cond_;
+  ExprEvaluator eval_;
+  TableSchema schema_;
+};
+
+// Evaluates one expression per output column for every input row
+class ProjectOperator final : public PhysicalOperator {
+public:
+  struct Item {
+    const Expression *expr = nullptr;
+    std::string name;
+  };
+
+  ProjectOperator(std::vector<Item> items, ExprEvaluator eval)
+      : items_(std::move(items)), eval_(std::move(eval)) {}
+
+  Status open(const std::vector<std::string> &names,
+              const std::vector<ColumnType> &types) override;
+  Status push(std::vector<Cells> &rows) override;
+  std::string name() const override { return "Project"; }
+  std::string detail() const override;
+
+private:
+  std::vector<Item> items_;
+  ExprEvaluator eval_;
+  TableSchema schema_;
+};
+
+/**
+ * Appends a Float column per time-series window function call (MOVING_AVG,
+ * RATE, DELTA, EWMA) to rows arriving in timestamp order, in one pass with
+ * a TimeWindow per call. The column is named by the call's text, which is
+ * how expressions downstream read it (see ExprProgram). A row whose
+ * argument is null gets a null and leaves the window alone; non-numeric
+ * arguments fail with InvalidArgument, and rows out of timestamp order
+ * with FailedPrecondition.
+ */
+class TimeWindowOperator final : public PhysicalOperator {
+public:
+  struct Item {
+    TimeWindowFunction fn = TimeWindowFunction::MovingAvg;
+    const Expression *expr = nullptr; // the windowed value
+    int64_t width = 1;                // in timestamp units
+    std::string name;
+  };
+
+  // Timestamps are read from `timestampColumn`, in units of `unitSeconds`
+  TimeWindowOperator(std::vector<Item> items, std::string timestampColumn,
+                     double unitSeconds, ExprEvaluator eval)
+      : items_(std::move(items)), tsColumn_(std::move(timestampColumn)),
+        unitSeconds_(unitSeconds), eval_(std::move(eval)) {}
+
+  Status open(const std::vector<std::string> &names,
+              const std::vector<ColumnType> &types) override;
+  Status push(std::vector<Cells> &rows) override;
+  std::string name() const override { return "TimeWindow"; }
+  std::string detail() const override;
+
+private:
+  std::vector<Item> items_;
+  std::string tsColumn_;
+  double unitSeconds_;
+  ExprEvaluator eval_;
+  TableSchema schema_;
+  size_t tsIdx_ = 0;
+  std::vector<TimeWindow> windows_; // per item
+  std::optional<int64_t> lastTs_;
+};
+
+/**
+ * Groups rows by the TIME_BUCKET and GROUP BY keys (no keys: a single group)
+ * and folds each row into per-group accumulators.
+ *
+ * Groups live in insertion-ordered vectors indexed by an open-addressing
+ * table (linear probing, power-of-two capacity, at most half full) over
+ * typed RowKeys, so a row costs one hash and usually one probe. Key columns
+ * referenced by name are read in place instead of being evaluated. With a
+ * bucket the groups are emitted in bucket order, otherwise in the order
+ * they were first seen. No input rows produce no groups.
+ *
+ * Past its memory budget the operator partitions: rows of the groups it
+ * holds keep updating them, while rows of other groups are written to
+ * partition files by key hash. finish() writes the groups out as a run
+ * ordered like the output, aggregates each partition in turn (which may
+ * partition again) into further runs, and merges the runs, so the output
+ * is the same as without a budget.
+ */
+class HashAggregateOperator final : public PhysicalOperator {
+public:
+  // One select item of an aggregate query
+  struct Item {
+    enum class Kind {
+      TimeBucket,
+      First,
+      Last,
+      Count,
+      Sum,
+      Min,
+      Max,
+      Avg,
+      ApproxCountDistinct,
+      ApproxPercentile,
+      Plain
+    };
+    Kind kind = Kind::Plain;
+    const Expression *expr = nullptr;  // Plain: the item; others: first arg
+    const Expression *order = nullptr; // FIRST/LAST explicit order key
+    double quantile = 0.5;             // APPROX_PERCENTILE, in [0, 1]
+    std::string name;                  // output column
+  };
+
+  // `bucket` is the TIME_BUCKET timestamp expression (nullptr: none) and
+  // `keys` the GROUP BY expressions; nulls form one group per key
+  HashAggregateOperator(std::vector<Item> items, const Expression *bucket,
+                        int64_t interval, ExprEvaluator eval,
+                        std::vector<const Expression *> keys = {})
+      : items_(std::move(items)), bucket_(bucket), interval_(interval),
+        eval_(std::move(eval)), keys_(std::move(keys)) {}
+
+  Status open(const std::vector<std::string> &names,
+              const std::vector<ColumnType> &types) override;
+  Status push(std::vector<Cells> &rows) override;
+  Status finish() override;
+  bool done() const override { return false; }
+  std::string name() const override { return "HashAggregate"; }
+  std::string detail() const override;
+
+private:
+  // Incremental per-group state of one item: every row updates it in O(1)
+  // (amortized for the t-digest)
+  struct State {
+    bool seen = false;
+    int64_t count = 0;   // COUNT; non-null inputs of SUM/AVG
+    int64_t intSum = 0;  // SUM/AVG over Integer inputs
+    double floatSum = 0; // SUM/AVG over Float inputs
+    bool anyFloat = false;
+    int64_t orderKey = 0;         // FIRST/LAST: order key of `value`
+    std::unique_ptr<Value> value; // MIN/MAX/FIRST/LAST/Plain
+    std::unique_ptr<HyperLogLog> distinct; // APPROX_COUNT_DISTINCT
+    std::unique_ptr<TDigest> digest;       // APPROX_PERCENTILE
+  };
+
+  Status update(const Item &item, State &st, const Cells &row);
+  // Group of `key_`, inserted when new; with `insert` false, npos when new
+  size_t findOrInsert(size_t hash, bool insert = true);
+  // Fold input row number rowNum_ into its group, or into its partition
+  // file when partitioning and the group is not held
+  Status consume(Cells &row);
+  // Output row of group `g`; its states are moved out
+  Cells groupRow(size_t g);
+  // Bucket start of group `g`, 0 without a bucket
+  int64_t bucketOf(size_t g) const;
+  // Write the groups held as a run ordered like the output, with each
+  // row's bucket and first row number appended, and drop them
+  Status spillGroups();
+
+  std::vector<Item> items_;
+  const Expression *bucket_;
+  int64_t interval_;
+  ExprEvaluator eval_;
+  std::vector<const Expression *> keys_;
+  std::vector<size_t> keyIdx_; // input column of each key, npos: evaluate
+  TableSchema schema_;
+  size_t tsIdx_ = TableSchema::npos;
+  size_t rowNum_ = 0; // input position, FIRST/LAST fallback order
+  // Groups in first-seen order. Keys are normalized (keycode), with the
+  // bucket start (keycode::appendI64()) first if any, so they hash and
+  // compare as bytes.
+  std::vector<std::string> groupKeys_;
+  std::vector<size_t> groupHashes_;
+  std::vector<std::vector<State>> groupStates_;
+  std::vector<size_t> groupFirst_; // rowNum_ of each group's first row
+  std::vector<size_t> slots_;      // group index + 1, 0: empty
+  std::string key_;                // key of the current row
+  // Spilling: estimated size of the groups held, the partition files of
+  // this pass (empty: not partitioning) and how many passes deep it is,
+  // partitions still to aggregate with their depth, and output runs
+  size_t bytes_ = 0;
+  std::vector<std::unique_ptr<SpillFile>> partitions_;
+  size_t depth_ = 0;
+  std::vector<std::pair<std::unique_ptr<SpillFile>, size_t>> pending_;
+  SpillRuns runs_;
+  size_t spilledRows_ = 0, spilledFiles_ = 0;
+  // "kadeql.aggregate", from the first batch until the groups are emitted
+  std::optional<tracing::Span> span_;
+};
+
+/**
+ * Stable sort on input columns; nulls order before every value. With `topK`
+ * set only the first topK rows of the order are kept, in a bounded heap, so
+ * ORDER BY ... LIMIT k costs O(n log k) time and O(k) memory.
+ *
+ * A full sort past its memory budget is an external merge sort: each time
+ * the buffered rows outgrow the budget they are sorted and written out as a
+ * run, and finish() merges the runs with the rows still buffered.
+ */
+class SortOperator final : public PhysicalOperator {
+public:
+  struct Key {
+    std::string column;
+    bool descending = false;
+  };
+
+  explicit SortOperator(std::vector<Key> keys,
+                        std::optional<size_t> topK = std::nullopt)
+      : keys_(std::move(keys)), topK_(topK) {}
+
+  Status open(const std::vector<std::string> &names,
+              const std::vector<ColumnType> &types) override;
+  Status push(std::vector<Cells> &rows) override;
+  Status finish() override;
+  bool done() const override { return false; }
+  std::string name() const override { return "Sort"; }
+  std::string detail() const override;
+
+private:
+  // Input position breaks ties, keeping the sort stable
+  struct Entry {
+    std::string key; // sortKey(cells)
+    size_t seq = 0;
+    Cells cells;
+  };
+  // The row's sort keys, normalized (keycode::appendSortKey()) so that rows
+  // compare with memcmp
+  std::string sortKey(const Cells &row) const;
+  static bool before(const Entry &a, const Entry &b);
+  void sortRows();
+  // Order of rows within a run, sequence numbers aside
+  RowLess runOrder() const;
+  // Write rows_, sorted, to a new run
+  Status spillRun();
+
+  std::vector<Key> keys_;
+  std::optional<size_t> topK_;
+  std::vector<std::pair<size_t, bool>> resolved_; // column, descending
+  std::vector<Entry> rows_; // a max-heap on `before` when topK_ is set
+  size_t seen_ = 0;
+  size_t bytes_ = 0; // estimated size of rows_ while a budget is set
+  SpillRuns runs_; // sorted runs of earlier input
+  size_t spilledRuns_ = 0, spilledRows_ = 0;
+};
+
+// Keeps the named input columns, in the given order, with their types;
+// `names` (when non-empty) renames them in the output
+class ColumnProjectOperator final : public PhysicalOperator {
+public:
+  explicit ColumnProjectOperator(std::vector<std::string> columns,
+                                 std::vector<std::string> names = {})
+      : columns_(std::move(columns)), names_(std::move(names)) {}
+
+  Status open(const std::vector<std::string> &names,
+              const std::vector<ColumnType> &types) override;
+  Status push(std::vector<Cells> &rows) override;
+  std::string name() const override { return "ColumnProject"; }
+  std::string detail() const override;
+
+private:
+  std::vector<std::string> columns_;
+  std::vector<std::string> names_;
+  std::vector<size_t> idx_;
+  bool distinct_ = true; // no input column is selected twice
+};
+
+/**
+ * Equi-join of the input (the probe side) with a table read from storage
+ * (the build side). open() scans the build table, applying `buildWhere`,
+ * into a hash table on its key columns; each probe row is then looked up
+ * and joined with every build row whose keys are equal. Null keys never
+ * match. Output rows hold the left input's columns, then the right's.
+ *
+ * Either side may be the build side, so the planner can hash the smaller
+ * input. For a LEFT join with the build side on the left, unmatched build
+ * rows are emitted, null-extended, on finish().
+ *
+ * Output columns are named `prefix + column`; a side with an empty prefix
+ * keeps its input names.
+ *
+ * When the build side outgrows the memory budget the join turns into a
+ * grace hash join: both sides are written to partition files by key hash
+ * and finish() joins each pair of partitions in memory, partitioning a pair
+ * again when its build side is still too large. Output is then grouped by
+ * partition rather than in probe order.
+ */
+class HashJoinOperator final : public PhysicalOperator {
+public:
+  enum class Type { Inner, Left };
+
+  struct Spec {
+    Type type = Type::Inner;
+    bool buildIsLeft = false;
+    std::string buildTable;
+    std::optional<Predicate> buildWhere;
+    std::vector<std::string> buildColumns; // read; empty: all
+    std::string buildPrefix;
+    std::vector<std::string> buildKeys; // build table columns
+    std::string probePrefix;
+    std::vector<std::string> probeKeys; // probe input columns
+  };
+
+  HashJoinOperator(RelationalStorage &storage, Spec spec)
+      : storage_(storage), spec_(std::move(spec)) {}
+
+  Status open(const std::vector<std::string> &names,
+              const std::vector<ColumnType> &types) override;
+  Status push(std::vector<Cells> &rows) override;
+  Status finish() override;
+  std::string name() const override { return "HashJoin"; }
+  std::string detail() const override;
+
+  size_t buildRows() const { return buildCount_; }
+
+private:
+  using Key = RowKey;
+
+  // Build and probe rows of one key hash partition
+  struct Partition {
+    std::unique_ptr<SpillFile> build, probe;
+    size_t depth = 0; // partitioning passes that produced it
+  };
+
+  // Key of `row` at `idx`; false when any key cell is null
+  static bool makeKey(const Cells &row, const std::vector<size_t> &idx,
+                      Key &out);
+  // Hash table over build_
+  void index();
+  // Join probe rows with build_
+  Status probe(std::vector<Cells> &rows);
+  // LEFT join, build side on the left: emit build rows nothing matched
+  Status emitUnmatched();
+  // Replace parts_ with `partitions` new partitions at `depth` and move
+  // build_ into them
+  Status partition(size_t depth);
+  // Partition of a row with key `key` in parts_; false when it has no key
+  // and no partition needs it
+  bool partitionOf(const Cells &row, const std::vector<size_t> &idx,
+                   bool keepKeyless, size_t &out);
+  // Join every partition of parts_
+  Status joinPartitions();
+  // Append the build and probe cells (nullptr: all null) in left/right
+  // order to `out_`
+  void emit(const Cells *build, Cells *probe, bool moveProbe);
+  // Push `out_` downstream
+  Status flush();
+
+  RelationalStorage &storage_;
+  Spec spec_;
+  std::vector<Cells> build_;
+  std::vector<size_t> buildIdx_, probeIdx_;
+  size_t buildWidth_ = 0, probeWidth_ = 0;
+  // Build rows by key: first row, then a chain through `chain_`
+  std::unordered_map<Key, size_t, RowKeyHash> heads_;
+  std::vector<size_t> chain_;
+  std::vector<bool> matched_; // LEFT join with the build side on the left
+  Key probeKey_;
+  std::vector<Cells> out_;
+  // Spilling: estimated size of build_, build rows read, and the current
+  // partitions (empty: joining in memory)
+  size_t bytes_ = 0, buildCount_ = 0;
+  std::vector<Partition> parts_;
+  size_t spilledFiles_ = 0;
+};
+
+// Skips `offset` rows, then passes at most `limit` rows (all when unset)
+class LimitOperator final : public PhysicalOperator {
+public:
+  LimitOperator(std::optional<size_t> limit, size_t offset)
+      : limit_(limit), offset_(offset) {}
+
+  Status open(const std::vector<std::string> &names,
+              const std::vector<ColumnType> &types) override;
+  Status push(std::vector<Cells> &rows) override;
+  bool done() const override;
+  std::string name() const override { return "Limit"; }
+  std::string detail() const override;
+
+private:
+  std::optional<size_t> limit_;
+  size_t offset_;
+  size_t skipped_ = 0;
+  size_t passed_ = 0;
+};
+
+// Terminal operator: appends every row to a ResultSet
+class CollectOperator final : public PhysicalOperator {
+public:
+  Status open(const std::vector<std::string> &names,
+              const std::vector<ColumnType> &types) override;
+  Status push(std::vector<Cells> &rows) override;
+  bool done() const override { return false; }
+  std::string name() const override { return "Collect"; }
+
+  ResultSet take() { return std::move(result_); }
+
+private:
+  ResultSet result_;
+};
+
+// Terminal operator: hands each batch to a sink as it arrives. The sink
+// returning false stops the plan. A plan that emits no rows still delivers
+// one empty batch carrying the column metadata.
+class SinkOperator final : public PhysicalOperator {
+public:
+  explicit SinkOperator(const RelationalStorage::BatchSink &sink)
+      : sink_(sink) {}
+
+  Status open(const std::vector<std::string> &names,
+              const std::vector<ColumnType> &types) override;
+  Status push(std::vector<Cells> &rows) override;
+  Status finish() override;
+  bool done() const override { return stopped_; }
+  std::string name() const override { return "Sink"; }
+
+private:
+  const RelationalStorage::BatchSink &sink_;
+  RowBatch batch_;
+  bool delivered_ = false;
+  bool stopped_ = false;
+};
+
+/**
+ * One stage of a plan as reported by EXPLAIN: the scan (first) or an
+ * operator. The counters are filled in by a profiled execute().
+ */
+struct PlanStage {
+  std::string name;
+  std::string detail;
+  size_t rowsIn = 0; // rows pushed into the stage; 0 for the scan
+  size_t rowsOut = 0;
+  size_t batchesOut = 0;
+  size_t bytesOut = 0; // estimated in-memory size of the rows emitted
+  double ms = 0;       // wall time inside the stage, downstream excluded
+};
+
+/**
+ * A scan of one table (or another Source) followed by a chain of operators.
+ * Operators run in the order they were added; execute() appends the
+ * CollectOperator (or a SinkOperator when streaming).
+ */
+class PhysicalPlan {
+public:
+  // Streams the plan's input into `sink` in batches of at most `batchRows`
+  // rows, like RelationalStorage::scan()
+  using Source = std::function<Status(const RelationalStorage::BatchSink &sink,
+                                      size_t batchRows)>;
+
+  PhysicalPlan(RelationalStorage &storage, std::string table,
+               std::vector<std::string> columns,
+               std::optional<Predicate> where)
+      : storage_(&storage), table_(std::move(table)),
+        columns_(std::move(columns)), where_(std::move(where)) {}
+
+  // Input from another scan, e.g. a time-series range read; `description`
+  // is its EXPLAIN detail
+  explicit PhysicalPlan(Source source, std::string description = {})
+      : source_(std::move(source)), description_(std::move(description)) {}
+
+  template <typename Op, typename... Args> Op &add(Args &&...args) {
+    auto op = std::make_unique<Op>(std::forward<Args>(args)...);
+    Op &ref = *op;
+    ops_.push_back(std::move(op));
+    return ref;
+  }
+
+  // Run the plan once; errors from the scan or any operator are returned.
+  // With `profile` set, every stage is also measured (rows, batches, bytes
+  // and time, from pass-through probes between the stages) into it.
+  Result<ResultSet> execute(std::vector<PlanStage> *profile = nullptr);
+
+  // Run the plan once, streaming its output into `sink` batch by batch
+  // (see SinkOperator) instead of collecting it
+  Status execute(const RelationalStorage::BatchSink &sink);
+
+  // The stages execute() runs: the scan, then the operators (without the
+  // CollectOperator); nothing is read
+  std::vector<PlanStage> describe() const;
+
+  // Maximum rows per scanned batch (default: the storage default)
+  void setBatchRows(size_t rows) { batchRows_ = rows; }
+  // Memory budget of the blocking operators (default: none)
+  void setSpillOptions(SpillOptions options) { spill_ = std::move(options); }
+  // Read the table with RelationalStorage::scanOrdered(): the operators
+  // sort its rows by `order` and keep the first of them
+  void setScanOrder(ScanOrder order) { order_ = std::move(order); }
+
+private:
+  RelationalStorage *storage_ = nullptr; // nullptr: read from source_
+  Source source_;
+  std::string description_;
+  std::string table_;
+  std::vector<std::string> columns_;
+  std::optional<Predicate> where_;
+  std::optional<ScanOrder> order_;
+  size_t batchRows_ = RelationalStorage::kDefaultBatchRows;
+  SpillOptions spill_;
+  std::vector<std::unique_ptr<PhysicalOperator>> ops_;
+
+  // Feed the scan through the operators, the last of which is terminal
+  Status run(std::vector<PlanStage> *profile);
+};
+
+} // namespace kadeql
+} // namespace kadedb
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "kadedb/kadeql_ast.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/result.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace kadedb {
+namespace kadeql {
+
+/**
+ * A parsed KadeQL statement that can be executed many times.
+ *
+ * The query is tokenized and parsed once by prepare(); `?` and `$n`
+ * placeholders become ParameterExpression slots that execute() binds before
+ * running the statement, so repeated executions skip the parser entirely.
+ *
+ * Example:
+ *
+ * ```cpp
+ * auto ps = PreparedStatement::prepare("SELECT * FROM t WHERE id = ?");
+ * std::vector<std::unique_ptr<Value>> params;
+ * params.push_back(ValueFactory::createInteger(7));
+ * auto rs = ps.value()->execute(executor, params);
+ * ```
+ *
+ * execute() is thread-safe: executions of a statement with parameters are
+ * serialized on an internal mutex while its slots are bound.
+ */
+class PreparedStatement {
+public:
+  // Parse `query`; syntax errors are returned as Status::InvalidArgument
+  static Result<std::shared_ptr<PreparedStatement>>
+  prepare(const std::string &query);
+
+  const std::string &text() const { return text_; }
+  const Statement &statement() const { return *stmt_; }
+
+  // Number of values execute() expects: `?` count, or the highest `$n`
+  size_t parameterCount() const { return slots_.size(); }
+
+  // Bind params[i] to parameter i+1 and run the statement. Only Integer,
+  // Float and String values can be bound. Returns InvalidArgument when the
+  // count does not match parameterCount() or a value cannot be bound.
+  Result<ResultSet>
+  execute(QueryExecutor &executor,
+          const std::vector<std::unique_ptr<Value>> &params) const;
+  // Like execute(), handing the rows to `sink` in batches as they are
+  // produced (see QueryExecutor::execute(statement, sink))
+  Status execute(QueryExecutor &executor,
+                 const std::vector<std::unique_ptr<Value>> &params,
+                 const RelationalStorage::BatchSink &sink) const;
+  // Like execute(), one page of a keyset-paginated SELECT (see
+  // QueryExecutor::executePage)
+  Result<QueryExecutor::Page>
+  executePage(QueryExecutor &executor,
+              const std::vector<std::unique_ptr<Value>> &params,
+              size_t pageSize, const std::string &token) const;
+
+private:
+  PreparedStatement(std::string text, std::unique_ptr<Statement> stmt,
+                    std::vector<std::vector<ParameterExpression *>> slots)
+      : text_(std::move(text)), stmt_(std::move(stmt)),
+        slots_(std::move(slots)) {}
+
+  // Bind `params` to the slots and call `run` while they stay bound
+  Status withBound(const std::vector<std::unique_ptr<Value>> &params,
+                   const std::function<Status()> &run) const;
+
+  std::string text_;
+  std::unique_ptr<Statement> stmt_;
+  // Occurrences of each parameter in the AST (`$n` may repeat)
+  std::vector<std::vector<ParameterExpression *>> slots_;
+  mutable std::mutex mtx_;
+};
+
+/**
+ * Canonical cache key for a query: runs of whitespace outside string
+ * literals collapse to one space, and surrounding whitespace and trailing
+ * semicolons are removed. Keywords and identifiers keep their case.
+ */
+std::string normalizeQuery(const std::string &query);
+
+/**
+ * Thread-safe LRU cache of prepared statements keyed by normalizeQuery().
+ * Failed parses are not cached. Statements handed out stay valid after they
+ * are evicted.
+ */
+class StatementCache {
+public:
+  static constexpr size_t kDefaultCapacity = 256;
+
+  explicit StatementCache(size_t capacity = kDefaultCapacity)
+      : capacity_(capacity) {}
+
+  // Cached statement for `query`, parsing and inserting it on a miss
+  Result<std::shared_ptr<PreparedStatement>> prepare(const std::string &query);
+
+  size_t size() const;
+  size_t capacity() const { return capacity_; }
+  uint64_t hits() const;
+  uint64_t misses() const;
+  void clear();
+
+private:
+  using Entry = std::pair<std::string, std::shared_ptr<PreparedStatement>>;
+
+  mutable std::mutex mtx_;
+  size_t capacity_;
+  std::list<Entry> lru_; // most recently used first
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+};
+
+} // namespace kadeql
+} // namespace kadedb
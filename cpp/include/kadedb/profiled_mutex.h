@@ -0,0 +1,136 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace kadedb {
+namespace metrics {
+
+/**
+ * The lock declarations of the storage engines. Built with
+ * KADEDB_LOCK_PROFILING (CMake option of the same name), every lock of a
+ * site adds its acquisitions, contended acquisitions, wait and hold times
+ * to the site's totals in the metrics registry (lockSnapshot()).
+ */
+enum class LockSite : uint8_t {
+  RelationalCatalog,
+  RelationalTableWrite,
+  RelationalTablePublish,
+  RelationalTableStats,
+  DocumentCatalog,
+  DocumentCollection,
+  TimeSeriesCatalog,
+  TimeSeriesSeries,
+  GraphCatalog,
+  GraphData,
+  GraphSnapshot,
+  CompactGraphCatalog,
+  CompactGraphData,
+  Columnar,
+};
+constexpr size_t kLockSiteCount =
+    static_cast<size_t>(LockSite::Columnar) + 1;
+
+// "relational_table_write", ...
+const char *lockSiteName(LockSite site);
+
+#ifdef KADEDB_LOCK_PROFILING
+constexpr bool kLockProfiling = true;
+#else
+constexpr bool kLockProfiling = false;
+#endif
+
+namespace detail {
+// Add one acquisition to the site's totals; `waitNs` is 0 for an
+// uncontended one
+void recordLockAcquired(LockSite site, bool shared, bool contended,
+                        uint64_t waitNs);
+// Add the time an exclusive acquisition was held
+void recordLockHeld(LockSite site, uint64_t heldNs);
+
+inline uint64_t nsSince(std::chrono::steady_clock::time_point t0) {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - t0)
+          .count());
+}
+} // namespace detail
+
+/**
+ * A std::mutex or std::shared_mutex (`Mutex`) that belongs to a LockSite.
+ * Without KADEDB_LOCK_PROFILING it is the bare mutex behind inline
+ * forwarding calls. With it, an exclusive hold costs two clock reads (to
+ * time it), a contended acquisition two more, and every acquisition a few
+ * relaxed atomic adds on counters shared by all threads. Shared holds are counted and waited on but not
+ * timed, since a mutex has no room to keep one start time per reader.
+ */
+template <typename Mutex> class ProfiledMutex {
+public:
+#ifdef KADEDB_LOCK_PROFILING
+  explicit ProfiledMutex(LockSite site) : site_(site) {}
+#else
+  explicit ProfiledMutex(LockSite) {}
+#endif
+  ProfiledMutex(const ProfiledMutex &) = delete;
+  ProfiledMutex &operator=(const ProfiledMutex &) = delete;
+
+#ifndef KADEDB_LOCK_PROFILING
+  void lock() { m_.lock(); }
+  bool try_lock() { return m_.try_lock(); }
+  void unlock() { m_.unlock(); }
+  void lock_shared() { m_.lock_shared(); }
+  bool try_lock_shared() { return m_.try_lock_shared(); }
+  void unlock_shared() { m_.unlock_shared(); }
+#else
+  void lock() {
+    if (m_.try_lock()) {
+      detail::recordLockAcquired(site_, false, false, 0);
+    } else {
+      const auto t0 = std::chrono::steady_clock::now();
+      m_.lock();
+      detail::recordLockAcquired(site_, false, true, detail::nsSince(t0));
+    }
+    heldSince_ = std::chrono::steady_clock::now();
+  }
+  bool try_lock() {
+    if (!m_.try_lock())
+      return false;
+    detail::recordLockAcquired(site_, false, false, 0);
+    heldSince_ = std::chrono::steady_clock::now();
+    return true;
+  }
+  void unlock() {
+    const uint64_t held = detail::nsSince(heldSince_);
+    m_.unlock();
+    detail::recordLockHeld(site_, held);
+  }
+  void lock_shared() {
+    if (m_.try_lock_shared()) {
+      detail::recordLockAcquired(site_, true, false, 0);
+      return;
+    }
+    const auto t0 = std::chrono::steady_clock::now();
+    m_.lock_shared();
+    detail::recordLockAcquired(site_, true, true, detail::nsSince(t0));
+  }
+  bool try_lock_shared() {
+    if (!m_.try_lock_shared())
+      return false;
+    detail::recordLockAcquired(site_, true, false, 0);
+    return true;
+  }
+  void unlock_shared() { m_.unlock_shared(); }
+#endif
+
+private:
+  Mutex m_;
+#ifdef KADEDB_LOCK_PROFILING
+  LockSite site_;
+  // Written by the exclusive holder only
+  std::chrono::steady_clock::time_point heldSince_;
+#endif
+};
+
+} // namespace metrics
+} // namespace kadedb
@@ -1,11 +1,21 @@
 #pragma once
 
+#include "kadedb/admission.h"
+#include "kadedb/cancellation.h"
 #include "kadedb/kadeql_ast.h"
+#include "kadedb/physical_plan.h"
 #include "kadedb/result.h"
+#include "kadedb/result_cache.h"
+#include "kadedb/slow_query_log.h"
 #include "kadedb/storage.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/tracing.h"
 
+#include <chrono>
+#include <memory>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace kadedb {
@@ -15,33 +25,195 @@ class QueryExecutor {
 public:
   explicit QueryExecutor(RelationalStorage &storage) : storage_(storage) {}
 
+  // SELECTs may also read the series of `timeseries` by name (relational
+  // tables take precedence). Timestamp bounds in WHERE select the time
+  // range read, so only the partitions in range are visited.
+  QueryExecutor(RelationalStorage &storage, TimeSeriesStorage &timeseries)
+      : storage_(storage), timeseries_(&timeseries) {}
+
   // Execute any KadeQL statement against the relational storage layer.
+  // EXPLAIN returns one row per plan stage (step, operator, detail) without
+  // running the statement; EXPLAIN ANALYZE runs it and adds each stage's
+  // rows in/out, batches, estimated bytes out and time, then a Total row.
   Result<ResultSet> execute(const Statement &statement);
 
+  // Execute `statement`, handing its rows to `sink` in batches as they are
+  // produced. SELECTs stream from their plan, so the first batch arrives
+  // before the scan ends and the sink returning false stops it; any other
+  // statement delivers its whole result as one batch.
+  Status execute(const Statement &statement,
+                 const RelationalStorage::BatchSink &sink);
+
+  // One page of a keyset-paginated SELECT
+  struct Page {
+    ResultSet rows;
+    // Token of the next page; empty after the last page
+    std::string nextToken;
+  };
+  // Run a single-table SELECT of columns with ORDER BY (and no LIMIT or
+  // OFFSET) a page at a time: its first `pageSize` rows after the last row
+  // of the page that returned `token` (empty: the first page). The token
+  // is an opaque encoding of that row's ORDER BY and primary key values,
+  // which must be NOT NULL. A page seeks an ordered index on the first
+  // ORDER BY column instead of reading the rows before it, and rows written
+  // between pages are neither repeated nor skipped.
+  Result<Page> executePage(const SelectStatement &select, size_t pageSize,
+                           const std::string &token = {});
+
+  // Log that statements slower than its threshold are added to, and that
+  // SELECTs from SlowQueryLog::kTableName read (default:
+  // SlowQueryLog::shared())
+  void setSlowQueryLog(SlowQueryLog &log) { slowLog_ = &log; }
+
+  // Memory budget of each sort, aggregation and join a query runs; past it
+  // they spill to temporary files (see SpillOptions; default: no budget)
+  void setSpillOptions(SpillOptions options) { spill_ = std::move(options); }
+
+  // Cache that SELECTs over tables and series are answered from while
+  // none of them changed since (see ResultCache; default: none)
+  void setResultCache(ResultCache &cache) { resultCache_ = &cache; }
+
+  // Each statement checks `token` before it starts, and SELECTs keep
+  // checking it between batches and every few thousand rows scanned,
+  // ending with StatusCode::Cancelled once it is cancelled. Writes that
+  // started run to completion.
+  void setCancellationToken(CancellationToken token) {
+    token_ = std::move(token);
+  }
+  // Deadline of each statement, from when execute() is called (0: none);
+  // checked like the cancellation token
+  void setTimeout(std::chrono::milliseconds timeout) { timeout_ = timeout; }
+  // Controller that admits each SELECT by the rows its scans are estimated
+  // to read before it runs (default: none)
+  void setAdmissionController(AdmissionController &admission) {
+    admission_ = &admission;
+  }
+
 private:
   RelationalStorage &storage_;
+  TimeSeriesStorage *timeseries_ = nullptr;
+  SpillOptions spill_;
+  ResultCache *resultCache_ = nullptr;
+  std::optional<CancellationToken> token_;
+  std::chrono::milliseconds timeout_{0};
+  AdmissionController *admission_ = nullptr;
+  // Deadline of the statement being run by the outermost execute()
+  std::optional<std::chrono::steady_clock::time_point> deadline_;
+
+  // Statement being run by the outermost execute(): whether it may be
+  // logged as slow, when it started, the plan it ran (kept only while
+  // logging) and the rows it streamed
+  SlowQueryLog *slowLog_ = &SlowQueryLog::shared();
+  bool inStatement_ = false;
+  bool slowLogging_ = false;
+  std::chrono::steady_clock::time_point statementStart_;
+  std::string statementPlan_;
+  size_t streamedRows_ = 0;
+  // "kadeql.plan" span of the SELECT being run, ended when its plan starts
+  std::optional<tracing::Span> *planSpan_ = nullptr;
+
+  // FROM source of a single-table SELECT after WHERE pushdown
+  struct ScanSpec;
+
+  // Statement being explained, and the stages it recorded
+  enum class ExplainMode { None, Plan, Analyze };
+  ExplainMode explain_ = ExplainMode::None;
+  std::vector<PlanStage> stages_;
+
+  // Sink of a streaming execute(), and whether a plan has written to it
+  const RelationalStorage::BatchSink *sink_ = nullptr;
+  bool streamed_ = false;
+
+  // Page requested by executePage() of the SELECT being run
+  struct PageState;
+  PageState *page_ = nullptr;
 
   // Helpers
   Result<ResultSet> executeSelect(const SelectStatement &select);
+  // executeSelect() once admission_ admits it
+  Result<ResultSet> executeAdmittedSelect(const SelectStatement &select);
+  // Rows the scans of `select` are estimated to read (see
+  // RelationalStorage::estimateScanCost); std::nullopt when unknown
+  std::optional<double> estimateSelectCost(const SelectStatement &select);
+  // Cancelled once token_ is cancelled or deadline_ has passed
+  Status interruptStatus() const;
+  // executeAdmittedSelect() through resultCache_, when every source of
+  // `select` has a data version
+  Result<ResultSet> executeCachedSelect(const SelectStatement &select);
+  // Current data version of `source`; std::nullopt once it no longer
+  // resolves to the same table or series
+  std::optional<uint64_t> sourceVersion(const ResultSource &source) const;
   Result<ResultSet> executeSelectWithExpressions(const SelectStatement &select);
+  Result<ResultSet> executeJoinSelect(const SelectStatement &select);
+  // Project or aggregate the select items, then ORDER BY / LIMIT; window
+  // functions need the `series` the rows come from
+  Status addExpressionOperators(PhysicalPlan &plan,
+                                const SelectStatement &select,
+                                const TimeSeriesSchema *series = nullptr);
   Result<ResultSet> executeInsert(const InsertStatement &insert);
+  Result<ResultSet> executeUpsert(const std::string &table,
+                                  const InsertStatement::OnConflict &onConflict,
+                                  const std::vector<Row> &rows);
   Result<ResultSet> executeUpdate(const UpdateStatement &update);
   Result<ResultSet> executeDelete(const DeleteStatement &del);
+  Result<ResultSet> executeExplain(const ExplainStatement &explain);
+  // Run `plan`; under EXPLAIN only its stages are recorded (ANALYZE: run
+  // and profiled). When streaming, the rows go to sink_ and an empty
+  // ResultSet is returned.
+  Result<ResultSet> runPlan(PhysicalPlan &plan);
+  // Under EXPLAIN, record the single stage of an INSERT, UPDATE or DELETE;
+  // true when the statement must not run (EXPLAIN without ANALYZE)
+  bool explainWrite(std::string name, std::string detail);
+  // Add the statement that just ran to slowLog_
+  void logSlowQuery(const Statement &statement, const Result<ResultSet> &res,
+                    uint64_t durationUs, uint64_t rowsScanned,
+                    uint64_t allocations, uint64_t bytesAllocated);
 
   // Build a storage Predicate (optional) from an expression tree.
   // Returns std::nullopt if expr is null. Returns InvalidArgument if
   // unsupported.
   Result<std::optional<Predicate>> buildPredicate(const Expression *expr) const;
 
+  // Split a WHERE clause at its top-level ANDs: the conjuncts buildPredicate
+  // translates are returned as one simplified Predicate (for pushdown into
+  // storage); the others are appended to `residual`, for evaluation in the
+  // executor.
+  Result<std::optional<Predicate>>
+  splitWhere(const Expression *where,
+             std::vector<const Expression *> &residual) const;
+
+  // Resolve the FROM table (or series) of a single-table SELECT and split
+  // and validate its WHERE clause
+  Result<ScanSpec> planScan(const SelectStatement &select);
+  // Scan of `spec` reading `columns` (empty: all); residual conjuncts are
+  // not applied (see addResidualFilters)
+  std::unique_ptr<PhysicalPlan> makeScan(ScanSpec &spec,
+                                         std::vector<std::string> columns);
+  // Scan of the slow query log (SlowQueryLog::kTableName)
+  std::unique_ptr<PhysicalPlan>
+  makeSlowQueryScan(ScanSpec &spec, std::vector<std::string> columns);
+  // TIME_BUCKET aggregate over `spec`'s series answered by the series
+  // itself: precomputed from its continuous aggregates when they answer it
+  // exactly, else from TimeSeriesStorage::bucketStats(); nullptr when
+  // neither applies (the query then aggregates the rows)
+  std::unique_ptr<PhysicalPlan> makeBucketScan(const ScanSpec &spec,
+                                               const SelectStatement &select);
+  // Per-row filters for WHERE conjuncts that were not pushed down
+  void addResidualFilters(PhysicalPlan &plan,
+                          const std::vector<const Expression *> &residual);
+  // Cost-based choices from the table's statistics (no-ops without them):
+  // reorder AND/OR children so that cheap, decisive tests run first
+  void orderConjuncts(const std::string &table,
+                      std::optional<Predicate> &where) const;
+  // Estimated rows a scan of `table` filtered by `where` returns
+  std::optional<double>
+  estimateScanRows(const std::string &table,
+                   const std::optional<Predicate> &where) const;
+
   // Literal to Value factory
   std::unique_ptr<Value>
   literalToValue(const LiteralExpression::Value &v) const;
 
-  // Evaluate an expression against a row (for computed UPDATE assignments)
-  Result<std::unique_ptr<Value>> evalExpr(const Expression *expr,
-                                          const TableSchema &schema,
-                                          const Row &row) const;
-
   // Validate that all columns referenced in the predicate exist in the table
   // schema. Returns Status::InvalidArgument on unknown columns.
   Status validatePredicateColumns(const std::string &table,
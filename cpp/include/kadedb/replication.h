@@ -0,0 +1,151 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "kadedb/compression.h" // Codec
+#include "kadedb/status.h"      // Status, Result<T>
+#include "kadedb/wal.h"         // WalReader, WalTargets, WriteAheadLog
+
+namespace kadedb {
+
+/**
+ * @defgroup ReplicationAPI Replication
+ * @brief Log shipping from a leader's write-ahead log to read replicas.
+ *
+ * A leader cuts its log into WalSegments with a WalShipper per follower;
+ * the transport (e.g. the gRPC ReplicationService) carries them as opaque
+ * bytes, and each follower applies them in order to its own in-memory
+ * storages with a Replica, which serves reads within a staleness bound.
+ */
+
+/**
+ * The log records [firstLsn, lastLsn] as one binary blob: a log file image
+ * (walFileHeader() then a frame per record). A segment without records
+ * (firstLsn == lastLsn + 1) is a heartbeat.
+ *  - tail: the leader had no later record when it cut the segment, so a
+ *    replica that applied it was up to date at that moment
+ */
+struct WalSegment {
+  uint64_t firstLsn = 1;
+  uint64_t lastLsn = 0;
+  bool tail = false;
+  std::string data;
+
+  uint64_t records() const { return lastLsn + 1 - firstLsn; }
+};
+
+/**
+ * Segment settings.
+ *  - maxSegmentBytes: a segment ends after the frame that reaches this size
+ *  - compression: codec for the segment's frames (see WalOptions)
+ *  - log: when set, the log being shipped; only its durable records ship,
+ *    so a follower never gets ahead of what the leader recovers after a
+ *    crash
+ */
+struct ShipOptions {
+  size_t maxSegmentBytes = size_t{1} << 20;
+  Codec compression = Codec::None;
+  const WriteAheadLog *log = nullptr;
+};
+
+/**
+ * Leader side of one replication stream: follows the log file at a path
+ * and cuts the records a follower has not applied yet into segments.
+ */
+/** @ingroup ReplicationAPI */
+class WalShipper {
+public:
+  /**
+   * Ship the log at `path` from the record after `afterLsn`, the follower's
+   * Replica::appliedLsn().
+   * @return Status::Internal on I/O errors
+   */
+  static Result<std::unique_ptr<WalShipper>>
+  open(const std::string &path, uint64_t afterLsn = 0,
+       ShipOptions options = {});
+
+  /**
+   * The records written since the previous segment, or a heartbeat when
+   * there are none yet; callers poll it or wait between heartbeats.
+   * @return Status::InvalidArgument if the file is not a KadeDB log;
+   *         Status::Internal on I/O errors
+   */
+  Result<WalSegment> next();
+
+  // Sequence number of the last record shipped
+  uint64_t lsn() const { return reader_->lsn(); }
+
+private:
+  WalShipper(std::unique_ptr<WalReader> reader, ShipOptions options)
+      : reader_(std::move(reader)), options_(options) {}
+
+  std::unique_ptr<WalReader> reader_;
+  const ShipOptions options_;
+};
+
+/**
+ * Follower side: applies a leader's segments, in log order, to storages
+ * that do not log (not the Logged* wrappers) and that only the replica
+ * writes. Reads go to the storages directly, after checkStaleness().
+ *
+ * Segments are applied per target in parallel like replayWal(), so while
+ * one is applied a reader may see one table further along than another.
+ * A failed apply leaves the storages part way through a segment; the
+ * replica then refuses further segments and reads and must be rebuilt.
+ */
+/** @ingroup ReplicationAPI */
+class Replica {
+public:
+  /**
+   * @param targets the follower's storages
+   * @param appliedLsn last record the storages already hold, e.g. a
+   *        CheckpointStorage's walLsn()
+   * @param threads workers per segment (0: one per hardware thread)
+   */
+  explicit Replica(const WalTargets &targets, uint64_t appliedLsn = 0,
+                   size_t threads = 0)
+      : targets_(targets), threads_(threads), appliedLsn_(appliedLsn) {}
+
+  /**
+   * Apply `segment`, which must start right after appliedLsn().
+   * @return Status::InvalidArgument for a segment out of order or that does
+   *         not decode; the failing record's error, after which the replica
+   *         is broken (Status::FailedPrecondition from then on)
+   */
+  Status apply(const WalSegment &segment);
+
+  uint64_t appliedLsn() const;
+
+  /**
+   * How far reads may lag the leader: the time since the replica last
+   * applied a tail segment, i.e. last held every record its leader had.
+   * Measured from when the segment was applied, so it leaves out the
+   * segment's time in transit. Empty before the first tail segment.
+   */
+  std::optional<std::chrono::milliseconds> staleness() const;
+
+  /**
+   * OK when reads may be served within `bound` of the leader.
+   * @return Status::FailedPrecondition when the replica is further behind,
+   *         has not caught up yet, or is broken
+   */
+  Status checkStaleness(std::chrono::milliseconds bound) const;
+
+private:
+  const WalTargets targets_;
+  const size_t threads_;
+
+  std::mutex applyMtx_; // one apply() at a time
+  mutable std::mutex mtx_;
+  uint64_t appliedLsn_;
+  std::optional<std::chrono::steady_clock::time_point> freshAt_;
+  Status broken_;
+};
+
+} // namespace kadedb
@@ -3,7 +3,7 @@
 #include <algorithm>
 #include <cstddef>
 #include <memory>
-#include <sstream>
+#include <functional>
 #include <stdexcept>
 #include <string>
 #include <utility>
@@ -14,11 +14,22 @@
 
 namespace kadedb {
 
+// Receives exported text a chunk at a time; `data` is valid only for the call
+using OutputSink = std::function<void(const char *data, size_t size)>;
+// Bytes the streaming writers buffer before each call to the sink
+constexpr size_t kOutputChunkBytes = 64 * 1024;
+
 class ResultRow {
 public:
   ResultRow() = default;
   explicit ResultRow(std::vector<std::unique_ptr<Value>> values)
       : values_(std::move(values)) {}
+  // Build from compact cells (empty InlineValue -> nullptr cell)
+  explicit ResultRow(const std::vector<InlineValue> &values) {
+    values_.reserve(values.size());
+    for (const auto &v : values)
+      values_.push_back(v.toValue());
+  }
 
   size_t size() const { return values_.size(); }
   const Value &at(size_t idx) const { return *values_.at(idx); }
@@ -56,6 +67,11 @@ public:
   void addRow(ResultRow row) { rows_.push_back(std::move(row)); }
   size_t rowCount() const { return rows_.size(); }
   const ResultRow &row(size_t idx) const { return rows_.at(idx); }
+  // Move-out accessor: the rows, leaving the set without any
+  std::vector<ResultRow> takeRows() {
+    cursor_ = static_cast<size_t>(-1);
+    return std::move(rows_);
+  }
 
   // Lookup column index by name; returns npos if not found
   size_t findColumn(const std::string &name) const {
@@ -124,233 +140,19 @@ public:
   // delimiters. alwaysQuote: if true, every field is quoted. quoteChar: quoting
   // character.
   std::string toCSV(char delimiter = ',', bool includeHeader = true,
-                    bool alwaysQuote = false, char quoteChar = '"') const {
-    auto csvEscape = [delimiter, alwaysQuote, quoteChar](const std::string &s) {
-      bool needQuotes = alwaysQuote || s.find(delimiter) != std::string::npos ||
-                        s.find(quoteChar) != std::string::npos ||
-                        s.find('\n') != std::string::npos ||
-                        s.find('\r') != std::string::npos;
-      if (!needQuotes)
-        return s;
-      std::string t;
-      t.reserve(s.size() + 2);
-      t.push_back(quoteChar);
-      for (char ch : s) {
-        if (ch == quoteChar)
-          t.push_back(quoteChar);
-        t.push_back(ch);
-      }
-      t.push_back(quoteChar);
-      return t;
-    };
-
-    std::ostringstream oss;
-    if (includeHeader && !columnNames_.empty()) {
-      for (size_t i = 0; i < columnNames_.size(); ++i) {
-        if (i)
-          oss << delimiter;
-        oss << csvEscape(columnNames_[i]);
-      }
-      oss << '\n';
-    }
-    for (const auto &r : rows_) {
-      for (size_t i = 0; i < r.size(); ++i) {
-        if (i)
-          oss << delimiter;
-        // Use raw string content for String values to avoid double-quoting
-        if (columnTypes_.at(i) == ColumnType::String) {
-          const auto &s = static_cast<const StringValue &>(r.at(i)).value();
-          oss << csvEscape(s);
-        } else {
-          oss << csvEscape(r.toString(i));
-        }
-      }
-      oss << '\n';
-    }
-    return oss.str();
-  }
+                    bool alwaysQuote = false, char quoteChar = '"') const;
 
   // Convert to a JSON string: [{col: value, ...}, ...]; values typed based on
   // ValueType indent: spaces per level; 0 means compact one-line JSON
-  std::string toJSON(bool includeMetadata = false, int indent = 0) const {
-    auto jsonEscape = [](const std::string &s) {
-      std::string out;
-      out.reserve(s.size() + 2);
-      for (char ch : s) {
-        switch (ch) {
-        case '"':
-          out += "\\\"";
-          break;
-        case '\\':
-          out += "\\\\";
-          break;
-        case '\b':
-          out += "\\b";
-          break;
-        case '\f':
-          out += "\\f";
-          break;
-        case '\n':
-          out += "\\n";
-          break;
-        case '\r':
-          out += "\\r";
-          break;
-        case '\t':
-          out += "\\t";
-          break;
-        default:
-          if (static_cast<unsigned char>(ch) < 0x20) {
-            // Control character -> \u00XX
-            const char *hex = "0123456789abcdef";
-            out += "\\u00";
-            out.push_back(hex[(ch >> 4) & 0xF]);
-            out.push_back(hex[ch & 0xF]);
-          } else {
-            out.push_back(ch);
-          }
-        }
-      }
-      return out;
-    };
-
-    auto emitValue = [&](const Value &v) {
-      switch (v.type()) {
-      case ValueType::Null:
-        return std::string("null");
-      case ValueType::Boolean:
-        return std::string(
-            static_cast<const BooleanValue &>(v).value() ? "true" : "false");
-      case ValueType::Integer:
-        return std::to_string(static_cast<const IntegerValue &>(v).value());
-      case ValueType::Float:
-        return static_cast<const FloatValue &>(v).toString();
-      case ValueType::String:
-        return std::string("\"") +
-               jsonEscape(static_cast<const StringValue &>(v).value()) + "\"";
-      }
-      return std::string("null");
-    };
+  std::string toJSON(bool includeMetadata = false, int indent = 0) const;
 
-    std::ostringstream oss;
-    auto indentNL = [&](int level) {
-      if (indent > 0) {
-        oss << '\n';
-        for (int i = 0; i < level * indent; ++i)
-          oss << ' ';
-      }
-    };
-
-    if (!includeMetadata) {
-      oss << '[';
-      if (indent > 0 && !rows_.empty())
-        indentNL(1);
-      for (size_t r = 0; r < rows_.size(); ++r) {
-        if (r) {
-          oss << ',';
-          indentNL(1);
-        }
-        oss << '{';
-        if (indent > 0 && !columnNames_.empty())
-          indentNL(2);
-        for (size_t c = 0; c < columnNames_.size(); ++c) {
-          if (c) {
-            oss << ',';
-            indentNL(2);
-          }
-          oss << '"' << jsonEscape(columnNames_[c]) << '"' << ':';
-          if (indent > 0)
-            oss << ' ';
-          oss << emitValue(rows_[r].at(c));
-        }
-        if (indent > 0 && !columnNames_.empty()) {
-          indentNL(1);
-        }
-        oss << '}';
-      }
-      if (indent > 0 && !rows_.empty()) {
-        indentNL(0);
-      }
-      oss << ']';
-      return oss.str();
-    }
-    // With metadata wrapper
-    oss << '{';
-    if (indent > 0)
-      indentNL(1);
-    // columns metadata
-    oss << "\"columns\":[";
-    for (size_t i = 0; i < columnNames_.size(); ++i) {
-      if (i)
-        oss << ',' << (indent > 0 ? ' ' : '\0');
-      oss << '"' << jsonEscape(columnNames_[i]) << '"';
-    }
-    oss << "],";
-    if (indent > 0)
-      indentNL(1), oss << "\"types\":[";
-    else
-      oss << "\"types\":[";
-    for (size_t i = 0; i < columnTypes_.size(); ++i) {
-      if (i)
-        oss << ',' << (indent > 0 ? ' ' : '\0');
-      switch (columnTypes_[i]) {
-      case ColumnType::Null:
-        oss << "\"Null\"";
-        break;
-      case ColumnType::Integer:
-        oss << "\"Integer\"";
-        break;
-      case ColumnType::Float:
-        oss << "\"Float\"";
-        break;
-      case ColumnType::String:
-        oss << "\"String\"";
-        break;
-      case ColumnType::Boolean:
-        oss << "\"Boolean\"";
-        break;
-      }
-    }
-    oss << "],";
-    if (indent > 0)
-      indentNL(1), oss << "\"rows\":";
-    else
-      oss << "\"rows\":";
-    // reuse array form
-    oss << '[';
-    if (indent > 0 && !rows_.empty())
-      indentNL(2);
-    for (size_t r = 0; r < rows_.size(); ++r) {
-      if (r) {
-        oss << ',';
-        indentNL(2);
-      }
-      oss << '{';
-      if (indent > 0 && !columnNames_.empty())
-        indentNL(3);
-      for (size_t c = 0; c < columnNames_.size(); ++c) {
-        if (c) {
-          oss << ',';
-          indentNL(3);
-        }
-        oss << '"' << jsonEscape(columnNames_[c]) << '"' << ':';
-        if (indent > 0)
-          oss << ' ';
-        oss << emitValue(rows_[r].at(c));
-      }
-      if (indent > 0 && !columnNames_.empty()) {
-        indentNL(2);
-      }
-      oss << '}';
-    }
-    if (indent > 0 && !rows_.empty())
-      indentNL(1);
-    oss << ']';
-    if (indent > 0)
-      indentNL(0);
-    oss << '}';
-    return oss.str();
-  }
+  // Streaming forms of toCSV()/toJSON(): the same text, handed to `sink` in
+  // chunks of about kOutputChunkBytes instead of built as one string
+  void writeCSV(const OutputSink &sink, char delimiter = ',',
+                bool includeHeader = true, bool alwaysQuote = false,
+                char quoteChar = '"') const;
+  void writeJSON(const OutputSink &sink, bool includeMetadata = false,
+                 int indent = 0) const;
 
   // -------- Pagination --------
   void setPageSize(size_t ps) { pageSize_ = (ps == 0 ? 0 : ps); }
@@ -391,4 +193,22 @@ private:
   size_t pageSize_ = 0; // 0 means no pagination (all rows in a single page)
 };
 
+/**
+ * Stream rows that are not held in a ResultSet, e.g. ones converted one at a
+ * time from another representation. `rowAt(i)` returns row i for i in
+ * [0, rowCount), and the reference need only stay valid until the next call.
+ * Output and options are those of ResultSet::writeCSV()/writeJSON(); null
+ * cells are written as empty fields in CSV and as null in JSON.
+ */
+using RowSource = std::function<const ResultRow &(size_t)>;
+void writeCSV(const std::vector<std::string> &columnNames,
+              const std::vector<ColumnType> &columnTypes, size_t rowCount,
+              const RowSource &rowAt, const OutputSink &sink,
+              char delimiter = ',', bool includeHeader = true,
+              bool alwaysQuote = false, char quoteChar = '"');
+void writeJSON(const std::vector<std::string> &columnNames,
+               const std::vector<ColumnType> &columnTypes, size_t rowCount,
+               const RowSource &rowAt, const OutputSink &sink,
+               bool includeMetadata = false, int indent = 0);
+
 } // namespace kadedb
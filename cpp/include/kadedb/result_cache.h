@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "kadedb/result.h" // ResultSet
+#include "kadedb/schema.h" // ColumnType
+#include "kadedb/value.h"  // InlineValue
+
+namespace kadedb {
+namespace kadeql {
+
+/**
+ * Table or series a cached result was read from, and its data version
+ * (RelationalStorage::tableVersion(), TimeSeriesStorage::seriesVersion())
+ * when the read began.
+ */
+struct ResultSource {
+  enum class Kind { Table, Series };
+  Kind kind = Kind::Table;
+  std::string name;
+  uint64_t version = 0;
+};
+
+/**
+ * Thread-safe LRU cache of SELECT results, bounded by the bytes of the rows
+ * it holds (memory::valueBytes() per cell).
+ *
+ * A result is cached under a key naming the statement and its parameter
+ * values, with the sources it read. A lookup hands out a copy only while
+ * every source still has the version the result was computed at; any write
+ * to a source restamps it, so the next lookup drops the stale entry rather
+ * than serving it. Entries of unrelated tables are never touched.
+ *
+ * Attach one to a QueryExecutor with QueryExecutor::setResultCache(); it
+ * may be shared by executors over the same storages.
+ */
+class ResultCache {
+public:
+  static constexpr size_t kDefaultCapacityBytes = size_t{64} << 20;
+
+  // Current data version of a source; std::nullopt when it is gone
+  using VersionOf =
+      std::function<std::optional<uint64_t>(const ResultSource &)>;
+
+  explicit ResultCache(size_t capacityBytes = kDefaultCapacityBytes)
+      : capacity_(capacityBytes) {}
+
+  // Copy of the result cached under `key`, if its sources are unchanged
+  // according to `versionOf`; a stale entry is dropped
+  std::optional<ResultSet> lookup(const std::string &key,
+                                  const VersionOf &versionOf);
+
+  // Cache `rs` under `key`, replacing any entry there and evicting the
+  // least recently used ones to make room; a result larger than the whole
+  // capacity is not cached
+  void insert(const std::string &key, std::vector<ResultSource> sources,
+              const ResultSet &rs);
+
+  size_t size() const;
+  size_t bytes() const;
+  size_t capacity() const { return capacity_; }
+  uint64_t hits() const;
+  uint64_t misses() const;
+  // Entries dropped because a source changed, and to make room
+  uint64_t invalidations() const;
+  uint64_t evictions() const;
+  void clear();
+
+private:
+  // Immutable once cached, so hits copy it out without holding mtx_
+  struct Rows {
+    std::vector<std::string> columnNames;
+    std::vector<ColumnType> columnTypes;
+    std::vector<std::vector<InlineValue>> rows;
+  };
+  struct Entry {
+    std::string key;
+    std::vector<ResultSource> sources;
+    std::shared_ptr<const Rows> result;
+    size_t bytes = 0;
+  };
+  using Iter = std::list<Entry>::iterator;
+
+  // Callers hold mtx_
+  void erase(Iter it);
+
+  mutable std::mutex mtx_;
+  size_t capacity_;
+  size_t bytes_ = 0;
+  std::list<Entry> lru_; // most recently used first
+  std::unordered_map<std::string, Iter> index_;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t invalidations_ = 0;
+  uint64_t evictions_ = 0;
+};
+
+} // namespace kadeql
+} // namespace kadedb
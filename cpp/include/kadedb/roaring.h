@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace kadedb {
+
+/**
+ * Compressed set of 32-bit integers in the style of a Roaring bitmap.
+ *
+ * Values are split on their high 16 bits into containers. A container
+ * holding at most kArrayMax values is a sorted array of the low 16 bits;
+ * a denser one is a 65536-bit bitmap. Containers switch representation as
+ * they grow and shrink, so sparse and dense sets both stay compact and the
+ * set operations below work container by container.
+ */
+class RoaringBitmap {
+public:
+  // Largest array container; past it a bitmap takes less space
+  static constexpr size_t kArrayMax = 4096;
+
+  RoaringBitmap() = default;
+  // The values [lo, hi)
+  static RoaringBitmap range(uint32_t lo, uint32_t hi);
+
+  void add(uint32_t v);
+  // False when `v` was not in the set
+  bool remove(uint32_t v);
+  bool contains(uint32_t v) const;
+  void clear() { containers_.clear(); }
+
+  bool empty() const { return containers_.empty(); }
+  size_t cardinality() const;
+  // Approximate heap footprint
+  size_t memoryBytes() const;
+
+  RoaringBitmap &operator&=(const RoaringBitmap &other);
+  RoaringBitmap &operator|=(const RoaringBitmap &other);
+  // Set difference: drop the values of `other`
+  RoaringBitmap &operator-=(const RoaringBitmap &other);
+
+  // Call fn(value) for each value in ascending order
+  template <typename Fn> void forEach(Fn &&fn) const {
+    for (const auto &c : containers_) {
+      const uint32_t high = uint32_t{c.key} << 16;
+      if (c.bits.empty()) {
+        for (uint16_t low : c.array)
+          fn(high | low);
+        continue;
+      }
+      for (size_t w = 0; w < c.bits.size(); ++w)
+        for (uint64_t word = c.bits[w]; word; word &= word - 1)
+          fn(high | static_cast<uint32_t>(w * 64 + lowestBit(word)));
+    }
+  }
+
+  std::vector<uint32_t> toVector() const;
+
+private:
+  static constexpr size_t kWords = 65536 / 64;
+
+  // Values sharing the high 16 bits `key`: `array` (sorted low bits) while
+  // `bits` is empty, else `bits` with `count` bits set
+  struct Container {
+    uint16_t key = 0;
+    uint32_t count = 0;
+    std::vector<uint16_t> array;
+    std::vector<uint64_t> bits;
+
+    size_t size() const { return bits.empty() ? array.size() : count; }
+    bool contains(uint16_t low) const;
+    // Switch to the representation suited to the current size
+    void normalize();
+  };
+
+  static std::vector<uint64_t> toBits(const Container &c);
+  // Index of the lowest set bit of a non-zero word
+  static unsigned lowestBit(uint64_t word) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx;
+    _BitScanForward64(&idx, word);
+    return static_cast<unsigned>(idx);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(word));
+#endif
+  }
+
+  Container *find(uint16_t key);
+  const Container *find(uint16_t key) const;
+
+  std::vector<Container> containers_; // ascending keys, none empty
+};
+
+} // namespace kadedb
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "kadedb/kv_store.h"
+#include "kadedb/result.h"
+#include "kadedb/schema.h"
+#include "kadedb/status.h"
+#include "kadedb/storage.h"
+
+namespace kadedb {
+
+/**
+ * Persistent RelationalStorage over a KeyValueStore, normally RocksDB (see
+ * openRocksDbStore()).
+ *
+ * Layout, one column family per table for each kind of key:
+ *  - "t:<table>": the rows, encoded with bin::writeRow(). The key is the
+ *    primary key cell (keycode) followed by an 8-byte big-endian row id, so
+ *    rows iterate in primary key order and duplicate keys stay apart;
+ *    without a primary key it is the row id alone.
+ *  - "u:<table>": column number and value of every unique cell, mapped to
+ *    the row key holding it
+ *  - "x:<table>": column number, value and row key of every non-null cell
+ *    of an indexed column, mapped to the row key
+ *  - "__catalog": schemas, row counts and index definitions, read back
+ *    when the storage is opened over the same store
+ * Each write commits its rows and keys in one atomic WriteBatch.
+ *
+ * Scans are iterator-based: comparisons against the primary key (or, when
+ * it has none, an indexed column) in `where` become a key range to seek,
+ * so only the rows in it are read; every row read is then matched against
+ * the whole predicate. Otherwise the rows family is scanned in full.
+ * scan() decodes one batch at a time.
+ *
+ * Semantics follow InMemoryRelationalStorage (same Status codes and
+ * uniqueness rules). createIndex() accepts every IndexType; the index is
+ * always an ordered key range.
+ */
+/** @ingroup StorageAPI */
+class RocksDbRelationalStorage final : public RelationalStorage {
+public:
+  /**
+   * Open the tables kept in `store`, creating the catalog family on first
+   * use.
+   * @return Status::Internal when the catalog cannot be read
+   */
+  static Result<std::unique_ptr<RocksDbRelationalStorage>>
+  open(std::shared_ptr<KeyValueStore> store);
+
+  Status createTable(const std::string &table,
+                     const TableSchema &schema) override;
+  Status insertRow(const std::string &table, const Row &row) override;
+  // Atomic: on error no row of the batch is inserted
+  Status insertRows(const std::string &table,
+                    const std::vector<Row> &rows) override;
+  Result<ResultSet> select(const std::string &table,
+                           const std::vector<std::string> &columns,
+                           const std::optional<Predicate> &where) override;
+  Status scan(const std::string &table,
+              const std::vector<std::string> &columns,
+              const std::optional<Predicate> &where, const BatchSink &sink,
+              size_t batchRows = kDefaultBatchRows) override;
+  std::vector<std::string> listTables() const override;
+  Result<TableSchema> getTableSchema(const std::string &table) override;
+  std::optional<size_t>
+  estimateRowCount(const std::string &table) const override;
+  // "primary key range on id", "index range on hr" or "full scan"
+  std::string
+  explainAccess(const std::string &table,
+                const std::optional<Predicate> &where) const override;
+  Status dropTable(const std::string &table) override;
+  Result<size_t> deleteRows(const std::string &table,
+                            const std::optional<Predicate> &where) override;
+  Result<size_t> updateRows(
+      const std::string &table,
+      const std::unordered_map<std::string, AssignmentValue> &assignments,
+      const std::optional<Predicate> &where) override;
+  Result<size_t> updateRowsWith(const std::string &table,
+                                const RowUpdater &updater,
+                                const std::optional<Predicate> &where) override;
+  Status
+  updateRows(const std::string &table,
+             const std::unordered_map<std::string, std::unique_ptr<Value>>
+                 &assignments,
+             const std::optional<Predicate> &where) override;
+  Status truncateTable(const std::string &table) override;
+  Status createIndex(const std::string &table, const std::string &column,
+                     IndexType type) override;
+
+private:
+  struct TableInfo {
+    TableSchema schema;
+    CompiledValidator validator; // of `schema`
+    size_t pk = TableSchema::npos;
+    std::set<size_t> indexed; // columns with an "x:" index
+    uint64_t rows = 0;
+    uint64_t nextRowId = 0;
+  };
+  // Row keys [lo, hi) a predicate confines its matches to, in the rows
+  // family (primary key) or the index family (indexed column)
+  struct KeyRange {
+    bool primary = false;
+    size_t column = TableSchema::npos;
+    std::string lo;
+    std::string hi; // empty: unbounded
+  };
+  // Receives each matching row, which it may move cells out of
+  using RowVisitor = std::function<bool(const std::string &rowKey, Row &row)>;
+
+  explicit RocksDbRelationalStorage(std::shared_ptr<KeyValueStore> store)
+      : store_(std::move(store)) {}
+
+  Status load();
+  Status insert(const std::string &table,
+                const std::vector<const Row *> &rows);
+  Result<size_t> applyUpdates(const std::string &table, TableInfo &ti,
+                              const std::optional<Predicate> &where,
+                              const RowUpdater &updater);
+  static std::optional<KeyRange> accessRange(const TableInfo &ti,
+                                             const Predicate &where);
+  // Visit the rows of `table` matching `where`, in key order, until `fn`
+  // returns false
+  Status visitRows(const std::string &table, const TableInfo &ti,
+                   const std::optional<Predicate> &where,
+                   const RowVisitor &fn) const;
+  Result<std::vector<std::pair<std::string, Row>>>
+  collectRows(const std::string &table, const TableInfo &ti,
+              const std::optional<Predicate> &where) const;
+  std::string rowKey(const TableInfo &ti, const Row &row,
+                     uint64_t rowId) const;
+  void addEntries(WriteBatch &batch, const std::string &table,
+                  const TableInfo &ti, const std::string &key,
+                  const Row &row) const;
+  void removeEntries(WriteBatch &batch, const std::string &table,
+                     const TableInfo &ti, const std::string &key,
+                     const Row &row) const;
+  void putCounters(WriteBatch &batch, const std::string &table,
+                   uint64_t rows, uint64_t nextRowId) const;
+  Status clearFamilies(const std::string &table) const;
+
+  std::shared_ptr<KeyValueStore> store_;
+  std::map<std::string, TableInfo> tables_;
+  // Writers hold it exclusively, so iterators never see half a write
+  mutable std::shared_mutex mtx_;
+};
+
+/**
+ * Persistent DocumentStorage over a KeyValueStore, laid out like
+ * RocksDbRelationalStorage: per collection a "d:<collection>" family of
+ * documents (bin::writeDocument()) by key, "du:<collection>" for unique
+ * field values and "dx:<collection>" for indexed fields (field name, value
+ * and document key), plus catalog entries in "__catalog". Both storages
+ * may share one store.
+ *
+ * Queries whose predicate compares an indexed field (alone or under AND)
+ * seek that index's key range and read only those documents; other
+ * queries iterate the collection. Every document read is matched against
+ * the whole predicate. Semantics follow InMemoryDocumentStorage.
+ */
+/** @ingroup DocumentAPI */
+class RocksDbDocumentStorage final : public DocumentStorage {
+public:
+  /**
+   * Open the collections kept in `store`.
+   * @return Status::Internal when the catalog cannot be read
+   */
+  static Result<std::unique_ptr<RocksDbDocumentStorage>>
+  open(std::shared_ptr<KeyValueStore> store);
+
+  Status createCollection(
+      const std::string &collection,
+      const std::optional<DocumentSchema> &schema = std::nullopt) override;
+  Status dropCollection(const std::string &collection) override;
+  std::vector<std::string> listCollections() const override;
+  Status put(const std::string &collection, const std::string &key,
+             const Document &doc) override;
+  Result<Document> get(const std::string &collection,
+                       const std::string &key) override;
+  Status erase(const std::string &collection,
+               const std::string &key) override;
+  Result<size_t> count(const std::string &collection) const override;
+  Result<std::optional<DocumentSchema>>
+  getCollectionSchema(const std::string &collection) const override;
+  Result<std::vector<std::pair<std::string, Document>>>
+  query(const std::string &collection, const std::vector<std::string> &fields,
+        const std::optional<DocPredicate> &where = std::nullopt) override;
+  Status queryVisit(const std::string &collection,
+                    const std::vector<std::string> &fields,
+                    const std::optional<DocPredicate> &where,
+                    const DocumentVisitor &fn) override;
+  // Every IndexType is kept as an ordered key range
+  Status createIndex(const std::string &collection, const std::string &field,
+                     IndexType type) override;
+
+private:
+  struct CollectionInfo {
+    std::optional<DocumentSchema> schema;
+    CompiledValidator validator; // of `schema`, when set
+    std::vector<std::string> unique; // unique fields of `schema`
+    std::set<std::string> indexed;
+    uint64_t docs = 0;
+  };
+
+  explicit RocksDbDocumentStorage(std::shared_ptr<KeyValueStore> store)
+      : store_(std::move(store)) {}
+
+  static CollectionInfo makeCollection(std::optional<DocumentSchema> schema);
+  Status load();
+  Status create(const std::string &collection,
+                const std::optional<DocumentSchema> &schema);
+  void addEntries(WriteBatch &batch, const std::string &collection,
+                  const CollectionInfo &ci, const std::string &key,
+                  const Document &doc) const;
+  void removeEntries(WriteBatch &batch, const std::string &collection,
+                     const CollectionInfo &ci, const std::string &key,
+                     const Document &doc) const;
+  void putCount(WriteBatch &batch, const std::string &collection,
+                uint64_t docs) const;
+
+  std::shared_ptr<KeyValueStore> store_;
+  std::map<std::string, CollectionInfo> collections_;
+  mutable std::shared_mutex mtx_;
+};
+
+} // namespace kadedb
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace kadedb {
+
+/**
+ * Typed comparison kernels over contiguous column data.
+ *
+ * Kernels write a selection bitmap: bit i of out[i / 64] is set when row i
+ * satisfies `data[i] <op> rhs`. `out` must hold (n + 63) / 64 words; bits at
+ * positions >= n are cleared. Validity (null) bitmaps are not consulted, so
+ * callers AND the result with them.
+ *
+ * Results match Value::compare() semantics: doubles compare through
+ * compareNumeric(), so a NaN operand compares equal to everything.
+ *
+ * When kadedb_core is built with AVX2 (x86-64) or NEON (AArch64) enabled,
+ * e.g. via KADEDB_ENABLE_NATIVE_ARCH, the int64/double kernels use SIMD;
+ * otherwise they fall back to portable scalar loops.
+ */
+namespace scan {
+
+// Rows evaluated per batch by vectorized scans (a multiple of 64)
+constexpr size_t kBatchRows = 1024;
+constexpr size_t kBatchWords = kBatchRows / 64;
+
+enum class CompareOp { Eq, Ne, Lt, Le, Gt, Ge };
+
+void compareInt64(const int64_t *data, size_t n, CompareOp op, int64_t rhs,
+                  uint64_t *out);
+void compareDouble(const double *data, size_t n, CompareOp op, double rhs,
+                   uint64_t *out);
+// Integer column against a Float rhs (cells widened to double)
+void compareInt64AsDouble(const int64_t *data, size_t n, CompareOp op,
+                          double rhs, uint64_t *out);
+// Dictionary codes: bit i is hits[codes[i]] (one byte, 0 or 1, per code)
+void lookupCodes(const uint32_t *codes, size_t n, const uint8_t *hits,
+                 uint64_t *out);
+
+// Rows and valid values of one time bucket, with the sum, min and max of
+// the values
+struct BucketAggregate {
+  int64_t bucketStart = 0;
+  int64_t rows = 0;
+  int64_t values = 0;
+  double sum = 0.0;
+  double min = std::numeric_limits<double>::infinity();
+  double max = -std::numeric_limits<double>::infinity();
+};
+
+// Aggregate `n` rows with ascending `timestamps` into buckets of `width`
+// starting at origin + k * width, appending one entry per non-empty bucket
+// in order. Each bucket is a contiguous run of rows, reduced with SIMD
+// where available. A value flagged off in `validity` (bit i of
+// validity[i / 64]; nullptr: all valid) counts as a row only; with
+// `values` null only rows are counted. Like `d < min`, min and max skip
+// NaN, which sums propagate.
+void bucketAggregate(const int64_t *timestamps, const double *values,
+                     const uint64_t *validity, size_t n, int64_t origin,
+                     int64_t width, std::vector<BucketAggregate> &out);
+
+// Name of the instruction set the kernels were compiled for
+// ("avx2", "neon" or "scalar")
+const char *kernelIsa();
+
+// Index of the lowest set bit; `w` must be non-zero
+inline unsigned lowestBit(uint64_t w) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long idx;
+  _BitScanForward64(&idx, w);
+  return static_cast<unsigned>(idx);
+#else
+  return static_cast<unsigned>(__builtin_ctzll(w));
+#endif
+}
+
+// Invoke fn(i) for every set bit i of a bitmap with `words` words
+template <typename Fn>
+inline void forEachSetBit(const uint64_t *bits, size_t words, Fn &&fn) {
+  for (size_t w = 0; w < words; ++w) {
+    for (uint64_t b = bits[w]; b; b &= b - 1)
+      fn(w * 64 + lowestBit(b));
+  }
+}
+
+} // namespace scan
+} // namespace kadedb
@@ -4,7 +4,9 @@
 #include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -95,7 +97,15 @@ private:
 // - Use for cheaper copies when sharing is acceptable; call toRowDeep() when
 // isolation is needed.
 //
-// Both align with TableSchema column counts and perform bounds checking in
+// InlineRow: compact value semantics
+// - Stores one 16-byte InlineValue per cell (tagged union, small strings
+// inline), so scalars and short strings need no per-cell heap allocation.
+// - Copies are deep; an empty InlineValue mirrors a nullptr cell in Row.
+// - Provides conversion helpers InlineRow::fromRow(const Row&) and
+// InlineRow::toRow().
+// - Used as the internal row format of InMemoryRelationalStorage.
+//
+// All align with TableSchema column counts and perform bounds checking in
 // accessors.
 //
 // A simple row representation that aligns with a TableSchema
@@ -118,6 +128,10 @@ public:
 
   // Deep clone utility
   Row clone() const;
+  // Move the values out, leaving the row with no columns
+  std::vector<std::unique_ptr<Value>> release() {
+    return std::exchange(values_, {});
+  }
 
 private:
   std::vector<std::unique_ptr<Value>> values_;
@@ -214,6 +228,8 @@ public:
                                         Args &&...args) {
     return map_.try_emplace(key, std::forward<Args>(args)...);
   }
+  iterator erase(const_iterator pos) { return map_.erase(pos); }
+  size_t erase(const std::string &key) { return map_.erase(key); }
   void clear() noexcept { map_.clear(); }
 
 private:
@@ -255,11 +271,39 @@ private:
   std::vector<std::shared_ptr<Value>> values_;
 };
 
+// A compact row representation holding InlineValue cells by value
+class InlineRow {
+public:
+  explicit InlineRow(size_t columnCount = 0) : values_(columnCount) {}
+
+  size_t size() const { return values_.size(); }
+  const InlineValue &at(size_t idx) const { return values_.at(idx); }
+  InlineValue &at(size_t idx) { return values_.at(idx); }
+
+  void set(size_t idx, InlineValue v) {
+    if (idx >= values_.size())
+      throw std::out_of_range("InlineRow::set index out of range");
+    values_[idx] = std::move(v);
+  }
+  const std::vector<InlineValue> &values() const { return values_; }
+
+  // Convert from a deep Row (nullptr cells become empty InlineValues)
+  static InlineRow fromRow(const Row &r);
+  // Convert back to a deep Row (empty InlineValues become nullptr cells)
+  Row toRow() const;
+
+private:
+  std::vector<InlineValue> values_;
+};
+
 // Minimal validation utility
 class SchemaValidator {
 public:
   // Returns empty string on success, otherwise an error message
   static std::string validateRow(const TableSchema &schema, const Row &row);
+  // Same checks as above for the compact InlineRow representation
+  static std::string validateRow(const TableSchema &schema,
+                                 const InlineRow &row);
 
   // Validate a document against a DocumentSchema. Flexible: unknown fields are
   // allowed.
@@ -272,6 +316,9 @@ public:
   static std::string validateUnique(const TableSchema &schema,
                                     const std::vector<Row> &rows,
                                     bool ignoreNulls = true);
+  static std::string validateUnique(const TableSchema &schema,
+                                    const std::vector<InlineRow> &rows,
+                                    bool ignoreNulls = true);
   // Ensures fields with unique=true do not have duplicate non-null values
   // across documents
   static std::string validateUnique(const DocumentSchema &schema,
@@ -288,6 +335,66 @@ private:
   static bool valueMatches(ColumnType ct, const Value &v);
   static bool checkConstraints(const Column &col, const Value &v,
                                std::string &err);
+  static bool valueMatches(ColumnType ct, const InlineValue &v);
+  static bool checkConstraints(const Column &col, const InlineValue &v,
+                               std::string &err);
+};
+
+// SchemaValidator's row or document checks for one schema, compiled once
+// for the insert path: a flat list of the columns (or fields) to check,
+// with each column's constraint tests reduced to the ones it declares,
+// oneOf turned into a hash set, numeric bounds unwrapped and error messages
+// prebuilt. Results and messages match SchemaValidator. Compiled from a
+// copy, so it must be rebuilt when the schema changes.
+class CompiledValidator {
+public:
+  // Accepts any row or document
+  CompiledValidator() = default;
+  explicit CompiledValidator(const TableSchema &schema);
+  explicit CompiledValidator(const DocumentSchema &schema);
+
+  // Empty on success, otherwise SchemaValidator's message
+  std::string validateRow(const Row &row) const;
+  std::string validateRow(const InlineRow &row) const;
+  std::string validateDocument(const Document &doc) const;
+  // validateDocument() limited to one field: `v` is its value when
+  // `present`, and the field is missing otherwise. Fields the schema does
+  // not declare always pass.
+  std::string validateField(const std::string &field, const Value *v,
+                            bool present) const;
+
+private:
+  // Allowed strings, shared by the copies of a validator
+  struct StringSet {
+    std::vector<std::string> values;
+    std::unordered_set<std::string_view> set; // views of `values`
+  };
+  struct Check {
+    size_t column = 0; // row position; unused for documents
+    std::string field; // document field name
+    ColumnType type = ColumnType::Null;
+    bool nullable = true;
+    // Constraint tests the column declares
+    bool length = false;
+    bool range = false;
+    size_t minLength = 0;
+    size_t maxLength = static_cast<size_t>(-1);
+    double minValue = 0; // -inf/+inf when unbounded
+    double maxValue = 0;
+    std::shared_ptr<const StringSet> oneOf;
+    // Prebuilt messages
+    std::string missingError, nullError, typeError;
+    std::string shortError, longError, oneOfError, belowError, aboveError;
+  };
+
+  static Check compile(const Column &col, const std::string &field,
+                       bool document);
+  template <typename V> static std::string check(const Check &c, const V &v);
+  template <typename RowT> std::string validateRowImpl(const RowT &row) const;
+
+  std::vector<Check> checks_;
+  size_t columnCount_ = 0;
+  bool compiled_ = false;
 };
 
 // Time granularity for time-series data
@@ -301,6 +408,15 @@ enum class TimeGranularity {
   Days
 };
 
+// A downsampled copy of a time series: per-bucket statistics of every
+// numeric value column, kept after the raw rows expire
+struct DownsampleTier {
+  // Bucket width in seconds (> 0)
+  uint64_t bucketSeconds = 60;
+  // How long the buckets are kept, in seconds (0 = as long as the series)
+  uint64_t ttlSeconds = 0;
+};
+
 // Retention policy for time-series data
 struct RetentionPolicy {
   // Time-to-live in seconds (0 = no expiration)
@@ -309,6 +425,9 @@ struct RetentionPolicy {
   size_t maxRows = 0;
   // Whether to drop oldest rows when maxRows exceeded
   bool dropOldest = true;
+  // Downsampled tiers filled as rows are appended, e.g. 1-minute buckets
+  // for a week and 1-hour buckets for a year
+  std::vector<DownsampleTier> tiers;
 };
 
 // Schema for time-series storage
@@ -359,6 +478,12 @@ public:
     retention_ = policy;
   }
 
+  // How late samples may arrive, in seconds behind the newest one, and
+  // still be added in place: a partition is compressed once the newest
+  // sample is this far past its end (0 = as soon as a newer one starts)
+  uint64_t latenessSeconds() const { return lateness_; }
+  void setLatenessSeconds(uint64_t seconds) { lateness_ = seconds; }
+
   // Convenience: get all columns (timestamp + tags + values) for validation
   std::vector<Column> allColumns() const;
 
@@ -372,6 +497,7 @@ private:
   std::vector<Column> tagColumns_;
   std::unordered_map<std::string, size_t> tagIndexByName_;
   RetentionPolicy retention_;
+  uint64_t lateness_ = 0;
 };
 
 } // namespace kadedb
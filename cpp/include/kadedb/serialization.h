@@ -9,6 +9,7 @@
 #include <unordered_map>
 #include <vector>
 
+#include "kadedb/compression.h"
 #include "kadedb/schema.h"
 #include "kadedb/value.h"
 
@@ -17,7 +18,13 @@ namespace kadedb {
 // Version/tagging for binary format
 namespace serialization_constants {
 static constexpr uint32_t MAGIC = 0x4B444256; // 'KDBV'
-static constexpr uint8_t VERSION = 1;         // bump on format changes
+static constexpr uint8_t VERSION = 2;         // bump on format changes
+static constexpr uint8_t MIN_VERSION = 1;     // oldest version still read
+// The "version" field of the JSON texts, whose format is unchanged
+static constexpr uint8_t JSON_VERSION = 1;
+// Compressed row batches: [u32 magic][u8 Codec][u32 raw size]
+// [u32 stored size][stored bytes], decompressing to a plain batch
+static constexpr uint32_t COMPRESSED_MAGIC = 0x4B44425A; // 'KDBZ'
 } // namespace serialization_constants
 
 // Error type for (de)serialization problems
@@ -26,16 +33,44 @@ public:
   using std::runtime_error::runtime_error;
 };
 
-// Binary serialization API
+// Binary serialization API. Writers produce VERSION; readers take
+// MIN_VERSION through VERSION.
+//
+// Version 2 writes integers as zigzag varints and lengths and counts as
+// varints, and folds booleans into the type tag. Rows write their cells'
+// types as runs, so a homogeneous row carries one tag, and pack their
+// booleans into a bitmap; documents fold nullptr fields into the tag.
 namespace bin {
-// Values
+// Values. They carry no header, so readValue() must be told the version
+// they were written in.
 void writeValue(const Value &v, std::ostream &os);
-std::unique_ptr<Value> readValue(std::istream &is);
+std::unique_ptr<Value>
+readValue(std::istream &is,
+          uint8_t version = serialization_constants::VERSION);
 
 // Rows
 void writeRow(const Row &row, std::ostream &os);
 Row readRow(std::istream &is);
 
+// Row batches: many rows of one width as a columnar block, encoded into and
+// decoded from memory with bulk copies instead of a stream call per field.
+// After the header come the row and column counts, then per column its
+// type, a null bitmap when it holds nullptr cells, and the cells: one
+// fixed-width array (integers, floats, booleans) or string offsets followed
+// by the string bytes. A column mixing value types falls back to tagged
+// cells. writeRowBatch appends to `out` and throws SerializationError when
+// the rows differ in width.
+void writeRowBatch(const std::vector<Row> &rows, std::string &out);
+// The batch compressed with `codec` (and `dict`, which the reader must
+// pass too); Codec::None writes a plain batch
+void writeRowBatch(const std::vector<Row> &rows, std::string &out,
+                   Codec codec, std::string_view dict = {});
+// Decode the plain or compressed batch at `data`; `consumed` receives its
+// encoded size
+std::vector<Row> readRowBatch(const char *data, size_t size,
+                              size_t *consumed = nullptr,
+                              std::string_view dict = {});
+
 // TableSchema
 void writeTableSchema(const TableSchema &schema, std::ostream &os);
 TableSchema readTableSchema(std::istream &is);
@@ -51,6 +86,12 @@ Document readDocument(std::istream &is);
 
 // JSON serialization API (text). Produces/consumes strict JSON.
 namespace json {
+// Streaming writers: append the same text toJson() returns to `out`, so one
+// buffer can be reused across many values and documents
+void appendJson(const Value &v, std::string &out);
+void appendJson(const Row &row, std::string &out);
+void appendJson(const Document &doc, std::string &out);
+
 // Values
 std::string toJson(const Value &v);
 std::unique_ptr<Value> fromJson(const std::string &json);
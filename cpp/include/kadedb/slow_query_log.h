@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "kadedb/schema.h"
+
+namespace kadedb {
+
+/** One KadeQL statement that ran longer than the slow query threshold. */
+struct SlowQueryEntry {
+  uint64_t id = 0;          // sequence number, from 1
+  int64_t startedAtUs = 0;  // wall clock, microseconds since the epoch
+  uint64_t durationUs = 0;  // time inside QueryExecutor::execute
+  std::string query;        // the statement as KadeQL renders it
+  std::string fingerprint;  // `query` with its literals replaced by ?
+  uint64_t fingerprintHash = 0;
+  std::string plan; // the stages run: "Scan (...) -> Filter (...) -> ..."
+  uint64_t rowsScanned = 0;  // rows the storage examined
+  uint64_t rowsReturned = 0; // rows the statement produced or changed
+  // Values the calling thread allocated while running it, and their bytes
+  uint64_t allocations = 0;
+  uint64_t bytesAllocated = 0;
+  std::string status; // "OK" or the error returned
+};
+
+/**
+ * Bounded log of slow statements. QueryExecutor::execute() adds every
+ * statement that takes at least threshold() to the log it was given
+ * (shared() by default); once the log holds capacity() entries, each new
+ * one replaces the oldest. KadeQL reads it as the table kTableName.
+ * Logging is off until a threshold is set; then a fast statement costs two
+ * clock reads and an atomic load.
+ */
+class SlowQueryLog {
+public:
+  static constexpr const char *kTableName = "kadedb_slow_queries";
+  static constexpr size_t kDefaultCapacity = 256;
+
+  explicit SlowQueryLog(size_t capacity = kDefaultCapacity);
+  SlowQueryLog(const SlowQueryLog &) = delete;
+  SlowQueryLog &operator=(const SlowQueryLog &) = delete;
+
+  // The log executors use unless given another
+  static SlowQueryLog &shared();
+
+  // Log statements taking at least `threshold`
+  void setThreshold(std::chrono::microseconds threshold);
+  // Stop logging (the default); entries already logged are kept
+  void disable();
+  bool enabled() const {
+    return thresholdUs_.load(std::memory_order_relaxed) >= 0;
+  }
+  // Whether a statement of `durationUs` is logged
+  bool isSlow(uint64_t durationUs) const {
+    const int64_t t = thresholdUs_.load(std::memory_order_relaxed);
+    return t >= 0 && durationUs >= static_cast<uint64_t>(t);
+  }
+
+  // Resizing keeps the newest entries that fit
+  void setCapacity(size_t capacity);
+  size_t capacity() const;
+
+  // Add `entry`, assigning its id
+  void record(SlowQueryEntry entry);
+  // Oldest first
+  std::vector<SlowQueryEntry> entries() const;
+  void clear();
+
+  // `query` with string and number literals replaced by ?, and runs of ?
+  // in a list collapsed to one, so that statements differing only in
+  // their constants share a fingerprint
+  static std::string fingerprint(const std::string &query);
+  // 64-bit FNV-1a of `fingerprint`
+  static uint64_t fingerprintHash(const std::string &fingerprint);
+
+  // Columns of kTableName, in SlowQueryEntry order (the hash as 16 hex
+  // digits), and the entries as its rows, oldest first
+  static TableSchema schema();
+  std::vector<Row> rows() const;
+
+private:
+  mutable std::mutex mtx_;
+  std::vector<SlowQueryEntry> ring_;
+  size_t capacity_;
+  size_t head_ = 0; // oldest entry once the ring is full
+  uint64_t nextId_ = 1;
+  std::atomic<int64_t> thresholdUs_{-1};
+};
+
+} // namespace kadedb
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "kadedb/schema.h"
+#include "kadedb/value.h"
+
+namespace kadedb {
+
+struct Predicate;
+
+/**
+ * HyperLogLog distinct-value sketch with 2^kPrecision one-byte registers
+ * (about 2.3% standard error). Callers add well-mixed 64-bit hashes;
+ * sketches only grow, so removed values are still counted until rebuilt.
+ */
+class HyperLogLog {
+public:
+  static constexpr unsigned kPrecision = 11;
+  static constexpr size_t kRegisters = size_t{1} << kPrecision;
+
+  void add(uint64_t hash);
+  void merge(const HyperLogLog &other);
+  void clear() { registers_.fill(0); }
+  double estimate() const;
+
+private:
+  std::array<uint8_t, kRegisters> registers_{};
+};
+
+// Well-mixed 64-bit hash of a present cell for HyperLogLog::add();
+// numerically equal Integer and Float cells hash alike, as they compare
+// equal
+uint64_t cellHash(const InlineValue &v);
+
+/**
+ * Merging t-digest: a quantile sketch of numeric values that keeps at most
+ * about kCompression centroids, small ones near the tails, so quantiles
+ * near 0 and 1 stay accurate (well under 1% of rank in between). Values
+ * are buffered and folded in batches; digests of disjoint inputs merge
+ * into the digest of their union.
+ */
+class TDigest {
+public:
+  static constexpr double kCompression = 100;
+
+  void add(double x, double weight = 1);
+  void merge(const TDigest &other);
+  bool empty() const { return total_ == 0; }
+  // Values added, by weight
+  double count() const { return total_; }
+  // Value at quantile `q` in [0, 1], interpolated between centroids; NaN
+  // when empty
+  double quantile(double q) const;
+  // Approximate bytes held
+  size_t bytes() const;
+
+private:
+  struct Centroid {
+    double mean;
+    double weight;
+  };
+  // Fold the buffered values into the centroids
+  void compress();
+
+  std::vector<Centroid> centroids_; // by mean
+  std::vector<Centroid> buffer_;    // not yet folded in
+  double total_ = 0;                // weight of both
+  double min_ = 0, max_ = 0;
+};
+
+/**
+ * Equi-depth histogram over numeric values: bucket i spans
+ * [bounds[i], bounds[i + 1]] and holds the same share of the values as
+ * every other bucket. Heavy hitters show up as zero-width buckets.
+ */
+class EquiDepthHistogram {
+public:
+  EquiDepthHistogram() = default;
+  // Build from unsorted values with at most `buckets` buckets
+  static EquiDepthHistogram build(std::vector<double> values, size_t buckets);
+
+  bool empty() const { return bounds_.size() < 2; }
+  size_t bucketCount() const { return empty() ? 0 : bounds_.size() - 1; }
+  const std::vector<double> &bounds() const { return bounds_; }
+  // Estimated share of values below x (at most x when `inclusive`),
+  // interpolating linearly inside a bucket
+  double fractionBelow(double x, bool inclusive) const;
+
+private:
+  std::vector<double> bounds_;
+};
+
+/** Planner statistics of one column, over the live rows of its table. */
+struct ColumnStatistics {
+  std::string name;
+  ColumnType type = ColumnType::Null;
+  size_t nonNull = 0; // rows with a value in this column
+  // Smallest and largest values seen; after updates and deletes they may
+  // be wider than the live values until the statistics are rebuilt
+  std::optional<InlineValue> min, max;
+  double distinct = 0; // estimated distinct non-null values
+  EquiDepthHistogram histogram; // numeric columns only
+};
+
+/**
+ * Statistics snapshot of one table, as used by the query planner.
+ * Estimates assume independent columns and never fail: comparisons the
+ * statistics cannot judge fall back to fixed default selectivities.
+ */
+class TableStatistics {
+public:
+  size_t rowCount = 0;
+  std::vector<ColumnStatistics> columns; // schema order
+
+  // nullptr when the table has no such column
+  const ColumnStatistics *column(const std::string &name) const;
+  // Estimated share of rows matching `p`, in [0, 1]
+  double selectivity(const Predicate &p) const;
+  // Estimated number of rows matching `where` (all rows when absent)
+  double estimateRows(const std::optional<Predicate> &where) const;
+};
+
+/**
+ * Incrementally maintained table statistics. Storage engines call add()
+ * and remove() as rows are written (updates are a remove plus an add) and
+ * snapshot() when the planner asks. Row and null counts are exact; min/max
+ * and distinct counts cannot shrink on removal, and the value sample keeps
+ * removed values, so engines clear() and re-add the live rows once stale()
+ * reports that removals outnumber them.
+ */
+class StatisticsCollector {
+public:
+  static constexpr size_t kSampleSize = 1024;
+  static constexpr size_t kHistogramBuckets = 32;
+  // In-place changes tolerated between snapshots however small the table
+  static constexpr size_t kMinRefreshChanges = 64;
+
+  StatisticsCollector() = default;
+  explicit StatisticsCollector(const TableSchema &schema);
+
+  void add(const InlineRow &row);
+  void add(const Row &row);
+  void remove(const InlineRow &row);
+  void remove(const Row &row);
+  void clear();
+  bool stale() const {
+    return removed_ >= kSampleSize && removed_ > rowCount_;
+  }
+  TableStatistics snapshot() const;
+  // The last snapshot, retaken once the row count drifted by more than a
+  // tenth or more rows than it counted (at least kMinRefreshChanges)
+  // changed since, so alternating writes and plans stay cheap
+  std::shared_ptr<const TableStatistics> cached() const;
+
+private:
+  struct ColumnState {
+    size_t nonNull = 0;
+    std::optional<InlineValue> min, max;
+    HyperLogLog distinct;
+    std::vector<double> sample; // reservoir of numeric values
+    size_t seen = 0;            // numeric values offered to the reservoir
+  };
+  void addCell(size_t column, const InlineValue &cell);
+  void removeCell(size_t column, const InlineValue &cell);
+  uint64_t nextRandom();
+
+  std::vector<std::string> names_;
+  std::vector<ColumnType> types_;
+  std::vector<ColumnState> state_;
+  size_t rowCount_ = 0;
+  size_t removed_ = 0; // removals since the last clear()
+  size_t changes_ = 0; // adds and removals ever
+  mutable std::shared_ptr<const TableStatistics> cache_;
+  mutable size_t cachedAt_ = 0; // changes_ when cache_ was taken
+  uint64_t rng_ = 0x9E3779B97F4A7C15ull;
+};
+
+} // namespace kadedb
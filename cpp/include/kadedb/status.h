@@ -13,7 +13,10 @@ enum class StatusCode {
   AlreadyExists,
   InvalidArgument,
   FailedPrecondition,
-  Internal
+  Internal,
+  Cancelled,
+  // A memory budget would be exceeded (memory.h)
+  ResourceExhausted
 };
 
 class Status {
@@ -38,6 +41,12 @@ public:
   static Status Internal(std::string msg = {}) {
     return Status(StatusCode::Internal, std::move(msg));
   }
+  static Status Cancelled(std::string msg = {}) {
+    return Status(StatusCode::Cancelled, std::move(msg));
+  }
+  static Status ResourceExhausted(std::string msg = {}) {
+    return Status(StatusCode::ResourceExhausted, std::move(msg));
+  }
 
   bool ok() const { return code_ == StatusCode::Ok; }
   StatusCode code() const { return code_; }
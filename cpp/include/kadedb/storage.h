@@ -1,18 +1,33 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <shared_mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
-#include "kadedb/result.h" // ResultSet
-#include "kadedb/schema.h" // TableSchema, Row, Document
-#include "kadedb/status.h" // Status, Result<T>
-#include "kadedb/value.h"  // Value helpers
+#include "kadedb/change_feed.h"     // ChangeFeed, ChangeSubscription
+#include "kadedb/index.h"           // IndexType, ColumnIndex, FieldIndex
+#include "kadedb/memory.h"          // MemoryAccount
+#include "kadedb/mvcc.h"            // RowVersionStore, RowSnapshot
+#include "kadedb/profiled_mutex.h"  // ProfiledMutex, LockSite
+#include "kadedb/result.h"          // ResultSet
+#include "kadedb/schema.h"          // TableSchema, Row, Document
+#include "kadedb/statistics.h"      // TableStatistics, StatisticsCollector
+#include "kadedb/status.h"          // Status, Result<T>
+#include "kadedb/stored_document.h" // StoredDocument, DocumentLayout
+#include "kadedb/value.h"           // Value helpers
+#include "kadedb/zone_map.h"        // ZoneMap
 
 namespace kadedb {
 
@@ -56,6 +71,39 @@ struct Predicate {
 
   // Logical payload (used when kind==And/Or/Not)
   std::vector<Predicate> children;
+
+  // Readable form, e.g. `(hr > 100 AND ward = "icu")`, for plan output
+  std::string toString() const;
+};
+
+// Deep copy of `p` (a Predicate owns its rhs values)
+Predicate copyPredicate(const Predicate &p);
+
+/**
+ * A Predicate bound to a TableSchema for repeated evaluation.
+ *
+ * bind() resolves every column name to its position once per query and keeps
+ * the rhs both borrowed (for Row) and as an InlineValue (for InlineRow), so
+ * matching a row does no name lookups. Semantics are those of the unbound
+ * Predicate: comparisons on an unknown column, a missing rhs or an absent
+ * cell never match. The source Predicate must outlive the bound form.
+ */
+struct BoundPredicate {
+  Predicate::Kind kind = Predicate::Kind::Comparison;
+  Predicate::Op op = Predicate::Op::Eq;
+  size_t column = TableSchema::npos; // npos => comparison never matches
+  const Value *rhs = nullptr;
+  InlineValue inlineRhs;
+  std::vector<BoundPredicate> children;
+
+  static BoundPredicate bind(const Predicate &pred, const TableSchema &schema);
+  bool matches(const InlineRow &row) const;
+  // Cells in schema order (nullptr = null), e.g. a ResultRow or a RowBatch row
+  bool matches(const std::vector<std::unique_ptr<Value>> &cells) const;
+  bool matches(const Row &row) const { return matches(row.values()); }
+  // False when no row summarized by `zone` can match, so its block can be
+  // skipped; true when some might
+  bool mayMatch(const ZoneMap &zone) const;
 };
 
 /**
@@ -69,6 +117,36 @@ struct AssignmentValue {
   std::string column_ref;          // used when kind==ColumnRef
 };
 
+/**
+ * Rows streamed by RelationalStorage::scan(). Every batch of one scan carries
+ * the same projected column metadata; each row holds one cell per column
+ * (nullptr = null). Consumers may move cells out of `rows`.
+ */
+struct RowBatch {
+  std::vector<std::string> columnNames;
+  std::vector<ColumnType> columnTypes;
+  std::vector<std::vector<std::unique_ptr<Value>>> rows;
+};
+
+/**
+ * The order a reader of RelationalStorage::scanOrdered() sorts rows in, and
+ * how many of the first it needs: ORDER BY `column` [DESC] LIMIT `limit`.
+ * With `withTies` it also needs the rows tying with the last of those on
+ * `column`, as when further ORDER BY keys break the ties.
+ */
+struct ScanOrder {
+  std::string column;
+  bool descending = false;
+  size_t limit = 0;
+  bool withTies = false;
+};
+
+// Rows written by RelationalStorage::upsertRows()
+struct UpsertCounts {
+  size_t inserted = 0;
+  size_t updated = 0;
+};
+
 /**
  * A simple predicate for Document queries.
  *
@@ -93,6 +171,29 @@ struct DocPredicate {
   std::vector<DocPredicate> children;
 };
 
+/**
+ * One field operation of DocumentStorage::patch(), in the manner of
+ * MongoDB's update operators:
+ *  - Set:   store `value` in `field` (nullptr: a field without a value)
+ *  - Unset: remove `field`; a missing field is left alone
+ *  - Inc:   add the Integer or Float `value` to a numeric `field`, or set
+ *           it when missing; Integer plus Integer stays an Integer
+ * Operations apply in order, so later ones see the effect of earlier ones.
+ */
+struct DocUpdate {
+  enum class Op { Set, Unset, Inc };
+  Op op = Op::Set;
+  std::string field;
+  std::unique_ptr<Value> value;
+};
+
+/**
+ * Apply `ops` to `doc`, all or nothing.
+ * @return Status::InvalidArgument for an empty field name, an Inc of a
+ *         non-numeric field or by a non-numeric value, or Integer overflow
+ */
+Status applyDocUpdates(Document &doc, const std::vector<DocUpdate> &ops);
+
 /**
  * Storage API for the relational model.
  *
@@ -107,12 +208,25 @@ struct DocPredicate {
  *  - select: NotFound when table missing; InvalidArgument when a requested
  *    projection column does not exist; Ok with ResultSet on success
  */
+/**
+ * Next stamp of a process-wide counter, for the data version of a table or
+ * series (see RelationalStorage::tableVersion()). Stamps are never reused,
+ * so equal stamps mean the same rows, even across storages and a drop and
+ * re-creation of the same name.
+ */
+uint64_t nextDataVersion();
+
 /** @ingroup StorageAPI */
 class RelationalStorage {
 public:
   virtual ~RelationalStorage() = default;
 
   using RowUpdater = std::function<Status(Row &row, const TableSchema &schema)>;
+  // Receives each scanned batch; returning false stops the scan
+  using BatchSink = std::function<bool(RowBatch &batch)>;
+
+  // Rows per batch delivered by scan() unless the caller asks otherwise
+  static constexpr size_t kDefaultBatchRows = 1024;
 
   /**
    * Create a table with a name and schema.
@@ -133,6 +247,43 @@ public:
    */
   virtual Status insertRow(const std::string &table, const Row &row) = 0;
 
+  /**
+   * Insert a batch of rows, each validated as by insertRow(). The default
+   * implementation calls insertRow() per row and stops at the first error,
+   * keeping the rows before it; implementations may override it to insert
+   * the batch at once.
+   * @return The first error, as insertRow(); Status::OK when every row was
+   *         inserted
+   */
+  virtual Status insertRows(const std::string &table,
+                            const std::vector<Row> &rows);
+
+  /**
+   * How upsertRows() merges a row into the live row with its primary key:
+   * edits `current`, a copy of that row, given the `proposed` one. It must
+   * leave the key as it is.
+   */
+  using UpsertMerger = std::function<Status(
+      Row &current, const Row &proposed, const TableSchema &schema)>;
+
+  /**
+   * Insert each row, or update the live row with the same primary key:
+   * replace it with the proposed row, or with what `merge` makes of the
+   * two. A row whose key an earlier row of the batch wrote merges into
+   * that version; each row written is counted once, as inserted if the
+   * batch inserted it. Updates that leave a row as it was write nothing.
+   * Rows are validated as by insertRow(). The default looks each key up
+   * with select() and writes through insertRow() and updateRowsWith(),
+   * stopping at the first error.
+   * @return Status::NotFound if table missing; Status::InvalidArgument
+   *         without a primary key, for a null key, on schema mismatch or a
+   *         merge that changes the key; Status::FailedPrecondition on
+   *         unique conflicts; the rows inserted and updated otherwise
+   */
+  virtual Result<UpsertCounts> upsertRows(const std::string &table,
+                                          const std::vector<Row> &rows,
+                                          const UpsertMerger &merge = nullptr);
+
   /**
    * Basic SELECT across all rows with optional projection and predicate.
    * @param table Table name
@@ -147,12 +298,110 @@ public:
   select(const std::string &table, const std::vector<std::string> &columns,
          const std::optional<Predicate> &where = std::nullopt) = 0;
 
+  /**
+   * Streaming SELECT: same arguments and errors as select(), but matching
+   * rows are handed to `sink` in batches of at most `batchRows` rows instead
+   * of being collected into one ResultSet. The sink is always called at
+   * least once (with an empty batch when nothing matches) so the column
+   * metadata reaches it. The default implementation slices select();
+   * implementations override it to keep only one batch in memory.
+   * @return Status::NotFound if table missing; Status::InvalidArgument if a
+   *         projection column is unknown; Status::OK otherwise, including
+   *         when the sink stopped the scan early
+   */
+  virtual Status scan(const std::string &table,
+                      const std::vector<std::string> &columns,
+                      const std::optional<Predicate> &where,
+                      const BatchSink &sink,
+                      size_t batchRows = kDefaultBatchRows);
+
+  /**
+   * scan() for a reader that sorts the rows by `order` and keeps the first
+   * of them: it may deliver only those rows (and their ties, see
+   * ScanOrder), in order, reading no others. The default delivers every
+   * matching row, as scan() does; readers sort what they get either way.
+   */
+  virtual Status scanOrdered(const std::string &table,
+                             const std::vector<std::string> &columns,
+                             const std::optional<Predicate> &where,
+                             const ScanOrder &order, const BatchSink &sink,
+                             size_t batchRows = kDefaultBatchRows);
+
   /**
    * List existing table names.
    * @return Vector of table names; empty if none.
    */
   virtual std::vector<std::string> listTables() const = 0;
 
+  /**
+   * Schema of an existing table, without reading its rows: nullability,
+   * uniqueness, constraints and the primary key as created.
+   * @return Result<TableSchema>::err(Status::NotFound) if table missing
+   */
+  virtual Result<TableSchema> getTableSchema(const std::string &table) = 0;
+
+  /**
+   * Cheap row-count estimate for planning, e.g. choosing the build side of a
+   * hash join. std::nullopt when unknown (the default) or the table is
+   * missing.
+   */
+  virtual std::optional<size_t>
+  estimateRowCount(const std::string &table) const;
+
+  /**
+   * Rows a scan of `table` filtered by `where` is expected to read, for
+   * admission control: the index candidates when an index answers `where`,
+   * otherwise every row. The default is estimateRowCount().
+   */
+  virtual std::optional<size_t>
+  estimateScanCost(const std::string &table,
+                   const std::optional<Predicate> &where) const;
+
+  /**
+   * Planner statistics (row count, per-column min/max, distinct estimates
+   * and histograms) maintained as rows are written. Snapshots are refreshed
+   * once about a tenth of the rows changed, so they may lag the table
+   * slightly. nullptr when unsupported (the default) or the table is
+   * missing.
+   */
+  virtual std::shared_ptr<const TableStatistics>
+  getTableStatistics(const std::string &table) const;
+
+  /**
+   * Access path a scan of `table` filtered by `where` would take, for
+   * EXPLAIN: e.g. "index on hr > 100 (12 candidates)", or "full scan" (the
+   * default). Implementations may consult their indexes but read no rows.
+   */
+  virtual std::string
+  explainAccess(const std::string &table,
+                const std::optional<Predicate> &where) const;
+  // explainAccess() of a scanOrdered(); the default is that of scan()
+  virtual std::string
+  explainOrderedAccess(const std::string &table,
+                       const std::optional<Predicate> &where,
+                       const ScanOrder &order) const;
+
+  /**
+   * Data version of `table`: a stamp from nextDataVersion() that changes
+   * after every write to its rows, so a result computed while it held one
+   * value is still current while it does. std::nullopt when unsupported
+   * (the default) or the table is missing.
+   */
+  virtual std::optional<uint64_t>
+  tableVersion(const std::string &table) const;
+
+  /**
+   * Subscribe to the changes committed to `table` from now on (see
+   * ChangeSubscription), only to the rows matching `where` when given: an
+   * update is delivered when its old or its new row matches. Truncate and
+   * Drop events are always delivered.
+   * @return Status::NotFound if table missing; Status::FailedPrecondition
+   *         when the storage does not capture changes (the default)
+   */
+  virtual Result<std::unique_ptr<ChangeSubscription>>
+  subscribeChanges(const std::string &table,
+                   const std::optional<Predicate> &where = std::nullopt);
+
   /**
    * Drop a table and its data.
    * @param table Table name
@@ -202,8 +451,33 @@ public:
    * @return Status::NotFound if table missing; Status::OK on success
    */
   virtual Status truncateTable(const std::string &table) = 0;
+
+  /**
+   * Create a secondary index on a single column. Implementations may use it
+   * to answer Eq/Lt/Le/Gt/Ge comparisons (and AND-conjunctions of them)
+   * without scanning every row; query results are unchanged.
+   * @param table Table name
+   * @param column Column to index
+   * @param type Hash (equality only), Ordered (equality and ranges) or
+   *        Bitmap (equality and ranges over few distinct values, with
+   *        AND/OR/NOT trees resolved as bitmap operations)
+   * @return Status::NotFound if table missing; Status::InvalidArgument if the
+   *         column is unknown; Status::AlreadyExists if the column is already
+   *         indexed; Status::OK on success
+   */
+  virtual Status createIndex(const std::string &table,
+                             const std::string &column, IndexType type) = 0;
 };
 
+/**
+ * Hand the rows of `rs` to `sink` in batches of at most `batchRows` (0: the
+ * default), always calling it at least once; scan() implementations built on
+ * a materialized ResultSet use it. Stops when the sink returns false.
+ */
+Status scanResultSet(const ResultSet &rs,
+                     const RelationalStorage::BatchSink &sink,
+                     size_t batchRows);
+
 // Storage API for document model
 /** @ingroup DocumentAPI */
 class DocumentStorage {
@@ -239,6 +513,14 @@ public:
   virtual Status put(const std::string &collection, const std::string &key,
                      const Document &doc) = 0;
 
+  /**
+   * Put taking ownership of `doc`, so implementations may store it without
+   * a deep copy. Same semantics as put() above, which the default calls.
+   * `doc` is left in a valid but unspecified state.
+   */
+  virtual Status put(const std::string &collection, const std::string &key,
+                     Document &&doc);
+
   /**
    * Get a document if present.
    * - Returns Result::err(Status::NotFound) if collection/key is not found.
@@ -253,12 +535,56 @@ public:
   virtual Status erase(const std::string &collection,
                        const std::string &key) = 0;
 
+  /**
+   * Update some fields of the document under collection/key (see
+   * DocUpdate), leaving the others as they are. The result is validated
+   * and checked for uniqueness like put(), and is published as an Update.
+   * Nothing changes when an operation fails. The default applies `ops` to
+   * a get() copy and put()s it back; implementations may edit in place.
+   * - Returns Status::NotFound if collection or key is not found.
+   * - Otherwise returns what applyDocUpdates() or put() return.
+   */
+  virtual Status patch(const std::string &collection, const std::string &key,
+                       const std::vector<DocUpdate> &ops);
+
+  /**
+   * patch() every document matching `where` (all without one).
+   * Implementations may apply it to all or none of them; the default
+   * patches them one at a time and stops at the first failure.
+   * - Returns Result::err(Status::NotFound) if the collection is missing.
+   * - Returns Result::err(Status::InvalidArgument) for unknown predicate
+   *   fields, as query() does.
+   * @return the number of documents patched
+   */
+  virtual Result<size_t> updateWhere(const std::string &collection,
+                                     const std::optional<DocPredicate> &where,
+                                     const std::vector<DocUpdate> &ops);
+
   /**
    * Count documents in a collection.
    * - Returns Result::err(Status::NotFound) if the collection does not exist.
    */
   virtual Result<size_t> count(const std::string &collection) const = 0;
 
+  /**
+   * Schema a collection was created with (std::nullopt without one).
+   * - Returns Result::err(Status::NotFound) if the collection is missing.
+   * - The default reports std::nullopt for every existing collection.
+   */
+  virtual Result<std::optional<DocumentSchema>>
+  getCollectionSchema(const std::string &collection) const;
+
+  /**
+   * Subscribe to the puts, erases and drop of `collection` from now on (see
+   * ChangeSubscription). A put of a new key is an Insert, of an existing
+   * key an Update.
+   * @return Status::NotFound if the collection is missing;
+   *         Status::FailedPrecondition when the storage does not capture
+   *         changes (the default)
+   */
+  virtual Result<std::unique_ptr<ChangeSubscription>>
+  subscribeChanges(const std::string &collection);
+
   /**
    * Query documents with optional field projection and predicate filter.
    * - fields: empty means return entire Document values.
@@ -273,6 +599,123 @@ public:
   virtual Result<std::vector<std::pair<std::string, Document>>>
   query(const std::string &collection, const std::vector<std::string> &fields,
         const std::optional<DocPredicate> &where = std::nullopt) = 0;
+
+  /**
+   * Streaming query: calls fn(key, view) for each match instead of
+   * returning copies, stopping early when fn returns false. The view
+   * applies the `fields` projection and is only valid during the call.
+   * Validation and errors are as for query(). `fn` may run under the
+   * storage's read lock, so it must not call back into the storage. The
+   * default visits the copies returned by query().
+   */
+  using DocumentVisitor =
+      std::function<bool(const std::string &key, const DocumentView &doc)>;
+  virtual Status queryVisit(const std::string &collection,
+                            const std::vector<std::string> &fields,
+                            const std::optional<DocPredicate> &where,
+                            const DocumentVisitor &fn);
+
+  /**
+   * Create a secondary index on a single document field. Implementations may
+   * use it to answer Eq/Lt/Le/Gt/Ge comparisons (and AND/OR combinations of
+   * them) without scanning every document; query results are unchanged.
+   * @param collection Collection name
+   * @param field Field to index
+   * @param type Hash (equality only), Ordered (equality and ranges) or
+   *        Bitmap (equality and ranges over few distinct values, with
+   *        AND/OR/NOT trees resolved as bitmap operations)
+   * @return Status::NotFound if the collection is missing;
+   *         Status::InvalidArgument if the field is unknown under the
+   *         collection's schema; Status::AlreadyExists if the field is
+   *         already indexed; Status::OK on success
+   */
+  virtual Status createIndex(const std::string &collection,
+                             const std::string &field, IndexType type) = 0;
+};
+
+/**
+ * Check a document query against `schema`, as DocumentStorage::query()
+ * does; nothing to check without a schema.
+ * @return Status::InvalidArgument when a projection field or a field the
+ *         predicate reads is unknown
+ */
+Status validateDocumentQuery(const std::optional<DocumentSchema> &schema,
+                             const std::vector<std::string> &fields,
+                             const std::optional<DocPredicate> &where);
+
+/**
+ * Borrowed, read-only view over the rows matched by
+ * InMemoryRelationalStorage::selectView().
+ *
+ * Unlike select(), nothing is copied up front: the view references the
+ * stored rows and only materializes an owned Value when value() (or
+ * toResultSet()) is called. cell() returns the stored InlineValue itself.
+ *
+ * The view reads the MVCC snapshot taken when selectView() ran. It holds no
+ * lock, so writers to the table are never blocked, and their later changes
+ * (including drops) are not reflected in the view. The row versions it
+ * references stay alive until the view is destroyed.
+ */
+/** @ingroup StorageAPI */
+class ResultView {
+public:
+  ResultView(ResultView &&) noexcept = default;
+  ResultView &operator=(ResultView &&) noexcept = default;
+  ResultView(const ResultView &) = delete;
+  ResultView &operator=(const ResultView &) = delete;
+
+  const std::vector<std::string> &columnNames() const { return columnNames_; }
+  const std::vector<ColumnType> &columnTypes() const { return columnTypes_; }
+  size_t columnCount() const { return columnNames_.size(); }
+  size_t rowCount() const { return positions_.size(); }
+
+  // Lookup column index by name; returns npos if not found
+  size_t findColumn(const std::string &name) const {
+    for (size_t i = 0; i < columnNames_.size(); ++i) {
+      if (columnNames_[i] == name)
+        return i;
+    }
+    return npos;
+  }
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+  // Borrowed cell (empty InlineValue for null); valid while the view lives
+  const InlineValue &cell(size_t rowIdx, size_t colIdx) const {
+    return store_->at(positions_.at(rowIdx)).row.at(projection_.at(colIdx));
+  }
+  // Owned copy of a cell (nullptr for null)
+  std::unique_ptr<Value> value(size_t rowIdx, size_t colIdx) const {
+    return cell(rowIdx, colIdx).toValue();
+  }
+
+  // Cursor iteration mirroring ResultSet: starts before the first row
+  void reset() { cursor_ = static_cast<size_t>(-1); }
+  bool next() {
+    if (cursor_ + 1 < positions_.size()) {
+      ++cursor_;
+      return true;
+    }
+    return false;
+  }
+  const InlineValue &current(size_t colIdx) const {
+    if (cursor_ >= positions_.size())
+      throw std::out_of_range("ResultView::current(): no current row");
+    return cell(cursor_, colIdx);
+  }
+
+  // Materialize an owning ResultSet (same contents as select())
+  ResultSet toResultSet() const;
+
+private:
+  friend class InMemoryRelationalStorage;
+  ResultView() = default;
+
+  std::shared_ptr<const RowVersionStore> store_; // pinned snapshot rows
+  std::vector<size_t> positions_;  // matched version positions in store_
+  std::vector<size_t> projection_; // view column -> table column
+  std::vector<std::string> columnNames_;
+  std::vector<ColumnType> columnTypes_;
+  size_t cursor_ = static_cast<size_t>(-1);
 };
 
 // In-memory implementations for development and testing
@@ -280,15 +723,83 @@ public:
 class InMemoryRelationalStorage final : public RelationalStorage {
 public:
   InMemoryRelationalStorage() = default;
-  ~InMemoryRelationalStorage() override = default;
+  ~InMemoryRelationalStorage() override;
 
   Status createTable(const std::string &table,
                      const TableSchema &schema) override;
+  /**
+   * Create a table hash-partitioned on its primary key into `partitions`
+   * partitions (0: one per hardware thread). Each partition keeps its own
+   * rows, indexes and locks, so writers to different partitions never wait
+   * for each other. Reads and writes whose predicate pins the key by
+   * equality go to one partition; the others visit every partition in
+   * parallel and return rows in partition order. Equal keys share a
+   * partition, so the key is kept unique and non-null by each partition
+   * alone.
+   *
+   * Each partition commits and is read at its own snapshot. insertRows()
+   * stays all or nothing (rows it put into other partitions before a
+   * failure are deleted again), but updates and deletes commit partition
+   * by partition, and a scan may see a concurrent multi-partition write in
+   * some partitions only. Updates of the key are refused, as is
+   * selectView() when more than one partition could match.
+   * @return Status::AlreadyExists if the table exists;
+   *         Status::InvalidArgument without a primary key or with a unique
+   *         column other than it
+   */
+  Status createPartitionedTable(const std::string &table,
+                                const TableSchema &schema, size_t partitions);
+  // Partitions of `table` (1 unless partitioned); nullopt if missing
+  std::optional<size_t> partitionCount(const std::string &table) const;
   Status insertRow(const std::string &table, const Row &row) override;
+  // All or nothing: the rows are validated and checked for unique conflicts
+  // (among themselves too) first, then published as one version under a
+  // single write lock
+  Status insertRows(const std::string &table,
+                    const std::vector<Row> &rows) override;
+  // All or nothing like insertRows(): keys are resolved through the
+  // primary key index under the write lock, and the updates and inserts
+  // commit as one version. A partitioned table upserts partition by
+  // partition.
+  Result<UpsertCounts> upsertRows(const std::string &table,
+                                  const std::vector<Row> &rows,
+                                  const UpsertMerger &merge = nullptr) override;
   Result<ResultSet> select(const std::string &table,
                            const std::vector<std::string> &columns,
                            const std::optional<Predicate> &where) override;
+  // Converts rows from a snapshot one batch at a time, holding no lock
+  Status scan(const std::string &table, const std::vector<std::string> &columns,
+              const std::optional<Predicate> &where, const BatchSink &sink,
+              size_t batchRows) override;
+  // Walks an Ordered index on the order column from the column's bounds
+  // in `where` (its top-level conjuncts) and stops after the rows needed,
+  // so a page costs its own rows rather than a scan of the table. Falls
+  // back to scan() without such an index, when the column is nullable and
+  // `where` does not compare it (null cells are not indexed), or when the
+  // scan spans partitions.
+  Status scanOrdered(const std::string &table,
+                     const std::vector<std::string> &columns,
+                     const std::optional<Predicate> &where,
+                     const ScanOrder &order, const BatchSink &sink,
+                     size_t batchRows = kDefaultBatchRows) override;
   std::vector<std::string> listTables() const override;
+  Result<TableSchema> getTableSchema(const std::string &table) override;
+  // Published row versions, including dead ones awaiting compaction
+  std::optional<size_t>
+  estimateRowCount(const std::string &table) const override;
+  std::optional<size_t>
+  estimateScanCost(const std::string &table,
+                   const std::optional<Predicate> &where) const override;
+  std::shared_ptr<const TableStatistics>
+  getTableStatistics(const std::string &table) const override;
+  std::string
+  explainAccess(const std::string &table,
+                const std::optional<Predicate> &where) const override;
+  std::string explainOrderedAccess(const std::string &table,
+                                   const std::optional<Predicate> &where,
+                                   const ScanOrder &order) const override;
+  std::optional<uint64_t>
+  tableVersion(const std::string &table) const override;
   Status dropTable(const std::string &table) override;
   Result<size_t> deleteRows(const std::string &table,
                             const std::optional<Predicate> &where) override;
@@ -305,23 +816,216 @@ public:
                  &assignments,
              const std::optional<Predicate> &where) override;
   Status truncateTable(const std::string &table) override;
+  /**
+   * Zero-copy SELECT: same arguments and errors as select(), but returns a
+   * ResultView that borrows the stored rows instead of cloning every
+   * projected cell. The view keeps its snapshot alive until destroyed.
+   */
+  Result<ResultView>
+  selectView(const std::string &table, const std::vector<std::string> &columns,
+             const std::optional<Predicate> &where = std::nullopt);
+
+  // The primary key column (if any) is indexed automatically (Ordered).
+  Status createIndex(const std::string &table, const std::string &column,
+                     IndexType type) override;
+
+  /**
+   * Reclaim dead row versions (superseded by updates or deleted) in every
+   * table and return how many were reclaimed. Readers are never blocked;
+   * writers to a table wait while it is compacted. Tables are also
+   * compacted automatically once dead versions outnumber live rows.
+   */
+  size_t collectGarbage();
+  // Run collectGarbage() every `interval` on a background thread until
+  // stopBackgroundGc() or destruction. Restarts the thread if running.
+  void startBackgroundGc(std::chrono::milliseconds interval);
+  void stopBackgroundGc();
+
+  /**
+   * Threads one select() or scan() uses. The positions it reads are split
+   * into morsels of ThreadPool::kMorselRows that the calling thread and
+   * workers of the shared ThreadPool filter and convert, and the rows come
+   * back in the order a serial scan returns them. 1 (the default) scans on
+   * the calling thread; 0 uses every hardware thread.
+   */
+  void setScanThreads(size_t threads) { scanThreads_.store(threads); }
+  size_t scanThreads() const { return scanThreads_.load(); }
+
+  /**
+   * Estimated bytes of a table's live rows (see MemoryAccount); versions
+   * superseded by updates or deletes are left out until compaction
+   * reclaims them. NotFound if the table does not exist.
+   */
+  Result<size_t> memoryUsage(const std::string &table) const;
+  // Budget for memoryUsage(), 0 for none: inserts and updates that would
+  // exceed it fail with ResourceExhausted. A budget below the current
+  // usage only stops the table from growing.
+  Status setMemoryBudget(const std::string &table, size_t bytes);
+
+  /**
+   * Publish every committed write to a ChangeFeed of `capacity` events
+   * from now on, for subscribeChanges(): one event per inserted, updated
+   * or deleted row, Truncate for truncateTable() and deleteRows() without
+   * a predicate, and Drop for dropTable(). Events are published under the
+   * table's write lock. Has no effect once enabled.
+   */
+  void enableChangeCapture(size_t capacity = ChangeFeed::kDefaultCapacity);
+  // nullptr until enableChangeCapture()
+  std::shared_ptr<ChangeFeed> changeFeed() const;
+  // Partitions of a partitioned table publish their rows as they commit;
+  // an insertRows() undone after a failure publishes the inserts and the
+  // deletes undoing them
+  Result<std::unique_ptr<ChangeSubscription>>
+  subscribeChanges(const std::string &table,
+                   const std::optional<Predicate> &where = std::nullopt)
+      override;
 
 private:
+  /**
+   * MVCC table state. Rows are stored as versions stamped with the commit
+   * versions that created and ended them; see RowVersionStore.
+   *
+   * Readers capture {store, size, version} (and their index candidates)
+   * under a shared publishMtx and then scan without any lock. Writers are
+   * serialized by writeMtx: they append new versions to unpublished slots
+   * and stamp the versions they end, then publish the new size and version
+   * (and index entries) under an exclusive publishMtx held only briefly.
+   */
   struct TableData {
     TableSchema schema;
-    std::vector<Row> rows; // deep rows
+    // `schema` compiled for the row checks of inserts and updates
+    CompiledValidator validator;
+    // Compact rows: one 16-byte InlineValue per cell, so inserts and
+    // predicate scans avoid per-cell heap objects and virtual dispatch
+    std::shared_ptr<RowVersionStore> store =
+        std::make_shared<RowVersionStore>();
+    size_t size = 0;     // published version count
+    Version version = 0; // last committed version
+    // Versions no longer visible at `version` (writer only)
+    size_t dead = 0;
+    // Secondary indexes keyed by column position; candidate positions refer
+    // to `store` and may include dead versions (callers re-check)
+    std::unordered_map<size_t, ColumnIndex> indexes;
+    // Per unique column: keys (Value::toString()) of present non-null
+    // values in live rows; aligned with schema columns, empty for
+    // non-unique columns (writer only)
+    std::vector<std::unordered_set<std::string>> uniqueKeys;
+    // Planner statistics of the live rows; written by the writer, read
+    // under statsMtx
+    StatisticsCollector stats;
+    // Bytes of the live versions, kept by commit() and reset()
+    MemoryAccount memory;
+    // Data version, restamped after each commit() and reset()
+    std::atomic<uint64_t> stamp{nextDataVersion()};
+    // Where commit() and reset() publish their changes, under `name`;
+    // set under writeMtx. A partition leaves Truncate to its parent.
+    std::string name;
+    std::shared_ptr<ChangeFeed> changes;
+    bool partition = false;
+    metrics::ProfiledMutex<std::mutex> writeMtx{
+        metrics::LockSite::RelationalTableWrite};
+    mutable metrics::ProfiledMutex<std::shared_mutex> publishMtx{
+        metrics::LockSite::RelationalTablePublish};
+    mutable metrics::ProfiledMutex<std::mutex> statsMtx{
+        metrics::LockSite::RelationalTableStats};
+
+    std::shared_ptr<const TableStatistics> statistics() const;
+    // Capture a read snapshot plus index candidates for `where` (nullopt
+    // when a full scan is needed); `path` describes the index lookups
+    RowSnapshot snapshot(const std::optional<Predicate> &where,
+                         std::optional<std::vector<size_t>> &candidates,
+                         std::string *path = nullptr) const;
+    // Capture a read snapshot plus, in `positions`, the rows scanOrdered()
+    // delivers for `order`, walking the Ordered index on its column (only
+    // checking that one can answer when `positions` is nullptr); false when
+    // none can. `examined` receives the index entries walked.
+    bool orderedSnapshot(const std::optional<Predicate> &where,
+                         const ScanOrder &order, RowSnapshot &snap,
+                         std::vector<size_t> *positions,
+                         size_t *examined = nullptr) const;
+    // Writer side (caller holds writeMtx) from here on.
+    // Positions of live versions matching `where`
+    std::vector<size_t> matchLive(const std::optional<Predicate> &where) const;
+    // Commit one new version: end the versions at `ended`, append `added`,
+    // then publish
+    void commit(const std::vector<size_t> &ended,
+                std::vector<InlineRow> added);
+    // Rewrite live versions into a fresh store; returns versions reclaimed
+    size_t compact();
+    // Drop every row
+    void reset();
   };
-  std::unordered_map<std::string, TableData> tables_;
-  // Simple mutex for dev/test thread-safety of the in-memory maps/vectors
-  mutable std::mutex mtx_;
+  // Lookup under the catalog lock; the returned pointer keeps the table
+  // alive after the catalog lock is released
+  std::shared_ptr<TableData> findTable(const std::string &table) const;
+
+  /**
+   * A table of createPartitionedTable(). Partition i holds the rows whose
+   * key hashes to i, as the only table (of the same name) of parts[i].
+   */
+  struct PartitionedTable {
+    TableSchema schema;
+    CompiledValidator validator; // of `schema`
+    size_t key = 0; // primary key column
+    std::vector<std::unique_ptr<InMemoryRelationalStorage>> parts;
+
+    size_t partitionOf(const Value *key) const;
+    // The one partition `where` can match when it pins the key by equality
+    std::optional<size_t> route(const std::optional<Predicate> &where) const;
+    // fn(part) on every partition `where` can match, in parallel; the
+    // error of the lowest failing partition, if any
+    Status forEach(const std::optional<Predicate> &where,
+                   const std::function<Status(size_t)> &fn) const;
+    // Rows of every partition `where` can match, as scan() batches in
+    // partition order; at least one batch
+    Result<std::vector<RowBatch>>
+    collect(const std::string &table, const std::vector<std::string> &columns,
+            const std::optional<Predicate> &where, size_t batchRows) const;
+  };
+  std::shared_ptr<PartitionedTable>
+  findPartitioned(const std::string &table) const;
+  // Capture changes into `feed` unless already capturing
+  void useChangeFeed(const std::shared_ptr<ChangeFeed> &feed);
+  // Publish a Truncate or Drop of `table` if capturing; mtx_ held
+  void publishTableChange(ChangeEvent::Kind kind, const std::string &table);
+
+  std::unordered_map<std::string, std::shared_ptr<TableData>> tables_;
+  std::unordered_map<std::string, std::shared_ptr<PartitionedTable>>
+      partitioned_;
+  // Set by the first createPartitionedTable(); until then ordinary tables
+  // skip the partitioned_ lookup
+  std::atomic<bool> anyPartitioned_{false};
+  // Guards the tables_ and partitioned_ catalogs (shared for lookups,
+  // exclusive for create/drop) and changes_; row data is guarded by each
+  // table's locks, which are taken after it when both are held
+  mutable metrics::ProfiledMutex<std::shared_mutex> mtx_{
+      metrics::LockSite::RelationalCatalog};
+  std::shared_ptr<ChangeFeed> changes_;
+  // The storage is a partition of a partitioned table
+  bool partition_ = false;
+
+  std::atomic<size_t> scanThreads_{1};
+
+  std::thread gcThread_;
+  std::mutex gcMtx_;
+  std::condition_variable gcCv_;
+  bool gcStop_ = false;
 };
 
 /** @ingroup DocumentAPI */
 class InMemoryDocumentStorage final : public DocumentStorage {
 public:
-  InMemoryDocumentStorage() = default;
+  // Shaped: documents with the same field set share one interned
+  // field-name list and keep their values in a flat InlineValue array,
+  // instead of a field-name map each. Collections with more than 1024
+  // distinct field sets keep the rest as maps.
+  explicit InMemoryDocumentStorage(
+      DocumentLayout layout = DocumentLayout::Map)
+      : layout_(layout) {}
   ~InMemoryDocumentStorage() override = default;
 
+  DocumentLayout layout() const { return layout_; }
+
   Status createCollection(const std::string &collection,
                           const std::optional<DocumentSchema> &schema) override;
   Status dropCollection(const std::string &collection) override;
@@ -329,23 +1033,101 @@ public:
 
   Status put(const std::string &collection, const std::string &key,
              const Document &doc) override;
+  Status put(const std::string &collection, const std::string &key,
+             Document &&doc) override;
   Result<Document> get(const std::string &collection,
                        const std::string &key) override;
   Status erase(const std::string &collection, const std::string &key) override;
+  // Edit the stored documents in place under the collection's write lock:
+  // only the touched fields are validated, checked for uniqueness and
+  // reindexed. updateWhere() patches all matches or none.
+  Status patch(const std::string &collection, const std::string &key,
+               const std::vector<DocUpdate> &ops) override;
+  Result<size_t> updateWhere(const std::string &collection,
+                             const std::optional<DocPredicate> &where,
+                             const std::vector<DocUpdate> &ops) override;
   Result<size_t> count(const std::string &collection) const override;
+  Result<std::optional<DocumentSchema>>
+  getCollectionSchema(const std::string &collection) const override;
   Result<std::vector<std::pair<std::string, Document>>>
   query(const std::string &collection, const std::vector<std::string> &fields,
         const std::optional<DocPredicate> &where) override;
+  // Views read the stored documents in place, under the collection's read
+  // lock
+  Status queryVisit(const std::string &collection,
+                    const std::vector<std::string> &fields,
+                    const std::optional<DocPredicate> &where,
+                    const DocumentVisitor &fn) override;
+  Status createIndex(const std::string &collection, const std::string &field,
+                     IndexType type) override;
+
+  // Threads one query() uses to match and copy documents, in morsels of
+  // kMorselDocuments on the shared ThreadPool; results keep the serial
+  // order. 1 (the default) queries on the calling thread; 0 uses every
+  // hardware thread.
+  static constexpr size_t kMorselDocuments = 4096;
+  void setScanThreads(size_t threads) { scanThreads_.store(threads); }
+  size_t scanThreads() const { return scanThreads_.load(); }
+
+  // Estimated bytes of a collection's documents and keys; NotFound if it
+  // does not exist
+  Result<size_t> memoryUsage(const std::string &collection) const;
+  // Budget for memoryUsage(), 0 for none: puts that would exceed it fail
+  // with ResourceExhausted
+  Status setMemoryBudget(const std::string &collection, size_t bytes);
+
+  // Publish every put, erase and dropCollection() to a ChangeFeed of
+  // `capacity` events from now on, under the collection's write lock, for
+  // subscribeChanges(). Has no effect once enabled.
+  void enableChangeCapture(size_t capacity = ChangeFeed::kDefaultCapacity);
+  // nullptr until enableChangeCapture()
+  std::shared_ptr<ChangeFeed> changeFeed() const;
+  Result<std::unique_ptr<ChangeSubscription>>
+  subscribeChanges(const std::string &collection) override;
 
 private:
   struct CollectionData {
     std::optional<DocumentSchema> schema;
-    std::unordered_map<std::string, Document> docs; // key -> Document
+    // `*schema` compiled for put(); accepts anything without one
+    CompiledValidator validator;
+    std::unordered_map<std::string, StoredDocument> docs; // key -> document
+    // Shapes of the collection's documents under DocumentLayout::Shaped
+    ShapeTable shapes;
+    // Per unique schema field: value key (Value::toString()) -> owning
+    // document key, for O(1) uniqueness checks on put
+    std::unordered_map<std::string,
+                       std::unordered_map<std::string, std::string>>
+        uniqueValues;
+    // field -> secondary index over the documents' keys in `docs`
+    std::unordered_map<std::string, FieldIndex> indexes;
+    // Numbers of the documents in `docs` for Bitmap indexes; set once the
+    // first one is created
+    std::unique_ptr<DocOrdinals> ordinals;
+    // Bytes of `docs`, kept by put() and erase()
+    MemoryAccount memory;
+    // Where put() and erase() publish their changes; set under mtx
+    std::shared_ptr<ChangeFeed> changes;
+    // Per-collection reader/writer lock: shared for reads, exclusive for
+    // writes
+    mutable metrics::ProfiledMutex<std::shared_mutex> mtx{
+        metrics::LockSite::DocumentCollection};
   };
+  std::shared_ptr<CollectionData>
+  findCollection(const std::string &collection) const;
+  // Shared by both put() overloads; Doc is const Document & or Document
+  template <typename Doc>
+  Status putDocument(const std::string &collection, const std::string &key,
+                     Doc &&doc);
 
-  std::unordered_map<std::string, CollectionData> data_;
-  // Simple mutex for dev/test thread-safety of the in-memory maps
-  mutable std::mutex mtx_;
+  DocumentLayout layout_;
+  std::atomic<size_t> scanThreads_{1};
+  std::unordered_map<std::string, std::shared_ptr<CollectionData>> data_;
+  // Guards the data_ catalog (shared for lookups, exclusive for
+  // create/drop) and changes_; documents are guarded by each
+  // CollectionData::mtx, which is taken after it when both are held
+  mutable metrics::ProfiledMutex<std::shared_mutex> mtx_{
+      metrics::LockSite::DocumentCatalog};
+  std::shared_ptr<ChangeFeed> changes_;
 };
 
 } // namespace kadedb
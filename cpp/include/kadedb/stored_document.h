@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "kadedb/schema.h" // Document
+#include "kadedb/value.h"
+
+namespace kadedb {
+
+/**
+ * How InMemoryDocumentStorage holds documents.
+ *  - Map:    each document keeps its own Document (field-name map)
+ *  - Shaped: documents with the same field set share an interned shape
+ *            and store their values in a flat InlineValue slot array
+ */
+enum class DocumentLayout { Map, Shaped };
+
+/**
+ * A document field as stored: either a Value of a Document or an
+ * InlineValue slot. A default-constructed FieldRef is a missing field; a
+ * present field may still hold no value (a nullptr Value or an empty
+ * slot).
+ */
+class FieldRef {
+public:
+  FieldRef() = default;
+  explicit FieldRef(const Value *v) : found_(true), value_(v) {}
+  explicit FieldRef(const InlineValue *v) : found_(true), inline_(v) {}
+
+  bool found() const { return found_; }
+  bool hasValue() const { return value_ || (inline_ && !inline_->empty()); }
+  // Caller must ensure hasValue()
+  ValueType type() const { return value_ ? value_->type() : inline_->type(); }
+  int compare(const Value &rhs) const {
+    return value_ ? value_->compare(rhs) : inline_->compare(rhs);
+  }
+  std::string toString() const {
+    return value_ ? value_->toString() : inline_->toString();
+  }
+  // Typed reads without cloning a Value; caller must ensure hasValue(). As
+  // with Value::asX, a type mismatch throws.
+  int64_t asInt() const { return value_ ? value_->asInt() : inline_->asInt(); }
+  double asFloat() const {
+    return value_ ? value_->asFloat() : inline_->asFloat();
+  }
+  bool asBool() const { return value_ ? value_->asBool() : inline_->asBool(); }
+  std::string asString() const {
+    return value_ ? value_->asString() : inline_->asString();
+  }
+
+  // Owned copy, nullptr without a value
+  std::unique_ptr<Value> clone() const;
+  // Empty without a value
+  InlineValue toInline() const;
+
+private:
+  bool found_ = false;
+  const Value *value_ = nullptr;
+  const InlineValue *inline_ = nullptr;
+};
+
+/**
+ * Interned document shapes: the sorted field names of a document, where a
+ * field's slot is its position. Shapes live as long as the table, and at
+ * most `maxShapes` are interned so that irregular collections do not grow
+ * the table without bound.
+ */
+class ShapeTable {
+public:
+  using Shape = std::vector<std::string>;
+
+  explicit ShapeTable(size_t maxShapes = 1024) : maxShapes_(maxShapes) {}
+
+  // Shape of `doc`, or nullptr once the table is full and it is new
+  const Shape *intern(const Document &doc);
+  size_t size() const { return shapes_.size(); }
+
+private:
+  size_t maxShapes_;
+  std::set<Shape> shapes_;
+};
+
+/**
+ * One document as held by InMemoryDocumentStorage: slot values over a
+ * shared shape, or a plain Document when it has none (Map layout, or a
+ * full ShapeTable).
+ */
+class StoredDocument {
+public:
+  StoredDocument() = default;
+  StoredDocument(StoredDocument &&) noexcept = default;
+  StoredDocument &operator=(StoredDocument &&) noexcept = default;
+
+  // Deep copy of `doc`; shaped when `shapes` is set and has room
+  static StoredDocument make(const Document &doc, ShapeTable *shapes);
+  // As above, but a map-held document takes over `doc` instead of copying
+  static StoredDocument make(Document &&doc, ShapeTable *shapes);
+
+  bool shaped() const { return shape_ != nullptr; }
+  // Binary search over the shape's names, or a map lookup
+  FieldRef field(const std::string &name) const;
+  // fn(name, field) for each field, in no particular order
+  void forEachField(
+      const std::function<void(const std::string &, FieldRef)> &fn) const;
+  // Deep copy as a Document
+  Document toDocument() const;
+  // Estimated bytes held beyond the object itself; the shape is shared
+  // and not counted
+  size_t memoryBytes() const;
+
+  // In-place edits, returning the change in memoryBytes(). set() stores a
+  // copy of `v` (nullptr: a field without a value), adding the field when
+  // missing; unset() removes it if present. A shaped document whose field
+  // set changes is reshaped through `shapes`, which copies its values.
+  std::ptrdiff_t set(const std::string &name, const Value *v,
+                     ShapeTable *shapes);
+  std::ptrdiff_t unset(const std::string &name, ShapeTable *shapes);
+
+private:
+  // Shape of `doc` and slot values copied from it; false without a shape
+  bool makeShaped(const Document &doc, ShapeTable *shapes);
+
+  const ShapeTable::Shape *shape_ = nullptr;
+  std::unique_ptr<InlineValue[]> values_; // one per shape field
+  Document map_;
+};
+
+/**
+ * Read-only view of a stored or owned document, optionally restricted to
+ * projected fields. It borrows the document, so it is only valid for the
+ * duration of the call that handed it out.
+ */
+class DocumentView {
+public:
+  // `fields`: projection, nullptr or empty for all fields
+  explicit DocumentView(const StoredDocument &doc,
+                        const std::vector<std::string> *fields = nullptr)
+      : stored_(&doc), fields_(projection(fields)) {}
+  explicit DocumentView(const Document &doc,
+                        const std::vector<std::string> *fields = nullptr)
+      : doc_(&doc), fields_(projection(fields)) {}
+
+  // Missing when absent or projected out
+  FieldRef field(const std::string &name) const;
+  // fn(name, field) for each field in the view: in projection order, or in
+  // no particular order without a projection
+  void forEachField(
+      const std::function<void(const std::string &, FieldRef)> &fn) const;
+  // Deep copy of the fields in the view
+  Document toDocument() const;
+
+private:
+  static const std::vector<std::string> *
+  projection(const std::vector<std::string> *fields) {
+    return fields && !fields->empty() ? fields : nullptr;
+  }
+  FieldRef lookup(const std::string &name) const;
+
+  const StoredDocument *stored_ = nullptr;
+  const Document *doc_ = nullptr;
+  const std::vector<std::string> *fields_;
+};
+
+} // namespace kadedb
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace kadedb {
+
+/**
+ * The distinct strings of a column, each interned once under a dense
+ * 32-bit code given in order of first appearance.
+ *
+ * A column of few distinct values (tags, codes, statuses) stores one code
+ * per row instead of the bytes, and a comparison against a constant is
+ * evaluated once per entry and then looked up by code (see
+ * scan::lookupCodes), so it never touches string bytes per row.
+ */
+class StringDictionary {
+public:
+  static constexpr uint32_t npos = UINT32_MAX;
+
+  StringDictionary() = default;
+  StringDictionary(const StringDictionary &other);
+  StringDictionary &operator=(const StringDictionary &other);
+  StringDictionary(StringDictionary &&) = default;
+  StringDictionary &operator=(StringDictionary &&) = default;
+
+  // Code of `s`, adding it if new
+  uint32_t intern(std::string_view s);
+  // Code of `s`, or npos if absent
+  uint32_t find(std::string_view s) const;
+
+  const std::string &at(uint32_t code) const { return entries_[code]; }
+  size_t size() const { return entries_.size(); }
+  bool empty() const { return entries_.empty(); }
+  void clear();
+
+  // Approximate heap bytes owned
+  size_t memoryBytes() const;
+
+private:
+  // A deque keeps entries in place, so the index can view them
+  std::deque<std::string> entries_;
+  std::unordered_map<std::string_view, uint32_t> codes_;
+};
+
+} // namespace kadedb
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace kadedb {
+
+/**
+ * Worker threads shared by the parallel scans of the storage engines.
+ *
+ * parallelFor() splits [0, n) into morsels of `grain` items that the calling
+ * thread and up to `threads - 1` workers claim one at a time from a shared
+ * counter, so a thread that finishes early takes the next morsel instead of
+ * idling behind a slow one. The caller always works too and only waits for
+ * morsels already claimed, so nested and concurrent calls make progress
+ * even when every worker is busy. submit() queues a task that runs on a
+ * worker alone, such as an asynchronous query. Workers start on first use
+ * and stay until the pool is destroyed, which runs the queued tasks first.
+ *
+ * On a machine with several NUMA nodes, worker i is kept on the CPUs of
+ * node i % nodes, and the morsels are split into one contiguous share per
+ * node. Threads claim from their own node's share first and then help
+ * the others, so a morsel range is scanned by the same node from call to
+ * call and the pages its threads first touched stay local.
+ */
+class ThreadPool {
+public:
+  // Rows per morsel of a parallel table scan
+  static constexpr size_t kMorselRows = 64 * 1024;
+  // Most workers one pool starts
+  static constexpr size_t kMaxWorkers = 64;
+
+  // fn(morsel, begin, end) for morsel `morsel` covering [begin, end)
+  using MorselFn = std::function<void(size_t, size_t, size_t)>;
+
+  ThreadPool() = default;
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // The process-wide pool; never destroyed
+  static ThreadPool &shared();
+  // `threads`, or the hardware concurrency when 0
+  static size_t resolve(size_t threads);
+
+  // fn over the morsels of [0, n) on up to `threads` threads (resolved as
+  // above), returning once all are done; fn must not throw
+  void parallelFor(size_t n, size_t grain, size_t threads, const MorselFn &fn);
+
+  // Run `task` on a worker, starting one per hardware thread if needed;
+  // tasks start in submission order. `task` must not throw.
+  void submit(std::function<void()> task);
+
+  // Workers started so far
+  size_t workers() const;
+
+private:
+  struct Job;
+
+  // Worker `index` of the pool
+  void workerLoop(size_t index);
+
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  // Submitted tasks, and one entry per worker a parallelFor() wants (stale
+  // ones find no morsel left)
+  std::deque<std::function<void()>> queue_;
+  std::vector<std::thread> workers_;
+  bool stop_ = false;
+};
+
+} // namespace kadedb
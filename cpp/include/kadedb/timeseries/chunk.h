@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "kadedb/schema.h"
+#include "kadedb/string_dictionary.h"
+#include "kadedb/value.h"
+
+namespace kadedb {
+
+/**
+ * An immutable block of time-series rows stored column by column in
+ * compressed form, for the sealed partitions of a series.
+ *
+ * Each column picks the encoding of its type:
+ * - Integer columns (the timestamp included): delta-of-delta in
+ *   variable-width buckets, so a regular interval costs one bit per row
+ * - Float columns: Gorilla XOR against the previous value
+ * - String columns (tags): a per-chunk dictionary and bit-packed codes
+ * - Boolean columns: one bit per row
+ *
+ * Null cells are flagged in a per-column bitmap, kept only when the
+ * column has one, and repeat the previous value in the stream. A column
+ * holding cells of another type than its own (Integer cells of a Float
+ * column, NullValues) is kept as plain InlineValues instead, so every row
+ * decodes to exactly the cells it was encoded from.
+ */
+class TimeSeriesChunk {
+public:
+  TimeSeriesChunk() = default;
+
+  // Encode `rows`, each with one cell per entry of `types`, keeping their
+  // order
+  static TimeSeriesChunk encode(const std::vector<ColumnType> &types,
+                                const std::vector<InlineRow> &rows);
+
+  size_t rowCount() const { return rows_; }
+  bool empty() const { return rows_ == 0; }
+
+  // Append the rows, in encoding order, to `out`
+  void decode(std::vector<InlineRow> &out) const;
+  // The cells of column `column`, one per row, replacing `out`
+  void decodeColumn(size_t column, std::vector<InlineValue> &out) const;
+
+  // Approximate heap bytes owned by the chunk
+  size_t memoryBytes() const;
+
+  // Append the chunk's columns, as encoded, to `out` for deserialize()
+  void serialize(std::string &out) const;
+  // The chunk serialize() wrote into the `size` bytes at `data`; throws
+  // SerializationError when they are not one. The value streams are taken
+  // as they are: callers checksum what they store.
+  static TimeSeriesChunk deserialize(const char *data, size_t size);
+
+private:
+  enum class Encoding : uint8_t {
+    DeltaOfDelta,
+    GorillaXor,
+    Dictionary,
+    Bits,
+    Plain
+  };
+  struct Column {
+    Encoding encoding = Encoding::Plain;
+    std::vector<uint64_t> bits;  // the value stream
+    std::vector<uint64_t> nulls; // bit i: row i is null; empty: no nulls
+    StringDictionary dictionary;    // Dictionary codes
+    std::vector<InlineValue> plain; // Plain cells
+  };
+
+  static Column encodeColumn(ColumnType type,
+                             const std::vector<InlineRow> &rows,
+                             size_t column);
+
+  size_t rows_ = 0;
+  std::vector<Column> columns_;
+};
+
+} // namespace kadedb
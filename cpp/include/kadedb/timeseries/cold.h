@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "kadedb/status.h"
+#include "kadedb/timeseries/chunk.h"
+
+namespace kadedb {
+
+class ColdChunk;
+
+/**
+ * Recently read cold chunks, decoded, up to a capacity in bytes (by
+ * TimeSeriesChunk::memoryBytes()); the least recently used go first. A
+ * chunk larger than the whole capacity is read but not kept. Shared by
+ * the cold chunks of a storage; thread-safe.
+ */
+class ColdChunkCache {
+public:
+  static constexpr size_t kDefaultCapacityBytes = 64 * 1024 * 1024;
+
+  explicit ColdChunkCache(size_t capacityBytes = kDefaultCapacityBytes)
+      : capacity_(capacityBytes) {}
+
+  // Shrinking evicts right away
+  void setCapacity(size_t bytes);
+  size_t capacity() const;
+  // Bytes of the chunks held
+  size_t bytes() const;
+  // Reads served from the cache and from chunk files
+  uint64_t hits() const;
+  uint64_t misses() const;
+
+private:
+  friend class ColdChunk;
+  struct Entry {
+    const ColdChunk *owner;
+    std::shared_ptr<const TimeSeriesChunk> chunk;
+    size_t bytes;
+  };
+
+  // The chunk of `owner`, counted as a hit, or nullptr (a miss)
+  std::shared_ptr<const TimeSeriesChunk> find(const ColdChunk *owner);
+  void insert(const ColdChunk *owner,
+              std::shared_ptr<const TimeSeriesChunk> chunk);
+  void erase(const ColdChunk *owner);
+  // Drop the least recently used until within capacity; mtx_ held
+  void trim();
+
+  size_t capacity_;
+  size_t bytes_ = 0;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  // Most recently used first
+  std::list<Entry> lru_;
+  std::unordered_map<const ColdChunk *, std::list<Entry>::iterator> index_;
+  mutable std::mutex mtx_;
+};
+
+/**
+ * A sealed TimeSeriesChunk moved to a file of its own:
+ * [u32 magic 'KDTC'][u8 Codec][u64 raw size][u64 checksum of the raw
+ * bytes][TimeSeriesChunk::serialize() output compressed with Lz4High].
+ * The file lives as long as the object and is removed with it. load()
+ * maps the file and decodes it, unless the cache still holds the chunk.
+ */
+class ColdChunk {
+public:
+  /**
+   * Write `chunk` to a new file in `directory`, read back through `cache`.
+   * @return Status::Internal when the file cannot be written
+   */
+  static Result<std::shared_ptr<ColdChunk>>
+  write(const std::string &directory, const TimeSeriesChunk &chunk,
+        std::shared_ptr<ColdChunkCache> cache);
+
+  ~ColdChunk();
+  ColdChunk(const ColdChunk &) = delete;
+  ColdChunk &operator=(const ColdChunk &) = delete;
+
+  /**
+   * The chunk, from the cache or the file.
+   * @return Status::Internal when the file cannot be read or fails its
+   *         checksum
+   */
+  Result<std::shared_ptr<const TimeSeriesChunk>> load() const;
+
+  size_t rowCount() const { return rows_; }
+  // Size of the file
+  size_t fileBytes() const { return fileBytes_; }
+  const std::string &path() const { return path_; }
+
+private:
+  ColdChunk(std::string path, size_t rows, size_t fileBytes,
+            std::shared_ptr<ColdChunkCache> cache)
+      : path_(std::move(path)), rows_(rows), fileBytes_(fileBytes),
+        cache_(std::move(cache)) {}
+
+  std::string path_;
+  size_t rows_;
+  size_t fileBytes_;
+  std::shared_ptr<ColdChunkCache> cache_;
+};
+
+} // namespace kadedb
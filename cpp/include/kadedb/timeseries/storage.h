@@ -1,23 +1,84 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <optional>
+#include <set>
+#include <shared_mutex>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "kadedb/memory.h"
 #include "kadedb/result.h"
+#include "kadedb/scan_kernels.h"
 #include "kadedb/schema.h"
+#include "kadedb/statistics.h" // HyperLogLog, TDigest
 #include "kadedb/status.h"
 #include "kadedb/storage.h" // Predicate
+#include "kadedb/timeseries/chunk.h"
+#include "kadedb/timeseries/cold.h"
+#include "kadedb/timeseries/window.h"
+#include "kadedb/zone_map.h"
 
 namespace kadedb {
 
 enum class TimePartition { Hourly, Daily };
 
-enum class TimeAggregation { Avg, Min, Max, Sum, Count };
+// ApproxCountDistinct estimates the distinct non-null values of a bucket
+// with a HyperLogLog sketch; ApproxPercentile estimates a quantile of its
+// numeric values with a t-digest
+enum class TimeAggregation {
+  Avg,
+  Min,
+  Max,
+  Sum,
+  Count,
+  ApproxCountDistinct,
+  ApproxPercentile
+};
+
+// Statistics of a value column over one time bucket, as kept by a
+// continuous aggregate
+struct TimeBucketStats {
+  int64_t bucketStart = 0; // seconds
+  int64_t rows = 0;        // rows in the bucket
+  int64_t values = 0;      // non-null numeric values among them
+  double sum = 0.0;
+  double min = std::numeric_limits<double>::infinity();
+  double max = -std::numeric_limits<double>::infinity();
+  // Value cells of the first and last rows by timestamp (ties: first and
+  // last appended) and their timestamps; an empty cell is a null
+  InlineValue first;
+  InlineValue last;
+  int64_t firstTs = 0;
+  int64_t lastTs = 0;
+  // Every value was a Float cell (no Integer cells)
+  bool allFloat = true;
+  // Sketches of the non-null values (distinct) and of the numeric ones
+  // (digest), kept by continuous aggregates created with sketches and
+  // null otherwise. Copies share them until one of them changes.
+  std::shared_ptr<HyperLogLog> distinct;
+  std::shared_ptr<TDigest> digest;
+
+  // Start keeping (empty) sketches; before the first add()
+  void enableSketches();
+  // Count a row with value cell `v` at timestamp `ts`
+  void add(const InlineValue &v, int64_t ts);
+  // Fold in the statistics of a later or earlier bucket; the sketches stay
+  // only when both buckets have them
+  void merge(const TimeBucketStats &other);
+};
+
+// Series and rows selected by tag: every listed tag column holds the given
+// String value (tag column name -> value)
+using TagFilter = std::map<std::string, std::string>;
 
 class TimeSeriesStorage {
 public:
@@ -33,20 +94,227 @@ public:
 
   virtual Status append(const std::string &series, const Row &row) = 0;
 
+  /**
+   * Append `rows` to a series, with the checks of append() for each row.
+   * The default implementation appends row by row and stops at the first
+   * error.
+   */
+  virtual Status appendBatch(const std::string &series,
+                             const std::vector<Row> &rows);
+
+  /**
+   * Append `n` samples given column by column: ts[i] is the timestamp of
+   * sample i and values[c][i] its value in the c-th value column, in schema
+   * order. Every value column must be Float; tag columns are left null and
+   * must be nullable. The default implementation builds the rows and calls
+   * appendBatch().
+   */
+  virtual Status appendColumns(const std::string &series, const int64_t *ts,
+                               const double *const *values, size_t n);
+
   virtual Result<ResultSet>
   rangeQuery(const std::string &series, const std::vector<std::string> &columns,
              int64_t startInclusive, int64_t endExclusive,
              const std::optional<Predicate> &where = std::nullopt) = 0;
 
+  /**
+   * Streaming rangeQuery(): same arguments and errors, but matching rows are
+   * handed to `sink` in batches of at most `batchRows` rows (see
+   * RelationalStorage::scan). The default implementation slices
+   * rangeQuery().
+   */
+  virtual Status scan(const std::string &series,
+                      const std::vector<std::string> &columns,
+                      int64_t startInclusive, int64_t endExclusive,
+                      const std::optional<Predicate> &where,
+                      const RelationalStorage::BatchSink &sink,
+                      size_t batchRows = RelationalStorage::kDefaultBatchRows);
+
+  // Schema of a series; NotFound if it does not exist
+  virtual Result<TimeSeriesSchema>
+  getSeriesSchema(const std::string &series) const = 0;
+
+  // Partitioning a series was created with; NotFound if it does not exist.
+  // The default reports Hourly for every existing series.
+  virtual Result<TimePartition>
+  getSeriesPartition(const std::string &series) const;
+
+  // `agg` of `valueColumn` per bucket of `bucketWidth` from
+  // `startInclusive`. ApproxPercentile estimates `quantile`, which must lie
+  // in [0, 1]; the other aggregations ignore it.
   virtual Result<ResultSet>
   aggregate(const std::string &series, const std::string &valueColumn,
             TimeAggregation agg, int64_t startInclusive, int64_t endExclusive,
             int64_t bucketWidth, TimeGranularity bucketGranularity,
-            const std::optional<Predicate> &where = std::nullopt) = 0;
+            const std::optional<Predicate> &where = std::nullopt,
+            double quantile = 0.5) = 0;
+
+  /**
+   * `fn` of `valueColumn` at every row in [startInclusive, endExclusive)
+   * matching `where`, over a window of `width` in `widthGranularity`
+   * ending at the row (see TimeWindowFunction). The result holds the
+   * timestamp column and a Float `value` column, null where the row's
+   * value is null or the function is undefined; windows see only the rows
+   * selected. One pass over scan(), which must return the rows in
+   * timestamp order (FailedPrecondition otherwise). InvalidArgument for a
+   * non-numeric column or a width under one timestamp unit.
+   */
+  virtual Result<ResultSet>
+  window(const std::string &series, const std::string &valueColumn,
+         TimeWindowFunction fn, int64_t startInclusive, int64_t endExclusive,
+         int64_t width, TimeGranularity widthGranularity,
+         const std::optional<Predicate> &where = std::nullopt);
+
+  /**
+   * Register a continuous aggregate: TimeBucketStats of a numeric value
+   * column per bucket of `bucketWidth`, maintained as rows are appended and
+   * evicted by retention. AlreadyExists for the same column and width. The
+   * default implementation reports FailedPrecondition.
+   *
+   * With `sketches` each bucket also keeps a HyperLogLog and a t-digest
+   * of its values (about 4 KiB more per bucket), so ApproxCountDistinct
+   * and ApproxPercentile can be answered from it as well.
+   */
+  virtual Status createContinuousAggregate(const std::string &series,
+                                           const std::string &valueColumn,
+                                           int64_t bucketWidth,
+                                           TimeGranularity bucketGranularity,
+                                           bool sketches = false);
+  // Unregister a continuous aggregate; NotFound if there is none
+  virtual Status dropContinuousAggregate(const std::string &series,
+                                         const std::string &valueColumn,
+                                         int64_t bucketWidth,
+                                         TimeGranularity bucketGranularity);
+
+  /**
+   * Statistics of `valueColumn` per bucket of `bucketSeconds` (aligned to
+   * the epoch) over the rows in [startSec, endSec), read from a continuous
+   * aggregate whose width divides `bucketSeconds` and whose bucket
+   * boundaries both bounds fall on (INT64_MIN and INT64_MAX are open
+   * bounds). Buckets without rows are left out. NotFound when the series
+   * or such a continuous aggregate does not exist (default
+   * implementation: always).
+   */
+  virtual Result<std::vector<TimeBucketStats>>
+  continuousAggregate(const std::string &series,
+                      const std::string &valueColumn, int64_t bucketSeconds,
+                      int64_t startSec, int64_t endSec);
+
+  /**
+   * Statistics of each of `valueColumns` per TIME_BUCKET of `bucketWidth`
+   * timestamp units over the rows of rangeQuery() with the same range and
+   * `where`: a row at `ts` falls in the bucket starting at
+   * (ts / bucketWidth) * bucketWidth, truncated toward zero, and
+   * bucketStart, firstTs and lastTs are in timestamp units. The result
+   * holds a list per column, in the order given, of the same buckets in
+   * time order; buckets without rows are left out. With `sketches` the
+   * buckets also keep sketches of their values (see TimeBucketStats).
+   * InvalidArgument for an unknown column or a width under 1. The default
+   * implementation folds the rows of scan(), which must return them in
+   * timestamp order (FailedPrecondition otherwise).
+   */
+  virtual Result<std::vector<std::vector<TimeBucketStats>>>
+  bucketStats(const std::string &series,
+              const std::vector<std::string> &valueColumns,
+              int64_t startInclusive, int64_t endExclusive,
+              int64_t bucketWidth,
+              const std::optional<Predicate> &where = std::nullopt,
+              bool sketches = false);
+
+  /**
+   * Data version of `series`, like RelationalStorage::tableVersion():
+   * changes after every append and every row retention or eviction removes.
+   * std::nullopt when unsupported (the default) or the series is missing.
+   */
+  virtual std::optional<uint64_t>
+  seriesVersion(const std::string &series) const;
+
+  /**
+   * Subscribe to the rows appended to `series` from now on, as Insert
+   * events (see ChangeSubscription), only to those matching `where` when
+   * given, and to its Drop. Rows that retention or eviction removes are
+   * not reported.
+   * @return Status::NotFound if the series is missing;
+   *         Status::FailedPrecondition when the storage does not capture
+   *         changes (the default)
+   */
+  virtual Result<std::unique_ptr<ChangeSubscription>>
+  subscribeChanges(const std::string &series,
+                   const std::optional<Predicate> &where = std::nullopt);
+
+  /**
+   * Names of the series holding a row whose tag columns match `tags`, in
+   * name order. InvalidArgument for an empty filter. The default
+   * implementation queries every series.
+   */
+  virtual Result<std::vector<std::string>>
+  findSeriesByTags(const TagFilter &tags) const;
+
+  /**
+   * rangeQuery() over every series findSeriesByTags() selects, keeping the
+   * rows whose tags match: a leading "series" column names each row's
+   * series, then `columns`, which every selected series must have (all
+   * columns: the same ones). Rows come series by series in name order,
+   * each series oldest first. The default implementation queries the
+   * series one at a time.
+   */
+  virtual Result<ResultSet>
+  rangeQueryByTags(const TagFilter &tags,
+                   const std::vector<std::string> &columns,
+                   int64_t startInclusive, int64_t endExclusive,
+                   const std::optional<Predicate> &where = std::nullopt);
+
+  /**
+   * aggregate() over the rows of every series findSeriesByTags() selects
+   * whose tags match, bucketed together as if they were one series; the
+   * series must share the timestamp granularity. The default
+   * implementation reports FailedPrecondition.
+   */
+  virtual Result<ResultSet>
+  aggregateByTags(const TagFilter &tags, const std::string &valueColumn,
+                  TimeAggregation agg, int64_t startInclusive,
+                  int64_t endExclusive, int64_t bucketWidth,
+                  TimeGranularity bucketGranularity,
+                  const std::optional<Predicate> &where = std::nullopt,
+                  double quantile = 0.5);
+
+protected:
+  // The conjunction of a tag equality per entry of `tags` and `where`
+  static Predicate tagPredicate(const TagFilter &tags,
+                                const std::optional<Predicate> &where);
 };
 
+/**
+ * Time series held in memory, one partition per hour or day of data.
+ *
+ * Rows are appended to the head buffer of their partition as compact
+ * InlineRows. Once the newest row of a series lies past the end of a
+ * partition by the schema's lateness window, the partition is sealed: its
+ * rows are compressed into a TimeSeriesChunk. Until then late rows are
+ * inserted in place. Rows for a sealed partition collect in its head
+ * buffer and are merged into the chunk every kLateRowsPerSeal rows or when
+ * the next partition starts. Partitions are kept in time order and each
+ * holds its rows in timestamp order (equal timestamps in append order), so
+ * queries return rows oldest first and retention only ever removes rows
+ * from the front of the series: an append expires whole partitions and
+ * the leading rows of the oldest remaining one, at an amortized constant
+ * cost however long the series has been written to.
+ *
+ * String tag values are indexed: the catalog maps each tag value to the
+ * series holding it, and each series maps it to the partitions holding
+ * it, so queries by tag visit neither other series nor other partitions.
+ *
+ * With a cold tier (setColdTier()), sealed partitions that fall out of the
+ * hot window are written to compressed chunk files and their rows dropped
+ * from memory; only their zone maps and tag postings stay. Queries read
+ * them back through a cache of recently read chunks (setColdCacheBytes()),
+ * skipping those the zone map rules out as for any partition.
+ */
 class InMemoryTimeSeriesStorage final : public TimeSeriesStorage {
 public:
+  // Late rows a sealed partition buffers before they are compressed
+  static constexpr size_t kLateRowsPerSeal = 256;
+
   InMemoryTimeSeriesStorage() = default;
   ~InMemoryTimeSeriesStorage() override = default;
 
@@ -56,29 +324,398 @@ public:
   std::vector<std::string> listSeries() const override;
 
   Status append(const std::string &series, const Row &row) override;
+  // Every row is validated before any is appended: a batch is appended
+  // whole, under a single lock, or not at all. Errors name the failing row
+  Status appendBatch(const std::string &series,
+                     const std::vector<Row> &rows) override;
+  Status appendColumns(const std::string &series, const int64_t *ts,
+                       const double *const *values, size_t n) override;
 
   Result<ResultSet> rangeQuery(const std::string &series,
                                const std::vector<std::string> &columns,
                                int64_t startInclusive, int64_t endExclusive,
                                const std::optional<Predicate> &where) override;
 
+  Result<TimeSeriesSchema>
+  getSeriesSchema(const std::string &series) const override;
+  Result<TimePartition>
+  getSeriesPartition(const std::string &series) const override;
+
   Result<ResultSet> aggregate(const std::string &series,
                               const std::string &valueColumn,
                               TimeAggregation agg, int64_t startInclusive,
                               int64_t endExclusive, int64_t bucketWidth,
                               TimeGranularity bucketGranularity,
-                              const std::optional<Predicate> &where) override;
+                              const std::optional<Predicate> &where,
+                              double quantile = 0.5) override;
+
+  // aggregate() calls without a predicate are answered from a continuous
+  // aggregate when their buckets and start are made of its buckets and
+  // their end is too or lies past the newest row. The downsampling tiers
+  // of the retention policy are continuous aggregates of every numeric
+  // value column that outlive the raw rows: buckets whose rows were
+  // evicted are read from the finest tier still holding them. Tiers cannot
+  // be dropped. The approximate aggregations only use continuous
+  // aggregates with sketches, which tiers do not keep.
+  Status createContinuousAggregate(const std::string &series,
+                                   const std::string &valueColumn,
+                                   int64_t bucketWidth,
+                                   TimeGranularity bucketGranularity,
+                                   bool sketches = false) override;
+  Status dropContinuousAggregate(const std::string &series,
+                                 const std::string &valueColumn,
+                                 int64_t bucketWidth,
+                                 TimeGranularity bucketGranularity) override;
+  Result<std::vector<TimeBucketStats>>
+  continuousAggregate(const std::string &series,
+                      const std::string &valueColumn, int64_t bucketSeconds,
+                      int64_t startSec, int64_t endSec) override;
+  // One pass over the partitions in range, skipping those whose zone map
+  // rules `where` out; partitions are read like rangeQuery()'s, into
+  // buckets of their own merged in time order
+  Result<std::vector<std::vector<TimeBucketStats>>>
+  bucketStats(const std::string &series,
+              const std::vector<std::string> &valueColumns,
+              int64_t startInclusive, int64_t endExclusive,
+              int64_t bucketWidth, const std::optional<Predicate> &where,
+              bool sketches = false) override;
+  std::optional<uint64_t>
+  seriesVersion(const std::string &series) const override;
+
+  // Answered from the tag index; the queries by tag read the series on up
+  // to scanThreads() threads, a series per morsel, and combine their rows
+  // or partial aggregates
+  Result<std::vector<std::string>>
+  findSeriesByTags(const TagFilter &tags) const override;
+  Result<ResultSet> rangeQueryByTags(const TagFilter &tags,
+                                     const std::vector<std::string> &columns,
+                                     int64_t startInclusive,
+                                     int64_t endExclusive,
+                                     const std::optional<Predicate> &where)
+      override;
+  Result<ResultSet> aggregateByTags(const TagFilter &tags,
+                                    const std::string &valueColumn,
+                                    TimeAggregation agg,
+                                    int64_t startInclusive,
+                                    int64_t endExclusive, int64_t bucketWidth,
+                                    TimeGranularity bucketGranularity,
+                                    const std::optional<Predicate> &where,
+                                    double quantile = 0.5) override;
+
+  // Approximate bytes held by the rows of a series (chunks and head
+  // buffers) and its continuous aggregates, kept up to date by appends
+  // and retention; NotFound if it does not exist
+  Result<size_t> memoryUsage(const std::string &series) const;
+  // Budget for memoryUsage(), 0 for none. Under BudgetPolicy::Reject an
+  // append that would exceed it fails with ResourceExhausted; under
+  // EvictOldest appends go through and whole partitions are then evicted,
+  // oldest first, until the series fits or only the newest is left.
+  Status setMemoryBudget(const std::string &series, size_t bytes,
+                         BudgetPolicy policy = BudgetPolicy::Reject);
+
+  /**
+   * Keep only the partitions of a series ending within `hotSeconds` of its
+   * newest row in memory: sealed partitions older than that are written,
+   * once the lateness window has closed them, to a chunk file of their own
+   * in `directory` (see ColdChunk) and their rows evicted. rangeQuery(),
+   * aggregate() and the other reads return the same rows as before,
+   * reading cold partitions from disk. A late row for a cold partition, or
+   * retention trimming one, brings it back into memory; it is moved out
+   * again once sealed. The files are removed with their partitions and
+   * with the storage: the cold tier extends memory, it does not persist.
+   *
+   * Applies right away and then after every append. An empty `directory`
+   * turns the tier off, reading every cold partition back in. Under a
+   * memory budget, cold partitions count only their bookkeeping.
+   * @return Status::NotFound for an unknown series; Status::Internal when
+   *         a chunk file cannot be written or read back (the partitions
+   *         already moved stay cold)
+   */
+  Status setColdTier(const std::string &series, const std::string &directory,
+                     uint64_t hotSeconds);
+
+  struct ColdTierStats {
+    size_t coldPartitions = 0;
+    size_t coldRows = 0;
+    size_t fileBytes = 0; // chunk files on disk
+    // Why the last move to the cold tier after an append failed; empty
+    // when it did not
+    std::string lastError;
+  };
+  // NotFound if the series does not exist
+  Result<ColdTierStats> coldTierStats(const std::string &series) const;
+  // Capacity of the cache of decoded cold chunks shared by every series
+  // (default ColdChunkCache::kDefaultCapacityBytes), not charged to memory
+  // budgets
+  void setColdCacheBytes(size_t bytes) { coldCache_->setCapacity(bytes); }
+  const ColdChunkCache &coldCache() const { return *coldCache_; }
+
+  // Publish the rows of every append and each dropSeries() to a ChangeFeed
+  // of `capacity` events from now on, under the series' write lock, for
+  // subscribeChanges(). Has no effect once enabled.
+  void enableChangeCapture(size_t capacity = ChangeFeed::kDefaultCapacity);
+  // nullptr until enableChangeCapture()
+  std::shared_ptr<ChangeFeed> changeFeed() const;
+  Result<std::unique_ptr<ChangeSubscription>>
+  subscribeChanges(const std::string &series,
+                   const std::optional<Predicate> &where = std::nullopt)
+      override;
+
+  // Threads one rangeQuery(), aggregate() or bucketStats() uses: the
+  // partitions in range are read on the shared ThreadPool, a partition per
+  // morsel, and their rows or partial aggregates combined in time order. 1 (the default)
+  // reads on the calling thread; 0 uses every hardware thread.
+  void setScanThreads(size_t threads) { scanThreads_.store(threads); }
+  size_t scanThreads() const { return scanThreads_.load(); }
 
 private:
+  // One time partition: a sealed run and a head run of rows, each in
+  // timestamp order, merged on reads with ties going to the sealed rows.
+  // Retention drops rows from the front of either run by advancing an
+  // offset; the dropped rows are reclaimed once they make up half a run.
+  // A cold partition holds its sealed run in a file alone: `sealed` and
+  // `head` are empty and every row is in `cold`.
+  struct Partition {
+    TimeSeriesChunk sealed;
+    std::vector<InlineRow> head;
+    size_t sealedFront = 0; // dropped rows at the front of `sealed`
+    size_t headFront = 0;   // dropped rows at the front of `head`
+    // Timestamps of the sealed rows, decoded once retention reaches them
+    std::vector<int64_t> sealedTimes;
+    // Bytes of `sealed`, and of the cells of the rows in `head`
+    size_t sealedBytes = 0;
+    size_t headBytes = 0;
+    // Footprint when last measured, as charged to `account`
+    size_t bytes = 0;
+    MemoryAccount *account = nullptr;
+    // Zone map of the rows, widened by insert() and rebuilt when dropped
+    // rows are reclaimed; scans skip partitions it rules out
+    ZoneMap zone;
+    // The rows moved to the cold tier, and the oldest one's timestamp
+    std::shared_ptr<ColdChunk> cold;
+    int64_t coldFrontTime = 0;
+
+    size_t rowCount() const {
+      return (cold ? cold->rowCount() : sealed.rowCount()) - sealedFront +
+             head.size() - headFront;
+    }
+    // The sealed run: `sealed`, or the chunk read back from `cold`
+    Result<std::shared_ptr<const TimeSeriesChunk>> sealedRun() const;
+    // Seal every row into a chunk file in `directory`, evicting them
+    Status freeze(const std::string &directory,
+                  const std::shared_ptr<ColdChunkCache> &cache,
+                  const std::vector<ColumnType> &types, size_t tsIdx);
+    // Read the rows of a cold partition back into memory; the file goes
+    Status thaw();
+    // insert() through dropOldest() take a partition that is not cold,
+    // but for frontTime()
+    // Add a row to the head, keeping it in timestamp order
+    void insert(InlineRow row, size_t tsIdx);
+    // Every row, in timestamp order
+    std::vector<InlineRow> rows(size_t tsIdx) const;
+    // Compress the head rows into the chunk
+    void seal(const std::vector<ColumnType> &types, size_t tsIdx);
+    // Drop the rows older than `cutoff` seconds; returns how many
+    size_t dropExpired(int64_t cutoff, TimeGranularity granularity,
+                       const std::vector<ColumnType> &types, size_t tsIdx);
+    // Timestamp of the oldest row; rowCount() > 0
+    int64_t frontTime(size_t tsIdx);
+    // Drop the `n` oldest rows; n < rowCount()
+    void dropOldest(size_t n, const std::vector<ColumnType> &types,
+                    size_t tsIdx);
+    // Fold the rows in [startSec, endSec) into buckets of `widthSec`
+    // seconds from startSec with the bucket kernel, appended to `out` per
+    // run. The chunk decodes the timestamp and value columns only; without
+    // `withValues` rows are only counted. Reads a cold run back.
+    Status aggregateBetween(size_t tsIdx, size_t valIdx, TimeGranularity g,
+                          int64_t startSec, int64_t endSec, int64_t widthSec,
+                          bool withValues,
+                          std::vector<scan::BucketAggregate> &out) const;
+    // fn(const InlineRow &) for every row, in timestamp order
+    template <typename Fn> Status forEachRow(size_t tsIdx, Fn &&fn) const {
+      auto never = [](int64_t) { return false; };
+      return forEachRowBetween(tsIdx, never, never, fn);
+    }
+    // fn(const InlineRow &) in timestamp order for the rows between those
+    // before the range, found by binary search, and the first row past it:
+    // before(ts) and after(ts) must be monotonic in ts. Fails only when a
+    // cold run cannot be read back.
+    template <typename Before, typename After, typename Fn>
+    Status forEachRowBetween(size_t tsIdx, Before before, After after,
+                             Fn &&fn) const {
+      auto firstIn = [&](const std::vector<InlineRow> &run, size_t from) {
+        return static_cast<size_t>(
+            std::partition_point(run.begin() + static_cast<ptrdiff_t>(from),
+                                 run.end(),
+                                 [&](const InlineRow &r) {
+                                   return before(timeOf(r, tsIdx));
+                                 }) -
+            run.begin());
+      };
+      auto run = sealedRun();
+      if (!run.hasValue())
+        return run.status();
+      std::vector<InlineRow> unpacked;
+      run.value()->decode(unpacked);
+      size_t i = firstIn(unpacked, sealedFront);
+      size_t j = firstIn(head, headFront);
+      while (i < unpacked.size() || j < head.size()) {
+        const bool fromSealed =
+            j == head.size() ||
+            (i < unpacked.size() &&
+             timeOf(unpacked[i], tsIdx) <= timeOf(head[j], tsIdx));
+        const InlineRow &row = fromSealed ? unpacked[i++] : head[j++];
+        if (after(timeOf(row, tsIdx)))
+          break;
+        fn(row);
+      }
+      return Status::OK();
+    }
+
+  private:
+    static int64_t timeOf(const InlineRow &row, size_t tsIdx) {
+      return row.values()[tsIdx].asInt();
+    }
+    const std::vector<int64_t> &sealedTimesFor(size_t tsIdx);
+    // Reclaim the dropped rows of a run once they are half of it
+    void compact(const std::vector<ColumnType> &types);
+    // Measure the footprint again and charge the change to `account`
+    void remeasure();
+  };
+
+  // A continuous aggregate of one value column. Buckets that lost rows to
+  // retention are `partial`: reads recompute them from the rows left.
+  // A downsampling `tier` keeps its buckets whole after their rows are
+  // evicted, and drops those older than its own TTL.
+  struct Rollup {
+    std::string column;
+    size_t valIdx = 0;
+    int64_t width = 0; // seconds
+    std::map<int64_t, TimeBucketStats> buckets;
+    std::set<int64_t> partial;
+    bool tier = false;
+    int64_t ttl = 0; // seconds; 0 = kept as long as the series
+    // Start of the oldest bucket a tier still holds whole
+    int64_t retainedFrom = std::numeric_limits<int64_t>::min();
+    bool sketches = false; // buckets keep sketches
+  };
+
   struct SeriesData {
     TimeSeriesSchema schema;
     TableSchema tableSchema;
+    CompiledValidator validator;   // of `tableSchema`, for appends
+    std::vector<ColumnType> types; // column types, schema order
     TimePartition partition = TimePartition::Hourly;
-    std::unordered_map<int64_t, std::vector<Row>> buckets;
+    // Partitions by start second, oldest first
+    std::map<int64_t, Partition> buckets;
+    // Rows across all partitions
+    size_t rowCount = 0;
+    // Start of the newest partition appended to
+    std::optional<int64_t> newest;
+    // Older partitions still inside the lateness window, never sealed
+    std::set<int64_t> open;
+    // Newest timestamp appended, in seconds; the end of the TTL window
+    int64_t latestSec = std::numeric_limits<int64_t>::min();
+    // Sealed partitions with late rows in their head buffer
+    std::set<int64_t> unsealed;
+    // Cold tier (setColdTier()); an empty directory when off
+    std::string coldDirectory;
+    int64_t hotSeconds = 0;
+    // Partitions starting before it were moved out or passed over
+    int64_t coldThrough = std::numeric_limits<int64_t>::min();
+    // Cold partitions read back for late rows, to move out again
+    std::set<int64_t> thawed;
+    std::string coldError;
+    // No row newer than this second was evicted: raw rows answer the
+    // buckets after it in full
+    int64_t evictedThroughSec = std::numeric_limits<int64_t>::min();
+    std::vector<Rollup> rollups;
+    // Bytes of the partitions (Partition::account) and the memory budget
+    MemoryAccount memory;
+    BudgetPolicy budgetPolicy = BudgetPolicy::Reject;
+    // Per tag column (tag order): String value -> starts of the
+    // partitions holding it. A partition stays listed until it is dropped
+    // whole.
+    std::vector<std::unordered_map<std::string, std::set<int64_t>>>
+        tagPartitions;
+    // Tag values a series gained or lost since the catalog's tag index was
+    // last brought up to date (tag order, value)
+    std::vector<std::pair<size_t, std::string>> tagChanges;
+    // Data version, restamped by appends and enforceRetention()
+    std::atomic<uint64_t> stamp{nextDataVersion()};
+    // Where appends publish their rows; set under mtx
+    std::shared_ptr<ChangeFeed> changes;
+    // Per-series reader/writer lock: shared for queries, exclusive for
+    // appends
+    mutable metrics::ProfiledMutex<std::shared_mutex> mtx{
+        metrics::LockSite::TimeSeriesSeries};
   };
+  // Partial aggregate of one bucket, see aggregateSeries()
+  struct BucketState;
+  using BucketStates = std::unordered_map<int64_t, BucketState>;
+
+  std::shared_ptr<SeriesData> findSeries(const std::string &series) const;
+  // Bring the tag index up to date with the tag changes of `sd`, unless
+  // the series was dropped; takes mtx_ and then sd.mtx
+  void publishTagChanges(const std::string &series,
+                         const std::shared_ptr<SeriesData> &sdp);
+  // Starts of the partitions of `sd` holding every tag value of `tags`;
+  // sd.mtx held
+  static std::set<int64_t> tagCandidates(const SeriesData &sd,
+                                         const TagFilter &tags);
+  // rangeQuery() of a series on `threads` threads, reading only the
+  // partitions in `only` when given and led by a "series" column holding
+  // `*series` when given; sd.mtx held
+  Result<ResultSet> querySeries(const SeriesData &sd,
+                                const std::vector<std::string> &columns,
+                                int64_t startInclusive, int64_t endExclusive,
+                                const std::optional<Predicate> &where,
+                                const std::set<int64_t> *only, size_t threads,
+                                const std::string *series) const;
+  // Fold the rows of aggregate() into `acc` by bucket start, reading only
+  // the partitions in `only` when given; sd.mtx held
+  Status aggregateSeries(const SeriesData &sd, const std::string &valueColumn,
+                         TimeAggregation agg, int64_t startInclusive,
+                         int64_t endExclusive, int64_t bucketWidth,
+                         TimeGranularity bucketGranularity,
+                         const std::optional<Predicate> &where,
+                         const std::set<int64_t> *only, size_t threads,
+                         BucketStates &acc) const;
+  // aggregate()'s result of the buckets in `acc`
+  static ResultSet bucketResult(const BucketStates &acc, TimeAggregation agg,
+                                double quantile);
+  // Validate all `rows`, then append them and enforce retention once;
+  // `batch` prefixes errors with the row number
+  Status appendRows(const std::string &series, std::vector<InlineRow> rows,
+                    bool batch);
+  // Add a validated row to its partition; sd.mtx held exclusively
+  void insertRow(SeriesData &sd, InlineRow row, size_t tsIdx);
+  void enforceRetention(SeriesData &sd, size_t tsIdx);
+  // Move the partitions out of the hot window to the cold tier; sd.mtx
+  // held exclusively
+  Status tierCold(SeriesData &sd, size_t tsIdx);
+  // Bytes of the continuous aggregates of a series; sd.mtx held
+  static size_t rollupBytes(const SeriesData &sd);
+  // Statistics of `r` per bucket in [startSec, endSec), in time order;
+  // sd.mtx held
+  Result<std::vector<TimeBucketStats>>
+  rollupBuckets(const SeriesData &sd, const Rollup &r, size_t tsIdx,
+                int64_t startSec, int64_t endSec) const;
 
-  std::unordered_map<std::string, SeriesData> series_;
-  mutable std::mutex mtx_;
+  std::atomic<size_t> scanThreads_{1};
+  std::shared_ptr<ColdChunkCache> coldCache_ =
+      std::make_shared<ColdChunkCache>();
+  std::unordered_map<std::string, std::shared_ptr<SeriesData>> series_;
+  // Tag column -> String value -> the series holding a row with it
+  std::unordered_map<std::string,
+                     std::unordered_map<std::string, std::set<std::string>>>
+      tagIndex_;
+  // Guards the series_ catalog, tagIndex_ and changes_; bucket data is
+  // guarded by each SeriesData::mtx, which is taken after mtx_ when both
+  // are held
+  mutable metrics::ProfiledMutex<std::shared_mutex> mtx_{
+      metrics::LockSite::TimeSeriesCatalog};
+  std::shared_ptr<ChangeFeed> changes_;
 };
 
 } // namespace kadedb
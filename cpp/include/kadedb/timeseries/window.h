@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "kadedb/schema.h" // TimeGranularity
+
+namespace kadedb {
+
+/**
+ * Functions of a value column over a time window ending at each sample
+ * (timestamp t, value v), with `width` in timestamp units:
+ * - MovingAvg: the mean of the values in (t - width, t]
+ * - Delta: v minus the oldest value in (t - width, t]
+ * - Rate: Delta divided by the seconds between the two samples
+ * - Ewma: an exponentially weighted moving average with time constant
+ *   `width`; a sample dt after the previous one has weight
+ *   1 - exp(-dt / width), so irregular sampling does not skew it
+ */
+enum class TimeWindowFunction { MovingAvg, Rate, Delta, Ewma };
+
+// KadeQL name of `fn` (MOVING_AVG, RATE, DELTA, EWMA)
+const char *timeWindowFunctionName(TimeWindowFunction fn);
+// The function named `upperName`, if any
+std::optional<TimeWindowFunction>
+parseTimeWindowFunction(const std::string &upperName);
+// Seconds in one timestamp unit of `g`
+double timeUnitSeconds(TimeGranularity g);
+
+/**
+ * One-pass evaluation of a TimeWindowFunction over samples in timestamp
+ * order. MovingAvg, Delta and Rate keep the samples inside the window;
+ * Ewma keeps only its running average.
+ */
+class TimeWindow {
+public:
+  // `width` > 0 timestamp units of `unitSeconds` seconds each
+  TimeWindow(TimeWindowFunction fn, int64_t width, double unitSeconds);
+
+  // The function at the sample (ts, value); ts must not precede the
+  // previous sample's. std::nullopt for Delta and Rate while no earlier
+  // sample is in the window.
+  std::optional<double> add(int64_t ts, double value);
+
+private:
+  TimeWindowFunction fn_;
+  int64_t width_;
+  double unitSeconds_;
+  std::deque<std::pair<int64_t, double>> samples_; // in the window
+  double sum_ = 0.0; // of samples_ (MovingAvg)
+  std::optional<double> ewma_;
+  int64_t lastTs_ = 0;
+};
+
+} // namespace kadedb
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace kadedb {
+namespace tracing {
+
+/**
+ * @defgroup Tracing Span tracing
+ * Spans of the work a request does inside the engine: parsing, planning
+ * and executing KadeQL, storage scans, aggregation and result
+ * serialization. Ids and propagation follow W3C Trace Context, as
+ * OpenTelemetry does: 128-bit trace ids, 64-bit span ids, and parents
+ * handed across process or FFI boundaries as `traceparent` strings.
+ *
+ * Finished spans go to the exporter set with setExporter(). Without one
+ * (the default) a Span costs a relaxed atomic load. A trace without a
+ * remote parent is sampled with probability sampleRatio(); every span of
+ * a trace follows its root's decision, and unsampled spans are not
+ * exported.
+ * @{
+ */
+
+/** Identity of a span, and of the trace it belongs to. */
+struct SpanContext {
+  uint64_t traceIdHigh = 0;
+  uint64_t traceIdLow = 0;
+  uint64_t spanId = 0;
+  bool sampled = false;
+
+  bool valid() const {
+    return (traceIdHigh | traceIdLow) != 0 && spanId != 0;
+  }
+};
+
+// "00-<32 hex digits trace id>-<16 hex digits span id>-<2 hex digits
+// flags>"; nullopt when `text` is not a valid version 00 traceparent
+std::optional<SpanContext> parseTraceparent(const std::string &text);
+std::string formatTraceparent(const SpanContext &ctx);
+
+/** A finished, sampled span as handed to the exporter. */
+struct SpanRecord {
+  SpanContext context;
+  uint64_t parentSpanId = 0; // 0: root of its trace
+  std::string name;          // "kadeql.parse", "storage.relational.scan", ...
+  int64_t startUnixNs = 0;
+  uint64_t durationNs = 0;
+  bool error = false;
+  std::vector<std::pair<std::string, std::string>> attributes;
+};
+
+// Receives every finished sampled span, on the thread that ended it, so it
+// must be thread-safe. An empty exporter stops tracing.
+using Exporter = std::function<void(const SpanRecord &)>;
+void setExporter(Exporter exporter);
+// Whether an exporter is set
+bool active();
+
+// Share of new traces sampled, clamped to [0, 1] (default 1)
+void setSampleRatio(double ratio);
+double sampleRatio();
+
+// Context new spans on this thread are children of: the innermost open
+// Span, or what ContextScope or setCurrent() installed. Invalid if none.
+SpanContext current();
+// Replace it; an invalid context makes the next span a root
+void setCurrent(const SpanContext &ctx);
+
+/** Makes `parent` the current context of this thread while it lives. */
+class ContextScope {
+public:
+  explicit ContextScope(const SpanContext &parent);
+  ~ContextScope();
+  ContextScope(const ContextScope &) = delete;
+  ContextScope &operator=(const ContextScope &) = delete;
+
+private:
+  SpanContext saved_;
+};
+
+/**
+ * One timed unit of work, from construction to destruction. The span is a
+ * child of current(); while it lives, it is current() itself, so the spans
+ * it encloses become its children. A Detached span is not made current,
+ * and so may end on another thread or out of nesting order.
+ */
+class Span {
+public:
+  enum class Mode : uint8_t { Nested, Detached };
+
+  explicit Span(const char *name, Mode mode = Mode::Nested) {
+    if (active())
+      begin(name, mode);
+  }
+  ~Span() {
+    if (engaged_)
+      end();
+  }
+  Span(const Span &) = delete;
+  Span &operator=(const Span &) = delete;
+
+  // Whether the span will be exported; attributes are dropped otherwise
+  bool recording() const { return record_ != nullptr; }
+  void setAttribute(const char *key, std::string value);
+  void setAttribute(const char *key, int64_t value);
+  void fail() {
+    if (record_)
+      record_->error = true;
+  }
+  // This span's context, for propagation (invalid when not tracing)
+  SpanContext context() const;
+
+private:
+  void begin(const char *name, Mode mode);
+  void end();
+
+  bool engaged_ = false;
+  bool nested_ = false;
+  SpanContext saved_;
+  SpanContext self_;
+  std::chrono::steady_clock::time_point start_;
+  std::unique_ptr<SpanRecord> record_;
+};
+
+/** @} */
+
+} // namespace tracing
+} // namespace kadedb
@@ -0,0 +1,602 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "kadedb/columnar_storage.h" // ColumnarRelationalStorage
+#include "kadedb/result.h"           // ResultSet
+#include "kadedb/schema.h"           // TableSchema, InlineRow
+#include "kadedb/status.h"           // Status, Result<T>
+#include "kadedb/value.h"            // Value, InlineValue
+
+namespace kadedb {
+
+/**
+ * @defgroup TypedTables Compile-time typed tables
+ * Columnar tables whose columns are fixed at compile time, for C++
+ * embedders: rows are std::tuples, cells go to and from the column arrays
+ * without a boxed Value, and column positions and predicates are resolved
+ * by the compiler. The tables stay ordinary tables of the storage, so
+ * KadeQL and the RelationalStorage API see them as well.
+ *
+ * A schema is a type with a constexpr tuple of columns:
+ *
+ *   struct Trade {
+ *     static constexpr auto columns = typed::columns(
+ *         typed::column<int64_t>("id").primaryKey(),
+ *         typed::column<std::string>("symbol"),
+ *         typed::column<double>("price"),
+ *         typed::column<std::optional<double>>("fee"));
+ *   };
+ *   using Trades = TypedTable<Trade>;
+ *   constexpr size_t kPrice = Trades::index("price");
+ *   auto trades = Trades::create(storage, "trades").takeValue();
+ *   trades.insert(Trades::Row{1, "ABC", 10.5, std::nullopt});
+ *   trades.scan(typed::gt<kPrice>(10.0), [](const Trades::Ref &r) {
+ *     use(r.get<kPrice>());
+ *   });
+ * @{
+ */
+namespace typed {
+
+/**
+ * How a C++ type is stored: int64_t as Integer, double as Float, bool as
+ * Boolean and std::string as String. std::optional of one of them makes
+ * the column nullable.
+ */
+template <class T> struct CellTraits {
+  static_assert(sizeof(T) == 0, "typed columns hold int64_t, double, bool, "
+                                "std::string or a std::optional of one");
+};
+
+template <> struct CellTraits<int64_t> {
+  static constexpr ColumnType kType = ColumnType::Integer;
+  static constexpr bool kNullable = false;
+  using View = int64_t;
+  static View read(const ColumnarRelationalStorage::ColumnVector &c,
+                   size_t r) {
+    return c.ints[r];
+  }
+  static InlineValue write(int64_t v) { return InlineValue::integer(v); }
+  static int64_t own(View v) { return v; }
+  static bool decode(const Value *v, int64_t &out) {
+    if (!v || v->type() != ValueType::Integer)
+      return false;
+    out = v->asInt();
+    return true;
+  }
+};
+
+template <> struct CellTraits<double> {
+  static constexpr ColumnType kType = ColumnType::Float;
+  static constexpr bool kNullable = false;
+  using View = double;
+  static View read(const ColumnarRelationalStorage::ColumnVector &c,
+                   size_t r) {
+    return c.floats[r];
+  }
+  static InlineValue write(double v) { return InlineValue::floating(v); }
+  static double own(View v) { return v; }
+  static bool decode(const Value *v, double &out) {
+    if (!v || (v->type() != ValueType::Float &&
+               v->type() != ValueType::Integer))
+      return false;
+    out = v->asFloat();
+    return true;
+  }
+};
+
+template <> struct CellTraits<bool> {
+  static constexpr ColumnType kType = ColumnType::Boolean;
+  static constexpr bool kNullable = false;
+  using View = bool;
+  static View read(const ColumnarRelationalStorage::ColumnVector &c,
+                   size_t r) {
+    return c.boolAt(r);
+  }
+  static InlineValue write(bool v) { return InlineValue::boolean(v); }
+  static bool own(View v) { return v; }
+  static bool decode(const Value *v, bool &out) {
+    if (!v || v->type() != ValueType::Boolean)
+      return false;
+    out = v->asBool();
+    return true;
+  }
+};
+
+template <> struct CellTraits<std::string> {
+  static constexpr ColumnType kType = ColumnType::String;
+  static constexpr bool kNullable = false;
+  // Borrowed from the column while the scan holds the storage lock
+  using View = std::string_view;
+  static View read(const ColumnarRelationalStorage::ColumnVector &c,
+                   size_t r) {
+    return std::string_view(c.strData(r), c.strLength(r));
+  }
+  static InlineValue write(const std::string &v) {
+    return InlineValue::string(v);
+  }
+  static std::string own(View v) { return std::string(v); }
+  static bool decode(const Value *v, std::string &out) {
+    if (!v || v->type() != ValueType::String)
+      return false;
+    out = v->asString();
+    return true;
+  }
+};
+
+template <class T> struct CellTraits<std::optional<T>> {
+  using Base = CellTraits<T>;
+  static constexpr ColumnType kType = Base::kType;
+  static constexpr bool kNullable = true;
+  using View = std::optional<typename Base::View>;
+  static View read(const ColumnarRelationalStorage::ColumnVector &c,
+                   size_t r) {
+    if (!c.isValid(r))
+      return std::nullopt;
+    return Base::read(c, r);
+  }
+  static InlineValue write(const std::optional<T> &v) {
+    return v ? Base::write(*v) : InlineValue();
+  }
+  static std::optional<T> own(const View &v) {
+    if (!v)
+      return std::nullopt;
+    return Base::own(*v);
+  }
+  static bool decode(const Value *v, std::optional<T> &out) {
+    if (!v) {
+      out.reset();
+      return true;
+    }
+    T inner{};
+    if (!Base::decode(v, inner))
+      return false;
+    out = std::move(inner);
+    return true;
+  }
+};
+
+// One column of a schema: its name, C++ type and constraints
+template <class T> struct TypedColumn {
+  using type = T;
+  const char *name;
+  bool isUnique = false;
+  bool isPrimaryKey = false;
+
+  constexpr explicit TypedColumn(const char *columnName) : name(columnName) {}
+  // The table's primary key, which is also unique
+  constexpr TypedColumn primaryKey() const {
+    TypedColumn c = *this;
+    c.isPrimaryKey = true;
+    c.isUnique = true;
+    return c;
+  }
+  constexpr TypedColumn unique() const {
+    TypedColumn c = *this;
+    c.isUnique = true;
+    return c;
+  }
+};
+
+template <class T> constexpr TypedColumn<T> column(const char *name) {
+  return TypedColumn<T>(name);
+}
+
+template <class... Cs> constexpr std::tuple<Cs...> columns(Cs... cs) {
+  return std::tuple<Cs...>(cs...);
+}
+
+// ---- Predicates ------------------------------------------------------------
+// Built from column positions, so each test compiles to a read of the
+// column array and a comparison of C++ values; absent cells never match
+// a comparison.
+
+template <class V> struct Stored {
+  using type = V;
+};
+template <> struct Stored<const char *> {
+  using type = std::string;
+};
+template <> struct Stored<char *> {
+  using type = std::string;
+};
+
+// Column I compared with a constant by `Op` (std::less<> and the like)
+template <size_t I, class Op, class V> struct Compare {
+  V rhs;
+};
+template <size_t I> struct IsNull {};
+template <class L, class R> struct And {
+  L l;
+  R r;
+};
+template <class L, class R> struct Or {
+  L l;
+  R r;
+};
+template <class P> struct Not {
+  P p;
+};
+// Every row
+struct All {};
+
+template <class P> struct IsPredicate : std::false_type {};
+template <size_t I, class Op, class V>
+struct IsPredicate<Compare<I, Op, V>> : std::true_type {};
+template <size_t I> struct IsPredicate<IsNull<I>> : std::true_type {};
+template <class L, class R> struct IsPredicate<And<L, R>> : std::true_type {};
+template <class L, class R> struct IsPredicate<Or<L, R>> : std::true_type {};
+template <class P> struct IsPredicate<Not<P>> : std::true_type {};
+template <> struct IsPredicate<All> : std::true_type {};
+
+template <class P>
+using EnableIfPredicate =
+    std::enable_if_t<IsPredicate<std::decay_t<P>>::value, int>;
+
+template <size_t I, class V> auto eq(V v) {
+  using S = typename Stored<std::decay_t<V>>::type;
+  return Compare<I, std::equal_to<>, S>{S(std::move(v))};
+}
+template <size_t I, class V> auto ne(V v) {
+  using S = typename Stored<std::decay_t<V>>::type;
+  return Compare<I, std::not_equal_to<>, S>{S(std::move(v))};
+}
+template <size_t I, class V> auto lt(V v) {
+  using S = typename Stored<std::decay_t<V>>::type;
+  return Compare<I, std::less<>, S>{S(std::move(v))};
+}
+template <size_t I, class V> auto le(V v) {
+  using S = typename Stored<std::decay_t<V>>::type;
+  return Compare<I, std::less_equal<>, S>{S(std::move(v))};
+}
+template <size_t I, class V> auto gt(V v) {
+  using S = typename Stored<std::decay_t<V>>::type;
+  return Compare<I, std::greater<>, S>{S(std::move(v))};
+}
+template <size_t I, class V> auto ge(V v) {
+  using S = typename Stored<std::decay_t<V>>::type;
+  return Compare<I, std::greater_equal<>, S>{S(std::move(v))};
+}
+template <size_t I> IsNull<I> isNull() { return {}; }
+
+template <class L, class R, EnableIfPredicate<L> = 0, EnableIfPredicate<R> = 0>
+And<std::decay_t<L>, std::decay_t<R>> operator&&(L &&l, R &&r) {
+  return {std::forward<L>(l), std::forward<R>(r)};
+}
+template <class L, class R, EnableIfPredicate<L> = 0, EnableIfPredicate<R> = 0>
+Or<std::decay_t<L>, std::decay_t<R>> operator||(L &&l, R &&r) {
+  return {std::forward<L>(l), std::forward<R>(r)};
+}
+template <class P, EnableIfPredicate<P> = 0>
+Not<std::decay_t<P>> operator!(P &&p) {
+  return {std::forward<P>(p)};
+}
+
+} // namespace typed
+
+/**
+ * A table of ColumnarRelationalStorage typed by schema `S` (see the group
+ * description). Inserts are validated and checked for uniqueness by the
+ * storage like insertRow(), as one all-or-nothing batch; scans read the
+ * column arrays under the storage lock, so callbacks must not call back
+ * into the storage and string views must not outlive them.
+ */
+template <class S> class TypedTable {
+public:
+  using Columns = std::decay_t<decltype(S::columns)>;
+  static constexpr size_t kColumns = std::tuple_size<Columns>::value;
+  static constexpr size_t npos = TableSchema::npos;
+
+  // C++ type of column I and how it is stored
+  template <size_t I>
+  using CellType = typename std::tuple_element_t<I, Columns>::type;
+  template <size_t I> using Traits = typed::CellTraits<CellType<I>>;
+
+private:
+  template <class Seq> struct RowOf;
+  template <size_t... Is> struct RowOf<std::index_sequence<Is...>> {
+    using type = std::tuple<CellType<Is>...>;
+  };
+  using Indexes = std::make_index_sequence<kColumns>;
+  using ColumnVector = ColumnarRelationalStorage::ColumnVector;
+
+public:
+  using Row = typename RowOf<Indexes>::type;
+
+  // Position of the column called `name`, or npos; usable in constant
+  // expressions
+  static constexpr size_t index(std::string_view name) {
+    return indexOf(name, Indexes{});
+  }
+
+  // The TableSchema of `S`
+  static TableSchema schema() {
+    std::vector<Column> cols;
+    std::optional<std::string> key;
+    addColumns(cols, key, Indexes{});
+    return TableSchema(std::move(cols), std::move(key));
+  }
+
+  /**
+   * Create table `name` with schema() in `storage`.
+   * @return Status::AlreadyExists if the table exists
+   */
+  static Result<TypedTable> create(ColumnarRelationalStorage &storage,
+                                   std::string name) {
+    Status st = storage.createTable(name, schema());
+    if (!st.ok())
+      return Result<TypedTable>::err(st);
+    return Result<TypedTable>::ok(TypedTable(storage, std::move(name)));
+  }
+
+  /**
+   * The existing table `name` of `storage`, whose columns must be those of
+   * `S` in order; nullable ones need a std::optional type.
+   * @return Status::NotFound for an unknown table;
+   *         Status::FailedPrecondition when the columns differ
+   */
+  static Result<TypedTable> open(ColumnarRelationalStorage &storage,
+                                 std::string name) {
+    auto actual = storage.getTableSchema(name);
+    if (!actual.hasValue())
+      return Result<TypedTable>::err(actual.status());
+    const auto &cols = actual.value().columns();
+    if (cols.size() != kColumns || !matches(cols, Indexes{}))
+      return Result<TypedTable>::err(Status::FailedPrecondition(
+          "Columns of table '" + name + "' do not match its typed schema"));
+    return Result<TypedTable>::ok(TypedTable(storage, std::move(name)));
+  }
+
+  const std::string &name() const { return name_; }
+  ColumnarRelationalStorage &storage() const { return *storage_; }
+
+  Status insert(const Row &row) {
+    std::vector<InlineRow> cells;
+    cells.push_back(toCells(row, Indexes{}));
+    return storage_->insertInlineRows(name_, cells);
+  }
+  Status insert(const std::vector<Row> &rows) {
+    std::vector<InlineRow> cells;
+    cells.reserve(rows.size());
+    for (const auto &row : rows)
+      cells.push_back(toCells(row, Indexes{}));
+    return storage_->insertInlineRows(name_, cells);
+  }
+  // insert() of the `n` rows `rowAt(i)` returns, without collecting them
+  // as tuples first
+  template <class F> Status insert(size_t n, F &&rowAt) {
+    std::vector<InlineRow> cells;
+    cells.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+      cells.push_back(toCells(static_cast<const Row &>(rowAt(i)), Indexes{}));
+    return storage_->insertInlineRows(name_, cells);
+  }
+
+  // One live row during a scan
+  class Ref {
+  public:
+    // Column I, borrowed from the column arrays for strings
+    template <size_t I> typename Traits<I>::View get() const {
+      static_assert(I < kColumns, "column position out of range");
+      return Traits<I>::read(columns_[I], row_);
+    }
+    // The whole row, owning its strings
+    Row row() const { return own(Indexes{}); }
+
+  private:
+    friend class TypedTable;
+    Ref(const ColumnVector *columns, size_t row)
+        : columns_(columns), row_(row) {}
+    template <size_t... Is> Row own(std::index_sequence<Is...>) const {
+      return Row(Traits<Is>::own(get<Is>())...);
+    }
+
+    const ColumnVector *columns_;
+    size_t row_;
+  };
+
+  /**
+   * Call `fn(ref)` for every live row matching `where`, in storage order;
+   * `fn` may return false to stop.
+   * @return Status::NotFound if the table was dropped
+   */
+  template <class P, class F> Status scan(const P &where, F &&fn) const {
+    using Out = std::invoke_result_t<F &, const Ref &>;
+    return storage_->readColumns(
+        name_, [&](const ColumnarRelationalStorage::ColumnsView &view) {
+          for (size_t r = 0; r < view.rows; ++r) {
+            if (!view.isLive(r) || !test(where, view.columns, r))
+              continue;
+            if constexpr (std::is_same_v<Out, bool>) {
+              if (!fn(Ref(view.columns, r)))
+                return;
+            } else {
+              fn(Ref(view.columns, r));
+            }
+          }
+        });
+  }
+  template <class F> Status scan(F &&fn) const {
+    return scan(typed::All{}, std::forward<F>(fn));
+  }
+
+  // The rows matching `where`
+  template <class P = typed::All>
+  Result<std::vector<Row>> select(const P &where = P()) const {
+    std::vector<Row> out;
+    Status st = scan(where, [&](const Ref &r) { out.push_back(r.row()); });
+    if (!st.ok())
+      return Result<std::vector<Row>>::err(st);
+    return Result<std::vector<Row>>::ok(std::move(out));
+  }
+
+  // The number of rows matching `where`
+  template <class P = typed::All>
+  Result<size_t> count(const P &where = P()) const {
+    size_t n = 0;
+    Status st = scan(where, [&](const Ref &) { ++n; });
+    if (!st.ok())
+      return Result<size_t>::err(st);
+    return Result<size_t>::ok(n);
+  }
+
+  /**
+   * The rows of `rs`, e.g. a KadeQL SELECT of the table, as tuples: each
+   * column of `S` is taken from the result column of the same name.
+   * @return Status::InvalidArgument for a missing column or a cell of
+   *         another type (or null in a column without std::optional)
+   */
+  static Result<std::vector<Row>> fromResultSet(const ResultSet &rs) {
+    using R = Result<std::vector<Row>>;
+    std::array<size_t, kColumns> at{};
+    for (size_t c = 0; c < kColumns; ++c) {
+      at[c] = rs.findColumn(columnName(c));
+      if (at[c] == ResultSet::npos)
+        return R::err(Status::InvalidArgument(
+            "Result has no column '" + std::string(columnName(c)) + "'"));
+    }
+    std::vector<Row> out(rs.rowCount());
+    for (size_t r = 0; r < rs.rowCount(); ++r) {
+      size_t bad = decodeRow(rs.row(r), at, out[r], Indexes{});
+      if (bad != npos)
+        return R::err(Status::InvalidArgument(
+            "Row " + std::to_string(r) + ": column '" +
+            std::string(columnName(bad)) + "' does not hold its typed value"));
+    }
+    return R::ok(std::move(out));
+  }
+
+private:
+  TypedTable(ColumnarRelationalStorage &storage, std::string name)
+      : storage_(&storage), name_(std::move(name)) {}
+
+  static constexpr const char *columnName(size_t c) { return names()[c]; }
+  static constexpr std::array<const char *, kColumns> names() {
+    return namesOf(Indexes{});
+  }
+  template <size_t... Is>
+  static constexpr std::array<const char *, kColumns>
+  namesOf(std::index_sequence<Is...>) {
+    return {{std::get<Is>(S::columns).name...}};
+  }
+
+  template <size_t... Is>
+  static constexpr size_t indexOf(std::string_view name,
+                                  std::index_sequence<Is...>) {
+    size_t found = npos;
+    ((found == npos && std::string_view(std::get<Is>(S::columns).name) == name
+          ? (void)(found = Is)
+          : (void)0),
+     ...);
+    return found;
+  }
+
+  template <size_t... Is>
+  static void addColumns(std::vector<Column> &cols,
+                         std::optional<std::string> &key,
+                         std::index_sequence<Is...>) {
+    (addColumn<Is>(cols, key), ...);
+  }
+  template <size_t I>
+  static void addColumn(std::vector<Column> &cols,
+                        std::optional<std::string> &key) {
+    const auto &c = std::get<I>(S::columns);
+    cols.push_back(
+        Column{c.name, Traits<I>::kType, Traits<I>::kNullable, c.isUnique, {}});
+    if (c.isPrimaryKey)
+      key = c.name;
+  }
+
+  template <size_t... Is>
+  static bool matches(const std::vector<Column> &cols,
+                      std::index_sequence<Is...>) {
+    return ((cols[Is].name == std::get<Is>(S::columns).name &&
+             cols[Is].type == Traits<Is>::kType &&
+             (!cols[Is].nullable || Traits<Is>::kNullable)) &&
+            ...);
+  }
+
+  template <size_t... Is>
+  static InlineRow toCells(const Row &row, std::index_sequence<Is...>) {
+    InlineRow cells(kColumns);
+    (cells.set(Is, Traits<Is>::write(std::get<Is>(row))), ...);
+    return cells;
+  }
+
+  // Position of the first cell that does not decode, or npos
+  template <size_t... Is>
+  static size_t decodeRow(const ResultRow &in,
+                          const std::array<size_t, kColumns> &at, Row &out,
+                          std::index_sequence<Is...>) {
+    size_t bad = npos;
+    ((bad == npos &&
+              !Traits<Is>::decode(in.values()[at[Is]].get(), std::get<Is>(out))
+          ? (void)(bad = Is)
+          : (void)0),
+     ...);
+    return bad;
+  }
+
+  // ---- Predicate evaluation over the column arrays ----
+  static bool test(const typed::All &, const ColumnVector *, size_t) {
+    return true;
+  }
+  template <size_t I, class Op, class V>
+  static bool test(const typed::Compare<I, Op, V> &p, const ColumnVector *c,
+                   size_t r) {
+    static_assert(I < kColumns, "column position out of range");
+    const auto v = Traits<I>::read(c[I], r);
+    if constexpr (Traits<I>::kNullable) {
+      if (!v)
+        return false;
+      return Op{}(*v, operand<I>(p.rhs));
+    } else {
+      return Op{}(v, operand<I>(p.rhs));
+    }
+  }
+  template <size_t I>
+  static bool test(const typed::IsNull<I> &, const ColumnVector *c,
+                   size_t r) {
+    static_assert(I < kColumns, "column position out of range");
+    return !c[I].isValid(r);
+  }
+  template <class L, class R>
+  static bool test(const typed::And<L, R> &p, const ColumnVector *c,
+                   size_t r) {
+    return test(p.l, c, r) && test(p.r, c, r);
+  }
+  template <class L, class R>
+  static bool test(const typed::Or<L, R> &p, const ColumnVector *c,
+                   size_t r) {
+    return test(p.l, c, r) || test(p.r, c, r);
+  }
+  template <class P>
+  static bool test(const typed::Not<P> &p, const ColumnVector *c, size_t r) {
+    return !test(p.p, c, r);
+  }
+
+  // The constant of a comparison with column I, as strings compare
+  template <size_t I, class V> static auto operand(const V &v) {
+    if constexpr (Traits<I>::kType == ColumnType::String)
+      return std::string_view(v);
+    else
+      return v;
+  }
+
+  ColumnarRelationalStorage *storage_;
+  std::string name_;
+};
+
+/** @} */
+
+} // namespace kadedb
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <stdexcept>
@@ -10,13 +11,18 @@ namespace kadedb {
 
 // Optional memory debug and pooling
 // Define KADEDB_MEM_DEBUG to enable allocation counters per Value type
-// Define KADEDB_ENABLE_SMALL_OBJECT_POOL to enable a tiny freelist pool for
-// fixed-size Value types (IntegerValue, BooleanValue, NullValue).
+// Define KADEDB_ENABLE_SMALL_OBJECT_POOL to take Values made outside a
+// ValueArena::Scope from thread-local slabs instead of the heap (see
+// ValueArena). Both are safe with any number of threads.
 
 namespace memdebug {
 // Accessors return cumulative counts since process start
 size_t allocCountInteger();
 size_t freeCountInteger();
+size_t allocCountFloat();
+size_t freeCountFloat();
+size_t allocCountString();
+size_t freeCountString();
 size_t allocCountBoolean();
 size_t freeCountBoolean();
 size_t allocCountNull();
@@ -32,11 +38,74 @@ enum class ValueType {
   Boolean = 4,
 };
 
+/**
+ * Bump allocation for the Values a query produces.
+ *
+ * While a Scope is open, every Value created on its thread is carved from
+ * the scope's arena instead of taking its own heap block: a result of a
+ * million rows costs a few hundred chunk allocations rather than a million
+ * malloc()/free() pairs, and its cells sit next to each other in memory.
+ *
+ * Values still own themselves. Each chunk counts the Values living in it
+ * and is freed with the last of them, on whichever thread that happens, so
+ * results, moved-out cells and clones may outlive the scope. Temporaries
+ * a query drops early release their chunks early; a survivor pins only the
+ * chunk it sits in.
+ *
+ * Scopes nest: an inner scope uses the arena of the outermost one.
+ *
+ * Outside a scope Values come from the heap or, with
+ * KADEDB_ENABLE_SMALL_OBJECT_POOL, from per-thread slabs of fixed-size
+ * blocks. A block freed on another thread is handed back to its owner
+ * through a lock-free list, and a thread's slabs pass to a later thread
+ * when it exits. Slab memory is kept for reuse rather than given back.
+ */
+class ValueArena {
+public:
+  class Scope {
+  public:
+    Scope();
+    ~Scope();
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    friend class ValueArena;
+    void retire() noexcept;
+
+    bool owner_ = false;
+    void *chunk_ = nullptr; // chunk being carved
+    char *next_ = nullptr;  // its first free byte
+    char *end_ = nullptr;   // its end
+    size_t carved_ = 0;     // Values carved from it
+    size_t chunkBytes_ = 0; // size of the next chunk
+  };
+
+  // Storage for a Value of `size` bytes, from the current scope's arena,
+  // the thread's slabs or the heap; release() returns it to wherever it
+  // came from
+  static void *allocate(std::size_t size);
+  static void release(void *p) noexcept;
+
+  // Whether a Scope is open on this thread
+  static bool active();
+  // Bytes the calling thread has requested through allocate() so far, and
+  // in how many calls
+  static uint64_t threadBytesAllocated();
+  static uint64_t threadAllocations();
+};
+
 // Base Value interface
 class Value {
 public:
   virtual ~Value() = default;
 
+  // Values are allocated through ValueArena
+  static void *operator new(std::size_t size) {
+    return ValueArena::allocate(size);
+  }
+  static void operator delete(void *p) noexcept { ValueArena::release(p); }
+
   // RTTI-like identification
   virtual ValueType type() const = 0;
 
@@ -147,6 +216,12 @@ public:
 
 private:
   double value_ = 0.0;
+
+#if defined(KADEDB_MEM_DEBUG) || defined(KADEDB_ENABLE_SMALL_OBJECT_POOL)
+public:
+  static void *operator new(std::size_t sz);
+  static void operator delete(void *p) noexcept;
+#endif
 };
 
 // StringValue storage model
@@ -208,6 +283,12 @@ private:
 #else
   std::string value_;
 #endif
+
+#if defined(KADEDB_MEM_DEBUG) || defined(KADEDB_ENABLE_SMALL_OBJECT_POOL)
+public:
+  static void *operator new(std::size_t sz);
+  static void operator delete(void *p) noexcept;
+#endif
 };
 
 class BooleanValue final : public Value {
@@ -257,4 +338,92 @@ inline int compareNumeric(double a, double b) {
   return 0;
 }
 
+// Compact tagged-union value (16 bytes, no virtual dispatch)
+//
+// InlineValue stores a type tag plus payload in place:
+// - Null/Integer/Float/Boolean: payload held inline, never allocates.
+// - String: up to kInlineCapacity bytes stored inline (small-string
+//   optimization); longer strings use a single owned heap buffer.
+// - A default-constructed InlineValue is "empty" and models an absent cell
+//   (the nullptr case of std::unique_ptr<Value>), distinct from Null.
+//
+// compare()/equals()/toString() follow the semantics of the Value hierarchy
+// exactly (numeric cross-type comparison, ordering by ValueType otherwise),
+// so InlineValue can be used wherever storage compares or keys cells.
+//
+// Converters: fromValue(const Value*) and toValue() map to/from the Value
+// hierarchy for API compatibility.
+class InlineValue {
+public:
+  static constexpr size_t kInlineCapacity = 14;
+
+  InlineValue() noexcept : len_(0), tag_(kEmptyTag) {}
+  ~InlineValue() { reset(); }
+
+  InlineValue(const InlineValue &other);
+  InlineValue(InlineValue &&other) noexcept;
+  InlineValue &operator=(const InlineValue &other);
+  InlineValue &operator=(InlineValue &&other) noexcept;
+
+  // Factories
+  static InlineValue null();
+  static InlineValue integer(int64_t v);
+  static InlineValue floating(double v);
+  static InlineValue boolean(bool v);
+  static InlineValue string(const char *data, size_t len);
+  static InlineValue string(const std::string &s) {
+    return string(s.data(), s.size());
+  }
+
+  // Converters to/from the Value hierarchy (nullptr <-> empty)
+  static InlineValue fromValue(const Value *v);
+  std::unique_ptr<Value> toValue() const;
+
+  // True when no value is present (absent cell)
+  bool empty() const { return tag_ == kEmptyTag; }
+  // Type of the contained value; caller must ensure !empty()
+  ValueType type() const { return static_cast<ValueType>(tag_); }
+  // True when the string payload lives in the inline buffer
+  bool isInlineString() const {
+    return tag_ == static_cast<uint8_t>(ValueType::String) && len_ != kHeapLen;
+  }
+
+  // Typed accessors (throw on type mismatch, like Value::asX)
+  int64_t asInt() const;
+  double asFloat() const;
+  bool asBool() const;
+  const char *stringData() const;
+  size_t stringSize() const;
+  std::string asString() const {
+    return std::string(stringData(), stringSize());
+  }
+
+  bool equals(const InlineValue &other) const;
+  int compare(const InlineValue &other) const;
+  // Compare against a Value without materializing an InlineValue
+  int compare(const Value &other) const;
+  std::string toString() const;
+
+  bool operator==(const InlineValue &o) const { return equals(o); }
+  bool operator!=(const InlineValue &o) const { return !equals(o); }
+  bool operator<(const InlineValue &o) const { return compare(o) < 0; }
+
+private:
+  static constexpr uint8_t kEmptyTag = 0xFF;
+  static constexpr uint8_t kHeapLen = 0xFF;
+
+  void reset() noexcept;
+  void copyFrom(const InlineValue &other);
+  char *heapPtr() const;
+  size_t heapSize() const;
+
+  // Payload bytes: int64/double/bool, inline string chars, or a pointer to a
+  // heap block laid out as [size_t length][chars].
+  alignas(8) unsigned char buf_[kInlineCapacity];
+  uint8_t len_; // inline string length, or kHeapLen for heap strings
+  uint8_t tag_; // ValueType, or kEmptyTag
+};
+
+static_assert(sizeof(InlineValue) == 16, "InlineValue must stay 16 bytes");
+
 } // namespace kadedb
@@ -0,0 +1,479 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "kadedb/compression.h"        // Codec
+#include "kadedb/file_io.h"            // IoBackend, IoQueue
+#include "kadedb/graph/storage.h"      // GraphStorage, Node, Edge
+#include "kadedb/status.h"             // Status, Result<T>
+#include "kadedb/storage.h"            // Relational/DocumentStorage
+#include "kadedb/timeseries/storage.h" // TimeSeriesStorage
+
+namespace kadedb {
+
+/**
+ * @defgroup WalAPI Write-Ahead Log
+ * @brief Durable mutation log for the in-memory storages, with group commit
+ * and parallel replay.
+ */
+
+/**
+ * Logged mutations. The engine of an op is its value / 16; each record
+ * targets one named table, collection, series or graph.
+ */
+enum class WalOp : uint8_t {
+  // Relational
+  CreateTable = 0x01,
+  DropTable,
+  TruncateTable,
+  InsertRow,
+  DeleteRows,
+  UpdateRows,
+  UpdateRowsWith,
+  CreateTableIndex,
+  InsertRows,
+  // Document
+  CreateCollection = 0x11,
+  DropCollection,
+  PutDocument,
+  EraseDocument,
+  CreateCollectionIndex,
+  // Time series
+  CreateSeries = 0x21,
+  DropSeries,
+  AppendRows,
+  AppendColumns,
+  CreateContinuousAggregate,
+  DropContinuousAggregate,
+  // Graph
+  CreateGraph = 0x31,
+  DropGraph,
+  PutNode,
+  EraseNode,
+  PutEdge,
+  EraseEdge,
+  CreateNodeIndex,
+  DropNodeIndex,
+  CreateEdgeIndex,
+  DropEdgeIndex,
+};
+
+/**
+ * One log record: an op, its target name and the op's arguments in the
+ * bin:: encodings (a row via bin::writeRow and several via
+ * bin::writeRowBatch, documents and properties via bin::writeDocument,
+ * schemas via bin::write*Schema). Build records with the walRecord
+ * functions below rather than by hand.
+ */
+struct WalRecord {
+  WalOp op = WalOp::CreateTable;
+  std::string target;
+  std::string body;
+};
+
+// Record builders, one per logged mutation
+namespace walRecord {
+WalRecord createTable(const std::string &table, const TableSchema &schema);
+WalRecord dropTable(const std::string &table);
+WalRecord truncateTable(const std::string &table);
+WalRecord insertRow(const std::string &table, const Row &row);
+// An all-or-nothing insertRows() batch, replayed as one batch
+WalRecord insertRows(const std::string &table, const std::vector<Row> &rows);
+WalRecord deleteRows(const std::string &table,
+                     const std::optional<Predicate> &where);
+WalRecord
+updateRows(const std::string &table,
+           const std::unordered_map<std::string, AssignmentValue> &assignments,
+           const std::optional<Predicate> &where);
+// An updateRowsWith() as the rows the updater produced, in the order the
+// storage visited the matching rows; replay hands them out in that order
+WalRecord updateRowsWith(const std::string &table,
+                         const std::optional<Predicate> &where,
+                         const std::vector<Row> &updated);
+WalRecord createTableIndex(const std::string &table, const std::string &column,
+                           IndexType type);
+
+WalRecord createCollection(const std::string &collection,
+                           const std::optional<DocumentSchema> &schema);
+WalRecord dropCollection(const std::string &collection);
+WalRecord putDocument(const std::string &collection, const std::string &key,
+                      const Document &doc);
+WalRecord eraseDocument(const std::string &collection, const std::string &key);
+WalRecord createCollectionIndex(const std::string &collection,
+                                const std::string &field, IndexType type);
+
+WalRecord createSeries(const std::string &series,
+                       const TimeSeriesSchema &schema,
+                       TimePartition partition);
+WalRecord dropSeries(const std::string &series);
+WalRecord appendRows(const std::string &series, const std::vector<Row> &rows);
+// `columns` value columns of `n` samples, as passed to appendColumns()
+WalRecord appendColumns(const std::string &series, const int64_t *ts,
+                        const double *const *values, size_t n,
+                        size_t columns);
+WalRecord createContinuousAggregate(const std::string &series,
+                                    const std::string &valueColumn,
+                                    int64_t bucketWidth,
+                                    TimeGranularity bucketGranularity,
+                                    bool sketches = false);
+WalRecord dropContinuousAggregate(const std::string &series,
+                                  const std::string &valueColumn,
+                                  int64_t bucketWidth,
+                                  TimeGranularity bucketGranularity);
+
+WalRecord createGraph(const std::string &graph);
+WalRecord dropGraph(const std::string &graph);
+WalRecord putNode(const std::string &graph, const Node &node);
+WalRecord eraseNode(const std::string &graph, NodeId id);
+WalRecord putEdge(const std::string &graph, const Edge &edge);
+WalRecord eraseEdge(const std::string &graph, EdgeId id);
+WalRecord createNodeIndex(const std::string &graph,
+                          const std::string &property, IndexType type);
+WalRecord dropNodeIndex(const std::string &graph, const std::string &property);
+WalRecord createEdgeIndex(const std::string &graph,
+                          const std::string &property, IndexType type);
+WalRecord dropEdgeIndex(const std::string &graph, const std::string &property);
+} // namespace walRecord
+
+/**
+ * Group commit settings.
+ *  - commitDelay: latency budget; once a record is queued the log writer
+ *    waits up to this long for more records to share its sync (0: write
+ *    as soon as the previous sync ends, which still batches the records
+ *    queued meanwhile). A lone writer waits it out on every commit, so
+ *    single-writer workloads want 0.
+ *  - maxBatchBytes: a batch is written before the delay ends once it
+ *    holds this many bytes
+ *  - sync: fdatasync each batch. Without it acknowledged records survive
+ *    a process crash but not an OS crash.
+ *  - compression: codec for frames of 64 bytes or more, each kept only if
+ *    it shrinks (Codec::Lz4 suits the log's latency budget). Logs written
+ *    with compression remain readable by replayWal() without it.
+ *  - dictionary: shared by the compressed frames from this open() on (see
+ *    codec::trainDictionary(); up to 64 KiB), so that single rows and
+ *    documents compress too. It is written to the log once.
+ *  - io: how batches are written and synced and the log read at open().
+ *    With io_uring a batch's write and fdatasync are one submission.
+ */
+struct WalOptions {
+  std::chrono::microseconds commitDelay{100};
+  size_t maxBatchBytes = size_t{1} << 20;
+  bool sync = true;
+  Codec compression = Codec::None;
+  std::string dictionary;
+  IoBackend io = IoBackend::Auto;
+};
+
+/**
+ * Append-only log file of WalRecords.
+ *
+ * The file is a header followed by frames of [u32 length][u32 CRC-32]
+ * [op, target, body], the payload optionally compressed. append() only
+ * queues a frame and returns its log sequence number (1-based, in file
+ * order); a background writer writes and syncs queued frames in batches,
+ * and sync(lsn) blocks until the frame is durable. Concurrent writers thus share syncs instead of paying
+ * one each.
+ *
+ * open() keeps the valid prefix of an existing log and truncates a torn or
+ * corrupt tail, which only ever holds records that were never reported
+ * durable. After a failed write every later append() and sync() reports
+ * the error: what reached the disk is unknown.
+ */
+/** @ingroup WalAPI */
+class WriteAheadLog {
+public:
+  /**
+   * Open or create the log at `path`.
+   * @return Status::InvalidArgument if the file is not a KadeDB log;
+   *         Status::Internal on I/O errors
+   */
+  static Result<std::unique_ptr<WriteAheadLog>>
+  open(const std::string &path, WalOptions options = {});
+
+  // Writes and syncs whatever is queued, then closes the file
+  ~WriteAheadLog();
+
+  WriteAheadLog(const WriteAheadLog &) = delete;
+  WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+  // Queue `rec`; never waits for I/O
+  Result<uint64_t> append(const WalRecord &rec);
+  // Block until every record up to `lsn` is durable
+  Status sync(uint64_t lsn);
+  // append() then sync()
+  Status commit(const WalRecord &rec);
+
+  const std::string &path() const { return path_; }
+  // Sequence numbers of the newest queued and newest durable records
+  uint64_t lastLsn() const;
+  uint64_t durableLsn() const;
+  // Batches written so far (one sync each when options.sync is set)
+  uint64_t batches() const;
+
+private:
+  WriteAheadLog(std::string path, int fd, uint64_t end,
+                std::unique_ptr<IoQueue> io, uint64_t lsn, WalOptions options);
+  void writerLoop();
+
+  const std::string path_;
+  const int fd_;
+  const WalOptions options_;
+  const std::unique_ptr<IoQueue> io_;
+  uint64_t end_; // file offset of the next batch; writer thread only
+
+  mutable std::mutex mtx_;
+  std::condition_variable queuedCv_;  // writer: frames queued or stopping
+  std::condition_variable durableCv_; // sync(): a batch finished
+  std::string queued_;                // encoded frames not yet written
+  std::chrono::steady_clock::time_point firstQueued_;
+  uint64_t lastLsn_;
+  uint64_t durableLsn_;
+  uint64_t batches_ = 0;
+  Status error_;
+  bool stop_ = false;
+  std::thread writer_;
+};
+
+/**
+ * Storages that replayWal() applies records to; records of an engine
+ * without a storage fail the replay.
+ */
+struct WalTargets {
+  RelationalStorage *relational = nullptr;
+  DocumentStorage *document = nullptr;
+  TimeSeriesStorage *timeseries = nullptr;
+  GraphStorage *graph = nullptr;
+};
+
+/**
+ * Apply one record to `targets`.
+ * @return the storage's Status, or Status::InvalidArgument if the record
+ *         does not decode
+ */
+Status applyWalRecord(const WalRecord &rec, const WalTargets &targets);
+
+/**
+ * Rebuild storages from the log at `path` (a missing file is an empty
+ * log). Records are read in one pass and split by target: each table,
+ * collection, series or graph is replayed in log order by one of
+ * `threads` workers (0: one per hardware thread), so distinct targets
+ * load in parallel. Consecutive node or edge puts of a graph are applied
+ * as one GraphStorage::putNodes()/putEdges() batch. Replay stops at a
+ * torn or corrupt tail, like open().
+ * Call it before opening the log for writing, on storages that do not
+ * log (not the Logged* wrappers). Records up to `afterLsn` are skipped,
+ * e.g. those a CheckpointStorage already holds.
+ * @return the number of records applied, or the first failing record's
+ *         error (other targets may have been replayed further)
+ */
+Result<uint64_t> replayWal(const std::string &path, const WalTargets &targets,
+                           size_t threads = 0, uint64_t afterLsn = 0);
+
+/**
+ * replayWal() of a file that must be complete, such as a backup: a missing
+ * file is Status::NotFound and a torn or corrupt tail
+ * Status::InvalidArgument, both reported before any record is applied.
+ */
+Result<uint64_t> replayWalFile(const std::string &path,
+                               const WalTargets &targets, size_t threads = 0);
+
+/**
+ * applyWalRecord() of each of `records`, which follow log sequence number
+ * `afterLsn`, in parallel per target like replayWal().
+ * @return the number of records applied, or the first failing record's
+ *         error
+ */
+Result<uint64_t> applyWalRecords(const std::vector<WalRecord> &records,
+                                 const WalTargets &targets, size_t threads = 0,
+                                 uint64_t afterLsn = 0);
+
+// The engine of a WalOp (its value / 16)
+enum class WalEngine : uint8_t { Relational, Document, TimeSeries, Graph };
+
+// Accesses per engine and target
+using WalAccessCounts = std::map<std::pair<WalEngine, std::string>, uint64_t>;
+
+/** How a LazyReplay loads targets nobody asked for yet. */
+struct LazyReplayOptions {
+  // Background loaders (0: one per hardware thread, at most one per
+  // target); none when `background` is false, so only load() replays
+  size_t threads = 0;
+  bool background = true;
+  // Expected accesses of targets, e.g. accessCounts() of the previous run;
+  // loaders take the targets with the most hinted and counted accesses
+  // first, the others in log order
+  WalAccessCounts hints;
+};
+
+/**
+ * replayWal() on demand, so a restart serves requests before the whole log
+ * tail is applied. open() reads and splits the records like replayWal()
+ * but applies none: each table, collection, series or graph is replayed
+ * by the first load() of it, which waits only for that target when
+ * another thread is already replaying it. Background loaders replay the
+ * rest meanwhile, busiest targets first. The Lazy* storages
+ * (lazy_storage.h) call load() before every use of a target.
+ *
+ * Like replayWal(), replay into storages that do not log, and open the log
+ * for writing only after open() has read it. Mutations of a target must
+ * go through its load() (the Lazy* wrappers), so they follow the replayed
+ * records. Thread-safe.
+ */
+/** @ingroup WalAPI */
+class LazyReplay {
+public:
+  /**
+   * Read the log at `path` (a missing file is an empty log) and start the
+   * loaders. Records up to `afterLsn` are skipped, as in replayWal().
+   * @return Status::Internal on I/O errors; Status::InvalidArgument if
+   *         the file is not a KadeDB log
+   */
+  static Result<std::unique_ptr<LazyReplay>>
+  open(const std::string &path, const WalTargets &targets,
+       uint64_t afterLsn = 0, LazyReplayOptions options = {});
+  // Stops the loaders after their current target
+  ~LazyReplay();
+
+  LazyReplay(const LazyReplay &) = delete;
+  LazyReplay &operator=(const LazyReplay &) = delete;
+
+  /**
+   * Replay the records of `target`, or wait for the thread replaying
+   * them. Cheap once they are applied, and for targets without records.
+   * @return the first failing record's error, on every call
+   */
+  Status load(WalEngine engine, const std::string &target);
+  // load() of every target of `engine`, e.g. for queries across series
+  Status loadAll(WalEngine engine);
+  // load() of every target: the whole replay done, like replayWal()
+  Status wait();
+
+  /**
+   * The names of `engine` as `base` (the storage's own list) shows them
+   * once replay is done: targets whose records create them are added and
+   * those whose records drop them removed, without loading any.
+   */
+  std::vector<std::string>
+  listed(WalEngine engine,
+         const std::function<std::vector<std::string>()> &base) const;
+
+  // Targets of `engine` with records not applied yet
+  std::vector<std::string> pendingTargets(WalEngine engine) const;
+  // Number of records applied so far
+  uint64_t applied() const { return applied_.load(); }
+  // load() calls per target with records, for LazyReplayOptions::hints of
+  // a later run
+  WalAccessCounts accessCounts() const;
+
+private:
+  struct Stream;
+
+  LazyReplay(WalTargets targets, uint64_t afterLsn);
+
+  // Whether this thread is the one to replay `s`
+  static bool claim(Stream &s);
+  // Replay a claimed `s` and wake its waiters
+  Status apply(Stream &s);
+  // Replay `s` if no thread has started it, else wait for it
+  Status run(Stream &s);
+  // The pending stream from `from` on with the most accesses, or null;
+  // advances `from` past streams that are no longer pending
+  Stream *pick(size_t &from) const;
+  void loaderLoop();
+
+  const WalTargets targets_;
+  const uint64_t afterLsn_;
+  // Each stream frees its records once applied
+  std::vector<WalRecord> records_;
+  std::vector<std::unique_ptr<Stream>> streams_;
+  // Engine byte and target name to stream; fixed after open()
+  std::unordered_map<std::string, Stream *> streamOf_;
+  std::atomic<uint64_t> applied_{0};
+
+  mutable std::mutex mtx_;
+  std::condition_variable doneCv_;
+  bool stop_ = false;
+  std::vector<std::thread> loaders_;
+};
+
+/**
+ * Follows a log file while its WriteAheadLog appends to it, e.g. to ship
+ * it to replicas. Each read() returns the intact records written after the
+ * previous one; a frame still being written is returned by a later read().
+ * Reopen readers when the log is reopened, which may truncate a torn tail.
+ */
+/** @ingroup WalAPI */
+class WalReader {
+public:
+  /**
+   * Follow the log at `path` from the record after `afterLsn`. A missing
+   * file is read as an empty log until it is created.
+   * @return Status::Internal on I/O errors
+   */
+  static Result<std::unique_ptr<WalReader>> open(const std::string &path,
+                                                 uint64_t afterLsn = 0);
+  ~WalReader();
+
+  WalReader(const WalReader &) = delete;
+  WalReader &operator=(const WalReader &) = delete;
+
+  /**
+   * The next records, at least one when any is available and at most
+   * about `maxBytes` of frames, none past `upToLsn`.
+   * @return Status::InvalidArgument if the file is not a KadeDB log;
+   *         Status::Internal on I/O errors
+   */
+  Result<std::vector<WalRecord>> read(size_t maxBytes = size_t{1} << 20,
+                                      uint64_t upToLsn = UINT64_MAX);
+
+  // Sequence number of the last record read (or skipped)
+  uint64_t lsn() const { return lsn_; }
+  // Whether the last read() stopped at the end of the log or at upToLsn
+  // rather than at maxBytes
+  bool atEnd() const { return atEnd_; }
+
+private:
+  WalReader(std::string path, uint64_t afterLsn)
+      : path_(std::move(path)), skip_(afterLsn) {}
+
+  const std::string path_;
+  const uint64_t skip_;
+  int fd_ = -1;
+  bool headerRead_ = false;
+  std::string buf_; // file bytes from buf_[pos_] on are not decoded yet
+  size_t pos_ = 0;
+  std::string dict_;
+  uint64_t lsn_ = 0;
+  bool atEnd_ = false;
+};
+
+/**
+ * The records of `data`, a complete log file image such as walFileHeader()
+ * followed by appendWalFrame() frames.
+ * @return Status::InvalidArgument on a bad header or a truncated or
+ *         corrupt frame
+ */
+Result<std::vector<WalRecord>> decodeWalFrames(const std::string &data);
+
+// The header WriteAheadLog files start with, and `rec` appended to `out` as
+// one of their frames, for writing other files that replayWal() reads. A
+// file whose frames use `codec` needs the header of the same codec.
+std::string walFileHeader(Codec codec = Codec::None);
+void appendWalFrame(std::string &out, const WalRecord &rec,
+                    Codec codec = Codec::None);
+
+} // namespace kadedb
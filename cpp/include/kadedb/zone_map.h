@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "kadedb/schema.h" // InlineRow
+#include "kadedb/value.h"  // InlineValue
+
+namespace kadedb {
+
+/**
+ * Summary of one column over a block of rows: the smallest and largest
+ * present cell and the number of absent (null) cells.
+ *
+ * Bounds are only kept while every present cell of the block compares
+ * consistently with them: cells of one type, none a NaN float, or Integer
+ * and Float cells mixed while every integer is exactly representable as a
+ * double. Then x.compare(rhs) lies between min.compare(rhs) and
+ * max.compare(rhs) for every present cell x, which is what lets a scan
+ * skip a block whose bounds rule a comparison out. A zone only widens as
+ * cells are added; a superset of the block's values is always safe.
+ */
+struct ColumnZone {
+  InlineValue min;
+  InlineValue max;
+  uint32_t present = 0;
+  uint32_t absent = 0;
+  // min and max bound the present cells
+  bool ordered = true;
+
+  void add(const InlineValue &v);
+
+  // Bounds [lo, hi] of the sign of x.compare(rhs) over the present cells
+  // x; false when the zone cannot tell (not ordered or no present cell)
+  bool compareRange(const InlineValue &rhs, int &lo, int &hi) const;
+
+private:
+  // Mixed Integer and Float cells, and any integer too wide for a double
+  bool mixed_ = false;
+  bool wideInts_ = false;
+};
+
+/** Zone map of a block of rows: one ColumnZone per column. */
+struct ZoneMap {
+  std::vector<ColumnZone> columns;
+
+  void add(const InlineRow &row);
+  void clear() { columns.clear(); }
+};
+
+} // namespace kadedb
@@ -0,0 +1,103 @@
+#include "kadedb/admission.h"
+
+#include <algorithm>
+
+namespace kadedb {
+namespace kadeql {
+
+namespace {
+
+// How often a waiter looks at its cancellation token
+constexpr auto kCancelPoll = std::chrono::milliseconds(10);
+
+} // namespace
+
+AdmissionController::Ticket &
+AdmissionController::Ticket::operator=(Ticket &&other) noexcept {
+  if (this != &other) {
+    release();
+    owner_ = other.owner_;
+    other.owner_ = nullptr;
+  }
+  return *this;
+}
+
+void AdmissionController::Ticket::release() {
+  if (owner_)
+    owner_->releaseSlot();
+  owner_ = nullptr;
+}
+
+Result<AdmissionController::Ticket>
+AdmissionController::admit(std::optional<double> estimatedRows,
+                           const CancellationToken *token,
+                           std::optional<Clock::time_point> deadline) {
+  using R = Result<Ticket>;
+  std::unique_lock<std::mutex> lk(mtx_);
+  if (estimatedRows && *estimatedRows <= options_.heavyRows) {
+    ++admittedLight_;
+    return R::ok(Ticket());
+  }
+  const uint64_t me = arrivals_++;
+  waiting_.push_back(me);
+  for (;;) {
+    if (waiting_.front() == me && running_ < std::max<size_t>(
+                                                 options_.maxHeavy, 1)) {
+      waiting_.pop_front();
+      ++running_;
+      ++admittedHeavy_;
+      // The next waiter may find a slot too
+      cv_.notify_all();
+      return R::ok(Ticket(this));
+    }
+    Status stop = Status::OK();
+    if (token && token->cancelled())
+      stop = Status::Cancelled("Query cancelled while waiting for admission");
+    else if (deadline && Clock::now() >= *deadline)
+      stop = Status::Cancelled("Query timed out waiting for admission");
+    if (!stop.ok()) {
+      waiting_.erase(std::find(waiting_.begin(), waiting_.end(), me));
+      ++rejected_;
+      cv_.notify_all();
+      return R::err(stop);
+    }
+    auto until = Clock::now() + kCancelPoll;
+    if (deadline && *deadline < until)
+      until = *deadline;
+    cv_.wait_until(lk, until);
+  }
+}
+
+void AdmissionController::releaseSlot() {
+  std::lock_guard<std::mutex> lk(mtx_);
+  --running_;
+  cv_.notify_all();
+}
+
+size_t AdmissionController::running() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return running_;
+}
+
+size_t AdmissionController::queued() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return waiting_.size();
+}
+
+uint64_t AdmissionController::admittedLight() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return admittedLight_;
+}
+
+uint64_t AdmissionController::admittedHeavy() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return admittedHeavy_;
+}
+
+uint64_t AdmissionController::rejected() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return rejected_;
+}
+
+} // namespace kadeql
+} // namespace kadedb
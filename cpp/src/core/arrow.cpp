@@ -0,0 +1,667 @@
+#include "kadedb/arrow.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace kadedb {
+
+namespace {
+
+// ---- Export ----------------------------------------------------------------
+
+// An 8-byte aligned buffer; Arrow only asks for 8, recommends 64
+struct Buffer {
+  std::vector<uint64_t> words;
+
+  explicit Buffer(size_t bytes) : words((bytes + 7) / 8, 0) {}
+  uint8_t *bytes() { return reinterpret_cast<uint8_t *>(words.data()); }
+  template <typename T> T *as() { return reinterpret_cast<T *>(words.data()); }
+};
+
+// Private data of an exported array: its buffers and (for the struct) the
+// child arrays, which the release callback releases first
+struct ExportedArray {
+  std::vector<Buffer> storage;
+  std::vector<const void *> buffers;
+  std::vector<ArrowArray> children;
+  std::vector<ArrowArray *> childPtrs;
+};
+
+struct ExportedSchema {
+  std::string format;
+  std::string name;
+  std::vector<ArrowSchema> children;
+  std::vector<ArrowSchema *> childPtrs;
+};
+
+void releaseArray(ArrowArray *a) {
+  auto *priv = static_cast<ExportedArray *>(a->private_data);
+  // Children moved out by the consumer have their release cleared
+  for (ArrowArray *child : priv->childPtrs)
+    if (child->release)
+      child->release(child);
+  delete priv;
+  a->release = nullptr;
+}
+
+void releaseSchema(ArrowSchema *s) {
+  auto *priv = static_cast<ExportedSchema *>(s->private_data);
+  for (ArrowSchema *child : priv->childPtrs)
+    if (child->release)
+      child->release(child);
+  delete priv;
+  s->release = nullptr;
+}
+
+void fillSchema(ArrowSchema *out, ExportedSchema *priv, int64_t flags) {
+  out->format = priv->format.c_str();
+  out->name = priv->name.c_str();
+  out->metadata = nullptr;
+  out->flags = flags;
+  out->dictionary = nullptr;
+  out->n_children = static_cast<int64_t>(priv->childPtrs.size());
+  out->children = priv->childPtrs.empty() ? nullptr : priv->childPtrs.data();
+  out->release = &releaseSchema;
+  out->private_data = priv;
+}
+
+void fillArray(ArrowArray *out, ExportedArray *priv, int64_t length,
+               int64_t nullCount) {
+  out->length = length;
+  out->null_count = nullCount;
+  out->offset = 0;
+  out->n_buffers = static_cast<int64_t>(priv->buffers.size());
+  out->buffers = priv->buffers.empty() ? nullptr : priv->buffers.data();
+  out->n_children = static_cast<int64_t>(priv->childPtrs.size());
+  out->children = priv->childPtrs.empty() ? nullptr : priv->childPtrs.data();
+  out->dictionary = nullptr;
+  out->release = &releaseArray;
+  out->private_data = priv;
+}
+
+void setBit(uint8_t *bits, size_t i) {
+  bits[i >> 3] = static_cast<uint8_t>(bits[i >> 3] | (1u << (i & 7)));
+}
+
+const Value *cellAt(const ResultSet &rs, size_t r, size_t c) {
+  const Value *v = rs.row(r).values().at(c).get();
+  return v && v->type() != ValueType::Null ? v : nullptr;
+}
+
+// Build the child array and format of column `c`
+Status exportColumn(const ResultSet &rs, size_t c, ExportedArray &arr,
+                    std::string &format, int64_t &nullCount) {
+  const size_t n = rs.rowCount();
+  ColumnType type = rs.columnTypes()[c];
+  if (type == ColumnType::Null) {
+    for (size_t r = 0; r < n; ++r)
+      if (const Value *v = cellAt(rs, r, c)) {
+        type = static_cast<ColumnType>(v->type());
+        break;
+      }
+  }
+
+  Buffer validity((n + 7) / 8);
+  size_t nulls = 0;
+  for (size_t r = 0; r < n; ++r) {
+    const Value *v = cellAt(rs, r, c);
+    if (!v) {
+      ++nulls;
+      continue;
+    }
+    const ValueType vt = v->type();
+    const bool fits =
+        vt == static_cast<ValueType>(type) ||
+        (type == ColumnType::Float && vt == ValueType::Integer);
+    if (!fits)
+      return Status::InvalidArgument("Column '" + rs.columnNames()[c] +
+                                     "' mixes value types; row " +
+                                     std::to_string(r) + " does not match");
+    setBit(validity.bytes(), r);
+  }
+  nullCount = static_cast<int64_t>(nulls);
+  if (type == ColumnType::Null) {
+    // The null type has no buffers at all
+    format = "n";
+    return Status::OK();
+  }
+  arr.storage.push_back(std::move(validity));
+
+  switch (type) {
+  case ColumnType::Integer: {
+    Buffer data(n * sizeof(int64_t));
+    auto *out = data.as<int64_t>();
+    for (size_t r = 0; r < n; ++r)
+      if (const Value *v = cellAt(rs, r, c))
+        out[r] = static_cast<const IntegerValue &>(*v).value();
+    arr.storage.push_back(std::move(data));
+    format = "l";
+    break;
+  }
+  case ColumnType::Float: {
+    Buffer data(n * sizeof(double));
+    auto *out = data.as<double>();
+    for (size_t r = 0; r < n; ++r)
+      if (const Value *v = cellAt(rs, r, c))
+        out[r] = v->type() == ValueType::Integer
+                     ? static_cast<double>(
+                           static_cast<const IntegerValue &>(*v).value())
+                     : static_cast<const FloatValue &>(*v).value();
+    arr.storage.push_back(std::move(data));
+    format = "g";
+    break;
+  }
+  case ColumnType::Boolean: {
+    Buffer data((n + 7) / 8);
+    for (size_t r = 0; r < n; ++r)
+      if (const Value *v = cellAt(rs, r, c))
+        if (static_cast<const BooleanValue &>(*v).value())
+          setBit(data.bytes(), r);
+    arr.storage.push_back(std::move(data));
+    format = "b";
+    break;
+  }
+  case ColumnType::String: {
+    size_t total = 0;
+    for (size_t r = 0; r < n; ++r)
+      if (const Value *v = cellAt(rs, r, c))
+        total += static_cast<const StringValue &>(*v).value().size();
+    // 32-bit offsets unless the text outgrows them
+    const bool large =
+        total > static_cast<size_t>(std::numeric_limits<int32_t>::max());
+    Buffer offsets((n + 1) * (large ? sizeof(int64_t) : sizeof(int32_t)));
+    Buffer data(total);
+    size_t pos = 0;
+    for (size_t r = 0; r < n; ++r) {
+      if (large)
+        offsets.as<int64_t>()[r] = static_cast<int64_t>(pos);
+      else
+        offsets.as<int32_t>()[r] = static_cast<int32_t>(pos);
+      if (const Value *v = cellAt(rs, r, c)) {
+        const auto &s = static_cast<const StringValue &>(*v).value();
+        std::memcpy(data.bytes() + pos, s.data(), s.size());
+        pos += s.size();
+      }
+    }
+    if (large)
+      offsets.as<int64_t>()[n] = static_cast<int64_t>(pos);
+    else
+      offsets.as<int32_t>()[n] = static_cast<int32_t>(pos);
+    arr.storage.push_back(std::move(offsets));
+    arr.storage.push_back(std::move(data));
+    format = large ? "U" : "u";
+    break;
+  }
+  case ColumnType::Null:
+    break;
+  }
+
+  for (auto &b : arr.storage)
+    arr.buffers.push_back(b.words.data());
+  // A validity buffer may be omitted when nothing is null
+  if (nulls == 0)
+    arr.buffers[0] = nullptr;
+  return Status::OK();
+}
+
+// ---- Import ----------------------------------------------------------------
+
+// Releases the consumed structures on every return path
+struct ConsumedBatch {
+  ArrowSchema *schema;
+  ArrowArray *array;
+  ~ConsumedBatch() {
+    if (array && array->release)
+      array->release(array);
+    if (schema && schema->release)
+      schema->release(schema);
+  }
+};
+
+float halfToFloat(uint16_t h) {
+  const int exp = (h >> 10) & 0x1F;
+  const int mant = h & 0x3FF;
+  float v;
+  if (exp == 0)
+    v = std::ldexp(static_cast<float>(mant), -24);
+  else if (exp == 31)
+    v = mant ? std::numeric_limits<float>::quiet_NaN()
+             : std::numeric_limits<float>::infinity();
+  else
+    v = std::ldexp(static_cast<float>(mant | 0x400), exp - 25);
+  return (h & 0x8000) ? -v : v;
+}
+
+// One child of an imported struct array
+struct ImportColumn {
+  enum class Kind {
+    Null,
+    Int,
+    UInt,
+    Half,
+    Float,
+    Double,
+    Utf8,
+    LargeUtf8,
+    Bool
+  };
+
+  std::string name;
+  Kind kind = Kind::Null;
+  int width = 0; // bytes per integer
+  const uint8_t *validity = nullptr;
+  const uint8_t *data = nullptr;
+  const void *offsets = nullptr;
+  int64_t offset = 0; // of row 0, parent offset included
+  int64_t nullCount = 0;
+
+  bool isValid(int64_t i) const {
+    if (kind == Kind::Null)
+      return false;
+    if (!validity)
+      return true;
+    const int64_t j = offset + i;
+    return (validity[j >> 3] >> (j & 7)) & 1;
+  }
+
+  bool integral() const { return kind == Kind::Int || kind == Kind::UInt; }
+
+  // Cell i converted for a `target` column (integers widen to Float)
+  Status cell(int64_t i, ColumnType target,
+              std::unique_ptr<Value> &out) const {
+    out.reset();
+    if (!isValid(i))
+      return Status::OK();
+    const int64_t j = offset + i;
+    switch (kind) {
+    case Kind::Null:
+      return Status::OK();
+    case Kind::Int:
+    case Kind::UInt: {
+      int64_t v = 0;
+      if (kind == Kind::Int) {
+        switch (width) {
+        case 1:
+          v = reinterpret_cast<const int8_t *>(data)[j];
+          break;
+        case 2:
+          v = reinterpret_cast<const int16_t *>(data)[j];
+          break;
+        case 4:
+          v = reinterpret_cast<const int32_t *>(data)[j];
+          break;
+        default:
+          v = reinterpret_cast<const int64_t *>(data)[j];
+        }
+      } else {
+        uint64_t u = 0;
+        switch (width) {
+        case 1:
+          u = data[j];
+          break;
+        case 2:
+          u = reinterpret_cast<const uint16_t *>(data)[j];
+          break;
+        case 4:
+          u = reinterpret_cast<const uint32_t *>(data)[j];
+          break;
+        default:
+          u = reinterpret_cast<const uint64_t *>(data)[j];
+        }
+        if (u > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+          return Status::InvalidArgument("Column '" + name + "': value " +
+                                         std::to_string(u) +
+                                         " exceeds the Integer range");
+        v = static_cast<int64_t>(u);
+      }
+      if (target == ColumnType::Float)
+        out = std::make_unique<FloatValue>(static_cast<double>(v));
+      else
+        out = std::make_unique<IntegerValue>(v);
+      return Status::OK();
+    }
+    case Kind::Half:
+      out = std::make_unique<FloatValue>(
+          halfToFloat(reinterpret_cast<const uint16_t *>(data)[j]));
+      return Status::OK();
+    case Kind::Float:
+      out = std::make_unique<FloatValue>(
+          reinterpret_cast<const float *>(data)[j]);
+      return Status::OK();
+    case Kind::Double:
+      out = std::make_unique<FloatValue>(
+          reinterpret_cast<const double *>(data)[j]);
+      return Status::OK();
+    case Kind::Utf8:
+    case Kind::LargeUtf8: {
+      int64_t begin, end;
+      if (kind == Kind::Utf8) {
+        begin = static_cast<const int32_t *>(offsets)[j];
+        end = static_cast<const int32_t *>(offsets)[j + 1];
+      } else {
+        begin = static_cast<const int64_t *>(offsets)[j];
+        end = static_cast<const int64_t *>(offsets)[j + 1];
+      }
+      out = std::make_unique<StringValue>(std::string(
+          reinterpret_cast<const char *>(data) + begin,
+          static_cast<size_t>(end - begin)));
+      return Status::OK();
+    }
+    case Kind::Bool:
+      out = std::make_unique<BooleanValue>((data[j >> 3] >> (j & 7)) & 1);
+      return Status::OK();
+    }
+    return Status::OK();
+  }
+};
+
+bool startsWith(const std::string &s, const char *prefix) {
+  return s.compare(0, std::strlen(prefix), prefix) == 0;
+}
+
+// Element kind and width of a primitive Arrow format, false if unsupported
+bool parseFormat(const std::string &f, ImportColumn &col) {
+  using Kind = ImportColumn::Kind;
+  struct Fixed {
+    const char *format;
+    Kind kind;
+    int width;
+  };
+  static const Fixed fixed[] = {
+      {"n", Kind::Null, 0},      {"b", Kind::Bool, 0},
+      {"c", Kind::Int, 1},       {"C", Kind::UInt, 1},
+      {"s", Kind::Int, 2},       {"S", Kind::UInt, 2},
+      {"i", Kind::Int, 4},       {"I", Kind::UInt, 4},
+      {"l", Kind::Int, 8},       {"L", Kind::UInt, 8},
+      {"e", Kind::Half, 2},      {"f", Kind::Float, 4},
+      {"g", Kind::Double, 8},    {"u", Kind::Utf8, 0},
+      {"U", Kind::LargeUtf8, 0}, {"tdD", Kind::Int, 4},
+      {"tdm", Kind::Int, 8},     {"tts", Kind::Int, 4},
+      {"ttm", Kind::Int, 4},     {"ttu", Kind::Int, 8},
+      {"ttn", Kind::Int, 8},
+  };
+  for (const auto &fx : fixed)
+    if (f == fx.format) {
+      col.kind = fx.kind;
+      col.width = fx.width;
+      return true;
+    }
+  // Timestamps ("tsu:UTC" etc.) and durations read as their 64-bit count
+  if ((startsWith(f, "ts") && f.size() >= 4 && f[3] == ':') ||
+      (startsWith(f, "tD") && f.size() == 3)) {
+    col.kind = Kind::Int;
+    col.width = 8;
+    return true;
+  }
+  return false;
+}
+
+struct ImportBatch {
+  int64_t rows = 0;
+  const uint8_t *validity = nullptr; // of the struct itself
+  int64_t offset = 0;
+  std::vector<ImportColumn> columns;
+
+  bool rowValid(int64_t i) const {
+    if (!validity)
+      return true;
+    const int64_t j = offset + i;
+    return (validity[j >> 3] >> (j & 7)) & 1;
+  }
+
+  size_t find(const std::string &name) const {
+    for (size_t i = 0; i < columns.size(); ++i)
+      if (columns[i].name == name)
+        return i;
+    return static_cast<size_t>(-1);
+  }
+};
+
+Status openBatch(const ArrowSchema *schema, const ArrowArray *array,
+                 ImportBatch &batch) {
+  if (!schema || !array || !schema->release || !array->release)
+    return Status::InvalidArgument("Arrow batch is missing or released");
+  if (!schema->format || std::strcmp(schema->format, "+s") != 0)
+    return Status::InvalidArgument(
+        "Arrow batch must be a struct array (format \"+s\")");
+  if (schema->n_children != array->n_children || array->length < 0)
+    return Status::InvalidArgument("Arrow schema and array do not match");
+  batch.rows = array->length;
+  batch.offset = array->offset;
+  if (array->n_buffers > 0 && array->buffers)
+    batch.validity = static_cast<const uint8_t *>(array->buffers[0]);
+  if (array->null_count == 0)
+    batch.validity = nullptr;
+
+  for (int64_t c = 0; c < schema->n_children; ++c) {
+    const ArrowSchema *cs = schema->children[c];
+    const ArrowArray *ca = array->children[c];
+    ImportColumn col;
+    col.name = cs->name ? cs->name : "";
+    const std::string format = cs->format ? cs->format : "";
+    if (cs->dictionary || !parseFormat(format, col))
+      return Status::InvalidArgument("Column '" + col.name +
+                                     "': unsupported Arrow format \"" +
+                                     format + "\"");
+    const int64_t want =
+        col.kind == ImportColumn::Kind::Null
+            ? 0
+            : (col.kind == ImportColumn::Kind::Utf8 ||
+                       col.kind == ImportColumn::Kind::LargeUtf8
+                   ? 3
+                   : 2);
+    if (ca->n_buffers < want || ca->length < batch.offset + batch.rows ||
+        ca->offset < 0)
+      return Status::InvalidArgument("Column '" + col.name +
+                                     "': malformed Arrow array");
+    col.offset = batch.offset + ca->offset;
+    col.nullCount = ca->null_count;
+    if (want > 0) {
+      col.validity = static_cast<const uint8_t *>(ca->buffers[0]);
+      if (ca->null_count == 0)
+        col.validity = nullptr;
+    }
+    if (want == 2) {
+      col.data = static_cast<const uint8_t *>(ca->buffers[1]);
+    } else if (want == 3) {
+      col.offsets = ca->buffers[1];
+      col.data = static_cast<const uint8_t *>(ca->buffers[2]);
+    }
+    batch.columns.push_back(std::move(col));
+  }
+  return Status::OK();
+}
+
+Status atRow(int64_t r, const Status &st) {
+  return Status(st.code(), "Row " + std::to_string(r) + ": " + st.message());
+}
+
+} // namespace
+
+Status exportArrow(const ResultSet &rs, ArrowSchema *schema,
+                   ArrowArray *array) {
+  if (!schema || !array)
+    return Status::InvalidArgument("exportArrow: null output structure");
+  const size_t cols = rs.columnCount();
+  const auto rows = static_cast<int64_t>(rs.rowCount());
+
+  auto arr = std::make_unique<ExportedArray>();
+  auto sch = std::make_unique<ExportedSchema>();
+  sch->format = "+s";
+  arr->children.resize(cols);
+  sch->children.resize(cols);
+  // The struct itself has only an (omitted) validity buffer
+  arr->buffers.push_back(nullptr);
+
+  // Children are filled before they are linked, so a failure part way only
+  // has to release the ones already built
+  size_t built = 0;
+  Status st = Status::OK();
+  for (; built < cols; ++built) {
+    auto childArr = std::make_unique<ExportedArray>();
+    auto childSch = std::make_unique<ExportedSchema>();
+    int64_t nulls = 0;
+    st = exportColumn(rs, built, *childArr, childSch->format, nulls);
+    if (!st.ok())
+      break;
+    childSch->name = rs.columnNames()[built];
+    fillArray(&arr->children[built], childArr.release(), rows, nulls);
+    fillSchema(&sch->children[built], childSch.release(),
+               nulls ? ARROW_FLAG_NULLABLE : 0);
+  }
+  if (!st.ok()) {
+    for (size_t i = 0; i < built; ++i) {
+      releaseArray(&arr->children[i]);
+      releaseSchema(&sch->children[i]);
+    }
+    return st;
+  }
+  for (size_t i = 0; i < cols; ++i) {
+    arr->childPtrs.push_back(&arr->children[i]);
+    sch->childPtrs.push_back(&sch->children[i]);
+  }
+  fillArray(array, arr.release(), rows, 0);
+  fillSchema(schema, sch.release(), 0);
+  return Status::OK();
+}
+
+Result<size_t> importArrow(ArrowSchema *schema, ArrowArray *array,
+                           RelationalStorage &storage,
+                           const std::string &table) {
+  ConsumedBatch consumed{schema, array};
+  ImportBatch batch;
+  if (Status st = openBatch(schema, array, batch); !st.ok())
+    return Result<size_t>::err(st);
+  auto ts = storage.getTableSchema(table);
+  if (!ts.hasValue())
+    return Result<size_t>::err(ts.status());
+  const auto &cols = ts.value().columns();
+
+  // Table column -> batch column
+  std::vector<size_t> source(cols.size(), static_cast<size_t>(-1));
+  for (size_t b = 0; b < batch.columns.size(); ++b) {
+    const size_t idx = ts.value().findColumn(batch.columns[b].name);
+    if (idx == TableSchema::npos)
+      return Result<size_t>::err(Status::InvalidArgument(
+          "Unknown column in Arrow batch: " + batch.columns[b].name));
+    source[idx] = b;
+  }
+
+  std::unique_ptr<Value> v;
+  for (int64_t r = 0; r < batch.rows; ++r) {
+    Row row(cols.size());
+    if (batch.rowValid(r)) {
+      for (size_t c = 0; c < cols.size(); ++c) {
+        if (source[c] == static_cast<size_t>(-1))
+          continue;
+        if (Status st = batch.columns[source[c]].cell(r, cols[c].type, v);
+            !st.ok())
+          return Result<size_t>::err(atRow(r, st));
+        row.set(c, std::move(v));
+      }
+    }
+    if (Status st = storage.insertRow(table, row); !st.ok())
+      return Result<size_t>::err(atRow(r, st));
+  }
+  return Result<size_t>::ok(static_cast<size_t>(batch.rows));
+}
+
+Result<size_t> importArrow(ArrowSchema *schema, ArrowArray *array,
+                           TimeSeriesStorage &storage,
+                           const std::string &series) {
+  ConsumedBatch consumed{schema, array};
+  ImportBatch batch;
+  if (Status st = openBatch(schema, array, batch); !st.ok())
+    return Result<size_t>::err(st);
+  auto ss = storage.getSeriesSchema(series);
+  if (!ss.hasValue())
+    return Result<size_t>::err(ss.status());
+  const TimeSeriesSchema &sch = ss.value();
+  const auto &tags = sch.tagColumns();
+  const auto &values = sch.valueColumns();
+
+  // Row layout: timestamp, tags, values; each slot maps to a batch column
+  const size_t width = 1 + tags.size() + values.size();
+  std::vector<size_t> source(width, static_cast<size_t>(-1));
+  std::vector<ColumnType> types(width, ColumnType::Integer);
+  for (size_t b = 0; b < batch.columns.size(); ++b) {
+    const std::string &name = batch.columns[b].name;
+    const size_t tag = sch.findTagColumn(name);
+    const size_t value = sch.findValueColumn(name);
+    size_t slot;
+    if (name == sch.timestampColumn())
+      slot = 0;
+    else if (tag != TimeSeriesSchema::npos)
+      slot = 1 + tag;
+    else if (value != TimeSeriesSchema::npos)
+      slot = 1 + tags.size() + value;
+    else
+      return Result<size_t>::err(
+          Status::InvalidArgument("Unknown column in Arrow batch: " + name));
+    source[slot] = b;
+  }
+  if (source[0] == static_cast<size_t>(-1))
+    return Result<size_t>::err(Status::InvalidArgument(
+        "Arrow batch lacks the timestamp column " + sch.timestampColumn()));
+  for (size_t t = 0; t < tags.size(); ++t)
+    types[1 + t] = tags[t].type;
+  for (size_t v = 0; v < values.size(); ++v)
+    types[1 + tags.size() + v] = values[v].type;
+
+  const auto noNulls = [&](const ImportColumn &c) {
+    return !c.validity && !batch.validity;
+  };
+  const ImportColumn &tsCol = batch.columns[source[0]];
+  bool direct = tsCol.kind == ImportColumn::Kind::Int && tsCol.width == 8 &&
+                noNulls(tsCol);
+  for (size_t t = 0; direct && t < tags.size(); ++t)
+    direct = source[1 + t] == static_cast<size_t>(-1);
+  for (size_t v = 0; direct && v < values.size(); ++v) {
+    const size_t b = source[1 + tags.size() + v];
+    direct = b != static_cast<size_t>(-1) &&
+             values[v].type == ColumnType::Float &&
+             batch.columns[b].kind == ImportColumn::Kind::Double &&
+             noNulls(batch.columns[b]);
+  }
+  if (direct) {
+    // The Arrow buffers are the columns appendColumns() wants
+    std::vector<const double *> cols(values.size());
+    for (size_t v = 0; v < values.size(); ++v) {
+      const ImportColumn &c = batch.columns[source[1 + tags.size() + v]];
+      cols[v] = reinterpret_cast<const double *>(c.data) + c.offset;
+    }
+    const int64_t *stamps =
+        reinterpret_cast<const int64_t *>(tsCol.data) + tsCol.offset;
+    Status st = storage.appendColumns(series, stamps, cols.data(),
+                                      static_cast<size_t>(batch.rows));
+    if (!st.ok())
+      return Result<size_t>::err(st);
+    return Result<size_t>::ok(static_cast<size_t>(batch.rows));
+  }
+
+  std::vector<Row> rows;
+  rows.reserve(static_cast<size_t>(batch.rows));
+  std::unique_ptr<Value> v;
+  for (int64_t r = 0; r < batch.rows; ++r) {
+    Row row(width);
+    if (batch.rowValid(r)) {
+      for (size_t s = 0; s < width; ++s) {
+        if (source[s] == static_cast<size_t>(-1))
+          continue;
+        if (Status st = batch.columns[source[s]].cell(r, types[s], v);
+            !st.ok())
+          return Result<size_t>::err(atRow(r, st));
+        row.set(s, std::move(v));
+      }
+    }
+    rows.push_back(std::move(row));
+  }
+  if (Status st = storage.appendBatch(series, rows); !st.ok())
+    return Result<size_t>::err(st);
+  return Result<size_t>::ok(rows.size());
+}
+
+} // namespace kadedb
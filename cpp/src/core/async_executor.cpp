@@ -0,0 +1,97 @@
+#include "kadedb/async_executor.h"
+
+#include "kadedb/query_executor.h"
+#include "kadedb/tracing.h"
+
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace kadedb {
+namespace kadeql {
+
+Result<ResultSet>
+AsyncQueryExecutor::run(const PreparedStatement &statement,
+                        const Params &params,
+                        const CancellationToken &token) const {
+  using R = Result<ResultSet>;
+  if (token.cancelled())
+    return R::err(Status::Cancelled("Query cancelled"));
+  try {
+    QueryExecutor exec = timeseries_ ? QueryExecutor(*storage_, *timeseries_)
+                                     : QueryExecutor(*storage_);
+    exec.setCancellationToken(token);
+    exec.setTimeout(timeout_);
+    if (admission_)
+      exec.setAdmissionController(*admission_);
+    if (statement.statement().type() != StatementType::SELECT)
+      return statement.execute(exec, params);
+
+    // Stream the SELECT so a cancel stops its scan between batches
+    std::optional<ResultSet> rs;
+    RelationalStorage::BatchSink sink = [&](RowBatch &batch) {
+      if (!rs)
+        rs.emplace(batch.columnNames, batch.columnTypes);
+      for (auto &row : batch.rows)
+        rs->addRow(ResultRow(std::move(row)));
+      return !token.cancelled();
+    };
+    Status st = statement.execute(exec, params, sink);
+    if (!st.ok())
+      return R::err(st);
+    if (token.cancelled())
+      return R::err(Status::Cancelled("Query cancelled"));
+    return R::ok(rs ? std::move(*rs) : ResultSet());
+  } catch (const std::exception &e) {
+    return R::err(Status::Internal(e.what()));
+  } catch (...) {
+    return R::err(Status::Internal("query failed"));
+  }
+}
+
+void AsyncQueryExecutor::executeAsync(
+    std::shared_ptr<const PreparedStatement> statement, Params params,
+    Callback done, CancellationToken token) const {
+  // std::function needs a copyable task
+  auto args = std::make_shared<Params>(std::move(params));
+  // The task holds a copy, so this executor need not outlive it. Its spans
+  // (and those of `done`) continue the submitting thread's trace.
+  pool_->submit([self = *this, statement = std::move(statement), args,
+                 done = std::move(done), token = std::move(token),
+                 trace = tracing::current()] {
+    tracing::ContextScope traced(trace);
+    Result<ResultSet> res = self.run(*statement, *args, token);
+    // Exceptions from the callback must not reach the worker
+    try {
+      done(std::move(res));
+    } catch (...) {
+    }
+  });
+}
+
+std::future<Result<ResultSet>> AsyncQueryExecutor::executeAsync(
+    std::shared_ptr<const PreparedStatement> statement, Params params,
+    CancellationToken token) const {
+  auto promise = std::make_shared<std::promise<Result<ResultSet>>>();
+  auto future = promise->get_future();
+  executeAsync(
+      std::move(statement), std::move(params),
+      [promise](Result<ResultSet> res) { promise->set_value(std::move(res)); },
+      std::move(token));
+  return future;
+}
+
+std::future<Result<ResultSet>>
+AsyncQueryExecutor::executeAsync(const std::string &query,
+                                 CancellationToken token) const {
+  auto ps = PreparedStatement::prepare(query);
+  if (!ps.hasValue()) {
+    std::promise<Result<ResultSet>> failed;
+    failed.set_value(Result<ResultSet>::err(ps.status()));
+    return failed.get_future();
+  }
+  return executeAsync(ps.takeValue(), {}, std::move(token));
+}
+
+} // namespace kadeql
+} // namespace kadedb
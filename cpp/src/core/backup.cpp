@@ -0,0 +1,281 @@
+#include "kadedb/backup.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace kadedb {
+namespace {
+
+Status ioError(const std::string &what, const std::string &path) {
+  return Status::Internal(what + " " + path + ": " + std::strerror(errno));
+}
+
+// Frames records into chunks and hands each to `write`, pacing the chunks
+// to options.maxBytesPerSecond
+class BackupWriter {
+public:
+  using WriteFn = std::function<Status(const char *data, size_t size)>;
+
+  BackupWriter(WriteFn write, const BackupOptions &options)
+      : write_(std::move(write)), options_(options),
+        start_(std::chrono::steady_clock::now()) {
+    buf_ = walFileHeader(options_.compression);
+  }
+
+  Status add(const WalRecord &rec) {
+    appendWalFrame(buf_, rec, options_.compression);
+    ++stats_.records;
+    return buf_.size() >= options_.chunkBytes ? flush() : Status::OK();
+  }
+
+  Status flush() {
+    if (buf_.empty())
+      return Status::OK();
+    Status st = write_(buf_.data(), buf_.size());
+    if (!st.ok())
+      return st;
+    stats_.bytes += buf_.size();
+    buf_.clear();
+    if (options_.maxBytesPerSecond) {
+      const auto due =
+          start_ + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::duration<double>(
+                           static_cast<double>(stats_.bytes) /
+                           static_cast<double>(options_.maxBytesPerSecond)));
+      std::this_thread::sleep_until(due);
+    }
+    return Status::OK();
+  }
+
+  const BackupStats &stats() const { return stats_; }
+
+private:
+  WriteFn write_;
+  const BackupOptions options_;
+  const std::chrono::steady_clock::time_point start_;
+  std::string buf_;
+  BackupStats stats_;
+};
+
+// Rows of a storage batch as owned Rows
+std::vector<Row> toRows(RowBatch &batch) {
+  std::vector<Row> rows;
+  rows.reserve(batch.rows.size());
+  for (auto &cells : batch.rows) {
+    Row row(cells.size());
+    for (size_t c = 0; c < cells.size(); ++c)
+      row.set(c, std::move(cells[c]));
+    rows.push_back(std::move(row));
+  }
+  return rows;
+}
+
+// A sink for scan() that writes each batch through `fn` and keeps the
+// first error, which ends the scan
+template <typename Fn>
+RelationalStorage::BatchSink batchWriter(Status &err, Fn fn) {
+  return [&err, fn](RowBatch &batch) {
+    err = fn(toRows(batch));
+    return err.ok();
+  };
+}
+
+Status backupTables(RelationalStorage &storage, BackupWriter &out) {
+  for (const auto &table : storage.listTables()) {
+    auto schema = storage.getTableSchema(table);
+    if (!schema.hasValue()) {
+      if (schema.status().code() == StatusCode::NotFound)
+        continue; // dropped meanwhile
+      return schema.status();
+    }
+    Status st = out.add(walRecord::createTable(table, schema.value()));
+    if (!st.ok())
+      return st;
+    Status err;
+    st = storage.scan(table, {}, std::nullopt,
+                      batchWriter(err,
+                                  [&](const std::vector<Row> &rows) {
+                                    for (const auto &row : rows) {
+                                      Status s = out.add(
+                                          walRecord::insertRow(table, row));
+                                      if (!s.ok())
+                                        return s;
+                                    }
+                                    return Status::OK();
+                                  }),
+                      RelationalStorage::kDefaultBatchRows);
+    if (!err.ok())
+      return err;
+    if (!st.ok())
+      return st;
+  }
+  return Status::OK();
+}
+
+Status backupCollections(DocumentStorage &storage, BackupWriter &out) {
+  for (const auto &collection : storage.listCollections()) {
+    auto schema = storage.getCollectionSchema(collection);
+    auto docs = storage.query(collection, {});
+    if (!schema.hasValue() || !docs.hasValue()) {
+      const Status &st = schema.hasValue() ? docs.status() : schema.status();
+      if (st.code() == StatusCode::NotFound)
+        continue;
+      return st;
+    }
+    Status st =
+        out.add(walRecord::createCollection(collection, schema.value()));
+    for (const auto &kv : docs.value()) {
+      if (!st.ok())
+        return st;
+      st = out.add(walRecord::putDocument(collection, kv.first, kv.second));
+    }
+    if (!st.ok())
+      return st;
+  }
+  return Status::OK();
+}
+
+Status backupSeries(TimeSeriesStorage &storage, BackupWriter &out) {
+  for (const auto &series : storage.listSeries()) {
+    auto schema = storage.getSeriesSchema(series);
+    auto partition = storage.getSeriesPartition(series);
+    if (!schema.hasValue() || !partition.hasValue()) {
+      const Status &st =
+          schema.hasValue() ? partition.status() : schema.status();
+      if (st.code() == StatusCode::NotFound)
+        continue;
+      return st;
+    }
+    Status st = out.add(walRecord::createSeries(series, schema.value(),
+                                                partition.value()));
+    if (!st.ok())
+      return st;
+    Status err;
+    st = storage.scan(series, {}, std::numeric_limits<int64_t>::min(),
+                      std::numeric_limits<int64_t>::max(), std::nullopt,
+                      batchWriter(err,
+                                  [&](const std::vector<Row> &rows) {
+                                    return out.add(
+                                        walRecord::appendRows(series, rows));
+                                  }));
+    if (!err.ok())
+      return err;
+    if (!st.ok() && st.code() != StatusCode::NotFound)
+      return st;
+  }
+  return Status::OK();
+}
+
+Status backupGraphs(GraphStorage &storage, BackupWriter &out) {
+  for (const auto &graph : storage.listGraphs()) {
+    auto contents = storage.contents(graph);
+    if (!contents.hasValue()) {
+      if (contents.status().code() == StatusCode::NotFound)
+        continue;
+      return contents.status();
+    }
+    Status st = out.add(walRecord::createGraph(graph));
+    for (const auto &node : contents.value().nodes) {
+      if (!st.ok())
+        return st;
+      st = out.add(walRecord::putNode(graph, node));
+    }
+    for (const auto &edge : contents.value().edges) {
+      if (!st.ok())
+        return st;
+      st = out.add(walRecord::putEdge(graph, edge));
+    }
+    if (!st.ok())
+      return st;
+  }
+  return Status::OK();
+}
+
+Result<BackupStats> runBackup(BackupWriter &out, const WalTargets &sources) {
+  Status st;
+  if (sources.relational &&
+      !(st = backupTables(*sources.relational, out)).ok())
+    return Result<BackupStats>::err(st);
+  if (sources.document &&
+      !(st = backupCollections(*sources.document, out)).ok())
+    return Result<BackupStats>::err(st);
+  if (sources.timeseries &&
+      !(st = backupSeries(*sources.timeseries, out)).ok())
+    return Result<BackupStats>::err(st);
+  if (sources.graph && !(st = backupGraphs(*sources.graph, out)).ok())
+    return Result<BackupStats>::err(st);
+  if (!(st = out.flush()).ok())
+    return Result<BackupStats>::err(st);
+  return Result<BackupStats>::ok(out.stats());
+}
+
+} // namespace
+
+Result<BackupStats> writeBackup(std::ostream &out, const WalTargets &sources,
+                                const BackupOptions &options) {
+  BackupWriter writer(
+      [&out](const char *data, size_t size) {
+        out.write(data, static_cast<std::streamsize>(size));
+        return out ? Status::OK()
+                   : Status::Internal("cannot write the backup stream");
+      },
+      options);
+  return runBackup(writer, sources);
+}
+
+Result<BackupStats> writeBackup(const std::string &path,
+                                const WalTargets &sources,
+                                const BackupOptions &options) {
+  using R = Result<BackupStats>;
+  const std::string tmp = path + ".tmp";
+  std::FILE *f = std::fopen(tmp.c_str(), "wb");
+  if (!f)
+    return R::err(ioError("cannot create", tmp));
+  BackupWriter writer(
+      [&](const char *data, size_t size) {
+        return std::fwrite(data, 1, size, f) == size
+                   ? Status::OK()
+                   : ioError("cannot write", tmp);
+      },
+      options);
+  auto res = runBackup(writer, sources);
+  bool ok = std::fflush(f) == 0;
+#ifdef _WIN32
+  ok = ok && ::_commit(::_fileno(f)) == 0;
+#else
+  ok = ok && ::fsync(::fileno(f)) == 0;
+#endif
+  ok = std::fclose(f) == 0 && ok;
+  if (!res.hasValue() || !ok) {
+    std::remove(tmp.c_str());
+    if (!res.hasValue())
+      return res;
+    return R::err(ioError("cannot sync", tmp));
+  }
+#ifdef _WIN32
+  std::remove(path.c_str());
+#endif
+  if (std::rename(tmp.c_str(), path.c_str()) != 0)
+    return R::err(ioError("cannot rename " + tmp + " to", path));
+  return res;
+}
+
+Result<uint64_t> restoreBackup(const std::string &path,
+                               const WalTargets &targets, size_t threads) {
+  return replayWalFile(path, targets, threads);
+}
+
+} // namespace kadedb
@@ -0,0 +1,30 @@
+#include "kadedb/cancellation.h"
+
+#include <utility>
+
+namespace kadedb {
+
+namespace {
+
+thread_local InterruptScope *t_interrupt = nullptr;
+
+} // namespace
+
+InterruptScope::InterruptScope(std::function<Status()> check)
+    : check_(std::move(check)), previous_(t_interrupt) {
+  t_interrupt = this;
+}
+
+InterruptScope::~InterruptScope() { t_interrupt = previous_; }
+
+Status InterruptScope::check() {
+  for (InterruptScope *s = t_interrupt; s; s = s->previous_) {
+    if (!s->check_)
+      continue;
+    if (Status st = s->check_(); !st.ok())
+      return st;
+  }
+  return Status::OK();
+}
+
+} // namespace kadedb
@@ -0,0 +1,120 @@
+#include "kadedb/change_feed.h"
+
+#include <algorithm>
+
+namespace kadedb {
+
+const char *changeKindName(ChangeEvent::Kind kind) {
+  switch (kind) {
+  case ChangeEvent::Kind::Insert:
+    return "INSERT";
+  case ChangeEvent::Kind::Update:
+    return "UPDATE";
+  case ChangeEvent::Kind::Delete:
+    return "DELETE";
+  case ChangeEvent::Kind::Truncate:
+    return "TRUNCATE";
+  case ChangeEvent::Kind::Drop:
+    return "DROP";
+  }
+  return "";
+}
+
+void ChangeFeed::publish(std::vector<ChangeEvent> events) {
+  if (events.empty())
+    return;
+  {
+    std::lock_guard lk(mtx_);
+    for (auto &e : events) {
+      e.seq = ++lastSeq_;
+      ring_.push_back(std::make_shared<const ChangeEvent>(std::move(e)));
+    }
+    while (ring_.size() > capacity_)
+      ring_.pop_front();
+  }
+  cv_.notify_all();
+}
+
+void ChangeFeed::publish(ChangeEvent event) {
+  std::vector<ChangeEvent> events;
+  events.push_back(std::move(event));
+  publish(std::move(events));
+}
+
+uint64_t ChangeFeed::lastSeq() const {
+  std::lock_guard lk(mtx_);
+  return lastSeq_;
+}
+
+std::unique_ptr<ChangeSubscription>
+ChangeFeed::subscribe(std::string target,
+                      std::function<bool(const ChangeEvent &)> filter) {
+  return std::unique_ptr<ChangeSubscription>(new ChangeSubscription(
+      shared_from_this(), std::move(target), std::move(filter), lastSeq()));
+}
+
+Result<ChangeSubscription::Events>
+ChangeSubscription::poll(size_t maxEvents, std::chrono::milliseconds wait) {
+  using R = Result<Events>;
+  if (dropped_)
+    return R::err(Status::NotFound("Change subscription target dropped: " +
+                                   target_));
+  const auto deadline = std::chrono::steady_clock::now() + wait;
+  Events out;
+  std::unique_lock lk(feed_->mtx_);
+  for (;;) {
+    if (cancelled_)
+      return R::err(Status::Cancelled("Change subscription cancelled"));
+    const auto &ring = feed_->ring_;
+    // Seq of ring.front(); position_ + 1 is the next event to read
+    const uint64_t first = feed_->lastSeq_ + 1 - ring.size();
+    if (position_ + 1 < first)
+      return R::err(Status::ResourceExhausted(
+          "Change subscription fell behind: " +
+          std::to_string(first - position_ - 1) + " events evicted"));
+    if (position_ < feed_->lastSeq_) {
+      // Filter a chunk outside the lock, so writers never wait for it
+      const size_t from = static_cast<size_t>(position_ + 1 - first);
+      const size_t n = std::min(ChangeFeed::kPollChunk, ring.size() - from);
+      Events chunk(ring.begin() + from, ring.begin() + from + n);
+      lk.unlock();
+      for (auto &e : chunk) {
+        position_ = e->seq;
+        if (!target_.empty() && e->target != target_)
+          continue;
+        const bool drop = e->kind == ChangeEvent::Kind::Drop;
+        // Truncate and Drop carry no images for a filter to test
+        if (filter_ && e->kind != ChangeEvent::Kind::Truncate && !drop &&
+            !filter_(*e))
+          continue;
+        out.push_back(std::move(e));
+        if (drop && !target_.empty()) {
+          dropped_ = true;
+          return R::ok(std::move(out));
+        }
+        if (maxEvents && out.size() == maxEvents)
+          return R::ok(std::move(out));
+      }
+      lk.lock();
+      continue;
+    }
+    if (!out.empty() || std::chrono::steady_clock::now() >= deadline)
+      return R::ok(std::move(out));
+    feed_->cv_.wait_until(lk, deadline);
+  }
+}
+
+void ChangeSubscription::cancel() {
+  {
+    std::lock_guard lk(feed_->mtx_);
+    cancelled_ = true;
+  }
+  feed_->cv_.notify_all();
+}
+
+uint64_t ChangeSubscription::lag() const {
+  std::lock_guard lk(feed_->mtx_);
+  return feed_->lastSeq_ - position_;
+}
+
+} // namespace kadedb
@@ -0,0 +1,1030 @@
+#include "kadedb/checkpoint.h"
+
+#include "kadedb/file_io.h"
+#include "kadedb/page_allocator.h"
+#include "kadedb/serialization.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <sstream>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace kadedb {
+namespace {
+
+// ---- Format ----------------------------------------------------------------
+
+constexpr uint8_t kCheckpointKind = 'C'; // after MAGIC and VERSION
+constexpr size_t kHeaderBytes = 48;
+constexpr size_t kBlockHeaderBytes = 24;
+// Compressed blocks add the u64 size of their compressed body
+constexpr size_t kCompressedHeaderBytes = 32;
+constexpr uint8_t kAbsentTag = 0xFF; // nullptr cell
+
+constexpr size_t pad8(size_t n) { return (n + 7) & ~size_t{7}; }
+
+uint64_t blockBytes(uint64_t rows, uint64_t blobBytes) {
+  return kBlockHeaderBytes + pad8(rows) + 8 * rows + pad8(blobBytes);
+}
+
+uint64_t rotl(uint64_t v, int s) { return (v << s) | (v >> (64 - s)); }
+
+// Word-at-a-time checksum over four independent lanes, so that verifying a
+// block runs near memory bandwidth; not cryptographic
+uint64_t checksum(const char *p, size_t n) {
+  constexpr uint64_t kPrime = 0x9E3779B97F4A7C15ull;
+  uint64_t lanes[4] = {1, 2, 3, 4};
+  const size_t words = n / 8;
+  size_t i = 0;
+  for (; i + 4 <= words; i += 4) {
+    for (int l = 0; l < 4; ++l) {
+      uint64_t w;
+      std::memcpy(&w, p + (i + l) * 8, 8);
+      lanes[l] = rotl(lanes[l] ^ w, 31) * kPrime;
+    }
+  }
+  for (; i < words; ++i) {
+    uint64_t w;
+    std::memcpy(&w, p + i * 8, 8);
+    lanes[0] = rotl(lanes[0] ^ w, 31) * kPrime;
+  }
+  if (n % 8) {
+    uint64_t w = 0;
+    std::memcpy(&w, p + words * 8, n % 8);
+    lanes[1] = rotl(lanes[1] ^ w, 31) * kPrime;
+  }
+  uint64_t h = n;
+  for (uint64_t lane : lanes) {
+    h = (h ^ lane) * kPrime;
+    h ^= h >> 29;
+  }
+  return h;
+}
+
+template <typename T> void put(std::string &out, T v) {
+  char b[sizeof(T)];
+  std::memcpy(b, &v, sizeof(T));
+  out.append(b, sizeof(T));
+}
+
+template <typename T> T get(const char *p) {
+  T v;
+  std::memcpy(&v, p, sizeof(T));
+  return v;
+}
+
+template <typename T> void write(std::ostream &os, T v) {
+  os.write(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+template <typename T> T read(std::istream &is) {
+  T v;
+  if (!is.read(reinterpret_cast<char *>(&v), sizeof(T)))
+    throw SerializationError("Truncated checkpoint directory");
+  return v;
+}
+
+void writeString(std::ostream &os, const std::string &s) {
+  write<uint32_t>(os, static_cast<uint32_t>(s.size()));
+  os.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+
+std::string readString(std::istream &is) {
+  std::string s(read<uint32_t>(is), '\0');
+  if (!is.read(s.data(), static_cast<std::streamsize>(s.size())))
+    throw SerializationError("Truncated checkpoint directory");
+  return s;
+}
+
+// One column of a row group being written
+struct ColumnBuilder {
+  std::string tags;
+  std::vector<uint64_t> slots;
+  std::string blob;
+
+  void add(const Value *v) {
+    uint64_t slot = 0;
+    if (!v) {
+      tags.push_back(static_cast<char>(kAbsentTag));
+      slots.push_back(0);
+      return;
+    }
+    switch (v->type()) {
+    case ValueType::Integer:
+      slot = static_cast<uint64_t>(v->asInt());
+      break;
+    case ValueType::Float: {
+      const double d = v->asFloat();
+      std::memcpy(&slot, &d, 8);
+      break;
+    }
+    case ValueType::Boolean:
+      slot = v->asBool() ? 1 : 0;
+      break;
+    case ValueType::String: {
+      const std::string &s = v->asString();
+      slot = static_cast<uint64_t>(blob.size()) |
+             (static_cast<uint64_t>(s.size()) << 32);
+      blob += s;
+      break;
+    }
+    case ValueType::Null:
+      break;
+    }
+    tags.push_back(static_cast<char>(v->type()));
+    slots.push_back(slot);
+  }
+
+  // [u64 checksum][u32 rows][u32 Codec][u64 blob bytes], then either
+  // [tags][slots][blob] or, compressed, [u64 stored bytes][their codec
+  // encoding]. Blocks that do not shrink are stored plain.
+  std::string encode(Codec codec) const {
+    const size_t rows = tags.size();
+    std::string out;
+    out.reserve(blockBytes(rows, blob.size()));
+    put<uint64_t>(out, 0);
+    put<uint32_t>(out, static_cast<uint32_t>(rows));
+    put<uint32_t>(out, 0);
+    put<uint64_t>(out, blob.size());
+    out += tags;
+    out.resize(kBlockHeaderBytes + pad8(rows), '\0');
+    out.append(reinterpret_cast<const char *>(slots.data()), 8 * rows);
+    out += blob;
+    out.resize(blockBytes(rows, blob.size()), '\0');
+    if (codec != Codec::None) {
+      std::string packed = out.substr(0, kBlockHeaderBytes);
+      const uint32_t tag = static_cast<uint32_t>(codec);
+      std::memcpy(&packed[12], &tag, 4);
+      put<uint64_t>(packed, 0);
+      codec::compress(codec, out.data() + kBlockHeaderBytes,
+                      out.size() - kBlockHeaderBytes, packed);
+      const uint64_t stored = packed.size() - kCompressedHeaderBytes;
+      std::memcpy(&packed[kBlockHeaderBytes], &stored, 8);
+      if (packed.size() < out.size())
+        out.swap(packed);
+    }
+    const uint64_t sum = checksum(out.data() + 8, out.size() - 8);
+    std::memcpy(&out[0], &sum, 8);
+    return out;
+  }
+
+  void clear() {
+    tags.clear();
+    slots.clear();
+    blob.clear();
+  }
+};
+
+Status ioError(const std::string &what, const std::string &path) {
+  return Status::Internal(what + " " + path + ": " + std::strerror(errno));
+}
+
+// Sequential writer of the checkpoint file. Bytes are staged in aligned
+// chunks, each written asynchronously while the next one fills, and with
+// O_DIRECT where the file system allows it, so a checkpoint neither
+// waits on every write nor pushes the live data out of the page cache.
+class FileWriter {
+public:
+  static constexpr size_t kChunkBytes = memory::kPageBlockBytes;
+  static constexpr size_t kChunksInFlight = 4;
+
+  FileWriter(int fd, std::string path) : fd_(fd), path_(std::move(path)) {}
+  ~FileWriter() {
+    drain();
+    for (char *buf : free_)
+      memory::releasePages(buf, kChunkBytes);
+    if (cur_)
+      memory::releasePages(cur_, kChunkBytes);
+    if (fd_ >= 0)
+      closeFd(fd_);
+  }
+
+  uint64_t pos() const { return pos_; }
+
+  Status write(const char *data, size_t n) {
+    while (n > 0) {
+      if (!cur_) {
+        Status st = takeBuffer();
+        if (!st.ok())
+          return st;
+      }
+      const size_t used = static_cast<size_t>(pos_ % kChunkBytes);
+      const size_t take = std::min(n, kChunkBytes - used);
+      std::memcpy(cur_ + used, data, take);
+      data += take;
+      n -= take;
+      pos_ += take;
+      if (pos_ % kChunkBytes == 0) {
+        Status st = flush(kChunkBytes);
+        if (!st.ok())
+          return st;
+      }
+    }
+    return Status::OK();
+  }
+
+  Status padTo(size_t align) {
+    const std::string zeros((align - pos_ % align) % align, '\0');
+    return write(zeros.data(), zeros.size());
+  }
+
+  // Write the last chunk, then `header` over the start of page 0 (zeros
+  // until now) once every chunk is on disk, sync and close
+  Status finish(const std::string &header) {
+    const size_t used = static_cast<size_t>(pos_ % kChunkBytes);
+    Status st;
+    if (used > 0) {
+      // Direct transfers cover whole pages; the file is cut back below
+      const size_t padded =
+          (used + fileio::kDirectAlign - 1) & ~(fileio::kDirectAlign - 1);
+      std::memset(cur_ + used, 0, padded - used);
+      st = flush(padded);
+    }
+    Status drained = drain();
+    if (st.ok())
+      st = drained;
+    if (!st.ok())
+      return st;
+    if (used > 0 && !truncateFd(fd_, pos_))
+      return ioError("cannot truncate", path_);
+    if (!(st = takeBuffer()).ok())
+      return st;
+    std::memset(cur_, 0, kCheckpointPageBytes);
+    std::memcpy(cur_, header.data(), header.size());
+    st = io_.run({IoOp::write(fd_, cur_, kCheckpointPageBytes, 0),
+                  IoOp::sync(fd_)},
+                 path_);
+    const bool closed = closeFd(fd_) == 0;
+    fd_ = -1;
+    if (st.ok() && !closed)
+      st = ioError("cannot close", path_);
+    return st;
+  }
+
+private:
+  // A free staging buffer as cur_, waiting for the oldest write if all
+  // are in flight
+  Status takeBuffer() {
+    if (free_.empty() && inflight_.size() < kChunksInFlight) {
+      cur_ = static_cast<char *>(memory::allocatePages(kChunkBytes));
+      return Status::OK();
+    }
+    if (free_.empty()) {
+      Status st = io_.wait(inflight_.front().first);
+      free_.push_back(inflight_.front().second);
+      inflight_.pop_front();
+      if (!st.ok())
+        return st;
+    }
+    cur_ = free_.back();
+    free_.pop_back();
+    return Status::OK();
+  }
+
+  // Start writing the first `bytes` of cur_, the chunk holding pos_ - 1
+  Status flush(size_t bytes) {
+    const uint64_t at = (pos_ - 1) / kChunkBytes * kChunkBytes;
+    inflight_.emplace_back(
+        io_.submit({IoOp::write(fd_, cur_, bytes, at)}, path_), cur_);
+    cur_ = nullptr;
+    return Status::OK();
+  }
+
+  // Wait for every chunk in flight; the first error
+  Status drain() {
+    Status first;
+    for (auto &w : inflight_) {
+      Status st = io_.wait(w.first);
+      if (first.ok())
+        first = st;
+      free_.push_back(w.second);
+    }
+    inflight_.clear();
+    return first;
+  }
+
+  static int closeFd(int fd) {
+#ifdef _WIN32
+    return ::_close(fd);
+#else
+    return ::close(fd);
+#endif
+  }
+  static bool truncateFd(int fd, uint64_t size) {
+#ifdef _WIN32
+    return ::_chsize_s(fd, static_cast<__int64>(size)) == 0;
+#else
+    return ::ftruncate(fd, static_cast<off_t>(size)) == 0;
+#endif
+  }
+
+  int fd_;
+  const std::string path_;
+  IoQueue io_;
+  uint64_t pos_ = 0;
+  char *cur_ = nullptr; // staging buffer of the chunk holding pos_
+  std::vector<char *> free_;
+  std::deque<std::pair<uint64_t, char *>> inflight_; // ticket, buffer
+};
+
+std::string encodeHeader(uint64_t walLsn, uint64_t dirOffset,
+                         uint64_t dirSize, uint64_t dirChecksum) {
+  std::string h;
+  put<uint32_t>(h, serialization_constants::MAGIC);
+  put<uint8_t>(h, serialization_constants::VERSION);
+  put<uint8_t>(h, kCheckpointKind);
+  put<uint16_t>(h, 0);
+  put<uint64_t>(h, walLsn);
+  put<uint64_t>(h, dirOffset);
+  put<uint64_t>(h, dirSize);
+  put<uint64_t>(h, dirChecksum);
+  put<uint64_t>(h, checksum(h.data(), h.size()));
+  return h;
+}
+
+// Read-only view of one mapped column block
+struct BlockView {
+  const uint8_t *tags;
+  const char *slots;
+  const char *blob;
+
+  BlockView(const char *block, uint32_t rows)
+      : tags(reinterpret_cast<const uint8_t *>(block + kBlockHeaderBytes)),
+        slots(block + kBlockHeaderBytes + pad8(rows)),
+        blob(slots + 8 * static_cast<size_t>(rows)) {}
+
+  uint64_t slot(size_t r) const { return get<uint64_t>(slots + 8 * r); }
+
+  std::unique_ptr<Value> value(size_t r) const {
+    const uint64_t s = slot(r);
+    switch (tags[r]) {
+    case static_cast<uint8_t>(ValueType::Null):
+      return ValueFactory::createNull();
+    case static_cast<uint8_t>(ValueType::Integer):
+      return ValueFactory::createInteger(static_cast<int64_t>(s));
+    case static_cast<uint8_t>(ValueType::Float): {
+      double d;
+      std::memcpy(&d, &s, 8);
+      return ValueFactory::createFloat(d);
+    }
+    case static_cast<uint8_t>(ValueType::Boolean):
+      return ValueFactory::createBoolean(s != 0);
+    case static_cast<uint8_t>(ValueType::String):
+      return ValueFactory::createString(
+          std::string(blob + (s & 0xFFFFFFFFu), s >> 32));
+    default:
+      return nullptr;
+    }
+  }
+
+  InlineValue inlineValue(size_t r) const {
+    const uint64_t s = slot(r);
+    switch (tags[r]) {
+    case static_cast<uint8_t>(ValueType::Null):
+      return InlineValue::null();
+    case static_cast<uint8_t>(ValueType::Integer):
+      return InlineValue::integer(static_cast<int64_t>(s));
+    case static_cast<uint8_t>(ValueType::Float): {
+      double d;
+      std::memcpy(&d, &s, 8);
+      return InlineValue::floating(d);
+    }
+    case static_cast<uint8_t>(ValueType::Boolean):
+      return InlineValue::boolean(s != 0);
+    case static_cast<uint8_t>(ValueType::String):
+      return InlineValue::string(blob + (s & 0xFFFFFFFFu), s >> 32);
+    default:
+      return InlineValue();
+    }
+  }
+};
+
+void predicateColumns(const BoundPredicate &p, std::vector<size_t> &out) {
+  if (p.kind == Predicate::Kind::Comparison) {
+    if (p.column != TableSchema::npos &&
+        std::find(out.begin(), out.end(), p.column) == out.end())
+      out.push_back(p.column);
+    return;
+  }
+  for (const auto &c : p.children)
+    predicateColumns(c, out);
+}
+
+Status resolveProjection(const TableSchema &schema,
+                         const std::vector<std::string> &columns,
+                         std::vector<size_t> &projIdx,
+                         std::vector<std::string> &outNames,
+                         std::vector<ColumnType> &outTypes) {
+  const auto &cols = schema.columns();
+  if (columns.empty()) {
+    for (size_t i = 0; i < cols.size(); ++i) {
+      projIdx.push_back(i);
+      outNames.push_back(cols[i].name);
+      outTypes.push_back(cols[i].type);
+    }
+    return Status::OK();
+  }
+  for (const auto &name : columns) {
+    const size_t idx = schema.findColumn(name);
+    if (idx == TableSchema::npos)
+      return Status::InvalidArgument("Unknown column in projection: " + name);
+    projIdx.push_back(idx);
+    outNames.push_back(cols[idx].name);
+    outTypes.push_back(cols[idx].type);
+  }
+  return Status::OK();
+}
+
+} // namespace
+
+// ---- Writing ---------------------------------------------------------------
+
+Status writeCheckpoint(const std::string &path, RelationalStorage &storage,
+                       uint64_t walLsn, Codec codec) {
+  const std::string tmp = path + ".tmp";
+  const int fd = fileio::openDirect(tmp);
+  if (fd < 0)
+    return ioError("cannot create", tmp);
+  FileWriter out(fd, tmp);
+  // Page 0 holds the header, rewritten once the directory is known
+  const std::string page(kCheckpointPageBytes, '\0');
+  Status st = out.write(page.data(), page.size());
+  if (!st.ok())
+    return st;
+
+  std::ostringstream dir;
+  const std::vector<std::string> tables = storage.listTables();
+  write<uint32_t>(dir, static_cast<uint32_t>(tables.size()));
+  for (const auto &table : tables) {
+    auto schemaRes = storage.getTableSchema(table);
+    if (!schemaRes.hasValue())
+      return schemaRes.status();
+    const TableSchema schema = schemaRes.value();
+    const size_t ncols = schema.columns().size();
+
+    std::vector<ColumnBuilder> columns(ncols);
+    // Per group: rows, then offset and size of each column block
+    std::ostringstream groups;
+    uint32_t groupCount = 0;
+    uint32_t inGroup = 0;
+    uint64_t rows = 0;
+    auto flush = [&]() -> Status {
+      write<uint32_t>(groups, inGroup);
+      for (auto &col : columns) {
+        Status ps = out.padTo(kCheckpointPageBytes);
+        if (!ps.ok())
+          return ps;
+        const std::string block = col.encode(codec);
+        write<uint64_t>(groups, out.pos());
+        write<uint64_t>(groups, block.size());
+        if (!(ps = out.write(block.data(), block.size())).ok())
+          return ps;
+        col.clear();
+      }
+      ++groupCount;
+      inGroup = 0;
+      return Status::OK();
+    };
+
+    Status io;
+    st = storage.scan(
+        table, {}, std::nullopt,
+        [&](RowBatch &batch) {
+          for (const auto &row : batch.rows) {
+            for (size_t c = 0; c < ncols; ++c)
+              columns[c].add(row[c].get());
+            ++rows;
+            if (++inGroup == kCheckpointGroupRows &&
+                !(io = flush()).ok())
+              return false;
+          }
+          return true;
+        },
+        RelationalStorage::kDefaultBatchRows);
+    if (!st.ok())
+      return st;
+    if (inGroup && !(io = flush()).ok())
+      return io;
+    if (!io.ok())
+      return io;
+
+    writeString(dir, table);
+    bin::writeTableSchema(schema, dir);
+    write<uint64_t>(dir, rows);
+    write<uint32_t>(dir, groupCount);
+    dir << groups.str();
+  }
+
+  const std::string dirBytes = dir.str();
+  const uint64_t dirOffset = out.pos();
+  if (!(st = out.write(dirBytes.data(), dirBytes.size())).ok())
+    return st;
+  const std::string header = encodeHeader(
+      walLsn, dirOffset, dirBytes.size(),
+      checksum(dirBytes.data(), dirBytes.size()));
+  if (!(st = out.finish(header)).ok())
+    return st;
+#ifdef _WIN32
+  std::remove(path.c_str());
+#endif
+  if (std::rename(tmp.c_str(), path.c_str()) != 0)
+    return ioError("cannot rename " + tmp + " to", path);
+  return Status::OK();
+}
+
+// ---- Mapping ---------------------------------------------------------------
+
+CheckpointStorage::CheckpointStorage(const char *base, size_t size,
+                                     uint64_t walLsn)
+    : base_(base), size_(size), walLsn_(walLsn) {}
+
+CheckpointStorage::~CheckpointStorage() {
+#ifdef _WIN32
+  delete[] base_;
+#else
+  ::munmap(const_cast<char *>(base_), size_);
+#endif
+}
+
+Result<std::unique_ptr<CheckpointStorage>>
+CheckpointStorage::open(const std::string &path) {
+  using R = Result<std::unique_ptr<CheckpointStorage>>;
+#ifdef _WIN32
+  const int fd = ::_open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+  if (fd < 0) {
+    if (errno == ENOENT)
+      return R::err(Status::NotFound("No checkpoint at " + path));
+    return R::err(ioError("cannot open", path));
+  }
+  struct stat info;
+  if (::fstat(fd, &info) != 0) {
+    Status st = ioError("cannot stat", path);
+#ifdef _WIN32
+    ::_close(fd);
+#else
+    ::close(fd);
+#endif
+    return R::err(st);
+  }
+  const size_t size = static_cast<size_t>(info.st_size);
+  if (size < kCheckpointPageBytes) {
+#ifdef _WIN32
+    ::_close(fd);
+#else
+    ::close(fd);
+#endif
+    return R::err(
+        Status::InvalidArgument("Not a KadeDB checkpoint: " + path));
+  }
+#ifdef _WIN32
+  // No mapping here: read the file up front
+  char *base = new char[size];
+  size_t got = 0;
+  while (got < size) {
+    const size_t chunk = std::min<size_t>(size - got, size_t{1} << 30);
+    const int n = ::_read(fd, base + got, static_cast<unsigned>(chunk));
+    if (n <= 0)
+      break;
+    got += static_cast<size_t>(n);
+  }
+  ::_close(fd);
+  if (got < size) {
+    delete[] base;
+    return R::err(ioError("cannot read", path));
+  }
+#else
+  void *map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED)
+    return R::err(ioError("cannot map", path));
+  const char *base = static_cast<const char *>(map);
+#endif
+
+  const uint64_t walLsn = get<uint64_t>(base + 8);
+  std::unique_ptr<CheckpointStorage> cs(
+      new CheckpointStorage(base, size, walLsn));
+  const bool headerOk =
+      get<uint32_t>(base) == serialization_constants::MAGIC &&
+      get<uint8_t>(base + 4) >= serialization_constants::MIN_VERSION &&
+      get<uint8_t>(base + 4) <= serialization_constants::VERSION &&
+      get<uint8_t>(base + 5) == kCheckpointKind &&
+      get<uint64_t>(base + kHeaderBytes - 8) ==
+          checksum(base, kHeaderBytes - 8);
+  if (!headerOk)
+    return R::err(
+        Status::InvalidArgument("Not a KadeDB checkpoint: " + path));
+  Status st =
+      cs->parseDirectory(get<uint64_t>(base + 16), get<uint64_t>(base + 24));
+  if (!st.ok())
+    return R::err(Status::InvalidArgument(st.message() + ": " + path));
+  return R::ok(std::move(cs));
+}
+
+Status CheckpointStorage::parseDirectory(uint64_t offset, uint64_t size) {
+  if (offset < kCheckpointPageBytes || offset > size_ || size > size_ - offset)
+    return Status::InvalidArgument("Checkpoint directory out of range");
+  const char *dirData = base_ + offset;
+  if (get<uint64_t>(base_ + 32) != checksum(dirData, size))
+    return Status::InvalidArgument("Checkpoint directory checksum mismatch");
+  try {
+    std::istringstream is(std::string(dirData, size));
+    const uint32_t tables = read<uint32_t>(is);
+    for (uint32_t t = 0; t < tables; ++t) {
+      auto mt = std::make_shared<MappedTable>();
+      mt->name = readString(is);
+      mt->schema = bin::readTableSchema(is);
+      mt->rows = read<uint64_t>(is);
+      const size_t ncols = mt->schema.columns().size();
+      const uint32_t groups = read<uint32_t>(is);
+      uint64_t rows = 0;
+      mt->groups.reserve(groups);
+      for (uint32_t g = 0; g < groups; ++g) {
+        Group group;
+        group.rows = read<uint32_t>(is);
+        group.state = std::make_unique<std::atomic<uint8_t>>(0);
+        group.blocks.resize(ncols);
+        for (auto &b : group.blocks) {
+          b.offset = read<uint64_t>(is);
+          b.bytes = read<uint64_t>(is);
+          if (b.offset % kCheckpointPageBytes || b.offset > size_ ||
+              b.bytes > size_ - b.offset ||
+              b.bytes < kBlockHeaderBytes)
+            throw SerializationError("Checkpoint block out of range");
+        }
+        rows += group.rows;
+        mt->groups.push_back(std::move(group));
+      }
+      if (rows != mt->rows)
+        throw SerializationError("Checkpoint row count mismatch");
+      mapped_.emplace(mt->name, std::move(mt));
+    }
+  } catch (const SerializationError &e) {
+    return Status::InvalidArgument(e.what());
+  }
+  return Status::OK();
+}
+
+std::vector<std::string> CheckpointStorage::mappedTables() const {
+  std::shared_lock<std::shared_mutex> lk(mtx_);
+  std::vector<std::string> names;
+  names.reserve(mapped_.size());
+  for (const auto &kv : mapped_)
+    names.push_back(kv.first);
+  return names;
+}
+
+std::shared_ptr<CheckpointStorage::MappedTable>
+CheckpointStorage::findMapped(const std::string &table) const {
+  std::shared_lock<std::shared_mutex> lk(mtx_);
+  auto it = mapped_.find(table);
+  return it == mapped_.end() ? nullptr : it->second;
+}
+
+Status CheckpointStorage::verifyGroup(const MappedTable &t,
+                                      const Group &g) const {
+  uint8_t state = g.state->load(std::memory_order_acquire);
+  if (state == 0) {
+    // Racing readers may both verify; they reach the same verdict
+    state = 1;
+    for (const auto &b : g.blocks) {
+      const char *block = base_ + b.offset;
+      const uint32_t codec = get<uint32_t>(block + 12);
+      const uint64_t bytes =
+          codec == 0 ? blockBytes(g.rows, get<uint64_t>(block + 16))
+          : b.bytes >= kCompressedHeaderBytes
+              ? kCompressedHeaderBytes +
+                    get<uint64_t>(block + kBlockHeaderBytes)
+              : 0;
+      if (get<uint32_t>(block + 8) != g.rows || codec > UINT8_MAX ||
+          !codec::isCodec(static_cast<uint8_t>(codec)) || bytes != b.bytes ||
+          get<uint64_t>(block) != checksum(block + 8, b.bytes - 8)) {
+        state = 2;
+        break;
+      }
+    }
+    g.state->store(state, std::memory_order_release);
+  }
+  if (state == 2)
+    return Status::Internal("Checkpoint block checksum mismatch in table " +
+                            t.name);
+  return Status::OK();
+}
+
+Status CheckpointStorage::loadBlock(const MappedTable &t, const Group &g,
+                                    size_t column, std::string &buf,
+                                    const char *&block) const {
+  const Block &b = g.blocks[column];
+  block = base_ + b.offset;
+  if (get<uint32_t>(block + 12) == 0)
+    return Status::OK();
+  // Decompress into the plain layout, header included, for BlockView
+  const size_t raw = blockBytes(g.rows, get<uint64_t>(block + 16));
+  buf.resize(raw);
+  std::memcpy(&buf[0], block, kBlockHeaderBytes);
+  if (!codec::decompress(block + kCompressedHeaderBytes,
+                         b.bytes - kCompressedHeaderBytes,
+                         &buf[kBlockHeaderBytes], raw - kBlockHeaderBytes))
+    return Status::Internal("Corrupt compressed checkpoint block in table " +
+                            t.name);
+  block = buf.data();
+  return Status::OK();
+}
+
+Status CheckpointStorage::scanMapped(const MappedTable &t,
+                                     const std::vector<std::string> &columns,
+                                     const std::optional<Predicate> &where,
+                                     const BatchSink &sink,
+                                     size_t batchRows) const {
+  std::vector<size_t> projIdx;
+  RowBatch batch;
+  if (auto st = resolveProjection(t.schema, columns, projIdx,
+                                  batch.columnNames, batch.columnTypes);
+      !st.ok())
+    return st;
+  if (batchRows == 0)
+    batchRows = kDefaultBatchRows;
+
+  std::optional<BoundPredicate> bound;
+  std::vector<size_t> predCols;
+  if (where) {
+    bound = BoundPredicate::bind(*where, t.schema);
+    predicateColumns(*bound, predCols);
+  }
+  const size_t ncols = t.schema.columns().size();
+  InlineRow probe(ncols);
+  bool delivered = false;
+  // Only the columns read are decompressed
+  std::vector<bool> used(ncols, false);
+  for (size_t c : projIdx)
+    used[c] = true;
+  for (size_t c : predCols)
+    used[c] = true;
+  std::vector<std::string> bufs(ncols);
+  std::vector<BlockView> views;
+  for (const auto &g : t.groups) {
+    if (auto st = verifyGroup(t, g); !st.ok())
+      return st;
+    views.clear();
+    for (size_t c = 0; c < ncols; ++c) {
+      const char *block = base_ + g.blocks[c].offset;
+      if (used[c])
+        if (auto st = loadBlock(t, g, c, bufs[c], block); !st.ok())
+          return st;
+      views.emplace_back(block, g.rows);
+    }
+    for (size_t r = 0; r < g.rows; ++r) {
+      if (bound) {
+        for (size_t c : predCols)
+          probe.set(c, views[c].inlineValue(r));
+        if (!bound->matches(probe))
+          continue;
+      }
+      std::vector<std::unique_ptr<Value>> cells;
+      cells.reserve(projIdx.size());
+      for (size_t c : projIdx)
+        cells.push_back(views[c].value(r));
+      batch.rows.push_back(std::move(cells));
+      if (batch.rows.size() == batchRows) {
+        delivered = true;
+        if (!sink(batch))
+          return Status::OK();
+        batch.rows.clear();
+      }
+    }
+  }
+  if (!batch.rows.empty() || !delivered)
+    sink(batch);
+  return Status::OK();
+}
+
+Status CheckpointStorage::materialize(const std::string &table) {
+  auto t = findMapped(table);
+  if (!t)
+    return Status::OK();
+  std::lock_guard<std::mutex> lk(t->mtx);
+  if (t->gone)
+    return Status::OK();
+  Status st = memory_.createTable(table, t->schema);
+  if (!st.ok())
+    return st;
+  const size_t ncols = t->schema.columns().size();
+  std::vector<std::string> bufs(ncols);
+  for (const auto &g : t->groups) {
+    if (!(st = verifyGroup(*t, g)).ok())
+      break;
+    std::vector<BlockView> views;
+    for (size_t c = 0; c < ncols && st.ok(); ++c) {
+      const char *block = nullptr;
+      st = loadBlock(*t, g, c, bufs[c], block);
+      views.emplace_back(block, g.rows);
+    }
+    for (size_t r = 0; r < g.rows && st.ok(); ++r) {
+      Row row(ncols);
+      for (size_t c = 0; c < ncols; ++c)
+        row.set(c, views[c].value(r));
+      st = memory_.insertRow(table, row);
+    }
+    if (!st.ok())
+      break;
+  }
+  if (!st.ok()) {
+    memory_.dropTable(table);
+    return st;
+  }
+  t->gone = true;
+  std::unique_lock<std::shared_mutex> wl(mtx_);
+  mapped_.erase(table);
+  return Status::OK();
+}
+
+// ---- RelationalStorage -----------------------------------------------------
+
+Status CheckpointStorage::createTable(const std::string &table,
+                                      const TableSchema &schema) {
+  std::unique_lock<std::shared_mutex> lk(mtx_);
+  if (mapped_.count(table))
+    return Status::AlreadyExists("Table already exists: " + table);
+  return memory_.createTable(table, schema);
+}
+
+Status CheckpointStorage::insertRow(const std::string &table, const Row &row) {
+  if (auto st = materialize(table); !st.ok())
+    return st;
+  return memory_.insertRow(table, row);
+}
+
+Result<ResultSet>
+CheckpointStorage::select(const std::string &table,
+                          const std::vector<std::string> &columns,
+                          const std::optional<Predicate> &where) {
+  auto t = findMapped(table);
+  if (!t)
+    return memory_.select(table, columns, where);
+  ResultSet rs;
+  Status st = scanMapped(
+      *t, columns, where,
+      [&](RowBatch &batch) {
+        if (rs.columnCount() == 0)
+          rs = ResultSet(batch.columnNames, batch.columnTypes);
+        for (auto &cells : batch.rows)
+          rs.addRow(ResultRow(std::move(cells)));
+        return true;
+      },
+      kDefaultBatchRows);
+  if (!st.ok())
+    return Result<ResultSet>::err(st);
+  return Result<ResultSet>::ok(std::move(rs));
+}
+
+Status CheckpointStorage::scan(const std::string &table,
+                               const std::vector<std::string> &columns,
+                               const std::optional<Predicate> &where,
+                               const BatchSink &sink, size_t batchRows) {
+  if (auto t = findMapped(table))
+    return scanMapped(*t, columns, where, sink, batchRows);
+  return memory_.scan(table, columns, where, sink, batchRows);
+}
+
+std::vector<std::string> CheckpointStorage::listTables() const {
+  std::vector<std::string> names = mappedTables();
+  std::unordered_set<std::string> seen(names.begin(), names.end());
+  // A table being materialized is briefly in both
+  for (auto &name : memory_.listTables())
+    if (!seen.count(name))
+      names.push_back(std::move(name));
+  return names;
+}
+
+Result<TableSchema>
+CheckpointStorage::getTableSchema(const std::string &table) {
+  if (auto t = findMapped(table))
+    return Result<TableSchema>::ok(t->schema);
+  return memory_.getTableSchema(table);
+}
+
+std::optional<size_t>
+CheckpointStorage::estimateRowCount(const std::string &table) const {
+  if (auto t = findMapped(table))
+    return static_cast<size_t>(t->rows);
+  return memory_.estimateRowCount(table);
+}
+
+std::optional<size_t>
+CheckpointStorage::estimateScanCost(
+    const std::string &table, const std::optional<Predicate> &where) const {
+  if (auto t = findMapped(table))
+    return static_cast<size_t>(t->rows);
+  return memory_.estimateScanCost(table, where);
+}
+
+std::optional<uint64_t>
+CheckpointStorage::tableVersion(const std::string &table) const {
+  if (auto t = findMapped(table))
+    return t->version;
+  return memory_.tableVersion(table);
+}
+
+std::shared_ptr<const TableStatistics>
+CheckpointStorage::getTableStatistics(const std::string &table) const {
+  if (findMapped(table))
+    return nullptr;
+  return memory_.getTableStatistics(table);
+}
+
+std::string
+CheckpointStorage::explainAccess(const std::string &table,
+                                 const std::optional<Predicate> &where) const {
+  if (findMapped(table))
+    return "checkpoint scan";
+  return memory_.explainAccess(table, where);
+}
+
+Status CheckpointStorage::dropTable(const std::string &table) {
+  if (auto t = findMapped(table)) {
+    std::lock_guard<std::mutex> lk(t->mtx);
+    if (!t->gone) {
+      t->gone = true;
+      std::unique_lock<std::shared_mutex> wl(mtx_);
+      mapped_.erase(table);
+      return Status::OK();
+    }
+  }
+  return memory_.dropTable(table);
+}
+
+Result<size_t>
+CheckpointStorage::deleteRows(const std::string &table,
+                              const std::optional<Predicate> &where) {
+  if (auto st = materialize(table); !st.ok())
+    return Result<size_t>::err(st);
+  return memory_.deleteRows(table, where);
+}
+
+Result<size_t> CheckpointStorage::updateRows(
+    const std::string &table,
+    const std::unordered_map<std::string, AssignmentValue> &assignments,
+    const std::optional<Predicate> &where) {
+  if (auto st = materialize(table); !st.ok())
+    return Result<size_t>::err(st);
+  return memory_.updateRows(table, assignments, where);
+}
+
+Result<size_t>
+CheckpointStorage::updateRowsWith(const std::string &table,
+                                  const RowUpdater &updater,
+                                  const std::optional<Predicate> &where) {
+  if (auto st = materialize(table); !st.ok())
+    return Result<size_t>::err(st);
+  return memory_.updateRowsWith(table, updater, where);
+}
+
+Status CheckpointStorage::updateRows(
+    const std::string &table,
+    const std::unordered_map<std::string, std::unique_ptr<Value>> &assignments,
+    const std::optional<Predicate> &where) {
+  if (auto st = materialize(table); !st.ok())
+    return st;
+  return memory_.updateRows(table, assignments, where);
+}
+
+Status CheckpointStorage::truncateTable(const std::string &table) {
+  if (auto t = findMapped(table)) {
+    // Nothing to copy: start an empty in-memory table
+    std::lock_guard<std::mutex> lk(t->mtx);
+    if (!t->gone) {
+      Status st = memory_.createTable(table, t->schema);
+      if (!st.ok())
+        return st;
+      t->gone = true;
+      std::unique_lock<std::shared_mutex> wl(mtx_);
+      mapped_.erase(table);
+      return Status::OK();
+    }
+  }
+  return memory_.truncateTable(table);
+}
+
+Status CheckpointStorage::createIndex(const std::string &table,
+                                      const std::string &column,
+                                      IndexType type) {
+  if (auto st = materialize(table); !st.ok())
+    return st;
+  return memory_.createIndex(table, column, type);
+}
+
+} // namespace kadedb
@@ -0,0 +1,1199 @@
+#include "kadedb/columnar_storage.h"
+#include "kadedb/gpu.h"
+#include "kadedb/scan_kernels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <string_view>
+
+namespace kadedb {
+namespace {
+
+static bool applyOp(Predicate::Op op, int cmp) {
+  switch (op) {
+  case Predicate::Op::Eq:
+    return cmp == 0;
+  case Predicate::Op::Ne:
+    return cmp != 0;
+  case Predicate::Op::Lt:
+    return cmp < 0;
+  case Predicate::Op::Le:
+    return cmp <= 0;
+  case Predicate::Op::Gt:
+    return cmp > 0;
+  case Predicate::Op::Ge:
+    return cmp >= 0;
+  }
+  return false;
+}
+
+// Ordering between a stored column type and an RHS of a different,
+// non-numeric type. Mirrors Value::compare (ordering by ValueType).
+static int typeOrder(ColumnType ct, ValueType rhs) {
+  return static_cast<int>(ct) - static_cast<int>(rhs);
+}
+
+// Unique-key for a value as it will be stored in a column of type ct.
+// Matches SchemaValidator::validateUnique (Value::toString()).
+static std::string cellKey(ColumnType ct, const Value &v) {
+  if (ct == ColumnType::Float && v.type() == ValueType::Integer)
+    return FloatValue(v.asFloat()).toString();
+  return v.toString();
+}
+
+static std::string cellKey(ColumnType ct, const InlineValue &v) {
+  if (ct == ColumnType::Float && v.type() == ValueType::Integer)
+    return FloatValue(v.asFloat()).toString();
+  return v.toString();
+}
+
+template <typename Bits>
+static void setBit(Bits &bits, size_t i, bool on) {
+  if ((i >> 6) >= bits.size())
+    bits.resize((i >> 6) + 1, 0);
+  if (on)
+    bits[i >> 6] |= (uint64_t{1} << (i & 63));
+  else
+    bits[i >> 6] &= ~(uint64_t{1} << (i & 63));
+}
+
+using ColumnVector = ColumnarRelationalStorage::ColumnVector;
+
+static scan::CompareOp toCompareOp(Predicate::Op op) {
+  switch (op) {
+  case Predicate::Op::Eq:
+    return scan::CompareOp::Eq;
+  case Predicate::Op::Ne:
+    return scan::CompareOp::Ne;
+  case Predicate::Op::Lt:
+    return scan::CompareOp::Lt;
+  case Predicate::Op::Le:
+    return scan::CompareOp::Le;
+  case Predicate::Op::Gt:
+    return scan::CompareOp::Gt;
+  case Predicate::Op::Ge:
+    return scan::CompareOp::Ge;
+  }
+  return scan::CompareOp::Eq;
+}
+
+static GpuScanSpec::Op toGpuOp(Predicate::Op op) {
+  switch (op) {
+  case Predicate::Op::Eq:
+    return GpuScanSpec::Op::Eq;
+  case Predicate::Op::Ne:
+    return GpuScanSpec::Op::Ne;
+  case Predicate::Op::Lt:
+    return GpuScanSpec::Op::Lt;
+  case Predicate::Op::Le:
+    return GpuScanSpec::Op::Le;
+  case Predicate::Op::Gt:
+    return GpuScanSpec::Op::Gt;
+  case Predicate::Op::Ge:
+    return GpuScanSpec::Op::Ge;
+  }
+  return GpuScanSpec::Op::Eq;
+}
+
+// Predicate compiled against a table once per query: column names are
+// resolved to column vectors and the rhs is converted to the physical type
+// the comparison runs on.
+struct CompiledPredicate {
+  enum class Form {
+    Never,      // unknown column or missing rhs
+    Int,        // Integer column vs Integer rhs
+    IntAsFloat, // Integer column vs Float rhs
+    Float,      // Float column vs numeric rhs
+    String,
+    StringCodes, // dictionary-encoded String column: `codeHits` by code
+    Bool,
+    Const, // result fixed by type ordering; `hit` applies to present cells
+    And,
+    Or,
+    Not
+  };
+  Form form = Form::Never;
+  const ColumnVector *col = nullptr;
+  Predicate::Op op = Predicate::Op::Eq;
+  int64_t intRhs = 0;
+  double floatRhs = 0.0;
+  std::string strRhs; // String and StringCodes
+  std::vector<uint8_t> codeHits;
+  bool boolRhs = false;
+  bool hit = false;
+  std::vector<CompiledPredicate> children;
+};
+
+static CompiledPredicate compilePredicate(const TableSchema &schema,
+                                          const std::vector<ColumnVector> &cols,
+                                          const Predicate &pred) {
+  using K = Predicate::Kind;
+  using F = CompiledPredicate::Form;
+  CompiledPredicate cp;
+  if (pred.kind != K::Comparison) {
+    cp.form = pred.kind == K::And  ? F::And
+              : pred.kind == K::Or ? F::Or
+                                   : F::Not;
+    for (const auto &ch : pred.children)
+      cp.children.push_back(compilePredicate(schema, cols, ch));
+    return cp;
+  }
+  size_t idx = schema.findColumn(pred.column);
+  const Value *rhs = pred.rhs.get();
+  if (idx == TableSchema::npos || !rhs)
+    return cp; // not matched
+  cp.col = &cols[idx];
+  cp.op = pred.op;
+  const ValueType rt = rhs->type();
+  switch (cp.col->type) {
+  case ColumnType::Integer:
+    if (rt == ValueType::Integer) {
+      cp.form = F::Int;
+      cp.intRhs = rhs->asInt();
+      return cp;
+    }
+    if (rt == ValueType::Float) {
+      cp.form = F::IntAsFloat;
+      cp.floatRhs = rhs->asFloat();
+      return cp;
+    }
+    break;
+  case ColumnType::Float:
+    if (rt == ValueType::Integer || rt == ValueType::Float) {
+      cp.form = F::Float;
+      cp.floatRhs = rhs->asFloat();
+      return cp;
+    }
+    break;
+  case ColumnType::String:
+    if (rt == ValueType::String && cp.col->strDictEncoded) {
+      // Each distinct value is compared once
+      const std::string &r = rhs->asString();
+      const StringDictionary &dict = cp.col->strDict;
+      cp.form = F::StringCodes;
+      cp.strRhs = r;
+      cp.codeHits.resize(dict.size());
+      for (uint32_t code = 0; code < dict.size(); ++code) {
+        const int c = dict.at(code).compare(r);
+        cp.codeHits[code] = applyOp(cp.op, c < 0 ? -1 : (c > 0 ? 1 : 0));
+      }
+      return cp;
+    }
+    if (rt == ValueType::String) {
+      cp.form = F::String;
+      cp.strRhs = rhs->asString();
+      return cp;
+    }
+    break;
+  case ColumnType::Boolean:
+    if (rt == ValueType::Boolean) {
+      cp.form = F::Bool;
+      cp.boolRhs = rhs->asBool();
+      return cp;
+    }
+    break;
+  case ColumnType::Null:
+    // Stored NullValue: equal to Null, less than anything else
+    cp.form = F::Const;
+    cp.hit = applyOp(cp.op, rt == ValueType::Null ? 0 : -1);
+    return cp;
+  }
+  // Cross-type comparison: constant ordering by type for every present cell
+  cp.form = F::Const;
+  cp.hit = applyOp(cp.op, typeOrder(cp.col->type, rt));
+  return cp;
+}
+
+// Bits of a boolean column word that satisfy `b <op> rhs` (false < true)
+static uint64_t boolWord(uint64_t b, Predicate::Op op, bool rhs) {
+  const uint64_t all = ~uint64_t{0};
+  switch (op) {
+  case Predicate::Op::Eq:
+    return rhs ? b : ~b;
+  case Predicate::Op::Ne:
+    return rhs ? ~b : b;
+  case Predicate::Op::Lt:
+    return rhs ? ~b : 0;
+  case Predicate::Op::Le:
+    return rhs ? all : ~b;
+  case Predicate::Op::Gt:
+    return rhs ? 0 : b;
+  case Predicate::Op::Ge:
+    return rhs ? b : all;
+  }
+  return 0;
+}
+
+// Evaluate `cp` over rows [start, start + n) into a selection bitmap of
+// (n + 63) / 64 words. `start` is a multiple of 64 and n <= kBatchRows; bits
+// past n are cleared.
+static void evalBatch(const CompiledPredicate &cp, size_t start, size_t n,
+                      uint64_t *out) {
+  using F = CompiledPredicate::Form;
+  const size_t words = (n + 63) / 64;
+  const size_t w0 = start / 64;
+  const uint64_t tail =
+      (n % 64) ? (uint64_t{1} << (n % 64)) - 1 : ~uint64_t{0};
+  const ColumnVector *col = cp.col;
+  switch (cp.form) {
+  case F::Never:
+    std::fill(out, out + words, 0);
+    return;
+  case F::Int:
+    scan::compareInt64(col->ints.data() + start, n, toCompareOp(cp.op),
+                       cp.intRhs, out);
+    break;
+  case F::IntAsFloat:
+    scan::compareInt64AsDouble(col->ints.data() + start, n, toCompareOp(cp.op),
+                               cp.floatRhs, out);
+    break;
+  case F::Float:
+    scan::compareDouble(col->floats.data() + start, n, toCompareOp(cp.op),
+                        cp.floatRhs, out);
+    break;
+  case F::String: {
+    const std::string_view r(cp.strRhs);
+    std::fill(out, out + words, 0);
+    for (size_t j = 0; j < n; ++j) {
+      if (!col->isValid(start + j))
+        continue;
+      std::string_view s(col->strData(start + j), col->strLength(start + j));
+      int c = s.compare(r);
+      if (applyOp(cp.op, c < 0 ? -1 : (c > 0 ? 1 : 0)))
+        out[j >> 6] |= uint64_t{1} << (j & 63);
+    }
+    break;
+  }
+  case F::StringCodes:
+    scan::lookupCodes(col->strCodes.data() + start, n, cp.codeHits.data(),
+                      out);
+    break;
+  case F::Bool:
+    for (size_t w = 0; w < words; ++w)
+      out[w] = boolWord(col->bools[w0 + w], cp.op, cp.boolRhs);
+    break;
+  case F::Const:
+    std::fill(out, out + words, cp.hit ? ~uint64_t{0} : 0);
+    break;
+  case F::And: {
+    // AND with zero children -> true (neutral element)
+    std::fill(out, out + words, ~uint64_t{0});
+    out[words - 1] &= tail;
+    uint64_t tmp[scan::kBatchWords];
+    for (const auto &ch : cp.children) {
+      evalBatch(ch, start, n, tmp);
+      uint64_t any = 0;
+      for (size_t w = 0; w < words; ++w)
+        any |= (out[w] &= tmp[w]);
+      if (!any)
+        return;
+    }
+    return;
+  }
+  case F::Or: {
+    // OR with zero children -> false (neutral element)
+    std::fill(out, out + words, 0);
+    uint64_t tmp[scan::kBatchWords];
+    for (const auto &ch : cp.children) {
+      evalBatch(ch, start, n, tmp);
+      for (size_t w = 0; w < words; ++w)
+        out[w] |= tmp[w];
+    }
+    return;
+  }
+  case F::Not:
+    // NOT with zero children -> false
+    if (cp.children.empty()) {
+      std::fill(out, out + words, 0);
+      return;
+    }
+    evalBatch(cp.children.front(), start, n, out);
+    for (size_t w = 0; w < words; ++w)
+      out[w] = ~out[w];
+    out[words - 1] &= tail;
+    return;
+  }
+  // Comparisons never match absent cells
+  for (size_t w = 0; w < words; ++w)
+    out[w] &= col->validity[w0 + w];
+  out[words - 1] &= tail;
+}
+
+// False when no row in zone `z` (rows [z * kZoneRows, +kZoneRows)) can
+// satisfy `cp`, judging by the zone maps of the columns it compares
+static bool zoneMayMatch(const CompiledPredicate &cp, size_t z) {
+  using F = CompiledPredicate::Form;
+  InlineValue rhs;
+  switch (cp.form) {
+  case F::Never:
+    return false;
+  case F::And:
+    for (const auto &ch : cp.children) {
+      if (!zoneMayMatch(ch, z))
+        return false;
+    }
+    return true;
+  case F::Or:
+    for (const auto &ch : cp.children) {
+      if (zoneMayMatch(ch, z))
+        return true;
+    }
+    return false;
+  case F::Not:
+    // Bounds cannot show that every row matches the child
+    return !cp.children.empty();
+  case F::Const:
+    return cp.hit && cp.col->zones[z].present > 0;
+  case F::Int:
+    rhs = InlineValue::integer(cp.intRhs);
+    break;
+  case F::IntAsFloat:
+  case F::Float:
+    rhs = InlineValue::floating(cp.floatRhs);
+    break;
+  case F::String:
+  case F::StringCodes:
+    rhs = InlineValue::string(cp.strRhs);
+    break;
+  case F::Bool:
+    rhs = InlineValue::boolean(cp.boolRhs);
+    break;
+  }
+  // Comparisons never match absent cells
+  const ColumnZone &zone = cp.col->zones[z];
+  if (zone.present == 0)
+    return false;
+  int lo = 0, hi = 0;
+  if (!zone.compareRange(rhs, lo, hi))
+    return true;
+  for (int c = lo; c <= hi; ++c)
+    if (applyOp(cp.op, c))
+      return true;
+  return false;
+}
+
+} // namespace
+
+// ---- ColumnVector ----
+
+void ColumnarRelationalStorage::ColumnVector::append(const Value *v) {
+  const size_t i = size;
+  const bool present = v != nullptr;
+  setBit(validity, i, present);
+  switch (type) {
+  case ColumnType::Integer:
+    ints.push_back(present ? v->asInt() : 0);
+    break;
+  case ColumnType::Float:
+    floats.push_back(present ? v->asFloat() : 0.0);
+    break;
+  case ColumnType::String: {
+    const std::string_view str =
+        present ? std::string_view(v->asString()) : std::string_view();
+    if (strDictEncoded) {
+      strCodes.push_back(strDict.intern(str));
+      if (strDict.size() > kMaxDictionaryEntries)
+        dropDictionary();
+      break;
+    }
+    strOffsets.push_back(strArena.size());
+    strLengths.push_back(str.size());
+    strArena.append(str);
+    break;
+  }
+  case ColumnType::Boolean:
+    setBit(bools, i, present && v->asBool());
+    break;
+  case ColumnType::Null:
+    break;
+  }
+  ++size;
+  addToZone(i);
+}
+
+void ColumnarRelationalStorage::ColumnVector::append(const InlineValue &v) {
+  const size_t i = size;
+  const bool present = !v.empty();
+  setBit(validity, i, present);
+  switch (type) {
+  case ColumnType::Integer:
+    ints.push_back(present ? v.asInt() : 0);
+    break;
+  case ColumnType::Float:
+    floats.push_back(present ? v.asFloat() : 0.0);
+    break;
+  case ColumnType::String: {
+    const std::string_view str =
+        present ? std::string_view(v.stringData(), v.stringSize())
+                : std::string_view();
+    if (strDictEncoded) {
+      strCodes.push_back(strDict.intern(str));
+      if (strDict.size() > kMaxDictionaryEntries)
+        dropDictionary();
+      break;
+    }
+    strOffsets.push_back(strArena.size());
+    strLengths.push_back(str.size());
+    strArena.append(str);
+    break;
+  }
+  case ColumnType::Boolean:
+    setBit(bools, i, present && v.asBool());
+    break;
+  case ColumnType::Null:
+    break;
+  }
+  ++size;
+  addToZone(i);
+}
+
+void ColumnarRelationalStorage::ColumnVector::set(size_t i, const Value *v) {
+  const bool present = v != nullptr;
+  setBit(validity, i, present);
+  switch (type) {
+  case ColumnType::Integer:
+    ints[i] = present ? v->asInt() : 0;
+    break;
+  case ColumnType::Float:
+    floats[i] = present ? v->asFloat() : 0.0;
+    break;
+  case ColumnType::String: {
+    const std::string_view str =
+        present ? std::string_view(v->asString()) : std::string_view();
+    if (strDictEncoded) {
+      strCodes[i] = strDict.intern(str);
+      if (strDict.size() > kMaxDictionaryEntries)
+        dropDictionary();
+      break;
+    }
+    if (str.size() <= strLengths[i]) {
+      std::copy(str.begin(), str.end(), strArena.begin() + strOffsets[i]);
+      strGarbage += strLengths[i] - str.size();
+    } else {
+      strGarbage += strLengths[i];
+      strOffsets[i] = strArena.size();
+      strArena.append(str);
+    }
+    strLengths[i] = str.size();
+    // Amortized O(1): reclaim once stale bytes outweigh live ones
+    if (strGarbage > strArena.size() / 2)
+      compactArena();
+    break;
+  }
+  case ColumnType::Boolean:
+    setBit(bools, i, present && v->asBool());
+    break;
+  case ColumnType::Null:
+    break;
+  }
+  addToZone(i);
+}
+
+void ColumnarRelationalStorage::ColumnVector::addToZone(size_t i) {
+  const size_t z = i / kZoneRows;
+  if (zones.size() <= z)
+    zones.resize(z + 1);
+  ColumnZone &zone = zones[z];
+  if (!isValid(i)) {
+    zone.add(InlineValue());
+    return;
+  }
+  switch (type) {
+  case ColumnType::Integer:
+    zone.add(InlineValue::integer(ints[i]));
+    break;
+  case ColumnType::Float:
+    zone.add(InlineValue::floating(floats[i]));
+    break;
+  case ColumnType::String:
+    zone.add(InlineValue::string(strData(i), strLength(i)));
+    break;
+  case ColumnType::Boolean:
+    zone.add(InlineValue::boolean(boolAt(i)));
+    break;
+  case ColumnType::Null:
+    zone.add(InlineValue::null());
+    break;
+  }
+}
+
+std::unique_ptr<Value>
+ColumnarRelationalStorage::ColumnVector::get(size_t i) const {
+  if (!isValid(i))
+    return nullptr;
+  switch (type) {
+  case ColumnType::Integer:
+    return ValueFactory::createInteger(ints[i]);
+  case ColumnType::Float:
+    return ValueFactory::createFloat(floats[i]);
+  case ColumnType::String:
+    if (strDictEncoded)
+      return ValueFactory::createString(strDict.at(strCodes[i]));
+    return ValueFactory::createString(std::string(strData(i), strLength(i)));
+  case ColumnType::Boolean:
+    return ValueFactory::createBoolean(boolAt(i));
+  case ColumnType::Null:
+    return ValueFactory::createNull();
+  }
+  return nullptr;
+}
+
+void ColumnarRelationalStorage::ColumnVector::clear() {
+  size = 0;
+  validity.clear();
+  ints.clear();
+  floats.clear();
+  strDictEncoded = true;
+  strCodes.clear();
+  strDict.clear();
+  strOffsets.clear();
+  strLengths.clear();
+  strArena.clear();
+  strGarbage = 0;
+  bools.clear();
+  zones.clear();
+}
+
+void ColumnarRelationalStorage::ColumnVector::compactArena() {
+  std::string arena;
+  arena.reserve(strArena.size() - strGarbage);
+  for (size_t i = 0; i < size; ++i) {
+    size_t off = arena.size();
+    arena.append(strData(i), strLength(i));
+    strOffsets[i] = off;
+  }
+  strArena.swap(arena);
+  strGarbage = 0;
+}
+
+void ColumnarRelationalStorage::ColumnVector::dropDictionary() {
+  // Called from append() before `size` counts the new row
+  const size_t rows = strCodes.size();
+  strOffsets.resize(rows);
+  strLengths.resize(rows);
+  strArena.clear();
+  for (size_t i = 0; i < rows; ++i) {
+    const std::string &str = strDict.at(strCodes[i]);
+    strOffsets[i] = strArena.size();
+    strLengths[i] = str.size();
+    strArena.append(str);
+  }
+  strGarbage = 0;
+  strDictEncoded = false;
+  strCodes = PageVector<uint32_t>();
+  strDict.clear();
+}
+
+void ColumnarRelationalStorage::ColumnVector::compact(
+    const std::vector<uint8_t> &keep) {
+  size_t out = 0;
+  std::string arena;
+  // Re-interned from the kept rows, without stale entries
+  StringDictionary dict;
+  const bool dictionary = type == ColumnType::String && strDictEncoded;
+  if (type == ColumnType::String && !dictionary)
+    arena.reserve(strArena.size() - strGarbage);
+  for (size_t i = 0; i < size; ++i) {
+    if (!keep[i])
+      continue;
+    const bool valid = isValid(i);
+    switch (type) {
+    case ColumnType::Integer:
+      ints[out] = ints[i];
+      break;
+    case ColumnType::Float:
+      floats[out] = floats[i];
+      break;
+    case ColumnType::String: {
+      if (dictionary) {
+        strCodes[out] = dict.intern(strDict.at(strCodes[i]));
+        break;
+      }
+      size_t len = strLength(i);
+      arena.append(strData(i), len);
+      strOffsets[out] = arena.size() - len;
+      strLengths[out] = len;
+      break;
+    }
+    case ColumnType::Boolean:
+      setBit(bools, out, boolAt(i));
+      break;
+    case ColumnType::Null:
+      break;
+    }
+    setBit(validity, out, valid);
+    ++out;
+  }
+  size = out;
+  ints.resize(type == ColumnType::Integer ? out : 0);
+  floats.resize(type == ColumnType::Float ? out : 0);
+  if (dictionary) {
+    strDict = std::move(dict);
+    strCodes.resize(out);
+  } else if (type == ColumnType::String) {
+    strArena.swap(arena);
+    strOffsets.resize(out);
+    strLengths.resize(out);
+    strGarbage = 0;
+  }
+  validity.resize((out + 63) / 64);
+  if (type == ColumnType::Boolean)
+    bools.resize((out + 63) / 64);
+  zones.clear();
+  for (size_t i = 0; i < size; ++i)
+    addToZone(i);
+}
+
+// ---- Table helpers ----
+
+ColumnarRelationalStorage::TableData
+ColumnarRelationalStorage::makeTable(const TableSchema &schema) {
+  TableData td;
+  td.schema = schema;
+  td.validator = CompiledValidator(schema);
+  td.columns.resize(schema.columns().size());
+  for (size_t i = 0; i < td.columns.size(); ++i)
+    td.columns[i].type = schema.columns()[i].type;
+  td.uniqueKeys.resize(schema.columns().size());
+  td.stats = StatisticsCollector(schema);
+  static std::atomic<uint64_t> nextId{1};
+  td.id = nextId.fetch_add(1, std::memory_order_relaxed);
+  return td;
+}
+
+Row ColumnarRelationalStorage::materializeRow(const TableData &td, size_t r) {
+  Row row(td.columns.size());
+  for (size_t c = 0; c < td.columns.size(); ++c)
+    row.set(c, td.columns[c].get(r));
+  return row;
+}
+
+void ColumnarRelationalStorage::appendRow(TableData &td, const Row &row) {
+  const auto &cols = td.schema.columns();
+  for (size_t c = 0; c < td.columns.size(); ++c) {
+    const Value *v = row.values()[c].get();
+    td.columns[c].append(v);
+    if (cols[c].unique && v)
+      td.uniqueKeys[c].insert(cellKey(cols[c].type, *v));
+  }
+  ++td.rowCount;
+  ++td.version;
+  td.stats.add(row);
+}
+
+void ColumnarRelationalStorage::appendRow(TableData &td, const InlineRow &row) {
+  const auto &cols = td.schema.columns();
+  for (size_t c = 0; c < td.columns.size(); ++c) {
+    const InlineValue &v = row.at(c);
+    td.columns[c].append(v);
+    if (cols[c].unique && !v.empty())
+      td.uniqueKeys[c].insert(cellKey(cols[c].type, v));
+  }
+  ++td.rowCount;
+  ++td.version;
+  td.stats.add(row);
+}
+
+bool ColumnarRelationalStorage::isDeleted(const TableData &td, size_t r) {
+  return (r >> 6) < td.deleted.size() &&
+         ((td.deleted[r >> 6] >> (r & 63)) & 1u);
+}
+
+void ColumnarRelationalStorage::compactTable(TableData &td) {
+  std::vector<uint8_t> keep(td.rowCount);
+  for (size_t r = 0; r < td.rowCount; ++r)
+    keep[r] = !isDeleted(td, r);
+  for (auto &c : td.columns)
+    c.compact(keep);
+  td.rowCount -= td.deletedCount;
+  ++td.version;
+  td.deleted.clear();
+  td.deletedCount = 0;
+  td.stats.clear();
+  for (size_t r = 0; r < td.rowCount; ++r)
+    td.stats.add(materializeRow(td, r));
+}
+
+void ColumnarRelationalStorage::clearTable(TableData &td) {
+  for (auto &c : td.columns)
+    c.clear();
+  for (auto &u : td.uniqueKeys)
+    u.clear();
+  td.rowCount = 0;
+  ++td.version;
+  td.deleted.clear();
+  td.deletedCount = 0;
+  td.stats.clear();
+}
+
+void ColumnarRelationalStorage::refreshStatistics(TableData &td) {
+  if (!td.stats.stale())
+    return;
+  td.stats.clear();
+  for (size_t r = 0; r < td.rowCount; ++r)
+    if (!isDeleted(td, r))
+      td.stats.add(materializeRow(td, r));
+}
+
+std::string ColumnarRelationalStorage::checkUniqueOnInsert(const TableData &td,
+                                                           const Row &row) {
+  const auto &cols = td.schema.columns();
+  for (size_t c = 0; c < cols.size(); ++c) {
+    if (!cols[c].unique)
+      continue;
+    const Value *v = row.values()[c].get();
+    if (!v)
+      continue; // nulls ignored, as in SchemaValidator::validateUnique
+    if (td.uniqueKeys[c].count(cellKey(cols[c].type, *v)))
+      return "Duplicate value for unique column '" + cols[c].name + "'";
+  }
+  return {};
+}
+
+std::vector<uint64_t>
+ColumnarRelationalStorage::evalMask(const TableData &td,
+                                    const std::optional<Predicate> &where) {
+  const size_t n = td.rowCount;
+  std::vector<uint64_t> sel((n + 63) / 64, ~uint64_t{0});
+  if (n % 64)
+    sel.back() = (uint64_t{1} << (n % 64)) - 1;
+  if (where) {
+    CompiledPredicate cp = compilePredicate(td.schema, td.columns, *where);
+    // A lone Integer comparison over a column large enough to pay for the
+    // transfer runs on the GPU, when there is one. The device copy of the
+    // column is cached until the table changes.
+    bool offloaded = false;
+    if (cp.form == CompiledPredicate::Form::Int &&
+        gpuShouldOffload(n, sizeof(int64_t))) {
+      GpuScanSpec spec;
+      spec.column = cp.col->ints.data();
+      spec.count = n;
+      spec.rhs = cp.intRhs;
+      spec.op = toGpuOp(cp.op);
+      spec.cacheKey = "columnar/" + std::to_string(td.id) + "/" +
+                      std::to_string(cp.col - td.columns.data());
+      spec.cacheVersion = td.version;
+      offloaded = gpuCompareInt64(spec, sel.data()).ok();
+      if (offloaded)
+        for (size_t w = 0; w < sel.size(); ++w)
+          sel[w] &= cp.col->validity[w];
+    }
+    // Batches lie within one zone; those it rules out are not evaluated
+    static_assert(ColumnVector::kZoneRows % scan::kBatchRows == 0);
+    if (!offloaded)
+      for (size_t start = 0; start < n; start += scan::kBatchRows) {
+        const size_t rows = std::min(scan::kBatchRows, n - start);
+        uint64_t *out = sel.data() + start / 64;
+        if (zoneMayMatch(cp, start / ColumnVector::kZoneRows))
+          evalBatch(cp, start, rows, out);
+        else
+          std::fill(out, out + (rows + 63) / 64, 0);
+      }
+  }
+  for (size_t w = 0; w < td.deleted.size() && w < sel.size(); ++w)
+    sel[w] &= ~td.deleted[w];
+  return sel;
+}
+
+// Rewrites matched rows through `updater` in place. Every replacement row is
+// validated (schema and uniqueness) before any column is touched, so a
+// failure leaves the table unchanged; work is proportional to the matches.
+Result<size_t>
+ColumnarRelationalStorage::applyRowUpdates(TableData &td,
+                                           const std::vector<uint64_t> &sel,
+                                           const RowUpdater &updater) {
+  const auto &schema = td.schema;
+  std::vector<std::pair<size_t, Row>> changed;
+  Status failed = Status::OK();
+  scan::forEachSetBit(sel.data(), sel.size(), [&](size_t r) {
+    if (!failed.ok())
+      return;
+    Row row = materializeRow(td, r);
+    Status st = updater(row, schema);
+    if (!st.ok()) {
+      failed = st;
+      return;
+    }
+    if (auto err = td.validator.validateRow(row); !err.empty()) {
+      failed = Status::InvalidArgument(err);
+      return;
+    }
+    changed.emplace_back(r, std::move(row));
+  });
+  if (!failed.ok())
+    return Result<size_t>::err(failed);
+  if (changed.empty())
+    return Result<size_t>::ok(0);
+
+  // Uniqueness: a new key conflicts unless it is only held by a row being
+  // rewritten (whose old key is released), or it repeats among new keys
+  const auto &cols = schema.columns();
+  using Keys = std::vector<std::optional<std::string>>;
+  std::vector<std::pair<Keys, Keys>> keyMoves(cols.size());
+  for (size_t c = 0; c < cols.size(); ++c) {
+    if (!cols[c].unique)
+      continue;
+    Keys &oldKeys = keyMoves[c].first;
+    Keys &newKeys = keyMoves[c].second;
+    std::unordered_set<std::string> released, seen;
+    for (const auto &ch : changed) {
+      auto old = td.columns[c].get(ch.first);
+      oldKeys.push_back(old ? std::optional<std::string>(
+                                  cellKey(cols[c].type, *old))
+                            : std::nullopt);
+      if (oldKeys.back())
+        released.insert(*oldKeys.back());
+    }
+    for (const auto &ch : changed) {
+      const Value *v = ch.second.values()[c].get();
+      newKeys.push_back(v ? std::optional<std::string>(
+                                cellKey(cols[c].type, *v))
+                          : std::nullopt);
+      const auto &k = newKeys.back();
+      if (k && ((td.uniqueKeys[c].count(*k) && !released.count(*k)) ||
+                !seen.insert(*k).second))
+        return Result<size_t>::err(Status::FailedPrecondition(
+            "Duplicate value for unique column '" + cols[c].name + "'"));
+    }
+  }
+
+  // Commit: overwrite the matched rows and move their unique keys
+  for (const auto &ch : changed) {
+    td.stats.remove(materializeRow(td, ch.first));
+    td.stats.add(ch.second);
+    for (size_t c = 0; c < td.columns.size(); ++c)
+      td.columns[c].set(ch.first, ch.second.values()[c].get());
+  }
+  if (!changed.empty())
+    ++td.version;
+  refreshStatistics(td);
+  for (size_t c = 0; c < cols.size(); ++c) {
+    for (const auto &k : keyMoves[c].first)
+      if (k)
+        td.uniqueKeys[c].erase(*k);
+    for (const auto &k : keyMoves[c].second)
+      if (k)
+        td.uniqueKeys[c].insert(*k);
+  }
+  return Result<size_t>::ok(changed.size());
+}
+
+// ---- RelationalStorage API ----
+
+Status ColumnarRelationalStorage::createTable(const std::string &table,
+                                              const TableSchema &schema) {
+  std::lock_guard lk(mtx_);
+  if (tables_.find(table) != tables_.end())
+    return Status::AlreadyExists("Table already exists: " + table);
+  tables_.emplace(table, makeTable(schema));
+  return Status::OK();
+}
+
+Status ColumnarRelationalStorage::insertRow(const std::string &table,
+                                            const Row &row) {
+  std::lock_guard lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Status::NotFound("Unknown table: " + table);
+  auto &td = it->second;
+  if (auto err = td.validator.validateRow(row); !err.empty())
+    return Status::InvalidArgument(err);
+  if (auto err = checkUniqueOnInsert(td, row); !err.empty())
+    return Status::FailedPrecondition(err);
+  appendRow(td, row);
+  return Status::OK();
+}
+
+Status ColumnarRelationalStorage::insertRows(const std::string &table,
+                                             const std::vector<Row> &rows) {
+  std::vector<InlineRow> cells;
+  cells.reserve(rows.size());
+  for (const auto &row : rows)
+    cells.push_back(InlineRow::fromRow(row));
+  return insertInlineRows(table, cells);
+}
+
+Status ColumnarRelationalStorage::insertInlineRows(
+    const std::string &table, const std::vector<InlineRow> &rows) {
+  std::lock_guard lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Status::NotFound("Unknown table: " + table);
+  auto &td = it->second;
+  const auto &cols = td.schema.columns();
+  // Keys of the unique columns taken by earlier rows of the batch
+  std::vector<std::unordered_set<std::string>> batchKeys(cols.size());
+  for (const auto &row : rows) {
+    if (auto err = td.validator.validateRow(row); !err.empty())
+      return Status::InvalidArgument(err);
+    for (size_t c = 0; c < cols.size(); ++c) {
+      if (!cols[c].unique || row.at(c).empty())
+        continue;
+      std::string key = cellKey(cols[c].type, row.at(c));
+      if (td.uniqueKeys[c].count(key) || !batchKeys[c].insert(key).second)
+        return Status::FailedPrecondition(
+            "Duplicate value for unique column '" + cols[c].name + "'");
+    }
+  }
+  for (const auto &row : rows)
+    appendRow(td, row);
+  return Status::OK();
+}
+
+Status ColumnarRelationalStorage::readColumns(
+    const std::string &table,
+    const std::function<void(const ColumnsView &)> &fn) const {
+  std::lock_guard lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Status::NotFound("Unknown table: " + table);
+  const auto &td = it->second;
+  ColumnsView view;
+  view.columns = td.columns.data();
+  view.rows = td.rowCount;
+  view.deleted = &td.deleted;
+  fn(view);
+  return Status::OK();
+}
+
+Result<ResultSet>
+ColumnarRelationalStorage::select(const std::string &table,
+                                  const std::vector<std::string> &columns,
+                                  const std::optional<Predicate> &where) {
+  std::lock_guard lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Result<ResultSet>::err(Status::NotFound("Unknown table: " + table));
+  const auto &td = it->second;
+  const auto &schemaCols = td.schema.columns();
+
+  std::vector<size_t> projIdx;
+  std::vector<std::string> outNames;
+  std::vector<ColumnType> outTypes;
+  if (columns.empty()) {
+    projIdx.resize(schemaCols.size());
+    for (size_t i = 0; i < schemaCols.size(); ++i) {
+      projIdx[i] = i;
+      outNames.push_back(schemaCols[i].name);
+      outTypes.push_back(schemaCols[i].type);
+    }
+  } else {
+    for (const auto &name : columns) {
+      size_t idx = td.schema.findColumn(name);
+      if (idx == TableSchema::npos)
+        return Result<ResultSet>::err(
+            Status::InvalidArgument("Unknown column in projection: " + name));
+      projIdx.push_back(idx);
+      outNames.push_back(schemaCols[idx].name);
+      outTypes.push_back(schemaCols[idx].type);
+    }
+  }
+
+  ResultSet rs(outNames, outTypes);
+  std::vector<uint64_t> sel = evalMask(td, where);
+  scan::forEachSetBit(sel.data(), sel.size(), [&](size_t r) {
+    std::vector<std::unique_ptr<Value>> cells;
+    cells.reserve(projIdx.size());
+    for (size_t idx : projIdx)
+      cells.push_back(td.columns[idx].get(r));
+    rs.addRow(ResultRow(std::move(cells)));
+  });
+  return Result<ResultSet>::ok(std::move(rs));
+}
+
+std::vector<std::string> ColumnarRelationalStorage::listTables() const {
+  std::lock_guard lk(mtx_);
+  std::vector<std::string> names;
+  names.reserve(tables_.size());
+  for (const auto &kv : tables_)
+    names.push_back(kv.first);
+  return names;
+}
+
+Result<TableSchema>
+ColumnarRelationalStorage::getTableSchema(const std::string &table) {
+  std::lock_guard lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Result<TableSchema>::err(
+        Status::NotFound("Unknown table: " + table));
+  return Result<TableSchema>::ok(it->second.schema);
+}
+
+std::optional<size_t>
+ColumnarRelationalStorage::estimateRowCount(const std::string &table) const {
+  std::lock_guard lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return std::nullopt;
+  return it->second.rowCount;
+}
+
+std::shared_ptr<const TableStatistics>
+ColumnarRelationalStorage::getTableStatistics(const std::string &table) const {
+  std::lock_guard lk(mtx_);
+  auto it = tables_.find(table);
+  return it == tables_.end() ? nullptr : it->second.stats.cached();
+}
+
+std::string ColumnarRelationalStorage::explainAccess(
+    const std::string &, const std::optional<Predicate> &) const {
+  return "columnar scan";
+}
+
+Status ColumnarRelationalStorage::dropTable(const std::string &table) {
+  std::lock_guard lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Status::NotFound("Unknown table: " + table);
+  tables_.erase(it);
+  return Status::OK();
+}
+
+Result<size_t>
+ColumnarRelationalStorage::deleteRows(const std::string &table,
+                                      const std::optional<Predicate> &where) {
+  std::lock_guard lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Result<size_t>::err(Status::NotFound("Unknown table: " + table));
+  auto &td = it->second;
+
+  if (!where) {
+    size_t cnt = td.rowCount - td.deletedCount;
+    clearTable(td);
+    return Result<size_t>::ok(cnt);
+  }
+
+  // Tombstone matched rows and release their unique keys
+  std::vector<uint64_t> sel = evalMask(td, where);
+  const auto &cols = td.schema.columns();
+  size_t removed = 0;
+  scan::forEachSetBit(sel.data(), sel.size(), [&](size_t r) {
+    setBit(td.deleted, r, true);
+    td.stats.remove(materializeRow(td, r));
+    for (size_t c = 0; c < cols.size(); ++c) {
+      if (!cols[c].unique)
+        continue;
+      if (auto v = td.columns[c].get(r))
+        td.uniqueKeys[c].erase(cellKey(cols[c].type, *v));
+    }
+    ++removed;
+  });
+  td.deletedCount += removed;
+  // Amortized O(1) per deleted row: compact once most rows are tombstones
+  if (td.deletedCount * 2 > td.rowCount)
+    compactTable(td);
+  else
+    refreshStatistics(td);
+  return Result<size_t>::ok(removed);
+}
+
+Result<size_t> ColumnarRelationalStorage::updateRows(
+    const std::string &table,
+    const std::unordered_map<std::string, AssignmentValue> &assignments,
+    const std::optional<Predicate> &where) {
+  std::lock_guard lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Result<size_t>::err(Status::NotFound("Unknown table: " + table));
+  auto &td = it->second;
+  const auto &schema = td.schema;
+
+  // Resolve assignment targets and sources once
+  struct Resolved {
+    size_t dst;
+    const AssignmentValue *av;
+    size_t src;
+  };
+  std::vector<Resolved> resolved;
+  resolved.reserve(assignments.size());
+  for (const auto &kv : assignments) {
+    size_t idx = schema.findColumn(kv.first);
+    if (idx == TableSchema::npos)
+      return Result<size_t>::err(
+          Status::InvalidArgument("Unknown assignment column: " + kv.first));
+    size_t src = TableSchema::npos;
+    if (kv.second.kind == AssignmentValue::Kind::ColumnRef) {
+      src = schema.findColumn(kv.second.column_ref);
+      if (src == TableSchema::npos)
+        return Result<size_t>::err(Status::InvalidArgument(
+            "Unknown column in assignment reference: " + kv.second.column_ref));
+    }
+    resolved.push_back(Resolved{idx, &kv.second, src});
+  }
+
+  std::vector<uint64_t> sel = evalMask(td, where);
+  auto updater = [&resolved](Row &r, const TableSchema &) -> Status {
+    // Assignments apply to the row in sequence, as in
+    // InMemoryRelationalStorage.
+    for (const auto &a : resolved) {
+      std::unique_ptr<Value> v;
+      if (a.av->kind == AssignmentValue::Kind::Constant) {
+        v = a.av->constant ? a.av->constant->clone() : nullptr;
+      } else {
+        const auto &src = r.values()[a.src];
+        v = src ? src->clone() : nullptr;
+      }
+      r.set(a.dst, std::move(v));
+    }
+    return Status::OK();
+  };
+  return applyRowUpdates(td, sel, updater);
+}
+
+Result<size_t> ColumnarRelationalStorage::updateRowsWith(
+    const std::string &table, const RowUpdater &updater,
+    const std::optional<Predicate> &where) {
+  std::lock_guard lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Result<size_t>::err(Status::NotFound("Unknown table: " + table));
+  auto &td = it->second;
+  std::vector<uint64_t> sel = evalMask(td, where);
+  return applyRowUpdates(td, sel, updater);
+}
+
+Status ColumnarRelationalStorage::updateRows(
+    const std::string &table,
+    const std::unordered_map<std::string, std::unique_ptr<Value>> &assignments,
+    const std::optional<Predicate> &where) {
+  std::unordered_map<std::string, AssignmentValue> wrapped;
+  wrapped.reserve(assignments.size());
+  for (const auto &kv : assignments) {
+    AssignmentValue av;
+    av.kind = AssignmentValue::Kind::Constant;
+    av.constant = kv.second ? kv.second->clone() : nullptr;
+    wrapped.emplace(kv.first, std::move(av));
+  }
+  auto res = updateRows(table, wrapped, where);
+  if (!res.hasValue())
+    return res.status();
+  return Status::OK();
+}
+
+Status ColumnarRelationalStorage::truncateTable(const std::string &table) {
+  std::lock_guard lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Status::NotFound("Unknown table: " + table);
+  clearTable(it->second);
+  return Status::OK();
+}
+
+Status ColumnarRelationalStorage::createIndex(const std::string &table,
+                                              const std::string &column,
+                                              IndexType /*type*/) {
+  std::lock_guard lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Status::NotFound("Unknown table: " + table);
+  size_t idx = it->second.schema.findColumn(column);
+  if (idx == TableSchema::npos)
+    return Status::InvalidArgument("Unknown column for index: " + column);
+  if (!it->second.indexedColumns.insert(idx).second)
+    return Status::AlreadyExists("Index already exists on column: " + column);
+  return Status::OK();
+}
+
+} // namespace kadedb
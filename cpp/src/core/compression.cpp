@@ -0,0 +1,439 @@
+#include "kadedb/compression.h"
+
+#include "kadedb/scan_kernels.h" // scan::lowestBit
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace kadedb {
+namespace codec {
+namespace {
+
+// ---- LZ4 block format ------------------------------------------------------
+//
+// Sequences of [token][literal length bytes][literals][u16 offset][match
+// length bytes]: the token holds 4 bits of literal length and 4 bits of
+// match length - 4, 15 meaning more bytes follow (255 each until a smaller
+// one). The last sequence is literals only. Matches start at least 12
+// bytes before the end and the last 5 bytes are always literals.
+
+constexpr size_t kMinMatch = 4;
+constexpr size_t kLastLiterals = 5;
+constexpr size_t kMfLimit = 12;
+constexpr size_t kMaxOffset = 65535;
+constexpr uint32_t kEmpty = UINT32_MAX;
+constexpr int kMaxHashLog = 16;
+// Candidates Lz4High compares per position
+constexpr int kMaxAttempts = 64;
+
+uint32_t read32(const uint8_t *p) {
+  uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+uint32_t hash4(uint32_t v, int hashLog) {
+  return (v * 2654435761u) >> (32 - hashLog);
+}
+
+size_t matchLength(const uint8_t *p, const uint8_t *q, const uint8_t *limit) {
+  const uint8_t *start = p;
+  while (p + 8 <= limit) {
+    uint64_t a, b;
+    std::memcpy(&a, p, 8);
+    std::memcpy(&b, q, 8);
+    if (a != b)
+      return static_cast<size_t>(p - start) +
+             static_cast<size_t>(scan::lowestBit(a ^ b) / 8);
+    p += 8;
+    q += 8;
+  }
+  while (p < limit && *p == *q) {
+    ++p;
+    ++q;
+  }
+  return static_cast<size_t>(p - start);
+}
+
+void putLength(std::string &out, size_t extra) {
+  for (; extra >= 255; extra -= 255)
+    out.push_back(static_cast<char>(0xFF));
+  out.push_back(static_cast<char>(extra));
+}
+
+// One sequence; matchLen 0 ends the block with literals only
+void emitSequence(std::string &out, const uint8_t *lit, size_t litLen,
+                  size_t offset, size_t matchLen) {
+  const size_t ml = matchLen ? matchLen - kMinMatch : 0;
+  out.push_back(static_cast<char>((std::min<size_t>(litLen, 15) << 4) |
+                                  std::min<size_t>(ml, 15)));
+  if (litLen >= 15)
+    putLength(out, litLen - 15);
+  out.append(reinterpret_cast<const char *>(lit), litLen);
+  if (!matchLen)
+    return;
+  out.push_back(static_cast<char>(offset & 0xFF));
+  out.push_back(static_cast<char>(offset >> 8));
+  if (ml >= 15)
+    putLength(out, ml - 15);
+}
+
+int hashLogFor(size_t windowBytes) {
+  int log = 10;
+  while (log < kMaxHashLog && (size_t{1} << log) < windowBytes)
+    ++log;
+  return log;
+}
+
+// Lz4: the last position seen per hash of 4 bytes
+class FastFinder {
+public:
+  FastFinder(const uint8_t *win, std::vector<uint32_t> &table, int hashLog)
+      : win_(win), table_(table), hashLog_(hashLog) {}
+
+  bool find(size_t ip, size_t matchLimit, size_t &ref, size_t &len) {
+    const uint32_t v = read32(win_ + ip);
+    uint32_t &slot = table_[hash4(v, hashLog_)];
+    const uint32_t cand = slot;
+    slot = static_cast<uint32_t>(ip);
+    if (cand == kEmpty || ip - cand > kMaxOffset || read32(win_ + cand) != v)
+      return false;
+    ref = cand;
+    len = kMinMatch + matchLength(win_ + ip + kMinMatch,
+                                  win_ + cand + kMinMatch, win_ + matchLimit);
+    return true;
+  }
+  // Skip ahead faster through data that does not match
+  size_t step(size_t sinceAnchor) const { return 1 + (sinceAnchor >> 6); }
+  void matched(size_t end) { insert(end - 2); }
+  void insert(size_t pos) {
+    table_[hash4(read32(win_ + pos), hashLog_)] = static_cast<uint32_t>(pos);
+  }
+
+private:
+  const uint8_t *win_;
+  std::vector<uint32_t> &table_;
+  const int hashLog_;
+};
+
+// Lz4High: every position chained per hash, for the longest match among
+// the nearest kMaxAttempts candidates
+class ChainFinder {
+public:
+  ChainFinder(const uint8_t *win, int hashLog)
+      : win_(win), hashLog_(hashLog), head_(size_t{1} << hashLog, kEmpty),
+        chain_(kMaxOffset + 1, kEmpty) {}
+
+  bool find(size_t ip, size_t matchLimit, size_t &ref, size_t &len) {
+    while (next_ < ip)
+      insert(next_++);
+    size_t best = 0;
+    uint32_t cand = head_[hash4(read32(win_ + ip), hashLog_)];
+    for (int attempts = kMaxAttempts;
+         cand != kEmpty && ip - cand <= kMaxOffset && attempts > 0;
+         --attempts) {
+      if (win_[cand + best] == win_[ip + best] &&
+          read32(win_ + cand) == read32(win_ + ip)) {
+        const size_t l =
+            kMinMatch + matchLength(win_ + ip + kMinMatch,
+                                    win_ + cand + kMinMatch,
+                                    win_ + matchLimit);
+        if (l > best) {
+          best = l;
+          ref = cand;
+          if (ip + best == matchLimit)
+            break;
+        }
+      }
+      const uint32_t prev = chain_[cand & kMaxOffset];
+      if (prev == kEmpty || prev >= cand)
+        break;
+      cand = prev;
+    }
+    insert(ip);
+    next_ = ip + 1;
+    len = best;
+    return best >= kMinMatch;
+  }
+  size_t step(size_t) const { return 1; }
+  void matched(size_t) {}
+  void insert(size_t pos) {
+    uint32_t &h = head_[hash4(read32(win_ + pos), hashLog_)];
+    chain_[pos & kMaxOffset] = h;
+    h = static_cast<uint32_t>(pos);
+  }
+  void skipTo(size_t pos) { next_ = pos; }
+
+private:
+  const uint8_t *win_;
+  const int hashLog_;
+  std::vector<uint32_t> head_;
+  std::vector<uint32_t> chain_;
+  size_t next_ = 0;
+};
+
+// Compress win[start, end); win[0, start) is the dictionary
+template <typename Finder>
+void compressWindow(const uint8_t *win, size_t start, size_t end,
+                    Finder &finder, std::string &out) {
+  size_t anchor = start;
+  if (end - start > kMfLimit) {
+    const size_t matchLimit = end - kLastLiterals;
+    const size_t mfLimit = end - kMfLimit;
+    size_t ip = start;
+    while (ip <= mfLimit) {
+      size_t ref = 0;
+      size_t len = 0;
+      if (!finder.find(ip, matchLimit, ref, len)) {
+        ip += finder.step(ip - anchor);
+        continue;
+      }
+      while (ip > anchor && ref > 0 && win[ip - 1] == win[ref - 1]) {
+        --ip;
+        --ref;
+        ++len;
+      }
+      emitSequence(out, win + anchor, ip - anchor, ip - ref, len);
+      ip += len;
+      anchor = ip;
+      finder.matched(ip);
+    }
+  }
+  emitSequence(out, win + anchor, end - anchor, 0, 0);
+}
+
+// Lz4 tables with a dictionary already inserted, per thread: preparing
+// them costs a pass over the dictionary, which small payloads would pay on
+// every call
+struct PreparedDictionary {
+  std::string dict;
+  int hashLog = 0;
+  std::vector<uint32_t> table;
+};
+
+std::string_view reachable(std::string_view dict) {
+  return dict.size() > kMaxOffset ? dict.substr(dict.size() - kMaxOffset)
+                                  : dict;
+}
+
+} // namespace
+
+size_t compressBound(size_t n) { return n + n / 255 + 16; }
+
+void compress(Codec codec, const char *data, size_t n, std::string &out,
+              std::string_view dict) {
+  if (codec == Codec::None) {
+    out.append(data, n);
+    return;
+  }
+  dict = reachable(dict);
+  std::string joined;
+  const uint8_t *win = reinterpret_cast<const uint8_t *>(data);
+  if (!dict.empty()) {
+    joined.reserve(dict.size() + n);
+    joined.append(dict.data(), dict.size());
+    joined.append(data, n);
+    win = reinterpret_cast<const uint8_t *>(joined.data());
+  }
+  const size_t start = dict.size();
+  out.reserve(out.size() + compressBound(n));
+  const int hashLog = hashLogFor(start + n);
+
+  if (codec == Codec::Lz4High) {
+    ChainFinder finder(win, hashLog);
+    for (size_t p = 0; p + kMinMatch <= start; ++p)
+      finder.insert(p);
+    finder.skipTo(start);
+    compressWindow(win, start, start + n, finder, out);
+    return;
+  }
+
+  std::vector<uint32_t> local;
+  std::vector<uint32_t> *table = &local;
+  if (!dict.empty()) {
+    thread_local PreparedDictionary prepared;
+    // Sized by the dictionary alone, so payloads of any size share it
+    const int dictLog = hashLogFor(start);
+    if (prepared.hashLog != dictLog || prepared.dict != dict) {
+      prepared.dict.assign(dict.data(), dict.size());
+      prepared.hashLog = dictLog;
+      prepared.table.assign(size_t{1} << dictLog, kEmpty);
+      FastFinder fill(win, prepared.table, dictLog);
+      for (size_t p = 0; p + kMinMatch <= start; ++p)
+        fill.insert(p);
+    }
+    local = prepared.table;
+    FastFinder finder(win, *table, dictLog);
+    compressWindow(win, start, start + n, finder, out);
+    return;
+  }
+  local.assign(size_t{1} << hashLog, kEmpty);
+  FastFinder finder(win, *table, hashLog);
+  compressWindow(win, start, start + n, finder, out);
+}
+
+bool decompress(const char *data, size_t n, char *dst, size_t rawSize,
+                std::string_view dict) {
+  dict = reachable(dict);
+  const uint8_t *ip = reinterpret_cast<const uint8_t *>(data);
+  const uint8_t *const iend = ip + n;
+  size_t op = 0;
+  auto readLength = [&](size_t &len) {
+    uint8_t b;
+    do {
+      if (ip == iend)
+        return false;
+      b = *ip++;
+      len += b;
+    } while (b == 255);
+    return true;
+  };
+  for (;;) {
+    if (ip == iend)
+      return false;
+    const uint8_t token = *ip++;
+    size_t lit = token >> 4;
+    if (lit == 15 && !readLength(lit))
+      return false;
+    if (lit > static_cast<size_t>(iend - ip) || lit > rawSize - op)
+      return false;
+    std::memcpy(dst + op, ip, lit);
+    ip += lit;
+    op += lit;
+    if (ip == iend)
+      break; // the last sequence has no match
+    if (iend - ip < 2)
+      return false;
+    const size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+    ip += 2;
+    size_t len = token & 15;
+    if (len == 15 && !readLength(len))
+      return false;
+    len += kMinMatch;
+    if (offset == 0 || offset > op + dict.size() || len > rawSize - op)
+      return false;
+    if (offset > op) {
+      // Starts in the dictionary and may run on into the output
+      const size_t fromDict = std::min(len, offset - op);
+      std::memcpy(dst + op, dict.data() + dict.size() - (offset - op),
+                  fromDict);
+      op += fromDict;
+      len -= fromDict;
+    }
+    if (len == 0)
+      continue;
+    char *d = dst + op;
+    const char *s = d - offset;
+    if (offset >= len) {
+      std::memcpy(d, s, len);
+    } else {
+      for (size_t i = 0; i < len; ++i) // overlapping: repeats a run
+        d[i] = s[i];
+    }
+    op += len;
+  }
+  return op == rawSize;
+}
+
+std::string trainDictionary(const std::vector<std::string> &samples,
+                            size_t maxBytes) {
+  constexpr size_t kGram = 8;
+  constexpr size_t kSegment = 48;
+  // Samples each distinct gram occurs in (once per sample); samples
+  // shorter than a gram count as one
+  std::unordered_map<std::string_view, uint32_t> counts;
+  std::unordered_map<std::string_view, size_t> lastSample;
+  auto grams = [&](std::string_view text, auto &&fn) {
+    if (text.size() < kMinMatch)
+      return;
+    if (text.size() <= kGram) {
+      fn(text);
+      return;
+    }
+    for (size_t i = 0; i + kGram <= text.size(); ++i)
+      fn(text.substr(i, kGram));
+  };
+  size_t total = 0;
+  for (size_t s = 0; s < samples.size(); ++s) {
+    total += samples[s].size();
+    grams(samples[s], [&](std::string_view gram) {
+      auto it = lastSample.emplace(gram, s).first;
+      if (it->second == s && counts.count(gram))
+        return;
+      it->second = s;
+      ++counts[gram];
+    });
+  }
+  auto score = [&](std::string_view gram) {
+    auto it = counts.find(gram);
+    return it == counts.end() || it->second < 2 ? 0u : it->second;
+  };
+
+  // The samples are cut into one epoch per segment the dictionary holds;
+  // each contributes its segment whose grams recur most, and the grams of
+  // a chosen segment count no more, so later segments add new content
+  struct Segment {
+    uint64_t score;
+    std::string_view text;
+  };
+  std::vector<Segment> chosen;
+  const size_t epochBytes =
+      std::max(kSegment, total / std::max<size_t>(1, maxBytes / kSegment));
+  std::vector<uint32_t> freq;
+  for (size_t first = 0; first < samples.size();) {
+    Segment best{0, {}};
+    size_t bytes = 0;
+    size_t s = first;
+    for (; s < samples.size() && (s == first || bytes < epochBytes); ++s) {
+      const std::string_view sample(samples[s]);
+      bytes += sample.size();
+      freq.clear();
+      grams(sample,
+            [&](std::string_view gram) { freq.push_back(score(gram)); });
+      if (freq.empty())
+        continue;
+      // Sliding sum over the grams that start within a segment
+      const size_t width = sample.size() <= kSegment
+                               ? freq.size()
+                               : kSegment - kGram + 1;
+      uint64_t sum = 0;
+      for (size_t i = 0; i < freq.size(); ++i) {
+        sum += freq[i];
+        if (i >= width)
+          sum -= freq[i - width];
+        if (i + 1 >= width && sum > best.score) {
+          const size_t at = i + 1 - width;
+          best = {sum, sample.substr(at, std::min(kSegment, sample.size()))};
+        }
+      }
+    }
+    first = s;
+    if (best.score == 0)
+      continue;
+    grams(best.text, [&](std::string_view gram) {
+      auto it = counts.find(gram);
+      if (it != counts.end())
+        it->second = 0;
+    });
+    chosen.push_back(best);
+  }
+
+  // The best segments while they fit, ordered best last: nearest the data,
+  // at the smallest offsets
+  std::stable_sort(chosen.begin(), chosen.end(),
+                   [](const Segment &a, const Segment &b) {
+                     return a.score > b.score;
+                   });
+  size_t bytes = 0, n = 0;
+  for (; n < chosen.size() && bytes + chosen[n].text.size() <= maxBytes; ++n)
+    bytes += chosen[n].text.size();
+  std::string dict;
+  dict.reserve(bytes);
+  while (n--)
+    dict.append(chosen[n].text.data(), chosen[n].text.size());
+  return dict;
+}
+
+} // namespace codec
+} // namespace kadedb
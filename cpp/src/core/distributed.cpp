@@ -0,0 +1,753 @@
+#include "kadedb/distributed.h"
+
+#include "kadedb/kadeql_parser.h"
+#include "kadedb/serialization.h"
+#include "kadedb/storage.h"
+#include "kadedb/thread_pool.h"
+#include "kadedb/timeseries/window.h"
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+
+namespace kadedb {
+namespace kadeql {
+namespace {
+
+// Replaces the text of some nodes while rendering; leaves `text` empty for
+// the others
+using Rewrite = std::function<Status(const Expression *, std::string &text)>;
+
+std::string toUpper(std::string s) {
+  for (auto &c : s)
+    c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  return s;
+}
+
+std::string join(const std::vector<std::string> &parts) {
+  std::string out;
+  for (size_t i = 0; i < parts.size(); ++i) {
+    if (i > 0)
+      out += ", ";
+    out += parts[i];
+  }
+  return out;
+}
+
+bool isAggregate(const std::string &upperName) {
+  return upperName == "TIME_BUCKET" || upperName == "FIRST" ||
+         upperName == "LAST" || upperName == "COUNT" || upperName == "SUM" ||
+         upperName == "MIN" || upperName == "MAX" || upperName == "AVG" ||
+         upperName == "APPROX_COUNT_DISTINCT" ||
+         upperName == "APPROX_PERCENTILE";
+}
+
+// Output column name of a select item, as the executor names it
+std::string itemName(const SelectItem &item) {
+  if (!item.alias.empty())
+    return item.alias;
+  if (auto id = dynamic_cast<const IdentifierExpression *>(item.expr.get()))
+    return id->getName();
+  if (auto fn = dynamic_cast<const FunctionCallExpression *>(item.expr.get())) {
+    std::string name = fn->getName();
+    for (auto &c : name)
+      c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return name;
+  }
+  return "expr";
+}
+
+std::string quote(const std::string &s) {
+  std::string out = "'";
+  for (char c : s) {
+    if (c == '\'' || c == '\\')
+      out += '\\';
+    out += c;
+  }
+  return out + "'";
+}
+
+// A Float literal the tokenizer reads back as the same double: it takes
+// neither exponents nor integers for floats
+std::string floatLiteral(double d) {
+  char buf[32];
+  std::snprintf(buf, sizeof buf, "%.17g", d);
+  std::string s = buf;
+  if (s.find_first_of("eE") != std::string::npos) {
+    const int n = std::snprintf(nullptr, 0, "%.340f", d);
+    s.assign(static_cast<size_t>(n) + 1, '\0');
+    std::snprintf(&s[0], s.size(), "%.340f", d);
+    s.resize(static_cast<size_t>(n));
+    while (s.back() == '0' && s[s.size() - 2] != '.')
+      s.pop_back();
+  } else if (s.find('.') == std::string::npos) {
+    s += ".0";
+  }
+  return s;
+}
+
+// KadeQL text of `e` that parses back to the same tree
+Status render(const Expression *e, const Rewrite &rewrite, std::string &out) {
+  if (!e)
+    return Status::InvalidArgument("Incomplete expression");
+  if (rewrite) {
+    std::string text;
+    if (auto st = rewrite(e, text); !st.ok())
+      return st;
+    if (!text.empty()) {
+      out += text;
+      return Status::OK();
+    }
+  }
+  if (dynamic_cast<const ParameterExpression *>(e)) {
+    return Status::InvalidArgument(
+        "Distributed queries cannot take parameters");
+  } else if (auto lit = dynamic_cast<const LiteralExpression *>(e)) {
+    const auto &v = lit->getValue();
+    if (auto s = std::get_if<std::string>(&v))
+      out += quote(*s);
+    else if (auto d = std::get_if<double>(&v))
+      out += floatLiteral(*d);
+    else
+      out += std::to_string(std::get<int64_t>(v));
+  } else if (auto id = dynamic_cast<const IdentifierExpression *>(e)) {
+    out += id->getName();
+  } else if (auto un = dynamic_cast<const UnaryExpression *>(e)) {
+    out += "(NOT ";
+    if (auto st = render(un->getOperand(), rewrite, out); !st.ok())
+      return st;
+    out += ")";
+  } else if (auto bin = dynamic_cast<const BinaryExpression *>(e)) {
+    out += "(";
+    if (auto st = render(bin->getLeft(), rewrite, out); !st.ok())
+      return st;
+    out += " " + BinaryExpression::operatorToString(bin->getOperator()) + " ";
+    if (auto st = render(bin->getRight(), rewrite, out); !st.ok())
+      return st;
+    out += ")";
+  } else if (auto bw = dynamic_cast<const BetweenExpression *>(e)) {
+    out += "(";
+    if (auto st = render(bw->getExpr(), rewrite, out); !st.ok())
+      return st;
+    out += " BETWEEN ";
+    if (auto st = render(bw->getLower(), rewrite, out); !st.ok())
+      return st;
+    out += " AND ";
+    if (auto st = render(bw->getUpper(), rewrite, out); !st.ok())
+      return st;
+    out += ")";
+  } else if (auto fn = dynamic_cast<const FunctionCallExpression *>(e)) {
+    // A node's rows are not the whole series a window slides over
+    if (parseTimeWindowFunction(toUpper(fn->getName())))
+      return Status::InvalidArgument(fn->getName() + " cannot be distributed");
+    out += fn->getName() + "(";
+    const auto &args = fn->getArgs();
+    if (args.empty() && toUpper(fn->getName()) == "COUNT")
+      out += "*";
+    for (size_t i = 0; i < args.size(); ++i) {
+      if (i > 0)
+        out += ", ";
+      if (auto st = render(args[i].get(), rewrite, out); !st.ok())
+        return st;
+    }
+    out += ")";
+  } else {
+    return Status::InvalidArgument("Cannot distribute expression " +
+                                   e->toString());
+  }
+  return Status::OK();
+}
+
+Status render(const Expression *e, std::string &out) {
+  return render(e, nullptr, out);
+}
+
+// " ORDER BY ... LIMIT ... OFFSET ..." over the columns `keys`, named in
+// the order of `order`
+std::string orderLimit(const std::vector<OrderByItem> &order,
+                       const std::vector<std::string> &keys,
+                       const std::optional<size_t> &limit, size_t offset) {
+  std::string out;
+  for (size_t i = 0; i < order.size(); ++i) {
+    out += i == 0 ? " ORDER BY " : ", ";
+    out += keys[i];
+    if (order[i].descending)
+      out += " DESC";
+  }
+  if (limit)
+    out += " LIMIT " + std::to_string(*limit);
+  if (offset > 0)
+    out += " OFFSET " + std::to_string(offset);
+  return out;
+}
+
+// The rows a node keeps for a top-K: LIMIT + OFFSET of the query
+std::optional<size_t> fragmentLimit(const SelectStatement &select) {
+  const auto &limit = select.getLimit();
+  if (!limit)
+    return std::nullopt;
+  const size_t offset = select.getOffset();
+  return *limit > SIZE_MAX - offset ? SIZE_MAX : *limit + offset;
+}
+
+// The two stages of an aggregate query. Nodes compute partial aggregates
+// per group; stage 1 folds the partials of a group into one row and stage
+// 2 finishes the aggregates (AVG), filters by HAVING and orders.
+struct AggregatePlan {
+  std::vector<std::string> fragItems, fragGroup;
+  std::vector<std::string> stage1Items, stage1Keys;
+  // Stage-2 text of each partial by its expression text
+  std::unordered_map<std::string, std::string> partials;
+  size_t aggregates = 0, plains = 0;
+  bool bucket = false;
+
+  // Stage-2 text of the aggregate `fn`, adding its partials
+  Status aggregate(const FunctionCallExpression &fn, std::string &text) {
+    const std::string name = toUpper(fn.getName());
+    if (name == "TIME_BUCKET") {
+      if (!bucket)
+        return Status::InvalidArgument(
+            "TIME_BUCKET must be selected or grouped on");
+      text = "__b";
+      return Status::OK();
+    }
+    // Sketches do not travel as row values
+    if (name == "APPROX_COUNT_DISTINCT" || name == "APPROX_PERCENTILE")
+      return Status::InvalidArgument(fn.getName() +
+                                     " cannot be distributed");
+    const std::string key = fn.toString();
+    if (auto it = partials.find(key); it != partials.end()) {
+      text = it->second;
+      return Status::OK();
+    }
+    const auto &args = fn.getArgs();
+    std::vector<std::string> argText(args.size());
+    for (size_t i = 0; i < args.size(); ++i)
+      if (auto st = render(args[i].get(), argText[i]); !st.ok())
+        return st;
+    const std::string a = "__a" + std::to_string(aggregates++);
+    if (name == "COUNT") {
+      if (args.size() > 1)
+        return Status::InvalidArgument("COUNT takes at most 1 argument");
+      fragItems.push_back("COUNT(" + (args.empty() ? "*" : argText[0]) +
+                          ") AS " + a);
+      stage1Items.push_back("SUM(" + a + ") AS " + a);
+      text = a;
+    } else if (name == "SUM" || name == "MIN" || name == "MAX") {
+      if (args.size() != 1)
+        return Status::InvalidArgument(name + " requires exactly 1 argument");
+      fragItems.push_back(name + "(" + argText[0] + ") AS " + a);
+      stage1Items.push_back(name + "(" + a + ") AS " + a);
+      text = a;
+    } else if (name == "AVG") {
+      if (args.size() != 1)
+        return Status::InvalidArgument("AVG requires exactly 1 argument");
+      fragItems.push_back("SUM(" + argText[0] + ") AS " + a + "s");
+      fragItems.push_back("COUNT(" + argText[0] + ") AS " + a + "c");
+      stage1Items.push_back("SUM(" + a + "s) AS " + a + "s");
+      stage1Items.push_back("SUM(" + a + "c) AS " + a + "c");
+      text = "(" + a + "s / " + a + "c)";
+    } else if (name == "FIRST" || name == "LAST") {
+      // Each node's pick travels with its order key, so stage 1 picks
+      // among the picks by the same key
+      if (args.size() != 2)
+        return Status::InvalidArgument(
+            name + " needs its order key argument to be distributed");
+      const std::string bound = name == "FIRST" ? "MIN" : "MAX";
+      fragItems.push_back(name + "(" + argText[0] + ", " + argText[1] +
+                          ") AS " + a);
+      fragItems.push_back(bound + "(" + argText[1] + ") AS " + a + "o");
+      stage1Items.push_back(name + "(" + a + ", " + a + "o) AS " + a);
+      text = a;
+    } else {
+      return Status::InvalidArgument("Unknown aggregate function: " +
+                                     fn.getName());
+    }
+    partials.emplace(key, text);
+    return Status::OK();
+  }
+
+  // Stage-2 text of a value not aggregated: a GROUP BY key, or the value
+  // of the group's first row
+  Status plain(const Expression *e, std::string &text) {
+    const std::string key = "=" + e->toString();
+    if (auto it = partials.find(key); it != partials.end()) {
+      text = it->second;
+      return Status::OK();
+    }
+    std::string expr;
+    if (auto st = render(e, expr); !st.ok())
+      return st;
+    text = "__p" + std::to_string(plains++);
+    fragItems.push_back(expr + " AS " + text);
+    stage1Items.push_back(text);
+    partials.emplace(key, text);
+    return Status::OK();
+  }
+
+  // A grouping key; `name` is __b for the bucket, else __k<n>
+  Status key(const Expression *e, const std::string &name) {
+    std::string expr;
+    if (auto st = render(e, expr); !st.ok())
+      return st;
+    fragItems.push_back(expr + " AS " + name);
+    fragGroup.push_back(name);
+    stage1Items.push_back(name);
+    stage1Keys.push_back(name);
+    if (name != "__b")
+      partials.emplace("=" + e->toString(), name);
+    return Status::OK();
+  }
+};
+
+// ---- Fragment results ------------------------------------------------------
+
+// Widen `type` to hold a value of type `v`: Integer and Float make Float,
+// and Null gives way to anything
+Status widen(ColumnType &type, ColumnType v, const std::string &column) {
+  if (v == ColumnType::Null || v == type)
+    return Status::OK();
+  if (type == ColumnType::Null) {
+    type = v;
+    return Status::OK();
+  }
+  const auto numeric = [](ColumnType t) {
+    return t == ColumnType::Integer || t == ColumnType::Float;
+  };
+  if (numeric(type) && numeric(v)) {
+    type = ColumnType::Float;
+    return Status::OK();
+  }
+  return Status::InvalidArgument("Column " + column + " mixes value types");
+}
+
+// Rows of `rs` with null cells as nullptr, and the type of each column;
+// a column mixing types keeps the first and is reported
+Status rowsOf(const ResultSet &rs, std::vector<Row> &rows,
+              std::vector<ColumnType> &types) {
+  const size_t width = rs.columnCount();
+  types.assign(width, ColumnType::Null);
+  rows.reserve(rows.size() + rs.rowCount());
+  Status mixed = Status::OK();
+  for (const ResultRow &r : rs) {
+    Row row(width);
+    for (size_t i = 0; i < width && i < r.size(); ++i) {
+      const Value *v = r.values()[i].get();
+      if (!v || v->type() == ValueType::Null)
+        continue;
+      if (auto st = widen(types[i], static_cast<ColumnType>(v->type()),
+                          rs.columnNames()[i]);
+          !st.ok() && mixed.ok())
+        mixed = st;
+      row.set(i, v->clone());
+    }
+    rows.push_back(std::move(row));
+  }
+  return mixed;
+}
+
+struct FragmentRows {
+  std::vector<std::string> names;
+  std::vector<ColumnType> types;
+  std::vector<Row> rows;
+};
+
+Status decodeFragment(const std::string &data, FragmentRows &out) {
+  try {
+    if (data.size() < 4)
+      return Status::InvalidArgument("Truncated fragment result");
+    uint32_t len = 0;
+    for (int i = 3; i >= 0; --i)
+      len = len << 8 | static_cast<unsigned char>(data[static_cast<size_t>(i)]);
+    if (len > data.size() - 4)
+      return Status::InvalidArgument("Truncated fragment result");
+    std::istringstream is(data.substr(4, len));
+    TableSchema schema = bin::readTableSchema(is);
+    for (const Column &c : schema.columns()) {
+      out.names.push_back(c.name);
+      out.types.push_back(c.type);
+    }
+    const size_t start = 4 + static_cast<size_t>(len);
+    size_t consumed = 0;
+    out.rows = bin::readRowBatch(data.data() + start, data.size() - start,
+                                 &consumed);
+    if (start + consumed != data.size())
+      return Status::InvalidArgument("Trailing bytes after fragment result");
+    for (const Row &r : out.rows)
+      if (r.size() != out.names.size())
+        return Status::InvalidArgument(
+            "Fragment result rows do not match its columns");
+  } catch (const std::exception &e) {
+    return Status::InvalidArgument(std::string("Malformed fragment result: ") +
+                                   e.what());
+  }
+  return Status::OK();
+}
+
+// Create `table` holding `rows`, its columns typed as `types`
+Status load(RelationalStorage &storage, const std::string &table,
+            const std::vector<std::string> &names,
+            const std::vector<ColumnType> &types,
+            const std::vector<Row> &rows) {
+  std::vector<Column> cols;
+  for (size_t i = 0; i < names.size(); ++i)
+    cols.push_back(Column{names[i], types[i], true, false, {}});
+  if (auto st = storage.createTable(table, TableSchema(std::move(cols)));
+      !st.ok())
+    return st;
+  return rows.empty() ? Status::OK() : storage.insertRows(table, rows);
+}
+
+} // namespace
+
+std::string encodeFragmentResult(const ResultSet &rs, Codec codec) {
+  std::vector<Row> rows;
+  std::vector<ColumnType> types;
+  // Mixed columns still travel; the merge reports them
+  (void)rowsOf(rs, rows, types);
+  std::vector<Column> cols;
+  for (size_t i = 0; i < rs.columnCount(); ++i)
+    cols.push_back(Column{rs.columnNames()[i], types[i], true, false, {}});
+  std::ostringstream os;
+  bin::writeTableSchema(TableSchema(std::move(cols)), os);
+  const std::string schema = os.str();
+  std::string out;
+  const auto len = static_cast<uint32_t>(schema.size());
+  for (int i = 0; i < 4; ++i)
+    out += static_cast<char>(len >> (8 * i) & 0xFF);
+  out += schema;
+  bin::writeRowBatch(rows, out, codec);
+  return out;
+}
+
+Result<std::string> executeFragment(QueryExecutor &executor,
+                                    const std::string &fragment,
+                                    Codec codec) {
+  using R = Result<std::string>;
+  std::unique_ptr<Statement> stmt;
+  try {
+    KadeQLParser parser;
+    stmt = parser.parse(fragment);
+  } catch (const ParseError &e) {
+    return R::err(Status::InvalidArgument(e.what()));
+  }
+  if (stmt->type() != StatementType::SELECT)
+    return R::err(Status::InvalidArgument("Fragments are SELECT statements"));
+  auto rs = executor.execute(*stmt);
+  if (!rs.hasValue())
+    return R::err(rs.status());
+  try {
+    return R::ok(encodeFragmentResult(rs.value(), codec));
+  } catch (const std::exception &e) {
+    return R::err(Status::Internal(e.what()));
+  }
+}
+
+// ---- DistributedQuery ------------------------------------------------------
+
+Result<std::shared_ptr<DistributedQuery>>
+DistributedQuery::plan(const std::string &query) {
+  using R = Result<std::shared_ptr<DistributedQuery>>;
+  std::unique_ptr<Statement> stmt;
+  try {
+    KadeQLParser parser;
+    stmt = parser.parse(query);
+  } catch (const ParseError &e) {
+    return R::err(Status::InvalidArgument(e.what()));
+  }
+  if (stmt->type() != StatementType::SELECT)
+    return R::err(
+        Status::InvalidArgument("Only SELECT statements are distributed"));
+  return plan(static_cast<const SelectStatement &>(*stmt));
+}
+
+Result<std::shared_ptr<DistributedQuery>>
+DistributedQuery::plan(const SelectStatement &select) {
+  using R = Result<std::shared_ptr<DistributedQuery>>;
+  if (!select.getJoins().empty())
+    return R::err(Status::InvalidArgument(
+        "Distributed queries read one table; JOINs are not supported"));
+  std::shared_ptr<DistributedQuery> q(new DistributedQuery);
+
+  std::string from = " FROM " + select.getTableName();
+  if (!select.getTableAlias().empty())
+    from += " AS " + select.getTableAlias();
+  if (select.getWhereClause()) {
+    from += " WHERE ";
+    if (auto st = render(select.getWhereClause(), from); !st.ok())
+      return R::err(st);
+  }
+  const auto &order = select.getOrderBy();
+  const bool ordered = !order.empty() || select.getLimit() ||
+                       select.getOffset() > 0;
+
+  // ORDER BY names select items; `columns` maps item i to its column
+  auto orderKeys = [&](const std::vector<std::string> &names,
+                       const std::vector<std::string> &columns,
+                       std::vector<std::string> &keys) {
+    for (const auto &o : order) {
+      size_t i = 0;
+      while (i < names.size() && names[i] != o.column)
+        ++i;
+      if (i == names.size())
+        return Status::InvalidArgument("ORDER BY " + o.column +
+                                       " is not a selected column");
+      keys.push_back(columns[i]);
+    }
+    return Status::OK();
+  };
+
+  bool aggregate = !select.getGroupBy().empty() || select.getHaving();
+  for (const auto &item : select.getSelectItems())
+    if (auto fn = dynamic_cast<const FunctionCallExpression *>(item.expr.get()))
+      aggregate = aggregate || isAggregate(toUpper(fn->getName()));
+
+  if (!select.isExpressionMode()) {
+    // Column list: nodes also return the columns ORDER BY reads
+    const auto &cols = select.getColumns();
+    const bool star = cols.empty() || (cols.size() == 1 && cols[0] == "*");
+    std::vector<std::string> fragCols = star ? std::vector<std::string>{"*"}
+                                             : cols;
+    std::vector<std::string> keys;
+    for (const auto &o : order) {
+      keys.push_back(o.column);
+      bool listed = star;
+      for (const auto &c : fragCols)
+        listed = listed || c == o.column;
+      if (!listed)
+        fragCols.push_back(o.column);
+    }
+    q->fragment_ = "SELECT " + join(fragCols) + from +
+                   orderLimit(order, keys, fragmentLimit(select), 0);
+    if (ordered)
+      q->stageText_.push_back(
+          "SELECT " + (star ? std::string("*") : join(cols)) +
+          " FROM __stage0" +
+          orderLimit(order, keys, select.getLimit(), select.getOffset()));
+  } else if (!aggregate) {
+    // Expressions: nodes evaluate them into columns __c<i>
+    std::vector<std::string> items, columns;
+    for (const auto &item : select.getSelectItems()) {
+      std::string text;
+      if (auto st = render(item.expr.get(), text); !st.ok())
+        return R::err(st);
+      columns.push_back("__c" + std::to_string(columns.size()));
+      items.push_back(text + " AS " + columns.back());
+      q->outputNames_.push_back(itemName(item));
+    }
+    std::vector<std::string> keys;
+    if (auto st = orderKeys(q->outputNames_, columns, keys); !st.ok())
+      return R::err(st);
+    q->fragment_ = "SELECT " + join(items) + from +
+                   orderLimit(order, keys, fragmentLimit(select), 0);
+    if (ordered)
+      q->stageText_.push_back(
+          "SELECT " + join(columns) + " FROM __stage0" +
+          orderLimit(order, keys, select.getLimit(), select.getOffset()));
+  } else {
+    AggregatePlan agg;
+    const auto &items = select.getSelectItems();
+    // GROUP BY keys, an alias standing for its item's expression, and the
+    // TIME_BUCKET, whether selected or grouped on
+    const FunctionCallExpression *bucket = nullptr;
+    std::vector<const Expression *> keys;
+    for (const auto &item : items)
+      if (auto fn = dynamic_cast<const FunctionCallExpression *>(item.expr.get()))
+        if (!bucket && toUpper(fn->getName()) == "TIME_BUCKET")
+          bucket = fn;
+    for (const auto &g : select.getGroupBy()) {
+      const Expression *key = g.get();
+      if (auto id = dynamic_cast<const IdentifierExpression *>(key))
+        for (const auto &item : items)
+          if (!item.alias.empty() && item.alias == id->getName()) {
+            key = item.expr.get();
+            break;
+          }
+      auto fn = dynamic_cast<const FunctionCallExpression *>(key);
+      if (fn && toUpper(fn->getName()) == "TIME_BUCKET") {
+        bucket = bucket ? bucket : fn;
+        continue;
+      }
+      keys.push_back(key);
+    }
+    if (bucket) {
+      agg.bucket = true;
+      if (auto st = agg.key(bucket, "__b"); !st.ok())
+        return R::err(st);
+    }
+    for (const Expression *key : keys)
+      if (auto st = agg.key(key, "__k" + std::to_string(agg.stage1Keys.size()));
+          !st.ok())
+        return R::err(st);
+
+    std::vector<std::string> stage2Items, texts, columns;
+    for (const auto &item : items) {
+      std::string text;
+      auto fn = dynamic_cast<const FunctionCallExpression *>(item.expr.get());
+      Status st = fn && isAggregate(toUpper(fn->getName()))
+                      ? agg.aggregate(*fn, text)
+                      : agg.plain(item.expr.get(), text);
+      if (!st.ok())
+        return R::err(st);
+      columns.push_back("__o" + std::to_string(columns.size()));
+      stage2Items.push_back(text + " AS " + columns.back());
+      texts.push_back(text);
+      q->outputNames_.push_back(itemName(item));
+    }
+
+    // HAVING reads aggregates, select items by name and grouped values
+    std::string having;
+    if (select.getHaving()) {
+      Rewrite rewrite = [&](const Expression *e, std::string &text) {
+        if (auto fn = dynamic_cast<const FunctionCallExpression *>(e)) {
+          if (isAggregate(toUpper(fn->getName())))
+            return agg.aggregate(*fn, text);
+        } else if (auto id = dynamic_cast<const IdentifierExpression *>(e)) {
+          for (size_t i = 0; i < texts.size(); ++i)
+            if (q->outputNames_[i] == id->getName()) {
+              text = texts[i];
+              return Status::OK();
+            }
+          return agg.plain(e, text);
+        }
+        return Status::OK();
+      };
+      having = " WHERE ";
+      if (auto st = render(select.getHaving(), rewrite, having); !st.ok())
+        return R::err(st);
+    }
+    std::vector<std::string> orderCols;
+    if (auto st = orderKeys(q->outputNames_, columns, orderCols); !st.ok())
+      return R::err(st);
+
+    q->fragment_ = "SELECT " + join(agg.fragItems) + from;
+    if (!agg.fragGroup.empty())
+      q->fragment_ += " GROUP BY " + join(agg.fragGroup);
+    std::string stage1 = "SELECT " + join(agg.stage1Items) + " FROM __stage0";
+    if (!agg.stage1Keys.empty())
+      stage1 += " GROUP BY " + join(agg.stage1Keys);
+    if (bucket && order.empty())
+      stage1 += " ORDER BY __b";
+    q->stageText_.push_back(std::move(stage1));
+    q->stageText_.push_back(
+        "SELECT " + join(stage2Items) + " FROM __stage1" + having +
+        orderLimit(order, orderCols, select.getLimit(), select.getOffset()));
+  }
+
+  for (const auto &text : q->stageText_) {
+    try {
+      KadeQLParser parser;
+      q->stages_.push_back(parser.parse(text));
+    } catch (const ParseError &e) {
+      return R::err(Status::InvalidArgument(
+          "Cannot plan the merge of this query: " + std::string(e.what())));
+    }
+  }
+  return R::ok(std::move(q));
+}
+
+Result<ResultSet>
+DistributedQuery::merge(const std::vector<std::string> &results) const {
+  using R = Result<ResultSet>;
+  if (results.empty())
+    return R::err(Status::InvalidArgument("No fragment results to merge"));
+  FragmentRows gathered;
+  for (size_t n = 0; n < results.size(); ++n) {
+    FragmentRows part;
+    if (auto st = decodeFragment(results[n], part); !st.ok())
+      return R::err(st);
+    if (n == 0) {
+      gathered.names = std::move(part.names);
+      gathered.types = std::move(part.types);
+    } else if (part.names != gathered.names) {
+      return R::err(Status::InvalidArgument(
+          "Fragment results disagree in their columns"));
+    } else {
+      for (size_t i = 0; i < part.types.size(); ++i)
+        if (auto st = widen(gathered.types[i], part.types[i],
+                            gathered.names[i]);
+            !st.ok())
+          return R::err(st);
+    }
+    gathered.rows.reserve(gathered.rows.size() + part.rows.size());
+    for (Row &r : part.rows)
+      gathered.rows.push_back(std::move(r));
+  }
+
+  auto named = [&](std::vector<std::string> names,
+                   std::vector<ColumnType> types) {
+    if (!outputNames_.empty() && outputNames_.size() == names.size())
+      names = outputNames_;
+    return ResultSet(std::move(names), std::move(types));
+  };
+
+  if (stages_.empty()) {
+    ResultSet out = named(gathered.names, gathered.types);
+    for (Row &r : gathered.rows)
+      out.addRow(ResultRow(r.release()));
+    return R::ok(std::move(out));
+  }
+
+  try {
+    InMemoryRelationalStorage storage;
+    if (auto st = load(storage, "__stage0", gathered.names, gathered.types,
+                       gathered.rows);
+        !st.ok())
+      return R::err(st);
+    gathered.rows.clear();
+    QueryExecutor executor(storage);
+    for (size_t i = 0;; ++i) {
+      auto rs = executor.execute(*stages_[i]);
+      if (!rs.hasValue())
+        return R::err(rs.status());
+      if (i + 1 == stages_.size()) {
+        ResultSet out = named(rs.value().columnNames(),
+                              rs.value().columnTypes());
+        for (const ResultRow &r : rs.value()) {
+          std::vector<std::unique_ptr<Value>> cells;
+          for (const auto &v : r.values())
+            cells.push_back(v ? v->clone() : nullptr);
+          out.addRow(ResultRow(std::move(cells)));
+        }
+        return R::ok(std::move(out));
+      }
+      std::vector<Row> rows;
+      std::vector<ColumnType> types;
+      if (auto st = rowsOf(rs.value(), rows, types); !st.ok())
+        return R::err(st);
+      if (auto st = load(storage, "__stage" + std::to_string(i + 1),
+                         rs.value().columnNames(), types, rows);
+          !st.ok())
+        return R::err(st);
+    }
+  } catch (const std::exception &e) {
+    return R::err(Status::Internal(e.what()));
+  }
+}
+
+Result<ResultSet>
+DistributedQuery::execute(const std::vector<FragmentRunner> &nodes) const {
+  using R = Result<ResultSet>;
+  std::vector<std::string> results(nodes.size());
+  std::vector<Status> status(nodes.size(), Status::OK());
+  ThreadPool::shared().parallelFor(
+      nodes.size(), 1, nodes.size(), [&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          auto res = nodes[i](fragment_);
+          if (res.hasValue())
+            results[i] = res.takeValue();
+          else
+            status[i] = res.status();
+        }
+      });
+  for (const auto &st : status)
+    if (!st.ok())
+      return R::err(st);
+  return merge(results);
+}
+
+} // namespace kadeql
+} // namespace kadedb
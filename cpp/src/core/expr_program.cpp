@@ -0,0 +1,365 @@
+#include "kadedb/expr_program.h"
+
+#include <utility>
+#include <variant>
+
+namespace kadedb {
+namespace kadeql {
+
+size_t findColumnRef(const TableSchema &schema, const std::string &name) {
+  size_t idx = schema.findColumn(name);
+  if (idx != TableSchema::npos || name.find('.') != std::string::npos)
+    return idx;
+  const auto &cols = schema.columns();
+  for (size_t i = 0; i < cols.size(); ++i) {
+    const std::string &c = cols[i].name;
+    if (c.size() > name.size() && c[c.size() - name.size() - 1] == '.' &&
+        c.compare(c.size() - name.size(), name.size(), name) == 0) {
+      if (idx != TableSchema::npos)
+        return TableSchema::npos; // ambiguous
+      idx = i;
+    }
+  }
+  return idx;
+}
+
+// Helper: truth value of a non-null register, as Value::asBool()
+static bool truthy(ValueType type, bool b, int64_t i, double f,
+                   const std::string *str) {
+  switch (type) {
+  case ValueType::Integer:
+    return i != 0;
+  case ValueType::Float:
+    return f != 0.0;
+  case ValueType::String:
+    return !str->empty();
+  default:
+    return b;
+  }
+}
+
+ExprProgram ExprProgram::compile(const Expression *expr,
+                                 const TableSchema &schema) {
+  ExprProgram prog;
+  prog.emit(expr, schema);
+  prog.regs_.resize(prog.code_.size());
+  return prog;
+}
+
+uint32_t ExprProgram::emit(const Expression *expr, const TableSchema &schema) {
+  Instr in;
+  auto push = [this](const Instr &i) {
+    code_.push_back(i);
+    return static_cast<uint32_t>(code_.size() - 1);
+  };
+  auto error = [&](std::string message) {
+    in.op = Op::Error;
+    in.a = static_cast<uint32_t>(errors_.size());
+    errors_.push_back(Status::InvalidArgument(std::move(message)));
+    return push(in);
+  };
+
+  if (auto ue = dynamic_cast<const UnaryExpression *>(expr)) {
+    in.op = Op::Not;
+    in.a = emit(ue->getOperand(), schema);
+    return push(in);
+  }
+  if (auto lit = dynamic_cast<const LiteralExpression *>(expr)) {
+    Slot c;
+    const auto &v = lit->getValue();
+    if (std::holds_alternative<std::string>(v)) {
+      c.type = ValueType::String;
+      c.own = std::get<std::string>(v);
+    } else if (std::holds_alternative<double>(v)) {
+      c.type = ValueType::Float;
+      c.f = std::get<double>(v);
+    } else {
+      c.type = ValueType::Integer;
+      c.i = std::get<int64_t>(v);
+    }
+    in.op = Op::Const;
+    in.a = static_cast<uint32_t>(consts_.size());
+    consts_.push_back(std::move(c));
+    return push(in);
+  }
+  if (auto id = dynamic_cast<const IdentifierExpression *>(expr)) {
+    size_t idx = findColumnRef(schema, id->getName());
+    if (idx == TableSchema::npos)
+      return error("Unknown identifier in expression: " + id->getName());
+    in.op = Op::Column;
+    in.a = static_cast<uint32_t>(idx);
+    return push(in);
+  }
+  if (auto be = dynamic_cast<const BinaryExpression *>(expr)) {
+    in.op = Op::Binary;
+    in.bop = be->getOperator();
+    in.a = emit(be->getLeft(), schema);
+    in.b = emit(be->getRight(), schema);
+    return push(in);
+  }
+  if (auto bw = dynamic_cast<const BetweenExpression *>(expr)) {
+    in.op = Op::Between;
+    in.a = emit(bw->getExpr(), schema);
+    in.b = emit(bw->getLower(), schema);
+    in.c = emit(bw->getUpper(), schema);
+    return push(in);
+  }
+  if (auto fn = dynamic_cast<const FunctionCallExpression *>(expr)) {
+    // An aggregate computed upstream (HAVING), in the column named by the
+    // call's text
+    size_t idx = schema.findColumn(fn->toString());
+    if (idx != TableSchema::npos) {
+      in.op = Op::Column;
+      in.a = static_cast<uint32_t>(idx);
+      return push(in);
+    }
+  }
+  return error("Unsupported expression in assignment");
+}
+
+Result<std::unique_ptr<Value>> ExprProgram::run(const Cells &row) const {
+  for (size_t k = 0; k < code_.size(); ++k) {
+    const Instr &in = code_[k];
+    Slot &out = regs_[k];
+    switch (in.op) {
+    case Op::Column: {
+      const Value *v = row[in.a].get();
+      out.type = v ? v->type() : ValueType::Null;
+      switch (out.type) {
+      case ValueType::Integer:
+        out.i = v->asInt();
+        break;
+      case ValueType::Float:
+        out.f = v->asFloat();
+        break;
+      case ValueType::String:
+        out.str = &v->asString();
+        break;
+      case ValueType::Boolean:
+        out.b = v->asBool();
+        break;
+      default:
+        break;
+      }
+      break;
+    }
+    case Op::Const: {
+      const Slot &c = consts_[in.a];
+      out.type = c.type;
+      out.i = c.i;
+      out.f = c.f;
+      out.b = c.b;
+      out.str = &c.own;
+      break;
+    }
+    case Op::Not: {
+      // NOT null is null (unknown)
+      const Slot &v = regs_[in.a];
+      if (v.type != ValueType::Null) {
+        out.b = !truthy(v.type, v.b, v.i, v.f, v.str);
+        out.type = ValueType::Boolean;
+      } else {
+        out.type = ValueType::Null;
+      }
+      break;
+    }
+    case Op::Binary:
+      if (auto st = binary(in, out); !st.ok())
+        return Result<std::unique_ptr<Value>>::err(st);
+      break;
+    case Op::Between: {
+      const Slot &v = regs_[in.a], &lo = regs_[in.b], &hi = regs_[in.c];
+      if (v.type == ValueType::Null || lo.type == ValueType::Null ||
+          hi.type == ValueType::Null) {
+        out.type = ValueType::Null;
+      } else {
+        out.b = compareSlots(v, lo) >= 0 && compareSlots(v, hi) <= 0;
+        out.type = ValueType::Boolean;
+      }
+      break;
+    }
+    case Op::Error:
+      return Result<std::unique_ptr<Value>>::err(errors_[in.a]);
+    }
+  }
+  return Result<std::unique_ptr<Value>>::ok(toValue(regs_.back()));
+}
+
+Status ExprProgram::binary(const Instr &in, Slot &out) const {
+  using BO = BinaryExpression::Operator;
+  const Slot &L = regs_[in.a];
+  const Slot &R = regs_[in.b];
+
+  // Logical AND/OR, with null as unknown: a false (AND) or true (OR)
+  // operand decides, otherwise any null makes the result null
+  if (in.bop == BO::AND || in.bop == BO::OR) {
+    const bool isAnd = in.bop == BO::AND;
+    bool unknown = false;
+    for (const Slot *s : {&L, &R}) {
+      if (s->type == ValueType::Null) {
+        unknown = true;
+        continue;
+      }
+      bool b = truthy(s->type, s->b, s->i, s->f, s->str);
+      if (b != isAnd) {
+        out.type = ValueType::Boolean;
+        out.b = b;
+        return Status::OK();
+      }
+    }
+    out.type = unknown ? ValueType::Null : ValueType::Boolean;
+    out.b = isAnd;
+    return Status::OK();
+  }
+
+  // Comparisons and arithmetic with a null operand are null
+  if (L.type == ValueType::Null || R.type == ValueType::Null) {
+    out.type = ValueType::Null;
+    return Status::OK();
+  }
+
+  if (in.bop == BO::EQUALS || in.bop == BO::NOT_EQUALS ||
+      in.bop == BO::LESS_THAN || in.bop == BO::LESS_EQUAL ||
+      in.bop == BO::GREATER_THAN || in.bop == BO::GREATER_EQUAL) {
+    int cmp = compareSlots(L, R);
+    out.type = ValueType::Boolean;
+    switch (in.bop) {
+    case BO::EQUALS:
+      out.b = cmp == 0;
+      break;
+    case BO::NOT_EQUALS:
+      out.b = cmp != 0;
+      break;
+    case BO::LESS_THAN:
+      out.b = cmp < 0;
+      break;
+    case BO::LESS_EQUAL:
+      out.b = cmp <= 0;
+      break;
+    case BO::GREATER_THAN:
+      out.b = cmp > 0;
+      break;
+    default:
+      out.b = cmp >= 0;
+      break;
+    }
+    return Status::OK();
+  }
+
+  // If either side is string, + is concatenation; other operators need
+  // numbers
+  if (in.bop == BO::ADD &&
+      (L.type == ValueType::String || R.type == ValueType::String)) {
+    out.own.clear();
+    for (const Slot *s : {&L, &R}) {
+      if (s->type == ValueType::String)
+        out.own += *s->str;
+      else
+        out.own += stringify(*s);
+    }
+    out.type = ValueType::String;
+    out.str = &out.own;
+    return Status::OK();
+  }
+  if (L.type != ValueType::Integer && L.type != ValueType::Float)
+    return Status::InvalidArgument("Non-numeric LHS in arithmetic expression");
+  if (R.type != ValueType::Integer && R.type != ValueType::Float)
+    return Status::InvalidArgument("Non-numeric RHS in arithmetic expression");
+
+  // Integer operands stay Integer except for division
+  if (L.type == ValueType::Integer && R.type == ValueType::Integer &&
+      in.bop != BO::DIV) {
+    out.type = ValueType::Integer;
+    switch (in.bop) {
+    case BO::ADD:
+      out.i = L.i + R.i;
+      return Status::OK();
+    case BO::SUB:
+      out.i = L.i - R.i;
+      return Status::OK();
+    case BO::MUL:
+      out.i = L.i * R.i;
+      return Status::OK();
+    default:
+      break;
+    }
+  } else {
+    double ld = L.type == ValueType::Integer ? static_cast<double>(L.i) : L.f;
+    double rd = R.type == ValueType::Integer ? static_cast<double>(R.i) : R.f;
+    out.type = ValueType::Float;
+    switch (in.bop) {
+    case BO::ADD:
+      out.f = ld + rd;
+      return Status::OK();
+    case BO::SUB:
+      out.f = ld - rd;
+      return Status::OK();
+    case BO::MUL:
+      out.f = ld * rd;
+      return Status::OK();
+    case BO::DIV:
+      if (rd == 0.0)
+        return Status::InvalidArgument("Division by zero");
+      out.f = ld / rd;
+      return Status::OK();
+    default:
+      break;
+    }
+  }
+  return Status::InvalidArgument(
+      "Unsupported operator in computed expression");
+}
+
+int ExprProgram::compareSlots(const Slot &l, const Slot &r) {
+  // As Value::compare: numbers compare by value, strings and booleans
+  // among themselves, other pairs by type
+  if (l.type == ValueType::Integer && r.type == ValueType::Integer)
+    return l.i < r.i ? -1 : (l.i > r.i ? 1 : 0);
+  auto numeric = [](ValueType t) {
+    return t == ValueType::Integer || t == ValueType::Float;
+  };
+  if (numeric(l.type) && numeric(r.type))
+    return compareNumeric(
+        l.type == ValueType::Integer ? static_cast<double>(l.i) : l.f,
+        r.type == ValueType::Integer ? static_cast<double>(r.i) : r.f);
+  if (l.type != r.type)
+    return static_cast<int>(l.type) - static_cast<int>(r.type);
+  if (l.type == ValueType::String)
+    return *l.str < *r.str ? -1 : (*r.str < *l.str ? 1 : 0);
+  if (l.b == r.b)
+    return 0;
+  return l.b ? 1 : -1;
+}
+
+std::string ExprProgram::stringify(const Slot &s) {
+  switch (s.type) {
+  case ValueType::Integer:
+    return IntegerValue(s.i).toString();
+  case ValueType::Float:
+    return FloatValue(s.f).toString();
+  case ValueType::String:
+    return *s.str;
+  case ValueType::Boolean:
+    return BooleanValue(s.b).toString();
+  default:
+    return NullValue().toString();
+  }
+}
+
+std::unique_ptr<Value> ExprProgram::toValue(const Slot &s) {
+  switch (s.type) {
+  case ValueType::Integer:
+    return ValueFactory::createInteger(s.i);
+  case ValueType::Float:
+    return ValueFactory::createFloat(s.f);
+  case ValueType::String:
+    return ValueFactory::createString(*s.str);
+  case ValueType::Boolean:
+    return ValueFactory::createBoolean(s.b);
+  default:
+    return ValueFactory::createNull();
+  }
+}
+
+} // namespace kadeql
+} // namespace kadedb
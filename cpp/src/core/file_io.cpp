@@ -0,0 +1,497 @@
+#include "kadedb/file_io.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define KADEDB_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+namespace kadedb {
+namespace {
+
+// Threads of the Threads backend
+constexpr size_t kIoThreads = 4;
+
+// One system call of `op`, continuing after `done` bytes: the bytes moved
+// (0 for a sync), or -errno
+long runOp(const IoOp &op, size_t done) {
+  char *data = op.data + done;
+  const size_t n = op.bytes - done;
+  const uint64_t off = op.offset + done;
+#ifdef _WIN32
+  // No positioned calls: seek and transfer as one step
+  static std::mutex seekMtx;
+  std::lock_guard<std::mutex> lk(seekMtx);
+  if (op.kind == IoOp::Kind::Sync)
+    return ::_commit(op.fd) == 0 ? 0 : -errno;
+  if (::_lseeki64(op.fd, static_cast<__int64>(off), SEEK_SET) < 0)
+    return -errno;
+  const unsigned len =
+      static_cast<unsigned>(std::min<size_t>(n, size_t{1} << 30));
+  const int r = op.kind == IoOp::Kind::Read ? ::_read(op.fd, data, len)
+                                            : ::_write(op.fd, data, len);
+  return r < 0 ? -errno : r;
+#else
+  ssize_t r = 0;
+  switch (op.kind) {
+  case IoOp::Kind::Read:
+    r = ::pread(op.fd, data, n, static_cast<off_t>(off));
+    break;
+  case IoOp::Kind::Write:
+    r = ::pwrite(op.fd, data, n, static_cast<off_t>(off));
+    break;
+  case IoOp::Kind::Sync:
+#ifdef __APPLE__
+    r = ::fsync(op.fd);
+#else
+    r = ::fdatasync(op.fd);
+#endif
+    break;
+  }
+  return r < 0 ? -errno : static_cast<long>(r);
+#endif
+}
+
+const char *verb(IoOp::Kind kind) {
+  switch (kind) {
+  case IoOp::Kind::Read:
+    return "cannot read ";
+  case IoOp::Kind::Write:
+    return "cannot write ";
+  default:
+    return "cannot sync ";
+  }
+}
+
+} // namespace
+
+struct IoQueue::Slot {
+  Batch *batch = nullptr;
+  size_t op = 0;    // index in batch->ops
+  size_t done = 0;  // bytes moved so far
+  bool linked = false; // Uring: the next slot, a sync, waits for this one
+#ifdef KADEDB_HAVE_IO_URING
+  iovec iov{};
+#endif
+};
+
+struct IoQueue::Batch {
+  uint64_t ticket = 0;
+  std::string path;
+  std::vector<IoOp> ops;
+  std::vector<Slot> slots; // one per op
+  size_t next = 0;         // first op not queued yet
+  size_t inflight = 0;     // slots queued or running
+  Slot *retrySync = nullptr; // a linked sync cancelled by a short write
+  Status status;
+  bool done = false;
+};
+
+// ---- io_uring --------------------------------------------------------------
+
+#ifdef KADEDB_HAVE_IO_URING
+struct IoQueue::Ring {
+  int fd = -1;
+  void *sq = MAP_FAILED;
+  void *cq = MAP_FAILED;
+  size_t sqBytes = 0;
+  size_t cqBytes = 0;
+  io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+  size_t sqeBytes = 0;
+  unsigned *sqHead = nullptr;
+  unsigned *sqTail = nullptr;
+  unsigned *sqArray = nullptr;
+  unsigned sqMask = 0;
+  unsigned *cqHead = nullptr;
+  unsigned *cqTail = nullptr;
+  io_uring_cqe *cqes = nullptr;
+  unsigned cqMask = 0;
+  unsigned tail = 0; // our copy of *sqTail
+
+  static std::unique_ptr<Ring> create(unsigned entries) {
+    std::unique_ptr<Ring> r(new Ring());
+    io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    r->fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+    if (r->fd < 0)
+      return nullptr;
+    r->sqBytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cqBytes = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+      r->sqBytes = r->cqBytes = std::max(r->sqBytes, r->cqBytes);
+    r->sq = ::mmap(nullptr, r->sqBytes, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq == MAP_FAILED)
+      return nullptr;
+    r->cq = single ? r->sq
+                   : ::mmap(nullptr, r->cqBytes, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, r->fd,
+                            IORING_OFF_CQ_RING);
+    if (r->cq == MAP_FAILED)
+      return nullptr;
+    r->sqeBytes = p.sq_entries * sizeof(io_uring_sqe);
+    r->sqes = static_cast<io_uring_sqe *>(
+        ::mmap(nullptr, r->sqeBytes, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES));
+    if (r->sqes == MAP_FAILED)
+      return nullptr;
+    char *sq = static_cast<char *>(r->sq);
+    char *cq = static_cast<char *>(r->cq);
+    r->sqHead = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+    r->sqTail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    r->sqArray = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    r->sqMask = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    r->cqHead = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    r->cqTail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    r->cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+    r->cqMask = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    r->tail = *r->sqTail;
+    return r;
+  }
+
+  ~Ring() {
+    if (sqes != MAP_FAILED)
+      ::munmap(sqes, sqeBytes);
+    if (cq != MAP_FAILED && cq != sq)
+      ::munmap(cq, cqBytes);
+    if (sq != MAP_FAILED)
+      ::munmap(sq, sqBytes);
+    if (fd >= 0)
+      ::close(fd);
+  }
+
+  // Fill the next submission entry from `slot`
+  void push(Slot *slot, const IoOp &op) {
+    io_uring_sqe *sqe = &sqes[tail & sqMask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = op.fd;
+    sqe->user_data = reinterpret_cast<uint64_t>(slot);
+    if (op.kind == IoOp::Kind::Sync) {
+      sqe->opcode = IORING_OP_FSYNC;
+      sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    } else {
+      slot->iov.iov_base = op.data + slot->done;
+      slot->iov.iov_len = op.bytes - slot->done;
+      sqe->opcode = op.kind == IoOp::Kind::Read ? IORING_OP_READV
+                                                : IORING_OP_WRITEV;
+      sqe->addr = reinterpret_cast<uint64_t>(&slot->iov);
+      sqe->len = 1;
+      sqe->off = op.offset + slot->done;
+    }
+    if (slot->linked)
+      sqe->flags |= IOSQE_IO_LINK;
+    sqArray[tail & sqMask] = tail & sqMask;
+    ++tail;
+    __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+  }
+
+  // Entries filled but not yet taken by the kernel
+  unsigned unsubmitted() const {
+    return tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+  }
+
+  // Submit what is filled and wait for `minComplete` completions; -errno
+  // on failure
+  int enter(unsigned minComplete) {
+    const unsigned flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+    for (;;) {
+      const long r = ::syscall(__NR_io_uring_enter, fd, unsubmitted(),
+                               minComplete, flags, nullptr, 0);
+      if (r >= 0)
+        return 0;
+      if (errno != EINTR)
+        return -errno;
+    }
+  }
+
+  // Each completion as fn(user data, result)
+  template <typename Fn> void drain(Fn &&fn) {
+    unsigned head = *cqHead;
+    const unsigned end = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    for (; head != end; ++head) {
+      const io_uring_cqe &cqe = cqes[head & cqMask];
+      fn(cqe.user_data, cqe.res);
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+  }
+};
+#else
+struct IoQueue::Ring {};
+#endif
+
+// ---- IoQueue ---------------------------------------------------------------
+
+IoQueue::IoQueue(IoBackend backend, size_t depth)
+    : backend_(IoBackend::Threads), depth_(std::max<size_t>(depth, 2)) {
+#ifdef KADEDB_HAVE_IO_URING
+  if (backend != IoBackend::Threads &&
+      (ring_ = Ring::create(static_cast<unsigned>(depth_))))
+    backend_ = IoBackend::Uring;
+#else
+  (void)backend;
+#endif
+  if (backend_ == IoBackend::Threads)
+    for (size_t i = 0; i < std::min(kIoThreads, depth_); ++i)
+      threads_.emplace_back([this] { threadLoop(); });
+}
+
+IoQueue::~IoQueue() {
+  {
+    std::lock_guard<std::mutex> lk(threadMtx_);
+    stop_ = true;
+  }
+  todoCv_.notify_all();
+  for (auto &t : threads_)
+    t.join();
+}
+
+uint64_t IoQueue::submit(std::vector<IoOp> ops, const std::string &path) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  std::unique_ptr<Batch> b(new Batch());
+  b->ticket = nextTicket_++;
+  b->path = path;
+  b->ops = std::move(ops);
+  b->slots.resize(b->ops.size());
+  for (size_t i = 0; i < b->slots.size(); ++i) {
+    b->slots[i].batch = b.get();
+    b->slots[i].op = i;
+  }
+  advance(*b);
+  batches_.push_back(std::move(b));
+  pump();
+  return batches_.back()->ticket;
+}
+
+Status IoQueue::wait(uint64_t ticket) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  for (;;) {
+    auto it = std::find_if(batches_.begin(), batches_.end(),
+                           [&](const std::unique_ptr<Batch> &b) {
+                             return b->ticket == ticket;
+                           });
+    if (it == batches_.end())
+      return Status::InvalidArgument("Unknown I/O batch " +
+                                     std::to_string(ticket));
+    if ((*it)->done) {
+      Status st = (*it)->status;
+      batches_.erase(it);
+      return st;
+    }
+    reap(/*block=*/true);
+    pump();
+  }
+}
+
+void IoQueue::advance(Batch &b) {
+  if (b.inflight > 0)
+    return; // the current step is still running
+  if (b.retrySync) {
+    b.retrySync->linked = false;
+    ready_.push_back(b.retrySync);
+    b.retrySync = nullptr;
+    ++b.inflight;
+    return;
+  }
+  if (!b.status.ok() || b.next == b.ops.size()) {
+    b.done = true;
+    return;
+  }
+  // A sync alone, or the run of transfers up to the next sync
+  if (b.ops[b.next].kind == IoOp::Kind::Sync) {
+    ready_.push_back(&b.slots[b.next++]);
+    ++b.inflight;
+    return;
+  }
+  const size_t begin = b.next;
+  while (b.next < b.ops.size() && b.ops[b.next].kind != IoOp::Kind::Sync)
+    ready_.push_back(&b.slots[b.next++]);
+  b.inflight += b.next - begin;
+  // One write then a sync: io_uring runs the pair as one linked request
+  if (backend_ == IoBackend::Uring && b.next - begin == 1 &&
+      b.next < b.ops.size()) {
+    b.slots[begin].linked = true;
+    ready_.push_back(&b.slots[b.next++]);
+    ++b.inflight;
+  }
+}
+
+void IoQueue::pump() {
+  size_t issued = 0;
+  while (!ready_.empty()) {
+    Slot *s = ready_.front();
+    // A linked pair goes to the ring together
+    const size_t need = s->linked ? 2 : 1;
+    if (inflight_ + need > depth_)
+      break;
+    for (size_t i = 0; i < need; ++i) {
+      Slot *t = ready_.front();
+      ready_.pop_front();
+      ++inflight_;
+      ++issued;
+#ifdef KADEDB_HAVE_IO_URING
+      if (backend_ == IoBackend::Uring) {
+        ring_->push(t, t->batch->ops[t->op]);
+        continue;
+      }
+#endif
+      std::lock_guard<std::mutex> lk(threadMtx_);
+      todo_.push_back(t);
+    }
+  }
+  if (issued == 0)
+    return;
+#ifdef KADEDB_HAVE_IO_URING
+  if (backend_ == IoBackend::Uring) {
+    // A failed submission is retried by the next enter() of reap()
+    ring_->enter(0);
+    return;
+  }
+#endif
+  todoCv_.notify_all();
+}
+
+void IoQueue::reap(bool block) {
+#ifdef KADEDB_HAVE_IO_URING
+  if (backend_ == IoBackend::Uring) {
+    if (block) {
+      const int err = ring_->enter(1);
+      if (err < 0 && err != -EAGAIN && err != -EBUSY) {
+        // The ring is unusable: fail what never reached the kernel
+        const unsigned head = ring_->tail - ring_->unsubmitted();
+        for (unsigned i = head; i != ring_->tail; ++i)
+          complete(reinterpret_cast<Slot *>(
+                       ring_->sqes[i & ring_->sqMask].user_data),
+                   err);
+        ring_->tail = head;
+        __atomic_store_n(ring_->sqTail, head, __ATOMIC_RELEASE);
+      }
+    }
+    ring_->drain([&](uint64_t data, int res) {
+      complete(reinterpret_cast<Slot *>(data), res);
+    });
+    return;
+  }
+#endif
+  std::vector<std::pair<Slot *, long>> done;
+  {
+    std::unique_lock<std::mutex> lk(threadMtx_);
+    if (block)
+      doneCv_.wait(lk, [&] { return !done_.empty(); });
+    done.swap(done_);
+  }
+  for (auto &d : done)
+    complete(d.first, d.second);
+}
+
+void IoQueue::complete(Slot *slot, long res) {
+  Batch &b = *slot->batch;
+  const IoOp &op = b.ops[slot->op];
+  --inflight_;
+  --b.inflight;
+  auto fail = [&](int err) {
+    if (b.status.ok())
+      b.status = Status::Internal(verb(op.kind) + b.path + ": " +
+                                  std::strerror(err));
+  };
+  auto again = [&] {
+    slot->linked = false;
+    ready_.push_back(slot);
+    ++b.inflight;
+  };
+  if (op.kind == IoOp::Kind::Sync) {
+    if (res == -ECANCELED && b.status.ok())
+      b.retrySync = slot; // its write came up short; sync after the rest
+    else if (res < 0)
+      fail(static_cast<int>(-res));
+  } else if (res == -EINTR || res == -EAGAIN) {
+    again();
+  } else if (res < 0) {
+    fail(static_cast<int>(-res));
+  } else if ((slot->done += static_cast<size_t>(res)) < op.bytes &&
+             b.status.ok()) {
+    if (res > 0)
+      again();
+    else
+      b.status = Status::Internal(verb(op.kind) + b.path +
+                                  ": unexpected end of file");
+  }
+  advance(b);
+}
+
+void IoQueue::threadLoop() {
+  for (;;) {
+    Slot *s;
+    {
+      std::unique_lock<std::mutex> lk(threadMtx_);
+      todoCv_.wait(lk, [&] { return stop_ || !todo_.empty(); });
+      if (todo_.empty())
+        return;
+      s = todo_.front();
+      todo_.pop_front();
+    }
+    // The slot's batch is only read here; complete() runs under mtx_
+    const long res = runOp(s->batch->ops[s->op], s->done);
+    {
+      std::lock_guard<std::mutex> lk(threadMtx_);
+      done_.emplace_back(s, res);
+    }
+    doneCv_.notify_all();
+  }
+}
+
+// ---- Helpers ---------------------------------------------------------------
+
+namespace fileio {
+
+Status readFile(IoQueue &queue, int fd, uint64_t size, const std::string &path,
+                std::string &out, size_t chunkBytes) {
+  out.resize(static_cast<size_t>(size));
+  std::vector<IoOp> ops;
+  chunkBytes = std::max<size_t>(chunkBytes, 1);
+  for (uint64_t off = 0; off < size; off += chunkBytes)
+    ops.push_back(IoOp::read(
+        fd, &out[static_cast<size_t>(off)],
+        static_cast<size_t>(std::min<uint64_t>(chunkBytes, size - off)), off));
+  return queue.run(std::move(ops), path);
+}
+
+int openDirect(const std::string &path, bool *direct) {
+  if (direct)
+    *direct = false;
+#ifdef _WIN32
+  return ::_open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY,
+                 _S_IREAD | _S_IWRITE);
+#else
+  const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+#ifdef O_DIRECT
+  const int fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+  if (fd >= 0 || errno != EINVAL) {
+    if (direct)
+      *direct = fd >= 0;
+    return fd;
+  }
+#endif
+  return ::open(path.c_str(), flags, 0644);
+#endif
+}
+
+} // namespace fileio
+
+} // namespace kadedb
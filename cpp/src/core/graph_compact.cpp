@@ -0,0 +1,727 @@
+#include "kadedb/graph/compact.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_set>
+
+namespace kadedb {
+namespace {
+
+static Status graphNotFound(const std::string &g) {
+  return Status::NotFound("Unknown graph: " + g);
+}
+
+static Status nodeNotFound(NodeId id) {
+  return Status::NotFound("Unknown node: " +
+                          std::to_string(static_cast<long long>(id)));
+}
+
+static Status edgeNotFound(EdgeId id) {
+  return Status::NotFound("Unknown edge: " +
+                          std::to_string(static_cast<long long>(id)));
+}
+
+static void putVarint(std::vector<uint8_t> &out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<uint8_t>(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+static uint64_t getVarint(const uint8_t *&p) {
+  uint64_t v = 0;
+  for (int shift = 0;; shift += 7) {
+    const uint8_t b = *p++;
+    v |= static_cast<uint64_t>(b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return v;
+  }
+}
+
+// Edge id deltas may be negative: zigzag keeps small magnitudes short
+static uint64_t zigzagDelta(EdgeId cur, EdgeId prev) {
+  const auto d = static_cast<int64_t>(static_cast<uint64_t>(cur) -
+                                      static_cast<uint64_t>(prev));
+  return (static_cast<uint64_t>(d) << 1) ^ static_cast<uint64_t>(d >> 63);
+}
+
+static EdgeId applyZigzag(EdgeId prev, uint64_t z) {
+  const uint64_t d = (z >> 1) ^ (~(z & 1) + 1);
+  return static_cast<EdgeId>(static_cast<uint64_t>(prev) + d);
+}
+
+// Approximate bytes of a node-based hash map holding `valueBytes` per
+// element beyond the element itself
+template <typename Map>
+static size_t mapBytes(const Map &m, size_t valueBytes = 0) {
+  return m.bucket_count() * sizeof(void *) +
+         m.size() * (sizeof(typename Map::value_type) + sizeof(void *) +
+                     valueBytes);
+}
+
+} // namespace
+
+// Interner
+
+uint32_t CompactGraphStorage::Interner::intern(const std::string &s) {
+  auto [it, added] = ids_.try_emplace(s, static_cast<uint32_t>(names_.size()));
+  if (added)
+    names_.push_back(s);
+  return it->second;
+}
+
+size_t CompactGraphStorage::Interner::memoryBytes() const {
+  size_t bytes = names_.capacity() * sizeof(std::string) + mapBytes(ids_);
+  for (const auto &n : names_)
+    bytes += 2 * n.capacity();
+  return bytes;
+}
+
+// EdgeLocator
+
+size_t CompactGraphStorage::EdgeLocator::position(EdgeId id) const {
+  auto bit = std::upper_bound(blockFirst_.begin(), blockFirst_.end(), id);
+  if (bit == blockFirst_.begin())
+    return SIZE_MAX;
+  const size_t block = static_cast<size_t>(bit - blockFirst_.begin()) - 1;
+  const size_t last = std::min(from_.size(), (block + 1) * kBlock);
+  const uint8_t *p = deltas_.data() + blockOffset_[block];
+  EdgeId cur = blockFirst_[block];
+  for (size_t pos = block * kBlock;;) {
+    if (cur == id)
+      return pos;
+    if (cur > id || ++pos == last)
+      return SIZE_MAX;
+    cur = static_cast<EdgeId>(static_cast<uint64_t>(cur) + getVarint(p));
+  }
+}
+
+CompactGraphStorage::Slot
+CompactGraphStorage::EdgeLocator::find(EdgeId id) const {
+  if (auto it = tail_.find(id); it != tail_.end())
+    return it->second;
+  const size_t pos = position(id);
+  return pos == SIZE_MAX ? npos : from_[pos];
+}
+
+void CompactGraphStorage::EdgeLocator::insert(EdgeId id, Slot from) {
+  tail_[id] = from;
+  if (tail_.size() > 256 + from_.size() / 16)
+    merge();
+}
+
+void CompactGraphStorage::EdgeLocator::erase(EdgeId id) {
+  if (tail_.erase(id))
+    return;
+  const size_t pos = position(id);
+  if (pos == SIZE_MAX || from_[pos] == npos)
+    return;
+  from_[pos] = npos;
+  if (++erased_ > 256 + from_.size() / 4)
+    merge();
+}
+
+void CompactGraphStorage::EdgeLocator::merge() {
+  std::vector<std::pair<EdgeId, Slot>> all(tail_.begin(), tail_.end());
+  all.reserve(all.size() + from_.size() - erased_);
+  for (size_t block = 0; block < blockFirst_.size(); ++block) {
+    const uint8_t *p = deltas_.data() + blockOffset_[block];
+    EdgeId cur = blockFirst_[block];
+    const size_t last = std::min(from_.size(), (block + 1) * kBlock);
+    for (size_t pos = block * kBlock; pos < last; ++pos) {
+      if (pos > block * kBlock)
+        cur = static_cast<EdgeId>(static_cast<uint64_t>(cur) + getVarint(p));
+      if (from_[pos] != npos)
+        all.emplace_back(cur, from_[pos]);
+    }
+  }
+  std::sort(all.begin(), all.end());
+
+  blockFirst_.clear();
+  blockOffset_.clear();
+  deltas_.clear();
+  from_.clear();
+  from_.reserve(all.size());
+  for (size_t pos = 0; pos < all.size(); ++pos) {
+    if (pos % kBlock == 0) {
+      blockFirst_.push_back(all[pos].first);
+      blockOffset_.push_back(static_cast<uint32_t>(deltas_.size()));
+    } else {
+      putVarint(deltas_, static_cast<uint64_t>(all[pos].first) -
+                             static_cast<uint64_t>(all[pos - 1].first));
+    }
+    from_.push_back(all[pos].second);
+  }
+  blockFirst_.shrink_to_fit();
+  blockOffset_.shrink_to_fit();
+  deltas_.shrink_to_fit();
+  erased_ = 0;
+  tail_.clear();
+}
+
+size_t CompactGraphStorage::EdgeLocator::memoryBytes() const {
+  return blockFirst_.capacity() * sizeof(EdgeId) +
+         blockOffset_.capacity() * sizeof(uint32_t) + deltas_.capacity() +
+         from_.capacity() * sizeof(Slot) + mapBytes(tail_);
+}
+
+// Lists
+
+namespace {
+
+template <typename Entry>
+void encodeList(const std::vector<Entry> &sorted, bool withType,
+                std::vector<uint8_t> &out) {
+  uint32_t node = 0;
+  EdgeId edge = 0;
+  for (const Entry &e : sorted) {
+    putVarint(out, e.node - node);
+    putVarint(out, zigzagDelta(e.edge, edge));
+    if (withType)
+      putVarint(out, e.type);
+    node = e.node;
+    edge = e.edge;
+  }
+}
+
+template <typename Entry, typename Fn>
+void decodeList(const uint8_t *p, const uint8_t *end, bool withType,
+                const Fn &fn) {
+  Entry e{0, 0, 0};
+  while (p < end) {
+    e.node += static_cast<uint32_t>(getVarint(p));
+    e.edge = applyZigzag(e.edge, getVarint(p));
+    if (withType)
+      e.type = static_cast<uint32_t>(getVarint(p));
+    fn(e);
+  }
+}
+
+// Tail entries stand alone: (node << 1 | out), the zigzag edge id and,
+// for out-edges, the type
+template <typename Entry, typename Fn>
+void decodeTail(const uint8_t *p, const uint8_t *end, const Fn &fn) {
+  while (p < end) {
+    const uint64_t head = getVarint(p);
+    const bool out = head & 1;
+    Entry e{static_cast<uint32_t>(head >> 1), applyZigzag(0, getVarint(p)),
+            0};
+    if (out)
+      e.type = static_cast<uint32_t>(getVarint(p));
+    fn(out, e);
+  }
+}
+
+} // namespace
+
+template <typename Fn>
+void CompactGraphStorage::forEachEntry(const NodeRecord &r, bool out,
+                                       const Fn &fn) {
+  const uint8_t *base = r.bytes.data();
+  if (out)
+    decodeList<Entry>(base, base + r.outEnd, true, fn);
+  else
+    decodeList<Entry>(base + r.outEnd, base + r.inEnd, false, fn);
+  if (r.tailCount)
+    decodeTail<Entry>(base + r.inEnd, base + r.bytes.size(),
+                      [&](bool isOut, const Entry &e) {
+                        if (isOut == out)
+                          fn(e);
+                      });
+}
+
+void CompactGraphStorage::store(NodeRecord &r, std::vector<Entry> &out,
+                                std::vector<Entry> &in) {
+  std::sort(out.begin(), out.end());
+  std::sort(in.begin(), in.end());
+  std::vector<uint8_t> bytes;
+  encodeList(out, true, bytes);
+  r.outEnd = static_cast<uint32_t>(bytes.size());
+  encodeList(in, false, bytes);
+  r.inEnd = static_cast<uint32_t>(bytes.size());
+  bytes.shrink_to_fit();
+  r.bytes.swap(bytes);
+  r.outCount = static_cast<uint32_t>(out.size());
+  r.inCount = static_cast<uint32_t>(in.size());
+  r.tailCount = 0;
+}
+
+void CompactGraphStorage::flush(NodeRecord &r) {
+  std::vector<Entry> out, in;
+  out.reserve(r.outCount);
+  in.reserve(r.inCount);
+  forEachEntry(r, true, [&](const Entry &e) { out.push_back(e); });
+  forEachEntry(r, false, [&](const Entry &e) { in.push_back(e); });
+  store(r, out, in);
+}
+
+void CompactGraphStorage::addEntry(NodeRecord &r, bool out, const Entry &e) {
+  // Grow by an eighth at a time rather than doubling: the lists are merged
+  // (and shrunk) about as often
+  constexpr size_t kMaxEntryBytes = 25;
+  if (r.bytes.size() + kMaxEntryBytes > r.bytes.capacity())
+    r.bytes.reserve(r.bytes.size() +
+                    std::max<size_t>(2 * kMaxEntryBytes, r.bytes.size() / 8));
+  putVarint(r.bytes, (static_cast<uint64_t>(e.node) << 1) | (out ? 1 : 0));
+  putVarint(r.bytes, zigzagDelta(e.edge, 0));
+  if (out)
+    putVarint(r.bytes, e.type);
+  ++(out ? r.outCount : r.inCount);
+  if (++r.tailCount > (r.outCount + r.inCount) / 8)
+    flush(r);
+}
+
+void CompactGraphStorage::removeEntry(NodeRecord &r, bool out, EdgeId edge) {
+  std::vector<Entry> lists[2]; // in, out
+  bool found = false;
+  for (bool dir : {false, true}) {
+    lists[dir].reserve(dir ? r.outCount : r.inCount);
+    forEachEntry(r, dir, [&](const Entry &e) {
+      if (dir == out && !found && e.edge == edge)
+        found = true;
+      else
+        lists[dir].push_back(e);
+    });
+  }
+  if (found)
+    store(r, lists[1], lists[0]);
+}
+
+// Graph data helpers
+
+const CompactGraphStorage::NodeRecord *
+CompactGraphStorage::record(const GraphData &g, NodeId id) {
+  auto it = g.slots.find(id);
+  return it == g.slots.end() ? nullptr : &g.records[it->second];
+}
+
+uint32_t CompactGraphStorage::internLabels(
+    GraphData &g, const std::unordered_set<std::string> &labels) {
+  if (labels.empty())
+    return 0;
+  std::vector<uint32_t> set;
+  set.reserve(labels.size());
+  for (const auto &l : labels)
+    set.push_back(g.labels.intern(l));
+  std::sort(set.begin(), set.end());
+  auto [it, added] = g.labelSetIds.try_emplace(
+      set, static_cast<uint32_t>(g.labelSets.size()));
+  if (added)
+    g.labelSets.push_back(std::move(set));
+  return it->second;
+}
+
+std::unordered_set<std::string>
+CompactGraphStorage::labelsOf(const GraphData &g, uint32_t set) {
+  std::unordered_set<std::string> out;
+  for (uint32_t l : g.labelSets[set])
+    out.insert(g.labels.name(l));
+  return out;
+}
+
+void CompactGraphStorage::unlinkEdge(GraphData &g, EdgeId id, Slot from) {
+  Slot to = EdgeLocator::npos;
+  forEachEntry(g.records[from], true, [&](const Entry &e) {
+    if (e.edge == id)
+      to = e.node;
+  });
+  removeEntry(g.records[from], true, id);
+  if (to != EdgeLocator::npos)
+    removeEntry(g.records[to], false, id);
+  g.edges.erase(id);
+  g.edgeLabelSets.erase(id);
+  for (auto &col : g.edgeColumns)
+    col.second.erase(id);
+}
+
+std::shared_ptr<CompactGraphStorage::GraphData>
+CompactGraphStorage::findGraph(const std::string &graph) const {
+  std::shared_lock lk(mtx_);
+  auto it = graphs_.find(graph);
+  return it == graphs_.end() ? nullptr : it->second;
+}
+
+// GraphStorage
+
+Status CompactGraphStorage::createGraph(const std::string &graph) {
+  std::lock_guard lk(mtx_);
+  if (graphs_.find(graph) != graphs_.end())
+    return Status::AlreadyExists("Graph already exists: " + graph);
+  graphs_.emplace(graph, std::make_shared<GraphData>());
+  return Status::OK();
+}
+
+Status CompactGraphStorage::dropGraph(const std::string &graph) {
+  std::lock_guard lk(mtx_);
+  auto it = graphs_.find(graph);
+  if (it == graphs_.end())
+    return graphNotFound(graph);
+  graphs_.erase(it);
+  return Status::OK();
+}
+
+std::vector<std::string> CompactGraphStorage::listGraphs() const {
+  std::shared_lock lk(mtx_);
+  std::vector<std::string> out;
+  out.reserve(graphs_.size());
+  for (const auto &kv : graphs_)
+    out.push_back(kv.first);
+  return out;
+}
+
+Result<Node> CompactGraphStorage::getNode(const std::string &graph,
+                                          NodeId id) const {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return Result<Node>::err(graphNotFound(graph));
+  std::shared_lock lk(gd->mtx);
+  const NodeRecord *r = record(*gd, id);
+  if (!r)
+    return Result<Node>::err(nodeNotFound(id));
+  Node node;
+  node.id = id;
+  node.labels = labelsOf(*gd, r->labelSet);
+  for (const auto &col : gd->nodeColumns)
+    if (auto it = col.second.find(id); it != col.second.end())
+      node.properties[col.first] = it->second.toValue();
+  return Result<Node>::ok(std::move(node));
+}
+
+Status CompactGraphStorage::putNode(const std::string &graph,
+                                    const Node &node) {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return graphNotFound(graph);
+  std::lock_guard lk(gd->mtx);
+  auto &g = *gd;
+
+  Slot slot;
+  if (auto it = g.slots.find(node.id); it != g.slots.end()) {
+    slot = it->second;
+    for (auto &col : g.nodeColumns)
+      col.second.erase(node.id);
+  } else {
+    if (!g.freeSlots.empty()) {
+      slot = g.freeSlots.back();
+      g.freeSlots.pop_back();
+    } else {
+      slot = static_cast<Slot>(g.records.size());
+      g.records.emplace_back();
+    }
+    g.records[slot].id = node.id;
+    g.slots.emplace(node.id, slot);
+  }
+  g.records[slot].labelSet = internLabels(g, node.labels);
+  for (const auto &kv : node.properties)
+    g.nodeColumns[kv.first][node.id] = InlineValue::fromValue(kv.second.get());
+  return Status::OK();
+}
+
+Status CompactGraphStorage::eraseNode(const std::string &graph, NodeId id) {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return graphNotFound(graph);
+  std::lock_guard lk(gd->mtx);
+  auto &g = *gd;
+  auto it = g.slots.find(id);
+  if (it == g.slots.end())
+    return nodeNotFound(id);
+  const Slot slot = it->second;
+  NodeRecord &r = g.records[slot];
+
+  // The node's own lists go away whole; only the far ends are re-encoded
+  std::vector<Entry> out, in;
+  forEachEntry(r, true, [&](const Entry &e) { out.push_back(e); });
+  forEachEntry(r, false, [&](const Entry &e) { in.push_back(e); });
+  auto drop = [&](const Entry &e, bool farOut) {
+    if (e.node != slot)
+      removeEntry(g.records[e.node], farOut, e.edge);
+    g.edges.erase(e.edge);
+    g.edgeLabelSets.erase(e.edge);
+    for (auto &col : g.edgeColumns)
+      col.second.erase(e.edge);
+  };
+  for (const Entry &e : out)
+    drop(e, false);
+  for (const Entry &e : in)
+    drop(e, true);
+
+  for (auto &col : g.nodeColumns)
+    col.second.erase(id);
+  r = NodeRecord();
+  g.freeSlots.push_back(slot);
+  g.slots.erase(it);
+  return Status::OK();
+}
+
+Result<Edge> CompactGraphStorage::getEdge(const std::string &graph,
+                                          EdgeId id) const {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return Result<Edge>::err(graphNotFound(graph));
+  std::shared_lock lk(gd->mtx);
+  const auto &g = *gd;
+  const Slot from = g.edges.find(id);
+  if (from == EdgeLocator::npos)
+    return Result<Edge>::err(edgeNotFound(id));
+
+  Edge edge;
+  edge.id = id;
+  edge.from = g.records[from].id;
+  forEachEntry(g.records[from], true, [&](const Entry &e) {
+    if (e.edge != id)
+      return;
+    edge.to = g.records[e.node].id;
+    edge.type = g.types.name(e.type);
+  });
+  if (auto it = g.edgeLabelSets.find(id); it != g.edgeLabelSets.end())
+    edge.labels = labelsOf(g, it->second);
+  for (const auto &col : g.edgeColumns)
+    if (auto it = col.second.find(id); it != col.second.end())
+      edge.properties[col.first] = it->second.toValue();
+  return Result<Edge>::ok(std::move(edge));
+}
+
+Result<GraphContents>
+CompactGraphStorage::contents(const std::string &graph) const {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return Result<GraphContents>::err(graphNotFound(graph));
+  std::shared_lock lk(gd->mtx);
+  const auto &g = *gd;
+  GraphContents out;
+  out.nodes.reserve(g.slots.size());
+  for (const auto &kv : g.slots) {
+    const NodeRecord &r = g.records[kv.second];
+    Node node;
+    node.id = kv.first;
+    node.labels = labelsOf(g, r.labelSet);
+    out.nodes.push_back(std::move(node));
+    forEachEntry(r, true, [&](const Entry &e) {
+      Edge edge;
+      edge.id = e.edge;
+      edge.from = r.id;
+      edge.to = g.records[e.node].id;
+      edge.type = g.types.name(e.type);
+      if (auto it = g.edgeLabelSets.find(e.edge); it != g.edgeLabelSets.end())
+        edge.labels = labelsOf(g, it->second);
+      out.edges.push_back(std::move(edge));
+    });
+  }
+  std::sort(out.nodes.begin(), out.nodes.end(),
+            [](const Node &a, const Node &b) { return a.id < b.id; });
+  std::sort(out.edges.begin(), out.edges.end(),
+            [](const Edge &a, const Edge &b) { return a.id < b.id; });
+
+  // Properties column by column rather than every column per id
+  auto fill = [](auto &items, const auto &columns) {
+    for (const auto &col : columns)
+      for (const auto &kv : col.second) {
+        auto it = std::lower_bound(
+            items.begin(), items.end(), kv.first,
+            [](const auto &item, int64_t id) { return item.id < id; });
+        if (it != items.end() && it->id == kv.first)
+          it->properties[col.first] = kv.second.toValue();
+      }
+  };
+  fill(out.nodes, g.nodeColumns);
+  fill(out.edges, g.edgeColumns);
+  return Result<GraphContents>::ok(std::move(out));
+}
+
+Status CompactGraphStorage::putEdge(const std::string &graph,
+                                    const Edge &edge) {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return graphNotFound(graph);
+  std::lock_guard lk(gd->mtx);
+  auto &g = *gd;
+  auto fit = g.slots.find(edge.from);
+  auto tit = g.slots.find(edge.to);
+  if (fit == g.slots.end() || tit == g.slots.end())
+    return Status::InvalidArgument("Edge endpoints must exist");
+
+  if (const Slot old = g.edges.find(edge.id); old != EdgeLocator::npos)
+    unlinkEdge(g, edge.id, old);
+  const uint32_t type = g.types.intern(edge.type);
+  addEntry(g.records[fit->second], true, Entry{tit->second, edge.id, type});
+  addEntry(g.records[tit->second], false, Entry{fit->second, edge.id, 0});
+  g.edges.insert(edge.id, fit->second);
+  if (!edge.labels.empty())
+    g.edgeLabelSets[edge.id] = internLabels(g, edge.labels);
+  for (const auto &kv : edge.properties)
+    g.edgeColumns[kv.first][edge.id] = InlineValue::fromValue(kv.second.get());
+  return Status::OK();
+}
+
+Status CompactGraphStorage::eraseEdge(const std::string &graph, EdgeId id) {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return graphNotFound(graph);
+  std::lock_guard lk(gd->mtx);
+  const Slot from = gd->edges.find(id);
+  if (from == EdgeLocator::npos)
+    return edgeNotFound(id);
+  unlinkEdge(*gd, id, from);
+  return Status::OK();
+}
+
+Result<std::vector<EdgeId>>
+CompactGraphStorage::edgeIdsOut(const std::string &graph, NodeId from) const {
+  using R = Result<std::vector<EdgeId>>;
+  auto gd = findGraph(graph);
+  if (!gd)
+    return R::err(graphNotFound(graph));
+  std::shared_lock lk(gd->mtx);
+  const NodeRecord *r = record(*gd, from);
+  if (!r)
+    return R::err(nodeNotFound(from));
+  std::vector<EdgeId> out;
+  out.reserve(r->outCount);
+  forEachEntry(*r, true, [&](const Entry &e) { out.push_back(e.edge); });
+  return R::ok(std::move(out));
+}
+
+Result<std::vector<EdgeId>>
+CompactGraphStorage::edgeIdsIn(const std::string &graph, NodeId to) const {
+  using R = Result<std::vector<EdgeId>>;
+  auto gd = findGraph(graph);
+  if (!gd)
+    return R::err(graphNotFound(graph));
+  std::shared_lock lk(gd->mtx);
+  const NodeRecord *r = record(*gd, to);
+  if (!r)
+    return R::err(nodeNotFound(to));
+  std::vector<EdgeId> out;
+  out.reserve(r->inCount);
+  forEachEntry(*r, false, [&](const Entry &e) { out.push_back(e.edge); });
+  return R::ok(std::move(out));
+}
+
+Result<std::vector<NodeId>>
+CompactGraphStorage::neighborsOut(const std::string &graph,
+                                  NodeId from) const {
+  using R = Result<std::vector<NodeId>>;
+  auto gd = findGraph(graph);
+  if (!gd)
+    return R::err(graphNotFound(graph));
+  std::shared_lock lk(gd->mtx);
+  const NodeRecord *r = record(*gd, from);
+  if (!r)
+    return R::err(nodeNotFound(from));
+  std::vector<NodeId> out;
+  out.reserve(r->outCount);
+  forEachEntry(*r, true,
+               [&](const Entry &e) { out.push_back(gd->records[e.node].id); });
+  return R::ok(std::move(out));
+}
+
+Result<std::vector<NodeId>>
+CompactGraphStorage::neighborsIn(const std::string &graph, NodeId to) const {
+  using R = Result<std::vector<NodeId>>;
+  auto gd = findGraph(graph);
+  if (!gd)
+    return R::err(graphNotFound(graph));
+  std::shared_lock lk(gd->mtx);
+  const NodeRecord *r = record(*gd, to);
+  if (!r)
+    return R::err(nodeNotFound(to));
+  std::vector<NodeId> out;
+  out.reserve(r->inCount);
+  forEachEntry(*r, false,
+               [&](const Entry &e) { out.push_back(gd->records[e.node].id); });
+  return R::ok(std::move(out));
+}
+
+Result<std::vector<NodeId>> CompactGraphStorage::bfs(const std::string &graph,
+                                                     NodeId start,
+                                                     size_t maxNodes) const {
+  using R = Result<std::vector<NodeId>>;
+  auto gd = findGraph(graph);
+  if (!gd)
+    return R::err(graphNotFound(graph));
+  std::shared_lock lk(gd->mtx);
+  const auto &g = *gd;
+  auto it = g.slots.find(start);
+  if (it == g.slots.end())
+    return R::err(nodeNotFound(start));
+
+  std::vector<bool> seen(g.records.size());
+  std::vector<Slot> q{it->second};
+  seen[it->second] = true;
+  std::vector<NodeId> order;
+  for (size_t head = 0; head < q.size(); ++head) {
+    order.push_back(g.records[q[head]].id);
+    if (maxNodes > 0 && order.size() >= maxNodes)
+      break;
+    forEachEntry(g.records[q[head]], true, [&](const Entry &e) {
+      if (!seen[e.node]) {
+        seen[e.node] = true;
+        q.push_back(e.node);
+      }
+    });
+  }
+  return R::ok(std::move(order));
+}
+
+Result<std::vector<NodeId>> CompactGraphStorage::dfs(const std::string &graph,
+                                                     NodeId start,
+                                                     size_t maxNodes) const {
+  using R = Result<std::vector<NodeId>>;
+  auto gd = findGraph(graph);
+  if (!gd)
+    return R::err(graphNotFound(graph));
+  std::shared_lock lk(gd->mtx);
+  const auto &g = *gd;
+  auto it = g.slots.find(start);
+  if (it == g.slots.end())
+    return R::err(nodeNotFound(start));
+
+  std::vector<bool> seen(g.records.size());
+  std::vector<Slot> stack{it->second}, next;
+  std::vector<NodeId> order;
+  while (!stack.empty()) {
+    const Slot cur = stack.back();
+    stack.pop_back();
+    if (seen[cur])
+      continue;
+    seen[cur] = true;
+    order.push_back(g.records[cur].id);
+    if (maxNodes > 0 && order.size() >= maxNodes)
+      break;
+    next.clear();
+    forEachEntry(g.records[cur], true,
+                 [&](const Entry &e) { next.push_back(e.node); });
+    // push neighbors in reverse so the first neighbor appears earlier
+    for (auto rit = next.rbegin(); rit != next.rend(); ++rit)
+      if (!seen[*rit])
+        stack.push_back(*rit);
+  }
+  return R::ok(std::move(order));
+}
+
+Result<size_t>
+CompactGraphStorage::memoryBytes(const std::string &graph) const {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return Result<size_t>::err(graphNotFound(graph));
+  std::shared_lock lk(gd->mtx);
+  const auto &g = *gd;
+  size_t bytes = g.records.capacity() * sizeof(NodeRecord) +
+                 g.freeSlots.capacity() * sizeof(Slot) + mapBytes(g.slots) +
+                 g.edges.memoryBytes() + g.types.memoryBytes() +
+                 g.labels.memoryBytes() + mapBytes(g.edgeLabelSets);
+  for (const auto &r : g.records)
+    bytes += r.bytes.capacity();
+  for (const auto &set : g.labelSets)
+    bytes += sizeof(set) + set.capacity() * sizeof(uint32_t);
+  bytes += g.labelSetIds.size() * (sizeof(std::vector<uint32_t>) + 48);
+  for (const auto &col : g.nodeColumns)
+    bytes += mapBytes(col.second) + col.first.capacity();
+  for (const auto &col : g.edgeColumns)
+    bytes += mapBytes(col.second) + col.first.capacity();
+  return Result<size_t>::ok(bytes);
+}
+
+} // namespace kadedb
@@ -0,0 +1,486 @@
+#include "kadedb/graph/csr.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+namespace kadedb {
+namespace {
+
+// Direction switching (Beamer et al.): bottom-up once a growing frontier's
+// out-edges exceed the unexplored edges / kAlpha, top-down again once the
+// frontier holds fewer than nodes / kBeta nodes
+constexpr double kAlpha = 14.0;
+constexpr double kBeta = 24.0;
+// Frontier or node slots per unit of work (a multiple of 64, so bottom-up
+// workers own whole bitmap words); smaller steps run on the calling thread
+constexpr size_t kGrain = 1024;
+
+// fn(worker, begin, end) over [0, n) in kGrain chunks claimed by up to
+// `threads` workers
+template <typename Fn>
+void parallelChunks(size_t n, size_t threads, const Fn &fn) {
+  if (threads <= 1 || n < 2 * kGrain) {
+    fn(size_t{0}, size_t{0}, n);
+    return;
+  }
+  threads = std::min(threads, (n + kGrain - 1) / kGrain);
+  std::atomic<size_t> next{0};
+  auto work = [&](size_t w) {
+    for (size_t b; (b = next.fetch_add(kGrain)) < n;)
+      fn(w, b, std::min(n, b + kGrain));
+  };
+  std::vector<std::thread> pool;
+  pool.reserve(threads - 1);
+  for (size_t w = 1; w < threads; ++w)
+    pool.emplace_back(work, w);
+  work(0);
+  for (auto &th : pool)
+    th.join();
+}
+
+} // namespace
+
+CsrGraph::Index CsrGraph::indexOf(NodeId id) const {
+  if (ids_.empty())
+    return npos;
+  if (contiguous_) {
+    if (id < ids_.front() || id > ids_.back())
+      return npos;
+    return static_cast<Index>(static_cast<uint64_t>(id) -
+                              static_cast<uint64_t>(ids_.front()));
+  }
+  auto it = std::lower_bound(ids_.begin(), ids_.end(), id);
+  if (it == ids_.end() || *it != id)
+    return npos;
+  return static_cast<Index>(it - ids_.begin());
+}
+
+CsrGraph CsrGraph::build(const std::vector<NodeId> &nodes,
+                         const std::unordered_map<EdgeId, Edge> &edges,
+                         const AdjacencyIndex &outAdj,
+                         const AdjacencyIndex &inAdj) {
+  CsrGraph g;
+  g.ids_.assign(nodes.begin(), nodes.end());
+  std::sort(g.ids_.begin(), g.ids_.end());
+  g.contiguous_ = g.ids_.empty() ||
+                  static_cast<uint64_t>(g.ids_.back()) -
+                          static_cast<uint64_t>(g.ids_.front()) ==
+                      g.ids_.size() - 1;
+
+  // One direction: `adj` lists the edges, `far` picks their other end
+  auto fill = [&](const AdjacencyIndex &adj, NodeId Edge::*far,
+                  PageVector<uint64_t> &offsets, PageVector<Index> &targets,
+                  PageVector<EdgeId> &edgeIds) {
+    offsets.assign(1, 0);
+    offsets.reserve(g.ids_.size() + 1);
+    targets.reserve(edges.size());
+    edgeIds.reserve(edges.size());
+    for (NodeId id : g.ids_) {
+      auto it = adj.find(id);
+      if (it != adj.end()) {
+        for (EdgeId e : it->second) {
+          auto eit = edges.find(e);
+          if (eit == edges.end())
+            continue;
+          const Index j = g.indexOf(eit->second.*far);
+          if (j == npos)
+            continue;
+          targets.push_back(j);
+          edgeIds.push_back(e);
+        }
+      }
+      offsets.push_back(targets.size());
+    }
+  };
+  fill(outAdj, &Edge::to, g.outOffsets_, g.outTargets_, g.outEdges_);
+  fill(inAdj, &Edge::from, g.inOffsets_, g.inTargets_, g.inEdges_);
+  return g;
+}
+
+CsrGraph CsrGraph::build(const std::vector<NodeId> &nodes,
+                         const std::vector<Edge> &edges, size_t threads) {
+  CsrGraph g;
+  g.ids_.assign(nodes.begin(), nodes.end());
+  std::sort(g.ids_.begin(), g.ids_.end());
+  g.contiguous_ = g.ids_.empty() ||
+                  static_cast<uint64_t>(g.ids_.back()) -
+                          static_cast<uint64_t>(g.ids_.front()) ==
+                      g.ids_.size() - 1;
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  // Dense ends of every edge; npos for edges that are skipped
+  const size_t m = edges.size();
+  std::vector<Index> src(m), dst(m);
+  parallelChunks(m, threads, [&](size_t, size_t lo, size_t hi) {
+    for (size_t e = lo; e < hi; ++e) {
+      src[e] = g.indexOf(edges[e].from);
+      dst[e] = g.indexOf(edges[e].to);
+      if (src[e] == npos || dst[e] == npos)
+        src[e] = dst[e] = npos;
+    }
+  });
+
+  // One direction: edges grouped by `key` end, pointing at the `far` end,
+  // in the order of `edges` within a group
+  const size_t n = g.ids_.size();
+  auto fill = [&](const std::vector<Index> &key, const std::vector<Index> &far,
+                  PageVector<uint64_t> &offsets, PageVector<Index> &targets,
+                  PageVector<EdgeId> &edgeIds) {
+    offsets.assign(n + 1, 0);
+    for (Index k : key)
+      if (k != npos)
+        ++offsets[k + 1];
+    for (size_t i = 0; i < n; ++i)
+      offsets[i + 1] += offsets[i];
+    targets.resize(offsets[n]);
+    edgeIds.resize(offsets[n]);
+    std::vector<uint64_t> next(offsets.begin(), offsets.end() - 1);
+    for (size_t e = 0; e < m; ++e) {
+      if (key[e] == npos)
+        continue;
+      const uint64_t at = next[key[e]]++;
+      targets[at] = far[e];
+      edgeIds[at] = edges[e].id;
+    }
+  };
+  auto fillIn = [&] {
+    fill(dst, src, g.inOffsets_, g.inTargets_, g.inEdges_);
+  };
+  if (threads > 1 && m >= 2 * kGrain) {
+    std::thread in(fillIn);
+    fill(src, dst, g.outOffsets_, g.outTargets_, g.outEdges_);
+    in.join();
+  } else {
+    fill(src, dst, g.outOffsets_, g.outTargets_, g.outEdges_);
+    fillIn();
+  }
+  return g;
+}
+
+std::vector<CsrGraph::Index> CsrGraph::breadthFirst(Index source,
+                                                    size_t maxNodes,
+                                                    size_t threads,
+                                                    BfsStats *stats) const {
+  BfsStats local;
+  BfsStats &st = stats ? *stats : local;
+  st = BfsStats{};
+  std::vector<Index> order;
+  const size_t n = ids_.size();
+  if (source >= n)
+    return order;
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  std::vector<std::atomic<uint64_t>> visited((n + 63) / 64);
+  for (auto &w : visited)
+    w.store(0, std::memory_order_relaxed);
+  auto seen = [&](Index v) {
+    return (visited[v >> 6].load(std::memory_order_relaxed) >> (v & 63)) & 1;
+  };
+  // True for the one caller that marks `v` first
+  auto claim = [&](Index v) {
+    const uint64_t bit = uint64_t{1} << (v & 63);
+    return !(visited[v >> 6].fetch_or(bit, std::memory_order_relaxed) & bit);
+  };
+
+  claim(source);
+  order.push_back(source);
+  std::vector<std::vector<Index>> found(threads);
+  std::vector<uint64_t> foundEdges(threads);
+  std::vector<uint64_t> frontierBits;
+  uint64_t frontierEdges = outDegree(source);
+  uint64_t unexplored = edgeCount() - frontierEdges;
+  bool bottomUp = false;
+  size_t previous = 0; // size of the last frontier
+
+  // The frontier is order[begin, end)
+  for (size_t begin = 0;
+       begin < order.size() && (maxNodes == 0 || order.size() < maxNodes);) {
+    const size_t end = order.size();
+    if (!bottomUp)
+      bottomUp = end - begin > previous &&
+                 static_cast<double>(frontierEdges) >
+                     static_cast<double>(unexplored) / kAlpha;
+    else
+      bottomUp = static_cast<double>(end - begin) >=
+                 static_cast<double>(n) / kBeta;
+    for (size_t w = 0; w < threads; ++w) {
+      found[w].clear();
+      foundEdges[w] = 0;
+    }
+
+    if (bottomUp) {
+      ++st.bottomUpSteps;
+      frontierBits.assign(visited.size(), 0);
+      for (size_t k = begin; k < end; ++k)
+        frontierBits[order[k] >> 6] |= uint64_t{1} << (order[k] & 63);
+      parallelChunks(n, threads, [&](size_t w, size_t lo, size_t hi) {
+        for (size_t v = lo; v < hi; ++v) {
+          if (seen(static_cast<Index>(v)))
+            continue;
+          for (Index u : in(static_cast<Index>(v))) {
+            if ((frontierBits[u >> 6] >> (u & 63)) & 1) {
+              claim(static_cast<Index>(v));
+              found[w].push_back(static_cast<Index>(v));
+              foundEdges[w] += outDegree(static_cast<Index>(v));
+              break;
+            }
+          }
+        }
+      });
+    } else {
+      ++st.topDownSteps;
+      parallelChunks(end - begin, threads,
+                     [&](size_t w, size_t lo, size_t hi) {
+                       for (size_t k = begin + lo; k < begin + hi; ++k) {
+                         for (Index v : out(order[k])) {
+                           if (!seen(v) && claim(v)) {
+                             found[w].push_back(v);
+                             foundEdges[w] += outDegree(v);
+                           }
+                         }
+                       }
+                     });
+    }
+
+    ++st.levels;
+    frontierEdges = 0;
+    for (size_t w = 0; w < threads; ++w) {
+      order.insert(order.end(), found[w].begin(), found[w].end());
+      frontierEdges += foundEdges[w];
+    }
+    std::sort(order.begin() + static_cast<std::ptrdiff_t>(end), order.end());
+    unexplored -= frontierEdges;
+    previous = end - begin;
+    begin = end;
+  }
+
+  if (maxNodes > 0 && order.size() > maxNodes)
+    order.resize(maxNodes);
+  return order;
+}
+
+std::vector<CsrGraph::Index> CsrGraph::weakComponents(size_t threads) const {
+  const size_t n = ids_.size();
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  // parent[x] <= x throughout, so every root is its tree's minimum
+  std::vector<std::atomic<Index>> parent(n);
+  for (size_t i = 0; i < n; ++i)
+    parent[i].store(static_cast<Index>(i), std::memory_order_relaxed);
+  auto find = [&](Index x) {
+    for (;;) {
+      Index p = parent[x].load(std::memory_order_relaxed);
+      if (p == x)
+        return x;
+      const Index gp = parent[p].load(std::memory_order_relaxed);
+      if (gp != p) // path halving; losing the race is harmless
+        parent[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+      x = gp;
+    }
+  };
+  auto unite = [&](Index a, Index b) {
+    for (;;) {
+      a = find(a);
+      b = find(b);
+      if (a == b)
+        return;
+      if (a < b)
+        std::swap(a, b);
+      Index root = a; // fails if another worker linked `a` meanwhile
+      if (parent[a].compare_exchange_strong(root, b,
+                                            std::memory_order_relaxed))
+        return;
+    }
+  };
+  parallelChunks(n, threads, [&](size_t, size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; ++i)
+      for (Index j : out(static_cast<Index>(i)))
+        unite(static_cast<Index>(i), j);
+  });
+  std::vector<Index> label(n);
+  for (size_t i = 0; i < n; ++i)
+    label[i] = find(static_cast<Index>(i));
+  return label;
+}
+
+std::vector<double> CsrGraph::pageRank(double damping, size_t iterations,
+                                       double tolerance,
+                                       size_t threads) const {
+  const size_t n = ids_.size();
+  if (n == 0)
+    return {};
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  std::vector<double> rank(n, 1.0 / static_cast<double>(n));
+  std::vector<double> next(n), contrib(n);
+  // Per-chunk partial sums, added in chunk order
+  std::vector<double> dangling((n + kGrain - 1) / kGrain + 1);
+  std::vector<double> delta(dangling.size());
+  for (size_t round = 0; round < iterations; ++round) {
+    std::fill(dangling.begin(), dangling.end(), 0.0);
+    parallelChunks(n, threads, [&](size_t, size_t lo, size_t hi) {
+      double lost = 0;
+      for (size_t u = lo; u < hi; ++u) {
+        const size_t d = outDegree(static_cast<Index>(u));
+        contrib[u] = d ? rank[u] / static_cast<double>(d) : 0.0;
+        if (!d)
+          lost += rank[u];
+      }
+      dangling[lo / kGrain] = lost;
+    });
+    double lost = 0;
+    for (double x : dangling)
+      lost += x;
+    const double base =
+        (1.0 - damping + damping * lost) / static_cast<double>(n);
+
+    std::fill(delta.begin(), delta.end(), 0.0);
+    parallelChunks(n, threads, [&](size_t, size_t lo, size_t hi) {
+      double change = 0;
+      for (size_t v = lo; v < hi; ++v) {
+        double sum = 0;
+        for (Index u : in(static_cast<Index>(v)))
+          sum += contrib[u];
+        next[v] = base + damping * sum;
+        change += std::fabs(next[v] - rank[v]);
+      }
+      delta[lo / kGrain] = change;
+    });
+    rank.swap(next);
+    double change = 0;
+    for (double x : delta)
+      change += x;
+    if (change < tolerance)
+      break;
+  }
+  return rank;
+}
+
+uint64_t CsrGraph::triangleCount(size_t threads) const {
+  const size_t n = ids_.size();
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  // Orient each edge toward the higher (degree, index): hubs keep short
+  // lists, which bounds the intersection work
+  auto above = [&](Index a, Index b) {
+    const size_t da = outDegree(a) + inDegree(a);
+    const size_t db = outDegree(b) + inDegree(b);
+    return da != db ? da < db : a < b;
+  };
+
+  // higher[offset[v], offset[v] + count[v]): v's neighbors above it,
+  // sorted and distinct, in a region sized for all of v's edges
+  std::vector<uint64_t> offset(n + 1, 0);
+  for (size_t v = 0; v < n; ++v)
+    offset[v + 1] = offset[v] + outDegree(static_cast<Index>(v)) +
+                    inDegree(static_cast<Index>(v));
+  std::vector<Index> higher(offset[n]);
+  std::vector<size_t> count(n);
+  parallelChunks(n, threads, [&](size_t, size_t lo, size_t hi) {
+    for (size_t v = lo; v < hi; ++v) {
+      const Index i = static_cast<Index>(v);
+      Index *first = higher.data() + offset[v];
+      Index *last = first;
+      for (Neighbors nb : {out(i), in(i)})
+        for (Index u : nb)
+          if (u != i && above(i, u))
+            *last++ = u;
+      std::sort(first, last);
+      count[v] = static_cast<size_t>(std::unique(first, last) - first);
+    }
+  });
+
+  std::vector<uint64_t> found(threads, 0);
+  parallelChunks(n, threads, [&](size_t w, size_t lo, size_t hi) {
+    uint64_t local = 0;
+    for (size_t v = lo; v < hi; ++v) {
+      const Index *a = higher.data() + offset[v];
+      const Index *aEnd = a + count[v];
+      for (const Index *p = a; p != aEnd; ++p) {
+        // Merge v's list with u's: common entries close a triangle
+        const Index *x = a;
+        const Index *y = higher.data() + offset[*p];
+        const Index *yEnd = y + count[*p];
+        while (x != aEnd && y != yEnd) {
+          if (*x < *y) {
+            ++x;
+          } else if (*y < *x) {
+            ++y;
+          } else {
+            ++local;
+            ++x;
+            ++y;
+          }
+        }
+      }
+    }
+    found[w] += local;
+  });
+  uint64_t total = 0;
+  for (uint64_t c : found)
+    total += c;
+  return total;
+}
+
+std::vector<CsrGraph::Index> CsrGraph::strongComponents() const {
+  // Tarjan's algorithm with an explicit stack of (node, next out slot)
+  const size_t n = ids_.size();
+  std::vector<Index> label(n, npos), num(n, npos), low(n);
+  std::vector<bool> onStack(n);
+  std::vector<Index> stack;
+  std::vector<std::pair<Index, uint64_t>> calls;
+  Index counter = 0, components = 0;
+
+  auto enter = [&](Index v) {
+    num[v] = low[v] = counter++;
+    stack.push_back(v);
+    onStack[v] = true;
+    calls.emplace_back(v, outOffsets_[v]);
+  };
+  for (size_t root = 0; root < n; ++root) {
+    if (num[root] != npos)
+      continue;
+    enter(static_cast<Index>(root));
+    while (!calls.empty()) {
+      const Index v = calls.back().first;
+      if (calls.back().second < outOffsets_[v + 1]) {
+        const Index w = outTargets_[calls.back().second++];
+        if (num[w] == npos)
+          enter(w);
+        else if (onStack[w])
+          low[v] = std::min(low[v], num[w]);
+        continue;
+      }
+      calls.pop_back();
+      if (!calls.empty()) {
+        const Index parent = calls.back().first;
+        low[parent] = std::min(low[parent], low[v]);
+      }
+      if (low[v] != num[v])
+        continue;
+      Index w;
+      do {
+        w = stack.back();
+        stack.pop_back();
+        onStack[w] = false;
+        label[w] = components;
+      } while (w != v);
+      ++components;
+    }
+  }
+  return label;
+}
+
+size_t CsrGraph::memoryBytes() const {
+  return ids_.capacity() * sizeof(NodeId) +
+         (outOffsets_.capacity() + inOffsets_.capacity()) * sizeof(uint64_t) +
+         (outTargets_.capacity() + inTargets_.capacity()) * sizeof(Index) +
+         (outEdges_.capacity() + inEdges_.capacity()) * sizeof(EdgeId);
+}
+
+} // namespace kadedb
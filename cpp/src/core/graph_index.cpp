@@ -0,0 +1,168 @@
+#include "kadedb/graph/index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string_view>
+
+namespace kadedb {
+namespace {
+
+bool isNumber(ValueType t) {
+  return t == ValueType::Integer || t == ValueType::Float;
+}
+
+// Whether `a` and `b` can match each other at all
+bool comparable(const Value &a, const Value &b) {
+  if (a.type() == ValueType::Null || b.type() == ValueType::Null)
+    return false;
+  if (isNumber(a.type()) != isNumber(b.type()))
+    return false;
+  if (!isNumber(a.type()))
+    return a.type() == b.type();
+  auto nan = [](const Value &v) {
+    return v.type() == ValueType::Float && std::isnan(v.asFloat());
+  };
+  return !nan(a) && !nan(b);
+}
+
+// Smallest key of the same type as `k`
+InlineValue firstKeyOfType(const InlineValue &k) {
+  switch (k.type()) {
+  case ValueType::Float:
+    return InlineValue::floating(-std::numeric_limits<double>::infinity());
+  case ValueType::String:
+    return InlineValue::string("");
+  case ValueType::Boolean:
+    return InlineValue::boolean(false);
+  default:
+    return k;
+  }
+}
+
+void insertSorted(std::vector<PropertyIndex::Id> &ids, PropertyIndex::Id id) {
+  auto it = std::lower_bound(ids.begin(), ids.end(), id);
+  if (it == ids.end() || *it != id)
+    ids.insert(it, id);
+}
+
+// True when `ids` is left empty
+bool eraseSorted(std::vector<PropertyIndex::Id> &ids, PropertyIndex::Id id) {
+  auto it = std::lower_bound(ids.begin(), ids.end(), id);
+  if (it != ids.end() && *it == id)
+    ids.erase(it);
+  return ids.empty();
+}
+
+} // namespace
+
+bool propertyEquals(const Value *property, const Value &value) {
+  return property && comparable(*property, value) &&
+         property->compare(value) == 0;
+}
+
+bool propertyInRange(const Value *property, const Value *lower,
+                     const Value *upper) {
+  if (!property || !comparable(*property, *property))
+    return false;
+  if (lower &&
+      (!comparable(*property, *lower) || property->compare(*lower) < 0))
+    return false;
+  if (upper &&
+      (!comparable(*property, *upper) || property->compare(*upper) > 0))
+    return false;
+  return true;
+}
+
+size_t PropertyIndex::KeyHash::operator()(const InlineValue &v) const {
+  switch (v.type()) {
+  case ValueType::Float: {
+    const double d = v.asFloat();
+    return std::hash<double>()(d == 0.0 ? 0.0 : d); // -0.0 == 0.0
+  }
+  case ValueType::String:
+    return std::hash<std::string_view>()(
+        std::string_view(v.stringData(), v.stringSize()));
+  case ValueType::Boolean:
+    return v.asBool() ? 1u : 0u;
+  default:
+    return 0;
+  }
+}
+
+std::optional<InlineValue> PropertyIndex::key(const Value *v) {
+  if (!v || !comparable(*v, *v))
+    return std::nullopt;
+  if (isNumber(v->type()))
+    return InlineValue::floating(v->asFloat());
+  return InlineValue::fromValue(v);
+}
+
+void PropertyIndex::insert(const Value *value, Id id) {
+  auto k = key(value);
+  if (!k)
+    return;
+  if (type_ == IndexType::Hash)
+    insertSorted(hash_[*k], id);
+  else
+    insertSorted(ordered_[*k], id);
+}
+
+void PropertyIndex::erase(const Value *value, Id id) {
+  auto k = key(value);
+  if (!k)
+    return;
+  if (type_ == IndexType::Hash) {
+    auto it = hash_.find(*k);
+    if (it != hash_.end() && eraseSorted(it->second, id))
+      hash_.erase(it);
+  } else {
+    auto it = ordered_.find(*k);
+    if (it != ordered_.end() && eraseSorted(it->second, id))
+      ordered_.erase(it);
+  }
+}
+
+std::vector<PropertyIndex::Id>
+PropertyIndex::lookupEq(const Value &value) const {
+  auto k = key(&value);
+  if (!k)
+    return {};
+  if (type_ == IndexType::Hash) {
+    auto it = hash_.find(*k);
+    return it == hash_.end() ? std::vector<Id>{} : it->second;
+  }
+  auto it = ordered_.find(*k);
+  return it == ordered_.end() ? std::vector<Id>{} : it->second;
+}
+
+std::optional<std::vector<PropertyIndex::Id>>
+PropertyIndex::lookupRange(const Value *lower, const Value *upper) const {
+  if (type_ != IndexType::Ordered)
+    return std::nullopt;
+  std::optional<InlineValue> lo, hi;
+  if (lower && !(lo = key(lower)))
+    return std::vector<Id>{};
+  if (upper && !(hi = key(upper)))
+    return std::vector<Id>{};
+  if (lo && hi && lo->type() != hi->type())
+    return std::vector<Id>{};
+
+  // Keys of one type are contiguous in the map; bounds pick the type
+  const InlineValue *bound = lo ? &*lo : (hi ? &*hi : nullptr);
+  auto it = lo   ? ordered_.lower_bound(*lo)
+            : hi ? ordered_.lower_bound(firstKeyOfType(*hi))
+                 : ordered_.begin();
+  std::vector<Id> out;
+  for (; it != ordered_.end(); ++it) {
+    if (bound && it->first.type() != bound->type())
+      break;
+    if (hi && it->first.compare(*hi) > 0)
+      break;
+    out.insert(out.end(), it->second.begin(), it->second.end());
+  }
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+} // namespace kadedb
@@ -2,9 +2,15 @@
 
 #include <algorithm>
 #include <cctype>
-#include <deque>
+#include <charconv>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <queue>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -13,23 +19,46 @@
 namespace kadedb {
 namespace {
 
-static std::string toUpper(std::string s) {
-  for (auto &c : s)
-    c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
-  return s;
+// Words of a query, viewing the query text
+using Tokens = std::vector<std::string_view>;
+
+// Case-insensitive equality without copying either side
+static bool ieq(std::string_view a, std::string_view b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (std::toupper(static_cast<unsigned char>(a[i])) !=
+        std::toupper(static_cast<unsigned char>(b[i])))
+      return false;
+  }
+  return true;
 }
 
-static bool ieq(const std::string &a, const std::string &b) {
-  return toUpper(a) == toUpper(b);
+// A leading '+' is accepted, as std::stoll did
+static std::string_view withoutPlus(std::string_view s) {
+  return s.size() > 1 && s[0] == '+' && s[1] != '-' ? s.substr(1) : s;
 }
 
-static Result<int64_t> parseInt64(const std::string &s) {
-  try {
-    return Result<int64_t>::ok(std::stoll(s));
-  } catch (...) {
+static Result<int64_t> parseInt64(std::string_view s) {
+  const std::string_view digits = withoutPlus(s);
+  int64_t v = 0;
+  auto [end, ec] =
+      std::from_chars(digits.data(), digits.data() + digits.size(), v);
+  if (ec != std::errc() || end != digits.data() + digits.size())
     return Result<int64_t>::err(
-        Status::InvalidArgument("Invalid integer: " + s));
-  }
+        Status::InvalidArgument("Invalid integer: " + std::string(s)));
+  return Result<int64_t>::ok(v);
+}
+
+static Result<double> parseDouble(std::string_view s) {
+  const std::string_view digits = withoutPlus(s);
+  double d = 0;
+  auto [end, ec] =
+      std::from_chars(digits.data(), digits.data() + digits.size(), d);
+  if (ec == std::errc() && end == digits.data() + digits.size())
+    return Result<double>::ok(d);
+  return Result<double>::err(
+      Status::InvalidArgument("Invalid number: " + std::string(s)));
 }
 
 static Result<ResultSet> resultNodeList(const std::vector<NodeId> &nodes) {
@@ -53,6 +82,20 @@ static Result<ResultSet> resultPath(const std::vector<NodeId> &path) {
   return Result<ResultSet>::ok(std::move(rs));
 }
 
+static Result<ResultSet>
+resultWeightedPath(const std::vector<std::pair<NodeId, double>> &path) {
+  ResultSet rs({"step", "node_id", "distance"},
+               {ColumnType::Integer, ColumnType::Integer, ColumnType::Float});
+  for (size_t i = 0; i < path.size(); ++i) {
+    std::vector<std::unique_ptr<Value>> row;
+    row.push_back(ValueFactory::createInteger(static_cast<int64_t>(i)));
+    row.push_back(ValueFactory::createInteger(path[i].first));
+    row.push_back(ValueFactory::createFloat(path[i].second));
+    rs.addRow(ResultRow(std::move(row)));
+  }
+  return Result<ResultSet>::ok(std::move(rs));
+}
+
 static Result<ResultSet> resultBool(bool v) {
   ResultSet rs({"value"}, {ColumnType::Boolean});
   std::vector<std::unique_ptr<Value>> row;
@@ -61,63 +104,143 @@ static Result<ResultSet> resultBool(bool v) {
   return Result<ResultSet>::ok(std::move(rs));
 }
 
-static Result<std::vector<NodeId>>
-shortestPathUnweighted(const GraphStorage &gs, const std::string &graph,
-                       NodeId start, NodeId goal) {
-  if (start == goal)
-    return Result<std::vector<NodeId>>::ok(std::vector<NodeId>{start});
-
-  std::deque<NodeId> q;
-  std::unordered_set<NodeId> seen;
-  std::unordered_map<NodeId, NodeId> parent;
+static Result<double> edgeWeight(const Edge &e, const std::string &property) {
+  auto it = e.properties.find(property);
+  if (it == e.properties.end() || !it->second ||
+      (it->second->type() != ValueType::Integer &&
+       it->second->type() != ValueType::Float))
+    return Result<double>::err(Status::InvalidArgument(
+        "Edge " + std::to_string(static_cast<long long>(e.id)) +
+        " has no numeric " + property));
+  const double w = it->second->asFloat();
+  if (!(w >= 0.0))
+    return Result<double>::err(Status::InvalidArgument(
+        "Edge " + std::to_string(static_cast<long long>(e.id)) +
+        " has a negative " + property));
+  return Result<double>::ok(w);
+}
 
-  q.push_back(start);
-  seen.insert(start);
+// Dijkstra over out-edges weighted by their numeric `property`: the path
+// from start to goal with the distance to each step, empty when goal is
+// unreachable
+static Result<std::vector<std::pair<NodeId, double>>>
+shortestPathWeighted(const GraphStorage &gs, const std::string &graph,
+                     NodeId start, NodeId goal, const std::string &property) {
+  using R = Result<std::vector<std::pair<NodeId, double>>>;
+  using Entry = std::pair<double, NodeId>;
+  // Stale entries are skipped when popped instead of decreasing keys
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+  std::unordered_map<NodeId, std::pair<double, NodeId>> best; // dist, parent
+  std::unordered_set<NodeId> done;
+
+  best[start] = {0.0, start};
+  heap.emplace(0.0, start);
+  while (!heap.empty()) {
+    const Entry top = heap.top();
+    heap.pop();
+    const NodeId u = top.second;
+    if (!done.insert(u).second)
+      continue;
+    if (u == goal) {
+      std::vector<std::pair<NodeId, double>> path;
+      for (NodeId x = goal;; x = best[x].second) {
+        path.emplace_back(x, best[x].first);
+        if (x == start)
+          break;
+      }
+      std::reverse(path.begin(), path.end());
+      return R::ok(std::move(path));
+    }
 
-  while (!q.empty()) {
-    NodeId cur = q.front();
-    q.pop_front();
+    Status bad = Status::OK();
+    Status st = gs.forEachEdge(graph, u, [&](const Edge &e) {
+      if (!bad.ok())
+        return;
+      auto w = edgeWeight(e, property);
+      if (!w.hasValue()) {
+        bad = w.status();
+        return;
+      }
+      const double d = top.first + w.value();
+      auto it = best.find(e.to);
+      if (it == best.end() || d < it->second.first) {
+        best[e.to] = {d, u};
+        heap.emplace(d, e.to);
+      }
+    });
+    if (!st.ok())
+      return R::err(st);
+    if (!bad.ok())
+      return R::err(bad);
+  }
+  return R::ok(std::vector<std::pair<NodeId, double>>{});
+}
 
-    auto nbrRes = gs.neighborsOut(graph, cur);
-    if (!nbrRes.hasValue())
-      return Result<std::vector<NodeId>>::err(nbrRes.status());
+// Comma-separated items of the words toks[i..], up to the next of
+// `keywords`; `i` ends on that keyword
+static std::vector<std::string>
+commaList(const Tokens &toks, size_t &i,
+          std::initializer_list<std::string_view> keywords) {
+  std::string joined;
+  for (; i < toks.size(); ++i) {
+    if (std::any_of(keywords.begin(), keywords.end(),
+                    [&](std::string_view k) { return ieq(toks[i], k); }))
+      break;
+    joined += toks[i];
+  }
+  std::vector<std::string> items;
+  std::istringstream in(joined);
+  for (std::string item; std::getline(in, item, ',');)
+    items.push_back(item);
+  return items;
+}
 
-    for (NodeId nxt : nbrRes.value()) {
-      if (!seen.insert(nxt).second)
-        continue;
-      parent[nxt] = cur;
-      if (nxt == goal) {
-        std::vector<NodeId> path;
-        NodeId x = goal;
-        while (true) {
-          path.push_back(x);
-          auto it = parent.find(x);
-          if (it == parent.end())
-            break;
-          x = it->second;
-          if (x == start) {
-            path.push_back(x);
-            break;
-          }
-        }
-        std::reverse(path.begin(), path.end());
-        return Result<std::vector<NodeId>>::ok(std::move(path));
-      }
-      q.push_back(nxt);
+// [VIA <type>[, ...]] [LABEL <label>[, ...]] [DEPTH <n>] [IN], and
+// [LIMIT <n>] when `limit` is given, in any order from toks[i]
+static Status parseTraversalFilter(const Tokens &toks, size_t i,
+                                   GraphStorage::TraversalFilter &filter,
+                                   size_t *limit) {
+  while (i < toks.size()) {
+    const std::string_view word = toks[i++];
+    if (ieq(word, "IN")) {
+      filter.direction = GraphStorage::Direction::In;
+      continue;
+    }
+    const bool via = ieq(word, "VIA");
+    if (via || ieq(word, "LABEL")) {
+      auto items = commaList(toks, i, {"VIA", "LABEL", "DEPTH", "IN", "LIMIT"});
+      if (items.empty() || std::any_of(items.begin(), items.end(),
+                                       [](const std::string &item) {
+                                         return item.empty();
+                                       }))
+        return Status::InvalidArgument("Expected names after " +
+                                       std::string(word));
+      auto &names = via ? filter.edgeTypes : filter.nodeLabels;
+      names.insert(names.end(), items.begin(), items.end());
+      continue;
     }
+    const bool depth = ieq(word, "DEPTH");
+    if ((!depth && !(limit && ieq(word, "LIMIT"))) || i >= toks.size())
+      return Status::InvalidArgument("Unexpected token: " +
+                                     std::string(word));
+    auto n = parseInt64(toks[i++]);
+    if (!n.hasValue())
+      return n.status();
+    if (n.value() < 0)
+      return Status::InvalidArgument(std::string(word) + " must be >= 0");
+    (depth ? filter.maxDepth : *limit) = static_cast<size_t>(n.value());
   }
-
-  return Result<std::vector<NodeId>>::ok(std::vector<NodeId>{});
+  return Status::OK();
 }
 
 static Result<ResultSet> execTraverse(const GraphStorage &gs,
-                                      const std::vector<std::string> &toks) {
+                                      const Tokens &toks) {
   if (toks.size() < 5)
-    return Result<ResultSet>::err(
-        Status::InvalidArgument("TRAVERSE syntax: TRAVERSE <graph> FROM "
-                                "<start> (BFS|DFS) [LIMIT <n>]"));
+    return Result<ResultSet>::err(Status::InvalidArgument(
+        "TRAVERSE syntax: TRAVERSE <graph> FROM <start> (BFS|DFS) "
+        "[VIA <types>] [LABEL <labels>] [DEPTH <n>] [IN] [LIMIT <n>]"));
 
-  const std::string &graph = toks[1];
+  const std::string graph(toks[1]);
   if (!ieq(toks[2], "FROM"))
     return Result<ResultSet>::err(Status::InvalidArgument("Expected FROM"));
 
@@ -126,20 +249,27 @@ static Result<ResultSet> execTraverse(const GraphStorage &gs,
     return Result<ResultSet>::err(sres.status());
   NodeId start = sres.value();
 
-  std::string mode = toks[4];
+  const std::string_view mode = toks[4];
   size_t limit = 0;
-  if (toks.size() >= 7 && ieq(toks[5], "LIMIT")) {
-    auto lres = parseInt64(toks[6]);
-    if (!lres.hasValue())
-      return Result<ResultSet>::err(lres.status());
-    if (lres.value() < 0)
-      return Result<ResultSet>::err(
-          Status::InvalidArgument("LIMIT must be >= 0"));
-    limit = static_cast<size_t>(lres.value());
+  GraphStorage::TraversalFilter filter;
+  Status st = parseTraversalFilter(toks, 5, filter, &limit);
+  if (!st.ok())
+    return Result<ResultSet>::err(st);
+  // Filters are applied by the storage while it expands
+  const bool filtered = !filter.edgeTypes.empty() ||
+                        !filter.nodeLabels.empty() || filter.maxDepth > 0 ||
+                        filter.direction != GraphStorage::Direction::Out;
+
+  if (filtered && (ieq(mode, "BFS") || ieq(mode, "DFS"))) {
+    auto r = ieq(mode, "BFS") ? gs.filteredBfs(graph, start, filter, limit)
+                              : gs.filteredDfs(graph, start, filter, limit);
+    if (!r.hasValue())
+      return Result<ResultSet>::err(r.status());
+    return resultNodeList(r.value());
   }
-
   if (ieq(mode, "BFS")) {
-    auto r = gs.bfs(graph, start, limit);
+    // Rows by depth, ascending node id within a depth
+    auto r = gs.parallelBfs(graph, start, limit);
     if (!r.hasValue())
       return Result<ResultSet>::err(r.status());
     return resultNodeList(r.value());
@@ -154,13 +284,54 @@ static Result<ResultSet> execTraverse(const GraphStorage &gs,
   return Result<ResultSet>::err(Status::InvalidArgument("Expected BFS or DFS"));
 }
 
+static Result<ResultSet> execNeighborhood(const GraphStorage &gs,
+                                          const Tokens &toks) {
+  using R = Result<ResultSet>;
+  if (toks.size() < 4 || !ieq(toks[2], "FROM"))
+    return R::err(Status::InvalidArgument(
+        "NEIGHBORHOOD syntax: NEIGHBORHOOD <graph> FROM <id>[, <id>...] "
+        "[VIA <types>] [LABEL <labels>] [DEPTH <n>] [IN]"));
+  const std::string graph(toks[1]);
+  size_t i = 3;
+  std::vector<NodeId> starts;
+  for (const std::string &item :
+       commaList(toks, i, {"VIA", "LABEL", "DEPTH", "IN"})) {
+    auto id = parseInt64(item);
+    if (!id.hasValue())
+      return R::err(id.status());
+    starts.push_back(id.value());
+  }
+  if (starts.empty())
+    return R::err(Status::InvalidArgument("Expected start nodes after FROM"));
+  GraphStorage::TraversalFilter filter;
+  Status st = parseTraversalFilter(toks, i, filter, nullptr);
+  if (!st.ok())
+    return R::err(st);
+
+  auto r = gs.neighborhoods(graph, starts, filter);
+  if (!r.hasValue())
+    return R::err(r.status());
+  // A row per start and node reached, in the order of the starts
+  ResultSet rs({"start", "node_id"},
+               {ColumnType::Integer, ColumnType::Integer});
+  for (size_t s = 0; s < starts.size(); ++s) {
+    for (NodeId n : r.value()[s]) {
+      std::vector<std::unique_ptr<Value>> row;
+      row.push_back(ValueFactory::createInteger(starts[s]));
+      row.push_back(ValueFactory::createInteger(n));
+      rs.addRow(ResultRow(std::move(row)));
+    }
+  }
+  return R::ok(std::move(rs));
+}
+
 static Result<ResultSet> execConnected(const GraphStorage &gs,
-                                       const std::vector<std::string> &toks) {
+                                       const Tokens &toks) {
   if (toks.size() < 6)
     return Result<ResultSet>::err(Status::InvalidArgument(
         "CONNECTED syntax: CONNECTED <graph> FROM <a> TO <b>"));
 
-  const std::string &graph = toks[1];
+  const std::string graph(toks[1]);
   if (!ieq(toks[2], "FROM"))
     return Result<ResultSet>::err(Status::InvalidArgument("Expected FROM"));
   auto ares = parseInt64(toks[3]);
@@ -172,19 +343,20 @@ static Result<ResultSet> execConnected(const GraphStorage &gs,
   if (!bres.hasValue())
     return Result<ResultSet>::err(bres.status());
 
-  auto path = shortestPathUnweighted(gs, graph, ares.value(), bres.value());
-  if (!path.hasValue())
-    return Result<ResultSet>::err(path.status());
-  return resultBool(!path.value().empty());
+  auto r = gs.reachable(graph, ares.value(), bres.value());
+  if (!r.hasValue())
+    return Result<ResultSet>::err(r.status());
+  return resultBool(r.value());
 }
 
 static Result<ResultSet>
-execShortestPath(const GraphStorage &gs, const std::vector<std::string> &toks) {
+execShortestPath(const GraphStorage &gs, const Tokens &toks) {
   if (toks.size() < 6)
     return Result<ResultSet>::err(Status::InvalidArgument(
-        "SHORTEST_PATH syntax: SHORTEST_PATH <graph> FROM <a> TO <b>"));
+        "SHORTEST_PATH syntax: SHORTEST_PATH <graph> FROM <a> TO <b> "
+        "[WEIGHT <property>]"));
 
-  const std::string &graph = toks[1];
+  const std::string graph(toks[1]);
   if (!ieq(toks[2], "FROM"))
     return Result<ResultSet>::err(Status::InvalidArgument("Expected FROM"));
   auto ares = parseInt64(toks[3]);
@@ -196,100 +368,372 @@ execShortestPath(const GraphStorage &gs, const std::vector<std::string> &toks) {
   if (!bres.hasValue())
     return Result<ResultSet>::err(bres.status());
 
-  auto path = shortestPathUnweighted(gs, graph, ares.value(), bres.value());
+  if (toks.size() > 6) {
+    if (toks.size() != 8 || !ieq(toks[6], "WEIGHT"))
+      return Result<ResultSet>::err(
+          Status::InvalidArgument("Expected WEIGHT <property>"));
+    auto path = shortestPathWeighted(gs, graph, ares.value(), bres.value(),
+                                     std::string(toks[7]));
+    if (!path.hasValue())
+      return Result<ResultSet>::err(path.status());
+    return resultWeightedPath(path.value());
+  }
+
+  auto path = gs.shortestPath(graph, ares.value(), bres.value());
   if (!path.hasValue())
     return Result<ResultSet>::err(path.status());
   return resultPath(path.value());
 }
 
-static std::vector<std::string> tokenize(const std::string &q) {
-  std::istringstream iss(q);
-  std::vector<std::string> toks;
-  std::string t;
-  while (iss >> t)
-    toks.push_back(t);
-  return toks;
+static Result<ResultSet> execPageRank(const GraphStorage &gs,
+                                      const Tokens &toks) {
+  using R = Result<ResultSet>;
+  if (toks.size() < 2 || toks.size() % 2 != 0)
+    return R::err(Status::InvalidArgument(
+        "PAGERANK syntax: PAGERANK <graph> [ITERATIONS <n>] [DAMPING <d>] "
+        "[LIMIT <n>]"));
+  size_t iterations = 20;
+  double damping = 0.85;
+  size_t limit = 0;
+  for (size_t i = 2; i < toks.size(); i += 2) {
+    if (ieq(toks[i], "DAMPING")) {
+      auto d = parseDouble(toks[i + 1]);
+      if (!d.hasValue())
+        return R::err(d.status());
+      if (!(d.value() >= 0.0 && d.value() < 1.0))
+        return R::err(Status::InvalidArgument("DAMPING must be in [0, 1)"));
+      damping = d.value();
+      continue;
+    }
+    const bool iter = ieq(toks[i], "ITERATIONS");
+    if (!iter && !ieq(toks[i], "LIMIT"))
+      return R::err(Status::InvalidArgument("Unexpected token: " +
+                                            std::string(toks[i])));
+    auto n = parseInt64(toks[i + 1]);
+    if (!n.hasValue())
+      return R::err(n.status());
+    if (n.value() < 0)
+      return R::err(
+          Status::InvalidArgument(std::string(toks[i]) + " must be >= 0"));
+    (iter ? iterations : limit) = static_cast<size_t>(n.value());
+  }
+
+  auto snap = gs.snapshot(std::string(toks[1]));
+  if (!snap.hasValue())
+    return R::err(snap.status());
+  const CsrGraph &csr = *snap.value();
+  const std::vector<double> rank = csr.pageRank(damping, iterations);
+
+  // Highest rank first, ascending id among ties
+  std::vector<CsrGraph::Index> order(rank.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = static_cast<CsrGraph::Index>(i);
+  auto higher = [&](CsrGraph::Index a, CsrGraph::Index b) {
+    return rank[a] != rank[b] ? rank[a] > rank[b] : a < b;
+  };
+  if (limit > 0 && limit < order.size()) {
+    std::partial_sort(order.begin(),
+                      order.begin() + static_cast<std::ptrdiff_t>(limit),
+                      order.end(), higher);
+    order.resize(limit);
+  } else {
+    std::sort(order.begin(), order.end(), higher);
+  }
+
+  ResultSet rs({"node_id", "rank"}, {ColumnType::Integer, ColumnType::Float});
+  for (CsrGraph::Index i : order) {
+    std::vector<std::unique_ptr<Value>> row;
+    row.push_back(ValueFactory::createInteger(csr.id(i)));
+    row.push_back(ValueFactory::createFloat(rank[i]));
+    rs.addRow(ResultRow(std::move(row)));
+  }
+  return R::ok(std::move(rs));
 }
 
-static Result<ResultSet> execMatch(const GraphStorage &gs,
-                                   const std::vector<std::string> &toks) {
-  // MATCH <graph> (a)-[:TYPE]->(b) WHERE a = <id> RETURN b
-  if (toks.size() < 8)
-    return Result<ResultSet>::err(
-        Status::InvalidArgument("MATCH syntax: MATCH <graph> (a)-[:TYPE]->(b) "
-                                "WHERE a = <id> RETURN b"));
-
-  const std::string &graph = toks[1];
-
-  std::string pattern = toks[2];
-  std::string whereTok = toks[3];
-  if (!ieq(whereTok, "WHERE")) {
-    // allow pattern to be split by whitespace, join until WHERE
-    size_t i = 3;
-    while (i < toks.size() && !ieq(toks[i], "WHERE")) {
-      pattern += toks[i];
+static Result<ResultSet> execComponents(const GraphStorage &gs,
+                                        const Tokens &toks) {
+  using R = Result<ResultSet>;
+  if (toks.size() != 2)
+    return R::err(
+        Status::InvalidArgument("COMPONENTS syntax: COMPONENTS <graph>"));
+  auto snap = gs.snapshot(std::string(toks[1]));
+  if (!snap.hasValue())
+    return R::err(snap.status());
+  const CsrGraph &csr = *snap.value();
+  const auto label = csr.weakComponents();
+
+  // One row per node in id order; a component is named by its smallest id
+  ResultSet rs({"node_id", "component"},
+               {ColumnType::Integer, ColumnType::Integer});
+  for (size_t i = 0; i < label.size(); ++i) {
+    std::vector<std::unique_ptr<Value>> row;
+    row.push_back(ValueFactory::createInteger(
+        csr.id(static_cast<CsrGraph::Index>(i))));
+    row.push_back(ValueFactory::createInteger(csr.id(label[i])));
+    rs.addRow(ResultRow(std::move(row)));
+  }
+  return R::ok(std::move(rs));
+}
+
+static Result<ResultSet> execTriangles(const GraphStorage &gs,
+                                       const Tokens &toks) {
+  using R = Result<ResultSet>;
+  if (toks.size() != 2)
+    return R::err(
+        Status::InvalidArgument("TRIANGLES syntax: TRIANGLES <graph>"));
+  auto snap = gs.snapshot(std::string(toks[1]));
+  if (!snap.hasValue())
+    return R::err(snap.status());
+  ResultSet rs({"triangles"}, {ColumnType::Integer});
+  std::vector<std::unique_ptr<Value>> row;
+  row.push_back(ValueFactory::createInteger(
+      static_cast<int64_t>(snap.value()->triangleCount())));
+  rs.addRow(ResultRow(std::move(row)));
+  return R::ok(std::move(rs));
+}
+
+// Whitespace-separated words of `q`
+static Tokens tokenize(std::string_view q) {
+  Tokens toks;
+  const auto space = [](char c) {
+    return std::isspace(static_cast<unsigned char>(c)) != 0;
+  };
+  for (size_t i = 0; i < q.size();) {
+    while (i < q.size() && space(q[i]))
       ++i;
+    const size_t start = i;
+    while (i < q.size() && !space(q[i]))
+      ++i;
+    if (i > start)
+      toks.push_back(q.substr(start, i - start));
+  }
+  return toks;
+}
+
+// One side of a MATCH pattern: a variable and the sorted id sets it must
+// fall in (labels and WHERE conditions); no sets means any node
+struct MatchVar {
+  std::string name;
+  std::vector<std::vector<NodeId>> sets;
+
+  bool allows(NodeId n) const {
+    for (const auto &s : sets)
+      if (!std::binary_search(s.begin(), s.end(), n))
+        return false;
+    return true;
+  }
+
+  std::vector<NodeId> seeds() const {
+    std::vector<const std::vector<NodeId> *> bySize;
+    for (const auto &s : sets)
+      bySize.push_back(&s);
+    std::sort(bySize.begin(), bySize.end(),
+              [](auto *x, auto *y) { return x->size() < y->size(); });
+    std::vector<NodeId> out = *bySize.front();
+    for (size_t i = 1; i < bySize.size() && !out.empty(); ++i) {
+      std::vector<NodeId> next;
+      std::set_intersection(out.begin(), out.end(), bySize[i]->begin(),
+                            bySize[i]->end(), std::back_inserter(next));
+      out.swap(next);
     }
-    if (i >= toks.size())
-      return Result<ResultSet>::err(Status::InvalidArgument("Expected WHERE"));
+    return out;
+  }
+};
+
+// "(name[:Label...])" into `v`, registering each label's posting list
+static Status parseMatchNode(const GraphStorage &gs, const std::string &graph,
+                             const std::string &text, MatchVar &v) {
+  if (text.size() < 3 || text.front() != '(' || text.back() != ')')
+    return Status::InvalidArgument("Expected (var) in MATCH pattern: " + text);
+  std::string inner = text.substr(1, text.size() - 2);
+  size_t colon = inner.find(':');
+  v.name = inner.substr(0, colon);
+  if (v.name.empty())
+    return Status::InvalidArgument("Missing variable in MATCH pattern");
+  while (colon != std::string::npos) {
+    size_t next = inner.find(':', colon + 1);
+    std::string label = inner.substr(colon + 1, next - colon - 1);
+    if (label.empty())
+      return Status::InvalidArgument("Empty label in MATCH pattern");
+    auto ids = gs.nodesWithLabel(graph, label);
+    if (!ids.hasValue())
+      return ids.status();
+    v.sets.push_back(ids.takeValue());
+    colon = next;
   }
+  return Status::OK();
+}
 
-  size_t whereIdx = 0;
-  for (size_t i = 0; i < toks.size(); ++i) {
-    if (ieq(toks[i], "WHERE")) {
-      whereIdx = i;
-      break;
+// Integer, float, 'string', "string", true or false
+static Result<std::unique_ptr<Value>> parseLiteral(const std::string &s) {
+  using R = Result<std::unique_ptr<Value>>;
+  if (s.size() >= 2 && (s.front() == '\'' || s.front() == '"') &&
+      s.back() == s.front())
+    return R::ok(ValueFactory::createString(s.substr(1, s.size() - 2)));
+  if (ieq(s, "true") || ieq(s, "false"))
+    return R::ok(ValueFactory::createBoolean(ieq(s, "true")));
+  if (s.find_first_of(".eE") != std::string::npos) {
+    try {
+      size_t used = 0;
+      double d = std::stod(s, &used);
+      if (used == s.size())
+        return R::ok(ValueFactory::createFloat(d));
+    } catch (...) {
     }
+    return R::err(Status::InvalidArgument("Invalid literal: " + s));
   }
-  if (whereIdx == 0 || whereIdx + 4 >= toks.size())
-    return Result<ResultSet>::err(
-        Status::InvalidArgument("Invalid WHERE clause"));
-
-  // Expect: WHERE a = <id> RETURN b
-  if (!ieq(toks[whereIdx + 1], "a"))
-    return Result<ResultSet>::err(
-        Status::InvalidArgument("Expected 'a' in WHERE"));
-  if (toks[whereIdx + 2] != "=")
-    return Result<ResultSet>::err(
-        Status::InvalidArgument("Expected '=' in WHERE"));
-  auto idres = parseInt64(toks[whereIdx + 3]);
-  if (!idres.hasValue())
-    return Result<ResultSet>::err(idres.status());
-  NodeId start = idres.value();
-
-  size_t retIdx = whereIdx + 4;
-  if (retIdx + 1 >= toks.size() || !ieq(toks[retIdx], "RETURN"))
-    return Result<ResultSet>::err(Status::InvalidArgument("Expected RETURN"));
-  if (!ieq(toks[retIdx + 1], "b"))
-    return Result<ResultSet>::err(
-        Status::InvalidArgument("Only RETURN b is supported"));
-
-  // Parse relationship type out of pattern if present: -[:TYPE]->
-  std::string relType;
-  auto pos = pattern.find("[:");
-  if (pos != std::string::npos) {
-    auto end = pattern.find("]", pos);
-    if (end != std::string::npos && end > pos + 2) {
-      relType = pattern.substr(pos + 2, end - (pos + 2));
+  auto i = parseInt64(s);
+  if (!i.hasValue())
+    return R::err(Status::InvalidArgument("Invalid literal: " + s));
+  return R::ok(ValueFactory::createInteger(i.value()));
+}
+
+static Result<ResultSet> execMatch(const GraphStorage &gs,
+                                   const Tokens &toks) {
+  // MATCH <graph> (a[:Label])-[[:TYPE]]->(b[:Label])
+  //   [WHERE <cond> [AND <cond>]...] RETURN b | a | a, b
+  // where <cond> is `<var> = <id>` or `<var>.<prop> = <literal>`
+  using R = Result<ResultSet>;
+  const auto syntax = [] {
+    return R::err(Status::InvalidArgument(
+        "MATCH syntax: MATCH <graph> (a[:Label])-[:TYPE]->(b[:Label]) "
+        "[WHERE <cond> [AND <cond>]...] RETURN <vars>"));
+  };
+  if (toks.size() < 5)
+    return syntax();
+  const std::string graph(toks[1]);
+
+  size_t i = 2;
+  std::string pattern;
+  while (i < toks.size() && !ieq(toks[i], "WHERE") && !ieq(toks[i], "RETURN"))
+    pattern += toks[i++];
+
+  // Split the pattern into (a), -[...]-> and (b)
+  const size_t open = pattern.find(")-[");
+  const size_t close = pattern.find("]->(");
+  if (open == std::string::npos || close == std::string::npos || close < open)
+    return syntax();
+  std::string rel = pattern.substr(open + 3, close - open - 3);
+  if (!rel.empty() && rel.front() != ':')
+    return syntax();
+  const std::string relType = rel.empty() ? "" : rel.substr(1);
+
+  MatchVar a, b;
+  Status st = parseMatchNode(gs, graph, pattern.substr(0, open + 1), a);
+  if (st.ok())
+    st = parseMatchNode(gs, graph, pattern.substr(close + 3), b);
+  if (!st.ok())
+    return R::err(st);
+  if (a.name == b.name)
+    return R::err(
+        Status::InvalidArgument("MATCH variables must differ: " + a.name));
+  auto var = [&](std::string_view name) -> MatchVar * {
+    return name == a.name ? &a : name == b.name ? &b : nullptr;
+  };
+
+  if (i < toks.size() && ieq(toks[i], "WHERE")) {
+    ++i;
+    while (true) {
+      if (i + 2 >= toks.size() || toks[i + 1] != "=")
+        return R::err(Status::InvalidArgument("Invalid WHERE clause"));
+      const std::string_view lhs = toks[i];
+      // Quoted literals may span several tokens
+      std::string literal(toks[i + 2]);
+      i += 3;
+      const char q = literal.front();
+      if ((q == '\'' || q == '"') &&
+          (literal.size() < 2 || literal.back() != q)) {
+        while (i < toks.size() && (literal.size() < 2 || literal.back() != q))
+          literal.append(" ").append(toks[i++]);
+      }
+
+      const size_t dot = lhs.find('.');
+      MatchVar *v = var(lhs.substr(0, dot));
+      if (!v)
+        return R::err(Status::InvalidArgument("Unknown variable: " +
+                                              std::string(lhs)));
+      if (dot == std::string_view::npos) {
+        auto id = parseInt64(literal);
+        if (!id.hasValue())
+          return R::err(id.status());
+        v->sets.push_back({id.value()});
+      } else {
+        auto value = parseLiteral(literal);
+        if (!value.hasValue())
+          return R::err(value.status());
+        auto ids = gs.findNodes(graph, std::string(lhs.substr(dot + 1)),
+                                *value.value());
+        if (!ids.hasValue())
+          return R::err(ids.status());
+        v->sets.push_back(ids.takeValue());
+      }
+
+      if (i < toks.size() && ieq(toks[i], "AND")) {
+        ++i;
+        continue;
+      }
+      break;
     }
   }
 
-  auto eidsRes = gs.edgeIdsOut(graph, start);
-  if (!eidsRes.hasValue())
-    return Result<ResultSet>::err(eidsRes.status());
-
-  std::vector<NodeId> out;
-  for (EdgeId eid : eidsRes.value()) {
-    auto er = gs.getEdge(graph, eid);
-    if (!er.hasValue())
-      return Result<ResultSet>::err(er.status());
-    const Edge &e = er.value();
-    if (!relType.empty() && !ieq(e.type, relType))
-      continue;
-    out.push_back(e.to);
+  if (i + 1 >= toks.size() || !ieq(toks[i], "RETURN"))
+    return R::err(Status::InvalidArgument("Expected RETURN"));
+  std::string joined;
+  for (++i; i < toks.size(); ++i)
+    joined += toks[i];
+  std::vector<const MatchVar *> columns;
+  std::istringstream names(joined);
+  for (std::string name; std::getline(names, name, ',');) {
+    const MatchVar *v = var(name);
+    if (!v)
+      return R::err(Status::InvalidArgument("Unknown RETURN variable: " +
+                                            name));
+    columns.push_back(v);
+  }
+  if (columns.empty())
+    return R::err(Status::InvalidArgument("Expected RETURN variables"));
+
+  // Seed from the constrained side, preferring a; walk edges toward the
+  // other side and filter it by its own sets
+  const bool forward = !a.sets.empty();
+  if (!forward && b.sets.empty())
+    return R::err(Status::InvalidArgument(
+        "MATCH needs a label or WHERE condition to start from"));
+  const MatchVar &seedVar = forward ? a : b;
+  const MatchVar &otherVar = forward ? b : a;
+
+  std::vector<std::pair<NodeId, NodeId>> matches; // (a, b)
+  for (NodeId seed : seedVar.seeds()) {
+    Status st = gs.forEachEdge(
+        graph, seed,
+        [&](const Edge &e) {
+          if (!relType.empty() && !ieq(e.type, relType))
+            return;
+          const NodeId other = forward ? e.to : e.from;
+          if (otherVar.allows(other))
+            matches.emplace_back(forward ? seed : other,
+                                 forward ? other : seed);
+        },
+        forward ? GraphStorage::Direction::Out : GraphStorage::Direction::In);
+    if (!st.ok())
+      return R::err(st);
   }
 
-  return resultNodeList(out);
+  std::vector<std::string> columnNames;
+  if (columns.size() == 1)
+    columnNames.push_back("node_id");
+  else
+    for (const MatchVar *v : columns)
+      columnNames.push_back(v->name);
+  ResultSet rs(columnNames,
+               std::vector<ColumnType>(columns.size(), ColumnType::Integer));
+  for (const auto &[na, nb] : matches) {
+    std::vector<std::unique_ptr<Value>> row;
+    for (const MatchVar *v : columns)
+      row.push_back(ValueFactory::createInteger(v == &a ? na : nb));
+    rs.addRow(ResultRow(std::move(row)));
+  }
+  return R::ok(std::move(rs));
 }
 
 } // namespace
@@ -303,15 +747,24 @@ Result<ResultSet> executeGraphQuery(const GraphStorage &storage,
 
   if (ieq(toks[0], "TRAVERSE"))
     return execTraverse(storage, toks);
+  if (ieq(toks[0], "NEIGHBORHOOD"))
+    return execNeighborhood(storage, toks);
   if (ieq(toks[0], "MATCH"))
     return execMatch(storage, toks);
   if (ieq(toks[0], "SHORTEST_PATH"))
     return execShortestPath(storage, toks);
   if (ieq(toks[0], "CONNECTED"))
     return execConnected(storage, toks);
+  if (ieq(toks[0], "PAGERANK"))
+    return execPageRank(storage, toks);
+  if (ieq(toks[0], "COMPONENTS"))
+    return execComponents(storage, toks);
+  if (ieq(toks[0], "TRIANGLES"))
+    return execTriangles(storage, toks);
 
   return Result<ResultSet>::err(
-      Status::InvalidArgument("Unknown graph query verb: " + toks[0]));
+      Status::InvalidArgument("Unknown graph query verb: " +
+                              std::string(toks[0])));
 }
 
 } // namespace kadedb
@@ -1,7 +1,11 @@
 #include "kadedb/graph/storage.h"
+#include "kadedb/memory.h"
+#include "kadedb/metrics.h"
+#include "kadedb/thread_pool.h"
 
 #include <algorithm>
-#include <deque>
+#include <cctype>
+#include <limits>
 #include <unordered_set>
 
 namespace kadedb {
@@ -21,28 +25,1017 @@ static Result<Edge> edgeNotFound(EdgeId id) {
       "Unknown edge: " + std::to_string(static_cast<long long>(id))));
 }
 
-static void eraseEdgeId(AdjacencyIndex &idx, NodeId n, EdgeId e) {
-  auto it = idx.find(n);
-  if (it == idx.end())
-    return;
-  auto &vec = it->second;
-  vec.erase(std::remove(vec.begin(), vec.end(), e), vec.end());
-  if (vec.empty())
-    idx.erase(it);
+static bool testBit(const std::vector<uint64_t> &bits, CsrGraph::Index i) {
+  return (i >> 6) < bits.size() && ((bits[i >> 6] >> (i & 63)) & 1u);
+}
+
+static void setBit(std::vector<uint64_t> &bits, CsrGraph::Index i) {
+  if ((i >> 6) < bits.size())
+    bits[i >> 6] |= uint64_t{1} << (i & 63);
+}
+
+static void clearBit(std::vector<uint64_t> &bits, CsrGraph::Index i) {
+  if ((i >> 6) < bits.size())
+    bits[i >> 6] &= ~(uint64_t{1} << (i & 63));
+}
+
+// Whether `type` is among `types`, ignoring case as MATCH does
+static bool typeListed(const std::vector<std::string> &types,
+                       const std::string &type) {
+  for (const std::string &t : types) {
+    if (t.size() == type.size() &&
+        std::equal(t.begin(), t.end(), type.begin(), [](char a, char b) {
+          return std::toupper(static_cast<unsigned char>(a)) ==
+                 std::toupper(static_cast<unsigned char>(b));
+        }))
+      return true;
+  }
+  return false;
+}
+
+static size_t labelBytes(const std::unordered_set<std::string> &labels) {
+  size_t bytes = 0;
+  for (const auto &l : labels)
+    bytes += memory::kMapEntryBytes + sizeof(l) + l.size();
+  return bytes;
+}
+
+// Estimated bytes of a stored node or edge; an edge also pays for its
+// adjacency list entries and slots
+static size_t nodeBytes(const Node &n) {
+  return memory::kMapEntryBytes + sizeof(std::pair<const NodeId, Node>) +
+         labelBytes(n.labels) + memory::documentBytes(n.properties);
+}
+
+static size_t edgeBytes(const Edge &e) {
+  return 2 * memory::kMapEntryBytes + sizeof(std::pair<const EdgeId, Edge>) +
+         e.type.size() + labelBytes(e.labels) +
+         memory::documentBytes(e.properties) + 2 * sizeof(EdgeId) +
+         sizeof(std::pair<const EdgeId, std::pair<size_t, size_t>>);
+}
+
+// Edges per morsel when putEdges() checks a batch in parallel
+constexpr size_t kEdgeMorsel = 16 * 1024;
+// Start nodes per morsel when neighborhoods() spreads them over threads
+constexpr size_t kStartMorsel = 16;
+// Interned type of a snapshot slot whose edge was erased since the build
+constexpr uint32_t kNoType = std::numeric_limits<uint32_t>::max();
+
+static Status indexesUnsupported() {
+  return Status::FailedPrecondition(
+      "Label and property lookups are not supported by this graph storage");
+}
+
+static const Value *propertyOf(const Document &d, const std::string &name) {
+  auto it = d.find(name);
+  return it == d.end() ? nullptr : it->second.get();
+}
+
+static void insertSortedId(std::vector<int64_t> &ids, int64_t id) {
+  auto it = std::lower_bound(ids.begin(), ids.end(), id);
+  if (it == ids.end() || *it != id)
+    ids.insert(it, id);
+}
+
+static void eraseSortedId(std::vector<int64_t> &ids, int64_t id) {
+  auto it = std::lower_bound(ids.begin(), ids.end(), id);
+  if (it != ids.end() && *it == id)
+    ids.erase(it);
+}
+
+// Ids of `items` (nodes or edges) whose `property` satisfies `match`,
+// ascending: the candidates of an index on it if `lookup` answers,
+// otherwise a scan
+template <typename Items, typename Lookup, typename Match>
+static std::vector<int64_t>
+findMatching(const Items &items,
+             const std::unordered_map<std::string, PropertyIndex> &indexes,
+             const std::string &property, const Lookup &lookup,
+             const Match &match) {
+  std::vector<int64_t> out;
+  std::optional<std::vector<int64_t>> candidates;
+  if (auto ix = indexes.find(property); ix != indexes.end())
+    candidates = lookup(ix->second);
+  if (candidates) {
+    for (int64_t id : *candidates) {
+      auto it = items.find(id);
+      if (it != items.end() &&
+          match(propertyOf(it->second.properties, property)))
+        out.push_back(id);
+    }
+    return out;
+  }
+  for (const auto &kv : items)
+    if (match(propertyOf(kv.second.properties, property)))
+      out.push_back(kv.first);
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+// filteredBfs() or filteredDfs() through forEachEdge(), reading each
+// node's labels at most once through withNode()
+static Result<std::vector<NodeId>>
+walkFiltered(const GraphStorage &gs, const std::string &graph, NodeId start,
+             const GraphStorage::TraversalFilter &filter, size_t maxNodes,
+             bool depthFirst) {
+  using R = Result<std::vector<NodeId>>;
+  auto node = gs.getNode(graph, start);
+  if (!node.hasValue())
+    return R::err(node.status());
+
+  const bool out = filter.direction == GraphStorage::Direction::Out;
+  std::unordered_map<NodeId, bool> labelled;
+  std::vector<NodeId> far;
+  // The far ends of the admitted edges of `id` that may be entered
+  auto hops = [&](NodeId id, std::vector<NodeId> &next) -> Status {
+    far.clear();
+    Status st = gs.forEachEdge(
+        graph, id,
+        [&](const Edge &e) {
+          if (filter.edgeTypes.empty() || typeListed(filter.edgeTypes, e.type))
+            far.push_back(out ? e.to : e.from);
+        },
+        filter.direction);
+    if (!st.ok())
+      return st;
+    next.clear();
+    for (NodeId n : far) {
+      if (!filter.nodeLabels.empty()) {
+        auto ins = labelled.emplace(n, false);
+        bool &enters = ins.first->second;
+        if (ins.second) {
+          st = gs.withNode(graph, n, [&](const Node &nd) {
+            for (const std::string &label : filter.nodeLabels)
+              enters = enters || nd.labels.count(label) != 0;
+          });
+          if (!st.ok())
+            return st;
+        }
+        if (!enters)
+          continue;
+      }
+      next.push_back(n);
+    }
+    return Status::OK();
+  };
+
+  std::vector<NodeId> order, next;
+  std::unordered_set<NodeId> seen;
+  if (depthFirst) {
+    std::vector<std::pair<NodeId, size_t>> stack{{start, 0}};
+    while (!stack.empty()) {
+      const auto [id, depth] = stack.back();
+      stack.pop_back();
+      if (!seen.insert(id).second)
+        continue;
+      order.push_back(id);
+      if (maxNodes > 0 && order.size() >= maxNodes)
+        break;
+      if (filter.maxDepth > 0 && depth >= filter.maxDepth)
+        continue;
+      Status st = hops(id, next);
+      if (!st.ok())
+        return R::err(st);
+      for (auto rit = next.rbegin(); rit != next.rend(); ++rit)
+        if (!seen.count(*rit))
+          stack.emplace_back(*rit, depth + 1);
+    }
+    return R::ok(std::move(order));
+  }
+
+  order.push_back(start);
+  seen.insert(start);
+  for (size_t begin = 0, depth = 0;
+       begin < order.size() && (maxNodes == 0 || order.size() < maxNodes) &&
+       (filter.maxDepth == 0 || depth < filter.maxDepth);
+       ++depth) {
+    const size_t end = order.size();
+    for (size_t k = begin; k < end; ++k) {
+      Status st = hops(order[k], next);
+      if (!st.ok())
+        return R::err(st);
+      for (NodeId n : next)
+        if (seen.insert(n).second)
+          order.push_back(n);
+    }
+    std::sort(order.begin() + static_cast<std::ptrdiff_t>(end), order.end());
+    begin = end;
+  }
+  if (maxNodes > 0 && order.size() > maxNodes)
+    order.resize(maxNodes);
+  return R::ok(std::move(order));
 }
 
 } // namespace
 
+Status GraphStorage::putNodes(const std::string &graph,
+                              const std::vector<Node> &nodes) {
+  for (const Node &n : nodes) {
+    Status st = putNode(graph, n);
+    if (!st.ok())
+      return st;
+  }
+  return Status::OK();
+}
+
+Status GraphStorage::putEdges(const std::string &graph,
+                              const std::vector<Edge> &edges) {
+  for (const Edge &e : edges) {
+    Status st = putEdge(graph, e);
+    if (!st.ok())
+      return st;
+  }
+  return Status::OK();
+}
+
+Status
+GraphStorage::withNode(const std::string &graph, NodeId id,
+                       const std::function<void(const Node &)> &fn) const {
+  auto node = getNode(graph, id);
+  if (!node.hasValue())
+    return node.status();
+  fn(node.value());
+  return Status::OK();
+}
+
+Status
+GraphStorage::withEdge(const std::string &graph, EdgeId id,
+                       const std::function<void(const Edge &)> &fn) const {
+  auto edge = getEdge(graph, id);
+  if (!edge.hasValue())
+    return edge.status();
+  fn(edge.value());
+  return Status::OK();
+}
+
+Status GraphStorage::forEachNeighbor(const std::string &graph, NodeId id,
+                                     const std::function<void(NodeId)> &fn,
+                                     Direction dir) const {
+  auto nb = dir == Direction::Out ? neighborsOut(graph, id)
+                                  : neighborsIn(graph, id);
+  if (!nb.hasValue())
+    return nb.status();
+  for (NodeId n : nb.value())
+    fn(n);
+  return Status::OK();
+}
+
+Status GraphStorage::forEachEdge(const std::string &graph, NodeId id,
+                                 const std::function<void(const Edge &)> &fn,
+                                 Direction dir) const {
+  auto eids = dir == Direction::Out ? edgeIdsOut(graph, id)
+                                    : edgeIdsIn(graph, id);
+  if (!eids.hasValue())
+    return eids.status();
+  for (EdgeId e : eids.value()) {
+    Status st = withEdge(graph, e, fn);
+    if (!st.ok())
+      return st;
+  }
+  return Status::OK();
+}
+
+Result<std::vector<NodeId>> GraphStorage::parallelBfs(const std::string &graph,
+                                                     NodeId start,
+                                                     size_t maxNodes,
+                                                     size_t) const {
+  using R = Result<std::vector<NodeId>>;
+  auto node = getNode(graph, start);
+  if (!node.hasValue())
+    return R::err(node.status());
+
+  std::vector<NodeId> order{start};
+  std::unordered_set<NodeId> seen{start};
+  for (size_t begin = 0;
+       begin < order.size() && (maxNodes == 0 || order.size() < maxNodes);) {
+    const size_t end = order.size();
+    for (size_t k = begin; k < end; ++k) {
+      Status st = forEachNeighbor(graph, order[k], [&](NodeId n) {
+        if (seen.insert(n).second)
+          order.push_back(n);
+      });
+      if (!st.ok())
+        return R::err(st);
+    }
+    std::sort(order.begin() + static_cast<std::ptrdiff_t>(end), order.end());
+    begin = end;
+  }
+  if (maxNodes > 0 && order.size() > maxNodes)
+    order.resize(maxNodes);
+  return R::ok(std::move(order));
+}
+
+Result<std::vector<NodeId>>
+GraphStorage::filteredBfs(const std::string &graph, NodeId start,
+                          const TraversalFilter &filter,
+                          size_t maxNodes) const {
+  return walkFiltered(*this, graph, start, filter, maxNodes, false);
+}
+
+Result<std::vector<NodeId>>
+GraphStorage::filteredDfs(const std::string &graph, NodeId start,
+                          const TraversalFilter &filter,
+                          size_t maxNodes) const {
+  return walkFiltered(*this, graph, start, filter, maxNodes, true);
+}
+
+Result<std::vector<std::vector<NodeId>>>
+GraphStorage::neighborhoods(const std::string &graph,
+                            const std::vector<NodeId> &starts,
+                            const TraversalFilter &filter, size_t) const {
+  using R = Result<std::vector<std::vector<NodeId>>>;
+  std::vector<std::vector<NodeId>> out;
+  out.reserve(starts.size());
+  for (NodeId start : starts) {
+    auto reached = filteredBfs(graph, start, filter);
+    if (!reached.hasValue())
+      return R::err(reached.status());
+    std::vector<NodeId> nodes = reached.takeValue();
+    nodes.erase(nodes.begin());
+    std::sort(nodes.begin(), nodes.end());
+    out.push_back(std::move(nodes));
+  }
+  return R::ok(std::move(out));
+}
+
+Result<std::vector<NodeId>>
+GraphStorage::shortestPath(const std::string &graph, NodeId from,
+                           NodeId to) const {
+  using R = Result<std::vector<NodeId>>;
+  if (from == to)
+    return R::ok(std::vector<NodeId>{from});
+
+  // One search per end: node -> (neighbor toward that end, depth)
+  struct Side {
+    std::unordered_map<NodeId, std::pair<NodeId, size_t>> seen;
+    std::vector<NodeId> frontier;
+    bool forward;
+  };
+  Side fwd{{{from, {from, 0}}}, {from}, true};
+  Side bwd{{{to, {to, 0}}}, {to}, false};
+  std::vector<NodeId> next;
+
+  while (!fwd.frontier.empty() && !bwd.frontier.empty()) {
+    Side &a = fwd.frontier.size() <= bwd.frontier.size() ? fwd : bwd;
+    const Side &b = &a == &fwd ? bwd : fwd;
+    // Every meeting found in this depth is a candidate; keep the shortest
+    NodeId meet = 0;
+    size_t best = 0;
+    next.clear();
+    for (NodeId u : a.frontier) {
+      const size_t depth = a.seen[u].second + 1;
+      Status st = forEachNeighbor(
+          graph, u,
+          [&](NodeId x) {
+            if (!a.seen.emplace(x, std::make_pair(u, depth)).second)
+              return;
+            next.push_back(x);
+            auto hit = b.seen.find(x);
+            if (hit != b.seen.end() &&
+                (best == 0 || depth + hit->second.second < best)) {
+              meet = x;
+              best = depth + hit->second.second;
+            }
+          },
+          a.forward ? Direction::Out : Direction::In);
+      if (!st.ok())
+        return R::err(st);
+    }
+    a.frontier.swap(next);
+    if (best == 0)
+      continue;
+
+    std::vector<NodeId> path;
+    for (NodeId x = meet; x != from; x = fwd.seen[x].first)
+      path.push_back(x);
+    path.push_back(from);
+    std::reverse(path.begin(), path.end());
+    for (NodeId x = meet; x != to;) {
+      x = bwd.seen[x].first;
+      path.push_back(x);
+    }
+    return R::ok(std::move(path));
+  }
+  return R::ok(std::vector<NodeId>{});
+}
+
+Result<bool> GraphStorage::reachable(const std::string &graph, NodeId from,
+                                     NodeId to) const {
+  auto path = shortestPath(graph, from, to);
+  if (!path.hasValue())
+    return Result<bool>::err(path.status());
+  return Result<bool>::ok(!path.value().empty());
+}
+
+Result<std::shared_ptr<const CsrGraph>>
+GraphStorage::snapshot(const std::string &) const {
+  return Result<std::shared_ptr<const CsrGraph>>::err(
+      Status::FailedPrecondition(
+          "CSR snapshots are not supported by this graph storage"));
+}
+
+Result<GraphContents> GraphStorage::contents(const std::string &graph) const {
+  auto snap = snapshot(graph);
+  if (!snap.hasValue())
+    return Result<GraphContents>::err(snap.status());
+  const CsrGraph &csr = *snap.value();
+  GraphContents out;
+  std::unordered_set<NodeId> present;
+  std::vector<EdgeId> edgeIds;
+  for (CsrGraph::Index i = 0; i < csr.nodeCount(); ++i) {
+    auto node = getNode(graph, csr.id(i));
+    if (!node.hasValue()) {
+      if (node.status().code() == StatusCode::NotFound)
+        continue;
+      return Result<GraphContents>::err(node.status());
+    }
+    present.insert(csr.id(i));
+    out.nodes.push_back(node.value());
+    edgeIds.insert(edgeIds.end(), csr.outEdges(i),
+                   csr.outEdges(i) + csr.outDegree(i));
+  }
+  std::sort(edgeIds.begin(), edgeIds.end());
+  for (EdgeId id : edgeIds) {
+    auto edge = getEdge(graph, id);
+    if (!edge.hasValue()) {
+      if (edge.status().code() == StatusCode::NotFound)
+        continue;
+      return Result<GraphContents>::err(edge.status());
+    }
+    if (present.count(edge.value().from) && present.count(edge.value().to))
+      out.edges.push_back(edge.value());
+  }
+  return Result<GraphContents>::ok(std::move(out));
+}
+
+Result<std::vector<NodeId>>
+GraphStorage::nodesWithLabel(const std::string &, const std::string &) const {
+  return Result<std::vector<NodeId>>::err(indexesUnsupported());
+}
+
+Status GraphStorage::createNodeIndex(const std::string &, const std::string &,
+                                     IndexType) {
+  return indexesUnsupported();
+}
+
+Status GraphStorage::dropNodeIndex(const std::string &, const std::string &) {
+  return indexesUnsupported();
+}
+
+Status GraphStorage::createEdgeIndex(const std::string &, const std::string &,
+                                     IndexType) {
+  return indexesUnsupported();
+}
+
+Status GraphStorage::dropEdgeIndex(const std::string &, const std::string &) {
+  return indexesUnsupported();
+}
+
+Result<std::vector<NodeId>> GraphStorage::findNodes(const std::string &,
+                                                    const std::string &,
+                                                    const Value &) const {
+  return Result<std::vector<NodeId>>::err(indexesUnsupported());
+}
+
+Result<std::vector<NodeId>>
+GraphStorage::findNodesInRange(const std::string &, const std::string &,
+                               const Value *, const Value *) const {
+  return Result<std::vector<NodeId>>::err(indexesUnsupported());
+}
+
+Result<std::vector<EdgeId>> GraphStorage::findEdges(const std::string &,
+                                                    const std::string &,
+                                                    const Value &) const {
+  return Result<std::vector<EdgeId>>::err(indexesUnsupported());
+}
+
+Result<std::vector<EdgeId>>
+GraphStorage::findEdgesInRange(const std::string &, const std::string &,
+                               const Value *, const Value *) const {
+  return Result<std::vector<EdgeId>>::err(indexesUnsupported());
+}
+
+struct InMemoryGraphStorage::EdgeTypes {
+  // Type name by id
+  std::vector<std::string> names;
+  std::vector<uint32_t> out;
+  std::vector<uint32_t> in;
+};
+
+class InMemoryGraphStorage::OverlayView {
+public:
+  using Index = CsrGraph::Index;
+
+  OverlayView(const GraphData &g, std::shared_ptr<const Snapshot> snap)
+      : g_(g), snap_(std::move(snap)), csr_(*snap_->csr) {}
+
+  // Dense index of `id` in the snapshot, or npos for nodes added since
+  Index indexOf(NodeId id) const { return csr_.indexOf(id); }
+
+  // fn(NodeId, Index) for the far ends of the out-edges of node `id` (at
+  // index `i`), in adjacency order: from the snapshot unless they changed
+  template <typename Fn> void forEachOut(NodeId id, Index i, Fn &&fn) const {
+    if (i != CsrGraph::npos && !testBit(snap_->dirtyOut, i)) {
+      for (Index j : csr_.out(i))
+        fn(csr_.id(j), j);
+      return;
+    }
+    fromIndex(g_.outAdj, id, &Edge::to, fn);
+  }
+  template <typename Fn> void forEachIn(NodeId id, Index i, Fn &&fn) const {
+    if (i != CsrGraph::npos && !testBit(snap_->dirtyIn, i)) {
+      for (Index j : csr_.in(i))
+        fn(csr_.id(j), j);
+      return;
+    }
+    fromIndex(g_.inAdj, id, &Edge::from, fn);
+  }
+  // forEachOut() (`out`) or forEachIn() over the edges of a type listed in
+  // `types`: snapshot edges by their id in `interned`, flagged in
+  // `admitted`, and the edges of changed nodes by name
+  template <typename Fn>
+  void forEachTyped(NodeId id, Index i, bool out, const EdgeTypes &interned,
+                    const std::vector<char> &admitted,
+                    const std::vector<std::string> &types, Fn &&fn) const {
+    if (i != CsrGraph::npos &&
+        !testBit(out ? snap_->dirtyOut : snap_->dirtyIn, i)) {
+      const CsrGraph::Neighbors nb = out ? csr_.out(i) : csr_.in(i);
+      const uint32_t *type = out ? interned.out.data() + csr_.outOffset(i)
+                                 : interned.in.data() + csr_.inOffset(i);
+      for (size_t k = 0; k < nb.size(); ++k)
+        if (type[k] < admitted.size() && admitted[type[k]])
+          fn(csr_.id(nb.first[k]), nb.first[k]);
+      return;
+    }
+    const AdjacencyIndex &adj = out ? g_.outAdj : g_.inAdj;
+    auto it = adj.find(id);
+    if (it == adj.end())
+      return;
+    for (EdgeId e : it->second) {
+      auto eit = g_.edges.find(e);
+      if (eit == g_.edges.end() || !typeListed(types, eit->second.type))
+        continue;
+      const NodeId other = out ? eit->second.to : eit->second.from;
+      fn(other, csr_.indexOf(other));
+    }
+  }
+
+  // Nodes reached by a traversal: a bit per snapshot node, a set for the
+  // nodes added since
+  class Visited {
+  public:
+    explicit Visited(size_t nodes) : bits_((nodes + 63) / 64) {}
+    // True the first time a node is inserted
+    bool insert(NodeId id, Index i) {
+      if (i == CsrGraph::npos)
+        return added_.insert(id).second;
+      if (testBit(bits_, i))
+        return false;
+      setBit(bits_, i);
+      return true;
+    }
+    bool contains(NodeId id, Index i) const {
+      return i == CsrGraph::npos ? added_.count(id) != 0 : testBit(bits_, i);
+    }
+    void erase(NodeId id, Index i) {
+      if (i == CsrGraph::npos)
+        added_.erase(id);
+      else
+        clearBit(bits_, i);
+    }
+
+  private:
+    std::vector<uint64_t> bits_;
+    std::unordered_set<NodeId> added_;
+  };
+  Visited visited() const { return Visited(csr_.nodeCount()); }
+
+private:
+  template <typename Fn>
+  void fromIndex(const AdjacencyIndex &adj, NodeId id, NodeId Edge::*far,
+                 Fn &fn) const {
+    auto it = adj.find(id);
+    if (it == adj.end())
+      return;
+    for (EdgeId e : it->second) {
+      auto eit = g_.edges.find(e);
+      if (eit == g_.edges.end())
+        continue;
+      const NodeId other = eit->second.*far;
+      fn(other, csr_.indexOf(other));
+    }
+  }
+
+  const GraphData &g_;
+  std::shared_ptr<const Snapshot> snap_;
+  const CsrGraph &csr_;
+};
+
+class InMemoryGraphStorage::FilteredWalk {
+public:
+  using Index = CsrGraph::Index;
+  using Visited = OverlayView::Visited;
+
+  FilteredWalk(const GraphData &g, const std::shared_ptr<const Snapshot> &snap,
+               const TraversalFilter &filter)
+      : view_(g, snap), filter_(filter), labelled_(view_.visited()) {
+    if (!filter.edgeTypes.empty()) {
+      types_ = edgeTypesOf(g, *snap);
+      for (const std::string &name : types_->names)
+        admitted_.push_back(typeListed(filter.edgeTypes, name));
+    }
+    for (const std::string &label : filter.nodeLabels) {
+      auto it = g.labels.find(label);
+      if (it == g.labels.end())
+        continue;
+      for (NodeId id : it->second)
+        labelled_.insert(id, view_.indexOf(id));
+    }
+  }
+
+  Index indexOf(NodeId id) const { return view_.indexOf(id); }
+  Visited visited() const { return view_.visited(); }
+
+  // The nodes of filteredBfs() or filteredDfs() from `start`. Every node
+  // reached is inserted into `seen`, which must not hold any of them yet.
+  std::vector<NodeId> breadthFirst(NodeId start, size_t maxNodes,
+                                   Visited &seen) const {
+    std::vector<std::pair<NodeId, Index>> level{{start, indexOf(start)}};
+    std::vector<std::pair<NodeId, Index>> next;
+    std::vector<NodeId> order{start};
+    seen.insert(start, level.front().second);
+    for (size_t depth = 0; !level.empty() &&
+                           (maxNodes == 0 || order.size() < maxNodes) &&
+                           (filter_.maxDepth == 0 || depth < filter_.maxDepth);
+         ++depth) {
+      next.clear();
+      for (const auto &[id, i] : level)
+        hops(id, i, [&](NodeId n, Index j) {
+          if (seen.insert(n, j))
+            next.emplace_back(n, j);
+        });
+      std::sort(next.begin(), next.end());
+      for (const auto &hop : next)
+        order.push_back(hop.first);
+      level.swap(next);
+    }
+    if (maxNodes > 0 && order.size() > maxNodes)
+      order.resize(maxNodes);
+    return order;
+  }
+
+  std::vector<NodeId> depthFirst(NodeId start, size_t maxNodes,
+                                 Visited &seen) const {
+    struct Entry {
+      NodeId id;
+      Index i;
+      size_t depth;
+    };
+    std::vector<Entry> stack{{start, indexOf(start), 0}};
+    std::vector<std::pair<NodeId, Index>> next;
+    std::vector<NodeId> order;
+    while (!stack.empty()) {
+      const Entry cur = stack.back();
+      stack.pop_back();
+      if (!seen.insert(cur.id, cur.i))
+        continue;
+      order.push_back(cur.id);
+      if (maxNodes > 0 && order.size() >= maxNodes)
+        break;
+      if (filter_.maxDepth > 0 && cur.depth >= filter_.maxDepth)
+        continue;
+      next.clear();
+      hops(cur.id, cur.i, [&](NodeId n, Index j) { next.emplace_back(n, j); });
+      for (auto rit = next.rbegin(); rit != next.rend(); ++rit)
+        if (!seen.contains(rit->first, rit->second))
+          stack.push_back({rit->first, rit->second, cur.depth + 1});
+    }
+    return order;
+  }
+
+private:
+  // fn(NodeId, Index) for the far ends of the admitted edges of `id` that
+  // may be entered
+  template <typename Fn> void hops(NodeId id, Index i, Fn &&fn) const {
+    auto enter = [&](NodeId n, Index j) {
+      if (filter_.nodeLabels.empty() || labelled_.contains(n, j))
+        fn(n, j);
+    };
+    const bool out = filter_.direction == Direction::Out;
+    if (types_)
+      view_.forEachTyped(id, i, out, *types_, admitted_, filter_.edgeTypes,
+                         enter);
+    else if (out)
+      view_.forEachOut(id, i, enter);
+    else
+      view_.forEachIn(id, i, enter);
+  }
+
+  OverlayView view_;
+  const TraversalFilter &filter_;
+  // Nodes carrying one of the filter's labels
+  Visited labelled_;
+  // Interned types, and whether the filter lists each; null for any type
+  std::shared_ptr<const EdgeTypes> types_;
+  std::vector<char> admitted_;
+};
+
+std::shared_ptr<const InMemoryGraphStorage::Snapshot>
+InMemoryGraphStorage::snapshotOf(const GraphData &g, bool exact) const {
+  std::lock_guard lk(g.snapshotMtx);
+  if (const Snapshot *cur = g.snap.get()) {
+    const size_t limit =
+        std::max(snapshotRebuildWrites_, cur->csr->edgeCount() / 8);
+    if (cur->writes == 0 || (!exact && cur->writes < limit))
+      return g.snap;
+  }
+  auto s = std::make_shared<Snapshot>();
+  if (g.nodes.size() < CsrGraph::npos) {
+    std::vector<NodeId> ids;
+    ids.reserve(g.nodes.size());
+    for (const auto &kv : g.nodes)
+      ids.push_back(kv.first);
+    s->csr = std::make_shared<const CsrGraph>(
+        CsrGraph::build(ids, g.edges, g.outAdj, g.inAdj));
+  } else {
+    // Too many nodes for 32-bit indices: every node reads the index
+    s->csr = std::make_shared<const CsrGraph>();
+  }
+  s->dirtyOut.assign((s->csr->nodeCount() + 63) / 64, 0);
+  s->dirtyIn.assign(s->dirtyOut.size(), 0);
+  g.snap = s;
+  return s;
+}
+
+std::shared_ptr<const InMemoryGraphStorage::Components>
+InMemoryGraphStorage::componentsOf(const GraphData &g, const Snapshot &snap) {
+  std::lock_guard lk(g.snapshotMtx);
+  if (!snap.components) {
+    auto c = std::make_shared<Components>();
+    c->weak = snap.csr->weakComponents();
+    c->strong = snap.csr->strongComponents();
+    snap.components = std::move(c);
+  }
+  return snap.components;
+}
+
+std::shared_ptr<const InMemoryGraphStorage::EdgeTypes>
+InMemoryGraphStorage::edgeTypesOf(const GraphData &g, const Snapshot &snap) {
+  std::lock_guard lk(g.snapshotMtx);
+  if (!snap.edgeTypes) {
+    const CsrGraph &csr = *snap.csr;
+    auto types = std::make_shared<EdgeTypes>();
+    std::unordered_map<std::string, uint32_t> ids;
+    // Edges erased since the build only sit on changed nodes, which are
+    // read from the adjacency index instead
+    auto intern = [&](EdgeId e) {
+      auto it = g.edges.find(e);
+      if (it == g.edges.end())
+        return kNoType;
+      auto ins = ids.emplace(it->second.type,
+                             static_cast<uint32_t>(types->names.size()));
+      if (ins.second)
+        types->names.push_back(it->second.type);
+      return ins.first->second;
+    };
+    types->out.reserve(csr.edgeCount());
+    types->in.reserve(csr.edgeCount());
+    for (CsrGraph::Index i = 0; i < csr.nodeCount(); ++i) {
+      for (size_t k = 0; k < csr.outDegree(i); ++k)
+        types->out.push_back(intern(csr.outEdges(i)[k]));
+      for (size_t k = 0; k < csr.inDegree(i); ++k)
+        types->in.push_back(intern(csr.inEdges(i)[k]));
+    }
+    snap.edgeTypes = std::move(types);
+  }
+  return snap.edgeTypes;
+}
+
+void InMemoryGraphStorage::linkEdge(GraphData &g, const Edge &e) {
+  EdgeList &out = g.outAdj[e.from];
+  EdgeList &in = g.inAdj[e.to];
+  g.slots[e.id] = {out.size(), in.size()};
+  out.push_back(e.id);
+  in.push_back(e.id);
+}
+
+void InMemoryGraphStorage::unlinkEdge(GraphData &g, const Edge &e) {
+  auto sit = g.slots.find(e.id);
+  if (sit == g.slots.end())
+    return;
+  const GraphData::EdgeSlots at = sit->second;
+  g.slots.erase(sit);
+  // Swap-and-pop: the list's last edge takes over the slot
+  auto remove = [&](AdjacencyIndex &adj, NodeId n, size_t slot,
+                    size_t GraphData::EdgeSlots::*which) {
+    auto it = adj.find(n);
+    if (it == adj.end() || slot >= it->second.size())
+      return;
+    EdgeList &list = it->second;
+    const EdgeId last = list.back();
+    list[slot] = last;
+    list.pop_back();
+    if (last != e.id)
+      g.slots.at(last).*which = slot;
+    if (list.empty())
+      adj.erase(it);
+  };
+  remove(g.outAdj, e.from, at.out, &GraphData::EdgeSlots::out);
+  remove(g.inAdj, e.to, at.in, &GraphData::EdgeSlots::in);
+}
+
+void InMemoryGraphStorage::storeNode(GraphData &g, const Node &node) {
+  auto [it, added] = g.nodes.try_emplace(node.id, node);
+  g.memory.add(nodeBytes(node));
+  if (added) {
+    noteNodeWrite(g, node.id);
+    reindexNode(g, nullptr, &node);
+  } else {
+    g.memory.sub(nodeBytes(it->second));
+    reindexNode(g, &it->second, &node);
+    it->second = node;
+  }
+}
+
+void InMemoryGraphStorage::storeEdge(GraphData &g, const Edge &edge) {
+  g.memory.add(edgeBytes(edge));
+  // If updating an existing edge, remove adjacency references first
+  auto eit = g.edges.find(edge.id);
+  if (eit != g.edges.end()) {
+    const Edge &old = eit->second;
+    g.memory.sub(edgeBytes(old));
+    unlinkEdge(g, old);
+    noteEdgeWrite(g, old.from, old.to);
+    reindexEdge(g, &old, &edge);
+    eit->second = edge;
+  } else {
+    reindexEdge(g, nullptr, &edge);
+    g.edges.emplace(edge.id, edge);
+  }
+  linkEdge(g, edge);
+  noteEdgeWrite(g, edge.from, edge.to);
+}
+
+void InMemoryGraphStorage::loadEdges(GraphData &g,
+                                     const std::vector<Edge> &edges) {
+  g.edges.reserve(edges.size());
+  bool repeats = false;
+  for (const Edge &e : edges)
+    repeats |= !g.edges.insert_or_assign(e.id, e).second;
+  // A repeated id keeps its last copy, at that copy's place in the lists
+  std::vector<Edge> unique;
+  if (repeats) {
+    std::unordered_set<EdgeId> later;
+    for (size_t i = edges.size(); i-- > 0;)
+      if (later.insert(edges[i].id).second)
+        unique.push_back(edges[i]);
+    std::reverse(unique.begin(), unique.end());
+  }
+  const std::vector<Edge> &batch = repeats ? unique : edges;
+
+  std::vector<NodeId> ids;
+  ids.reserve(g.nodes.size());
+  for (const auto &kv : g.nodes)
+    ids.push_back(kv.first);
+  auto snap = std::make_shared<Snapshot>();
+  snap->csr = std::make_shared<const CsrGraph>(CsrGraph::build(ids, batch));
+  const CsrGraph &csr = *snap->csr;
+  snap->dirtyOut.assign((csr.nodeCount() + 63) / 64, 0);
+  snap->dirtyIn.assign(snap->dirtyOut.size(), 0);
+
+  // The snapshot's edge runs become the adjacency lists, a direction per
+  // thread
+  ThreadPool::shared().parallelFor(
+      2, 1, 2, [&](size_t dir, size_t, size_t) {
+        AdjacencyIndex &adj = dir == 0 ? g.outAdj : g.inAdj;
+        for (CsrGraph::Index i = 0; i < csr.nodeCount(); ++i) {
+          const size_t n = dir == 0 ? csr.outDegree(i) : csr.inDegree(i);
+          const EdgeId *first = dir == 0 ? csr.outEdges(i) : csr.inEdges(i);
+          if (n)
+            adj.emplace(csr.id(i), EdgeList(first, first + n));
+        }
+      });
+  g.slots.reserve(batch.size());
+  for (CsrGraph::Index i = 0; i < csr.nodeCount(); ++i)
+    for (size_t k = 0; k < csr.outDegree(i); ++k)
+      g.slots.emplace(csr.outEdges(i)[k], GraphData::EdgeSlots{k, 0});
+  for (CsrGraph::Index i = 0; i < csr.nodeCount(); ++i)
+    for (size_t k = 0; k < csr.inDegree(i); ++k)
+      g.slots.at(csr.inEdges(i)[k]).in = k;
+
+  size_t bytes = 0;
+  for (const Edge &e : batch) {
+    bytes += edgeBytes(e);
+    reindexEdge(g, nullptr, &e);
+  }
+  g.memory.add(bytes);
+  g.snap = std::move(snap);
+}
+
+void InMemoryGraphStorage::reindexNode(GraphData &g, const Node *before,
+                                       const Node *after) {
+  const NodeId id = after ? after->id : before->id;
+  if (before) {
+    for (const auto &label : before->labels) {
+      if (after && after->labels.count(label))
+        continue;
+      auto it = g.labels.find(label);
+      if (it == g.labels.end())
+        continue;
+      eraseSortedId(it->second, id);
+      if (it->second.empty())
+        g.labels.erase(it);
+    }
+  }
+  if (after) {
+    for (const auto &label : after->labels)
+      if (!before || !before->labels.count(label))
+        insertSortedId(g.labels[label], id);
+  }
+  for (auto &kv : g.nodeIndexes) {
+    kv.second.erase(before ? propertyOf(before->properties, kv.first)
+                           : nullptr,
+                    id);
+    kv.second.insert(after ? propertyOf(after->properties, kv.first) : nullptr,
+                     id);
+  }
+}
+
+void InMemoryGraphStorage::reindexEdge(GraphData &g, const Edge *before,
+                                       const Edge *after) {
+  const EdgeId id = after ? after->id : before->id;
+  for (auto &kv : g.edgeIndexes) {
+    kv.second.erase(before ? propertyOf(before->properties, kv.first)
+                           : nullptr,
+                    id);
+    kv.second.insert(after ? propertyOf(after->properties, kv.first) : nullptr,
+                     id);
+  }
+}
+
+void InMemoryGraphStorage::noteEdgeWrite(GraphData &g, NodeId from,
+                                         NodeId to) {
+  Snapshot *s = g.snap.get();
+  if (!s)
+    return;
+  ++s->writes;
+  setBit(s->dirtyOut, s->csr->indexOf(from));
+  setBit(s->dirtyIn, s->csr->indexOf(to));
+}
+
+void InMemoryGraphStorage::noteNodeWrite(GraphData &g, NodeId id) {
+  noteEdgeWrite(g, id, id);
+}
+
+Result<std::shared_ptr<const CsrGraph>>
+InMemoryGraphStorage::snapshot(const std::string &graph) const {
+  using R = Result<std::shared_ptr<const CsrGraph>>;
+  auto gd = findGraph(graph);
+  if (!gd)
+    return R::err(graphNotFound(graph));
+  std::shared_lock lk(gd->mtx);
+  return R::ok(snapshotOf(*gd, /*exact=*/true)->csr);
+}
+
+Result<GraphContents>
+InMemoryGraphStorage::contents(const std::string &graph) const {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return Result<GraphContents>::err(graphNotFound(graph));
+  GraphContents out;
+  {
+    std::shared_lock lk(gd->mtx);
+    out.nodes.reserve(gd->nodes.size());
+    for (const auto &kv : gd->nodes)
+      out.nodes.push_back(kv.second);
+    out.edges.reserve(gd->edges.size());
+    for (const auto &kv : gd->edges)
+      out.edges.push_back(kv.second);
+  }
+  std::sort(out.nodes.begin(), out.nodes.end(),
+            [](const Node &a, const Node &b) { return a.id < b.id; });
+  std::sort(out.edges.begin(), out.edges.end(),
+            [](const Edge &a, const Edge &b) { return a.id < b.id; });
+  return Result<GraphContents>::ok(std::move(out));
+}
+
+std::shared_ptr<InMemoryGraphStorage::GraphData>
+InMemoryGraphStorage::findGraph(const std::string &graph) const {
+  std::shared_lock lk(mtx_);
+  auto it = graphs_.find(graph);
+  return it == graphs_.end() ? nullptr : it->second;
+}
+
 Status InMemoryGraphStorage::createGraph(const std::string &graph) {
-  std::lock_guard<std::mutex> lk(mtx_);
+  std::lock_guard lk(mtx_);
   if (graphs_.find(graph) != graphs_.end())
     return Status::AlreadyExists("Graph already exists: " + graph);
-  graphs_.emplace(graph, GraphData{});
+  graphs_.emplace(graph, std::make_shared<GraphData>());
   return Status::OK();
 }
 
 Status InMemoryGraphStorage::dropGraph(const std::string &graph) {
-  std::lock_guard<std::mutex> lk(mtx_);
+  std::lock_guard lk(mtx_);
   auto it = graphs_.find(graph);
   if (it == graphs_.end())
     return graphNotFound(graph);
@@ -50,8 +1043,25 @@ Status InMemoryGraphStorage::dropGraph(const std::string &graph) {
   return Status::OK();
 }
 
+Result<size_t>
+InMemoryGraphStorage::memoryUsage(const std::string &graph) const {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return Result<size_t>::err(graphNotFound(graph));
+  return Result<size_t>::ok(gd->memory.bytes());
+}
+
+Status InMemoryGraphStorage::setMemoryBudget(const std::string &graph,
+                                             size_t bytes) {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return graphNotFound(graph);
+  gd->memory.setBudget(bytes);
+  return Status::OK();
+}
+
 std::vector<std::string> InMemoryGraphStorage::listGraphs() const {
-  std::lock_guard<std::mutex> lk(mtx_);
+  std::shared_lock lk(mtx_);
   std::vector<std::string> out;
   out.reserve(graphs_.size());
   for (const auto &kv : graphs_)
@@ -61,131 +1071,237 @@ std::vector<std::string> InMemoryGraphStorage::listGraphs() const {
 
 Result<Node> InMemoryGraphStorage::getNode(const std::string &graph,
                                            NodeId id) const {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto git = graphs_.find(graph);
-  if (git == graphs_.end())
-    return Result<Node>::err(graphNotFound(graph));
-  const auto &g = git->second;
-  auto it = g.nodes.find(id);
-  if (it == g.nodes.end())
-    return nodeNotFound(id);
-  return Result<Node>::ok(it->second);
+  auto run = [&]() -> Result<Node> {
+    auto gd = findGraph(graph);
+    if (!gd)
+      return Result<Node>::err(graphNotFound(graph));
+    metrics::TimedSharedLock lk(gd->mtx);
+    const auto &g = *gd;
+    auto it = g.nodes.find(id);
+    if (it == g.nodes.end())
+      return nodeNotFound(id);
+    return Result<Node>::ok(it->second);
+  };
+  return metrics::measure(metrics::Operation::GraphRead, run);
 }
 
 Status InMemoryGraphStorage::putNode(const std::string &graph,
                                      const Node &node) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto git = graphs_.find(graph);
-  if (git == graphs_.end())
-    return graphNotFound(graph);
-  auto &g = git->second;
-  g.nodes[node.id] = node;
-  return Status::OK();
+  auto run = [&]() -> Status {
+    auto gd = findGraph(graph);
+    if (!gd)
+      return graphNotFound(graph);
+    metrics::TimedLock lk(gd->mtx);
+    auto &g = *gd;
+    const size_t bytes = nodeBytes(node);
+    auto old = g.nodes.find(node.id);
+    const size_t replaced = old != g.nodes.end() ? nodeBytes(old->second) : 0;
+    if (bytes > replaced && !g.memory.fits(bytes - replaced))
+      return memory::budgetExceeded("graph", graph, g.memory,
+                                    bytes - replaced);
+    storeNode(g, node);
+    return Status::OK();
+  };
+  return metrics::measure(metrics::Operation::GraphWrite, run);
+}
+
+Status InMemoryGraphStorage::putNodes(const std::string &graph,
+                                      const std::vector<Node> &nodes) {
+  auto run = [&]() -> Status {
+    auto gd = findGraph(graph);
+    if (!gd)
+      return graphNotFound(graph);
+    metrics::TimedLock lk(gd->mtx);
+    auto &g = *gd;
+    // Replaced bytes count nodes stored before the batch only, so a batch
+    // repeating an id is checked against slightly more than it adds
+    size_t bytes = 0, replaced = 0;
+    for (const Node &n : nodes) {
+      bytes += nodeBytes(n);
+      if (auto it = g.nodes.find(n.id); it != g.nodes.end())
+        replaced += nodeBytes(it->second);
+    }
+    if (bytes > replaced && !g.memory.fits(bytes - replaced))
+      return memory::budgetExceeded("graph", graph, g.memory,
+                                    bytes - replaced);
+    g.nodes.reserve(g.nodes.size() + nodes.size());
+    for (const Node &n : nodes)
+      storeNode(g, n);
+    return Status::OK();
+  };
+  return metrics::measure(metrics::Operation::GraphWrite, run);
 }
 
 Status InMemoryGraphStorage::eraseNode(const std::string &graph, NodeId id) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto git = graphs_.find(graph);
-  if (git == graphs_.end())
-    return graphNotFound(graph);
-  auto &g = git->second;
+  auto run = [&]() -> Status {
+    auto gd = findGraph(graph);
+    if (!gd)
+      return graphNotFound(graph);
+    metrics::TimedLock lk(gd->mtx);
+    auto &g = *gd;
 
-  auto nit = g.nodes.find(id);
-  if (nit == g.nodes.end())
-    return Status::NotFound("Unknown node: " +
-                            std::to_string(static_cast<long long>(id)));
+    auto nit = g.nodes.find(id);
+    if (nit == g.nodes.end())
+      return Status::NotFound("Unknown node: " +
+                              std::to_string(static_cast<long long>(id)));
 
-  // collect edges to delete (out + in)
-  std::vector<EdgeId> toErase;
-  if (auto oit = g.outAdj.find(id); oit != g.outAdj.end()) {
-    toErase.insert(toErase.end(), oit->second.begin(), oit->second.end());
-  }
-  if (auto iit = g.inAdj.find(id); iit != g.inAdj.end()) {
-    toErase.insert(toErase.end(), iit->second.begin(), iit->second.end());
-  }
-  std::sort(toErase.begin(), toErase.end());
-  toErase.erase(std::unique(toErase.begin(), toErase.end()), toErase.end());
-  for (EdgeId e : toErase) {
-    auto eit = g.edges.find(e);
-    if (eit == g.edges.end())
-      continue;
-    const Edge &edge = eit->second;
-    eraseEdgeId(g.outAdj, edge.from, edge.id);
-    eraseEdgeId(g.inAdj, edge.to, edge.id);
-    g.edges.erase(eit);
-  }
+    // collect edges to delete (out + in)
+    std::vector<EdgeId> toErase;
+    if (auto oit = g.outAdj.find(id); oit != g.outAdj.end()) {
+      toErase.insert(toErase.end(), oit->second.begin(), oit->second.end());
+    }
+    if (auto iit = g.inAdj.find(id); iit != g.inAdj.end()) {
+      toErase.insert(toErase.end(), iit->second.begin(), iit->second.end());
+    }
+    std::sort(toErase.begin(), toErase.end());
+    toErase.erase(std::unique(toErase.begin(), toErase.end()), toErase.end());
+    for (EdgeId e : toErase) {
+      auto eit = g.edges.find(e);
+      if (eit == g.edges.end())
+        continue;
+      const Edge &edge = eit->second;
+      unlinkEdge(g, edge);
+      noteEdgeWrite(g, edge.from, edge.to);
+      reindexEdge(g, &edge, nullptr);
+      g.memory.sub(edgeBytes(edge));
+      g.edges.erase(eit);
+    }
 
-  g.outAdj.erase(id);
-  g.inAdj.erase(id);
-  g.nodes.erase(nit);
-  return Status::OK();
+    g.outAdj.erase(id);
+    g.inAdj.erase(id);
+    reindexNode(g, &nit->second, nullptr);
+    g.memory.sub(nodeBytes(nit->second));
+    g.nodes.erase(nit);
+    noteNodeWrite(g, id);
+    return Status::OK();
+  };
+  return metrics::measure(metrics::Operation::GraphWrite, run);
 }
 
 Result<Edge> InMemoryGraphStorage::getEdge(const std::string &graph,
                                            EdgeId id) const {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto git = graphs_.find(graph);
-  if (git == graphs_.end())
-    return Result<Edge>::err(graphNotFound(graph));
-  const auto &g = git->second;
-  auto it = g.edges.find(id);
-  if (it == g.edges.end())
-    return edgeNotFound(id);
-  return Result<Edge>::ok(it->second);
+  auto run = [&]() -> Result<Edge> {
+    auto gd = findGraph(graph);
+    if (!gd)
+      return Result<Edge>::err(graphNotFound(graph));
+    metrics::TimedSharedLock lk(gd->mtx);
+    const auto &g = *gd;
+    auto it = g.edges.find(id);
+    if (it == g.edges.end())
+      return edgeNotFound(id);
+    return Result<Edge>::ok(it->second);
+  };
+  return metrics::measure(metrics::Operation::GraphRead, run);
 }
 
 Status InMemoryGraphStorage::putEdge(const std::string &graph,
                                      const Edge &edge) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto git = graphs_.find(graph);
-  if (git == graphs_.end())
-    return graphNotFound(graph);
-  auto &g = git->second;
+  auto run = [&]() -> Status {
+    auto gd = findGraph(graph);
+    if (!gd)
+      return graphNotFound(graph);
+    metrics::TimedLock lk(gd->mtx);
+    auto &g = *gd;
 
-  if (g.nodes.find(edge.from) == g.nodes.end() ||
-      g.nodes.find(edge.to) == g.nodes.end()) {
-    return Status::InvalidArgument("Edge endpoints must exist");
-  }
+    if (g.nodes.find(edge.from) == g.nodes.end() ||
+        g.nodes.find(edge.to) == g.nodes.end()) {
+      return Status::InvalidArgument("Edge endpoints must exist");
+    }
+    const size_t bytes = edgeBytes(edge);
+    auto eit = g.edges.find(edge.id);
+    const size_t replaced = eit != g.edges.end() ? edgeBytes(eit->second) : 0;
+    if (bytes > replaced && !g.memory.fits(bytes - replaced))
+      return memory::budgetExceeded("graph", graph, g.memory,
+                                    bytes - replaced);
+    storeEdge(g, edge);
+    return Status::OK();
+  };
+  return metrics::measure(metrics::Operation::GraphWrite, run);
+}
 
-  // If updating an existing edge, remove adjacency references first
-  if (auto eit = g.edges.find(edge.id); eit != g.edges.end()) {
-    const Edge &old = eit->second;
-    eraseEdgeId(g.outAdj, old.from, old.id);
-    eraseEdgeId(g.inAdj, old.to, old.id);
-  }
+Status InMemoryGraphStorage::putEdges(const std::string &graph,
+                                      const std::vector<Edge> &edges) {
+  auto run = [&]() -> Status {
+    auto gd = findGraph(graph);
+    if (!gd)
+      return graphNotFound(graph);
+    metrics::TimedLock lk(gd->mtx);
+    auto &g = *gd;
 
-  g.edges[edge.id] = edge;
-  g.outAdj[edge.from].push_back(edge.id);
-  g.inAdj[edge.to].push_back(edge.id);
-  return Status::OK();
+    // Endpoints and bytes of the whole batch, checked by the shared pool's
+    // workers: the exclusive lock keeps the maps still while they read
+    const GraphData &cg = g;
+    const size_t morsels = (edges.size() + kEdgeMorsel - 1) / kEdgeMorsel;
+    std::vector<size_t> missing(morsels, edges.size());
+    std::vector<size_t> bytes(morsels), replaced(morsels);
+    ThreadPool::shared().parallelFor(
+        edges.size(), kEdgeMorsel, 0, [&](size_t m, size_t lo, size_t hi) {
+          for (size_t i = lo; i < hi; ++i) {
+            const Edge &e = edges[i];
+            if (!cg.nodes.count(e.from) || !cg.nodes.count(e.to)) {
+              missing[m] = i;
+              return;
+            }
+            bytes[m] += edgeBytes(e);
+            if (auto it = cg.edges.find(e.id); it != cg.edges.end())
+              replaced[m] += edgeBytes(it->second);
+          }
+        });
+    size_t add = 0, sub = 0;
+    for (size_t m = 0; m < morsels; ++m) {
+      if (missing[m] != edges.size())
+        return Status::InvalidArgument(
+            "Edge endpoints must exist: edge " +
+            std::to_string(static_cast<long long>(edges[missing[m]].id)));
+      add += bytes[m];
+      sub += replaced[m];
+    }
+    if (add > sub && !g.memory.fits(add - sub))
+      return memory::budgetExceeded("graph", graph, g.memory, add - sub);
+
+    if (g.edges.empty() && g.nodes.size() < CsrGraph::npos) {
+      loadEdges(g, edges);
+      return Status::OK();
+    }
+    g.edges.reserve(g.edges.size() + edges.size());
+    for (const Edge &e : edges)
+      storeEdge(g, e);
+    return Status::OK();
+  };
+  return metrics::measure(metrics::Operation::GraphWrite, run);
 }
 
 Status InMemoryGraphStorage::eraseEdge(const std::string &graph, EdgeId id) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto git = graphs_.find(graph);
-  if (git == graphs_.end())
-    return graphNotFound(graph);
-  auto &g = git->second;
+  auto run = [&]() -> Status {
+    auto gd = findGraph(graph);
+    if (!gd)
+      return graphNotFound(graph);
+    metrics::TimedLock lk(gd->mtx);
+    auto &g = *gd;
 
-  auto eit = g.edges.find(id);
-  if (eit == g.edges.end())
-    return Status::NotFound("Unknown edge: " +
-                            std::to_string(static_cast<long long>(id)));
-  const Edge &edge = eit->second;
-  eraseEdgeId(g.outAdj, edge.from, edge.id);
-  eraseEdgeId(g.inAdj, edge.to, edge.id);
-  g.edges.erase(eit);
-  return Status::OK();
+    auto eit = g.edges.find(id);
+    if (eit == g.edges.end())
+      return Status::NotFound("Unknown edge: " +
+                              std::to_string(static_cast<long long>(id)));
+    const Edge &edge = eit->second;
+    unlinkEdge(g, edge);
+    noteEdgeWrite(g, edge.from, edge.to);
+    reindexEdge(g, &edge, nullptr);
+    g.memory.sub(edgeBytes(edge));
+    g.edges.erase(eit);
+    return Status::OK();
+  };
+  return metrics::measure(metrics::Operation::GraphWrite, run);
 }
 
 Result<std::vector<EdgeId>>
 InMemoryGraphStorage::edgeIdsOut(const std::string &graph, NodeId from) const {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto git = graphs_.find(graph);
-  if (git == graphs_.end()) {
+  auto gd = findGraph(graph);
+  if (!gd) {
     return Result<std::vector<EdgeId>>::err(graphNotFound(graph));
   }
-  const auto &g = git->second;
+  std::shared_lock lk(gd->mtx);
+  const auto &g = *gd;
   if (g.nodes.find(from) == g.nodes.end()) {
     return Result<std::vector<EdgeId>>::err(Status::NotFound(
         "Unknown node: " + std::to_string(static_cast<long long>(from))));
@@ -200,12 +1316,12 @@ InMemoryGraphStorage::edgeIdsOut(const std::string &graph, NodeId from) const {
 
 Result<std::vector<EdgeId>>
 InMemoryGraphStorage::edgeIdsIn(const std::string &graph, NodeId to) const {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto git = graphs_.find(graph);
-  if (git == graphs_.end()) {
+  auto gd = findGraph(graph);
+  if (!gd) {
     return Result<std::vector<EdgeId>>::err(graphNotFound(graph));
   }
-  const auto &g = git->second;
+  std::shared_lock lk(gd->mtx);
+  const auto &g = *gd;
   if (g.nodes.find(to) == g.nodes.end()) {
     return Result<std::vector<EdgeId>>::err(Status::NotFound(
         "Unknown node: " + std::to_string(static_cast<long long>(to))));
@@ -221,145 +1337,451 @@ InMemoryGraphStorage::edgeIdsIn(const std::string &graph, NodeId to) const {
 Result<std::vector<NodeId>>
 InMemoryGraphStorage::neighborsOut(const std::string &graph,
                                    NodeId from) const {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto git = graphs_.find(graph);
-  if (git == graphs_.end())
-    return Result<std::vector<NodeId>>::err(graphNotFound(graph));
-  const auto &g = git->second;
-  if (g.nodes.find(from) == g.nodes.end()) {
-    return Result<std::vector<NodeId>>::err(Status::NotFound(
-        "Unknown node: " + std::to_string(static_cast<long long>(from))));
-  }
-
   std::vector<NodeId> out;
-  auto it = g.outAdj.find(from);
-  if (it == g.outAdj.end())
-    return Result<std::vector<NodeId>>::ok(out);
-
-  out.reserve(it->second.size());
-  for (EdgeId eid : it->second) {
-    auto eit = g.edges.find(eid);
-    if (eit != g.edges.end())
-      out.push_back(eit->second.to);
-  }
+  Status st =
+      forEachNeighbor(graph, from, [&](NodeId n) { out.push_back(n); });
+  if (!st.ok())
+    return Result<std::vector<NodeId>>::err(st);
   return Result<std::vector<NodeId>>::ok(std::move(out));
 }
 
 Result<std::vector<NodeId>>
 InMemoryGraphStorage::neighborsIn(const std::string &graph, NodeId to) const {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto git = graphs_.find(graph);
-  if (git == graphs_.end())
-    return Result<std::vector<NodeId>>::err(graphNotFound(graph));
-  const auto &g = git->second;
-  if (g.nodes.find(to) == g.nodes.end()) {
-    return Result<std::vector<NodeId>>::err(Status::NotFound(
-        "Unknown node: " + std::to_string(static_cast<long long>(to))));
-  }
-
   std::vector<NodeId> out;
-  auto it = g.inAdj.find(to);
-  if (it == g.inAdj.end())
-    return Result<std::vector<NodeId>>::ok(out);
+  Status st = forEachNeighbor(
+      graph, to, [&](NodeId n) { out.push_back(n); }, Direction::In);
+  if (!st.ok())
+    return Result<std::vector<NodeId>>::err(st);
+  return Result<std::vector<NodeId>>::ok(std::move(out));
+}
 
-  out.reserve(it->second.size());
-  for (EdgeId eid : it->second) {
-    auto eit = g.edges.find(eid);
+Status InMemoryGraphStorage::withNode(
+    const std::string &graph, NodeId id,
+    const std::function<void(const Node &)> &fn) const {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return graphNotFound(graph);
+  std::shared_lock lk(gd->mtx);
+  auto it = gd->nodes.find(id);
+  if (it == gd->nodes.end())
+    return nodeNotFound(id).status();
+  fn(it->second);
+  return Status::OK();
+}
+
+Status InMemoryGraphStorage::withEdge(
+    const std::string &graph, EdgeId id,
+    const std::function<void(const Edge &)> &fn) const {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return graphNotFound(graph);
+  std::shared_lock lk(gd->mtx);
+  auto it = gd->edges.find(id);
+  if (it == gd->edges.end())
+    return edgeNotFound(id).status();
+  fn(it->second);
+  return Status::OK();
+}
+
+Status InMemoryGraphStorage::forEachNeighbor(
+    const std::string &graph, NodeId id, const std::function<void(NodeId)> &fn,
+    Direction dir) const {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return graphNotFound(graph);
+  std::shared_lock lk(gd->mtx);
+  const auto &g = *gd;
+  if (g.nodes.find(id) == g.nodes.end())
+    return Status::NotFound("Unknown node: " +
+                            std::to_string(static_cast<long long>(id)));
+
+  OverlayView view(g, snapshotOf(g, /*exact=*/false));
+  auto visit = [&](NodeId n, CsrGraph::Index) { fn(n); };
+  if (dir == Direction::Out)
+    view.forEachOut(id, view.indexOf(id), visit);
+  else
+    view.forEachIn(id, view.indexOf(id), visit);
+  return Status::OK();
+}
+
+Status
+InMemoryGraphStorage::forEachEdge(const std::string &graph, NodeId id,
+                                  const std::function<void(const Edge &)> &fn,
+                                  Direction dir) const {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return graphNotFound(graph);
+  std::shared_lock lk(gd->mtx);
+  const auto &g = *gd;
+  if (g.nodes.find(id) == g.nodes.end())
+    return Status::NotFound("Unknown node: " +
+                            std::to_string(static_cast<long long>(id)));
+
+  const AdjacencyIndex &adj = dir == Direction::Out ? g.outAdj : g.inAdj;
+  auto it = adj.find(id);
+  if (it == adj.end())
+    return Status::OK();
+  for (EdgeId e : it->second) {
+    auto eit = g.edges.find(e);
     if (eit != g.edges.end())
-      out.push_back(eit->second.from);
+      fn(eit->second);
   }
-  return Result<std::vector<NodeId>>::ok(std::move(out));
+  return Status::OK();
 }
 
 Result<std::vector<NodeId>> InMemoryGraphStorage::bfs(const std::string &graph,
                                                       NodeId start,
                                                       size_t maxNodes) const {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto git = graphs_.find(graph);
-  if (git == graphs_.end())
-    return Result<std::vector<NodeId>>::err(graphNotFound(graph));
-  const auto &g = git->second;
-  if (g.nodes.find(start) == g.nodes.end()) {
-    return Result<std::vector<NodeId>>::err(Status::NotFound(
-        "Unknown node: " + std::to_string(static_cast<long long>(start))));
-  }
-
-  std::deque<NodeId> q;
-  std::unordered_set<NodeId> seen;
-  std::vector<NodeId> order;
+  auto run = [&]() -> Result<std::vector<NodeId>> {
+    auto gd = findGraph(graph);
+    if (!gd)
+      return Result<std::vector<NodeId>>::err(graphNotFound(graph));
+    metrics::TimedSharedLock lk(gd->mtx);
+    const auto &g = *gd;
+    if (g.nodes.find(start) == g.nodes.end()) {
+      return Result<std::vector<NodeId>>::err(Status::NotFound(
+          "Unknown node: " + std::to_string(static_cast<long long>(start))));
+    }
 
-  q.push_back(start);
-  seen.insert(start);
+    using Index = CsrGraph::Index;
+    OverlayView view(g, snapshotOf(g, /*exact=*/false));
+    auto seen = view.visited();
+    std::vector<std::pair<NodeId, Index>> q;
+    std::vector<NodeId> order;
 
-  while (!q.empty()) {
-    NodeId cur = q.front();
-    q.pop_front();
-    order.push_back(cur);
-    if (maxNodes > 0 && order.size() >= maxNodes)
-      break;
+    q.emplace_back(start, view.indexOf(start));
+    seen.insert(start, q.back().second);
 
-    auto adjIt = g.outAdj.find(cur);
-    if (adjIt == g.outAdj.end())
-      continue;
-    for (EdgeId eid : adjIt->second) {
-      auto eit = g.edges.find(eid);
-      if (eit == g.edges.end())
-        continue;
-      NodeId nxt = eit->second.to;
-      if (seen.insert(nxt).second) {
-        q.push_back(nxt);
-      }
+    for (size_t head = 0; head < q.size(); ++head) {
+      const NodeId cur = q[head].first;
+      order.push_back(cur);
+      if (maxNodes > 0 && order.size() >= maxNodes)
+        break;
+      view.forEachOut(cur, q[head].second, [&](NodeId nxt, Index i) {
+        if (seen.insert(nxt, i))
+          q.emplace_back(nxt, i);
+      });
     }
-  }
 
-  return Result<std::vector<NodeId>>::ok(std::move(order));
+    metrics::OperationScope::addRows(q.size(), order.size());
+    return Result<std::vector<NodeId>>::ok(std::move(order));
+  };
+  return metrics::measure(metrics::Operation::GraphTraversal, run);
 }
 
 Result<std::vector<NodeId>> InMemoryGraphStorage::dfs(const std::string &graph,
                                                       NodeId start,
                                                       size_t maxNodes) const {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto git = graphs_.find(graph);
-  if (git == graphs_.end())
-    return Result<std::vector<NodeId>>::err(graphNotFound(graph));
-  const auto &g = git->second;
-  if (g.nodes.find(start) == g.nodes.end()) {
-    return Result<std::vector<NodeId>>::err(Status::NotFound(
-        "Unknown node: " + std::to_string(static_cast<long long>(start))));
-  }
+  auto run = [&]() -> Result<std::vector<NodeId>> {
+    auto gd = findGraph(graph);
+    if (!gd)
+      return Result<std::vector<NodeId>>::err(graphNotFound(graph));
+    metrics::TimedSharedLock lk(gd->mtx);
+    const auto &g = *gd;
+    if (g.nodes.find(start) == g.nodes.end()) {
+      return Result<std::vector<NodeId>>::err(Status::NotFound(
+          "Unknown node: " + std::to_string(static_cast<long long>(start))));
+    }
 
-  std::vector<NodeId> stack;
-  std::unordered_set<NodeId> seen;
-  std::vector<NodeId> order;
+    using Index = CsrGraph::Index;
+    OverlayView view(g, snapshotOf(g, /*exact=*/false));
+    auto seen = view.visited();
+    std::vector<std::pair<NodeId, Index>> stack, next;
+    std::vector<NodeId> order;
 
-  stack.push_back(start);
+    stack.emplace_back(start, view.indexOf(start));
 
-  while (!stack.empty()) {
-    NodeId cur = stack.back();
-    stack.pop_back();
-    if (!seen.insert(cur).second)
-      continue;
-    order.push_back(cur);
-    if (maxNodes > 0 && order.size() >= maxNodes)
-      break;
+    while (!stack.empty()) {
+      const auto cur = stack.back();
+      stack.pop_back();
+      if (!seen.insert(cur.first, cur.second))
+        continue;
+      order.push_back(cur.first);
+      if (maxNodes > 0 && order.size() >= maxNodes)
+        break;
 
-    auto adjIt = g.outAdj.find(cur);
-    if (adjIt == g.outAdj.end())
-      continue;
+      next.clear();
+      view.forEachOut(cur.first, cur.second,
+                      [&](NodeId nxt, Index i) { next.emplace_back(nxt, i); });
+      // push neighbors in reverse so the first neighbor appears earlier
+      // (stable)
+      for (auto rit = next.rbegin(); rit != next.rend(); ++rit)
+        if (!seen.contains(rit->first, rit->second))
+          stack.push_back(*rit);
+    }
 
-    // push neighbors in reverse so the first neighbor appears earlier (stable)
-    for (auto rit = adjIt->second.rbegin(); rit != adjIt->second.rend();
-         ++rit) {
-      auto eit = g.edges.find(*rit);
-      if (eit == g.edges.end())
-        continue;
-      NodeId nxt = eit->second.to;
-      if (seen.find(nxt) == seen.end())
-        stack.push_back(nxt);
+    metrics::OperationScope::addRows(order.size(), order.size());
+    return Result<std::vector<NodeId>>::ok(std::move(order));
+  };
+  return metrics::measure(metrics::Operation::GraphTraversal, run);
+}
+
+Result<std::vector<NodeId>>
+InMemoryGraphStorage::parallelBfs(const std::string &graph, NodeId start,
+                                  size_t maxNodes, size_t threads) const {
+  using R = Result<std::vector<NodeId>>;
+  auto run = [&]() -> R {
+    auto gd = findGraph(graph);
+    if (!gd)
+      return R::err(graphNotFound(graph));
+    std::shared_lock lk(gd->mtx);
+    const auto &g = *gd;
+    if (g.nodes.find(start) == g.nodes.end()) {
+      return R::err(Status::NotFound(
+          "Unknown node: " + std::to_string(static_cast<long long>(start))));
+    }
+
+    auto snap = snapshotOf(g, /*exact=*/true);
+    const CsrGraph &csr = *snap->csr;
+    const CsrGraph::Index source = csr.indexOf(start);
+    if (source == CsrGraph::npos) {
+      // No snapshot past 32-bit node indices
+      lk.unlock();
+      return GraphStorage::parallelBfs(graph, start, maxNodes, threads);
+    }
+    std::vector<NodeId> order;
+    for (CsrGraph::Index i : csr.breadthFirst(source, maxNodes, threads))
+      order.push_back(csr.id(i));
+    metrics::OperationScope::addRows(order.size(), order.size());
+    return R::ok(std::move(order));
+  };
+  return metrics::measure(metrics::Operation::GraphTraversal, run);
+}
+
+Result<std::vector<NodeId>> InMemoryGraphStorage::traverseFiltered(
+    const std::string &graph, NodeId start, const TraversalFilter &filter,
+    size_t maxNodes, bool depthFirst) const {
+  using R = Result<std::vector<NodeId>>;
+  auto run = [&]() -> R {
+    auto gd = findGraph(graph);
+    if (!gd)
+      return R::err(graphNotFound(graph));
+    metrics::TimedSharedLock lk(gd->mtx);
+    const auto &g = *gd;
+    if (g.nodes.find(start) == g.nodes.end()) {
+      return R::err(Status::NotFound(
+          "Unknown node: " + std::to_string(static_cast<long long>(start))));
+    }
+
+    FilteredWalk walk(g, snapshotOf(g, /*exact=*/false), filter);
+    auto seen = walk.visited();
+    std::vector<NodeId> order = depthFirst
+                                    ? walk.depthFirst(start, maxNodes, seen)
+                                    : walk.breadthFirst(start, maxNodes, seen);
+    metrics::OperationScope::addRows(order.size(), order.size());
+    return R::ok(std::move(order));
+  };
+  return metrics::measure(metrics::Operation::GraphTraversal, run);
+}
+
+Result<std::vector<NodeId>>
+InMemoryGraphStorage::filteredBfs(const std::string &graph, NodeId start,
+                                  const TraversalFilter &filter,
+                                  size_t maxNodes) const {
+  return traverseFiltered(graph, start, filter, maxNodes, false);
+}
+
+Result<std::vector<NodeId>>
+InMemoryGraphStorage::filteredDfs(const std::string &graph, NodeId start,
+                                  const TraversalFilter &filter,
+                                  size_t maxNodes) const {
+  return traverseFiltered(graph, start, filter, maxNodes, true);
+}
+
+Result<std::vector<std::vector<NodeId>>>
+InMemoryGraphStorage::neighborhoods(const std::string &graph,
+                                    const std::vector<NodeId> &starts,
+                                    const TraversalFilter &filter,
+                                    size_t threads) const {
+  using R = Result<std::vector<std::vector<NodeId>>>;
+  auto run = [&]() -> R {
+    auto gd = findGraph(graph);
+    if (!gd)
+      return R::err(graphNotFound(graph));
+    metrics::TimedSharedLock lk(gd->mtx);
+    const auto &g = *gd;
+    for (NodeId start : starts) {
+      if (g.nodes.find(start) == g.nodes.end()) {
+        return R::err(Status::NotFound(
+            "Unknown node: " + std::to_string(static_cast<long long>(start))));
+      }
+    }
+
+    // Workers share the walk under this thread's read lock; each reuses
+    // one visited set across its starts, clearing the nodes it reached
+    FilteredWalk walk(g, snapshotOf(g, /*exact=*/false), filter);
+    std::vector<std::vector<NodeId>> out(starts.size());
+    ThreadPool::shared().parallelFor(
+        starts.size(), kStartMorsel, threads,
+        [&](size_t, size_t lo, size_t hi) {
+          auto seen = walk.visited();
+          for (size_t s = lo; s < hi; ++s) {
+            std::vector<NodeId> nodes = walk.breadthFirst(starts[s], 0, seen);
+            for (NodeId id : nodes)
+              seen.erase(id, walk.indexOf(id));
+            nodes.erase(nodes.begin());
+            std::sort(nodes.begin(), nodes.end());
+            out[s] = std::move(nodes);
+          }
+        });
+    size_t reached = 0;
+    for (const auto &nodes : out)
+      reached += nodes.size();
+    metrics::OperationScope::addRows(reached, reached);
+    return R::ok(std::move(out));
+  };
+  return metrics::measure(metrics::Operation::GraphTraversal, run);
+}
+
+Result<bool> InMemoryGraphStorage::reachable(const std::string &graph,
+                                             NodeId from, NodeId to) const {
+  {
+    auto gd = findGraph(graph);
+    if (!gd)
+      return Result<bool>::err(graphNotFound(graph));
+    std::shared_lock lk(gd->mtx);
+    auto snap = snapshotOf(*gd, /*exact=*/false);
+    const CsrGraph::Index a = snap->csr->indexOf(from);
+    const CsrGraph::Index b = snap->csr->indexOf(to);
+    if (snap->writes == 0 && a != CsrGraph::npos && b != CsrGraph::npos) {
+      auto labels = componentsOf(*gd, *snap);
+      if (labels->weak[a] != labels->weak[b])
+        return Result<bool>::ok(false);
+      if (labels->strong[a] == labels->strong[b])
+        return Result<bool>::ok(true);
     }
   }
+  return GraphStorage::reachable(graph, from, to);
+}
+
+Result<std::vector<NodeId>>
+InMemoryGraphStorage::nodesWithLabel(const std::string &graph,
+                                     const std::string &label) const {
+  using R = Result<std::vector<NodeId>>;
+  auto gd = findGraph(graph);
+  if (!gd)
+    return R::err(graphNotFound(graph));
+  std::shared_lock lk(gd->mtx);
+  auto it = gd->labels.find(label);
+  return R::ok(it == gd->labels.end() ? std::vector<NodeId>{} : it->second);
+}
+
+Status InMemoryGraphStorage::createNodeIndex(const std::string &graph,
+                                             const std::string &property,
+                                             IndexType type) {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return graphNotFound(graph);
+  std::lock_guard lk(gd->mtx);
+  auto [it, added] = gd->nodeIndexes.try_emplace(property, type);
+  if (!added)
+    return Status::AlreadyExists("Node index exists: " + property);
+  for (const auto &kv : gd->nodes)
+    it->second.insert(propertyOf(kv.second.properties, property), kv.first);
+  return Status::OK();
+}
+
+Status InMemoryGraphStorage::dropNodeIndex(const std::string &graph,
+                                           const std::string &property) {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return graphNotFound(graph);
+  std::lock_guard lk(gd->mtx);
+  if (gd->nodeIndexes.erase(property) == 0)
+    return Status::NotFound("Unknown node index: " + property);
+  return Status::OK();
+}
+
+Status InMemoryGraphStorage::createEdgeIndex(const std::string &graph,
+                                             const std::string &property,
+                                             IndexType type) {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return graphNotFound(graph);
+  std::lock_guard lk(gd->mtx);
+  auto [it, added] = gd->edgeIndexes.try_emplace(property, type);
+  if (!added)
+    return Status::AlreadyExists("Edge index exists: " + property);
+  for (const auto &kv : gd->edges)
+    it->second.insert(propertyOf(kv.second.properties, property), kv.first);
+  return Status::OK();
+}
 
-  return Result<std::vector<NodeId>>::ok(std::move(order));
+Status InMemoryGraphStorage::dropEdgeIndex(const std::string &graph,
+                                           const std::string &property) {
+  auto gd = findGraph(graph);
+  if (!gd)
+    return graphNotFound(graph);
+  std::lock_guard lk(gd->mtx);
+  if (gd->edgeIndexes.erase(property) == 0)
+    return Status::NotFound("Unknown edge index: " + property);
+  return Status::OK();
+}
+
+Result<std::vector<NodeId>>
+InMemoryGraphStorage::findNodes(const std::string &graph,
+                                const std::string &property,
+                                const Value &value) const {
+  using R = Result<std::vector<NodeId>>;
+  auto gd = findGraph(graph);
+  if (!gd)
+    return R::err(graphNotFound(graph));
+  std::shared_lock lk(gd->mtx);
+  return R::ok(findMatching(
+      gd->nodes, gd->nodeIndexes, property,
+      [&](const PropertyIndex &ix) {
+        return std::optional<std::vector<int64_t>>(ix.lookupEq(value));
+      },
+      [&](const Value *p) { return propertyEquals(p, value); }));
+}
+
+Result<std::vector<NodeId>>
+InMemoryGraphStorage::findNodesInRange(const std::string &graph,
+                                       const std::string &property,
+                                       const Value *lower,
+                                       const Value *upper) const {
+  using R = Result<std::vector<NodeId>>;
+  auto gd = findGraph(graph);
+  if (!gd)
+    return R::err(graphNotFound(graph));
+  std::shared_lock lk(gd->mtx);
+  return R::ok(findMatching(
+      gd->nodes, gd->nodeIndexes, property,
+      [&](const PropertyIndex &ix) { return ix.lookupRange(lower, upper); },
+      [&](const Value *p) { return propertyInRange(p, lower, upper); }));
+}
+
+Result<std::vector<EdgeId>>
+InMemoryGraphStorage::findEdges(const std::string &graph,
+                                const std::string &property,
+                                const Value &value) const {
+  using R = Result<std::vector<EdgeId>>;
+  auto gd = findGraph(graph);
+  if (!gd)
+    return R::err(graphNotFound(graph));
+  std::shared_lock lk(gd->mtx);
+  return R::ok(findMatching(
+      gd->edges, gd->edgeIndexes, property,
+      [&](const PropertyIndex &ix) {
+        return std::optional<std::vector<int64_t>>(ix.lookupEq(value));
+      },
+      [&](const Value *p) { return propertyEquals(p, value); }));
+}
+
+Result<std::vector<EdgeId>>
+InMemoryGraphStorage::findEdgesInRange(const std::string &graph,
+                                       const std::string &property,
+                                       const Value *lower,
+                                       const Value *upper) const {
+  using R = Result<std::vector<EdgeId>>;
+  auto gd = findGraph(graph);
+  if (!gd)
+    return R::err(graphNotFound(graph));
+  std::shared_lock lk(gd->mtx);
+  return R::ok(findMatching(
+      gd->edges, gd->edgeIndexes, property,
+      [&](const PropertyIndex &ix) { return ix.lookupRange(lower, upper); },
+      [&](const Value *p) { return propertyInRange(p, lower, upper); }));
 }
 
 } // namespace kadedb
@@ -0,0 +1,520 @@
+#include "kadedb/index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string_view>
+
+namespace kadedb {
+
+namespace {
+// Largest magnitude below which every integer is exactly representable as a
+// double; beyond it numeric cross-type comparisons lose precision.
+constexpr double kExactIntLimit = 9007199254740992.0; // 2^53
+} // namespace
+
+ColumnIndex::ColumnIndex(IndexType type, ColumnType columnType)
+    : type_(type), columnType_(columnType) {}
+
+size_t ColumnIndex::KeyHash::operator()(const InlineValue &v) const {
+  switch (v.type()) {
+  case ValueType::Integer:
+    return std::hash<int64_t>()(v.asInt());
+  case ValueType::Float:
+    return std::hash<double>()(v.asFloat());
+  case ValueType::String:
+    return std::hash<std::string_view>()(
+        std::string_view(v.stringData(), v.stringSize()));
+  case ValueType::Boolean:
+    return v.asBool() ? 1u : 0u;
+  case ValueType::Null:
+    break;
+  }
+  return 0;
+}
+
+std::optional<InlineValue>
+ColumnIndex::normalizeCell(const InlineValue &cell) const {
+  switch (columnType_) {
+  case ColumnType::Integer:
+    if (cell.type() == ValueType::Integer)
+      return cell;
+    break;
+  case ColumnType::Float:
+    if (cell.type() == ValueType::Integer)
+      return InlineValue::floating(cell.asFloat());
+    if (cell.type() == ValueType::Float && !std::isnan(cell.asFloat()))
+      return cell;
+    break;
+  case ColumnType::String:
+    if (cell.type() == ValueType::String)
+      return cell;
+    break;
+  case ColumnType::Boolean:
+    if (cell.type() == ValueType::Boolean)
+      return cell;
+    break;
+  case ColumnType::Null:
+    break;
+  }
+  return std::nullopt;
+}
+
+std::optional<InlineValue> ColumnIndex::normalizeLookup(const Value &v) const {
+  switch (columnType_) {
+  case ColumnType::Integer:
+    if (v.type() == ValueType::Integer)
+      return InlineValue::integer(v.asInt());
+    if (v.type() == ValueType::Float) {
+      // Only integral doubles map exactly onto Integer keys
+      double d = v.asFloat();
+      if (std::fabs(d) < kExactIntLimit && std::trunc(d) == d)
+        return InlineValue::integer(static_cast<int64_t>(d));
+    }
+    break;
+  case ColumnType::Float:
+    if (v.type() == ValueType::Integer ||
+        (v.type() == ValueType::Float && !std::isnan(v.asFloat())))
+      return InlineValue::floating(v.asFloat());
+    break;
+  case ColumnType::String:
+  case ColumnType::Boolean:
+    if ((columnType_ == ColumnType::String && v.type() == ValueType::String) ||
+        (columnType_ == ColumnType::Boolean && v.type() == ValueType::Boolean))
+      return InlineValue::fromValue(&v);
+    break;
+  case ColumnType::Null:
+    break;
+  }
+  return std::nullopt;
+}
+
+void ColumnIndex::insert(const InlineValue &cell, size_t pos) {
+  if (cell.empty())
+    return; // absent cells never match a comparison
+  auto key = normalizeCell(cell);
+  if (!key || (type_ == IndexType::Bitmap && pos > UINT32_MAX)) {
+    degraded_ = true;
+    return;
+  }
+  if (cell.type() == ValueType::Integer && columnType_ == ColumnType::Float &&
+      std::fabs(cell.asFloat()) >= kExactIntLimit)
+    lossy_ = true;
+  switch (type_) {
+  case IndexType::Hash:
+    hash_[std::move(*key)].push_back(pos);
+    break;
+  case IndexType::Ordered:
+    ordered_[std::move(*key)].push_back(pos);
+    break;
+  case IndexType::Bitmap:
+    bitmaps_[std::move(*key)].add(static_cast<uint32_t>(pos));
+    present_.add(static_cast<uint32_t>(pos));
+    break;
+  }
+}
+
+void ColumnIndex::clear() {
+  hash_.clear();
+  ordered_.clear();
+  bitmaps_.clear();
+  present_.clear();
+  degraded_ = false;
+  lossy_ = false;
+}
+
+void ColumnIndex::rebuild(const std::vector<InlineRow> &rows, size_t column) {
+  clear();
+  for (size_t i = 0; i < rows.size(); ++i)
+    insert(rows[i].values()[column], i);
+}
+
+// Utility: the positions of a bitmap, ascending
+static std::vector<size_t> positions(const RoaringBitmap &bits) {
+  std::vector<size_t> out;
+  out.reserve(bits.cardinality());
+  bits.forEach([&](uint32_t pos) { out.push_back(pos); });
+  return out;
+}
+
+std::optional<std::vector<size_t>>
+ColumnIndex::lookupEq(const Value &rhs) const {
+  if (degraded_)
+    return std::nullopt;
+  if (type_ == IndexType::Bitmap) {
+    bool exact = false;
+    auto bits = bitmapEq(rhs, exact);
+    if (!bits)
+      return std::nullopt;
+    return positions(*bits);
+  }
+  auto key = normalizeLookup(rhs);
+  if (!key)
+    return std::nullopt;
+  if (type_ == IndexType::Hash) {
+    auto it = hash_.find(*key);
+    if (it == hash_.end())
+      return std::vector<size_t>{};
+    return it->second;
+  }
+  auto it = ordered_.find(*key);
+  if (it == ordered_.end())
+    return std::vector<size_t>{};
+  return it->second;
+}
+
+std::optional<std::vector<size_t>>
+ColumnIndex::lookupRange(const Value *lower, const Value *upper) const {
+  if (type_ == IndexType::Bitmap) {
+    bool exact = false;
+    auto bits = bitmapRange(lower, false, upper, false, exact);
+    if (!bits)
+      return std::nullopt;
+    return positions(*bits);
+  }
+  if (type_ != IndexType::Ordered || degraded_)
+    return std::nullopt;
+  std::optional<InlineValue> lo, hi;
+  if (lower && !(lo = normalizeLookup(*lower)))
+    return std::nullopt;
+  if (upper && !(hi = normalizeLookup(*upper)))
+    return std::nullopt;
+  std::vector<size_t> out;
+  // An inverted range yields no candidates
+  if (lo && hi && KeyLess()(*hi, *lo))
+    return out;
+  auto begin = lo ? ordered_.lower_bound(*lo) : ordered_.begin();
+  auto end = hi ? ordered_.upper_bound(*hi) : ordered_.end();
+  for (auto it = begin; it != end; ++it)
+    out.insert(out.end(), it->second.begin(), it->second.end());
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+bool ColumnIndex::forEachOrdered(
+    const Value *lower, const Value *upper, bool descending,
+    const std::function<bool(size_t)> &visit) const {
+  if (type_ != IndexType::Ordered || degraded_ || lossy_)
+    return false;
+  std::optional<InlineValue> lo, hi;
+  if (lower && !(lo = normalizeLookup(*lower)))
+    return false;
+  if (upper && !(hi = normalizeLookup(*upper)))
+    return false;
+  if (lo && hi && KeyLess()(*hi, *lo))
+    return true;
+  auto begin = lo ? ordered_.lower_bound(*lo) : ordered_.begin();
+  auto end = hi ? ordered_.upper_bound(*hi) : ordered_.end();
+  auto visitKey = [&](const std::vector<size_t> &positions) {
+    for (size_t pos : positions)
+      if (!visit(pos))
+        return false;
+    return true;
+  };
+  if (descending) {
+    for (auto it = end; it != begin;)
+      if (!visitKey((--it)->second))
+        break;
+  } else {
+    for (auto it = begin; it != end; ++it)
+      if (!visitKey(it->second))
+        break;
+  }
+  return true;
+}
+
+std::optional<RoaringBitmap> ColumnIndex::bitmapEq(const Value &rhs,
+                                                   bool &exact) const {
+  return bitmapRange(&rhs, false, &rhs, false, exact);
+}
+
+std::optional<RoaringBitmap>
+ColumnIndex::bitmapRange(const Value *lower, bool lowerOpen,
+                         const Value *upper, bool upperOpen,
+                         bool &exact) const {
+  if (type_ != IndexType::Bitmap || degraded_)
+    return std::nullopt;
+  std::optional<InlineValue> lo, hi;
+  if (lower && !(lo = normalizeLookup(*lower)))
+    return std::nullopt;
+  if (upper && !(hi = normalizeLookup(*upper)))
+    return std::nullopt;
+  exact = !lossy_;
+  RoaringBitmap out;
+  // An empty range yields no positions
+  if (lo && hi) {
+    const int c = hi->compare(*lo);
+    if (c < 0 || (c == 0 && (lowerOpen || upperOpen)))
+      return out;
+  }
+  auto begin = !lo       ? bitmaps_.begin()
+               : lowerOpen ? bitmaps_.upper_bound(*lo)
+                           : bitmaps_.lower_bound(*lo);
+  auto end = !hi       ? bitmaps_.end()
+             : upperOpen ? bitmaps_.lower_bound(*hi)
+                         : bitmaps_.upper_bound(*hi);
+  for (auto it = begin; it != end; ++it)
+    out |= it->second;
+  return out;
+}
+
+// FieldIndex
+
+FieldIndex::Class FieldIndex::classOf(ValueType t) {
+  switch (t) {
+  case ValueType::Integer:
+  case ValueType::Float:
+    return kNumber;
+  case ValueType::String:
+    return kString;
+  case ValueType::Boolean:
+    return kBoolean;
+  case ValueType::Null:
+    break;
+  }
+  return kNull;
+}
+
+InlineValue FieldIndex::key(const InlineValue &v) {
+  if (classOf(v.type()) == kNumber)
+    return InlineValue::floating(v.asFloat());
+  return v;
+}
+
+bool FieldIndex::isNaN(const InlineValue &v) {
+  return v.type() == ValueType::Float && std::isnan(v.asFloat());
+}
+
+bool FieldIndex::onlyClass(Class c) const {
+  for (int k = 0; k < kClasses; ++k)
+    if (k != c && counts_[k])
+      return false;
+  return true;
+}
+
+size_t FieldIndex::KeyHash::operator()(const InlineValue &v) const {
+  switch (v.type()) {
+  case ValueType::Float: {
+    const double d = v.asFloat();
+    return std::hash<double>()(d == 0.0 ? 0.0 : d); // -0.0 == 0.0
+  }
+  case ValueType::String:
+    return std::hash<std::string_view>()(
+        std::string_view(v.stringData(), v.stringSize()));
+  case ValueType::Boolean:
+    return v.asBool() ? 1u : 0u;
+  default:
+    return 0;
+  }
+}
+
+// Utility: an Integer too wide to be keyed apart from its neighbours
+static bool isWideInt(const InlineValue &v) {
+  return v.type() == ValueType::Integer &&
+         std::fabs(v.asFloat()) >= kExactIntLimit;
+}
+
+void FieldIndex::insert(const InlineValue &value, Key key, uint32_t ordinal) {
+  if (value.empty())
+    return;
+  ++counts_[classOf(value.type())];
+  if (type_ == IndexType::Bitmap)
+    valued_.add(ordinal);
+  if (value.type() == ValueType::Null)
+    return;
+  if (isNaN(value)) {
+    ++nanCount_;
+    return;
+  }
+  if (isWideInt(value))
+    ++wideCount_;
+  switch (type_) {
+  case IndexType::Hash:
+    hash_[FieldIndex::key(value)].push_back(key);
+    break;
+  case IndexType::Ordered:
+    ordered_[FieldIndex::key(value)].push_back(key);
+    break;
+  case IndexType::Bitmap:
+    bitmaps_[FieldIndex::key(value)].add(ordinal);
+    break;
+  }
+}
+
+void FieldIndex::erase(const InlineValue &value, Key key, uint32_t ordinal) {
+  if (value.empty())
+    return;
+  --counts_[classOf(value.type())];
+  if (type_ == IndexType::Bitmap)
+    valued_.remove(ordinal);
+  if (value.type() == ValueType::Null)
+    return;
+  if (isNaN(value)) {
+    --nanCount_;
+    return;
+  }
+  if (isWideInt(value))
+    --wideCount_;
+  if (type_ == IndexType::Bitmap) {
+    auto it = bitmaps_.find(FieldIndex::key(value));
+    if (it != bitmaps_.end() && it->second.remove(ordinal) &&
+        it->second.empty())
+      bitmaps_.erase(it);
+    return;
+  }
+  auto drop = [&](auto &map) {
+    auto it = map.find(FieldIndex::key(value));
+    if (it == map.end())
+      return;
+    auto &keys = it->second;
+    auto pos = std::find(keys.begin(), keys.end(), key);
+    if (pos != keys.end()) {
+      *pos = keys.back();
+      keys.pop_back();
+    }
+    if (keys.empty())
+      map.erase(it);
+  };
+  if (type_ == IndexType::Hash)
+    drop(hash_);
+  else
+    drop(ordered_);
+}
+
+std::optional<std::vector<FieldIndex::Key>>
+FieldIndex::lookupEq(const Value &rhs) const {
+  if (type_ == IndexType::Bitmap)
+    return std::nullopt;
+  // NaN compares equal to every number, and Null to Null
+  const InlineValue v = InlineValue::fromValue(&rhs);
+  if (v.type() == ValueType::Null || isNaN(v) ||
+      (classOf(v.type()) == kNumber && nanCount_))
+    return std::nullopt;
+  if (type_ == IndexType::Hash) {
+    auto it = hash_.find(key(v));
+    if (it == hash_.end())
+      return std::vector<Key>{};
+    return it->second;
+  }
+  auto it = ordered_.find(key(v));
+  if (it == ordered_.end())
+    return std::vector<Key>{};
+  return it->second;
+}
+
+std::optional<std::vector<FieldIndex::Key>>
+FieldIndex::lookupRange(const Value *lower, const Value *upper) const {
+  std::optional<InlineValue> lo, hi;
+  if (type_ != IndexType::Ordered || !rangeKeys(lower, upper, lo, hi))
+    return std::nullopt;
+  std::vector<Key> out;
+  // An inverted range yields no candidates
+  if (lo && hi && KeyLess()(*hi, *lo))
+    return out;
+  auto begin = lo ? ordered_.lower_bound(*lo) : ordered_.begin();
+  auto end = hi ? ordered_.upper_bound(*hi) : ordered_.end();
+  for (auto it = begin; it != end; ++it)
+    out.insert(out.end(), it->second.begin(), it->second.end());
+  return out;
+}
+
+bool FieldIndex::rangeKeys(const Value *lower, const Value *upper,
+                           std::optional<InlineValue> &lo,
+                           std::optional<InlineValue> &hi) const {
+  const Value *bound = lower ? lower : upper;
+  if (!bound)
+    return false;
+  // Values of other types order before or after every bound, so only a
+  // field holding the bound's type alone can be answered from the keys
+  const Class c = classOf(bound->type());
+  if (c == kNull || (upper && classOf(upper->type()) != c) || !onlyClass(c))
+    return false;
+  if (lower)
+    lo = InlineValue::fromValue(lower);
+  if (upper)
+    hi = InlineValue::fromValue(upper);
+  if ((lo && isNaN(*lo)) || (hi && isNaN(*hi)) || (c == kNumber && nanCount_))
+    return false;
+  if (lo)
+    lo = key(*lo);
+  if (hi)
+    hi = key(*hi);
+  return true;
+}
+
+std::optional<RoaringBitmap> FieldIndex::bitmapEq(const Value &rhs,
+                                                  bool &exact) const {
+  if (type_ != IndexType::Bitmap)
+    return std::nullopt;
+  // NaN compares equal to every number, and Null to Null
+  const InlineValue v = InlineValue::fromValue(&rhs);
+  if (v.type() == ValueType::Null || isNaN(v) ||
+      (classOf(v.type()) == kNumber && nanCount_))
+    return std::nullopt;
+  exact = !wideCount_ && !isWideInt(v);
+  auto it = bitmaps_.find(key(v));
+  return it == bitmaps_.end() ? RoaringBitmap() : it->second;
+}
+
+std::optional<RoaringBitmap>
+FieldIndex::bitmapRange(const Value *lower, bool lowerOpen,
+                        const Value *upper, bool upperOpen,
+                        bool &exact) const {
+  std::optional<InlineValue> lo, hi;
+  if (type_ != IndexType::Bitmap || !rangeKeys(lower, upper, lo, hi))
+    return std::nullopt;
+  exact = !wideCount_ && !(lo && isWideInt(InlineValue::fromValue(lower))) &&
+          !(hi && isWideInt(InlineValue::fromValue(upper)));
+  RoaringBitmap out;
+  // An empty range yields no documents
+  if (lo && hi) {
+    const int c = hi->compare(*lo);
+    if (c < 0 || (c == 0 && (lowerOpen || upperOpen)))
+      return out;
+  }
+  auto begin = !lo       ? bitmaps_.begin()
+               : lowerOpen ? bitmaps_.upper_bound(*lo)
+                           : bitmaps_.lower_bound(*lo);
+  auto end = !hi       ? bitmaps_.end()
+             : upperOpen ? bitmaps_.lower_bound(*hi)
+                         : bitmaps_.upper_bound(*hi);
+  for (auto it = begin; it != end; ++it)
+    out |= it->second;
+  return out;
+}
+
+// DocOrdinals
+
+uint32_t DocOrdinals::assign(Key key) {
+  auto [it, added] = ordinals_.emplace(key, 0);
+  if (!added)
+    return it->second;
+  if (free_.empty()) {
+    it->second = static_cast<uint32_t>(keys_.size());
+    keys_.push_back(key);
+  } else {
+    it->second = free_.back();
+    free_.pop_back();
+    keys_[it->second] = key;
+  }
+  all_.add(it->second);
+  return it->second;
+}
+
+void DocOrdinals::release(Key key) {
+  auto it = ordinals_.find(key);
+  if (it == ordinals_.end())
+    return;
+  keys_[it->second] = nullptr;
+  free_.push_back(it->second);
+  all_.remove(it->second);
+  ordinals_.erase(it);
+}
+
+void DocOrdinals::clear() {
+  ordinals_.clear();
+  keys_.clear();
+  free_.clear();
+  all_.clear();
+}
+
+} // namespace kadedb
@@ -1,9 +1,107 @@
 #include "kadedb/kadeql_ast.h"
+
+#include <algorithm>
 #include <sstream>
 
 namespace kadedb {
 namespace kadeql {
 
+namespace {
+
+// Chunks grow from the first size to the largest by doubling
+constexpr size_t kFirstChunk = 4096;
+constexpr size_t kLargestChunk = 64 * 1024;
+constexpr size_t kAlign = alignof(std::max_align_t);
+
+// Each node is preceded by a header saying where its memory came from
+constexpr size_t kNodeHeader = kAlign;
+constexpr unsigned char kHeapNode = 0;
+constexpr unsigned char kArenaNode = 1;
+
+thread_local AstArena::Scope *t_scope = nullptr;
+
+} // namespace
+
+void *AstArena::allocate(size_t size) {
+  size = (size + kAlign - 1) & ~(kAlign - 1);
+  if (static_cast<size_t>(end_ - next_) < size) {
+    const size_t grown =
+        chunks_.empty() ? kFirstChunk
+                        : std::min(kLargestChunk, 2 * chunk_size_);
+    const size_t chunk = std::max(grown, size);
+    chunks_.emplace_back(new char[chunk]);
+    chunk_size_ = grown;
+    next_ = chunks_.back().get();
+    end_ = next_ + chunk;
+  }
+  void *p = next_;
+  next_ += size;
+  bytes_ += size;
+  return p;
+}
+
+const std::string &AstArena::intern(std::string_view text) {
+  auto it = interned_.find(text);
+  if (it != interned_.end())
+    return *it->second;
+  const std::string &copy = strings_.emplace_back(text);
+  interned_.emplace(copy, &copy);
+  return copy;
+}
+
+AstArena::Scope::Scope(std::shared_ptr<AstArena> arena)
+    : arena_(std::move(arena)), previous_(t_scope) {
+  t_scope = this;
+}
+
+AstArena::Scope::~Scope() { t_scope = previous_; }
+
+const std::shared_ptr<AstArena> *AstArena::active() {
+  return t_scope ? &t_scope->arena_ : nullptr;
+}
+
+void *ASTNode::operator new(size_t size) {
+  const std::shared_ptr<AstArena> *arena = AstArena::active();
+  char *p = static_cast<char *>(arena ? (*arena)->allocate(kNodeHeader + size)
+                                      : ::operator new(kNodeHeader + size));
+  *p = arena ? kArenaNode : kHeapNode;
+  return p + kNodeHeader;
+}
+
+void ASTNode::operator delete(void *p) {
+  if (!p)
+    return;
+  // Arena memory goes away with its arena
+  char *base = static_cast<char *>(p) - kNodeHeader;
+  if (*base == kHeapNode)
+    ::operator delete(base);
+}
+
+Statement::Statement() {
+  if (const std::shared_ptr<AstArena> *arena = AstArena::active())
+    arena_ = *arena;
+}
+
+IdentifierExpression::IdentifierExpression(const std::string &name) {
+  if (const std::shared_ptr<AstArena> *arena = AstArena::active()) {
+    name_ = &(*arena)->intern(name);
+  } else {
+    owned_ = name;
+    name_ = &owned_;
+  }
+}
+
+FunctionCallExpression::FunctionCallExpression(
+    std::string name, std::vector<std::unique_ptr<Expression>> args)
+    : args_(std::move(args)) {
+  if (const std::shared_ptr<AstArena> *arena = AstArena::active()) {
+    name_ = &(*arena)->intern(name);
+  } else {
+    owned_ = std::move(name);
+    name_ = &owned_;
+  }
+}
+
 std::string LiteralExpression::toString() const {
   return std::visit(
       [](const auto &value) -> std::string {
@@ -17,6 +115,10 @@ std::string LiteralExpression::toString() const {
       value_);
 }
 
+std::string ParameterExpression::toString() const {
+  return "$" + std::to_string(index_ + 1);
+}
+
 std::string UnaryExpression::toString() const {
   std::ostringstream oss;
   switch (operator_) {
@@ -96,7 +198,7 @@ std::string BetweenExpression::toString() const {
 
 std::string FunctionCallExpression::toString() const {
   std::ostringstream oss;
-  oss << name_ << "(";
+  oss << *name_ << "(";
   for (size_t i = 0; i < args_.size(); ++i) {
     if (i > 0)
       oss << ", ";
@@ -123,6 +225,16 @@ std::string SelectItem::toString() const {
   return oss.str();
 }
 
+std::string JoinClause::toString() const {
+  std::string out = type == Type::Left ? "LEFT JOIN " : "JOIN ";
+  out += table;
+  if (!alias.empty())
+    out += " AS " + alias;
+  if (on)
+    out += " ON " + on->toString();
+  return out;
+}
+
 std::string SelectStatement::toString() const {
   std::ostringstream oss;
   oss << "SELECT ";
@@ -145,14 +257,49 @@ std::string SelectStatement::toString() const {
   }
 
   oss << " FROM " << table_name_;
+  if (!table_alias_.empty())
+    oss << " AS " << table_alias_;
+  for (const auto &join : joins_)
+    oss << " " << join.toString();
 
   if (where_clause_) {
     oss << " WHERE " << where_clause_->toString();
   }
 
+  if (!group_by_.empty()) {
+    oss << " GROUP BY ";
+    for (size_t i = 0; i < group_by_.size(); ++i) {
+      if (i > 0)
+        oss << ", ";
+      oss << group_by_[i]->toString();
+    }
+  }
+  if (having_) {
+    oss << " HAVING " << having_->toString();
+  }
+
+  if (!order_by_.empty()) {
+    oss << " ORDER BY ";
+    for (size_t i = 0; i < order_by_.size(); ++i) {
+      if (i > 0)
+        oss << ", ";
+      oss << order_by_[i].toString();
+    }
+  }
+  if (limit_) {
+    oss << " LIMIT " << *limit_;
+  }
+  if (offset_ > 0) {
+    oss << " OFFSET " << offset_;
+  }
+
   return oss.str();
 }
 
+std::string OrderByItem::toString() const {
+  return descending ? column + " DESC" : column;
+}
+
 std::string InsertStatement::toString() const {
   std::ostringstream oss;
   oss << "INSERT INTO " << table_name_;
@@ -181,6 +328,21 @@ std::string InsertStatement::toString() const {
     oss << ")";
   }
 
+  if (on_conflict_) {
+    oss << " ON CONFLICT (" << on_conflict_->column << ") DO ";
+    if (on_conflict_->doNothing) {
+      oss << "NOTHING";
+    } else {
+      oss << "UPDATE SET ";
+      const auto &assigns = on_conflict_->assignments;
+      for (size_t i = 0; i < assigns.size(); ++i) {
+        if (i > 0)
+          oss << ", ";
+        oss << assigns[i].first << " = " << assigns[i].second->toString();
+      }
+    }
+  }
+
   return oss.str();
 }
 
@@ -212,5 +374,10 @@ std::string DeleteStatement::toString() const {
   return oss.str();
 }
 
+std::string ExplainStatement::toString() const {
+  return std::string(analyze_ ? "EXPLAIN ANALYZE " : "EXPLAIN ") +
+         statement_->toString();
+}
+
 } // namespace kadeql
 } // namespace kadedb
@@ -1,4 +1,6 @@
 #include "kadedb/kadeql_parser.h"
+#include "kadedb/tracing.h"
+#include <cctype>
 #include <sstream>
 #include <stdexcept>
 
@@ -6,7 +8,13 @@ namespace kadedb {
 namespace kadeql {
 
 std::unique_ptr<Statement> KadeQLParser::parse(const std::string &query) {
+  tracing::Span span("kadeql.parse");
+  // The statement's nodes come from one arena, which the statement keeps
+  AstArena::Scope scope(std::make_shared<AstArena>());
   tokenizer_ = std::make_unique<Tokenizer>(query);
+  parameters_.clear();
+  positional_ = 0;
+  numbered_ = false;
   advance(); // Initialize current_token_
 
   try {
@@ -19,13 +27,16 @@ std::unique_ptr<Statement> KadeQLParser::parse(const std::string &query) {
 
     // Ensure we've consumed all tokens
     if (!isAtEnd()) {
-      error("Unexpected token after statement: " + current_token_.value);
+      error("Unexpected token after statement: " +
+            std::string(current_token_.value));
     }
 
     return statement;
   } catch (const ParseError &e) {
+    span.fail();
     throw;
   } catch (const std::exception &e) {
+    span.fail();
     error("Parse error: " + std::string(e.what()));
     return nullptr; // Never reached due to error() throwing
   }
@@ -40,9 +51,15 @@ std::unique_ptr<Statement> KadeQLParser::parseStatement() {
     return parseUpdateStatement();
   } else if (match(TokenType::DELETE_)) {
     return parseDeleteStatement();
+  } else if (match(TokenType::EXPLAIN)) {
+    const bool analyze = match(TokenType::ANALYZE);
+    if (check(TokenType::EXPLAIN))
+      error("EXPLAIN cannot be nested");
+    return std::make_unique<ExplainStatement>(parseStatement(), analyze);
   } else {
-    error("Expected SELECT, INSERT, UPDATE or DELETE statement, got: " +
-          current_token_.value);
+    error("Expected SELECT, INSERT, UPDATE, DELETE or EXPLAIN statement, "
+          "got: " +
+          std::string(current_token_.value));
     return nullptr; // Never reached
   }
 }
@@ -60,17 +77,24 @@ std::unique_ptr<SelectStatement> KadeQLParser::parseSelectStatement() {
     columns.push_back("*");
 
     consume(TokenType::FROM, "Expected FROM after column list");
-    Token table_token =
-        consume(TokenType::IDENTIFIER, "Expected table name after FROM");
-    std::string table_name = table_token.value;
+    std::string table_name, table_alias;
+    std::vector<JoinClause> joins;
+    parseFromClause(table_name, table_alias, joins);
 
     std::unique_ptr<Expression> where_clause = nullptr;
     if (match(TokenType::WHERE)) {
       where_clause = parseExpression();
     }
+    if (check(TokenType::GROUP) || check(TokenType::HAVING)) {
+      error("SELECT * cannot be used with GROUP BY or HAVING");
+    }
 
-    return std::make_unique<SelectStatement>(
+    auto select = std::make_unique<SelectStatement>(
         std::move(columns), std::move(table_name), std::move(where_clause));
+    select->setTableAlias(std::move(table_alias));
+    select->setJoins(std::move(joins));
+    parseOrderByLimit(*select);
+    return select;
   }
 
   // Parse first select item (expression with optional alias)
@@ -111,10 +135,10 @@ std::unique_ptr<SelectStatement> KadeQLParser::parseSelectStatement() {
   // Expect FROM
   consume(TokenType::FROM, "Expected FROM after column list");
 
-  // Parse table name
-  Token table_token =
-      consume(TokenType::IDENTIFIER, "Expected table name after FROM");
-  std::string table_name = table_token.value;
+  // Table name, alias and joins
+  std::string table_name, table_alias;
+  std::vector<JoinClause> joins;
+  parseFromClause(table_name, table_alias, joins);
 
   // Optional WHERE clause
   std::unique_ptr<Expression> where_clause = nullptr;
@@ -122,28 +146,137 @@ std::unique_ptr<SelectStatement> KadeQLParser::parseSelectStatement() {
     where_clause = parseExpression();
   }
 
-  // If we have expressions (function calls, aliases, etc.), use expression mode
-  if (has_expressions) {
-    return std::make_unique<SelectStatement>(
-        std::move(select_items), std::move(table_name), std::move(where_clause),
-        true /*expr_tag*/);
+  // Optional GROUP BY / HAVING
+  std::vector<std::unique_ptr<Expression>> group_by;
+  std::unique_ptr<Expression> having;
+  parseGroupByHaving(group_by, having);
+  if (!group_by.empty() || having) {
+    has_expressions = true;
   }
 
+  // If we have expressions (function calls, aliases, etc.), use expression mode
   // Otherwise, convert to legacy column-name mode for backward compatibility
   std::vector<std::string> columns;
   for (const auto &item : select_items) {
+    if (has_expressions)
+      break;
     if (auto id = dynamic_cast<IdentifierExpression *>(item.expr.get())) {
       columns.push_back(id->getName());
     } else {
       // Fallback: use expression mode if we can't extract simple column names
-      return std::make_unique<SelectStatement>(
-          std::move(select_items), std::move(table_name),
-          std::move(where_clause), true /*expr_tag*/);
+      has_expressions = true;
+    }
+  }
+
+  std::unique_ptr<SelectStatement> select;
+  if (has_expressions) {
+    select = std::make_unique<SelectStatement>(
+        std::move(select_items), std::move(table_name), std::move(where_clause),
+        true /*expr_tag*/);
+  } else {
+    select = std::make_unique<SelectStatement>(
+        std::move(columns), std::move(table_name), std::move(where_clause));
+  }
+  select->setTableAlias(std::move(table_alias));
+  select->setJoins(std::move(joins));
+  select->setGroupBy(std::move(group_by));
+  select->setHaving(std::move(having));
+  parseOrderByLimit(*select);
+  return select;
+}
+
+// [GROUP BY expr {, expr}] [HAVING expr]
+void KadeQLParser::parseGroupByHaving(
+    std::vector<std::unique_ptr<Expression>> &group_by,
+    std::unique_ptr<Expression> &having) {
+  if (match(TokenType::GROUP)) {
+    consume(TokenType::BY, "Expected BY after GROUP");
+    do {
+      group_by.push_back(parseExpression());
+    } while (match(TokenType::COMMA));
+  }
+  if (match(TokenType::HAVING)) {
+    having = parseExpression();
+  }
+}
+
+// <table> [[AS] alias] {[INNER | LEFT [OUTER]] JOIN <table> [[AS] alias]
+//   ON <expr>}
+void KadeQLParser::parseFromClause(std::string &table, std::string &alias,
+                                   std::vector<JoinClause> &joins) {
+  table =
+      consume(TokenType::IDENTIFIER, "Expected table name after FROM").value;
+  alias = parseTableAlias();
+  while (true) {
+    JoinClause join;
+    if (match(TokenType::LEFT)) {
+      match(TokenType::OUTER);
+      consume(TokenType::JOIN, "Expected JOIN after LEFT");
+      join.type = JoinClause::Type::Left;
+    } else if (match(TokenType::INNER)) {
+      consume(TokenType::JOIN, "Expected JOIN after INNER");
+    } else if (!match(TokenType::JOIN)) {
+      break;
     }
+    join.table =
+        consume(TokenType::IDENTIFIER, "Expected table name after JOIN").value;
+    join.alias = parseTableAlias();
+    consume(TokenType::ON, "Expected ON after JOIN table");
+    join.on = parseExpression();
+    joins.push_back(std::move(join));
+  }
+  if (!alias.empty() && joins.empty())
+    error("Table aliases are only supported in JOIN queries");
+}
+
+// [[AS] alias] after a table name; empty when absent
+std::string KadeQLParser::parseTableAlias() {
+  if (match(TokenType::AS))
+    return std::string(
+        consume(TokenType::IDENTIFIER, "Expected alias after AS").value);
+  if (check(TokenType::IDENTIFIER)) {
+    std::string alias(current_token_.value);
+    advance();
+    return alias;
+  }
+  return std::string();
+}
+
+// [ORDER BY col [ASC|DESC] {, col [ASC|DESC]}] [LIMIT n] [OFFSET m]
+void KadeQLParser::parseOrderByLimit(SelectStatement &select) {
+  if (match(TokenType::ORDER)) {
+    consume(TokenType::BY, "Expected BY after ORDER");
+    std::vector<OrderByItem> keys;
+    do {
+      Token col =
+          consume(TokenType::IDENTIFIER, "Expected column name in ORDER BY");
+      OrderByItem key;
+      key.column = col.value;
+      if (match(TokenType::DESC)) {
+        key.descending = true;
+      } else {
+        match(TokenType::ASC);
+      }
+      keys.push_back(std::move(key));
+    } while (match(TokenType::COMMA));
+    select.setOrderBy(std::move(keys));
   }
 
-  return std::make_unique<SelectStatement>(
-      std::move(columns), std::move(table_name), std::move(where_clause));
+  // Row counts must be non-negative integer literals
+  auto count = [&](const char *clause) -> size_t {
+    Token tok = consume(TokenType::NUMBER_LITERAL,
+                        std::string("Expected row count after ") + clause);
+    if (tok.value.find_first_not_of("0123456789") != std::string::npos) {
+      error(std::string(clause) + " requires a non-negative integer");
+    }
+    return static_cast<size_t>(std::stoull(std::string(tok.value)));
+  };
+  if (match(TokenType::LIMIT)) {
+    select.setLimit(count("LIMIT"));
+  }
+  if (match(TokenType::OFFSET)) {
+    select.setOffset(count("OFFSET"));
+  }
 }
 
 std::unique_ptr<InsertStatement> KadeQLParser::parseInsertStatement() {
@@ -153,7 +286,7 @@ std::unique_ptr<InsertStatement> KadeQLParser::parseInsertStatement() {
   // Parse table name
   Token table_token =
       consume(TokenType::IDENTIFIER, "Expected table name after INTO");
-  std::string table_name = table_token.value;
+  std::string table_name(table_token.value);
 
   // Optional column list
   std::vector<std::string> columns;
@@ -189,8 +322,31 @@ std::unique_ptr<InsertStatement> KadeQLParser::parseInsertStatement() {
     }
   }
 
+  // Optional ON CONFLICT (column) DO NOTHING | DO UPDATE SET ...
+  std::optional<InsertStatement::OnConflict> on_conflict;
+  if (match(TokenType::ON)) {
+    if (!matchWord("CONFLICT"))
+      error("Expected CONFLICT after ON");
+    InsertStatement::OnConflict oc;
+    consume(TokenType::LPAREN, "Expected '(' after ON CONFLICT");
+    oc.column = std::string(
+        consume(TokenType::IDENTIFIER, "Expected conflict column").value);
+    consume(TokenType::RPAREN, "Expected ')' after conflict column");
+    if (!matchWord("DO"))
+      error("Expected DO after ON CONFLICT (...)");
+    if (matchWord("NOTHING")) {
+      oc.doNothing = true;
+    } else {
+      consume(TokenType::UPDATE, "Expected NOTHING or UPDATE after DO");
+      consume(TokenType::SET, "Expected SET after DO UPDATE");
+      oc.assignments = parseAssignments();
+    }
+    on_conflict = std::move(oc);
+  }
+
   return std::make_unique<InsertStatement>(
-      std::move(table_name), std::move(columns), std::move(values));
+      std::move(table_name), std::move(columns), std::move(values),
+      std::move(on_conflict));
 }
 
 std::unique_ptr<Expression> KadeQLParser::parseExpression() {
@@ -308,22 +464,12 @@ std::unique_ptr<UpdateStatement> KadeQLParser::parseUpdateStatement() {
   // UPDATE <table>
   Token table_token =
       consume(TokenType::IDENTIFIER, "Expected table name after UPDATE");
-  std::string table_name = table_token.value;
+  std::string table_name(table_token.value);
 
   // SET
   consume(TokenType::SET, "Expected SET in UPDATE statement");
 
-  // Parse assignments: col = expr (, col = expr)*
-  std::vector<UpdateStatement::Assignment> assigns;
-  while (true) {
-    Token colTok =
-        consume(TokenType::IDENTIFIER, "Expected column name in SET");
-    consume(TokenType::EQUALS, "Expected '=' in assignment");
-    auto expr = parseExpression();
-    assigns.emplace_back(colTok.value, std::move(expr));
-    if (!match(TokenType::COMMA))
-      break;
-  }
+  auto assigns = parseAssignments();
 
   // Optional WHERE
   std::unique_ptr<Expression> where_clause = nullptr;
@@ -335,12 +481,27 @@ std::unique_ptr<UpdateStatement> KadeQLParser::parseUpdateStatement() {
       std::move(table_name), std::move(assigns), std::move(where_clause));
 }
 
+std::vector<std::pair<std::string, std::unique_ptr<Expression>>>
+KadeQLParser::parseAssignments() {
+  std::vector<std::pair<std::string, std::unique_ptr<Expression>>> assigns;
+  while (true) {
+    Token colTok =
+        consume(TokenType::IDENTIFIER, "Expected column name in SET");
+    consume(TokenType::EQUALS, "Expected '=' in assignment");
+    auto expr = parseExpression();
+    assigns.emplace_back(colTok.value, std::move(expr));
+    if (!match(TokenType::COMMA))
+      break;
+  }
+  return assigns;
+}
+
 std::unique_ptr<DeleteStatement> KadeQLParser::parseDeleteStatement() {
   // DELETE FROM <table>
   consume(TokenType::FROM, "Expected FROM after DELETE");
   Token table_token =
       consume(TokenType::IDENTIFIER, "Expected table name after FROM");
-  std::string table_name = table_token.value;
+  std::string table_name(table_token.value);
 
   // Optional WHERE
   std::unique_ptr<Expression> where_clause = nullptr;
@@ -356,7 +517,7 @@ std::unique_ptr<Expression> KadeQLParser::parsePrimary() {
   if (check(TokenType::STRING_LITERAL)) {
     Token token = current_token_;
     advance();
-    return std::make_unique<LiteralExpression>(token.value);
+    return std::make_unique<LiteralExpression>(std::string(token.value));
   }
 
   if (check(TokenType::NUMBER_LITERAL)) {
@@ -365,18 +526,42 @@ std::unique_ptr<Expression> KadeQLParser::parsePrimary() {
     // Try to parse as integer first, then as double
     try {
       if (token.value.find('.') != std::string::npos) {
-        double value = std::stod(token.value);
+        double value = std::stod(std::string(token.value));
         return std::make_unique<LiteralExpression>(value);
       } else {
-        int64_t value = std::stoll(token.value);
+        int64_t value = std::stoll(std::string(token.value));
         return std::make_unique<LiteralExpression>(value);
       }
     } catch (const std::exception &) {
-      error("Invalid number format: " + token.value);
+      error("Invalid number format: " + std::string(token.value));
       return nullptr; // Never reached
     }
   }
 
+  if (check(TokenType::PARAMETER)) {
+    Token token = current_token_;
+    advance();
+    size_t index = 0;
+    if (token.value == "?") {
+      index = positional_++;
+    } else {
+      unsigned long long n = 0;
+      try {
+        n = std::stoull(std::string(token.value.substr(1)));
+      } catch (const std::exception &) {
+      }
+      if (n == 0 || n > kMaxParameters)
+        error("Invalid parameter number: " + std::string(token.value));
+      index = static_cast<size_t>(n - 1);
+      numbered_ = true;
+    }
+    if (numbered_ && positional_ > 0)
+      error("Cannot mix ? and $n parameters in one statement");
+    auto param = std::make_unique<ParameterExpression>(index);
+    parameters_.push_back(param.get());
+    return param;
+  }
+
   if (check(TokenType::IDENTIFIER)) {
     Token token = current_token_;
     advance();
@@ -384,14 +569,15 @@ std::unique_ptr<Expression> KadeQLParser::parsePrimary() {
     if (check(TokenType::LPAREN)) {
       advance(); // consume '('
       std::vector<std::unique_ptr<Expression>> args;
-      if (!check(TokenType::RPAREN)) {
+      // f(*) (e.g. COUNT(*)) is parsed as a call without arguments
+      if (!match(TokenType::ASTERISK) && !check(TokenType::RPAREN)) {
         args = parseExpressionList();
       }
       consume(TokenType::RPAREN, "Expected ')' after function arguments");
-      return std::make_unique<FunctionCallExpression>(token.value,
+      return std::make_unique<FunctionCallExpression>(std::string(token.value),
                                                       std::move(args));
     }
-    return std::make_unique<IdentifierExpression>(token.value);
+    return std::make_unique<IdentifierExpression>(std::string(token.value));
   }
 
   if (match(TokenType::LPAREN)) {
@@ -400,7 +586,7 @@ std::unique_ptr<Expression> KadeQLParser::parsePrimary() {
     return expr;
   }
 
-  error("Expected expression, got: " + current_token_.value);
+  error("Expected expression, got: " + std::string(current_token_.value));
   return nullptr; // Never reached
 }
 
@@ -415,13 +601,13 @@ std::vector<std::string> KadeQLParser::parseColumnList() {
 
   // Parse first column
   Token column_token = consume(TokenType::IDENTIFIER, "Expected column name");
-  columns.push_back(column_token.value);
+  columns.emplace_back(column_token.value);
 
   // Parse additional columns
   while (match(TokenType::COMMA)) {
     column_token =
         consume(TokenType::IDENTIFIER, "Expected column name after ','");
-    columns.push_back(column_token.value);
+    columns.emplace_back(column_token.value);
   }
 
   return columns;
@@ -451,13 +637,13 @@ std::vector<std::string> KadeQLParser::parseIdentifierList() {
 
   // Parse first identifier
   Token id = consume(TokenType::IDENTIFIER, "Expected identifier");
-  identifiers.push_back(id.value);
+  identifiers.emplace_back(id.value);
 
   // Parse additional identifiers
   while (match(TokenType::COMMA)) {
     Token next =
         consume(TokenType::IDENTIFIER, "Expected identifier after ','");
-    identifiers.push_back(next.value);
+    identifiers.emplace_back(next.value);
   }
 
   return identifiers;
@@ -491,6 +677,18 @@ bool KadeQLParser::match(TokenType type) {
   return false;
 }
 
+bool KadeQLParser::matchWord(std::string_view word) {
+  if (!check(TokenType::IDENTIFIER) ||
+      current_token_.value.size() != word.size())
+    return false;
+  for (size_t i = 0; i < word.size(); ++i)
+    if (std::toupper(static_cast<unsigned char>(current_token_.value[i])) !=
+        word[i])
+      return false;
+  advance();
+  return true;
+}
+
 bool KadeQLParser::check(TokenType type) const {
   if (isAtEnd())
     return false;
@@ -504,7 +702,7 @@ Token KadeQLParser::consume(TokenType type, const std::string &message) {
     return token;
   }
 
-  error(message + ", got: " + current_token_.value);
+  error(message + ", got: " + std::string(current_token_.value));
   return Token(); // Never reached
 }
 
@@ -5,20 +5,95 @@
 namespace kadedb {
 namespace kadeql {
 
-// Initialize keyword mapping
-const std::unordered_map<std::string, TokenType> Tokenizer::keywords_ = {
+namespace {
+
+// Keywords by a perfect hash of their first two letters and length, so
+// an identifier is classified with one probe and one compare
+struct Keyword {
+  const char *word;
+  TokenType type;
+};
+
+constexpr Keyword kKeywords[] = {
     {"SELECT", TokenType::SELECT},   {"FROM", TokenType::FROM},
     {"WHERE", TokenType::WHERE},     {"INSERT", TokenType::INSERT},
     {"INTO", TokenType::INTO},       {"VALUES", TokenType::VALUES},
     {"UPDATE", TokenType::UPDATE},   {"DELETE", TokenType::DELETE_},
     {"SET", TokenType::SET},         {"NOT", TokenType::NOT},
     {"AND", TokenType::AND},         {"OR", TokenType::OR},
-    {"BETWEEN", TokenType::BETWEEN}, {"AS", TokenType::AS}};
+    {"BETWEEN", TokenType::BETWEEN}, {"AS", TokenType::AS},
+    {"ORDER", TokenType::ORDER},     {"BY", TokenType::BY},
+    {"ASC", TokenType::ASC},         {"DESC", TokenType::DESC},
+    {"LIMIT", TokenType::LIMIT},     {"OFFSET", TokenType::OFFSET},
+    {"JOIN", TokenType::JOIN},       {"INNER", TokenType::INNER},
+    {"LEFT", TokenType::LEFT},       {"OUTER", TokenType::OUTER},
+    {"ON", TokenType::ON},           {"GROUP", TokenType::GROUP},
+    {"HAVING", TokenType::HAVING},   {"EXPLAIN", TokenType::EXPLAIN},
+    {"ANALYZE", TokenType::ANALYZE}};
+
+constexpr size_t kMinKeyword = 2;
+constexpr size_t kMaxKeyword = 7;
+constexpr size_t kSlots = 64;
+
+constexpr char asciiUpper(char c) {
+  return c >= 'a' && c <= 'z' ? static_cast<char>(c - 'a' + 'A') : c;
+}
+
+constexpr size_t length(const char *s) {
+  size_t n = 0;
+  while (s[n])
+    ++n;
+  return n;
+}
 
-Tokenizer::Tokenizer(const std::string &input)
+// Collision-free for kKeywords (checked below); needs two characters
+constexpr size_t keywordSlot(char c0, char c1, size_t len) {
+  return (7 * static_cast<unsigned char>(asciiUpper(c0)) +
+          26 * static_cast<unsigned char>(asciiUpper(c1)) + 3 * len) %
+         kSlots;
+}
+
+struct KeywordTable {
+  // Index into kKeywords plus one; 0 for an empty slot
+  unsigned char slot[kSlots] = {};
+  bool perfect = true;
+
+  constexpr KeywordTable() {
+    for (size_t i = 0; i < sizeof(kKeywords) / sizeof(kKeywords[0]); ++i) {
+      const char *w = kKeywords[i].word;
+      const size_t h = keywordSlot(w[0], w[1], length(w));
+      if (slot[h] != 0)
+        perfect = false;
+      slot[h] = static_cast<unsigned char>(i + 1);
+    }
+  }
+};
+
+constexpr KeywordTable kKeywordTable;
+static_assert(kKeywordTable.perfect, "keyword hash has a collision");
+
+} // namespace
+
+Tokenizer::Tokenizer(std::string_view input)
     : input_(input), current_pos_(0), current_line_(1), current_column_(1),
       has_peeked_(false) {}
 
+TokenType Tokenizer::keywordType(std::string_view word) {
+  if (word.size() < kMinKeyword || word.size() > kMaxKeyword)
+    return TokenType::IDENTIFIER;
+  const unsigned char e =
+      kKeywordTable.slot[keywordSlot(word[0], word[1], word.size())];
+  if (e == 0)
+    return TokenType::IDENTIFIER;
+  const Keyword &kw = kKeywords[e - 1];
+  for (size_t i = 0; i < word.size(); ++i) {
+    // A keyword's terminating NUL never matches, so lengths agree too
+    if (asciiUpper(word[i]) != kw.word[i])
+      return TokenType::IDENTIFIER;
+  }
+  return kw.word[word.size()] == '\0' ? kw.type : TokenType::IDENTIFIER;
+}
+
 Token Tokenizer::next() {
   if (has_peeked_) {
     has_peeked_ = false;
@@ -27,8 +102,11 @@ Token Tokenizer::next() {
 
   skipWhitespace();
 
+  const size_t start = current_pos_;
+  const size_t line = current_line_;
+  const size_t column = current_column_;
   if (current_pos_ >= input_.length()) {
-    return makeToken(TokenType::END_OF_INPUT, "");
+    return makeToken(TokenType::END_OF_INPUT, start, line, column);
   }
 
   char c = currentChar();
@@ -52,55 +130,66 @@ Token Tokenizer::next() {
   switch (c) {
   case '=':
     advance();
-    return makeToken(TokenType::EQUALS, '=');
+    return makeToken(TokenType::EQUALS, start, line, column);
   case '<':
     advance();
     if (currentChar() == '=') {
       advance();
-      return makeToken(TokenType::LESS_EQUAL, "<=");
+      return makeToken(TokenType::LESS_EQUAL, start, line, column);
     }
-    return makeToken(TokenType::LESS_THAN, '<');
+    return makeToken(TokenType::LESS_THAN, start, line, column);
   case '>':
     advance();
     if (currentChar() == '=') {
       advance();
-      return makeToken(TokenType::GREATER_EQUAL, ">=");
+      return makeToken(TokenType::GREATER_EQUAL, start, line, column);
     }
-    return makeToken(TokenType::GREATER_THAN, '>');
+    return makeToken(TokenType::GREATER_THAN, start, line, column);
   case '!':
     advance();
     if (currentChar() == '=') {
       advance();
-      return makeToken(TokenType::NOT_EQUAL, "!=");
+      return makeToken(TokenType::NOT_EQUAL, start, line, column);
     }
-    return makeToken(TokenType::UNKNOWN, '!');
+    return makeToken(TokenType::UNKNOWN, start, line, column);
   case ',':
     advance();
-    return makeToken(TokenType::COMMA, ',');
+    return makeToken(TokenType::COMMA, start, line, column);
   case ';':
     advance();
-    return makeToken(TokenType::SEMICOLON, ';');
+    return makeToken(TokenType::SEMICOLON, start, line, column);
   case '(':
     advance();
-    return makeToken(TokenType::LPAREN, '(');
+    return makeToken(TokenType::LPAREN, start, line, column);
   case ')':
     advance();
-    return makeToken(TokenType::RPAREN, ')');
+    return makeToken(TokenType::RPAREN, start, line, column);
   case '*':
     advance();
-    return makeToken(TokenType::ASTERISK, '*');
+    return makeToken(TokenType::ASTERISK, start, line, column);
   case '+':
     advance();
-    return makeToken(TokenType::PLUS, '+');
+    return makeToken(TokenType::PLUS, start, line, column);
   case '-':
     advance();
-    return makeToken(TokenType::MINUS, '-');
+    return makeToken(TokenType::MINUS, start, line, column);
   case '/':
     advance();
-    return makeToken(TokenType::SLASH, '/');
+    return makeToken(TokenType::SLASH, start, line, column);
+  case '?':
+    advance();
+    return makeToken(TokenType::PARAMETER, start, line, column);
+  case '$':
+    // $n: the digits are the 1-based parameter number
+    advance();
+    while (current_pos_ < input_.length() && isDigit(currentChar()))
+      advance();
+    return makeToken(current_pos_ - start > 1 ? TokenType::PARAMETER
+                                              : TokenType::UNKNOWN,
+                     start, line, column);
   default:
     advance();
-    return makeToken(TokenType::UNKNOWN, c);
+    return makeToken(TokenType::UNKNOWN, start, line, column);
   }
 }
 
@@ -113,15 +202,12 @@ Token Tokenizer::peek() {
 }
 
 bool Tokenizer::hasMore() const {
-  // Create a temporary tokenizer to check if there are more non-whitespace
-  // tokens
-  Tokenizer temp(input_);
-  temp.current_pos_ = current_pos_;
-  temp.current_line_ = current_line_;
-  temp.current_column_ = current_column_;
-
-  temp.skipWhitespace();
-  return temp.current_pos_ < input_.length();
+  // Whether anything but whitespace is left
+  for (size_t pos = current_pos_; pos < input_.length(); ++pos) {
+    if (!isWhitespace(input_[pos]))
+      return true;
+  }
+  return false;
 }
 
 void Tokenizer::reset() {
@@ -145,6 +231,36 @@ std::string Tokenizer::tokenTypeToString(TokenType type) {
     return "BETWEEN";
   case TokenType::AS:
     return "AS";
+  case TokenType::ORDER:
+    return "ORDER";
+  case TokenType::BY:
+    return "BY";
+  case TokenType::ASC:
+    return "ASC";
+  case TokenType::DESC:
+    return "DESC";
+  case TokenType::LIMIT:
+    return "LIMIT";
+  case TokenType::OFFSET:
+    return "OFFSET";
+  case TokenType::JOIN:
+    return "JOIN";
+  case TokenType::INNER:
+    return "INNER";
+  case TokenType::LEFT:
+    return "LEFT";
+  case TokenType::OUTER:
+    return "OUTER";
+  case TokenType::ON:
+    return "ON";
+  case TokenType::GROUP:
+    return "GROUP";
+  case TokenType::HAVING:
+    return "HAVING";
+  case TokenType::EXPLAIN:
+    return "EXPLAIN";
+  case TokenType::ANALYZE:
+    return "ANALYZE";
   case TokenType::SELECT:
     return "SELECT";
   case TokenType::FROM:
@@ -163,6 +279,8 @@ std::string Tokenizer::tokenTypeToString(TokenType type) {
     return "STRING_LITERAL";
   case TokenType::NUMBER_LITERAL:
     return "NUMBER_LITERAL";
+  case TokenType::PARAMETER:
+    return "PARAMETER";
   case TokenType::EQUALS:
     return "EQUALS";
   case TokenType::LESS_THAN:
@@ -241,45 +359,44 @@ void Tokenizer::skipWhitespace() {
 
 Token Tokenizer::readString() {
   char quote_char = currentChar();
-  std::string value;
   size_t start_line = current_line_;
   size_t start_column = current_column_;
   size_t start_pos = current_pos_;
 
   advance(); // Skip opening quote
 
+  // Text without escapes is viewed where it is; the first escape switches
+  // to an unescaped copy
+  const size_t text_start = current_pos_;
+  std::shared_ptr<std::string> decoded;
   while (current_pos_ < input_.length() && currentChar() != quote_char) {
     if (currentChar() == '\\') {
+      if (!decoded)
+        decoded = std::make_shared<std::string>(
+            input_.substr(text_start, current_pos_ - text_start));
       advance();
       if (current_pos_ < input_.length()) {
         char escaped = currentChar();
         switch (escaped) {
         case 'n':
-          value += '\n';
+          *decoded += '\n';
           break;
         case 't':
-          value += '\t';
+          *decoded += '\t';
           break;
         case 'r':
-          value += '\r';
-          break;
-        case '\\':
-          value += '\\';
-          break;
-        case '\'':
-          value += '\'';
-          break;
-        case '"':
-          value += '"';
+          *decoded += '\r';
           break;
         default:
-          value += escaped;
+          // \\, \', \" and unknown escapes stand for the character
+          *decoded += escaped;
           break;
         }
         advance();
       }
     } else {
-      value += currentChar();
+      if (decoded)
+        *decoded += currentChar();
       advance();
     }
   }
@@ -290,72 +407,84 @@ Token Tokenizer::readString() {
                              std::to_string(start_column));
   }
 
+  Token token(TokenType::STRING_LITERAL,
+              input_.substr(text_start, current_pos_ - text_start),
+              start_line, start_column, start_pos);
+  if (decoded) {
+    token.value = *decoded;
+    token.decoded = std::move(decoded);
+  }
   advance(); // Skip closing quote
-
-  return Token(TokenType::STRING_LITERAL, value, start_line, start_column,
-               start_pos);
+  return token;
 }
 
 Token Tokenizer::readNumber() {
-  std::string value;
   size_t start_line = current_line_;
   size_t start_column = current_column_;
   size_t start_pos = current_pos_;
 
   while (current_pos_ < input_.length() &&
          (isDigit(currentChar()) || currentChar() == '.')) {
-    value += currentChar();
     advance();
   }
 
-  return Token(TokenType::NUMBER_LITERAL, value, start_line, start_column,
-               start_pos);
+  return makeToken(TokenType::NUMBER_LITERAL, start_pos, start_line,
+                   start_column);
 }
 
 Token Tokenizer::readIdentifierOrKeyword() {
-  std::string value;
   size_t start_line = current_line_;
   size_t start_column = current_column_;
   size_t start_pos = current_pos_;
 
   while (current_pos_ < input_.length() &&
          (isAlphaNumeric(currentChar()) || currentChar() == '_')) {
-    value += currentChar();
     advance();
   }
-
-  // Convert to uppercase for keyword lookup
-  std::string upper_value = value;
-  for (char &c : upper_value) {
-    c = std::toupper(c);
+  // Qualified column reference: table.column
+  if (current_pos_ + 1 < input_.length() && currentChar() == '.' &&
+      (isAlpha(input_[current_pos_ + 1]) || input_[current_pos_ + 1] == '_')) {
+    advance();
+    while (current_pos_ < input_.length() &&
+           (isAlphaNumeric(currentChar()) || currentChar() == '_')) {
+      advance();
+    }
+    return makeToken(TokenType::IDENTIFIER, start_pos, start_line,
+                     start_column);
   }
 
-  auto it = keywords_.find(upper_value);
-  TokenType type = (it != keywords_.end()) ? it->second : TokenType::IDENTIFIER;
-
-  return Token(type, value, start_line, start_column, start_pos);
+  Token token =
+      makeToken(TokenType::IDENTIFIER, start_pos, start_line, start_column);
+  token.type = keywordType(token.value);
+  return token;
 }
 
 Token Tokenizer::readOperator() {
   // This method is currently unused but could be extended for complex operators
-  return makeToken(TokenType::UNKNOWN, "");
+  return makeToken(TokenType::UNKNOWN, current_pos_, current_line_,
+                   current_column_);
 }
 
-bool Tokenizer::isAlpha(char c) const { return std::isalpha(c); }
-
-bool Tokenizer::isDigit(char c) const { return std::isdigit(c); }
+bool Tokenizer::isAlpha(char c) const {
+  return std::isalpha(static_cast<unsigned char>(c));
+}
 
-bool Tokenizer::isAlphaNumeric(char c) const { return std::isalnum(c); }
+bool Tokenizer::isDigit(char c) const {
+  return std::isdigit(static_cast<unsigned char>(c));
+}
 
-bool Tokenizer::isWhitespace(char c) const { return std::isspace(c); }
+bool Tokenizer::isAlphaNumeric(char c) const {
+  return std::isalnum(static_cast<unsigned char>(c));
+}
 
-Token Tokenizer::makeToken(TokenType type, const std::string &value) const {
-  return Token(type, value, current_line_, current_column_, current_pos_);
+bool Tokenizer::isWhitespace(char c) const {
+  return std::isspace(static_cast<unsigned char>(c));
 }
 
-Token Tokenizer::makeToken(TokenType type, char value) const {
-  return Token(type, std::string(1, value), current_line_, current_column_,
-               current_pos_);
+Token Tokenizer::makeToken(TokenType type, size_t start, size_t line,
+                           size_t column) const {
+  return Token(type, input_.substr(start, current_pos_ - start), line, column,
+               start);
 }
 
 } // namespace kadeql
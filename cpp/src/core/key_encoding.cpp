@@ -0,0 +1,153 @@
+#include "kadedb/key_encoding.h"
+
+#include <cstring>
+#include <limits>
+
+namespace kadedb {
+namespace keycode {
+
+namespace {
+enum Tag : uint8_t {
+  kAbsent = 0x00,
+  kNull = 0x01,
+  kNumber = 0x02,
+  kString = 0x03,
+  kBoolean = 0x04,
+};
+
+// Positive doubles get the sign bit set; negative ones have every bit
+// flipped, reversing their order
+void appendDouble(std::string &out, double d) {
+  if (d == 0)
+    d = 0; // -0.0 == 0.0
+  else if (d != d)
+    d = std::numeric_limits<double>::quiet_NaN();
+  uint64_t bits;
+  std::memcpy(&bits, &d, sizeof bits);
+  bits = (bits >> 63) ? ~bits : bits | (uint64_t{1} << 63);
+  appendU64(out, bits);
+}
+
+// `i` minus the double nearest it, biased to sort as unsigned. Doubles are
+// 2^11 apart at most below 2^63, so it fits in 16 bits.
+void appendRemainder(std::string &out, int64_t i, double d) {
+  int64_t rem = 0;
+  if (d >= 9223372036854775808.0) // rounded up to 2^63
+    rem = static_cast<int64_t>(static_cast<uint64_t>(i) -
+                               (uint64_t{1} << 63));
+  else
+    rem = i - static_cast<int64_t>(d);
+  const auto biased = static_cast<uint16_t>(rem + 0x8000);
+  out.push_back(static_cast<char>(biased >> 8));
+  out.push_back(static_cast<char>(biased & 0xFF));
+}
+} // namespace
+
+void appendValue(std::string &out, const Value *v) {
+  if (!v) {
+    out.push_back(static_cast<char>(kAbsent));
+    return;
+  }
+  switch (v->type()) {
+  case ValueType::Null:
+    out.push_back(static_cast<char>(kNull));
+    return;
+  case ValueType::Integer: {
+    const int64_t i = v->asInt();
+    const double d = static_cast<double>(i);
+    out.push_back(static_cast<char>(kNumber));
+    appendDouble(out, d);
+    appendRemainder(out, i, d);
+    return;
+  }
+  case ValueType::Float:
+    out.push_back(static_cast<char>(kNumber));
+    appendDouble(out, v->asFloat());
+    out.push_back('\x80');
+    out.push_back('\0');
+    return;
+  case ValueType::String:
+    appendString(out, v->asString());
+    return;
+  case ValueType::Boolean:
+    out.push_back(static_cast<char>(kBoolean));
+    out.push_back(v->asBool() ? '\x01' : '\0');
+    return;
+  }
+}
+
+void appendSortKey(std::string &out, const Value *v, bool descending) {
+  const size_t start = out.size();
+  if (!v || v->type() == ValueType::Null)
+    out.push_back(static_cast<char>(kAbsent));
+  else
+    appendValue(out, v);
+  if (descending)
+    for (size_t i = start; i < out.size(); ++i)
+      out[i] = static_cast<char>(~static_cast<uint8_t>(out[i]));
+}
+
+void appendBound(std::string &out, const Value *v) {
+  const size_t start = out.size();
+  appendValue(out, v);
+  if (static_cast<uint8_t>(out[start]) == kNumber)
+    out.resize(start + kNumberPrefixBytes);
+}
+
+void appendString(std::string &out, std::string_view s) {
+  out.push_back(static_cast<char>(kString));
+  for (char c : s) {
+    out.push_back(c);
+    if (c == '\0')
+      out.push_back('\xFF');
+  }
+  out.push_back('\0');
+  out.push_back('\x01');
+}
+
+void appendU32(std::string &out, uint32_t v) {
+  for (int shift = 24; shift >= 0; shift -= 8)
+    out.push_back(static_cast<char>((v >> shift) & 0xFF));
+}
+
+void appendU64(std::string &out, uint64_t v) {
+  for (int shift = 56; shift >= 0; shift -= 8)
+    out.push_back(static_cast<char>((v >> shift) & 0xFF));
+}
+
+void appendI64(std::string &out, int64_t v) {
+  appendU64(out, static_cast<uint64_t>(v) ^ (uint64_t{1} << 63));
+}
+
+uint32_t readU32(std::string_view in) {
+  uint32_t v = 0;
+  for (size_t i = 0; i < 4; ++i)
+    v = (v << 8) | static_cast<uint8_t>(in[i]);
+  return v;
+}
+
+uint64_t readU64(std::string_view in) {
+  uint64_t v = 0;
+  for (size_t i = 0; i < 8; ++i)
+    v = (v << 8) | static_cast<uint8_t>(in[i]);
+  return v;
+}
+
+int64_t readI64(std::string_view in) {
+  return static_cast<int64_t>(readU64(in) ^ (uint64_t{1} << 63));
+}
+
+std::string prefixEnd(std::string_view prefix) {
+  std::string end(prefix);
+  while (!end.empty()) {
+    if (static_cast<uint8_t>(end.back()) != 0xFF) {
+      end.back() = static_cast<char>(static_cast<uint8_t>(end.back()) + 1);
+      return end;
+    }
+    end.pop_back();
+  }
+  return end;
+}
+
+} // namespace keycode
+} // namespace kadedb
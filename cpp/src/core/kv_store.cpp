@@ -0,0 +1,113 @@
+#include "kadedb/kv_store.h"
+
+#include <mutex>
+
+namespace kadedb {
+
+// ---- InMemoryKeyValueStore ----
+
+class InMemoryKeyValueStore::Iterator final : public KeyValueIterator {
+public:
+  Iterator(const InMemoryKeyValueStore &store, std::shared_ptr<Family> family)
+      : store_(store), family_(std::move(family)) {}
+
+  void seek(std::string_view target) override {
+    std::shared_lock lk(store_.mtx_);
+    load(family_->lower_bound(target));
+  }
+  bool valid() const override { return valid_; }
+  void next() override {
+    std::shared_lock lk(store_.mtx_);
+    load(family_->upper_bound(key_));
+  }
+  std::string_view key() const override { return key_; }
+  std::string_view value() const override { return value_; }
+  Status status() const override { return Status::OK(); }
+
+private:
+  // Copy the entry at `it` out, so no lock is needed to read it
+  void load(Family::const_iterator it) {
+    valid_ = it != family_->end();
+    if (valid_) {
+      key_ = it->first;
+      value_ = it->second;
+    }
+  }
+
+  const InMemoryKeyValueStore &store_;
+  std::shared_ptr<Family> family_;
+  bool valid_ = false;
+  std::string key_;
+  std::string value_;
+};
+
+Status InMemoryKeyValueStore::createFamily(const std::string &family) {
+  std::unique_lock lk(mtx_);
+  auto &slot = families_[family];
+  if (!slot)
+    slot = std::make_shared<Family>();
+  return Status::OK();
+}
+
+Status InMemoryKeyValueStore::dropFamily(const std::string &family) {
+  std::unique_lock lk(mtx_);
+  families_.erase(family);
+  return Status::OK();
+}
+
+std::vector<std::string> InMemoryKeyValueStore::listFamilies() const {
+  std::shared_lock lk(mtx_);
+  std::vector<std::string> names;
+  names.reserve(families_.size());
+  for (const auto &kv : families_)
+    names.push_back(kv.first);
+  return names;
+}
+
+Result<std::string> InMemoryKeyValueStore::get(const std::string &family,
+                                               std::string_view key) const {
+  std::shared_lock lk(mtx_);
+  auto fit = families_.find(family);
+  if (fit == families_.end())
+    return Result<std::string>::err(
+        Status::NotFound("Unknown column family: " + family));
+  auto it = fit->second->find(key);
+  if (it == fit->second->end())
+    return Result<std::string>::err(Status::NotFound("Key not found"));
+  return Result<std::string>::ok(it->second);
+}
+
+Status InMemoryKeyValueStore::write(const WriteBatch &batch) {
+  std::unique_lock lk(mtx_);
+  for (const auto &op : batch.ops)
+    if (!families_.count(op.family))
+      return Status::NotFound("Unknown column family: " + op.family);
+  for (const auto &op : batch.ops) {
+    auto &family = *families_[op.family];
+    if (op.value)
+      family.insert_or_assign(op.key, *op.value);
+    else
+      family.erase(op.key);
+  }
+  return Status::OK();
+}
+
+Result<std::unique_ptr<KeyValueIterator>>
+InMemoryKeyValueStore::newIterator(const std::string &family) const {
+  using R = Result<std::unique_ptr<KeyValueIterator>>;
+  std::shared_lock lk(mtx_);
+  auto it = families_.find(family);
+  if (it == families_.end())
+    return R::err(Status::NotFound("Unknown column family: " + family));
+  return R::ok(std::make_unique<Iterator>(*this, it->second));
+}
+
+#ifndef KADEDB_HAVE_ROCKSDB
+Result<std::shared_ptr<KeyValueStore>>
+openRocksDbStore(const std::string & /*path*/) {
+  return Result<std::shared_ptr<KeyValueStore>>::err(Status::FailedPrecondition(
+      "KadeDB was built without RocksDB (KADEDB_WITH_ROCKSDB)"));
+}
+#endif
+
+} // namespace kadedb
@@ -0,0 +1,345 @@
+#include "kadedb/logged_storage.h"
+
+namespace kadedb {
+
+Status WalSequencer::run(const std::string &target,
+                         const std::function<Status()> &apply,
+                         const std::function<WalRecord()> &record) {
+  uint64_t lsn = 0;
+  {
+    std::lock_guard<std::mutex> lk(
+        stripes_[std::hash<std::string>()(target) % kStripes]);
+    Status st = apply();
+    if (!st.ok())
+      return st;
+    auto queued = wal_.append(record());
+    if (!queued.hasValue())
+      return queued.status();
+    lsn = queued.value();
+  }
+  return wal_.sync(lsn);
+}
+
+// ---- Relational ------------------------------------------------------------
+
+Status LoggedRelationalStorage::createTable(const std::string &table,
+                                            const TableSchema &schema) {
+  return seq_.run(
+      table, [&] { return base_.createTable(table, schema); },
+      [&] { return walRecord::createTable(table, schema); });
+}
+
+Status LoggedRelationalStorage::insertRow(const std::string &table,
+                                          const Row &row) {
+  return seq_.run(
+      table, [&] { return base_.insertRow(table, row); },
+      [&] { return walRecord::insertRow(table, row); });
+}
+
+Status LoggedRelationalStorage::insertRows(const std::string &table,
+                                           const std::vector<Row> &rows) {
+  return seq_.run(
+      table, [&] { return base_.insertRows(table, rows); },
+      [&] { return walRecord::insertRows(table, rows); });
+}
+
+Status LoggedRelationalStorage::dropTable(const std::string &table) {
+  return seq_.run(
+      table, [&] { return base_.dropTable(table); },
+      [&] { return walRecord::dropTable(table); });
+}
+
+Result<size_t>
+LoggedRelationalStorage::deleteRows(const std::string &table,
+                                    const std::optional<Predicate> &where) {
+  size_t deleted = 0;
+  Status st = seq_.run(
+      table,
+      [&] {
+        auto res = base_.deleteRows(table, where);
+        if (res.hasValue())
+          deleted = res.value();
+        return res.status();
+      },
+      [&] { return walRecord::deleteRows(table, where); });
+  if (!st.ok())
+    return Result<size_t>::err(st);
+  return Result<size_t>::ok(deleted);
+}
+
+Result<size_t> LoggedRelationalStorage::updateRows(
+    const std::string &table,
+    const std::unordered_map<std::string, AssignmentValue> &assignments,
+    const std::optional<Predicate> &where) {
+  size_t updated = 0;
+  Status st = seq_.run(
+      table,
+      [&] {
+        auto res = base_.updateRows(table, assignments, where);
+        if (res.hasValue())
+          updated = res.value();
+        return res.status();
+      },
+      [&] { return walRecord::updateRows(table, assignments, where); });
+  if (!st.ok())
+    return Result<size_t>::err(st);
+  return Result<size_t>::ok(updated);
+}
+
+Result<size_t>
+LoggedRelationalStorage::updateRowsWith(const std::string &table,
+                                        const RowUpdater &updater,
+                                        const std::optional<Predicate> &where) {
+  std::vector<Row> rows;
+  size_t updated = 0;
+  Status st = seq_.run(
+      table,
+      [&] {
+        auto res = base_.updateRowsWith(
+            table,
+            [&](Row &row, const TableSchema &schema) {
+              Status us = updater(row, schema);
+              if (us.ok())
+                rows.push_back(row);
+              return us;
+            },
+            where);
+        if (res.hasValue())
+          updated = res.value();
+        return res.status();
+      },
+      [&] { return walRecord::updateRowsWith(table, where, rows); });
+  if (!st.ok())
+    return Result<size_t>::err(st);
+  return Result<size_t>::ok(updated);
+}
+
+Status LoggedRelationalStorage::updateRows(
+    const std::string &table,
+    const std::unordered_map<std::string, std::unique_ptr<Value>> &assignments,
+    const std::optional<Predicate> &where) {
+  // Logged as the equivalent constant assignments
+  std::unordered_map<std::string, AssignmentValue> wrapped;
+  wrapped.reserve(assignments.size());
+  for (const auto &kv : assignments) {
+    AssignmentValue av;
+    av.kind = AssignmentValue::Kind::Constant;
+    av.constant = kv.second ? kv.second->clone() : nullptr;
+    wrapped.emplace(kv.first, std::move(av));
+  }
+  return seq_.run(
+      table, [&] { return base_.updateRows(table, assignments, where); },
+      [&] { return walRecord::updateRows(table, wrapped, where); });
+}
+
+Status LoggedRelationalStorage::truncateTable(const std::string &table) {
+  return seq_.run(
+      table, [&] { return base_.truncateTable(table); },
+      [&] { return walRecord::truncateTable(table); });
+}
+
+Status LoggedRelationalStorage::createIndex(const std::string &table,
+                                            const std::string &column,
+                                            IndexType type) {
+  return seq_.run(
+      table, [&] { return base_.createIndex(table, column, type); },
+      [&] { return walRecord::createTableIndex(table, column, type); });
+}
+
+// ---- Document --------------------------------------------------------------
+
+Status LoggedDocumentStorage::createCollection(
+    const std::string &collection,
+    const std::optional<DocumentSchema> &schema) {
+  return seq_.run(
+      collection, [&] { return base_.createCollection(collection, schema); },
+      [&] { return walRecord::createCollection(collection, schema); });
+}
+
+Status LoggedDocumentStorage::dropCollection(const std::string &collection) {
+  return seq_.run(
+      collection, [&] { return base_.dropCollection(collection); },
+      [&] { return walRecord::dropCollection(collection); });
+}
+
+Status LoggedDocumentStorage::put(const std::string &collection,
+                                  const std::string &key, const Document &doc) {
+  return seq_.run(
+      collection, [&] { return base_.put(collection, key, doc); },
+      [&] { return walRecord::putDocument(collection, key, doc); });
+}
+
+Status LoggedDocumentStorage::put(const std::string &collection,
+                                  const std::string &key, Document &&doc) {
+  // Encoded up front: the storage takes the document over
+  WalRecord rec = walRecord::putDocument(collection, key, doc);
+  return seq_.run(
+      collection, [&] { return base_.put(collection, key, std::move(doc)); },
+      [&] { return std::move(rec); });
+}
+
+Status LoggedDocumentStorage::erase(const std::string &collection,
+                                    const std::string &key) {
+  return seq_.run(
+      collection, [&] { return base_.erase(collection, key); },
+      [&] { return walRecord::eraseDocument(collection, key); });
+}
+
+Status LoggedDocumentStorage::createIndex(const std::string &collection,
+                                          const std::string &field,
+                                          IndexType type) {
+  return seq_.run(
+      collection, [&] { return base_.createIndex(collection, field, type); },
+      [&] {
+        return walRecord::createCollectionIndex(collection, field, type);
+      });
+}
+
+// ---- Time series -----------------------------------------------------------
+
+Status LoggedTimeSeriesStorage::createSeries(const std::string &series,
+                                             const TimeSeriesSchema &schema,
+                                             TimePartition partition) {
+  return seq_.run(
+      series, [&] { return base_.createSeries(series, schema, partition); },
+      [&] { return walRecord::createSeries(series, schema, partition); });
+}
+
+Status LoggedTimeSeriesStorage::dropSeries(const std::string &series) {
+  return seq_.run(
+      series, [&] { return base_.dropSeries(series); },
+      [&] { return walRecord::dropSeries(series); });
+}
+
+Status LoggedTimeSeriesStorage::append(const std::string &series,
+                                       const Row &row) {
+  return seq_.run(
+      series, [&] { return base_.append(series, row); },
+      [&] {
+        std::vector<Row> rows;
+        rows.push_back(row);
+        return walRecord::appendRows(series, rows);
+      });
+}
+
+Status LoggedTimeSeriesStorage::appendBatch(const std::string &series,
+                                            const std::vector<Row> &rows) {
+  return seq_.run(
+      series, [&] { return base_.appendBatch(series, rows); },
+      [&] { return walRecord::appendRows(series, rows); });
+}
+
+Status LoggedTimeSeriesStorage::appendColumns(const std::string &series,
+                                              const int64_t *ts,
+                                              const double *const *values,
+                                              size_t n) {
+  return seq_.run(
+      series, [&] { return base_.appendColumns(series, ts, values, n); },
+      [&] {
+        // The append succeeded, so the series exists
+        const size_t columns =
+            base_.getSeriesSchema(series).value().valueColumns().size();
+        return walRecord::appendColumns(series, ts, values, n, columns);
+      });
+}
+
+Status LoggedTimeSeriesStorage::createContinuousAggregate(
+    const std::string &series, const std::string &valueColumn,
+    int64_t bucketWidth, TimeGranularity bucketGranularity, bool sketches) {
+  return seq_.run(
+      series,
+      [&] {
+        return base_.createContinuousAggregate(
+            series, valueColumn, bucketWidth, bucketGranularity, sketches);
+      },
+      [&] {
+        return walRecord::createContinuousAggregate(
+            series, valueColumn, bucketWidth, bucketGranularity, sketches);
+      });
+}
+
+Status LoggedTimeSeriesStorage::dropContinuousAggregate(
+    const std::string &series, const std::string &valueColumn,
+    int64_t bucketWidth, TimeGranularity bucketGranularity) {
+  return seq_.run(
+      series,
+      [&] {
+        return base_.dropContinuousAggregate(series, valueColumn, bucketWidth,
+                                             bucketGranularity);
+      },
+      [&] {
+        return walRecord::dropContinuousAggregate(series, valueColumn,
+                                                  bucketWidth,
+                                                  bucketGranularity);
+      });
+}
+
+// ---- Graph -----------------------------------------------------------------
+
+Status LoggedGraphStorage::createGraph(const std::string &graph) {
+  return seq_.run(
+      graph, [&] { return base_.createGraph(graph); },
+      [&] { return walRecord::createGraph(graph); });
+}
+
+Status LoggedGraphStorage::dropGraph(const std::string &graph) {
+  return seq_.run(
+      graph, [&] { return base_.dropGraph(graph); },
+      [&] { return walRecord::dropGraph(graph); });
+}
+
+Status LoggedGraphStorage::putNode(const std::string &graph, const Node &node) {
+  return seq_.run(
+      graph, [&] { return base_.putNode(graph, node); },
+      [&] { return walRecord::putNode(graph, node); });
+}
+
+Status LoggedGraphStorage::eraseNode(const std::string &graph, NodeId id) {
+  return seq_.run(
+      graph, [&] { return base_.eraseNode(graph, id); },
+      [&] { return walRecord::eraseNode(graph, id); });
+}
+
+Status LoggedGraphStorage::putEdge(const std::string &graph, const Edge &edge) {
+  return seq_.run(
+      graph, [&] { return base_.putEdge(graph, edge); },
+      [&] { return walRecord::putEdge(graph, edge); });
+}
+
+Status LoggedGraphStorage::eraseEdge(const std::string &graph, EdgeId id) {
+  return seq_.run(
+      graph, [&] { return base_.eraseEdge(graph, id); },
+      [&] { return walRecord::eraseEdge(graph, id); });
+}
+
+Status LoggedGraphStorage::createNodeIndex(const std::string &graph,
+                                           const std::string &property,
+                                           IndexType type) {
+  return seq_.run(
+      graph, [&] { return base_.createNodeIndex(graph, property, type); },
+      [&] { return walRecord::createNodeIndex(graph, property, type); });
+}
+
+Status LoggedGraphStorage::dropNodeIndex(const std::string &graph,
+                                         const std::string &property) {
+  return seq_.run(
+      graph, [&] { return base_.dropNodeIndex(graph, property); },
+      [&] { return walRecord::dropNodeIndex(graph, property); });
+}
+
+Status LoggedGraphStorage::createEdgeIndex(const std::string &graph,
+                                           const std::string &property,
+                                           IndexType type) {
+  return seq_.run(
+      graph, [&] { return base_.createEdgeIndex(graph, property, type); },
+      [&] { return walRecord::createEdgeIndex(graph, property, type); });
+}
+
+Status LoggedGraphStorage::dropEdgeIndex(const std::string &graph,
+                                         const std::string &property) {
+  return seq_.run(
+      graph, [&] { return base_.dropEdgeIndex(graph, property); },
+      [&] { return walRecord::dropEdgeIndex(graph, property); });
+}
+
+} // namespace kadedb
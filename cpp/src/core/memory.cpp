@@ -0,0 +1,58 @@
+#include "kadedb/memory.h"
+
+#include "kadedb/value.h"
+
+namespace kadedb {
+namespace memory {
+
+size_t valueBytes(const InlineValue &v) {
+  size_t bytes = sizeof(InlineValue);
+  // Longer strings live in a heap block of their own
+  if (!v.empty() && v.type() == ValueType::String && !v.isInlineString())
+    bytes += sizeof(size_t) + v.stringSize();
+  return bytes;
+}
+
+size_t valueBytes(const Value *v) {
+  if (!v)
+    return 0;
+  switch (v->type()) {
+  case ValueType::Null:
+    return sizeof(NullValue);
+  case ValueType::Integer:
+    return sizeof(IntegerValue);
+  case ValueType::Float:
+    return sizeof(FloatValue);
+  case ValueType::String:
+    return sizeof(StringValue) + v->asString().size();
+  case ValueType::Boolean:
+    return sizeof(BooleanValue);
+  }
+  return sizeof(Value);
+}
+
+size_t rowBytes(const InlineRow &row) {
+  size_t bytes = 0;
+  for (const auto &v : row.values())
+    bytes += valueBytes(v);
+  return bytes;
+}
+
+size_t documentBytes(const Document &doc) {
+  size_t bytes = 0;
+  for (const auto &kv : doc)
+    bytes += kMapEntryBytes + sizeof(kv) + kv.first.size() +
+             valueBytes(kv.second.get());
+  return bytes;
+}
+
+Status budgetExceeded(const std::string &kind, const std::string &name,
+                      const MemoryAccount &account, size_t more) {
+  return Status::ResourceExhausted(
+      "Memory budget of " + kind + " '" + name + "' exceeded: " +
+      std::to_string(account.bytes()) + " + " + std::to_string(more) +
+      " bytes > " + std::to_string(account.budget()));
+}
+
+} // namespace memory
+} // namespace kadedb
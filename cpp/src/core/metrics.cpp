@@ -0,0 +1,557 @@
+#include "kadedb/metrics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <utility>
+
+#include "kadedb/value.h"
+
+namespace kadedb {
+namespace metrics {
+
+namespace {
+
+std::atomic<bool> g_enabled{true};
+thread_local OperationScope *t_current = nullptr;
+
+using Counter = std::atomic<uint64_t>;
+
+// Each cell has a single writer, its thread, so a relaxed load and store
+// take the place of a read-modify-write; snapshots load them concurrently
+inline void bump(Counter &c, uint64_t n) {
+  c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// One thread's record of one operation
+struct Cells {
+  Counter calls{0}, errors{0}, scanned{0}, returned{0}, lockWaitNs{0},
+      bytes{0}, latencySumNs{0};
+  std::array<Counter, LatencyBuckets::kCount> buckets{};
+};
+
+// Plain sums of Cells, as kept for exited threads and resets
+struct Totals {
+  uint64_t calls = 0, errors = 0, scanned = 0, returned = 0, lockWaitNs = 0,
+           bytes = 0, latencySumNs = 0;
+  std::array<uint64_t, LatencyBuckets::kCount> buckets{};
+
+  void add(const Cells &c) {
+    auto get = [](const Counter &v) {
+      return v.load(std::memory_order_relaxed);
+    };
+    calls += get(c.calls);
+    errors += get(c.errors);
+    scanned += get(c.scanned);
+    returned += get(c.returned);
+    lockWaitNs += get(c.lockWaitNs);
+    bytes += get(c.bytes);
+    latencySumNs += get(c.latencySumNs);
+    for (size_t i = 0; i < buckets.size(); ++i)
+      buckets[i] += get(c.buckets[i]);
+  }
+  void add(const Totals &t, bool subtract = false) {
+    auto apply = [subtract](uint64_t &into, uint64_t v) {
+      into = subtract ? into - v : into + v;
+    };
+    apply(calls, t.calls);
+    apply(errors, t.errors);
+    apply(scanned, t.scanned);
+    apply(returned, t.returned);
+    apply(lockWaitNs, t.lockWaitNs);
+    apply(bytes, t.bytes);
+    apply(latencySumNs, t.latencySumNs);
+    for (size_t i = 0; i < buckets.size(); ++i)
+      apply(buckets[i], t.buckets[i]);
+  }
+};
+
+using AllTotals = std::array<Totals, kOperationCount>;
+
+struct ThreadCells;
+
+} // namespace
+
+// Every thread's cells, with the sums of exited threads and the totals
+// reset() subtracts. Never destroyed: threads may exit after static
+// destruction has begun.
+class Registry {
+public:
+  static Registry &instance() {
+    static Registry *r = new Registry;
+    return *r;
+  }
+
+  void attach(ThreadCells *t) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    threads_.push_back(t);
+  }
+  void detach(ThreadCells *t);
+
+  std::vector<OperationMetrics> snapshot() {
+    auto sums = std::make_unique<AllTotals>();
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      sumLocked(*sums);
+    }
+    std::vector<OperationMetrics> out(kOperationCount);
+    for (size_t i = 0; i < kOperationCount; ++i) {
+      const Totals &t = (*sums)[i];
+      OperationMetrics &m = out[i];
+      m.op = static_cast<Operation>(i);
+      m.calls = t.calls;
+      m.errors = t.errors;
+      m.rowsScanned = t.scanned;
+      m.rowsReturned = t.returned;
+      m.lockWaitNs = t.lockWaitNs;
+      m.bytesAllocated = t.bytes;
+      m.latency.counts_ = t.buckets;
+      m.latency.count_ = t.calls;
+      m.latency.sumNs_ = t.latencySumNs;
+    }
+    return out;
+  }
+
+  void reset() {
+    auto sums = std::make_unique<AllTotals>();
+    std::lock_guard<std::mutex> lk(mtx_);
+    for (size_t i = 0; i < kOperationCount; ++i)
+      (*sums)[i].add(baseline_[i]);
+    sumLocked(*sums);
+    baseline_ = *sums;
+  }
+
+private:
+  Registry() = default;
+
+  // Everything recorded since the last reset()
+  void sumLocked(AllTotals &into);
+
+  std::mutex mtx_;
+  std::vector<ThreadCells *> threads_;
+  AllTotals exited_{};
+  AllTotals baseline_{};
+};
+
+namespace {
+
+struct ThreadCells {
+  // Allocated on a thread's first call of each operation
+  std::array<std::atomic<Cells *>, kOperationCount> ops{};
+
+  ThreadCells() { Registry::instance().attach(this); }
+  ~ThreadCells() { Registry::instance().detach(this); }
+
+  Cells &at(Operation op) {
+    auto &slot = ops[static_cast<size_t>(op)];
+    Cells *c = slot.load(std::memory_order_relaxed);
+    if (!c) {
+      c = new Cells();
+      slot.store(c, std::memory_order_release);
+    }
+    return *c;
+  }
+};
+
+ThreadCells &threadCells() {
+  static thread_local ThreadCells cells;
+  return cells;
+}
+
+} // namespace
+
+void Registry::detach(ThreadCells *t) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  threads_.erase(std::find(threads_.begin(), threads_.end(), t));
+  for (size_t i = 0; i < kOperationCount; ++i) {
+    if (Cells *c = t->ops[i].load(std::memory_order_acquire)) {
+      exited_[i].add(*c);
+      delete c;
+    }
+  }
+}
+
+void Registry::sumLocked(AllTotals &into) {
+  for (size_t i = 0; i < kOperationCount; ++i) {
+    into[i].add(exited_[i]);
+    for (ThreadCells *t : threads_)
+      if (const Cells *c = t->ops[i].load(std::memory_order_acquire))
+        into[i].add(*c);
+    into[i].add(baseline_[i], /*subtract=*/true);
+  }
+}
+
+// ---- Names ----
+
+const char *storageName(Operation op) {
+  switch (op) {
+  case Operation::RelationalInsert:
+  case Operation::RelationalSelect:
+  case Operation::RelationalUpdate:
+  case Operation::RelationalDelete:
+  case Operation::RelationalUpsert:
+    return "relational";
+  case Operation::DocumentPut:
+  case Operation::DocumentGet:
+  case Operation::DocumentErase:
+  case Operation::DocumentQuery:
+  case Operation::DocumentPatch:
+    return "document";
+  case Operation::TimeSeriesAppend:
+  case Operation::TimeSeriesRangeQuery:
+  case Operation::TimeSeriesAggregate:
+    return "timeseries";
+  case Operation::GraphRead:
+  case Operation::GraphWrite:
+  case Operation::GraphTraversal:
+    return "graph";
+  case Operation::KadeqlExecute:
+    return "kadeql";
+  }
+  return "unknown";
+}
+
+const char *operationName(Operation op) {
+  switch (op) {
+  case Operation::RelationalInsert:
+    return "insert";
+  case Operation::RelationalSelect:
+    return "select";
+  case Operation::RelationalUpdate:
+    return "update";
+  case Operation::RelationalDelete:
+    return "delete";
+  case Operation::RelationalUpsert:
+    return "upsert";
+  case Operation::DocumentPut:
+    return "put";
+  case Operation::DocumentGet:
+    return "get";
+  case Operation::DocumentErase:
+    return "erase";
+  case Operation::DocumentQuery:
+    return "query";
+  case Operation::DocumentPatch:
+    return "patch";
+  case Operation::TimeSeriesAppend:
+    return "append";
+  case Operation::TimeSeriesRangeQuery:
+    return "range_query";
+  case Operation::TimeSeriesAggregate:
+    return "aggregate";
+  case Operation::GraphRead:
+    return "read";
+  case Operation::GraphWrite:
+    return "write";
+  case Operation::GraphTraversal:
+    return "traversal";
+  case Operation::KadeqlExecute:
+    return "execute";
+  }
+  return "unknown";
+}
+
+const char *lockSiteName(LockSite site) {
+  switch (site) {
+  case LockSite::RelationalCatalog:
+    return "relational_catalog";
+  case LockSite::RelationalTableWrite:
+    return "relational_table_write";
+  case LockSite::RelationalTablePublish:
+    return "relational_table_publish";
+  case LockSite::RelationalTableStats:
+    return "relational_table_stats";
+  case LockSite::DocumentCatalog:
+    return "document_catalog";
+  case LockSite::DocumentCollection:
+    return "document_collection";
+  case LockSite::TimeSeriesCatalog:
+    return "timeseries_catalog";
+  case LockSite::TimeSeriesSeries:
+    return "timeseries_series";
+  case LockSite::GraphCatalog:
+    return "graph_catalog";
+  case LockSite::GraphData:
+    return "graph_data";
+  case LockSite::GraphSnapshot:
+    return "graph_snapshot";
+  case LockSite::CompactGraphCatalog:
+    return "compact_graph_catalog";
+  case LockSite::CompactGraphData:
+    return "compact_graph_data";
+  case LockSite::Columnar:
+    return "columnar";
+  }
+  return "unknown";
+}
+
+// ---- Lock sites ----
+
+namespace {
+
+// Contended by nature: many threads take the same lock, so these are
+// plain read-modify-write atomics rather than per-thread cells
+struct LockSiteCells {
+  Counter acquisitions{0}, shared{0}, contended{0}, waitNs{0}, maxWaitNs{0},
+      holdNs{0}, maxHoldNs{0};
+};
+
+std::array<LockSiteCells, kLockSiteCount> g_lockSites;
+
+LockSiteCells &cellsOf(LockSite site) {
+  return g_lockSites[static_cast<size_t>(site)];
+}
+
+void raiseTo(Counter &c, uint64_t v) {
+  uint64_t cur = c.load(std::memory_order_relaxed);
+  while (cur < v &&
+         !c.compare_exchange_weak(cur, v, std::memory_order_relaxed))
+    ;
+}
+
+} // namespace
+
+namespace detail {
+
+void recordLockAcquired(LockSite site, bool shared, bool contended,
+                        uint64_t waitNs) {
+  LockSiteCells &c = cellsOf(site);
+  c.acquisitions.fetch_add(1, std::memory_order_relaxed);
+  if (shared)
+    c.shared.fetch_add(1, std::memory_order_relaxed);
+  if (!contended)
+    return;
+  c.contended.fetch_add(1, std::memory_order_relaxed);
+  c.waitNs.fetch_add(waitNs, std::memory_order_relaxed);
+  raiseTo(c.maxWaitNs, waitNs);
+}
+
+void recordLockHeld(LockSite site, uint64_t heldNs) {
+  LockSiteCells &c = cellsOf(site);
+  c.holdNs.fetch_add(heldNs, std::memory_order_relaxed);
+  raiseTo(c.maxHoldNs, heldNs);
+}
+
+} // namespace detail
+
+std::vector<LockSiteMetrics> lockSnapshot() {
+  std::vector<LockSiteMetrics> out;
+  if (!kLockProfiling)
+    return out;
+  out.resize(kLockSiteCount);
+  for (size_t i = 0; i < kLockSiteCount; ++i) {
+    const LockSiteCells &c = g_lockSites[i];
+    auto get = [](const Counter &v) {
+      return v.load(std::memory_order_relaxed);
+    };
+    LockSiteMetrics &m = out[i];
+    m.site = static_cast<LockSite>(i);
+    m.acquisitions = get(c.acquisitions);
+    m.sharedAcquisitions = get(c.shared);
+    m.contended = get(c.contended);
+    m.waitNs = get(c.waitNs);
+    m.maxWaitNs = get(c.maxWaitNs);
+    m.holdNs = get(c.holdNs);
+    m.maxHoldNs = get(c.maxHoldNs);
+  }
+  return out;
+}
+
+static void resetLockSites() {
+  for (LockSiteCells &c : g_lockSites)
+    for (Counter *v : {&c.acquisitions, &c.shared, &c.contended, &c.waitNs,
+                       &c.maxWaitNs, &c.holdNs, &c.maxHoldNs})
+      v->store(0, std::memory_order_relaxed);
+}
+
+// ---- LatencySnapshot ----
+
+uint64_t LatencySnapshot::maxNs() const {
+  for (size_t i = counts_.size(); i-- > 0;)
+    if (counts_[i])
+      return LatencyBuckets::highestIn(i);
+  return 0;
+}
+
+uint64_t LatencySnapshot::percentileNs(double p) const {
+  if (count_ == 0)
+    return 0;
+  const double want = std::max(1.0, p / 100.0 * static_cast<double>(count_));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < counts_.size(); ++i) {
+    seen += counts_[i];
+    if (static_cast<double>(seen) >= want)
+      return LatencyBuckets::highestIn(i);
+  }
+  return maxNs();
+}
+
+// ---- Registry access ----
+
+bool enabled() { return g_enabled.load(std::memory_order_relaxed); }
+
+void setEnabled(bool on) { g_enabled.store(on, std::memory_order_relaxed); }
+
+std::vector<OperationMetrics> snapshot() {
+  return Registry::instance().snapshot();
+}
+
+void reset() {
+  Registry::instance().reset();
+  resetLockSites();
+}
+
+std::string toPrometheus() {
+  const std::vector<OperationMetrics> all = snapshot();
+  std::ostringstream os;
+  auto labels = [](const OperationMetrics &m) {
+    return std::string("storage=\"") + storageName(m.op) +
+           "\",operation=\"" + operationName(m.op) + "\"";
+  };
+  auto seconds = [](uint64_t ns) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.9g", static_cast<double>(ns) / 1e9);
+    return std::string(buf);
+  };
+  auto counter = [&](const char *name, const char *help,
+                     uint64_t OperationMetrics::*field, bool ns = false) {
+    os << "# HELP " << name << " " << help << "\n"
+       << "# TYPE " << name << " counter\n";
+    for (const auto &m : all) {
+      os << name << "{" << labels(m) << "} ";
+      if (ns)
+        os << seconds(m.*field);
+      else
+        os << m.*field;
+      os << "\n";
+    }
+  };
+
+  counter("kadedb_operations_total", "Engine operations completed.",
+          &OperationMetrics::calls);
+  counter("kadedb_operation_errors_total",
+          "Engine operations that returned an error.",
+          &OperationMetrics::errors);
+  counter("kadedb_rows_scanned_total",
+          "Rows, documents, points or nodes examined.",
+          &OperationMetrics::rowsScanned);
+  counter("kadedb_rows_returned_total",
+          "Rows, documents, points or nodes returned or written.",
+          &OperationMetrics::rowsReturned);
+  counter("kadedb_lock_wait_seconds_total",
+          "Time engine operations spent blocked on storage locks.",
+          &OperationMetrics::lockWaitNs, /*ns=*/true);
+  counter("kadedb_bytes_allocated_total",
+          "Bytes allocated by engine operations.",
+          &OperationMetrics::bytesAllocated);
+
+  const char *latency = "kadedb_operation_duration_seconds";
+  os << "# HELP " << latency << " Engine operation latency.\n"
+     << "# TYPE " << latency << " summary\n";
+  for (const auto &m : all) {
+    static const std::pair<const char *, double> kQuantiles[] = {
+        {"0.5", 50}, {"0.9", 90}, {"0.99", 99}, {"0.999", 99.9}};
+    for (const auto &[q, pct] : kQuantiles) {
+      os << latency << "{" << labels(m) << ",quantile=\"" << q << "\"} ";
+      if (m.latency.count() == 0)
+        os << "NaN\n";
+      else
+        os << seconds(m.latency.percentileNs(pct)) << "\n";
+    }
+    os << latency << "_sum{" << labels(m) << "} "
+       << seconds(m.latency.sumNs()) << "\n"
+       << latency << "_count{" << labels(m) << "} " << m.latency.count()
+       << "\n";
+  }
+
+  const std::vector<LockSiteMetrics> sites = lockSnapshot();
+  if (sites.empty())
+    return os.str();
+  auto lockFamily = [&](const char *name, const char *type, const char *help,
+                        uint64_t LockSiteMetrics::*field, bool ns) {
+    os << "# HELP " << name << " " << help << "\n"
+       << "# TYPE " << name << " " << type << "\n";
+    for (const auto &m : sites) {
+      os << name << "{site=\"" << lockSiteName(m.site) << "\"} ";
+      if (ns)
+        os << seconds(m.*field);
+      else
+        os << m.*field;
+      os << "\n";
+    }
+  };
+  lockFamily("kadedb_lock_site_acquisitions_total", "counter",
+             "Storage lock acquisitions, exclusive and shared.",
+             &LockSiteMetrics::acquisitions, false);
+  lockFamily("kadedb_lock_site_shared_acquisitions_total", "counter",
+             "Shared storage lock acquisitions.",
+             &LockSiteMetrics::sharedAcquisitions, false);
+  lockFamily("kadedb_lock_site_contended_total", "counter",
+             "Storage lock acquisitions that had to wait.",
+             &LockSiteMetrics::contended, false);
+  lockFamily("kadedb_lock_site_wait_seconds_total", "counter",
+             "Time spent waiting for storage locks.", &LockSiteMetrics::waitNs,
+             true);
+  lockFamily("kadedb_lock_site_max_wait_seconds", "gauge",
+             "Longest wait for a storage lock.", &LockSiteMetrics::maxWaitNs,
+             true);
+  lockFamily("kadedb_lock_site_hold_seconds_total", "counter",
+             "Time storage locks were held exclusively.",
+             &LockSiteMetrics::holdNs, true);
+  lockFamily("kadedb_lock_site_max_hold_seconds", "gauge",
+             "Longest exclusive hold of a storage lock.",
+             &LockSiteMetrics::maxHoldNs, true);
+  return os.str();
+}
+
+// ---- OperationScope ----
+
+OperationScope::OperationScope(Operation op) : op_(op), active_(enabled()) {
+  if (!active_)
+    return;
+  outer_ = t_current;
+  t_current = this;
+  startBytes_ = ValueArena::threadBytesAllocated();
+  start_ = std::chrono::steady_clock::now();
+}
+
+OperationScope::~OperationScope() {
+  if (!active_)
+    return;
+  const uint64_t ns = detail::elapsedNs(start_);
+  t_current = outer_;
+  if (outer_)
+    outer_->scanned_ += scanned_;
+  Cells &c = threadCells().at(op_);
+  bump(c.calls, 1);
+  if (failed_)
+    bump(c.errors, 1);
+  bump(c.scanned, scanned_);
+  bump(c.returned, returned_);
+  bump(c.lockWaitNs, lockWaitNs_);
+  bump(c.bytes, bytes_ + ValueArena::threadBytesAllocated() - startBytes_);
+  bump(c.latencySumNs, ns);
+  bump(c.buckets[LatencyBuckets::bucketOf(ns)], 1);
+}
+
+void OperationScope::addRows(size_t scanned, size_t returned) {
+  if (OperationScope *s = t_current) {
+    s->scanned_ += scanned;
+    s->returned_ += returned;
+  }
+}
+
+void OperationScope::addBytes(size_t bytes) {
+  if (OperationScope *s = t_current)
+    s->bytes_ += bytes;
+}
+
+void OperationScope::addLockWait(uint64_t ns) {
+  if (OperationScope *s = t_current)
+    s->lockWaitNs_ += ns;
+}
+
+} // namespace metrics
+} // namespace kadedb
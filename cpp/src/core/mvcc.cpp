@@ -0,0 +1,36 @@
+#include "kadedb/mvcc.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace kadedb {
+
+std::shared_ptr<RowVersionStore> RowVersionStore::grow(size_t rows) const {
+  auto out = std::make_shared<RowVersionStore>(*this);
+  const size_t chunks = (size_ + std::max<size_t>(rows, 1) + kChunkRows - 1) /
+                        kChunkRows;
+  out->chunks_.reserve(chunks);
+  do {
+    out->chunks_.push_back(
+        std::shared_ptr<RowVersion[]>(new RowVersion[kChunkRows]));
+  } while (out->chunks_.size() < chunks);
+  out->zones_.resize(out->chunks_.size());
+  return out;
+}
+
+size_t RowVersionStore::append(InlineRow row, Version begin) {
+  size_t pos = size_++;
+  RowVersion &v = at(pos);
+  v.row = std::move(row);
+  v.begin = begin;
+  v.end.store(kMaxVersion, std::memory_order_relaxed);
+  filling_.add(v.row);
+  if (size_ % kChunkRows == 0) {
+    zones_[pos / kChunkRows] =
+        std::make_shared<const ZoneMap>(std::move(filling_));
+    filling_.clear();
+  }
+  return pos;
+}
+
+} // namespace kadedb
@@ -0,0 +1,281 @@
+#include "kadedb/page_allocator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+namespace kadedb {
+namespace memory {
+namespace {
+
+struct Topology {
+  // System ids of the online nodes, the CPUs of each, and the dense index
+  // of each CPU's node
+  std::vector<size_t> nodes{0};
+  std::vector<std::vector<size_t>> cpus;
+  std::vector<size_t> nodeOfCpu;
+};
+
+// "0-3,8,10-11" into its numbers
+std::vector<size_t> parseList(const std::string &text) {
+  std::vector<size_t> out;
+  size_t i = 0;
+  auto number = [&](size_t &v) {
+    const size_t start = i;
+    v = 0;
+    while (i < text.size() && text[i] >= '0' && text[i] <= '9')
+      v = v * 10 + static_cast<size_t>(text[i++] - '0');
+    return i > start;
+  };
+  while (i < text.size()) {
+    size_t lo = 0, hi = 0;
+    if (!number(lo))
+      break;
+    hi = lo;
+    if (i < text.size() && text[i] == '-') {
+      ++i;
+      if (!number(hi))
+        break;
+    }
+    for (size_t v = lo; v <= hi; ++v)
+      out.push_back(v);
+    if (i < text.size() && text[i] == ',')
+      ++i;
+    else
+      break;
+  }
+  return out;
+}
+
+std::string readLine(const std::string &path) {
+  std::ifstream in(path);
+  std::string line;
+  std::getline(in, line);
+  return line;
+}
+
+Topology readTopology() {
+  Topology t;
+  const size_t hardware =
+      std::max<size_t>(1, std::thread::hardware_concurrency());
+#ifdef __linux__
+  const std::string root = "/sys/devices/system/node/";
+  std::vector<size_t> online = parseList(readLine(root + "online"));
+  if (!online.empty()) {
+    std::vector<std::vector<size_t>> cpus;
+    for (size_t id : online)
+      cpus.push_back(parseList(
+          readLine(root + "node" + std::to_string(id) + "/cpulist")));
+    t.nodes = std::move(online);
+    t.cpus = std::move(cpus);
+  }
+#endif
+  if (t.cpus.empty()) {
+    t.cpus.emplace_back();
+    for (size_t c = 0; c < hardware; ++c)
+      t.cpus.back().push_back(c);
+  }
+  for (size_t n = 0; n < t.cpus.size(); ++n) {
+    for (size_t c : t.cpus[n]) {
+      if (c >= t.nodeOfCpu.size())
+        t.nodeOfCpu.resize(c + 1, 0);
+      t.nodeOfCpu[c] = n;
+    }
+  }
+  return t;
+}
+
+const Topology &topology() {
+  static const Topology t = readTopology();
+  return t;
+}
+
+std::atomic<HugePages> hugePolicy{HugePages::Transparent};
+std::atomic<NumaPlacement> placementPolicy{NumaPlacement::Interleave};
+std::atomic<size_t> mapped{0};
+std::atomic<size_t> hugeMapped{0};
+
+// Blocks taken from the explicit huge page pool
+std::mutex hugeMtx;
+std::unordered_set<void *> &hugeBlocks() {
+  static auto *blocks = new std::unordered_set<void *>();
+  return *blocks;
+}
+
+size_t roundUp(size_t bytes) {
+  return (bytes + kPageBlockBytes - 1) & ~(kPageBlockBytes - 1);
+}
+
+#ifndef _WIN32
+// A mapping of `len` bytes (a multiple of kPageBlockBytes) aligned to
+// kPageBlockBytes: map one block more and trim both ends
+void *mapAligned(size_t len) {
+  const size_t over = len + kPageBlockBytes;
+  void *raw = ::mmap(nullptr, over, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED)
+    return nullptr;
+  const uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+  const uintptr_t aligned =
+      (start + kPageBlockBytes - 1) & ~uintptr_t{kPageBlockBytes - 1};
+  if (aligned > start)
+    ::munmap(raw, aligned - start);
+  const uintptr_t end = start + over;
+  if (end > aligned + len)
+    ::munmap(reinterpret_cast<void *>(aligned + len), end - aligned - len);
+  return reinterpret_cast<void *>(aligned);
+}
+
+void interleave(void *p, size_t len) {
+#ifdef __linux__
+  const Topology &t = topology();
+  if (t.nodes.size() < 2)
+    return;
+  std::vector<unsigned long> mask;
+  const size_t bits = 8 * sizeof(unsigned long);
+  for (size_t id : t.nodes) {
+    if (id / bits >= mask.size())
+      mask.resize(id / bits + 1, 0);
+    mask[id / bits] |= 1ul << (id % bits);
+  }
+  // Best effort: without the policy the pages stay first-touch
+  ::syscall(SYS_mbind, p, len, MPOL_INTERLEAVE, mask.data(),
+            mask.size() * bits + 1, 0u);
+#else
+  (void)p;
+  (void)len;
+#endif
+}
+#endif
+
+} // namespace
+
+void setPagePolicy(const PagePolicy &policy) {
+  hugePolicy.store(policy.hugePages, std::memory_order_relaxed);
+  placementPolicy.store(policy.placement, std::memory_order_relaxed);
+}
+
+PagePolicy pagePolicy() {
+  PagePolicy p;
+  p.hugePages = hugePolicy.load(std::memory_order_relaxed);
+  p.placement = placementPolicy.load(std::memory_order_relaxed);
+  return p;
+}
+
+size_t numaNodes() { return topology().cpus.size(); }
+
+size_t currentNumaNode() {
+#ifdef __linux__
+  const Topology &t = topology();
+  if (t.cpus.size() < 2)
+    return 0;
+  const int cpu = ::sched_getcpu();
+  if (cpu >= 0 && static_cast<size_t>(cpu) < t.nodeOfCpu.size())
+    return t.nodeOfCpu[static_cast<size_t>(cpu)];
+#endif
+  return 0;
+}
+
+std::vector<size_t> numaCpus(size_t node) {
+  const Topology &t = topology();
+  return node < t.cpus.size() ? t.cpus[node] : std::vector<size_t>{};
+}
+
+bool bindThreadToNode(size_t node) {
+#ifdef __linux__
+  const Topology &t = topology();
+  if (node >= t.cpus.size() || t.cpus[node].empty())
+    return false;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (size_t c : t.cpus[node])
+    if (c < CPU_SETSIZE)
+      CPU_SET(c, &set);
+  return ::sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  (void)node;
+  return false;
+#endif
+}
+
+void *allocatePages(size_t bytes) {
+  if (bytes < kPageBlockBytes)
+    return ::operator new(bytes);
+#ifdef _WIN32
+  return ::operator new(bytes);
+#else
+  const size_t len = roundUp(bytes);
+  const HugePages huge = hugePolicy.load(std::memory_order_relaxed);
+  void *p = nullptr;
+#ifdef MAP_HUGETLB
+  if (huge == HugePages::Explicit) {
+    void *q = ::mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (q != MAP_FAILED) {
+      p = q;
+      std::lock_guard<std::mutex> lk(hugeMtx);
+      hugeBlocks().insert(p);
+      hugeMapped.fetch_add(len, std::memory_order_relaxed);
+    }
+  }
+#endif
+  if (!p) {
+    p = mapAligned(len);
+    if (!p)
+      throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+    if (huge != HugePages::Off)
+      ::madvise(p, len, MADV_HUGEPAGE);
+#endif
+  }
+  // Before any page is touched, so the policy decides every placement
+  if (placementPolicy.load(std::memory_order_relaxed) ==
+      NumaPlacement::Interleave)
+    interleave(p, len);
+  mapped.fetch_add(len, std::memory_order_relaxed);
+  return p;
+#endif
+}
+
+void releasePages(void *p, size_t bytes) noexcept {
+  if (!p)
+    return;
+  if (bytes < kPageBlockBytes) {
+    ::operator delete(p);
+    return;
+  }
+#ifdef _WIN32
+  ::operator delete(p);
+#else
+  const size_t len = roundUp(bytes);
+  if (hugeMapped.load(std::memory_order_relaxed) > 0) {
+    std::lock_guard<std::mutex> lk(hugeMtx);
+    if (hugeBlocks().erase(p))
+      hugeMapped.fetch_sub(len, std::memory_order_relaxed);
+  }
+  ::munmap(p, len);
+  mapped.fetch_sub(len, std::memory_order_relaxed);
+#endif
+}
+
+size_t mappedBytes() { return mapped.load(std::memory_order_relaxed); }
+
+size_t hugePageBytes() { return hugeMapped.load(std::memory_order_relaxed); }
+
+} // namespace memory
+} // namespace kadedb
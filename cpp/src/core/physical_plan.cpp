@@ -0,0 +1,1611 @@
+#include "kadedb/physical_plan.h"
+
+#include "kadedb/cancellation.h"
+#include "kadedb/key_encoding.h"
+#include "kadedb/memory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <queue>
+
+namespace kadedb {
+namespace kadeql {
+
+// Utility: schema over a batch's column metadata (for expression lookups)
+static TableSchema schemaOf(const std::vector<std::string> &names,
+                            const std::vector<ColumnType> &types) {
+  TableSchema schema;
+  for (size_t i = 0; i < names.size(); ++i)
+    schema.addColumn(Column{names[i], types[i], true, false, {}});
+  return schema;
+}
+
+// Utility: `parts` separated by ", "
+static std::string joinList(const std::vector<std::string> &parts) {
+  std::string out;
+  for (const auto &part : parts)
+    out += (out.empty() ? "" : ", ") + part;
+  return out;
+}
+
+// ---- Keys ----
+
+size_t RowKeyHash::operator()(const RowKey &key) const {
+  size_t h = 0;
+  for (const auto &part : key)
+    h ^= std::hash<KeyPart>{}(part) + 0x9e3779b97f4a7c15ULL + (h << 6) +
+         (h >> 2);
+  return h;
+}
+
+KeyPart keyPart(const Value *v) {
+  if (!v)
+    return std::monostate{};
+  switch (v->type()) {
+  case ValueType::Integer:
+    return v->asInt();
+  case ValueType::Float: {
+    const double d = v->asFloat();
+    // 2^63 bounds the integral doubles that fit in int64_t
+    if (std::trunc(d) == d && d >= -9223372036854775808.0 &&
+        d < 9223372036854775808.0)
+      return static_cast<int64_t>(d);
+    return d;
+  }
+  case ValueType::String:
+    return v->asString();
+  case ValueType::Boolean:
+    return v->asBool();
+  case ValueType::Null:
+    break;
+  }
+  return std::monostate{};
+}
+
+Status PhysicalOperator::pushInBatches(std::vector<Cells> &rows) {
+  const size_t step = RelationalStorage::kDefaultBatchRows;
+  std::vector<Cells> batch;
+  for (size_t i = 0; i < rows.size() && !next_->done(); i += step) {
+    if (auto st = InterruptScope::check(); !st.ok())
+      return st;
+    const size_t end = std::min(rows.size(), i + step);
+    batch.clear();
+    batch.reserve(end - i);
+    for (size_t r = i; r < end; ++r)
+      batch.push_back(std::move(rows[r]));
+    if (auto st = next_->push(batch); !st.ok())
+      return st;
+  }
+  rows.clear();
+  return Status::OK();
+}
+
+// ---- Spilling ----
+
+size_t cellsBytes(const Cells &row) {
+  size_t bytes =
+      sizeof(Cells) + row.capacity() * sizeof(std::unique_ptr<Value>);
+  for (const auto &cell : row)
+    bytes += memory::valueBytes(cell.get());
+  return bytes;
+}
+
+namespace {
+
+// Partitioning passes before an operator keeps a partition in memory
+// whatever its size (rows sharing one key cannot be split further)
+constexpr size_t kMaxSpillDepth = 4;
+
+// `n` new spill files appended to `out`
+Status createSpillFiles(const SpillOptions &options, size_t n,
+                        std::vector<std::unique_ptr<SpillFile>> &out) {
+  for (size_t i = 0; i < n; ++i) {
+    auto file = SpillFile::create(options.directory);
+    if (!file.hasValue())
+      return file.status();
+    out.push_back(file.takeValue());
+  }
+  return Status::OK();
+}
+
+// Merge sorted inputs into `emit`, batch by batch, until it returns false
+class RunMerger {
+public:
+  using Emit = std::function<Result<bool>(std::vector<Cells> &rows)>;
+
+  RunMerger(const RowLess &less) : less_(less) {}
+
+  void addRun(SpillFile *file) { sources_.push_back(Source{file, {}, 0}); }
+  void addRows(std::vector<Cells> rows) {
+    sources_.push_back(Source{nullptr, std::move(rows), 0});
+  }
+
+  Status run(const Emit &emit) {
+    // Min-heap on each source's head row; ties go to the earlier source
+    auto after = [this](size_t a, size_t b) {
+      const Cells &x = head(a), &y = head(b);
+      if (less_(y, x))
+        return true;
+      return !less_(x, y) && b < a;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(after)> heap(
+        after);
+    for (size_t s = 0; s < sources_.size(); ++s) {
+      auto more = refill(s);
+      if (!more.hasValue())
+        return more.status();
+      if (more.value())
+        heap.push(s);
+    }
+    std::vector<Cells> out;
+    while (!heap.empty()) {
+      const size_t s = heap.top();
+      heap.pop();
+      Source &src = sources_[s];
+      out.push_back(std::move(src.rows[src.pos++]));
+      auto more = refill(s);
+      if (!more.hasValue())
+        return more.status();
+      if (more.value())
+        heap.push(s);
+      if (out.size() >= RelationalStorage::kDefaultBatchRows || heap.empty()) {
+        auto go = emit(out);
+        if (!go.hasValue())
+          return go.status();
+        out.clear();
+        if (!go.value())
+          break;
+      }
+    }
+    return Status::OK();
+  }
+
+private:
+  struct Source {
+    SpillFile *file; // nullptr: only `rows`
+    std::vector<Cells> rows;
+    size_t pos;
+  };
+
+  const Cells &head(size_t s) const {
+    return sources_[s].rows[sources_[s].pos];
+  }
+  // Whether source `s` has a head row, reading its next batch if needed
+  Result<bool> refill(size_t s) {
+    Source &src = sources_[s];
+    if (src.pos < src.rows.size())
+      return Result<bool>::ok(true);
+    if (!src.file)
+      return Result<bool>::ok(false);
+    if (auto st = src.file->read(src.rows); !st.ok())
+      return Result<bool>::err(st);
+    src.pos = 0;
+    return Result<bool>::ok(!src.rows.empty());
+  }
+
+  const RowLess &less_;
+  std::vector<Source> sources_;
+};
+
+} // namespace
+
+// The runs [first, last) merged into a new file
+static Result<std::unique_ptr<SpillFile>>
+mergeRuns(std::vector<std::unique_ptr<SpillFile>>::iterator first,
+          std::vector<std::unique_ptr<SpillFile>>::iterator last,
+          const RowLess &less, const std::string &directory) {
+  using R = Result<std::unique_ptr<SpillFile>>;
+  auto file = SpillFile::create(directory);
+  if (!file.hasValue())
+    return file;
+  SpillFile &into = *file.value();
+  RunMerger merger(less);
+  for (auto it = first; it != last; ++it)
+    merger.addRun(it->get());
+  Status st = merger.run([&](std::vector<Cells> &rows) {
+    for (auto &row : rows)
+      if (auto ast = into.append(std::move(row)); !ast.ok())
+        return Result<bool>::err(ast);
+    return Result<bool>::ok(true);
+  });
+  if (!st.ok())
+    return R::err(st);
+  return file;
+}
+
+Status SpillRuns::add(std::unique_ptr<SpillFile> run, const RowLess &less,
+                      const std::string &directory) {
+  files_.push_back(std::move(run));
+  levels_.push_back(0);
+  // Levels only fall towards the back, so full levels are trailing
+  // stretches of consecutive runs
+  while (files_.size() >= kMergeFanIn &&
+         levels_[files_.size() - kMergeFanIn] == levels_.back()) {
+    const auto first = files_.end() - kMergeFanIn;
+    auto merged = mergeRuns(first, files_.end(), less, directory);
+    if (!merged.hasValue())
+      return merged.status();
+    const size_t level = levels_.back() + 1;
+    files_.erase(first, files_.end());
+    levels_.resize(files_.size());
+    files_.push_back(merged.takeValue());
+    levels_.push_back(level);
+  }
+  return Status::OK();
+}
+
+size_t SpillRuns::rows() const {
+  size_t rows = 0;
+  for (const auto &file : files_)
+    rows += file->rows();
+  return rows;
+}
+
+void SpillRuns::clear() {
+  files_.clear();
+  levels_.clear();
+}
+
+Status PhysicalOperator::pushMerged(SpillRuns &runs, std::vector<Cells> tail,
+                                    const RowLess &less, size_t width) {
+  auto &files = runs.files();
+  // Merge the oldest runs until one pass can read the rest and the tail
+  while (files.size() + 1 > SpillRuns::kMergeFanIn) {
+    const auto last = files.begin() + SpillRuns::kMergeFanIn;
+    auto merged = mergeRuns(files.begin(), last, less, spill_.directory);
+    if (!merged.hasValue())
+      return merged.status();
+    files.erase(files.begin() + 1, last);
+    files.front() = merged.takeValue();
+  }
+  RunMerger merger(less);
+  for (auto &run : files)
+    merger.addRun(run.get());
+  merger.addRows(std::move(tail));
+  Status st = merger.run([&](std::vector<Cells> &rows) {
+    if (auto ist = InterruptScope::check(); !ist.ok())
+      return Result<bool>::err(ist);
+    for (auto &row : rows)
+      if (row.size() > width)
+        row.resize(width);
+    if (auto pst = next_->push(rows); !pst.ok())
+      return Result<bool>::err(pst);
+    return Result<bool>::ok(!next_->done());
+  });
+  runs.clear();
+  return st;
+}
+
+// ---- Filter ----
+
+Status FilterOperator::open(const std::vector<std::string> &names,
+                            const std::vector<ColumnType> &types) {
+  schema_ = schemaOf(names, types);
+  bound_ = BoundPredicate::bind(pred_, schema_);
+  return next_->open(names, types);
+}
+
+Status FilterOperator::push(std::vector<Cells> &rows) {
+  size_t kept = 0;
+  for (size_t r = 0; r < rows.size(); ++r) {
+    if (!bound_.matches(rows[r]))
+      continue;
+    if (kept != r)
+      rows[kept] = std::move(rows[r]);
+    ++kept;
+  }
+  rows.resize(kept);
+  return rows.empty() ? Status::OK() : next_->push(rows);
+}
+
+// ---- ExprFilter ----
+
+Status ExprFilterOperator::open(const std::vector<std::string> &names,
+                                const std::vector<ColumnType> &types) {
+  schema_ = schemaOf(names, types);
+  return next_->open(names, types);
+}
+
+Status ExprFilterOperator::push(std::vector<Cells> &rows) {
+  size_t kept = 0;
+  for (size_t r = 0; r < rows.size(); ++r) {
+    auto res = eval_(cond_, schema_, rows[r]);
+    if (!res.hasValue())
+      return res.status();
+    const Value &v = *res.value();
+    bool keep = false;
+    if (v.type() != ValueType::Null) {
+      try {
+        keep = v.asBool();
+      } catch (...) {
+        return Status::InvalidArgument(
+            "Filter condition is not boolean-convertible");
+      }
+    }
+    if (!keep)
+      continue;
+    if (kept != r)
+      rows[kept] = std::move(rows[r]);
+    ++kept;
+  }
+  rows.resize(kept);
+  return rows.empty() ? Status::OK() : next_->push(rows);
+}
+
+// ---- Project ----
+
+Status ProjectOperator::open(const std::vector<std::string> &names,
+                             const std::vector<ColumnType> &types) {
+  schema_ = schemaOf(names, types);
+  std::vector<std::string> outNames;
+  std::vector<ColumnType> outTypes;
+  for (const auto &item : items_) {
+    outNames.push_back(item.name);
+    outTypes.push_back(ColumnType::Integer); // default, will be refined
+  }
+  return next_->open(outNames, outTypes);
+}
+
+Status ProjectOperator::push(std::vector<Cells> &rows) {
+  std::vector<Cells> out;
+  out.reserve(rows.size());
+  for (const auto &row : rows) {
+    Cells vals;
+    vals.reserve(items_.size());
+    for (const auto &item : items_) {
+      auto valRes = eval_(item.expr, schema_, row);
+      if (!valRes.hasValue())
+        return valRes.status();
+      vals.push_back(valRes.takeValue());
+    }
+    out.push_back(std::move(vals));
+  }
+  return next_->push(out);
+}
+
+std::string ProjectOperator::detail() const {
+  std::vector<std::string> parts;
+  for (const auto &item : items_)
+    parts.push_back(item.expr->toString() + " AS " + item.name);
+  return joinList(parts);
+}
+
+// ---- TimeWindow ----
+
+Status TimeWindowOperator::open(const std::vector<std::string> &names,
+                                const std::vector<ColumnType> &types) {
+  schema_ = schemaOf(names, types);
+  tsIdx_ = schema_.findColumn(tsColumn_);
+  if (tsIdx_ == TableSchema::npos)
+    return Status::InvalidArgument("Unknown timestamp column: " + tsColumn_);
+  windows_.clear();
+  lastTs_.reset();
+  std::vector<std::string> outNames = names;
+  std::vector<ColumnType> outTypes = types;
+  for (const auto &item : items_) {
+    windows_.emplace_back(item.fn, item.width, unitSeconds_);
+    outNames.push_back(item.name);
+    outTypes.push_back(ColumnType::Float);
+  }
+  return next_->open(outNames, outTypes);
+}
+
+Status TimeWindowOperator::push(std::vector<Cells> &rows) {
+  for (auto &row : rows) {
+    const Value *t = row[tsIdx_].get();
+    if (!t || t->type() != ValueType::Integer)
+      return Status::InvalidArgument("Timestamp must be an integer");
+    const int64_t ts = t->asInt();
+    if (lastTs_ && ts < *lastTs_)
+      return Status::FailedPrecondition(
+          "Window functions need rows in timestamp order");
+    lastTs_ = ts;
+    for (size_t i = 0; i < items_.size(); ++i) {
+      auto valRes = eval_(items_[i].expr, schema_, row);
+      if (!valRes.hasValue())
+        return valRes.status();
+      const Value *v = valRes.value().get();
+      std::optional<double> y;
+      if (v && (v->type() == ValueType::Integer ||
+                v->type() == ValueType::Float))
+        y = windows_[i].add(ts, v->asFloat());
+      else if (v && v->type() != ValueType::Null)
+        return Status::InvalidArgument(
+            std::string(timeWindowFunctionName(items_[i].fn)) +
+            " requires numeric values");
+      row.push_back(y ? ValueFactory::createFloat(*y) : nullptr);
+    }
+  }
+  return next_->push(rows);
+}
+
+std::string TimeWindowOperator::detail() const {
+  std::vector<std::string> parts;
+  for (const auto &item : items_)
+    parts.push_back(item.name);
+  return joinList(parts) + " over " + tsColumn_;
+}
+
+// ---- HashAggregate ----
+
+Status HashAggregateOperator::open(const std::vector<std::string> &names,
+                                   const std::vector<ColumnType> &types) {
+  using K = Item::Kind;
+  // Detached: it ends after the scan feeding it
+  if (tracing::active())
+    span_.emplace("kadeql.aggregate", tracing::Span::Mode::Detached);
+  schema_ = schemaOf(names, types);
+  // FIRST/LAST without an order expression order by 'timestamp' if present
+  tsIdx_ = schema_.findColumn("timestamp");
+  auto columnOf = [&](const Expression *expr) {
+    auto id = dynamic_cast<const IdentifierExpression *>(expr);
+    return id ? schema_.findColumn(id->getName()) : TableSchema::npos;
+  };
+  keyIdx_.clear();
+  for (const Expression *key : keys_)
+    keyIdx_.push_back(columnOf(key));
+  std::vector<std::string> outNames;
+  std::vector<ColumnType> outTypes;
+  for (const auto &item : items_) {
+    outNames.push_back(item.name);
+    // Items passing a column's values through keep its type
+    const bool passThrough = item.kind == K::Plain || item.kind == K::Min ||
+                             item.kind == K::Max || item.kind == K::First ||
+                             item.kind == K::Last;
+    const size_t col = passThrough ? columnOf(item.expr) : TableSchema::npos;
+    const bool isFloat =
+        item.kind == K::Avg || item.kind == K::ApproxPercentile;
+    outTypes.push_back(col != TableSchema::npos ? types[col]
+                       : isFloat                ? ColumnType::Float
+                                                : ColumnType::Integer);
+  }
+  return next_->open(outNames, outTypes);
+}
+
+Status HashAggregateOperator::update(const Item &item, State &st,
+                                     const Cells &row) {
+  using K = Item::Kind;
+  switch (item.kind) {
+  case K::TimeBucket:
+    return Status::OK();
+  case K::First:
+  case K::Last: {
+    int64_t key = static_cast<int64_t>(rowNum_); // row index as fallback
+    if (item.order) {
+      auto okRes = eval_(item.order, schema_, row);
+      if (!okRes.hasValue())
+        return okRes.status();
+      key = okRes.value()->asInt();
+    } else if (tsIdx_ != TableSchema::npos && row[tsIdx_]) {
+      key = row[tsIdx_]->asInt();
+    }
+    // Ties keep the earliest row for FIRST and the latest for LAST
+    bool better =
+        !st.seen ||
+        (item.kind == K::First ? key < st.orderKey : key >= st.orderKey);
+    if (!better)
+      return Status::OK();
+    auto valRes = eval_(item.expr, schema_, row);
+    if (!valRes.hasValue())
+      return valRes.status();
+    st.seen = true;
+    st.orderKey = key;
+    st.value = valRes.takeValue();
+    return Status::OK();
+  }
+  case K::Plain: {
+    // Non-aggregate expression: evaluated on the first row of the group
+    if (st.seen)
+      return Status::OK();
+    auto valRes = eval_(item.expr, schema_, row);
+    if (!valRes.hasValue())
+      return valRes.status();
+    st.seen = true;
+    st.value = valRes.takeValue();
+    return Status::OK();
+  }
+  case K::Count:
+  case K::Sum:
+  case K::Min:
+  case K::Max:
+  case K::Avg:
+  case K::ApproxCountDistinct:
+  case K::ApproxPercentile:
+    break;
+  }
+  if (item.kind == K::Count && !item.expr) {
+    ++st.count;
+    return Status::OK();
+  }
+  auto valRes = eval_(item.expr, schema_, row);
+  if (!valRes.hasValue())
+    return valRes.status();
+  std::unique_ptr<Value> v = valRes.takeValue();
+  if (v->type() == ValueType::Null)
+    return Status::OK(); // aggregates skip nulls
+  switch (item.kind) {
+  case K::Sum:
+  case K::Avg:
+    if (v->type() == ValueType::Integer) {
+      st.intSum += v->asInt();
+    } else if (v->type() == ValueType::Float) {
+      st.floatSum += v->asFloat();
+      st.anyFloat = true;
+    } else {
+      return Status::InvalidArgument("SUM/AVG require numeric values");
+    }
+    ++st.count;
+    return Status::OK();
+  case K::Min:
+  case K::Max: {
+    int cmp = st.value ? v->compare(*st.value) : 0;
+    if (!st.value || (item.kind == K::Min ? cmp < 0 : cmp > 0))
+      st.value = std::move(v);
+    return Status::OK();
+  }
+  case K::ApproxCountDistinct:
+    if (!st.distinct)
+      st.distinct = std::make_unique<HyperLogLog>();
+    st.distinct->add(cellHash(InlineValue::fromValue(v.get())));
+    return Status::OK();
+  case K::ApproxPercentile:
+    if (v->type() != ValueType::Integer && v->type() != ValueType::Float)
+      return Status::InvalidArgument(
+          "APPROX_PERCENTILE requires numeric values");
+    if (!st.digest)
+      st.digest = std::make_unique<TDigest>();
+    st.digest->add(v->type() == ValueType::Integer
+                       ? static_cast<double>(v->asInt())
+                       : v->asFloat());
+    return Status::OK();
+  default:
+    ++st.count;
+    return Status::OK();
+  }
+}
+
+// Finalizer scrambling the low bits used for slot selection: integer keys
+// hash to themselves, and bucket starts share their low bits
+static size_t mixHash(size_t h) {
+  uint64_t x = static_cast<uint64_t>(h);
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  return static_cast<size_t>(x);
+}
+
+// Spill partition of a row with (mixed) key hash `hash` in a pass `depth`
+// deep; each pass remixes the hash so that it splits what the last one
+// could not
+static size_t spillPartition(size_t hash, size_t depth, size_t partitions) {
+  return mixHash(hash + 0x9e3779b97f4a7c15ULL * (depth + 1)) % partitions;
+}
+
+size_t HashAggregateOperator::findOrInsert(size_t hash, bool insert) {
+  if (insert && (groupKeys_.size() + 1) * 2 > slots_.size()) {
+    // Double the table, keeping it at most half full
+    std::vector<size_t> grown(std::max<size_t>(16, slots_.size() * 2), 0);
+    const size_t mask = grown.size() - 1;
+    for (size_t g = 0; g < groupHashes_.size(); ++g) {
+      size_t i = groupHashes_[g] & mask;
+      while (grown[i] != 0)
+        i = (i + 1) & mask;
+      grown[i] = g + 1;
+    }
+    slots_.swap(grown);
+  }
+  if (slots_.empty())
+    return TableSchema::npos;
+  const size_t mask = slots_.size() - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    const size_t slot = slots_[i];
+    if (slot == 0) {
+      if (!insert)
+        return TableSchema::npos;
+      slots_[i] = groupKeys_.size() + 1;
+      groupKeys_.push_back(key_);
+      groupHashes_.push_back(hash);
+      groupStates_.emplace_back(items_.size());
+      groupFirst_.push_back(rowNum_);
+      return groupKeys_.size() - 1;
+    }
+    if (groupHashes_[slot - 1] == hash && groupKeys_[slot - 1] == key_)
+      return slot - 1;
+  }
+}
+
+Status HashAggregateOperator::consume(Cells &row) {
+  key_.clear();
+  if (bucket_) {
+    auto tsRes = eval_(bucket_, schema_, row);
+    if (!tsRes.hasValue())
+      return tsRes.status();
+    int64_t ts = tsRes.value()->asInt();
+    keycode::appendI64(key_, (ts / interval_) * interval_);
+  }
+  for (size_t k = 0; k < keys_.size(); ++k) {
+    if (keyIdx_[k] != TableSchema::npos) {
+      keycode::appendSortKey(key_, row[keyIdx_[k]].get());
+      continue;
+    }
+    auto keyRes = eval_(keys_[k], schema_, row);
+    if (!keyRes.hasValue())
+      return keyRes.status();
+    keycode::appendSortKey(key_, keyRes.value().get());
+  }
+  const size_t hash = mixHash(std::hash<std::string>{}(key_));
+  const size_t groups = groupKeys_.size();
+  const size_t g = findOrInsert(hash, /*insert=*/partitions_.empty());
+  if (g == TableSchema::npos) {
+    // Partitioning: the row goes out with its number, FIRST/LAST's order
+    row.push_back(ValueFactory::createInteger(static_cast<int64_t>(rowNum_)));
+    ++spilledRows_;
+    return partitions_[spillPartition(hash, depth_, partitions_.size())]
+        ->append(std::move(row));
+  }
+  auto &states = groupStates_[g];
+  for (size_t i = 0; i < items_.size(); ++i) {
+    if (auto st = update(items_[i], states[i], row); !st.ok())
+      return st;
+  }
+  if (spill_.memoryBudget == 0 || groupKeys_.size() == groups)
+    return Status::OK();
+  bytes_ += sizeof(std::string) + key_.size() + 4 * sizeof(size_t) +
+            items_.size() * sizeof(State);
+  for (size_t i = 0; i < items_.size(); ++i)
+    if (states[i].distinct)
+      bytes_ += sizeof(HyperLogLog);
+    else if (states[i].digest)
+      bytes_ += states[i].digest->bytes();
+  if (bytes_ <= spill_.memoryBudget || depth_ >= kMaxSpillDepth)
+    return Status::OK();
+  const size_t n = std::max<size_t>(2, spill_.partitions);
+  spilledFiles_ += n;
+  return createSpillFiles(spill_, n, partitions_);
+}
+
+Status HashAggregateOperator::push(std::vector<Cells> &rows) {
+  for (auto &row : rows) {
+    if (auto st = consume(row); !st.ok())
+      return st;
+    ++rowNum_;
+  }
+  return Status::OK();
+}
+
+Cells HashAggregateOperator::groupRow(size_t g) {
+  using K = Item::Kind;
+  auto &states = groupStates_[g];
+  Cells outRow;
+  outRow.reserve(items_.size());
+  for (size_t i = 0; i < items_.size(); ++i) {
+    State &st = states[i];
+    switch (items_[i].kind) {
+    case K::TimeBucket:
+      // Return the bucket start
+      outRow.push_back(ValueFactory::createInteger(bucketOf(g)));
+      break;
+    case K::Count:
+      outRow.push_back(ValueFactory::createInteger(st.count));
+      break;
+    case K::Sum:
+      if (st.count == 0)
+        outRow.push_back(ValueFactory::createNull());
+      else if (st.anyFloat)
+        outRow.push_back(ValueFactory::createFloat(
+            st.floatSum + static_cast<double>(st.intSum)));
+      else
+        outRow.push_back(ValueFactory::createInteger(st.intSum));
+      break;
+    case K::Avg:
+      if (st.count == 0)
+        outRow.push_back(ValueFactory::createNull());
+      else
+        outRow.push_back(ValueFactory::createFloat(
+            (st.floatSum + static_cast<double>(st.intSum)) /
+            static_cast<double>(st.count)));
+      break;
+    case K::ApproxCountDistinct:
+      outRow.push_back(ValueFactory::createInteger(
+          st.distinct ? std::llround(st.distinct->estimate()) : 0));
+      break;
+    case K::ApproxPercentile:
+      if (!st.digest)
+        outRow.push_back(ValueFactory::createNull());
+      else
+        outRow.push_back(ValueFactory::createFloat(
+            st.digest->quantile(items_[i].quantile)));
+      break;
+    default:
+      outRow.push_back(st.value ? std::move(st.value)
+                                : ValueFactory::createNull());
+      break;
+    }
+  }
+  return outRow;
+}
+
+// Order of spilled groups: by the bucket and first row number appended
+// after their `width` output cells
+static RowLess groupOrder(size_t width) {
+  return [width](const Cells &a, const Cells &b) {
+    for (size_t i = width; i < width + 2; ++i)
+      if (a[i]->asInt() != b[i]->asInt())
+        return a[i]->asInt() < b[i]->asInt();
+    return false;
+  };
+}
+
+int64_t HashAggregateOperator::bucketOf(size_t g) const {
+  return bucket_ ? keycode::readI64(groupKeys_[g]) : 0;
+}
+
+Status HashAggregateOperator::spillGroups() {
+  // Output order: bucket (0 without one), then first row number
+  std::vector<size_t> order(groupKeys_.size());
+  for (size_t g = 0; g < order.size(); ++g)
+    order[g] = g;
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return bucketOf(a) != bucketOf(b) ? bucketOf(a) < bucketOf(b)
+                                      : groupFirst_[a] < groupFirst_[b];
+  });
+  std::vector<std::unique_ptr<SpillFile>> run;
+  if (auto st = createSpillFiles(spill_, 1, run); !st.ok())
+    return st;
+  ++spilledFiles_;
+  for (size_t g : order) {
+    Cells row = groupRow(g);
+    row.push_back(ValueFactory::createInteger(bucketOf(g)));
+    row.push_back(
+        ValueFactory::createInteger(static_cast<int64_t>(groupFirst_[g])));
+    if (auto st = run.front()->append(std::move(row)); !st.ok())
+      return st;
+  }
+  if (!order.empty())
+    if (auto st = runs_.add(std::move(run.front()),
+                            groupOrder(items_.size()), spill_.directory);
+        !st.ok())
+      return st;
+  groupKeys_.clear();
+  groupHashes_.clear();
+  groupStates_.clear();
+  groupFirst_.clear();
+  slots_.clear();
+  bytes_ = 0;
+  return Status::OK();
+}
+
+Status HashAggregateOperator::finish() {
+  const size_t rowsIn = rowNum_;
+  size_t groups = 0;
+  Status st = Status::OK();
+  if (partitions_.empty() && runs_.empty()) {
+    std::vector<size_t> order(groupKeys_.size());
+    for (size_t g = 0; g < order.size(); ++g)
+      order[g] = g;
+    // With a bucket, emit in bucket order (first-seen order within one)
+    if (bucket_)
+      std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return bucketOf(a) < bucketOf(b);
+      });
+    std::vector<Cells> out;
+    out.reserve(order.size());
+    for (size_t g : order)
+      out.push_back(groupRow(g));
+    groups = out.size();
+    groupKeys_.clear();
+    groupHashes_.clear();
+    groupStates_.clear();
+    groupFirst_.clear();
+    slots_.clear();
+    st = pushInBatches(out);
+  } else {
+    // Each pass aggregates one partition file, which may partition again
+    std::vector<Cells> rows;
+    for (;;) {
+      if (st = spillGroups(); !st.ok())
+        break;
+      for (auto &part : partitions_)
+        pending_.emplace_back(std::move(part), depth_ + 1);
+      partitions_.clear();
+      if (pending_.empty())
+        break;
+      std::unique_ptr<SpillFile> input = std::move(pending_.back().first);
+      depth_ = pending_.back().second;
+      pending_.pop_back();
+      for (;;) {
+        if (st = input->read(rows); !st.ok() || rows.empty())
+          break;
+        for (auto &row : rows) {
+          rowNum_ = static_cast<size_t>(row.back()->asInt());
+          row.pop_back();
+          if (st = consume(row); !st.ok())
+            break;
+        }
+        if (!st.ok())
+          break;
+      }
+      if (!st.ok())
+        break;
+    }
+    groups = runs_.rows();
+    if (st.ok())
+      st = pushMerged(runs_, {}, groupOrder(items_.size()), items_.size());
+    pending_.clear();
+    runs_.clear();
+  }
+  if (span_) {
+    span_->setAttribute("kadedb.rows_in", static_cast<int64_t>(rowsIn));
+    span_->setAttribute("kadedb.groups", static_cast<int64_t>(groups));
+  }
+  span_.reset();
+  if (!st.ok())
+    return st;
+  return next_->finish();
+}
+
+std::string HashAggregateOperator::detail() const {
+  std::vector<std::string> keys;
+  if (bucket_)
+    keys.push_back("TIME_BUCKET(" + bucket_->toString() + ", " +
+                   std::to_string(interval_) + ")");
+  for (const Expression *key : keys_)
+    keys.push_back(key->toString());
+  std::vector<std::string> names;
+  for (const auto &item : items_)
+    names.push_back(item.name);
+  std::string out =
+      keys.empty() ? "single group" : "hash groups on " + joinList(keys);
+  out += "; items " + joinList(names);
+  if (spilledFiles_ > 0)
+    out += "; spilled " + std::to_string(spilledRows_) + " rows to " +
+           std::to_string(spilledFiles_) + " files";
+  return out;
+}
+
+// ---- Sort ----
+
+Status SortOperator::open(const std::vector<std::string> &names,
+                          const std::vector<ColumnType> &types) {
+  resolved_.clear();
+  for (const auto &key : keys_) {
+    auto it = std::find(names.begin(), names.end(), key.column);
+    if (it == names.end())
+      return Status::InvalidArgument("Unknown column in ORDER BY: " +
+                                     key.column);
+    resolved_.emplace_back(static_cast<size_t>(it - names.begin()),
+                           key.descending);
+  }
+  return next_->open(names, types);
+}
+
+std::string SortOperator::sortKey(const Cells &row) const {
+  std::string key;
+  for (const auto &[col, desc] : resolved_)
+    keycode::appendSortKey(key, row[col].get(), desc);
+  return key;
+}
+
+bool SortOperator::before(const Entry &a, const Entry &b) {
+  const int c = a.key.compare(b.key);
+  return c != 0 ? c < 0 : a.seq < b.seq;
+}
+
+Status SortOperator::push(std::vector<Cells> &rows) {
+  for (auto &row : rows) {
+    Entry e{sortKey(row), seen_++, std::move(row)};
+    if (!topK_) {
+      if (spill_.memoryBudget > 0)
+        bytes_ += sizeof(Entry) + e.key.size() + cellsBytes(e.cells);
+      rows_.push_back(std::move(e));
+      if (spill_.memoryBudget > 0 && bytes_ > spill_.memoryBudget)
+        if (auto st = spillRun(); !st.ok())
+          return st;
+      continue;
+    }
+    if (rows_.size() < *topK_) {
+      rows_.push_back(std::move(e));
+      std::push_heap(rows_.begin(), rows_.end(), before);
+      continue;
+    }
+    // Full: replace the current last row when the new one sorts before it
+    if (rows_.empty() || !before(e, rows_.front()))
+      continue;
+    std::pop_heap(rows_.begin(), rows_.end(), before);
+    rows_.back() = std::move(e);
+    std::push_heap(rows_.begin(), rows_.end(), before);
+  }
+  return Status::OK();
+}
+
+RowLess SortOperator::runOrder() const {
+  // Runs hold consecutive stretches of input, so a merge taking ties from
+  // the earlier run stays stable
+  return [this](const Cells &a, const Cells &b) {
+    return sortKey(a) < sortKey(b);
+  };
+}
+
+void SortOperator::sortRows() {
+  // Sequence numbers make the order total, so an unstable sort is stable
+  std::sort(rows_.begin(), rows_.end(), before);
+}
+
+Status SortOperator::spillRun() {
+  sortRows();
+  std::vector<std::unique_ptr<SpillFile>> run;
+  if (auto st = createSpillFiles(spill_, 1, run); !st.ok())
+    return st;
+  for (auto &e : rows_)
+    if (auto st = run.front()->append(std::move(e.cells)); !st.ok())
+      return st;
+  ++spilledRuns_;
+  spilledRows_ += rows_.size();
+  rows_.clear();
+  bytes_ = 0;
+  return runs_.add(std::move(run.front()), runOrder(), spill_.directory);
+}
+
+Status SortOperator::finish() {
+  sortRows();
+  std::vector<Cells> out;
+  out.reserve(rows_.size());
+  for (auto &e : rows_)
+    out.push_back(std::move(e.cells));
+  rows_.clear();
+  bytes_ = 0;
+  Status st = runs_.empty() ? pushInBatches(out)
+                            : pushMerged(runs_, std::move(out), runOrder());
+  if (!st.ok())
+    return st;
+  return next_->finish();
+}
+
+std::string SortOperator::detail() const {
+  std::vector<std::string> keys;
+  for (const auto &key : keys_)
+    keys.push_back(key.column + (key.descending ? " DESC" : ""));
+  std::string out =
+      joinList(keys) +
+      (topK_ ? "; top " + std::to_string(*topK_) + " in a bounded heap"
+             : "; full sort");
+  if (spilledRuns_ > 0)
+    out += "; spilled " + std::to_string(spilledRows_) + " rows in " +
+           std::to_string(spilledRuns_) + " runs";
+  return out;
+}
+
+// ---- ColumnProject ----
+
+Status ColumnProjectOperator::open(const std::vector<std::string> &names,
+                                   const std::vector<ColumnType> &types) {
+  idx_.clear();
+  std::vector<ColumnType> outTypes;
+  for (const auto &c : columns_) {
+    auto it = std::find(names.begin(), names.end(), c);
+    if (it == names.end())
+      return Status::InvalidArgument("Unknown column in projection: " + c);
+    const size_t i = static_cast<size_t>(it - names.begin());
+    distinct_ = distinct_ && std::find(idx_.begin(), idx_.end(), i) ==
+                                 idx_.end();
+    idx_.push_back(i);
+    outTypes.push_back(types[i]);
+  }
+  return next_->open(names_.empty() ? columns_ : names_, outTypes);
+}
+
+Status ColumnProjectOperator::push(std::vector<Cells> &rows) {
+  for (auto &row : rows) {
+    Cells out;
+    out.reserve(idx_.size());
+    for (size_t i : idx_) {
+      if (distinct_)
+        out.push_back(std::move(row[i]));
+      else
+        out.push_back(row[i] ? row[i]->clone() : nullptr);
+    }
+    row = std::move(out);
+  }
+  return next_->push(rows);
+}
+
+std::string ColumnProjectOperator::detail() const {
+  std::vector<std::string> parts;
+  for (size_t i = 0; i < columns_.size(); ++i) {
+    const bool renamed = i < names_.size() && names_[i] != columns_[i];
+    parts.push_back(columns_[i] + (renamed ? " AS " + names_[i] : ""));
+  }
+  return joinList(parts);
+}
+
+// ---- HashJoin ----
+
+bool HashJoinOperator::makeKey(const Cells &row, const std::vector<size_t> &idx,
+                               Key &out) {
+  out.clear();
+  for (size_t i : idx) {
+    out.push_back(keyPart(row[i].get()));
+    if (std::holds_alternative<std::monostate>(out.back()))
+      return false;
+  }
+  return true;
+}
+
+Status HashJoinOperator::open(const std::vector<std::string> &names,
+                              const std::vector<ColumnType> &types) {
+  if (spec_.buildKeys.empty() ||
+      spec_.buildKeys.size() != spec_.probeKeys.size())
+    return Status::InvalidArgument("Join requires matching key columns");
+  probeWidth_ = names.size();
+  probeIdx_.clear();
+  for (const auto &key : spec_.probeKeys) {
+    auto it = std::find(names.begin(), names.end(), key);
+    if (it == names.end())
+      return Status::InvalidArgument("Unknown join column: " + key);
+    probeIdx_.push_back(static_cast<size_t>(it - names.begin()));
+  }
+
+  // Build side: materialize the (filtered) table, or partition it once it
+  // outgrows the budget
+  std::vector<std::string> buildNames;
+  std::vector<ColumnType> buildTypes;
+  build_.clear();
+  parts_.clear();
+  bytes_ = buildCount_ = 0;
+  const bool keepKeyless = spec_.type == Type::Left && spec_.buildIsLeft;
+  Status rowStatus = Status::OK();
+  Status st = storage_.scan(
+      spec_.buildTable, spec_.buildColumns, spec_.buildWhere,
+      [&](RowBatch &batch) {
+        if (buildNames.empty()) {
+          buildNames = std::move(batch.columnNames);
+          buildTypes = std::move(batch.columnTypes);
+          buildIdx_.clear();
+          for (const auto &key : spec_.buildKeys) {
+            auto it = std::find(buildNames.begin(), buildNames.end(), key);
+            if (it == buildNames.end()) {
+              rowStatus =
+                  Status::InvalidArgument("Unknown join column: " + key);
+              return false;
+            }
+            buildIdx_.push_back(static_cast<size_t>(it - buildNames.begin()));
+          }
+        }
+        buildCount_ += batch.rows.size();
+        for (auto &row : batch.rows) {
+          size_t p = 0;
+          if (!parts_.empty()) {
+            if (partitionOf(row, buildIdx_, keepKeyless, p))
+              rowStatus = parts_[p].build->append(std::move(row));
+          } else {
+            if (spill_.memoryBudget > 0)
+              bytes_ += cellsBytes(row) + memory::kMapEntryBytes;
+            build_.push_back(std::move(row));
+            if (spill_.memoryBudget > 0 && bytes_ > spill_.memoryBudget)
+              rowStatus = partition(0);
+          }
+          if (!rowStatus.ok())
+            return false;
+        }
+        return true;
+      });
+  if (!st.ok())
+    return st;
+  if (!rowStatus.ok())
+    return rowStatus;
+  buildWidth_ = buildNames.size();
+  if (buildNames.empty()) // no batch arrived
+    return Status::InvalidArgument("Unknown join column: " +
+                                   spec_.buildKeys.front());
+  if (parts_.empty())
+    index();
+
+  std::vector<std::string> outNames;
+  std::vector<ColumnType> outTypes;
+  auto append = [&](const std::vector<std::string> &ns,
+                    const std::vector<ColumnType> &ts,
+                    const std::string &prefix) {
+    for (size_t i = 0; i < ns.size(); ++i) {
+      outNames.push_back(prefix + ns[i]);
+      outTypes.push_back(ts[i]);
+    }
+  };
+  if (spec_.buildIsLeft) {
+    append(buildNames, buildTypes, spec_.buildPrefix);
+    append(names, types, spec_.probePrefix);
+  } else {
+    append(names, types, spec_.probePrefix);
+    append(buildNames, buildTypes, spec_.buildPrefix);
+  }
+  return next_->open(outNames, outTypes);
+}
+
+void HashJoinOperator::index() {
+  // Chain rows in input order: insert back to front so each head is the
+  // first row with its key
+  heads_.clear();
+  chain_.assign(build_.size(), TableSchema::npos);
+  Key key;
+  for (size_t r = build_.size(); r-- > 0;) {
+    if (!makeKey(build_[r], buildIdx_, key))
+      continue;
+    auto [it, inserted] = heads_.try_emplace(key, r);
+    if (!inserted) {
+      chain_[r] = it->second;
+      it->second = r;
+    }
+  }
+  matched_.clear();
+  if (spec_.type == Type::Left && spec_.buildIsLeft)
+    matched_.assign(build_.size(), false);
+}
+
+void HashJoinOperator::emit(const Cells *build, Cells *probe, bool moveProbe) {
+  Cells row;
+  row.reserve(buildWidth_ + probeWidth_);
+  auto addBuild = [&]() {
+    for (size_t i = 0; i < buildWidth_; ++i)
+      row.push_back(build && (*build)[i] ? (*build)[i]->clone() : nullptr);
+  };
+  auto addProbe = [&]() {
+    for (size_t i = 0; i < probeWidth_; ++i) {
+      if (!probe || !(*probe)[i])
+        row.push_back(nullptr);
+      else if (moveProbe)
+        row.push_back(std::move((*probe)[i]));
+      else
+        row.push_back((*probe)[i]->clone());
+    }
+  };
+  if (spec_.buildIsLeft) {
+    addBuild();
+    addProbe();
+  } else {
+    addProbe();
+    addBuild();
+  }
+  out_.push_back(std::move(row));
+}
+
+Status HashJoinOperator::flush() {
+  if (out_.empty())
+    return Status::OK();
+  Status st = next_->push(out_);
+  out_.clear();
+  return st;
+}
+
+Status HashJoinOperator::probe(std::vector<Cells> &rows) {
+  const bool preserveProbe = spec_.type == Type::Left && !spec_.buildIsLeft;
+  for (auto &row : rows) {
+    if (next_->done())
+      break;
+    auto it = makeKey(row, probeIdx_, probeKey_) ? heads_.find(probeKey_)
+                                                 : heads_.end();
+    if (it == heads_.end()) {
+      if (preserveProbe)
+        emit(nullptr, &row, /*moveProbe=*/true);
+    } else {
+      for (size_t r = it->second; r != TableSchema::npos; r = chain_[r]) {
+        emit(&build_[r], &row, /*moveProbe=*/chain_[r] == TableSchema::npos);
+        if (!matched_.empty())
+          matched_[r] = true;
+      }
+    }
+    if (out_.size() >= RelationalStorage::kDefaultBatchRows)
+      if (auto st = flush(); !st.ok())
+        return st;
+  }
+  return flush();
+}
+
+Status HashJoinOperator::push(std::vector<Cells> &rows) {
+  if (parts_.empty())
+    return probe(rows);
+  // Partitioned: probe rows wait in their partition, except keyless rows
+  // of a LEFT join that preserves them, which match nothing anyway
+  const bool preserveProbe = spec_.type == Type::Left && !spec_.buildIsLeft;
+  for (auto &row : rows) {
+    size_t p = 0;
+    if (partitionOf(row, probeIdx_, /*keepKeyless=*/false, p)) {
+      if (auto st = parts_[p].probe->append(std::move(row)); !st.ok())
+        return st;
+    } else if (preserveProbe) {
+      emit(nullptr, &row, /*moveProbe=*/true);
+    }
+  }
+  return flush();
+}
+
+Status HashJoinOperator::emitUnmatched() {
+  for (size_t r = 0; r < matched_.size() && !next_->done(); ++r) {
+    if (matched_[r])
+      continue;
+    emit(&build_[r], nullptr, /*moveProbe=*/false);
+    if (out_.size() >= RelationalStorage::kDefaultBatchRows)
+      if (auto st = flush(); !st.ok())
+        return st;
+  }
+  return flush();
+}
+
+bool HashJoinOperator::partitionOf(const Cells &row,
+                                   const std::vector<size_t> &idx,
+                                   bool keepKeyless, size_t &out) {
+  if (!makeKey(row, idx, probeKey_)) {
+    // Keyless rows join nothing; the first partition keeps them for LEFT
+    out = 0;
+    return keepKeyless;
+  }
+  const size_t depth = parts_.front().depth;
+  out = spillPartition(mixHash(RowKeyHash{}(probeKey_)), depth, parts_.size());
+  return true;
+}
+
+Status HashJoinOperator::partition(size_t depth) {
+  const size_t n = std::max<size_t>(2, spill_.partitions);
+  std::vector<std::unique_ptr<SpillFile>> files;
+  if (auto st = createSpillFiles(spill_, 2 * n, files); !st.ok())
+    return st;
+  spilledFiles_ += 2 * n;
+  parts_.clear();
+  for (size_t p = 0; p < n; ++p)
+    parts_.push_back(Partition{std::move(files[2 * p]),
+                               std::move(files[2 * p + 1]), depth});
+  const bool keepKeyless = spec_.type == Type::Left && spec_.buildIsLeft;
+  for (auto &row : build_) {
+    size_t p = 0;
+    if (!partitionOf(row, buildIdx_, keepKeyless, p))
+      continue;
+    if (auto st = parts_[p].build->append(std::move(row)); !st.ok())
+      return st;
+  }
+  build_.clear();
+  bytes_ = 0;
+  return Status::OK();
+}
+
+Status HashJoinOperator::joinPartitions() {
+  const bool keepKeyless = spec_.type == Type::Left && spec_.buildIsLeft;
+  std::vector<Partition> pending = std::move(parts_);
+  parts_.clear();
+  std::vector<Cells> rows;
+  while (!pending.empty() && !next_->done()) {
+    Partition part = std::move(pending.back());
+    pending.pop_back();
+    // Load the build side; one still too large is partitioned again
+    build_.clear();
+    bytes_ = 0;
+    for (;;) {
+      if (auto st = part.build->read(rows); !st.ok())
+        return st;
+      if (rows.empty())
+        break;
+      for (auto &row : rows) {
+        if (!parts_.empty()) {
+          size_t p = 0;
+          if (partitionOf(row, buildIdx_, keepKeyless, p))
+            if (auto st = parts_[p].build->append(std::move(row)); !st.ok())
+              return st;
+          continue;
+        }
+        bytes_ += cellsBytes(row) + memory::kMapEntryBytes;
+        build_.push_back(std::move(row));
+        if (bytes_ > spill_.memoryBudget && part.depth + 1 < kMaxSpillDepth)
+          if (auto st = partition(part.depth + 1); !st.ok())
+            return st;
+      }
+    }
+    if (!parts_.empty()) {
+      for (;;) {
+        if (auto st = part.probe->read(rows); !st.ok())
+          return st;
+        if (rows.empty())
+          break;
+        if (auto st = push(rows); !st.ok())
+          return st;
+      }
+      for (auto &child : parts_)
+        pending.push_back(std::move(child));
+      parts_.clear();
+      continue;
+    }
+    index();
+    for (;;) {
+      if (auto st = part.probe->read(rows); !st.ok())
+        return st;
+      if (rows.empty() || next_->done())
+        break;
+      if (auto st = probe(rows); !st.ok())
+        return st;
+    }
+    if (auto st = emitUnmatched(); !st.ok())
+      return st;
+  }
+  build_.clear();
+  heads_.clear();
+  chain_.clear();
+  matched_.clear();
+  return Status::OK();
+}
+
+Status HashJoinOperator::finish() {
+  Status st = parts_.empty() ? emitUnmatched() : joinPartitions();
+  if (!st.ok())
+    return st;
+  return PhysicalOperator::finish();
+}
+
+std::string HashJoinOperator::detail() const {
+  std::vector<std::string> keys;
+  for (size_t i = 0; i < spec_.buildKeys.size(); ++i)
+    keys.push_back(spec_.buildPrefix + spec_.buildKeys[i] + " = " +
+                   (i < spec_.probeKeys.size()
+                        ? spec_.probePrefix + spec_.probeKeys[i]
+                        : std::string("?")));
+  std::string out = spec_.type == Type::Left ? "LEFT" : "INNER";
+  out += " on " + joinList(keys) + "; build " + spec_.buildTable;
+  if (!spec_.buildColumns.empty())
+    out += " columns " + joinList(spec_.buildColumns);
+  out += spec_.buildIsLeft ? " (left side)" : " (right side)";
+  if (spec_.buildWhere)
+    out += " filtered by " + spec_.buildWhere->toString();
+  out += ", " + storage_.explainAccess(spec_.buildTable, spec_.buildWhere);
+  if (buildWidth_ > 0)
+    out += "; " + std::to_string(buildCount_) + " build rows";
+  if (spilledFiles_ > 0)
+    out += "; spilled to " + std::to_string(spilledFiles_) + " files";
+  return out;
+}
+
+// ---- Limit ----
+
+Status LimitOperator::open(const std::vector<std::string> &names,
+                           const std::vector<ColumnType> &types) {
+  return next_->open(names, types);
+}
+
+Status LimitOperator::push(std::vector<Cells> &rows) {
+  size_t begin = std::min(rows.size(), offset_ - skipped_);
+  skipped_ += begin;
+  size_t end = rows.size();
+  if (limit_)
+    end = std::min(end, begin + (*limit_ - passed_));
+  if (begin == end)
+    return Status::OK();
+  if (begin > 0 || end < rows.size()) {
+    std::vector<Cells> slice;
+    slice.reserve(end - begin);
+    for (size_t r = begin; r < end; ++r)
+      slice.push_back(std::move(rows[r]));
+    rows.swap(slice);
+  }
+  passed_ += rows.size();
+  return next_->push(rows);
+}
+
+bool LimitOperator::done() const {
+  return (limit_ && passed_ >= *limit_) || PhysicalOperator::done();
+}
+
+std::string LimitOperator::detail() const {
+  std::string out =
+      limit_ ? "limit " + std::to_string(*limit_) : std::string("no limit");
+  if (offset_ > 0)
+    out += " offset " + std::to_string(offset_);
+  return out;
+}
+
+// ---- Collect ----
+
+Status CollectOperator::open(const std::vector<std::string> &names,
+                             const std::vector<ColumnType> &types) {
+  result_ = ResultSet(names, types);
+  return Status::OK();
+}
+
+Status CollectOperator::push(std::vector<Cells> &rows) {
+  for (auto &row : rows)
+    result_.addRow(ResultRow(std::move(row)));
+  return Status::OK();
+}
+
+Status SinkOperator::open(const std::vector<std::string> &names,
+                          const std::vector<ColumnType> &types) {
+  batch_.columnNames = names;
+  batch_.columnTypes = types;
+  return Status::OK();
+}
+
+Status SinkOperator::push(std::vector<Cells> &rows) {
+  if (stopped_ || rows.empty())
+    return Status::OK();
+  batch_.rows = std::move(rows);
+  rows.clear();
+  delivered_ = true;
+  stopped_ = !sink_(batch_);
+  batch_.rows.clear();
+  return Status::OK();
+}
+
+Status SinkOperator::finish() {
+  if (!delivered_ && !stopped_) {
+    delivered_ = true;
+    stopped_ = !sink_(batch_);
+  }
+  return Status::OK();
+}
+
+// ---- Plan ----
+
+namespace {
+
+// Utility: estimated heap footprint of a batch of rows
+size_t batchBytes(const std::vector<Cells> &rows) {
+  size_t bytes = 0;
+  for (const auto &row : rows) {
+    bytes += sizeof(Cells) + row.capacity() * sizeof(std::unique_ptr<Value>);
+    for (const auto &cell : row) {
+      if (!cell)
+        continue;
+      switch (cell->type()) {
+      case ValueType::String:
+        bytes += sizeof(StringValue) + cell->asString().size();
+        break;
+      case ValueType::Float:
+        bytes += sizeof(FloatValue);
+        break;
+      default:
+        bytes += sizeof(IntegerValue);
+        break;
+      }
+    }
+  }
+  return bytes;
+}
+
+// Pass-through operator placed after every stage of a profiled plan:
+// counts what the stage emits and the time spent downstream of it
+class StageProbe final : public PhysicalOperator {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  Status open(const std::vector<std::string> &names,
+              const std::vector<ColumnType> &types) override {
+    auto start = Clock::now();
+    Status st = next_->open(names, types);
+    downstream += Clock::now() - start;
+    return st;
+  }
+  Status push(std::vector<Cells> &rows) override {
+    rowsOut += rows.size();
+    ++batchesOut;
+    bytesOut += batchBytes(rows);
+    auto start = Clock::now();
+    Status st = next_->push(rows);
+    downstream += Clock::now() - start;
+    return st;
+  }
+  Status finish() override {
+    auto start = Clock::now();
+    Status st = next_->finish();
+    downstream += Clock::now() - start;
+    return st;
+  }
+  std::string name() const override { return "Probe"; }
+
+  size_t rowsOut = 0, batchesOut = 0, bytesOut = 0;
+  Clock::duration downstream{};
+};
+
+} // namespace
+
+std::vector<PlanStage> PhysicalPlan::describe() const {
+  std::vector<PlanStage> stages;
+  PlanStage scan;
+  scan.name = "Scan";
+  if (storage_) {
+    scan.detail = table_;
+    if (!columns_.empty())
+      scan.detail += " columns " + joinList(columns_);
+    if (where_)
+      scan.detail += " filtered by " + where_->toString();
+    scan.detail += ", " + (order_ ? storage_->explainOrderedAccess(
+                                         table_, where_, *order_)
+                                   : storage_->explainAccess(table_, where_));
+  } else {
+    scan.detail = description_;
+  }
+  stages.push_back(std::move(scan));
+  for (const auto &op : ops_) {
+    if (dynamic_cast<const CollectOperator *>(op.get()))
+      continue;
+    PlanStage stage;
+    stage.name = op->name();
+    stage.detail = op->detail();
+    stages.push_back(std::move(stage));
+  }
+  return stages;
+}
+
+Result<ResultSet> PhysicalPlan::execute(std::vector<PlanStage> *profile) {
+  CollectOperator &collect = add<CollectOperator>();
+  if (auto st = run(profile); !st.ok())
+    return Result<ResultSet>::err(st);
+  return Result<ResultSet>::ok(collect.take());
+}
+
+Status PhysicalPlan::execute(const RelationalStorage::BatchSink &sink) {
+  add<SinkOperator>(sink);
+  return run(nullptr);
+}
+
+Status PhysicalPlan::run(std::vector<PlanStage> *profile) {
+  using Clock = StageProbe::Clock;
+  // Probe k follows stage k: the scan, then each operator before Collect
+  std::vector<std::unique_ptr<StageProbe>> probes;
+  std::vector<PhysicalOperator *> chain;
+  for (auto &op : ops_) {
+    op->setSpillOptions(spill_);
+    if (profile) {
+      probes.push_back(std::make_unique<StageProbe>());
+      chain.push_back(probes.back().get());
+    }
+    chain.push_back(op.get());
+  }
+  for (size_t i = 0; i + 1 < chain.size(); ++i)
+    chain[i]->setNext(chain[i + 1]);
+  PhysicalOperator &root = *chain.front();
+
+  const auto start = Clock::now();
+  bool opened = false;
+  Status opStatus = Status::OK();
+  RelationalStorage::BatchSink sink = [&](RowBatch &batch) {
+    opStatus = InterruptScope::check();
+    if (!opStatus.ok())
+      return false;
+    if (!opened) {
+      opened = true;
+      opStatus = root.open(batch.columnNames, batch.columnTypes);
+      if (!opStatus.ok())
+        return false;
+    }
+    if (!batch.rows.empty())
+      opStatus = root.push(batch.rows);
+    return opStatus.ok() && !root.done();
+  };
+  Status scanStatus =
+      !storage_ ? source_(sink, batchRows_)
+      : order_  ? storage_->scanOrdered(table_, columns_, where_, *order_,
+                                        sink, batchRows_)
+                : storage_->scan(table_, columns_, where_, sink, batchRows_);
+  if (!scanStatus.ok())
+    return scanStatus;
+  if (!opStatus.ok())
+    return opStatus;
+  if (auto st = root.finish(); !st.ok())
+    return st;
+
+  if (profile) {
+    const auto total = Clock::now() - start;
+    auto ms = [](Clock::duration d) {
+      return std::chrono::duration<double, std::milli>(d).count();
+    };
+    *profile = describe();
+    for (size_t k = 0; k < profile->size(); ++k) {
+      PlanStage &stage = (*profile)[k];
+      const StageProbe &out = *probes[k];
+      stage.rowsIn = k > 0 ? probes[k - 1]->rowsOut : 0;
+      stage.rowsOut = out.rowsOut;
+      stage.batchesOut = out.batchesOut;
+      stage.bytesOut = out.bytesOut;
+      stage.ms = ms((k > 0 ? probes[k - 1]->downstream : total) -
+                    out.downstream);
+    }
+  }
+  return Status::OK();
+}
+
+} // namespace kadeql
+} // namespace kadedb
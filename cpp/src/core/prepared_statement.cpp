@@ -0,0 +1,204 @@
+#include "kadedb/prepared_statement.h"
+
+#include "kadedb/kadeql_parser.h"
+
+#include <cctype>
+#include <optional>
+
+namespace kadedb {
+namespace kadeql {
+
+// ---- PreparedStatement ----
+
+Result<std::shared_ptr<PreparedStatement>>
+PreparedStatement::prepare(const std::string &query) {
+  using R = Result<std::shared_ptr<PreparedStatement>>;
+  KadeQLParser parser;
+  std::unique_ptr<Statement> stmt;
+  try {
+    stmt = parser.parse(query);
+  } catch (const ParseError &e) {
+    return R::err(Status::InvalidArgument(e.what()));
+  }
+  std::vector<std::vector<ParameterExpression *>> slots;
+  for (ParameterExpression *p : parser.parameters()) {
+    if (p->getIndex() >= slots.size())
+      slots.resize(p->getIndex() + 1);
+    slots[p->getIndex()].push_back(p);
+  }
+  return R::ok(std::shared_ptr<PreparedStatement>(
+      new PreparedStatement(query, std::move(stmt), std::move(slots))));
+}
+
+Status PreparedStatement::withBound(
+    const std::vector<std::unique_ptr<Value>> &params,
+    const std::function<Status()> &run) const {
+  if (params.size() != slots_.size())
+    return Status::InvalidArgument(
+        "Statement expects " + std::to_string(slots_.size()) +
+        " parameters, got " + std::to_string(params.size()));
+  // Without parameters the AST is never written, so no lock is needed
+  if (slots_.empty())
+    return run();
+
+  std::vector<LiteralExpression::Value> bound;
+  bound.reserve(params.size());
+  for (size_t i = 0; i < params.size(); ++i) {
+    const Value *v = params[i].get();
+    const ValueType t = v ? v->type() : ValueType::Null;
+    switch (t) {
+    case ValueType::Integer:
+      bound.emplace_back(v->asInt());
+      break;
+    case ValueType::Float:
+      bound.emplace_back(v->asFloat());
+      break;
+    case ValueType::String:
+      bound.emplace_back(v->asString());
+      break;
+    default:
+      return Status::InvalidArgument(
+          "Parameter $" + std::to_string(i + 1) +
+          " must be an Integer, Float or String value");
+    }
+  }
+
+  std::lock_guard<std::mutex> lk(mtx_);
+  for (size_t i = 0; i < slots_.size(); ++i)
+    for (ParameterExpression *p : slots_[i])
+      p->bind(bound[i]);
+  return run();
+}
+
+Result<ResultSet> PreparedStatement::execute(
+    QueryExecutor &executor,
+    const std::vector<std::unique_ptr<Value>> &params) const {
+  std::optional<Result<ResultSet>> res;
+  Status st = withBound(params, [&] {
+    res.emplace(executor.execute(*stmt_));
+    return Status::OK();
+  });
+  if (!st.ok())
+    return Result<ResultSet>::err(st);
+  return std::move(*res);
+}
+
+Status
+PreparedStatement::execute(QueryExecutor &executor,
+                           const std::vector<std::unique_ptr<Value>> &params,
+                           const RelationalStorage::BatchSink &sink) const {
+  return withBound(params, [&] { return executor.execute(*stmt_, sink); });
+}
+
+Result<QueryExecutor::Page> PreparedStatement::executePage(
+    QueryExecutor &executor, const std::vector<std::unique_ptr<Value>> &params,
+    size_t pageSize, const std::string &token) const {
+  using R = Result<QueryExecutor::Page>;
+  if (stmt_->type() != StatementType::SELECT)
+    return R::err(Status::InvalidArgument("Only a SELECT can be paginated"));
+  std::optional<R> res;
+  Status st = withBound(params, [&] {
+    res.emplace(executor.executePage(
+        static_cast<const SelectStatement &>(*stmt_), pageSize, token));
+    return Status::OK();
+  });
+  if (!st.ok())
+    return R::err(st);
+  return std::move(*res);
+}
+
+// ---- Normalization ----
+
+std::string normalizeQuery(const std::string &query) {
+  std::string out;
+  out.reserve(query.size());
+  char quote = 0;     // active string delimiter, 0 outside literals
+  bool space = false; // whitespace pending since the last emitted char
+  for (size_t i = 0; i < query.size(); ++i) {
+    const char c = query[i];
+    if (quote) {
+      out += c;
+      if (c == '\\' && i + 1 < query.size())
+        out += query[++i];
+      else if (c == quote)
+        quote = 0;
+      continue;
+    }
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      space = true;
+      continue;
+    }
+    if (space && !out.empty())
+      out += ' ';
+    space = false;
+    if (c == '\'' || c == '"')
+      quote = c;
+    out += c;
+  }
+  // Trailing semicolons (and the whitespace between them)
+  while (!quote && !out.empty() && (out.back() == ';' || out.back() == ' '))
+    out.pop_back();
+  return out;
+}
+
+// ---- StatementCache ----
+
+Result<std::shared_ptr<PreparedStatement>>
+StatementCache::prepare(const std::string &query) {
+  using R = Result<std::shared_ptr<PreparedStatement>>;
+  std::string key = normalizeQuery(query);
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      ++hits_;
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return R::ok(it->second->second);
+    }
+    ++misses_;
+  }
+
+  // Parse outside the lock; a concurrent miss on the same key keeps the
+  // first entry inserted
+  auto prepared = PreparedStatement::prepare(key);
+  if (!prepared.hasValue() || capacity_ == 0)
+    return prepared;
+
+  std::lock_guard<std::mutex> lk(mtx_);
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return R::ok(it->second->second);
+  }
+  lru_.emplace_front(key, prepared.value());
+  index_.emplace(std::move(key), lru_.begin());
+  if (lru_.size() > capacity_) {
+    index_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+  return prepared;
+}
+
+size_t StatementCache::size() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return lru_.size();
+}
+
+uint64_t StatementCache::hits() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return hits_;
+}
+
+uint64_t StatementCache::misses() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return misses_;
+}
+
+void StatementCache::clear() {
+  std::lock_guard<std::mutex> lk(mtx_);
+  lru_.clear();
+  index_.clear();
+}
+
+} // namespace kadeql
+} // namespace kadedb
@@ -1,16 +1,26 @@
 #include "kadedb/query_executor.h"
 
+#include "kadedb/expr_program.h"
 #include "kadedb/gpu.h"
+#include "kadedb/metrics.h"
+#include "kadedb/physical_plan.h"
 #include "kadedb/predicate_builder.h"
 #include "kadedb/schema.h"
+#include "kadedb/serialization.h"
 #include "kadedb/value.h"
 
 #include <algorithm>
 #include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
-#include <map>
+#include <cstring>
+#include <sstream>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
+#include <variant>
 
 namespace kadedb {
 namespace kadeql {
@@ -31,6 +41,32 @@ QueryExecutor::literalToValue(const LiteralExpression::Value &v) const {
   return ValueFactory::createNull();
 }
 
+// Helper: check that every column a predicate references exists in `schema`
+static Status checkPredicateColumns(const TableSchema &schema,
+                                    const Predicate &p) {
+  using K = Predicate::Kind;
+  switch (p.kind) {
+  case K::Comparison:
+    if (schema.findColumn(p.column) == TableSchema::npos)
+      return Status::InvalidArgument("Unknown column in predicate: " +
+                                     p.column);
+    return Status::OK();
+  case K::And:
+  case K::Or:
+    for (const auto &ch : p.children) {
+      auto st = checkPredicateColumns(schema, ch);
+      if (!st.ok())
+        return st;
+    }
+    return Status::OK();
+  case K::Not:
+    if (p.children.empty())
+      return Status::OK();
+    return checkPredicateColumns(schema, p.children.front());
+  }
+  return Status::OK();
+}
+
 // Validate that all columns referenced in a predicate exist in the table schema
 Status
 QueryExecutor::validatePredicateColumns(const std::string &table,
@@ -38,42 +74,12 @@ QueryExecutor::validatePredicateColumns(const std::string &table,
   if (!where)
     return Status::OK();
 
-  // Probe schema via select * (as in executeInsert)
-  auto probe = storage_.select(table, /*columns=*/{}, /*where=*/std::nullopt);
+  // Schema lookup only; no rows are read
+  auto probe = storage_.getTableSchema(table);
   if (!probe.hasValue()) {
     return probe.status();
   }
-  const ResultSet &schemaView = probe.value();
-  const auto &allCols = schemaView.columnNames();
-  std::unordered_set<std::string> colset(allCols.begin(), allCols.end());
-
-  // Recursive check
-  std::function<Status(const Predicate &)> check =
-      [&](const Predicate &p) -> Status {
-    using K = Predicate::Kind;
-    switch (p.kind) {
-    case K::Comparison:
-      if (colset.find(p.column) == colset.end())
-        return Status::InvalidArgument("Unknown column in predicate: " +
-                                       p.column);
-      return Status::OK();
-    case K::And:
-    case K::Or:
-      for (const auto &ch : p.children) {
-        auto st = check(ch);
-        if (!st.ok())
-          return st;
-      }
-      return Status::OK();
-    case K::Not:
-      if (p.children.empty())
-        return Status::OK();
-      return check(p.children.front());
-    }
-    return Status::OK();
-  };
-
-  return check(*where);
+  return checkPredicateColumns(probe.value(), *where);
 }
 
 static Predicate::Op toPredOp(BinaryExpression::Operator op) {
@@ -530,24 +536,839 @@ QueryExecutor::buildPredicate(const Expression *expr) const {
       "Unsupported WHERE predicate: expected binary expression"));
 }
 
+// Helper: AND of the given predicates (nullopt when there are none)
+static std::optional<Predicate> conjunction(std::vector<Predicate> parts) {
+  std::optional<Predicate> out;
+  if (parts.size() == 1) {
+    out.emplace(std::move(parts[0]));
+  } else if (!parts.empty()) {
+    Predicate p;
+    p.kind = Predicate::Kind::And;
+    p.children = std::move(parts);
+    out.emplace(std::move(p));
+  }
+  return out;
+}
+
+// Collect the identifiers an expression references
+static void collectIdentifiers(const Expression *expr,
+                               std::vector<std::string> &out) {
+  if (!expr)
+    return;
+  if (auto id = dynamic_cast<const IdentifierExpression *>(expr)) {
+    out.push_back(id->getName());
+  } else if (auto be = dynamic_cast<const BinaryExpression *>(expr)) {
+    collectIdentifiers(be->getLeft(), out);
+    collectIdentifiers(be->getRight(), out);
+  } else if (auto ue = dynamic_cast<const UnaryExpression *>(expr)) {
+    collectIdentifiers(ue->getOperand(), out);
+  } else if (auto bw = dynamic_cast<const BetweenExpression *>(expr)) {
+    collectIdentifiers(bw->getExpr(), out);
+    collectIdentifiers(bw->getLower(), out);
+    collectIdentifiers(bw->getUpper(), out);
+  } else if (auto fn = dynamic_cast<const FunctionCallExpression *>(expr)) {
+    for (const auto &arg : fn->getArgs())
+      collectIdentifiers(arg.get(), out);
+  }
+}
+
+// Helper: append the exact value of every literal and bound parameter in
+// `expr` to `key`; toString() rounds floats and shows parameters as $n
+static void appendLiterals(const Expression *expr, std::string &key) {
+  if (!expr)
+    return;
+  if (auto lit = dynamic_cast<const LiteralExpression *>(expr)) {
+    std::visit(
+        [&](const auto &v) {
+          using T = std::decay_t<decltype(v)>;
+          if constexpr (std::is_same_v<T, std::string>) {
+            key += 's' + std::to_string(v.size()) + ':';
+            key += v;
+          } else {
+            char bytes[sizeof(T)];
+            std::memcpy(bytes, &v, sizeof(T));
+            key += std::is_same_v<T, double> ? 'f' : 'i';
+            key.append(bytes, sizeof(T));
+          }
+        },
+        lit->getValue());
+  } else if (auto be = dynamic_cast<const BinaryExpression *>(expr)) {
+    appendLiterals(be->getLeft(), key);
+    appendLiterals(be->getRight(), key);
+  } else if (auto ue = dynamic_cast<const UnaryExpression *>(expr)) {
+    appendLiterals(ue->getOperand(), key);
+  } else if (auto bw = dynamic_cast<const BetweenExpression *>(expr)) {
+    appendLiterals(bw->getExpr(), key);
+    appendLiterals(bw->getLower(), key);
+    appendLiterals(bw->getUpper(), key);
+  } else if (auto fn = dynamic_cast<const FunctionCallExpression *>(expr)) {
+    for (const auto &arg : fn->getArgs())
+      appendLiterals(arg.get(), key);
+  }
+}
+
+// Helper: append the top-level AND operands of `expr` to `out`
+static void collectConjuncts(const Expression *expr,
+                             std::vector<const Expression *> &out) {
+  auto be = dynamic_cast<const BinaryExpression *>(expr);
+  if (be && be->getOperator() == BinaryExpression::Operator::AND) {
+    collectConjuncts(be->getLeft(), out);
+    collectConjuncts(be->getRight(), out);
+  } else if (expr) {
+    out.push_back(expr);
+  }
+}
+
+Result<std::optional<Predicate>>
+QueryExecutor::splitWhere(const Expression *where,
+                          std::vector<const Expression *> &residual) const {
+  std::vector<const Expression *> conjuncts;
+  collectConjuncts(where, conjuncts);
+  std::vector<Predicate> pushed;
+  for (const Expression *c : conjuncts) {
+    auto res = buildPredicate(c);
+    if (!res.hasValue()) {
+      residual.push_back(c);
+      continue;
+    }
+    if (auto p = res.takeValue())
+      pushed.push_back(std::move(*p));
+  }
+  std::optional<Predicate> out = conjunction(std::move(pushed));
+  if (out)
+    out = simplifyPred(*out);
+  return Result<std::optional<Predicate>>::ok(std::move(out));
+}
+
 // ---- Public API ----
 
-Result<ResultSet> QueryExecutor::execute(const Statement &statement) {
-  switch (statement.type()) {
+// Helper: "SELECT", "INSERT", ... for span attributes
+static const char *statementTypeName(StatementType type) {
+  switch (type) {
   case StatementType::SELECT:
-    return executeSelect(static_cast<const SelectStatement &>(statement));
+    return "SELECT";
   case StatementType::INSERT:
-    return executeInsert(static_cast<const InsertStatement &>(statement));
+    return "INSERT";
   case StatementType::UPDATE:
-    return executeUpdate(static_cast<const UpdateStatement &>(statement));
+    return "UPDATE";
   case StatementType::DELETE:
-    return executeDelete(static_cast<const DeleteStatement &>(statement));
+    return "DELETE";
+  case StatementType::EXPLAIN:
+    return "EXPLAIN";
+  }
+  return "";
+}
+
+// Helper: one-line plan of a slow or traced statement
+static std::string planSummary(const std::vector<PlanStage> &stages) {
+  std::string out;
+  for (const auto &stage : stages) {
+    if (!out.empty())
+      out += " -> ";
+    out += stage.name;
+    if (!stage.detail.empty())
+      out += " (" + stage.detail + ")";
+  }
+  return out;
+}
+
+Result<ResultSet> QueryExecutor::execute(const Statement &statement) {
+  using Clock = std::chrono::steady_clock;
+  metrics::OperationScope scope(metrics::Operation::KadeqlExecute);
+  tracing::Span span("kadeql.execute");
+  if (span.recording())
+    span.setAttribute("db.operation", statementTypeName(statement.type()));
+  std::optional<tracing::Span> planSpan;
+  if (statement.type() == StatementType::SELECT && span.recording())
+    planSpan.emplace("kadeql.plan");
+  std::optional<tracing::Span> *const outerPlanSpan = planSpan_;
+  planSpan_ = &planSpan;
+  // Only the outermost statement is logged, not the one EXPLAIN runs
+  const bool outermost = !inStatement_;
+  uint64_t allocations = 0, bytes = 0;
+  // The statement's cancellation and deadline reach every loop it runs
+  std::optional<InterruptScope> interrupt;
+  if (outermost) {
+    inStatement_ = true;
+    deadline_.reset();
+    if (timeout_.count() > 0)
+      deadline_ = Clock::now() + timeout_;
+    if (token_ || deadline_)
+      interrupt.emplace([this] { return interruptStatus(); });
+    slowLogging_ = slowLog_->enabled();
+    if (slowLogging_) {
+      statementPlan_.clear();
+      streamedRows_ = 0;
+      allocations = ValueArena::threadAllocations();
+      bytes = ValueArena::threadBytesAllocated();
+      statementStart_ = Clock::now();
+    }
+  }
+  auto run = [&]() -> Result<ResultSet> {
+    if (auto st = interruptStatus(); !st.ok())
+      return Result<ResultSet>::err(st);
+    switch (statement.type()) {
+    case StatementType::SELECT: {
+      const auto &select = static_cast<const SelectStatement &>(statement);
+      // The values a query produces are short-lived and many
+      ValueArena::Scope arena;
+      if (!outermost || explain_ != ExplainMode::None)
+        return executeSelect(select);
+      // A page's token is not part of the cache key
+      if (resultCache_ && !page_)
+        return executeCachedSelect(select);
+      return executeAdmittedSelect(select);
+    }
+    case StatementType::INSERT:
+      return executeInsert(static_cast<const InsertStatement &>(statement));
+    case StatementType::UPDATE:
+      return executeUpdate(static_cast<const UpdateStatement &>(statement));
+    case StatementType::DELETE:
+      return executeDelete(static_cast<const DeleteStatement &>(statement));
+    case StatementType::EXPLAIN:
+      return executeExplain(static_cast<const ExplainStatement &>(statement));
+    }
+    return Result<ResultSet>::err(
+        Status::InvalidArgument("Unsupported statement type in executor"));
+  };
+  auto res = run();
+  planSpan_ = outerPlanSpan;
+  planSpan.reset();
+  if (res.hasValue()) {
+    metrics::OperationScope::addRows(0, res.value().rowCount());
+  } else {
+    scope.fail();
+    span.fail();
+  }
+  if (outermost) {
+    inStatement_ = false;
+    if (slowLogging_) {
+      const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                          Clock::now() - statementStart_)
+                          .count();
+      if (slowLog_->isSlow(static_cast<uint64_t>(us)))
+        logSlowQuery(statement, res, static_cast<uint64_t>(us),
+                     scope.rowsScanned(),
+                     ValueArena::threadAllocations() - allocations,
+                     ValueArena::threadBytesAllocated() - bytes);
+    }
+  }
+  return res;
+}
+
+struct QueryExecutor::PageState {
+  size_t size = 0;
+  Row after; // page keys of the previous page's last row (none: first page)
+  std::string nextToken;
+};
+
+// Helper: page token of `keys` (hex of the serialized row)
+static std::string encodePageToken(const Row &keys) {
+  std::ostringstream os;
+  bin::writeRow(keys, os);
+  static const char kHex[] = "0123456789abcdef";
+  std::string token;
+  for (unsigned char c : os.str()) {
+    token.push_back(kHex[c >> 4]);
+    token.push_back(kHex[c & 0xF]);
+  }
+  return token;
+}
+
+static std::optional<Row> decodePageToken(const std::string &token) {
+  if (token.size() % 2 != 0)
+    return std::nullopt;
+  auto nibble = [](char c) -> int {
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    return -1;
+  };
+  std::string bytes;
+  for (size_t i = 0; i < token.size(); i += 2) {
+    const int hi = nibble(token[i]), lo = nibble(token[i + 1]);
+    if (hi < 0 || lo < 0)
+      return std::nullopt;
+    bytes.push_back(static_cast<char>(hi << 4 | lo));
+  }
+  try {
+    std::istringstream is(bytes);
+    Row row = bin::readRow(is);
+    if (is.peek() != std::char_traits<char>::eof())
+      return std::nullopt;
+    for (const auto &v : row.values())
+      if (!v || v->type() == ValueType::Null)
+        return std::nullopt;
+    return row;
+  } catch (const SerializationError &) {
+    return std::nullopt;
+  }
+}
+
+Result<QueryExecutor::Page>
+QueryExecutor::executePage(const SelectStatement &select, size_t pageSize,
+                           const std::string &token) {
+  using R = Result<Page>;
+  if (pageSize == 0)
+    return R::err(Status::InvalidArgument("Page size must be positive"));
+  if (!select.getJoins().empty() || select.isExpressionMode() ||
+      select.getOrderBy().empty() || select.getLimit() ||
+      select.getOffset() > 0)
+    return R::err(Status::InvalidArgument(
+        "Keyset pagination needs a single-table SELECT of columns with "
+        "ORDER BY and without LIMIT or OFFSET"));
+  PageState page;
+  page.size = pageSize;
+  if (!token.empty()) {
+    auto after = decodePageToken(token);
+    if (!after)
+      return R::err(Status::InvalidArgument("Invalid page token"));
+    page.after = std::move(*after);
+  }
+  PageState *const outer = std::exchange(page_, &page);
+  auto res = execute(select);
+  page_ = outer;
+  if (!res.hasValue())
+    return R::err(res.status());
+  return R::ok(Page{res.takeValue(), std::move(page.nextToken)});
+}
+
+Result<ResultSet>
+QueryExecutor::executeCachedSelect(const SelectStatement &select) {
+  // FROM and JOIN sources resolved the way the plan will; anything else
+  // (the slow query log, a missing table) is not cached
+  std::vector<ResultSource> sources;
+  std::vector<std::string> names{select.getTableName()};
+  for (const auto &join : select.getJoins())
+    names.push_back(join.table);
+  for (auto &name : names) {
+    ResultSource source;
+    source.name = std::move(name);
+    std::optional<uint64_t> version = storage_.tableVersion(source.name);
+    if (!version && timeseries_ && source.name != SlowQueryLog::kTableName) {
+      source.kind = ResultSource::Kind::Series;
+      version = timeseries_->seriesVersion(source.name);
+    }
+    if (!version)
+      return executeAdmittedSelect(select);
+    source.version = *version;
+    sources.push_back(std::move(source));
+  }
+
+  std::string key = select.toString();
+  key += '\0';
+  for (const auto &item : select.getSelectItems())
+    appendLiterals(item.expr.get(), key);
+  for (const auto &join : select.getJoins())
+    appendLiterals(join.on.get(), key);
+  appendLiterals(select.getWhereClause(), key);
+  for (const auto &expr : select.getGroupBy())
+    appendLiterals(expr.get(), key);
+  appendLiterals(select.getHaving(), key);
+
+  auto versionOf = [this](const ResultSource &source) {
+    return sourceVersion(source);
+  };
+  if (auto hit = resultCache_->lookup(key, versionOf))
+    return Result<ResultSet>::ok(std::move(*hit));
+  // Versions were read before the plan ran: a write racing with it makes
+  // the entry stale rather than wrong
+  auto res = executeAdmittedSelect(select);
+  // A streamed result went to sink_ and is not kept
+  if (res.hasValue() && !sink_)
+    resultCache_->insert(key, std::move(sources), res.value());
+  return res;
+}
+
+Result<ResultSet>
+QueryExecutor::executeAdmittedSelect(const SelectStatement &select) {
+  if (!admission_)
+    return executeSelect(select);
+  // Held until the result is complete (streamed results included)
+  auto ticket = admission_->admit(estimateSelectCost(select),
+                                  token_ ? &*token_ : nullptr, deadline_);
+  if (!ticket.hasValue())
+    return Result<ResultSet>::err(ticket.status());
+  return executeSelect(select);
+}
+
+std::optional<double>
+QueryExecutor::estimateSelectCost(const SelectStatement &select) {
+  const std::string &table = select.getTableName();
+  if (select.getJoins().empty()) {
+    std::optional<Predicate> where;
+    std::vector<const Expression *> residual;
+    if (auto split = splitWhere(select.getWhereClause(), residual);
+        split.hasValue())
+      where = split.takeValue();
+    if (auto rows = storage_.estimateScanCost(table, where))
+      return static_cast<double>(*rows);
+    // The slow query log is small and bounded
+    if (table == SlowQueryLog::kTableName)
+      return 0.0;
+    return std::nullopt;
+  }
+  // Every table of a join is read in full
+  double rows = 0;
+  std::vector<std::string> tables{table};
+  for (const auto &join : select.getJoins())
+    tables.push_back(join.table);
+  for (const auto &t : tables) {
+    auto n = storage_.estimateRowCount(t);
+    if (!n)
+      return std::nullopt;
+    rows += static_cast<double>(*n);
   }
-  return Result<ResultSet>::err(
-      Status::InvalidArgument("Unsupported statement type in executor"));
+  return rows;
+}
+
+Status QueryExecutor::interruptStatus() const {
+  if (token_ && token_->cancelled())
+    return Status::Cancelled("Query cancelled");
+  if (deadline_ && std::chrono::steady_clock::now() >= *deadline_)
+    return Status::Cancelled("Query timed out after " +
+                             std::to_string(timeout_.count()) + " ms");
+  return Status::OK();
+}
+
+std::optional<uint64_t>
+QueryExecutor::sourceVersion(const ResultSource &source) const {
+  std::optional<uint64_t> table = storage_.tableVersion(source.name);
+  if (source.kind == ResultSource::Kind::Table)
+    return table;
+  // A table created under the name of a series takes precedence over it
+  if (table || !timeseries_)
+    return std::nullopt;
+  return timeseries_->seriesVersion(source.name);
+}
+
+Status QueryExecutor::execute(const Statement &statement,
+                              const RelationalStorage::BatchSink &sink) {
+  // Counts the rows streamed, for the slow query log
+  const RelationalStorage::BatchSink counted = [&](RowBatch &batch) {
+    streamedRows_ += batch.rows.size();
+    return sink(batch);
+  };
+  sink_ = &counted;
+  streamed_ = false;
+  auto res = execute(statement);
+  sink_ = nullptr;
+  if (!res.hasValue())
+    return res.status();
+  if (streamed_)
+    return Status::OK();
+  // Not run as a plan: hand over the materialized result
+  RowBatch batch;
+  ResultSet rs = res.takeValue();
+  batch.columnNames = rs.columnNames();
+  batch.columnTypes = rs.columnTypes();
+  batch.rows.reserve(rs.rowCount());
+  for (const auto &row : rs) {
+    Cells cells;
+    cells.reserve(row.size());
+    for (const auto &v : row.values())
+      cells.push_back(v ? v->clone() : nullptr);
+    batch.rows.push_back(std::move(cells));
+  }
+  sink(batch);
+  return Status::OK();
+}
+
+void QueryExecutor::logSlowQuery(const Statement &statement,
+                                 const Result<ResultSet> &res,
+                                 uint64_t durationUs, uint64_t rowsScanned,
+                                 uint64_t allocations,
+                                 uint64_t bytesAllocated) {
+  SlowQueryEntry e;
+  e.durationUs = durationUs;
+  e.startedAtUs =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count() -
+      static_cast<int64_t>(durationUs);
+  e.query = statement.toString();
+  e.fingerprint = SlowQueryLog::fingerprint(e.query);
+  e.fingerprintHash = SlowQueryLog::fingerprintHash(e.fingerprint);
+  e.plan = std::move(statementPlan_);
+  statementPlan_.clear();
+  if (e.plan.empty() && res.hasValue() &&
+      statement.type() != StatementType::SELECT &&
+      statement.type() != StatementType::EXPLAIN) {
+    // Writes describe their plan only under EXPLAIN: plan this one again
+    inStatement_ = true;
+    stages_.clear();
+    explain_ = ExplainMode::Plan;
+    if (execute(statement).hasValue())
+      e.plan = planSummary(stages_);
+    explain_ = ExplainMode::None;
+    stages_.clear();
+    inStatement_ = false;
+  }
+  e.rowsScanned = rowsScanned;
+  if (res.hasValue()) {
+    const ResultSet &out = res.value();
+    // Writes answer with the rows they changed
+    if (statement.type() == StatementType::INSERT ||
+        statement.type() == StatementType::UPDATE ||
+        statement.type() == StatementType::DELETE)
+      e.rowsReturned = out.rowCount() > 0
+                           ? static_cast<uint64_t>(out.at(0, 0).asInt())
+                           : 0;
+    else
+      e.rowsReturned = streamed_ ? streamedRows_ : out.rowCount();
+    e.status = "OK";
+  } else {
+    e.status = res.status().message();
+  }
+  e.allocations = allocations;
+  e.bytesAllocated = bytesAllocated;
+  slowLog_->record(std::move(e));
+}
+
+// Helper: append the ORDER BY / LIMIT / OFFSET operators of a SELECT. With a
+// LIMIT the sort keeps only the first offset + limit rows (top-K); without
+// ORDER BY the Limit stops the scan once it has enough rows. `keyColumns`
+// names the input column of each ORDER BY key (default: as written).
+static void
+addOrderLimit(PhysicalPlan &plan, const SelectStatement &select,
+              const std::vector<std::string> *keyColumns = nullptr) {
+  const auto &limit = select.getLimit();
+  const size_t offset = select.getOffset();
+  if (!select.getOrderBy().empty()) {
+    std::vector<SortOperator::Key> keys;
+    const auto &orderBy = select.getOrderBy();
+    for (size_t i = 0; i < orderBy.size(); ++i)
+      keys.push_back(SortOperator::Key{
+          keyColumns ? (*keyColumns)[i] : orderBy[i].column,
+          orderBy[i].descending});
+    std::optional<size_t> topK;
+    if (limit)
+      topK = *limit > SIZE_MAX - offset ? SIZE_MAX : *limit + offset;
+    plan.add<SortOperator>(std::move(keys), topK);
+  }
+  if (limit || offset > 0)
+    plan.add<LimitOperator>(limit, offset);
+}
+
+// Helper: sort keys of a keyset-paginated SELECT: its ORDER BY keys, then
+// the primary key unless ORDER BY has it, so that no two rows tie
+static Result<std::vector<SortOperator::Key>>
+pageKeys(const SelectStatement &select, const TableSchema &schema) {
+  using R = Result<std::vector<SortOperator::Key>>;
+  const auto &pk = schema.primaryKey();
+  if (!pk)
+    return R::err(Status::InvalidArgument(
+        "Keyset pagination needs a table with a primary key"));
+  std::vector<SortOperator::Key> keys;
+  for (const auto &key : select.getOrderBy())
+    keys.push_back(SortOperator::Key{key.column, key.descending});
+  if (std::none_of(keys.begin(), keys.end(),
+                   [&](const SortOperator::Key &k) { return k.column == *pk; }))
+    keys.push_back(SortOperator::Key{*pk, false});
+  for (const auto &key : keys) {
+    const size_t idx = schema.findColumn(key.column);
+    if (idx == TableSchema::npos)
+      return R::err(Status::InvalidArgument("Unknown column in ORDER BY: " +
+                                            key.column));
+    if (schema.columns()[idx].nullable)
+      return R::err(Status::InvalidArgument(
+          "Keyset pagination needs NOT NULL sort keys: " + key.column));
+  }
+  return R::ok(std::move(keys));
+}
+
+// Helper: the rows after `after` in the order of `keys`: k1 >= v1 AND
+// (k1 > v1 OR (k1 = v1 AND (k2 > v2 OR ...))), with <= and < on descending
+// keys. The leading conjunct bounds a scan of an index on k1.
+static Predicate pageAfter(const std::vector<SortOperator::Key> &keys,
+                           const Row &after) {
+  auto compare = [&](size_t i, bool strict) {
+    Predicate p;
+    p.column = keys[i].column;
+    if (!strict)
+      p.op = keys[i].descending ? Predicate::Op::Le : Predicate::Op::Ge;
+    else
+      p.op = keys[i].descending ? Predicate::Op::Lt : Predicate::Op::Gt;
+    p.rhs = after.at(i).clone();
+    return p;
+  };
+  auto logical = [](Predicate::Kind kind, Predicate a, Predicate b) {
+    Predicate p;
+    p.kind = kind;
+    p.children.push_back(std::move(a));
+    p.children.push_back(std::move(b));
+    return p;
+  };
+  Predicate rest = compare(keys.size() - 1, true);
+  for (size_t i = keys.size() - 1; i-- > 0;) {
+    Predicate eq = compare(i, true);
+    eq.op = Predicate::Op::Eq;
+    rest = logical(Predicate::Kind::Or, compare(i, true),
+                   logical(Predicate::Kind::And, std::move(eq),
+                           std::move(rest)));
+  }
+  if (keys.size() == 1)
+    return rest;
+  return logical(Predicate::Kind::And, compare(0, false), std::move(rest));
+}
+
+struct QueryExecutor::ScanSpec {
+  std::string table;
+  TableSchema schema;
+  std::optional<TimeSeriesSchema> series; // set when FROM names a series
+  bool slowQueries = false; // FROM names SlowQueryLog::kTableName
+  std::optional<Predicate> where;         // pushed into the scan
+  std::vector<const Expression *> residual;
+};
+
+Result<QueryExecutor::ScanSpec>
+QueryExecutor::planScan(const SelectStatement &select) {
+  using R = Result<ScanSpec>;
+  ScanSpec spec;
+  spec.table = select.getTableName();
+  // Schema lookup only; no rows are read
+  auto schemaRes = storage_.getTableSchema(spec.table);
+  if (schemaRes.hasValue()) {
+    spec.schema = schemaRes.takeValue();
+  } else if (schemaRes.status().code() == StatusCode::NotFound &&
+             spec.table == SlowQueryLog::kTableName) {
+    spec.slowQueries = true;
+    spec.schema = SlowQueryLog::schema();
+  } else {
+    if (!timeseries_ || schemaRes.status().code() != StatusCode::NotFound)
+      return R::err(schemaRes.status());
+    auto seriesRes = timeseries_->getSeriesSchema(spec.table);
+    if (!seriesRes.hasValue())
+      return R::err(schemaRes.status());
+    spec.series = seriesRes.takeValue();
+    spec.schema = TableSchema(spec.series->allColumns());
+  }
+
+  auto whereRes = splitWhere(select.getWhereClause(), spec.residual);
+  if (!whereRes.hasValue())
+    return R::err(whereRes.status());
+  spec.where = whereRes.takeValue();
+  // Validate referenced columns (clearer error vs silent mismatch)
+  if (spec.where) {
+    if (auto st = checkPredicateColumns(spec.schema, *spec.where); !st.ok())
+      return R::err(st);
+  }
+  std::vector<std::string> refs;
+  for (const Expression *c : spec.residual)
+    collectIdentifiers(c, refs);
+  for (const auto &ref : refs) {
+    if (spec.schema.findColumn(ref) == TableSchema::npos)
+      return R::err(
+          Status::InvalidArgument("Unknown column in predicate: " + ref));
+  }
+  if (!spec.series && !spec.slowQueries)
+    orderConjuncts(spec.table, spec.where);
+  return R::ok(std::move(spec));
+}
+
+// Helper: narrow [start, end) by the Integer comparisons on `column` in the
+// top-level conjunction `p`
+static void narrowTimeRange(const Predicate &p, const std::string &column,
+                            int64_t &start, int64_t &end) {
+  if (p.kind == Predicate::Kind::And) {
+    for (const auto &ch : p.children)
+      narrowTimeRange(ch, column, start, end);
+    return;
+  }
+  if (p.kind != Predicate::Kind::Comparison || p.column != column || !p.rhs ||
+      p.rhs->type() != ValueType::Integer)
+    return;
+  const int64_t v = p.rhs->asInt();
+  const int64_t next = v == INT64_MAX ? v : v + 1;
+  switch (p.op) {
+  case Predicate::Op::Eq:
+    start = std::max(start, v);
+    end = std::min(end, next);
+    break;
+  case Predicate::Op::Gt:
+    start = std::max(start, next);
+    break;
+  case Predicate::Op::Ge:
+    start = std::max(start, v);
+    break;
+  case Predicate::Op::Lt:
+    end = std::min(end, v);
+    break;
+  case Predicate::Op::Le:
+    end = std::min(end, next);
+    break;
+  case Predicate::Op::Ne:
+    break;
+  }
+}
+
+std::unique_ptr<PhysicalPlan>
+QueryExecutor::makeSlowQueryScan(ScanSpec &spec,
+                                 std::vector<std::string> columns) {
+  // The entries are read when the plan runs, not when it is built
+  const SlowQueryLog &log = *slowLog_;
+  auto where = std::make_shared<const std::optional<Predicate>>(
+      std::move(spec.where));
+  std::string description = std::string("system table ") +
+                            SlowQueryLog::kTableName;
+  if (*where)
+    description += " filtered by " + (*where)->toString();
+  return std::make_unique<PhysicalPlan>(
+      [&log, columns = std::move(columns),
+       where](const RelationalStorage::BatchSink &sink, size_t batchRows) {
+        const TableSchema schema = SlowQueryLog::schema();
+        std::vector<size_t> idx;
+        std::vector<std::string> names;
+        std::vector<ColumnType> types;
+        if (columns.empty())
+          for (size_t i = 0; i < schema.columns().size(); ++i)
+            idx.push_back(i);
+        for (const auto &name : columns) {
+          const size_t i = schema.findColumn(name);
+          if (i == TableSchema::npos)
+            return Status::InvalidArgument("Unknown column: " + name);
+          idx.push_back(i);
+        }
+        for (size_t i : idx) {
+          names.push_back(schema.columns()[i].name);
+          types.push_back(schema.columns()[i].type);
+        }
+        std::optional<BoundPredicate> bound;
+        if (*where)
+          bound = BoundPredicate::bind(**where, schema);
+        ResultSet rs(std::move(names), std::move(types));
+        for (const auto &row : log.rows()) {
+          if (bound && !bound->matches(row))
+            continue;
+          std::vector<std::unique_ptr<Value>> cells;
+          cells.reserve(idx.size());
+          for (size_t i : idx)
+            cells.push_back(row.values()[i]->clone());
+          rs.addRow(ResultRow(std::move(cells)));
+        }
+        return scanResultSet(rs, sink, batchRows);
+      },
+      std::move(description));
+}
+
+std::unique_ptr<PhysicalPlan>
+QueryExecutor::makeScan(ScanSpec &spec, std::vector<std::string> columns) {
+  if (spec.slowQueries)
+    return makeSlowQueryScan(spec, std::move(columns));
+  if (!spec.series)
+    return std::make_unique<PhysicalPlan>(storage_, spec.table,
+                                          std::move(columns),
+                                          std::move(spec.where));
+  // Time series: the timestamp bounds of the pushed predicate become the
+  // range read. The predicate still filters the rows in range, as ranges
+  // are resolved at the series' granularity.
+  int64_t start = INT64_MIN, end = INT64_MAX;
+  if (spec.where)
+    narrowTimeRange(*spec.where, spec.series->timestampColumn(), start, end);
+  end = std::max(start, end);
+  auto where = std::make_shared<const std::optional<Predicate>>(
+      std::move(spec.where));
+  TimeSeriesStorage &ts = *timeseries_;
+  std::string series = spec.table;
+  auto bound = [](int64_t t, int64_t open, const char *inf) {
+    return t == open ? std::string(inf) : std::to_string(t);
+  };
+  std::string description = "series " + series + " time range [" +
+                            bound(start, INT64_MIN, "-inf") + ", " +
+                            bound(end, INT64_MAX, "+inf") + ")";
+  if (*where)
+    description += " filtered by " + (*where)->toString();
+  return std::make_unique<PhysicalPlan>(
+      [&ts, series, columns = std::move(columns), start, end,
+       where](const RelationalStorage::BatchSink &sink, size_t batchRows) {
+        return ts.scan(series, columns, start, end, *where, sink, batchRows);
+      },
+      std::move(description));
+}
+
+// Helper: relative cost of evaluating `p` on one row; string comparisons
+// walk characters
+static double predicateCost(const Predicate &p) {
+  if (p.kind == Predicate::Kind::Comparison)
+    return p.rhs && p.rhs->type() == ValueType::String ? 2.0 : 1.0;
+  double cost = 0;
+  for (const auto &ch : p.children)
+    cost += predicateCost(ch);
+  return std::max(cost, 1.0);
+}
+
+// Helper: order the children of every AND/OR in `p` by rank. An AND child
+// lets a share `sel` of the rows through to the next one, an OR child a
+// share 1 - sel, so ascending (pass - 1) / cost puts the cheapest, most
+// decisive tests first; ties keep the canonical order.
+static void orderByRank(Predicate &p, const TableStatistics &stats) {
+  using K = Predicate::Kind;
+  for (auto &ch : p.children)
+    orderByRank(ch, stats);
+  if (p.kind != K::And && p.kind != K::Or)
+    return;
+  std::vector<std::pair<double, Predicate>> ranked;
+  ranked.reserve(p.children.size());
+  for (auto &ch : p.children) {
+    const double sel = stats.selectivity(ch);
+    const double pass = p.kind == K::And ? sel : 1 - sel;
+    ranked.emplace_back((pass - 1) / predicateCost(ch), std::move(ch));
+  }
+  std::stable_sort(
+      ranked.begin(), ranked.end(),
+      [](const auto &a, const auto &b) { return a.first < b.first; });
+  for (size_t i = 0; i < ranked.size(); ++i)
+    p.children[i] = std::move(ranked[i].second);
+}
+
+void QueryExecutor::orderConjuncts(const std::string &table,
+                                   std::optional<Predicate> &where) const {
+  if (!where)
+    return;
+  if (auto stats = storage_.getTableStatistics(table))
+    orderByRank(*where, *stats);
+}
+
+std::optional<double>
+QueryExecutor::estimateScanRows(const std::string &table,
+                                const std::optional<Predicate> &where) const {
+  if (auto stats = storage_.getTableStatistics(table))
+    return stats->estimateRows(where);
+  if (auto rows = storage_.estimateRowCount(table))
+    return static_cast<double>(*rows);
+  return std::nullopt;
+}
+
+// Helper: evaluator that compiles each expression once per input schema
+// (on its first row) and reruns the program for the following rows. The
+// schemas are the operators' own, so they outlive the evaluator's calls.
+static ExprEvaluator compiledEvaluator() {
+  struct Entry {
+    const Expression *expr;
+    const TableSchema *schema;
+    ExprProgram program;
+  };
+  auto cache = std::make_shared<std::vector<Entry>>();
+  return [cache](const Expression *expr, const TableSchema &schema,
+                 const Cells &row) {
+    for (const auto &e : *cache)
+      if (e.expr == expr && e.schema == &schema)
+        return e.program.run(row);
+    cache->push_back(Entry{expr, &schema, ExprProgram::compile(expr, schema)});
+    return cache->back().program.run(row);
+  };
+}
+
+void QueryExecutor::addResidualFilters(
+    PhysicalPlan &plan, const std::vector<const Expression *> &residual) {
+  for (const Expression *cond : residual)
+    plan.add<ExprFilterOperator>(cond, compiledEvaluator());
 }
 
 Result<ResultSet> QueryExecutor::executeSelect(const SelectStatement &select) {
+  if (!select.getJoins().empty())
+    return executeJoinSelect(select);
   // Check if this is expression mode with potential aggregates
   if (select.isExpressionMode()) {
     return executeSelectWithExpressions(select);
@@ -560,27 +1381,31 @@ Result<ResultSet> QueryExecutor::executeSelect(const SelectStatement &select) {
     cols = sc; // projection list
   }
 
-  auto predRes = buildPredicate(select.getWhereClause());
-  if (!predRes.hasValue())
-    return Result<ResultSet>::err(predRes.status());
-  // Simplify predicate before pushdown
-  std::optional<Predicate> where = predRes.takeValue();
-  if (where) {
-    where = simplifyPred(*where);
-  }
-  // Validate referenced columns (clearer error vs silent mismatch)
-  if (auto st = validatePredicateColumns(select.getTableName(), where);
-      !st.ok()) {
-    return Result<ResultSet>::err(st);
-  }
+  // Translatable WHERE conjuncts are pushed into the scan (simplified);
+  // the rest are evaluated per row
+  auto specRes = planScan(select);
+  if (!specRes.hasValue())
+    return Result<ResultSet>::err(specRes.status());
+  ScanSpec spec = specRes.takeValue();
+  const std::optional<Predicate> &where = spec.where;
 
   const char *gpuEnv = std::getenv("KADEDB_ENABLE_GPU_EXEC");
   const bool gpuEnabled = (gpuEnv && std::string(gpuEnv) != "0");
 
-  if (gpuEnabled && where && where->kind == Predicate::Kind::Comparison &&
+  const bool ordered = !select.getOrderBy().empty() || select.getLimit() ||
+                       select.getOffset() > 0;
+  const bool pushedOnly = !spec.series && spec.residual.empty();
+  if (gpuEnabled && explain_ == ExplainMode::None && pushedOnly && !ordered &&
+      where &&
+      where->kind == Predicate::Kind::Comparison &&
       where->rhs && where->rhs->type() == ValueType::Integer) {
+    // Read the filter column and the projection only
+    std::vector<std::string> baseCols = cols;
+    if (!baseCols.empty() && std::find(baseCols.begin(), baseCols.end(),
+                                       where->column) == baseCols.end())
+      baseCols.push_back(where->column);
     auto baseRes =
-        storage_.select(select.getTableName(), /*columns=*/{}, std::nullopt);
+        storage_.select(select.getTableName(), baseCols, std::nullopt);
     if (!baseRes.hasValue())
       return Result<ResultSet>::err(baseRes.status());
     const ResultSet &base = baseRes.value();
@@ -673,12 +1498,119 @@ Result<ResultSet> QueryExecutor::executeSelect(const SelectStatement &select) {
     }
   }
 
-  return storage_.select(select.getTableName(), cols, where);
+  // A page reads the rows after the previous page's, sorted by its keys
+  std::vector<SortOperator::Key> keys;
+  if (page_) {
+    if (spec.series || spec.slowQueries)
+      return Result<ResultSet>::err(Status::InvalidArgument(
+          "Keyset pagination needs a table: " + spec.table));
+    auto keysRes = pageKeys(select, spec.schema);
+    if (!keysRes.hasValue())
+      return Result<ResultSet>::err(keysRes.status());
+    keys = keysRes.takeValue();
+    if (page_->after.size() > 0) {
+      if (page_->after.size() != keys.size())
+        return Result<ResultSet>::err(
+            Status::InvalidArgument("Page token does not match the query"));
+      Predicate after = pageAfter(keys, page_->after);
+      if (spec.where) {
+        Predicate both;
+        both.kind = Predicate::Kind::And;
+        both.children.push_back(std::move(*spec.where));
+        both.children.push_back(std::move(after));
+        spec.where = std::move(both);
+      } else {
+        spec.where = std::move(after);
+      }
+    }
+  }
+
+  // Scan [-> Residual filters] [-> Sort] [-> Limit] -> Collect: storage
+  // applies the projection and pushed predicate. Columns that only residual
+  // conditions or sort keys read are scanned too and dropped at the end.
+  std::vector<std::string> scanCols = cols;
+  std::vector<std::string> extra;
+  for (const Expression *cond : spec.residual)
+    collectIdentifiers(cond, extra);
+  for (const auto &key : select.getOrderBy())
+    extra.push_back(key.column);
+  for (const auto &key : keys)
+    extra.push_back(key.column);
+  for (const auto &col : extra) {
+    if (!cols.empty() &&
+        std::find(scanCols.begin(), scanCols.end(), col) == scanCols.end())
+      scanCols.push_back(col);
+  }
+  const bool trim = scanCols.size() != cols.size();
+  const bool fromTable = !spec.series && !spec.slowQueries;
+  const bool residual = !spec.residual.empty();
+  std::unique_ptr<PhysicalPlan> plan = makeScan(spec, std::move(scanCols));
+  addResidualFilters(*plan, spec.residual);
+  if (page_) {
+    plan->add<SortOperator>(keys, page_->size);
+    plan->add<LimitOperator>(page_->size, 0);
+  } else {
+    addOrderLimit(*plan, select);
+  }
+  // A top-K sort needs only the first rows of an ordered index walk (and
+  // those tying with the last, when later keys break the ties)
+  const auto &orderBy = select.getOrderBy();
+  const auto &limit = select.getLimit();
+  if (fromTable && !residual && (page_ || (!orderBy.empty() && limit))) {
+    size_t rows = page_ ? page_->size : SIZE_MAX;
+    if (!page_ && *limit <= SIZE_MAX - select.getOffset())
+      rows = *limit + select.getOffset();
+    const size_t nkeys = page_ ? keys.size() : orderBy.size();
+    plan->setScanOrder(
+        ScanOrder{orderBy[0].column, orderBy[0].descending, rows, nkeys > 1});
+  }
+  if (!page_) {
+    if (trim)
+      plan->add<ColumnProjectOperator>(std::move(cols));
+    return runPlan(*plan);
+  }
+
+  auto res = runPlan(*plan);
+  if (!res.hasValue() || explain_ != ExplainMode::None)
+    return res;
+  ResultSet rows = res.takeValue();
+  // A full page may have more after it
+  if (rows.rowCount() == page_->size) {
+    const ResultRow &last = rows.row(rows.rowCount() - 1);
+    Row after(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      const size_t idx = rows.findColumn(keys[i].column);
+      if (idx == ResultSet::npos || !last.values()[idx])
+        return Result<ResultSet>::err(Status::Internal(
+            "Page key missing from result: " + keys[i].column));
+      after.set(i, last.at(idx).clone());
+    }
+    page_->nextToken = encodePageToken(after);
+  }
+  if (!trim)
+    return Result<ResultSet>::ok(std::move(rows));
+  std::vector<size_t> idx;
+  std::vector<ColumnType> types;
+  for (const auto &col : cols) {
+    idx.push_back(rows.findColumn(col));
+    types.push_back(rows.columnTypes()[idx.back()]);
+  }
+  ResultSet out(cols, std::move(types));
+  for (auto &row : rows.takeRows()) {
+    std::vector<std::unique_ptr<Value>> values;
+    for (size_t i : idx)
+      values.push_back(row.takeValue(i));
+    out.addRow(ResultRow(std::move(values)));
+  }
+  return Result<ResultSet>::ok(std::move(out));
 }
 
 // Helper: check if a function name is an aggregate function
 static bool isAggregateFunction(const std::string &name) {
-  return name == "TIME_BUCKET" || name == "FIRST" || name == "LAST";
+  return name == "TIME_BUCKET" || name == "FIRST" || name == "LAST" ||
+         name == "COUNT" || name == "SUM" || name == "MIN" || name == "MAX" ||
+         name == "AVG" || name == "APPROX_COUNT_DISTINCT" ||
+         name == "APPROX_PERCENTILE";
 }
 
 // Helper: uppercase a string for case-insensitive comparison
@@ -689,39 +1621,529 @@ static std::string toUpper(const std::string &s) {
   return result;
 }
 
+// Helper: default output column name of a select item
+static std::string itemName(const SelectItem &item) {
+  if (!item.alias.empty())
+    return item.alias;
+  if (auto id = dynamic_cast<const IdentifierExpression *>(item.expr.get()))
+    return id->getName();
+  if (auto fn = dynamic_cast<const FunctionCallExpression *>(item.expr.get())) {
+    // Use lowercase function name as default column name
+    std::string name = fn->getName();
+    for (auto &c : name)
+      c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return name;
+  }
+  return "expr";
+}
+
+// Helper: collect the time-series window function calls (MOVING_AVG, RATE,
+// DELTA, EWMA) in an expression
+static void
+collectWindowCalls(const Expression *expr,
+                   std::vector<const FunctionCallExpression *> &out) {
+  if (!expr)
+    return;
+  if (auto fn = dynamic_cast<const FunctionCallExpression *>(expr)) {
+    if (parseTimeWindowFunction(toUpper(fn->getName())))
+      out.push_back(fn);
+    for (const auto &arg : fn->getArgs())
+      collectWindowCalls(arg.get(), out);
+  } else if (auto be = dynamic_cast<const BinaryExpression *>(expr)) {
+    collectWindowCalls(be->getLeft(), out);
+    collectWindowCalls(be->getRight(), out);
+  } else if (auto ue = dynamic_cast<const UnaryExpression *>(expr)) {
+    collectWindowCalls(ue->getOperand(), out);
+  } else if (auto bw = dynamic_cast<const BetweenExpression *>(expr)) {
+    collectWindowCalls(bw->getExpr(), out);
+    collectWindowCalls(bw->getLower(), out);
+    collectWindowCalls(bw->getUpper(), out);
+  }
+}
+
+// Helper: the columns of `schema` an expression-mode SELECT reads beyond
+// its pushed predicate, in schema order: those its select items, residual
+// conditions, GROUP BY keys, HAVING and ORDER BY name. A statement naming
+// none (COUNT(*)) reads the first column, as an empty list means all.
+static std::vector<std::string>
+readColumns(const SelectStatement &select,
+            const std::vector<const Expression *> &residual,
+            const TableSchema &schema) {
+  std::vector<std::string> refs;
+  for (const auto &item : select.getSelectItems())
+    collectIdentifiers(item.expr.get(), refs);
+  for (const Expression *cond : residual)
+    collectIdentifiers(cond, refs);
+  for (const auto &key : select.getGroupBy())
+    collectIdentifiers(key.get(), refs);
+  collectIdentifiers(select.getHaving(), refs);
+  for (const auto &key : select.getOrderBy())
+    refs.push_back(key.column);
+  std::vector<std::string> out;
+  for (const auto &c : schema.columns())
+    if (std::find(refs.begin(), refs.end(), c.name) != refs.end())
+      out.push_back(c.name);
+  if (out.empty() && !schema.columns().empty())
+    out.push_back(schema.columns().front().name);
+  return out;
+}
+
 Result<ResultSet>
 QueryExecutor::executeSelectWithExpressions(const SelectStatement &select) {
-  const auto &items = select.getSelectItems();
-  const std::string &table = select.getTableName();
-
-  // First, fetch all rows matching the WHERE clause
-  auto predRes = buildPredicate(select.getWhereClause());
-  if (!predRes.hasValue())
-    return Result<ResultSet>::err(predRes.status());
-  std::optional<Predicate> where = predRes.takeValue();
-  if (where) {
-    where = simplifyPred(*where);
+  auto specRes = planScan(select);
+  if (!specRes.hasValue())
+    return Result<ResultSet>::err(specRes.status());
+  ScanSpec spec = specRes.takeValue();
+
+  if (auto buckets = makeBucketScan(spec, select))
+    return runPlan(*buckets);
+
+  // Scan only the columns read downstream; the pushable predicate is
+  // pushed into the scan, which filters before materializing any column.
+  // Residual conditions and expressions are evaluated batch by batch.
+  std::vector<std::string> columns =
+      readColumns(select, spec.residual, spec.schema);
+  // Window functions also read the timestamps
+  std::vector<const FunctionCallExpression *> windows;
+  for (const auto &item : select.getSelectItems())
+    collectWindowCalls(item.expr.get(), windows);
+  if (spec.series && !windows.empty()) {
+    const std::string &tsCol = spec.series->timestampColumn();
+    if (std::find(columns.begin(), columns.end(), tsCol) == columns.end())
+      columns.insert(columns.begin(), tsCol);
   }
-  if (auto st = validatePredicateColumns(table, where); !st.ok()) {
+  std::unique_ptr<PhysicalPlan> plan = makeScan(spec, std::move(columns));
+  addResidualFilters(*plan, spec.residual);
+  const TimeSeriesSchema *series = spec.series ? &*spec.series : nullptr;
+  if (auto st = addExpressionOperators(*plan, select, series); !st.ok())
     return Result<ResultSet>::err(st);
+  return runPlan(*plan);
+}
+
+// Helper: aggregate Item of an aggregate function call, checking its arity
+static Status classifyAggregate(const FunctionCallExpression &fn,
+                                HashAggregateOperator::Item &ai) {
+  using AK = HashAggregateOperator::Item::Kind;
+  std::string fnName = toUpper(fn.getName());
+  const auto &args = fn.getArgs();
+  if (fnName == "TIME_BUCKET") {
+    ai.kind = AK::TimeBucket;
+  } else if (fnName == "FIRST" || fnName == "LAST") {
+    // FIRST(value_expr, order_by_expr) / LAST(value_expr, order_by_expr)
+    if (args.size() < 1 || args.size() > 2) {
+      return Status::InvalidArgument(fnName + " requires 1 or 2 arguments: "
+                                              "(value_expr [, order_by_expr])");
+    }
+    ai.kind = fnName == "FIRST" ? AK::First : AK::Last;
+    ai.expr = args[0].get();
+    ai.order = args.size() == 2 ? args[1].get() : nullptr;
+  } else if (fnName == "COUNT") {
+    // COUNT() / COUNT(*) count rows; COUNT(expr) counts non-null values
+    if (args.size() > 1) {
+      return Status::InvalidArgument("COUNT takes at most 1 argument");
+    }
+    ai.kind = AK::Count;
+    ai.expr = args.empty() ? nullptr : args[0].get();
+  } else if (fnName == "SUM" || fnName == "MIN" || fnName == "MAX" ||
+             fnName == "AVG") {
+    if (args.size() != 1) {
+      return Status::InvalidArgument(fnName + " requires exactly 1 argument");
+    }
+    ai.kind = fnName == "SUM"   ? AK::Sum
+              : fnName == "MIN" ? AK::Min
+              : fnName == "MAX" ? AK::Max
+                                : AK::Avg;
+    ai.expr = args[0].get();
+  } else if (fnName == "APPROX_COUNT_DISTINCT") {
+    if (args.size() != 1) {
+      return Status::InvalidArgument(fnName + " requires exactly 1 argument");
+    }
+    ai.kind = AK::ApproxCountDistinct;
+    ai.expr = args[0].get();
+  } else if (fnName == "APPROX_PERCENTILE") {
+    // APPROX_PERCENTILE(value_expr, quantile), quantile a literal in [0, 1]
+    const LiteralExpression *q =
+        args.size() == 2
+            ? dynamic_cast<const LiteralExpression *>(args[1].get())
+            : nullptr;
+    double quantile = -1;
+    if (q && std::holds_alternative<double>(q->getValue()))
+      quantile = std::get<double>(q->getValue());
+    else if (q && std::holds_alternative<int64_t>(q->getValue()))
+      quantile = static_cast<double>(std::get<int64_t>(q->getValue()));
+    if (!(quantile >= 0.0 && quantile <= 1.0)) {
+      return Status::InvalidArgument(
+          fnName + " requires 2 arguments: (value_expr, quantile) with a "
+                   "literal quantile between 0 and 1");
+    }
+    ai.kind = AK::ApproxPercentile;
+    ai.expr = args[0].get();
+    ai.quantile = quantile;
+  } else {
+    return Status::InvalidArgument("Unknown aggregate function: " + fnName);
   }
+  return Status::OK();
+}
 
-  // Fetch all columns for expression evaluation
-  auto baseRes = storage_.select(table, /*columns=*/{}, where);
-  if (!baseRes.hasValue())
-    return Result<ResultSet>::err(baseRes.status());
-  const ResultSet &baseRs = baseRes.value();
-  const auto &colNames = baseRs.columnNames();
-  const auto &colTypes = baseRs.columnTypes();
+// Helper: true when `p` only bounds `column` by Integer comparisons, as
+// narrowTimeRange() reads them
+static bool onlyTimeBounds(const Predicate &p, const std::string &column) {
+  if (p.kind == Predicate::Kind::And) {
+    for (const auto &ch : p.children)
+      if (!onlyTimeBounds(ch, column))
+        return false;
+    return true;
+  }
+  return p.kind == Predicate::Kind::Comparison && p.column == column &&
+         p.rhs && p.rhs->type() == ValueType::Integer &&
+         p.op != Predicate::Op::Ne;
+}
 
-  // Build schema lookup
-  TableSchema schema;
-  for (size_t i = 0; i < colNames.size(); ++i) {
-    schema.addColumn(Column{colNames[i], colTypes[i], true});
+// Helper: the cells of bucket `r` of `stats` (per value column) for
+// `aggs`, item i reading column columnOf[i]. SUM, MIN and MAX are Float:
+// HashAggregateOperator's cells when the bucket's values were all Float.
+static ResultRow
+bucketRow(const std::vector<HashAggregateOperator::Item> &aggs,
+          const std::vector<size_t> &columnOf,
+          const std::vector<std::vector<TimeBucketStats>> &stats, size_t r) {
+  using AK = HashAggregateOperator::Item::Kind;
+  std::vector<std::unique_ptr<Value>> cells;
+  for (size_t i = 0; i < aggs.size(); ++i) {
+    const TimeBucketStats &b = stats[columnOf[i]][r];
+    const bool none = b.values == 0;
+    switch (aggs[i].kind) {
+    case AK::TimeBucket:
+      cells.push_back(ValueFactory::createInteger(b.bucketStart));
+      break;
+    case AK::Count:
+      cells.push_back(
+          ValueFactory::createInteger(aggs[i].expr ? b.values : b.rows));
+      break;
+    case AK::Sum:
+      cells.push_back(none ? ValueFactory::createNull()
+                           : ValueFactory::createFloat(b.sum));
+      break;
+    case AK::Avg:
+      cells.push_back(none ? ValueFactory::createNull()
+                           : ValueFactory::createFloat(
+                                 b.sum / static_cast<double>(b.values)));
+      break;
+    case AK::Min:
+    case AK::Max:
+      cells.push_back(none ? ValueFactory::createNull()
+                           : ValueFactory::createFloat(
+                                 aggs[i].kind == AK::Min ? b.min : b.max));
+      break;
+    case AK::ApproxCountDistinct:
+      cells.push_back(
+          ValueFactory::createInteger(std::llround(b.distinct->estimate())));
+      break;
+    case AK::ApproxPercentile:
+      cells.push_back(none ? ValueFactory::createNull()
+                           : ValueFactory::createFloat(
+                                 b.digest->quantile(aggs[i].quantile)));
+      break;
+    default: {
+      const InlineValue &v = aggs[i].kind == AK::First ? b.first : b.last;
+      cells.push_back(v.empty() ? ValueFactory::createNull() : v.toValue());
+      break;
+    }
+    }
+  }
+  return ResultRow(std::move(cells));
+}
+
+std::unique_ptr<PhysicalPlan>
+QueryExecutor::makeBucketScan(const ScanSpec &spec,
+                              const SelectStatement &select) {
+  using AK = HashAggregateOperator::Item::Kind;
+  // Bucket statistics know nothing of residual conditions or HAVING
+  if (!spec.series || !spec.residual.empty() || select.getHaving())
+    return nullptr;
+  const std::string &tsCol = spec.series->timestampColumn();
+
+  // One TIME_BUCKET of the timestamp, and aggregates of value columns
+  auto isColumn = [](const Expression *e, const std::string &name) {
+    auto id = dynamic_cast<const IdentifierExpression *>(e);
+    return id && id->getName() == name;
+  };
+  const FunctionCallExpression *bucket = nullptr;
+  std::vector<HashAggregateOperator::Item> aggs;
+  std::vector<std::string> columns; // read, each once
+  std::vector<size_t> columnOf;     // per item
+  bool sketches = false;
+  for (const auto &item : select.getSelectItems()) {
+    auto fn = dynamic_cast<const FunctionCallExpression *>(item.expr.get());
+    HashAggregateOperator::Item ai;
+    if (!fn || !classifyAggregate(*fn, ai).ok())
+      return nullptr;
+    ai.name = itemName(item);
+    size_t col = 0;
+    if (ai.kind == AK::TimeBucket) {
+      if (bucket || fn->getArgs().size() != 2 ||
+          !isColumn(fn->getArgs()[0].get(), tsCol))
+        return nullptr;
+      bucket = fn;
+    } else if (ai.expr) {
+      auto id = dynamic_cast<const IdentifierExpression *>(ai.expr);
+      if (!id || id->getName() == tsCol ||
+          (ai.order && !isColumn(ai.order, tsCol)))
+        return nullptr;
+      col = std::find(columns.begin(), columns.end(), id->getName()) -
+            columns.begin();
+      if (col == columns.size())
+        columns.push_back(id->getName());
+    }
+    sketches |= ai.kind == AK::ApproxCountDistinct ||
+                ai.kind == AK::ApproxPercentile;
+    columnOf.push_back(col);
+    aggs.push_back(std::move(ai));
+  }
+  if (!bucket || columns.empty())
+    return nullptr;
+  const auto *intervalLit =
+      dynamic_cast<const LiteralExpression *>(bucket->getArgs()[1].get());
+  if (!intervalLit ||
+      !std::holds_alternative<int64_t>(intervalLit->getValue()))
+    return nullptr;
+  const int64_t interval = std::get<int64_t>(intervalLit->getValue());
+  if (interval <= 0)
+    return nullptr;
+  // Grouped by the bucket only
+  for (const auto &g : select.getGroupBy()) {
+    bool isBucket = g->toString() == bucket->toString();
+    if (auto id = dynamic_cast<const IdentifierExpression *>(g.get()))
+      for (const auto &item : select.getSelectItems())
+        if (!item.alias.empty() && item.alias == id->getName())
+          isBucket = item.expr.get() == bucket;
+    if (!isBucket)
+      return nullptr;
+  }
+
+  int64_t start = INT64_MIN, end = INT64_MAX;
+  if (spec.where)
+    narrowTimeRange(*spec.where, tsCol, start, end);
+  end = std::max(start, end);
+
+  // Columns as HashAggregateOperator names and types them
+  std::vector<std::string> names;
+  std::vector<ColumnType> types;
+  for (size_t i = 0; i < aggs.size(); ++i) {
+    names.push_back(aggs[i].name);
+    const AK k = aggs[i].kind;
+    if (k == AK::Min || k == AK::Max || k == AK::First || k == AK::Last)
+      types.push_back(
+          spec.schema.columns()[spec.schema.findColumn(columns[columnOf[i]])]
+              .type);
+    else
+      types.push_back(k == AK::Avg || k == AK::ApproxPercentile
+                          ? ColumnType::Float
+                          : ColumnType::Integer);
+  }
+  auto bound = [](int64_t t, int64_t open, const char *inf) {
+    return t == open ? std::string(inf) : std::to_string(t);
+  };
+  std::string list;
+  for (const auto &col : columns)
+    list += (list.empty() ? "" : ", ") + col;
+  const std::string range = "series " + spec.table + " time range [" +
+                            bound(start, INT64_MIN, "-inf") + ", " +
+                            bound(end, INT64_MAX, "+inf") + ")";
+
+  // Continuous aggregates: whole seconds, and no filter but the time
+  // range. TIME_BUCKET truncates toward zero, rollups floor: they agree
+  // from the epoch on. SUM and AVG of Float cells alone are Float.
+  auto rollupStats = [&]() {
+    std::optional<std::vector<std::vector<TimeBucketStats>>> stats;
+    if (spec.series->granularity() != TimeGranularity::Seconds ||
+        (spec.where && !onlyTimeBounds(*spec.where, tsCol)))
+      return stats;
+    stats.emplace();
+    for (const auto &col : columns) {
+      auto res = timeseries_->continuousAggregate(spec.table, col, interval,
+                                                  start, end);
+      bool exact = res.hasValue() &&
+                   (stats->empty() ||
+                    (*stats)[0].size() == res.value().size());
+      if (exact)
+        for (const auto &b : res.value())
+          exact = exact && b.allFloat && b.bucketStart >= 0 &&
+                  (!sketches || (b.distinct && b.digest));
+      if (!exact) {
+        stats.reset();
+        return stats;
+      }
+      stats->push_back(res.takeValue());
+    }
+    return stats;
+  };
+  if (auto stats = rollupStats()) {
+    ResultSet out(names, types);
+    for (size_t r = 0; r < (*stats)[0].size(); ++r)
+      out.addRow(bucketRow(aggs, columnOf, *stats, r));
+    auto rs = std::make_shared<const ResultSet>(std::move(out));
+    auto plan = std::make_unique<PhysicalPlan>(
+        [rs](const RelationalStorage::BatchSink &sink, size_t batchRows) {
+          return scanResultSet(*rs, sink, batchRows);
+        },
+        "continuous aggregate of " + list + " in " +
+            std::to_string(interval) + "s buckets, " + range);
+    addOrderLimit(*plan, select);
+    return plan;
   }
 
+  // Otherwise the series folds its rows into bucket statistics in one
+  // pass (see TimeSeriesStorage::bucketStats), for Float columns. Buckets
+  // that saw Integer cells make SUM, MIN and MAX keep their types: the
+  // rows are then aggregated as the query would have been.
+  for (const auto &col : columns)
+    if (spec.schema.columns()[spec.schema.findColumn(col)].type !=
+        ColumnType::Float)
+      return nullptr;
+  std::string description =
+      "bucket statistics of " + list + " per TIME_BUCKET(" + tsCol + ", " +
+      std::to_string(interval) + "), " + range;
+  if (spec.where)
+    description += " filtered by " + spec.where->toString();
+  // What the fallback scans: the series and the pushed predicate
+  auto scan = std::make_shared<ScanSpec>();
+  scan->table = spec.table;
+  scan->series = spec.series;
+  if (spec.where)
+    scan->where = copyPredicate(*spec.where);
+  std::vector<std::string> read{tsCol};
+  read.insert(read.end(), columns.begin(), columns.end());
+  const Expression *bucketTs = bucket->getArgs()[0].get();
+  auto plan = std::make_unique<PhysicalPlan>(
+      [this, scan, read, columns, aggs, columnOf, names, types, start, end,
+       interval, sketches, bucketTs](const RelationalStorage::BatchSink &sink,
+                                     size_t batchRows) -> Status {
+        auto stats = timeseries_->bucketStats(scan->table, columns, start,
+                                              end, interval, scan->where,
+                                              sketches);
+        if (!stats.hasValue())
+          return stats.status();
+        const auto &buckets = stats.value();
+        bool exact = true;
+        for (size_t i = 0; i < aggs.size(); ++i)
+          if (aggs[i].kind == AK::Sum || aggs[i].kind == AK::Min ||
+              aggs[i].kind == AK::Max)
+            for (const auto &b : buckets[columnOf[i]])
+              exact = exact && b.allFloat;
+        if (!exact) {
+          ScanSpec rows;
+          rows.table = scan->table;
+          rows.series = scan->series;
+          if (scan->where)
+            rows.where = copyPredicate(*scan->where);
+          auto plan = makeScan(rows, read);
+          plan->setBatchRows(batchRows);
+          plan->add<HashAggregateOperator>(aggs, bucketTs, interval,
+                                           compiledEvaluator());
+          return plan->execute(sink);
+        }
+        ResultSet out(names, types);
+        for (size_t r = 0; r < buckets[0].size(); ++r)
+          out.addRow(bucketRow(aggs, columnOf, buckets, r));
+        return scanResultSet(out, sink, batchRows);
+      },
+      std::move(description));
+  addOrderLimit(*plan, select);
+  return plan;
+}
+
+// Helper: add the aggregates and columns a HAVING condition reads that the
+// select list does not produce as hidden items. An aggregate call's column
+// is named by its text (see ExprProgram), an identifier's by the identifier.
+static Status
+addHavingItems(const Expression *expr,
+               std::vector<HashAggregateOperator::Item> &aggItems) {
+  if (!expr)
+    return Status::OK();
+  auto produced = [&](const std::string &name) {
+    for (const auto &ai : aggItems)
+      if (ai.name == name)
+        return true;
+    return false;
+  };
+  if (auto id = dynamic_cast<const IdentifierExpression *>(expr)) {
+    if (!produced(id->getName())) {
+      HashAggregateOperator::Item ai;
+      ai.expr = id;
+      ai.name = id->getName();
+      aggItems.push_back(std::move(ai));
+    }
+  } else if (auto fn = dynamic_cast<const FunctionCallExpression *>(expr)) {
+    if (!isAggregateFunction(toUpper(fn->getName())))
+      return Status::InvalidArgument("Unknown function in HAVING: " +
+                                     fn->getName());
+    if (!produced(fn->toString())) {
+      HashAggregateOperator::Item ai;
+      if (auto st = classifyAggregate(*fn, ai); !st.ok())
+        return st;
+      ai.name = fn->toString();
+      aggItems.push_back(std::move(ai));
+    }
+  } else if (auto be = dynamic_cast<const BinaryExpression *>(expr)) {
+    if (auto st = addHavingItems(be->getLeft(), aggItems); !st.ok())
+      return st;
+    return addHavingItems(be->getRight(), aggItems);
+  } else if (auto ue = dynamic_cast<const UnaryExpression *>(expr)) {
+    return addHavingItems(ue->getOperand(), aggItems);
+  } else if (auto bw = dynamic_cast<const BetweenExpression *>(expr)) {
+    for (const Expression *e : {bw->getExpr(), bw->getLower(), bw->getUpper()})
+      if (auto st = addHavingItems(e, aggItems); !st.ok())
+        return st;
+  }
+  return Status::OK();
+}
+
+// Helper: TimeWindowOperator items of the window function calls `calls`,
+// each distinct call once, checking their arguments
+static Status
+windowItems(const std::vector<const FunctionCallExpression *> &calls,
+            std::vector<TimeWindowOperator::Item> &out) {
+  for (const FunctionCallExpression *fn : calls) {
+    const std::string name = fn->toString();
+    if (std::any_of(out.begin(), out.end(),
+                    [&](const auto &w) { return w.name == name; }))
+      continue;
+    // FN(value_expr, width), width a literal count of timestamp units
+    const auto &args = fn->getArgs();
+    const LiteralExpression *w =
+        args.size() == 2
+            ? dynamic_cast<const LiteralExpression *>(args[1].get())
+            : nullptr;
+    if (!w || !std::holds_alternative<int64_t>(w->getValue()) ||
+        std::get<int64_t>(w->getValue()) <= 0)
+      return Status::InvalidArgument(
+          toUpper(fn->getName()) +
+          " requires 2 arguments: (value_expr, width) with a positive "
+          "literal integer width");
+    TimeWindowOperator::Item item;
+    item.fn = *parseTimeWindowFunction(toUpper(fn->getName()));
+    item.expr = args[0].get();
+    item.width = std::get<int64_t>(w->getValue());
+    item.name = name;
+    out.push_back(std::move(item));
+  }
+  return Status::OK();
+}
+
+Status QueryExecutor::addExpressionOperators(PhysicalPlan &plan,
+                                             const SelectStatement &select,
+                                             const TimeSeriesSchema *series) {
+  const auto &items = select.getSelectItems();
+
+  // Window functions run over the rows in timestamp order, before the
+  // select items read their columns
+  std::vector<const FunctionCallExpression *> windows;
+  for (const auto &item : items)
+    collectWindowCalls(item.expr.get(), windows);
+  collectWindowCalls(select.getHaving(), windows);
+
   // Check if any select item contains an aggregate function
-  bool hasAggregate = false;
+  bool hasAggregate = !select.getGroupBy().empty() || select.getHaving();
   const FunctionCallExpression *timeBucketFunc = nullptr;
 
   for (const auto &item : items) {
@@ -737,237 +2159,514 @@ QueryExecutor::executeSelectWithExpressions(const SelectStatement &select) {
     }
   }
 
-  if (!hasAggregate) {
-    // No aggregates: evaluate expressions row-by-row
-    std::vector<std::string> outColNames;
-    std::vector<ColumnType> outColTypes;
-    for (const auto &item : items) {
-      if (!item.alias.empty()) {
-        outColNames.push_back(item.alias);
-      } else if (auto id = dynamic_cast<const IdentifierExpression *>(
-                     item.expr.get())) {
-        outColNames.push_back(id->getName());
-      } else if (auto fn = dynamic_cast<const FunctionCallExpression *>(
-                     item.expr.get())) {
-        // Use lowercase function name as default column name
-        std::string name = fn->getName();
-        for (auto &c : name)
-          c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
-        outColNames.push_back(name);
-      } else {
-        outColNames.push_back("expr");
-      }
-      outColTypes.push_back(ColumnType::Integer); // default, will be refined
-    }
+  ExprEvaluator eval = compiledEvaluator();
+
+  if (!windows.empty()) {
+    const std::string fnName = toUpper(windows.front()->getName());
+    if (hasAggregate)
+      return Status::InvalidArgument(fnName +
+                                     " cannot be combined with aggregates");
+    if (!series)
+      return Status::InvalidArgument(fnName + " requires a time series");
+    std::vector<TimeWindowOperator::Item> windowOps;
+    if (auto st = windowItems(windows, windowOps); !st.ok())
+      return st;
+    plan.add<TimeWindowOperator>(std::move(windowOps),
+                                 series->timestampColumn(),
+                                 timeUnitSeconds(series->granularity()),
+                                 compiledEvaluator());
+  }
 
-    ResultSet result(outColNames, outColTypes);
-    for (size_t r = 0; r < baseRs.rowCount(); ++r) {
-      std::vector<std::unique_ptr<Value>> rowVals;
-      // Build a Row for evalExpr
-      Row row(colNames.size());
-      for (size_t c = 0; c < colNames.size(); ++c) {
-        row.set(c, baseRs.at(r, c).clone());
-      }
+  if (!hasAggregate) {
+    // No aggregates: Project
+    std::vector<ProjectOperator::Item> proj;
+    proj.reserve(items.size());
+    for (const auto &item : items)
+      proj.push_back(ProjectOperator::Item{item.expr.get(), itemName(item)});
+    plan.add<ProjectOperator>(std::move(proj), std::move(eval));
+    addOrderLimit(plan, select);
+    return Status::OK();
+  }
 
+  // GROUP BY keys: a select alias stands for its item's expression, and a
+  // TIME_BUCKET key is the bucket
+  std::vector<const Expression *> keys;
+  for (const auto &g : select.getGroupBy()) {
+    const Expression *key = g.get();
+    if (auto id = dynamic_cast<const IdentifierExpression *>(key)) {
       for (const auto &item : items) {
-        auto valRes = evalExpr(item.expr.get(), schema, row);
-        if (!valRes.hasValue()) {
-          return Result<ResultSet>::err(valRes.status());
+        if (!item.alias.empty() && item.alias == id->getName()) {
+          key = item.expr.get();
+          break;
         }
-        rowVals.push_back(valRes.takeValue());
       }
-      result.addRow(ResultRow(std::move(rowVals)));
     }
-    return Result<ResultSet>::ok(std::move(result));
+    if (auto fn = dynamic_cast<const FunctionCallExpression *>(key)) {
+      std::string fnName = toUpper(fn->getName());
+      if (fnName != "TIME_BUCKET")
+        return Status::InvalidArgument(
+            "GROUP BY cannot use function " + fn->getName() +
+            (isAggregateFunction(fnName) ? " (aggregate)" : ""));
+      if (timeBucketFunc && timeBucketFunc->toString() != fn->toString())
+        return Status::InvalidArgument(
+            "GROUP BY TIME_BUCKET must match the selected TIME_BUCKET");
+      timeBucketFunc = fn;
+      continue;
+    }
+    keys.push_back(key);
   }
 
-  // Aggregate mode: group by TIME_BUCKET if present, otherwise single group
-  // Map: bucket_key -> vector of row indices
-  std::map<int64_t, std::vector<size_t>> buckets;
-
+  // Aggregate mode: HashAggregate, grouped by TIME_BUCKET and the GROUP BY
+  // keys if present, otherwise a single group
+  int64_t interval = 0;
   if (timeBucketFunc) {
     // TIME_BUCKET(timestamp_expr, interval_seconds)
     const auto &args = timeBucketFunc->getArgs();
     if (args.size() != 2) {
-      return Result<ResultSet>::err(
-          Status::InvalidArgument("TIME_BUCKET requires exactly 2 arguments: "
-                                  "(timestamp_expr, interval_seconds)"));
+      return Status::InvalidArgument("TIME_BUCKET requires exactly 2 "
+                                     "arguments: (timestamp_expr, "
+                                     "interval_seconds)");
     }
 
     // Get interval from second argument (must be literal)
     const auto *intervalLit =
         dynamic_cast<const LiteralExpression *>(args[1].get());
     if (!intervalLit) {
-      return Result<ResultSet>::err(Status::InvalidArgument(
-          "TIME_BUCKET interval must be a literal integer"));
+      return Status::InvalidArgument(
+          "TIME_BUCKET interval must be a literal integer");
     }
-    int64_t interval = 0;
     const auto &iv = intervalLit->getValue();
     if (std::holds_alternative<int64_t>(iv)) {
       interval = std::get<int64_t>(iv);
     } else if (std::holds_alternative<double>(iv)) {
       interval = static_cast<int64_t>(std::get<double>(iv));
     } else {
-      return Result<ResultSet>::err(
-          Status::InvalidArgument("TIME_BUCKET interval must be numeric"));
+      return Status::InvalidArgument("TIME_BUCKET interval must be numeric");
     }
     if (interval <= 0) {
-      return Result<ResultSet>::err(
-          Status::InvalidArgument("TIME_BUCKET interval must be positive"));
-    }
-
-    // Group rows by bucket
-    for (size_t r = 0; r < baseRs.rowCount(); ++r) {
-      Row row(colNames.size());
-      for (size_t c = 0; c < colNames.size(); ++c) {
-        row.set(c, baseRs.at(r, c).clone());
-      }
-      auto tsRes = evalExpr(args[0].get(), schema, row);
-      if (!tsRes.hasValue()) {
-        return Result<ResultSet>::err(tsRes.status());
-      }
-      int64_t ts = tsRes.value()->asInt();
-      int64_t bucketStart = (ts / interval) * interval;
-      buckets[bucketStart].push_back(r);
-    }
-  } else {
-    // Single group (all rows)
-    for (size_t r = 0; r < baseRs.rowCount(); ++r) {
-      buckets[0].push_back(r);
+      return Status::InvalidArgument("TIME_BUCKET interval must be positive");
     }
   }
 
-  // Build output schema
-  std::vector<std::string> outColNames;
-  std::vector<ColumnType> outColTypes;
+  // Classify items and check aggregate arity once
+  using AggItem = HashAggregateOperator::Item;
+  std::vector<AggItem> aggItems;
+  aggItems.reserve(items.size());
   for (const auto &item : items) {
-    if (!item.alias.empty()) {
-      outColNames.push_back(item.alias);
-    } else if (auto id = dynamic_cast<const IdentifierExpression *>(
-                   item.expr.get())) {
-      outColNames.push_back(id->getName());
-    } else if (auto fn = dynamic_cast<const FunctionCallExpression *>(
-                   item.expr.get())) {
-      std::string name = fn->getName();
-      for (auto &c : name)
-        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
-      outColNames.push_back(name);
-    } else {
-      outColNames.push_back("expr");
+    AggItem ai;
+    ai.name = itemName(item);
+    auto fn = dynamic_cast<const FunctionCallExpression *>(item.expr.get());
+    if (!fn) {
+      // Not aggregated: evaluated on the first row of its group
+      ai.expr = item.expr.get();
+    } else if (auto st = classifyAggregate(*fn, ai); !st.ok()) {
+      return st;
     }
-    outColTypes.push_back(ColumnType::Integer); // default
+    aggItems.push_back(std::move(ai));
   }
 
-  ResultSet result(outColNames, outColTypes);
+  // HAVING filters the groups; what it reads beyond the select list is
+  // aggregated in hidden columns, dropped once the groups are filtered
+  // and sorted
+  std::vector<std::string> visible;
+  for (const auto &ai : aggItems)
+    visible.push_back(ai.name);
+  if (auto st = addHavingItems(select.getHaving(), aggItems); !st.ok())
+    return st;
+  const bool hidden = aggItems.size() > visible.size();
+
+  plan.add<HashAggregateOperator>(
+      std::move(aggItems),
+      timeBucketFunc ? timeBucketFunc->getArgs()[0].get() : nullptr, interval,
+      eval, std::move(keys));
+  if (select.getHaving())
+    plan.add<ExprFilterOperator>(select.getHaving(), std::move(eval));
+  addOrderLimit(plan, select);
+  if (hidden)
+    plan.add<ColumnProjectOperator>(std::move(visible));
+  return Status::OK();
+}
 
-  // Process each bucket
-  for (const auto &[bucketKey, rowIndices] : buckets) {
-    std::vector<std::unique_ptr<Value>> outRow;
+// ---- Joins ----
 
-    for (const auto &item : items) {
-      auto fn = dynamic_cast<const FunctionCallExpression *>(item.expr.get());
-      if (fn) {
-        std::string fnName = toUpper(fn->getName());
+// One table of a join query; `qualifier` (alias or table name) prefixes its
+// columns in joined rows as "qualifier.column"
+struct JoinTable {
+  std::string table;
+  std::string qualifier;
+  TableSchema schema;
+};
+
+// Resolve a column reference of a join query ("q.col", or "col" when only
+// one joined table has it) to its table and column
+static Status resolveJoinColumn(const std::vector<JoinTable> &tables,
+                                const std::string &ref, size_t &tableIdx,
+                                std::string &column) {
+  const size_t dot = ref.find('.');
+  if (dot != std::string::npos) {
+    const std::string q = ref.substr(0, dot);
+    column = ref.substr(dot + 1);
+    for (size_t t = 0; t < tables.size(); ++t) {
+      if (tables[t].qualifier != q)
+        continue;
+      if (tables[t].schema.findColumn(column) == TableSchema::npos)
+        return Status::InvalidArgument("Unknown column: " + ref);
+      tableIdx = t;
+      return Status::OK();
+    }
+    return Status::InvalidArgument("Unknown table or alias: " + q);
+  }
+  tableIdx = TableSchema::npos;
+  for (size_t t = 0; t < tables.size(); ++t) {
+    if (tables[t].schema.findColumn(ref) == TableSchema::npos)
+      continue;
+    if (tableIdx != TableSchema::npos)
+      return Status::InvalidArgument("Ambiguous column reference: " + ref);
+    tableIdx = t;
+  }
+  if (tableIdx == TableSchema::npos)
+    return Status::InvalidArgument("Unknown column: " + ref);
+  column = ref;
+  return Status::OK();
+}
 
-        if (fnName == "TIME_BUCKET") {
-          // Return the bucket start
-          outRow.push_back(ValueFactory::createInteger(bucketKey));
-        } else if (fnName == "FIRST" || fnName == "LAST") {
-          // FIRST(value_expr, order_by_expr) / LAST(value_expr, order_by_expr)
-          const auto &args = fn->getArgs();
-          if (args.size() < 1 || args.size() > 2) {
-            return Result<ResultSet>::err(Status::InvalidArgument(
-                fnName +
-                " requires 1 or 2 arguments: (value_expr [, order_by_expr])"));
-          }
+// Rewrite predicate columns to "qualifier.column", collecting the tables
+// they belong to
+static Status qualifyPredicate(Predicate &p,
+                               const std::vector<JoinTable> &tables,
+                               std::vector<size_t> &used) {
+  if (p.kind == Predicate::Kind::Comparison) {
+    size_t t = 0;
+    std::string column;
+    if (auto st = resolveJoinColumn(tables, p.column, t, column); !st.ok())
+      return st;
+    p.column = tables[t].qualifier + "." + column;
+    if (std::find(used.begin(), used.end(), t) == used.end())
+      used.push_back(t);
+    return Status::OK();
+  }
+  for (auto &ch : p.children)
+    if (auto st = qualifyPredicate(ch, tables, used); !st.ok())
+      return st;
+  return Status::OK();
+}
 
-          // Collect (order_key, value) pairs
-          std::vector<std::pair<int64_t, std::unique_ptr<Value>>> pairs;
-          for (size_t ri : rowIndices) {
-            Row row(colNames.size());
-            for (size_t c = 0; c < colNames.size(); ++c) {
-              row.set(c, baseRs.at(ri, c).clone());
-            }
-
-            // Get order key
-            int64_t orderKey = 0;
-            if (args.size() == 2) {
-              auto okRes = evalExpr(args[1].get(), schema, row);
-              if (!okRes.hasValue())
-                return Result<ResultSet>::err(okRes.status());
-              orderKey = okRes.value()->asInt();
-            } else {
-              // Default: use 'timestamp' column if exists
-              size_t tsIdx = schema.findColumn("timestamp");
-              if (tsIdx != TableSchema::npos) {
-                orderKey = row.values()[tsIdx]->asInt();
-              } else {
-                // Use row index as fallback
-                orderKey = static_cast<int64_t>(ri);
-              }
-            }
-
-            // Get value
-            auto valRes = evalExpr(args[0].get(), schema, row);
-            if (!valRes.hasValue())
-              return Result<ResultSet>::err(valRes.status());
-
-            pairs.emplace_back(orderKey, valRes.takeValue());
-          }
+// Drop the "qualifier." prefix of every column (predicate on one table)
+static void unqualifyPredicate(Predicate &p, size_t prefix) {
+  if (p.kind == Predicate::Kind::Comparison)
+    p.column = p.column.substr(prefix);
+  for (auto &ch : p.children)
+    unqualifyPredicate(ch, prefix);
+}
 
-          if (pairs.empty()) {
-            outRow.push_back(ValueFactory::createNull());
-          } else {
-            // Sort by order key ascending
-            std::sort(
-                pairs.begin(), pairs.end(),
-                [](const auto &a, const auto &b) { return a.first < b.first; });
-
-            if (fnName == "FIRST") {
-              outRow.push_back(pairs.front().second->clone());
-            } else { // LAST
-              outRow.push_back(pairs.back().second->clone());
-            }
-          }
-        } else {
-          return Result<ResultSet>::err(
-              Status::InvalidArgument("Unknown aggregate function: " + fnName));
-        }
-      } else {
-        // Non-aggregate expression in aggregate query: evaluate on first row of
-        // group
-        if (rowIndices.empty()) {
-          outRow.push_back(ValueFactory::createNull());
-        } else {
-          Row row(colNames.size());
-          for (size_t c = 0; c < colNames.size(); ++c) {
-            row.set(c, baseRs.at(rowIndices[0], c).clone());
-          }
-          auto valRes = evalExpr(item.expr.get(), schema, row);
-          if (!valRes.hasValue())
-            return Result<ResultSet>::err(valRes.status());
-          outRow.push_back(valRes.takeValue());
-        }
+// Collect the columns a predicate compares
+static void collectPredicateColumns(const Predicate &p,
+                                    std::vector<std::string> &out) {
+  if (p.kind == Predicate::Kind::Comparison)
+    out.push_back(p.column);
+  for (const auto &ch : p.children)
+    collectPredicateColumns(ch, out);
+}
+
+// Equality key pairs of `ON a.x = b.y [AND ...]`
+static Status collectJoinKeys(
+    const Expression *on,
+    std::vector<std::pair<std::string, std::string>> &pairs) {
+  auto be = dynamic_cast<const BinaryExpression *>(on);
+  if (be && be->getOperator() == BinaryExpression::Operator::AND) {
+    if (auto st = collectJoinKeys(be->getLeft(), pairs); !st.ok())
+      return st;
+    return collectJoinKeys(be->getRight(), pairs);
+  }
+  if (be && be->getOperator() == BinaryExpression::Operator::EQUALS) {
+    auto l = dynamic_cast<const IdentifierExpression *>(be->getLeft());
+    auto r = dynamic_cast<const IdentifierExpression *>(be->getRight());
+    if (l && r) {
+      pairs.emplace_back(l->getName(), r->getName());
+      return Status::OK();
+    }
+  }
+  return Status::InvalidArgument(
+      "JOIN ON supports equalities between columns combined with AND");
+}
+
+/**
+ * Joins run left-deep as a chain of hash joins over one scan. The first join
+ * hashes the side with fewer estimated rows after its pushed-down filter
+ * (see estimateScanRows) and probes with the other; each later join hashes
+ * its own table and probes with the joined rows so far. WHERE conjuncts
+ * that reference a single table whose rows cannot be null-extended (the
+ * FROM table or an INNER-joined one) are pushed into that table's scan; the
+ * rest filter the joined rows.
+ */
+Result<ResultSet>
+QueryExecutor::executeJoinSelect(const SelectStatement &select) {
+  using R = Result<ResultSet>;
+  const auto &joins = select.getJoins();
+  std::vector<JoinTable> tables;
+  auto addTable = [&](const std::string &table,
+                      const std::string &alias) -> Status {
+    auto schema = storage_.getTableSchema(table);
+    if (!schema.hasValue())
+      return schema.status();
+    const std::string &q = alias.empty() ? table : alias;
+    for (const auto &t : tables)
+      if (t.qualifier == q)
+        return Status::InvalidArgument("Duplicate table name in join: " + q);
+    tables.push_back(JoinTable{table, q, schema.takeValue()});
+    return Status::OK();
+  };
+  if (auto st = addTable(select.getTableName(), select.getTableAlias());
+      !st.ok())
+    return R::err(st);
+  for (const auto &join : joins)
+    if (auto st = addTable(join.table, join.alias); !st.ok())
+      return R::err(st);
+
+  // ON keys of join k: (table, column) pairs of its own table (k + 1) and
+  // of the earlier tables they are compared with
+  using Keys = std::vector<std::pair<size_t, std::string>>;
+  std::vector<Keys> innerKeys(joins.size());
+  std::vector<Keys> outerKeys(joins.size());
+  for (size_t k = 0; k < joins.size(); ++k) {
+    const size_t self = k + 1;
+    std::vector<std::pair<std::string, std::string>> pairs;
+    if (auto st = collectJoinKeys(joins[k].on.get(), pairs); !st.ok())
+      return R::err(st);
+    for (const auto &[lhs, rhs] : pairs) {
+      size_t lt = 0, rt = 0;
+      std::string lc, rc;
+      if (auto st = resolveJoinColumn(tables, lhs, lt, lc); !st.ok())
+        return R::err(st);
+      if (auto st = resolveJoinColumn(tables, rhs, rt, rc); !st.ok())
+        return R::err(st);
+      if (rt == self && lt < self) {
+        std::swap(lt, rt);
+        std::swap(lc, rc);
       }
+      if (lt != self || rt >= self)
+        return R::err(Status::InvalidArgument(
+            "JOIN ON must compare a column of " + tables[self].qualifier +
+            " with a column of a table joined before it"));
+      innerKeys[k].emplace_back(lt, lc);
+      outerKeys[k].emplace_back(rt, rc);
     }
+  }
 
-    result.addRow(ResultRow(std::move(outRow)));
+  // WHERE: push single-table conjuncts down, keep the rest as a residual.
+  // Conjuncts that are not column-vs-literal predicates are evaluated on
+  // the joined rows.
+  std::vector<const Expression *> exprResidual;
+  auto predRes = splitWhere(select.getWhereClause(), exprResidual);
+  if (!predRes.hasValue())
+    return R::err(predRes.status());
+  std::optional<Predicate> where = predRes.takeValue();
+  std::vector<Predicate> conjuncts;
+  if (where) {
+    if (where->kind == Predicate::Kind::And)
+      conjuncts = std::move(where->children);
+    else
+      conjuncts.push_back(std::move(*where));
+  }
+  {
+    std::vector<std::string> refs;
+    for (const Expression *cond : exprResidual)
+      collectIdentifiers(cond, refs);
+    for (const auto &ref : refs) {
+      size_t t = 0;
+      std::string column;
+      if (auto st = resolveJoinColumn(tables, ref, t, column); !st.ok())
+        return R::err(st);
+    }
+  }
+  std::vector<std::vector<Predicate>> pushed(tables.size());
+  std::vector<Predicate> rest;
+  for (auto &c : conjuncts) {
+    std::vector<size_t> used;
+    if (auto st = qualifyPredicate(c, tables, used); !st.ok())
+      return R::err(st);
+    const bool preserved =
+        used.size() == 1 &&
+        (used[0] == 0 || joins[used[0] - 1].type == JoinClause::Type::Inner);
+    if (preserved) {
+      unqualifyPredicate(c, tables[used[0]].qualifier.size() + 1);
+      pushed[used[0]].push_back(std::move(c));
+    } else {
+      rest.push_back(std::move(c));
+    }
+  }
+  std::optional<Predicate> residual = conjunction(std::move(rest));
+  std::vector<std::optional<Predicate>> scanWhere(tables.size());
+  for (size_t t = 0; t < tables.size(); ++t) {
+    scanWhere[t] = conjunction(std::move(pushed[t]));
+    orderConjuncts(tables[t].table, scanWhere[t]);
   }
 
-  return Result<ResultSet>::ok(std::move(result));
+  // Columns each scan reads, in schema order: its join keys and what is
+  // evaluated on joined rows (pushed conjuncts are evaluated inside the
+  // scans). SELECT * reads all of them. References that do not resolve
+  // are reported below, before any row is read.
+  std::vector<std::vector<std::string>> reads(tables.size());
+  const auto &sc = select.getColumns();
+  if (select.isExpressionMode() || !(sc.size() == 1 && sc[0] == "*")) {
+    std::vector<std::string> refs;
+    for (size_t k = 0; k < joins.size(); ++k) {
+      for (const auto &key : innerKeys[k])
+        refs.push_back(tables[key.first].qualifier + "." + key.second);
+      for (const auto &key : outerKeys[k])
+        refs.push_back(tables[key.first].qualifier + "." + key.second);
+    }
+    if (residual)
+      collectPredicateColumns(*residual, refs);
+    for (const Expression *cond : exprResidual)
+      collectIdentifiers(cond, refs);
+    if (select.isExpressionMode()) {
+      for (const auto &item : select.getSelectItems())
+        collectIdentifiers(item.expr.get(), refs);
+      for (const auto &key : select.getGroupBy())
+        collectIdentifiers(key.get(), refs);
+      collectIdentifiers(select.getHaving(), refs);
+    } else {
+      refs.insert(refs.end(), sc.begin(), sc.end());
+    }
+    for (const auto &key : select.getOrderBy())
+      refs.push_back(key.column);
+    std::vector<std::vector<std::string>> used(tables.size());
+    for (const auto &ref : refs) {
+      size_t t = 0;
+      std::string column;
+      if (resolveJoinColumn(tables, ref, t, column).ok())
+        used[t].push_back(std::move(column));
+    }
+    for (size_t t = 0; t < tables.size(); ++t) {
+      for (const auto &c : tables[t].schema.columns())
+        if (std::find(used[t].begin(), used[t].end(), c.name) !=
+            used[t].end())
+          reads[t].push_back(c.name);
+      if (reads[t].empty() && !tables[t].schema.columns().empty())
+        reads[t].push_back(tables[t].schema.columns().front().name);
+    }
+  }
+
+  // Build side of the first join: the side expected to return fewer rows
+  // after its pushed-down filter, when both estimates are known
+  auto leftRows = estimateScanRows(tables[0].table, scanWhere[0]);
+  auto rightRows = estimateScanRows(tables[1].table, scanWhere[1]);
+  const bool buildLeft = leftRows && rightRows && *leftRows < *rightRows;
+  const size_t probe = buildLeft ? 1 : 0;
+
+  PhysicalPlan plan(storage_, tables[probe].table, std::move(reads[probe]),
+                    std::move(scanWhere[probe]));
+  for (size_t k = 0; k < joins.size(); ++k) {
+    const size_t self = k + 1;
+    const size_t build = k == 0 && buildLeft ? 0 : self;
+    HashJoinOperator::Spec spec;
+    spec.type = joins[k].type == JoinClause::Type::Left
+                    ? HashJoinOperator::Type::Left
+                    : HashJoinOperator::Type::Inner;
+    spec.buildIsLeft = build != self;
+    spec.buildTable = tables[build].table;
+    spec.buildWhere = std::move(scanWhere[build]);
+    spec.buildColumns = std::move(reads[build]);
+    spec.buildPrefix = tables[build].qualifier + ".";
+    // The first join reads raw table columns on both sides; later joins
+    // probe with already qualified joined rows
+    if (k == 0)
+      spec.probePrefix = tables[probe].qualifier + ".";
+    const auto &buildKeys = spec.buildIsLeft ? outerKeys[k] : innerKeys[k];
+    const auto &probeKeys = spec.buildIsLeft ? innerKeys[k] : outerKeys[k];
+    for (const auto &key : buildKeys)
+      spec.buildKeys.push_back(key.second);
+    for (const auto &key : probeKeys)
+      spec.probeKeys.push_back(k == 0 ? key.second
+                                      : tables[key.first].qualifier + "." +
+                                            key.second);
+    plan.add<HashJoinOperator>(storage_, std::move(spec));
+  }
+  if (residual)
+    plan.add<FilterOperator>(*residual);
+  addResidualFilters(plan, exprResidual);
+
+  if (select.isExpressionMode()) {
+    // Report unknown or ambiguous references before any row is read
+    std::vector<std::string> refs;
+    for (const auto &item : select.getSelectItems())
+      collectIdentifiers(item.expr.get(), refs);
+    for (const auto &key : select.getGroupBy())
+      collectIdentifiers(key.get(), refs);
+    collectIdentifiers(select.getHaving(), refs);
+    for (const auto &ref : refs) {
+      // GROUP BY and HAVING may name select aliases
+      bool alias = false;
+      for (const auto &item : select.getSelectItems())
+        alias = alias || item.alias == ref;
+      if (alias)
+        continue;
+      size_t t = 0;
+      std::string column;
+      if (auto st = resolveJoinColumn(tables, ref, t, column); !st.ok())
+        return R::err(st);
+    }
+    if (auto st = addExpressionOperators(plan, select); !st.ok())
+      return R::err(st);
+    return runPlan(plan);
+  }
+
+  // Column-name mode: sort on joined columns, then project. SELECT * names
+  // a column by itself unless another joined table has the same name.
+  auto qualify = [&](const std::string &ref, std::string &out) -> Status {
+    size_t t = 0;
+    std::string column;
+    if (auto st = resolveJoinColumn(tables, ref, t, column); !st.ok())
+      return st;
+    out = tables[t].qualifier + "." + column;
+    return Status::OK();
+  };
+  std::vector<std::string> sortCols;
+  for (const auto &key : select.getOrderBy()) {
+    std::string col;
+    if (auto st = qualify(key.column, col); !st.ok())
+      return R::err(st);
+    sortCols.push_back(std::move(col));
+  }
+  std::vector<std::string> projCols, outNames;
+  if (sc.size() == 1 && sc[0] == "*") {
+    for (const auto &t : tables) {
+      for (const auto &c : t.schema.columns()) {
+        bool shared = false;
+        for (const auto &other : tables)
+          shared = shared || (&other != &t && other.schema.findColumn(
+                                                  c.name) != TableSchema::npos);
+        projCols.push_back(t.qualifier + "." + c.name);
+        outNames.push_back(shared ? projCols.back() : c.name);
+      }
+    }
+  } else {
+    for (const auto &ref : sc) {
+      std::string col;
+      if (auto st = qualify(ref, col); !st.ok())
+        return R::err(st);
+      projCols.push_back(std::move(col));
+      outNames.push_back(ref);
+    }
+  }
+  addOrderLimit(plan, select, &sortCols);
+  plan.add<ColumnProjectOperator>(std::move(projCols), std::move(outNames));
+  return runPlan(plan);
 }
 
 Result<ResultSet> QueryExecutor::executeInsert(const InsertStatement &insert) {
   const std::string &table = insert.getTableName();
 
-  // Discover schema via a select * to obtain column names/types
-  auto probe = storage_.select(table, /*columns=*/{}, /*where=*/std::nullopt);
+  // Discover column names/types from the schema (no rows are read)
+  auto probe = storage_.getTableSchema(table);
   if (!probe.hasValue()) {
     // If NotFound, still propagate; executor doesn't create tables.
     return Result<ResultSet>::err(probe.status());
   }
-  const ResultSet &schemaView = probe.value();
-  const auto &allCols = schemaView.columnNames();
+  std::vector<std::string> allCols;
+  for (const auto &c : probe.value().columns())
+    allCols.push_back(c.name);
 
   if (allCols.empty()) {
     // If table exists but has zero columns, nothing to insert; treat as error
@@ -1000,8 +2699,24 @@ Result<ResultSet> QueryExecutor::executeInsert(const InsertStatement &insert) {
     }
   }
 
-  // For each VALUES row, build a full Row of table width
-  size_t inserted = 0;
+  const auto *onConflict = insert.getOnConflict();
+  if (onConflict && onConflict->column != probe.value().primaryKey())
+    return Result<ResultSet>::err(Status::InvalidArgument(
+        "ON CONFLICT column must be the primary key of " + table));
+  if (explainWrite(onConflict ? "Upsert" : "Insert",
+                   table + "; " + std::to_string(insert.getValues().size()) +
+                       " rows" +
+                       (onConflict ? ", conflicts on " + onConflict->column +
+                                         (onConflict->doNothing
+                                              ? " skipped"
+                                              : " updated")
+                                   : "")))
+    return Result<ResultSet>::ok(ResultSet());
+
+  // Build a full Row of table width for each VALUES row, then insert them
+  // as one batch (all or nothing in the in-memory engine)
+  std::vector<Row> rows;
+  rows.reserve(insert.getValues().size());
   for (const auto &exprRow : insert.getValues()) {
     if (exprRow.size() != targetIdx.size()) {
       return Result<ResultSet>::err(Status::InvalidArgument(
@@ -1027,13 +2742,14 @@ Result<ResultSet> QueryExecutor::executeInsert(const InsertStatement &insert) {
       row.set(idx, literalToValue(lit->getValue()));
     }
 
-    // Delegate to storage validation and insert
-    auto st = storage_.insertRow(table, row);
-    if (!st.ok()) {
-      return Result<ResultSet>::err(st);
-    }
-    ++inserted;
+    rows.push_back(std::move(row));
   }
+  if (onConflict)
+    return executeUpsert(table, *onConflict, rows);
+  // Delegate to storage validation and insert
+  if (auto st = storage_.insertRows(table, rows); !st.ok())
+    return Result<ResultSet>::err(st);
+  const size_t inserted = rows.size();
 
   // Return DML feedback: canonical 'affected' and legacy 'inserted'
   ResultSet rs({"affected", "inserted"},
@@ -1047,6 +2763,92 @@ Result<ResultSet> QueryExecutor::executeInsert(const InsertStatement &insert) {
   return Result<ResultSet>::ok(std::move(rs));
 }
 
+Result<ResultSet>
+QueryExecutor::executeUpsert(const std::string &table,
+                             const InsertStatement::OnConflict &onConflict,
+                             const std::vector<Row> &rows) {
+  // DO UPDATE assignments see the stored row's columns by name and the
+  // proposed row's as excluded.<name>, compiled once against a schema of
+  // both
+  const auto &assignments = onConflict.assignments;
+  const TableSchema *bound = nullptr;
+  std::vector<ExprProgram> programs;
+  std::vector<size_t> targets;
+  auto merge = [&](Row &current, const Row &proposed,
+                   const TableSchema &schema) -> Status {
+    if (onConflict.doNothing)
+      return Status::OK();
+    if (bound != &schema) {
+      std::vector<Column> cols = schema.columns();
+      for (const auto &c : schema.columns()) {
+        Column ex = c;
+        ex.name = "excluded." + c.name;
+        cols.push_back(std::move(ex));
+      }
+      const TableSchema both(std::move(cols));
+      programs.clear();
+      targets.clear();
+      for (const auto &asgn : assignments) {
+        programs.push_back(ExprProgram::compile(asgn.second.get(), both));
+        targets.push_back(schema.findColumn(asgn.first));
+        if (targets.back() == TableSchema::npos)
+          return Status::InvalidArgument("Unknown assignment column: " +
+                                         asgn.first);
+      }
+      bound = &schema;
+    }
+    std::vector<std::unique_ptr<Value>> cells;
+    cells.reserve(current.size() + proposed.size());
+    for (const auto &v : current.values())
+      cells.push_back(v ? v->clone() : nullptr);
+    for (const auto &v : proposed.values())
+      cells.push_back(v ? v->clone() : nullptr);
+    // Every assignment reads the stored row as it was
+    std::vector<std::unique_ptr<Value>> results;
+    for (auto &program : programs) {
+      auto vres = program.run(cells);
+      if (!vres.hasValue())
+        return vres.status();
+      results.push_back(vres.takeValue());
+    }
+    for (size_t a = 0; a < results.size(); ++a)
+      current.set(targets[a], std::move(results[a]));
+    return Status::OK();
+  };
+  auto res = storage_.upsertRows(table, rows, merge);
+  if (!res.hasValue())
+    return Result<ResultSet>::err(res.status());
+  const UpsertCounts counts = res.value();
+
+  // DML feedback: 'affected' counts rows inserted or updated
+  ResultSet rs({"affected", "inserted", "updated"},
+               {ColumnType::Integer, ColumnType::Integer, ColumnType::Integer});
+  std::vector<std::unique_ptr<Value>> cells;
+  cells.emplace_back(ValueFactory::createInteger(
+      static_cast<int64_t>(counts.inserted + counts.updated)));
+  cells.emplace_back(
+      ValueFactory::createInteger(static_cast<int64_t>(counts.inserted)));
+  cells.emplace_back(
+      ValueFactory::createInteger(static_cast<int64_t>(counts.updated)));
+  rs.addRow(ResultRow(std::move(cells)));
+  return Result<ResultSet>::ok(std::move(rs));
+}
+
+// Helper: EXPLAIN detail of the rows an UPDATE or DELETE visits; NotFound
+// for an unknown table
+static Result<std::string> writeDetail(RelationalStorage &storage,
+                                       const std::string &table,
+                                       const std::optional<Predicate> &where) {
+  auto schema = storage.getTableSchema(table);
+  if (!schema.hasValue())
+    return Result<std::string>::err(schema.status());
+  std::string out = table;
+  if (where)
+    out += " filtered by " + where->toString();
+  return Result<std::string>::ok(out + ", " +
+                                 storage.explainAccess(table, where));
+}
+
 Result<ResultSet> QueryExecutor::executeUpdate(const UpdateStatement &update) {
   const std::string &table = update.getTableName();
 
@@ -1075,6 +2877,20 @@ Result<ResultSet> QueryExecutor::executeUpdate(const UpdateStatement &update) {
   if (auto st = validatePredicateColumns(table, where); !st.ok()) {
     return Result<ResultSet>::err(st);
   }
+  orderConjuncts(table, where);
+  if (explain_ != ExplainMode::None) {
+    std::string sets;
+    for (const auto &asgn : update.getAssignments())
+      sets += (sets.empty() ? "" : ", ") + asgn.first + " = " +
+              asgn.second->toString();
+    auto detail = writeDetail(storage_, table, where);
+    if (!detail.hasValue())
+      return Result<ResultSet>::err(detail.status());
+    if (explainWrite("Update", detail.value() + "; set " + sets +
+                                   (allSimple ? " (constants and column copies)"
+                                              : " (compiled expressions)")))
+      return Result<ResultSet>::ok(ResultSet());
+  }
   size_t affected = 0;
   if (allSimple) {
     // Fast path: use storage.updateRows with AssignmentValue map
@@ -1098,19 +2914,30 @@ Result<ResultSet> QueryExecutor::executeUpdate(const UpdateStatement &update) {
       return Result<ResultSet>::err(upd.status());
     affected = upd.value();
   } else {
-    // Computed expressions: evaluate per row via updateRowsWith
-    auto updater = [this, &update](Row &row,
-                                   const TableSchema &schema) -> Status {
-      for (const auto &asgn : update.getAssignments()) {
-        const std::string &col = asgn.first;
-        const Expression *expr = asgn.second.get();
-        auto vres = evalExpr(expr, schema, row);
+    // Computed expressions: evaluate per row via updateRowsWith, with each
+    // assignment compiled once against the table schema
+    const auto &assignments = update.getAssignments();
+    const TableSchema *bound = nullptr;
+    std::vector<ExprProgram> programs;
+    std::vector<size_t> targets;
+    auto updater = [&](Row &row, const TableSchema &schema) -> Status {
+      if (bound != &schema) {
+        programs.clear();
+        targets.clear();
+        for (const auto &asgn : assignments) {
+          programs.push_back(ExprProgram::compile(asgn.second.get(), schema));
+          targets.push_back(schema.findColumn(asgn.first));
+        }
+        bound = &schema;
+      }
+      for (size_t a = 0; a < assignments.size(); ++a) {
+        auto vres = programs[a].run(row.values());
         if (!vres.hasValue())
           return vres.status();
-        size_t idx = schema.findColumn(col);
-        if (idx == TableSchema::npos)
-          return Status::InvalidArgument("Unknown assignment column: " + col);
-        row.set(idx, vres.takeValue());
+        if (targets[a] == TableSchema::npos)
+          return Status::InvalidArgument("Unknown assignment column: " +
+                                         assignments[a].first);
+        row.set(targets[a], vres.takeValue());
       }
       return Status::OK();
     };
@@ -1148,6 +2975,14 @@ Result<ResultSet> QueryExecutor::executeDelete(const DeleteStatement &del) {
   if (auto st = validatePredicateColumns(table, where); !st.ok()) {
     return Result<ResultSet>::err(st);
   }
+  orderConjuncts(table, where);
+  if (explain_ != ExplainMode::None) {
+    auto detail = writeDetail(storage_, table, where);
+    if (!detail.hasValue())
+      return Result<ResultSet>::err(detail.status());
+    if (explainWrite("Delete", detail.takeValue()))
+      return Result<ResultSet>::ok(ResultSet());
+  }
 
   auto res = storage_.deleteRows(table, where);
   if (!res.hasValue()) {
@@ -1166,182 +3001,133 @@ Result<ResultSet> QueryExecutor::executeDelete(const DeleteStatement &del) {
   return Result<ResultSet>::ok(std::move(rs));
 }
 
-Result<std::unique_ptr<Value>>
-QueryExecutor::evalExpr(const Expression *expr, const TableSchema &schema,
-                        const Row &row) const {
-  // Unary logical NOT
-  if (auto ue = dynamic_cast<const UnaryExpression *>(expr)) {
-    if (ue->getOperator() == UnaryExpression::Operator::NOT) {
-      auto vres = evalExpr(ue->getOperand(), schema, row);
-      if (!vres.hasValue())
-        return vres;
-      std::unique_ptr<Value> v = vres.takeValue();
-      bool b;
-      try {
-        b = v->asBool();
-      } catch (...) {
-        return Result<std::unique_ptr<Value>>::err(
-            Status::InvalidArgument("NOT operand is not boolean-convertible"));
-      }
-      return Result<std::unique_ptr<Value>>::ok(
-          ValueFactory::createBoolean(!b));
+bool QueryExecutor::explainWrite(std::string name, std::string detail) {
+  if (explain_ == ExplainMode::None)
+    return false;
+  PlanStage stage;
+  stage.name = std::move(name);
+  stage.detail = std::move(detail);
+  stages_.push_back(std::move(stage));
+  return explain_ == ExplainMode::Plan;
+}
+
+Result<ResultSet> QueryExecutor::runPlan(PhysicalPlan &plan) {
+  plan.setSpillOptions(spill_);
+  // Planning ends here
+  if (planSpan_ && *planSpan_) {
+    if ((*planSpan_)->recording())
+      (*planSpan_)->setAttribute("kadedb.plan", planSummary(plan.describe()));
+    planSpan_->reset();
+  }
+  // The plan of a statement that turns out slow is kept for its log entry
+  auto keepPlanIfSlow = [&] {
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - statementStart_)
+                        .count();
+    if (slowLogging_ && slowLog_->isSlow(static_cast<uint64_t>(us))) {
+      if (!statementPlan_.empty())
+        statementPlan_ += "; ";
+      statementPlan_ += planSummary(plan.describe());
     }
+  };
+  if (explain_ == ExplainMode::None && sink_) {
+    streamed_ = true;
+    auto st = plan.execute(*sink_);
+    keepPlanIfSlow();
+    if (!st.ok())
+      return Result<ResultSet>::err(st);
+    return Result<ResultSet>::ok(ResultSet());
+  }
+  if (explain_ == ExplainMode::None) {
+    auto res = plan.execute();
+    keepPlanIfSlow();
+    return res;
   }
+  std::vector<PlanStage> stages;
+  Result<ResultSet> res = Result<ResultSet>::ok(ResultSet());
+  if (explain_ == ExplainMode::Plan)
+    stages = plan.describe();
+  else
+    res = plan.execute(&stages);
+  for (auto &stage : stages)
+    stages_.push_back(std::move(stage));
+  return res;
+}
 
-  if (auto lit = dynamic_cast<const LiteralExpression *>(expr)) {
-    return Result<std::unique_ptr<Value>>::ok(literalToValue(lit->getValue()));
+Result<ResultSet>
+QueryExecutor::executeExplain(const ExplainStatement &explain) {
+  using Clock = std::chrono::steady_clock;
+  const bool analyze = explain.isAnalyze();
+  const Statement &inner = explain.getStatement();
+  stages_.clear();
+  explain_ = analyze ? ExplainMode::Analyze : ExplainMode::Plan;
+  const auto start = Clock::now();
+  auto res = execute(inner);
+  const double totalMs =
+      std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  explain_ = ExplainMode::None;
+  std::vector<PlanStage> stages = std::move(stages_);
+  stages_.clear();
+  if (!res.hasValue())
+    return Result<ResultSet>::err(res.status());
+
+  // Writes report the affected rows; they run as one stage
+  const ResultSet &out = res.value();
+  size_t produced = out.rowCount();
+  if (inner.type() != StatementType::SELECT) {
+    produced = out.rowCount() > 0 ? static_cast<size_t>(out.at(0, 0).asInt())
+                                  : 0;
+    if (stages.size() == 1) {
+      stages[0].rowsOut = produced;
+      stages[0].ms = totalMs;
+    }
   }
-  if (auto id = dynamic_cast<const IdentifierExpression *>(expr)) {
-    size_t idx = schema.findColumn(id->getName());
-    if (idx == TableSchema::npos)
-      return Result<std::unique_ptr<Value>>::err(Status::InvalidArgument(
-          "Unknown identifier in expression: " + id->getName()));
-    const auto &v = row.values()[idx];
-    return Result<std::unique_ptr<Value>>::ok(v ? v->clone()
-                                                : ValueFactory::createNull());
+
+  std::vector<std::string> names = {"step", "operator", "detail"};
+  std::vector<ColumnType> types = {ColumnType::Integer, ColumnType::String,
+                                   ColumnType::String};
+  if (analyze) {
+    for (const char *name : {"rows_in", "rows_out", "batches", "bytes_out"}) {
+      names.push_back(name);
+      types.push_back(ColumnType::Integer);
+    }
+    names.push_back("time_ms");
+    types.push_back(ColumnType::Float);
   }
-  if (auto be = dynamic_cast<const BinaryExpression *>(expr)) {
-    using BO = BinaryExpression::Operator;
-    auto lres = evalExpr(be->getLeft(), schema, row);
-    if (!lres.hasValue())
-      return lres;
-    auto rres = evalExpr(be->getRight(), schema, row);
-    if (!rres.hasValue())
-      return rres;
-    std::unique_ptr<Value> L = lres.takeValue();
-    std::unique_ptr<Value> R = rres.takeValue();
-
-    // Logical AND/OR
-    if (be->getOperator() == BO::AND || be->getOperator() == BO::OR) {
-      bool lb, rb;
-      try {
-        lb = L->asBool();
-        rb = R->asBool();
-      } catch (...) {
-        return Result<std::unique_ptr<Value>>::err(Status::InvalidArgument(
-            "AND/OR operands are not boolean-convertible"));
-      }
-      bool out = (be->getOperator() == BO::AND) ? (lb && rb) : (lb || rb);
-      return Result<std::unique_ptr<Value>>::ok(
-          ValueFactory::createBoolean(out));
-    }
-
-    // Comparisons: delegate to Value::compare
-    if (be->getOperator() == BO::EQUALS ||
-        be->getOperator() == BO::NOT_EQUALS ||
-        be->getOperator() == BO::LESS_THAN ||
-        be->getOperator() == BO::LESS_EQUAL ||
-        be->getOperator() == BO::GREATER_THAN ||
-        be->getOperator() == BO::GREATER_EQUAL) {
-      int cmp = L->compare(*R);
-      bool out = false;
-      switch (be->getOperator()) {
-      case BO::EQUALS:
-        out = (cmp == 0);
-        break;
-      case BO::NOT_EQUALS:
-        out = (cmp != 0);
-        break;
-      case BO::LESS_THAN:
-        out = (cmp < 0);
-        break;
-      case BO::LESS_EQUAL:
-        out = (cmp <= 0);
-        break;
-      case BO::GREATER_THAN:
-        out = (cmp > 0);
-        break;
-      case BO::GREATER_EQUAL:
-        out = (cmp >= 0);
-        break;
-      default:
-        break;
-      }
-      return Result<std::unique_ptr<Value>>::ok(
-          ValueFactory::createBoolean(out));
+  ResultSet rs(names, types);
+  auto count = [](size_t n) {
+    return ValueFactory::createInteger(static_cast<int64_t>(n));
+  };
+  for (size_t k = 0; k < stages.size(); ++k) {
+    const PlanStage &stage = stages[k];
+    std::vector<std::unique_ptr<Value>> cells;
+    cells.push_back(count(k + 1));
+    cells.push_back(ValueFactory::createString(stage.name));
+    cells.push_back(ValueFactory::createString(stage.detail));
+    if (analyze) {
+      // The first stage (the scan or a write) has no input stage
+      cells.push_back(k == 0 ? ValueFactory::createNull()
+                             : count(stage.rowsIn));
+      cells.push_back(count(stage.rowsOut));
+      cells.push_back(count(stage.batchesOut));
+      cells.push_back(count(stage.bytesOut));
+      cells.push_back(ValueFactory::createFloat(stage.ms));
     }
-
-    // Arithmetic and string concatenation
-    // If either side is string, treat + as concatenation; others invalid
-    auto isString = [](const Value &v) {
-      return v.type() == ValueType::String;
-    };
-    auto stringify = [](const Value &v) -> std::string {
-      if (v.type() == ValueType::String)
-        return v.asString();
-      return v.toString();
-    };
-    if (be->getOperator() == BO::ADD && (isString(*L) || isString(*R))) {
-      std::string s = stringify(*L) + stringify(*R);
-      return Result<std::unique_ptr<Value>>::ok(
-          ValueFactory::createString(std::move(s)));
-    }
-
-    // Numeric-only arithmetic
-    auto toDouble = [](const Value &v, bool &isInt, int64_t &iout, double &dout,
-                       ValueType &t) -> bool {
-      t = v.type();
-      if (t == ValueType::Integer) {
-        isInt = true;
-        iout = v.asInt();
-        dout = static_cast<double>(iout);
-        return true;
-      }
-      if (t == ValueType::Float) {
-        isInt = false;
-        dout = v.asFloat();
-        return true;
-      }
-      return false;
-    };
-    bool lIsInt = false;
-    int64_t li = 0;
-    double ld = 0.0;
-    ValueType lt;
-    if (!toDouble(*L, lIsInt, li, ld, lt))
-      return Result<std::unique_ptr<Value>>::err(
-          Status::InvalidArgument("Non-numeric LHS in arithmetic expression"));
-    bool rIsInt = false;
-    int64_t ri = 0;
-    double rd = 0.0;
-    ValueType rt;
-    if (!toDouble(*R, rIsInt, ri, rd, rt))
-      return Result<std::unique_ptr<Value>>::err(
-          Status::InvalidArgument("Non-numeric RHS in arithmetic expression"));
-
-    bool resultInt = lIsInt && rIsInt && be->getOperator() != BO::DIV;
-    switch (be->getOperator()) {
-    case BO::ADD:
-      if (resultInt)
-        return Result<std::unique_ptr<Value>>::ok(
-            ValueFactory::createInteger(li + ri));
-      return Result<std::unique_ptr<Value>>::ok(
-          ValueFactory::createFloat(ld + rd));
-    case BO::SUB:
-      if (resultInt)
-        return Result<std::unique_ptr<Value>>::ok(
-            ValueFactory::createInteger(li - ri));
-      return Result<std::unique_ptr<Value>>::ok(
-          ValueFactory::createFloat(ld - rd));
-    case BO::MUL:
-      if (resultInt)
-        return Result<std::unique_ptr<Value>>::ok(
-            ValueFactory::createInteger(li * ri));
-      return Result<std::unique_ptr<Value>>::ok(
-          ValueFactory::createFloat(ld * rd));
-    case BO::DIV:
-      if (rd == 0.0)
-        return Result<std::unique_ptr<Value>>::err(
-            Status::InvalidArgument("Division by zero"));
-      return Result<std::unique_ptr<Value>>::ok(
-          ValueFactory::createFloat(ld / rd));
-    default:
-      return Result<std::unique_ptr<Value>>::err(Status::InvalidArgument(
-          "Unsupported operator in computed expression"));
-    }
-  }
-  return Result<std::unique_ptr<Value>>::err(
-      Status::InvalidArgument("Unsupported expression in assignment"));
+    rs.addRow(ResultRow(std::move(cells)));
+  }
+  if (analyze) {
+    std::vector<std::unique_ptr<Value>> cells;
+    cells.push_back(ValueFactory::createNull());
+    cells.push_back(ValueFactory::createString("Total"));
+    cells.push_back(ValueFactory::createString(""));
+    cells.push_back(ValueFactory::createNull());
+    cells.push_back(count(produced));
+    cells.push_back(ValueFactory::createNull());
+    cells.push_back(ValueFactory::createNull());
+    cells.push_back(ValueFactory::createFloat(totalMs));
+    rs.addRow(ResultRow(std::move(cells)));
+  }
+  return Result<ResultSet>::ok(std::move(rs));
 }
 
 } // namespace kadeql
@@ -0,0 +1,106 @@
+#include "kadedb/replication.h"
+
+#include <utility>
+#include <vector>
+
+namespace kadedb {
+
+// ---- WalShipper ------------------------------------------------------------
+
+Result<std::unique_ptr<WalShipper>>
+WalShipper::open(const std::string &path, uint64_t afterLsn,
+                 ShipOptions options) {
+  using R = Result<std::unique_ptr<WalShipper>>;
+  auto reader = WalReader::open(path, afterLsn);
+  if (!reader.hasValue())
+    return R::err(reader.status());
+  return R::ok(std::unique_ptr<WalShipper>(
+      new WalShipper(reader.takeValue(), options)));
+}
+
+Result<WalSegment> WalShipper::next() {
+  using R = Result<WalSegment>;
+  const uint64_t upTo =
+      options_.log ? options_.log->durableLsn() : UINT64_MAX;
+  auto records = reader_->read(options_.maxSegmentBytes, upTo);
+  if (!records.hasValue())
+    return R::err(records.status());
+  const std::vector<WalRecord> &recs = records.value();
+  WalSegment seg;
+  seg.lastLsn = reader_->lsn();
+  seg.firstLsn = seg.lastLsn + 1 - recs.size();
+  seg.tail = reader_->atEnd();
+  seg.data = walFileHeader(options_.compression);
+  for (const WalRecord &rec : recs)
+    appendWalFrame(seg.data, rec, options_.compression);
+  return R::ok(std::move(seg));
+}
+
+// ---- Replica ---------------------------------------------------------------
+
+Status Replica::apply(const WalSegment &segment) {
+  std::lock_guard<std::mutex> applying(applyMtx_);
+  std::unique_lock<std::mutex> lk(mtx_);
+  if (!broken_.ok())
+    return broken_;
+  if (segment.firstLsn != appliedLsn_ + 1 ||
+      segment.lastLsn + 1 < segment.firstLsn)
+    return Status::InvalidArgument(
+        "Segment of records " + std::to_string(segment.firstLsn) + ".." +
+        std::to_string(segment.lastLsn) + " does not follow record " +
+        std::to_string(appliedLsn_));
+  auto records = decodeWalFrames(segment.data);
+  if (!records.hasValue())
+    return records.status();
+  if (records.value().size() != segment.records())
+    return Status::InvalidArgument(
+        "Segment holds " + std::to_string(records.value().size()) +
+        " records, not " + std::to_string(segment.records()));
+  // Staleness checks need not wait for the records
+  lk.unlock();
+  auto applied = applyWalRecords(records.value(), targets_, threads_,
+                                 segment.firstLsn - 1);
+  lk.lock();
+  if (!applied.hasValue()) {
+    broken_ = Status::FailedPrecondition("Replica must be rebuilt: " +
+                                         applied.status().message());
+    return applied.status();
+  }
+  appliedLsn_ = segment.lastLsn;
+  if (segment.tail)
+    freshAt_ = std::chrono::steady_clock::now();
+  return Status::OK();
+}
+
+uint64_t Replica::appliedLsn() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return appliedLsn_;
+}
+
+std::optional<std::chrono::milliseconds> Replica::staleness() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (!freshAt_)
+    return std::nullopt;
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - *freshAt_);
+}
+
+Status Replica::checkStaleness(std::chrono::milliseconds bound) const {
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (!broken_.ok())
+      return broken_;
+  }
+  auto lag = staleness();
+  if (!lag)
+    return Status::FailedPrecondition(
+        "Replica has not caught up with its leader yet");
+  if (*lag > bound)
+    return Status::FailedPrecondition(
+        "Replica is " + std::to_string(lag->count()) +
+        " ms behind its leader, over the " + std::to_string(bound.count()) +
+        " ms bound");
+  return Status::OK();
+}
+
+} // namespace kadedb
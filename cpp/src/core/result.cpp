@@ -0,0 +1,390 @@
+#include "kadedb/result.h"
+
+#include <charconv>
+#include <cstdio>
+
+namespace kadedb {
+
+namespace {
+
+// Output buffer for the writers: appends to `buf` and hands it to the sink
+// whenever it fills. Without a sink `buf` simply grows into the result.
+class ChunkedOutput {
+public:
+  explicit ChunkedOutput(const OutputSink *sink) : sink_(sink) {
+    if (sink_)
+      buf_.reserve(kOutputChunkBytes + kOutputChunkBytes / 4);
+  }
+
+  void put(char c) { buf_.push_back(c); }
+  void append(const char *p, size_t n) { buf_.append(p, n); }
+  void append(const std::string &s) { buf_.append(s); }
+  void spaces(size_t n) { buf_.append(n, ' '); }
+
+  // Called between cells, so one chunk ends up at most a cell past the limit
+  void maybeFlush() {
+    if (sink_ && buf_.size() >= kOutputChunkBytes)
+      flush();
+  }
+  void flush() {
+    if (sink_ && !buf_.empty()) {
+      (*sink_)(buf_.data(), buf_.size());
+      buf_.clear();
+    }
+  }
+  std::string take() { return std::move(buf_); }
+
+private:
+  const OutputSink *sink_;
+  std::string buf_;
+};
+
+void appendInt(ChunkedOutput &out, int64_t v) {
+  char buf[24];
+  const auto res = std::to_chars(buf, buf + sizeof(buf), v);
+  out.append(buf, static_cast<size_t>(res.ptr - buf));
+}
+
+// Same text as FloatValue::toString(): %g at 15 significant digits
+void appendFloat(ChunkedOutput &out, double d) {
+  char buf[32];
+  const int n = std::snprintf(buf, sizeof(buf), "%.15g", d);
+  out.append(buf, static_cast<size_t>(n));
+}
+
+// ---- CSV -------------------------------------------------------------------
+
+struct CsvFormat {
+  char delimiter;
+  bool alwaysQuote;
+  char quoteChar;
+
+  bool needsQuotes(const char *p, size_t n) const {
+    if (alwaysQuote)
+      return true;
+    for (size_t i = 0; i < n; ++i)
+      if (p[i] == delimiter || p[i] == quoteChar || p[i] == '\n' ||
+          p[i] == '\r')
+        return true;
+    return false;
+  }
+
+  void field(ChunkedOutput &out, const char *p, size_t n) const {
+    if (!needsQuotes(p, n)) {
+      out.append(p, n);
+      return;
+    }
+    out.put(quoteChar);
+    size_t run = 0;
+    for (size_t i = 0; i < n; ++i) {
+      if (p[i] == quoteChar) {
+        // Copy through the quote, then start the next run on it again
+        out.append(p + run, i + 1 - run);
+        run = i;
+      }
+    }
+    out.append(p + run, n - run);
+    out.put(quoteChar);
+  }
+  void field(ChunkedOutput &out, const std::string &s) const {
+    field(out, s.data(), s.size());
+  }
+
+  void cell(ChunkedOutput &out, const Value *v, ColumnType columnType) const {
+    if (!v)
+      return;
+    char buf[32];
+    switch (v->type()) {
+    case ValueType::String: {
+      const auto &s = static_cast<const StringValue &>(*v).value();
+      if (columnType == ColumnType::String) {
+        field(out, s);
+        return;
+      }
+      // Outside String columns the cell is written as toString() would,
+      // i.e. with its own quotes
+      std::string quoted;
+      quoted.reserve(s.size() + 2);
+      quoted.push_back('"');
+      quoted += s;
+      quoted.push_back('"');
+      field(out, quoted);
+      return;
+    }
+    case ValueType::Integer: {
+      const auto res = std::to_chars(
+          buf, buf + sizeof(buf),
+          static_cast<const IntegerValue &>(*v).value());
+      field(out, buf, static_cast<size_t>(res.ptr - buf));
+      return;
+    }
+    case ValueType::Float: {
+      const int n = std::snprintf(buf, sizeof(buf), "%.15g",
+                                  static_cast<const FloatValue &>(*v).value());
+      field(out, buf, static_cast<size_t>(n));
+      return;
+    }
+    case ValueType::Boolean:
+      if (static_cast<const BooleanValue &>(*v).value())
+        field(out, "true", 4);
+      else
+        field(out, "false", 5);
+      return;
+    case ValueType::Null:
+      field(out, "null", 4);
+      return;
+    }
+  }
+};
+
+void writeCSVImpl(const std::vector<std::string> &columnNames,
+                  const std::vector<ColumnType> &columnTypes, size_t rowCount,
+                  const RowSource &rowAt, ChunkedOutput &out, char delimiter,
+                  bool includeHeader, bool alwaysQuote, char quoteChar) {
+  const CsvFormat fmt{delimiter, alwaysQuote, quoteChar};
+  if (includeHeader && !columnNames.empty()) {
+    for (size_t i = 0; i < columnNames.size(); ++i) {
+      if (i)
+        out.put(delimiter);
+      fmt.field(out, columnNames[i]);
+    }
+    out.put('\n');
+  }
+  for (size_t r = 0; r < rowCount; ++r) {
+    const auto &values = rowAt(r).values();
+    for (size_t i = 0; i < values.size(); ++i) {
+      if (i)
+        out.put(delimiter);
+      fmt.cell(out, values[i].get(), columnTypes.at(i));
+    }
+    out.put('\n');
+    out.maybeFlush();
+  }
+  out.flush();
+}
+
+// ---- JSON ------------------------------------------------------------------
+
+void appendJsonString(ChunkedOutput &out, const std::string &s) {
+  static const char hex[] = "0123456789abcdef";
+  out.put('"');
+  size_t run = 0;
+  for (size_t i = 0; i < s.size(); ++i) {
+    const unsigned char ch = static_cast<unsigned char>(s[i]);
+    if (ch >= 0x20 && ch != '"' && ch != '\\')
+      continue;
+    out.append(s.data() + run, i - run);
+    run = i + 1;
+    switch (ch) {
+    case '"':
+      out.append("\\\"", 2);
+      break;
+    case '\\':
+      out.append("\\\\", 2);
+      break;
+    case '\b':
+      out.append("\\b", 2);
+      break;
+    case '\f':
+      out.append("\\f", 2);
+      break;
+    case '\n':
+      out.append("\\n", 2);
+      break;
+    case '\r':
+      out.append("\\r", 2);
+      break;
+    case '\t':
+      out.append("\\t", 2);
+      break;
+    default: {
+      const char esc[6] = {'\\', 'u', '0', '0', hex[ch >> 4], hex[ch & 0xF]};
+      out.append(esc, sizeof(esc));
+    }
+    }
+  }
+  out.append(s.data() + run, s.size() - run);
+  out.put('"');
+}
+
+void appendJsonValue(ChunkedOutput &out, const Value *v) {
+  if (!v) {
+    out.append("null", 4);
+    return;
+  }
+  switch (v->type()) {
+  case ValueType::Null:
+    out.append("null", 4);
+    return;
+  case ValueType::Boolean:
+    if (static_cast<const BooleanValue &>(*v).value())
+      out.append("true", 4);
+    else
+      out.append("false", 5);
+    return;
+  case ValueType::Integer:
+    appendInt(out, static_cast<const IntegerValue &>(*v).value());
+    return;
+  case ValueType::Float:
+    appendFloat(out, static_cast<const FloatValue &>(*v).value());
+    return;
+  case ValueType::String:
+    appendJsonString(out, static_cast<const StringValue &>(*v).value());
+    return;
+  }
+}
+
+const char *columnTypeName(ColumnType t) {
+  switch (t) {
+  case ColumnType::Null:
+    return "\"Null\"";
+  case ColumnType::Integer:
+    return "\"Integer\"";
+  case ColumnType::Float:
+    return "\"Float\"";
+  case ColumnType::String:
+    return "\"String\"";
+  case ColumnType::Boolean:
+    return "\"Boolean\"";
+  }
+  return "\"Null\"";
+}
+
+void writeJSONImpl(const std::vector<std::string> &columnNames,
+                   const std::vector<ColumnType> &columnTypes, size_t rowCount,
+                   const RowSource &rowAt, ChunkedOutput &out,
+                   bool includeMetadata, int indent) {
+  const size_t step = indent > 0 ? static_cast<size_t>(indent) : 0;
+  auto indentNL = [&](size_t level) {
+    if (step) {
+      out.put('\n');
+      out.spaces(level * step);
+    }
+  };
+
+  // Rows nest one level deeper inside the metadata wrapper
+  const size_t base = includeMetadata ? 1 : 0;
+  if (includeMetadata) {
+    out.put('{');
+    indentNL(1);
+    out.append("\"columns\":[", 11);
+    for (size_t i = 0; i < columnNames.size(); ++i) {
+      if (i) {
+        out.put(',');
+        if (step)
+          out.put(' ');
+      }
+      appendJsonString(out, columnNames[i]);
+    }
+    out.append("],", 2);
+    indentNL(1);
+    out.append("\"types\":[", 9);
+    for (size_t i = 0; i < columnTypes.size(); ++i) {
+      if (i) {
+        out.put(',');
+        if (step)
+          out.put(' ');
+      }
+      const char *name = columnTypeName(columnTypes[i]);
+      out.append(name, std::char_traits<char>::length(name));
+    }
+    out.append("],", 2);
+    indentNL(1);
+    out.append("\"rows\":", 7);
+  }
+
+  out.put('[');
+  if (rowCount)
+    indentNL(base + 1);
+  for (size_t r = 0; r < rowCount; ++r) {
+    if (r) {
+      out.put(',');
+      indentNL(base + 1);
+    }
+    const auto &values = rowAt(r).values();
+    out.put('{');
+    if (!columnNames.empty())
+      indentNL(base + 2);
+    for (size_t c = 0; c < columnNames.size(); ++c) {
+      if (c) {
+        out.put(',');
+        indentNL(base + 2);
+      }
+      appendJsonString(out, columnNames[c]);
+      out.put(':');
+      if (step)
+        out.put(' ');
+      appendJsonValue(out, values.at(c).get());
+    }
+    if (!columnNames.empty())
+      indentNL(base + 1);
+    out.put('}');
+    out.maybeFlush();
+  }
+  if (rowCount)
+    indentNL(base);
+  out.put(']');
+  if (includeMetadata) {
+    indentNL(0);
+    out.put('}');
+  }
+  out.flush();
+}
+
+} // namespace
+
+void writeCSV(const std::vector<std::string> &columnNames,
+              const std::vector<ColumnType> &columnTypes, size_t rowCount,
+              const RowSource &rowAt, const OutputSink &sink, char delimiter,
+              bool includeHeader, bool alwaysQuote, char quoteChar) {
+  ChunkedOutput out(&sink);
+  writeCSVImpl(columnNames, columnTypes, rowCount, rowAt, out, delimiter,
+               includeHeader, alwaysQuote, quoteChar);
+}
+
+void writeJSON(const std::vector<std::string> &columnNames,
+               const std::vector<ColumnType> &columnTypes, size_t rowCount,
+               const RowSource &rowAt, const OutputSink &sink,
+               bool includeMetadata, int indent) {
+  ChunkedOutput out(&sink);
+  writeJSONImpl(columnNames, columnTypes, rowCount, rowAt, out,
+                includeMetadata, indent);
+}
+
+std::string ResultSet::toCSV(char delimiter, bool includeHeader,
+                             bool alwaysQuote, char quoteChar) const {
+  ChunkedOutput out(nullptr);
+  writeCSVImpl(
+      columnNames_, columnTypes_, rows_.size(),
+      [this](size_t i) -> const ResultRow & { return rows_[i]; }, out,
+      delimiter, includeHeader, alwaysQuote, quoteChar);
+  return out.take();
+}
+
+std::string ResultSet::toJSON(bool includeMetadata, int indent) const {
+  ChunkedOutput out(nullptr);
+  writeJSONImpl(
+      columnNames_, columnTypes_, rows_.size(),
+      [this](size_t i) -> const ResultRow & { return rows_[i]; }, out,
+      includeMetadata, indent);
+  return out.take();
+}
+
+void ResultSet::writeCSV(const OutputSink &sink, char delimiter,
+                         bool includeHeader, bool alwaysQuote,
+                         char quoteChar) const {
+  kadedb::writeCSV(
+      columnNames_, columnTypes_, rows_.size(),
+      [this](size_t i) -> const ResultRow & { return rows_[i]; }, sink,
+      delimiter, includeHeader, alwaysQuote, quoteChar);
+}
+
+void ResultSet::writeJSON(const OutputSink &sink, bool includeMetadata,
+                          int indent) const {
+  kadedb::writeJSON(
+      columnNames_, columnTypes_, rows_.size(),
+      [this](size_t i) -> const ResultRow & { return rows_[i]; }, sink,
+      includeMetadata, indent);
+}
+
+} // namespace kadedb
@@ -0,0 +1,119 @@
+#include "kadedb/result_cache.h"
+
+#include "kadedb/memory.h"
+
+#include <iterator>
+
+namespace kadedb {
+namespace kadeql {
+
+std::optional<ResultSet> ResultCache::lookup(const std::string &key,
+                                             const VersionOf &versionOf) {
+  std::shared_ptr<const Rows> result;
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      ++misses_;
+      return std::nullopt;
+    }
+    for (const auto &source : it->second->sources) {
+      if (versionOf(source) != source.version) {
+        ++invalidations_;
+        ++misses_;
+        erase(it->second);
+        return std::nullopt;
+      }
+    }
+    ++hits_;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    result = it->second->result;
+  }
+
+  ResultSet rs(result->columnNames, result->columnTypes);
+  for (const auto &row : result->rows)
+    rs.addRow(ResultRow(row));
+  return rs;
+}
+
+void ResultCache::insert(const std::string &key,
+                         std::vector<ResultSource> sources,
+                         const ResultSet &rs) {
+  // Sized while copying; stop once it cannot fit
+  auto result = std::make_shared<Rows>();
+  size_t bytes = key.size();
+  for (const auto &name : rs.columnNames())
+    bytes += name.size();
+  for (const auto &row : rs) {
+    if (bytes > capacity_)
+      return;
+    std::vector<InlineValue> cells;
+    cells.reserve(row.size());
+    for (const auto &v : row.values()) {
+      cells.push_back(InlineValue::fromValue(v.get()));
+      bytes += memory::valueBytes(cells.back());
+    }
+    result->rows.push_back(std::move(cells));
+  }
+  if (bytes > capacity_)
+    return;
+  result->columnNames = rs.columnNames();
+  result->columnTypes = rs.columnTypes();
+
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (auto it = index_.find(key); it != index_.end())
+    erase(it->second);
+  while (!lru_.empty() && bytes_ + bytes > capacity_) {
+    ++evictions_;
+    erase(std::prev(lru_.end()));
+  }
+  lru_.push_front(Entry{key, std::move(sources), std::move(result), bytes});
+  index_.emplace(key, lru_.begin());
+  bytes_ += bytes;
+}
+
+void ResultCache::erase(Iter it) {
+  bytes_ -= it->bytes;
+  index_.erase(it->key);
+  lru_.erase(it);
+}
+
+size_t ResultCache::size() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return lru_.size();
+}
+
+size_t ResultCache::bytes() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return bytes_;
+}
+
+uint64_t ResultCache::hits() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return hits_;
+}
+
+uint64_t ResultCache::misses() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return misses_;
+}
+
+uint64_t ResultCache::invalidations() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return invalidations_;
+}
+
+uint64_t ResultCache::evictions() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return evictions_;
+}
+
+void ResultCache::clear() {
+  std::lock_guard<std::mutex> lk(mtx_);
+  lru_.clear();
+  index_.clear();
+  bytes_ = 0;
+}
+
+} // namespace kadeql
+} // namespace kadedb
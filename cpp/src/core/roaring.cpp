@@ -0,0 +1,276 @@
+#include "kadedb/roaring.h"
+
+#include <algorithm>
+#include <bitset>
+#include <iterator>
+
+namespace kadedb {
+namespace {
+
+uint32_t countBits(const std::vector<uint64_t> &bits) {
+  uint32_t n = 0;
+  for (uint64_t w : bits)
+    n += static_cast<uint32_t>(std::bitset<64>(w).count());
+  return n;
+}
+
+} // namespace
+
+bool RoaringBitmap::Container::contains(uint16_t low) const {
+  if (bits.empty())
+    return std::binary_search(array.begin(), array.end(), low);
+  return (bits[low >> 6] >> (low & 63)) & 1;
+}
+
+void RoaringBitmap::Container::normalize() {
+  if (bits.empty()) {
+    if (array.size() <= kArrayMax)
+      return;
+    bits = toBits(*this);
+    count = static_cast<uint32_t>(array.size());
+    std::vector<uint16_t>().swap(array);
+    return;
+  }
+  if (count > kArrayMax)
+    return;
+  array.clear();
+  array.reserve(count);
+  for (size_t w = 0; w < bits.size(); ++w)
+    for (uint64_t word = bits[w]; word; word &= word - 1)
+      array.push_back(static_cast<uint16_t>(w * 64 + lowestBit(word)));
+  std::vector<uint64_t>().swap(bits);
+  count = 0;
+}
+
+std::vector<uint64_t> RoaringBitmap::toBits(const Container &c) {
+  if (!c.bits.empty())
+    return c.bits;
+  std::vector<uint64_t> bits(kWords, 0);
+  for (uint16_t low : c.array)
+    bits[low >> 6] |= uint64_t{1} << (low & 63);
+  return bits;
+}
+
+RoaringBitmap::Container *RoaringBitmap::find(uint16_t key) {
+  auto it = std::lower_bound(
+      containers_.begin(), containers_.end(), key,
+      [](const Container &c, uint16_t k) { return c.key < k; });
+  return it != containers_.end() && it->key == key ? &*it : nullptr;
+}
+
+const RoaringBitmap::Container *RoaringBitmap::find(uint16_t key) const {
+  return const_cast<RoaringBitmap *>(this)->find(key);
+}
+
+RoaringBitmap RoaringBitmap::range(uint32_t lo, uint32_t hi) {
+  RoaringBitmap out;
+  for (uint64_t start = lo; start < hi;) {
+    // The part of [start, hi) sharing start's high bits
+    const uint64_t end = std::min<uint64_t>(hi, (start | 0xffff) + 1);
+    Container c;
+    c.key = static_cast<uint16_t>(start >> 16);
+    if (end - start > kArrayMax) {
+      c.bits.assign(kWords, 0);
+      for (uint64_t v = start; v < end; ++v)
+        c.bits[(v & 0xffff) >> 6] |= uint64_t{1} << (v & 63);
+      c.count = static_cast<uint32_t>(end - start);
+    } else {
+      for (uint64_t v = start; v < end; ++v)
+        c.array.push_back(static_cast<uint16_t>(v & 0xffff));
+    }
+    out.containers_.push_back(std::move(c));
+    start = end;
+  }
+  return out;
+}
+
+void RoaringBitmap::add(uint32_t v) {
+  const auto key = static_cast<uint16_t>(v >> 16);
+  const auto low = static_cast<uint16_t>(v & 0xffff);
+  auto it = std::lower_bound(
+      containers_.begin(), containers_.end(), key,
+      [](const Container &c, uint16_t k) { return c.key < k; });
+  if (it == containers_.end() || it->key != key) {
+    it = containers_.insert(it, Container{});
+    it->key = key;
+  }
+  if (it->bits.empty()) {
+    auto pos = std::lower_bound(it->array.begin(), it->array.end(), low);
+    if (pos != it->array.end() && *pos == low)
+      return;
+    it->array.insert(pos, low);
+    it->normalize();
+    return;
+  }
+  uint64_t &word = it->bits[low >> 6];
+  const uint64_t bit = uint64_t{1} << (low & 63);
+  if (!(word & bit)) {
+    word |= bit;
+    ++it->count;
+  }
+}
+
+bool RoaringBitmap::remove(uint32_t v) {
+  Container *c = find(static_cast<uint16_t>(v >> 16));
+  if (!c)
+    return false;
+  const auto low = static_cast<uint16_t>(v & 0xffff);
+  if (c->bits.empty()) {
+    auto pos = std::lower_bound(c->array.begin(), c->array.end(), low);
+    if (pos == c->array.end() || *pos != low)
+      return false;
+    c->array.erase(pos);
+  } else {
+    uint64_t &word = c->bits[low >> 6];
+    const uint64_t bit = uint64_t{1} << (low & 63);
+    if (!(word & bit))
+      return false;
+    word &= ~bit;
+    --c->count;
+    c->normalize();
+  }
+  if (c->size() == 0)
+    containers_.erase(containers_.begin() + (c - containers_.data()));
+  return true;
+}
+
+bool RoaringBitmap::contains(uint32_t v) const {
+  const Container *c = find(static_cast<uint16_t>(v >> 16));
+  return c && c->contains(static_cast<uint16_t>(v & 0xffff));
+}
+
+size_t RoaringBitmap::cardinality() const {
+  size_t n = 0;
+  for (const auto &c : containers_)
+    n += c.size();
+  return n;
+}
+
+size_t RoaringBitmap::memoryBytes() const {
+  size_t n = containers_.capacity() * sizeof(Container);
+  for (const auto &c : containers_)
+    n += c.array.capacity() * sizeof(uint16_t) +
+         c.bits.capacity() * sizeof(uint64_t);
+  return n;
+}
+
+RoaringBitmap &RoaringBitmap::operator&=(const RoaringBitmap &other) {
+  std::vector<Container> out;
+  auto a = containers_.begin();
+  auto b = other.containers_.begin();
+  while (a != containers_.end() && b != other.containers_.end()) {
+    if (a->key != b->key) {
+      if (a->key < b->key)
+        ++a;
+      else
+        ++b;
+      continue;
+    }
+    Container c;
+    c.key = a->key;
+    if (a->bits.empty() || b->bits.empty()) {
+      // Keep the array side's values found in the other side
+      const Container &arr = a->bits.empty() ? *a : *b;
+      const Container &any = a->bits.empty() ? *b : *a;
+      for (uint16_t low : arr.array)
+        if (any.contains(low))
+          c.array.push_back(low);
+    } else {
+      c.bits.resize(kWords);
+      for (size_t w = 0; w < kWords; ++w)
+        c.bits[w] = a->bits[w] & b->bits[w];
+      c.count = countBits(c.bits);
+      c.normalize();
+    }
+    if (c.size())
+      out.push_back(std::move(c));
+    ++a;
+    ++b;
+  }
+  containers_ = std::move(out);
+  return *this;
+}
+
+RoaringBitmap &RoaringBitmap::operator|=(const RoaringBitmap &other) {
+  std::vector<Container> out;
+  out.reserve(containers_.size() + other.containers_.size());
+  auto a = containers_.begin();
+  auto b = other.containers_.begin();
+  while (a != containers_.end() || b != other.containers_.end()) {
+    if (b == other.containers_.end() ||
+        (a != containers_.end() && a->key < b->key)) {
+      out.push_back(std::move(*a++));
+      continue;
+    }
+    if (a == containers_.end() || b->key < a->key) {
+      out.push_back(*b++);
+      continue;
+    }
+    Container c;
+    c.key = a->key;
+    if (a->bits.empty() && b->bits.empty()) {
+      std::set_union(a->array.begin(), a->array.end(), b->array.begin(),
+                     b->array.end(), std::back_inserter(c.array));
+    } else {
+      c.bits = toBits(*a);
+      const std::vector<uint64_t> rhs = toBits(*b);
+      for (size_t w = 0; w < kWords; ++w)
+        c.bits[w] |= rhs[w];
+      c.count = countBits(c.bits);
+    }
+    c.normalize();
+    out.push_back(std::move(c));
+    ++a;
+    ++b;
+  }
+  containers_ = std::move(out);
+  return *this;
+}
+
+RoaringBitmap &RoaringBitmap::operator-=(const RoaringBitmap &other) {
+  if (&other == this) {
+    clear();
+    return *this;
+  }
+  std::vector<Container> out;
+  out.reserve(containers_.size());
+  auto b = other.containers_.begin();
+  for (auto &a : containers_) {
+    while (b != other.containers_.end() && b->key < a.key)
+      ++b;
+    if (b == other.containers_.end() || b->key != a.key) {
+      out.push_back(std::move(a));
+      continue;
+    }
+    if (a.bits.empty()) {
+      a.array.erase(std::remove_if(a.array.begin(), a.array.end(),
+                                   [&](uint16_t low) {
+                                     return b->contains(low);
+                                   }),
+                    a.array.end());
+    } else {
+      if (b->bits.empty()) {
+        for (uint16_t low : b->array)
+          a.bits[low >> 6] &= ~(uint64_t{1} << (low & 63));
+      } else {
+        for (size_t w = 0; w < kWords; ++w)
+          a.bits[w] &= ~b->bits[w];
+      }
+      a.count = countBits(a.bits);
+      a.normalize();
+    }
+    if (a.size())
+      out.push_back(std::move(a));
+  }
+  containers_ = std::move(out);
+  return *this;
+}
+
+std::vector<uint32_t> RoaringBitmap::toVector() const {
+  std::vector<uint32_t> out;
+  out.reserve(cardinality());
+  forEach([&](uint32_t v) { out.push_back(v); });
+  return out;
+}
+
+} // namespace kadedb
@@ -0,0 +1,176 @@
+// KeyValueStore over RocksDB; built only with KADEDB_WITH_ROCKSDB
+#include "kadedb/kv_store.h"
+
+#include <mutex>
+
+#include <rocksdb/db.h>
+#include <rocksdb/options.h>
+#include <rocksdb/write_batch.h>
+
+namespace kadedb {
+namespace {
+
+Status fromRocks(const rocksdb::Status &st) {
+  if (st.ok())
+    return Status::OK();
+  if (st.IsNotFound())
+    return Status::NotFound(st.ToString());
+  return Status::Internal(st.ToString());
+}
+
+rocksdb::Slice slice(std::string_view s) {
+  return rocksdb::Slice(s.data(), s.size());
+}
+
+class RocksDbIterator final : public KeyValueIterator {
+public:
+  explicit RocksDbIterator(std::unique_ptr<rocksdb::Iterator> it)
+      : it_(std::move(it)) {}
+
+  void seek(std::string_view target) override { it_->Seek(slice(target)); }
+  bool valid() const override { return it_->Valid(); }
+  void next() override { it_->Next(); }
+  std::string_view key() const override {
+    auto k = it_->key();
+    return std::string_view(k.data(), k.size());
+  }
+  std::string_view value() const override {
+    auto v = it_->value();
+    return std::string_view(v.data(), v.size());
+  }
+  Status status() const override { return fromRocks(it_->status()); }
+
+private:
+  std::unique_ptr<rocksdb::Iterator> it_;
+};
+
+class RocksDbKeyValueStore final : public KeyValueStore {
+public:
+  RocksDbKeyValueStore(
+      std::unique_ptr<rocksdb::DB> db,
+      const std::vector<rocksdb::ColumnFamilyHandle *> &handles)
+      : db_(std::move(db)) {
+    for (auto *h : handles)
+      families_.emplace(h->GetName(), h);
+  }
+
+  ~RocksDbKeyValueStore() override {
+    for (auto &kv : families_)
+      db_->DestroyColumnFamilyHandle(kv.second);
+    db_->Close();
+  }
+
+  Status createFamily(const std::string &family) override {
+    std::unique_lock lk(mtx_);
+    if (families_.count(family))
+      return Status::OK();
+    rocksdb::ColumnFamilyHandle *h = nullptr;
+    auto st = db_->CreateColumnFamily(rocksdb::ColumnFamilyOptions(), family,
+                                      &h);
+    if (!st.ok())
+      return fromRocks(st);
+    families_.emplace(family, h);
+    return Status::OK();
+  }
+
+  Status dropFamily(const std::string &family) override {
+    std::unique_lock lk(mtx_);
+    auto it = families_.find(family);
+    if (it == families_.end())
+      return Status::OK();
+    auto st = db_->DropColumnFamily(it->second);
+    if (!st.ok())
+      return fromRocks(st);
+    db_->DestroyColumnFamilyHandle(it->second);
+    families_.erase(it);
+    return Status::OK();
+  }
+
+  std::vector<std::string> listFamilies() const override {
+    std::shared_lock lk(mtx_);
+    std::vector<std::string> names;
+    for (const auto &kv : families_)
+      if (kv.first != rocksdb::kDefaultColumnFamilyName)
+        names.push_back(kv.first);
+    return names;
+  }
+
+  Result<std::string> get(const std::string &family,
+                          std::string_view key) const override {
+    std::shared_lock lk(mtx_);
+    auto *h = handle(family);
+    if (!h)
+      return Result<std::string>::err(
+          Status::NotFound("Unknown column family: " + family));
+    std::string value;
+    auto st = db_->Get(rocksdb::ReadOptions(), h, slice(key), &value);
+    if (!st.ok())
+      return Result<std::string>::err(fromRocks(st));
+    return Result<std::string>::ok(std::move(value));
+  }
+
+  Status write(const WriteBatch &batch) override {
+    std::shared_lock lk(mtx_);
+    rocksdb::WriteBatch wb;
+    for (const auto &op : batch.ops) {
+      auto *h = handle(op.family);
+      if (!h)
+        return Status::NotFound("Unknown column family: " + op.family);
+      auto st = op.value ? wb.Put(h, op.key, *op.value) : wb.Delete(h, op.key);
+      if (!st.ok())
+        return fromRocks(st);
+    }
+    return fromRocks(db_->Write(rocksdb::WriteOptions(), &wb));
+  }
+
+  Result<std::unique_ptr<KeyValueIterator>>
+  newIterator(const std::string &family) const override {
+    using R = Result<std::unique_ptr<KeyValueIterator>>;
+    std::shared_lock lk(mtx_);
+    auto *h = handle(family);
+    if (!h)
+      return R::err(Status::NotFound("Unknown column family: " + family));
+    std::unique_ptr<rocksdb::Iterator> it(
+        db_->NewIterator(rocksdb::ReadOptions(), h));
+    return R::ok(std::make_unique<RocksDbIterator>(std::move(it)));
+  }
+
+private:
+  rocksdb::ColumnFamilyHandle *handle(const std::string &family) const {
+    auto it = families_.find(family);
+    return it == families_.end() ? nullptr : it->second;
+  }
+
+  std::unique_ptr<rocksdb::DB> db_;
+  std::unordered_map<std::string, rocksdb::ColumnFamilyHandle *> families_;
+  mutable std::shared_mutex mtx_;
+};
+
+} // namespace
+
+Result<std::shared_ptr<KeyValueStore>>
+openRocksDbStore(const std::string &path) {
+  using R = Result<std::shared_ptr<KeyValueStore>>;
+  rocksdb::Options options;
+  options.create_if_missing = true;
+
+  // Every existing family must be opened; a new database has only the
+  // default one
+  std::vector<std::string> names;
+  if (!rocksdb::DB::ListColumnFamilies(options, path, &names).ok())
+    names = {rocksdb::kDefaultColumnFamilyName};
+  std::vector<rocksdb::ColumnFamilyDescriptor> descriptors;
+  for (const auto &name : names)
+    descriptors.emplace_back(name, rocksdb::ColumnFamilyOptions());
+
+  std::vector<rocksdb::ColumnFamilyHandle *> handles;
+  rocksdb::DB *raw = nullptr;
+  auto st = rocksdb::DB::Open(options, path, descriptors, &handles, &raw);
+  if (!st.ok())
+    return R::err(Status::Internal("Cannot open RocksDB at " + path + ": " +
+                                   st.ToString()));
+  return R::ok(std::make_shared<RocksDbKeyValueStore>(
+      std::unique_ptr<rocksdb::DB>(raw), handles));
+}
+
+} // namespace kadedb
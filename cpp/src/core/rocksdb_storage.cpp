@@ -0,0 +1,1322 @@
+#include "kadedb/rocksdb_storage.h"
+
+#include "kadedb/serialization.h"
+
+#include <cmath>
+#include <mutex>
+#include <sstream>
+#include <unordered_set>
+
+namespace kadedb {
+namespace {
+
+const std::string kCatalog = "__catalog";
+
+// Column families of a table and a collection
+std::string rowsFamily(const std::string &table) { return "t:" + table; }
+std::string uniqueFamily(const std::string &table) { return "u:" + table; }
+std::string indexFamily(const std::string &table) { return "x:" + table; }
+std::string docsFamily(const std::string &coll) { return "d:" + coll; }
+std::string docUniqueFamily(const std::string &coll) { return "du:" + coll; }
+std::string docIndexFamily(const std::string &coll) { return "dx:" + coll; }
+
+// Catalog keys: "t/<table>" schema, "n/<table>" row count and next row id,
+// "ti/<table>\0<column>" index; "c/", "cn/" and "ci/" likewise for
+// collections
+std::string catalogKey(const char *kind, const std::string &name) {
+  return kind + name;
+}
+std::string catalogKey(const char *kind, const std::string &name,
+                       const std::string &member) {
+  return kind + name + '\0' + member;
+}
+
+bool startsWith(std::string_view s, std::string_view prefix) {
+  return s.substr(0, prefix.size()) == prefix;
+}
+
+template <typename T, typename Write> std::string encode(const T &v, Write w) {
+  std::ostringstream os;
+  w(v, os);
+  return os.str();
+}
+
+template <typename Read> auto decode(std::string_view data, Read r) {
+  std::istringstream is{std::string(data)};
+  return r(is);
+}
+
+std::string encodeRow(const Row &row) { return encode(row, bin::writeRow); }
+Row decodeRow(std::string_view data) { return decode(data, bin::readRow); }
+std::string encodeDocument(const Document &doc) {
+  return encode(doc, bin::writeDocument);
+}
+Document decodeDocument(std::string_view data) {
+  return decode(data, bin::readDocument);
+}
+
+// Value under `key` in `family`, std::nullopt when absent
+Result<std::optional<std::string>> lookup(const KeyValueStore &store,
+                                          const std::string &family,
+                                          std::string_view key) {
+  using R = Result<std::optional<std::string>>;
+  auto got = store.get(family, key);
+  if (got.hasValue())
+    return R::ok(got.takeValue());
+  if (got.status().code() == StatusCode::NotFound)
+    return R::ok(std::nullopt);
+  return R::err(got.status());
+}
+
+Status createFamilies(KeyValueStore &store,
+                      std::initializer_list<std::string> families) {
+  for (const auto &f : families)
+    if (auto st = store.createFamily(f); !st.ok())
+      return st;
+  return Status::OK();
+}
+
+Status dropFamilies(KeyValueStore &store,
+                    std::initializer_list<std::string> families) {
+  for (const auto &f : families)
+    if (auto st = store.dropFamily(f); !st.ok())
+      return st;
+  return Status::OK();
+}
+
+// Unique key of cell `v` of column `col`: its text, as the in-memory
+// storages compare unique values, with Integer values of a Float column
+// written as floats
+std::string uniqueKey(size_t col, ColumnType type, const Value &v) {
+  std::string key;
+  keycode::appendU32(key, static_cast<uint32_t>(col));
+  if (type == ColumnType::Float && v.type() == ValueType::Integer)
+    key += FloatValue(v.asFloat()).toString();
+  else
+    key += v.toString();
+  return key;
+}
+
+std::string indexKey(size_t col, const Value &v, const std::string &rowKey) {
+  std::string key;
+  keycode::appendU32(key, static_cast<uint32_t>(col));
+  keycode::appendValue(key, &v);
+  key += rowKey;
+  return key;
+}
+
+// NaN compares equal to every number under Value::compare(), so no key
+// range bounds a comparison against it
+bool isNaN(const Value *v) {
+  return v->type() == ValueType::Float && std::isnan(v->asFloat());
+}
+
+// Whether `rhs` encodes like the cells of a column of type `type`, so a
+// comparison against it can bound a key range
+bool keyable(ColumnType type, const Value *rhs) {
+  if (!rhs || isNaN(rhs))
+    return false;
+  switch (type) {
+  case ColumnType::Integer:
+  case ColumnType::Float:
+    return rhs->type() == ValueType::Integer ||
+           rhs->type() == ValueType::Float;
+  case ColumnType::String:
+    return rhs->type() == ValueType::String;
+  case ColumnType::Boolean:
+    return rhs->type() == ValueType::Boolean;
+  case ColumnType::Null:
+    return false;
+  }
+  return false;
+}
+
+// Narrow [lo, hi) to the encoded values `op rhs` can match. Bounds are
+// inclusive of every key starting with the rhs encoding; the rows read
+// are matched against the predicate anyway.
+template <typename Op>
+void narrow(Op op, const std::string &rhs, std::string &lo, std::string &hi) {
+  auto raise = [&](std::string b) {
+    if (b > lo)
+      lo = std::move(b);
+  };
+  auto lower = [&](std::string b) {
+    if (hi.empty() || b < hi)
+      hi = std::move(b);
+  };
+  switch (op) {
+  case Op::Eq:
+    raise(rhs);
+    lower(keycode::prefixEnd(rhs));
+    break;
+  case Op::Gt:
+  case Op::Ge:
+    raise(rhs);
+    break;
+  case Op::Lt:
+  case Op::Le:
+    lower(keycode::prefixEnd(rhs));
+    break;
+  case Op::Ne:
+    break;
+  }
+}
+
+// Apply the comparisons on `column` in `p` (itself or under AND) to the
+// range; true when one bounded it
+bool narrowRows(const Predicate &p, const Column &column, std::string &lo,
+                std::string &hi) {
+  if (p.kind == Predicate::Kind::And) {
+    bool used = false;
+    for (const auto &ch : p.children)
+      used = narrowRows(ch, column, lo, hi) || used;
+    return used;
+  }
+  if (p.kind != Predicate::Kind::Comparison || p.column != column.name ||
+      p.op == Predicate::Op::Ne || !keyable(column.type, p.rhs.get()))
+    return false;
+  std::string rhs;
+  keycode::appendBound(rhs, p.rhs.get());
+  narrow(p.op, rhs, lo, hi);
+  return true;
+}
+
+bool narrowDocuments(const DocPredicate &p, const std::string &field,
+                     std::string &lo, std::string &hi) {
+  if (p.kind == DocPredicate::Kind::And) {
+    bool used = false;
+    for (const auto &ch : p.children)
+      used = narrowDocuments(ch, field, lo, hi) || used;
+    return used;
+  }
+  if (p.kind != DocPredicate::Kind::Comparison || p.field != field ||
+      p.op == DocPredicate::Op::Ne || !p.rhs || isNaN(p.rhs.get()))
+    return false;
+  std::string rhs;
+  keycode::appendBound(rhs, p.rhs.get());
+  narrow(p.op, rhs, lo, hi);
+  return true;
+}
+
+bool matchesDocument(const Document &doc, const DocPredicate &p) {
+  using K = DocPredicate::Kind;
+  switch (p.kind) {
+  case K::Comparison: {
+    auto it = doc.find(p.field);
+    if (it == doc.end() || !it->second || !p.rhs)
+      return false; // missing or null comparisons never match
+    const int cmp = it->second->compare(*p.rhs);
+    switch (p.op) {
+    case DocPredicate::Op::Eq:
+      return cmp == 0;
+    case DocPredicate::Op::Ne:
+      return cmp != 0;
+    case DocPredicate::Op::Lt:
+      return cmp < 0;
+    case DocPredicate::Op::Le:
+      return cmp <= 0;
+    case DocPredicate::Op::Gt:
+      return cmp > 0;
+    case DocPredicate::Op::Ge:
+      return cmp >= 0;
+    }
+    return false;
+  }
+  case K::And:
+    for (const auto &ch : p.children)
+      if (!matchesDocument(doc, ch))
+        return false;
+    return true;
+  case K::Or:
+    for (const auto &ch : p.children)
+      if (matchesDocument(doc, ch))
+        return true;
+    return false;
+  case K::Not:
+    return !p.children.empty() && !matchesDocument(doc, p.children.front());
+  }
+  return false;
+}
+
+// Value of a unique field, or nullptr when it is missing or null (nullish
+// values are exempt from uniqueness)
+const Value *uniqueFieldValue(const Document &doc, const std::string &field) {
+  auto it = doc.find(field);
+  if (it == doc.end() || !it->second ||
+      it->second->type() == ValueType::Null)
+    return nullptr;
+  return it->second.get();
+}
+
+std::string docUniqueKey(const std::string &field, const Value &v) {
+  std::string key;
+  keycode::appendString(key, field);
+  key += v.toString();
+  return key;
+}
+
+std::string docIndexKey(const std::string &field, const Value &v,
+                        const std::string &docKey) {
+  std::string key;
+  keycode::appendString(key, field);
+  keycode::appendValue(key, &v);
+  key += docKey;
+  return key;
+}
+
+// Catalog value of a collection: 1 and its schema, or 0 without one
+std::string encodeCollection(const std::optional<DocumentSchema> &schema) {
+  std::string v(1, schema ? '\x01' : '\0');
+  if (schema)
+    v += encode(*schema, bin::writeDocumentSchema);
+  return v;
+}
+
+Status corrupt(const std::string &what, const SerializationError &e) {
+  return Status::Internal("Corrupt " + what + ": " + e.what());
+}
+
+} // namespace
+
+// ---- RocksDbRelationalStorage ----
+
+Result<std::unique_ptr<RocksDbRelationalStorage>>
+RocksDbRelationalStorage::open(std::shared_ptr<KeyValueStore> store) {
+  using R = Result<std::unique_ptr<RocksDbRelationalStorage>>;
+  std::unique_ptr<RocksDbRelationalStorage> rs(
+      new RocksDbRelationalStorage(std::move(store)));
+  if (auto st = rs->load(); !st.ok())
+    return R::err(st);
+  return R::ok(std::move(rs));
+}
+
+Status RocksDbRelationalStorage::load() {
+  if (auto st = store_->createFamily(kCatalog); !st.ok())
+    return st;
+  auto itRes = store_->newIterator(kCatalog);
+  if (!itRes.hasValue())
+    return itRes.status();
+  auto &it = *itRes.value();
+  try {
+    for (it.seek("t/"); it.valid() && startsWith(it.key(), "t/"); it.next()) {
+      TableInfo ti;
+      ti.schema = decode(it.value(), bin::readTableSchema);
+      ti.validator = CompiledValidator(ti.schema);
+      if (const auto &pk = ti.schema.primaryKey())
+        ti.pk = ti.schema.findColumn(*pk);
+      tables_.emplace(std::string(it.key().substr(2)), std::move(ti));
+    }
+  } catch (const SerializationError &e) {
+    return corrupt("table schema", e);
+  }
+  for (it.seek("n/"); it.valid() && startsWith(it.key(), "n/"); it.next()) {
+    auto t = tables_.find(std::string(it.key().substr(2)));
+    if (t == tables_.end() || it.value().size() != 16)
+      continue;
+    t->second.rows = keycode::readU64(it.value());
+    t->second.nextRowId = keycode::readU64(it.value().substr(8));
+  }
+  for (it.seek("ti/"); it.valid() && startsWith(it.key(), "ti/"); it.next()) {
+    std::string_view rest = it.key().substr(3);
+    const size_t sep = rest.find('\0');
+    if (sep == std::string_view::npos)
+      continue;
+    auto t = tables_.find(std::string(rest.substr(0, sep)));
+    if (t == tables_.end())
+      continue;
+    size_t col = t->second.schema.findColumn(std::string(rest.substr(sep + 1)));
+    if (col != TableSchema::npos)
+      t->second.indexed.insert(col);
+  }
+  return it.status();
+}
+
+std::optional<RocksDbRelationalStorage::KeyRange>
+RocksDbRelationalStorage::accessRange(const TableInfo &ti,
+                                      const Predicate &where) {
+  const auto &cols = ti.schema.columns();
+  KeyRange r;
+  // Comparisons never match absent cells (0x00), which are not indexed
+  r.lo = std::string(1, '\x01');
+  if (ti.pk != TableSchema::npos &&
+      narrowRows(where, cols[ti.pk], r.lo, r.hi)) {
+    r.primary = true;
+    r.column = ti.pk;
+    return r;
+  }
+  for (size_t col : ti.indexed) {
+    r.lo = std::string(1, '\x01');
+    r.hi.clear();
+    if (narrowRows(where, cols[col], r.lo, r.hi)) {
+      r.column = col;
+      return r;
+    }
+  }
+  return std::nullopt;
+}
+
+Status
+RocksDbRelationalStorage::visitRows(const std::string &table,
+                                    const TableInfo &ti,
+                                    const std::optional<Predicate> &where,
+                                    const RowVisitor &fn) const {
+  std::optional<BoundPredicate> bound;
+  std::optional<KeyRange> range;
+  if (where) {
+    bound = BoundPredicate::bind(*where, ti.schema);
+    range = accessRange(ti, *where);
+  }
+  auto visit = [&](const std::string &key, std::string_view data) {
+    Row row = decodeRow(data);
+    return (bound && !bound->matches(row)) || fn(key, row);
+  };
+
+  try {
+    if (range && !range->primary) {
+      // Index entries in the range, each pointing at its row
+      std::string prefix;
+      keycode::appendU32(prefix, static_cast<uint32_t>(range->column));
+      const std::string hi = range->hi.empty()
+                                 ? keycode::prefixEnd(prefix)
+                                 : prefix + range->hi;
+      auto itRes = store_->newIterator(indexFamily(table));
+      if (!itRes.hasValue())
+        return itRes.status();
+      auto &it = *itRes.value();
+      for (it.seek(prefix + range->lo); it.valid() && it.key() < hi;
+           it.next()) {
+        const std::string key(it.value());
+        auto row = store_->get(rowsFamily(table), key);
+        if (!row.hasValue())
+          return Status::Internal("Index entry without a row in table " +
+                                  table);
+        if (!visit(key, row.value()))
+          break;
+      }
+      return it.status();
+    }
+
+    auto itRes = store_->newIterator(rowsFamily(table));
+    if (!itRes.hasValue())
+      return itRes.status();
+    auto &it = *itRes.value();
+    for (it.seek(range ? range->lo : std::string()); it.valid(); it.next()) {
+      if (range && !range->hi.empty() && it.key() >= range->hi)
+        break;
+      if (!visit(std::string(it.key()), it.value()))
+        break;
+    }
+    return it.status();
+  } catch (const SerializationError &e) {
+    return corrupt("row in table " + table, e);
+  }
+}
+
+Result<std::vector<std::pair<std::string, Row>>>
+RocksDbRelationalStorage::collectRows(
+    const std::string &table, const TableInfo &ti,
+    const std::optional<Predicate> &where) const {
+  using R = Result<std::vector<std::pair<std::string, Row>>>;
+  std::vector<std::pair<std::string, Row>> out;
+  Status st = visitRows(table, ti, where,
+                        [&](const std::string &key, Row &row) {
+                          out.emplace_back(key, std::move(row));
+                          return true;
+                        });
+  if (!st.ok())
+    return R::err(st);
+  return R::ok(std::move(out));
+}
+
+std::string RocksDbRelationalStorage::rowKey(const TableInfo &ti,
+                                             const Row &row,
+                                             uint64_t rowId) const {
+  std::string key;
+  if (ti.pk != TableSchema::npos)
+    keycode::appendValue(key, row.values()[ti.pk].get());
+  keycode::appendU64(key, rowId);
+  return key;
+}
+
+void RocksDbRelationalStorage::addEntries(WriteBatch &batch,
+                                          const std::string &table,
+                                          const TableInfo &ti,
+                                          const std::string &key,
+                                          const Row &row) const {
+  batch.put(rowsFamily(table), key, encodeRow(row));
+  const auto &cols = ti.schema.columns();
+  for (size_t c = 0; c < cols.size(); ++c) {
+    const Value *v = row.values()[c].get();
+    if (!v)
+      continue;
+    if (cols[c].unique)
+      batch.put(uniqueFamily(table), uniqueKey(c, cols[c].type, *v), key);
+    if (ti.indexed.count(c))
+      batch.put(indexFamily(table), indexKey(c, *v, key), key);
+  }
+}
+
+void RocksDbRelationalStorage::removeEntries(WriteBatch &batch,
+                                             const std::string &table,
+                                             const TableInfo &ti,
+                                             const std::string &key,
+                                             const Row &row) const {
+  batch.erase(rowsFamily(table), key);
+  const auto &cols = ti.schema.columns();
+  for (size_t c = 0; c < cols.size(); ++c) {
+    const Value *v = row.values()[c].get();
+    if (!v)
+      continue;
+    if (cols[c].unique)
+      batch.erase(uniqueFamily(table), uniqueKey(c, cols[c].type, *v));
+    if (ti.indexed.count(c))
+      batch.erase(indexFamily(table), indexKey(c, *v, key));
+  }
+}
+
+void RocksDbRelationalStorage::putCounters(WriteBatch &batch,
+                                           const std::string &table,
+                                           uint64_t rows,
+                                           uint64_t nextRowId) const {
+  std::string v;
+  keycode::appendU64(v, rows);
+  keycode::appendU64(v, nextRowId);
+  batch.put(kCatalog, catalogKey("n/", table), std::move(v));
+}
+
+Status RocksDbRelationalStorage::clearFamilies(const std::string &table) const {
+  if (auto st = dropFamilies(*store_, {rowsFamily(table), uniqueFamily(table),
+                                       indexFamily(table)});
+      !st.ok())
+    return st;
+  return createFamilies(*store_, {rowsFamily(table), uniqueFamily(table),
+                                  indexFamily(table)});
+}
+
+Status RocksDbRelationalStorage::createTable(const std::string &table,
+                                             const TableSchema &schema) {
+  std::unique_lock lk(mtx_);
+  if (tables_.count(table))
+    return Status::AlreadyExists("Table already exists: " + table);
+  // Clear whatever a failed earlier create left behind
+  if (auto st = clearFamilies(table); !st.ok())
+    return st;
+  WriteBatch batch;
+  batch.put(kCatalog, catalogKey("t/", table),
+            encode(schema, bin::writeTableSchema));
+  putCounters(batch, table, 0, 0);
+  if (auto st = store_->write(batch); !st.ok())
+    return st;
+  TableInfo ti;
+  ti.schema = schema;
+  ti.validator = CompiledValidator(schema);
+  if (const auto &pk = schema.primaryKey())
+    ti.pk = schema.findColumn(*pk);
+  tables_.emplace(table, std::move(ti));
+  return Status::OK();
+}
+
+Status RocksDbRelationalStorage::insert(const std::string &table,
+                                        const std::vector<const Row *> &rows) {
+  std::unique_lock lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Status::NotFound("Unknown table: " + table);
+  auto &ti = it->second;
+  for (const Row *row : rows)
+    if (auto err = ti.validator.validateRow(*row); !err.empty())
+      return Status::InvalidArgument(err);
+
+  // Unique values must be new to the table and to the batch
+  const auto &cols = ti.schema.columns();
+  std::unordered_set<std::string> seen;
+  for (const Row *row : rows) {
+    for (size_t c = 0; c < cols.size(); ++c) {
+      const Value *v = row->values()[c].get();
+      if (!cols[c].unique || !v)
+        continue;
+      std::string key = uniqueKey(c, cols[c].type, *v);
+      auto owner = lookup(*store_, uniqueFamily(table), key);
+      if (!owner.hasValue())
+        return owner.status();
+      if (owner.value() || !seen.insert(std::move(key)).second)
+        return Status::FailedPrecondition(
+            "Duplicate value for unique column '" + cols[c].name + "'");
+    }
+  }
+
+  WriteBatch batch;
+  uint64_t id = ti.nextRowId;
+  for (const Row *row : rows)
+    addEntries(batch, table, ti, rowKey(ti, *row, id++), *row);
+  putCounters(batch, table, ti.rows + rows.size(), id);
+  if (auto st = store_->write(batch); !st.ok())
+    return st;
+  ti.rows += rows.size();
+  ti.nextRowId = id;
+  return Status::OK();
+}
+
+Status RocksDbRelationalStorage::insertRow(const std::string &table,
+                                           const Row &row) {
+  return insert(table, {&row});
+}
+
+Status RocksDbRelationalStorage::insertRows(const std::string &table,
+                                            const std::vector<Row> &rows) {
+  std::vector<const Row *> ptrs;
+  ptrs.reserve(rows.size());
+  for (const auto &row : rows)
+    ptrs.push_back(&row);
+  return insert(table, ptrs);
+}
+
+Result<ResultSet>
+RocksDbRelationalStorage::select(const std::string &table,
+                                 const std::vector<std::string> &columns,
+                                 const std::optional<Predicate> &where) {
+  ResultSet rs;
+  bool first = true;
+  Status st = scan(table, columns, where, [&](RowBatch &batch) {
+    if (first) {
+      rs = ResultSet(batch.columnNames, batch.columnTypes);
+      first = false;
+    }
+    for (auto &cells : batch.rows)
+      rs.addRow(ResultRow(std::move(cells)));
+    return true;
+  });
+  if (!st.ok())
+    return Result<ResultSet>::err(st);
+  return Result<ResultSet>::ok(std::move(rs));
+}
+
+Status RocksDbRelationalStorage::scan(const std::string &table,
+                                      const std::vector<std::string> &columns,
+                                      const std::optional<Predicate> &where,
+                                      const BatchSink &sink,
+                                      size_t batchRows) {
+  std::shared_lock lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Status::NotFound("Unknown table: " + table);
+  const auto &ti = it->second;
+  const auto &schemaCols = ti.schema.columns();
+
+  RowBatch batch;
+  std::vector<size_t> projIdx;
+  if (columns.empty()) {
+    for (size_t i = 0; i < schemaCols.size(); ++i) {
+      projIdx.push_back(i);
+      batch.columnNames.push_back(schemaCols[i].name);
+      batch.columnTypes.push_back(schemaCols[i].type);
+    }
+  } else {
+    for (const auto &name : columns) {
+      size_t idx = ti.schema.findColumn(name);
+      if (idx == TableSchema::npos)
+        return Status::InvalidArgument("Unknown column in projection: " +
+                                       name);
+      projIdx.push_back(idx);
+      batch.columnNames.push_back(schemaCols[idx].name);
+      batch.columnTypes.push_back(schemaCols[idx].type);
+    }
+  }
+
+  if (batchRows == 0)
+    batchRows = kDefaultBatchRows;
+  bool delivered = false, stopped = false;
+  auto flush = [&] {
+    delivered = true;
+    stopped = !sink(batch);
+    batch.rows.clear();
+    return !stopped;
+  };
+  Status st = visitRows(table, ti, where, [&](const std::string &, Row &row) {
+    if (columns.empty()) {
+      batch.rows.push_back(row.release());
+    } else {
+      // A projection may name a column twice, so copy the cells
+      std::vector<std::unique_ptr<Value>> cells;
+      cells.reserve(projIdx.size());
+      for (size_t idx : projIdx) {
+        const auto &v = row.values()[idx];
+        cells.push_back(v ? v->clone() : nullptr);
+      }
+      batch.rows.push_back(std::move(cells));
+    }
+    return batch.rows.size() < batchRows || flush();
+  });
+  if (!st.ok())
+    return st;
+  if (!stopped && (!delivered || !batch.rows.empty()))
+    flush();
+  return Status::OK();
+}
+
+std::vector<std::string> RocksDbRelationalStorage::listTables() const {
+  std::shared_lock lk(mtx_);
+  std::vector<std::string> names;
+  names.reserve(tables_.size());
+  for (const auto &kv : tables_)
+    names.push_back(kv.first);
+  return names;
+}
+
+Result<TableSchema>
+RocksDbRelationalStorage::getTableSchema(const std::string &table) {
+  std::shared_lock lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Result<TableSchema>::err(
+        Status::NotFound("Unknown table: " + table));
+  return Result<TableSchema>::ok(it->second.schema);
+}
+
+std::optional<size_t>
+RocksDbRelationalStorage::estimateRowCount(const std::string &table) const {
+  std::shared_lock lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return std::nullopt;
+  return static_cast<size_t>(it->second.rows);
+}
+
+std::string RocksDbRelationalStorage::explainAccess(
+    const std::string &table, const std::optional<Predicate> &where) const {
+  std::shared_lock lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end() || !where)
+    return "full scan";
+  auto range = accessRange(it->second, *where);
+  if (!range)
+    return "full scan";
+  const auto &name = it->second.schema.columns()[range->column].name;
+  return (range->primary ? "primary key range on " : "index range on ") +
+         name;
+}
+
+Status RocksDbRelationalStorage::dropTable(const std::string &table) {
+  std::unique_lock lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Status::NotFound("Unknown table: " + table);
+  const auto &ti = it->second;
+  WriteBatch batch;
+  batch.erase(kCatalog, catalogKey("t/", table));
+  batch.erase(kCatalog, catalogKey("n/", table));
+  for (size_t col : ti.indexed)
+    batch.erase(kCatalog,
+                catalogKey("ti/", table, ti.schema.columns()[col].name));
+  if (auto st = store_->write(batch); !st.ok())
+    return st;
+  tables_.erase(it);
+  return dropFamilies(*store_, {rowsFamily(table), uniqueFamily(table),
+                                indexFamily(table)});
+}
+
+Result<size_t>
+RocksDbRelationalStorage::deleteRows(const std::string &table,
+                                     const std::optional<Predicate> &where) {
+  std::unique_lock lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Result<size_t>::err(Status::NotFound("Unknown table: " + table));
+  auto &ti = it->second;
+
+  if (!where) {
+    const size_t n = ti.rows;
+    if (auto st = clearFamilies(table); !st.ok())
+      return Result<size_t>::err(st);
+    WriteBatch batch;
+    putCounters(batch, table, 0, ti.nextRowId);
+    if (auto st = store_->write(batch); !st.ok())
+      return Result<size_t>::err(st);
+    ti.rows = 0;
+    return Result<size_t>::ok(n);
+  }
+
+  auto found = collectRows(table, ti, where);
+  if (!found.hasValue())
+    return Result<size_t>::err(found.status());
+  const auto &matches = found.value();
+  if (matches.empty())
+    return Result<size_t>::ok(0);
+  WriteBatch batch;
+  for (const auto &m : matches)
+    removeEntries(batch, table, ti, m.first, m.second);
+  putCounters(batch, table, ti.rows - matches.size(), ti.nextRowId);
+  if (auto st = store_->write(batch); !st.ok())
+    return Result<size_t>::err(st);
+  ti.rows -= matches.size();
+  return Result<size_t>::ok(matches.size());
+}
+
+Result<size_t>
+RocksDbRelationalStorage::applyUpdates(const std::string &table,
+                                       TableInfo &ti,
+                                       const std::optional<Predicate> &where,
+                                       const RowUpdater &updater) {
+  auto found = collectRows(table, ti, where);
+  if (!found.hasValue())
+    return Result<size_t>::err(found.status());
+  const auto &matches = found.value();
+  std::vector<Row> updated;
+  updated.reserve(matches.size());
+  for (const auto &m : matches) {
+    Row row = m.second;
+    if (auto st = updater(row, ti.schema); !st.ok())
+      return Result<size_t>::err(st);
+    if (auto err = ti.validator.validateRow(row); !err.empty())
+      return Result<size_t>::err(Status::InvalidArgument(err));
+    updated.push_back(std::move(row));
+  }
+  if (matches.empty())
+    return Result<size_t>::ok(0);
+
+  // Uniqueness: a new value conflicts unless the row holding it is being
+  // rewritten (releasing its old value), or it repeats among new values
+  const auto &cols = ti.schema.columns();
+  std::unordered_set<std::string> rewritten, seen;
+  for (const auto &m : matches)
+    rewritten.insert(m.first);
+  for (const auto &row : updated) {
+    for (size_t c = 0; c < cols.size(); ++c) {
+      const Value *v = row.values()[c].get();
+      if (!cols[c].unique || !v)
+        continue;
+      std::string key = uniqueKey(c, cols[c].type, *v);
+      auto owner = lookup(*store_, uniqueFamily(table), key);
+      if (!owner.hasValue())
+        return Result<size_t>::err(owner.status());
+      if ((owner.value() && !rewritten.count(*owner.value())) ||
+          !seen.insert(std::move(key)).second)
+        return Result<size_t>::err(Status::FailedPrecondition(
+            "Duplicate value for unique column '" + cols[c].name + "'"));
+    }
+  }
+
+  // Every old entry goes before any new one is written, since a new value
+  // may be another rewritten row's old one. A changed primary key moves the
+  // row; it keeps its row id.
+  WriteBatch batch;
+  for (const auto &m : matches)
+    removeEntries(batch, table, ti, m.first, m.second);
+  for (size_t i = 0; i < matches.size(); ++i) {
+    const std::string &old = matches[i].first;
+    // A moved primary key keeps the row id
+    const uint64_t rowId = keycode::readU64(old.substr(old.size() - 8));
+    const std::string key =
+        ti.pk == TableSchema::npos ? old : rowKey(ti, updated[i], rowId);
+    addEntries(batch, table, ti, key, updated[i]);
+  }
+  if (auto st = store_->write(batch); !st.ok())
+    return Result<size_t>::err(st);
+  return Result<size_t>::ok(matches.size());
+}
+
+Result<size_t> RocksDbRelationalStorage::updateRows(
+    const std::string &table,
+    const std::unordered_map<std::string, AssignmentValue> &assignments,
+    const std::optional<Predicate> &where) {
+  std::unique_lock lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Result<size_t>::err(Status::NotFound("Unknown table: " + table));
+  auto &ti = it->second;
+  const auto &schema = ti.schema;
+
+  // Resolve assignment targets and sources once
+  struct Resolved {
+    size_t dst;
+    const AssignmentValue *av;
+    size_t src;
+  };
+  std::vector<Resolved> resolved;
+  resolved.reserve(assignments.size());
+  for (const auto &kv : assignments) {
+    size_t idx = schema.findColumn(kv.first);
+    if (idx == TableSchema::npos)
+      return Result<size_t>::err(
+          Status::InvalidArgument("Unknown assignment column: " + kv.first));
+    size_t src = TableSchema::npos;
+    if (kv.second.kind == AssignmentValue::Kind::ColumnRef) {
+      src = schema.findColumn(kv.second.column_ref);
+      if (src == TableSchema::npos)
+        return Result<size_t>::err(Status::InvalidArgument(
+            "Unknown column in assignment reference: " + kv.second.column_ref));
+    }
+    resolved.push_back(Resolved{idx, &kv.second, src});
+  }
+
+  auto updater = [&resolved](Row &r, const TableSchema &) -> Status {
+    for (const auto &a : resolved) {
+      std::unique_ptr<Value> v;
+      if (a.av->kind == AssignmentValue::Kind::Constant) {
+        v = a.av->constant ? a.av->constant->clone() : nullptr;
+      } else {
+        const auto &src = r.values()[a.src];
+        v = src ? src->clone() : nullptr;
+      }
+      r.set(a.dst, std::move(v));
+    }
+    return Status::OK();
+  };
+  return applyUpdates(table, ti, where, updater);
+}
+
+Result<size_t> RocksDbRelationalStorage::updateRowsWith(
+    const std::string &table, const RowUpdater &updater,
+    const std::optional<Predicate> &where) {
+  std::unique_lock lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Result<size_t>::err(Status::NotFound("Unknown table: " + table));
+  return applyUpdates(table, it->second, where, updater);
+}
+
+Status RocksDbRelationalStorage::updateRows(
+    const std::string &table,
+    const std::unordered_map<std::string, std::unique_ptr<Value>> &assignments,
+    const std::optional<Predicate> &where) {
+  std::unordered_map<std::string, AssignmentValue> wrapped;
+  wrapped.reserve(assignments.size());
+  for (const auto &kv : assignments) {
+    AssignmentValue av;
+    av.kind = AssignmentValue::Kind::Constant;
+    av.constant = kv.second ? kv.second->clone() : nullptr;
+    wrapped.emplace(kv.first, std::move(av));
+  }
+  auto res = updateRows(table, wrapped, where);
+  if (!res.hasValue())
+    return res.status();
+  return Status::OK();
+}
+
+Status RocksDbRelationalStorage::truncateTable(const std::string &table) {
+  auto res = deleteRows(table, std::nullopt);
+  return res.hasValue() ? Status::OK() : res.status();
+}
+
+Status RocksDbRelationalStorage::createIndex(const std::string &table,
+                                             const std::string &column,
+                                             IndexType /*type*/) {
+  std::unique_lock lk(mtx_);
+  auto it = tables_.find(table);
+  if (it == tables_.end())
+    return Status::NotFound("Unknown table: " + table);
+  auto &ti = it->second;
+  size_t idx = ti.schema.findColumn(column);
+  if (idx == TableSchema::npos)
+    return Status::InvalidArgument("Unknown column for index: " + column);
+  // The primary key is indexed by the row keys themselves
+  if (idx == ti.pk || ti.indexed.count(idx))
+    return Status::AlreadyExists("Index already exists on column: " + column);
+
+  WriteBatch batch;
+  Status st = visitRows(table, ti, std::nullopt,
+                        [&](const std::string &key, Row &row) {
+                          if (const Value *v = row.values()[idx].get())
+                            batch.put(indexFamily(table),
+                                      indexKey(idx, *v, key), key);
+                          return true;
+                        });
+  if (!st.ok())
+    return st;
+  batch.put(kCatalog, catalogKey("ti/", table, column), std::string());
+  if (auto ws = store_->write(batch); !ws.ok())
+    return ws;
+  ti.indexed.insert(idx);
+  return Status::OK();
+}
+
+// ---- RocksDbDocumentStorage ----
+
+Result<std::unique_ptr<RocksDbDocumentStorage>>
+RocksDbDocumentStorage::open(std::shared_ptr<KeyValueStore> store) {
+  using R = Result<std::unique_ptr<RocksDbDocumentStorage>>;
+  std::unique_ptr<RocksDbDocumentStorage> ds(
+      new RocksDbDocumentStorage(std::move(store)));
+  if (auto st = ds->load(); !st.ok())
+    return R::err(st);
+  return R::ok(std::move(ds));
+}
+
+Status RocksDbDocumentStorage::load() {
+  if (auto st = store_->createFamily(kCatalog); !st.ok())
+    return st;
+  auto itRes = store_->newIterator(kCatalog);
+  if (!itRes.hasValue())
+    return itRes.status();
+  auto &it = *itRes.value();
+  try {
+    for (it.seek("c/"); it.valid() && startsWith(it.key(), "c/"); it.next()) {
+      std::string_view v = it.value();
+      std::optional<DocumentSchema> schema;
+      if (!v.empty() && v[0] == '\x01')
+        schema = decode(v.substr(1), bin::readDocumentSchema);
+      collections_.emplace(std::string(it.key().substr(2)),
+                           makeCollection(std::move(schema)));
+    }
+  } catch (const SerializationError &e) {
+    return corrupt("collection schema", e);
+  }
+  for (it.seek("cn/"); it.valid() && startsWith(it.key(), "cn/"); it.next()) {
+    auto c = collections_.find(std::string(it.key().substr(3)));
+    if (c != collections_.end() && it.value().size() == 8)
+      c->second.docs = keycode::readU64(it.value());
+  }
+  for (it.seek("ci/"); it.valid() && startsWith(it.key(), "ci/"); it.next()) {
+    std::string_view rest = it.key().substr(3);
+    const size_t sep = rest.find('\0');
+    if (sep == std::string_view::npos)
+      continue;
+    auto c = collections_.find(std::string(rest.substr(0, sep)));
+    if (c != collections_.end())
+      c->second.indexed.insert(std::string(rest.substr(sep + 1)));
+  }
+  return it.status();
+}
+
+RocksDbDocumentStorage::CollectionInfo
+RocksDbDocumentStorage::makeCollection(std::optional<DocumentSchema> schema) {
+  CollectionInfo ci;
+  if (schema) {
+    ci.validator = CompiledValidator(*schema);
+    for (const auto &kv : schema->fields())
+      if (kv.second.unique)
+        ci.unique.push_back(kv.first);
+  }
+  ci.schema = std::move(schema);
+  return ci;
+}
+
+Status
+RocksDbDocumentStorage::create(const std::string &collection,
+                               const std::optional<DocumentSchema> &schema) {
+  const std::initializer_list<std::string> families = {
+      docsFamily(collection), docUniqueFamily(collection),
+      docIndexFamily(collection)};
+  // Clear whatever a failed earlier create left behind
+  if (auto st = dropFamilies(*store_, families); !st.ok())
+    return st;
+  if (auto st = createFamilies(*store_, families); !st.ok())
+    return st;
+  WriteBatch batch;
+  batch.put(kCatalog, catalogKey("c/", collection), encodeCollection(schema));
+  putCount(batch, collection, 0);
+  if (auto st = store_->write(batch); !st.ok())
+    return st;
+  collections_.emplace(collection, makeCollection(schema));
+  return Status::OK();
+}
+
+void RocksDbDocumentStorage::addEntries(WriteBatch &batch,
+                                        const std::string &collection,
+                                        const CollectionInfo &ci,
+                                        const std::string &key,
+                                        const Document &doc) const {
+  batch.put(docsFamily(collection), key, encodeDocument(doc));
+  for (const auto &field : ci.unique)
+    if (const Value *v = uniqueFieldValue(doc, field))
+      batch.put(docUniqueFamily(collection), docUniqueKey(field, *v), key);
+  for (const auto &field : ci.indexed) {
+    auto it = doc.find(field);
+    if (it != doc.end() && it->second)
+      batch.put(docIndexFamily(collection),
+                docIndexKey(field, *it->second, key), key);
+  }
+}
+
+void RocksDbDocumentStorage::removeEntries(WriteBatch &batch,
+                                           const std::string &collection,
+                                           const CollectionInfo &ci,
+                                           const std::string &key,
+                                           const Document &doc) const {
+  batch.erase(docsFamily(collection), key);
+  for (const auto &field : ci.unique)
+    if (const Value *v = uniqueFieldValue(doc, field))
+      batch.erase(docUniqueFamily(collection), docUniqueKey(field, *v));
+  for (const auto &field : ci.indexed) {
+    auto it = doc.find(field);
+    if (it != doc.end() && it->second)
+      batch.erase(docIndexFamily(collection),
+                  docIndexKey(field, *it->second, key));
+  }
+}
+
+void RocksDbDocumentStorage::putCount(WriteBatch &batch,
+                                      const std::string &collection,
+                                      uint64_t docs) const {
+  std::string v;
+  keycode::appendU64(v, docs);
+  batch.put(kCatalog, catalogKey("cn/", collection), std::move(v));
+}
+
+Status RocksDbDocumentStorage::createCollection(
+    const std::string &collection,
+    const std::optional<DocumentSchema> &schema) {
+  std::unique_lock lk(mtx_);
+  if (collections_.count(collection))
+    return Status::AlreadyExists("Collection already exists: " + collection);
+  return create(collection, schema);
+}
+
+Status RocksDbDocumentStorage::dropCollection(const std::string &collection) {
+  std::unique_lock lk(mtx_);
+  auto it = collections_.find(collection);
+  if (it == collections_.end())
+    return Status::NotFound("Unknown collection: " + collection);
+  WriteBatch batch;
+  batch.erase(kCatalog, catalogKey("c/", collection));
+  batch.erase(kCatalog, catalogKey("cn/", collection));
+  for (const auto &field : it->second.indexed)
+    batch.erase(kCatalog, catalogKey("ci/", collection, field));
+  if (auto st = store_->write(batch); !st.ok())
+    return st;
+  collections_.erase(it);
+  return dropFamilies(*store_, {docsFamily(collection),
+                                docUniqueFamily(collection),
+                                docIndexFamily(collection)});
+}
+
+std::vector<std::string> RocksDbDocumentStorage::listCollections() const {
+  std::shared_lock lk(mtx_);
+  std::vector<std::string> names;
+  names.reserve(collections_.size());
+  for (const auto &kv : collections_)
+    names.push_back(kv.first);
+  return names;
+}
+
+Status RocksDbDocumentStorage::put(const std::string &collection,
+                                   const std::string &key,
+                                   const Document &doc) {
+  std::unique_lock lk(mtx_);
+  // Create collection lazily if missing (MVP behavior)
+  auto it = collections_.find(collection);
+  if (it == collections_.end()) {
+    if (auto st = create(collection, std::nullopt); !st.ok())
+      return st;
+    it = collections_.find(collection);
+  }
+  auto &ci = it->second;
+  if (ci.schema)
+    if (auto err = ci.validator.validateDocument(doc); !err.empty())
+      return Status::InvalidArgument(err);
+
+  // A unique value already owned by the same key is allowed (the document
+  // is replaced)
+  for (const auto &field : ci.unique) {
+    const Value *v = uniqueFieldValue(doc, field);
+    if (!v)
+      continue;
+    auto owner =
+        lookup(*store_, docUniqueFamily(collection), docUniqueKey(field, *v));
+    if (!owner.hasValue())
+      return owner.status();
+    if (owner.value() && *owner.value() != key)
+      return Status::FailedPrecondition("Duplicate value for unique field '" +
+                                        field + "'");
+  }
+
+  auto old = lookup(*store_, docsFamily(collection), key);
+  if (!old.hasValue())
+    return old.status();
+  WriteBatch batch;
+  if (old.value()) {
+    try {
+      removeEntries(batch, collection, ci, key,
+                    decodeDocument(*old.value()));
+    } catch (const SerializationError &e) {
+      return corrupt("document " + key, e);
+    }
+  } else {
+    putCount(batch, collection, ci.docs + 1);
+  }
+  addEntries(batch, collection, ci, key, doc);
+  if (auto st = store_->write(batch); !st.ok())
+    return st;
+  if (!old.value())
+    ++ci.docs;
+  return Status::OK();
+}
+
+Result<Document> RocksDbDocumentStorage::get(const std::string &collection,
+                                             const std::string &key) {
+  std::shared_lock lk(mtx_);
+  if (!collections_.count(collection))
+    return Result<Document>::err(Status::NotFound("Unknown collection"));
+  auto data = store_->get(docsFamily(collection), key);
+  if (!data.hasValue()) {
+    if (data.status().code() == StatusCode::NotFound)
+      return Result<Document>::err(Status::NotFound("Key not found"));
+    return Result<Document>::err(data.status());
+  }
+  try {
+    return Result<Document>::ok(decodeDocument(data.value()));
+  } catch (const SerializationError &e) {
+    return Result<Document>::err(corrupt("document " + key, e));
+  }
+}
+
+Status RocksDbDocumentStorage::erase(const std::string &collection,
+                                     const std::string &key) {
+  std::unique_lock lk(mtx_);
+  auto it = collections_.find(collection);
+  if (it == collections_.end())
+    return Status::NotFound("Unknown collection: " + collection);
+  auto &ci = it->second;
+  auto old = lookup(*store_, docsFamily(collection), key);
+  if (!old.hasValue())
+    return old.status();
+  if (!old.value())
+    return Status::NotFound("Key not found: " + key);
+  WriteBatch batch;
+  try {
+    removeEntries(batch, collection, ci, key, decodeDocument(*old.value()));
+  } catch (const SerializationError &e) {
+    return corrupt("document " + key, e);
+  }
+  putCount(batch, collection, ci.docs - 1);
+  if (auto st = store_->write(batch); !st.ok())
+    return st;
+  --ci.docs;
+  return Status::OK();
+}
+
+Result<size_t>
+RocksDbDocumentStorage::count(const std::string &collection) const {
+  std::shared_lock lk(mtx_);
+  auto it = collections_.find(collection);
+  if (it == collections_.end())
+    return Result<size_t>::err(Status::NotFound("Unknown collection"));
+  return Result<size_t>::ok(static_cast<size_t>(it->second.docs));
+}
+
+Result<std::optional<DocumentSchema>>
+RocksDbDocumentStorage::getCollectionSchema(
+    const std::string &collection) const {
+  using R = Result<std::optional<DocumentSchema>>;
+  std::shared_lock lk(mtx_);
+  auto it = collections_.find(collection);
+  if (it == collections_.end())
+    return R::err(Status::NotFound("Unknown collection: " + collection));
+  return R::ok(it->second.schema);
+}
+
+Result<std::vector<std::pair<std::string, Document>>>
+RocksDbDocumentStorage::query(const std::string &collection,
+                              const std::vector<std::string> &fields,
+                              const std::optional<DocPredicate> &where) {
+  using R = Result<std::vector<std::pair<std::string, Document>>>;
+  std::vector<std::pair<std::string, Document>> out;
+  Status st = queryVisit(collection, fields, where,
+                         [&](const std::string &key, const DocumentView &doc) {
+                           out.emplace_back(key, doc.toDocument());
+                           return true;
+                         });
+  if (!st.ok())
+    return R::err(st);
+  return R::ok(std::move(out));
+}
+
+Status RocksDbDocumentStorage::queryVisit(
+    const std::string &collection, const std::vector<std::string> &fields,
+    const std::optional<DocPredicate> &where, const DocumentVisitor &fn) {
+  std::shared_lock lk(mtx_);
+  auto cit = collections_.find(collection);
+  if (cit == collections_.end())
+    return Status::NotFound("Unknown collection");
+  const auto &ci = cit->second;
+  if (auto st = validateDocumentQuery(ci.schema, fields, where); !st.ok())
+    return st;
+
+  auto visit = [&](const std::string &key, std::string_view data) {
+    Document doc = decodeDocument(data);
+    if (where && !matchesDocument(doc, *where))
+      return true;
+    return fn(key, DocumentView(doc, &fields));
+  };
+
+  try {
+    // The first indexed field the predicate bounds answers it
+    if (where) {
+      for (const auto &field : ci.indexed) {
+        std::string lo, hi;
+        if (!narrowDocuments(*where, field, lo, hi))
+          continue;
+        std::string prefix;
+        keycode::appendString(prefix, field);
+        hi = hi.empty() ? keycode::prefixEnd(prefix) : prefix + hi;
+        auto itRes = store_->newIterator(docIndexFamily(collection));
+        if (!itRes.hasValue())
+          return itRes.status();
+        auto &it = *itRes.value();
+        for (it.seek(prefix + lo); it.valid() && it.key() < hi; it.next()) {
+          const std::string key(it.value());
+          auto data = store_->get(docsFamily(collection), key);
+          if (!data.hasValue())
+            return Status::Internal("Index entry without a document in " +
+                                    collection);
+          if (!visit(key, data.value()))
+            break;
+        }
+        return it.status();
+      }
+    }
+
+    auto itRes = store_->newIterator(docsFamily(collection));
+    if (!itRes.hasValue())
+      return itRes.status();
+    auto &it = *itRes.value();
+    for (it.seek(std::string()); it.valid(); it.next())
+      if (!visit(std::string(it.key()), it.value()))
+        break;
+    return it.status();
+  } catch (const SerializationError &e) {
+    return corrupt("document in " + collection, e);
+  }
+}
+
+Status RocksDbDocumentStorage::createIndex(const std::string &collection,
+                                           const std::string &field,
+                                           IndexType /*type*/) {
+  std::unique_lock lk(mtx_);
+  auto it = collections_.find(collection);
+  if (it == collections_.end())
+    return Status::NotFound("Unknown collection: " + collection);
+  auto &ci = it->second;
+  if (ci.schema && !ci.schema->hasField(field))
+    return Status::InvalidArgument("Unknown field for index: " + field);
+  if (ci.indexed.count(field))
+    return Status::AlreadyExists("Index already exists on field: " + field);
+
+  WriteBatch batch;
+  auto itRes = store_->newIterator(docsFamily(collection));
+  if (!itRes.hasValue())
+    return itRes.status();
+  auto &docs = *itRes.value();
+  try {
+    for (docs.seek(std::string()); docs.valid(); docs.next()) {
+      Document doc = decodeDocument(docs.value());
+      auto f = doc.find(field);
+      if (f != doc.end() && f->second) {
+        const std::string key(docs.key());
+        batch.put(docIndexFamily(collection),
+                  docIndexKey(field, *f->second, key), key);
+      }
+    }
+  } catch (const SerializationError &e) {
+    return corrupt("document in " + collection, e);
+  }
+  if (auto st = docs.status(); !st.ok())
+    return st;
+  batch.put(kCatalog, catalogKey("ci/", collection, field), std::string());
+  if (auto st = store_->write(batch); !st.ok())
+    return st;
+  ci.indexed.insert(field);
+  return Status::OK();
+}
+
+} // namespace kadedb
@@ -0,0 +1,363 @@
+#include "kadedb/scan_kernels.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define KADEDB_SCAN_AVX2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define KADEDB_SCAN_NEON 1
+#endif
+
+namespace kadedb {
+namespace scan {
+namespace {
+
+// Three-way comparison as in compareNumeric(): unordered (NaN) compares equal
+template <typename T, typename U> inline int cmp3(T a, U b) {
+  return (a < b) ? -1 : (a > b ? 1 : 0);
+}
+
+template <CompareOp Op> inline bool test(int c) {
+  switch (Op) {
+  case CompareOp::Eq:
+    return c == 0;
+  case CompareOp::Ne:
+    return c != 0;
+  case CompareOp::Lt:
+    return c < 0;
+  case CompareOp::Le:
+    return c <= 0;
+  case CompareOp::Gt:
+    return c > 0;
+  case CompareOp::Ge:
+    return c >= 0;
+  }
+  return false;
+}
+
+// Scalar bits for the rows of word `base / 64` that are below n
+template <CompareOp Op, typename T, typename U>
+inline uint64_t scalarWord(const T *d, size_t base, size_t n, U rhs) {
+  uint64_t bits = 0;
+  for (size_t j = 0; base + j < n && j < 64; ++j)
+    bits |= uint64_t{test<Op>(cmp3(d[base + j], rhs))} << j;
+  return bits;
+}
+
+#if defined(KADEDB_SCAN_AVX2)
+
+template <CompareOp Op>
+inline uint64_t int64Word(const int64_t *d, __m256i r) {
+  uint64_t bits = 0;
+  for (int k = 0; k < 16; ++k) {
+    __m256i a =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(d + 4 * k));
+    __m256i m;
+    if (Op == CompareOp::Eq || Op == CompareOp::Ne)
+      m = _mm256_cmpeq_epi64(a, r);
+    else if (Op == CompareOp::Gt || Op == CompareOp::Le)
+      m = _mm256_cmpgt_epi64(a, r);
+    else
+      m = _mm256_cmpgt_epi64(r, a);
+    bits |= static_cast<uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(m)))
+            << (4 * k);
+  }
+  if (Op == CompareOp::Ne || Op == CompareOp::Le || Op == CompareOp::Ge)
+    bits = ~bits;
+  return bits;
+}
+
+// Unordered predicates (_UQ) make NaN compare equal, as compareNumeric does
+template <CompareOp Op> constexpr int avxPredicate() {
+  switch (Op) {
+  case CompareOp::Eq:
+    return _CMP_EQ_UQ;
+  case CompareOp::Ne:
+    return _CMP_NEQ_OQ;
+  case CompareOp::Lt:
+    return _CMP_LT_OQ;
+  case CompareOp::Le:
+    return _CMP_NGT_UQ;
+  case CompareOp::Gt:
+    return _CMP_GT_OQ;
+  case CompareOp::Ge:
+    return _CMP_NLT_UQ;
+  }
+  return _CMP_FALSE_OQ;
+}
+
+template <CompareOp Op>
+inline uint64_t doubleWord(const double *d, __m256d r) {
+  uint64_t bits = 0;
+  for (int k = 0; k < 16; ++k) {
+    __m256d m =
+        _mm256_cmp_pd(_mm256_loadu_pd(d + 4 * k), r, avxPredicate<Op>());
+    bits |= static_cast<uint64_t>(_mm256_movemask_pd(m)) << (4 * k);
+  }
+  return bits;
+}
+
+#elif defined(KADEDB_SCAN_NEON)
+
+inline uint64_t laneBits(uint64x2_t m) {
+  return (vgetq_lane_u64(m, 0) & 1u) | ((vgetq_lane_u64(m, 1) & 1u) << 1);
+}
+
+template <CompareOp Op>
+inline uint64_t int64Word(const int64_t *d, int64x2_t r) {
+  uint64_t bits = 0;
+  for (int k = 0; k < 32; ++k) {
+    int64x2_t a = vld1q_s64(d + 2 * k);
+    uint64x2_t m;
+    if (Op == CompareOp::Eq || Op == CompareOp::Ne)
+      m = vceqq_s64(a, r);
+    else if (Op == CompareOp::Gt || Op == CompareOp::Le)
+      m = vcgtq_s64(a, r);
+    else
+      m = vcltq_s64(a, r);
+    bits |= laneBits(m) << (2 * k);
+  }
+  if (Op == CompareOp::Ne || Op == CompareOp::Le || Op == CompareOp::Ge)
+    bits = ~bits;
+  return bits;
+}
+
+// Ordered lt/gt are false for NaN, so Eq/Le/Ge are taken as their negations
+template <CompareOp Op>
+inline uint64_t doubleWord(const double *d, float64x2_t r) {
+  uint64_t bits = 0;
+  for (int k = 0; k < 32; ++k) {
+    float64x2_t a = vld1q_f64(d + 2 * k);
+    uint64x2_t m;
+    if (Op == CompareOp::Eq || Op == CompareOp::Ne)
+      m = vorrq_u64(vcltq_f64(a, r), vcgtq_f64(a, r));
+    else if (Op == CompareOp::Gt || Op == CompareOp::Le)
+      m = vcgtq_f64(a, r);
+    else
+      m = vcltq_f64(a, r);
+    bits |= laneBits(m) << (2 * k);
+  }
+  if (Op == CompareOp::Eq || Op == CompareOp::Le || Op == CompareOp::Ge)
+    bits = ~bits;
+  return bits;
+}
+
+#endif
+
+template <CompareOp Op>
+void int64Kernel(const int64_t *d, size_t n, int64_t rhs, uint64_t *out) {
+  size_t w = 0;
+#if defined(KADEDB_SCAN_AVX2)
+  const __m256i r = _mm256_set1_epi64x(rhs);
+  for (; w < n / 64; ++w)
+    out[w] = int64Word<Op>(d + w * 64, r);
+#elif defined(KADEDB_SCAN_NEON)
+  const int64x2_t r = vdupq_n_s64(rhs);
+  for (; w < n / 64; ++w)
+    out[w] = int64Word<Op>(d + w * 64, r);
+#endif
+  for (; w < (n + 63) / 64; ++w)
+    out[w] = scalarWord<Op>(d, w * 64, n, rhs);
+}
+
+template <CompareOp Op>
+void doubleKernel(const double *d, size_t n, double rhs, uint64_t *out) {
+  size_t w = 0;
+#if defined(KADEDB_SCAN_AVX2)
+  const __m256d r = _mm256_set1_pd(rhs);
+  for (; w < n / 64; ++w)
+    out[w] = doubleWord<Op>(d + w * 64, r);
+#elif defined(KADEDB_SCAN_NEON)
+  const float64x2_t r = vdupq_n_f64(rhs);
+  for (; w < n / 64; ++w)
+    out[w] = doubleWord<Op>(d + w * 64, r);
+#endif
+  for (; w < (n + 63) / 64; ++w)
+    out[w] = scalarWord<Op>(d, w * 64, n, rhs);
+}
+
+template <CompareOp Op>
+void int64AsDoubleKernel(const int64_t *d, size_t n, double rhs,
+                         uint64_t *out) {
+  for (size_t w = 0; w < (n + 63) / 64; ++w) {
+    uint64_t bits = 0;
+    for (size_t j = 0; w * 64 + j < n && j < 64; ++j)
+      bits |= uint64_t{test<Op>(
+                  cmp3(static_cast<double>(d[w * 64 + j]), rhs))}
+              << j;
+    out[w] = bits;
+  }
+}
+
+// Fold the values d[0, n) into `b`, all of them valid
+inline void reduceValues(const double *d, size_t n, BucketAggregate &b) {
+  size_t i = 0;
+  double sum = 0.0, lo = b.min, hi = b.max;
+#if defined(KADEDB_SCAN_AVX2)
+  if (n >= 8) {
+    // min/max return their second operand when the first is NaN
+    __m256d s = _mm256_setzero_pd();
+    __m256d vlo = _mm256_set1_pd(lo), vhi = _mm256_set1_pd(hi);
+    for (; i + 4 <= n; i += 4) {
+      const __m256d x = _mm256_loadu_pd(d + i);
+      s = _mm256_add_pd(s, x);
+      vlo = _mm256_min_pd(x, vlo);
+      vhi = _mm256_max_pd(x, vhi);
+    }
+    alignas(32) double ls[4], ll[4], lh[4];
+    _mm256_store_pd(ls, s);
+    _mm256_store_pd(ll, vlo);
+    _mm256_store_pd(lh, vhi);
+    for (int k = 0; k < 4; ++k) {
+      sum += ls[k];
+      lo = std::min(lo, ll[k]);
+      hi = std::max(hi, lh[k]);
+    }
+  }
+#elif defined(KADEDB_SCAN_NEON)
+  if (n >= 4) {
+    // minnm/maxnm return the number when one operand is NaN
+    float64x2_t s = vdupq_n_f64(0.0);
+    float64x2_t vlo = vdupq_n_f64(lo), vhi = vdupq_n_f64(hi);
+    for (; i + 2 <= n; i += 2) {
+      const float64x2_t x = vld1q_f64(d + i);
+      s = vaddq_f64(s, x);
+      vlo = vminnmq_f64(vlo, x);
+      vhi = vmaxnmq_f64(vhi, x);
+    }
+    sum += vgetq_lane_f64(s, 0) + vgetq_lane_f64(s, 1);
+    lo = std::min({lo, vgetq_lane_f64(vlo, 0), vgetq_lane_f64(vlo, 1)});
+    hi = std::max({hi, vgetq_lane_f64(vhi, 0), vgetq_lane_f64(vhi, 1)});
+  }
+#endif
+  for (; i < n; ++i) {
+    sum += d[i];
+    if (d[i] < lo)
+      lo = d[i];
+    if (d[i] > hi)
+      hi = d[i];
+  }
+  b.sum += sum;
+  b.min = lo;
+  b.max = hi;
+  b.values += static_cast<int64_t>(n);
+}
+
+inline bool validAt(const uint64_t *validity, size_t i) {
+  return (validity[i / 64] >> (i % 64)) & 1u;
+}
+
+// True when rows [from, to) are all valid
+inline bool allValid(const uint64_t *validity, size_t from, size_t to) {
+  if (!validity)
+    return true;
+  for (size_t i = from; i < to;) {
+    if (i % 64 == 0 && i + 64 <= to) {
+      if (validity[i / 64] != ~uint64_t{0})
+        return false;
+      i += 64;
+    } else if (!validAt(validity, i++)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+void bucketAggregate(const int64_t *timestamps, const double *values,
+                     const uint64_t *validity, size_t n, int64_t origin,
+                     int64_t width, std::vector<BucketAggregate> &out) {
+  size_t i = 0;
+  while (i < n) {
+    const int64_t offset = timestamps[i] - origin;
+    int64_t q = offset / width;
+    if (offset % width != 0 && offset < 0)
+      --q;
+    BucketAggregate b;
+    b.bucketStart = origin + q * width;
+    // The bucket's rows end at the first timestamp past it
+    const size_t end =
+        b.bucketStart > INT64_MAX - width
+            ? n
+            : static_cast<size_t>(std::lower_bound(timestamps + i,
+                                                   timestamps + n,
+                                                   b.bucketStart + width) -
+                                  timestamps);
+    b.rows = static_cast<int64_t>(end - i);
+    if (values && allValid(validity, i, end)) {
+      reduceValues(values + i, end - i, b);
+    } else if (values) {
+      for (size_t j = i; j < end; ++j)
+        if (validAt(validity, j))
+          reduceValues(values + j, 1, b);
+    }
+    out.push_back(b);
+    i = end;
+  }
+}
+
+#define KADEDB_SCAN_DISPATCH(kernel, ...)                                      \
+  switch (op) {                                                                \
+  case CompareOp::Eq:                                                          \
+    return kernel<CompareOp::Eq>(__VA_ARGS__);                                 \
+  case CompareOp::Ne:                                                          \
+    return kernel<CompareOp::Ne>(__VA_ARGS__);                                 \
+  case CompareOp::Lt:                                                          \
+    return kernel<CompareOp::Lt>(__VA_ARGS__);                                 \
+  case CompareOp::Le:                                                          \
+    return kernel<CompareOp::Le>(__VA_ARGS__);                                 \
+  case CompareOp::Gt:                                                          \
+    return kernel<CompareOp::Gt>(__VA_ARGS__);                                 \
+  case CompareOp::Ge:                                                          \
+    return kernel<CompareOp::Ge>(__VA_ARGS__);                                 \
+  }
+
+void compareInt64(const int64_t *data, size_t n, CompareOp op, int64_t rhs,
+                  uint64_t *out) {
+  KADEDB_SCAN_DISPATCH(int64Kernel, data, n, rhs, out)
+}
+
+void compareDouble(const double *data, size_t n, CompareOp op, double rhs,
+                   uint64_t *out) {
+  KADEDB_SCAN_DISPATCH(doubleKernel, data, n, rhs, out)
+}
+
+void compareInt64AsDouble(const int64_t *data, size_t n, CompareOp op,
+                          double rhs, uint64_t *out) {
+  KADEDB_SCAN_DISPATCH(int64AsDoubleKernel, data, n, rhs, out)
+}
+
+#undef KADEDB_SCAN_DISPATCH
+
+void lookupCodes(const uint32_t *codes, size_t n, const uint8_t *hits,
+                 uint64_t *out) {
+  const size_t full = n / 64;
+  for (size_t w = 0; w < full; ++w) {
+    uint64_t word = 0;
+    for (unsigned b = 0; b < 64; ++b)
+      word |= uint64_t{hits[codes[w * 64 + b]]} << b;
+    out[w] = word;
+  }
+  if (n % 64) {
+    uint64_t word = 0;
+    for (size_t b = 0; b < n % 64; ++b)
+      word |= uint64_t{hits[codes[full * 64 + b]]} << b;
+    out[full] = word;
+  }
+}
+
+const char *kernelIsa() {
+#if defined(KADEDB_SCAN_AVX2)
+  return "avx2";
+#elif defined(KADEDB_SCAN_NEON)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
+
+} // namespace scan
+} // namespace kadedb
@@ -1,6 +1,8 @@
 #include "kadedb/schema.h"
 
+#include <limits>
 #include <stdexcept>
+#include <string_view>
 #include <unordered_map>
 
 namespace kadedb {
@@ -112,7 +114,24 @@ Row &Row::operator=(const Row &other) {
 
 Row Row::clone() const { return Row(*this); }
 
-bool SchemaValidator::valueMatches(ColumnType ct, const Value &v) {
+namespace {
+// Cell access shared by Row and InlineRow (nullptr => absent cell)
+inline const Value *cellOf(const Row &row, size_t i) {
+  return row.values()[i].get();
+}
+inline const InlineValue *cellOf(const InlineRow &row, size_t i) {
+  const InlineValue &v = row.values()[i];
+  return v.empty() ? nullptr : &v;
+}
+
+inline std::string_view stringOf(const Value &v) {
+  return static_cast<const StringValue &>(v).asString();
+}
+inline std::string_view stringOf(const InlineValue &v) {
+  return std::string_view(v.stringData(), v.stringSize());
+}
+
+template <typename V> bool valueMatchesImpl(ColumnType ct, const V &v) {
   switch (ct) {
   case ColumnType::Null:
     return v.type() == ValueType::Null;
@@ -128,14 +147,14 @@ bool SchemaValidator::valueMatches(ColumnType ct, const Value &v) {
   return false;
 }
 
-bool SchemaValidator::checkConstraints(const Column &col, const Value &v,
-                                       std::string &err) {
+template <typename V>
+bool checkConstraintsImpl(const Column &col, const V &v, std::string &err) {
   // Type-specific richer constraints
   switch (col.type) {
   case ColumnType::String: {
     if (v.type() != ValueType::String)
       return true; // type mismatch handled elsewhere
-    const auto &s = static_cast<const StringValue &>(v).asString();
+    std::string_view s = stringOf(v);
     if (col.constraints.minLength && s.size() < *col.constraints.minLength) {
       err = "String shorter than minLength for '" + col.name + "'";
       return false;
@@ -162,10 +181,8 @@ bool SchemaValidator::checkConstraints(const Column &col, const Value &v,
   case ColumnType::Integer:
   case ColumnType::Float: {
     double d = 0.0;
-    if (v.type() == ValueType::Integer)
-      d = static_cast<const IntegerValue &>(v).asFloat();
-    else if (v.type() == ValueType::Float)
-      d = static_cast<const FloatValue &>(v).asFloat();
+    if (v.type() == ValueType::Integer || v.type() == ValueType::Float)
+      d = v.asFloat();
     else
       return true; // type mismatch handled elsewhere
     if (col.constraints.minValue && d < *col.constraints.minValue) {
@@ -186,32 +203,102 @@ bool SchemaValidator::checkConstraints(const Column &col, const Value &v,
   return true;
 }
 
-std::string SchemaValidator::validateRow(const TableSchema &schema,
-                                         const Row &row) {
+template <typename RowT>
+std::string validateRowImpl(const TableSchema &schema, const RowT &row) {
   const auto &cols = schema.columns();
   if (row.size() != cols.size()) {
     return "Row size does not match schema column count";
   }
   for (size_t i = 0; i < cols.size(); ++i) {
     const auto &col = cols[i];
-    const auto &val = row.values()[i];
+    const auto *val = cellOf(row, i);
     if (!val) {
       if (!col.nullable) {
         return "Non-nullable column '" + col.name + "' has null value";
       }
       continue;
     }
-    if (!valueMatches(col.type, *val)) {
+    if (!valueMatchesImpl(col.type, *val)) {
       return "Value type does not match column '" + col.name + "'";
     }
     std::string err;
-    if (!checkConstraints(col, *val, err)) {
+    if (!checkConstraintsImpl(col, *val, err)) {
       return err;
     }
   }
   return {};
 }
 
+template <typename RowT>
+std::string validateUniqueImpl(const TableSchema &schema,
+                               const std::vector<RowT> &rows,
+                               bool ignoreNulls) {
+  std::vector<size_t> uniqueIdx;
+  uniqueIdx.reserve(schema.columns().size());
+  for (size_t i = 0; i < schema.columns().size(); ++i) {
+    if (schema.columns()[i].unique)
+      uniqueIdx.push_back(i);
+  }
+  if (uniqueIdx.empty())
+    return {};
+
+  std::vector<std::unordered_map<std::string, size_t>> seen(uniqueIdx.size());
+  for (size_t r = 0; r < rows.size(); ++r) {
+    const RowT &row = rows[r];
+    for (size_t ui = 0; ui < uniqueIdx.size(); ++ui) {
+      size_t idx = uniqueIdx[ui];
+      const auto *valPtr = cellOf(row, idx);
+      if (!valPtr) {
+        if (ignoreNulls)
+          continue;
+        auto [it, inserted] = seen[ui].emplace("<null>", r);
+        if (!inserted) {
+          return "Duplicate value for unique column '" +
+                 schema.columns()[idx].name + "'";
+        }
+        continue;
+      }
+      std::string key = valPtr->toString();
+      auto [it, inserted] = seen[ui].emplace(std::move(key), r);
+      if (!inserted) {
+        return "Duplicate value for unique column '" +
+               schema.columns()[idx].name + "'";
+      }
+    }
+  }
+  return {};
+}
+} // namespace
+
+bool SchemaValidator::valueMatches(ColumnType ct, const Value &v) {
+  return valueMatchesImpl(ct, v);
+}
+
+bool SchemaValidator::valueMatches(ColumnType ct, const InlineValue &v) {
+  return valueMatchesImpl(ct, v);
+}
+
+bool SchemaValidator::checkConstraints(const Column &col, const Value &v,
+                                       std::string &err) {
+  return checkConstraintsImpl(col, v, err);
+}
+
+bool SchemaValidator::checkConstraints(const Column &col,
+                                       const InlineValue &v,
+                                       std::string &err) {
+  return checkConstraintsImpl(col, v, err);
+}
+
+std::string SchemaValidator::validateRow(const TableSchema &schema,
+                                         const Row &row) {
+  return validateRowImpl(schema, row);
+}
+
+std::string SchemaValidator::validateRow(const TableSchema &schema,
+                                         const InlineRow &row) {
+  return validateRowImpl(schema, row);
+}
+
 std::string
 SchemaValidator::validateUnique(const DocumentSchema &schema,
                                 const std::vector<const Document *> &docs,
@@ -289,6 +376,23 @@ Row RowShallow::toRowDeep() const {
   return r;
 }
 
+// ----- InlineRow helpers -----
+InlineRow InlineRow::fromRow(const Row &r) {
+  InlineRow out(r.size());
+  for (size_t i = 0; i < r.size(); ++i)
+    out.values_[i] = InlineValue::fromValue(r.values()[i].get());
+  return out;
+}
+
+Row InlineRow::toRow() const {
+  Row r(values_.size());
+  for (size_t i = 0; i < values_.size(); ++i) {
+    if (!values_[i].empty())
+      r.set(i, values_[i].toValue());
+  }
+  return r;
+}
+
 // DocumentSchema methods
 void DocumentSchema::addField(Column field) {
   fields_[field.name] = std::move(field);
@@ -338,45 +442,168 @@ std::string SchemaValidator::validateDocument(const DocumentSchema &schema,
   return {};
 }
 
-std::string SchemaValidator::validateUnique(const TableSchema &schema,
-                                            const std::vector<Row> &rows,
-                                            bool ignoreNulls) {
-  std::vector<size_t> uniqueIdx;
-  uniqueIdx.reserve(schema.columns().size());
-  for (size_t i = 0; i < schema.columns().size(); ++i) {
-    if (schema.columns()[i].unique)
-      uniqueIdx.push_back(i);
+// ----- CompiledValidator -----
+// `field` names the column or field in presence and type messages; the
+// constraint messages name col.name, as checkConstraints() does
+CompiledValidator::Check CompiledValidator::compile(const Column &col,
+                                                    const std::string &field,
+                                                    bool document) {
+  Check c;
+  c.field = field;
+  c.type = col.type;
+  c.nullable = col.nullable;
+  const auto &k = col.constraints;
+  const std::string what = document ? "field '" : "column '";
+  c.missingError = "Missing required field '" + field + "'";
+  c.nullError = "Non-nullable " + what + field + "' has null value";
+  c.typeError = "Value type does not match " + what + field + "'";
+  const std::string name = col.name + "'";
+  switch (col.type) {
+  case ColumnType::String:
+    c.length = k.minLength || k.maxLength;
+    c.minLength = k.minLength.value_or(0);
+    c.maxLength = k.maxLength.value_or(static_cast<size_t>(-1));
+    c.shortError = "String shorter than minLength for '" + name;
+    c.longError = "String longer than maxLength for '" + name;
+    if (!k.oneOf.empty()) {
+      auto set = std::make_shared<StringSet>();
+      set->values = k.oneOf; // not resized after this: views stay valid
+      set->set.reserve(set->values.size());
+      for (const auto &v : set->values)
+        set->set.insert(v);
+      c.oneOf = std::move(set);
+      c.oneOfError = "Value not in allowed set for '" + name;
+    }
+    break;
+  case ColumnType::Integer:
+  case ColumnType::Float:
+    c.range = k.minValue || k.maxValue;
+    c.minValue = k.minValue.value_or(-std::numeric_limits<double>::infinity());
+    c.maxValue = k.maxValue.value_or(std::numeric_limits<double>::infinity());
+    c.belowError = "Numeric value below minValue for '" + name;
+    c.aboveError = "Numeric value above maxValue for '" + name;
+    break;
+  case ColumnType::Null:
+  case ColumnType::Boolean:
+    break;
   }
-  if (uniqueIdx.empty())
+  return c;
+}
+
+CompiledValidator::CompiledValidator(const TableSchema &schema)
+    : columnCount_(schema.columns().size()), compiled_(true) {
+  checks_.reserve(columnCount_);
+  for (size_t i = 0; i < columnCount_; ++i) {
+    const Column &col = schema.columns()[i];
+    checks_.push_back(compile(col, col.name, false));
+    checks_.back().column = i;
+  }
+}
+
+CompiledValidator::CompiledValidator(const DocumentSchema &schema)
+    : compiled_(true) {
+  // In the schema's iteration order, so the first error matches
+  checks_.reserve(schema.fields().size());
+  for (const auto &kv : schema.fields()) {
+    checks_.push_back(compile(kv.second, kv.first, true));
+  }
+}
+
+template <typename V>
+std::string CompiledValidator::check(const Check &c, const V &v) {
+  if (!valueMatchesImpl(c.type, v))
+    return c.typeError;
+  if (c.length || c.oneOf) {
+    std::string_view s = stringOf(v);
+    if (s.size() < c.minLength)
+      return c.shortError;
+    if (s.size() > c.maxLength)
+      return c.longError;
+    if (c.oneOf && !c.oneOf->set.count(s))
+      return c.oneOfError;
+  } else if (c.range) {
+    const double d = v.asFloat();
+    if (d < c.minValue)
+      return c.belowError;
+    if (d > c.maxValue)
+      return c.aboveError;
+  }
+  return {};
+}
+
+template <typename RowT>
+std::string CompiledValidator::validateRowImpl(const RowT &row) const {
+  if (!compiled_)
     return {};
+  if (row.size() != columnCount_)
+    return "Row size does not match schema column count";
+  for (const Check &c : checks_) {
+    const auto *val = cellOf(row, c.column);
+    if (!val) {
+      if (!c.nullable)
+        return c.nullError;
+      continue;
+    }
+    if (auto err = check(c, *val); !err.empty())
+      return err;
+  }
+  return {};
+}
 
-  std::vector<std::unordered_map<std::string, size_t>> seen(uniqueIdx.size());
-  for (size_t r = 0; r < rows.size(); ++r) {
-    const Row &row = rows[r];
-    for (size_t ui = 0; ui < uniqueIdx.size(); ++ui) {
-      size_t idx = uniqueIdx[ui];
-      const auto &valPtr = row.values()[idx];
-      if (!valPtr) {
-        if (ignoreNulls)
-          continue;
-        auto [it, inserted] = seen[ui].emplace("<null>", r);
-        if (!inserted) {
-          return "Duplicate value for unique column '" +
-                 schema.columns()[idx].name + "'";
-        }
-        continue;
-      }
-      std::string key = valPtr->toString();
-      auto [it, inserted] = seen[ui].emplace(std::move(key), r);
-      if (!inserted) {
-        return "Duplicate value for unique column '" +
-               schema.columns()[idx].name + "'";
-      }
+std::string CompiledValidator::validateRow(const Row &row) const {
+  return validateRowImpl(row);
+}
+
+std::string CompiledValidator::validateRow(const InlineRow &row) const {
+  return validateRowImpl(row);
+}
+
+std::string CompiledValidator::validateDocument(const Document &doc) const {
+  for (const Check &c : checks_) {
+    auto it = doc.find(c.field);
+    if (it == doc.end()) {
+      if (!c.nullable)
+        return c.missingError;
+      continue;
     }
+    if (!it->second) {
+      if (!c.nullable)
+        return c.nullError;
+      continue;
+    }
+    if (auto err = check(c, *it->second); !err.empty())
+      return err;
+  }
+  return {};
+}
+
+std::string CompiledValidator::validateField(const std::string &field,
+                                             const Value *v,
+                                             bool present) const {
+  for (const Check &c : checks_) {
+    if (c.field != field)
+      continue;
+    if (!present)
+      return c.nullable ? std::string() : c.missingError;
+    if (!v)
+      return c.nullable ? std::string() : c.nullError;
+    return check(c, *v);
   }
   return {};
 }
 
+std::string SchemaValidator::validateUnique(const TableSchema &schema,
+                                            const std::vector<Row> &rows,
+                                            bool ignoreNulls) {
+  return validateUniqueImpl(schema, rows, ignoreNulls);
+}
+
+std::string SchemaValidator::validateUnique(const TableSchema &schema,
+                                            const std::vector<InlineRow> &rows,
+                                            bool ignoreNulls) {
+  return validateUniqueImpl(schema, rows, ignoreNulls);
+}
+
 std::string SchemaValidator::validateUnique(const DocumentSchema &schema,
                                             const std::vector<Document> &docs,
                                             bool ignoreNulls) {
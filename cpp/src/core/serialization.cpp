@@ -1,6 +1,11 @@
 #include "kadedb/serialization.h"
 
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <limits>
 #include <sstream>
 
 namespace kadedb {
@@ -58,25 +63,80 @@ inline std::string readString(std::istream &is) {
   return s;
 }
 
+// LEB128 varints, with zigzag mapping for signed values so that small
+// magnitudes of either sign take few bytes
+inline void writeVarint(std::ostream &os, uint64_t v) {
+  char buf[10];
+  size_t n = 0;
+  for (; v >= 0x80; v >>= 7)
+    buf[n++] = static_cast<char>(v | 0x80);
+  buf[n++] = static_cast<char>(v);
+  os.write(buf, static_cast<std::streamsize>(n));
+}
+inline uint64_t readVarint(std::istream &is) {
+  uint64_t v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    const uint8_t b = readU8(is);
+    v |= static_cast<uint64_t>(b & 0x7F) << shift;
+    if (!(b & 0x80))
+      return v;
+  }
+  throw SerializationError("Overlong varint");
+}
+inline uint64_t zigzag(int64_t v) {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+inline int64_t unzigzag(uint64_t v) {
+  return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+inline void writeVarString(std::ostream &os, const std::string &s) {
+  writeVarint(os, s.size());
+  if (!s.empty())
+    os.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+inline std::string readVarString(std::istream &is) {
+  const uint64_t n = readVarint(is);
+  if (n > UINT32_MAX)
+    throw SerializationError("String too long");
+  std::string s(n, '\0');
+  if (n && !is.read(&s[0], static_cast<std::streamsize>(n)))
+    throw SerializationError("Unexpected EOF reading string");
+  return s;
+}
+
+// Version 2 tags: the ValueType, with kTrueTag for true booleans (false
+// ones take the plain Boolean tag) and kAbsentTag for nullptr cells
+constexpr uint8_t kTrueTag = 0x80 | static_cast<uint8_t>(ValueType::Boolean);
+constexpr uint8_t kAbsentTag = 0xFF;
+
 inline void writeHeader(std::ostream &os) {
   writeU32(os, serialization_constants::MAGIC);
   writeU8(os, serialization_constants::VERSION);
 }
-inline void readHeader(std::istream &is) {
+// The version of the data that follows
+inline uint8_t readHeader(std::istream &is) {
   uint32_t magic = readU32(is);
   if (magic != serialization_constants::MAGIC)
     throw SerializationError("Bad magic");
   uint8_t version = readU8(is);
-  if (version != serialization_constants::VERSION)
+  if (version < serialization_constants::MIN_VERSION ||
+      version > serialization_constants::VERSION)
     throw SerializationError("Unsupported version");
+  return version;
 }
 
-// JSON helpers (very small, not a full JSON implementation). We emit simple
-// compact JSON
-static inline std::string jsonEscape(const std::string &s) {
-  std::string out;
-  out.reserve(s.size() + 8);
-  for (char c : s) {
+// JSON string escaping, appended to `out` a run of plain bytes at a time.
+// Control characters become \u00XX escapes so every string round-trips.
+inline void appendEscaped(std::string &out, const std::string &s) {
+  static const char kHex[] = "0123456789abcdef";
+  size_t plain = 0;
+  for (size_t i = 0; i < s.size(); ++i) {
+    const unsigned char c = static_cast<unsigned char>(s[i]);
+    if (c >= 0x20 && c != '"' && c != '\\')
+      continue;
+    out.append(s, plain, i - plain);
+    plain = i + 1;
     switch (c) {
     case '"':
       out += "\\\"";
@@ -93,13 +153,19 @@ static inline std::string jsonEscape(const std::string &s) {
     case '\t':
       out += "\\t";
       break;
-    default:
-      if (static_cast<unsigned char>(c) < 0x20) {
-        // control char -> skip
-      } else
-        out += c;
+    default: {
+      const char esc[] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xF]};
+      out.append(esc, sizeof(esc));
+    }
     }
   }
+  out.append(s, plain, s.size() - plain);
+}
+
+static inline std::string jsonEscape(const std::string &s) {
+  std::string out;
+  out.reserve(s.size() + 8);
+  appendEscaped(out, s);
   return out;
 }
 
@@ -107,67 +173,535 @@ static inline std::string jsonEscape(const std::string &s) {
 
 namespace bin {
 
+namespace {
+
+// Version 1 values: the type tag, then integers and floats as 8 bytes,
+// strings with a u32 length and booleans as one byte
+std::unique_ptr<Value> readValueV1(std::istream &is) {
+  auto t = static_cast<ValueType>(readU8(is));
+  switch (t) {
+  case ValueType::Null:
+    return ValueFactory::createNull();
+  case ValueType::Integer:
+    return ValueFactory::createInteger(readI64(is));
+  case ValueType::Float:
+    return ValueFactory::createFloat(readF64(is));
+  case ValueType::String:
+    return ValueFactory::createString(readString(is));
+  case ValueType::Boolean:
+    return ValueFactory::createBoolean(readU8(is) != 0);
+  }
+  throw SerializationError("Unknown ValueType");
+}
+
+// The payload of a version 2 value after its tag
+void writePayload(const Value &v, std::ostream &os) {
+  switch (v.type()) {
+  case ValueType::Integer:
+    writeVarint(os, zigzag(static_cast<const IntegerValue &>(v).value()));
+    break;
+  case ValueType::Float:
+    writeF64(os, static_cast<const FloatValue &>(v).value());
+    break;
+  case ValueType::String:
+    writeVarString(os, static_cast<const StringValue &>(v).value());
+    break;
+  case ValueType::Null:
+  case ValueType::Boolean: // in the tag or the row's bitmap
+    break;
+  }
+}
+
+std::unique_ptr<Value> readPayload(uint8_t tag, std::istream &is) {
+  switch (tag) {
+  case static_cast<uint8_t>(ValueType::Null):
+    return ValueFactory::createNull();
+  case static_cast<uint8_t>(ValueType::Integer):
+    return ValueFactory::createInteger(unzigzag(readVarint(is)));
+  case static_cast<uint8_t>(ValueType::Float):
+    return ValueFactory::createFloat(readF64(is));
+  case static_cast<uint8_t>(ValueType::String):
+    return ValueFactory::createString(readVarString(is));
+  case static_cast<uint8_t>(ValueType::Boolean):
+    return ValueFactory::createBoolean(false);
+  case kTrueTag:
+    return ValueFactory::createBoolean(true);
+  }
+  throw SerializationError("Unknown ValueType");
+}
+
+uint8_t tagOf(const Value *v) {
+  if (!v)
+    return kAbsentTag;
+  if (v->type() == ValueType::Boolean &&
+      static_cast<const BooleanValue *>(v)->value())
+    return kTrueTag;
+  return static_cast<uint8_t>(v->type());
+}
+
+// Row kind of a cell: its tag, with both booleans as one kind so that
+// boolean runs stay unbroken; their values go to the row's bitmap
+uint8_t kindOf(const Value *v) {
+  return v ? static_cast<uint8_t>(v->type()) : kAbsentTag;
+}
+
+Row readRowV1(std::istream &is) {
+  uint32_t n = readU32(is);
+  Row row(n);
+  for (uint32_t i = 0; i < n; ++i) {
+    uint8_t isNull = readU8(is);
+    if (!isNull)
+      row.set(i, readValueV1(is));
+  }
+  return row;
+}
+
+} // namespace
+
 void writeValue(const Value &v, std::ostream &os) {
   // No header here; callers at top-level should write header once
-  writeU8(os, static_cast<uint8_t>(v.type()));
+  writeU8(os, tagOf(&v));
+  writePayload(v, os);
+}
+
+std::unique_ptr<Value> readValue(std::istream &is, uint8_t version) {
+  if (version == 1)
+    return readValueV1(is);
+  return readPayload(readU8(is), is);
+}
+
+// Version 2: the cell count, then the cells' kinds as runs of [u8 kind]
+// [varint length], the payloads of integer, float and string cells in
+// order, and one bit per boolean cell
+void writeRow(const Row &row, std::ostream &os) {
+  writeHeader(os);
+  const auto &cells = row.values();
+  writeVarint(os, cells.size());
+  size_t runs = 0, bools = 0;
+  for (size_t i = 0; i < cells.size(); ++i) {
+    if (i == 0 || kindOf(cells[i].get()) != kindOf(cells[i - 1].get()))
+      ++runs;
+    if (cells[i] && cells[i]->type() == ValueType::Boolean)
+      ++bools;
+  }
+  writeVarint(os, runs);
+  for (size_t i = 0; i < cells.size();) {
+    const uint8_t kind = kindOf(cells[i].get());
+    size_t j = i + 1;
+    while (j < cells.size() && kindOf(cells[j].get()) == kind)
+      ++j;
+    writeU8(os, kind);
+    writeVarint(os, j - i);
+    i = j;
+  }
+  std::string bits((bools + 7) / 8, '\0');
+  size_t b = 0;
+  for (const auto &cell : cells) {
+    if (!cell)
+      continue;
+    if (cell->type() == ValueType::Boolean) {
+      if (static_cast<const BooleanValue &>(*cell).value())
+        bits[b / 8] = static_cast<char>(bits[b / 8] | (1 << (b % 8)));
+      ++b;
+    } else {
+      writePayload(*cell, os);
+    }
+  }
+  os.write(bits.data(), static_cast<std::streamsize>(bits.size()));
+}
+
+Row readRow(std::istream &is) {
+  if (readHeader(is) == 1)
+    return readRowV1(is);
+  const uint64_t n = readVarint(is);
+  const uint64_t runCount = readVarint(is);
+  if (n > UINT32_MAX || runCount > n)
+    throw SerializationError("Bad row kind runs");
+  std::vector<std::pair<uint8_t, uint64_t>> runs;
+  runs.reserve(runCount);
+  uint64_t total = 0;
+  for (uint64_t r = 0; r < runCount; ++r) {
+    const uint8_t kind = readU8(is);
+    const uint64_t len = readVarint(is);
+    const bool known = kind == kAbsentTag ||
+                       kind <= static_cast<uint8_t>(ValueType::Boolean);
+    if (len == 0 || len > n - total || !known)
+      throw SerializationError("Bad row kind runs");
+    total += len;
+    runs.emplace_back(kind, len);
+  }
+  if (total != n)
+    throw SerializationError("Bad row kind runs");
+  Row row(n);
+  std::vector<size_t> boolCells;
+  size_t i = 0;
+  for (const auto &run : runs) {
+    for (uint64_t k = 0; k < run.second; ++k, ++i) {
+      if (run.first == kAbsentTag)
+        continue;
+      if (run.first == static_cast<uint8_t>(ValueType::Boolean))
+        boolCells.push_back(i);
+      else
+        row.set(i, readPayload(run.first, is));
+    }
+  }
+  std::string bits((boolCells.size() + 7) / 8, '\0');
+  if (!bits.empty() &&
+      !is.read(&bits[0], static_cast<std::streamsize>(bits.size())))
+    throw SerializationError("Unexpected EOF reading row booleans");
+  for (size_t b = 0; b < boolCells.size(); ++b)
+    row.set(boolCells[b],
+            ValueFactory::createBoolean(
+                (static_cast<uint8_t>(bits[b / 8]) >> (b % 8)) & 1));
+  return row;
+}
+
+// ---- Row batches -----------------------------------------------------------
+
+namespace {
+
+// Column kinds beyond the ValueType values
+constexpr uint8_t kBatchAbsent = 0xFF; // every cell is nullptr
+constexpr uint8_t kBatchMixed = 0xFE;  // cells of several types, tagged
+
+// Appends to a buffer in bulk
+class BatchWriter {
+public:
+  explicit BatchWriter(std::string &out) : out_(out) {}
+
+  char *grow(size_t n) {
+    const size_t at = out_.size();
+    out_.resize(at + n);
+    return &out_[at];
+  }
+  template <typename T> void put(T v) {
+    std::memcpy(grow(sizeof(T)), &v, sizeof(T));
+  }
+  void putBytes(const char *p, size_t n) { out_.append(p, n); }
+
+private:
+  std::string &out_;
+};
+
+// Bounds-checked cursor over an encoded batch
+class BatchReader {
+public:
+  BatchReader(const char *p, size_t n) : p_(p), end_(p + n), begin_(p) {}
+
+  const char *take(size_t n) {
+    if (static_cast<size_t>(end_ - p_) < n)
+      throw SerializationError("Unexpected EOF reading row batch");
+    const char *at = p_;
+    p_ += n;
+    return at;
+  }
+  template <typename T> T get() {
+    T v;
+    std::memcpy(&v, take(sizeof(T)), sizeof(T));
+    return v;
+  }
+  size_t consumed() const { return static_cast<size_t>(p_ - begin_); }
+
+private:
+  const char *p_;
+  const char *const end_;
+  const char *const begin_;
+};
+
+// Physical kind of column `c`: the one type of its non-nullptr cells
+uint8_t columnKind(const std::vector<Row> &rows, size_t c, bool &hasNulls) {
+  uint8_t kind = kBatchAbsent;
+  hasNulls = false;
+  for (const auto &row : rows) {
+    const Value *v = row.values()[c].get();
+    if (!v) {
+      hasNulls = true;
+      continue;
+    }
+    const uint8_t t = static_cast<uint8_t>(v->type());
+    if (kind == kBatchAbsent)
+      kind = t;
+    else if (kind != t)
+      kind = kBatchMixed;
+  }
+  return kind;
+}
+
+void writeTaggedValue(BatchWriter &w, const Value &v) {
+  w.put<uint8_t>(static_cast<uint8_t>(v.type()));
   switch (v.type()) {
   case ValueType::Null:
     break;
   case ValueType::Integer:
-    writeI64(os, static_cast<const IntegerValue &>(v).value());
+    w.put<int64_t>(static_cast<const IntegerValue &>(v).value());
     break;
   case ValueType::Float:
-    writeF64(os, static_cast<const FloatValue &>(v).value());
+    w.put<double>(static_cast<const FloatValue &>(v).value());
     break;
-  case ValueType::String:
-    writeString(os, static_cast<const StringValue &>(v).value());
+  case ValueType::String: {
+    const std::string &s = static_cast<const StringValue &>(v).value();
+    w.put<uint32_t>(static_cast<uint32_t>(s.size()));
+    w.putBytes(s.data(), s.size());
     break;
+  }
   case ValueType::Boolean:
-    writeU8(os,
-            static_cast<uint8_t>(static_cast<const BooleanValue &>(v).value()));
+    w.put<uint8_t>(static_cast<const BooleanValue &>(v).value() ? 1 : 0);
     break;
   }
 }
 
-std::unique_ptr<Value> readValue(std::istream &is) {
-  auto t = static_cast<ValueType>(readU8(is));
-  switch (t) {
+std::unique_ptr<Value> readTaggedValue(BatchReader &r) {
+  switch (static_cast<ValueType>(r.get<uint8_t>())) {
   case ValueType::Null:
     return ValueFactory::createNull();
   case ValueType::Integer:
-    return ValueFactory::createInteger(readI64(is));
+    return ValueFactory::createInteger(r.get<int64_t>());
   case ValueType::Float:
-    return ValueFactory::createFloat(readF64(is));
-  case ValueType::String:
-    return ValueFactory::createString(readString(is));
+    return ValueFactory::createFloat(r.get<double>());
+  case ValueType::String: {
+    const uint32_t n = r.get<uint32_t>();
+    return ValueFactory::createString(std::string(r.take(n), n));
+  }
   case ValueType::Boolean:
-    return ValueFactory::createBoolean(readU8(is) != 0);
+    return ValueFactory::createBoolean(r.get<uint8_t>() != 0);
   }
   throw SerializationError("Unknown ValueType");
 }
 
-void writeRow(const Row &row, std::ostream &os) {
-  writeHeader(os);
-  writeU32(os, static_cast<uint32_t>(row.size()));
-  for (size_t i = 0; i < row.size(); ++i) {
-    const auto &ptr = row.values()[i];
-    uint8_t isNull = ptr ? 0 : 1;
-    writeU8(os, isNull);
-    if (!isNull)
-      writeValue(*ptr, os);
+} // namespace
+
+void writeRowBatch(const std::vector<Row> &rows, std::string &out) {
+  const size_t n = rows.size();
+  const size_t ncols = n ? rows[0].size() : 0;
+  for (const auto &row : rows)
+    if (row.size() != ncols)
+      throw SerializationError("Row batch rows differ in width");
+  if (n > UINT32_MAX || ncols > UINT32_MAX)
+    throw SerializationError("Row batch too large");
+
+  BatchWriter w(out);
+  w.put<uint32_t>(serialization_constants::MAGIC);
+  w.put<uint8_t>(serialization_constants::VERSION);
+  w.put<uint32_t>(static_cast<uint32_t>(n));
+  w.put<uint32_t>(static_cast<uint32_t>(ncols));
+  const size_t bitmapBytes = (n + 7) / 8;
+  for (size_t c = 0; c < ncols; ++c) {
+    bool hasNulls = false;
+    const uint8_t kind = columnKind(rows, c, hasNulls);
+    w.put<uint8_t>(kind);
+    w.put<uint8_t>(hasNulls ? 1 : 0);
+    if (kind == kBatchAbsent)
+      continue;
+    if (hasNulls) {
+      char *bits = w.grow(bitmapBytes);
+      std::memset(bits, 0, bitmapBytes);
+      for (size_t r = 0; r < n; ++r)
+        if (!rows[r].values()[c])
+          bits[r / 8] = static_cast<char>(bits[r / 8] | (1 << (r % 8)));
+    }
+    // Fixed-width arrays hold a zero slot for null cells
+    switch (kind) {
+    case static_cast<uint8_t>(ValueType::Integer): {
+      char *dst = w.grow(8 * n);
+      for (size_t r = 0; r < n; ++r) {
+        const Value *v = rows[r].values()[c].get();
+        const int64_t x = v ? static_cast<const IntegerValue *>(v)->value() : 0;
+        std::memcpy(dst + 8 * r, &x, 8);
+      }
+      break;
+    }
+    case static_cast<uint8_t>(ValueType::Float): {
+      char *dst = w.grow(8 * n);
+      for (size_t r = 0; r < n; ++r) {
+        const Value *v = rows[r].values()[c].get();
+        const double x = v ? static_cast<const FloatValue *>(v)->value() : 0.0;
+        std::memcpy(dst + 8 * r, &x, 8);
+      }
+      break;
+    }
+    case static_cast<uint8_t>(ValueType::Boolean): {
+      char *dst = w.grow(n);
+      for (size_t r = 0; r < n; ++r) {
+        const Value *v = rows[r].values()[c].get();
+        dst[r] = v && static_cast<const BooleanValue *>(v)->value() ? 1 : 0;
+      }
+      break;
+    }
+    case static_cast<uint8_t>(ValueType::String): {
+      // n + 1 offsets into the string bytes that follow
+      size_t total = 0;
+      char *offsets = w.grow(4 * (n + 1));
+      for (size_t r = 0; r < n; ++r) {
+        const uint32_t at = static_cast<uint32_t>(total);
+        std::memcpy(offsets + 4 * r, &at, 4);
+        if (const Value *v = rows[r].values()[c].get())
+          total += static_cast<const StringValue *>(v)->value().size();
+        if (total > UINT32_MAX)
+          throw SerializationError("Row batch strings too large");
+      }
+      const uint32_t end = static_cast<uint32_t>(total);
+      std::memcpy(offsets + 4 * n, &end, 4);
+      char *dst = w.grow(total);
+      for (size_t r = 0; r < n; ++r) {
+        if (const Value *v = rows[r].values()[c].get()) {
+          const std::string &s = static_cast<const StringValue *>(v)->value();
+          std::memcpy(dst, s.data(), s.size());
+          dst += s.size();
+        }
+      }
+      break;
+    }
+    case kBatchMixed:
+      for (size_t r = 0; r < n; ++r)
+        if (const Value *v = rows[r].values()[c].get())
+          writeTaggedValue(w, *v);
+      break;
+    default: // every present cell is a NullValue
+      break;
+    }
   }
 }
 
-Row readRow(std::istream &is) {
-  readHeader(is);
-  uint32_t n = readU32(is);
-  Row row(n);
-  for (uint32_t i = 0; i < n; ++i) {
-    uint8_t isNull = readU8(is);
-    if (!isNull)
-      row.set(i, readValue(is));
+void writeRowBatch(const std::vector<Row> &rows, std::string &out,
+                   Codec codec, std::string_view dict) {
+  if (codec == Codec::None) {
+    writeRowBatch(rows, out);
+    return;
   }
-  return row;
+  thread_local std::string plain;
+  plain.clear();
+  writeRowBatch(rows, plain);
+  if (plain.size() > UINT32_MAX)
+    throw SerializationError("Row batch too large");
+  const size_t start = out.size();
+  BatchWriter w(out);
+  w.put<uint32_t>(serialization_constants::COMPRESSED_MAGIC);
+  w.put<uint8_t>(static_cast<uint8_t>(codec));
+  w.put<uint32_t>(static_cast<uint32_t>(plain.size()));
+  w.put<uint32_t>(0);
+  const size_t body = out.size();
+  codec::compress(codec, plain.data(), plain.size(), out, dict);
+  if (out.size() - body > UINT32_MAX) {
+    out.resize(start);
+    throw SerializationError("Row batch too large");
+  }
+  const uint32_t stored = static_cast<uint32_t>(out.size() - body);
+  std::memcpy(&out[body - 4], &stored, 4);
+}
+
+std::vector<Row> readRowBatch(const char *data, size_t size,
+                              size_t *consumed, std::string_view dict) {
+  BatchReader rd(data, size);
+  const uint32_t magic = rd.get<uint32_t>();
+  if (magic == serialization_constants::COMPRESSED_MAGIC) {
+    const uint8_t codec = rd.get<uint8_t>();
+    const uint32_t raw = rd.get<uint32_t>();
+    const uint32_t stored = rd.get<uint32_t>();
+    const char *body = rd.take(stored);
+    if (codec == static_cast<uint8_t>(Codec::None) || !codec::isCodec(codec))
+      throw SerializationError("Unknown row batch codec");
+    // No LZ4 block expands more than 255-fold
+    if (raw / 255 > stored)
+      throw SerializationError("Corrupt compressed row batch");
+    std::string plain(raw, '\0');
+    if (!codec::decompress(body, stored, &plain[0], raw, dict))
+      throw SerializationError("Corrupt compressed row batch");
+    size_t used = 0;
+    auto rows = readRowBatch(plain.data(), plain.size(), &used);
+    if (used != raw)
+      throw SerializationError("Corrupt compressed row batch");
+    if (consumed)
+      *consumed = rd.consumed();
+    return rows;
+  }
+  if (magic != serialization_constants::MAGIC)
+    throw SerializationError("Bad magic");
+  const uint8_t version = rd.get<uint8_t>();
+  if (version < serialization_constants::MIN_VERSION ||
+      version > serialization_constants::VERSION)
+    throw SerializationError("Unsupported version");
+  const size_t n = rd.get<uint32_t>();
+  const size_t ncols = rd.get<uint32_t>();
+  std::vector<Row> rows;
+  rows.reserve(n);
+  for (size_t r = 0; r < n; ++r)
+    rows.emplace_back(ncols);
+  const size_t bitmapBytes = (n + 7) / 8;
+  for (size_t c = 0; c < ncols; ++c) {
+    const uint8_t kind = rd.get<uint8_t>();
+    const bool hasNulls = rd.get<uint8_t>() != 0;
+    if (kind == kBatchAbsent)
+      continue;
+    const char *bits = hasNulls ? rd.take(bitmapBytes) : nullptr;
+    auto present = [&](size_t r) {
+      return !bits || !(static_cast<uint8_t>(bits[r / 8]) >> (r % 8) & 1);
+    };
+    switch (kind) {
+    case static_cast<uint8_t>(ValueType::Integer): {
+      const char *src = rd.take(8 * n);
+      for (size_t r = 0; r < n; ++r) {
+        if (!present(r))
+          continue;
+        int64_t x;
+        std::memcpy(&x, src + 8 * r, 8);
+        rows[r].set(c, ValueFactory::createInteger(x));
+      }
+      break;
+    }
+    case static_cast<uint8_t>(ValueType::Float): {
+      const char *src = rd.take(8 * n);
+      for (size_t r = 0; r < n; ++r) {
+        if (!present(r))
+          continue;
+        double x;
+        std::memcpy(&x, src + 8 * r, 8);
+        rows[r].set(c, ValueFactory::createFloat(x));
+      }
+      break;
+    }
+    case static_cast<uint8_t>(ValueType::Boolean): {
+      const char *src = rd.take(n);
+      for (size_t r = 0; r < n; ++r)
+        if (present(r))
+          rows[r].set(c, ValueFactory::createBoolean(src[r] != 0));
+      break;
+    }
+    case static_cast<uint8_t>(ValueType::String): {
+      const char *offsets = rd.take(4 * (n + 1));
+      uint32_t end;
+      std::memcpy(&end, offsets + 4 * n, 4);
+      const char *blob = rd.take(end);
+      uint32_t at;
+      std::memcpy(&at, offsets, 4);
+      for (size_t r = 0; r < n; ++r) {
+        uint32_t next;
+        std::memcpy(&next, offsets + 4 * (r + 1), 4);
+        if (next < at || next > end)
+          throw SerializationError("Bad string offset in row batch");
+        if (present(r))
+          rows[r].set(c, ValueFactory::createString(
+                             std::string(blob + at, next - at)));
+        at = next;
+      }
+      break;
+    }
+    case kBatchMixed:
+      for (size_t r = 0; r < n; ++r)
+        if (present(r))
+          rows[r].set(c, readTaggedValue(rd));
+      break;
+    case static_cast<uint8_t>(ValueType::Null):
+      for (size_t r = 0; r < n; ++r)
+        if (present(r))
+          rows[r].set(c, ValueFactory::createNull());
+      break;
+    default:
+      throw SerializationError("Unknown row batch column kind");
+    }
+  }
+  if (consumed)
+    *consumed = rd.consumed();
+  return rows;
 }
 
 void writeTableSchema(const TableSchema &schema, std::ostream &os) {
@@ -303,30 +837,38 @@ DocumentSchema readDocumentSchema(std::istream &is) {
   return ds;
 }
 
+// Version 2: the field count, then per field its name and its value's tag
+// (kAbsentTag for nullptr) and payload
 void writeDocument(const Document &doc, std::ostream &os) {
   writeHeader(os);
-  writeU32(os, static_cast<uint32_t>(doc.size()));
+  writeVarint(os, doc.size());
   for (const auto &kv : doc) {
-    writeString(os, kv.first);
-    uint8_t isNull = kv.second ? 0 : 1;
-    writeU8(os, isNull);
-    if (!isNull)
-      writeValue(*kv.second, os);
+    writeVarString(os, kv.first);
+    writeU8(os, tagOf(kv.second.get()));
+    if (kv.second)
+      writePayload(*kv.second, os);
   }
 }
 
 Document readDocument(std::istream &is) {
-  readHeader(is);
-  uint32_t n = readU32(is);
+  const uint8_t version = readHeader(is);
+  const uint64_t n = version == 1 ? readU32(is) : readVarint(is);
   Document d;
-  for (uint32_t i = 0; i < n; ++i) {
-    std::string name = readString(is);
-    uint8_t isNull = readU8(is);
-    if (!isNull) {
-      d.try_emplace(std::move(name), readValue(is));
-    } else {
-      d.try_emplace(std::move(name), nullptr);
+  for (uint64_t i = 0; i < n; ++i) {
+    if (version == 1) {
+      std::string name = readString(is);
+      uint8_t isNull = readU8(is);
+      if (!isNull) {
+        d.try_emplace(std::move(name), readValueV1(is));
+      } else {
+        d.try_emplace(std::move(name), nullptr);
+      }
+      continue;
     }
+    std::string name = readVarString(is);
+    const uint8_t tag = readU8(is);
+    d.try_emplace(std::move(name),
+                  tag == kAbsentTag ? nullptr : readPayload(tag, is));
   }
   return d;
 }
@@ -352,133 +894,430 @@ static inline const char *typeToStr(ValueType t) {
   return "unknown";
 }
 
-std::string toJson(const Value &v) {
-  std::ostringstream oss;
-  oss << "{\"t\":\"" << typeToStr(v.type()) << "\",";
-  oss << "\"v\":";
+namespace {
+
+void appendDouble(std::string &out, double d) {
+  char buf[32];
+#if defined(__cpp_lib_to_chars)
+  // Shortest text that reads back as the same double
+  const auto res = std::to_chars(buf, buf + sizeof(buf), d);
+  out.append(buf, res.ptr);
+#else
+  const int n = std::snprintf(buf, sizeof(buf), "%.17g", d);
+  out.append(buf, static_cast<size_t>(n));
+#endif
+}
+
+void appendInt(std::string &out, int64_t v) {
+  char buf[24];
+  const auto res = std::to_chars(buf, buf + sizeof(buf), v);
+  out.append(buf, res.ptr);
+}
+
+// Single-pass JSON cursor over an input buffer. Tokens are read in place:
+// only decoded strings allocate.
+class JsonCursor {
+public:
+  JsonCursor(const char *p, size_t n) : p_(p), end_(p + n) {}
+
+  void skipSpace() {
+    while (p_ < end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' ||
+                         *p_ == '\t'))
+      ++p_;
+  }
+  bool peek(char c) {
+    skipSpace();
+    return p_ < end_ && *p_ == c;
+  }
+  bool consume(char c) {
+    if (!peek(c))
+      return false;
+    ++p_;
+    return true;
+  }
+  void expect(char c) {
+    if (!consume(c))
+      fail(std::string("expected '") + c + "'");
+  }
+  // A bare word such as null, true or nan
+  bool word(const char *w) {
+    skipSpace();
+    const size_t n = std::strlen(w);
+    if (static_cast<size_t>(end_ - p_) < n || std::memcmp(p_, w, n) != 0)
+      return false;
+    if (p_ + n < end_ && std::isalnum(static_cast<unsigned char>(p_[n])))
+      return false;
+    p_ += n;
+    return true;
+  }
+  void finish() {
+    skipSpace();
+    if (p_ != end_)
+      fail("trailing characters");
+  }
+
+  // A string's decoded contents
+  std::string string() {
+    expect('"');
+    std::string out;
+    const char *plain = p_;
+    while (true) {
+      // Copy runs without escapes in one go
+      while (p_ < end_ && *p_ != '"' && *p_ != '\\')
+        ++p_;
+      out.append(plain, p_);
+      if (p_ == end_)
+        fail("unterminated string");
+      if (*p_++ == '"')
+        return out;
+      if (p_ == end_)
+        fail("unterminated escape");
+      switch (*p_++) {
+      case '"':
+        out += '"';
+        break;
+      case '\\':
+        out += '\\';
+        break;
+      case '/':
+        out += '/';
+        break;
+      case 'b':
+        out += '\b';
+        break;
+      case 'f':
+        out += '\f';
+        break;
+      case 'n':
+        out += '\n';
+        break;
+      case 'r':
+        out += '\r';
+        break;
+      case 't':
+        out += '\t';
+        break;
+      case 'u':
+        appendCodePoint(out, codePoint());
+        break;
+      default:
+        fail("bad escape");
+      }
+      plain = p_;
+    }
+  }
+
+  // True when the next string equals `key`, which holds no escapes
+  bool stringIs(const char *key) {
+    skipSpace();
+    const size_t n = std::strlen(key);
+    if (static_cast<size_t>(end_ - p_) < n + 2 || *p_ != '"' ||
+        std::memcmp(p_ + 1, key, n) != 0 || p_[n + 1] != '"')
+      return false;
+    p_ += n + 2;
+    return true;
+  }
+
+  int64_t integer() {
+    skipSpace();
+    int64_t v = 0;
+    const auto res = std::from_chars(p_, end_, v);
+    if (res.ec != std::errc())
+      fail("bad integer");
+    p_ = res.ptr;
+    return v;
+  }
+
+  double number() {
+    skipSpace();
+    if (word("nan"))
+      return std::numeric_limits<double>::quiet_NaN();
+    if (word("inf"))
+      return std::numeric_limits<double>::infinity();
+    if (word("-inf"))
+      return -std::numeric_limits<double>::infinity();
+#if defined(__cpp_lib_to_chars)
+    double v = 0;
+    const auto res = std::from_chars(p_, end_, v);
+    if (res.ec != std::errc())
+      fail("bad number");
+    p_ = res.ptr;
+    return v;
+#else
+    const char *q = p_;
+    while (q < end_ && (std::isdigit(static_cast<unsigned char>(*q)) ||
+                        *q == '-' || *q == '+' || *q == '.' || *q == 'e' ||
+                        *q == 'E'))
+      ++q;
+    const std::string text(p_, q);
+    char *stop = nullptr;
+    const double v = std::strtod(text.c_str(), &stop);
+    if (text.empty() || stop != text.c_str() + text.size())
+      fail("bad number");
+    p_ = q;
+    return v;
+#endif
+  }
+
+  // Skip any value, e.g. a field this parser does not use
+  void skipValue() {
+    skipSpace();
+    if (p_ == end_)
+      fail("unexpected end");
+    if (*p_ == '"') {
+      string();
+    } else if (*p_ == '{' || *p_ == '[') {
+      const char close = *p_ == '{' ? '}' : ']';
+      ++p_;
+      if (consume(close))
+        return;
+      do {
+        if (close == '}') {
+          string();
+          expect(':');
+        }
+        skipValue();
+      } while (consume(','));
+      expect(close);
+    } else if (!word("null") && !word("true") && !word("false")) {
+      number();
+    }
+  }
+
+  [[noreturn]] void fail(const std::string &what) const {
+    throw SerializationError("Bad JSON: " + what);
+  }
+
+private:
+  uint32_t hex4() {
+    if (end_ - p_ < 4)
+      fail("bad \\u escape");
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) {
+      const char c = *p_++;
+      v <<= 4;
+      if (c >= '0' && c <= '9')
+        v |= static_cast<uint32_t>(c - '0');
+      else if (c >= 'a' && c <= 'f')
+        v |= static_cast<uint32_t>(c - 'a' + 10);
+      else if (c >= 'A' && c <= 'F')
+        v |= static_cast<uint32_t>(c - 'A' + 10);
+      else
+        fail("bad \\u escape");
+    }
+    return v;
+  }
+
+  uint32_t codePoint() {
+    const uint32_t hi = hex4();
+    if (hi < 0xD800 || hi > 0xDBFF)
+      return hi;
+    // Surrogate pair
+    if (end_ - p_ < 2 || p_[0] != '\\' || p_[1] != 'u')
+      fail("unpaired surrogate");
+    p_ += 2;
+    const uint32_t lo = hex4();
+    if (lo < 0xDC00 || lo > 0xDFFF)
+      fail("unpaired surrogate");
+    return 0x10000 + ((hi - 0xD800) << 10) + (lo - 0xDC00);
+  }
+
+  static void appendCodePoint(std::string &out, uint32_t cp) {
+    if (cp < 0x80) {
+      out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+      out += static_cast<char>(0xC0 | (cp >> 6));
+      out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+      out += static_cast<char>(0xE0 | (cp >> 12));
+      out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+      out += static_cast<char>(0xF0 | (cp >> 18));
+      out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+      out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+  }
+
+  const char *p_;
+  const char *end_;
+};
+
+// A {"t":..,"v":..} Value object; the keys may come in either order
+std::unique_ptr<Value> parseValue(JsonCursor &in) {
+  in.expect('{');
+  std::string type;
+  // Position of "v" when it precedes "t"
+  std::optional<JsonCursor> pending;
+  std::unique_ptr<Value> value;
+  auto readV = [&](JsonCursor &c) -> std::unique_ptr<Value> {
+    if (type == "null") {
+      c.skipValue();
+      return ValueFactory::createNull();
+    }
+    if (type == "int")
+      return ValueFactory::createInteger(c.integer());
+    if (type == "float")
+      return ValueFactory::createFloat(c.number());
+    if (type == "string")
+      return ValueFactory::createString(c.string());
+    if (type == "bool") {
+      if (c.word("true"))
+        return ValueFactory::createBoolean(true);
+      if (c.word("false"))
+        return ValueFactory::createBoolean(false);
+      c.fail("bad bool value");
+    }
+    throw SerializationError("Unknown Value JSON type");
+  };
+  if (!in.consume('}')) {
+    do {
+      if (in.stringIs("t")) {
+        in.expect(':');
+        type = in.string();
+      } else if (in.stringIs("v")) {
+        in.expect(':');
+        if (type.empty()) {
+          pending = in;
+          in.skipValue();
+        } else {
+          value = readV(in);
+        }
+      } else {
+        in.string();
+        in.expect(':');
+        in.skipValue();
+      }
+    } while (in.consume(','));
+    in.expect('}');
+  }
+  if (!value && pending && !type.empty())
+    value = readV(*pending);
+  if (!value)
+    throw SerializationError("Bad JSON Value");
+  return value;
+}
+
+// A Value object or null (a nullptr cell)
+std::unique_ptr<Value> parseCell(JsonCursor &in) {
+  if (in.word("null"))
+    return nullptr;
+  return parseValue(in);
+}
+
+} // namespace
+
+void appendJson(const Value &v, std::string &out) {
+  out += "{\"t\":\"";
+  out += typeToStr(v.type());
+  out += "\",\"v\":";
   switch (v.type()) {
   case ValueType::Null:
-    oss << "null";
+    out += "null";
     break;
   case ValueType::Integer:
-    oss << static_cast<const IntegerValue &>(v).value();
+    appendInt(out, static_cast<const IntegerValue &>(v).value());
     break;
   case ValueType::Float:
-    oss << static_cast<const FloatValue &>(v).toString();
+    appendDouble(out, static_cast<const FloatValue &>(v).value());
     break;
   case ValueType::String:
-    oss << '"' << jsonEscape(static_cast<const StringValue &>(v).value())
-        << '"';
+    out += '"';
+    appendEscaped(out, static_cast<const StringValue &>(v).value());
+    out += '"';
     break;
   case ValueType::Boolean:
-    oss << (static_cast<const BooleanValue &>(v).value() ? "true" : "false");
+    out += static_cast<const BooleanValue &>(v).value() ? "true" : "false";
     break;
   }
-  oss << '}';
-  return oss.str();
+  out += '}';
 }
 
-std::unique_ptr<Value> fromJson(const std::string &jsonStr) {
-  // Very small parser assuming our own format
-  auto tpos = jsonStr.find("\"t\"");
-  auto vpos = jsonStr.find("\"v\"");
-  if (tpos == std::string::npos || vpos == std::string::npos)
-    throw SerializationError("Bad JSON Value");
-  auto tstart = jsonStr.find('"', tpos + 3);
-  if (tstart == std::string::npos)
-    throw SerializationError("Bad JSON");
-  auto tend = jsonStr.find('"', tstart + 1);
-  if (tend == std::string::npos)
-    throw SerializationError("Bad JSON");
-  std::string t = jsonStr.substr(tstart + 1, tend - tstart - 1);
-  auto vstart = jsonStr.find(':', vpos);
-  if (vstart == std::string::npos)
-    throw SerializationError("Bad JSON");
-  ++vstart;
-  // trim spaces
-  while (vstart < jsonStr.size() &&
-         isspace(static_cast<unsigned char>(jsonStr[vstart])))
-    ++vstart;
-  std::string v = jsonStr.substr(vstart);
-  // remove trailing }
-  if (!v.empty() && v.back() == '}')
-    v.pop_back();
-  while (!v.empty() && isspace(static_cast<unsigned char>(v.back())))
-    v.pop_back();
-  if (t == "null")
-    return ValueFactory::createNull();
-  if (t == "int")
-    return ValueFactory::createInteger(std::stoll(v));
-  if (t == "float")
-    return ValueFactory::createFloat(std::stod(v));
-  if (t == "string") {
-    if (v.size() >= 2 && v.front() == '"' && v.back() == '"')
-      return ValueFactory::createString(v.substr(1, v.size() - 2));
-    throw SerializationError("Bad JSON string value");
-  }
-  if (t == "bool") {
-    if (v.rfind("true", 0) == 0)
-      return ValueFactory::createBoolean(true);
-    if (v.rfind("false", 0) == 0)
-      return ValueFactory::createBoolean(false);
-    throw SerializationError("Bad JSON bool value");
-  }
-  throw SerializationError("Unknown Value JSON type");
-}
-
-std::string toJson(const Row &row) {
-  std::ostringstream oss;
-  oss << "{\"values\":[";
+void appendJson(const Row &row, std::string &out) {
+  out += "{\"values\":[";
   for (size_t i = 0; i < row.size(); ++i) {
     if (i)
-      oss << ',';
+      out += ',';
     const auto &ptr = row.values()[i];
-    if (!ptr)
-      oss << "null";
+    if (ptr)
+      appendJson(*ptr, out);
     else
-      oss << toJson(*ptr);
+      out += "null";
   }
-  oss << "],\"version\":" << static_cast<int>(serialization_constants::VERSION)
-      << "}";
-  return oss.str();
+  out += "],\"version\":";
+  appendInt(out, serialization_constants::JSON_VERSION);
+  out += '}';
 }
 
-Row rowFromJson(const std::string &s) {
-  auto arrPos = s.find("["),
-       arrEnd = s.find("]", arrPos == std::string::npos ? 0 : arrPos + 1);
-  if (arrPos == std::string::npos || arrEnd == std::string::npos)
-    throw SerializationError("Bad Row JSON");
-  std::string arr = s.substr(arrPos + 1, arrEnd - arrPos - 1);
-  // naive split on commas not inside braces
-  std::vector<std::string> items;
-  int depth = 0;
-  size_t last = 0;
-  for (size_t i = 0; i < arr.size(); ++i) {
-    char c = arr[i];
-    if (c == '{')
-      ++depth;
-    else if (c == '}')
-      --depth;
-    else if (c == ',' && depth == 0) {
-      items.emplace_back(arr.substr(last, i - last));
-      last = i + 1;
-    }
+void appendJson(const Document &doc, std::string &out) {
+  out += '{';
+  bool first = true;
+  for (const auto &kv : doc) {
+    if (!first)
+      out += ',';
+    first = false;
+    out += '"';
+    appendEscaped(out, kv.first);
+    out += "\":";
+    if (kv.second)
+      appendJson(*kv.second, out);
+    else
+      out += "null";
   }
-  if (last < arr.size())
-    items.emplace_back(arr.substr(last));
-  Row row(items.size());
-  for (size_t i = 0; i < items.size(); ++i) {
-    std::string it = items[i];
-    // trim
-    size_t a = 0, b = it.size();
-    while (a < b && isspace(static_cast<unsigned char>(it[a])))
-      ++a;
-    while (b > a && isspace(static_cast<unsigned char>(it[b - 1])))
-      --b;
-    if (a == b || (b - a == 4 && it.substr(a, 4) == "null"))
-      continue;
-    row.set(i, fromJson(it.substr(a, b - a)));
+  out += '}';
+}
+
+std::string toJson(const Value &v) {
+  std::string out;
+  appendJson(v, out);
+  return out;
+}
+
+std::unique_ptr<Value> fromJson(const std::string &jsonStr) {
+  JsonCursor in(jsonStr.data(), jsonStr.size());
+  auto v = parseValue(in);
+  in.finish();
+  return v;
+}
+
+std::string toJson(const Row &row) {
+  std::string out;
+  appendJson(row, out);
+  return out;
+}
+
+Row rowFromJson(const std::string &s) {
+  JsonCursor in(s.data(), s.size());
+  std::vector<std::unique_ptr<Value>> cells;
+  bool sawValues = false;
+  in.expect('{');
+  if (!in.consume('}')) {
+    do {
+      if (in.stringIs("values")) {
+        in.expect(':');
+        in.expect('[');
+        sawValues = true;
+        if (!in.consume(']')) {
+          do
+            cells.push_back(parseCell(in));
+          while (in.consume(','));
+          in.expect(']');
+        }
+      } else {
+        in.string();
+        in.expect(':');
+        in.skipValue();
+      }
+    } while (in.consume(','));
+    in.expect('}');
   }
+  in.finish();
+  if (!sawValues)
+    throw SerializationError("Bad Row JSON");
+  Row row(cells.size());
+  for (size_t i = 0; i < cells.size(); ++i)
+    row.set(i, std::move(cells[i]));
   return row;
 }
 
@@ -553,8 +1392,8 @@ std::string toJson(const TableSchema &schema) {
     oss << '"' << jsonEscape(*schema.primaryKey()) << '"';
   else
     oss << "null";
-  oss << ",\"version\":" << static_cast<int>(serialization_constants::VERSION)
-      << '}';
+  oss << ",\"version\":"
+      << static_cast<int>(serialization_constants::JSON_VERSION) << '}';
   return oss.str();
 }
 
@@ -661,8 +1500,8 @@ std::string toJson(const DocumentSchema &schema) {
     oss << "\"unique\":" << (c.unique ? "true" : "false") << ",";
     oss << "\"constraints\":{" << constraintsToJson(c.constraints) << "}}";
   }
-  oss << "},\"version\":" << static_cast<int>(serialization_constants::VERSION)
-      << '}';
+  oss << "},\"version\":"
+      << static_cast<int>(serialization_constants::JSON_VERSION) << '}';
   return oss.str();
 }
 
@@ -729,94 +1568,25 @@ DocumentSchema documentSchemaFromJson(const std::string &s) {
 }
 
 std::string toJson(const Document &doc) {
-  std::ostringstream oss;
-  oss << '{';
-  bool first = true;
-  for (const auto &kv : doc) {
-    if (!first)
-      oss << ',';
-    first = false;
-    oss << '"' << jsonEscape(kv.first) << '"' << ':';
-    if (!kv.second) {
-      oss << "null";
-    } else {
-      oss << toJson(*kv.second);
-    }
-  }
-  oss << '}';
-  return oss.str();
+  std::string out;
+  appendJson(doc, out);
+  return out;
 }
 
 Document documentFromJson(const std::string &s) {
-  // Expect an object with keys -> Value JSON or null
-  size_t objStart = s.find('{');
-  size_t objEnd = s.rfind('}');
-  if (objStart == std::string::npos || objEnd == std::string::npos ||
-      objEnd <= objStart)
-    throw SerializationError("Bad Document JSON");
-  std::string obj = s.substr(objStart + 1, objEnd - objStart - 1);
+  // An object of field -> Value object or null
+  JsonCursor in(s.data(), s.size());
   Document d;
-  int depth = 0;
-  size_t last = 0;
-  for (size_t i = 0; i < obj.size(); ++i) {
-    char c = obj[i];
-    if (c == '{')
-      ++depth;
-    else if (c == '}')
-      --depth;
-    else if (c == ',' && depth == 0) {
-      std::string pair = obj.substr(last, i - last);
-      last = i + 1;
-      // parse pair key:value
-      size_t q1 = pair.find('"');
-      if (q1 == std::string::npos)
-        continue;
-      size_t q2 = pair.find('"', q1 + 1);
-      if (q2 == std::string::npos)
-        continue;
-      std::string key = pair.substr(q1 + 1, q2 - q1 - 1);
-      size_t colon = pair.find(':', q2 + 1);
-      if (colon == std::string::npos)
-        continue;
-      std::string val = pair.substr(colon + 1);
-      // trim
-      size_t a = 0, b = val.size();
-      while (a < b && isspace(static_cast<unsigned char>(val[a])))
-        ++a;
-      while (b > a && isspace(static_cast<unsigned char>(val[b - 1])))
-        --b;
-      if (a == b || (b - a == 4 && val.substr(a, 4) == "null")) {
-        d.try_emplace(std::move(key), nullptr);
-      } else {
-        d.try_emplace(std::move(key), fromJson(val.substr(a, b - a)));
-      }
-    }
-  }
-  // last segment
-  if (last < obj.size()) {
-    std::string pair = obj.substr(last);
-    size_t q1 = pair.find('"');
-    if (q1 != std::string::npos) {
-      size_t q2 = pair.find('"', q1 + 1);
-      if (q2 != std::string::npos) {
-        std::string key = pair.substr(q1 + 1, q2 - q1 - 1);
-        size_t colon = pair.find(':', q2 + 1);
-        if (colon != std::string::npos) {
-          std::string val = pair.substr(colon + 1);
-          size_t a = 0, b = val.size();
-          while (a < b && isspace(static_cast<unsigned char>(val[a])))
-            ++a;
-          while (b > a && isspace(static_cast<unsigned char>(val[b - 1])))
-            --b;
-          if (a == b || (b - a == 4 && val.substr(a, 4) == "null")) {
-            d.try_emplace(std::move(key), nullptr);
-          } else {
-            d.try_emplace(std::move(key), fromJson(val.substr(a, b - a)));
-          }
-        }
-      }
-    }
+  in.expect('{');
+  if (!in.consume('}')) {
+    do {
+      std::string key = in.string();
+      in.expect(':');
+      d.try_emplace(std::move(key), parseCell(in));
+    } while (in.consume(','));
+    in.expect('}');
   }
+  in.finish();
   return d;
 }
 
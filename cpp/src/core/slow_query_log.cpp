@@ -0,0 +1,172 @@
+#include "kadedb/slow_query_log.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+
+#include "kadedb/value.h"
+
+namespace kadedb {
+
+SlowQueryLog::SlowQueryLog(size_t capacity)
+    : capacity_(std::max<size_t>(capacity, 1)) {}
+
+SlowQueryLog &SlowQueryLog::shared() {
+  // Never destroyed: executors may log during static destruction
+  static SlowQueryLog *log = new SlowQueryLog();
+  return *log;
+}
+
+void SlowQueryLog::setThreshold(std::chrono::microseconds threshold) {
+  thresholdUs_.store(std::max<int64_t>(threshold.count(), 0),
+                     std::memory_order_relaxed);
+}
+
+void SlowQueryLog::disable() {
+  thresholdUs_.store(-1, std::memory_order_relaxed);
+}
+
+void SlowQueryLog::setCapacity(size_t capacity) {
+  capacity = std::max<size_t>(capacity, 1);
+  std::lock_guard<std::mutex> lk(mtx_);
+  std::rotate(ring_.begin(), ring_.begin() + head_, ring_.end());
+  head_ = 0;
+  if (ring_.size() > capacity)
+    ring_.erase(ring_.begin(), ring_.end() - capacity);
+  capacity_ = capacity;
+}
+
+size_t SlowQueryLog::capacity() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return capacity_;
+}
+
+void SlowQueryLog::record(SlowQueryEntry entry) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  entry.id = nextId_++;
+  if (ring_.size() < capacity_) {
+    ring_.push_back(std::move(entry));
+    return;
+  }
+  ring_[head_] = std::move(entry);
+  head_ = (head_ + 1) % capacity_;
+}
+
+std::vector<SlowQueryEntry> SlowQueryLog::entries() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  std::vector<SlowQueryEntry> out;
+  out.reserve(ring_.size());
+  out.insert(out.end(), ring_.begin() + head_, ring_.end());
+  out.insert(out.end(), ring_.begin(), ring_.begin() + head_);
+  return out;
+}
+
+void SlowQueryLog::clear() {
+  std::lock_guard<std::mutex> lk(mtx_);
+  ring_.clear();
+  head_ = 0;
+}
+
+std::string SlowQueryLog::fingerprint(const std::string &query) {
+  std::string out;
+  out.reserve(query.size());
+  auto isWord = [](char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' ||
+           c == '$';
+  };
+  for (size_t i = 0; i < query.size();) {
+    const char c = query[i];
+    const bool afterWord = !out.empty() && isWord(out.back());
+    const bool number =
+        std::isdigit(static_cast<unsigned char>(c)) ||
+        (c == '-' && i + 1 < query.size() &&
+         std::isdigit(static_cast<unsigned char>(query[i + 1])));
+    if (c == '\'' || c == '"') {
+      // String literal, with backslash escapes
+      for (++i; i < query.size() && query[i] != c; ++i)
+        if (query[i] == '\\')
+          ++i;
+      i = std::min(i + 1, query.size());
+      out += '?';
+    } else if (number && !afterWord) {
+      // Number, with its sign and fraction; digits inside identifiers and
+      // parameters ($1) are kept
+      ++i;
+      while (i < query.size() &&
+             (std::isalnum(static_cast<unsigned char>(query[i])) ||
+              query[i] == '.'))
+        ++i;
+      out += '?';
+    } else {
+      out += c;
+      ++i;
+    }
+    // Collapse "?, ?" to "?"
+    const size_t n = out.size();
+    if (n >= 4 && out[n - 1] == '?' && out.compare(n - 4, 3, "?, ") == 0)
+      out.resize(n - 3);
+  }
+  return out;
+}
+
+uint64_t SlowQueryLog::fingerprintHash(const std::string &fingerprint) {
+  uint64_t h = 1469598103934665603ull;
+  for (unsigned char c : fingerprint) {
+    h ^= c;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+TableSchema SlowQueryLog::schema() {
+  std::vector<Column> cols;
+  auto add = [&](const char *name, ColumnType type) {
+    Column c;
+    c.name = name;
+    c.type = type;
+    c.nullable = false;
+    cols.push_back(std::move(c));
+  };
+  add("id", ColumnType::Integer);
+  add("started_at_us", ColumnType::Integer);
+  add("duration_us", ColumnType::Integer);
+  add("query", ColumnType::String);
+  add("fingerprint", ColumnType::String);
+  add("fingerprint_hash", ColumnType::String);
+  add("plan", ColumnType::String);
+  add("rows_scanned", ColumnType::Integer);
+  add("rows_returned", ColumnType::Integer);
+  add("allocations", ColumnType::Integer);
+  add("bytes_allocated", ColumnType::Integer);
+  add("status", ColumnType::String);
+  return TableSchema(std::move(cols));
+}
+
+std::vector<Row> SlowQueryLog::rows() const {
+  std::vector<Row> out;
+  for (const auto &e : entries()) {
+    auto integer = [](uint64_t v) {
+      return ValueFactory::createInteger(static_cast<int64_t>(v));
+    };
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx",
+                  static_cast<unsigned long long>(e.fingerprintHash));
+    Row row(12);
+    row.set(0, integer(e.id));
+    row.set(1, ValueFactory::createInteger(e.startedAtUs));
+    row.set(2, integer(e.durationUs));
+    row.set(3, ValueFactory::createString(e.query));
+    row.set(4, ValueFactory::createString(e.fingerprint));
+    row.set(5, ValueFactory::createString(hash));
+    row.set(6, ValueFactory::createString(e.plan));
+    row.set(7, integer(e.rowsScanned));
+    row.set(8, integer(e.rowsReturned));
+    row.set(9, integer(e.allocations));
+    row.set(10, integer(e.bytesAllocated));
+    row.set(11, ValueFactory::createString(e.status));
+    out.push_back(std::move(row));
+  }
+  return out;
+}
+
+} // namespace kadedb
@@ -0,0 +1,131 @@
+#include "kadedb/physical_plan.h"
+#include "kadedb/serialization.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace kadedb {
+namespace kadeql {
+
+namespace {
+
+Status ioError(const std::string &what, const std::string &path) {
+  return Status::Internal(what + " " +
+                          (path.empty() ? "temporary file" : path) + ": " +
+                          std::strerror(errno));
+}
+
+// Unique among the files this process creates
+std::string spillPath(const std::string &directory) {
+  static std::atomic<uint64_t> counter{0};
+#ifdef _WIN32
+  const long pid = static_cast<long>(::_getpid());
+#else
+  const long pid = static_cast<long>(::getpid());
+#endif
+  std::string path = directory;
+  if (path.back() != '/' && path.back() != '\\')
+    path += '/';
+  return path + "kadedb-spill-" + std::to_string(pid) + "-" +
+         std::to_string(counter.fetch_add(1)) + ".tmp";
+}
+
+} // namespace
+
+Result<std::unique_ptr<SpillFile>>
+SpillFile::create(const std::string &directory) {
+  using R = Result<std::unique_ptr<SpillFile>>;
+  std::string path;
+  std::FILE *f = nullptr;
+  if (directory.empty()) {
+    f = std::tmpfile();
+  } else {
+    path = spillPath(directory);
+    f = std::fopen(path.c_str(), "w+b");
+  }
+  if (!f)
+    return R::err(ioError("cannot create", path));
+  return R::ok(std::unique_ptr<SpillFile>(new SpillFile(f, std::move(path))));
+}
+
+SpillFile::~SpillFile() {
+  std::fclose(file_);
+  if (!path_.empty())
+    std::remove(path_.c_str());
+}
+
+Status SpillFile::append(Cells row) {
+  if (reading_)
+    return Status::FailedPrecondition("Spill file is being read");
+  pending_.push_back(std::move(row));
+  ++rows_;
+  return pending_.size() >= kBatchRows ? flush() : Status::OK();
+}
+
+// Frame: [u64 encoded size][row batch]
+Status SpillFile::flush() {
+  if (pending_.empty())
+    return Status::OK();
+  std::vector<Row> rows;
+  rows.reserve(pending_.size());
+  for (auto &cells : pending_) {
+    Row row(cells.size());
+    for (size_t i = 0; i < cells.size(); ++i)
+      row.set(i, std::move(cells[i]));
+    rows.push_back(std::move(row));
+  }
+  pending_.clear();
+  buf_.assign(sizeof(uint64_t), '\0');
+  try {
+    bin::writeRowBatch(rows, buf_);
+  } catch (const SerializationError &e) {
+    return Status::Internal(std::string("Cannot spill rows: ") + e.what());
+  }
+  const uint64_t size = buf_.size() - sizeof(uint64_t);
+  std::memcpy(&buf_[0], &size, sizeof(size));
+  if (std::fwrite(buf_.data(), 1, buf_.size(), file_) != buf_.size())
+    return ioError("cannot write", path_);
+  bytes_ += buf_.size();
+  return Status::OK();
+}
+
+Status SpillFile::read(std::vector<Cells> &rows) {
+  rows.clear();
+  if (!reading_) {
+    if (auto st = flush(); !st.ok())
+      return st;
+    reading_ = true;
+    if (std::fflush(file_) != 0 || std::fseek(file_, 0, SEEK_SET) != 0)
+      return ioError("cannot rewind", path_);
+  }
+  uint64_t size = 0;
+  const size_t got = std::fread(&size, 1, sizeof(size), file_);
+  if (got == 0 && std::feof(file_))
+    return Status::OK();
+  if (got != sizeof(size))
+    return ioError("cannot read", path_);
+  buf_.resize(static_cast<size_t>(size));
+  if (std::fread(&buf_[0], 1, buf_.size(), file_) != buf_.size())
+    return ioError("cannot read", path_);
+  try {
+    std::vector<Row> batch = bin::readRowBatch(buf_.data(), buf_.size());
+    rows.reserve(batch.size());
+    for (auto &row : batch)
+      rows.push_back(row.release());
+  } catch (const SerializationError &e) {
+    return Status::Internal(std::string("Cannot read spilled rows: ") +
+                            e.what());
+  }
+  return Status::OK();
+}
+
+} // namespace kadeql
+} // namespace kadedb
@@ -0,0 +1,493 @@
+#include "kadedb/statistics.h"
+
+#include "kadedb/storage.h" // Predicate
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <string_view>
+
+namespace kadedb {
+
+namespace {
+// Fallback selectivities when statistics cannot judge a comparison
+constexpr double kDefaultEq = 0.1;
+constexpr double kDefaultRange = 1.0 / 3.0;
+
+// Helper: splitmix64 finalizer, spreads any input over all 64 bits
+uint64_t mix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ull;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBull;
+  x ^= x >> 31;
+  return x;
+}
+
+bool isNumeric(const InlineValue &v) {
+  return !v.empty() &&
+         (v.type() == ValueType::Integer || v.type() == ValueType::Float);
+}
+
+double clamp01(double x) { return std::min(1.0, std::max(0.0, x)); }
+} // namespace
+
+// ---- HyperLogLog ----
+
+void HyperLogLog::add(uint64_t hash) {
+  const size_t idx = static_cast<size_t>(hash >> (64 - kPrecision));
+  const uint64_t rest = hash << kPrecision;
+  // Position of the leftmost set bit of the remaining bits
+  const uint8_t rank =
+      rest == 0 ? static_cast<uint8_t>(64 - kPrecision + 1)
+                : static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+  registers_[idx] = std::max(registers_[idx], rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog &other) {
+  for (size_t i = 0; i < kRegisters; ++i)
+    registers_[i] = std::max(registers_[i], other.registers_[i]);
+}
+
+double HyperLogLog::estimate() const {
+  const double m = static_cast<double>(kRegisters);
+  double sum = 0;
+  size_t zeros = 0;
+  for (uint8_t r : registers_) {
+    sum += 1.0 / static_cast<double>(uint64_t{1} << r);
+    zeros += r == 0;
+  }
+  const double alpha = 0.7213 / (1.0 + 1.079 / m);
+  const double raw = alpha * m * m / sum;
+  // Small cardinalities: linear counting over the empty registers
+  if (raw <= 2.5 * m && zeros > 0)
+    return m * std::log(m / static_cast<double>(zeros));
+  return raw;
+}
+
+uint64_t cellHash(const InlineValue &v) {
+  switch (v.type()) {
+  case ValueType::Integer:
+    return mix64(static_cast<uint64_t>(v.asInt()));
+  case ValueType::Float: {
+    double d = v.asFloat();
+    if (d == 0.0)
+      return mix64(0); // +0.0 and -0.0
+    if (std::trunc(d) == d && std::fabs(d) < 9007199254740992.0)
+      return mix64(static_cast<uint64_t>(static_cast<int64_t>(d)));
+    uint64_t bits = 0;
+    std::memcpy(&bits, &d, sizeof bits);
+    return mix64(bits ^ 0x5851F42D4C957F2Dull);
+  }
+  case ValueType::String:
+    return mix64(std::hash<std::string_view>()(
+        std::string_view(v.stringData(), v.stringSize())));
+  case ValueType::Boolean:
+    return mix64(v.asBool() ? 0xB5u : 0x4Au);
+  case ValueType::Null:
+    break;
+  }
+  return 0;
+}
+
+// ---- TDigest ----
+
+namespace {
+constexpr double kPi = 3.14159265358979323846;
+
+// Scale function k1 of the t-digest paper and its inverse: a centroid
+// spans at most one unit of k, so centroids shrink toward q = 0 and 1
+double digestScale(double q) {
+  return TDigest::kCompression / (2 * kPi) * std::asin(2 * q - 1);
+}
+double digestScaleInverse(double k) {
+  k = std::min(k, TDigest::kCompression / 4);
+  return (std::sin(k * 2 * kPi / TDigest::kCompression) + 1) / 2;
+}
+
+// Values buffered before they are folded into the centroids
+constexpr size_t kDigestBuffer = static_cast<size_t>(TDigest::kCompression);
+} // namespace
+
+void TDigest::add(double x, double weight) {
+  if (!(weight > 0) || std::isnan(x))
+    return;
+  if (total_ == 0) {
+    min_ = max_ = x;
+  } else {
+    min_ = std::min(min_, x);
+    max_ = std::max(max_, x);
+  }
+  buffer_.push_back(Centroid{x, weight});
+  total_ += weight;
+  if (buffer_.size() >= kDigestBuffer)
+    compress();
+}
+
+void TDigest::merge(const TDigest &other) {
+  if (other.empty())
+    return;
+  if (empty()) {
+    min_ = other.min_;
+    max_ = other.max_;
+  } else {
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+  }
+  buffer_.insert(buffer_.end(), other.centroids_.begin(),
+                 other.centroids_.end());
+  buffer_.insert(buffer_.end(), other.buffer_.begin(), other.buffer_.end());
+  total_ += other.total_;
+  compress();
+}
+
+void TDigest::compress() {
+  if (buffer_.empty())
+    return;
+  std::vector<Centroid> all;
+  all.reserve(centroids_.size() + buffer_.size());
+  all.insert(all.end(), centroids_.begin(), centroids_.end());
+  all.insert(all.end(), buffer_.begin(), buffer_.end());
+  buffer_.clear();
+  std::sort(all.begin(), all.end(), [](const Centroid &a, const Centroid &b) {
+    return a.mean < b.mean;
+  });
+  // Greedily merge neighbours while the merged centroid stays within one
+  // unit of k from where it starts
+  centroids_.clear();
+  centroids_.push_back(all.front());
+  double before = 0; // weight left of the current centroid
+  double limit = total_ * digestScaleInverse(digestScale(0) + 1);
+  for (size_t i = 1; i < all.size(); ++i) {
+    Centroid &cur = centroids_.back();
+    if (before + cur.weight + all[i].weight <= limit) {
+      cur.weight += all[i].weight;
+      cur.mean += (all[i].mean - cur.mean) * all[i].weight / cur.weight;
+      continue;
+    }
+    before += cur.weight;
+    limit = total_ * digestScaleInverse(digestScale(before / total_) + 1);
+    centroids_.push_back(all[i]);
+  }
+}
+
+double TDigest::quantile(double q) const {
+  if (empty() || std::isnan(q))
+    return std::numeric_limits<double>::quiet_NaN();
+  if (!buffer_.empty()) {
+    TDigest folded = *this;
+    folded.compress();
+    return folded.quantile(q);
+  }
+  if (q <= 0)
+    return min_;
+  if (q >= 1)
+    return max_;
+  // Each centroid's weight sits around its mean: interpolate between
+  // neighbouring means, and toward min/max in the tails
+  const double target = q * total_;
+  const Centroid &front = centroids_.front();
+  if (target < front.weight / 2)
+    return min_ + (front.mean - min_) * target / (front.weight / 2);
+  double at = front.weight / 2;
+  for (size_t i = 0; i + 1 < centroids_.size(); ++i) {
+    const double gap = (centroids_[i].weight + centroids_[i + 1].weight) / 2;
+    if (target < at + gap)
+      return centroids_[i].mean + (centroids_[i + 1].mean -
+                                   centroids_[i].mean) *
+                                      (target - at) / gap;
+    at += gap;
+  }
+  const Centroid &back = centroids_.back();
+  const double rest = total_ - at;
+  return rest > 0 ? back.mean + (max_ - back.mean) * (target - at) / rest
+                  : max_;
+}
+
+size_t TDigest::bytes() const {
+  return sizeof(TDigest) +
+         (centroids_.capacity() + buffer_.capacity()) * sizeof(Centroid);
+}
+
+// ---- EquiDepthHistogram ----
+
+EquiDepthHistogram EquiDepthHistogram::build(std::vector<double> values,
+                                             size_t buckets) {
+  EquiDepthHistogram h;
+  const size_t n = values.size();
+  if (n == 0 || buckets == 0)
+    return h;
+  std::sort(values.begin(), values.end());
+  const size_t b = std::min(buckets, n);
+  h.bounds_.reserve(b + 1);
+  h.bounds_.push_back(values.front());
+  for (size_t i = 1; i < b; ++i)
+    h.bounds_.push_back(values[i * n / b]);
+  h.bounds_.push_back(values.back());
+  return h;
+}
+
+double EquiDepthHistogram::fractionBelow(double x, bool inclusive) const {
+  if (empty())
+    return 0;
+  double whole = 0;
+  for (size_t i = 0; i + 1 < bounds_.size(); ++i) {
+    const double lo = bounds_[i], hi = bounds_[i + 1];
+    if (hi < x || (inclusive && hi == x)) {
+      whole += 1;
+      continue;
+    }
+    // Buckets are ascending: none of the later ones reach below x either
+    if (lo > x || (!inclusive && lo == x))
+      break;
+    if (hi > lo)
+      whole += (x - lo) / (hi - lo);
+    break;
+  }
+  return whole / static_cast<double>(bucketCount());
+}
+
+// ---- TableStatistics ----
+
+const ColumnStatistics *
+TableStatistics::column(const std::string &name) const {
+  for (const auto &c : columns)
+    if (c.name == name)
+      return &c;
+  return nullptr;
+}
+
+// Helper: share of a column's values equal to `rhs`
+static double equalShare(const ColumnStatistics &col, const Value &rhs) {
+  if (col.min && col.max &&
+      (col.min->compare(rhs) > 0 || col.max->compare(rhs) < 0))
+    return 0;
+  double share = col.distinct >= 1 ? 1.0 / col.distinct : kDefaultEq;
+  InlineValue v = InlineValue::fromValue(&rhs);
+  if (isNumeric(v) && !col.histogram.empty()) {
+    // Heavy hitters fill whole zero-width buckets
+    const double x = v.asFloat();
+    share = std::max(share, col.histogram.fractionBelow(x, true) -
+                                col.histogram.fractionBelow(x, false));
+  }
+  return share;
+}
+
+// Helper: share of a column's values below `rhs` (or at most, when
+// `inclusive`)
+static double belowShare(const ColumnStatistics &col, const Value &rhs,
+                         bool inclusive) {
+  if (col.min && col.max) {
+    const int toMin = col.min->compare(rhs); // sign of min - rhs
+    const int toMax = col.max->compare(rhs);
+    if (toMin > 0 || (toMin == 0 && !inclusive))
+      return 0;
+    if (toMax < 0 || (toMax == 0 && inclusive))
+      return 1;
+  }
+  InlineValue v = InlineValue::fromValue(&rhs);
+  if (!isNumeric(v))
+    return kDefaultRange;
+  const double x = v.asFloat();
+  if (!col.histogram.empty())
+    return col.histogram.fractionBelow(x, inclusive);
+  if (col.min && col.max && isNumeric(*col.min) && isNumeric(*col.max)) {
+    const double lo = col.min->asFloat(), hi = col.max->asFloat();
+    if (hi > lo)
+      return clamp01((x - lo) / (hi - lo));
+  }
+  return kDefaultRange;
+}
+
+double TableStatistics::selectivity(const Predicate &p) const {
+  using K = Predicate::Kind;
+  switch (p.kind) {
+  case K::Comparison: {
+    const ColumnStatistics *col = column(p.column);
+    // Unknown columns and missing operands never match
+    if (!col || !p.rhs || rowCount == 0)
+      return 0;
+    const double present =
+        static_cast<double>(col->nonNull) / static_cast<double>(rowCount);
+    const Value &rhs = *p.rhs;
+    double share = 0;
+    switch (p.op) {
+    case Predicate::Op::Eq:
+      share = equalShare(*col, rhs);
+      break;
+    case Predicate::Op::Ne:
+      share = 1 - equalShare(*col, rhs);
+      break;
+    case Predicate::Op::Lt:
+      share = belowShare(*col, rhs, false);
+      break;
+    case Predicate::Op::Le:
+      share = belowShare(*col, rhs, true);
+      break;
+    case Predicate::Op::Gt:
+      share = 1 - belowShare(*col, rhs, true);
+      break;
+    case Predicate::Op::Ge:
+      share = 1 - belowShare(*col, rhs, false);
+      break;
+    }
+    return clamp01(present * share);
+  }
+  case K::And: {
+    double s = 1;
+    for (const auto &ch : p.children)
+      s *= selectivity(ch);
+    return s;
+  }
+  case K::Or: {
+    double none = 1;
+    for (const auto &ch : p.children)
+      none *= 1 - selectivity(ch);
+    return 1 - none;
+  }
+  case K::Not:
+    return p.children.empty() ? 0 : 1 - selectivity(p.children.front());
+  }
+  return 1;
+}
+
+double
+TableStatistics::estimateRows(const std::optional<Predicate> &where) const {
+  const double rows = static_cast<double>(rowCount);
+  return where ? rows * selectivity(*where) : rows;
+}
+
+// ---- StatisticsCollector ----
+
+StatisticsCollector::StatisticsCollector(const TableSchema &schema)
+    : state_(schema.columns().size()) {
+  for (const auto &c : schema.columns()) {
+    names_.push_back(c.name);
+    types_.push_back(c.type);
+  }
+}
+
+uint64_t StatisticsCollector::nextRandom() {
+  // xorshift64*: deterministic, so plans are reproducible
+  rng_ ^= rng_ >> 12;
+  rng_ ^= rng_ << 25;
+  rng_ ^= rng_ >> 27;
+  return rng_ * 0x2545F4914F6CDD1Dull;
+}
+
+void StatisticsCollector::addCell(size_t column, const InlineValue &cell) {
+  if (cell.empty() || cell.type() == ValueType::Null)
+    return;
+  ColumnState &st = state_[column];
+  ++st.nonNull;
+  st.distinct.add(cellHash(cell));
+  if (isNumeric(cell) && std::isnan(cell.asFloat()))
+    return; // NaN has no place in an order
+  if (!st.min || cell.compare(*st.min) < 0)
+    st.min = cell;
+  if (!st.max || cell.compare(*st.max) > 0)
+    st.max = cell;
+  if (!isNumeric(cell))
+    return;
+  // Reservoir sampling keeps a uniform sample of every value added
+  ++st.seen;
+  if (st.sample.size() < kSampleSize) {
+    st.sample.push_back(cell.asFloat());
+  } else {
+    const uint64_t j = nextRandom() % st.seen;
+    if (j < kSampleSize)
+      st.sample[j] = cell.asFloat();
+  }
+}
+
+void StatisticsCollector::removeCell(size_t column, const InlineValue &cell) {
+  if (cell.empty() || cell.type() == ValueType::Null)
+    return;
+  ColumnState &st = state_[column];
+  if (st.nonNull > 0)
+    --st.nonNull;
+}
+
+void StatisticsCollector::add(const InlineRow &row) {
+  for (size_t c = 0; c < state_.size() && c < row.size(); ++c)
+    addCell(c, row.values()[c]);
+  ++rowCount_;
+  ++changes_;
+}
+
+void StatisticsCollector::add(const Row &row) {
+  for (size_t c = 0; c < state_.size() && c < row.size(); ++c)
+    addCell(c, InlineValue::fromValue(row.values()[c].get()));
+  ++rowCount_;
+  ++changes_;
+}
+
+void StatisticsCollector::remove(const InlineRow &row) {
+  for (size_t c = 0; c < state_.size() && c < row.size(); ++c)
+    removeCell(c, row.values()[c]);
+  if (rowCount_ > 0)
+    --rowCount_;
+  ++removed_;
+  ++changes_;
+}
+
+void StatisticsCollector::remove(const Row &row) {
+  for (size_t c = 0; c < state_.size() && c < row.size(); ++c)
+    removeCell(c, InlineValue::fromValue(row.values()[c].get()));
+  if (rowCount_ > 0)
+    --rowCount_;
+  ++removed_;
+  ++changes_;
+}
+
+void StatisticsCollector::clear() {
+  for (auto &st : state_)
+    st = ColumnState{};
+  rowCount_ = 0;
+  removed_ = 0;
+  // The cache no longer describes the rows
+  cache_.reset();
+}
+
+TableStatistics StatisticsCollector::snapshot() const {
+  TableStatistics out;
+  out.rowCount = rowCount_;
+  out.columns.reserve(state_.size());
+  for (size_t c = 0; c < state_.size(); ++c) {
+    const ColumnState &st = state_[c];
+    ColumnStatistics col;
+    col.name = names_[c];
+    col.type = types_[c];
+    col.nonNull = st.nonNull;
+    if (st.nonNull > 0) {
+      col.min = st.min;
+      col.max = st.max;
+      col.distinct = std::min(st.distinct.estimate(),
+                              static_cast<double>(st.nonNull));
+      col.histogram = EquiDepthHistogram::build(st.sample, kHistogramBuckets);
+    }
+    out.columns.push_back(std::move(col));
+  }
+  return out;
+}
+
+std::shared_ptr<const TableStatistics> StatisticsCollector::cached() const {
+  bool refresh = !cache_;
+  if (!refresh) {
+    // Retake when the row count drifted by a tenth, or once a table's
+    // worth of rows changed in place
+    const size_t was = cache_->rowCount;
+    const size_t drift = rowCount_ > was ? rowCount_ - was : was - rowCount_;
+    refresh = drift > was / 10 ||
+              changes_ - cachedAt_ > std::max(was, kMinRefreshChanges);
+  }
+  if (refresh) {
+    cache_ = std::make_shared<const TableStatistics>(snapshot());
+    cachedAt_ = changes_;
+  }
+  return cache_;
+}
+
+} // namespace kadedb
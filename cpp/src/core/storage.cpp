@@ -1,21 +1,20 @@
 #include "kadedb/storage.h"
+#include "kadedb/cancellation.h"
+#include "kadedb/key_encoding.h"
+#include "kadedb/memory.h"
+#include "kadedb/metrics.h"
+#include "kadedb/thread_pool.h"
+#include "kadedb/tracing.h"
 
+#include <algorithm>
+#include <limits>
 #include <unordered_set>
 
 namespace kadedb {
 
-// Utility: evaluate a comparison predicate on a row
-static bool evalPredicateComparison(const TableSchema &schema, const Row &row,
-                                    const Predicate &pred) {
-  size_t idx = schema.findColumn(pred.column);
-  if (idx == TableSchema::npos)
-    return false; // unknown column -> not matched
-  const Value *lhs = row.values()[idx].get();
-  const Value *rhs = pred.rhs.get();
-  if (!lhs || !rhs)
-    return false; // null comparisons -> no match (semantics retained)
-  int cmp = lhs->compare(*rhs);
-  switch (pred.op) {
+// Utility: apply a comparison operator to a three-way compare result
+static bool applyOp(Predicate::Op op, int cmp) {
+  switch (op) {
   case Predicate::Op::Eq:
     return cmp == 0;
   case Predicate::Op::Ne:
@@ -32,94 +31,1029 @@ static bool evalPredicateComparison(const TableSchema &schema, const Row &row,
   return false;
 }
 
-// Forward declaration for evalPredicate used earlier in this file
-static bool evalPredicate(const TableSchema &schema, const Row &row,
-                          const Predicate &pred);
+std::string Predicate::toString() const {
+  static const char *const kOps[] = {"=", "!=", "<", "<=", ">", ">="};
+  switch (kind) {
+  case Kind::Comparison:
+    return column + " " + kOps[static_cast<int>(op)] + " " +
+           (rhs ? rhs->toString() : std::string("null"));
+  case Kind::Not:
+    return "NOT " + (children.empty() ? std::string("TRUE")
+                                      : children.front().toString());
+  case Kind::And:
+  case Kind::Or:
+    break;
+  }
+  const bool isAnd = kind == Kind::And;
+  if (children.empty())
+    return isAnd ? "TRUE" : "FALSE";
+  if (children.size() == 1)
+    return children.front().toString();
+  std::string out = "(";
+  for (size_t i = 0; i < children.size(); ++i) {
+    if (i > 0)
+      out += isAnd ? " AND " : " OR ";
+    out += children[i].toString();
+  }
+  return out + ")";
+}
 
-Result<size_t> InMemoryRelationalStorage::updateRowsWith(
-    const std::string &table, const RowUpdater &updater,
-    const std::optional<Predicate> &where) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto it = tables_.find(table);
-  if (it == tables_.end())
-    return Result<size_t>::err(Status::NotFound("Unknown table: " + table));
+Predicate copyPredicate(const Predicate &p) {
+  Predicate out;
+  out.kind = p.kind;
+  out.column = p.column;
+  out.op = p.op;
+  if (p.rhs)
+    out.rhs = p.rhs->clone();
+  for (const auto &c : p.children)
+    out.children.push_back(copyPredicate(c));
+  return out;
+}
 
-  auto &tableData = it->second;
-  const auto &schema = tableData.schema;
+BoundPredicate BoundPredicate::bind(const Predicate &pred,
+                                    const TableSchema &schema) {
+  BoundPredicate out;
+  out.kind = pred.kind;
+  if (pred.kind != Predicate::Kind::Comparison) {
+    out.children.reserve(pred.children.size());
+    for (const auto &ch : pred.children)
+      out.children.push_back(bind(ch, schema));
+    return out;
+  }
+  out.op = pred.op;
+  out.rhs = pred.rhs.get();
+  if (out.rhs) {
+    out.column = schema.findColumn(pred.column);
+    out.inlineRhs = InlineValue::fromValue(out.rhs);
+  }
+  return out;
+}
 
-  // Work on a copy for atomicity
-  auto newRows = tableData.rows; // deep rows
+bool BoundPredicate::matches(const InlineRow &row) const {
+  using K = Predicate::Kind;
+  switch (kind) {
+  case K::Comparison: {
+    if (column == TableSchema::npos)
+      return false; // unknown column or no rhs -> not matched
+    const InlineValue &lhs = row.values()[column];
+    if (lhs.empty())
+      return false; // null comparisons -> no match (semantics retained)
+    // Tagged-union compare on both sides: no virtual dispatch
+    return applyOp(op, lhs.compare(inlineRhs));
+  }
+  case K::And:
+    // AND with zero children -> true (neutral element)
+    for (const auto &ch : children) {
+      if (!ch.matches(row))
+        return false;
+    }
+    return true;
+  case K::Or:
+    // OR with zero children -> false (neutral element)
+    for (const auto &ch : children) {
+      if (ch.matches(row))
+        return true;
+    }
+    return false;
+  case K::Not:
+    // NOT expects exactly one child; if none, treat as true negated -> false
+    return !children.empty() && !children.front().matches(row);
+  }
+  return false;
+}
 
-  size_t updated = 0;
-  for (auto &r : newRows) {
-    if (where && !evalPredicate(schema, r, *where))
+bool BoundPredicate::matches(
+    const std::vector<std::unique_ptr<Value>> &cells) const {
+  using K = Predicate::Kind;
+  switch (kind) {
+  case K::Comparison: {
+    if (column == TableSchema::npos || column >= cells.size())
+      return false;
+    const Value *lhs = cells[column].get();
+    return lhs && applyOp(op, lhs->compare(*rhs));
+  }
+  case K::And:
+    for (const auto &ch : children) {
+      if (!ch.matches(cells))
+        return false;
+    }
+    return true;
+  case K::Or:
+    for (const auto &ch : children) {
+      if (ch.matches(cells))
+        return true;
+    }
+    return false;
+  case K::Not:
+    return !children.empty() && !children.front().matches(cells);
+  }
+  return false;
+}
+
+bool BoundPredicate::mayMatch(const ZoneMap &zone) const {
+  using K = Predicate::Kind;
+  switch (kind) {
+  case K::Comparison: {
+    if (column == TableSchema::npos)
+      return false;
+    if (column >= zone.columns.size())
+      return true;
+    const ColumnZone &cz = zone.columns[column];
+    if (cz.present == 0)
+      return cz.absent == 0; // absent cells never match
+    int lo = 0, hi = 0;
+    if (!cz.compareRange(inlineRhs, lo, hi))
+      return true;
+    for (int c = lo; c <= hi; ++c)
+      if (applyOp(op, c))
+        return true;
+    return false;
+  }
+  case K::And:
+    for (const auto &ch : children) {
+      if (!ch.mayMatch(zone))
+        return false;
+    }
+    return true;
+  case K::Or:
+    for (const auto &ch : children) {
+      if (ch.mayMatch(zone))
+        return true;
+    }
+    return false;
+  case K::Not:
+    // Bounds cannot show that every row matches the child
+    return !children.empty();
+  }
+  return true;
+}
+
+std::optional<size_t>
+RelationalStorage::estimateRowCount(const std::string &) const {
+  return std::nullopt;
+}
+
+std::optional<size_t>
+RelationalStorage::estimateScanCost(const std::string &table,
+                                    const std::optional<Predicate> &) const {
+  return estimateRowCount(table);
+}
+
+std::shared_ptr<const TableStatistics>
+RelationalStorage::getTableStatistics(const std::string &) const {
+  return nullptr;
+}
+
+std::string
+RelationalStorage::explainAccess(const std::string &,
+                                 const std::optional<Predicate> &) const {
+  return "full scan";
+}
+
+std::string
+RelationalStorage::explainOrderedAccess(const std::string &table,
+                                        const std::optional<Predicate> &where,
+                                        const ScanOrder &) const {
+  return explainAccess(table, where);
+}
+
+std::optional<uint64_t>
+RelationalStorage::tableVersion(const std::string &) const {
+  return std::nullopt;
+}
+
+Result<std::unique_ptr<ChangeSubscription>>
+RelationalStorage::subscribeChanges(const std::string &,
+                                    const std::optional<Predicate> &) {
+  return Result<std::unique_ptr<ChangeSubscription>>::err(
+      Status::FailedPrecondition("Change capture is not supported"));
+}
+
+uint64_t nextDataVersion() {
+  static std::atomic<uint64_t> next{1};
+  return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+Status scanResultSet(const ResultSet &rs,
+                     const RelationalStorage::BatchSink &sink,
+                     size_t batchRows) {
+  if (batchRows == 0)
+    batchRows = RelationalStorage::kDefaultBatchRows;
+  RowBatch batch;
+  batch.columnNames = rs.columnNames();
+  batch.columnTypes = rs.columnTypes();
+  size_t r = 0;
+  do {
+    batch.rows.clear();
+    for (; r < rs.rowCount() && batch.rows.size() < batchRows; ++r) {
+      std::vector<std::unique_ptr<Value>> cells;
+      cells.reserve(rs.columnCount());
+      for (const auto &v : rs.row(r).values())
+        cells.push_back(v ? v->clone() : nullptr);
+      batch.rows.push_back(std::move(cells));
+    }
+    if (!sink(batch))
+      break;
+  } while (r < rs.rowCount());
+  return Status::OK();
+}
+
+Status RelationalStorage::insertRows(const std::string &table,
+                                     const std::vector<Row> &rows) {
+  for (const auto &row : rows)
+    if (auto st = insertRow(table, row); !st.ok())
+      return st;
+  return Status::OK();
+}
+
+Result<UpsertCounts>
+RelationalStorage::upsertRows(const std::string &table,
+                              const std::vector<Row> &rows,
+                              const UpsertMerger &merge) {
+  using R = Result<UpsertCounts>;
+  auto schemaRes = getTableSchema(table);
+  if (!schemaRes.hasValue())
+    return R::err(schemaRes.status());
+  const TableSchema &schema = schemaRes.value();
+  if (!schema.primaryKey())
+    return R::err(
+        Status::InvalidArgument("Upsert needs a primary key: " + table));
+  const std::string &keyName = *schema.primaryKey();
+  const size_t key = schema.findColumn(keyName);
+  UpsertCounts counts;
+  // Keys the batch wrote: a row is counted once, as inserted if it was
+  std::unordered_set<std::string> written;
+  for (size_t i = 0; i < rows.size(); ++i) {
+    const Row &row = rows[i];
+    const Value *k = key < row.size() ? row.values()[key].get() : nullptr;
+    if (!k || k->type() == ValueType::Null)
+      return R::err(Status::InvalidArgument("Row " + std::to_string(i) +
+                                            ": null primary key"));
+    std::string code;
+    keycode::appendValue(code, k);
+    Predicate eq;
+    eq.column = keyName;
+    eq.op = Predicate::Op::Eq;
+    eq.rhs = k->clone();
+    std::optional<Predicate> where(std::move(eq));
+    auto found = select(table, {}, where);
+    if (!found.hasValue())
+      return R::err(found.status());
+    if (found.value().rowCount() == 0) {
+      if (auto st = insertRow(table, row); !st.ok())
+        return R::err(st);
+      ++counts.inserted;
+      written.insert(std::move(code));
       continue;
-    // Let the updater mutate the row
-    Status st = updater(r, schema);
-    if (!st.ok())
-      return Result<size_t>::err(st);
-    // Validate the updated row against schema
-    if (auto err = SchemaValidator::validateRow(schema, r); !err.empty()) {
-      return Result<size_t>::err(Status::InvalidArgument(err));
     }
-    ++updated;
+    // Merge into a copy first, so that a no-op writes nothing
+    const auto &cells = found.value().row(0).values();
+    Row current(cells.size());
+    for (size_t c = 0; c < cells.size(); ++c)
+      current.set(c, cells[c] ? cells[c]->clone() : nullptr);
+    Row next = row;
+    if (merge) {
+      next = current;
+      if (auto st = merge(next, row, schema); !st.ok())
+        return R::err(st);
+      const Value *after =
+          key < next.size() ? next.values()[key].get() : nullptr;
+      if (!after || after->compare(*k) != 0)
+        return R::err(Status::InvalidArgument(
+            "Upsert cannot change primary key column '" + keyName + "'"));
+    }
+    bool same = next.size() == current.size();
+    for (size_t c = 0; same && c < next.size(); ++c) {
+      const Value *a = next.values()[c].get(), *b = current.values()[c].get();
+      same = (!a || !b) ? a == b
+                        : a->type() == b->type() && a->compare(*b) == 0;
+    }
+    if (same)
+      continue;
+    auto upd = updateRowsWith(
+        table,
+        [&](Row &target, const TableSchema &) {
+          target = next;
+          return Status::OK();
+        },
+        where);
+    if (!upd.hasValue())
+      return R::err(upd.status());
+    if (upd.value() > 0 && written.insert(std::move(code)).second)
+      ++counts.updated;
+  }
+  return R::ok(counts);
+}
+
+Status RelationalStorage::scan(const std::string &table,
+                               const std::vector<std::string> &columns,
+                               const std::optional<Predicate> &where,
+                               const BatchSink &sink, size_t batchRows) {
+  auto res = select(table, columns, where);
+  if (!res.hasValue())
+    return res.status();
+  return scanResultSet(res.value(), sink, batchRows);
+}
+
+Status RelationalStorage::scanOrdered(const std::string &table,
+                                      const std::vector<std::string> &columns,
+                                      const std::optional<Predicate> &where,
+                                      const ScanOrder &, const BatchSink &sink,
+                                      size_t batchRows) {
+  return scan(table, columns, where, sink, batchRows);
+}
+
+namespace {
+// State of one field after a patch
+struct FieldChange {
+  std::string field;
+  bool present = false;
+  std::unique_ptr<Value> value; // nullptr: no value (or not present)
+};
+} // namespace
+
+static bool isNumber(const Value *v) {
+  return v &&
+         (v->type() == ValueType::Integer || v->type() == ValueType::Float);
+}
+
+// Utility: the net effect of `ops` on the fields they touch, in order of
+// first touch; `current(field)` reads the document before the patch
+static Result<std::vector<FieldChange>> resolveDocUpdates(
+    const std::function<FieldRef(const std::string &)> &current,
+    const std::vector<DocUpdate> &ops) {
+  using R = Result<std::vector<FieldChange>>;
+  std::vector<FieldChange> out;
+  for (const auto &op : ops) {
+    if (op.field.empty())
+      return R::err(Status::InvalidArgument("Empty field name in update"));
+    auto it = std::find_if(out.begin(), out.end(), [&](const FieldChange &c) {
+      return c.field == op.field;
+    });
+    if (it == out.end()) {
+      FieldChange c;
+      c.field = op.field;
+      // Only an increment reads the current value
+      if (op.op == DocUpdate::Op::Inc) {
+        FieldRef f = current(op.field);
+        c.present = f.found();
+        c.value = f.clone();
+      }
+      out.push_back(std::move(c));
+      it = out.end() - 1;
+    }
+    switch (op.op) {
+    case DocUpdate::Op::Set:
+      it->present = true;
+      it->value = op.value ? op.value->clone() : nullptr;
+      break;
+    case DocUpdate::Op::Unset:
+      it->present = false;
+      it->value.reset();
+      break;
+    case DocUpdate::Op::Inc: {
+      const Value *by = op.value.get();
+      if (!isNumber(by))
+        return R::err(Status::InvalidArgument(
+            "Increment of field '" + op.field + "' is not a number"));
+      if (!it->present) {
+        it->present = true;
+        it->value = by->clone();
+        break;
+      }
+      if (!isNumber(it->value.get()))
+        return R::err(Status::InvalidArgument(
+            "Cannot increment non-numeric field '" + op.field + "'"));
+      if (it->value->type() == ValueType::Float ||
+          by->type() == ValueType::Float) {
+        it->value = ValueFactory::createFloat(it->value->asFloat() +
+                                              by->asFloat());
+        break;
+      }
+      const int64_t a = it->value->asInt(), b = by->asInt();
+      if ((b > 0 && a > std::numeric_limits<int64_t>::max() - b) ||
+          (b < 0 && a < std::numeric_limits<int64_t>::min() - b))
+        return R::err(Status::InvalidArgument(
+            "Integer overflow incrementing field '" + op.field + "'"));
+      it->value = ValueFactory::createInteger(a + b);
+      break;
+    }
+    }
+  }
+  return R::ok(std::move(out));
+}
+
+Status applyDocUpdates(Document &doc, const std::vector<DocUpdate> &ops) {
+  auto res = resolveDocUpdates(
+      [&](const std::string &field) {
+        auto it = doc.find(field);
+        return it == doc.end() ? FieldRef() : FieldRef(it->second.get());
+      },
+      ops);
+  if (!res.hasValue())
+    return res.status();
+  for (auto &c : res.value()) {
+    if (c.present)
+      doc[c.field] = std::move(c.value);
+    else
+      doc.erase(c.field);
+  }
+  return Status::OK();
+}
+
+Status DocumentStorage::put(const std::string &collection,
+                            const std::string &key, Document &&doc) {
+  return put(collection, key, static_cast<const Document &>(doc));
+}
+
+Status DocumentStorage::patch(const std::string &collection,
+                             const std::string &key,
+                             const std::vector<DocUpdate> &ops) {
+  auto res = get(collection, key);
+  if (!res.hasValue())
+    return res.status();
+  Document doc = res.takeValue();
+  if (auto st = applyDocUpdates(doc, ops); !st.ok())
+    return st;
+  return put(collection, key, std::move(doc));
+}
+
+Result<size_t>
+DocumentStorage::updateWhere(const std::string &collection,
+                             const std::optional<DocPredicate> &where,
+                             const std::vector<DocUpdate> &ops) {
+  auto res = query(collection, {}, where);
+  if (!res.hasValue())
+    return Result<size_t>::err(res.status());
+  size_t patched = 0;
+  for (auto &kv : res.value()) {
+    if (auto st = applyDocUpdates(kv.second, ops); !st.ok())
+      return Result<size_t>::err(st);
+    if (auto st = put(collection, kv.first, std::move(kv.second)); !st.ok())
+      return Result<size_t>::err(st);
+    ++patched;
   }
+  return Result<size_t>::ok(patched);
+}
 
-  // Enforce uniqueness constraints after updates
-  if (auto err = SchemaValidator::validateUnique(schema, newRows);
-      !err.empty()) {
-    return Result<size_t>::err(Status::FailedPrecondition(err));
+Result<std::optional<DocumentSchema>>
+DocumentStorage::getCollectionSchema(const std::string &collection) const {
+  using R = Result<std::optional<DocumentSchema>>;
+  auto n = count(collection);
+  if (!n.hasValue())
+    return R::err(n.status());
+  return R::ok(std::nullopt);
+}
+
+Result<std::unique_ptr<ChangeSubscription>>
+DocumentStorage::subscribeChanges(const std::string &) {
+  return Result<std::unique_ptr<ChangeSubscription>>::err(
+      Status::FailedPrecondition("Change capture is not supported"));
+}
+
+Status DocumentStorage::queryVisit(const std::string &collection,
+                                   const std::vector<std::string> &fields,
+                                   const std::optional<DocPredicate> &where,
+                                   const DocumentVisitor &fn) {
+  auto res = query(collection, fields, where);
+  if (!res.hasValue())
+    return res.status();
+  for (const auto &kv : res.value())
+    if (!fn(kv.first, DocumentView(kv.second)))
+      break;
+  return Status::OK();
+}
+
+// Forward declarations for helpers used earlier in this file
+static std::string
+replaceUniqueKeys(const TableSchema &schema,
+                  std::vector<std::unordered_set<std::string>> &keys,
+                  const std::vector<const InlineRow *> &oldRows,
+                  const std::vector<InlineRow> &newRows);
+static size_t liveGrowth(const std::vector<const InlineRow *> &ended,
+                         const std::vector<InlineRow> &added);
+
+Result<size_t> InMemoryRelationalStorage::updateRowsWith(
+    const std::string &table, const RowUpdater &updater,
+    const std::optional<Predicate> &where) {
+  if (auto pt = findPartitioned(table)) {
+    const size_t key = pt->key;
+    const std::string &keyName = pt->schema.columns()[key].name;
+    // Rows stay in the partition of their key
+    RowUpdater keepKey = [&](Row &row, const TableSchema &schema) -> Status {
+      const std::string before = row.at(key).toString();
+      if (auto st = updater(row, schema); !st.ok())
+        return st;
+      const Value *after =
+          key < row.size() ? row.values()[key].get() : nullptr;
+      if (!after || after->toString() != before)
+        return Status::InvalidArgument(
+            "Cannot update partition key column '" + keyName + "'");
+      return Status::OK();
+    };
+    // One partition at a time: updaters may not be thread-safe and see the
+    // rows in partition order
+    auto one = pt->route(where);
+    const size_t first = one.value_or(0);
+    const size_t last = one ? *one + 1 : pt->parts.size();
+    size_t n = 0;
+    for (size_t i = first; i < last; ++i) {
+      auto res = pt->parts[i]->updateRowsWith(table, keepKey, where);
+      if (!res.hasValue())
+        return res;
+      n += res.value();
+    }
+    return Result<size_t>::ok(n);
   }
+  auto run = [&]() -> Result<size_t> {
+    auto td = findTable(table);
+    if (!td)
+      return Result<size_t>::err(Status::NotFound("Unknown table: " + table));
+    auto &tableData = *td;
+    const auto &schema = tableData.schema;
+    metrics::TimedLock lk(tableData.writeMtx);
+
+    // Build and validate every new version before committing any of them
+    // (atomicity); only matched rows are copied
+    std::vector<size_t> matched = tableData.matchLive(where);
+    std::vector<const InlineRow *> oldRows;
+    std::vector<InlineRow> newRows;
+    oldRows.reserve(matched.size());
+    newRows.reserve(matched.size());
+    for (size_t i : matched) {
+      const InlineRow &cur = tableData.store->at(i).row;
+      // Let the updater mutate a materialized Row, then store it back compactly
+      Row row = cur.toRow();
+      Status st = updater(row, schema);
+      if (!st.ok())
+        return Result<size_t>::err(st);
+      // Validate the updated row against schema
+      if (auto err = tableData.validator.validateRow(row); !err.empty()) {
+        return Result<size_t>::err(Status::InvalidArgument(err));
+      }
+      oldRows.push_back(&cur);
+      newRows.push_back(InlineRow::fromRow(row));
+    }
 
-  // Commit
-  tableData.rows.swap(newRows);
-  return Result<size_t>::ok(updated);
+    if (const size_t bytes = liveGrowth(oldRows, newRows);
+        !tableData.memory.fits(bytes))
+      return Result<size_t>::err(
+          memory::budgetExceeded("table", table, tableData.memory, bytes));
+    // Enforce uniqueness constraints against the per-column key sets
+    if (auto err =
+            replaceUniqueKeys(schema, tableData.uniqueKeys, oldRows, newRows);
+        !err.empty()) {
+      return Result<size_t>::err(Status::FailedPrecondition(err));
+    }
+
+    // Commit: end the old versions and append the new ones
+    tableData.commit(matched, std::move(newRows));
+    return Result<size_t>::ok(matched.size());
+  };
+  return metrics::measure(metrics::Operation::RelationalUpdate, run);
 }
 
-// Utility: evaluate predicate tree (supports And/Or/Not and Comparison)
-static bool evalPredicate(const TableSchema &schema, const Row &row,
-                          const Predicate &pred) {
+// Estimated share of rows above which an index lookup loses to a scan:
+// candidates are visited out of the scan's sequential order and sorted
+static constexpr double kIndexMaxSelectivity = 0.25;
+
+// Positions resolved from Bitmap indexes: exactly the matching positions
+// among those indexed when `exact`, a superset of them otherwise
+struct BitmapMatch {
+  RoaringBitmap rows;
+  bool exact = true;
+};
+
+// Utility: resolve a predicate over Bitmap column indexes with set
+// operations before any row is read. AND intersects the children it can
+// resolve, OR unions its children and NOT complements an exact child
+// within the `size` published positions; nullopt when a comparison has no
+// Bitmap index, or an OR or NOT child cannot be resolved.
+static std::optional<BitmapMatch>
+bitmapCandidates(const TableSchema &schema,
+                 const std::unordered_map<size_t, ColumnIndex> &indexes,
+                 const Predicate &pred, size_t size) {
   using K = Predicate::Kind;
   switch (pred.kind) {
-  case K::Comparison:
-    return evalPredicateComparison(schema, row, pred);
+  case K::Comparison: {
+    auto it = indexes.find(schema.findColumn(pred.column));
+    if (it == indexes.end() || it->second.type() != IndexType::Bitmap ||
+        !pred.rhs)
+      return std::nullopt;
+    const ColumnIndex &index = it->second;
+    const Value *rhs = pred.rhs.get();
+    BitmapMatch m;
+    std::optional<RoaringBitmap> bits;
+    switch (pred.op) {
+    case Predicate::Op::Eq:
+      bits = index.bitmapEq(*rhs, m.exact);
+      break;
+    case Predicate::Op::Ne:
+      // Present cells other than the equal ones; only an exact equality
+      // leaves every match
+      bits = index.bitmapEq(*rhs, m.exact);
+      if (!bits || !m.exact)
+        return std::nullopt;
+      m.rows = index.presentBitmap();
+      m.rows -= *bits;
+      return m;
+    case Predicate::Op::Lt:
+      bits = index.bitmapRange(nullptr, false, rhs, true, m.exact);
+      break;
+    case Predicate::Op::Le:
+      bits = index.bitmapRange(nullptr, false, rhs, false, m.exact);
+      break;
+    case Predicate::Op::Gt:
+      bits = index.bitmapRange(rhs, true, nullptr, false, m.exact);
+      break;
+    case Predicate::Op::Ge:
+      bits = index.bitmapRange(rhs, false, nullptr, false, m.exact);
+      break;
+    }
+    if (!bits)
+      return std::nullopt;
+    m.rows = std::move(*bits);
+    return m;
+  }
   case K::And: {
-    // AND with zero children -> true (neutral element)
+    // Children left unresolved are re-checked on the intersection
+    std::optional<BitmapMatch> out;
+    bool all = true;
     for (const auto &ch : pred.children) {
-      if (!evalPredicate(schema, row, ch))
-        return false;
+      auto m = bitmapCandidates(schema, indexes, ch, size);
+      if (!m) {
+        all = false;
+      } else if (!out) {
+        out = std::move(m);
+      } else {
+        out->rows &= m->rows;
+        out->exact = out->exact && m->exact;
+      }
     }
-    return true;
+    if (out)
+      out->exact = out->exact && all;
+    return out;
   }
   case K::Or: {
-    // OR with zero children -> false (neutral element)
+    if (pred.children.empty())
+      return std::nullopt;
+    BitmapMatch out;
     for (const auto &ch : pred.children) {
-      if (evalPredicate(schema, row, ch))
-        return true;
+      auto m = bitmapCandidates(schema, indexes, ch, size);
+      if (!m)
+        return std::nullopt;
+      out.rows |= m->rows;
+      out.exact = out.exact && m->exact;
     }
-    return false;
+    return out;
   }
   case K::Not: {
-    // NOT expects exactly one child; if none, treat as true negated -> false
-    if (pred.children.empty())
-      return false;
-    return !evalPredicate(schema, row, pred.children.front());
+    // Positions missing from an index (versions already dead when it was
+    // built) land in the complement, which callers' visibility re-check
+    // drops
+    if (pred.children.empty() || size > UINT32_MAX)
+      return std::nullopt;
+    auto m = bitmapCandidates(schema, indexes, pred.children.front(), size);
+    if (!m || !m->exact)
+      return std::nullopt;
+    BitmapMatch out;
+    out.rows = RoaringBitmap::range(0, static_cast<uint32_t>(size));
+    out.rows -= m->rows;
+    return out;
   }
   }
-  return false;
+  return std::nullopt;
+}
+
+// Utility: candidate row positions for a predicate answered from column
+// indexes, or nullopt when a full scan is required (no usable index, or
+// `stats` estimate that a scan is cheaper). Candidates are sorted ascending
+// and may include non-matching rows; callers re-check the predicate on each.
+// Predicates over Bitmap indexes are resolved as a whole by
+// bitmapCandidates() first, whose exact count stands in for the estimate.
+// When candidates are returned, `path` (if set) describes the lookups.
+static std::optional<std::vector<size_t>>
+indexCandidates(const TableSchema &schema,
+                const std::unordered_map<size_t, ColumnIndex> &indexes,
+                const Predicate &pred, size_t size,
+                const TableStatistics *stats, std::string *path = nullptr) {
+  using K = Predicate::Kind;
+  if (indexes.empty())
+    return std::nullopt;
+  if (auto m = bitmapCandidates(schema, indexes, pred, size);
+      m && m->rows.cardinality() <= kIndexMaxSelectivity * size) {
+    if (path)
+      *path = "bitmap index on " + pred.toString();
+    std::vector<size_t> out;
+    out.reserve(m->rows.cardinality());
+    m->rows.forEach([&](uint32_t pos) { out.push_back(pos); });
+    return out;
+  }
+  switch (pred.kind) {
+  case K::Comparison: {
+    auto it = indexes.find(schema.findColumn(pred.column));
+    // A Bitmap index was consulted above
+    if (it == indexes.end() || it->second.type() == IndexType::Bitmap ||
+        !pred.rhs)
+      return std::nullopt;
+    if (stats && stats->selectivity(pred) > kIndexMaxSelectivity)
+      return std::nullopt;
+    const ColumnIndex &index = it->second;
+    const Value *rhs = pred.rhs.get();
+    if (path && pred.op != Predicate::Op::Ne)
+      *path = "index on " + pred.toString();
+    switch (pred.op) {
+    case Predicate::Op::Eq:
+      return index.lookupEq(*rhs);
+    case Predicate::Op::Lt:
+    case Predicate::Op::Le:
+      return index.lookupRange(nullptr, rhs);
+    case Predicate::Op::Gt:
+    case Predicate::Op::Ge:
+      return index.lookupRange(rhs, nullptr);
+    case Predicate::Op::Ne:
+      break;
+    }
+    return std::nullopt;
+  }
+  case K::And: {
+    // Drive the conjunction from its most selective indexed child. With
+    // statistics only the child estimated most selective is looked up;
+    // without, every indexed child is and the smallest result wins.
+    if (stats) {
+      std::vector<std::pair<double, const Predicate *>> order;
+      for (const auto &ch : pred.children)
+        order.emplace_back(stats->selectivity(ch), &ch);
+      std::stable_sort(order.begin(), order.end(),
+                       [](const auto &a, const auto &b) {
+                         return a.first < b.first;
+                       });
+      for (const auto &[sel, ch] : order)
+        if (auto cand =
+                indexCandidates(schema, indexes, *ch, size, stats, path))
+          return cand;
+      return std::nullopt;
+    }
+    std::optional<std::vector<size_t>> best;
+    for (const auto &ch : pred.children) {
+      std::string chPath;
+      auto cand = indexCandidates(schema, indexes, ch, size, stats,
+                                  path ? &chPath : nullptr);
+      if (cand && (!best || cand->size() < best->size())) {
+        best = std::move(cand);
+        if (path)
+          *path = std::move(chPath);
+      }
+    }
+    return best;
+  }
+  case K::Or: {
+    // Union of the children; any child needing a scan forces a scan
+    std::vector<size_t> out;
+    std::string paths;
+    for (const auto &ch : pred.children) {
+      std::string chPath;
+      auto cand = indexCandidates(schema, indexes, ch, size, stats,
+                                  path ? &chPath : nullptr);
+      if (!cand)
+        return std::nullopt;
+      out.insert(out.end(), cand->begin(), cand->end());
+      paths += (paths.empty() ? "" : ", ") + chPath;
+    }
+    if (path)
+      *path = "union of (" + paths + ")";
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+  }
+  case K::Not:
+    break;
+  }
+  return std::nullopt;
+}
+
+// Utility: true when position `i` starts a chunk that was full in `snap`
+// and whose zone map rules out every match of `bound`
+static bool skipChunk(const RowVersionStore &store, const RowSnapshot &snap,
+                      const std::optional<BoundPredicate> &bound, size_t i) {
+  constexpr size_t kRows = RowVersionStore::kChunkRows;
+  if (!bound || i % kRows != 0 || i + kRows > snap.size)
+    return false;
+  const ZoneMap *zone = store.zone(i / kRows);
+  return zone && !bound->mayMatch(*zone);
+}
+
+// Utility: visit store positions of the versions in `snap` that are visible
+// and match `where` (every visible version when absent), in ascending order.
+// When `candidates` is set only those positions are considered; otherwise
+// chunks whose zone map rules `where` out are skipped. `fn` returns false
+// to stop the scan. With `interrupted` set, the scan also stops (and sets
+// it) once InterruptScope::check() fails, which it polls every
+// kInterruptRows positions; writers never pass it, as they must see every
+// match.
+constexpr size_t kInterruptRows = 4096;
+template <typename Fn>
+static void forEachMatch(const TableSchema &schema, const RowSnapshot &snap,
+                         const std::optional<std::vector<size_t>> &candidates,
+                         const std::optional<Predicate> &where, Fn &&fn,
+                         bool *interrupted = nullptr) {
+  const RowVersionStore &store = *snap.store;
+  // Resolve column names once for the whole scan
+  std::optional<BoundPredicate> bound;
+  if (where)
+    bound = BoundPredicate::bind(*where, schema);
+  size_t untilCheck = kInterruptRows;
+  auto visit = [&](size_t i) {
+    if (interrupted && --untilCheck == 0) {
+      untilCheck = kInterruptRows;
+      if (!InterruptScope::check().ok()) {
+        *interrupted = true;
+        return false;
+      }
+    }
+    const RowVersion &v = store.at(i);
+    if (v.visibleAt(snap.version) && (!bound || bound->matches(v.row)))
+      return fn(i);
+    return true;
+  };
+  if (candidates) {
+    for (size_t i : *candidates) {
+      // Candidates are ascending; the rest were appended after the snapshot
+      if (i >= snap.size || !visit(i))
+        break;
+    }
+    return;
+  }
+  for (size_t i = 0; i < snap.size;) {
+    if (skipChunk(store, snap, bound, i)) {
+      i += RowVersionStore::kChunkRows;
+      continue;
+    }
+    if (!visit(i))
+      break;
+    ++i;
+  }
+}
+
+// Utility: morsels of ThreadPool::kMorselRows in the positions forEachMatch
+// visits for `snap` and `candidates`
+static size_t
+morselCount(const RowSnapshot &snap,
+            const std::optional<std::vector<size_t>> &candidates) {
+  const size_t n = candidates ? candidates->size() : snap.size;
+  return (n + ThreadPool::kMorselRows - 1) / ThreadPool::kMorselRows;
+}
+
+// Utility: forEachMatch over morsels [first, last) of those positions, on up
+// to `threads` threads of the shared pool. fn(morsel, hits) gets the matches
+// of one morsel in ascending order, concurrently with other morsels; the
+// positions of a morsel precede those of the next.
+template <typename Fn>
+static void forEachMorselMatch(
+    const RowSnapshot &snap,
+    const std::optional<std::vector<size_t>> &candidates,
+    const std::optional<BoundPredicate> &bound, size_t first, size_t last,
+    size_t threads, Fn &&fn) {
+  const RowVersionStore &store = *snap.store;
+  const size_t n = candidates ? candidates->size() : snap.size;
+  const size_t base = first * ThreadPool::kMorselRows;
+  const size_t end = std::min(n, last * ThreadPool::kMorselRows);
+  if (end <= base)
+    return;
+  ThreadPool::shared().parallelFor(
+      end - base, ThreadPool::kMorselRows, threads,
+      [&](size_t m, size_t lo, size_t hi) {
+        std::vector<size_t> hits;
+        for (size_t k = base + lo; k < base + hi; ++k) {
+          if (!candidates && skipChunk(store, snap, bound, k)) {
+            k += RowVersionStore::kChunkRows - 1;
+            continue;
+          }
+          const size_t i = candidates ? (*candidates)[k] : k;
+          // Candidates are ascending; the rest were appended after the
+          // snapshot
+          if (i >= snap.size)
+            break;
+          const RowVersion &v = store.at(i);
+          if (v.visibleAt(snap.version) && (!bound || bound->matches(v.row)))
+            hits.push_back(i);
+        }
+        fn(first + m, hits);
+      });
+}
+
+// Utility: indexes of the same columns and types as `indexes`, but empty
+static std::unordered_map<size_t, ColumnIndex>
+emptyIndexesLike(const std::unordered_map<size_t, ColumnIndex> &indexes) {
+  std::unordered_map<size_t, ColumnIndex> out;
+  for (const auto &kv : indexes)
+    out.emplace(kv.first,
+                ColumnIndex(kv.second.type(), kv.second.columnType()));
+  return out;
+}
+
+// Utility: resolve a projection list (empty = all columns) to column
+// positions and output metadata
+static Status resolveProjection(const TableSchema &schema,
+                                const std::vector<std::string> &columns,
+                                std::vector<size_t> &projIdx,
+                                std::vector<std::string> &outNames,
+                                std::vector<ColumnType> &outTypes) {
+  const auto &cols = schema.columns();
+  if (columns.empty()) {
+    // select *
+    projIdx.resize(cols.size());
+    for (size_t i = 0; i < cols.size(); ++i) {
+      projIdx[i] = i;
+      outNames.push_back(cols[i].name);
+      outTypes.push_back(cols[i].type);
+    }
+    return Status::OK();
+  }
+  for (const auto &name : columns) {
+    size_t idx = schema.findColumn(name);
+    if (idx == TableSchema::npos)
+      return Status::InvalidArgument("Unknown column in projection: " + name);
+    projIdx.push_back(idx);
+    outNames.push_back(cols[idx].name);
+    outTypes.push_back(cols[idx].type);
+  }
+  return Status::OK();
+}
+
+using UniqueKeySets = std::vector<std::unordered_set<std::string>>;
+
+// Utility: first unique column whose value in `row` is already present in
+// `keys`; returns an error message (empty when no conflict). Absent cells
+// are ignored, matching SchemaValidator::validateUnique.
+static std::string uniqueConflict(const TableSchema &schema,
+                                  const UniqueKeySets &keys,
+                                  const InlineRow &row) {
+  const auto &cols = schema.columns();
+  for (size_t i = 0; i < cols.size(); ++i) {
+    if (!cols[i].unique || row.values()[i].empty())
+      continue;
+    if (keys[i].count(row.values()[i].toString()))
+      return "Duplicate value for unique column '" + cols[i].name + "'";
+  }
+  return {};
+}
+
+static void addUniqueKeys(const TableSchema &schema, UniqueKeySets &keys,
+                          const InlineRow &row) {
+  const auto &cols = schema.columns();
+  for (size_t i = 0; i < cols.size(); ++i) {
+    if (cols[i].unique && !row.values()[i].empty())
+      keys[i].insert(row.values()[i].toString());
+  }
+}
+
+static void removeUniqueKeys(const TableSchema &schema, UniqueKeySets &keys,
+                             const InlineRow &row) {
+  const auto &cols = schema.columns();
+  for (size_t i = 0; i < cols.size(); ++i) {
+    if (cols[i].unique && !row.values()[i].empty())
+      keys[i].erase(row.values()[i].toString());
+  }
+}
+
+// Utility: move the unique keys of the rows in `oldRows` to their
+// replacements in `newRows` (same order). On conflict the key sets are
+// restored and an error message is returned.
+static std::string
+replaceUniqueKeys(const TableSchema &schema, UniqueKeySets &keys,
+                  const std::vector<const InlineRow *> &oldRows,
+                  const std::vector<InlineRow> &newRows) {
+  bool anyUnique = false;
+  for (const auto &col : schema.columns())
+    anyUnique = anyUnique || col.unique;
+  if (!anyUnique)
+    return {};
+  for (const InlineRow *row : oldRows)
+    removeUniqueKeys(schema, keys, *row);
+  for (size_t n = 0; n < newRows.size(); ++n) {
+    if (auto err = uniqueConflict(schema, keys, newRows[n]); !err.empty()) {
+      for (size_t j = 0; j < n; ++j)
+        removeUniqueKeys(schema, keys, newRows[j]);
+      for (const InlineRow *row : oldRows)
+        addUniqueKeys(schema, keys, *row);
+      return err;
+    }
+    addUniqueKeys(schema, keys, newRows[n]);
+  }
+  return {};
 }
 
 // Utility: evaluate document predicate comparison
-static bool evalDocPredicateComparison(const Document &doc,
+static bool evalDocPredicateComparison(const StoredDocument &doc,
                                        const DocPredicate &pred) {
-  auto it = doc.find(pred.field);
-  if (it == doc.end())
+  FieldRef lhs = doc.field(pred.field);
+  if (!lhs.found())
     return false; // unknown field -> not matched
-  const Value *lhs = it->second.get();
   const Value *rhs = pred.rhs.get();
-  if (!lhs || !rhs)
+  if (!lhs.hasValue() || !rhs)
     return false; // null comparisons -> no match
-  int cmp = lhs->compare(*rhs);
+  int cmp = lhs.compare(*rhs);
   switch (pred.op) {
   case DocPredicate::Op::Eq:
     return cmp == 0;
@@ -138,7 +1072,8 @@ static bool evalDocPredicateComparison(const Document &doc,
 }
 
 // Utility: evaluate document predicate tree (And/Or/Not/Comparison)
-static bool evalDocPredicate(const Document &doc, const DocPredicate &pred) {
+static bool evalDocPredicate(const StoredDocument &doc,
+                             const DocPredicate &pred) {
   using K = DocPredicate::Kind;
   switch (pred.kind) {
   case K::Comparison:
@@ -163,127 +1098,1523 @@ static bool evalDocPredicate(const Document &doc, const DocPredicate &pred) {
     return !evalDocPredicate(doc, pred.children.front());
   }
   }
-  return false;
+  return false;
+}
+
+using UniqueValueMaps =
+    std::unordered_map<std::string,
+                       std::unordered_map<std::string, std::string>>;
+
+// Utility: value of a unique document field, or nullptr when it is missing
+// or null (nullish values are exempt from uniqueness)
+static const Value *uniqueFieldValue(const Document &doc,
+                                     const std::string &field) {
+  auto it = doc.find(field);
+  if (it == doc.end() || !it->second ||
+      it->second->type() == ValueType::Null)
+    return nullptr;
+  return it->second.get();
+}
+
+static bool uniqueFieldValue(const StoredDocument &doc,
+                             const std::string &field, std::string &out) {
+  FieldRef f = doc.field(field);
+  if (!f.hasValue() || f.type() == ValueType::Null)
+    return false;
+  out = f.toString();
+  return true;
+}
+
+static void addUniqueValues(UniqueValueMaps &maps, const StoredDocument &doc,
+                            const std::string &key) {
+  std::string v;
+  for (auto &kv : maps) {
+    if (uniqueFieldValue(doc, kv.first, v))
+      kv.second[v] = key;
+  }
+}
+
+static void removeUniqueValues(UniqueValueMaps &maps,
+                               const StoredDocument &doc,
+                               const std::string &key) {
+  std::string v;
+  for (auto &kv : maps) {
+    if (!uniqueFieldValue(doc, kv.first, v))
+      continue;
+    auto it = kv.second.find(v);
+    if (it != kv.second.end() && it->second == key)
+      kv.second.erase(it);
+  }
+}
+
+using FieldIndexes = std::unordered_map<std::string, FieldIndex>;
+
+// `ordinals` numbers the documents once the collection has a Bitmap index
+// (nullptr before)
+static void addIndexEntries(FieldIndexes &indexes, DocOrdinals *ordinals,
+                            const StoredDocument &doc,
+                            const std::string &key) {
+  const uint32_t ordinal = ordinals ? ordinals->assign(&key) : 0;
+  for (auto &kv : indexes)
+    kv.second.insert(doc.field(kv.first).toInline(), &key, ordinal);
+}
+
+static void removeIndexEntries(FieldIndexes &indexes, DocOrdinals *ordinals,
+                               const StoredDocument &doc,
+                               const std::string &key) {
+  const uint32_t ordinal = ordinals ? ordinals->of(&key) : 0;
+  for (auto &kv : indexes)
+    kv.second.erase(doc.field(kv.first).toInline(), &key, ordinal);
+}
+
+// Utility: check the fields a patch changes against the schema, and their
+// unique values against those of the other documents
+static Status checkFieldChanges(const CompiledValidator &validator,
+                                const UniqueValueMaps &unique,
+                                const std::string &key,
+                                const std::vector<FieldChange> &changes) {
+  for (const auto &c : changes) {
+    if (auto err = validator.validateField(c.field, c.value.get(), c.present);
+        !err.empty())
+      return Status::InvalidArgument(err);
+    auto uit = unique.find(c.field);
+    if (uit == unique.end() || !c.value ||
+        c.value->type() == ValueType::Null)
+      continue;
+    auto hit = uit->second.find(c.value->toString());
+    if (hit != uit->second.end() && hit->second != key)
+      return Status::FailedPrecondition("Duplicate value for unique field '" +
+                                        c.field + "'");
+  }
+  return Status::OK();
+}
+
+// Utility: write `changes` into the document stored under `key`, moving the
+// changed fields' unique values and index entries along. Each change is
+// swapped for the field's previous state, so applying `changes` again
+// undoes the patch. Returns the change in the document's bytes.
+static std::ptrdiff_t applyFieldChanges(StoredDocument &doc,
+                                        const std::string &key,
+                                        std::vector<FieldChange> &changes,
+                                        ShapeTable *shapes,
+                                        UniqueValueMaps &unique,
+                                        FieldIndexes &indexes,
+                                        DocOrdinals *ordinals) {
+  const uint32_t ordinal = ordinals ? ordinals->of(&key) : 0;
+  std::ptrdiff_t delta = 0;
+  std::string v;
+  for (auto &c : changes) {
+    auto uit = unique.find(c.field);
+    auto iit = indexes.find(c.field);
+    if (uit != unique.end() && uniqueFieldValue(doc, c.field, v)) {
+      auto hit = uit->second.find(v);
+      if (hit != uit->second.end() && hit->second == key)
+        uit->second.erase(hit);
+    }
+    FieldRef before = doc.field(c.field);
+    if (iit != indexes.end())
+      iit->second.erase(before.toInline(), &key, ordinal);
+    const bool wasPresent = before.found();
+    std::unique_ptr<Value> was = before.clone();
+    delta += c.present ? doc.set(c.field, c.value.get(), shapes)
+                       : doc.unset(c.field, shapes);
+    if (uit != unique.end() && uniqueFieldValue(doc, c.field, v))
+      uit->second[v] = key;
+    if (iit != indexes.end())
+      iit->second.insert(doc.field(c.field).toInline(), &key, ordinal);
+    c.present = wasPresent;
+    c.value = std::move(was);
+  }
+  return delta;
+}
+
+static void accountBytes(MemoryAccount &memory, std::ptrdiff_t delta) {
+  if (delta > 0)
+    memory.add(static_cast<size_t>(delta));
+  else
+    memory.sub(static_cast<size_t>(-delta));
+}
+
+// Utility: bitmapCandidates() over Bitmap field indexes, resolving to
+// document ordinals; NOT complements within every numbered document
+static std::optional<BitmapMatch>
+docBitmapCandidates(const FieldIndexes &indexes, const DocOrdinals &ordinals,
+                    const DocPredicate &pred) {
+  using K = DocPredicate::Kind;
+  switch (pred.kind) {
+  case K::Comparison: {
+    auto it = indexes.find(pred.field);
+    if (it == indexes.end() || it->second.type() != IndexType::Bitmap ||
+        !pred.rhs)
+      return std::nullopt;
+    const FieldIndex &index = it->second;
+    const Value *rhs = pred.rhs.get();
+    BitmapMatch m;
+    std::optional<RoaringBitmap> bits;
+    switch (pred.op) {
+    case DocPredicate::Op::Eq:
+      bits = index.bitmapEq(*rhs, m.exact);
+      break;
+    case DocPredicate::Op::Ne:
+      bits = index.bitmapEq(*rhs, m.exact);
+      if (!bits || !m.exact)
+        return std::nullopt;
+      m.rows = index.valuedBitmap();
+      m.rows -= *bits;
+      return m;
+    case DocPredicate::Op::Lt:
+      bits = index.bitmapRange(nullptr, false, rhs, true, m.exact);
+      break;
+    case DocPredicate::Op::Le:
+      bits = index.bitmapRange(nullptr, false, rhs, false, m.exact);
+      break;
+    case DocPredicate::Op::Gt:
+      bits = index.bitmapRange(rhs, true, nullptr, false, m.exact);
+      break;
+    case DocPredicate::Op::Ge:
+      bits = index.bitmapRange(rhs, false, nullptr, false, m.exact);
+      break;
+    }
+    if (!bits)
+      return std::nullopt;
+    m.rows = std::move(*bits);
+    return m;
+  }
+  case K::And: {
+    std::optional<BitmapMatch> out;
+    bool all = true;
+    for (const auto &ch : pred.children) {
+      auto m = docBitmapCandidates(indexes, ordinals, ch);
+      if (!m) {
+        all = false;
+      } else if (!out) {
+        out = std::move(m);
+      } else {
+        out->rows &= m->rows;
+        out->exact = out->exact && m->exact;
+      }
+    }
+    if (out)
+      out->exact = out->exact && all;
+    return out;
+  }
+  case K::Or: {
+    if (pred.children.empty())
+      return std::nullopt;
+    BitmapMatch out;
+    for (const auto &ch : pred.children) {
+      auto m = docBitmapCandidates(indexes, ordinals, ch);
+      if (!m)
+        return std::nullopt;
+      out.rows |= m->rows;
+      out.exact = out.exact && m->exact;
+    }
+    return out;
+  }
+  case K::Not: {
+    if (pred.children.empty())
+      return std::nullopt;
+    auto m = docBitmapCandidates(indexes, ordinals, pred.children.front());
+    if (!m || !m->exact)
+      return std::nullopt;
+    BitmapMatch out;
+    out.rows = ordinals.all();
+    out.rows -= m->rows;
+    return out;
+  }
+  }
+  return std::nullopt;
+}
+
+// Utility: candidate document keys for a predicate answered from field
+// indexes, or nullopt when a full scan is required. As with
+// indexCandidates, candidates may include non-matching documents; callers
+// re-check the predicate on each, and Bitmap indexes (numbering documents
+// through `ordinals`) resolve the predicate as a whole first.
+static std::optional<std::vector<FieldIndex::Key>>
+docIndexCandidates(const FieldIndexes &indexes, const DocOrdinals *ordinals,
+                   const DocPredicate &pred) {
+  using K = DocPredicate::Kind;
+  if (indexes.empty())
+    return std::nullopt;
+  if (ordinals) {
+    const size_t docs = ordinals->all().cardinality();
+    if (auto m = docBitmapCandidates(indexes, *ordinals, pred);
+        m && m->rows.cardinality() <= kIndexMaxSelectivity * docs) {
+      std::vector<FieldIndex::Key> out;
+      out.reserve(m->rows.cardinality());
+      m->rows.forEach([&](uint32_t n) { out.push_back(ordinals->key(n)); });
+      return out;
+    }
+  }
+  switch (pred.kind) {
+  case K::Comparison: {
+    auto it = indexes.find(pred.field);
+    if (it == indexes.end() || !pred.rhs)
+      return std::nullopt;
+    const Value *rhs = pred.rhs.get();
+    switch (pred.op) {
+    case DocPredicate::Op::Eq:
+      return it->second.lookupEq(*rhs);
+    case DocPredicate::Op::Lt:
+    case DocPredicate::Op::Le:
+      return it->second.lookupRange(nullptr, rhs);
+    case DocPredicate::Op::Gt:
+    case DocPredicate::Op::Ge:
+      return it->second.lookupRange(rhs, nullptr);
+    case DocPredicate::Op::Ne:
+      break;
+    }
+    return std::nullopt;
+  }
+  case K::And: {
+    // Drive the conjunction from its smallest indexed child
+    std::optional<std::vector<FieldIndex::Key>> best;
+    for (const auto &ch : pred.children) {
+      auto cand = docIndexCandidates(indexes, ordinals, ch);
+      if (cand && (!best || cand->size() < best->size()))
+        best = std::move(cand);
+    }
+    return best;
+  }
+  case K::Or: {
+    // Union of the children; any child needing a scan forces a scan
+    std::vector<FieldIndex::Key> out;
+    for (const auto &ch : pred.children) {
+      auto cand = docIndexCandidates(indexes, ordinals, ch);
+      if (!cand)
+        return std::nullopt;
+      out.insert(out.end(), cand->begin(), cand->end());
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+  }
+  case K::Not:
+    break;
+  }
+  return std::nullopt;
+}
+
+std::shared_ptr<const TableStatistics>
+InMemoryRelationalStorage::TableData::statistics() const {
+  std::lock_guard lk(statsMtx);
+  return stats.cached();
+}
+
+RowSnapshot InMemoryRelationalStorage::TableData::snapshot(
+    const std::optional<Predicate> &where,
+    std::optional<std::vector<size_t>> &candidates, std::string *path) const {
+  std::shared_ptr<const TableStatistics> st;
+  if (where && !indexes.empty())
+    st = statistics();
+  metrics::TimedSharedLock lk(publishMtx);
+  // Candidates must come from the indexes matching the captured store
+  if (where)
+    candidates =
+        indexCandidates(schema, indexes, *where, size, st.get(), path);
+  return RowSnapshot{store, size, version};
+}
+
+// Utility: the bounds on `column` of the top-level conjuncts of `p`, the
+// tightest of each side; `compared` is set when one compares the column,
+// so that rows whose cell is null cannot match
+static void columnBounds(const Predicate &p, const std::string &column,
+                         const Value *&lower, const Value *&upper,
+                         bool &compared) {
+  if (p.kind == Predicate::Kind::And) {
+    for (const auto &ch : p.children)
+      columnBounds(ch, column, lower, upper, compared);
+    return;
+  }
+  if (p.kind != Predicate::Kind::Comparison || p.column != column || !p.rhs)
+    return;
+  compared = true;
+  const Value *rhs = p.rhs.get();
+  const bool lo = p.op == Predicate::Op::Eq || p.op == Predicate::Op::Gt ||
+                  p.op == Predicate::Op::Ge;
+  const bool hi = p.op == Predicate::Op::Eq || p.op == Predicate::Op::Lt ||
+                  p.op == Predicate::Op::Le;
+  if (lo && (!lower || rhs->compare(*lower) > 0))
+    lower = rhs;
+  if (hi && (!upper || rhs->compare(*upper) < 0))
+    upper = rhs;
+}
+
+bool InMemoryRelationalStorage::TableData::orderedSnapshot(
+    const std::optional<Predicate> &where, const ScanOrder &order,
+    RowSnapshot &snap, std::vector<size_t> *positions,
+    size_t *examined) const {
+  const size_t col = schema.findColumn(order.column);
+  if (col == TableSchema::npos)
+    return false;
+  const Value *lower = nullptr, *upper = nullptr;
+  bool compared = false;
+  if (where)
+    columnBounds(*where, order.column, lower, upper, compared);
+  // Null cells are not indexed, yet sort first (last when descending)
+  if (schema.columns()[col].nullable && !compared)
+    return false;
+  std::optional<BoundPredicate> bound;
+  if (where && positions)
+    bound = BoundPredicate::bind(*where, schema);
+  metrics::TimedSharedLock lk(publishMtx);
+  auto it = indexes.find(col);
+  if (it == indexes.end() || it->second.type() != IndexType::Ordered)
+    return false;
+  snap = RowSnapshot{store, size, version};
+  if (!positions)
+    return it->second.forEachOrdered(lower, upper, order.descending,
+                                     [](size_t) { return false; });
+  positions->clear();
+  const InlineValue *last = nullptr;
+  size_t walked = 0;
+  const bool answered = it->second.forEachOrdered(
+      lower, upper, order.descending, [&](size_t i) {
+        if (++walked % kInterruptRows == 0 && !InterruptScope::check().ok())
+          return false;
+        const RowVersion &v = snap.store->at(i);
+        if (!v.visibleAt(snap.version) || (bound && !bound->matches(v.row)))
+          return true;
+        const InlineValue &cell = v.row.values()[col];
+        if (positions->size() >= order.limit &&
+            !(order.withTies && last && cell.compare(*last) == 0))
+          return false;
+        positions->push_back(i);
+        last = &cell;
+        return true;
+      });
+  if (examined)
+    *examined = walked;
+  return answered;
+}
+
+std::vector<size_t> InMemoryRelationalStorage::TableData::matchLive(
+    const std::optional<Predicate> &where) const {
+  std::optional<std::vector<size_t>> candidates;
+  if (where && !indexes.empty())
+    candidates = indexCandidates(schema, indexes, *where, size,
+                                 statistics().get());
+  std::vector<size_t> out;
+  forEachMatch(schema, RowSnapshot{store, size, version}, candidates, where,
+               [&](size_t i) {
+                 out.push_back(i);
+                 return true;
+               });
+  metrics::OperationScope::addRows(candidates ? candidates->size() : size,
+                                   out.size());
+  return out;
+}
+
+// Estimated footprint of a stored row version
+static size_t versionBytes(const InlineRow &row) {
+  return sizeof(RowVersion) + memory::rowBytes(row);
+}
+
+// Live bytes a write adds: its new versions less those it ends, or 0
+static size_t liveGrowth(const std::vector<const InlineRow *> &ended,
+                         const std::vector<InlineRow> &added) {
+  size_t adds = 0, ends = 0;
+  for (const auto &row : added)
+    adds += versionBytes(row);
+  for (const InlineRow *row : ended)
+    ends += versionBytes(*row);
+  return adds > ends ? adds - ends : 0;
+}
+
+// One event per row of a commit of `target`: the i-th ended and added
+// rows are the old and new versions of an updated row, and the rest are
+// deleted or inserted
+static std::vector<ChangeEvent>
+rowChanges(const std::string &target, const RowVersionStore &store,
+           const std::vector<size_t> &ended,
+           const std::vector<InlineRow> &added) {
+  std::vector<ChangeEvent> events(std::max(ended.size(), added.size()));
+  for (size_t i = 0; i < events.size(); ++i) {
+    ChangeEvent &e = events[i];
+    e.target = target;
+    if (i < ended.size())
+      e.before = store.at(ended[i]).row;
+    if (i < added.size())
+      e.after = added[i];
+    e.kind = !e.before  ? ChangeEvent::Kind::Insert
+             : !e.after ? ChangeEvent::Kind::Delete
+                        : ChangeEvent::Kind::Update;
+  }
+  return events;
+}
+
+void InMemoryRelationalStorage::TableData::commit(
+    const std::vector<size_t> &ended, std::vector<InlineRow> added) {
+  Version next = version + 1;
+  auto nextStore = store;
+  std::vector<ChangeEvent> events;
+  if (changes)
+    events = rowChanges(name, *nextStore, ended, added);
+  size_t adds = 0, ends = 0;
+  {
+    std::lock_guard lk(statsMtx);
+    for (size_t i : ended) {
+      stats.remove(nextStore->at(i).row);
+      ends += versionBytes(nextStore->at(i).row);
+    }
+    for (const auto &row : added) {
+      stats.add(row);
+      adds += versionBytes(row);
+    }
+  }
+  // Charged to the operation storing the rows
+  metrics::OperationScope::addBytes(adds);
+  memory.add(adds);
+  memory.sub(ends);
+  std::vector<size_t> positions;
+  positions.reserve(added.size());
+  // Room for the whole batch at once, so a bulk load copies the chunk
+  // list once rather than once per chunk
+  if (nextStore->room() < added.size())
+    nextStore = nextStore->grow(added.size());
+  for (auto &row : added)
+    positions.push_back(nextStore->append(std::move(row), next));
+  // Readers on older snapshots still see these (their version < next)
+  for (size_t i : ended)
+    nextStore->at(i).end.store(next, std::memory_order_release);
+  dead += ended.size();
+  {
+    std::lock_guard lk(publishMtx);
+    for (auto &kv : indexes) {
+      for (size_t pos : positions)
+        kv.second.insert(nextStore->at(pos).row.values()[kv.first], pos);
+    }
+    size = nextStore->size();
+    store = std::move(nextStore);
+    version = next;
+  }
+  // Only after publishing: a reader that sees the new stamp sees the rows
+  stamp.store(nextDataVersion(), std::memory_order_release);
+  if (changes)
+    changes->publish(std::move(events));
+  // Amortized O(1): compact once dead versions outnumber live rows
+  if (dead >= RowVersionStore::kChunkRows && dead * 2 > size)
+    compact();
+}
+
+size_t InMemoryRelationalStorage::TableData::compact() {
+  auto nextStore = std::make_shared<RowVersionStore>();
+  auto nextIndexes = emptyIndexesLike(indexes);
+  for (size_t i = 0; i < size; ++i) {
+    const RowVersion &v = store->at(i);
+    if (!v.live())
+      continue;
+    if (nextStore->full())
+      nextStore = nextStore->grow();
+    size_t pos = nextStore->append(v.row, v.begin);
+    for (auto &kv : nextIndexes)
+      kv.second.insert(v.row.values()[kv.first], pos);
+  }
+  size_t reclaimed = size - nextStore->size();
+  {
+    // Removed rows no longer skew the statistics
+    std::lock_guard lk(statsMtx);
+    stats.clear();
+    for (size_t i = 0; i < nextStore->size(); ++i)
+      stats.add(nextStore->at(i).row);
+  }
+  {
+    // Readers still scanning the old store keep it alive; new snapshots
+    // (at the same version) see identical rows
+    std::lock_guard lk(publishMtx);
+    indexes.swap(nextIndexes);
+    size = nextStore->size();
+    store = std::move(nextStore);
+  }
+  dead = 0;
+  return reclaimed;
+}
+
+void InMemoryRelationalStorage::TableData::reset() {
+  auto nextIndexes = emptyIndexesLike(indexes);
+  {
+    std::lock_guard lk(publishMtx);
+    indexes.swap(nextIndexes);
+    store = std::make_shared<RowVersionStore>();
+    size = 0;
+    ++version;
+  }
+  dead = 0;
+  memory.set(0);
+  stamp.store(nextDataVersion(), std::memory_order_release);
+  for (auto &keys : uniqueKeys)
+    keys.clear();
+  {
+    std::lock_guard lk(statsMtx);
+    stats.clear();
+  }
+  if (changes && !partition) {
+    ChangeEvent e;
+    e.kind = ChangeEvent::Kind::Truncate;
+    e.target = name;
+    changes->publish(std::move(e));
+  }
+}
+
+std::shared_ptr<InMemoryRelationalStorage::TableData>
+InMemoryRelationalStorage::findTable(const std::string &table) const {
+  std::shared_lock lk(mtx_);
+  auto it = tables_.find(table);
+  return it == tables_.end() ? nullptr : it->second;
+}
+
+// ---- Partitioned tables ----
+
+// Helper: the value `p` requires `column` to equal, when it is an equality
+// or a conjunction holding one. Only Integer and String values of the
+// column's own type qualify: their toString() keys are equal exactly when
+// the values are, as partitioning needs.
+static const Value *pinnedValue(const Predicate &p, const std::string &column,
+                                ColumnType type) {
+  if (p.kind == Predicate::Kind::And) {
+    for (const auto &ch : p.children)
+      if (const Value *v = pinnedValue(ch, column, type))
+        return v;
+    return nullptr;
+  }
+  if (p.kind != Predicate::Kind::Comparison || p.op != Predicate::Op::Eq ||
+      p.column != column || !p.rhs)
+    return nullptr;
+  const bool keyed = (type == ColumnType::Integer &&
+                      p.rhs->type() == ValueType::Integer) ||
+                     (type == ColumnType::String &&
+                      p.rhs->type() == ValueType::String);
+  return keyed ? p.rhs.get() : nullptr;
+}
+
+size_t
+InMemoryRelationalStorage::PartitionedTable::partitionOf(const Value *v) const {
+  // Keyed like the unique key sets, so equal keys share a partition
+  return v ? std::hash<std::string>{}(v->toString()) % parts.size() : 0;
+}
+
+std::optional<size_t> InMemoryRelationalStorage::PartitionedTable::route(
+    const std::optional<Predicate> &where) const {
+  if (!where)
+    return std::nullopt;
+  const Column &col = schema.columns()[key];
+  if (const Value *v = pinnedValue(*where, col.name, col.type))
+    return partitionOf(v);
+  return std::nullopt;
+}
+
+Status InMemoryRelationalStorage::PartitionedTable::forEach(
+    const std::optional<Predicate> &where,
+    const std::function<Status(size_t)> &fn) const {
+  if (auto one = route(where))
+    return fn(*one);
+  std::vector<Status> status(parts.size(), Status::OK());
+  ThreadPool::shared().parallelFor(parts.size(), 1, parts.size(),
+                                   [&](size_t, size_t begin, size_t end) {
+                                     for (size_t i = begin; i < end; ++i)
+                                       status[i] = fn(i);
+                                   });
+  for (auto &st : status)
+    if (!st.ok())
+      return st;
+  return Status::OK();
+}
+
+Result<std::vector<RowBatch>>
+InMemoryRelationalStorage::PartitionedTable::collect(
+    const std::string &table, const std::vector<std::string> &columns,
+    const std::optional<Predicate> &where, size_t batchRows) const {
+  using R = Result<std::vector<RowBatch>>;
+  std::vector<std::vector<RowBatch>> batches(parts.size());
+  Status st = forEach(where, [&](size_t i) {
+    return parts[i]->scan(
+        table, columns, where,
+        [&](RowBatch &batch) {
+          // The scan reuses `batch`; keep its metadata
+          RowBatch kept;
+          kept.columnNames = batch.columnNames;
+          kept.columnTypes = batch.columnTypes;
+          kept.rows = std::move(batch.rows);
+          batch.rows.clear();
+          batches[i].push_back(std::move(kept));
+          return true;
+        },
+        batchRows);
+  });
+  // Partitions scanned on workers could not see the caller's interrupt
+  // scope
+  if (st.ok())
+    st = InterruptScope::check();
+  if (!st.ok())
+    return R::err(st);
+  std::vector<RowBatch> out;
+  for (auto &part : batches)
+    for (auto &batch : part)
+      if (!batch.rows.empty() || out.empty())
+        out.push_back(std::move(batch));
+  if (out.size() > 1 && out.front().rows.empty())
+    out.erase(out.begin());
+  return R::ok(std::move(out));
+}
+
+// Helper: statistics of a partitioned table from those of its partitions.
+// Counts add up and min/max span the partitions. Keys are spread by hash,
+// so each partition is a sample of the table: histograms come from the
+// largest one, and so do distinct counts except the key's, which add up.
+static std::shared_ptr<const TableStatistics> mergeStatistics(
+    const std::vector<std::shared_ptr<const TableStatistics>> &parts,
+    size_t key) {
+  const TableStatistics *largest = nullptr;
+  for (const auto &p : parts)
+    if (p && (!largest || p->rowCount > largest->rowCount))
+      largest = p.get();
+  if (!largest)
+    return nullptr;
+  auto out = std::make_shared<TableStatistics>(*largest);
+  out->rowCount = 0;
+  for (auto &c : out->columns) {
+    c.nonNull = 0;
+    c.min.reset();
+    c.max.reset();
+  }
+  if (key < out->columns.size())
+    out->columns[key].distinct = 0;
+  for (const auto &p : parts) {
+    if (!p)
+      continue;
+    out->rowCount += p->rowCount;
+    for (size_t i = 0; i < out->columns.size() && i < p->columns.size();
+         ++i) {
+      ColumnStatistics &c = out->columns[i];
+      const ColumnStatistics &pc = p->columns[i];
+      c.nonNull += pc.nonNull;
+      if (pc.min && (!c.min || pc.min->compare(*c.min) < 0))
+        c.min = pc.min;
+      if (pc.max && (!c.max || pc.max->compare(*c.max) > 0))
+        c.max = pc.max;
+      if (i == key)
+        c.distinct += pc.distinct;
+    }
+  }
+  return out;
+}
+
+std::shared_ptr<InMemoryRelationalStorage::PartitionedTable>
+InMemoryRelationalStorage::findPartitioned(const std::string &table) const {
+  if (!anyPartitioned_.load(std::memory_order_acquire))
+    return nullptr;
+  std::shared_lock lk(mtx_);
+  auto it = partitioned_.find(table);
+  return it == partitioned_.end() ? nullptr : it->second;
+}
+
+Status InMemoryRelationalStorage::createPartitionedTable(
+    const std::string &table, const TableSchema &schema, size_t partitions) {
+  const auto &pk = schema.primaryKey();
+  if (!pk)
+    return Status::InvalidArgument("Partitioned table needs a primary key: " +
+                                   table);
+  for (const auto &c : schema.columns())
+    if (c.unique && c.name != *pk)
+      return Status::InvalidArgument(
+          "Partitioned tables support no unique column but the primary "
+          "key: " +
+          c.name);
+  auto pt = std::make_shared<PartitionedTable>();
+  pt->schema = schema;
+  pt->key = schema.findColumn(*pk);
+  // Equal keys share a partition, so each one checks its keys alone
+  Column keyCol = schema.columns()[pt->key];
+  keyCol.unique = true;
+  keyCol.nullable = false;
+  pt->schema.updateColumn(keyCol);
+  pt->validator = CompiledValidator(pt->schema);
+  pt->parts.resize(ThreadPool::resolve(partitions));
+  for (auto &part : pt->parts) {
+    part = std::make_unique<InMemoryRelationalStorage>();
+    part->partition_ = true;
+    if (auto st = part->createTable(table, pt->schema); !st.ok())
+      return st;
+  }
+  std::lock_guard lk(mtx_);
+  if (tables_.count(table) || partitioned_.count(table))
+    return Status::AlreadyExists("Table already exists: " + table);
+  if (changes_)
+    for (auto &part : pt->parts)
+      part->useChangeFeed(changes_);
+  partitioned_.emplace(table, std::move(pt));
+  anyPartitioned_.store(true, std::memory_order_release);
+  return Status::OK();
+}
+
+std::optional<size_t>
+InMemoryRelationalStorage::partitionCount(const std::string &table) const {
+  if (auto pt = findPartitioned(table))
+    return pt->parts.size();
+  if (findTable(table))
+    return 1;
+  return std::nullopt;
+}
+
+Status InMemoryRelationalStorage::createTable(const std::string &table,
+                                              const TableSchema &schema) {
+  std::lock_guard lk(mtx_);
+  if (tables_.count(table) || partitioned_.count(table)) {
+    return Status::AlreadyExists("Table already exists: " + table);
+  }
+  auto td = std::make_shared<TableData>();
+  td->schema = schema;
+  td->validator = CompiledValidator(schema);
+  td->uniqueKeys.resize(schema.columns().size());
+  td->stats = StatisticsCollector(schema);
+  td->name = table;
+  td->changes = changes_;
+  td->partition = partition_;
+  if (const auto &pk = schema.primaryKey()) {
+    size_t idx = schema.findColumn(*pk);
+    td->indexes.emplace(idx, ColumnIndex(IndexType::Ordered,
+                                         schema.columns()[idx].type));
+  }
+  tables_.emplace(table, std::move(td));
+  return Status::OK();
+}
+
+Status InMemoryRelationalStorage::insertRow(const std::string &table,
+                                            const Row &row) {
+  if (auto pt = findPartitioned(table)) {
+    const auto &cells = row.values();
+    const Value *key = pt->key < cells.size() ? cells[pt->key].get() : nullptr;
+    return pt->parts[pt->partitionOf(key)]->insertRow(table, row);
+  }
+  auto run = [&]() -> Status {
+    auto td = findTable(table);
+    if (!td) {
+      return Status::NotFound("Unknown table: " + table);
+    }
+    auto &tableData = *td;
+    const auto &schema = tableData.schema;
+    // Validate row matches schema
+    if (auto err = tableData.validator.validateRow(row); !err.empty()) {
+      return Status::InvalidArgument(err);
+    }
+    InlineRow stored = InlineRow::fromRow(row);
+
+    // Enforce uniqueness constraints via per-column key sets (O(1) per column)
+    metrics::TimedLock lk(tableData.writeMtx);
+    if (const size_t bytes = versionBytes(stored);
+        !tableData.memory.fits(bytes))
+      return memory::budgetExceeded("table", table, tableData.memory, bytes);
+    if (auto err = uniqueConflict(schema, tableData.uniqueKeys, stored);
+        !err.empty()) {
+      return Status::FailedPrecondition(err);
+    }
+    addUniqueKeys(schema, tableData.uniqueKeys, stored);
+
+    // Append as a new version (compact copy to keep isolation)
+    std::vector<InlineRow> added;
+    added.push_back(std::move(stored));
+    tableData.commit({}, std::move(added));
+    metrics::OperationScope::addRows(0, 1);
+    return Status::OK();
+  };
+  return metrics::measure(metrics::Operation::RelationalInsert, run);
+}
+
+Status InMemoryRelationalStorage::insertRows(const std::string &table,
+                                             const std::vector<Row> &rows) {
+  if (auto pt = findPartitioned(table)) {
+    // Validate every row before any partition commits
+    std::vector<std::vector<Row>> byPart(pt->parts.size());
+    for (size_t i = 0; i < rows.size(); ++i) {
+      if (auto err = pt->validator.validateRow(rows[i]); !err.empty())
+        return Status::InvalidArgument("Row " + std::to_string(i) + ": " +
+                                       err);
+      byPart[pt->partitionOf(rows[i].values()[pt->key].get())].push_back(
+          rows[i]);
+    }
+    std::vector<Status> status(byPart.size(), Status::OK());
+    ThreadPool::shared().parallelFor(
+        byPart.size(), 1, byPart.size(), [&](size_t, size_t begin, size_t end) {
+          for (size_t i = begin; i < end; ++i)
+            if (!byPart[i].empty())
+              status[i] = pt->parts[i]->insertRows(table, byPart[i]);
+        });
+    auto failed = std::find_if(status.begin(), status.end(),
+                               [](const Status &st) { return !st.ok(); });
+    if (failed == status.end())
+      return Status::OK();
+    // Delete the rows the other partitions took, by their unique keys
+    const std::string &keyName = pt->schema.columns()[pt->key].name;
+    for (size_t i = 0; i < byPart.size(); ++i) {
+      if (!status[i].ok() || byPart[i].empty())
+        continue;
+      Predicate anyKey;
+      anyKey.kind = Predicate::Kind::Or;
+      for (const auto &row : byPart[i]) {
+        Predicate eq;
+        eq.column = keyName;
+        eq.op = Predicate::Op::Eq;
+        eq.rhs = row.at(pt->key).clone();
+        anyKey.children.push_back(std::move(eq));
+      }
+      auto undone = pt->parts[i]->deleteRows(
+          table, std::optional<Predicate>(std::move(anyKey)));
+      if (!undone.hasValue())
+        return Status::Internal("Cannot undo the rows partition " +
+                                std::to_string(i) +
+                                " took from a failed batch: " +
+                                undone.status().message());
+    }
+    return *failed;
+  }
+  auto run = [&]() -> Status {
+    auto td = findTable(table);
+    if (!td)
+      return Status::NotFound("Unknown table: " + table);
+    auto &tableData = *td;
+    const auto &schema = tableData.schema;
+    std::vector<InlineRow> added;
+    added.reserve(rows.size());
+    for (size_t i = 0; i < rows.size(); ++i) {
+      if (auto err = tableData.validator.validateRow(rows[i]); !err.empty())
+        return Status::InvalidArgument("Row " + std::to_string(i) + ": " +
+                                       err);
+      added.push_back(InlineRow::fromRow(rows[i]));
+    }
+    if (added.empty())
+      return Status::OK();
+
+    metrics::TimedLock lk(tableData.writeMtx);
+    if (const size_t bytes = liveGrowth({}, added);
+        !tableData.memory.fits(bytes))
+      return memory::budgetExceeded("table", table, tableData.memory, bytes);
+    if (auto err = replaceUniqueKeys(schema, tableData.uniqueKeys, {}, added);
+        !err.empty())
+      return Status::FailedPrecondition(err);
+    metrics::OperationScope::addRows(0, added.size());
+    tableData.commit({}, std::move(added));
+    return Status::OK();
+  };
+  return metrics::measure(metrics::Operation::RelationalInsert, run);
+}
+
+// Same cells, of the same types
+static bool sameRow(const InlineRow &a, const InlineRow &b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t c = 0; c < a.size(); ++c) {
+    const InlineValue &x = a.values()[c], &y = b.values()[c];
+    if (x.empty() || y.empty()) {
+      if (x.empty() != y.empty())
+        return false;
+    } else if (x.type() != y.type() || x.compare(y) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Result<UpsertCounts>
+InMemoryRelationalStorage::upsertRows(const std::string &table,
+                                      const std::vector<Row> &rows,
+                                      const UpsertMerger &merge) {
+  using R = Result<UpsertCounts>;
+  if (auto pt = findPartitioned(table)) {
+    std::vector<std::vector<Row>> byPart(pt->parts.size());
+    for (const auto &row : rows) {
+      const auto &cells = row.values();
+      const Value *key =
+          pt->key < cells.size() ? cells[pt->key].get() : nullptr;
+      byPart[pt->partitionOf(key)].push_back(row);
+    }
+    UpsertCounts total;
+    for (size_t i = 0; i < byPart.size(); ++i) {
+      if (byPart[i].empty())
+        continue;
+      auto res = pt->parts[i]->upsertRows(table, byPart[i], merge);
+      if (!res.hasValue())
+        return res;
+      total.inserted += res.value().inserted;
+      total.updated += res.value().updated;
+    }
+    return R::ok(total);
+  }
+  auto run = [&]() -> R {
+    auto td = findTable(table);
+    if (!td)
+      return R::err(Status::NotFound("Unknown table: " + table));
+    auto &tableData = *td;
+    const auto &schema = tableData.schema;
+    if (!schema.primaryKey())
+      return R::err(
+          Status::InvalidArgument("Upsert needs a primary key: " + table));
+    const std::string &keyName = *schema.primaryKey();
+    const size_t key = schema.findColumn(keyName);
+    std::vector<std::string> keys(rows.size());
+    for (size_t i = 0; i < rows.size(); ++i) {
+      if (auto err = tableData.validator.validateRow(rows[i]); !err.empty())
+        return R::err(Status::InvalidArgument("Row " + std::to_string(i) +
+                                              ": " + err));
+      const Value *k = rows[i].values()[key].get();
+      if (!k || k->type() == ValueType::Null)
+        return R::err(Status::InvalidArgument("Row " + std::to_string(i) +
+                                              ": null primary key"));
+      keycode::appendValue(keys[i], k);
+    }
+
+    metrics::TimedLock lk(tableData.writeMtx);
+    const RowVersionStore &store = *tableData.store;
+    // The live version holding `k`, through the primary key index
+    auto liveWithKey = [&](const Value &k) -> std::optional<size_t> {
+      auto it = tableData.indexes.find(key);
+      std::optional<std::vector<size_t>> candidates;
+      if (it != tableData.indexes.end())
+        candidates = it->second.lookupEq(k);
+      auto holds = [&](size_t pos) {
+        const RowVersion &v = store.at(pos);
+        const InlineValue &cell = v.row.values()[key];
+        return v.live() && !cell.empty() && cell.compare(k) == 0;
+      };
+      if (candidates) {
+        for (size_t pos : *candidates)
+          if (holds(pos))
+            return pos;
+        return std::nullopt;
+      }
+      for (size_t pos = 0; pos < tableData.size; ++pos)
+        if (holds(pos))
+          return pos;
+      return std::nullopt;
+    };
+
+    // Updated versions first, paired with the versions they end, then the
+    // inserted ones; `written` finds a key's version written by the batch
+    std::vector<size_t> ended;
+    std::vector<const InlineRow *> oldRows;
+    std::vector<InlineRow> updated, inserted;
+    std::unordered_map<std::string, std::pair<bool, size_t>> written;
+    for (size_t i = 0; i < rows.size(); ++i) {
+      const Row &row = rows[i];
+      InlineRow *pending = nullptr;
+      std::optional<size_t> pos;
+      if (auto w = written.find(keys[i]); w != written.end())
+        pending = w->second.first ? &updated[w->second.second]
+                                  : &inserted[w->second.second];
+      else
+        pos = liveWithKey(*row.values()[key]);
+      if (!pending && !pos) {
+        written.emplace(keys[i], std::make_pair(false, inserted.size()));
+        inserted.push_back(InlineRow::fromRow(row));
+        continue;
+      }
+      const InlineRow &current = pending ? *pending : store.at(*pos).row;
+      InlineRow next;
+      if (merge) {
+        Row merged = current.toRow();
+        if (auto st = merge(merged, row, schema); !st.ok())
+          return R::err(st);
+        if (auto err = tableData.validator.validateRow(merged); !err.empty())
+          return R::err(Status::InvalidArgument(err));
+        std::string after;
+        keycode::appendValue(after, merged.values()[key].get());
+        if (after != keys[i])
+          return R::err(Status::InvalidArgument(
+              "Upsert cannot change primary key column '" + keyName + "'"));
+        next = InlineRow::fromRow(merged);
+      } else {
+        next = InlineRow::fromRow(row);
+      }
+      if (pending) {
+        *pending = std::move(next);
+      } else if (!sameRow(next, current)) {
+        written.emplace(keys[i], std::make_pair(true, updated.size()));
+        ended.push_back(*pos);
+        oldRows.push_back(&current);
+        updated.push_back(std::move(next));
+      }
+    }
+
+    UpsertCounts counts{inserted.size(), updated.size()};
+    std::vector<InlineRow> added = std::move(updated);
+    for (auto &row : inserted)
+      added.push_back(std::move(row));
+    metrics::OperationScope::addRows(rows.size(), added.size());
+    if (added.empty())
+      return R::ok(counts);
+    if (const size_t bytes = liveGrowth(oldRows, added);
+        !tableData.memory.fits(bytes))
+      return R::err(
+          memory::budgetExceeded("table", table, tableData.memory, bytes));
+    if (auto err =
+            replaceUniqueKeys(schema, tableData.uniqueKeys, oldRows, added);
+        !err.empty())
+      return R::err(Status::FailedPrecondition(err));
+    tableData.commit(ended, std::move(added));
+    return R::ok(counts);
+  };
+  return metrics::measure(metrics::Operation::RelationalUpsert, run);
+}
+
+Result<ResultSet>
+InMemoryRelationalStorage::select(const std::string &table,
+                                  const std::vector<std::string> &columns,
+                                  const std::optional<Predicate> &where) {
+  if (auto pt = findPartitioned(table)) {
+    if (auto one = pt->route(where))
+      return pt->parts[*one]->select(table, columns, where);
+    auto batches = pt->collect(table, columns, where, kDefaultBatchRows);
+    if (!batches.hasValue())
+      return Result<ResultSet>::err(batches.status());
+    std::vector<RowBatch> parts = batches.takeValue();
+    ResultSet rs(parts.front().columnNames, parts.front().columnTypes);
+    for (auto &batch : parts)
+      for (auto &cells : batch.rows)
+        rs.addRow(ResultRow(std::move(cells)));
+    return Result<ResultSet>::ok(std::move(rs));
+  }
+  auto run = [&]() -> Result<ResultSet> {
+    auto td = findTable(table);
+    if (!td) {
+      return Result<ResultSet>::err(
+          Status::NotFound("Unknown table: " + table));
+    }
+    const auto &schema = td->schema;
+
+    // Determine projection indices and column metadata
+    std::vector<size_t> projIdx;
+    std::vector<std::string> outNames;
+    std::vector<ColumnType> outTypes;
+    if (auto st =
+            resolveProjection(schema, columns, projIdx, outNames, outTypes);
+        !st.ok()) {
+      return Result<ResultSet>::err(st);
+    }
+
+    ResultSet rs(outNames, outTypes);
+
+    // Scan a snapshot without holding any lock; the cells come from an arena
+    std::optional<std::vector<size_t>> candidates;
+    RowSnapshot snap = td->snapshot(where, candidates);
+    const size_t scanned = candidates ? candidates->size() : snap.size;
+    auto project = [&](size_t i) {
+      const InlineRow &row = snap.store->at(i).row;
+      std::vector<std::unique_ptr<Value>> cells;
+      cells.reserve(projIdx.size());
+      for (size_t idx : projIdx)
+        cells.push_back(row.values()[idx].toValue());
+      return ResultRow(std::move(cells));
+    };
+
+    const size_t threads = ThreadPool::resolve(scanThreads());
+    const size_t morsels = morselCount(snap, candidates);
+    if (threads > 1 && morsels > 1) {
+      // Each morsel converts its matches into its own rows and arena
+      std::optional<BoundPredicate> bound;
+      if (where)
+        bound = BoundPredicate::bind(*where, schema);
+      std::vector<std::vector<ResultRow>> parts(morsels);
+      forEachMorselMatch(snap, candidates, bound, 0, morsels, threads,
+                         [&](size_t m, const std::vector<size_t> &hits) {
+                           ValueArena::Scope arena;
+                           parts[m].reserve(hits.size());
+                           for (size_t i : hits)
+                             parts[m].push_back(project(i));
+                         });
+      for (auto &part : parts)
+        for (auto &row : part)
+          rs.addRow(std::move(row));
+      metrics::OperationScope::addRows(scanned, rs.rowCount());
+      return Result<ResultSet>::ok(std::move(rs));
+    }
+
+    ValueArena::Scope arena;
+    forEachMatch(schema, snap, candidates, where, [&](size_t i) {
+      rs.addRow(project(i));
+      return true;
+    });
+
+    metrics::OperationScope::addRows(scanned, rs.rowCount());
+    return Result<ResultSet>::ok(std::move(rs));
+  };
+  return metrics::measure(metrics::Operation::RelationalSelect, run);
+}
+
+Result<TableSchema>
+InMemoryRelationalStorage::getTableSchema(const std::string &table) {
+  if (auto pt = findPartitioned(table))
+    return Result<TableSchema>::ok(pt->schema);
+  auto td = findTable(table);
+  if (!td)
+    return Result<TableSchema>::err(
+        Status::NotFound("Unknown table: " + table));
+  return Result<TableSchema>::ok(td->schema);
+}
+
+std::optional<size_t>
+InMemoryRelationalStorage::estimateRowCount(const std::string &table) const {
+  if (auto pt = findPartitioned(table)) {
+    size_t rows = 0;
+    for (const auto &part : pt->parts)
+      rows += part->estimateRowCount(table).value_or(0);
+    return rows;
+  }
+  auto td = findTable(table);
+  if (!td)
+    return std::nullopt;
+  std::shared_lock lk(td->publishMtx);
+  return td->size;
 }
 
-Status InMemoryRelationalStorage::createTable(const std::string &table,
-                                              const TableSchema &schema) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  if (tables_.find(table) != tables_.end()) {
-    return Status::AlreadyExists("Table already exists: " + table);
+std::optional<uint64_t>
+InMemoryRelationalStorage::tableVersion(const std::string &table) const {
+  if (auto pt = findPartitioned(table)) {
+    // Every commit restamps its partition above all earlier stamps, so the
+    // largest stamp changes whenever any partition does
+    uint64_t stamp = 0;
+    for (const auto &part : pt->parts)
+      stamp = std::max(stamp, part->tableVersion(table).value_or(0));
+    return stamp;
   }
-  tables_.emplace(table, TableData{schema, {}});
-  return Status::OK();
+  auto td = findTable(table);
+  if (!td)
+    return std::nullopt;
+  return td->stamp.load(std::memory_order_acquire);
 }
 
-Status InMemoryRelationalStorage::insertRow(const std::string &table,
-                                            const Row &row) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto it = tables_.find(table);
-  if (it == tables_.end()) {
-    return Status::NotFound("Unknown table: " + table);
+std::shared_ptr<const TableStatistics>
+InMemoryRelationalStorage::getTableStatistics(const std::string &table) const {
+  if (auto pt = findPartitioned(table)) {
+    std::vector<std::shared_ptr<const TableStatistics>> parts;
+    for (const auto &part : pt->parts)
+      parts.push_back(part->getTableStatistics(table));
+    return mergeStatistics(parts, pt->key);
   }
-  const auto &schema = it->second.schema;
-  // Validate row matches schema
-  if (auto err = SchemaValidator::validateRow(schema, row); !err.empty()) {
-    return Status::InvalidArgument(err);
+  auto td = findTable(table);
+  return td ? td->statistics() : nullptr;
+}
+
+std::optional<size_t> InMemoryRelationalStorage::estimateScanCost(
+    const std::string &table, const std::optional<Predicate> &where) const {
+  if (auto pt = findPartitioned(table)) {
+    if (auto one = pt->route(where))
+      return pt->parts[*one]->estimateScanCost(table, where);
+    size_t cost = 0;
+    for (const auto &part : pt->parts)
+      cost += part->estimateScanCost(table, where).value_or(0);
+    return cost;
   }
-  // In-memory append (deep copy to keep isolation)
-  it->second.rows.push_back(row.clone());
+  auto td = findTable(table);
+  if (!td)
+    return std::nullopt;
+  // Index lookups only; no row is read
+  std::optional<std::vector<size_t>> candidates;
+  RowSnapshot snap = td->snapshot(where, candidates);
+  return candidates ? candidates->size() : snap.size;
+}
 
-  // Enforce uniqueness constraints after insertion
-  if (auto err = SchemaValidator::validateUnique(schema, it->second.rows);
-      !err.empty()) {
-    // revert append
-    it->second.rows.pop_back();
-    return Status::FailedPrecondition(err);
+std::string InMemoryRelationalStorage::explainAccess(
+    const std::string &table, const std::optional<Predicate> &where) const {
+  if (auto pt = findPartitioned(table)) {
+    const std::string n = std::to_string(pt->parts.size());
+    if (auto one = pt->route(where))
+      return "partition " + std::to_string(*one) + " of " + n + ", " +
+             pt->parts[*one]->explainAccess(table, where);
+    return n + " partitions in parallel, each " +
+           pt->parts.front()->explainAccess(table, where);
   }
+  auto td = findTable(table);
+  if (!td || !where || td->indexes.empty())
+    return "full scan";
+  std::optional<std::vector<size_t>> candidates;
+  std::string path;
+  td->snapshot(where, candidates, &path);
+  if (!candidates)
+    return "full scan";
+  const size_t n = candidates->size();
+  return path + " (" + std::to_string(n) + (n == 1 ? " candidate)"
+                                                   : " candidates)");
+}
 
-  return Status::OK();
+std::string InMemoryRelationalStorage::explainOrderedAccess(
+    const std::string &table, const std::optional<Predicate> &where,
+    const ScanOrder &order) const {
+  if (auto pt = findPartitioned(table)) {
+    auto one = pt->route(where);
+    if (!one)
+      return explainAccess(table, where);
+    return "partition " + std::to_string(*one) + " of " +
+           std::to_string(pt->parts.size()) + ", " +
+           pt->parts[*one]->explainOrderedAccess(table, where, order);
+  }
+  auto td = findTable(table);
+  RowSnapshot snap;
+  if (!td || !td->orderedSnapshot(where, order, snap, nullptr))
+    return explainAccess(table, where);
+  return "ordered index on " + order.column +
+         (order.descending ? " descending" : "") + ", first " +
+         std::to_string(order.limit) + (order.withTies ? " rows and ties"
+                                                         : " rows");
 }
 
-Result<ResultSet>
-InMemoryRelationalStorage::select(const std::string &table,
-                                  const std::vector<std::string> &columns,
-                                  const std::optional<Predicate> &where) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto it = tables_.find(table);
-  if (it == tables_.end()) {
-    return Result<ResultSet>::err(Status::NotFound("Unknown table: " + table));
+Status InMemoryRelationalStorage::scan(const std::string &table,
+                                       const std::vector<std::string> &columns,
+                                       const std::optional<Predicate> &where,
+                                       const BatchSink &sink,
+                                       size_t batchRows) {
+  if (auto pt = findPartitioned(table)) {
+    if (auto one = pt->route(where))
+      return pt->parts[*one]->scan(table, columns, where, sink, batchRows);
+    auto batches = pt->collect(table, columns, where, batchRows);
+    if (!batches.hasValue())
+      return batches.status();
+    std::vector<RowBatch> parts = batches.takeValue();
+    for (auto &batch : parts)
+      if (!sink(batch))
+        break;
+    return Status::OK();
+  }
+  tracing::Span span("storage.relational.scan");
+  if (span.recording())
+    span.setAttribute("kadedb.table", table);
+  auto td = findTable(table);
+  if (!td) {
+    span.fail();
+    return Status::NotFound("Unknown table: " + table);
   }
-  const auto &schema = it->second.schema;
+  const auto &schema = td->schema;
 
-  // Determine projection indices and column metadata
+  RowBatch batch;
   std::vector<size_t> projIdx;
-  std::vector<std::string> outNames;
-  std::vector<ColumnType> outTypes;
+  if (auto st = resolveProjection(schema, columns, projIdx, batch.columnNames,
+                                  batch.columnTypes);
+      !st.ok()) {
+    return st;
+  }
+  if (batchRows == 0)
+    batchRows = kDefaultBatchRows;
 
-  if (columns.empty()) {
-    // select *
-    const auto &cols = schema.columns();
-    projIdx.resize(cols.size());
-    for (size_t i = 0; i < cols.size(); ++i) {
-      projIdx[i] = i;
-      outNames.push_back(cols[i].name);
-      outTypes.push_back(cols[i].type);
+  // Only the current batch is materialized; the snapshot keeps the rows alive
+  std::optional<std::vector<size_t>> candidates;
+  RowSnapshot snap = td->snapshot(where, candidates);
+  auto project = [&](size_t i) {
+    const InlineRow &row = snap.store->at(i).row;
+    std::vector<std::unique_ptr<Value>> cells;
+    cells.reserve(projIdx.size());
+    for (size_t idx : projIdx)
+      cells.push_back(row.values()[idx].toValue());
+    return cells;
+  };
+  bool stopped = false;
+  bool delivered = false;
+  bool interrupted = false;
+  auto add = [&](std::vector<std::unique_ptr<Value>> cells) {
+    batch.rows.push_back(std::move(cells));
+    if (batch.rows.size() < batchRows)
+      return true;
+    delivered = true;
+    stopped = !sink(batch);
+    batch.rows.clear();
+    return !stopped;
+  };
+
+  const size_t threads = ThreadPool::resolve(scanThreads());
+  const size_t morsels = morselCount(snap, candidates);
+  if (threads > 1 && morsels > 1) {
+    // Waves of one morsel per thread are converted in parallel and then
+    // delivered in order, so at most a wave is buffered
+    std::optional<BoundPredicate> bound;
+    if (where)
+      bound = BoundPredicate::bind(*where, schema);
+    std::vector<std::vector<std::vector<std::unique_ptr<Value>>>> parts;
+    for (size_t first = 0; first < morsels && !stopped; first += threads) {
+      if (!InterruptScope::check().ok()) {
+        interrupted = true;
+        break;
+      }
+      const size_t last = std::min(morsels, first + threads);
+      parts.clear();
+      parts.resize(last - first);
+      forEachMorselMatch(snap, candidates, bound, first, last, threads,
+                         [&](size_t m, const std::vector<size_t> &hits) {
+                           auto &part = parts[m - first];
+                           part.reserve(hits.size());
+                           for (size_t i : hits)
+                             part.push_back(project(i));
+                         });
+      for (size_t p = 0; p < parts.size() && !stopped; ++p)
+        for (size_t r = 0; r < parts[p].size() && add(std::move(parts[p][r]));
+             ++r) {
+        }
     }
   } else {
-    for (const auto &name : columns) {
-      size_t idx = schema.findColumn(name);
-      if (idx == TableSchema::npos) {
-        return Result<ResultSet>::err(
-            Status::InvalidArgument("Unknown column in projection: " + name));
-      }
-      projIdx.push_back(idx);
-      Column col;
-      schema.getColumn(name, col);
-      outNames.push_back(col.name);
-      outTypes.push_back(col.type);
+    forEachMatch(
+        schema, snap, candidates, where,
+        [&](size_t i) { return add(project(i)); }, &interrupted);
+  }
+  if (interrupted) {
+    span.fail();
+    return InterruptScope::check();
+  }
+  // Flush the tail; an empty first batch still delivers the metadata
+  if (!stopped && (!batch.rows.empty() || !delivered))
+    sink(batch);
+  // Charged to the caller's operation (a KadeQL statement's plan)
+  const size_t scanned = candidates ? candidates->size() : snap.size;
+  metrics::OperationScope::addRows(scanned, 0);
+  span.setAttribute("kadedb.rows_scanned", static_cast<int64_t>(scanned));
+  return Status::OK();
+}
+
+Status InMemoryRelationalStorage::scanOrdered(
+    const std::string &table, const std::vector<std::string> &columns,
+    const std::optional<Predicate> &where, const ScanOrder &order,
+    const BatchSink &sink, size_t batchRows) {
+  if (auto pt = findPartitioned(table)) {
+    if (auto one = pt->route(where))
+      return pt->parts[*one]->scanOrdered(table, columns, where, order, sink,
+                                          batchRows);
+    return scan(table, columns, where, sink, batchRows);
+  }
+  auto td = findTable(table);
+  if (!td)
+    return Status::NotFound("Unknown table: " + table);
+  RowBatch batch;
+  std::vector<size_t> projIdx;
+  if (auto st = resolveProjection(td->schema, columns, projIdx,
+                                  batch.columnNames, batch.columnTypes);
+      !st.ok())
+    return st;
+  RowSnapshot snap;
+  std::vector<size_t> positions;
+  size_t examined = 0;
+  if (!td->orderedSnapshot(where, order, snap, &positions, &examined))
+    return scan(table, columns, where, sink, batchRows);
+  if (auto st = InterruptScope::check(); !st.ok())
+    return st;
+  tracing::Span span("storage.relational.scan");
+  if (span.recording()) {
+    span.setAttribute("kadedb.table", table);
+    span.setAttribute("kadedb.rows_scanned", static_cast<int64_t>(examined));
+  }
+  if (batchRows == 0)
+    batchRows = kDefaultBatchRows;
+  // The rows are few: convert and deliver them batch by batch
+  bool delivered = false;
+  for (size_t first = 0; first < positions.size(); first += batchRows) {
+    batch.rows.clear();
+    const size_t last = std::min(positions.size(), first + batchRows);
+    for (size_t p = first; p < last; ++p) {
+      const InlineRow &row = snap.store->at(positions[p]).row;
+      std::vector<std::unique_ptr<Value>> cells;
+      cells.reserve(projIdx.size());
+      for (size_t idx : projIdx)
+        cells.push_back(row.values()[idx].toValue());
+      batch.rows.push_back(std::move(cells));
     }
+    delivered = true;
+    if (!sink(batch))
+      break;
   }
+  if (!delivered)
+    sink(batch);
+  metrics::OperationScope::addRows(examined, 0);
+  return Status::OK();
+}
 
-  ResultSet rs(outNames, outTypes);
+Result<ResultView>
+InMemoryRelationalStorage::selectView(const std::string &table,
+                                      const std::vector<std::string> &columns,
+                                      const std::optional<Predicate> &where) {
+  if (auto pt = findPartitioned(table)) {
+    // A view borrows the rows of one store
+    auto one = pt->route(where);
+    if (!one && pt->parts.size() > 1)
+      return Result<ResultView>::err(Status::FailedPrecondition(
+          "selectView of partitioned table " + table +
+          " needs a predicate pinning its key"));
+    return pt->parts[one.value_or(0)]->selectView(table, columns, where);
+  }
+  auto td = findTable(table);
+  if (!td) {
+    return Result<ResultView>::err(
+        Status::NotFound("Unknown table: " + table));
+  }
+  const auto &schema = td->schema;
 
-  for (const auto &r : it->second.rows) {
-    if (where) {
-      if (!evalPredicate(schema, r, *where))
-        continue;
-    }
+  ResultView view;
+  if (auto st = resolveProjection(schema, columns, view.projection_,
+                                  view.columnNames_, view.columnTypes_);
+      !st.ok()) {
+    return Result<ResultView>::err(st);
+  }
+  std::optional<std::vector<size_t>> candidates;
+  RowSnapshot snap = td->snapshot(where, candidates);
+  forEachMatch(schema, snap, candidates, where,
+               [&](size_t i) {
+                 view.positions_.push_back(i);
+                 return true;
+               });
+  view.store_ = std::move(snap.store);
+  return Result<ResultView>::ok(std::move(view));
+}
+
+ResultSet ResultView::toResultSet() const {
+  ResultSet rs(columnNames_, columnTypes_);
+  for (size_t r = 0; r < positions_.size(); ++r) {
     std::vector<std::unique_ptr<Value>> cells;
-    cells.reserve(projIdx.size());
-    for (size_t idx : projIdx) {
-      const auto &v = r.values()[idx];
-      cells.push_back(v ? v->clone() : nullptr);
-    }
+    cells.reserve(projection_.size());
+    for (size_t c = 0; c < projection_.size(); ++c)
+      cells.push_back(value(r, c));
     rs.addRow(ResultRow(std::move(cells)));
   }
+  return rs;
+}
 
-  return Result<ResultSet>::ok(std::move(rs));
+std::shared_ptr<InMemoryDocumentStorage::CollectionData>
+InMemoryDocumentStorage::findCollection(const std::string &collection) const {
+  std::shared_lock lk(mtx_);
+  auto it = data_.find(collection);
+  return it == data_.end() ? nullptr : it->second;
 }
 
 Status InMemoryDocumentStorage::createCollection(
     const std::string &collection,
     const std::optional<DocumentSchema> &schema) {
-  std::lock_guard<std::mutex> lk(mtx_);
+  std::lock_guard lk(mtx_);
   if (data_.find(collection) != data_.end())
     return Status::AlreadyExists("Collection already exists: " + collection);
-  CollectionData cd;
-  cd.schema = schema;
+  auto cd = std::make_shared<CollectionData>();
+  cd->schema = schema;
+  cd->changes = changes_;
+  if (schema) {
+    cd->validator = CompiledValidator(*schema);
+    for (const auto &kv : schema->fields()) {
+      if (kv.second.unique)
+        cd->uniqueValues[kv.first];
+    }
+  }
   data_.emplace(collection, std::move(cd));
   return Status::OK();
 }
 
 Status InMemoryDocumentStorage::dropCollection(const std::string &collection) {
-  std::lock_guard<std::mutex> lk(mtx_);
+  std::lock_guard lk(mtx_);
   auto it = data_.find(collection);
   if (it == data_.end())
     return Status::NotFound("Unknown collection: " + collection);
   data_.erase(it);
+  if (changes_) {
+    ChangeEvent e;
+    e.kind = ChangeEvent::Kind::Drop;
+    e.target = collection;
+    changes_->publish(std::move(e));
+  }
   return Status::OK();
 }
 
 std::vector<std::string> InMemoryDocumentStorage::listCollections() const {
-  std::lock_guard<std::mutex> lk(mtx_);
+  std::shared_lock lk(mtx_);
   std::vector<std::string> names;
   names.reserve(data_.size());
   for (const auto &kv : data_)
@@ -291,104 +2622,375 @@ std::vector<std::string> InMemoryDocumentStorage::listCollections() const {
   return names;
 }
 
+// Estimated bytes of a document held under `key` in a collection
+static size_t storedBytes(const std::string &key, const StoredDocument &doc) {
+  return memory::kMapEntryBytes +
+         sizeof(std::pair<const std::string, StoredDocument>) + key.size() +
+         doc.memoryBytes();
+}
+
+template <typename Doc>
+Status InMemoryDocumentStorage::putDocument(const std::string &collection,
+                                            const std::string &key,
+                                            Doc &&doc) {
+  auto run = [&]() -> Status {
+    // Create collection lazily if missing (MVP behavior)
+    auto cdp = findCollection(collection);
+    if (!cdp) {
+      std::lock_guard catalog(mtx_);
+      auto &slot = data_[collection];
+      if (!slot) {
+        slot = std::make_shared<CollectionData>();
+        slot->changes = changes_;
+      }
+      cdp = slot;
+    }
+    metrics::TimedLock lk(cdp->mtx);
+    auto &cd = *cdp;
+
+    // Validate against schema if present
+    if (cd.schema) {
+      auto err = cd.validator.validateDocument(doc);
+      if (!err.empty())
+        return Status::InvalidArgument(err);
+    }
+
+    // Enforce uniqueness constraints via the per-field value maps; a value
+    // already owned by the same key is allowed (the document is replaced)
+    if (cd.schema) {
+      for (const auto &kv : cd.schema->fields()) {
+        auto uit = cd.uniqueValues.find(kv.first);
+        if (uit == cd.uniqueValues.end())
+          continue;
+        const Value *v = uniqueFieldValue(doc, kv.first);
+        if (!v)
+          continue;
+        auto hit = uit->second.find(v->toString());
+        if (hit != uit->second.end() && hit->second != key)
+          return Status::FailedPrecondition(
+              "Duplicate value for unique field '" + kv.first + "'");
+      }
+    }
+
+    // Copies `doc`, or takes it over when passed by rvalue
+    StoredDocument stored = StoredDocument::make(
+        std::forward<Doc>(doc),
+        layout_ == DocumentLayout::Shaped ? &cd.shapes : nullptr);
+    auto it = cd.docs.find(key);
+    const size_t bytes = storedBytes(key, stored);
+    const size_t replaced =
+        it != cd.docs.end() ? storedBytes(key, it->second) : 0;
+    if (bytes > replaced && !cd.memory.fits(bytes - replaced))
+      return memory::budgetExceeded("collection", collection, cd.memory,
+                                    bytes - replaced);
+    cd.memory.add(bytes);
+    cd.memory.sub(replaced);
+    ChangeEvent event;
+    if (cd.changes) {
+      event.target = collection;
+      event.key = key;
+      if (it != cd.docs.end()) {
+        event.kind = ChangeEvent::Kind::Update;
+        event.beforeDoc = it->second.toDocument();
+      }
+    }
+    if (it != cd.docs.end()) {
+      removeUniqueValues(cd.uniqueValues, it->second, key);
+      removeIndexEntries(cd.indexes, cd.ordinals.get(), it->second,
+                         it->first);
+      it->second = std::move(stored);
+    } else {
+      it = cd.docs.emplace(key, std::move(stored)).first;
+    }
+    addUniqueValues(cd.uniqueValues, it->second, key);
+    addIndexEntries(cd.indexes, cd.ordinals.get(), it->second, it->first);
+    if (cd.changes) {
+      event.afterDoc = it->second.toDocument();
+      cd.changes->publish(std::move(event));
+    }
+    metrics::OperationScope::addRows(0, 1);
+    return Status::OK();
+  };
+  return metrics::measure(metrics::Operation::DocumentPut, run);
+}
+
 Status InMemoryDocumentStorage::put(const std::string &collection,
                                     const std::string &key,
                                     const Document &doc) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  // Create collection lazily if missing (MVP behavior)
-  auto it = data_.find(collection);
-  if (it == data_.end()) {
-    CollectionData cd;
-    data_.emplace(collection, std::move(cd));
-    it = data_.find(collection);
-  }
-
-  // Validate against schema if present
-  if (it->second.schema) {
-    auto err = SchemaValidator::validateDocument(*it->second.schema, doc);
-    if (!err.empty())
-      return Status::InvalidArgument(err);
-  }
-
-  // Enforce uniqueness constraints if schema defines unique fields
-  if (it->second.schema) {
-    // Avoid copying/moving Document (contains unique_ptr) to prevent
-    // MSVC from attempting to copy during potential vector reallocation.
-    std::vector<const Document *> docPtrs;
-    docPtrs.reserve(it->second.docs.size() + 1);
-    for (const auto &kv : it->second.docs) {
-      if (kv.first == key)
-        continue; // skip existing same key; replaced later
-      docPtrs.emplace_back(&kv.second);
-    }
-    docPtrs.emplace_back(&doc);
-    auto err = SchemaValidator::validateUnique(*it->second.schema, docPtrs);
-    if (!err.empty())
-      return Status::FailedPrecondition(err);
-  }
+  return putDocument(collection, key, doc);
+}
 
-  // Explicitly move the deep-copied Document to avoid any chance of MSVC
-  // selecting a copy-assignment path for the unordered_map value.
-  {
-    Document docCopy = deepCopyDocument(doc);
-    it->second.docs.erase(key);
-    it->second.docs.emplace(key, std::move(docCopy));
-  }
-  return Status::OK();
+Status InMemoryDocumentStorage::put(const std::string &collection,
+                                    const std::string &key, Document &&doc) {
+  return putDocument(collection, key, std::move(doc));
 }
 
 Result<Document> InMemoryDocumentStorage::get(const std::string &collection,
                                               const std::string &key) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto cit = data_.find(collection);
-  if (cit == data_.end())
-    return Result<Document>::err(Status::NotFound("Unknown collection"));
-  auto kit = cit->second.docs.find(key);
-  if (kit == cit->second.docs.end())
-    return Result<Document>::err(Status::NotFound("Key not found"));
-  return Result<Document>::ok(deepCopyDocument(kit->second));
+  auto run = [&]() -> Result<Document> {
+    auto cd = findCollection(collection);
+    if (!cd)
+      return Result<Document>::err(Status::NotFound("Unknown collection"));
+    metrics::TimedSharedLock lk(cd->mtx);
+    auto kit = cd->docs.find(key);
+    if (kit == cd->docs.end())
+      return Result<Document>::err(Status::NotFound("Key not found"));
+    metrics::OperationScope::addRows(1, 1);
+    return Result<Document>::ok(kit->second.toDocument());
+  };
+  return metrics::measure(metrics::Operation::DocumentGet, run);
 }
 
 Status InMemoryDocumentStorage::erase(const std::string &collection,
                                       const std::string &key) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto cit = data_.find(collection);
-  if (cit == data_.end())
+  auto run = [&]() -> Status {
+    auto cd = findCollection(collection);
+    if (!cd)
+      return Status::NotFound("Unknown collection: " + collection);
+    metrics::TimedLock lk(cd->mtx);
+    auto kit = cd->docs.find(key);
+    if (kit == cd->docs.end())
+      return Status::NotFound("Key not found: " + key);
+    metrics::OperationScope::addRows(1, 1);
+    removeUniqueValues(cd->uniqueValues, kit->second, key);
+    removeIndexEntries(cd->indexes, cd->ordinals.get(), kit->second,
+                       kit->first);
+    if (cd->ordinals)
+      cd->ordinals->release(&kit->first);
+    cd->memory.sub(storedBytes(key, kit->second));
+    if (cd->changes) {
+      ChangeEvent e;
+      e.kind = ChangeEvent::Kind::Delete;
+      e.target = collection;
+      e.key = key;
+      e.beforeDoc = kit->second.toDocument();
+      cd->changes->publish(std::move(e));
+    }
+    cd->docs.erase(kit);
+    return Status::OK();
+  };
+  return metrics::measure(metrics::Operation::DocumentErase, run);
+}
+
+Status InMemoryDocumentStorage::patch(const std::string &collection,
+                                      const std::string &key,
+                                      const std::vector<DocUpdate> &ops) {
+  auto run = [&]() -> Status {
+    auto cd = findCollection(collection);
+    if (!cd)
+      return Status::NotFound("Unknown collection: " + collection);
+    metrics::TimedLock lk(cd->mtx);
+    auto kit = cd->docs.find(key);
+    if (kit == cd->docs.end())
+      return Status::NotFound("Key not found: " + key);
+    metrics::OperationScope::addRows(1, 1);
+    StoredDocument &doc = kit->second;
+    auto res = resolveDocUpdates(
+        [&](const std::string &field) { return doc.field(field); }, ops);
+    if (!res.hasValue())
+      return res.status();
+    std::vector<FieldChange> changes = res.takeValue();
+    if (auto st = checkFieldChanges(cd->validator, cd->uniqueValues, key,
+                                    changes);
+        !st.ok())
+      return st;
+    ChangeEvent event;
+    if (cd->changes) {
+      event.kind = ChangeEvent::Kind::Update;
+      event.target = collection;
+      event.key = key;
+      event.beforeDoc = doc.toDocument();
+    }
+    ShapeTable *shapes =
+        layout_ == DocumentLayout::Shaped ? &cd->shapes : nullptr;
+    auto apply = [&] {
+      return applyFieldChanges(doc, kit->first, changes, shapes,
+                               cd->uniqueValues, cd->indexes,
+                               cd->ordinals.get());
+    };
+    const std::ptrdiff_t delta = apply();
+    if (delta > 0 && !cd->memory.fits(static_cast<size_t>(delta))) {
+      apply(); // undo
+      return memory::budgetExceeded("collection", collection, cd->memory,
+                                    static_cast<size_t>(delta));
+    }
+    accountBytes(cd->memory, delta);
+    if (cd->changes) {
+      event.afterDoc = doc.toDocument();
+      cd->changes->publish(std::move(event));
+    }
+    return Status::OK();
+  };
+  return metrics::measure(metrics::Operation::DocumentPatch, run);
+}
+
+Result<size_t>
+InMemoryDocumentStorage::updateWhere(const std::string &collection,
+                                     const std::optional<DocPredicate> &where,
+                                     const std::vector<DocUpdate> &ops) {
+  using R = Result<size_t>;
+  auto run = [&]() -> R {
+    auto cd = findCollection(collection);
+    if (!cd)
+      return R::err(Status::NotFound("Unknown collection: " + collection));
+    metrics::TimedLock lk(cd->mtx);
+    if (auto st = validateDocumentQuery(cd->schema, {}, where); !st.ok())
+      return R::err(st);
+
+    using Entry = std::pair<const std::string, StoredDocument>;
+    std::vector<Entry *> matches;
+    std::optional<std::vector<FieldIndex::Key>> candidates;
+    if (where)
+      candidates =
+          docIndexCandidates(cd->indexes, cd->ordinals.get(), *where);
+    size_t scanned = 0;
+    auto consider = [&](Entry &kv) {
+      ++scanned;
+      if (!where || evalDocPredicate(kv.second, *where))
+        matches.push_back(&kv);
+    };
+    if (candidates) {
+      for (FieldIndex::Key k : *candidates)
+        consider(*cd->docs.find(*k));
+    } else {
+      for (auto &kv : cd->docs)
+        consider(kv);
+    }
+    metrics::OperationScope::addRows(scanned, matches.size());
+
+    // Patch the matches one after another, each checked against the
+    // documents patched before it; a failure undoes them all
+    ShapeTable *shapes =
+        layout_ == DocumentLayout::Shaped ? &cd->shapes : nullptr;
+    std::vector<std::vector<FieldChange>> undo;
+    undo.reserve(matches.size());
+    std::vector<Document> before;
+    std::ptrdiff_t delta = 0;
+    auto apply = [&](size_t m) {
+      return applyFieldChanges(matches[m]->second, matches[m]->first,
+                               undo[m], shapes, cd->uniqueValues,
+                               cd->indexes, cd->ordinals.get());
+    };
+    auto rollback = [&] {
+      for (size_t m = undo.size(); m-- > 0;)
+        apply(m);
+    };
+    for (size_t m = 0; m < matches.size(); ++m) {
+      const Entry &kv = *matches[m];
+      auto res = resolveDocUpdates(
+          [&](const std::string &field) { return kv.second.field(field); },
+          ops);
+      Status st = res.hasValue() ? checkFieldChanges(cd->validator,
+                                                     cd->uniqueValues,
+                                                     kv.first, res.value())
+                                 : res.status();
+      if (!st.ok()) {
+        rollback();
+        return R::err(st);
+      }
+      if (cd->changes)
+        before.push_back(kv.second.toDocument());
+      undo.push_back(res.takeValue());
+      delta += apply(m);
+    }
+    if (delta > 0 && !cd->memory.fits(static_cast<size_t>(delta))) {
+      rollback();
+      return R::err(memory::budgetExceeded("collection", collection,
+                                           cd->memory,
+                                           static_cast<size_t>(delta)));
+    }
+    accountBytes(cd->memory, delta);
+    if (cd->changes) {
+      for (size_t m = 0; m < matches.size(); ++m) {
+        ChangeEvent e;
+        e.kind = ChangeEvent::Kind::Update;
+        e.target = collection;
+        e.key = matches[m]->first;
+        e.beforeDoc = std::move(before[m]);
+        e.afterDoc = matches[m]->second.toDocument();
+        cd->changes->publish(std::move(e));
+      }
+    }
+    return R::ok(matches.size());
+  };
+  return metrics::measure(metrics::Operation::DocumentPatch, run);
+}
+
+Result<size_t>
+InMemoryDocumentStorage::memoryUsage(const std::string &collection) const {
+  auto cd = findCollection(collection);
+  if (!cd)
+    return Result<size_t>::err(
+        Status::NotFound("Unknown collection: " + collection));
+  return Result<size_t>::ok(cd->memory.bytes());
+}
+
+Status InMemoryDocumentStorage::setMemoryBudget(const std::string &collection,
+                                                size_t bytes) {
+  auto cd = findCollection(collection);
+  if (!cd)
     return Status::NotFound("Unknown collection: " + collection);
-  auto kit = cit->second.docs.find(key);
-  if (kit == cit->second.docs.end())
-    return Status::NotFound("Key not found: " + key);
-  cit->second.docs.erase(kit);
+  cd->memory.setBudget(bytes);
   return Status::OK();
 }
 
+void InMemoryDocumentStorage::enableChangeCapture(size_t capacity) {
+  std::lock_guard lk(mtx_);
+  if (changes_)
+    return;
+  changes_ = std::make_shared<ChangeFeed>(capacity);
+  for (auto &kv : data_) {
+    std::lock_guard clk(kv.second->mtx);
+    kv.second->changes = changes_;
+  }
+}
+
+std::shared_ptr<ChangeFeed> InMemoryDocumentStorage::changeFeed() const {
+  std::shared_lock lk(mtx_);
+  return changes_;
+}
+
+Result<std::unique_ptr<ChangeSubscription>>
+InMemoryDocumentStorage::subscribeChanges(const std::string &collection) {
+  using R = Result<std::unique_ptr<ChangeSubscription>>;
+  auto feed = changeFeed();
+  if (!feed)
+    return R::err(Status::FailedPrecondition("Change capture is not enabled"));
+  if (!findCollection(collection))
+    return R::err(Status::NotFound("Unknown collection: " + collection));
+  return R::ok(feed->subscribe(collection));
+}
+
 Result<size_t>
 InMemoryDocumentStorage::count(const std::string &collection) const {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto cit = data_.find(collection);
-  if (cit == data_.end())
+  auto cd = findCollection(collection);
+  if (!cd)
     return Result<size_t>::err(Status::NotFound("Unknown collection"));
-  return Result<size_t>::ok(cit->second.docs.size());
+  std::shared_lock lk(cd->mtx);
+  return Result<size_t>::ok(cd->docs.size());
 }
 
-Result<std::vector<std::pair<std::string, Document>>>
-InMemoryDocumentStorage::query(const std::string &collection,
-                               const std::vector<std::string> &fields,
-                               const std::optional<DocPredicate> &where) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto cit = data_.find(collection);
-  if (cit == data_.end())
-    return Result<std::vector<std::pair<std::string, Document>>>::err(
-        Status::NotFound("Unknown collection"));
-
-  const auto &schemaOpt = cit->second.schema;
+Result<std::optional<DocumentSchema>>
+InMemoryDocumentStorage::getCollectionSchema(
+    const std::string &collection) const {
+  using R = Result<std::optional<DocumentSchema>>;
+  auto cd = findCollection(collection);
+  if (!cd)
+    return R::err(Status::NotFound("Unknown collection"));
+  std::shared_lock lk(cd->mtx);
+  return R::ok(cd->schema);
+}
 
+// Utility: check the projection and predicate fields of a document query
+// against the collection schema, if any
+Status validateDocumentQuery(const std::optional<DocumentSchema> &schemaOpt,
+                             const std::vector<std::string> &fields,
+                             const std::optional<DocPredicate> &where) {
   // Validate projection field names if we have a schema
   if (schemaOpt && !fields.empty()) {
     for (const auto &f : fields) {
       if (!schemaOpt->hasField(f)) {
-        return Result<std::vector<std::pair<std::string, Document>>>::err(
-            Status::InvalidArgument("Unknown field in projection: " + f));
+        return Status::InvalidArgument("Unknown field in projection: " + f);
       }
     }
   }
@@ -420,157 +3022,321 @@ InMemoryDocumentStorage::query(const std::string &collection,
   // Validate predicate fields against schema, if present
   if (schemaOpt && where) {
     if (!validateWhereFields(*schemaOpt, *where, validateWhereFields)) {
-      return Result<std::vector<std::pair<std::string, Document>>>::err(
-          Status::InvalidArgument("Unknown field in predicate"));
+      return Status::InvalidArgument("Unknown field in predicate");
     }
   }
+  return Status::OK();
+}
 
-  std::vector<std::pair<std::string, Document>> out;
-  out.reserve(cit->second.docs.size());
-  for (const auto &kv : cit->second.docs) {
-    const auto &k = kv.first;
-    const auto &doc = kv.second;
-    if (where) {
-      if (!evalDocPredicate(doc, *where))
-        continue;
+Result<std::vector<std::pair<std::string, Document>>>
+InMemoryDocumentStorage::query(const std::string &collection,
+                               const std::vector<std::string> &fields,
+                               const std::optional<DocPredicate> &where) {
+  using R = Result<std::vector<std::pair<std::string, Document>>>;
+  tracing::Span span("storage.document.query");
+  if (span.recording())
+    span.setAttribute("kadedb.collection", collection);
+  auto run = [&]() -> R {
+    std::vector<std::pair<std::string, Document>> out;
+    const size_t threads = ThreadPool::resolve(scanThreads());
+    if (threads <= 1) {
+      Status st = queryVisit(collection, fields, where,
+                             [&](const std::string &key,
+                                 const DocumentView &doc) {
+                               out.emplace_back(key, doc.toDocument());
+                               return true;
+                             });
+      if (!st.ok())
+        return R::err(st);
+      return R::ok(std::move(out));
     }
-    if (fields.empty()) {
-      // Deep copy the document and construct the pair plainly.
-      Document copy = deepCopyDocument(doc);
-      out.emplace_back(std::string(k), std::move(copy));
+
+    auto cd = findCollection(collection);
+    if (!cd)
+      return R::err(Status::NotFound("Unknown collection"));
+    metrics::TimedSharedLock lk(cd->mtx);
+    if (auto st = validateDocumentQuery(cd->schema, fields, where); !st.ok())
+      return R::err(st);
+
+    // The documents in the order queryVisit() visits them, then matched and
+    // copied morsel by morsel under the read lock
+    using Entry = std::pair<const std::string, StoredDocument>;
+    std::vector<const Entry *> docs;
+    std::optional<std::vector<FieldIndex::Key>> candidates;
+    if (where)
+      candidates =
+          docIndexCandidates(cd->indexes, cd->ordinals.get(), *where);
+    if (candidates) {
+      docs.reserve(candidates->size());
+      for (FieldIndex::Key k : *candidates)
+        docs.push_back(&*cd->docs.find(*k));
     } else {
-      Document proj;
-      for (const auto &fname : fields) {
-        auto it = doc.find(fname);
-        if (it != doc.end()) {
-          if (it->second)
-            proj.emplace(std::piecewise_construct, std::forward_as_tuple(fname),
-                         std::forward_as_tuple(it->second->clone()));
-          else
-            proj.emplace(std::piecewise_construct, std::forward_as_tuple(fname),
-                         std::forward_as_tuple(nullptr));
-        }
-      }
-      out.emplace_back(std::string(k), std::move(proj));
+      docs.reserve(cd->docs.size());
+      for (const auto &kv : cd->docs)
+        docs.push_back(&kv);
+    }
+    std::vector<std::vector<std::pair<std::string, Document>>> parts(
+        (docs.size() + kMorselDocuments - 1) / kMorselDocuments);
+    ThreadPool::shared().parallelFor(
+        docs.size(), kMorselDocuments, threads,
+        [&](size_t m, size_t lo, size_t hi) {
+          for (size_t k = lo; k < hi; ++k) {
+            const Entry &kv = *docs[k];
+            if (where && !evalDocPredicate(kv.second, *where))
+              continue;
+            parts[m].emplace_back(
+                kv.first, DocumentView(kv.second, &fields).toDocument());
+          }
+        });
+    for (auto &part : parts)
+      for (auto &doc : part)
+        out.push_back(std::move(doc));
+    metrics::OperationScope::addRows(docs.size(), out.size());
+    return R::ok(std::move(out));
+  };
+  auto res = metrics::measure(metrics::Operation::DocumentQuery, run);
+  if (!res.hasValue())
+    span.fail();
+  return res;
+}
+
+Status InMemoryDocumentStorage::queryVisit(
+    const std::string &collection, const std::vector<std::string> &fields,
+    const std::optional<DocPredicate> &where, const DocumentVisitor &fn) {
+  auto cd = findCollection(collection);
+  if (!cd)
+    return Status::NotFound("Unknown collection");
+  metrics::TimedSharedLock lk(cd->mtx);
+  if (auto st = validateDocumentQuery(cd->schema, fields, where); !st.ok())
+    return st;
+
+  std::optional<std::vector<FieldIndex::Key>> candidates;
+  if (where)
+    candidates =
+        docIndexCandidates(cd->indexes, cd->ordinals.get(), *where);
+
+  size_t scanned = 0, returned = 0;
+  auto visit = [&](const std::string &k, const StoredDocument &doc) {
+    ++scanned;
+    if (where && !evalDocPredicate(doc, *where))
+      return true;
+    ++returned;
+    return fn(k, DocumentView(doc, &fields));
+  };
+  if (candidates) {
+    for (FieldIndex::Key k : *candidates) {
+      auto it = cd->docs.find(*k);
+      if (!visit(it->first, it->second))
+        break;
     }
+  } else {
+    for (const auto &kv : cd->docs)
+      if (!visit(kv.first, kv.second))
+        break;
   }
+  metrics::OperationScope::addRows(scanned, returned);
+  return Status::OK();
+}
 
-  return Result<std::vector<std::pair<std::string, Document>>>::ok(
-      std::move(out));
+Status InMemoryDocumentStorage::createIndex(const std::string &collection,
+                                            const std::string &field,
+                                            IndexType type) {
+  auto cdp = findCollection(collection);
+  if (!cdp)
+    return Status::NotFound("Unknown collection: " + collection);
+  std::lock_guard lk(cdp->mtx);
+  auto &cd = *cdp;
+  if (cd.schema && !cd.schema->hasField(field))
+    return Status::InvalidArgument("Unknown field for index: " + field);
+  if (cd.indexes.count(field))
+    return Status::AlreadyExists("Index already exists on field: " + field);
+  if (type == IndexType::Bitmap && !cd.ordinals)
+    cd.ordinals = std::make_unique<DocOrdinals>();
+  FieldIndex index(type);
+  for (const auto &kv : cd.docs)
+    index.insert(kv.second.field(field).toInline(), &kv.first,
+                 cd.ordinals ? cd.ordinals->assign(&kv.first) : 0);
+  cd.indexes.emplace(field, std::move(index));
+  return Status::OK();
 }
 
 std::vector<std::string> InMemoryRelationalStorage::listTables() const {
-  std::lock_guard<std::mutex> lk(mtx_);
+  std::shared_lock lk(mtx_);
   std::vector<std::string> names;
-  names.reserve(tables_.size());
+  names.reserve(tables_.size() + partitioned_.size());
   for (const auto &kv : tables_)
     names.push_back(kv.first);
+  for (const auto &kv : partitioned_)
+    names.push_back(kv.first);
   return names;
 }
 
 Status InMemoryRelationalStorage::dropTable(const std::string &table) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto it = tables_.find(table);
-  if (it == tables_.end())
-    return Status::NotFound("Unknown table: " + table);
-  tables_.erase(it);
+  // Operations already holding the table keep it alive until they finish
+  std::lock_guard lk(mtx_);
+  if (!partitioned_.erase(table)) {
+    auto it = tables_.find(table);
+    if (it == tables_.end())
+      return Status::NotFound("Unknown table: " + table);
+    tables_.erase(it);
+  }
+  publishTableChange(ChangeEvent::Kind::Drop, table);
   return Status::OK();
 }
 
 Result<size_t>
 InMemoryRelationalStorage::deleteRows(const std::string &table,
                                       const std::optional<Predicate> &where) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto it = tables_.find(table);
-  if (it == tables_.end())
-    return Result<size_t>::err(Status::NotFound("Unknown table: " + table));
-
-  auto &rows = it->second.rows;
-  const auto &schema = it->second.schema;
-
-  if (!where) {
-    size_t cnt = rows.size();
-    rows.clear();
-    return Result<size_t>::ok(cnt);
+  if (auto pt = findPartitioned(table)) {
+    std::vector<size_t> deleted(pt->parts.size(), 0);
+    Status st = pt->forEach(where, [&](size_t i) {
+      auto res = pt->parts[i]->deleteRows(table, where);
+      if (!res.hasValue())
+        return res.status();
+      deleted[i] = res.value();
+      return Status::OK();
+    });
+    if (!st.ok())
+      return Result<size_t>::err(st);
+    if (!where) {
+      std::shared_lock lk(mtx_);
+      publishTableChange(ChangeEvent::Kind::Truncate, table);
+    }
+    size_t n = 0;
+    for (size_t d : deleted)
+      n += d;
+    return Result<size_t>::ok(n);
   }
+  auto run = [&]() -> Result<size_t> {
+    auto td = findTable(table);
+    if (!td)
+      return Result<size_t>::err(Status::NotFound("Unknown table: " + table));
+    auto &tableData = *td;
+    const auto &schema = tableData.schema;
+    metrics::TimedLock lk(tableData.writeMtx);
 
-  std::vector<Row> kept;
-  kept.reserve(rows.size());
-  size_t removed = 0;
-  for (const auto &r : rows) {
-    if (evalPredicate(schema, r, *where))
-      ++removed;
-    else
-      kept.push_back(r.clone());
-  }
-  rows.swap(kept);
-  return Result<size_t>::ok(removed);
+    if (!where) {
+      size_t cnt = tableData.size - tableData.dead;
+      metrics::OperationScope::addRows(cnt, cnt);
+      tableData.reset();
+      return Result<size_t>::ok(cnt);
+    }
+
+    // Deleting only stamps the end version of the matched rows
+    std::vector<size_t> matched = tableData.matchLive(where);
+    if (matched.empty())
+      return Result<size_t>::ok(0);
+    for (size_t i : matched)
+      removeUniqueKeys(schema, tableData.uniqueKeys,
+                       tableData.store->at(i).row);
+    tableData.commit(matched, {});
+    return Result<size_t>::ok(matched.size());
+  };
+  return metrics::measure(metrics::Operation::RelationalDelete, run);
 }
 
 Result<size_t> InMemoryRelationalStorage::updateRows(
     const std::string &table,
     const std::unordered_map<std::string, AssignmentValue> &assignments,
     const std::optional<Predicate> &where) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto it = tables_.find(table);
-  if (it == tables_.end())
-    return Result<size_t>::err(Status::NotFound("Unknown table: " + table));
-
-  auto &tableData = it->second;
-  const auto &schema = tableData.schema;
-
-  // Validate assignment columns exist
-  for (const auto &kv : assignments) {
-    const std::string &colName = kv.first;
-    size_t idx = schema.findColumn(colName);
-    if (idx == TableSchema::npos)
-      return Result<size_t>::err(
-          Status::InvalidArgument("Unknown assignment column: " + colName));
+  if (auto pt = findPartitioned(table)) {
+    const std::string &keyName = pt->schema.columns()[pt->key].name;
+    if (assignments.count(keyName))
+      return Result<size_t>::err(Status::InvalidArgument(
+          "Cannot update partition key column '" + keyName + "'"));
+    std::vector<size_t> updated(pt->parts.size(), 0);
+    Status st = pt->forEach(where, [&](size_t i) {
+      auto res = pt->parts[i]->updateRows(table, assignments, where);
+      if (!res.hasValue())
+        return res.status();
+      updated[i] = res.value();
+      return Status::OK();
+    });
+    if (!st.ok())
+      return Result<size_t>::err(st);
+    size_t n = 0;
+    for (size_t u : updated)
+      n += u;
+    return Result<size_t>::ok(n);
   }
+  auto run = [&]() -> Result<size_t> {
+    auto td = findTable(table);
+    if (!td)
+      return Result<size_t>::err(Status::NotFound("Unknown table: " + table));
+    auto &tableData = *td;
+    const auto &schema = tableData.schema;
 
-  // Work on a copy for atomicity
-  auto newRows = tableData.rows; // deep rows
-
-  size_t updated = 0;
-  for (auto &r : newRows) {
-    if (where && !evalPredicate(schema, r, *where))
-      continue;
-    // Apply each assignment
+    // Validate assignment columns exist
     for (const auto &kv : assignments) {
       const std::string &colName = kv.first;
       size_t idx = schema.findColumn(colName);
-      const AssignmentValue &av = kv.second;
-      std::unique_ptr<Value> v;
-      if (av.kind == AssignmentValue::Kind::Constant) {
-        v = av.constant ? av.constant->clone() : nullptr;
-      } else {
-        // ColumnRef: fetch from current row
-        size_t srcIdx = schema.findColumn(av.column_ref);
-        if (srcIdx == TableSchema::npos) {
-          return Result<size_t>::err(Status::InvalidArgument(
-              "Unknown column in assignment reference: " + av.column_ref));
+      if (idx == TableSchema::npos)
+        return Result<size_t>::err(
+            Status::InvalidArgument("Unknown assignment column: " + colName));
+    }
+
+    // Convert constant assignments to compact values once per statement
+    std::unordered_map<std::string, InlineValue> constants;
+    for (const auto &kv : assignments) {
+      if (kv.second.kind == AssignmentValue::Kind::Constant)
+        constants.emplace(kv.first,
+                          InlineValue::fromValue(kv.second.constant.get()));
+    }
+
+    // Build and validate every new version before committing any of them
+    // (atomicity); only matched rows are copied
+    metrics::TimedLock lk(tableData.writeMtx);
+    std::vector<size_t> matched = tableData.matchLive(where);
+    std::vector<const InlineRow *> oldRows;
+    std::vector<InlineRow> newRows;
+    oldRows.reserve(matched.size());
+    newRows.reserve(matched.size());
+    for (size_t i : matched) {
+      const InlineRow &cur = tableData.store->at(i).row;
+      InlineRow r = cur;
+      // Apply each assignment
+      for (const auto &kv : assignments) {
+        const std::string &colName = kv.first;
+        size_t idx = schema.findColumn(colName);
+        const AssignmentValue &av = kv.second;
+        InlineValue v;
+        if (av.kind == AssignmentValue::Kind::Constant) {
+          v = constants.find(colName)->second;
+        } else {
+          // ColumnRef: fetch from current row
+          size_t srcIdx = schema.findColumn(av.column_ref);
+          if (srcIdx == TableSchema::npos) {
+            return Result<size_t>::err(Status::InvalidArgument(
+                "Unknown column in assignment reference: " + av.column_ref));
+          }
+          v = r.values()[srcIdx];
         }
-        const auto &src = r.values()[srcIdx];
-        v = src ? src->clone() : nullptr;
+        r.set(idx, std::move(v));
       }
-      r.set(idx, std::move(v));
-    }
-    // Validate the updated row against schema
-    if (auto err = SchemaValidator::validateRow(schema, r); !err.empty()) {
-      return Result<size_t>::err(Status::InvalidArgument(err));
+      // Validate the updated row against schema
+      if (auto err = tableData.validator.validateRow(r); !err.empty()) {
+        return Result<size_t>::err(Status::InvalidArgument(err));
+      }
+      oldRows.push_back(&cur);
+      newRows.push_back(std::move(r));
     }
-    ++updated;
-  }
 
-  // Enforce uniqueness constraints after updates
-  if (auto err = SchemaValidator::validateUnique(schema, newRows);
-      !err.empty()) {
-    return Result<size_t>::err(Status::FailedPrecondition(err));
-  }
+    if (const size_t bytes = liveGrowth(oldRows, newRows);
+        !tableData.memory.fits(bytes))
+      return Result<size_t>::err(
+          memory::budgetExceeded("table", table, tableData.memory, bytes));
+    // Enforce uniqueness constraints against the per-column key sets
+    if (auto err =
+            replaceUniqueKeys(schema, tableData.uniqueKeys, oldRows, newRows);
+        !err.empty()) {
+      return Result<size_t>::err(Status::FailedPrecondition(err));
+    }
 
-  // Commit
-  tableData.rows.swap(newRows);
-  return Result<size_t>::ok(updated);
+    // Commit: end the old versions and append the new ones
+    tableData.commit(matched, std::move(newRows));
+    return Result<size_t>::ok(matched.size());
+  };
+  return metrics::measure(metrics::Operation::RelationalUpdate, run);
 }
 
 Status InMemoryRelationalStorage::updateRows(
@@ -593,12 +3359,195 @@ Status InMemoryRelationalStorage::updateRows(
 }
 
 Status InMemoryRelationalStorage::truncateTable(const std::string &table) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto it = tables_.find(table);
-  if (it == tables_.end())
+  if (auto pt = findPartitioned(table)) {
+    Status st = pt->forEach(std::nullopt, [&](size_t i) {
+      return pt->parts[i]->truncateTable(table);
+    });
+    if (st.ok()) {
+      std::shared_lock lk(mtx_);
+      publishTableChange(ChangeEvent::Kind::Truncate, table);
+    }
+    return st;
+  }
+  auto td = findTable(table);
+  if (!td)
+    return Status::NotFound("Unknown table: " + table);
+  std::lock_guard lk(td->writeMtx);
+  td->reset();
+  return Status::OK();
+}
+
+Status InMemoryRelationalStorage::createIndex(const std::string &table,
+                                              const std::string &column,
+                                              IndexType type) {
+  if (auto pt = findPartitioned(table)) {
+    for (const auto &part : pt->parts)
+      if (auto st = part->createIndex(table, column, type); !st.ok())
+        return st;
+    return Status::OK();
+  }
+  auto td = findTable(table);
+  if (!td)
+    return Status::NotFound("Unknown table: " + table);
+  auto &tableData = *td;
+  std::lock_guard lk(tableData.writeMtx);
+  size_t idx = tableData.schema.findColumn(column);
+  if (idx == TableSchema::npos)
+    return Status::InvalidArgument("Unknown column for index: " + column);
+  if (tableData.indexes.count(idx))
+    return Status::AlreadyExists("Index already exists on column: " + column);
+  // Only live versions: snapshots taken once the index exists see no others
+  ColumnIndex index(type, tableData.schema.columns()[idx].type);
+  for (size_t i = 0; i < tableData.size; ++i) {
+    const RowVersion &v = tableData.store->at(i);
+    if (v.live())
+      index.insert(v.row.values()[idx], i);
+  }
+  std::lock_guard pub(tableData.publishMtx);
+  tableData.indexes.emplace(idx, std::move(index));
+  return Status::OK();
+}
+
+Result<size_t>
+InMemoryRelationalStorage::memoryUsage(const std::string &table) const {
+  if (auto pt = findPartitioned(table)) {
+    size_t bytes = 0;
+    for (const auto &part : pt->parts)
+      bytes += part->memoryUsage(table).value();
+    return Result<size_t>::ok(bytes);
+  }
+  auto td = findTable(table);
+  if (!td)
+    return Result<size_t>::err(Status::NotFound("Unknown table: " + table));
+  return Result<size_t>::ok(td->memory.bytes());
+}
+
+Status InMemoryRelationalStorage::setMemoryBudget(const std::string &table,
+                                                  size_t bytes) {
+  if (auto pt = findPartitioned(table)) {
+    // Split evenly; keys hash evenly too
+    const size_t n = pt->parts.size();
+    for (const auto &part : pt->parts)
+      part->setMemoryBudget(table, bytes == 0 ? 0 : (bytes + n - 1) / n);
+    return Status::OK();
+  }
+  auto td = findTable(table);
+  if (!td)
     return Status::NotFound("Unknown table: " + table);
-  it->second.rows.clear();
+  td->memory.setBudget(bytes);
   return Status::OK();
 }
 
+// ---- Change capture ----
+
+void InMemoryRelationalStorage::enableChangeCapture(size_t capacity) {
+  useChangeFeed(std::make_shared<ChangeFeed>(capacity));
+}
+
+std::shared_ptr<ChangeFeed> InMemoryRelationalStorage::changeFeed() const {
+  std::shared_lock lk(mtx_);
+  return changes_;
+}
+
+void InMemoryRelationalStorage::useChangeFeed(
+    const std::shared_ptr<ChangeFeed> &feed) {
+  std::lock_guard lk(mtx_);
+  if (changes_)
+    return;
+  changes_ = feed;
+  for (auto &kv : tables_) {
+    std::lock_guard wlk(kv.second->writeMtx);
+    kv.second->changes = feed;
+  }
+  for (auto &kv : partitioned_)
+    for (auto &part : kv.second->parts)
+      part->useChangeFeed(feed);
+}
+
+void InMemoryRelationalStorage::publishTableChange(ChangeEvent::Kind kind,
+                                                   const std::string &table) {
+  if (!changes_)
+    return;
+  ChangeEvent e;
+  e.kind = kind;
+  e.target = table;
+  changes_->publish(std::move(e));
+}
+
+Result<std::unique_ptr<ChangeSubscription>>
+InMemoryRelationalStorage::subscribeChanges(
+    const std::string &table, const std::optional<Predicate> &where) {
+  using R = Result<std::unique_ptr<ChangeSubscription>>;
+  auto feed = changeFeed();
+  if (!feed)
+    return R::err(Status::FailedPrecondition("Change capture is not enabled"));
+  TableSchema schema;
+  if (auto pt = findPartitioned(table))
+    schema = pt->schema;
+  else if (auto td = findTable(table))
+    schema = td->schema;
+  else
+    return R::err(Status::NotFound("Unknown table: " + table));
+  if (!where)
+    return R::ok(feed->subscribe(table));
+  // The bound form points into the predicate, so the filter owns both
+  auto pred = std::make_shared<Predicate>(copyPredicate(*where));
+  auto bound =
+      std::make_shared<BoundPredicate>(BoundPredicate::bind(*pred, schema));
+  return R::ok(feed->subscribe(table, [pred, bound](const ChangeEvent &e) {
+    return (e.before && bound->matches(*e.before)) ||
+           (e.after && bound->matches(*e.after));
+  }));
+}
+
+size_t InMemoryRelationalStorage::collectGarbage() {
+  std::vector<std::shared_ptr<TableData>> tables;
+  std::vector<std::shared_ptr<PartitionedTable>> partitioned;
+  {
+    std::shared_lock lk(mtx_);
+    tables.reserve(tables_.size());
+    for (const auto &kv : tables_)
+      tables.push_back(kv.second);
+    for (const auto &kv : partitioned_)
+      partitioned.push_back(kv.second);
+  }
+  size_t reclaimed = 0;
+  for (const auto &pt : partitioned)
+    for (const auto &part : pt->parts)
+      reclaimed += part->collectGarbage();
+  for (const auto &td : tables) {
+    std::lock_guard lk(td->writeMtx);
+    if (td->dead > 0)
+      reclaimed += td->compact();
+  }
+  return reclaimed;
+}
+
+void InMemoryRelationalStorage::startBackgroundGc(
+    std::chrono::milliseconds interval) {
+  stopBackgroundGc();
+  gcStop_ = false;
+  gcThread_ = std::thread([this, interval]() {
+    std::unique_lock lk(gcMtx_);
+    while (!gcCv_.wait_for(lk, interval, [this] { return gcStop_; })) {
+      lk.unlock();
+      collectGarbage();
+      lk.lock();
+    }
+  });
+}
+
+void InMemoryRelationalStorage::stopBackgroundGc() {
+  if (!gcThread_.joinable())
+    return;
+  {
+    std::lock_guard lk(gcMtx_);
+    gcStop_ = true;
+  }
+  gcCv_.notify_all();
+  gcThread_.join();
+}
+
+InMemoryRelationalStorage::~InMemoryRelationalStorage() { stopBackgroundGc(); }
+
 } // namespace kadedb
@@ -0,0 +1,196 @@
+#include "kadedb/stored_document.h"
+#include "kadedb/memory.h"
+
+#include <algorithm>
+
+namespace kadedb {
+
+std::unique_ptr<Value> FieldRef::clone() const {
+  if (value_)
+    return value_->clone();
+  if (inline_)
+    return inline_->toValue();
+  return nullptr;
+}
+
+InlineValue FieldRef::toInline() const {
+  if (inline_)
+    return *inline_;
+  return InlineValue::fromValue(value_);
+}
+
+const ShapeTable::Shape *ShapeTable::intern(const Document &doc) {
+  Shape shape;
+  shape.reserve(doc.size());
+  for (const auto &kv : doc)
+    shape.push_back(kv.first);
+  std::sort(shape.begin(), shape.end());
+  auto it = shapes_.find(shape);
+  if (it != shapes_.end())
+    return &*it;
+  if (shapes_.size() >= maxShapes_)
+    return nullptr;
+  return &*shapes_.insert(std::move(shape)).first;
+}
+
+bool StoredDocument::makeShaped(const Document &doc, ShapeTable *shapes) {
+  if (shapes)
+    shape_ = shapes->intern(doc);
+  if (!shape_)
+    return false;
+  const auto &names = *shape_;
+  values_.reset(new InlineValue[names.size()]);
+  for (size_t slot = 0; slot < names.size(); ++slot)
+    values_[slot] =
+        InlineValue::fromValue(doc.find(names[slot])->second.get());
+  return true;
+}
+
+StoredDocument StoredDocument::make(const Document &doc, ShapeTable *shapes) {
+  StoredDocument out;
+  if (!out.makeShaped(doc, shapes))
+    out.map_ = deepCopyDocument(doc);
+  return out;
+}
+
+StoredDocument StoredDocument::make(Document &&doc, ShapeTable *shapes) {
+  StoredDocument out;
+  if (!out.makeShaped(doc, shapes))
+    out.map_ = std::move(doc);
+  return out;
+}
+
+FieldRef StoredDocument::field(const std::string &name) const {
+  if (!shape_) {
+    auto it = map_.find(name);
+    return it == map_.end() ? FieldRef() : FieldRef(it->second.get());
+  }
+  auto it = std::lower_bound(shape_->begin(), shape_->end(), name);
+  if (it == shape_->end() || *it != name)
+    return FieldRef();
+  return FieldRef(&values_[static_cast<size_t>(it - shape_->begin())]);
+}
+
+void StoredDocument::forEachField(
+    const std::function<void(const std::string &, FieldRef)> &fn) const {
+  if (!shape_) {
+    for (const auto &kv : map_)
+      fn(kv.first, FieldRef(kv.second.get()));
+    return;
+  }
+  for (size_t slot = 0; slot < shape_->size(); ++slot)
+    fn((*shape_)[slot], FieldRef(&values_[slot]));
+}
+
+Document StoredDocument::toDocument() const {
+  if (!shape_)
+    return deepCopyDocument(map_);
+  Document out;
+  out.reserve(shape_->size());
+  for (size_t slot = 0; slot < shape_->size(); ++slot)
+    out.emplace((*shape_)[slot], values_[slot].toValue());
+  return out;
+}
+
+size_t StoredDocument::memoryBytes() const {
+  if (!shape_)
+    return memory::documentBytes(map_);
+  size_t bytes = 0;
+  for (size_t slot = 0; slot < shape_->size(); ++slot)
+    bytes += memory::valueBytes(values_[slot]);
+  return bytes;
+}
+
+std::ptrdiff_t StoredDocument::set(const std::string &name, const Value *v,
+                                   ShapeTable *shapes) {
+  auto delta = [](size_t after, size_t before) {
+    return static_cast<std::ptrdiff_t>(after) -
+           static_cast<std::ptrdiff_t>(before);
+  };
+  if (!shape_) {
+    auto it = map_.find(name);
+    if (it == map_.end()) {
+      map_.emplace(name, v ? v->clone() : nullptr);
+      return delta(memory::kMapEntryBytes + sizeof(Document::value_type) +
+                       name.size() + memory::valueBytes(v),
+                   0);
+    }
+    const size_t before = memory::valueBytes(it->second.get());
+    it->second = v ? v->clone() : nullptr;
+    return delta(memory::valueBytes(v), before);
+  }
+  auto it = std::lower_bound(shape_->begin(), shape_->end(), name);
+  if (it != shape_->end() && *it == name) {
+    InlineValue &slot = values_[static_cast<size_t>(it - shape_->begin())];
+    const size_t before = memory::valueBytes(slot);
+    slot = InlineValue::fromValue(v);
+    return delta(memory::valueBytes(slot), before);
+  }
+  const size_t before = memoryBytes();
+  Document doc = toDocument();
+  doc.emplace(name, v ? v->clone() : nullptr);
+  *this = make(std::move(doc), shapes);
+  return delta(memoryBytes(), before);
+}
+
+std::ptrdiff_t StoredDocument::unset(const std::string &name,
+                                     ShapeTable *shapes) {
+  if (!field(name).found())
+    return 0;
+  if (!shape_) {
+    auto it = map_.find(name);
+    const size_t bytes = memory::kMapEntryBytes +
+                         sizeof(Document::value_type) + name.size() +
+                         memory::valueBytes(it->second.get());
+    map_.erase(it);
+    return -static_cast<std::ptrdiff_t>(bytes);
+  }
+  const size_t before = memoryBytes();
+  Document doc = toDocument();
+  doc.erase(name);
+  *this = make(std::move(doc), shapes);
+  return static_cast<std::ptrdiff_t>(memoryBytes()) -
+         static_cast<std::ptrdiff_t>(before);
+}
+
+FieldRef DocumentView::lookup(const std::string &name) const {
+  if (stored_)
+    return stored_->field(name);
+  auto it = doc_->find(name);
+  return it == doc_->end() ? FieldRef() : FieldRef(it->second.get());
+}
+
+FieldRef DocumentView::field(const std::string &name) const {
+  if (fields_ &&
+      std::find(fields_->begin(), fields_->end(), name) == fields_->end())
+    return FieldRef();
+  return lookup(name);
+}
+
+void DocumentView::forEachField(
+    const std::function<void(const std::string &, FieldRef)> &fn) const {
+  if (fields_) {
+    for (const auto &name : *fields_) {
+      FieldRef f = lookup(name);
+      if (f.found())
+        fn(name, f);
+    }
+  } else if (stored_) {
+    stored_->forEachField(fn);
+  } else {
+    for (const auto &kv : *doc_)
+      fn(kv.first, FieldRef(kv.second.get()));
+  }
+}
+
+Document DocumentView::toDocument() const {
+  if (!fields_)
+    return stored_ ? stored_->toDocument() : deepCopyDocument(*doc_);
+  Document out;
+  forEachField([&](const std::string &name, FieldRef f) {
+    out.emplace(name, f.clone());
+  });
+  return out;
+}
+
+} // namespace kadedb
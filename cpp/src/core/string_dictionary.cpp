@@ -0,0 +1,52 @@
+#include "kadedb/string_dictionary.h"
+
+#include <utility>
+
+namespace kadedb {
+
+StringDictionary::StringDictionary(const StringDictionary &other)
+    : entries_(other.entries_) {
+  for (uint32_t code = 0; code < entries_.size(); ++code)
+    codes_.emplace(entries_[code], code);
+}
+
+StringDictionary &StringDictionary::operator=(const StringDictionary &other) {
+  if (this != &other) {
+    StringDictionary copy(other);
+    *this = std::move(copy);
+  }
+  return *this;
+}
+
+uint32_t StringDictionary::intern(std::string_view s) {
+  auto it = codes_.find(s);
+  if (it != codes_.end())
+    return it->second;
+  const auto code = static_cast<uint32_t>(entries_.size());
+  entries_.emplace_back(s);
+  codes_.emplace(entries_.back(), code);
+  return code;
+}
+
+uint32_t StringDictionary::find(std::string_view s) const {
+  auto it = codes_.find(s);
+  return it == codes_.end() ? npos : it->second;
+}
+
+void StringDictionary::clear() {
+  codes_.clear();
+  entries_.clear();
+}
+
+size_t StringDictionary::memoryBytes() const {
+  // Index nodes hold a view, a code, a hash and a next pointer
+  const size_t node = sizeof(std::string_view) + 3 * sizeof(void *);
+  size_t bytes = entries_.size() * sizeof(std::string) +
+                 codes_.size() * node + codes_.bucket_count() * sizeof(void *);
+  for (const auto &s : entries_)
+    if (s.size() >= sizeof(std::string))
+      bytes += s.capacity() + 1;
+  return bytes;
+}
+
+} // namespace kadedb
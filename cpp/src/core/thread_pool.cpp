@@ -0,0 +1,157 @@
+#include "kadedb/thread_pool.h"
+
+#include "kadedb/page_allocator.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace kadedb {
+namespace {
+
+// NUMA node of a pool worker; callers look theirs up per call
+thread_local size_t workerNode = 0;
+
+} // namespace
+
+struct ThreadPool::Job {
+  // Morsels [next, end) of one NUMA node
+  struct Share {
+    std::atomic<size_t> next{0};
+    size_t end = 0;
+  };
+
+  const MorselFn *fn;
+  size_t n;
+  size_t grain;
+  size_t morsels;
+  std::unique_ptr<Share[]> shares;
+  size_t shareCount = 1;
+  std::atomic<size_t> done{0};
+  std::mutex mtx;
+  std::condition_variable cv;
+
+  // One contiguous share per node, in node order
+  void split(size_t nodes) {
+    shareCount = std::max<size_t>(1, std::min(nodes, morsels));
+    shares.reset(new Share[shareCount]);
+    for (size_t s = 0; s < shareCount; ++s) {
+      shares[s].next.store(s * morsels / shareCount);
+      shares[s].end = (s + 1) * morsels / shareCount;
+    }
+  }
+
+  // Run morsels until none is left, the share of node `home` first. `fn`
+  // is only touched after a morsel was claimed, which the caller waits
+  // for, so late workers are safe.
+  void work(size_t home) {
+    for (size_t k = 0; k < shareCount; ++k) {
+      Share &share = shares[(home + k) % shareCount];
+      for (size_t m; (m = share.next.fetch_add(1)) < share.end;) {
+        const size_t begin = m * grain;
+        (*fn)(m, begin, std::min(n, begin + grain));
+        if (done.fetch_add(1) + 1 == morsels) {
+          std::lock_guard<std::mutex> lk(mtx);
+          cv.notify_all();
+        }
+      }
+    }
+  }
+};
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto &th : workers_)
+    th.join();
+}
+
+ThreadPool &ThreadPool::shared() {
+  // Leaked so scans running during static destruction still find it
+  static ThreadPool *pool = new ThreadPool();
+  return *pool;
+}
+
+size_t ThreadPool::resolve(size_t threads) {
+  if (threads != 0)
+    return threads;
+  return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+size_t ThreadPool::workers() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return workers_.size();
+}
+
+void ThreadPool::parallelFor(size_t n, size_t grain, size_t threads,
+                             const MorselFn &fn) {
+  if (n == 0)
+    return;
+  grain = std::max<size_t>(grain, 1);
+  const size_t morsels = (n + grain - 1) / grain;
+  const size_t helpers =
+      std::min({resolve(threads), morsels, kMaxWorkers + 1}) - 1;
+  if (helpers == 0) {
+    for (size_t m = 0; m < morsels; ++m)
+      fn(m, m * grain, std::min(n, m * grain + grain));
+    return;
+  }
+
+  auto job = std::make_shared<Job>();
+  job->fn = &fn;
+  job->n = n;
+  job->grain = grain;
+  job->morsels = morsels;
+  const size_t nodes = memory::numaNodes();
+  job->split(nodes);
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    while (workers_.size() < helpers) {
+      const size_t index = workers_.size();
+      workers_.emplace_back([this, index] { workerLoop(index); });
+    }
+    for (size_t i = 0; i < helpers; ++i)
+      queue_.push_back([job] { job->work(workerNode); });
+  }
+  cv_.notify_all();
+
+  job->work(nodes > 1 ? memory::currentNumaNode() : 0);
+  std::unique_lock<std::mutex> lk(job->mtx);
+  job->cv.wait(lk, [&] { return job->done.load() == morsels; });
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    const size_t want = std::min(resolve(0), kMaxWorkers);
+    while (workers_.size() < want) {
+      const size_t index = workers_.size();
+      workers_.emplace_back([this, index] { workerLoop(index); });
+    }
+    queue_.push_back(std::move(task));
+  }
+  cv_.notify_one();
+}
+
+void ThreadPool::workerLoop(size_t index) {
+  const size_t nodes = memory::numaNodes();
+  workerNode = index % nodes;
+  if (nodes > 1)
+    memory::bindThreadToNode(workerNode);
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lk(mtx_);
+      cv_.wait(lk, [this] { return stop_ || !queue_.empty(); });
+      if (queue_.empty())
+        return;
+      task = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    task();
+  }
+}
+
+} // namespace kadedb
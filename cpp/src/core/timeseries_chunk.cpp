@@ -0,0 +1,562 @@
+#include "kadedb/timeseries/chunk.h"
+
+#include "kadedb/serialization.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+namespace kadedb {
+namespace {
+
+// Bits appended least significant first into 64-bit words
+class BitWriter {
+public:
+  explicit BitWriter(std::vector<uint64_t> &words) : words_(words) {}
+
+  // The low `width` bits of `v` (width <= 64)
+  void put(uint64_t v, unsigned width) {
+    if (width == 0)
+      return;
+    if (width < 64)
+      v &= (uint64_t{1} << width) - 1;
+    const unsigned offset = static_cast<unsigned>(pos_ % 64);
+    if (offset == 0)
+      words_.push_back(0);
+    words_.back() |= v << offset;
+    if (offset + width > 64)
+      words_.push_back(v >> (64 - offset));
+    pos_ += width;
+  }
+
+private:
+  std::vector<uint64_t> &words_;
+  size_t pos_ = 0;
+};
+
+class BitReader {
+public:
+  explicit BitReader(const std::vector<uint64_t> &words) : words_(words) {}
+
+  uint64_t get(unsigned width) {
+    if (width == 0)
+      return 0;
+    const size_t word = pos_ / 64;
+    const unsigned offset = static_cast<unsigned>(pos_ % 64);
+    uint64_t v = words_[word] >> offset;
+    if (offset + width > 64)
+      v |= words_[word + 1] << (64 - offset);
+    pos_ += width;
+    return width < 64 ? v & ((uint64_t{1} << width) - 1) : v;
+  }
+  bool bit() { return get(1) != 0; }
+
+private:
+  const std::vector<uint64_t> &words_;
+  size_t pos_ = 0;
+};
+
+// Payload widths of the delta-of-delta buckets; bucket b is announced by b
+// one bits and, below the last bucket, a zero bit
+constexpr unsigned kDodWidths[] = {0, 7, 9, 12, 64};
+constexpr unsigned kDodBuckets = sizeof(kDodWidths) / sizeof(kDodWidths[0]);
+
+uint64_t zigzag(int64_t v) {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+int64_t unzigzag(uint64_t z) {
+  return static_cast<int64_t>(z >> 1) ^ -static_cast<int64_t>(z & 1);
+}
+
+// Delta-of-delta stream: the first value raw, then the change of each delta
+// from the previous one (the first delta against 0). Arithmetic wraps, so
+// any int64 sequence round-trips.
+class DeltaEncoder {
+public:
+  explicit DeltaEncoder(BitWriter &out) : out_(out) {}
+  void add(int64_t v) {
+    const uint64_t cur = static_cast<uint64_t>(v);
+    if (first_) {
+      out_.put(cur, 64);
+      first_ = false;
+    } else {
+      const uint64_t delta = cur - prev_;
+      const uint64_t z = zigzag(static_cast<int64_t>(delta - prevDelta_));
+      unsigned b = 0;
+      while (b + 1 < kDodBuckets && kDodWidths[b] < 64 &&
+             z >> kDodWidths[b] != 0)
+        ++b;
+      out_.put((uint64_t{1} << b) - 1, b);
+      if (b + 1 < kDodBuckets)
+        out_.put(0, 1);
+      out_.put(z, kDodWidths[b]);
+      prevDelta_ = delta;
+    }
+    prev_ = cur;
+  }
+
+private:
+  BitWriter &out_;
+  bool first_ = true;
+  uint64_t prev_ = 0, prevDelta_ = 0;
+};
+
+class DeltaDecoder {
+public:
+  explicit DeltaDecoder(BitReader &in) : in_(in) {}
+  int64_t next() {
+    if (first_) {
+      prev_ = in_.get(64);
+      first_ = false;
+    } else {
+      unsigned b = 0;
+      while (b + 1 < kDodBuckets && in_.bit())
+        ++b;
+      const uint64_t dod =
+          static_cast<uint64_t>(unzigzag(in_.get(kDodWidths[b])));
+      prevDelta_ += dod;
+      prev_ += prevDelta_;
+    }
+    return static_cast<int64_t>(prev_);
+  }
+
+private:
+  BitReader &in_;
+  bool first_ = true;
+  uint64_t prev_ = 0, prevDelta_ = 0;
+};
+
+unsigned leadingZeros(uint64_t v) {
+  unsigned n = 0;
+  for (uint64_t mask = uint64_t{1} << 63; mask && !(v & mask); mask >>= 1)
+    ++n;
+  return n;
+}
+unsigned trailingZeros(uint64_t v) {
+  unsigned n = 0;
+  for (; n < 64 && !(v & (uint64_t{1} << n)); ++n) {
+  }
+  return n;
+}
+
+uint64_t doubleBits(double d) {
+  uint64_t bits;
+  std::memcpy(&bits, &d, sizeof bits);
+  return bits;
+}
+double bitsDouble(uint64_t bits) {
+  double d;
+  std::memcpy(&d, &bits, sizeof d);
+  return d;
+}
+
+// Gorilla XOR stream: the first value raw; then '0' for a repeat, or '1'
+// and the meaningful bits of the XOR with the previous value, either inside
+// the previous leading/trailing-zero window ('0') or with a new window
+// ('1', 5 bits of leading zeros, 6 bits of length - 1)
+class XorEncoder {
+public:
+  explicit XorEncoder(BitWriter &out) : out_(out) {}
+  void add(double d) {
+    const uint64_t cur = doubleBits(d);
+    if (first_) {
+      out_.put(cur, 64);
+      first_ = false;
+      prev_ = cur;
+      return;
+    }
+    const uint64_t x = cur ^ prev_;
+    prev_ = cur;
+    if (x == 0) {
+      out_.put(0, 1);
+      return;
+    }
+    out_.put(1, 1);
+    unsigned lead = std::min(leadingZeros(x), 31u);
+    unsigned trail = trailingZeros(x);
+    if (window_ && lead >= lead_ && trail >= trail_) {
+      out_.put(0, 1);
+      out_.put(x >> trail_, 64 - lead_ - trail_);
+      return;
+    }
+    const unsigned length = 64 - lead - trail;
+    out_.put(1, 1);
+    out_.put(lead, 5);
+    out_.put(length - 1, 6);
+    out_.put(x >> trail, length);
+    window_ = true;
+    lead_ = lead;
+    trail_ = trail;
+  }
+
+private:
+  BitWriter &out_;
+  bool first_ = true, window_ = false;
+  uint64_t prev_ = 0;
+  unsigned lead_ = 0, trail_ = 0;
+};
+
+class XorDecoder {
+public:
+  explicit XorDecoder(BitReader &in) : in_(in) {}
+  double next() {
+    if (first_) {
+      prev_ = in_.get(64);
+      first_ = false;
+    } else if (in_.bit()) {
+      if (in_.bit()) {
+        lead_ = static_cast<unsigned>(in_.get(5));
+        const unsigned length = static_cast<unsigned>(in_.get(6)) + 1;
+        trail_ = 64 - lead_ - length;
+      }
+      prev_ ^= in_.get(64 - lead_ - trail_) << trail_;
+    }
+    return bitsDouble(prev_);
+  }
+
+private:
+  BitReader &in_;
+  bool first_ = true;
+  uint64_t prev_ = 0;
+  unsigned lead_ = 0, trail_ = 0;
+};
+
+// Bits needed for codes below `n`
+unsigned codeWidth(size_t n) {
+  unsigned width = 0;
+  while (width < 64 && (size_t{1} << width) < n)
+    ++width;
+  return width;
+}
+
+template <typename T> void put(std::string &out, T v) {
+  char b[sizeof(T)];
+  std::memcpy(b, &v, sizeof(T));
+  out.append(b, sizeof(T));
+}
+
+// Bounds-checked reads of the serialized form
+class ChunkReader {
+public:
+  ChunkReader(const char *data, size_t size) : p_(data), end_(data + size) {}
+
+  template <typename T> T get() {
+    T v;
+    std::memcpy(&v, take(sizeof(T)), sizeof(T));
+    return v;
+  }
+  // A count of items of at least `itemBytes` each that the input can hold
+  size_t count(size_t itemBytes) {
+    const uint64_t n = get<uint64_t>();
+    if (n > static_cast<uint64_t>(end_ - p_) / std::max<size_t>(itemBytes, 1))
+      throw SerializationError("Time-series chunk truncated");
+    return static_cast<size_t>(n);
+  }
+  const char *take(size_t n) {
+    if (n > static_cast<size_t>(end_ - p_))
+      throw SerializationError("Time-series chunk truncated");
+    const char *at = p_;
+    p_ += n;
+    return at;
+  }
+  bool done() const { return p_ == end_; }
+
+private:
+  const char *p_;
+  const char *end_;
+};
+
+constexpr uint8_t kAbsentTag = 0xFF; // empty Plain cell
+
+void putWords(std::string &out, const std::vector<uint64_t> &words) {
+  put<uint64_t>(out, words.size());
+  out.append(reinterpret_cast<const char *>(words.data()),
+             words.size() * sizeof(uint64_t));
+}
+
+std::vector<uint64_t> getWords(ChunkReader &in) {
+  std::vector<uint64_t> words(in.count(sizeof(uint64_t)));
+  if (!words.empty())
+    std::memcpy(words.data(), in.take(words.size() * sizeof(uint64_t)),
+                words.size() * sizeof(uint64_t));
+  return words;
+}
+
+void putCell(std::string &out, const InlineValue &v) {
+  if (v.empty()) {
+    out.push_back(static_cast<char>(kAbsentTag));
+    return;
+  }
+  out.push_back(static_cast<char>(v.type()));
+  switch (v.type()) {
+  case ValueType::Integer:
+    put<int64_t>(out, v.asInt());
+    break;
+  case ValueType::Float:
+    put<double>(out, v.asFloat());
+    break;
+  case ValueType::String:
+    put<uint64_t>(out, v.stringSize());
+    out.append(v.stringData(), v.stringSize());
+    break;
+  case ValueType::Boolean:
+    out.push_back(v.asBool() ? 1 : 0);
+    break;
+  case ValueType::Null:
+    break;
+  }
+}
+
+InlineValue getCell(ChunkReader &in) {
+  const uint8_t tag = in.get<uint8_t>();
+  if (tag == kAbsentTag)
+    return InlineValue();
+  switch (static_cast<ValueType>(tag)) {
+  case ValueType::Null:
+    return InlineValue::null();
+  case ValueType::Integer:
+    return InlineValue::integer(in.get<int64_t>());
+  case ValueType::Float:
+    return InlineValue::floating(in.get<double>());
+  case ValueType::String: {
+    const size_t n = in.count(1);
+    return InlineValue::string(in.take(n), n);
+  }
+  case ValueType::Boolean:
+    return InlineValue::boolean(in.get<uint8_t>() != 0);
+  }
+  throw SerializationError("Invalid time-series chunk cell tag");
+}
+
+ValueType exactType(ColumnType type) {
+  switch (type) {
+  case ColumnType::Integer:
+    return ValueType::Integer;
+  case ColumnType::Float:
+    return ValueType::Float;
+  case ColumnType::String:
+    return ValueType::String;
+  case ColumnType::Boolean:
+    return ValueType::Boolean;
+  default:
+    return ValueType::Null;
+  }
+}
+
+} // namespace
+
+TimeSeriesChunk TimeSeriesChunk::encode(const std::vector<ColumnType> &types,
+                                        const std::vector<InlineRow> &rows) {
+  TimeSeriesChunk chunk;
+  chunk.rows_ = rows.size();
+  chunk.columns_.reserve(types.size());
+  for (size_t c = 0; c < types.size(); ++c)
+    chunk.columns_.push_back(encodeColumn(types[c], rows, c));
+  return chunk;
+}
+
+TimeSeriesChunk::Column
+TimeSeriesChunk::encodeColumn(ColumnType type,
+                              const std::vector<InlineRow> &rows,
+                              size_t column) {
+  Column col;
+  const ValueType want = exactType(type);
+  bool typed = want != ValueType::Null, nulls = false;
+  for (const auto &row : rows) {
+    const InlineValue &v = row.values()[column];
+    if (v.empty())
+      nulls = true;
+    else if (v.type() != want)
+      typed = false;
+  }
+  if (!typed) {
+    col.encoding = Encoding::Plain;
+    col.plain.reserve(rows.size());
+    for (const auto &row : rows)
+      col.plain.push_back(row.values()[column]);
+    return col;
+  }
+  if (nulls) {
+    col.nulls.assign((rows.size() + 63) / 64, 0);
+    for (size_t r = 0; r < rows.size(); ++r)
+      if (rows[r].values()[column].empty())
+        col.nulls[r / 64] |= uint64_t{1} << (r % 64);
+  }
+
+  BitWriter out(col.bits);
+  // Null cells repeat the last value (the first value: a zero)
+  size_t last = rows.size();
+  auto cell = [&](size_t r) -> const InlineValue * {
+    const InlineValue &v = rows[r].values()[column];
+    if (!v.empty())
+      last = r;
+    return last < rows.size() ? &rows[last].values()[column] : nullptr;
+  };
+  switch (want) {
+  case ValueType::Integer: {
+    col.encoding = Encoding::DeltaOfDelta;
+    DeltaEncoder enc(out);
+    for (size_t r = 0; r < rows.size(); ++r) {
+      const InlineValue *v = cell(r);
+      enc.add(v ? v->asInt() : 0);
+    }
+    break;
+  }
+  case ValueType::Float: {
+    col.encoding = Encoding::GorillaXor;
+    XorEncoder enc(out);
+    for (size_t r = 0; r < rows.size(); ++r) {
+      const InlineValue *v = cell(r);
+      enc.add(v ? v->asFloat() : 0.0);
+    }
+    break;
+  }
+  case ValueType::String: {
+    col.encoding = Encoding::Dictionary;
+    std::vector<uint64_t> rowCodes(rows.size(), 0);
+    for (size_t r = 0; r < rows.size(); ++r) {
+      const InlineValue &v = rows[r].values()[column];
+      if (!v.empty())
+        rowCodes[r] = col.dictionary.intern(
+            std::string_view(v.stringData(), v.stringSize()));
+    }
+    const unsigned width = codeWidth(col.dictionary.size());
+    for (uint64_t code : rowCodes)
+      out.put(code, width);
+    break;
+  }
+  default: {
+    col.encoding = Encoding::Bits;
+    for (const auto &row : rows) {
+      const InlineValue &v = row.values()[column];
+      out.put(!v.empty() && v.asBool() ? 1 : 0, 1);
+    }
+    break;
+  }
+  }
+  col.bits.shrink_to_fit();
+  return col;
+}
+
+void TimeSeriesChunk::decodeColumn(size_t column,
+                                   std::vector<InlineValue> &out) const {
+  const Column &col = columns_[column];
+  out.clear();
+  if (col.encoding == Encoding::Plain) {
+    out = col.plain;
+    return;
+  }
+  out.reserve(rows_);
+  BitReader in(col.bits);
+  DeltaDecoder deltas(in);
+  XorDecoder floats(in);
+  const unsigned width = codeWidth(col.dictionary.size());
+  for (size_t r = 0; r < rows_; ++r) {
+    InlineValue v;
+    switch (col.encoding) {
+    case Encoding::DeltaOfDelta:
+      v = InlineValue::integer(deltas.next());
+      break;
+    case Encoding::GorillaXor:
+      v = InlineValue::floating(floats.next());
+      break;
+    case Encoding::Dictionary: {
+      const uint64_t code = in.get(width);
+      if (!col.dictionary.empty()) // else every row is null
+        v = InlineValue::string(
+            col.dictionary.at(static_cast<uint32_t>(code)));
+      break;
+    }
+    default:
+      v = InlineValue::boolean(in.bit());
+      break;
+    }
+    const bool null =
+        !col.nulls.empty() && (col.nulls[r / 64] >> (r % 64) & 1) != 0;
+    out.push_back(null ? InlineValue() : std::move(v));
+  }
+}
+
+void TimeSeriesChunk::decode(std::vector<InlineRow> &out) const {
+  const size_t first = out.size();
+  for (size_t r = 0; r < rows_; ++r)
+    out.emplace_back(columns_.size());
+  std::vector<InlineValue> cells;
+  for (size_t c = 0; c < columns_.size(); ++c) {
+    decodeColumn(c, cells);
+    for (size_t r = 0; r < rows_; ++r)
+      out[first + r].set(c, std::move(cells[r]));
+  }
+}
+
+// Layout: [u64 rows][u64 columns], then per column [u8 encoding], the
+// value and null words ([u64 count][words]), the dictionary ([u64 count]
+// then [u64 size][bytes] per entry) and the Plain cells ([u64 count] then a
+// type tag and payload per cell)
+void TimeSeriesChunk::serialize(std::string &out) const {
+  put<uint64_t>(out, rows_);
+  put<uint64_t>(out, columns_.size());
+  for (const auto &col : columns_) {
+    out.push_back(static_cast<char>(col.encoding));
+    putWords(out, col.bits);
+    putWords(out, col.nulls);
+    put<uint64_t>(out, col.dictionary.size());
+    for (size_t i = 0; i < col.dictionary.size(); ++i) {
+      const std::string &entry = col.dictionary.at(static_cast<uint32_t>(i));
+      put<uint64_t>(out, entry.size());
+      out.append(entry);
+    }
+    put<uint64_t>(out, col.plain.size());
+    for (const auto &v : col.plain)
+      putCell(out, v);
+  }
+}
+
+TimeSeriesChunk TimeSeriesChunk::deserialize(const char *data, size_t size) {
+  ChunkReader in(data, size);
+  TimeSeriesChunk chunk;
+  chunk.rows_ = static_cast<size_t>(in.get<uint64_t>());
+  chunk.columns_.resize(in.count(1));
+  for (auto &col : chunk.columns_) {
+    const uint8_t encoding = in.get<uint8_t>();
+    if (encoding > static_cast<uint8_t>(Encoding::Plain))
+      throw SerializationError("Invalid time-series chunk encoding");
+    col.encoding = static_cast<Encoding>(encoding);
+    col.bits = getWords(in);
+    col.nulls = getWords(in);
+    const size_t entries = in.count(sizeof(uint64_t));
+    for (size_t i = 0; i < entries; ++i) {
+      const size_t n = in.count(1);
+      col.dictionary.intern(std::string_view(in.take(n), n));
+    }
+    if (col.dictionary.size() != entries)
+      throw SerializationError("Duplicate time-series dictionary entry");
+    col.plain.resize(in.count(1));
+    for (auto &v : col.plain)
+      v = getCell(in);
+    const bool plainOk = col.encoding == Encoding::Plain
+                             ? col.plain.size() == chunk.rows_
+                             : col.plain.empty();
+    if (!plainOk || (!col.nulls.empty() &&
+                     col.nulls.size() != (chunk.rows_ + 63) / 64))
+      throw SerializationError("Inconsistent time-series chunk column");
+  }
+  if (!in.done())
+    throw SerializationError("Trailing bytes after time-series chunk");
+  return chunk;
+}
+
+size_t TimeSeriesChunk::memoryBytes() const {
+  size_t bytes = columns_.capacity() * sizeof(Column);
+  for (const auto &col : columns_) {
+    bytes += (col.bits.capacity() + col.nulls.capacity()) * sizeof(uint64_t);
+    bytes += col.dictionary.memoryBytes();
+    bytes += col.plain.capacity() * sizeof(InlineValue);
+    for (const auto &v : col.plain)
+      if (!v.empty() && v.type() == ValueType::String && !v.isInlineString())
+        bytes += sizeof(size_t) + v.stringSize();
+  }
+  return bytes;
+}
+
+} // namespace kadedb
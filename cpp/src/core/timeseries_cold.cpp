@@ -0,0 +1,262 @@
+#include "kadedb/timeseries/cold.h"
+
+#include "kadedb/compression.h"
+#include "kadedb/serialization.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#include <process.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace kadedb {
+namespace {
+
+constexpr uint32_t kColdMagic = 0x4B445443; // 'KDTC'
+constexpr size_t kHeaderBytes = 4 + 1 + 8 + 8;
+
+Status ioError(const std::string &what, const std::string &path) {
+  return Status::Internal(what + " " + path + ": " + std::strerror(errno));
+}
+
+// Unique among the files this process creates
+std::string chunkPath(const std::string &directory) {
+  static std::atomic<uint64_t> counter{0};
+#ifdef _WIN32
+  const long pid = static_cast<long>(::_getpid());
+#else
+  const long pid = static_cast<long>(::getpid());
+#endif
+  std::string path = directory;
+  if (path.back() != '/' && path.back() != '\\')
+    path += '/';
+  return path + "kadedb-ts-" + std::to_string(pid) + "-" +
+         std::to_string(counter.fetch_add(1)) + ".chunk";
+}
+
+// FNV-1a over 64-bit words; detects torn or overwritten files, not
+// tampering
+uint64_t checksum(const char *p, size_t n) {
+  constexpr uint64_t kPrime = 0x100000001B3ull;
+  uint64_t h = 0xCBF29CE484222325ull ^ n;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint64_t w;
+    std::memcpy(&w, p + i, 8);
+    h = (h ^ w) * kPrime;
+  }
+  for (; i < n; ++i)
+    h = (h ^ static_cast<uint8_t>(p[i])) * kPrime;
+  return h;
+}
+
+template <typename T> void put(std::string &out, T v) {
+  char b[sizeof(T)];
+  std::memcpy(b, &v, sizeof(T));
+  out.append(b, sizeof(T));
+}
+
+template <typename T> T get(const char *p) {
+  T v;
+  std::memcpy(&v, p, sizeof(T));
+  return v;
+}
+
+// Decode the file image at `base`
+Result<std::shared_ptr<const TimeSeriesChunk>>
+decodeFile(const char *base, size_t size, const std::string &path) {
+  using R = Result<std::shared_ptr<const TimeSeriesChunk>>;
+  if (size < kHeaderBytes || get<uint32_t>(base) != kColdMagic ||
+      !codec::isCodec(get<uint8_t>(base + 4)))
+    return R::err(Status::Internal("Not a cold chunk file: " + path));
+  const uint64_t rawSize = get<uint64_t>(base + 5);
+  if (rawSize > (size_t{1} << 40))
+    return R::err(Status::Internal("Corrupt cold chunk file: " + path));
+  std::string raw(static_cast<size_t>(rawSize), '\0');
+  if (!codec::decompress(base + kHeaderBytes, size - kHeaderBytes, &raw[0],
+                         raw.size()) ||
+      checksum(raw.data(), raw.size()) != get<uint64_t>(base + 13))
+    return R::err(Status::Internal("Corrupt cold chunk file: " + path));
+  try {
+    return R::ok(std::make_shared<const TimeSeriesChunk>(
+        TimeSeriesChunk::deserialize(raw.data(), raw.size())));
+  } catch (const SerializationError &e) {
+    return R::err(Status::Internal("Corrupt cold chunk file " + path + ": " +
+                                   e.what()));
+  }
+}
+
+} // namespace
+
+// ---- ColdChunkCache ----
+
+void ColdChunkCache::setCapacity(size_t bytes) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  capacity_ = bytes;
+  trim();
+}
+
+size_t ColdChunkCache::capacity() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return capacity_;
+}
+
+size_t ColdChunkCache::bytes() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return bytes_;
+}
+
+uint64_t ColdChunkCache::hits() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return hits_;
+}
+
+uint64_t ColdChunkCache::misses() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return misses_;
+}
+
+std::shared_ptr<const TimeSeriesChunk>
+ColdChunkCache::find(const ColdChunk *owner) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  auto it = index_.find(owner);
+  if (it == index_.end()) {
+    ++misses_;
+    return nullptr;
+  }
+  ++hits_;
+  lru_.splice(lru_.begin(), lru_, it->second);
+  return it->second->chunk;
+}
+
+void ColdChunkCache::insert(const ColdChunk *owner,
+                            std::shared_ptr<const TimeSeriesChunk> chunk) {
+  const size_t bytes = chunk->memoryBytes();
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (bytes > capacity_ || index_.count(owner))
+    return;
+  lru_.push_front(Entry{owner, std::move(chunk), bytes});
+  index_.emplace(owner, lru_.begin());
+  bytes_ += bytes;
+  trim();
+}
+
+void ColdChunkCache::erase(const ColdChunk *owner) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  auto it = index_.find(owner);
+  if (it == index_.end())
+    return;
+  bytes_ -= it->second->bytes;
+  lru_.erase(it->second);
+  index_.erase(it);
+}
+
+void ColdChunkCache::trim() {
+  while (bytes_ > capacity_) {
+    bytes_ -= lru_.back().bytes;
+    index_.erase(lru_.back().owner);
+    lru_.pop_back();
+  }
+}
+
+// ---- ColdChunk ----
+
+Result<std::shared_ptr<ColdChunk>>
+ColdChunk::write(const std::string &directory, const TimeSeriesChunk &chunk,
+                 std::shared_ptr<ColdChunkCache> cache) {
+  using R = Result<std::shared_ptr<ColdChunk>>;
+  if (directory.empty())
+    return R::err(Status::InvalidArgument("Cold tier directory is empty"));
+  std::string raw;
+  chunk.serialize(raw);
+  std::string file;
+  file.reserve(kHeaderBytes + codec::compressBound(raw.size()));
+  put<uint32_t>(file, kColdMagic);
+  put<uint8_t>(file, static_cast<uint8_t>(Codec::Lz4High));
+  put<uint64_t>(file, raw.size());
+  put<uint64_t>(file, checksum(raw.data(), raw.size()));
+  codec::compress(Codec::Lz4High, raw.data(), raw.size(), file);
+
+  std::string path = chunkPath(directory);
+  std::FILE *f = std::fopen(path.c_str(), "wb");
+  if (!f)
+    return R::err(ioError("cannot create", path));
+  const bool written =
+      std::fwrite(file.data(), 1, file.size(), f) == file.size();
+  if (std::fclose(f) != 0 || !written) {
+    Status st = ioError("cannot write", path);
+    std::remove(path.c_str());
+    return R::err(st);
+  }
+  return R::ok(std::shared_ptr<ColdChunk>(new ColdChunk(
+      std::move(path), chunk.rowCount(), file.size(), std::move(cache))));
+}
+
+ColdChunk::~ColdChunk() {
+  if (cache_)
+    cache_->erase(this);
+  std::remove(path_.c_str());
+}
+
+Result<std::shared_ptr<const TimeSeriesChunk>> ColdChunk::load() const {
+  using R = Result<std::shared_ptr<const TimeSeriesChunk>>;
+  if (cache_)
+    if (auto hit = cache_->find(this))
+      return R::ok(std::move(hit));
+#ifdef _WIN32
+  const int fd = ::_open(path_.c_str(), _O_RDONLY | _O_BINARY);
+#else
+  const int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+  if (fd < 0)
+    return R::err(ioError("cannot open", path_));
+  struct stat info;
+  if (::fstat(fd, &info) != 0 || info.st_size <= 0) {
+    Status st = ioError("cannot stat", path_);
+#ifdef _WIN32
+    ::_close(fd);
+#else
+    ::close(fd);
+#endif
+    return R::err(st);
+  }
+  const size_t size = static_cast<size_t>(info.st_size);
+#ifdef _WIN32
+  // No mapping here: read the file up front
+  std::string image(size, '\0');
+  size_t got = 0;
+  while (got < size) {
+    const int n = ::_read(fd, &image[got],
+                          static_cast<unsigned>(std::min<size_t>(
+                              size - got, size_t{1} << 30)));
+    if (n <= 0)
+      break;
+    got += static_cast<size_t>(n);
+  }
+  ::_close(fd);
+  if (got < size)
+    return R::err(ioError("cannot read", path_));
+  R chunk = decodeFile(image.data(), size, path_);
+#else
+  void *map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED)
+    return R::err(ioError("cannot map", path_));
+  R chunk = decodeFile(static_cast<const char *>(map), size, path_);
+  ::munmap(map, size);
+#endif
+  if (chunk.hasValue() && cache_)
+    cache_->insert(this, chunk.value());
+  return chunk;
+}
+
+} // namespace kadedb
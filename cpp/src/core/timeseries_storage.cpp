@@ -1,12 +1,29 @@
 #include "kadedb/timeseries/storage.h"
+#include "kadedb/cancellation.h"
+#include "kadedb/memory.h"
+#include "kadedb/metrics.h"
+#include "kadedb/thread_pool.h"
+#include "kadedb/tracing.h"
 
 #include <algorithm>
 #include <cmath>
+#include <iterator>
 #include <limits>
+#include <numeric>
 
 namespace kadedb {
 namespace {
 
+// ts * factor, saturated to the int64_t range
+static int64_t scaleSaturated(int64_t ts, int64_t factor) {
+  const int64_t limit = std::numeric_limits<int64_t>::max() / factor;
+  if (ts > limit)
+    return std::numeric_limits<int64_t>::max();
+  if (ts < -limit)
+    return std::numeric_limits<int64_t>::min();
+  return ts * factor;
+}
+
 static int64_t toSeconds(int64_t ts, TimeGranularity g) {
   switch (g) {
   case TimeGranularity::Nanoseconds:
@@ -18,11 +35,11 @@ static int64_t toSeconds(int64_t ts, TimeGranularity g) {
   case TimeGranularity::Seconds:
     return ts;
   case TimeGranularity::Minutes:
-    return ts * 60LL;
+    return scaleSaturated(ts, 60LL);
   case TimeGranularity::Hours:
-    return ts * 3600LL;
+    return scaleSaturated(ts, 3600LL);
   case TimeGranularity::Days:
-    return ts * 86400LL;
+    return scaleSaturated(ts, 86400LL);
   }
   return ts;
 }
@@ -63,83 +80,32 @@ static int64_t partitionBucketStartSeconds(int64_t timeSec, TimePartition p) {
   return q * div;
 }
 
-static bool evalPredicateComparison(const TableSchema &schema, const Row &row,
-                                    const Predicate &pred) {
-  size_t idx = schema.findColumn(pred.column);
-  if (idx == TableSchema::npos)
-    return false;
-  const Value *lhs = row.values()[idx].get();
-  const Value *rhs = pred.rhs.get();
-  if (!lhs || !rhs)
-    return false;
-  int cmp = lhs->compare(*rhs);
-  switch (pred.op) {
-  case Predicate::Op::Eq:
-    return cmp == 0;
-  case Predicate::Op::Ne:
-    return cmp != 0;
-  case Predicate::Op::Lt:
-    return cmp < 0;
-  case Predicate::Op::Le:
-    return cmp <= 0;
-  case Predicate::Op::Gt:
-    return cmp > 0;
-  case Predicate::Op::Ge:
-    return cmp >= 0;
-  }
-  return false;
-}
-
-static bool evalPredicate(const TableSchema &schema, const Row &row,
-                          const Predicate &pred) {
-  using K = Predicate::Kind;
-  switch (pred.kind) {
-  case K::Comparison:
-    return evalPredicateComparison(schema, row, pred);
-  case K::And: {
-    for (const auto &ch : pred.children) {
-      if (!evalPredicate(schema, row, ch))
-        return false;
-    }
-    return true;
-  }
-  case K::Or: {
-    for (const auto &ch : pred.children) {
-      if (evalPredicate(schema, row, ch))
-        return true;
-    }
-    return false;
-  }
-  case K::Not: {
-    if (pred.children.empty())
-      return false;
-    return !evalPredicate(schema, row, pred.children.front());
-  }
-  }
-  return false;
-}
-
 static Result<ResultSet> projectionUnknownColumn(const std::string &name) {
   return Result<ResultSet>::err(
       Status::InvalidArgument("Unknown column in projection: " + name));
 }
 
-static std::vector<int64_t>
-sortedBucketKeys(const std::unordered_map<int64_t, std::vector<Row>> &buckets) {
-  std::vector<int64_t> keys;
-  keys.reserve(buckets.size());
-  for (const auto &kv : buckets)
-    keys.push_back(kv.first);
-  std::sort(keys.begin(), keys.end());
-  return keys;
-}
-
-static size_t
-totalRows(const std::unordered_map<int64_t, std::vector<Row>> &buckets) {
-  size_t n = 0;
-  for (const auto &kv : buckets)
-    n += kv.second.size();
-  return n;
+// appendColumns() input: one timestamp and one Float per value column for
+// each sample; tag columns are left null
+static Status checkColumnLayout(const TimeSeriesSchema &schema,
+                                const int64_t *ts,
+                                const double *const *values, size_t n) {
+  for (const auto &c : schema.tagColumns())
+    if (!c.nullable)
+      return Status::InvalidArgument(
+          "appendColumns leaves tag columns null; not nullable: " + c.name);
+  for (const auto &c : schema.valueColumns())
+    if (c.type != ColumnType::Float)
+      return Status::InvalidArgument(
+          "appendColumns requires Float value columns: " + c.name);
+  if (n == 0)
+    return Status::OK();
+  if (!ts || (!values && !schema.valueColumns().empty()))
+    return Status::InvalidArgument("appendColumns: missing column data");
+  for (size_t c = 0; c < schema.valueColumns().size(); ++c)
+    if (!values[c])
+      return Status::InvalidArgument("appendColumns: missing column data");
+  return Status::OK();
 }
 
 static int64_t floorDiv(int64_t a, int64_t b) {
@@ -156,37 +122,561 @@ static int64_t floorDiv(int64_t a, int64_t b) {
   return q;
 }
 
+// The rows of each series' result in turn, as one result of their columns,
+// which must agree; series without a result (dropped meanwhile) are skipped
+static Result<ResultSet>
+concatSeries(const std::vector<std::string> &names,
+             std::vector<std::optional<Result<ResultSet>>> &parts,
+             const std::vector<std::string> &columns) {
+  std::optional<ResultSet> out;
+  for (size_t m = 0; m < parts.size(); ++m) {
+    if (!parts[m])
+      continue;
+    if (!parts[m]->hasValue())
+      return Result<ResultSet>::err(parts[m]->status());
+    ResultSet rs = parts[m]->takeValue();
+    if (!out) {
+      out.emplace(rs.columnNames(), rs.columnTypes());
+    } else if (rs.columnNames() != out->columnNames()) {
+      return Result<ResultSet>::err(Status::InvalidArgument(
+          "Series " + names[m] + " has other columns than " + names[0]));
+    }
+    for (auto &row : rs.takeRows())
+      out->addRow(std::move(row));
+  }
+  if (!out) {
+    // No series: the requested columns, of unknown type
+    std::vector<std::string> outNames{"series"};
+    outNames.insert(outNames.end(), columns.begin(), columns.end());
+    std::vector<ColumnType> outTypes(outNames.size(), ColumnType::Null);
+    outTypes[0] = ColumnType::String;
+    out.emplace(std::move(outNames), std::move(outTypes));
+  }
+  return Result<ResultSet>::ok(std::move(*out));
+}
+
+// Helper: the sketch behind `p`, copied first when another holder shares
+// it
+template <typename Sketch> Sketch &ownSketch(std::shared_ptr<Sketch> &p) {
+  if (p.use_count() > 1)
+    p = std::make_shared<Sketch>(*p);
+  return *p;
+}
+
+// Bytes of a rollup bucket's sketches as budgets count them: the
+// HyperLogLog and a t-digest of typical size
+constexpr size_t kSketchBytes =
+    sizeof(HyperLogLog) + sizeof(TDigest) +
+    2 * static_cast<size_t>(TDigest::kCompression) * 2 * sizeof(double);
+
+// Helper: InvalidArgument unless `quantile` suits `agg`
+Status checkQuantile(TimeAggregation agg, double quantile) {
+  if (agg == TimeAggregation::ApproxPercentile &&
+      !(quantile >= 0.0 && quantile <= 1.0))
+    return Status::InvalidArgument("quantile must lie in [0, 1]");
+  return Status::OK();
+}
+
+// Buckets of bucketStats(): a list per value column, in time order
+using ColumnBuckets = std::vector<std::vector<TimeBucketStats>>;
+
+// Helper: the bucket of a row at `ts` for TIME_BUCKET of `width`, which
+// truncates toward zero; opened at the end of every list of `out` unless
+// the last bucket already is it
+void openBucket(ColumnBuckets &out, int64_t ts, int64_t width,
+                bool sketches) {
+  const int64_t start = (ts / width) * width;
+  if (!out[0].empty() && out[0].back().bucketStart == start)
+    return;
+  for (auto &col : out) {
+    col.emplace_back();
+    col.back().bucketStart = start;
+    if (sketches)
+      col.back().enableSketches();
+  }
+}
+
+// Helper: append the buckets of a later run of rows to `into`, merging
+// the bucket the two runs share
+void appendBuckets(ColumnBuckets &into, ColumnBuckets &from) {
+  if (from[0].empty())
+    return;
+  const bool shared = !into[0].empty() &&
+                      into[0].back().bucketStart == from[0].front().bucketStart;
+  for (size_t c = 0; c < into.size(); ++c) {
+    auto it = from[c].begin();
+    if (shared)
+      into[c].back().merge(*it++);
+    into[c].insert(into[c].end(), std::make_move_iterator(it),
+                   std::make_move_iterator(from[c].end()));
+  }
+}
+
 } // namespace
 
+void TimeBucketStats::enableSketches() {
+  distinct = std::make_shared<HyperLogLog>();
+  digest = std::make_shared<TDigest>();
+}
+
+void TimeBucketStats::add(const InlineValue &v, int64_t ts) {
+  if (rows == 0 || ts < firstTs) {
+    first = v;
+    firstTs = ts;
+  }
+  if (rows == 0 || ts >= lastTs) {
+    last = v;
+    lastTs = ts;
+  }
+  ++rows;
+  if (distinct && !v.empty())
+    ownSketch(distinct).add(cellHash(v));
+  if (v.empty() ||
+      !(v.type() == ValueType::Integer || v.type() == ValueType::Float))
+    return;
+  double d;
+  if (v.type() == ValueType::Integer) {
+    d = static_cast<double>(v.asInt());
+    allFloat = false;
+  } else {
+    d = v.asFloat();
+  }
+  ++values;
+  if (digest)
+    ownSketch(digest).add(d);
+  sum += d;
+  if (d < min)
+    min = d;
+  if (d > max)
+    max = d;
+}
+
+void TimeBucketStats::merge(const TimeBucketStats &other) {
+  if (other.rows == 0)
+    return;
+  if (rows == 0) {
+    distinct = other.distinct;
+    digest = other.digest;
+  } else {
+    if (distinct && other.distinct)
+      ownSketch(distinct).merge(*other.distinct);
+    else
+      distinct.reset();
+    if (digest && other.digest)
+      ownSketch(digest).merge(*other.digest);
+    else
+      digest.reset();
+  }
+  if (rows == 0 || other.firstTs < firstTs) {
+    first = other.first;
+    firstTs = other.firstTs;
+  }
+  if (rows == 0 || other.lastTs >= lastTs) {
+    last = other.last;
+    lastTs = other.lastTs;
+  }
+  rows += other.rows;
+  values += other.values;
+  sum += other.sum;
+  if (other.min < min)
+    min = other.min;
+  if (other.max > max)
+    max = other.max;
+  allFloat = allFloat && other.allFloat;
+}
+
+struct InMemoryTimeSeriesStorage::BucketState {
+  bool any = false;
+  double sum = 0.0;
+  double min = std::numeric_limits<double>::infinity();
+  double max = -std::numeric_limits<double>::infinity();
+  int64_t count = 0;
+  // The approximate aggregations' sketches, made on first use
+  std::unique_ptr<HyperLogLog> distinct;
+  std::unique_ptr<TDigest> digest;
+
+  HyperLogLog &distinctSketch() {
+    if (!distinct)
+      distinct = std::make_unique<HyperLogLog>();
+    return *distinct;
+  }
+  TDigest &digestSketch() {
+    if (!digest)
+      digest = std::make_unique<TDigest>();
+    return *digest;
+  }
+  void merge(const BucketState &other) {
+    any = any || other.any;
+    count += other.count;
+    sum += other.sum;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+    if (other.distinct)
+      distinctSketch().merge(*other.distinct);
+    if (other.digest)
+      digestSketch().merge(*other.digest);
+  }
+};
+
+void InMemoryTimeSeriesStorage::Partition::insert(InlineRow row,
+                                                 size_t tsIdx) {
+  const int64_t t = timeOf(row, tsIdx);
+  headBytes += memory::rowBytes(row);
+  zone.add(row);
+  if (head.size() == headFront || timeOf(head.back(), tsIdx) <= t) {
+    head.push_back(std::move(row));
+  } else {
+    // A row older than the head's newest goes after its equals
+    auto pos = std::upper_bound(
+        head.begin() + static_cast<ptrdiff_t>(headFront), head.end(), t,
+        [&](int64_t v, const InlineRow &r) { return v < timeOf(r, tsIdx); });
+    head.insert(pos, std::move(row));
+  }
+  remeasure();
+}
+
+std::vector<InlineRow>
+InMemoryTimeSeriesStorage::Partition::rows(size_t tsIdx) const {
+  std::vector<InlineRow> out;
+  out.reserve(rowCount());
+  // Not cold: both runs are in memory
+  forEachRow(tsIdx, [&](const InlineRow &row) { out.push_back(row); });
+  return out;
+}
+
+void InMemoryTimeSeriesStorage::Partition::seal(
+    const std::vector<ColumnType> &types, size_t tsIdx) {
+  if (head.size() == headFront)
+    return;
+  sealed = TimeSeriesChunk::encode(types, rows(tsIdx));
+  head = std::vector<InlineRow>();
+  sealedFront = headFront = 0;
+  sealedTimes = std::vector<int64_t>();
+  sealedBytes = sealed.memoryBytes();
+  headBytes = 0;
+  remeasure();
+}
+
+const std::vector<int64_t> &
+InMemoryTimeSeriesStorage::Partition::sealedTimesFor(size_t tsIdx) {
+  if (sealedTimes.empty() && !sealed.empty()) {
+    std::vector<InlineValue> cells;
+    sealed.decodeColumn(tsIdx, cells);
+    sealedTimes.reserve(cells.size());
+    for (const auto &v : cells)
+      sealedTimes.push_back(v.asInt());
+    remeasure();
+  }
+  return sealedTimes;
+}
+
+size_t InMemoryTimeSeriesStorage::Partition::dropExpired(
+    int64_t cutoff, TimeGranularity granularity,
+    const std::vector<ColumnType> &types, size_t tsIdx) {
+  // Both runs are in timestamp order: their expired rows lead
+  const size_t before = rowCount();
+  while (headFront < head.size() &&
+         toSeconds(timeOf(head[headFront], tsIdx), granularity) < cutoff)
+    ++headFront;
+  if (sealedFront < sealed.rowCount()) {
+    const std::vector<int64_t> &times = sealedTimesFor(tsIdx);
+    while (sealedFront < times.size() &&
+           toSeconds(times[sealedFront], granularity) < cutoff)
+      ++sealedFront;
+  }
+  compact(types);
+  return before - rowCount();
+}
+
+Status InMemoryTimeSeriesStorage::Partition::aggregateBetween(
+    size_t tsIdx, size_t valIdx, TimeGranularity g, int64_t startSec,
+    int64_t endSec, int64_t widthSec, bool withValues,
+    std::vector<scan::BucketAggregate> &out) const {
+  // Each run is gathered into contiguous seconds, values and validity
+  std::vector<int64_t> secs;
+  std::vector<double> values;
+  std::vector<uint64_t> validity;
+  auto push = [&](int64_t tsec, const InlineValue &v) {
+    const size_t i = secs.size();
+    secs.push_back(tsec);
+    if (!withValues)
+      return;
+    if (i % 64 == 0)
+      validity.push_back(0);
+    const bool numeric = !v.empty() && (v.type() == ValueType::Integer ||
+                                        v.type() == ValueType::Float);
+    values.push_back(!numeric ? 0.0
+                     : v.type() == ValueType::Integer
+                         ? static_cast<double>(v.asInt())
+                         : v.asFloat());
+    validity.back() |= uint64_t{numeric} << (i % 64);
+  };
+  auto fold = [&]() {
+    scan::bucketAggregate(secs.data(), withValues ? values.data() : nullptr,
+                          validity.data(), secs.size(), startSec, widthSec,
+                          out);
+    secs.clear();
+    values.clear();
+    validity.clear();
+  };
+
+  if (rowCount() > head.size() - headFront) {
+    auto run = sealedRun();
+    if (!run.hasValue())
+      return run.status();
+    std::vector<InlineValue> times, cells;
+    run.value()->decodeColumn(tsIdx, times);
+    if (withValues)
+      run.value()->decodeColumn(valIdx, cells);
+    for (size_t i = sealedFront; i < times.size(); ++i) {
+      const int64_t tsec = toSeconds(times[i].asInt(), g);
+      if (tsec >= endSec)
+        break;
+      if (tsec >= startSec)
+        push(tsec, withValues ? cells[i] : InlineValue());
+    }
+    fold();
+  }
+  auto j = std::partition_point(
+      head.begin() + static_cast<ptrdiff_t>(headFront), head.end(),
+      [&](const InlineRow &r) {
+        return toSeconds(timeOf(r, tsIdx), g) < startSec;
+      });
+  for (; j != head.end(); ++j) {
+    const int64_t tsec = toSeconds(timeOf(*j, tsIdx), g);
+    if (tsec >= endSec)
+      break;
+    push(tsec, j->values()[valIdx]);
+  }
+  fold();
+  return Status::OK();
+}
+
+int64_t InMemoryTimeSeriesStorage::Partition::frontTime(size_t tsIdx) {
+  if (cold)
+    return coldFrontTime;
+  if (sealedFront == sealed.rowCount())
+    return timeOf(head[headFront], tsIdx);
+  const int64_t t = sealedTimesFor(tsIdx)[sealedFront];
+  return headFront < head.size() ? std::min(t, timeOf(head[headFront], tsIdx))
+                                 : t;
+}
+
+void InMemoryTimeSeriesStorage::Partition::dropOldest(
+    size_t n, const std::vector<ColumnType> &types, size_t tsIdx) {
+  while (n > 0) {
+    const size_t sealedLeft = sealed.rowCount() - sealedFront;
+    const size_t headLeft = head.size() - headFront;
+    if (headLeft == 0 || sealedLeft == 0) {
+      size_t &front = headLeft == 0 ? sealedFront : headFront;
+      front += std::min(n, headLeft + sealedLeft);
+      break;
+    }
+    // The older of the two leading rows goes first, sealed on ties
+    if (sealedTimesFor(tsIdx)[sealedFront] <= timeOf(head[headFront], tsIdx))
+      ++sealedFront;
+    else
+      ++headFront;
+    --n;
+  }
+  compact(types);
+}
+
+void InMemoryTimeSeriesStorage::Partition::compact(
+    const std::vector<ColumnType> &types) {
+  // Each dropped row is rewritten a constant number of times on average
+  const bool headDue = headFront > 0 && headFront * 2 >= head.size();
+  const bool sealedDue =
+      sealedFront > 0 && sealedFront * 2 >= sealed.rowCount();
+  if (headDue) {
+    for (size_t i = 0; i < headFront; ++i)
+      headBytes -= memory::rowBytes(head[i]);
+    head.erase(head.begin(), head.begin() + static_cast<ptrdiff_t>(headFront));
+    headFront = 0;
+  }
+  std::vector<InlineRow> rest;
+  if (sealedDue || headDue)
+    sealed.decode(rest);
+  if (sealedDue) {
+    rest.erase(rest.begin(),
+               rest.begin() + static_cast<ptrdiff_t>(sealedFront));
+    sealed = TimeSeriesChunk::encode(types, rest);
+    if (!sealedTimes.empty())
+      sealedTimes.erase(sealedTimes.begin(),
+                        sealedTimes.begin() +
+                            static_cast<ptrdiff_t>(sealedFront));
+    sealedFront = 0;
+    sealedBytes = sealed.memoryBytes();
+  }
+  if (sealedDue || headDue) {
+    // Narrow the zone map to the rows still held
+    zone.clear();
+    for (const auto &row : rest)
+      zone.add(row);
+    for (const auto &row : head)
+      zone.add(row);
+  }
+  remeasure();
+}
+
+void InMemoryTimeSeriesStorage::Partition::remeasure() {
+  const size_t now = sizeof(std::pair<const int64_t, Partition>) +
+                     sealedBytes + head.capacity() * sizeof(InlineRow) +
+                     headBytes + sealedTimes.capacity() * sizeof(int64_t);
+  if (account) {
+    account->add(now);
+    account->sub(bytes);
+  }
+  bytes = now;
+}
+
+Result<std::shared_ptr<const TimeSeriesChunk>>
+InMemoryTimeSeriesStorage::Partition::sealedRun() const {
+  using R = Result<std::shared_ptr<const TimeSeriesChunk>>;
+  if (cold)
+    return cold->load();
+  // Not owned: the partition outlives the read
+  return R::ok(std::shared_ptr<const TimeSeriesChunk>(
+      std::shared_ptr<const TimeSeriesChunk>(), &sealed));
+}
+
+Status InMemoryTimeSeriesStorage::Partition::freeze(
+    const std::string &directory,
+    const std::shared_ptr<ColdChunkCache> &cache,
+    const std::vector<ColumnType> &types, size_t tsIdx) {
+  if (cold || rowCount() == 0)
+    return Status::OK();
+  // One run without dropped rows
+  TimeSeriesChunk chunk = head.size() > headFront || sealedFront > 0
+                              ? TimeSeriesChunk::encode(types, rows(tsIdx))
+                              : sealed;
+  const int64_t front = frontTime(tsIdx);
+  auto file = ColdChunk::write(directory, chunk, cache);
+  if (!file.hasValue())
+    return file.status();
+  cold = std::move(file.value());
+  coldFrontTime = front;
+  sealed = TimeSeriesChunk();
+  head = std::vector<InlineRow>();
+  sealedFront = headFront = 0;
+  sealedTimes = std::vector<int64_t>();
+  sealedBytes = headBytes = 0;
+  remeasure();
+  return Status::OK();
+}
+
+Status InMemoryTimeSeriesStorage::Partition::thaw() {
+  if (!cold)
+    return Status::OK();
+  auto run = cold->load();
+  if (!run.hasValue())
+    return run.status();
+  sealed = *run.value();
+  cold.reset();
+  sealedBytes = sealed.memoryBytes();
+  remeasure();
+  return Status::OK();
+}
+
+std::shared_ptr<InMemoryTimeSeriesStorage::SeriesData>
+InMemoryTimeSeriesStorage::findSeries(const std::string &series) const {
+  std::shared_lock lk(mtx_);
+  auto it = series_.find(series);
+  return it == series_.end() ? nullptr : it->second;
+}
+
 Status InMemoryTimeSeriesStorage::createSeries(const std::string &series,
                                                const TimeSeriesSchema &schema,
                                                TimePartition partition) {
-  std::lock_guard<std::mutex> lk(mtx_);
+  std::lock_guard lk(mtx_);
   if (series_.find(series) != series_.end())
     return Status::AlreadyExists("Series already exists: " + series);
 
-  SeriesData sd;
-  sd.schema = schema;
-  sd.partition = partition;
+  auto sd = std::make_shared<SeriesData>();
+  sd->schema = schema;
+  sd->partition = partition;
+  sd->changes = changes_;
 
   auto cols = schema.allColumns();
-  sd.tableSchema = TableSchema(std::move(cols));
+  for (const auto &c : cols)
+    sd->types.push_back(c.type);
+  sd->tableSchema = TableSchema(std::move(cols));
+  sd->validator = CompiledValidator(sd->tableSchema);
+  sd->tagPartitions.resize(schema.tagColumns().size());
+
+  // Each downsampling tier rolls up every numeric value column
+  const auto &tiers = schema.retentionPolicy().tiers;
+  const auto kMaxSeconds =
+      static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+  for (size_t t = 0; t < tiers.size(); ++t) {
+    const DownsampleTier &tier = tiers[t];
+    if (tier.bucketSeconds == 0 || tier.bucketSeconds > kMaxSeconds ||
+        tier.ttlSeconds > kMaxSeconds)
+      return Status::InvalidArgument("Invalid downsampling tier " +
+                                     std::to_string(t));
+    for (size_t u = 0; u < t; ++u)
+      if (tiers[u].bucketSeconds == tier.bucketSeconds)
+        return Status::InvalidArgument(
+            "Duplicate downsampling tier of " +
+            std::to_string(tier.bucketSeconds) + "s buckets");
+    for (const auto &c : schema.valueColumns()) {
+      if (c.type != ColumnType::Integer && c.type != ColumnType::Float)
+        continue;
+      Rollup r;
+      r.column = c.name;
+      r.valIdx = sd->tableSchema.findColumn(c.name);
+      r.width = static_cast<int64_t>(tier.bucketSeconds);
+      r.tier = true;
+      r.ttl = static_cast<int64_t>(tier.ttlSeconds);
+      sd->rollups.push_back(std::move(r));
+    }
+  }
 
   series_.emplace(series, std::move(sd));
   return Status::OK();
 }
 
 Status InMemoryTimeSeriesStorage::dropSeries(const std::string &series) {
-  std::lock_guard<std::mutex> lk(mtx_);
+  std::lock_guard lk(mtx_);
   auto it = series_.find(series);
   if (it == series_.end())
     return Status::NotFound("Unknown series: " + series);
+  {
+    // Unindex the tag values the series holds, and those it gained or lost
+    // since the index was last brought up to date
+    auto &sd = *it->second;
+    std::shared_lock slk(sd.mtx);
+    auto unindex = [&](size_t t, const std::string &value) {
+      auto tag = tagIndex_.find(sd.schema.tagColumns()[t].name);
+      if (tag == tagIndex_.end())
+        return;
+      auto holders = tag->second.find(value);
+      if (holders == tag->second.end())
+        return;
+      holders->second.erase(series);
+      if (holders->second.empty())
+        tag->second.erase(holders);
+      if (tag->second.empty())
+        tagIndex_.erase(tag);
+    };
+    for (size_t t = 0; t < sd.tagPartitions.size(); ++t)
+      for (const auto &kv : sd.tagPartitions[t])
+        unindex(t, kv.first);
+    for (const auto &change : sd.tagChanges)
+      unindex(change.first, change.second);
+  }
   series_.erase(it);
+  if (changes_) {
+    ChangeEvent e;
+    e.kind = ChangeEvent::Kind::Drop;
+    e.target = series;
+    changes_->publish(std::move(e));
+  }
   return Status::OK();
 }
 
 std::vector<std::string> InMemoryTimeSeriesStorage::listSeries() const {
-  std::lock_guard<std::mutex> lk(mtx_);
+  std::shared_lock lk(mtx_);
   std::vector<std::string> out;
   out.reserve(series_.size());
   for (const auto &kv : series_)
@@ -196,95 +686,435 @@ std::vector<std::string> InMemoryTimeSeriesStorage::listSeries() const {
 
 Status InMemoryTimeSeriesStorage::append(const std::string &series,
                                          const Row &row) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto it = series_.find(series);
-  if (it == series_.end())
-    return Status::NotFound("Unknown series: " + series);
+  std::vector<InlineRow> rows;
+  rows.push_back(InlineRow::fromRow(row));
+  return appendRows(series, std::move(rows), /*batch=*/false);
+}
 
-  auto &sd = it->second;
-  if (auto err = SchemaValidator::validateRow(sd.tableSchema, row);
-      !err.empty()) {
-    return Status::InvalidArgument(err);
+Status InMemoryTimeSeriesStorage::appendBatch(const std::string &series,
+                                              const std::vector<Row> &rows) {
+  std::vector<InlineRow> inlined;
+  inlined.reserve(rows.size());
+  for (const auto &row : rows)
+    inlined.push_back(InlineRow::fromRow(row));
+  return appendRows(series, std::move(inlined), /*batch=*/true);
+}
+
+Status InMemoryTimeSeriesStorage::appendColumns(const std::string &series,
+                                                const int64_t *ts,
+                                                const double *const *values,
+                                                size_t n) {
+  auto sdp = findSeries(series);
+  if (!sdp)
+    return Status::NotFound("Unknown series: " + series);
+  // The schema of a series never changes once created
+  const TimeSeriesSchema &schema = sdp->schema;
+  if (auto st = checkColumnLayout(schema, ts, values, n); !st.ok())
+    return st;
+
+  const size_t firstValue = 1 + schema.tagColumns().size();
+  const size_t nValues = schema.valueColumns().size();
+  std::vector<InlineRow> rows;
+  rows.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    InlineRow row(firstValue + nValues);
+    row.set(0, InlineValue::integer(ts[i]));
+    for (size_t c = 0; c < nValues; ++c)
+      row.set(firstValue + c, InlineValue::floating(values[c][i]));
+    rows.push_back(std::move(row));
   }
+  return appendRows(series, std::move(rows), /*batch=*/true);
+}
 
-  size_t tsIdx = sd.tableSchema.findColumn(sd.schema.timestampColumn());
-  if (tsIdx == TableSchema::npos)
-    return Status::FailedPrecondition("Timestamp column missing from schema");
+Status InMemoryTimeSeriesStorage::appendRows(const std::string &series,
+                                             std::vector<InlineRow> rows,
+                                             bool batch) {
+  auto run = [&]() -> Status {
+    auto sdp = findSeries(series);
+    if (!sdp)
+      return Status::NotFound("Unknown series: " + series);
+    auto &sd = *sdp;
+
+    size_t tsIdx = sd.tableSchema.findColumn(sd.schema.timestampColumn());
+    if (tsIdx == TableSchema::npos)
+      return Status::FailedPrecondition("Timestamp column missing from schema");
+
+    // Validate every row before any is appended, outside the series lock:
+    // the schema of a series never changes once created
+    for (size_t i = 0; i < rows.size(); ++i) {
+      std::string err = sd.validator.validateRow(rows[i]);
+      if (err.empty()) {
+        const InlineValue &tsv = rows[i].values()[tsIdx];
+        if (tsv.empty() || tsv.type() != ValueType::Integer)
+          err = "Timestamp value must be an integer";
+      }
+      if (!err.empty())
+        return Status::InvalidArgument(
+            batch ? "Row " + std::to_string(i) + ": " + err : err);
+    }
 
-  const Value *tsv = row.values()[tsIdx].get();
-  if (!tsv || tsv->type() != ValueType::Integer)
-    return Status::InvalidArgument("Timestamp value must be an integer");
+    metrics::OperationScope::addRows(0, rows.size());
+    metrics::OperationScope::addBytes(
+        rows.size() * (sizeof(InlineRow) + sd.tableSchema.columns().size() *
+                                              sizeof(InlineValue)));
+    bool retagged = false;
+    {
+      metrics::TimedLock lk(sd.mtx);
+      if (sd.budgetPolicy == BudgetPolicy::Reject && sd.memory.budget() > 0) {
+        size_t bytes = 0;
+        for (const auto &row : rows)
+          bytes += sizeof(InlineRow) + memory::rowBytes(row);
+        if (!sd.memory.fits(rollupBytes(sd) + bytes))
+          return memory::budgetExceeded("series", series, sd.memory,
+                                        rollupBytes(sd) + bytes);
+      }
+      // Rows for cold partitions read them back into memory first, so a
+      // failed read leaves the series as it was
+      const TimeGranularity g = sd.schema.granularity();
+      for (const auto &row : rows) {
+        const int64_t start = partitionBucketStartSeconds(
+            toSeconds(row.values()[tsIdx].asInt(), g), sd.partition);
+        if (start >= sd.coldThrough)
+          continue;
+        auto p = sd.buckets.find(start);
+        if (p == sd.buckets.end() || !p->second.cold)
+          continue;
+        if (auto st = p->second.thaw(); !st.ok())
+          return st;
+        sd.thawed.insert(start);
+      }
+      std::vector<ChangeEvent> events;
+      if (sd.changes) {
+        events.resize(rows.size());
+        for (size_t i = 0; i < rows.size(); ++i) {
+          events[i].target = series;
+          events[i].after = rows[i];
+        }
+      }
+      for (auto &row : rows)
+        insertRow(sd, std::move(row), tsIdx);
+      enforceRetention(sd, tsIdx);
+      // The rows are in: a failure to move partitions out is kept for
+      // coldTierStats() and retried after the next append
+      if (!sd.coldDirectory.empty()) {
+        Status st = tierCold(sd, tsIdx);
+        sd.coldError = st.ok() ? std::string() : st.message();
+      }
+      sd.stamp.store(nextDataVersion(), std::memory_order_release);
+      if (sd.changes)
+        sd.changes->publish(std::move(events));
+      retagged = !sd.tagChanges.empty();
+    }
+    // Only rows bringing a tag value new to the series, or retention
+    // removing its last one, touch the catalog
+    if (retagged)
+      publishTagChanges(series, sdp);
+    return Status::OK();
+  };
+  return metrics::measure(metrics::Operation::TimeSeriesAppend, run);
+}
 
-  int64_t ts = static_cast<const IntegerValue &>(*tsv).asInt();
+void InMemoryTimeSeriesStorage::insertRow(SeriesData &sd, InlineRow row,
+                                          size_t tsIdx) {
+  int64_t ts = row.values()[tsIdx].asInt();
   int64_t tsec = toSeconds(ts, sd.schema.granularity());
   int64_t bstart = partitionBucketStartSeconds(tsec, sd.partition);
+  sd.latestSec = std::max(sd.latestSec, tsec);
+  for (auto &r : sd.rollups) {
+    const int64_t key = floorDiv(tsec, r.width) * r.width;
+    // A tier does not bring back the buckets it already expired
+    if (key < r.retainedFrom)
+      continue;
+    TimeBucketStats &b = r.buckets[key];
+    b.bucketStart = key;
+    if (b.rows == 0 && r.sketches)
+      b.enableSketches();
+    b.add(row.values()[r.valIdx], ts);
+  }
+
+  // In-order appends land in the newest partition, found without a search
+  auto bit = !sd.buckets.empty() && sd.buckets.rbegin()->first == bstart
+                 ? std::prev(sd.buckets.end())
+                 : sd.buckets.try_emplace(bstart).first;
+  Partition &part = bit->second;
+  part.account = &sd.memory;
+  // List the partition under the row's String tag values
+  for (size_t t = 0; t < sd.tagPartitions.size(); ++t) {
+    const InlineValue &tag = row.values()[1 + t];
+    if (tag.empty() || tag.type() != ValueType::String)
+      continue;
+    std::set<int64_t> &holders = sd.tagPartitions[t][tag.asString()];
+    if (holders.empty())
+      sd.tagChanges.emplace_back(t, tag.asString());
+    holders.insert(bstart);
+  }
+  part.insert(std::move(row), tsIdx);
+  ++sd.rowCount;
+  // A partition is open while the newest row is within the lateness
+  // window of its end
+  const uint64_t window =
+      ((sd.partition == TimePartition::Daily) ? 86400ULL : 3600ULL) +
+      std::min<uint64_t>(sd.schema.latenessSeconds(), uint64_t{1} << 62);
+  auto closed = [&](int64_t start) {
+    return static_cast<uint64_t>(sd.latestSec) -
+               static_cast<uint64_t>(start) >=
+           window;
+  };
+  if (!sd.newest || bstart > *sd.newest) {
+    // A newer partition starts: compress the late rows buffered by sealed
+    // partitions, and keep the previous one open for late rows
+    if (sd.newest)
+      sd.open.insert(*sd.newest);
+    for (int64_t k : sd.unsealed) {
+      auto u = sd.buckets.find(k);
+      if (u != sd.buckets.end())
+        u->second.seal(sd.types, tsIdx);
+    }
+    sd.unsealed.clear();
+    sd.newest = bstart;
+  } else if (bstart < *sd.newest && sd.open.count(bstart) == 0) {
+    if (!closed(bstart)) {
+      // The first row of a partition skipped over, still in the window
+      sd.open.insert(bstart);
+    } else if (part.head.size() - part.headFront >= kLateRowsPerSeal) {
+      part.seal(sd.types, tsIdx);
+      sd.unsealed.erase(bstart);
+    } else {
+      sd.unsealed.insert(bstart);
+    }
+  }
 
-  sd.buckets[bstart].push_back(row.clone());
+  // Seal the open partitions the window has passed, oldest first
+  while (!sd.open.empty() && closed(*sd.open.begin())) {
+    auto o = sd.buckets.find(*sd.open.begin());
+    if (o != sd.buckets.end())
+      o->second.seal(sd.types, tsIdx);
+    sd.open.erase(sd.open.begin());
+  }
+}
 
+void InMemoryTimeSeriesStorage::enforceRetention(SeriesData &sd,
+                                                 size_t tsIdx) {
   const auto &ret = sd.schema.retentionPolicy();
+  const size_t before = sd.rowCount;
+  auto dropFront = [&]() {
+    auto front = sd.buckets.begin();
+    sd.rowCount -= front->second.rowCount();
+    sd.memory.sub(front->second.bytes);
+    sd.unsealed.erase(front->first);
+    sd.open.erase(front->first);
+    for (size_t t = 0; t < sd.tagPartitions.size(); ++t)
+      for (auto it = sd.tagPartitions[t].begin();
+           it != sd.tagPartitions[t].end();) {
+        it->second.erase(front->first);
+        if (!it->second.empty()) {
+          ++it;
+          continue;
+        }
+        sd.tagChanges.emplace_back(t, it->first);
+        it = sd.tagPartitions[t].erase(it);
+      }
+    sd.buckets.erase(front);
+  };
 
   if (ret.ttlSeconds > 0) {
-    int64_t cutoff = tsec - static_cast<int64_t>(ret.ttlSeconds);
-    auto keys = sortedBucketKeys(sd.buckets);
-    for (int64_t k : keys) {
-      if (k + 86400LL < cutoff) {
-        sd.buckets.erase(k);
+    // The window ends at the newest row, so a late row cannot bring back
+    // rows that already expired
+    const int64_t cutoff =
+        sd.latestSec - static_cast<int64_t>(ret.ttlSeconds);
+    const int64_t width =
+        (sd.partition == TimePartition::Daily) ? 86400LL : 3600LL;
+    // Rows expire oldest first: whole partitions, then the leading rows of
+    // the oldest one still holding live rows
+    while (!sd.buckets.empty()) {
+      auto front = sd.buckets.begin();
+      // Partitions starting at the cutoff or later hold no expired rows
+      if (front->first >= cutoff)
+        break;
+      if (front->first <= cutoff - width) {
+        dropFront();
         continue;
       }
-      auto bit = sd.buckets.find(k);
-      if (bit == sd.buckets.end())
-        continue;
-      auto &vec = bit->second;
-      vec.erase(
-          std::remove_if(vec.begin(), vec.end(),
-                         [&](const Row &r) {
-                           const Value *v = r.values()[tsIdx].get();
-                           if (!v || v->type() != ValueType::Integer)
-                             return true;
-                           int64_t rsec = toSeconds(
-                               static_cast<const IntegerValue &>(*v).asInt(),
-                               sd.schema.granularity());
-                           return rsec < cutoff;
-                         }),
-          vec.end());
-      if (vec.empty())
-        sd.buckets.erase(k);
+      // A cold partition unreadable now is trimmed after a later append
+      if (!front->second.thaw().ok())
+        break;
+      sd.rowCount -= front->second.dropExpired(
+          cutoff, sd.schema.granularity(), sd.types, tsIdx);
+      if (front->second.rowCount() > 0)
+        break;
+      dropFront();
     }
   }
 
   if (ret.maxRows > 0 && ret.dropOldest) {
-    while (totalRows(sd.buckets) > ret.maxRows) {
-      auto keys = sortedBucketKeys(sd.buckets);
-      if (keys.empty())
-        break;
-      int64_t oldest = keys.front();
-      auto bit = sd.buckets.find(oldest);
-      if (bit == sd.buckets.end())
-        break;
-      auto &vec = bit->second;
-      if (!vec.empty()) {
-        vec.erase(vec.begin());
-      }
-      if (vec.empty()) {
-        sd.buckets.erase(bit);
+    while (sd.rowCount > ret.maxRows) {
+      const size_t excess = sd.rowCount - ret.maxRows;
+      Partition &oldest = sd.buckets.begin()->second;
+      if (oldest.rowCount() <= excess) {
+        dropFront();
+        continue;
       }
+      if (!oldest.thaw().ok())
+        break;
+      oldest.dropOldest(excess, sd.types, tsIdx);
+      sd.rowCount -= excess;
+    }
+  }
+
+  if (sd.budgetPolicy == BudgetPolicy::EvictOldest)
+    while (sd.buckets.size() > 1 && !sd.memory.fits(rollupBytes(sd)))
+      dropFront();
+
+  // Tiers expire whole buckets by their own TTL, from the newest row
+  for (auto &r : sd.rollups) {
+    if (!r.tier || r.ttl == 0 ||
+        sd.latestSec < std::numeric_limits<int64_t>::min() + r.ttl)
+      continue;
+    const int64_t key = floorDiv(sd.latestSec - r.ttl, r.width) * r.width;
+    if (key <= r.retainedFrom)
+      continue;
+    r.retainedFrom = key;
+    r.buckets.erase(r.buckets.begin(), r.buckets.lower_bound(key));
+  }
+
+  if (sd.rowCount == before || sd.rollups.empty())
+    return;
+  if (!ret.tiers.empty())
+    sd.evictedThroughSec =
+        sd.buckets.empty()
+            ? sd.latestSec
+            : toSeconds(sd.buckets.begin()->second.frontTime(tsIdx),
+                        sd.schema.granularity());
+  // Rows were evicted, oldest first: the rollup buckets before the oldest
+  // row left have no rows, and its own bucket may have lost some. Tiers
+  // keep them.
+  for (auto &r : sd.rollups) {
+    if (r.tier)
+      continue;
+    if (sd.buckets.empty()) {
+      r.buckets.clear();
+      r.partial.clear();
+      continue;
     }
+    const int64_t front = toSeconds(
+        sd.buckets.begin()->second.frontTime(tsIdx), sd.schema.granularity());
+    const int64_t key = floorDiv(front, r.width) * r.width;
+    r.buckets.erase(r.buckets.begin(), r.buckets.lower_bound(key));
+    r.partial.erase(r.partial.begin(), r.partial.lower_bound(key));
+    r.partial.insert(key);
   }
+}
+
+Status InMemoryTimeSeriesStorage::tierCold(SeriesData &sd, size_t tsIdx) {
+  if (sd.coldDirectory.empty())
+    return Status::OK();
+  const int64_t width =
+      (sd.partition == TimePartition::Daily) ? 86400LL : 3600LL;
+  if (sd.latestSec <
+      std::numeric_limits<int64_t>::min() + sd.hotSeconds + width)
+    return Status::OK();
+  // Partitions starting by it end before the hot window
+  const int64_t lastCold = sd.latestSec - sd.hotSeconds - width;
+  // Retention trims the oldest partition row by row: it stays in memory
+  const auto &ret = sd.schema.retentionPolicy();
+  const bool trimmed = ret.ttlSeconds > 0 || ret.maxRows > 0;
+  auto movable = [&](std::map<int64_t, Partition>::iterator it) {
+    return sd.open.count(it->first) == 0 &&
+           sd.unsealed.count(it->first) == 0 && sd.newest != it->first &&
+           !(trimmed && it == sd.buckets.begin());
+  };
 
+  for (auto t = sd.thawed.begin(); t != sd.thawed.end();) {
+    auto it = sd.buckets.find(*t);
+    if (it != sd.buckets.end() && !movable(it)) {
+      ++t;
+      continue;
+    }
+    if (it != sd.buckets.end() && it->first <= lastCold)
+      if (auto st = it->second.freeze(sd.coldDirectory, coldCache_, sd.types,
+                                      tsIdx);
+          !st.ok())
+        return st;
+    t = sd.thawed.erase(t);
+  }
+  // Partitions go out in time order; one still open for late rows holds
+  // back those after it until it is sealed
+  for (auto it = sd.buckets.lower_bound(sd.coldThrough);
+       it != sd.buckets.end() && it->first <= lastCold; ++it) {
+    if (!movable(it)) {
+      if (it == sd.buckets.begin() && trimmed) {
+        sd.coldThrough = it->first + 1;
+        continue;
+      }
+      break;
+    }
+    if (auto st =
+            it->second.freeze(sd.coldDirectory, coldCache_, sd.types, tsIdx);
+        !st.ok())
+      return st;
+    sd.coldThrough = it->first + 1;
+  }
   return Status::OK();
 }
 
+Result<std::vector<TimeBucketStats>>
+InMemoryTimeSeriesStorage::rollupBuckets(const SeriesData &sd,
+                                         const Rollup &r, size_t tsIdx,
+                                         int64_t startSec,
+                                         int64_t endSec) const {
+  using R = Result<std::vector<TimeBucketStats>>;
+  const TimeGranularity g = sd.schema.granularity();
+  std::vector<TimeBucketStats> out;
+  for (auto it = r.buckets.lower_bound(startSec);
+       it != r.buckets.end() && it->first < endSec; ++it) {
+    if (r.partial.count(it->first) == 0) {
+      out.push_back(it->second);
+      continue;
+    }
+    // Recompute a bucket that lost rows from the rows left in it
+    const int64_t lo = it->first, hi = it->first + r.width;
+    auto before = [&](int64_t ts) { return toSeconds(ts, g) < lo; };
+    auto after = [&](int64_t ts) { return toSeconds(ts, g) >= hi; };
+    TimeBucketStats st;
+    st.bucketStart = lo;
+    if (r.sketches)
+      st.enableSketches();
+    auto add = [&](const InlineRow &row) {
+      st.add(row.values()[r.valIdx], row.values()[tsIdx].asInt());
+    };
+    for (auto p = sd.buckets.lower_bound(
+             partitionBucketStartSeconds(lo, sd.partition));
+         p != sd.buckets.end() && p->first < hi; ++p)
+      if (auto rs = p->second.forEachRowBetween(tsIdx, before, after, add);
+          !rs.ok())
+        return R::err(rs);
+    if (st.rows > 0)
+      out.push_back(std::move(st));
+  }
+  return R::ok(std::move(out));
+}
+
 Result<ResultSet> InMemoryTimeSeriesStorage::rangeQuery(
     const std::string &series, const std::vector<std::string> &columns,
     int64_t startInclusive, int64_t endExclusive,
     const std::optional<Predicate> &where) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto it = series_.find(series);
-  if (it == series_.end())
-    return Result<ResultSet>::err(
-        Status::NotFound("Unknown series: " + series));
+  auto run = [&]() -> Result<ResultSet> {
+    auto sdp = findSeries(series);
+    if (!sdp)
+      return Result<ResultSet>::err(
+          Status::NotFound("Unknown series: " + series));
+    metrics::TimedSharedLock lk(sdp->mtx);
+    return querySeries(*sdp, columns, startInclusive, endExclusive, where,
+                       nullptr, ThreadPool::resolve(scanThreads()), nullptr);
+  };
+  return metrics::measure(metrics::Operation::TimeSeriesRangeQuery, run);
+}
 
-  const auto &sd = it->second;
+Result<ResultSet> InMemoryTimeSeriesStorage::querySeries(
+    const SeriesData &sd, const std::vector<std::string> &columns,
+    int64_t startInclusive, int64_t endExclusive,
+    const std::optional<Predicate> &where, const std::set<int64_t> *only,
+    size_t threads, const std::string *series) const {
   size_t tsIdx = sd.tableSchema.findColumn(sd.schema.timestampColumn());
   if (tsIdx == TableSchema::npos)
     return Result<ResultSet>::err(
@@ -299,6 +1129,10 @@ Result<ResultSet> InMemoryTimeSeriesStorage::rangeQuery(
   std::vector<size_t> projIdx;
   std::vector<std::string> outNames;
   std::vector<ColumnType> outTypes;
+  if (series) {
+    outNames.push_back("series");
+    outTypes.push_back(ColumnType::String);
+  }
 
   const auto &cols = sd.tableSchema.columns();
 
@@ -325,153 +1159,1223 @@ Result<ResultSet> InMemoryTimeSeriesStorage::rangeQuery(
 
   ResultSet rs(outNames, outTypes);
 
-  int64_t firstBucket = partitionBucketStartSeconds(startSec, sd.partition);
-  int64_t lastBucket = partitionBucketStartSeconds(
-      (endSec <= startSec) ? startSec : (endSec - 1), sd.partition);
+  // Partition starts of an open-ended range (down to INT64_MIN seconds)
+  // would overflow; no partition starts that far out
+  const int64_t kEdge = std::numeric_limits<int64_t>::max() / 2;
+  const int64_t lo = std::max(startSec, -kEdge);
+  const int64_t hi =
+      std::min(endSec <= startSec ? startSec : endSec - 1, kEdge);
+  int64_t firstBucket = partitionBucketStartSeconds(lo, sd.partition);
+  int64_t lastBucket =
+      partitionBucketStartSeconds(std::max(lo, hi), sd.partition);
+
+  // Resolve predicate columns once for the whole range scan
+  std::optional<BoundPredicate> bound;
+  if (where)
+    bound = BoundPredicate::bind(*where, sd.tableSchema);
+
+  // Rows are in timestamp order: each partition in range is searched for
+  // its first row at startSec or later and read up to endSec
+  const TimeGranularity g = sd.schema.granularity();
+  auto before = [&](int64_t ts) { return toSeconds(ts, g) < startSec; };
+  auto after = [&](int64_t ts) { return toSeconds(ts, g) >= endSec; };
+  auto project = [&](const InlineRow &r) {
+    std::vector<std::unique_ptr<Value>> cells;
+    cells.reserve(projIdx.size() + 1);
+    if (series)
+      cells.push_back(ValueFactory::createString(*series));
+    for (size_t idx : projIdx)
+      cells.push_back(r.values()[idx].toValue());
+    return ResultRow(std::move(cells));
+  };
+  // Partitions whose zone map rules the predicate out are skipped
+  std::vector<const Partition *> parts;
+  for (auto bit = sd.buckets.lower_bound(firstBucket);
+       bit != sd.buckets.end() && bit->first <= lastBucket; ++bit)
+    if ((!only || only->count(bit->first)) &&
+        (!bound || bound->mayMatch(bit->second.zone)))
+      parts.push_back(&bit->second);
+
+  if (threads > 1 && parts.size() > 1) {
+    // Partitions are read concurrently into their own rows, then appended
+    // in time order
+    std::vector<std::vector<ResultRow>> rows(parts.size());
+    std::vector<size_t> scanned(parts.size());
+    std::vector<Status> read(parts.size());
+    ThreadPool::shared().parallelFor(
+        parts.size(), 1, threads, [&](size_t m, size_t, size_t) {
+          read[m] = parts[m]->forEachRowBetween(
+              tsIdx, before, after, [&](const InlineRow &r) {
+                ++scanned[m];
+                if (!bound || bound->matches(r))
+                  rows[m].push_back(project(r));
+              });
+        });
+    for (const auto &st : read)
+      if (!st.ok())
+        return Result<ResultSet>::err(st);
+    for (auto &part : rows)
+      for (auto &row : part)
+        rs.addRow(std::move(row));
+    metrics::OperationScope::addRows(
+        std::accumulate(scanned.begin(), scanned.end(), size_t{0}),
+        rs.rowCount());
+    return Result<ResultSet>::ok(std::move(rs));
+  }
 
-  const int64_t step =
-      (sd.partition == TimePartition::Daily) ? 86400LL : 3600LL;
+  size_t scanned = 0;
+  for (const Partition *part : parts) {
+    // A partition at a time, so an interrupted query stops early
+    if (auto st = InterruptScope::check(); !st.ok())
+      return Result<ResultSet>::err(st);
+    auto st = part->forEachRowBetween(tsIdx, before, after,
+                                      [&](const InlineRow &r) {
+                                        ++scanned;
+                                        if (!bound || bound->matches(r))
+                                          rs.addRow(project(r));
+                                      });
+    if (!st.ok())
+      return Result<ResultSet>::err(st);
+  }
 
-  for (int64_t b = firstBucket; b <= lastBucket; b += step) {
-    auto bit = sd.buckets.find(b);
-    if (bit == sd.buckets.end())
-      continue;
+  metrics::OperationScope::addRows(scanned, rs.rowCount());
+  return Result<ResultSet>::ok(std::move(rs));
+}
 
-    for (const auto &r : bit->second) {
-      const Value *v = r.values()[tsIdx].get();
-      if (!v || v->type() != ValueType::Integer)
-        continue;
+Status TimeSeriesStorage::scan(const std::string &series,
+                               const std::vector<std::string> &columns,
+                               int64_t startInclusive, int64_t endExclusive,
+                               const std::optional<Predicate> &where,
+                               const RelationalStorage::BatchSink &sink,
+                               size_t batchRows) {
+  tracing::Span span("storage.timeseries.scan");
+  if (span.recording())
+    span.setAttribute("kadedb.series", series);
+  auto res = rangeQuery(series, columns, startInclusive, endExclusive, where);
+  if (!res.hasValue()) {
+    span.fail();
+    return res.status();
+  }
+  span.setAttribute("kadedb.rows_scanned",
+                    static_cast<int64_t>(res.value().rowCount()));
+  return scanResultSet(res.value(), sink, batchRows);
+}
 
-      int64_t ts = static_cast<const IntegerValue &>(*v).asInt();
-      int64_t tsec = toSeconds(ts, sd.schema.granularity());
-      if (tsec < startSec || tsec >= endSec)
-        continue;
+Result<TimePartition>
+TimeSeriesStorage::getSeriesPartition(const std::string &series) const {
+  auto schema = getSeriesSchema(series);
+  if (!schema.hasValue())
+    return Result<TimePartition>::err(schema.status());
+  return Result<TimePartition>::ok(TimePartition::Hourly);
+}
 
-      if (where && !evalPredicate(sd.tableSchema, r, *where))
-        continue;
+Status TimeSeriesStorage::appendBatch(const std::string &series,
+                                      const std::vector<Row> &rows) {
+  for (const auto &row : rows)
+    if (auto st = append(series, row); !st.ok())
+      return st;
+  return Status::OK();
+}
+
+Status TimeSeriesStorage::appendColumns(const std::string &series,
+                                        const int64_t *ts,
+                                        const double *const *values,
+                                        size_t n) {
+  auto schema = getSeriesSchema(series);
+  if (!schema.hasValue())
+    return schema.status();
+  if (auto st = checkColumnLayout(schema.value(), ts, values, n); !st.ok())
+    return st;
+
+  const size_t firstValue = 1 + schema.value().tagColumns().size();
+  const size_t nValues = schema.value().valueColumns().size();
+  std::vector<Row> rows;
+  rows.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    Row row(firstValue + nValues);
+    row.set(0, ValueFactory::createInteger(ts[i]));
+    for (size_t c = 0; c < nValues; ++c)
+      row.set(firstValue + c, ValueFactory::createFloat(values[c][i]));
+    rows.push_back(std::move(row));
+  }
+  return appendBatch(series, rows);
+}
+
+Status TimeSeriesStorage::createContinuousAggregate(const std::string &,
+                                                    const std::string &,
+                                                    int64_t, TimeGranularity,
+                                                    bool) {
+  return Status::FailedPrecondition(
+      "Continuous aggregates are not supported by this storage");
+}
+
+Status TimeSeriesStorage::dropContinuousAggregate(const std::string &,
+                                                  const std::string &,
+                                                  int64_t, TimeGranularity) {
+  return Status::FailedPrecondition(
+      "Continuous aggregates are not supported by this storage");
+}
+
+Result<std::vector<TimeBucketStats>>
+TimeSeriesStorage::continuousAggregate(const std::string &,
+                                       const std::string &valueColumn,
+                                       int64_t, int64_t, int64_t) {
+  return Result<std::vector<TimeBucketStats>>::err(
+      Status::NotFound("No continuous aggregate of " + valueColumn));
+}
+
+std::optional<uint64_t>
+TimeSeriesStorage::seriesVersion(const std::string &) const {
+  return std::nullopt;
+}
+
+Result<std::unique_ptr<ChangeSubscription>>
+TimeSeriesStorage::subscribeChanges(const std::string &,
+                                    const std::optional<Predicate> &) {
+  return Result<std::unique_ptr<ChangeSubscription>>::err(
+      Status::FailedPrecondition("Change capture is not supported"));
+}
+
+Predicate
+TimeSeriesStorage::tagPredicate(const TagFilter &tags,
+                                const std::optional<Predicate> &where) {
+  Predicate all;
+  all.kind = Predicate::Kind::And;
+  for (const auto &[tag, value] : tags) {
+    Predicate eq;
+    eq.column = tag;
+    eq.op = Predicate::Op::Eq;
+    eq.rhs = ValueFactory::createString(value);
+    all.children.push_back(std::move(eq));
+  }
+  if (where)
+    all.children.push_back(copyPredicate(*where));
+  return all;
+}
+
+Result<std::vector<std::string>>
+TimeSeriesStorage::findSeriesByTags(const TagFilter &tags) const {
+  using R = Result<std::vector<std::string>>;
+  if (tags.empty())
+    return R::err(Status::InvalidArgument("Empty tag filter"));
+  // Each tag value in some row: one probe per tag and series
+  auto &self = const_cast<TimeSeriesStorage &>(*this);
+  std::vector<std::string> names = listSeries();
+  std::sort(names.begin(), names.end());
+  std::vector<std::string> out;
+  for (const auto &name : names) {
+    bool all = true;
+    for (const auto &[tag, value] : tags) {
+      const std::optional<Predicate> eq =
+          tagPredicate({{tag, value}}, std::nullopt);
+      auto rs = self.rangeQuery(name, {tag},
+                                std::numeric_limits<int64_t>::min(),
+                                std::numeric_limits<int64_t>::max(), eq);
+      if (!rs.hasValue() || rs.value().rowCount() == 0) {
+        all = false;
+        break;
+      }
+    }
+    if (all)
+      out.push_back(name);
+  }
+  return R::ok(std::move(out));
+}
 
+Result<ResultSet> TimeSeriesStorage::rangeQueryByTags(
+    const TagFilter &tags, const std::vector<std::string> &columns,
+    int64_t startInclusive, int64_t endExclusive,
+    const std::optional<Predicate> &where) {
+  auto names = findSeriesByTags(tags);
+  if (!names.hasValue())
+    return Result<ResultSet>::err(names.status());
+  const std::vector<std::string> &list = names.value();
+  const std::optional<Predicate> pred = tagPredicate(tags, where);
+  std::vector<std::optional<Result<ResultSet>>> parts(list.size());
+  for (size_t m = 0; m < list.size(); ++m) {
+    auto rs = rangeQuery(list[m], columns, startInclusive, endExclusive, pred);
+    if (!rs.hasValue()) {
+      parts[m] = std::move(rs);
+      continue;
+    }
+    // Lead every row with the name of its series
+    std::vector<std::string> outNames{"series"};
+    std::vector<ColumnType> outTypes{ColumnType::String};
+    const ResultSet &got = rs.value();
+    outNames.insert(outNames.end(), got.columnNames().begin(),
+                    got.columnNames().end());
+    outTypes.insert(outTypes.end(), got.columnTypes().begin(),
+                    got.columnTypes().end());
+    ResultSet led(std::move(outNames), std::move(outTypes));
+    for (auto &row : rs.value().takeRows()) {
       std::vector<std::unique_ptr<Value>> cells;
-      cells.reserve(projIdx.size());
-      for (size_t idx : projIdx) {
-        const auto &cv = r.values()[idx];
-        cells.push_back(cv ? cv->clone() : nullptr);
+      cells.reserve(row.size() + 1);
+      cells.push_back(ValueFactory::createString(list[m]));
+      for (size_t c = 0; c < row.size(); ++c)
+        cells.push_back(row.takeValue(c));
+      led.addRow(ResultRow(std::move(cells)));
+    }
+    parts[m] = Result<ResultSet>::ok(std::move(led));
+  }
+  return concatSeries(list, parts, columns);
+}
+
+Result<ResultSet> TimeSeriesStorage::aggregateByTags(
+    const TagFilter &, const std::string &, TimeAggregation, int64_t, int64_t,
+    int64_t, TimeGranularity, const std::optional<Predicate> &, double) {
+  return Result<ResultSet>::err(Status::FailedPrecondition(
+      "Aggregates across series are not supported by this storage"));
+}
+
+Result<ResultSet> TimeSeriesStorage::window(
+    const std::string &series, const std::string &valueColumn,
+    TimeWindowFunction fn, int64_t startInclusive, int64_t endExclusive,
+    int64_t width, TimeGranularity widthGranularity,
+    const std::optional<Predicate> &where) {
+  using R = Result<ResultSet>;
+  auto schema = getSeriesSchema(series);
+  if (!schema.hasValue())
+    return R::err(schema.status());
+  const TimeSeriesSchema &sc = schema.value();
+  const size_t v = sc.findValueColumn(valueColumn);
+  if (v == TimeSeriesSchema::npos)
+    return R::err(
+        Status::InvalidArgument("Unknown value column: " + valueColumn));
+  const ColumnType type = sc.valueColumns()[v].type;
+  if (type != ColumnType::Integer && type != ColumnType::Float)
+    return R::err(Status::InvalidArgument(
+        std::string(timeWindowFunctionName(fn)) +
+        " requires a numeric column: " + valueColumn));
+  // The width in timestamp units of the series
+  const double unit = timeUnitSeconds(sc.granularity());
+  const double units = static_cast<double>(width) *
+                       timeUnitSeconds(widthGranularity) / unit;
+  if (!(units >= 0.5))
+    return R::err(Status::InvalidArgument(
+        "Window width must be at least one timestamp unit"));
+  const int64_t span = units >= 9.2e18 ? std::numeric_limits<int64_t>::max()
+                                        : std::llround(units);
+
+  const std::string &tsCol = sc.timestampColumn();
+  ResultSet out({tsCol, "value"}, {ColumnType::Integer, ColumnType::Float});
+  TimeWindow state(fn, span, unit);
+  std::optional<int64_t> last;
+  Status failed = Status::OK();
+  auto st = scan(
+      series, {tsCol, valueColumn}, startInclusive, endExclusive, where,
+      [&](RowBatch &batch) {
+        for (auto &row : batch.rows) {
+          const int64_t ts = row[0]->asInt();
+          if (last && ts < *last) {
+            failed = Status::FailedPrecondition(
+                "Series rows are not in timestamp order");
+            return false;
+          }
+          last = ts;
+          std::optional<double> y;
+          const Value *x = row[1].get();
+          if (x && (x->type() == ValueType::Integer ||
+                    x->type() == ValueType::Float))
+            y = state.add(ts, x->asFloat());
+          std::vector<std::unique_ptr<Value>> cells;
+          cells.push_back(std::move(row[0]));
+          cells.push_back(y ? ValueFactory::createFloat(*y)
+                            : ValueFactory::createNull());
+          out.addRow(ResultRow(std::move(cells)));
+        }
+        return true;
+      });
+  if (!st.ok())
+    return R::err(st);
+  if (!failed.ok())
+    return R::err(failed);
+  return R::ok(std::move(out));
+}
+
+Result<std::vector<std::vector<TimeBucketStats>>>
+TimeSeriesStorage::bucketStats(const std::string &series,
+                               const std::vector<std::string> &valueColumns,
+                               int64_t startInclusive, int64_t endExclusive,
+                               int64_t bucketWidth,
+                               const std::optional<Predicate> &where,
+                               bool sketches) {
+  using R = Result<std::vector<std::vector<TimeBucketStats>>>;
+  auto schema = getSeriesSchema(series);
+  if (!schema.hasValue())
+    return R::err(schema.status());
+  if (bucketWidth <= 0)
+    return R::err(Status::InvalidArgument("bucketWidth must be > 0"));
+  std::vector<std::string> columns{schema.value().timestampColumn()};
+  for (const auto &col : valueColumns) {
+    if (schema.value().findValueColumn(col) == TimeSeriesSchema::npos)
+      return R::err(Status::InvalidArgument("Unknown value column: " + col));
+    columns.push_back(col);
+  }
+  if (valueColumns.empty())
+    return R::ok({});
+
+  ColumnBuckets out(valueColumns.size());
+  std::optional<int64_t> last;
+  Status failed = Status::OK();
+  auto st = scan(series, columns, startInclusive, endExclusive, where,
+                 [&](RowBatch &batch) {
+                   for (const auto &row : batch.rows) {
+                     const int64_t ts = row[0]->asInt();
+                     if (last && ts < *last) {
+                       failed = Status::FailedPrecondition(
+                           "Series rows are not in timestamp order");
+                       return false;
+                     }
+                     last = ts;
+                     openBucket(out, ts, bucketWidth, sketches);
+                     for (size_t c = 0; c < out.size(); ++c) {
+                       const Value *v = row[c + 1].get();
+                       out[c].back().add(
+                           v && v->type() != ValueType::Null
+                               ? InlineValue::fromValue(v)
+                               : InlineValue(),
+                           ts);
+                     }
+                   }
+                   return true;
+                 });
+  if (!st.ok())
+    return R::err(st);
+  if (!failed.ok())
+    return R::err(failed);
+  return R::ok(std::move(out));
+}
+
+Status InMemoryTimeSeriesStorage::createContinuousAggregate(
+    const std::string &series, const std::string &valueColumn,
+    int64_t bucketWidth, TimeGranularity bucketGranularity, bool sketches) {
+  auto sdp = findSeries(series);
+  if (!sdp)
+    return Status::NotFound("Unknown series: " + series);
+  std::lock_guard lk(sdp->mtx);
+
+  auto &sd = *sdp;
+  const Column *col = nullptr;
+  for (const auto &c : sd.schema.valueColumns())
+    if (c.name == valueColumn)
+      col = &c;
+  if (!col)
+    return Status::InvalidArgument("Unknown value column: " + valueColumn);
+  if (col->type != ColumnType::Integer && col->type != ColumnType::Float)
+    return Status::InvalidArgument(
+        "Continuous aggregates need a numeric value column: " + valueColumn);
+  const int64_t width = bucketWidthSeconds(bucketWidth, bucketGranularity);
+  if (width <= 0)
+    return Status::InvalidArgument("bucketWidth must be > 0");
+  for (const auto &r : sd.rollups)
+    if (r.column == valueColumn && r.width == width)
+      return Status::AlreadyExists("Continuous aggregate already exists: " +
+                                   valueColumn + " in " +
+                                   std::to_string(width) + "s buckets");
+  size_t tsIdx = sd.tableSchema.findColumn(sd.schema.timestampColumn());
+  if (tsIdx == TableSchema::npos)
+    return Status::FailedPrecondition("Timestamp column missing from schema");
+
+  // Roll up the rows already stored, in timestamp order
+  Rollup r;
+  r.column = valueColumn;
+  r.valIdx = sd.tableSchema.findColumn(valueColumn);
+  r.width = width;
+  r.sketches = sketches;
+  const TimeGranularity g = sd.schema.granularity();
+  auto add = [&](const InlineRow &row) {
+    const int64_t ts = row.values()[tsIdx].asInt();
+    const int64_t key = floorDiv(toSeconds(ts, g), width) * width;
+    TimeBucketStats &b = r.buckets[key];
+    b.bucketStart = key;
+    if (b.rows == 0 && sketches)
+      b.enableSketches();
+    b.add(row.values()[r.valIdx], ts);
+  };
+  for (const auto &kv : sd.buckets)
+    if (auto st = kv.second.forEachRow(tsIdx, add); !st.ok())
+      return st;
+  sd.rollups.push_back(std::move(r));
+  return Status::OK();
+}
+
+Status InMemoryTimeSeriesStorage::dropContinuousAggregate(
+    const std::string &series, const std::string &valueColumn,
+    int64_t bucketWidth, TimeGranularity bucketGranularity) {
+  auto sdp = findSeries(series);
+  if (!sdp)
+    return Status::NotFound("Unknown series: " + series);
+  std::lock_guard lk(sdp->mtx);
+  const int64_t width = bucketWidthSeconds(bucketWidth, bucketGranularity);
+  auto &rollups = sdp->rollups;
+  for (auto it = rollups.begin(); it != rollups.end(); ++it) {
+    if (it->column == valueColumn && it->width == width) {
+      if (it->tier)
+        return Status::FailedPrecondition(
+            "Continuous aggregate of " + valueColumn + " in " +
+            std::to_string(width) +
+            "s buckets is a downsampling tier of the retention policy");
+      rollups.erase(it);
+      return Status::OK();
+    }
+  }
+  return Status::NotFound("No continuous aggregate of " + valueColumn +
+                          " in " + std::to_string(width) + "s buckets");
+}
+
+Result<std::vector<TimeBucketStats>>
+InMemoryTimeSeriesStorage::continuousAggregate(const std::string &series,
+                                               const std::string &valueColumn,
+                                               int64_t bucketSeconds,
+                                               int64_t startSec,
+                                               int64_t endSec) {
+  using R = Result<std::vector<TimeBucketStats>>;
+  auto sdp = findSeries(series);
+  if (!sdp)
+    return R::err(Status::NotFound("Unknown series: " + series));
+  std::shared_lock lk(sdp->mtx);
+
+  const auto &sd = *sdp;
+  size_t tsIdx = sd.tableSchema.findColumn(sd.schema.timestampColumn());
+  if (tsIdx == TableSchema::npos)
+    return R::err(
+        Status::FailedPrecondition("Timestamp column missing from schema"));
+  if (bucketSeconds <= 0)
+    return R::err(Status::InvalidArgument("bucketSeconds must be > 0"));
+  if (endSec < startSec)
+    return R::err(Status::InvalidArgument("Invalid time range: end < start"));
+
+  // The widest continuous aggregate tiling the buckets and the range
+  const Rollup *best = nullptr;
+  for (const auto &r : sd.rollups)
+    if (r.column == valueColumn && bucketSeconds % r.width == 0 &&
+        (startSec == std::numeric_limits<int64_t>::min() ||
+         startSec % r.width == 0) &&
+        (endSec == std::numeric_limits<int64_t>::max() ||
+         endSec % r.width == 0) &&
+        (!best || r.width > best->width))
+      best = &r;
+  if (!best)
+    return R::err(Status::NotFound("No continuous aggregate of " +
+                                   valueColumn + " answers " +
+                                   std::to_string(bucketSeconds) +
+                                   "s buckets"));
+
+  auto buckets = rollupBuckets(sd, *best, tsIdx, startSec, endSec);
+  if (!buckets.hasValue())
+    return R::err(buckets.status());
+  std::vector<TimeBucketStats> out;
+  for (auto &b : buckets.value()) {
+    const int64_t key = floorDiv(b.bucketStart, bucketSeconds) * bucketSeconds;
+    if (!out.empty() && out.back().bucketStart == key) {
+      out.back().merge(b);
+      continue;
+    }
+    b.bucketStart = key;
+    out.push_back(std::move(b));
+  }
+  return R::ok(std::move(out));
+}
+
+Result<std::vector<std::vector<TimeBucketStats>>>
+InMemoryTimeSeriesStorage::bucketStats(
+    const std::string &series, const std::vector<std::string> &valueColumns,
+    int64_t startInclusive, int64_t endExclusive, int64_t bucketWidth,
+    const std::optional<Predicate> &where, bool sketches) {
+  using R = Result<std::vector<std::vector<TimeBucketStats>>>;
+  auto run = [&]() -> R {
+    auto sdp = findSeries(series);
+    if (!sdp)
+      return R::err(Status::NotFound("Unknown series: " + series));
+    metrics::TimedSharedLock lk(sdp->mtx);
+    const auto &sd = *sdp;
+    size_t tsIdx = sd.tableSchema.findColumn(sd.schema.timestampColumn());
+    if (tsIdx == TableSchema::npos)
+      return R::err(
+          Status::FailedPrecondition("Timestamp column missing from schema"));
+    if (bucketWidth <= 0)
+      return R::err(Status::InvalidArgument("bucketWidth must be > 0"));
+    std::vector<size_t> valIdx;
+    for (const auto &col : valueColumns) {
+      valIdx.push_back(sd.tableSchema.findColumn(col));
+      if (valIdx.back() == TableSchema::npos || valIdx.back() == tsIdx)
+        return R::err(
+            Status::InvalidArgument("Unknown value column: " + col));
+    }
+
+    const TimeGranularity g = sd.schema.granularity();
+    const int64_t startSec = toSeconds(startInclusive, g);
+    const int64_t endSec = toSeconds(endExclusive, g);
+    if (endSec < startSec)
+      return R::err(Status::InvalidArgument("Invalid time range: end < start"));
+    if (valueColumns.empty())
+      return R::ok({});
+
+    // The partitions rangeQuery() reads (see querySeries)
+    const int64_t kEdge = std::numeric_limits<int64_t>::max() / 2;
+    const int64_t lo = std::max(startSec, -kEdge);
+    const int64_t hi =
+        std::min(endSec <= startSec ? startSec : endSec - 1, kEdge);
+    const int64_t firstBucket = partitionBucketStartSeconds(lo, sd.partition);
+    const int64_t lastBucket =
+        partitionBucketStartSeconds(std::max(lo, hi), sd.partition);
+    std::optional<BoundPredicate> bound;
+    if (where)
+      bound = BoundPredicate::bind(*where, sd.tableSchema);
+    std::vector<const Partition *> parts;
+    for (auto bit = sd.buckets.lower_bound(firstBucket);
+         bit != sd.buckets.end() && bit->first <= lastBucket; ++bit)
+      if (!bound || bound->mayMatch(bit->second.zone))
+        parts.push_back(&bit->second);
+
+    // Rows come in timestamp order within a partition, so each one fills
+    // its buckets front to back
+    auto before = [&](int64_t ts) { return toSeconds(ts, g) < startSec; };
+    auto after = [&](int64_t ts) { return toSeconds(ts, g) >= endSec; };
+    auto read = [&](const Partition &part, ColumnBuckets &into,
+                    size_t &scanned) {
+      return part.forEachRowBetween(
+          tsIdx, before, after, [&](const InlineRow &r) {
+            ++scanned;
+            if (bound && !bound->matches(r))
+              return;
+            const int64_t ts = r.values()[tsIdx].asInt();
+            openBucket(into, ts, bucketWidth, sketches);
+            for (size_t c = 0; c < into.size(); ++c)
+              into[c].back().add(r.values()[valIdx[c]], ts);
+          });
+    };
+
+    ColumnBuckets out(valueColumns.size());
+    size_t scanned = 0;
+    const size_t threads = ThreadPool::resolve(scanThreads());
+    if (threads > 1 && parts.size() > 1) {
+      std::vector<ColumnBuckets> partial(parts.size(), out);
+      std::vector<size_t> partScanned(parts.size());
+      std::vector<Status> status(parts.size());
+      ThreadPool::shared().parallelFor(
+          parts.size(), 1, threads, [&](size_t m, size_t, size_t) {
+            status[m] = read(*parts[m], partial[m], partScanned[m]);
+          });
+      for (const auto &st : status)
+        if (!st.ok())
+          return R::err(st);
+      for (auto &p : partial)
+        appendBuckets(out, p);
+      scanned = std::accumulate(partScanned.begin(), partScanned.end(),
+                                size_t{0});
+    } else {
+      for (const Partition *part : parts) {
+        // A partition at a time, so an interrupted query stops early
+        if (auto st = InterruptScope::check(); !st.ok())
+          return R::err(st);
+        if (auto st = read(*part, out, scanned); !st.ok())
+          return R::err(st);
       }
-      rs.addRow(ResultRow(std::move(cells)));
     }
+    metrics::OperationScope::addRows(scanned, out[0].size());
+    return R::ok(std::move(out));
+  };
+  return metrics::measure(metrics::Operation::TimeSeriesAggregate, run);
+}
+
+Result<TimeSeriesSchema>
+InMemoryTimeSeriesStorage::getSeriesSchema(const std::string &series) const {
+  auto sdp = findSeries(series);
+  if (!sdp)
+    return Result<TimeSeriesSchema>::err(
+        Status::NotFound("Unknown series: " + series));
+  std::shared_lock lk(sdp->mtx);
+  return Result<TimeSeriesSchema>::ok(sdp->schema);
+}
+
+Result<TimePartition>
+InMemoryTimeSeriesStorage::getSeriesPartition(const std::string &series) const {
+  auto sdp = findSeries(series);
+  if (!sdp)
+    return Result<TimePartition>::err(
+        Status::NotFound("Unknown series: " + series));
+  std::shared_lock lk(sdp->mtx);
+  return Result<TimePartition>::ok(sdp->partition);
+}
+
+std::optional<uint64_t>
+InMemoryTimeSeriesStorage::seriesVersion(const std::string &series) const {
+  auto sdp = findSeries(series);
+  if (!sdp)
+    return std::nullopt;
+  return sdp->stamp.load(std::memory_order_acquire);
+}
+
+Result<size_t>
+InMemoryTimeSeriesStorage::memoryUsage(const std::string &series) const {
+  auto sdp = findSeries(series);
+  if (!sdp)
+    return Result<size_t>::err(Status::NotFound("Unknown series: " + series));
+  std::shared_lock lk(sdp->mtx);
+  return Result<size_t>::ok(sdp->memory.bytes() + rollupBytes(*sdp));
+}
+
+size_t InMemoryTimeSeriesStorage::rollupBytes(const SeriesData &sd) {
+  size_t bytes = 0;
+  for (const auto &r : sd.rollups)
+    bytes += r.buckets.size() * (sizeof(int64_t) + sizeof(TimeBucketStats) +
+                                 (r.sketches ? kSketchBytes : 0));
+  return bytes;
+}
+
+Status InMemoryTimeSeriesStorage::setMemoryBudget(const std::string &series,
+                                                  size_t bytes,
+                                                  BudgetPolicy policy) {
+  auto sdp = findSeries(series);
+  if (!sdp)
+    return Status::NotFound("Unknown series: " + series);
+  auto &sd = *sdp;
+  bool retagged = false;
+  {
+    std::lock_guard lk(sd.mtx);
+    sd.memory.setBudget(bytes);
+    sd.budgetPolicy = policy;
+    // Evict at once when the new budget is already exceeded
+    const size_t tsIdx =
+        sd.tableSchema.findColumn(sd.schema.timestampColumn());
+    if (policy == BudgetPolicy::EvictOldest && tsIdx != TableSchema::npos) {
+      const size_t before = sd.rowCount;
+      enforceRetention(sd, tsIdx);
+      if (sd.rowCount != before)
+        sd.stamp.store(nextDataVersion(), std::memory_order_release);
+    }
+    retagged = !sd.tagChanges.empty();
   }
+  if (retagged)
+    publishTagChanges(series, sdp);
+  return Status::OK();
+}
 
-  return Result<ResultSet>::ok(std::move(rs));
+Status InMemoryTimeSeriesStorage::setColdTier(const std::string &series,
+                                              const std::string &directory,
+                                              uint64_t hotSeconds) {
+  auto sdp = findSeries(series);
+  if (!sdp)
+    return Status::NotFound("Unknown series: " + series);
+  auto &sd = *sdp;
+  size_t tsIdx = sd.tableSchema.findColumn(sd.schema.timestampColumn());
+  if (tsIdx == TableSchema::npos)
+    return Status::FailedPrecondition("Timestamp column missing from schema");
+  std::unique_lock lk(sd.mtx);
+  if (directory.empty()) {
+    for (auto &kv : sd.buckets)
+      if (auto st = kv.second.thaw(); !st.ok())
+        return st;
+    sd.coldDirectory.clear();
+    sd.coldThrough = std::numeric_limits<int64_t>::min();
+    sd.thawed.clear();
+    sd.coldError.clear();
+    return Status::OK();
+  }
+  sd.coldDirectory = directory;
+  sd.hotSeconds = static_cast<int64_t>(
+      std::min<uint64_t>(hotSeconds, uint64_t{1} << 62));
+  Status st = tierCold(sd, tsIdx);
+  sd.coldError = st.ok() ? std::string() : st.message();
+  return st;
+}
+
+Result<InMemoryTimeSeriesStorage::ColdTierStats>
+InMemoryTimeSeriesStorage::coldTierStats(const std::string &series) const {
+  using R = Result<ColdTierStats>;
+  auto sdp = findSeries(series);
+  if (!sdp)
+    return R::err(Status::NotFound("Unknown series: " + series));
+  std::shared_lock lk(sdp->mtx);
+  ColdTierStats stats;
+  for (const auto &kv : sdp->buckets) {
+    if (!kv.second.cold)
+      continue;
+    ++stats.coldPartitions;
+    stats.coldRows += kv.second.cold->rowCount();
+    stats.fileBytes += kv.second.cold->fileBytes();
+  }
+  stats.lastError = sdp->coldError;
+  return R::ok(std::move(stats));
+}
+
+void InMemoryTimeSeriesStorage::enableChangeCapture(size_t capacity) {
+  std::lock_guard lk(mtx_);
+  if (changes_)
+    return;
+  changes_ = std::make_shared<ChangeFeed>(capacity);
+  for (auto &kv : series_) {
+    std::lock_guard slk(kv.second->mtx);
+    kv.second->changes = changes_;
+  }
+}
+
+std::shared_ptr<ChangeFeed> InMemoryTimeSeriesStorage::changeFeed() const {
+  std::shared_lock lk(mtx_);
+  return changes_;
+}
+
+Result<std::unique_ptr<ChangeSubscription>>
+InMemoryTimeSeriesStorage::subscribeChanges(
+    const std::string &series, const std::optional<Predicate> &where) {
+  using R = Result<std::unique_ptr<ChangeSubscription>>;
+  auto feed = changeFeed();
+  if (!feed)
+    return R::err(Status::FailedPrecondition("Change capture is not enabled"));
+  auto sdp = findSeries(series);
+  if (!sdp)
+    return R::err(Status::NotFound("Unknown series: " + series));
+  if (!where)
+    return R::ok(feed->subscribe(series));
+  // The bound form points into the predicate, so the filter owns both
+  auto pred = std::make_shared<Predicate>(copyPredicate(*where));
+  auto bound = std::make_shared<BoundPredicate>(
+      BoundPredicate::bind(*pred, sdp->tableSchema));
+  return R::ok(feed->subscribe(series, [pred, bound](const ChangeEvent &e) {
+    return e.after && bound->matches(*e.after);
+  }));
+}
+
+void InMemoryTimeSeriesStorage::publishTagChanges(
+    const std::string &series, const std::shared_ptr<SeriesData> &sdp) {
+  std::lock_guard lk(mtx_);
+  auto it = series_.find(series);
+  if (it == series_.end() || it->second != sdp)
+    return;
+  // Changes are applied as the series stands now, so concurrent appends
+  // may publish in either order
+  std::lock_guard slk(sdp->mtx);
+  for (const auto &[t, value] : sdp->tagChanges) {
+    const std::string &tag = sdp->schema.tagColumns()[t].name;
+    if (sdp->tagPartitions[t].count(value)) {
+      tagIndex_[tag][value].insert(series);
+      continue;
+    }
+    auto byTag = tagIndex_.find(tag);
+    if (byTag == tagIndex_.end())
+      continue;
+    auto holders = byTag->second.find(value);
+    if (holders == byTag->second.end())
+      continue;
+    holders->second.erase(series);
+    if (holders->second.empty())
+      byTag->second.erase(holders);
+    if (byTag->second.empty())
+      tagIndex_.erase(byTag);
+  }
+  sdp->tagChanges.clear();
+}
+
+std::set<int64_t>
+InMemoryTimeSeriesStorage::tagCandidates(const SeriesData &sd,
+                                         const TagFilter &tags) {
+  std::set<int64_t> out;
+  bool first = true;
+  for (const auto &[tag, value] : tags) {
+    const size_t t = sd.schema.findTagColumn(tag);
+    if (t == TimeSeriesSchema::npos)
+      return {};
+    auto holders = sd.tagPartitions[t].find(value);
+    if (holders == sd.tagPartitions[t].end())
+      return {};
+    if (first) {
+      out = holders->second;
+      first = false;
+      continue;
+    }
+    std::set<int64_t> both;
+    std::set_intersection(out.begin(), out.end(), holders->second.begin(),
+                          holders->second.end(),
+                          std::inserter(both, both.end()));
+    out = std::move(both);
+  }
+  return out;
+}
+
+Result<std::vector<std::string>>
+InMemoryTimeSeriesStorage::findSeriesByTags(const TagFilter &tags) const {
+  using R = Result<std::vector<std::string>>;
+  if (tags.empty())
+    return R::err(Status::InvalidArgument("Empty tag filter"));
+  std::shared_lock lk(mtx_);
+  // Walk the fewest holders and look each up in the other tags' sets
+  std::vector<const std::set<std::string> *> sets;
+  for (const auto &[tag, value] : tags) {
+    auto byTag = tagIndex_.find(tag);
+    if (byTag == tagIndex_.end())
+      return R::ok({});
+    auto holders = byTag->second.find(value);
+    if (holders == byTag->second.end())
+      return R::ok({});
+    sets.push_back(&holders->second);
+  }
+  std::sort(sets.begin(), sets.end(),
+            [](const auto *a, const auto *b) { return a->size() < b->size(); });
+  std::vector<std::string> out;
+  for (const std::string &name : *sets.front())
+    if (std::all_of(sets.begin() + 1, sets.end(),
+                    [&](const auto *set) { return set->count(name) > 0; }))
+      out.push_back(name);
+  return R::ok(std::move(out));
+}
+
+Result<ResultSet> InMemoryTimeSeriesStorage::rangeQueryByTags(
+    const TagFilter &tags, const std::vector<std::string> &columns,
+    int64_t startInclusive, int64_t endExclusive,
+    const std::optional<Predicate> &where) {
+  auto run = [&]() -> Result<ResultSet> {
+    auto names = findSeriesByTags(tags);
+    if (!names.hasValue())
+      return Result<ResultSet>::err(names.status());
+    const std::vector<std::string> &list = names.value();
+    const std::optional<Predicate> pred = tagPredicate(tags, where);
+
+    // A series per morsel, each read on its own thread; series dropped
+    // since the lookup are left out
+    std::vector<std::optional<Result<ResultSet>>> parts(list.size());
+    ThreadPool::shared().parallelFor(
+        list.size(), 1, scanThreads(), [&](size_t m, size_t, size_t) {
+          auto sdp = findSeries(list[m]);
+          if (!sdp)
+            return;
+          metrics::TimedSharedLock lk(sdp->mtx);
+          const std::set<int64_t> only = tagCandidates(*sdp, tags);
+          parts[m] = querySeries(*sdp, columns, startInclusive, endExclusive,
+                                 pred, &only, 1, &list[m]);
+        });
+    return concatSeries(list, parts, columns);
+  };
+  return metrics::measure(metrics::Operation::TimeSeriesRangeQuery, run);
+}
+
+Result<ResultSet> InMemoryTimeSeriesStorage::aggregateByTags(
+    const TagFilter &tags, const std::string &valueColumn, TimeAggregation agg,
+    int64_t startInclusive, int64_t endExclusive, int64_t bucketWidth,
+    TimeGranularity bucketGranularity, const std::optional<Predicate> &where,
+    double quantile) {
+  auto run = [&]() -> Result<ResultSet> {
+    if (auto st = checkQuantile(agg, quantile); !st.ok())
+      return Result<ResultSet>::err(st);
+    auto names = findSeriesByTags(tags);
+    if (!names.hasValue())
+      return Result<ResultSet>::err(names.status());
+    const std::vector<std::string> &list = names.value();
+    const std::optional<Predicate> pred = tagPredicate(tags, where);
+
+    // Each series folds its rows into its own buckets, merged after
+    std::vector<BucketStates> partial(list.size());
+    std::vector<Status> errors(list.size());
+    std::vector<std::optional<TimeGranularity>> granularity(list.size());
+    ThreadPool::shared().parallelFor(
+        list.size(), 1, scanThreads(), [&](size_t m, size_t, size_t) {
+          auto sdp = findSeries(list[m]);
+          if (!sdp)
+            return;
+          metrics::TimedSharedLock lk(sdp->mtx);
+          granularity[m] = sdp->schema.granularity();
+          const std::set<int64_t> only = tagCandidates(*sdp, tags);
+          errors[m] = aggregateSeries(*sdp, valueColumn, agg, startInclusive,
+                                      endExclusive, bucketWidth,
+                                      bucketGranularity, pred, &only, 1,
+                                      partial[m]);
+        });
+    std::optional<TimeGranularity> shared;
+    BucketStates acc;
+    for (size_t m = 0; m < list.size(); ++m) {
+      if (!errors[m].ok())
+        return Result<ResultSet>::err(errors[m]);
+      if (!granularity[m])
+        continue;
+      if (shared && *shared != *granularity[m])
+        return Result<ResultSet>::err(Status::InvalidArgument(
+            "Series " + list[m] + " has another timestamp granularity"));
+      shared = granularity[m];
+      for (const auto &kv : partial[m])
+        acc[kv.first].merge(kv.second);
+    }
+    return Result<ResultSet>::ok(bucketResult(acc, agg, quantile));
+  };
+  return metrics::measure(metrics::Operation::TimeSeriesAggregate, run);
 }
 
 Result<ResultSet> InMemoryTimeSeriesStorage::aggregate(
     const std::string &series, const std::string &valueColumn,
     TimeAggregation agg, int64_t startInclusive, int64_t endExclusive,
     int64_t bucketWidth, TimeGranularity bucketGranularity,
-    const std::optional<Predicate> &where) {
-  std::lock_guard<std::mutex> lk(mtx_);
-  auto it = series_.find(series);
-  if (it == series_.end())
-    return Result<ResultSet>::err(
-        Status::NotFound("Unknown series: " + series));
+    const std::optional<Predicate> &where, double quantile) {
+  auto run = [&]() -> Result<ResultSet> {
+    if (auto st = checkQuantile(agg, quantile); !st.ok())
+      return Result<ResultSet>::err(st);
+    auto sdp = findSeries(series);
+    if (!sdp)
+      return Result<ResultSet>::err(
+          Status::NotFound("Unknown series: " + series));
+    metrics::TimedSharedLock lk(sdp->mtx);
+    BucketStates acc;
+    if (auto st = aggregateSeries(*sdp, valueColumn, agg, startInclusive,
+                                  endExclusive, bucketWidth, bucketGranularity,
+                                  where, nullptr, scanThreads(), acc);
+        !st.ok())
+      return Result<ResultSet>::err(st);
+    return Result<ResultSet>::ok(bucketResult(acc, agg, quantile));
+  };
+  return metrics::measure(metrics::Operation::TimeSeriesAggregate, run);
+}
 
-  const auto &sd = it->second;
+Status InMemoryTimeSeriesStorage::aggregateSeries(
+    const SeriesData &sd, const std::string &valueColumn, TimeAggregation agg,
+    int64_t startInclusive, int64_t endExclusive, int64_t bucketWidth,
+    TimeGranularity bucketGranularity, const std::optional<Predicate> &where,
+    const std::set<int64_t> *only, size_t threads, BucketStates &acc) const {
   size_t tsIdx = sd.tableSchema.findColumn(sd.schema.timestampColumn());
   if (tsIdx == TableSchema::npos)
-    return Result<ResultSet>::err(
-        Status::FailedPrecondition("Timestamp column missing from schema"));
+    return Status::FailedPrecondition("Timestamp column missing from schema");
 
   size_t valIdx = sd.tableSchema.findColumn(valueColumn);
   if (valIdx == TableSchema::npos)
-    return Result<ResultSet>::err(
-        Status::InvalidArgument("Unknown value column: " + valueColumn));
+    return Status::InvalidArgument("Unknown value column: " + valueColumn);
 
   int64_t startSec = toSeconds(startInclusive, sd.schema.granularity());
   int64_t endSec = toSeconds(endExclusive, sd.schema.granularity());
   if (endSec < startSec)
-    return Result<ResultSet>::err(
-        Status::InvalidArgument("Invalid time range: end < start"));
+    return Status::InvalidArgument("Invalid time range: end < start");
 
   int64_t widthSec = bucketWidthSeconds(bucketWidth, bucketGranularity);
   if (widthSec <= 0)
-    return Result<ResultSet>::err(
-        Status::InvalidArgument("bucketWidth must be > 0"));
-
-  struct AggState {
-    bool any = false;
-    double sum = 0.0;
-    double min = std::numeric_limits<double>::infinity();
-    double max = -std::numeric_limits<double>::infinity();
-    int64_t count = 0;
-  };
-
-  std::unordered_map<int64_t, AggState> acc;
+    return Status::InvalidArgument("bucketWidth must be > 0");
 
   int64_t firstBucket = partitionBucketStartSeconds(startSec, sd.partition);
   int64_t lastBucket = partitionBucketStartSeconds(
       (endSec <= startSec) ? startSec : (endSec - 1), sd.partition);
-  const int64_t step =
-      (sd.partition == TimePartition::Daily) ? 86400LL : 3600LL;
+  // Resolve predicate columns once for the whole range scan
+  std::optional<BoundPredicate> bound;
+  if (where)
+    bound = BoundPredicate::bind(*where, sd.tableSchema);
+
+  // Rows are in timestamp order: each partition in range is searched for
+  // its first row at startSec or later and read up to endSec
+  const TimeGranularity g = sd.schema.granularity();
+  auto before = [&](int64_t ts) { return toSeconds(ts, g) < startSec; };
+  auto after = [&](int64_t ts) { return toSeconds(ts, g) >= endSec; };
+  const bool sketch = agg == TimeAggregation::ApproxCountDistinct ||
+                      agg == TimeAggregation::ApproxPercentile;
+  auto accumulate = [&](BucketStates &into, const InlineRow &r) {
+    if (bound && !bound->matches(r))
+      return;
+
+    int64_t tsec = toSeconds(r.values()[tsIdx].asInt(), g);
+    int64_t offset = tsec - startSec;
+    int64_t bucketStart = startSec + floorDiv(offset, widthSec) * widthSec;
+
+    BucketState &st = into[bucketStart];
+    st.any = true;
+    st.count += 1;
+
+    if (agg == TimeAggregation::Count)
+      return;
+
+    const InlineValue &vv = r.values()[valIdx];
+    if (vv.empty())
+      return;
+    if (agg == TimeAggregation::ApproxCountDistinct) {
+      st.distinctSketch().add(cellHash(vv));
+      return;
+    }
+    if (!(vv.type() == ValueType::Integer || vv.type() == ValueType::Float))
+      return;
+
+    double d = (vv.type() == ValueType::Integer)
+                   ? static_cast<double>(vv.asInt())
+                   : vv.asFloat();
+    if (agg == TimeAggregation::ApproxPercentile) {
+      st.digestSketch().add(d);
+      return;
+    }
 
-  for (int64_t b = firstBucket; b <= lastBucket; b += step) {
-    auto bit = sd.buckets.find(b);
-    if (bit == sd.buckets.end())
-      continue;
+    st.sum += d;
+    if (d < st.min)
+      st.min = d;
+    if (d > st.max)
+      st.max = d;
+  };
 
-    for (const auto &r : bit->second) {
-      const Value *tv = r.values()[tsIdx].get();
-      if (!tv || tv->type() != ValueType::Integer)
-        continue;
-      int64_t ts = static_cast<const IntegerValue &>(*tv).asInt();
-      int64_t tsec = toSeconds(ts, sd.schema.granularity());
-      if (tsec < startSec || tsec >= endSec)
-        continue;
+  auto fold = [&](const TimeBucketStats &b) {
+    const int64_t offset = b.bucketStart - startSec;
+    BucketState &st = acc[startSec + floorDiv(offset, widthSec) * widthSec];
+    st.any = true;
+    st.count += b.rows;
+    st.sum += b.sum;
+    st.min = std::min(st.min, b.min);
+    st.max = std::max(st.max, b.max);
+    if (sketch && b.distinct)
+      st.distinctSketch().merge(*b.distinct);
+    if (sketch && b.digest)
+      st.digestSketch().merge(*b.digest);
+  };
+  auto tiles = [&](const Rollup &r, int64_t from) {
+    return r.valIdx == valIdx && (!sketch || r.sketches) &&
+           widthSec % r.width == 0 &&
+           from % r.width == 0 &&
+           (endSec % r.width == 0 || endSec > sd.latestSec);
+  };
 
-      if (where && !evalPredicate(sd.tableSchema, r, *where))
+  // Buckets whose rows were partly evicted come from the downsampling
+  // tiers: the finest one holding them whole, then coarser ones for older
+  // buckets. Raw rows answer from the first bucket after the newest
+  // evicted row.
+  int64_t rawStart = startSec;
+  if (!where && sd.evictedThroughSec >= startSec) {
+    const auto w = static_cast<uint64_t>(widthSec);
+    const uint64_t room = static_cast<uint64_t>(endSec) -
+                          static_cast<uint64_t>(startSec);
+    // Start of the first bucket at or after startSec + offset, or endSec
+    auto boundary = [&](uint64_t offset) {
+      const uint64_t k = (offset + w - 1) / w;
+      return k > room / w ? endSec
+                          : static_cast<int64_t>(
+                                static_cast<uint64_t>(startSec) + k * w);
+    };
+    const int64_t rawFrom = boundary(
+        static_cast<uint64_t>(sd.evictedThroughSec) -
+        static_cast<uint64_t>(startSec) + 1);
+    std::vector<const Rollup *> tiers;
+    for (const auto &r : sd.rollups)
+      if (r.tier && tiles(r, startSec))
+        tiers.push_back(&r);
+    std::sort(tiers.begin(), tiers.end(),
+              [](const Rollup *a, const Rollup *b) {
+                return a->width < b->width;
+              });
+    int64_t hi = rawFrom;
+    for (const Rollup *r : tiers) {
+      if (hi <= startSec)
+        break;
+      const int64_t lo =
+          r->retainedFrom <= startSec
+              ? startSec
+              : boundary(static_cast<uint64_t>(r->retainedFrom) -
+                         static_cast<uint64_t>(startSec));
+      if (lo >= hi)
         continue;
-
-      int64_t offset = tsec - startSec;
-      int64_t bucketStart = startSec + floorDiv(offset, widthSec) * widthSec;
-
-      AggState &st = acc[bucketStart];
+      auto buckets = rollupBuckets(sd, *r, tsIdx, lo, hi);
+      if (!buckets.hasValue())
+        return buckets.status();
+      for (const auto &b : buckets.value())
+        fold(b);
+      hi = lo;
+    }
+    if (hi < rawFrom)
+      rawStart = rawFrom;
+  }
+  if (rawStart > startSec)
+    firstBucket = partitionBucketStartSeconds(rawStart, sd.partition);
+
+  // Without a predicate, a continuous aggregate whose buckets tile the
+  // requested ones answers bucket by bucket
+  const Rollup *rollup = nullptr;
+  if (!where)
+    for (const auto &r : sd.rollups)
+      if (tiles(r, rawStart) && (!r.tier || r.retainedFrom <= rawStart) &&
+          (!rollup || r.width > rollup->width))
+        rollup = &r;
+  if (rawStart >= endSec && endSec > startSec) {
+    // The tiers answered every bucket
+  } else if (rollup) {
+    auto buckets = rollupBuckets(sd, *rollup, tsIdx, rawStart, endSec);
+    if (!buckets.hasValue())
+      return buckets.status();
+    for (const auto &b : buckets.value())
+      fold(b);
+  } else if (!where && !sketch) {
+    // Without a predicate only the timestamp and value columns are read,
+    // bucket by bucket through the SIMD kernel; partitions in parallel
+    // give their runs in time order, as a serial read does
+    std::vector<const Partition *> parts;
+    for (auto bit = sd.buckets.lower_bound(firstBucket);
+         bit != sd.buckets.end() && bit->first <= lastBucket; ++bit)
+      parts.push_back(&bit->second);
+    std::vector<std::vector<scan::BucketAggregate>> partRuns(parts.size());
+    std::vector<Status> read(parts.size());
+    ThreadPool::shared().parallelFor(
+        parts.size(), 1, threads, [&](size_t m, size_t, size_t) {
+          read[m] = parts[m]->aggregateBetween(
+              tsIdx, valIdx, g, rawStart, endSec, widthSec,
+              agg != TimeAggregation::Count, partRuns[m]);
+        });
+    for (const auto &st : read)
+      if (!st.ok())
+        return st;
+    std::vector<scan::BucketAggregate> runs;
+    for (auto &part : partRuns)
+      runs.insert(runs.end(), part.begin(), part.end());
+    for (const auto &b : runs) {
+      BucketState &st = acc[b.bucketStart];
       st.any = true;
-      st.count += 1;
-
-      if (agg == TimeAggregation::Count)
-        continue;
-
-      const Value *vv = r.values()[valIdx].get();
-      if (!vv)
-        continue;
-      if (!(vv->type() == ValueType::Integer || vv->type() == ValueType::Float))
-        continue;
-
-      double d = (vv->type() == ValueType::Integer)
-                     ? static_cast<double>(vv->asInt())
-                     : vv->asFloat();
-
-      st.sum += d;
-      if (d < st.min)
-        st.min = d;
-      if (d > st.max)
-        st.max = d;
+      st.count += b.rows;
+      st.sum += b.sum;
+      st.min = std::min(st.min, b.min);
+      st.max = std::max(st.max, b.max);
     }
+  } else if (ThreadPool::resolve(threads) > 1) {
+    // Each partition accumulates its own buckets, merged in time order
+    std::vector<const Partition *> parts;
+    for (auto bit = sd.buckets.lower_bound(firstBucket);
+         bit != sd.buckets.end() && bit->first <= lastBucket; ++bit)
+      if ((!only || only->count(bit->first)) &&
+          (!bound || bound->mayMatch(bit->second.zone)))
+        parts.push_back(&bit->second);
+    std::vector<BucketStates> partial(parts.size());
+    std::vector<Status> read(parts.size());
+    ThreadPool::shared().parallelFor(
+        parts.size(), 1, threads, [&](size_t m, size_t, size_t) {
+          read[m] = parts[m]->forEachRowBetween(
+              tsIdx, before, after,
+              [&](const InlineRow &r) { accumulate(partial[m], r); });
+        });
+    for (const auto &st : read)
+      if (!st.ok())
+        return st;
+    for (const auto &part : partial)
+      for (const auto &kv : part)
+        acc[kv.first].merge(kv.second);
+  } else {
+    for (auto bit = sd.buckets.lower_bound(firstBucket);
+         bit != sd.buckets.end() && bit->first <= lastBucket; ++bit)
+      if ((!only || only->count(bit->first)) &&
+          (!bound || bound->mayMatch(bit->second.zone)))
+        if (auto st = bit->second.forEachRowBetween(
+                tsIdx, before, after,
+                [&](const InlineRow &r) { accumulate(acc, r); });
+            !st.ok())
+          return st;
   }
+  return Status::OK();
+}
 
+ResultSet InMemoryTimeSeriesStorage::bucketResult(const BucketStates &acc,
+                                                  TimeAggregation agg,
+                                                  double quantile) {
   std::vector<int64_t> bucketStarts;
   bucketStarts.reserve(acc.size());
-  for (const auto &kv : acc)
+  size_t aggregated = 0;
+  for (const auto &kv : acc) {
     bucketStarts.push_back(kv.first);
+    aggregated += static_cast<size_t>(kv.second.count);
+  }
   std::sort(bucketStarts.begin(), bucketStarts.end());
+  metrics::OperationScope::addRows(aggregated, bucketStarts.size());
 
   std::vector<std::string> colNames = {"bucket_start", "value"};
+  const bool counted = agg == TimeAggregation::Count ||
+                       agg == TimeAggregation::ApproxCountDistinct;
   std::vector<ColumnType> colTypes = {
-      ColumnType::Integer, (agg == TimeAggregation::Count) ? ColumnType::Integer
-                                                           : ColumnType::Float};
+      ColumnType::Integer, counted ? ColumnType::Integer : ColumnType::Float};
 
   ResultSet rs(std::move(colNames), std::move(colTypes));
 
   for (int64_t bs : bucketStarts) {
-    const AggState &st = acc.at(bs);
+    const BucketState &st = acc.at(bs);
     std::vector<std::unique_ptr<Value>> row;
     row.reserve(2);
     row.push_back(ValueFactory::createInteger(bs));
@@ -495,12 +2399,21 @@ Result<ResultSet> InMemoryTimeSeriesStorage::aggregate(
       row.push_back(ValueFactory::createFloat(
           st.count > 0 ? (st.sum / static_cast<double>(st.count)) : 0.0));
       break;
+    case TimeAggregation::ApproxCountDistinct:
+      row.push_back(ValueFactory::createInteger(
+          st.distinct ? std::llround(st.distinct->estimate()) : 0));
+      break;
+    case TimeAggregation::ApproxPercentile:
+      row.push_back(ValueFactory::createFloat(
+          st.digest && !st.digest->empty() ? st.digest->quantile(quantile)
+                                           : 0.0));
+      break;
     }
 
     rs.addRow(ResultRow(std::move(row)));
   }
 
-  return Result<ResultSet>::ok(std::move(rs));
+  return rs;
 }
 
 } // namespace kadedb
@@ -0,0 +1,95 @@
+#include "kadedb/timeseries/window.h"
+
+#include <cmath>
+
+namespace kadedb {
+
+const char *timeWindowFunctionName(TimeWindowFunction fn) {
+  switch (fn) {
+  case TimeWindowFunction::MovingAvg:
+    return "MOVING_AVG";
+  case TimeWindowFunction::Rate:
+    return "RATE";
+  case TimeWindowFunction::Delta:
+    return "DELTA";
+  case TimeWindowFunction::Ewma:
+    return "EWMA";
+  }
+  return "";
+}
+
+std::optional<TimeWindowFunction>
+parseTimeWindowFunction(const std::string &upperName) {
+  for (auto fn : {TimeWindowFunction::MovingAvg, TimeWindowFunction::Rate,
+                  TimeWindowFunction::Delta, TimeWindowFunction::Ewma})
+    if (upperName == timeWindowFunctionName(fn))
+      return fn;
+  return std::nullopt;
+}
+
+double timeUnitSeconds(TimeGranularity g) {
+  switch (g) {
+  case TimeGranularity::Nanoseconds:
+    return 1e-9;
+  case TimeGranularity::Microseconds:
+    return 1e-6;
+  case TimeGranularity::Milliseconds:
+    return 1e-3;
+  case TimeGranularity::Seconds:
+    return 1.0;
+  case TimeGranularity::Minutes:
+    return 60.0;
+  case TimeGranularity::Hours:
+    return 3600.0;
+  case TimeGranularity::Days:
+    return 86400.0;
+  }
+  return 1.0;
+}
+
+TimeWindow::TimeWindow(TimeWindowFunction fn, int64_t width,
+                       double unitSeconds)
+    : fn_(fn), width_(width), unitSeconds_(unitSeconds) {}
+
+std::optional<double> TimeWindow::add(int64_t ts, double value) {
+  if (fn_ == TimeWindowFunction::Ewma) {
+    if (!ewma_) {
+      ewma_ = value;
+    } else {
+      const double dt = static_cast<double>(ts - lastTs_);
+      const double alpha = -std::expm1(-dt / static_cast<double>(width_));
+      *ewma_ += alpha * (value - *ewma_);
+    }
+    lastTs_ = ts;
+    return ewma_;
+  }
+
+  // Samples at or before ts - width have left the window
+  while (!samples_.empty() && samples_.front().first <= ts - width_) {
+    sum_ -= samples_.front().second;
+    samples_.pop_front();
+  }
+  if (samples_.empty())
+    sum_ = 0.0; // drop rounding error left by the evictions
+  samples_.emplace_back(ts, value);
+  sum_ += value;
+
+  switch (fn_) {
+  case TimeWindowFunction::MovingAvg:
+    return sum_ / static_cast<double>(samples_.size());
+  case TimeWindowFunction::Delta:
+  case TimeWindowFunction::Rate: {
+    const auto &oldest = samples_.front();
+    if (samples_.size() < 2 || oldest.first == ts)
+      return std::nullopt;
+    const double delta = value - oldest.second;
+    if (fn_ == TimeWindowFunction::Delta)
+      return delta;
+    return delta / (static_cast<double>(ts - oldest.first) * unitSeconds_);
+  }
+  default:
+    return std::nullopt;
+  }
+}
+
+} // namespace kadedb
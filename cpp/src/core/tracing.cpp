@@ -0,0 +1,187 @@
+#include "kadedb/tracing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <random>
+
+namespace kadedb {
+namespace tracing {
+
+namespace {
+
+std::atomic<bool> g_active{false};
+std::mutex g_exporterMtx;
+std::shared_ptr<const Exporter> g_exporter;
+// Sampled when a draw of 64 random bits is below it
+std::atomic<uint64_t> g_sampleBelow{~uint64_t{0}};
+std::atomic<double> g_sampleRatio{1.0};
+
+thread_local SpanContext t_current;
+
+// xorshift64*, seeded per thread
+uint64_t nextRandom() {
+  thread_local uint64_t state = [] {
+    std::random_device rd;
+    uint64_t s = (uint64_t{rd()} << 32) ^ rd();
+    return s ? s : 0x9e3779b97f4a7c15ull;
+  }();
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 0x2545f4914f6cdd1dull;
+}
+
+uint64_t nextId() {
+  uint64_t id;
+  while ((id = nextRandom()) == 0) {
+  }
+  return id;
+}
+
+bool parseHex(const std::string &s, size_t pos, size_t len, uint64_t &out) {
+  out = 0;
+  for (size_t i = pos; i < pos + len; ++i) {
+    const char c = s[i];
+    uint64_t d;
+    if (c >= '0' && c <= '9')
+      d = static_cast<uint64_t>(c - '0');
+    else if (c >= 'a' && c <= 'f')
+      d = static_cast<uint64_t>(c - 'a' + 10);
+    else
+      return false;
+    out = out << 4 | d;
+  }
+  return true;
+}
+
+} // namespace
+
+std::optional<SpanContext> parseTraceparent(const std::string &text) {
+  // 2 + 1 + 32 + 1 + 16 + 1 + 2
+  if (text.size() != 55 || text[2] != '-' || text[35] != '-' ||
+      text[52] != '-')
+    return std::nullopt;
+  uint64_t version, flags;
+  SpanContext ctx;
+  if (!parseHex(text, 0, 2, version) || version != 0 ||
+      !parseHex(text, 3, 16, ctx.traceIdHigh) ||
+      !parseHex(text, 19, 16, ctx.traceIdLow) ||
+      !parseHex(text, 36, 16, ctx.spanId) || !parseHex(text, 53, 2, flags))
+    return std::nullopt;
+  if (!ctx.valid())
+    return std::nullopt;
+  ctx.sampled = (flags & 1) != 0;
+  return ctx;
+}
+
+std::string formatTraceparent(const SpanContext &ctx) {
+  char buf[56];
+  std::snprintf(buf, sizeof(buf), "00-%016llx%016llx-%016llx-%02x",
+                static_cast<unsigned long long>(ctx.traceIdHigh),
+                static_cast<unsigned long long>(ctx.traceIdLow),
+                static_cast<unsigned long long>(ctx.spanId),
+                ctx.sampled ? 1u : 0u);
+  return buf;
+}
+
+void setExporter(Exporter exporter) {
+  std::shared_ptr<const Exporter> next;
+  if (exporter)
+    next = std::make_shared<const Exporter>(std::move(exporter));
+  std::lock_guard lk(g_exporterMtx);
+  g_exporter = std::move(next);
+  g_active.store(g_exporter != nullptr, std::memory_order_relaxed);
+}
+
+bool active() { return g_active.load(std::memory_order_relaxed); }
+
+void setSampleRatio(double ratio) {
+  ratio = std::clamp(ratio, 0.0, 1.0);
+  g_sampleRatio.store(ratio, std::memory_order_relaxed);
+  // 2^64 * ratio, saturating at 1
+  g_sampleBelow.store(ratio >= 1.0 ? ~uint64_t{0}
+                                   : static_cast<uint64_t>(ratio * 0x1p64),
+                      std::memory_order_relaxed);
+}
+
+double sampleRatio() { return g_sampleRatio.load(std::memory_order_relaxed); }
+
+SpanContext current() { return t_current; }
+
+void setCurrent(const SpanContext &ctx) { t_current = ctx; }
+
+ContextScope::ContextScope(const SpanContext &parent) : saved_(t_current) {
+  t_current = parent;
+}
+
+ContextScope::~ContextScope() { t_current = saved_; }
+
+void Span::begin(const char *name, Mode mode) {
+  engaged_ = true;
+  nested_ = mode == Mode::Nested;
+  saved_ = t_current;
+  if (saved_.valid()) {
+    self_.traceIdHigh = saved_.traceIdHigh;
+    self_.traceIdLow = saved_.traceIdLow;
+    self_.sampled = saved_.sampled;
+  } else {
+    self_.traceIdHigh = nextRandom();
+    self_.traceIdLow = nextId();
+    const uint64_t below = g_sampleBelow.load(std::memory_order_relaxed);
+    self_.sampled = below == ~uint64_t{0} || nextRandom() < below;
+  }
+  self_.spanId = nextId();
+  if (nested_)
+    t_current = self_;
+  if (!self_.sampled)
+    return;
+  record_ = std::make_unique<SpanRecord>();
+  record_->context = self_;
+  record_->parentSpanId = saved_.valid() ? saved_.spanId : 0;
+  record_->name = name;
+  record_->startUnixNs =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count();
+  start_ = std::chrono::steady_clock::now();
+}
+
+void Span::end() {
+  if (nested_)
+    t_current = saved_;
+  if (!record_)
+    return;
+  record_->durationNs = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start_)
+          .count());
+  std::shared_ptr<const Exporter> exporter;
+  {
+    std::lock_guard lk(g_exporterMtx);
+    exporter = g_exporter;
+  }
+  if (!exporter)
+    return;
+  // Exceptions from the exporter must not escape a destructor
+  try {
+    (*exporter)(*record_);
+  } catch (...) {
+  }
+}
+
+void Span::setAttribute(const char *key, std::string value) {
+  if (record_)
+    record_->attributes.emplace_back(key, std::move(value));
+}
+
+void Span::setAttribute(const char *key, int64_t value) {
+  if (record_)
+    record_->attributes.emplace_back(key, std::to_string(value));
+}
+
+SpanContext Span::context() const { return engaged_ ? self_ : SpanContext{}; }
+
+} // namespace tracing
+} // namespace kadedb
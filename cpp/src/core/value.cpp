@@ -1,56 +1,44 @@
 #include "kadedb/value.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstddef>
+#include <cstring>
 #include <iomanip>
+#include <mutex>
 #include <new>
 #include <sstream>
+#include <vector>
 
 namespace kadedb {
 
 #if defined(KADEDB_MEM_DEBUG) || defined(KADEDB_ENABLE_SMALL_OBJECT_POOL)
 namespace {
-struct FreeNode {
-  FreeNode *next;
-};
-
-// Tiny freelists per type (not thread-safe; intended for debug/micro perf
-// experiments)
-static FreeNode *g_pool_int = nullptr;
-static FreeNode *g_pool_bool = nullptr;
-static FreeNode *g_pool_null = nullptr;
-
-// Counters
-static size_t g_alloc_int = 0, g_free_int = 0;
-static size_t g_alloc_bool = 0, g_free_bool = 0;
-static size_t g_alloc_null = 0, g_free_null = 0;
+// Counters, bumped from any thread
+std::atomic<size_t> g_alloc_int{0}, g_free_int{0};
+std::atomic<size_t> g_alloc_float{0}, g_free_float{0};
+std::atomic<size_t> g_alloc_string{0}, g_free_string{0};
+std::atomic<size_t> g_alloc_bool{0}, g_free_bool{0};
+std::atomic<size_t> g_alloc_null{0}, g_free_null{0};
 
-inline void *pool_alloc(FreeNode *&head, std::size_t sz, size_t &allocCounter) {
-  ++allocCounter;
-#ifdef KADEDB_ENABLE_SMALL_OBJECT_POOL
-  if (head) {
-    void *p = head;
-    head = head->next;
-    return p;
-  }
-#endif
-  return ::operator new(sz);
+inline void *counted_alloc(std::size_t sz, std::atomic<size_t> &allocCounter) {
+  allocCounter.fetch_add(1, std::memory_order_relaxed);
+  return ValueArena::allocate(sz);
 }
-inline void pool_free(FreeNode *&head, void *p, size_t &freeCounter) noexcept {
-  ++freeCounter;
-#ifdef KADEDB_ENABLE_SMALL_OBJECT_POOL
-  auto *node = static_cast<FreeNode *>(p);
-  node->next = head;
-  head = node;
-  return;
-#endif
-  ::operator delete(p);
+inline void counted_free(void *p, std::atomic<size_t> &freeCounter) noexcept {
+  freeCounter.fetch_add(1, std::memory_order_relaxed);
+  ValueArena::release(p);
 }
 } // namespace
 
 namespace memdebug {
 size_t allocCountInteger() { return g_alloc_int; }
 size_t freeCountInteger() { return g_free_int; }
+size_t allocCountFloat() { return g_alloc_float; }
+size_t freeCountFloat() { return g_free_float; }
+size_t allocCountString() { return g_alloc_string; }
+size_t freeCountString() { return g_free_string; }
 size_t allocCountBoolean() { return g_alloc_bool; }
 size_t freeCountBoolean() { return g_free_bool; }
 size_t allocCountNull() { return g_alloc_null; }
@@ -58,6 +46,236 @@ size_t freeCountNull() { return g_free_null; }
 } // namespace memdebug
 #endif
 
+// ----- ValueArena -----
+//
+// Every Value is preceded by a header word naming where its block came
+// from: zero for the heap, an arena chunk, or (low bit set) a slab pool and
+// size class. A chunk starts with its count of live Values, biased by
+// kOpenBias while a scope still carves from it so that allocation needs no
+// atomic: the scope settles the bias when it moves on, and whoever brings
+// the count to zero frees the chunk.
+namespace {
+struct ArenaChunk {
+  std::atomic<size_t> live;
+};
+
+constexpr size_t kHeaderBytes = sizeof(uintptr_t);
+constexpr size_t kOpenBias = size_t(1) << (sizeof(size_t) * 8 - 2);
+// Chunks grow from small (short queries, values a cache keeps) to large
+constexpr size_t kFirstChunkBytes = 4 * 1024;
+constexpr size_t kMaxChunkBytes = 64 * 1024;
+
+static_assert(alignof(StringValue) <= kHeaderBytes &&
+                  alignof(IntegerValue) <= kHeaderBytes &&
+                  alignof(FloatValue) <= kHeaderBytes,
+              "Value alignment exceeds the arena header");
+
+thread_local ValueArena::Scope *t_scope = nullptr;
+thread_local uint64_t t_bytesAllocated = 0;
+thread_local uint64_t t_allocations = 0;
+
+inline size_t roundUp(size_t n) {
+  return (n + kHeaderBytes - 1) & ~(kHeaderBytes - 1);
+}
+
+inline uintptr_t &headerOf(char *block) {
+  return *reinterpret_cast<uintptr_t *>(block);
+}
+
+inline void dropLive(ArenaChunk *chunk, size_t n) noexcept {
+  if (chunk->live.fetch_sub(n, std::memory_order_acq_rel) == n) {
+    chunk->~ArenaChunk();
+    ::operator delete(chunk);
+  }
+}
+
+#ifdef KADEDB_ENABLE_SMALL_OBJECT_POOL
+// Blocks are 8-byte multiples up to 64 bytes (header included), carved
+// from 64 KiB slabs. The owning thread pushes and pops its free lists
+// without synchronization; other threads push onto the remote lists, which
+// the owner takes over whole once a local list runs dry. Pools are never
+// freed: when a thread exits, its pool waits for the next thread to adopt
+// it, so blocks freed late still land somewhere and memory is reused.
+constexpr size_t kPoolClasses = 8;
+constexpr size_t kSlabBytes = 64 * 1024;
+constexpr uintptr_t kPoolTag = 1;
+
+struct FreeBlock {
+  FreeBlock *next;
+};
+
+struct alignas(64) ValuePool {
+  ValuePool() {
+    for (auto &r : remote)
+      r.store(nullptr, std::memory_order_relaxed);
+  }
+
+  FreeBlock *local[kPoolClasses] = {};
+  char *next[kPoolClasses] = {};
+  char *end[kPoolClasses] = {};
+  std::atomic<FreeBlock *> remote[kPoolClasses];
+};
+
+struct IdlePools {
+  std::mutex mtx;
+  std::vector<ValuePool *> pools;
+};
+
+IdlePools &idlePools() {
+  static auto *idle = new IdlePools; // outlives every thread's exit
+  return *idle;
+}
+
+thread_local ValuePool *t_pool = nullptr;
+thread_local bool t_poolClosed = false;
+
+// The calling thread's pool, or null once the thread is exiting
+ValuePool *threadPool() {
+  if (t_pool || t_poolClosed)
+    return t_pool;
+  struct Owner {
+    ValuePool *pool;
+    Owner() {
+      auto &idle = idlePools();
+      std::lock_guard<std::mutex> lk(idle.mtx);
+      if (idle.pools.empty()) {
+        pool = new ValuePool;
+      } else {
+        pool = idle.pools.back();
+        idle.pools.pop_back();
+      }
+    }
+    ~Owner() {
+      t_pool = nullptr;
+      t_poolClosed = true;
+      auto &idle = idlePools();
+      std::lock_guard<std::mutex> lk(idle.mtx);
+      idle.pools.push_back(pool);
+    }
+  };
+  thread_local Owner owner;
+  t_pool = owner.pool;
+  return t_pool;
+}
+
+char *poolAllocate(ValuePool &pool, size_t cls, size_t need) {
+  FreeBlock *b = pool.local[cls];
+  if (!b)
+    b = pool.remote[cls].exchange(nullptr, std::memory_order_acquire);
+  if (b) {
+    pool.local[cls] = b->next;
+    return reinterpret_cast<char *>(b);
+  }
+  if (static_cast<size_t>(pool.end[cls] - pool.next[cls]) < need) {
+    pool.next[cls] = static_cast<char *>(::operator new(kSlabBytes));
+    pool.end[cls] = pool.next[cls] + kSlabBytes;
+  }
+  char *p = pool.next[cls];
+  pool.next[cls] += need;
+  return p;
+}
+
+void poolRelease(ValuePool &pool, size_t cls, char *block) noexcept {
+  auto *b = reinterpret_cast<FreeBlock *>(block);
+  if (&pool == t_pool) {
+    b->next = pool.local[cls];
+    pool.local[cls] = b;
+    return;
+  }
+  FreeBlock *head = pool.remote[cls].load(std::memory_order_relaxed);
+  do {
+    b->next = head;
+  } while (!pool.remote[cls].compare_exchange_weak(
+      head, b, std::memory_order_release, std::memory_order_relaxed));
+}
+#endif
+} // namespace
+
+ValueArena::Scope::Scope() {
+  if (t_scope)
+    return;
+  owner_ = true;
+  chunkBytes_ = kFirstChunkBytes;
+  t_scope = this;
+}
+
+ValueArena::Scope::~Scope() {
+  if (!owner_)
+    return;
+  retire();
+  t_scope = nullptr;
+}
+
+void ValueArena::Scope::retire() noexcept {
+  if (chunk_)
+    dropLive(static_cast<ArenaChunk *>(chunk_), kOpenBias - carved_);
+  chunk_ = nullptr;
+  next_ = end_ = nullptr;
+  carved_ = 0;
+}
+
+void *ValueArena::allocate(std::size_t size) {
+  const size_t need = kHeaderBytes + roundUp(size);
+  t_bytesAllocated += need;
+  ++t_allocations;
+  Scope *s = t_scope;
+  char *p;
+  if (!s) {
+#ifdef KADEDB_ENABLE_SMALL_OBJECT_POOL
+    const size_t cls = need / kHeaderBytes - 1;
+    if (cls < kPoolClasses) {
+      if (ValuePool *pool = threadPool()) {
+        p = poolAllocate(*pool, cls, need);
+        headerOf(p) = reinterpret_cast<uintptr_t>(pool) | cls << 1 | kPoolTag;
+        return p + kHeaderBytes;
+      }
+    }
+#endif
+    p = static_cast<char *>(::operator new(need));
+    headerOf(p) = 0;
+    return p + kHeaderBytes;
+  }
+  if (static_cast<size_t>(s->end_ - s->next_) < need) {
+    const size_t bytes =
+        std::max(s->chunkBytes_, roundUp(sizeof(ArenaChunk)) + need);
+    char *block = static_cast<char *>(::operator new(bytes));
+    s->retire();
+    s->chunk_ = new (block) ArenaChunk{{kOpenBias}};
+    s->next_ = block + roundUp(sizeof(ArenaChunk));
+    s->end_ = block + bytes;
+    s->chunkBytes_ = std::min(s->chunkBytes_ * 2, kMaxChunkBytes);
+  }
+  p = s->next_;
+  s->next_ += need;
+  ++s->carved_;
+  headerOf(p) = reinterpret_cast<uintptr_t>(s->chunk_);
+  return p + kHeaderBytes;
+}
+
+void ValueArena::release(void *p) noexcept {
+  if (!p)
+    return;
+  char *block = static_cast<char *>(p) - kHeaderBytes;
+  const uintptr_t header = headerOf(block);
+#ifdef KADEDB_ENABLE_SMALL_OBJECT_POOL
+  if (header & kPoolTag) {
+    auto *pool = reinterpret_cast<ValuePool *>(header & ~uintptr_t(63));
+    poolRelease(*pool, (header >> 1) & (kPoolClasses - 1), block);
+    return;
+  }
+#endif
+  if (header)
+    dropLive(reinterpret_cast<ArenaChunk *>(header), 1);
+  else
+    ::operator delete(block);
+}
+
+bool ValueArena::active() { return t_scope != nullptr; }
+
+uint64_t ValueArena::threadBytesAllocated() { return t_bytesAllocated; }
+
+uint64_t ValueArena::threadAllocations() { return t_allocations; }
+
 // ----- IntegerValue -----
 bool IntegerValue::equals(const Value &other) const {
   if (other.type() == ValueType::Integer) {
@@ -90,10 +308,10 @@ int IntegerValue::compare(const Value &other) const {
 // Custom allocators (optional)
 #if defined(KADEDB_MEM_DEBUG) || defined(KADEDB_ENABLE_SMALL_OBJECT_POOL)
 void *IntegerValue::operator new(std::size_t sz) {
-  return pool_alloc(g_pool_int, sz, g_alloc_int);
+  return counted_alloc(sz, g_alloc_int);
 }
 void IntegerValue::operator delete(void *p) noexcept {
-  pool_free(g_pool_int, p, g_free_int);
+  counted_free(p, g_free_int);
 }
 #endif
 
@@ -129,6 +347,15 @@ std::string FloatValue::toString() const {
   return oss.str();
 }
 
+#if defined(KADEDB_MEM_DEBUG) || defined(KADEDB_ENABLE_SMALL_OBJECT_POOL)
+void *FloatValue::operator new(std::size_t sz) {
+  return counted_alloc(sz, g_alloc_float);
+}
+void FloatValue::operator delete(void *p) noexcept {
+  counted_free(p, g_free_float);
+}
+#endif
+
 // ----- StringValue -----
 bool StringValue::equals(const Value &other) const {
   if (other.type() != ValueType::String)
@@ -150,6 +377,15 @@ int StringValue::compare(const Value &other) const {
   return static_cast<int>(type()) - static_cast<int>(other.type());
 }
 
+#if defined(KADEDB_MEM_DEBUG) || defined(KADEDB_ENABLE_SMALL_OBJECT_POOL)
+void *StringValue::operator new(std::size_t sz) {
+  return counted_alloc(sz, g_alloc_string);
+}
+void StringValue::operator delete(void *p) noexcept {
+  counted_free(p, g_free_string);
+}
+#endif
+
 // ----- BooleanValue -----
 bool BooleanValue::equals(const Value &other) const {
   if (other.type() == ValueType::Boolean) {
@@ -171,10 +407,10 @@ int BooleanValue::compare(const Value &other) const {
 // Custom allocators (optional)
 #if defined(KADEDB_MEM_DEBUG) || defined(KADEDB_ENABLE_SMALL_OBJECT_POOL)
 void *BooleanValue::operator new(std::size_t sz) {
-  return pool_alloc(g_pool_bool, sz, g_alloc_bool);
+  return counted_alloc(sz, g_alloc_bool);
 }
 void BooleanValue::operator delete(void *p) noexcept {
-  pool_free(g_pool_bool, p, g_free_bool);
+  counted_free(p, g_free_bool);
 }
 #endif
 
@@ -195,13 +431,348 @@ std::unique_ptr<Value> ValueFactory::createBoolean(bool v) {
   return std::make_unique<BooleanValue>(v);
 }
 
+// ----- InlineValue -----
+InlineValue::InlineValue(const InlineValue &other) : len_(0), tag_(kEmptyTag) {
+  copyFrom(other);
+}
+
+InlineValue::InlineValue(InlineValue &&other) noexcept
+    : len_(other.len_), tag_(other.tag_) {
+  std::memcpy(buf_, other.buf_, sizeof(buf_));
+  other.len_ = 0;
+  other.tag_ = kEmptyTag;
+}
+
+InlineValue &InlineValue::operator=(const InlineValue &other) {
+  if (this != &other) {
+    reset();
+    copyFrom(other);
+  }
+  return *this;
+}
+
+InlineValue &InlineValue::operator=(InlineValue &&other) noexcept {
+  if (this != &other) {
+    reset();
+    std::memcpy(buf_, other.buf_, sizeof(buf_));
+    len_ = other.len_;
+    tag_ = other.tag_;
+    other.len_ = 0;
+    other.tag_ = kEmptyTag;
+  }
+  return *this;
+}
+
+void InlineValue::reset() noexcept {
+  if (tag_ == static_cast<uint8_t>(ValueType::String) && len_ == kHeapLen)
+    ::operator delete(heapPtr());
+  len_ = 0;
+  tag_ = kEmptyTag;
+}
+
+void InlineValue::copyFrom(const InlineValue &other) {
+  if (other.tag_ == static_cast<uint8_t>(ValueType::String) &&
+      other.len_ == kHeapLen) {
+    *this = string(other.stringData(), other.stringSize());
+    return;
+  }
+  std::memcpy(buf_, other.buf_, sizeof(buf_));
+  len_ = other.len_;
+  tag_ = other.tag_;
+}
+
+char *InlineValue::heapPtr() const {
+  char *p = nullptr;
+  std::memcpy(&p, buf_, sizeof(p));
+  return p;
+}
+
+size_t InlineValue::heapSize() const {
+  size_t n = 0;
+  std::memcpy(&n, heapPtr(), sizeof(n));
+  return n;
+}
+
+InlineValue InlineValue::null() {
+  InlineValue v;
+  v.tag_ = static_cast<uint8_t>(ValueType::Null);
+  return v;
+}
+
+InlineValue InlineValue::integer(int64_t x) {
+  InlineValue v;
+  std::memcpy(v.buf_, &x, sizeof(x));
+  v.tag_ = static_cast<uint8_t>(ValueType::Integer);
+  return v;
+}
+
+InlineValue InlineValue::floating(double x) {
+  InlineValue v;
+  std::memcpy(v.buf_, &x, sizeof(x));
+  v.tag_ = static_cast<uint8_t>(ValueType::Float);
+  return v;
+}
+
+InlineValue InlineValue::boolean(bool x) {
+  InlineValue v;
+  v.buf_[0] = x ? 1 : 0;
+  v.tag_ = static_cast<uint8_t>(ValueType::Boolean);
+  return v;
+}
+
+InlineValue InlineValue::string(const char *data, size_t len) {
+  InlineValue v;
+  if (len <= kInlineCapacity) {
+    if (len)
+      std::memcpy(v.buf_, data, len);
+    v.len_ = static_cast<uint8_t>(len);
+  } else {
+    // Heap block: [size_t length][chars]
+    char *block = static_cast<char *>(::operator new(sizeof(size_t) + len));
+    std::memcpy(block, &len, sizeof(len));
+    std::memcpy(block + sizeof(size_t), data, len);
+    std::memcpy(v.buf_, &block, sizeof(block));
+    v.len_ = kHeapLen;
+  }
+  v.tag_ = static_cast<uint8_t>(ValueType::String);
+  return v;
+}
+
+InlineValue InlineValue::fromValue(const Value *v) {
+  if (!v)
+    return InlineValue();
+  switch (v->type()) {
+  case ValueType::Null:
+    return null();
+  case ValueType::Integer:
+    return integer(static_cast<const IntegerValue &>(*v).value());
+  case ValueType::Float:
+    return floating(static_cast<const FloatValue &>(*v).value());
+  case ValueType::String: {
+    const auto &s = static_cast<const StringValue &>(*v).asString();
+    return string(s.data(), s.size());
+  }
+  case ValueType::Boolean:
+    return boolean(static_cast<const BooleanValue &>(*v).value());
+  }
+  return InlineValue();
+}
+
+std::unique_ptr<Value> InlineValue::toValue() const {
+  if (empty())
+    return nullptr;
+  switch (type()) {
+  case ValueType::Null:
+    return ValueFactory::createNull();
+  case ValueType::Integer:
+    return ValueFactory::createInteger(asInt());
+  case ValueType::Float:
+    return ValueFactory::createFloat(asFloat());
+  case ValueType::String:
+    return ValueFactory::createString(asString());
+  case ValueType::Boolean:
+    return ValueFactory::createBoolean(asBool());
+  }
+  return nullptr;
+}
+
+int64_t InlineValue::asInt() const {
+  if (tag_ == static_cast<uint8_t>(ValueType::Integer)) {
+    int64_t x;
+    std::memcpy(&x, buf_, sizeof(x));
+    return x;
+  }
+  if (tag_ == static_cast<uint8_t>(ValueType::Boolean))
+    return buf_[0] ? 1 : 0;
+  throw std::runtime_error("Value not convertible to int");
+}
+
+double InlineValue::asFloat() const {
+  if (tag_ == static_cast<uint8_t>(ValueType::Float)) {
+    double x;
+    std::memcpy(&x, buf_, sizeof(x));
+    return x;
+  }
+  if (tag_ == static_cast<uint8_t>(ValueType::Integer))
+    return static_cast<double>(asInt());
+  if (tag_ == static_cast<uint8_t>(ValueType::Boolean))
+    return buf_[0] ? 1.0 : 0.0;
+  throw std::runtime_error("Value not convertible to float");
+}
+
+bool InlineValue::asBool() const {
+  switch (tag_) {
+  case static_cast<uint8_t>(ValueType::Integer):
+    return asInt() != 0;
+  case static_cast<uint8_t>(ValueType::Float):
+    return asFloat() != 0.0;
+  case static_cast<uint8_t>(ValueType::String):
+    return stringSize() != 0;
+  case static_cast<uint8_t>(ValueType::Boolean):
+    return buf_[0] != 0;
+  default:
+    throw std::runtime_error("Value not convertible to bool");
+  }
+}
+
+const char *InlineValue::stringData() const {
+  if (tag_ != static_cast<uint8_t>(ValueType::String))
+    throw std::runtime_error("Value not convertible to string");
+  if (len_ == kHeapLen)
+    return heapPtr() + sizeof(size_t);
+  return reinterpret_cast<const char *>(buf_);
+}
+
+size_t InlineValue::stringSize() const {
+  if (tag_ != static_cast<uint8_t>(ValueType::String))
+    throw std::runtime_error("Value not convertible to string");
+  return len_ == kHeapLen ? heapSize() : len_;
+}
+
+namespace {
+inline int compareBytes(const char *a, size_t an, const char *b, size_t bn) {
+  int c = std::char_traits<char>::compare(a, b, an < bn ? an : bn);
+  if (c != 0)
+    return c < 0 ? -1 : 1;
+  if (an < bn)
+    return -1;
+  if (an > bn)
+    return 1;
+  return 0;
+}
+} // namespace
+
+bool InlineValue::equals(const InlineValue &other) const {
+  if (empty() || other.empty())
+    return empty() && other.empty();
+  switch (type()) {
+  case ValueType::Null:
+    return other.type() == ValueType::Null;
+  case ValueType::Integer:
+    if (other.type() == ValueType::Integer)
+      return asInt() == other.asInt();
+    if (other.type() == ValueType::Float)
+      return static_cast<double>(asInt()) == other.asFloat();
+    return false;
+  case ValueType::Float:
+    if (other.type() == ValueType::Float ||
+        other.type() == ValueType::Integer)
+      return asFloat() == other.asFloat();
+    return false;
+  case ValueType::String:
+    return other.type() == ValueType::String &&
+           compareBytes(stringData(), stringSize(), other.stringData(),
+                        other.stringSize()) == 0;
+  case ValueType::Boolean:
+    return other.type() == ValueType::Boolean && asBool() == other.asBool();
+  }
+  return false;
+}
+
+int InlineValue::compare(const InlineValue &other) const {
+  if (empty() || other.empty())
+    throw std::runtime_error("InlineValue::compare on empty value");
+  switch (type()) {
+  case ValueType::Null:
+    return other.type() == ValueType::Null ? 0 : -1;
+  case ValueType::Integer:
+    if (other.type() == ValueType::Integer) {
+      int64_t a = asInt(), b = other.asInt();
+      return a < b ? -1 : (a > b ? 1 : 0);
+    }
+    if (other.type() == ValueType::Float)
+      return compareNumeric(static_cast<double>(asInt()), other.asFloat());
+    break;
+  case ValueType::Float:
+    if (other.type() == ValueType::Float ||
+        other.type() == ValueType::Integer)
+      return compareNumeric(asFloat(), other.asFloat());
+    break;
+  case ValueType::String:
+    if (other.type() == ValueType::String)
+      return compareBytes(stringData(), stringSize(), other.stringData(),
+                          other.stringSize());
+    break;
+  case ValueType::Boolean:
+    if (other.type() == ValueType::Boolean) {
+      bool a = asBool(), b = other.asBool();
+      return a == b ? 0 : (a ? 1 : -1);
+    }
+    break;
+  }
+  // Define ordering by ValueType for non-numeric comparisons
+  return static_cast<int>(type()) - static_cast<int>(other.type());
+}
+
+int InlineValue::compare(const Value &other) const {
+  if (empty())
+    throw std::runtime_error("InlineValue::compare on empty value");
+  ValueType ot = other.type();
+  switch (type()) {
+  case ValueType::Null:
+    return ot == ValueType::Null ? 0 : -1;
+  case ValueType::Integer:
+    if (ot == ValueType::Integer) {
+      int64_t a = asInt();
+      int64_t b = static_cast<const IntegerValue &>(other).value();
+      return a < b ? -1 : (a > b ? 1 : 0);
+    }
+    if (ot == ValueType::Float)
+      return compareNumeric(static_cast<double>(asInt()),
+                            static_cast<const FloatValue &>(other).value());
+    break;
+  case ValueType::Float:
+    if (ot == ValueType::Float || ot == ValueType::Integer)
+      return compareNumeric(asFloat(), other.asFloat());
+    break;
+  case ValueType::String:
+    if (ot == ValueType::String) {
+      const auto &s = static_cast<const StringValue &>(other).asString();
+      return compareBytes(stringData(), stringSize(), s.data(), s.size());
+    }
+    break;
+  case ValueType::Boolean:
+    if (ot == ValueType::Boolean) {
+      bool a = asBool();
+      bool b = static_cast<const BooleanValue &>(other).value();
+      return a == b ? 0 : (a ? 1 : -1);
+    }
+    break;
+  }
+  return static_cast<int>(type()) - static_cast<int>(ot);
+}
+
+std::string InlineValue::toString() const {
+  if (empty())
+    return std::string();
+  switch (type()) {
+  case ValueType::Null:
+    return "null";
+  case ValueType::Integer:
+    return std::to_string(asInt());
+  case ValueType::Float:
+    return FloatValue(asFloat()).toString();
+  case ValueType::String: {
+    std::string out;
+    out.reserve(stringSize() + 2);
+    out.push_back('"');
+    out.append(stringData(), stringSize());
+    out.push_back('"');
+    return out;
+  }
+  case ValueType::Boolean:
+    return asBool() ? "true" : "false";
+  }
+  return std::string();
+}
+
 // ----- NullValue custom allocator -----
 #if defined(KADEDB_MEM_DEBUG) || defined(KADEDB_ENABLE_SMALL_OBJECT_POOL)
 void *NullValue::operator new(std::size_t sz) {
-  return pool_alloc(g_pool_null, sz, g_alloc_null);
+  return counted_alloc(sz, g_alloc_null);
 }
 void NullValue::operator delete(void *p) noexcept {
-  pool_free(g_pool_null, p, g_free_null);
+  counted_free(p, g_free_null);
 }
 #endif
 
@@ -0,0 +1,1580 @@
+#include "kadedb/wal.h"
+
+#include "kadedb/file_io.h"
+#include "kadedb/serialization.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace kadedb {
+namespace {
+
+// ---- File I/O --------------------------------------------------------------
+
+#ifdef _WIN32
+int openFile(const std::string &path) {
+  return ::_open(path.c_str(), _O_RDWR | _O_CREAT | _O_BINARY,
+                 _S_IREAD | _S_IWRITE);
+}
+int openForRead(const std::string &path) {
+  return ::_open(path.c_str(), _O_RDONLY | _O_BINARY);
+}
+int readSome(int fd, char *buf, size_t n) {
+  return ::_read(fd, buf, static_cast<unsigned>(n));
+}
+int writeSome(int fd, const char *buf, size_t n) {
+  return ::_write(fd, buf, static_cast<unsigned>(n));
+}
+bool seekTo(int fd, uint64_t off) {
+  return ::_lseeki64(fd, static_cast<__int64>(off), SEEK_SET) >= 0;
+}
+bool truncateTo(int fd, uint64_t size) {
+  return ::_chsize_s(fd, static_cast<__int64>(size)) == 0;
+}
+bool syncFile(int fd) { return ::_commit(fd) == 0; }
+void closeFile(int fd) { ::_close(fd); }
+#else
+int openFile(const std::string &path) {
+  return ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+}
+int openForRead(const std::string &path) {
+  return ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+}
+ssize_t readSome(int fd, char *buf, size_t n) { return ::read(fd, buf, n); }
+ssize_t writeSome(int fd, const char *buf, size_t n) {
+  return ::write(fd, buf, n);
+}
+bool seekTo(int fd, uint64_t off) {
+  return ::lseek(fd, static_cast<off_t>(off), SEEK_SET) >= 0;
+}
+bool truncateTo(int fd, uint64_t size) {
+  return ::ftruncate(fd, static_cast<off_t>(size)) == 0;
+}
+#ifdef __APPLE__
+bool syncFile(int fd) { return ::fsync(fd) == 0; }
+#else
+bool syncFile(int fd) { return ::fdatasync(fd) == 0; }
+#endif
+void closeFile(int fd) { ::close(fd); }
+#endif
+
+Status ioError(const std::string &what, const std::string &path) {
+  return Status::Internal(what + " " + path + ": " + std::strerror(errno));
+}
+
+// The whole of `fd` as concurrent chunk reads on `io`
+Status readAll(IoQueue &io, int fd, const std::string &path,
+               std::string &out) {
+  struct stat info;
+  if (::fstat(fd, &info) != 0)
+    return ioError("cannot stat", path);
+  return fileio::readFile(io, fd, static_cast<uint64_t>(info.st_size), path,
+                          out);
+}
+
+Status writeAll(int fd, const std::string &path, const char *data,
+                size_t n) {
+  while (n > 0) {
+    auto w = writeSome(fd, data, n);
+    if (w < 0) {
+      if (errno == EINTR)
+        continue;
+      return ioError("cannot write", path);
+    }
+    data += w;
+    n -= static_cast<size_t>(w);
+  }
+  return Status::OK();
+}
+
+// ---- Framing ---------------------------------------------------------------
+
+constexpr uint32_t kWalMagic = 0x4B444257; // 'KDBW'
+constexpr uint32_t kWalVersion = 1;
+// Version 2 files may hold compressed and dictionary frames
+constexpr uint32_t kWalCompressedVersion = 2;
+constexpr size_t kHeaderBytes = 8;
+constexpr size_t kFrameHeaderBytes = 8;
+// Larger lengths can only come from a torn or corrupt frame
+constexpr uint32_t kMaxFrameBytes = uint32_t{1} << 30;
+// Length bit of frames whose payload is [u32 raw length][compressed]
+constexpr uint32_t kCompressedFrame = uint32_t{1} << 31;
+// Payloads below this size are stored as they are
+constexpr size_t kMinCompressBytes = 64;
+// Op of the frames that set the dictionary of the frames after them
+constexpr uint8_t kDictionaryOp = 0x00;
+// CRC-32 (IEEE 802.3, reflected)
+const std::array<uint32_t, 256> &crcTable() {
+  static const std::array<uint32_t, 256> table = [] {
+    std::array<uint32_t, 256> t{};
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k)
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+    return t;
+  }();
+  return table;
+}
+
+uint32_t crc32(const char *data, size_t n) {
+  const auto &t = crcTable();
+  uint32_t c = 0xFFFFFFFFu;
+  for (size_t i = 0; i < n; ++i)
+    c = t[(c ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (c >> 8);
+  return c ^ 0xFFFFFFFFu;
+}
+
+void putU32(std::string &out, uint32_t v) {
+  char b[4];
+  std::memcpy(b, &v, 4);
+  out.append(b, 4);
+}
+
+uint32_t getU32(const char *p) {
+  uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+std::string fileHeader(uint32_t version = kWalVersion) {
+  std::string h;
+  putU32(h, kWalMagic);
+  putU32(h, version);
+  return h;
+}
+
+// Frame payload: op, target length, target, body; compressed with
+// `codec` and `dict` when that makes it smaller
+void appendFrame(std::string &out, const WalRecord &rec,
+                 Codec codec = Codec::None, std::string_view dict = {}) {
+  const size_t len = 1 + 4 + rec.target.size() + rec.body.size();
+  const size_t start = out.size();
+  out.resize(start + kFrameHeaderBytes);
+  out.push_back(static_cast<char>(rec.op));
+  putU32(out, static_cast<uint32_t>(rec.target.size()));
+  out += rec.target;
+  out += rec.body;
+  uint32_t n = static_cast<uint32_t>(len);
+  if (codec != Codec::None && len >= kMinCompressBytes) {
+    thread_local std::string packed;
+    packed.clear();
+    putU32(packed, n);
+    codec::compress(codec, out.data() + start + kFrameHeaderBytes, len,
+                    packed, dict);
+    if (packed.size() < len) {
+      out.replace(start + kFrameHeaderBytes, len, packed);
+      n = static_cast<uint32_t>(packed.size()) | kCompressedFrame;
+    }
+  }
+  const uint32_t crc = crc32(out.data() + start + kFrameHeaderBytes,
+                             out.size() - start - kFrameHeaderBytes);
+  std::memcpy(&out[start], &n, 4);
+  std::memcpy(&out[start + 4], &crc, 4);
+}
+
+// A frame that makes `dict` the dictionary of the frames after it
+void appendDictionaryFrame(std::string &out, std::string_view dict) {
+  WalRecord rec;
+  rec.op = static_cast<WalOp>(kDictionaryOp);
+  rec.body.assign(dict.data(), dict.size());
+  appendFrame(out, rec);
+}
+
+// Decodes the frame of `data` at `pos` into `rec` and moves `pos` past it;
+// false, leaving `pos`, at a short, oversized or mismatching frame. A
+// dictionary frame replaces `dict` and yields a record of kDictionaryOp.
+bool readFrame(const std::string &data, size_t &pos, std::string &dict,
+               WalRecord &rec) {
+  if (data.size() - pos < kFrameHeaderBytes)
+    return false;
+  const uint32_t word = getU32(data.data() + pos);
+  const uint32_t len = word & ~kCompressedFrame;
+  const uint32_t crc = getU32(data.data() + pos + 4);
+  if (len < 5 || len > kMaxFrameBytes ||
+      data.size() - pos - kFrameHeaderBytes < len)
+    return false;
+  const char *p = data.data() + pos + kFrameHeaderBytes;
+  if (crc32(p, len) != crc)
+    return false;
+  uint32_t plain = len;
+  thread_local std::string raw;
+  if (word & kCompressedFrame) {
+    plain = getU32(p);
+    if (plain < 5 || plain > kMaxFrameBytes)
+      return false;
+    raw.resize(plain);
+    if (!codec::decompress(p + 4, len - 4, &raw[0], plain, dict))
+      return false;
+    p = raw.data();
+  }
+  const uint32_t targetLen = getU32(p + 1);
+  if (targetLen > plain - 5)
+    return false;
+  rec.op = static_cast<WalOp>(static_cast<uint8_t>(p[0]));
+  rec.target.assign(p + 5, targetLen);
+  rec.body.assign(p + 5 + targetLen, plain - 5 - targetLen);
+  if (static_cast<uint8_t>(p[0]) == kDictionaryOp)
+    dict = rec.body;
+  pos += kFrameHeaderBytes + len;
+  return true;
+}
+
+// Calls fn(record) for each intact frame of `data` after the header and
+// returns the end of the last one; a short, oversized or mismatching frame
+// ends the log. Dictionary frames are applied, not passed on; `dict` ends
+// as the dictionary in effect.
+template <typename Fn>
+size_t scanFrames(const std::string &data, Fn &&fn,
+                  std::string *dict = nullptr) {
+  std::string current;
+  size_t pos = kHeaderBytes;
+  WalRecord rec;
+  while (readFrame(data, pos, current, rec))
+    if (static_cast<uint8_t>(rec.op) != kDictionaryOp)
+      fn(std::move(rec));
+  if (dict)
+    *dict = std::move(current);
+  return pos;
+}
+
+// Whether `data` holds no more than a (possibly partial) header
+bool isHeaderPrefix(const std::string &data) {
+  return data.size() < kHeaderBytes &&
+         (fileHeader().compare(0, data.size(), data) == 0 ||
+          fileHeader(kWalCompressedVersion).compare(0, data.size(), data) ==
+              0);
+}
+
+Status checkHeader(const std::string &data, const std::string &path) {
+  if (data.size() < kHeaderBytes || getU32(data.data()) != kWalMagic)
+    return Status::InvalidArgument("Not a KadeDB write-ahead log: " + path);
+  const uint32_t version = getU32(data.data() + 4);
+  if (version != kWalVersion && version != kWalCompressedVersion)
+    return Status::InvalidArgument("Unsupported write-ahead log version: " +
+                                   path);
+  return Status::OK();
+}
+
+// ---- Record bodies ---------------------------------------------------------
+
+void writeU8(std::ostream &os, uint8_t v) {
+  os.write(reinterpret_cast<const char *>(&v), 1);
+}
+void writeU32(std::ostream &os, uint32_t v) {
+  os.write(reinterpret_cast<const char *>(&v), 4);
+}
+void writeI64(std::ostream &os, int64_t v) {
+  os.write(reinterpret_cast<const char *>(&v), 8);
+}
+void writeString(std::ostream &os, const std::string &s) {
+  writeU32(os, static_cast<uint32_t>(s.size()));
+  os.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+
+uint8_t readU8(std::istream &is) {
+  uint8_t v{};
+  if (!is.read(reinterpret_cast<char *>(&v), 1))
+    throw SerializationError("Unexpected EOF reading u8");
+  return v;
+}
+uint32_t readU32(std::istream &is) {
+  uint32_t v{};
+  if (!is.read(reinterpret_cast<char *>(&v), 4))
+    throw SerializationError("Unexpected EOF reading u32");
+  return v;
+}
+int64_t readI64(std::istream &is) {
+  int64_t v{};
+  if (!is.read(reinterpret_cast<char *>(&v), 8))
+    throw SerializationError("Unexpected EOF reading i64");
+  return v;
+}
+std::string readString(std::istream &is) {
+  const uint32_t n = readU32(is);
+  std::string s(n, '\0');
+  if (n && !is.read(&s[0], n))
+    throw SerializationError("Unexpected EOF reading string");
+  return s;
+}
+
+// A presence byte, which for a value is the version of its encoding
+void writeOptValue(std::ostream &os, const Value *v) {
+  writeU8(os, v ? serialization_constants::VERSION : 0);
+  if (v)
+    bin::writeValue(*v, os);
+}
+std::unique_ptr<Value> readOptValue(std::istream &is) {
+  const uint8_t version = readU8(is);
+  if (version == 0)
+    return nullptr;
+  if (version > serialization_constants::VERSION)
+    throw SerializationError("Unsupported value version");
+  return bin::readValue(is, version);
+}
+
+void writePredicate(std::ostream &os, const Predicate &p) {
+  writeU8(os, static_cast<uint8_t>(p.kind));
+  writeString(os, p.column);
+  writeU8(os, static_cast<uint8_t>(p.op));
+  writeOptValue(os, p.rhs.get());
+  writeU32(os, static_cast<uint32_t>(p.children.size()));
+  for (const auto &ch : p.children)
+    writePredicate(os, ch);
+}
+Predicate readPredicate(std::istream &is) {
+  Predicate p;
+  p.kind = static_cast<Predicate::Kind>(readU8(is));
+  p.column = readString(is);
+  p.op = static_cast<Predicate::Op>(readU8(is));
+  p.rhs = readOptValue(is);
+  const uint32_t n = readU32(is);
+  for (uint32_t i = 0; i < n; ++i)
+    p.children.push_back(readPredicate(is));
+  return p;
+}
+
+void writeWhere(std::ostream &os, const std::optional<Predicate> &where) {
+  writeU8(os, where ? 1 : 0);
+  if (where)
+    writePredicate(os, *where);
+}
+std::optional<Predicate> readWhere(std::istream &is) {
+  std::optional<Predicate> where;
+  if (readU8(is))
+    where.emplace(readPredicate(is));
+  return where;
+}
+
+void writeLabels(std::ostream &os,
+                 const std::unordered_set<std::string> &labels) {
+  writeU32(os, static_cast<uint32_t>(labels.size()));
+  for (const auto &l : labels)
+    writeString(os, l);
+}
+std::unordered_set<std::string> readLabels(std::istream &is) {
+  std::unordered_set<std::string> labels;
+  const uint32_t n = readU32(is);
+  for (uint32_t i = 0; i < n; ++i)
+    labels.insert(readString(is));
+  return labels;
+}
+
+Node readNode(std::istream &is) {
+  Node node;
+  node.id = readI64(is);
+  node.labels = readLabels(is);
+  node.properties = bin::readDocument(is);
+  return node;
+}
+
+Edge readEdge(std::istream &is) {
+  Edge edge;
+  edge.id = readI64(is);
+  edge.from = readI64(is);
+  edge.to = readI64(is);
+  edge.type = readString(is);
+  edge.labels = readLabels(is);
+  edge.properties = bin::readDocument(is);
+  return edge;
+}
+
+void writeSeriesSchema(std::ostream &os, const TimeSeriesSchema &s) {
+  writeString(os, s.timestampColumn());
+  writeU8(os, static_cast<uint8_t>(s.granularity()));
+  bin::writeTableSchema(TableSchema(s.tagColumns()), os);
+  bin::writeTableSchema(TableSchema(s.valueColumns()), os);
+  const RetentionPolicy &r = s.retentionPolicy();
+  writeI64(os, static_cast<int64_t>(r.ttlSeconds));
+  writeI64(os, static_cast<int64_t>(r.maxRows));
+  writeU8(os, r.dropOldest ? 1 : 0);
+  writeU32(os, static_cast<uint32_t>(r.tiers.size()));
+  for (const auto &t : r.tiers) {
+    writeI64(os, static_cast<int64_t>(t.bucketSeconds));
+    writeI64(os, static_cast<int64_t>(t.ttlSeconds));
+  }
+  writeI64(os, static_cast<int64_t>(s.latenessSeconds()));
+}
+TimeSeriesSchema readSeriesSchema(std::istream &is) {
+  TimeSeriesSchema s;
+  s.setTimestampColumn(readString(is));
+  s.setGranularity(static_cast<TimeGranularity>(readU8(is)));
+  const TableSchema tags = bin::readTableSchema(is);
+  for (const auto &c : tags.columns())
+    s.addTagColumn(c);
+  const TableSchema values = bin::readTableSchema(is);
+  for (const auto &c : values.columns())
+    s.addValueColumn(c);
+  RetentionPolicy r;
+  r.ttlSeconds = static_cast<uint64_t>(readI64(is));
+  r.maxRows = static_cast<size_t>(readI64(is));
+  r.dropOldest = readU8(is) != 0;
+  const uint32_t tiers = readU32(is);
+  for (uint32_t i = 0; i < tiers; ++i) {
+    DownsampleTier t;
+    t.bucketSeconds = static_cast<uint64_t>(readI64(is));
+    t.ttlSeconds = static_cast<uint64_t>(readI64(is));
+    r.tiers.push_back(t);
+  }
+  s.setRetentionPolicy(r);
+  s.setLatenessSeconds(static_cast<uint64_t>(readI64(is)));
+  return s;
+}
+
+WalRecord record(WalOp op, const std::string &target, std::string body = {}) {
+  WalRecord rec;
+  rec.op = op;
+  rec.target = target;
+  rec.body = std::move(body);
+  return rec;
+}
+
+WalRecord record(WalOp op, const std::string &target,
+                 const std::ostringstream &body) {
+  return record(op, target, body.str());
+}
+
+WalRecord nameRecord(WalOp op, const std::string &target,
+                     const std::string &name) {
+  std::ostringstream os;
+  writeString(os, name);
+  return record(op, target, os);
+}
+
+WalRecord indexRecord(WalOp op, const std::string &target,
+                      const std::string &name, IndexType type) {
+  std::ostringstream os;
+  writeString(os, name);
+  writeU8(os, static_cast<uint8_t>(type));
+  return record(op, target, os);
+}
+
+WalRecord aggregateRecord(WalOp op, const std::string &series,
+                          const std::string &valueColumn, int64_t bucketWidth,
+                          TimeGranularity bucketGranularity) {
+  std::ostringstream os;
+  writeString(os, valueColumn);
+  writeI64(os, bucketWidth);
+  writeU8(os, static_cast<uint8_t>(bucketGranularity));
+  return record(op, series, os);
+}
+
+} // namespace
+
+namespace walRecord {
+
+WalRecord createTable(const std::string &table, const TableSchema &schema) {
+  std::ostringstream os;
+  bin::writeTableSchema(schema, os);
+  return record(WalOp::CreateTable, table, os);
+}
+
+WalRecord dropTable(const std::string &table) {
+  return record(WalOp::DropTable, table);
+}
+
+WalRecord truncateTable(const std::string &table) {
+  return record(WalOp::TruncateTable, table);
+}
+
+WalRecord insertRow(const std::string &table, const Row &row) {
+  std::ostringstream os;
+  bin::writeRow(row, os);
+  return record(WalOp::InsertRow, table, os);
+}
+
+WalRecord insertRows(const std::string &table, const std::vector<Row> &rows) {
+  WalRecord rec = record(WalOp::InsertRows, table);
+  bin::writeRowBatch(rows, rec.body);
+  return rec;
+}
+
+WalRecord deleteRows(const std::string &table,
+                     const std::optional<Predicate> &where) {
+  std::ostringstream os;
+  writeWhere(os, where);
+  return record(WalOp::DeleteRows, table, os);
+}
+
+WalRecord
+updateRows(const std::string &table,
+           const std::unordered_map<std::string, AssignmentValue> &assignments,
+           const std::optional<Predicate> &where) {
+  std::ostringstream os;
+  writeU32(os, static_cast<uint32_t>(assignments.size()));
+  for (const auto &kv : assignments) {
+    writeString(os, kv.first);
+    writeU8(os, static_cast<uint8_t>(kv.second.kind));
+    writeOptValue(os, kv.second.constant.get());
+    writeString(os, kv.second.column_ref);
+  }
+  writeWhere(os, where);
+  return record(WalOp::UpdateRows, table, os);
+}
+
+WalRecord updateRowsWith(const std::string &table,
+                         const std::optional<Predicate> &where,
+                         const std::vector<Row> &updated) {
+  std::ostringstream os;
+  writeWhere(os, where);
+  WalRecord rec = record(WalOp::UpdateRowsWith, table, os);
+  bin::writeRowBatch(updated, rec.body);
+  return rec;
+}
+
+WalRecord createTableIndex(const std::string &table, const std::string &column,
+                           IndexType type) {
+  return indexRecord(WalOp::CreateTableIndex, table, column, type);
+}
+
+WalRecord createCollection(const std::string &collection,
+                           const std::optional<DocumentSchema> &schema) {
+  std::ostringstream os;
+  writeU8(os, schema ? 1 : 0);
+  if (schema)
+    bin::writeDocumentSchema(*schema, os);
+  return record(WalOp::CreateCollection, collection, os);
+}
+
+WalRecord dropCollection(const std::string &collection) {
+  return record(WalOp::DropCollection, collection);
+}
+
+WalRecord putDocument(const std::string &collection, const std::string &key,
+                      const Document &doc) {
+  std::ostringstream os;
+  writeString(os, key);
+  bin::writeDocument(doc, os);
+  return record(WalOp::PutDocument, collection, os);
+}
+
+WalRecord eraseDocument(const std::string &collection, const std::string &key) {
+  return nameRecord(WalOp::EraseDocument, collection, key);
+}
+
+WalRecord createCollectionIndex(const std::string &collection,
+                                const std::string &field, IndexType type) {
+  return indexRecord(WalOp::CreateCollectionIndex, collection, field, type);
+}
+
+WalRecord createSeries(const std::string &series,
+                       const TimeSeriesSchema &schema,
+                       TimePartition partition) {
+  std::ostringstream os;
+  writeSeriesSchema(os, schema);
+  writeU8(os, static_cast<uint8_t>(partition));
+  return record(WalOp::CreateSeries, series, os);
+}
+
+WalRecord dropSeries(const std::string &series) {
+  return record(WalOp::DropSeries, series);
+}
+
+WalRecord appendRows(const std::string &series, const std::vector<Row> &rows) {
+  WalRecord rec = record(WalOp::AppendRows, series);
+  bin::writeRowBatch(rows, rec.body);
+  return rec;
+}
+
+WalRecord appendColumns(const std::string &series, const int64_t *ts,
+                        const double *const *values, size_t n,
+                        size_t columns) {
+  std::ostringstream os;
+  writeI64(os, static_cast<int64_t>(n));
+  writeU32(os, static_cast<uint32_t>(columns));
+  os.write(reinterpret_cast<const char *>(ts),
+           static_cast<std::streamsize>(n * sizeof(int64_t)));
+  for (size_t c = 0; c < columns; ++c)
+    os.write(reinterpret_cast<const char *>(values[c]),
+             static_cast<std::streamsize>(n * sizeof(double)));
+  return record(WalOp::AppendColumns, series, os);
+}
+
+WalRecord createContinuousAggregate(const std::string &series,
+                                    const std::string &valueColumn,
+                                    int64_t bucketWidth,
+                                    TimeGranularity bucketGranularity,
+                                    bool sketches) {
+  WalRecord rec =
+      aggregateRecord(WalOp::CreateContinuousAggregate, series, valueColumn,
+                      bucketWidth, bucketGranularity);
+  // Appended only when set, so records without it stay as they were
+  if (sketches)
+    rec.body.push_back('\1');
+  return rec;
+}
+
+WalRecord dropContinuousAggregate(const std::string &series,
+                                  const std::string &valueColumn,
+                                  int64_t bucketWidth,
+                                  TimeGranularity bucketGranularity) {
+  return aggregateRecord(WalOp::DropContinuousAggregate, series, valueColumn,
+                         bucketWidth, bucketGranularity);
+}
+
+WalRecord createGraph(const std::string &graph) {
+  return record(WalOp::CreateGraph, graph);
+}
+
+WalRecord dropGraph(const std::string &graph) {
+  return record(WalOp::DropGraph, graph);
+}
+
+WalRecord putNode(const std::string &graph, const Node &node) {
+  std::ostringstream os;
+  writeI64(os, node.id);
+  writeLabels(os, node.labels);
+  bin::writeDocument(node.properties, os);
+  return record(WalOp::PutNode, graph, os);
+}
+
+WalRecord eraseNode(const std::string &graph, NodeId id) {
+  std::ostringstream os;
+  writeI64(os, id);
+  return record(WalOp::EraseNode, graph, os);
+}
+
+WalRecord putEdge(const std::string &graph, const Edge &edge) {
+  std::ostringstream os;
+  writeI64(os, edge.id);
+  writeI64(os, edge.from);
+  writeI64(os, edge.to);
+  writeString(os, edge.type);
+  writeLabels(os, edge.labels);
+  bin::writeDocument(edge.properties, os);
+  return record(WalOp::PutEdge, graph, os);
+}
+
+WalRecord eraseEdge(const std::string &graph, EdgeId id) {
+  std::ostringstream os;
+  writeI64(os, id);
+  return record(WalOp::EraseEdge, graph, os);
+}
+
+WalRecord createNodeIndex(const std::string &graph,
+                          const std::string &property, IndexType type) {
+  return indexRecord(WalOp::CreateNodeIndex, graph, property, type);
+}
+
+WalRecord dropNodeIndex(const std::string &graph,
+                        const std::string &property) {
+  return nameRecord(WalOp::DropNodeIndex, graph, property);
+}
+
+WalRecord createEdgeIndex(const std::string &graph,
+                          const std::string &property, IndexType type) {
+  return indexRecord(WalOp::CreateEdgeIndex, graph, property, type);
+}
+
+WalRecord dropEdgeIndex(const std::string &graph,
+                        const std::string &property) {
+  return nameRecord(WalOp::DropEdgeIndex, graph, property);
+}
+
+} // namespace walRecord
+
+// ---- WriteAheadLog ---------------------------------------------------------
+
+Result<std::unique_ptr<WriteAheadLog>>
+WriteAheadLog::open(const std::string &path, WalOptions options) {
+  using R = Result<std::unique_ptr<WriteAheadLog>>;
+  const int fd = openFile(path);
+  if (fd < 0)
+    return R::err(ioError("cannot open", path));
+  std::unique_ptr<IoQueue> io(new IoQueue(options.io));
+  std::string data;
+  Status st = readAll(*io, fd, path, data);
+  uint64_t records = 0;
+  size_t end = kHeaderBytes;
+  const bool compress = options.compression != Codec::None;
+  std::string dict;
+  if (st.ok() && isHeaderPrefix(data)) {
+    // A new log, or one torn while its header was written
+    const std::string header =
+        fileHeader(compress ? kWalCompressedVersion : kWalVersion);
+    if (!truncateTo(fd, 0) || !seekTo(fd, 0))
+      st = ioError("cannot reset", path);
+    else
+      st = writeAll(fd, path, header.data(), header.size());
+    if (st.ok() && options.sync && !syncFile(fd))
+      st = ioError("cannot sync", path);
+  } else if (st.ok() && (st = checkHeader(data, path)).ok()) {
+    end = scanFrames(data, [&](WalRecord &&) { ++records; }, &dict);
+    // Drop a torn tail so that new frames follow the last intact one
+    if (end < data.size() && !truncateTo(fd, end))
+      st = ioError("cannot truncate", path);
+    // Readers of version 1 would take compressed frames for a torn tail
+    if (st.ok() && compress && getU32(data.data() + 4) == kWalVersion) {
+      const std::string header = fileHeader(kWalCompressedVersion);
+      if (!seekTo(fd, 0))
+        st = ioError("cannot seek", path);
+      else
+        st = writeAll(fd, path, header.data(), header.size());
+    }
+  }
+  if (st.ok() && !seekTo(fd, end))
+    st = ioError("cannot seek", path);
+  if (st.ok() && compress && dict != options.dictionary) {
+    std::string frame;
+    appendDictionaryFrame(frame, options.dictionary);
+    st = writeAll(fd, path, frame.data(), frame.size());
+    end += frame.size();
+    if (st.ok() && options.sync && !syncFile(fd))
+      st = ioError("cannot sync", path);
+  }
+  if (!st.ok()) {
+    closeFile(fd);
+    return R::err(st);
+  }
+  return R::ok(std::unique_ptr<WriteAheadLog>(new WriteAheadLog(
+      path, fd, end, std::move(io), records, options)));
+}
+
+WriteAheadLog::WriteAheadLog(std::string path, int fd, uint64_t end,
+                             std::unique_ptr<IoQueue> io, uint64_t lsn,
+                             WalOptions options)
+    : path_(std::move(path)), fd_(fd), options_(options), io_(std::move(io)),
+      end_(end), lastLsn_(lsn), durableLsn_(lsn) {
+  writer_ = std::thread([this] { writerLoop(); });
+}
+
+WriteAheadLog::~WriteAheadLog() {
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    stop_ = true;
+  }
+  queuedCv_.notify_one();
+  writer_.join();
+  closeFile(fd_);
+}
+
+Result<uint64_t> WriteAheadLog::append(const WalRecord &rec) {
+  // Compress before taking the lock, so that writers compress in parallel
+  thread_local std::string frame;
+  const bool compress = options_.compression != Codec::None;
+  if (compress) {
+    frame.clear();
+    appendFrame(frame, rec, options_.compression, options_.dictionary);
+  }
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (!error_.ok())
+    return Result<uint64_t>::err(error_);
+  const bool wasEmpty = queued_.empty();
+  if (wasEmpty)
+    firstQueued_ = std::chrono::steady_clock::now();
+  if (compress)
+    queued_ += frame;
+  else
+    appendFrame(queued_, rec);
+  // The writer waits for the first frame of a batch, or for a full one
+  if (wasEmpty || queued_.size() >= options_.maxBatchBytes)
+    queuedCv_.notify_one();
+  return Result<uint64_t>::ok(++lastLsn_);
+}
+
+Status WriteAheadLog::sync(uint64_t lsn) {
+  std::unique_lock<std::mutex> lk(mtx_);
+  durableCv_.wait(lk, [&] { return durableLsn_ >= lsn || !error_.ok(); });
+  return durableLsn_ >= lsn ? Status::OK() : error_;
+}
+
+Status WriteAheadLog::commit(const WalRecord &rec) {
+  auto lsn = append(rec);
+  if (!lsn.hasValue())
+    return lsn.status();
+  return sync(lsn.value());
+}
+
+uint64_t WriteAheadLog::lastLsn() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return lastLsn_;
+}
+
+uint64_t WriteAheadLog::durableLsn() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return durableLsn_;
+}
+
+uint64_t WriteAheadLog::batches() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return batches_;
+}
+
+void WriteAheadLog::writerLoop() {
+  std::string batch;
+  std::unique_lock<std::mutex> lk(mtx_);
+  for (;;) {
+    queuedCv_.wait(lk, [&] { return stop_ || !queued_.empty(); });
+    if (queued_.empty())
+      return; // stopping with nothing left to write
+    // Give other writers the latency budget to join this batch
+    if (options_.commitDelay.count() > 0)
+      queuedCv_.wait_until(lk, firstQueued_ + options_.commitDelay, [&] {
+        return stop_ || queued_.size() >= options_.maxBatchBytes;
+      });
+    batch.clear();
+    batch.swap(queued_);
+    const uint64_t upto = lastLsn_;
+    lk.unlock();
+    // One submission: the sync starts as soon as the write completes
+    std::vector<IoOp> ops{IoOp::write(fd_, batch.data(), batch.size(), end_)};
+    if (options_.sync)
+      ops.push_back(IoOp::sync(fd_));
+    Status st = io_->run(std::move(ops), path_);
+    if (st.ok())
+      end_ += batch.size();
+    lk.lock();
+    ++batches_;
+    if (st.ok()) {
+      durableLsn_ = upto;
+    } else {
+      error_ = st;
+      queued_.clear();
+    }
+    durableCv_.notify_all();
+  }
+}
+
+// ---- Replay ----------------------------------------------------------------
+
+Status applyWalRecord(const WalRecord &rec, const WalTargets &targets) {
+  const std::string &t = rec.target;
+  std::istringstream is(rec.body);
+  auto missing = [&](const char *engine) {
+    return Status::FailedPrecondition(
+        std::string("No ") + engine + " storage to replay into: " + t);
+  };
+  try {
+    switch (rec.op) {
+    case WalOp::CreateTable:
+    case WalOp::DropTable:
+    case WalOp::TruncateTable:
+    case WalOp::InsertRow:
+    case WalOp::DeleteRows:
+    case WalOp::UpdateRows:
+    case WalOp::UpdateRowsWith:
+    case WalOp::CreateTableIndex:
+    case WalOp::InsertRows: {
+      RelationalStorage *rel = targets.relational;
+      if (!rel)
+        return missing("relational");
+      switch (rec.op) {
+      case WalOp::CreateTable:
+        return rel->createTable(t, bin::readTableSchema(is));
+      case WalOp::DropTable:
+        return rel->dropTable(t);
+      case WalOp::TruncateTable:
+        return rel->truncateTable(t);
+      case WalOp::InsertRow:
+        return rel->insertRow(t, bin::readRow(is));
+      case WalOp::InsertRows:
+        return rel->insertRows(
+            t, bin::readRowBatch(rec.body.data(), rec.body.size()));
+      case WalOp::DeleteRows:
+        return rel->deleteRows(t, readWhere(is)).status();
+      case WalOp::UpdateRows: {
+        std::unordered_map<std::string, AssignmentValue> assignments;
+        const uint32_t n = readU32(is);
+        for (uint32_t i = 0; i < n; ++i) {
+          std::string column = readString(is);
+          AssignmentValue av;
+          av.kind = static_cast<AssignmentValue::Kind>(readU8(is));
+          av.constant = readOptValue(is);
+          av.column_ref = readString(is);
+          assignments.emplace(std::move(column), std::move(av));
+        }
+        return rel->updateRows(t, assignments, readWhere(is)).status();
+      }
+      case WalOp::UpdateRowsWith: {
+        std::optional<Predicate> where = readWhere(is);
+        const size_t at = static_cast<size_t>(is.tellg());
+        std::vector<Row> rows =
+            bin::readRowBatch(rec.body.data() + at, rec.body.size() - at);
+        size_t next = 0;
+        auto res = rel->updateRowsWith(
+            t,
+            [&](Row &row, const TableSchema &) {
+              if (next == rows.size())
+                return Status::Internal("More rows match than were logged");
+              row = std::move(rows[next++]);
+              return Status::OK();
+            },
+            where);
+        if (res.hasValue() && next != rows.size())
+          return Status::Internal("Fewer rows match than were logged: " + t);
+        return res.status();
+      }
+      default: {
+        std::string column = readString(is);
+        return rel->createIndex(t, column, static_cast<IndexType>(readU8(is)));
+      }
+      }
+    }
+    case WalOp::CreateCollection:
+    case WalOp::DropCollection:
+    case WalOp::PutDocument:
+    case WalOp::EraseDocument:
+    case WalOp::CreateCollectionIndex: {
+      DocumentStorage *doc = targets.document;
+      if (!doc)
+        return missing("document");
+      switch (rec.op) {
+      case WalOp::CreateCollection: {
+        std::optional<DocumentSchema> schema;
+        if (readU8(is))
+          schema = bin::readDocumentSchema(is);
+        return doc->createCollection(t, schema);
+      }
+      case WalOp::DropCollection:
+        return doc->dropCollection(t);
+      case WalOp::PutDocument: {
+        std::string key = readString(is);
+        return doc->put(t, key, bin::readDocument(is));
+      }
+      case WalOp::EraseDocument:
+        return doc->erase(t, readString(is));
+      default: {
+        std::string field = readString(is);
+        return doc->createIndex(t, field, static_cast<IndexType>(readU8(is)));
+      }
+      }
+    }
+    case WalOp::CreateSeries:
+    case WalOp::DropSeries:
+    case WalOp::AppendRows:
+    case WalOp::AppendColumns:
+    case WalOp::CreateContinuousAggregate:
+    case WalOp::DropContinuousAggregate: {
+      TimeSeriesStorage *ts = targets.timeseries;
+      if (!ts)
+        return missing("time series");
+      switch (rec.op) {
+      case WalOp::CreateSeries: {
+        TimeSeriesSchema schema = readSeriesSchema(is);
+        return ts->createSeries(t, schema,
+                                static_cast<TimePartition>(readU8(is)));
+      }
+      case WalOp::DropSeries:
+        return ts->dropSeries(t);
+      case WalOp::AppendRows: {
+        std::vector<Row> rows =
+            bin::readRowBatch(rec.body.data(), rec.body.size());
+        return rows.size() == 1 ? ts->append(t, rows[0])
+                                : ts->appendBatch(t, rows);
+      }
+      case WalOp::AppendColumns: {
+        const size_t n = static_cast<size_t>(readI64(is));
+        const size_t columns = readU32(is);
+        if (rec.body.size() != 12 + n * 8 * (columns + 1))
+          throw SerializationError("Bad column append length");
+        std::vector<int64_t> stamps(n);
+        std::vector<std::vector<double>> cols(columns, std::vector<double>(n));
+        std::vector<const double *> values(columns);
+        is.read(reinterpret_cast<char *>(stamps.data()),
+                static_cast<std::streamsize>(n * sizeof(int64_t)));
+        for (size_t c = 0; c < columns; ++c) {
+          is.read(reinterpret_cast<char *>(cols[c].data()),
+                  static_cast<std::streamsize>(n * sizeof(double)));
+          values[c] = cols[c].data();
+        }
+        return ts->appendColumns(t, stamps.data(), values.data(), n);
+      }
+      default: {
+        std::string column = readString(is);
+        const int64_t width = readI64(is);
+        const auto granularity = static_cast<TimeGranularity>(readU8(is));
+        const bool sketches =
+            is.peek() != std::char_traits<char>::eof() && readU8(is) != 0;
+        return rec.op == WalOp::CreateContinuousAggregate
+                   ? ts->createContinuousAggregate(t, column, width,
+                                                   granularity, sketches)
+                   : ts->dropContinuousAggregate(t, column, width,
+                                                 granularity);
+      }
+      }
+    }
+    case WalOp::CreateGraph:
+    case WalOp::DropGraph:
+    case WalOp::PutNode:
+    case WalOp::EraseNode:
+    case WalOp::PutEdge:
+    case WalOp::EraseEdge:
+    case WalOp::CreateNodeIndex:
+    case WalOp::DropNodeIndex:
+    case WalOp::CreateEdgeIndex:
+    case WalOp::DropEdgeIndex: {
+      GraphStorage *g = targets.graph;
+      if (!g)
+        return missing("graph");
+      switch (rec.op) {
+      case WalOp::CreateGraph:
+        return g->createGraph(t);
+      case WalOp::DropGraph:
+        return g->dropGraph(t);
+      case WalOp::PutNode:
+        return g->putNode(t, readNode(is));
+      case WalOp::EraseNode:
+        return g->eraseNode(t, readI64(is));
+      case WalOp::PutEdge:
+        return g->putEdge(t, readEdge(is));
+      case WalOp::EraseEdge:
+        return g->eraseEdge(t, readI64(is));
+      case WalOp::CreateNodeIndex:
+      case WalOp::CreateEdgeIndex: {
+        std::string property = readString(is);
+        const auto type = static_cast<IndexType>(readU8(is));
+        return rec.op == WalOp::CreateNodeIndex
+                   ? g->createNodeIndex(t, property, type)
+                   : g->createEdgeIndex(t, property, type);
+      }
+      default: {
+        std::string property = readString(is);
+        return rec.op == WalOp::DropNodeIndex ? g->dropNodeIndex(t, property)
+                                              : g->dropEdgeIndex(t, property);
+      }
+      }
+    }
+    }
+  } catch (const SerializationError &e) {
+    return Status::InvalidArgument(std::string("Corrupt log record: ") +
+                                   e.what());
+  }
+  return Status::InvalidArgument(
+      "Unknown log op " + std::to_string(static_cast<int>(rec.op)));
+}
+
+std::string walFileHeader(Codec codec) {
+  return fileHeader(codec == Codec::None ? kWalVersion
+                                         : kWalCompressedVersion);
+}
+
+void appendWalFrame(std::string &out, const WalRecord &rec, Codec codec) {
+  appendFrame(out, rec, codec);
+}
+
+namespace {
+
+// A run of PutNode or PutEdge records of one graph applied by one
+// putNodes()/putEdges(), so a graph's load takes its lock once per run and
+// an edgeless graph is bulk loaded. False if the batch decodes or applies
+// badly: puts are idempotent, so the caller reapplies the run record by
+// record to find the failing one.
+bool applyGraphPuts(const std::vector<WalRecord> &records,
+                    const std::vector<size_t> &run, GraphStorage &g) {
+  const WalRecord &first = records[run.front()];
+  try {
+    if (first.op == WalOp::PutNode) {
+      std::vector<Node> nodes;
+      nodes.reserve(run.size());
+      for (size_t i : run) {
+        std::istringstream is(records[i].body);
+        nodes.push_back(readNode(is));
+      }
+      return g.putNodes(first.target, nodes).ok();
+    }
+    std::vector<Edge> edges;
+    edges.reserve(run.size());
+    for (size_t i : run) {
+      std::istringstream is(records[i].body);
+      edges.push_back(readEdge(is));
+    }
+    return g.putEdges(first.target, edges).ok();
+  } catch (const SerializationError &) {
+    return false;
+  }
+}
+
+// The indexes of `records` per engine and target, in log order
+std::vector<std::vector<size_t>>
+splitStreams(const std::vector<WalRecord> &records) {
+  std::unordered_map<std::string, size_t> streamOf;
+  std::vector<std::vector<size_t>> streams;
+  for (size_t i = 0; i < records.size(); ++i) {
+    const WalRecord &rec = records[i];
+    std::string key(1, static_cast<char>(static_cast<uint8_t>(rec.op) >> 4));
+    key += rec.target;
+    auto it = streamOf.emplace(std::move(key), streams.size()).first;
+    if (it->second == streams.size())
+      streams.emplace_back();
+    streams[it->second].push_back(i);
+  }
+  return streams;
+}
+
+// Applies the records of one stream in order, as runs of graph puts where
+// possible. Stops at the first failure and returns its index in `records`
+// and its error (records.size() and OK when all applied).
+std::pair<size_t, Status> applyStream(const std::vector<WalRecord> &records,
+                                      const std::vector<size_t> &stream,
+                                      const WalTargets &targets,
+                                      std::atomic<uint64_t> &applied) {
+  auto isPut = [&](size_t i) {
+    return records[i].op == WalOp::PutNode || records[i].op == WalOp::PutEdge;
+  };
+  std::vector<size_t> run;
+  // Records before `single` belong to a run that failed as a batch
+  size_t single = 0;
+  for (size_t k = 0; k < stream.size(); ++k) {
+    const size_t i = stream[k];
+    if (targets.graph && k >= single && isPut(i) && k + 1 < stream.size() &&
+        records[stream[k + 1]].op == records[i].op) {
+      run.clear();
+      for (size_t j = k;
+           j < stream.size() && records[stream[j]].op == records[i].op; ++j)
+        run.push_back(stream[j]);
+      if (applyGraphPuts(records, run, *targets.graph)) {
+        applied.fetch_add(run.size(), std::memory_order_relaxed);
+        k += run.size() - 1;
+        continue;
+      }
+      single = k + run.size();
+    }
+    Status rs = applyWalRecord(records[i], targets);
+    if (!rs.ok())
+      return {i, rs};
+    applied.fetch_add(1, std::memory_order_relaxed);
+  }
+  return {records.size(), Status::OK()};
+}
+
+// `err` of the record at log sequence number `lsn`
+Status recordError(const Status &err, uint64_t lsn) {
+  return Status(err.code(),
+                "Log record " + std::to_string(lsn) + ": " + err.message());
+}
+
+// Applies `records` with one worker per target stream, like replayWal();
+// `firstLsn` numbers them in errors
+Result<uint64_t> applyRecords(const std::vector<WalRecord> &records,
+                              const WalTargets &targets, size_t threads,
+                              uint64_t firstLsn) {
+  const std::vector<std::vector<size_t>> streams = splitStreams(records);
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::max<size_t>(1, std::min(threads, streams.size()));
+  std::atomic<size_t> next{0};
+  std::atomic<uint64_t> applied{0};
+  std::mutex errMtx;
+  size_t errAt = records.size();
+  Status err;
+  auto work = [&] {
+    for (size_t s; (s = next.fetch_add(1)) < streams.size();) {
+      auto failed = applyStream(records, streams[s], targets, applied);
+      if (failed.first < records.size()) {
+        std::lock_guard<std::mutex> lk(errMtx);
+        if (failed.first < errAt) {
+          errAt = failed.first;
+          err = failed.second;
+        }
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  pool.reserve(threads - 1);
+  for (size_t w = 1; w < threads; ++w)
+    pool.emplace_back(work);
+  work();
+  for (auto &th : pool)
+    th.join();
+  if (!err.ok())
+    return Result<uint64_t>::err(recordError(err, firstLsn + errAt));
+  return Result<uint64_t>::ok(applied.load());
+}
+
+// The records of the log at `path` after `afterLsn`, as replayWal() reads
+// them; `whole` makes a missing file or a torn tail an error
+Result<std::vector<WalRecord>> readRecords(const std::string &path,
+                                           uint64_t afterLsn, bool whole) {
+  using R = Result<std::vector<WalRecord>>;
+  struct stat info;
+  if (::stat(path.c_str(), &info) != 0 && errno == ENOENT) {
+    if (whole)
+      return R::err(Status::NotFound("No such file: " + path));
+    return R::ok({});
+  }
+  const int fd = openFile(path);
+  if (fd < 0)
+    return R::err(ioError("cannot open", path));
+  std::string data;
+  IoQueue io;
+  Status st = readAll(io, fd, path, data);
+  closeFile(fd);
+  if (!st.ok())
+    return R::err(st);
+  if (!whole && isHeaderPrefix(data))
+    return R::ok({});
+  if (!(st = checkHeader(data, path)).ok())
+    return R::err(st);
+
+  std::vector<WalRecord> records;
+  uint64_t lsn = 0;
+  const size_t end = scanFrames(data, [&](WalRecord &&rec) {
+    if (++lsn > afterLsn)
+      records.push_back(std::move(rec));
+  });
+  if (whole && end != data.size())
+    return R::err(Status::InvalidArgument(
+        "Truncated or corrupt file after byte " + std::to_string(end) + ": " +
+        path));
+  return R::ok(std::move(records));
+}
+
+// replayWal(); `whole` makes a missing file or a torn tail an error
+Result<uint64_t> replay(const std::string &path, const WalTargets &targets,
+                        size_t threads, uint64_t afterLsn, bool whole) {
+  auto records = readRecords(path, afterLsn, whole);
+  if (!records.hasValue())
+    return Result<uint64_t>::err(records.status());
+  return applyRecords(records.value(), targets, threads, afterLsn + 1);
+}
+
+} // namespace
+
+Result<uint64_t> replayWal(const std::string &path, const WalTargets &targets,
+                           size_t threads, uint64_t afterLsn) {
+  return replay(path, targets, threads, afterLsn, /*whole=*/false);
+}
+
+Result<uint64_t> replayWalFile(const std::string &path,
+                               const WalTargets &targets, size_t threads) {
+  return replay(path, targets, threads, 0, /*whole=*/true);
+}
+
+Result<uint64_t> applyWalRecords(const std::vector<WalRecord> &records,
+                                 const WalTargets &targets, size_t threads,
+                                 uint64_t afterLsn) {
+  return applyRecords(records, targets, threads, afterLsn + 1);
+}
+
+// ---- LazyReplay ------------------------------------------------------------
+
+struct LazyReplay::Stream {
+  enum State : int { Pending, Loading, Done };
+  WalEngine engine = WalEngine::Relational;
+  std::string target;
+  std::vector<size_t> records; // indexes into records_, in log order
+  // Whether the records leave the target created (1), dropped (-1) or
+  // as the storage has it (0)
+  int exists = 0;
+  uint64_t hint = 0;
+  std::atomic<uint64_t> accesses{0};
+  std::atomic<int> state{Pending};
+  Status status; // written before state becomes Done
+};
+
+LazyReplay::LazyReplay(WalTargets targets, uint64_t afterLsn)
+    : targets_(targets), afterLsn_(afterLsn) {}
+
+Result<std::unique_ptr<LazyReplay>>
+LazyReplay::open(const std::string &path, const WalTargets &targets,
+                 uint64_t afterLsn, LazyReplayOptions options) {
+  using R = Result<std::unique_ptr<LazyReplay>>;
+  auto records = readRecords(path, afterLsn, /*whole=*/false);
+  if (!records.hasValue())
+    return R::err(records.status());
+  std::unique_ptr<LazyReplay> lr(new LazyReplay(targets, afterLsn));
+  lr->records_ = records.takeValue();
+  for (auto &indexes : splitStreams(lr->records_)) {
+    auto s = std::make_unique<Stream>();
+    const WalRecord &first = lr->records_[indexes.front()];
+    const uint8_t engine = static_cast<uint8_t>(first.op) >> 4;
+    s->engine = static_cast<WalEngine>(engine);
+    s->target = first.target;
+    // Every engine numbers its create op 1 and its drop op 2
+    for (size_t i : indexes) {
+      const uint8_t op = static_cast<uint8_t>(lr->records_[i].op) & 0x0f;
+      if (op == 1)
+        s->exists = 1;
+      else if (op == 2)
+        s->exists = -1;
+    }
+    auto hint = options.hints.find({s->engine, s->target});
+    if (hint != options.hints.end())
+      s->hint = hint->second;
+    s->records = std::move(indexes);
+    lr->streamOf_.emplace(std::string(1, static_cast<char>(engine)) +
+                              s->target,
+                          s.get());
+    lr->streams_.push_back(std::move(s));
+  }
+
+  if (options.background && !lr->streams_.empty()) {
+    size_t threads = options.threads;
+    if (threads == 0)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, lr->streams_.size());
+    LazyReplay *self = lr.get();
+    for (size_t t = 0; t < threads; ++t)
+      lr->loaders_.emplace_back([self] { self->loaderLoop(); });
+  }
+  return R::ok(std::move(lr));
+}
+
+LazyReplay::~LazyReplay() {
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    stop_ = true;
+  }
+  for (auto &t : loaders_)
+    t.join();
+}
+
+bool LazyReplay::claim(Stream &s) {
+  int expected = Stream::Pending;
+  return s.state.compare_exchange_strong(expected, Stream::Loading);
+}
+
+Status LazyReplay::apply(Stream &s) {
+  auto failed = applyStream(records_, s.records, targets_, applied_);
+  if (failed.first < records_.size())
+    s.status = recordError(failed.second, afterLsn_ + 1 + failed.first);
+  for (size_t i : s.records)
+    records_[i] = WalRecord();
+  s.records.clear();
+  s.records.shrink_to_fit();
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    s.state.store(Stream::Done, std::memory_order_release);
+  }
+  doneCv_.notify_all();
+  return s.status;
+}
+
+Status LazyReplay::run(Stream &s) {
+  if (s.state.load(std::memory_order_acquire) == Stream::Done)
+    return s.status;
+  if (claim(s))
+    return apply(s);
+  std::unique_lock<std::mutex> lk(mtx_);
+  doneCv_.wait(lk, [&] {
+    return s.state.load(std::memory_order_acquire) == Stream::Done;
+  });
+  return s.status;
+}
+
+Status LazyReplay::load(WalEngine engine, const std::string &target) {
+  if (streamOf_.empty())
+    return Status::OK();
+  std::string key(1, static_cast<char>(engine));
+  key += target;
+  auto it = streamOf_.find(key);
+  if (it == streamOf_.end())
+    return Status::OK();
+  it->second->accesses.fetch_add(1, std::memory_order_relaxed);
+  return run(*it->second);
+}
+
+Status LazyReplay::loadAll(WalEngine engine) {
+  Status first;
+  for (auto &s : streams_) {
+    if (s->engine != engine)
+      continue;
+    Status st = run(*s);
+    if (first.ok())
+      first = st;
+  }
+  return first;
+}
+
+Status LazyReplay::wait() {
+  Status first;
+  for (auto &s : streams_) {
+    Status st = run(*s);
+    if (first.ok())
+      first = st;
+  }
+  return first;
+}
+
+std::vector<std::string> LazyReplay::listed(
+    WalEngine engine,
+    const std::function<std::vector<std::string>()> &base) const {
+  // Taken before `base` runs: a stream that completes in between has made
+  // the storage agree with its `exists`
+  std::unordered_map<std::string, int> pending;
+  for (auto &s : streams_)
+    if (s->engine == engine && s->exists != 0 &&
+        s->state.load(std::memory_order_acquire) != Stream::Done)
+      pending.emplace(s->target, s->exists);
+  std::vector<std::string> names = base();
+  if (pending.empty())
+    return names;
+  std::vector<std::string> out;
+  out.reserve(names.size() + pending.size());
+  for (auto &name : names) {
+    auto it = pending.find(name);
+    if (it == pending.end()) {
+      out.push_back(std::move(name));
+    } else if (it->second > 0) {
+      out.push_back(std::move(name));
+      it->second = 0;
+    }
+  }
+  for (auto &p : pending)
+    if (p.second > 0)
+      out.push_back(p.first);
+  return out;
+}
+
+std::vector<std::string> LazyReplay::pendingTargets(WalEngine engine) const {
+  std::vector<std::string> out;
+  for (auto &s : streams_)
+    if (s->engine == engine &&
+        s->state.load(std::memory_order_acquire) != Stream::Done)
+      out.push_back(s->target);
+  return out;
+}
+
+WalAccessCounts LazyReplay::accessCounts() const {
+  WalAccessCounts out;
+  for (auto &s : streams_)
+    out[{s->engine, s->target}] += s->accesses.load(std::memory_order_relaxed);
+  return out;
+}
+
+LazyReplay::Stream *LazyReplay::pick(size_t &from) const {
+  while (from < streams_.size() &&
+         streams_[from]->state.load(std::memory_order_relaxed) !=
+             Stream::Pending)
+    ++from;
+  Stream *best = nullptr;
+  uint64_t bestScore = 0;
+  for (size_t i = from; i < streams_.size(); ++i) {
+    Stream &s = *streams_[i];
+    if (s.state.load(std::memory_order_relaxed) != Stream::Pending)
+      continue;
+    const uint64_t score = s.hint + s.accesses.load(std::memory_order_relaxed);
+    if (!best || score > bestScore) {
+      best = &s;
+      bestScore = score;
+    }
+  }
+  return best;
+}
+
+void LazyReplay::loaderLoop() {
+  size_t from = 0;
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      if (stop_)
+        return;
+    }
+    Stream *s = pick(from);
+    if (!s)
+      return;
+    if (claim(*s))
+      apply(*s);
+  }
+}
+
+// ---- WalReader -------------------------------------------------------------
+
+Result<std::unique_ptr<WalReader>> WalReader::open(const std::string &path,
+                                                   uint64_t afterLsn) {
+  using R = Result<std::unique_ptr<WalReader>>;
+  std::unique_ptr<WalReader> reader(new WalReader(path, afterLsn));
+  reader->fd_ = openForRead(path);
+  if (reader->fd_ < 0 && errno != ENOENT)
+    return R::err(ioError("cannot open", path));
+  return R::ok(std::move(reader));
+}
+
+WalReader::~WalReader() {
+  if (fd_ >= 0)
+    closeFile(fd_);
+}
+
+Result<std::vector<WalRecord>> WalReader::read(size_t maxBytes,
+                                               uint64_t upToLsn) {
+  using R = Result<std::vector<WalRecord>>;
+  std::vector<WalRecord> out;
+  atEnd_ = true;
+  if (fd_ < 0 && (fd_ = openForRead(path_)) < 0) {
+    if (errno == ENOENT)
+      return R::ok(std::move(out));
+    return R::err(ioError("cannot open", path_));
+  }
+  buf_.erase(0, pos_);
+  pos_ = 0;
+  size_t bytes = 0;
+  bool eof = false;
+  WalRecord rec;
+  for (;;) {
+    if (!headerRead_ && buf_.size() >= kHeaderBytes) {
+      Status st = checkHeader(buf_, path_);
+      if (!st.ok())
+        return R::err(st);
+      pos_ = kHeaderBytes;
+      headerRead_ = true;
+    }
+    // Decode what is buffered, reading more only for an incomplete frame
+    size_t at = pos_;
+    if (headerRead_ && readFrame(buf_, at, dict_, rec)) {
+      if (static_cast<uint8_t>(rec.op) == kDictionaryOp) {
+        pos_ = at;
+        continue;
+      }
+      if (lsn_ >= upToLsn)
+        break;
+      const size_t frame = at - pos_;
+      pos_ = at;
+      if (++lsn_ <= skip_)
+        continue;
+      bytes += frame;
+      out.push_back(std::move(rec));
+      if (bytes >= maxBytes) {
+        atEnd_ = false;
+        break;
+      }
+      continue;
+    }
+    if (eof)
+      break;
+    if (pos_ >= (size_t{1} << 20)) {
+      buf_.erase(0, pos_);
+      pos_ = 0;
+    }
+    char chunk[1 << 16];
+    auto n = readSome(fd_, chunk, sizeof(chunk));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return R::err(ioError("cannot read", path_));
+    }
+    if (n == 0)
+      eof = true;
+    else
+      buf_.append(chunk, static_cast<size_t>(n));
+  }
+  return R::ok(std::move(out));
+}
+
+Result<std::vector<WalRecord>> decodeWalFrames(const std::string &data) {
+  using R = Result<std::vector<WalRecord>>;
+  Status st = checkHeader(data, "log image");
+  if (!st.ok())
+    return R::err(st);
+  std::vector<WalRecord> records;
+  const size_t end = scanFrames(
+      data, [&](WalRecord &&rec) { records.push_back(std::move(rec)); });
+  if (end != data.size())
+    return R::err(Status::InvalidArgument(
+        "Truncated or corrupt log image after byte " + std::to_string(end)));
+  return R::ok(std::move(records));
+}
+
+} // namespace kadedb
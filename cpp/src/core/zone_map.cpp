@@ -0,0 +1,76 @@
+#include "kadedb/zone_map.h"
+
+#include <cmath>
+
+namespace kadedb {
+namespace {
+
+bool isNumeric(ValueType t) {
+  return t == ValueType::Integer || t == ValueType::Float;
+}
+
+// Integers beyond 2^53 in magnitude compare differently against floats
+// than against each other
+bool isWide(const InlineValue &v) {
+  constexpr int64_t kExact = int64_t{1} << 53;
+  return v.type() == ValueType::Integer &&
+         (v.asInt() >= kExact || v.asInt() <= -kExact);
+}
+
+int sign(int c) { return c < 0 ? -1 : (c > 0 ? 1 : 0); }
+
+} // namespace
+
+void ColumnZone::add(const InlineValue &v) {
+  if (v.empty()) {
+    ++absent;
+    return;
+  }
+  ++present;
+  if (!ordered)
+    return;
+  if (v.type() == ValueType::Float && std::isnan(v.asFloat())) {
+    ordered = false; // compares equal to everything
+    return;
+  }
+  wideInts_ = wideInts_ || isWide(v);
+  if (present == 1) {
+    min = v;
+    max = v;
+    return;
+  }
+  if (v.type() != min.type() || v.type() != max.type()) {
+    if (!isNumeric(v.type()) || !isNumeric(min.type())) {
+      ordered = false;
+      return;
+    }
+    mixed_ = true;
+  }
+  if (mixed_ && wideInts_) {
+    ordered = false;
+    return;
+  }
+  if (v.compare(min) < 0)
+    min = v;
+  else if (v.compare(max) > 0)
+    max = v;
+}
+
+bool ColumnZone::compareRange(const InlineValue &rhs, int &lo,
+                              int &hi) const {
+  if (!ordered || present == 0 || rhs.empty())
+    return false;
+  lo = sign(min.compare(rhs));
+  hi = sign(max.compare(rhs));
+  return true;
+}
+
+void ZoneMap::add(const InlineRow &row) {
+  const auto &cells = row.values();
+  if (columns.size() < cells.size())
+    columns.resize(cells.size());
+  for (size_t c = 0; c < cells.size(); ++c)
+    columns[c].add(cells[c]);
+}
+
+} // namespace kadedb
@@ -1,5 +1,8 @@
 #include "kadedb/gpu.h"
 
+#include "kadedb/gpu_column_cache.h"
+#include "kadedb/scan_kernels.h"
+
 #include <algorithm>
 #include <atomic>
 #include <thread>
@@ -8,9 +11,25 @@
 
 namespace kadedb {
 
+#if defined(KADEDB_HAVE_CUDA_KERNELS)
+// Defined in gpu_kernels.cu
+namespace cuda {
+bool deviceAvailable();
+Status compareInt64(const GpuScanSpec &spec, uint64_t *out);
+Status compareInt64Resident(const int64_t *column, const GpuScanSpec &spec,
+                            uint64_t *out);
+Status timeBucketSumCount(const GpuTimeBucketAggSpec &spec,
+                          GpuTimeBucketAggResult &out);
+} // namespace cuda
+#endif
+
 GpuStatus gpuStatus() {
   GpuStatus st;
-#if defined(KADEDB_HAVE_CUDA)
+#if defined(KADEDB_HAVE_CUDA_KERNELS)
+  static const bool device = cuda::deviceAvailable();
+  st.available = device;
+  st.message = device ? "CUDA kernels enabled" : "No CUDA device found";
+#elif defined(KADEDB_HAVE_CUDA)
   st.available = true;
   st.message = "CUDA enabled";
 #else
@@ -38,11 +57,65 @@ static bool evalInt64(int64_t lhs, GpuScanSpec::Op op, int64_t rhs) {
   return false;
 }
 
+bool gpuOffloadPays(size_t rows, size_t bytesPerRow,
+                    const GpuOffloadModel &model) {
+  if (rows < model.minRows)
+    return false;
+  const double bytes =
+      static_cast<double>(rows) * static_cast<double>(bytesPerRow);
+  const double cores = std::max(1u, std::thread::hardware_concurrency());
+  const double cpu = bytes / (model.cpuBytesPerSecond * cores);
+  const double device = model.launchSeconds + bytes / model.busBytesPerSecond;
+  return device < cpu;
+}
+
+bool gpuShouldOffload(size_t rows, size_t bytesPerRow,
+                      const GpuOffloadModel &model) {
+#if defined(KADEDB_HAVE_CUDA_KERNELS)
+  return gpuStatus().available && gpuOffloadPays(rows, bytesPerRow, model);
+#else
+  (void)rows;
+  (void)bytesPerRow;
+  (void)model;
+  return false;
+#endif
+}
+
+Status gpuCompareInt64(const GpuScanSpec &spec, uint64_t *out) {
+#if defined(KADEDB_HAVE_CUDA_KERNELS)
+  if (!gpuStatus().available)
+    return Status::FailedPrecondition("No CUDA device found");
+  if (!spec.cacheKey.empty() && spec.count > 0) {
+    auto device = defaultGpuColumnCache().acquire(
+        spec.cacheKey, spec.cacheVersion, spec.column,
+        spec.count * sizeof(int64_t));
+    // Columns over the cache budget are copied per scan
+    if (device.hasValue())
+      return cuda::compareInt64Resident(
+          static_cast<const int64_t *>(device.value().get()), spec, out);
+  }
+  return cuda::compareInt64(spec, out);
+#else
+  (void)spec;
+  (void)out;
+  return Status::FailedPrecondition("Built without CUDA kernels");
+#endif
+}
+
 std::vector<size_t> gpuScanFilterInt64(const GpuScanSpec &spec) {
   std::vector<size_t> out;
   if (!spec.column || spec.count == 0)
     return out;
 
+  if (gpuShouldOffload(spec.count, sizeof(int64_t))) {
+    std::vector<uint64_t> bits((spec.count + 63) / 64);
+    if (gpuCompareInt64(spec, bits.data()).ok()) {
+      scan::forEachSetBit(bits.data(), bits.size(),
+                          [&](size_t i) { out.push_back(i); });
+      return out;
+    }
+  }
+
   const unsigned hw = std::max(1u, std::thread::hardware_concurrency());
   const size_t threads = std::min<size_t>(hw, spec.count);
   if (threads <= 1) {
@@ -92,6 +165,34 @@ GpuTimeBucketAggResult gpuTimeBucketSumCount(const GpuTimeBucketAggSpec &spec) {
   if (spec.endExclusive <= spec.startInclusive)
     return out;
 
+#if defined(KADEDB_HAVE_CUDA_KERNELS)
+  if (gpuShouldOffload(spec.count, sizeof(int64_t) + sizeof(double))) {
+    GpuTimeBucketAggResult device;
+    if (cuda::timeBucketSumCount(spec, device).ok())
+      return device;
+  }
+#endif
+
+  // Ascending timestamps, as a time-series column stores them: each bucket
+  // is a run of rows, reduced by the SIMD bucket kernel
+  const int64_t *ts = spec.timestamps;
+  if (std::is_sorted(ts, ts + spec.count)) {
+    const int64_t *first = std::lower_bound(ts, ts + spec.count,
+                                            spec.startInclusive);
+    const int64_t *last =
+        std::lower_bound(first, ts + spec.count, spec.endExclusive);
+    std::vector<scan::BucketAggregate> buckets;
+    scan::bucketAggregate(first, spec.values + (first - ts), nullptr,
+                          static_cast<size_t>(last - first),
+                          spec.startInclusive, spec.bucketWidth, buckets);
+    for (const auto &b : buckets) {
+      out.bucketStart.push_back(b.bucketStart);
+      out.sum.push_back(b.sum);
+      out.count.push_back(b.rows);
+    }
+    return out;
+  }
+
   const unsigned hw = std::max(1u, std::thread::hardware_concurrency());
   const size_t threads = std::min<size_t>(hw, spec.count);
 
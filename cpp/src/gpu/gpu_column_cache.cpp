@@ -0,0 +1,178 @@
+#include "kadedb/gpu_column_cache.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace kadedb {
+
+GpuColumnCache::MemoryOps GpuColumnCache::deviceOps() {
+  MemoryOps ops;
+  ops.mallocDevice = [](void *&out, size_t bytes) {
+    return gpuMallocDevice(out, bytes);
+  };
+  ops.freeDevice = [](void *p) { return gpuFreeDevice(p); };
+  ops.mallocPinned = [](void *&out, size_t bytes) {
+    return gpuMallocPinned(out, bytes);
+  };
+  ops.freePinned = [](void *p) { return gpuFreePinned(p); };
+  ops.streamCreate = [](GpuStreamHandle &out) { return gpuStreamCreate(out); };
+  ops.streamDestroy = [](GpuStreamHandle s) { return gpuStreamDestroy(s); };
+  ops.copyToDevice = [](void *dst, const void *src, size_t bytes,
+                        GpuStreamHandle s) {
+    return gpuMemcpyHtoDAsync(dst, src, bytes, s);
+  };
+  ops.synchronize = [](GpuStreamHandle s) { return gpuStreamSynchronize(s); };
+  return ops;
+}
+
+GpuColumnCache::GpuColumnCache(size_t budgetBytes, size_t stagingBytes,
+                               MemoryOps ops)
+    : ops_(std::move(ops)), budget_(budgetBytes),
+      stagingBytes_(std::max<size_t>(1, stagingBytes)) {}
+
+GpuColumnCache::~GpuColumnCache() {
+  clear();
+  for (auto &s : staging_) {
+    if (s.stream) {
+      ops_.synchronize(s.stream);
+      ops_.streamDestroy(s.stream);
+    }
+    if (s.buffer)
+      ops_.freePinned(s.buffer);
+  }
+}
+
+Status GpuColumnCache::ensureStaging() {
+  if (stagingReady_)
+    return Status::OK();
+  for (auto &s : staging_) {
+    if (!s.buffer)
+      if (auto st = ops_.mallocPinned(s.buffer, stagingBytes_); !st.ok())
+        return st;
+    if (!s.stream)
+      if (auto st = ops_.streamCreate(s.stream); !st.ok())
+        return st;
+  }
+  stagingReady_ = true;
+  return Status::OK();
+}
+
+Status GpuColumnCache::upload(void *device, const void *host, size_t bytes) {
+  if (auto st = ensureStaging(); !st.ok())
+    return st;
+  const auto *src = static_cast<const char *>(host);
+  auto *dst = static_cast<char *>(device);
+  Status failed = Status::OK();
+  size_t k = 0;
+  for (size_t off = 0; off < bytes && failed.ok(); off += stagingBytes_) {
+    Staging &s = staging_[k];
+    k ^= 1;
+    // The buffer is free again once its previous copy completed
+    if (failed = ops_.synchronize(s.stream); !failed.ok())
+      break;
+    const size_t n = std::min(stagingBytes_, bytes - off);
+    std::memcpy(s.buffer, src + off, n);
+    failed = ops_.copyToDevice(dst + off, s.buffer, n, s.stream);
+  }
+  for (auto &s : staging_) {
+    Status st = ops_.synchronize(s.stream);
+    if (failed.ok())
+      failed = st;
+  }
+  return failed;
+}
+
+void GpuColumnCache::erase(std::list<Entry>::iterator it) {
+  stats_.residentBytes -= it->bytes;
+  index_.erase(it->key);
+  lru_.erase(it);
+}
+
+void GpuColumnCache::evictTo(size_t bytes) {
+  while (!lru_.empty() && stats_.residentBytes > bytes) {
+    erase(std::prev(lru_.end()));
+    ++stats_.evictions;
+  }
+}
+
+Result<std::shared_ptr<const void>>
+GpuColumnCache::acquire(const std::string &key, uint64_t version,
+                        const void *host, size_t bytes) {
+  using R = Result<std::shared_ptr<const void>>;
+  std::lock_guard<std::mutex> lk(mtx_);
+  auto found = index_.find(key);
+  if (found != index_.end()) {
+    auto it = found->second;
+    if (it->version == version && it->bytes == bytes) {
+      lru_.splice(lru_.begin(), lru_, it);
+      ++stats_.hits;
+      return R::ok(it->device);
+    }
+    erase(it); // stale copy
+  }
+  ++stats_.misses;
+  if (bytes == 0 || !host)
+    return R::err(Status::InvalidArgument("Nothing to cache for " + key));
+  if (bytes > budget_)
+    return R::err(
+        Status::FailedPrecondition("Column exceeds the GPU cache budget"));
+
+  evictTo(budget_ - bytes);
+  void *raw = nullptr;
+  if (auto st = ops_.mallocDevice(raw, bytes); !st.ok())
+    return R::err(st);
+  auto freeDevice = ops_.freeDevice;
+  std::shared_ptr<const void> device(
+      raw, [freeDevice](const void *p) { freeDevice(const_cast<void *>(p)); });
+  if (auto st = upload(raw, host, bytes); !st.ok())
+    return R::err(st);
+
+  lru_.push_front(Entry{key, version, bytes, device});
+  index_[key] = lru_.begin();
+  stats_.residentBytes += bytes;
+  return R::ok(std::move(device));
+}
+
+void GpuColumnCache::invalidate(const std::string &key) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  auto it = index_.find(key);
+  if (it != index_.end())
+    erase(it->second);
+}
+
+void GpuColumnCache::clear() {
+  std::lock_guard<std::mutex> lk(mtx_);
+  lru_.clear();
+  index_.clear();
+  stats_.residentBytes = 0;
+}
+
+size_t GpuColumnCache::budget() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return budget_;
+}
+
+void GpuColumnCache::setBudget(size_t budgetBytes) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  budget_ = budgetBytes;
+  evictTo(budget_);
+}
+
+GpuColumnCache::Stats GpuColumnCache::stats() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  Stats out = stats_;
+  out.entries = lru_.size();
+  return out;
+}
+
+GpuColumnCache &defaultGpuColumnCache() {
+  static GpuColumnCache cache([] {
+    const char *env = std::getenv("KADEDB_GPU_CACHE_BYTES");
+    return env ? static_cast<size_t>(std::strtoull(env, nullptr, 10))
+               : size_t{1} << 30;
+  }());
+  return cache;
+}
+
+} // namespace kadedb
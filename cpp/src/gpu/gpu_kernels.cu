@@ -0,0 +1,202 @@
+// Device kernels behind kadedb/gpu.h, built only when a CUDA compiler is
+// found (KADEDB_HAVE_CUDA_KERNELS)
+
+#include "kadedb/gpu.h"
+#include "kadedb/status.h"
+
+#include <cuda_runtime.h>
+
+#include <string>
+#include <vector>
+
+namespace kadedb {
+namespace cuda {
+namespace {
+
+constexpr unsigned kThreads = 256; // a multiple of the warp size
+// Bucket arrays beyond this stay on the CPU
+constexpr size_t kMaxDeviceBuckets = size_t{1} << 24;
+
+Status check(cudaError_t e, const char *what) {
+  if (e == cudaSuccess)
+    return Status::OK();
+  return Status::Internal(std::string(what) + ": " + cudaGetErrorString(e));
+}
+
+// Device allocation freed on scope exit
+template <typename T> struct DeviceBuffer {
+  T *ptr = nullptr;
+  DeviceBuffer() = default;
+  DeviceBuffer(const DeviceBuffer &) = delete;
+  DeviceBuffer &operator=(const DeviceBuffer &) = delete;
+  ~DeviceBuffer() {
+    if (ptr)
+      cudaFree(ptr);
+  }
+  Status alloc(size_t n) {
+    return check(cudaMalloc(reinterpret_cast<void **>(&ptr), n * sizeof(T)),
+                 "cudaMalloc");
+  }
+};
+
+unsigned blocksFor(size_t n) {
+  return static_cast<unsigned>((n + kThreads - 1) / kThreads);
+}
+
+__device__ bool matches(int64_t lhs, GpuScanSpec::Op op, int64_t rhs) {
+  switch (op) {
+  case GpuScanSpec::Op::Eq:
+    return lhs == rhs;
+  case GpuScanSpec::Op::Ne:
+    return lhs != rhs;
+  case GpuScanSpec::Op::Lt:
+    return lhs < rhs;
+  case GpuScanSpec::Op::Le:
+    return lhs <= rhs;
+  case GpuScanSpec::Op::Gt:
+    return lhs > rhs;
+  case GpuScanSpec::Op::Ge:
+    return lhs >= rhs;
+  }
+  return false;
+}
+
+// One thread per row; each warp writes the 32 bits of its rows. Blocks are
+// warp-aligned, so warp w covers rows [32w, 32w + 32).
+__global__ void compareKernel(const int64_t *column, size_t n,
+                              GpuScanSpec::Op op, int64_t rhs,
+                              uint32_t *out) {
+  const size_t i = static_cast<size_t>(blockIdx.x) * blockDim.x + threadIdx.x;
+  const bool hit = i < n && matches(column[i], op, rhs);
+  const unsigned bits = __ballot_sync(0xffffffffu, hit);
+  if ((threadIdx.x & 31u) == 0 && i < n)
+    out[i / 32] = bits;
+}
+
+__global__ void bucketKernel(const int64_t *timestamps, const double *values,
+                             size_t n, int64_t start, int64_t end,
+                             int64_t width, double *sums,
+                             unsigned long long *counts) {
+  const size_t i = static_cast<size_t>(blockIdx.x) * blockDim.x + threadIdx.x;
+  if (i >= n)
+    return;
+  const int64_t ts = timestamps[i];
+  if (ts < start || ts >= end)
+    return;
+  const size_t b = static_cast<size_t>((ts - start) / width);
+  atomicAdd(&sums[b], values[i]);
+  atomicAdd(&counts[b], 1ull);
+}
+
+} // namespace
+
+bool deviceAvailable() {
+  int devices = 0;
+  return cudaGetDeviceCount(&devices) == cudaSuccess && devices > 0;
+}
+
+Status compareInt64Resident(const int64_t *column, const GpuScanSpec &spec,
+                            uint64_t *out) {
+  const size_t n = spec.count;
+  if (n == 0)
+    return Status::OK();
+  // Two 32-bit device words per 64-bit host word (little-endian hosts)
+  const size_t words = (n + 63) / 64;
+  DeviceBuffer<uint32_t> bits;
+  Status st = bits.alloc(words * 2);
+  if (st.ok())
+    st = check(cudaMemset(bits.ptr, 0, words * sizeof(uint64_t)),
+               "cudaMemset");
+  if (!st.ok())
+    return st;
+  compareKernel<<<blocksFor(n), kThreads>>>(column, n, spec.op, spec.rhs,
+                                            bits.ptr);
+  st = check(cudaGetLastError(), "compareKernel");
+  if (!st.ok())
+    return st;
+  return check(cudaMemcpy(out, bits.ptr, words * sizeof(uint64_t),
+                          cudaMemcpyDeviceToHost),
+               "cudaMemcpy");
+}
+
+Status compareInt64(const GpuScanSpec &spec, uint64_t *out) {
+  const size_t n = spec.count;
+  if (n == 0)
+    return Status::OK();
+  DeviceBuffer<int64_t> column;
+  Status st = column.alloc(n);
+  if (st.ok())
+    st = check(cudaMemcpy(column.ptr, spec.column, n * sizeof(int64_t),
+                          cudaMemcpyHostToDevice),
+               "cudaMemcpy");
+  if (!st.ok())
+    return st;
+  return compareInt64Resident(column.ptr, spec, out);
+}
+
+Status timeBucketSumCount(const GpuTimeBucketAggSpec &spec,
+                          GpuTimeBucketAggResult &out) {
+  const size_t n = spec.count;
+  const uint64_t span = static_cast<uint64_t>(spec.endExclusive) -
+                        static_cast<uint64_t>(spec.startInclusive);
+  const uint64_t buckets =
+      (span - 1) / static_cast<uint64_t>(spec.bucketWidth) + 1;
+  if (buckets > kMaxDeviceBuckets)
+    return Status::FailedPrecondition("Too many buckets for the device");
+  DeviceBuffer<int64_t> timestamps;
+  DeviceBuffer<double> values, sums;
+  DeviceBuffer<unsigned long long> counts;
+  Status st = timestamps.alloc(n);
+  if (st.ok())
+    st = values.alloc(n);
+  if (st.ok())
+    st = sums.alloc(buckets);
+  if (st.ok())
+    st = counts.alloc(buckets);
+  if (st.ok())
+    st = check(cudaMemcpy(timestamps.ptr, spec.timestamps, n * sizeof(int64_t),
+                          cudaMemcpyHostToDevice),
+               "cudaMemcpy");
+  if (st.ok())
+    st = check(cudaMemcpy(values.ptr, spec.values, n * sizeof(double),
+                          cudaMemcpyHostToDevice),
+               "cudaMemcpy");
+  if (st.ok())
+    st = check(cudaMemset(sums.ptr, 0, buckets * sizeof(double)),
+               "cudaMemset");
+  if (st.ok())
+    st = check(cudaMemset(counts.ptr, 0, buckets * sizeof(unsigned long long)),
+               "cudaMemset");
+  if (!st.ok())
+    return st;
+  bucketKernel<<<blocksFor(n), kThreads>>>(
+      timestamps.ptr, values.ptr, n, spec.startInclusive, spec.endExclusive,
+      spec.bucketWidth, sums.ptr, counts.ptr);
+  st = check(cudaGetLastError(), "bucketKernel");
+
+  std::vector<double> hostSums(buckets);
+  std::vector<unsigned long long> hostCounts(buckets);
+  if (st.ok())
+    st = check(cudaMemcpy(hostSums.data(), sums.ptr, buckets * sizeof(double),
+                          cudaMemcpyDeviceToHost),
+               "cudaMemcpy");
+  if (st.ok())
+    st = check(cudaMemcpy(hostCounts.data(), counts.ptr,
+                          buckets * sizeof(unsigned long long),
+                          cudaMemcpyDeviceToHost),
+               "cudaMemcpy");
+  if (!st.ok())
+    return st;
+  for (size_t b = 0; b < buckets; ++b) {
+    if (hostCounts[b] == 0)
+      continue;
+    out.bucketStart.push_back(spec.startInclusive +
+                              static_cast<int64_t>(b) * spec.bucketWidth);
+    out.sum.push_back(hostSums[b]);
+    out.count.push_back(static_cast<int64_t>(hostCounts[b]));
+  }
+  return Status::OK();
+}
+
+} // namespace cuda
+} // namespace kadedb
@@ -0,0 +1,189 @@
+#include "kadedb/admission.h"
+#include "kadedb/cancellation.h"
+#include "kadedb/kadeql.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+using namespace std::chrono_literals;
+
+static Result<ResultSet> run(QueryExecutor &exec, const std::string &q) {
+  return exec.execute(*parseQuery(q));
+}
+
+static bool cancelled(const Result<ResultSet> &res, const std::string &what) {
+  return !res.hasValue() && res.status().code() == StatusCode::Cancelled &&
+         res.status().message().find(what) != std::string::npos;
+}
+
+int main() {
+  std::cout << "=== Admission Control Tests ===" << std::endl;
+
+  // t(id, grp, v): 200k rows, id indexed
+  InMemoryRelationalStorage st;
+  TableSchema schema({Column{"id", ColumnType::Integer, false, false, {}},
+                      Column{"grp", ColumnType::Integer, true, false, {}},
+                      Column{"v", ColumnType::Integer, true, false, {}}});
+  assert(st.createTable("t", schema).ok());
+  std::vector<Row> rows;
+  for (int64_t i = 0; i < 200000; ++i) {
+    Row r(3);
+    r.set(0, ValueFactory::createInteger(i));
+    r.set(1, ValueFactory::createInteger(i % 1000));
+    r.set(2, ValueFactory::createInteger(i % 7));
+    rows.push_back(std::move(r));
+  }
+  assert(st.insertRows("t", rows).ok());
+  assert(st.createIndex("t", "id", IndexType::Ordered).ok());
+
+  std::cout << "Test 1: interrupt scopes..." << std::endl;
+  {
+    assert(InterruptScope::check().ok());
+    int checks = 0;
+    {
+      InterruptScope outer([&] {
+        return ++checks > 3 ? Status::Cancelled("outer") : Status::OK();
+      });
+      InterruptScope inner([] { return Status::OK(); });
+      assert(InterruptScope::check().ok());
+      // A full scan still polls while no row matches (an expression is
+      // not pruned by zone maps)
+      QueryExecutor exec(st);
+      auto res = run(exec, "SELECT id FROM t WHERE v + 1 = 100");
+      assert(cancelled(res, "outer"));
+      assert(checks > 3);
+    }
+    assert(InterruptScope::check().ok());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: cancellation and deadlines..." << std::endl;
+  {
+    QueryExecutor exec(st);
+    CancellationToken token;
+    exec.setCancellationToken(token);
+    assert(run(exec, "SELECT COUNT(*) FROM t").hasValue());
+    token.cancel();
+    assert(cancelled(run(exec, "SELECT COUNT(*) FROM t"), "cancelled"));
+    // Writes do not start either
+    assert(cancelled(run(exec, "INSERT INTO t (id, grp, v) VALUES (-5, 1, 1)"),
+                     "cancelled"));
+    assert(st.estimateRowCount("t") == 200000u);
+
+    // Cancelled from another thread while the aggregation scans
+    QueryExecutor other(st);
+    CancellationToken later;
+    other.setCancellationToken(later);
+    std::thread canceller([&] {
+      std::this_thread::sleep_for(2ms);
+      later.cancel();
+    });
+    std::optional<Result<ResultSet>> res;
+    for (int i = 0; i < 1000 && (!res || res->hasValue()); ++i)
+      res.emplace(run(other, "SELECT grp, SUM(v) FROM t GROUP BY grp "
+                             "ORDER BY grp"));
+    canceller.join();
+    assert(cancelled(*res, "cancelled"));
+
+    QueryExecutor timed(st);
+    timed.setTimeout(1ms);
+    assert(cancelled(run(timed, "SELECT grp, COUNT(*) FROM t GROUP BY grp"),
+                     "timed out after 1 ms"));
+    // A point lookup finishes well within it
+    timed.setTimeout(10s);
+    auto point = run(timed, "SELECT v FROM t WHERE id = 42");
+    assert(point.hasValue() && point.value().rowCount() == 1);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: estimated scan cost..." << std::endl;
+  {
+    Predicate eq;
+    eq.kind = Predicate::Kind::Comparison;
+    eq.column = "id";
+    eq.op = Predicate::Op::Eq;
+    eq.rhs = ValueFactory::createInteger(7);
+    assert(st.estimateScanCost("t", std::move(eq)) == 1u);
+    Predicate unindexed;
+    unindexed.kind = Predicate::Kind::Comparison;
+    unindexed.column = "v";
+    unindexed.op = Predicate::Op::Eq;
+    unindexed.rhs = ValueFactory::createInteger(7);
+    assert(st.estimateScanCost("t", std::move(unindexed)) == 200000u);
+    assert(st.estimateScanCost("t", std::nullopt) == 200000u);
+    assert(!st.estimateScanCost("missing", std::nullopt));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: heavy queries queue, point lookups do not..."
+            << std::endl;
+  {
+    AdmissionOptions options;
+    options.heavyRows = 1000;
+    options.maxHeavy = 1;
+    AdmissionController admission(options);
+    // Occupy the only heavy slot
+    auto held = admission.admit(std::nullopt);
+    assert(held.hasValue() && held.value().heavy());
+    assert(admission.running() == 1);
+
+    QueryExecutor exec(st);
+    exec.setAdmissionController(admission);
+    auto point = run(exec, "SELECT v FROM t WHERE id = 42");
+    assert(point.hasValue() && point.value().rowCount() == 1);
+    auto range = run(exec, "SELECT COUNT(*) FROM t WHERE id < 100");
+    assert(range.hasValue() && range.value().at(0, 0).asInt() == 100);
+    assert(admission.admittedLight() == 2);
+
+    // A heavy query gives up at its deadline
+    exec.setTimeout(30ms);
+    assert(cancelled(run(exec, "SELECT COUNT(*) FROM t WHERE v = 3"),
+                     "waiting for admission"));
+    assert(admission.rejected() == 1 && admission.queued() == 0);
+
+    // ... or runs once the slot frees up
+    exec.setTimeout(0ms);
+    std::optional<Result<ResultSet>> heavy;
+    std::thread waiter([&] {
+      heavy.emplace(run(exec, "SELECT COUNT(*) FROM t WHERE v = 3"));
+    });
+    while (admission.queued() == 0)
+      std::this_thread::sleep_for(1ms);
+    assert(!heavy);
+    held.value().release();
+    waiter.join();
+    assert(heavy->hasValue() && heavy->value().at(0, 0).asInt() > 0);
+    assert(admission.admittedHeavy() == 2 && admission.running() == 0);
+
+    // Waiting queries can be cancelled
+    auto again = admission.admit(std::nullopt);
+    CancellationToken token;
+    exec.setCancellationToken(token);
+    std::optional<Result<ResultSet>> waiting;
+    std::thread stuck(
+        [&] { waiting.emplace(run(exec, "SELECT COUNT(*) FROM t")); });
+    while (admission.queued() == 0)
+      std::this_thread::sleep_for(1ms);
+    token.cancel();
+    stuck.join();
+    assert(cancelled(*waiting, "waiting for admission"));
+    assert(admission.queued() == 0 && admission.running() == 1);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "All admission control tests passed." << std::endl;
+  return 0;
+}
@@ -0,0 +1,293 @@
+#include "kadedb/distributed.h"
+#include "kadedb/kadeql.h"
+#include "kadedb/logged_storage.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/schema.h"
+#include "kadedb/statistics.h"
+#include "kadedb/storage.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/value.h"
+#include "kadedb/wal.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+
+// (timestamp, bed STRING, hr FLOAT nullable, steps INTEGER)
+static TimeSeriesSchema vitalsSchema() {
+  TimeSeriesSchema schema("timestamp", TimeGranularity::Seconds);
+  schema.addTagColumn(Column{"bed", ColumnType::String, true, false, {}});
+  schema.addValueColumn(Column{"hr", ColumnType::Float, true, false, {}});
+  schema.addValueColumn(Column{"steps", ColumnType::Integer, true, false, {}});
+  return schema;
+}
+
+// hr takes (ts * 7919) % 5000 / 10, so 5000 distinct values; every 50th is
+// missing
+static Row vital(int64_t ts) {
+  Row r(4);
+  r.set(0, ValueFactory::createInteger(ts));
+  r.set(1, ValueFactory::createString(ts % 2 ? "b1" : "b2"));
+  if (ts % 50 != 7)
+    r.set(2, ValueFactory::createFloat(
+                 static_cast<double>((ts * 7919) % 5000) / 10.0));
+  r.set(3, ValueFactory::createInteger(ts % 11));
+  return r;
+}
+
+static void fill(TimeSeriesStorage &ts, const std::string &series,
+                 int64_t from, int64_t to) {
+  for (int64_t t = from; t < to; ++t)
+    assert(ts.append(series, vital(t)).ok());
+}
+
+// Fraction of `sorted` below `x`
+static double rankOf(const std::vector<double> &sorted, double x) {
+  auto it = std::lower_bound(sorted.begin(), sorted.end(), x);
+  return static_cast<double>(it - sorted.begin()) /
+         static_cast<double>(sorted.size());
+}
+
+static ResultSet run(QueryExecutor &exec, const std::string &q) {
+  auto res = exec.execute(*parseQuery(q));
+  assert(res.hasValue());
+  return res.takeValue();
+}
+
+static StatusCode fails(QueryExecutor &exec, const std::string &q) {
+  auto res = exec.execute(*parseQuery(q));
+  assert(!res.hasValue());
+  return res.status().code();
+}
+
+int main() {
+  std::cout << "=== Approximate Aggregate Tests ===" << std::endl;
+
+  std::cout << "Test 1: t-digest quantiles..." << std::endl;
+  {
+    TDigest empty;
+    assert(empty.empty() && std::isnan(empty.quantile(0.5)));
+
+    std::mt19937_64 rng(42);
+    std::lognormal_distribution<double> dist(0.0, 1.0);
+    std::vector<double> all;
+    TDigest whole, left, right;
+    for (int i = 0; i < 200000; ++i) {
+      double x = dist(rng);
+      all.push_back(x);
+      whole.add(x);
+      (i % 3 ? left : right).add(x);
+    }
+    left.merge(right);
+    std::sort(all.begin(), all.end());
+    assert(whole.count() == 200000 && left.count() == 200000);
+    assert(whole.quantile(0.0) == all.front());
+    assert(whole.quantile(1.0) == all.back());
+    // Well under 1% rank error, tighter still in the tails
+    for (double q : {0.001, 0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99, 0.999}) {
+      double bound = (q < 0.05 || q > 0.95) ? 0.001 : 0.01;
+      assert(std::abs(rankOf(all, whole.quantile(q)) - q) < bound);
+      assert(std::abs(rankOf(all, left.quantile(q)) - q) < bound);
+    }
+    // Bounded memory however many values it saw
+    assert(whole.bytes() < 16 * 1024);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: time-series approximate aggregations..." << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    assert(ts.createSeries("v", vitalsSchema(), TimePartition::Hourly).ok());
+    fill(ts, "v", 0, 6 * 3600);
+
+    std::vector<double> hr;
+    for (int64_t t = 0; t < 6 * 3600; ++t)
+      if (t % 50 != 7)
+        hr.push_back(static_cast<double>((t * 7919) % 5000) / 10.0);
+    std::sort(hr.begin(), hr.end());
+    std::vector<double> unique = hr;
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+    const double exact = static_cast<double>(unique.size());
+
+    const auto S = TimeGranularity::Seconds;
+    auto distinct =
+        ts.aggregate("v", "hr", TimeAggregation::ApproxCountDistinct, 0,
+                     6 * 3600, 6 * 3600, S, std::nullopt);
+    assert(distinct.hasValue() && distinct.value().rowCount() == 1);
+    double est = static_cast<double>(distinct.value().at(0, 1).asInt());
+    assert(std::abs(est - exact) / exact < 0.05);
+
+    // Integer cells equal to a Float count once: steps holds 11 values
+    auto steps = ts.aggregate("v", "steps",
+                              TimeAggregation::ApproxCountDistinct, 0, 3600,
+                              3600, S, std::nullopt);
+    assert(steps.value().at(0, 1).asInt() == 11);
+
+    for (double q : {0.01, 0.5, 0.95}) {
+      auto p = ts.aggregate("v", "hr", TimeAggregation::ApproxPercentile, 0,
+                            6 * 3600, 6 * 3600, S, std::nullopt, q);
+      assert(p.hasValue());
+      assert(std::abs(rankOf(hr, p.value().at(0, 1).asFloat()) - q) < 0.01);
+    }
+
+    // Parallel partition scans and predicates agree with the exact answer
+    ts.setScanThreads(4);
+    std::optional<Predicate> above(Predicate{});
+    above->column = "hr";
+    above->op = Predicate::Op::Gt;
+    above->rhs = ValueFactory::createFloat(250.0);
+    auto p = ts.aggregate("v", "hr", TimeAggregation::ApproxPercentile, 0,
+                          6 * 3600, 6 * 3600, S, above, 0.5);
+    double median = p.value().at(0, 1).asFloat();
+    assert(median > 360.0 && median < 390.0);
+
+    auto bad = ts.aggregate("v", "hr", TimeAggregation::ApproxPercentile, 0,
+                            3600, 3600, S, std::nullopt, 1.5);
+    assert(bad.status().code() == StatusCode::InvalidArgument);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: continuous aggregates with sketches..." << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    const auto S = TimeGranularity::Seconds;
+    assert(
+        ts.createSeries("rolled", vitalsSchema(), TimePartition::Hourly).ok());
+    assert(
+        ts.createSeries("plain", vitalsSchema(), TimePartition::Hourly).ok());
+    fill(ts, "rolled", 0, 3600);
+    fill(ts, "plain", 0, 3600);
+    assert(ts.createContinuousAggregate("plain", "hr", 600, S).ok());
+    size_t before = ts.memoryUsage("rolled").value();
+    assert(ts.createContinuousAggregate("rolled", "hr", 600, S, true).ok());
+    assert(ts.memoryUsage("rolled").value() > before + 6 * 1024);
+    fill(ts, "rolled", 3600, 2 * 3600);
+    fill(ts, "plain", 3600, 2 * 3600);
+
+    auto rolled = ts.continuousAggregate("rolled", "hr", 1800, 0, 7200);
+    assert(rolled.hasValue() && rolled.value().size() == 4);
+    for (const auto &b : rolled.value())
+      assert(b.distinct && b.digest && b.digest->count() == b.values);
+    auto plain = ts.continuousAggregate("plain", "hr", 600, 0, 7200);
+    assert(!plain.value()[0].distinct && !plain.value()[0].digest);
+
+    // Buckets merge their sketches the way rows fold into them
+    for (auto agg : {TimeAggregation::ApproxCountDistinct,
+                     TimeAggregation::ApproxPercentile}) {
+      auto a = ts.aggregate("rolled", "hr", agg, 0, 7200, 1800, S,
+                            std::nullopt, 0.9);
+      auto b = ts.aggregate("plain", "hr", agg, 0, 7200, 1800, S, std::nullopt,
+                            0.9);
+      assert(a.value().rowCount() == 4 && b.value().rowCount() == 4);
+      for (size_t r = 0; r < 4; ++r) {
+        double x = a.value().at(r, 1).asFloat();
+        double y = b.value().at(r, 1).asFloat();
+        assert(std::abs(x - y) <= 0.02 * std::max(x, y));
+      }
+    }
+
+    // The sketches survive WAL replay
+    auto path = (std::filesystem::temp_directory_path() /
+                 "kadedb_approx_aggregate_test.log")
+                    .string();
+    std::filesystem::remove(path);
+    {
+      auto wal = WriteAheadLog::open(path, {}).takeValue();
+      InMemoryTimeSeriesStorage base;
+      LoggedTimeSeriesStorage logged(base, *wal);
+      assert(logged.createSeries("v", vitalsSchema()).ok());
+      assert(logged.createContinuousAggregate("v", "hr", 600, S, true).ok());
+      assert(logged.createContinuousAggregate("v", "steps", 600, S).ok());
+      fill(logged, "v", 0, 1200);
+    }
+    InMemoryTimeSeriesStorage replayed;
+    assert(replayWal(path, {nullptr, nullptr, &replayed, nullptr}).hasValue());
+    auto hrBuckets = replayed.continuousAggregate("v", "hr", 600, 0, 1200);
+    assert(hrBuckets.value().size() == 2 && hrBuckets.value()[0].distinct);
+    auto stepBuckets = replayed.continuousAggregate("v", "steps", 600, 0, 1200);
+    assert(!stepBuckets.value()[0].distinct);
+    std::filesystem::remove(path);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: KadeQL APPROX_COUNT_DISTINCT and APPROX_PERCENTILE..."
+            << std::endl;
+  {
+    InMemoryRelationalStorage st;
+    InMemoryTimeSeriesStorage ts;
+    assert(
+        ts.createSeries("rolled", vitalsSchema(), TimePartition::Hourly).ok());
+    assert(ts.createSeries("raw", vitalsSchema(), TimePartition::Hourly).ok());
+    assert(ts.createContinuousAggregate("rolled", "hr", 300,
+                                        TimeGranularity::Seconds, true)
+               .ok());
+    fill(ts, "rolled", 0, 2 * 3600);
+    fill(ts, "raw", 0, 2 * 3600);
+    QueryExecutor exec(st, ts);
+
+    auto grouped = run(exec, "SELECT bed, APPROX_COUNT_DISTINCT(steps) AS d, "
+                             "APPROX_PERCENTILE(hr, 0.5) AS m FROM raw "
+                             "GROUP BY bed ORDER BY bed");
+    assert(grouped.rowCount() == 2);
+    assert(grouped.columnTypes()[1] == ColumnType::Integer);
+    assert(grouped.columnTypes()[2] == ColumnType::Float);
+    for (size_t r = 0; r < 2; ++r) {
+      assert(grouped.at(r, 1).asInt() == 11);
+      double m = grouped.at(r, 2).asFloat();
+      assert(m > 240.0 && m < 260.0);
+    }
+    auto having = run(exec, "SELECT bed, APPROX_COUNT_DISTINCT(steps) AS d "
+                            "FROM raw GROUP BY bed HAVING d > 11");
+    assert(having.rowCount() == 0);
+
+    // Aligned TIME_BUCKET queries read the sketches of the rollup
+    const std::string q = "SELECT TIME_BUCKET(timestamp, 900) AS b, "
+                          "APPROX_COUNT_DISTINCT(hr) AS d, "
+                          "APPROX_PERCENTILE(hr, 0.25) AS p FROM ";
+    auto plan = run(exec, "EXPLAIN " + q + "rolled GROUP BY b");
+    assert(plan.at(0, 2).asString().rfind("continuous aggregate of hr", 0) ==
+           0);
+    auto a = run(exec, q + "rolled GROUP BY b ORDER BY b");
+    auto b = run(exec, q + "raw GROUP BY b ORDER BY b");
+    assert(a.rowCount() == 8 && b.rowCount() == 8);
+    for (size_t r = 0; r < 8; ++r) {
+      double x = static_cast<double>(a.at(r, 1).asInt());
+      double y = static_cast<double>(b.at(r, 1).asInt());
+      assert(std::abs(x - y) <= 0.02 * y);
+      assert(std::abs(a.at(r, 2).asFloat() - b.at(r, 2).asFloat()) < 10.0);
+    }
+    // Without a rollup the series folds its rows into sketched buckets
+    plan = run(exec, "EXPLAIN " + q + "raw GROUP BY b");
+    assert(plan.at(0, 2).asString().rfind("bucket statistics of hr", 0) ==
+           0);
+
+    assert(fails(exec, "SELECT APPROX_COUNT_DISTINCT(hr, steps) FROM raw") ==
+           StatusCode::InvalidArgument);
+    assert(fails(exec, "SELECT APPROX_PERCENTILE(hr) FROM raw") ==
+           StatusCode::InvalidArgument);
+    assert(fails(exec, "SELECT APPROX_PERCENTILE(hr, steps) FROM raw") ==
+           StatusCode::InvalidArgument);
+    assert(fails(exec, "SELECT APPROX_PERCENTILE(hr, 2) FROM raw") ==
+           StatusCode::InvalidArgument);
+    assert(fails(exec, "SELECT APPROX_PERCENTILE(bed, 0.5) FROM raw") ==
+           StatusCode::InvalidArgument);
+
+    auto distributed = DistributedQuery::plan(
+        "SELECT bed, APPROX_COUNT_DISTINCT(hr) FROM raw GROUP BY bed");
+    assert(distributed.status().code() == StatusCode::InvalidArgument);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll approximate aggregate tests passed!" << std::endl;
+  return 0;
+}
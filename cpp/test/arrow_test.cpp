@@ -0,0 +1,408 @@
+#include "kadedb/arrow.h"
+
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+
+// Counts the bulk entry points the importer picks, delegating to an
+// in-memory store
+class CountingSeries final : public TimeSeriesStorage {
+public:
+  Status createSeries(const std::string &series, const TimeSeriesSchema &schema,
+                      TimePartition partition) override {
+    return impl.createSeries(series, schema, partition);
+  }
+  Status dropSeries(const std::string &series) override {
+    return impl.dropSeries(series);
+  }
+  std::vector<std::string> listSeries() const override {
+    return impl.listSeries();
+  }
+  Status append(const std::string &series, const Row &row) override {
+    return impl.append(series, row);
+  }
+  Status appendBatch(const std::string &series,
+                     const std::vector<Row> &rows) override {
+    ++batches;
+    return impl.appendBatch(series, rows);
+  }
+  Status appendColumns(const std::string &series, const int64_t *ts,
+                       const double *const *values, size_t n) override {
+    ++columnCalls;
+    return impl.appendColumns(series, ts, values, n);
+  }
+  Result<ResultSet> rangeQuery(const std::string &series,
+                               const std::vector<std::string> &columns,
+                               int64_t startInclusive, int64_t endExclusive,
+                               const std::optional<Predicate> &where) override {
+    return impl.rangeQuery(series, columns, startInclusive, endExclusive,
+                           where);
+  }
+  Result<TimeSeriesSchema>
+  getSeriesSchema(const std::string &series) const override {
+    return impl.getSeriesSchema(series);
+  }
+  Result<ResultSet> aggregate(const std::string &series,
+                              const std::string &valueColumn,
+                              TimeAggregation agg, int64_t startInclusive,
+                              int64_t endExclusive, int64_t bucketWidth,
+                              TimeGranularity bucketGranularity,
+                              const std::optional<Predicate> &where,
+                              double quantile) override {
+    return impl.aggregate(series, valueColumn, agg, startInclusive,
+                          endExclusive, bucketWidth, bucketGranularity, where,
+                          quantile);
+  }
+
+  InMemoryTimeSeriesStorage impl;
+  size_t batches = 0;
+  size_t columnCalls = 0;
+};
+
+static bool bit(const void *bits, int64_t i) {
+  return (static_cast<const uint8_t *>(bits)[i >> 3] >> (i & 7)) & 1;
+}
+
+static std::string rowsOf(const ResultSet &rs) {
+  std::string out;
+  for (const auto &row : rs) {
+    out += "\n ";
+    for (const auto &v : row.values())
+      out += " " + (v ? v->toString() : "null");
+  }
+  return out;
+}
+
+static TableSchema patientsSchema() {
+  std::vector<Column> cols{
+      Column{"id", ColumnType::Integer, false, true, {}},
+      Column{"name", ColumnType::String, true, false, {}},
+      Column{"weight", ColumnType::Float, true, false, {}},
+      Column{"active", ColumnType::Boolean, true, false, {}},
+  };
+  return TableSchema(cols, std::string("id"));
+}
+
+static Row patient(int64_t id) {
+  Row r(4);
+  r.set(0, ValueFactory::createInteger(id));
+  if (id % 5)
+    r.set(1, ValueFactory::createString("patient " + std::to_string(id)));
+  r.set(2, ValueFactory::createFloat(50.0 + id * 0.5));
+  if (id % 3)
+    r.set(3, ValueFactory::createBoolean(id % 2 == 0));
+  return r;
+}
+
+static void testExportLayout() {
+  std::cout << "Test 1: Result sets export as Arrow struct arrays"
+            << std::endl;
+  InMemoryRelationalStorage rel;
+  assert(rel.createTable("patients", patientsSchema()).ok());
+  for (int64_t i = 0; i < 100; ++i)
+    assert(rel.insertRow("patients", patient(i)).ok());
+  auto rs = rel.select("patients", {}, std::nullopt).takeValue();
+
+  ArrowSchema schema;
+  ArrowArray array;
+  assert(exportArrow(rs, &schema, &array).ok());
+  assert(std::strcmp(schema.format, "+s") == 0 && schema.n_children == 4);
+  assert(array.length == 100 && array.n_children == 4);
+  const char *formats[] = {"l", "u", "g", "b"};
+  for (int c = 0; c < 4; ++c) {
+    assert(std::strcmp(schema.children[c]->format, formats[c]) == 0);
+    assert(schema.children[c]->name == rs.columnNames()[c]);
+    assert(array.children[c]->length == 100);
+  }
+
+  // Row 7: id 7, "patient 7", 53.5, false; row 10 has nulls
+  const ArrowArray *ids = array.children[0];
+  assert(ids->null_count == 0 && ids->buffers[0] == nullptr);
+  assert(static_cast<const int64_t *>(ids->buffers[1])[7] == 7);
+  const ArrowArray *names = array.children[1];
+  assert(names->null_count == 20 && !bit(names->buffers[0], 10));
+  const auto *offsets = static_cast<const int32_t *>(names->buffers[1]);
+  const auto *text = static_cast<const char *>(names->buffers[2]);
+  assert(std::string(text + offsets[7], offsets[8] - offsets[7]) ==
+         "patient 7");
+  assert(offsets[11] == offsets[10]);
+  assert(static_cast<const double *>(array.children[2]->buffers[1])[7] ==
+         53.5);
+  const ArrowArray *active = array.children[3];
+  assert(active->null_count == 34 && bit(active->buffers[0], 7) &&
+         !bit(active->buffers[1], 7) && bit(active->buffers[1], 8));
+
+  // The batch outlives the result set; a consumer may move a child out
+  rs = ResultSet();
+  ArrowArray moved = *array.children[1];
+  array.children[1]->release = nullptr;
+  array.release(&array);
+  assert(array.release == nullptr);
+  assert(std::string(static_cast<const char *>(moved.buffers[2]), 9) ==
+         "patient 1");
+  moved.release(&moved);
+  schema.release(&schema);
+
+  // Untyped columns take the type of their cells; mixed ones are refused
+  ResultSet mixed({"x", "y"}, {ColumnType::Null, ColumnType::Integer});
+  for (int i = 0; i < 3; ++i) {
+    std::vector<std::unique_ptr<Value>> vals;
+    vals.push_back(i ? ValueFactory::createFloat(i) : nullptr);
+    vals.push_back(ValueFactory::createInteger(i));
+    mixed.addRow(ResultRow(std::move(vals)));
+  }
+  assert(exportArrow(mixed, &schema, &array).ok());
+  assert(std::strcmp(schema.children[0]->format, "g") == 0);
+  assert(array.children[0]->null_count == 1);
+  array.release(&array);
+  schema.release(&schema);
+  std::vector<std::unique_ptr<Value>> bad;
+  bad.push_back(nullptr);
+  bad.push_back(ValueFactory::createString("three"));
+  mixed.addRow(ResultRow(std::move(bad)));
+  assert(exportArrow(mixed, &schema, &array).code() ==
+         StatusCode::InvalidArgument);
+  std::cout << "  PASSED" << std::endl;
+}
+
+static void testRelationalRoundTrip() {
+  std::cout << "Test 2: Exported batches import back into a table"
+            << std::endl;
+  InMemoryRelationalStorage src, dst;
+  assert(src.createTable("patients", patientsSchema()).ok());
+  assert(dst.createTable("patients", patientsSchema()).ok());
+  for (int64_t i = 0; i < 1000; ++i)
+    assert(src.insertRow("patients", patient(i)).ok());
+  auto all = src.select("patients", {}, std::nullopt).takeValue();
+
+  ArrowSchema schema;
+  ArrowArray array;
+  assert(exportArrow(all, &schema, &array).ok());
+  auto res = importArrow(&schema, &array, dst, "patients");
+  assert(res.hasValue() && res.value() == 1000);
+  assert(schema.release == nullptr && array.release == nullptr);
+  assert(rowsOf(dst.select("patients", {}, std::nullopt).value()) ==
+         rowsOf(all));
+
+  // Columns match by name and may be missing; constraints still apply
+  const std::vector<std::string> some{"name", "id"};
+  auto part = src.select("patients", some, std::nullopt).takeValue();
+  assert(dst.truncateTable("patients").ok());
+  assert(exportArrow(part, &schema, &array).ok());
+  assert(importArrow(&schema, &array, dst, "patients").value() == 1000);
+  auto back = dst.select("patients", {}, std::nullopt).takeValue();
+  assert(back.rowCount() == 1000 && !back.row(3).values()[2]);
+  assert(exportArrow(part, &schema, &array).ok());
+  auto dup = importArrow(&schema, &array, dst, "patients");
+  assert(dup.status().code() == StatusCode::FailedPrecondition);
+  assert(dup.status().message().rfind("Row 0: ", 0) == 0);
+  assert(array.release == nullptr);
+
+  assert(exportArrow(part, &schema, &array).ok());
+  assert(importArrow(&schema, &array, dst, "missing").status().code() ==
+         StatusCode::NotFound);
+  ResultSet extra({"id", "ward"}, {ColumnType::Integer, ColumnType::String});
+  assert(exportArrow(extra, &schema, &array).ok());
+  assert(importArrow(&schema, &array, dst, "patients").status().code() ==
+         StatusCode::InvalidArgument);
+  std::cout << "  PASSED" << std::endl;
+}
+
+// A producer-side batch of hand-built Arrow buffers, as pyarrow would pass
+struct ForeignBatch {
+  std::vector<ArrowSchema> childSchemas;
+  std::vector<ArrowArray> childArrays;
+  std::vector<ArrowSchema *> schemaPtrs;
+  std::vector<ArrowArray *> arrayPtrs;
+  std::vector<std::vector<const void *>> buffers;
+  std::vector<std::string> names;
+  std::vector<std::string> formats;
+  const void *structBuffers[1] = {nullptr};
+  ArrowSchema schema{};
+  ArrowArray array{};
+  int released = 0;
+
+  void add(const std::string &name, const std::string &format,
+           std::vector<const void *> bufs, int64_t length, int64_t nulls,
+           int64_t offset = 0) {
+    names.push_back(name);
+    formats.push_back(format);
+    buffers.push_back(std::move(bufs));
+    ArrowArray a{};
+    a.length = length;
+    a.null_count = nulls;
+    a.offset = offset;
+    childArrays.push_back(a);
+  }
+
+  static void releaseSchema(ArrowSchema *s) {
+    ++static_cast<ForeignBatch *>(s->private_data)->released;
+    s->release = nullptr;
+  }
+  static void releaseArray(ArrowArray *a) {
+    ++static_cast<ForeignBatch *>(a->private_data)->released;
+    a->release = nullptr;
+  }
+
+  void finish(int64_t length, int64_t offset = 0) {
+    childSchemas.resize(names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+      childSchemas[i] = ArrowSchema{};
+      childSchemas[i].format = formats[i].c_str();
+      childSchemas[i].name = names[i].c_str();
+      childArrays[i].n_buffers = static_cast<int64_t>(buffers[i].size());
+      childArrays[i].buffers = buffers[i].data();
+    }
+    for (size_t i = 0; i < names.size(); ++i) {
+      schemaPtrs.push_back(&childSchemas[i]);
+      arrayPtrs.push_back(&childArrays[i]);
+    }
+    schema.format = "+s";
+    schema.n_children = static_cast<int64_t>(names.size());
+    schema.children = schemaPtrs.data();
+    schema.release = &releaseSchema;
+    schema.private_data = this;
+    array.length = length;
+    array.offset = offset;
+    array.n_buffers = 1;
+    array.buffers = structBuffers;
+    array.n_children = static_cast<int64_t>(names.size());
+    array.children = arrayPtrs.data();
+    array.release = &releaseArray;
+    array.private_data = this;
+  }
+};
+
+static void testForeignTypes() {
+  std::cout << "Test 3: Narrow, unsigned, temporal and sliced columns"
+            << std::endl;
+  std::vector<Column> cols{
+      Column{"id", ColumnType::Integer, false, true, {}},
+      Column{"score", ColumnType::Float, true, false, {}},
+      Column{"label", ColumnType::String, true, false, {}},
+      Column{"seen", ColumnType::Integer, true, false, {}},
+  };
+  InMemoryRelationalStorage rel;
+  assert(rel.createTable("t", TableSchema(cols, std::string("id"))).ok());
+
+  // Five rows; the struct is sliced to rows 1..3 and the label child has
+  // its own offset of 1 on top
+  const int32_t ids[] = {10, 11, 12, 13, 14};
+  // float16 1, 2, -2.5, 0.5 and 0
+  const uint16_t half[] = {0x3C00, 0x4000, 0xC100, 0x3800, 0x0000};
+  const uint8_t validHalf[] = {0x1B}; // row 2 null
+  const int64_t labelOffsets[] = {0, 1, 3, 6, 10, 15, 20};
+  const char labelText[] = "abbcccddddeeeeefffff";
+  const int64_t seen[] = {100, 200, 300, 400, 500};
+  ForeignBatch fb;
+  fb.add("id", "i", {nullptr, ids}, 5, 0);
+  fb.add("score", "e", {validHalf, half}, 5, 1);
+  fb.add("label", "U", {nullptr, labelOffsets, labelText}, 4, 0, 1);
+  fb.add("seen", "tss:UTC", {nullptr, seen}, 5, 0);
+  fb.finish(3, 1);
+
+  auto res = importArrow(&fb.schema, &fb.array, rel, "t");
+  assert(res.hasValue() && res.value() == 3);
+  assert(fb.released == 2);
+  auto rs = rel.select("t", {}, std::nullopt).takeValue();
+  assert(rowsOf(rs) == "\n  11 2 \"ccc\" 200"
+                       "\n  12 null \"dddd\" 300"
+                       "\n  13 0.5 \"eeeee\" 400");
+
+  // Unsigned values beyond int64 and unsupported formats are refused
+  const uint64_t huge[] = {~0ULL};
+  ForeignBatch over;
+  over.add("id", "L", {nullptr, huge}, 1, 0);
+  over.finish(1);
+  auto bad = importArrow(&over.schema, &over.array, rel, "t");
+  assert(bad.status().code() == StatusCode::InvalidArgument);
+  assert(over.released == 2);
+  ForeignBatch list;
+  list.add("id", "+l", {nullptr, nullptr}, 0, 0);
+  list.finish(0);
+  assert(importArrow(&list.schema, &list.array, rel, "t").status().code() ==
+         StatusCode::InvalidArgument);
+  assert(list.released == 2);
+  std::cout << "  PASSED" << std::endl;
+}
+
+static void testTimeSeriesImport() {
+  std::cout << "Test 4: Series take Arrow columns without row conversion"
+            << std::endl;
+  TimeSeriesSchema schema("ts", TimeGranularity::Seconds);
+  schema.addTagColumn(Column{"bed", ColumnType::String, true, false, {}});
+  schema.addValueColumn(Column{"hr", ColumnType::Float, true, false, {}});
+  schema.addValueColumn(Column{"spo2", ColumnType::Float, true, false, {}});
+  CountingSeries ts;
+  assert(ts.createSeries("vitals", schema, TimePartition::Hourly).ok());
+
+  constexpr int64_t n = 10000;
+  std::vector<int64_t> stamps(n);
+  std::vector<double> hr(n), spo2(n);
+  for (int64_t i = 0; i < n; ++i) {
+    stamps[i] = 1700000000 + i;
+    hr[i] = 60.0 + (i % 40);
+    spo2[i] = 90.0 + (i % 10);
+  }
+  // Columns in another order than the schema's
+  ForeignBatch fb;
+  fb.add("spo2", "g", {nullptr, spo2.data()}, n, 0);
+  fb.add("ts", "tss:", {nullptr, stamps.data()}, n, 0);
+  fb.add("hr", "g", {nullptr, hr.data()}, n, 0);
+  fb.finish(n);
+  auto res = importArrow(&fb.schema, &fb.array, ts, "vitals");
+  assert(res.hasValue() && res.value() == static_cast<size_t>(n));
+  assert(ts.columnCalls == 1 && ts.batches == 0 && fb.released == 2);
+  auto got = ts.rangeQuery("vitals", {"ts", "hr", "spo2"}, 1700000100,
+                           1700000102, std::nullopt)
+                 .takeValue();
+  assert(rowsOf(got) == "\n  1700000100 80 90\n  1700000101 81 91");
+
+  // Tags (or nulls) need rows
+  const int32_t offsets[] = {0, 2, 4};
+  const char text[] = "b1b2";
+  const int64_t later[] = {1800000000, 1800000001};
+  const double hr2[] = {70.0, 71.0};
+  const uint8_t valid[] = {0x01};
+  ForeignBatch tagged;
+  tagged.add("ts", "l", {nullptr, later}, 2, 0);
+  tagged.add("bed", "u", {nullptr, offsets, text}, 2, 0);
+  tagged.add("hr", "g", {valid, hr2}, 2, 1);
+  tagged.finish(2);
+  res = importArrow(&tagged.schema, &tagged.array, ts, "vitals");
+  assert(res.hasValue() && res.value() == 2);
+  assert(ts.columnCalls == 1 && ts.batches == 1);
+  got = ts.rangeQuery("vitals", {}, 1800000000, 1800000002, std::nullopt)
+            .takeValue();
+  assert(rowsOf(got) == "\n  1800000000 \"b1\" 70 null"
+                        "\n  1800000001 \"b2\" null null");
+
+  ForeignBatch noTime;
+  noTime.add("hr", "g", {nullptr, hr2}, 2, 0);
+  noTime.finish(2);
+  assert(importArrow(&noTime.schema, &noTime.array, ts, "vitals")
+             .status()
+             .code() == StatusCode::InvalidArgument);
+  assert(noTime.released == 2);
+  std::cout << "  PASSED" << std::endl;
+}
+
+int main() {
+  testExportLayout();
+  testRelationalRoundTrip();
+  testForeignTypes();
+  testTimeSeriesImport();
+  std::cout << "All Arrow tests passed!" << std::endl;
+  return 0;
+}
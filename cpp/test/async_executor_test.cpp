@@ -0,0 +1,181 @@
+#include "kadedb/async_executor.h"
+#include "kadedb/prepared_statement.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/thread_pool.h"
+#include "kadedb/value.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+
+using Params = AsyncQueryExecutor::Params;
+
+static Params one(std::unique_ptr<Value> v) {
+  Params out;
+  out.push_back(std::move(v));
+  return out;
+}
+
+static void load(InMemoryRelationalStorage &storage, int64_t rows) {
+  TableSchema schema({
+      Column{"id", ColumnType::Integer, /*nullable=*/false, false, {}},
+      Column{"name", ColumnType::String, /*nullable=*/true, false, {}},
+  });
+  assert(storage.createTable("t", schema).ok());
+  std::vector<Row> batch;
+  for (int64_t i = 0; i < rows; ++i) {
+    Row r(2);
+    r.set(0, ValueFactory::createInteger(i));
+    r.set(1, ValueFactory::createString("n" + std::to_string(i)));
+    batch.push_back(std::move(r));
+  }
+  assert(storage.insertRows("t", batch).ok());
+}
+
+static void testFutures() {
+  std::cout << "Test 1: statements complete through futures" << std::endl;
+  InMemoryRelationalStorage storage;
+  load(storage, 1000);
+  AsyncQueryExecutor async(storage);
+
+  auto rs = async.executeAsync("SELECT id, name FROM t WHERE id >= 900")
+                .get();
+  assert(rs.hasValue() && rs.value().rowCount() == 100);
+  assert(rs.value().columnCount() == 2);
+  assert(rs.value().at(0, 0).asInt() == 900);
+
+  // An empty result keeps its columns
+  auto none = async.executeAsync("SELECT id FROM t WHERE id < 0").get();
+  assert(none.hasValue() && none.value().rowCount() == 0);
+  assert(none.value().columnCount() == 1);
+
+  // A syntax error is the future's result, not an exception
+  auto bad = async.executeAsync("SELEC id FROM t");
+  assert(bad.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+  assert(!bad.get().hasValue());
+
+  // Errors of the statement itself arrive the same way
+  auto missing = async.executeAsync("SELECT * FROM nope").get();
+  assert(!missing.hasValue());
+
+  // Writes and bound parameters
+  auto upd = PreparedStatement::prepare("UPDATE t SET name = ? WHERE id < 10")
+                 .takeValue();
+  auto u =
+      async.executeAsync(upd, one(ValueFactory::createString("x"))).get();
+  assert(u.hasValue() && u.value().at(0, 0).asInt() == 10);
+  auto sel = PreparedStatement::prepare("SELECT id FROM t WHERE name = $1")
+                 .takeValue();
+  auto x = async.executeAsync(sel, one(ValueFactory::createString("x"))).get();
+  assert(x.hasValue() && x.value().rowCount() == 10);
+  // A parameter that cannot be bound
+  assert(!async.executeAsync(sel, {}).get().hasValue());
+  std::cout << "  PASSED" << std::endl;
+}
+
+static void testCallbacks() {
+  std::cout << "Test 2: many queries in flight report through callbacks"
+            << std::endl;
+  InMemoryRelationalStorage storage;
+  load(storage, 5000);
+  auto sel = PreparedStatement::prepare("SELECT id FROM t WHERE id >= ?")
+                 .takeValue();
+
+  const int kQueries = 64;
+  std::mutex mtx;
+  std::condition_variable cv;
+  int done = 0;
+  std::vector<size_t> rows(kQueries, 0);
+  {
+    AsyncQueryExecutor async(storage);
+    for (int q = 0; q < kQueries; ++q)
+      async.executeAsync(sel, one(ValueFactory::createInteger(q * 50)),
+                         [&, q](Result<ResultSet> res) {
+                           assert(res.hasValue());
+                           std::lock_guard<std::mutex> lk(mtx);
+                           rows[q] = res.value().rowCount();
+                           ++done;
+                           cv.notify_all();
+                         });
+    // The executor is a handle; queries do not depend on it
+  }
+  std::unique_lock<std::mutex> lk(mtx);
+  cv.wait(lk, [&] { return done == kQueries; });
+  for (int q = 0; q < kQueries; ++q)
+    assert(rows[q] == static_cast<size_t>(5000 - q * 50));
+
+  // A private pool finishes its queued queries before it is destroyed
+  std::atomic<int> finished{0};
+  {
+    ThreadPool pool;
+    AsyncQueryExecutor async(storage, pool);
+    for (int q = 0; q < 8; ++q)
+      async.executeAsync(sel, one(ValueFactory::createInteger(0)),
+                         [&](Result<ResultSet> res) {
+                           assert(res.hasValue());
+                           finished.fetch_add(1);
+                         });
+    // A callback that throws does not take down its worker
+    async.executeAsync(sel, one(ValueFactory::createInteger(0)),
+                       [](Result<ResultSet>) {
+                         throw std::runtime_error("callback failed");
+                       });
+  }
+  assert(finished.load() == 8);
+  std::cout << "  PASSED" << std::endl;
+}
+
+static void testCancellation() {
+  std::cout << "Test 3: cancelled tokens end queries" << std::endl;
+  InMemoryRelationalStorage storage;
+  load(storage, 200000);
+  AsyncQueryExecutor async(storage);
+
+  CancellationToken token;
+  CancellationToken copy = token;
+  assert(!copy.cancelled());
+  token.cancel();
+  assert(copy.cancelled());
+
+  // Before it starts: nothing runs, not even a write
+  auto del = PreparedStatement::prepare("DELETE FROM t").takeValue();
+  auto d = async.executeAsync(del, {}, copy).get();
+  assert(!d.hasValue() && d.status().code() == StatusCode::Cancelled);
+  auto all = async.executeAsync("SELECT id FROM t", copy).get();
+  assert(!all.hasValue() && all.status().code() == StatusCode::Cancelled);
+
+  // While it runs: a SELECT stops between batches, or has finished
+  CancellationToken late;
+  auto running = async.executeAsync("SELECT id, name FROM t", late);
+  late.cancel();
+  auto r = running.get();
+  assert(r.hasValue() ? r.value().rowCount() == 200000
+                      : r.status().code() == StatusCode::Cancelled);
+
+  // An untouched token lets the query through
+  auto ok = async.executeAsync("SELECT id FROM t WHERE id < 5",
+                               CancellationToken())
+                .get();
+  assert(ok.hasValue() && ok.value().rowCount() == 5);
+  std::cout << "  PASSED" << std::endl;
+}
+
+int main() {
+  testFutures();
+  testCallbacks();
+  testCancellation();
+  std::cout << "All async executor tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,385 @@
+#include "kadedb/backup.h"
+#include "kadedb/graph/compact.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace kadedb;
+
+static std::string tempPath(const char *name) {
+  auto p = std::filesystem::temp_directory_path() /
+           ("kadedb_backup_test_" + std::string(name));
+  std::filesystem::remove(p);
+  return p.string();
+}
+
+static TableSchema patientsSchema() {
+  std::vector<Column> cols{
+      Column{"id", ColumnType::Integer, false, true, {}},
+      Column{"ward", ColumnType::String, true, false, {}},
+      Column{"score", ColumnType::Float, true, false, {}},
+  };
+  return TableSchema(cols, std::string("id"));
+}
+
+static Row patientRow(int64_t id) {
+  Row r(3);
+  r.set(0, ValueFactory::createInteger(id));
+  if (id % 5)
+    r.set(1, ValueFactory::createString("w" + std::to_string(id % 4)));
+  r.set(2, ValueFactory::createFloat(static_cast<double>(id) / 4.0));
+  return r;
+}
+
+static TimeSeriesSchema vitalsSchema() {
+  TimeSeriesSchema schema("ts", TimeGranularity::Seconds);
+  schema.addTagColumn(Column{"bed", ColumnType::String, true, false, {}});
+  schema.addValueColumn(Column{"hr", ColumnType::Float, true, false, {}});
+  return schema;
+}
+
+static Row vitalsRow(int64_t ts) {
+  Row r(3);
+  r.set(0, ValueFactory::createInteger(ts));
+  r.set(1, ValueFactory::createString("bed-" + std::to_string(ts % 3)));
+  r.set(2, ValueFactory::createFloat(60.0 + static_cast<double>(ts % 30)));
+  return r;
+}
+
+struct Storages {
+  InMemoryRelationalStorage rel;
+  InMemoryDocumentStorage doc;
+  InMemoryTimeSeriesStorage ts;
+  InMemoryGraphStorage graph;
+
+  WalTargets targets() { return {&rel, &doc, &ts, &graph}; }
+};
+
+static std::string rowsOf(const ResultSet &rs) {
+  std::string out;
+  for (const auto &row : rs) {
+    out += "\n ";
+    for (const auto &v : row.values())
+      out += " " + (v ? v->toString() : "null");
+  }
+  return out;
+}
+
+// Fields sorted by name, as the document's iteration order is unspecified
+static std::string fieldsOf(const Document &doc) {
+  std::vector<std::string> fields;
+  for (const auto &f : doc)
+    fields.push_back(" " + f.first + "=" +
+                     (f.second ? f.second->toString() : "<none>"));
+  std::sort(fields.begin(), fields.end());
+  std::string out;
+  for (const auto &f : fields)
+    out += f;
+  return out;
+}
+
+static std::string graphOf(const GraphStorage &graph, const std::string &g) {
+  std::string out = g + "\n";
+  const auto contents = graph.contents(g).takeValue();
+  for (const auto &n : contents.nodes) {
+    std::vector<std::string> labels(n.labels.begin(), n.labels.end());
+    std::sort(labels.begin(), labels.end());
+    out += "  node " + std::to_string(n.id);
+    for (const auto &l : labels)
+      out += " :" + l;
+    out += fieldsOf(n.properties) + "\n";
+  }
+  for (const auto &e : contents.edges) {
+    out += "  edge " + std::to_string(e.id) + " " + std::to_string(e.from) +
+           "->" + std::to_string(e.to) + " " + e.type;
+    for (const auto &l : e.labels) // one label each
+      out += " :" + l;
+    out += fieldsOf(e.properties) + "\n";
+  }
+  return out;
+}
+
+// Every engine's observable state
+static std::string dump(Storages &s) {
+  const std::vector<std::string> all;
+  std::string out;
+  auto tables = s.rel.listTables();
+  std::sort(tables.begin(), tables.end());
+  for (const auto &t : tables)
+    out += t + rowsOf(s.rel.select(t, all, std::nullopt).value()) + "\n";
+  auto collections = s.doc.listCollections();
+  std::sort(collections.begin(), collections.end());
+  for (const auto &c : collections) {
+    const auto schema = s.doc.getCollectionSchema(c).takeValue();
+    out += c + (schema ? " (schema)" : "") + "\n";
+    std::vector<std::string> lines;
+    for (const auto &kv : s.doc.query(c, all, std::nullopt).takeValue())
+      lines.push_back("  " + kv.first + fieldsOf(kv.second));
+    std::sort(lines.begin(), lines.end());
+    for (const auto &l : lines)
+      out += l + "\n";
+  }
+  auto series = s.ts.listSeries();
+  std::sort(series.begin(), series.end());
+  for (const auto &name : series) {
+    const bool daily =
+        s.ts.getSeriesPartition(name).value() == TimePartition::Daily;
+    out += name + (daily ? " daily" : " hourly") +
+           rowsOf(s.ts.rangeQuery(name, all, INT64_MIN, INT64_MAX,
+                                  std::nullopt)
+                      .value()) +
+           "\n";
+  }
+  auto graphs = s.graph.listGraphs();
+  std::sort(graphs.begin(), graphs.end());
+  for (const auto &g : graphs)
+    out += graphOf(s.graph, g);
+  return out;
+}
+
+static void populate(Storages &s) {
+  assert(s.rel.createTable("patients", patientsSchema()).ok());
+  for (int64_t id = 0; id < 300; ++id)
+    assert(s.rel.insertRow("patients", patientRow(id)).ok());
+  assert(s.rel.createTable("empty", patientsSchema()).ok());
+
+  DocumentSchema notes;
+  notes.addField(Column{"text", ColumnType::String, false, false, {}});
+  assert(s.doc.createCollection("notes", notes).ok());
+  assert(s.doc.createCollection("free", std::nullopt).ok());
+  for (int i = 0; i < 50; ++i) {
+    Document d;
+    d["text"] = ValueFactory::createString("note " + std::to_string(i));
+    d["n"] = ValueFactory::createInteger(i);
+    assert(s.doc.put("notes", "k" + std::to_string(i), d).ok());
+  }
+  Document f;
+  f["any"] = ValueFactory::createBoolean(true);
+  f["void"] = nullptr;
+  assert(s.doc.put("free", "x", f).ok());
+
+  assert(s.ts.createSeries("vitals", vitalsSchema(), TimePartition::Daily)
+             .ok());
+  for (int64_t i = 0; i < 5000; ++i)
+    assert(s.ts.append("vitals", vitalsRow(1000 + i * 7)).ok());
+  assert(s.ts.createSeries("quiet", vitalsSchema(), TimePartition::Hourly)
+             .ok());
+
+  assert(s.graph.createGraph("care").ok());
+  for (NodeId id = 0; id < 30; ++id) {
+    Node n;
+    n.id = id;
+    n.labels = {id % 2 ? "Patient" : "Doctor"};
+    n.properties["name"] =
+        ValueFactory::createString("n" + std::to_string(id));
+    assert(s.graph.putNode("care", n).ok());
+  }
+  for (EdgeId id = 0; id < 60; ++id) {
+    Edge e;
+    e.id = id;
+    e.from = id % 30;
+    e.to = (id * 7 + 1) % 30;
+    e.type = id % 3 ? "TREATS" : "REFERS";
+    e.labels = {"care"};
+    e.properties["since"] = ValueFactory::createInteger(id);
+    assert(s.graph.putEdge("care", e).ok());
+  }
+  assert(s.graph.eraseEdge("care", 5).ok());
+  assert(s.graph.eraseNode("care", 29).ok());
+}
+
+static void testRoundTrip() {
+  std::cout << "Test 1: every engine restores from a backup" << std::endl;
+  const std::string path = tempPath("roundtrip");
+  Storages live;
+  populate(live);
+  const std::string expected = dump(live);
+
+  auto stats = writeBackup(path, live.targets());
+  assert(stats.hasValue());
+  assert(stats.value().bytes == std::filesystem::file_size(path));
+  assert(!std::filesystem::exists(path + ".tmp"));
+  for (size_t threads : {1, 4}) {
+    Storages restored;
+    auto applied = restoreBackup(path, restored.targets(), threads);
+    assert(applied.hasValue());
+    assert(applied.value() == stats.value().records);
+    assert(dump(restored) == expected);
+  }
+
+  // The stream overload writes the same bytes
+  std::ostringstream os;
+  auto streamed = writeBackup(os, live.targets());
+  assert(streamed.hasValue());
+  std::ifstream in(path, std::ios::binary);
+  std::string file((std::istreambuf_iterator<char>(in)),
+                   std::istreambuf_iterator<char>());
+  assert(os.str() == file);
+
+  // Compressed backups restore the same state from fewer bytes
+  auto packed =
+      writeBackup(path, live.targets(), BackupOptions{0, 4096, Codec::Lz4});
+  assert(packed.hasValue() && packed.value().records == stats.value().records);
+  assert(packed.value().bytes * 2 < stats.value().bytes);
+  {
+    Storages restored;
+    assert(restoreBackup(path, restored.targets()).value() ==
+           stats.value().records);
+    assert(dump(restored) == expected);
+  }
+
+  // Only the engines given are backed up
+  WalTargets relOnly;
+  relOnly.relational = &live.rel;
+  assert(writeBackup(path, relOnly).hasValue());
+  InMemoryRelationalStorage rel;
+  WalTargets into;
+  into.relational = &rel;
+  assert(restoreBackup(path, into).hasValue());
+  assert(rel.listTables().size() == 2);
+  std::filesystem::remove(path);
+  std::cout << "  PASSED" << std::endl;
+}
+
+static void testCompactGraph() {
+  std::cout << "Test 2: compact graphs back up like in-memory ones"
+            << std::endl;
+  Storages live;
+  populate(live);
+  CompactGraphStorage compact;
+  assert(compact.createGraph("care").ok());
+  const auto contents = live.graph.contents("care").takeValue();
+  for (const auto &n : contents.nodes)
+    assert(compact.putNode("care", n).ok());
+  for (const auto &e : contents.edges)
+    assert(compact.putEdge("care", e).ok());
+  assert(graphOf(compact, "care") == graphOf(live.graph, "care"));
+
+  WalTargets source;
+  source.graph = &compact;
+  std::ostringstream os;
+  assert(writeBackup(os, source).hasValue());
+  const std::string path = tempPath("compact");
+  {
+    std::ofstream f(path, std::ios::binary);
+    f << os.str();
+  }
+  InMemoryGraphStorage restored;
+  WalTargets into;
+  into.graph = &restored;
+  assert(restoreBackup(path, into).hasValue());
+  assert(graphOf(restored, "care") == graphOf(live.graph, "care"));
+  std::filesystem::remove(path);
+  std::cout << "  PASSED" << std::endl;
+}
+
+static void testOnlineThrottled() {
+  std::cout << "Test 3: a throttled backup runs while writes continue"
+            << std::endl;
+  const std::string path = tempPath("online");
+  Storages live;
+  assert(live.rel.createTable("patients", patientsSchema()).ok());
+  assert(live.ts.createSeries("vitals", vitalsSchema(), TimePartition::Hourly)
+             .ok());
+  for (int64_t id = 0; id < 2000; ++id) {
+    assert(live.rel.insertRow("patients", patientRow(id)).ok());
+    assert(live.ts.append("vitals", vitalsRow(id)).ok());
+  }
+
+  // Writers append in key order, so every consistent copy holds a prefix
+  std::atomic<bool> stop{false};
+  std::atomic<int64_t> written{2000};
+  std::thread writer([&] {
+    for (int64_t id = 2000; !stop.load(); ++id) {
+      assert(live.rel.insertRow("patients", patientRow(id)).ok());
+      assert(live.ts.append("vitals", vitalsRow(id)).ok());
+      written.store(id + 1);
+    }
+  });
+
+  BackupOptions options;
+  options.chunkBytes = 4096;
+  options.maxBytesPerSecond = 1 << 20;
+  const auto start = std::chrono::steady_clock::now();
+  auto stats = writeBackup(path, live.targets(), options);
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  stop.store(true);
+  writer.join();
+  assert(stats.hasValue());
+  // Paced to the cap: the first chunk is free, every later one waits
+  const double floor =
+      static_cast<double>(stats.value().bytes - options.chunkBytes) /
+      static_cast<double>(options.maxBytesPerSecond);
+  assert(seconds >= floor * 0.9);
+
+  Storages restored;
+  assert(restoreBackup(path, restored.targets()).hasValue());
+  const std::vector<std::string> all;
+  auto rows = restored.rel.select("patients", all, std::nullopt).takeValue();
+  assert(rows.rowCount() >= 2000 &&
+         rows.rowCount() <= static_cast<size_t>(written.load()));
+  std::vector<int64_t> ids;
+  for (const auto &row : rows)
+    ids.push_back(row.values()[0]->asInt());
+  std::sort(ids.begin(), ids.end());
+  for (size_t i = 0; i < ids.size(); ++i)
+    assert(ids[i] == static_cast<int64_t>(i));
+  auto samples = restored.ts
+                     .rangeQuery("vitals", all, INT64_MIN, INT64_MAX,
+                                 std::nullopt)
+                     .takeValue();
+  assert(samples.rowCount() >= 2000 &&
+         samples.rowCount() <= static_cast<size_t>(written.load()));
+  int64_t expect = 0;
+  for (const auto &row : samples)
+    assert(row.values()[0]->asInt() == expect++);
+  std::filesystem::remove(path);
+  std::cout << "  PASSED" << std::endl;
+}
+
+static void testIncompleteFiles() {
+  std::cout << "Test 4: missing and truncated backups are refused"
+            << std::endl;
+  const std::string path = tempPath("truncated");
+  Storages live;
+  populate(live);
+  Storages restored;
+  assert(restoreBackup(path, restored.targets()).status().code() ==
+         StatusCode::NotFound);
+  assert(writeBackup(path, live.targets()).hasValue());
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 3);
+  assert(restoreBackup(path, restored.targets()).status().code() ==
+         StatusCode::InvalidArgument);
+  // Nothing was applied
+  assert(restored.rel.listTables().empty());
+  {
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f << "not a backup";
+  }
+  assert(restoreBackup(path, restored.targets()).status().code() ==
+         StatusCode::InvalidArgument);
+  std::filesystem::remove(path);
+  std::cout << "  PASSED" << std::endl;
+}
+
+int main() {
+  testRoundTrip();
+  testCompactGraph();
+  testOnlineThrottled();
+  testIncompleteFiles();
+  std::cout << "All backup tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,370 @@
+#include "kadedb/index.h"
+#include "kadedb/metrics.h"
+#include "kadedb/predicate_builder.h"
+#include "kadedb/roaring.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace kadedb;
+
+using Op = Predicate::Op;
+using DOp = DocPredicate::Op;
+
+static std::vector<uint32_t> sorted(const std::set<uint32_t> &s) {
+  return std::vector<uint32_t>(s.begin(), s.end());
+}
+
+// The variadic And/Or overloads are ambiguous between predicate kinds
+template <typename P, typename... Ps> static std::vector<P> list(Ps &&...ps) {
+  std::vector<P> out;
+  (out.push_back(std::forward<Ps>(ps)), ...);
+  return out;
+}
+
+static Predicate clonePred(const Predicate &p) {
+  Predicate out;
+  out.kind = p.kind;
+  out.column = p.column;
+  out.op = p.op;
+  out.rhs = p.rhs ? p.rhs->clone() : nullptr;
+  for (const auto &ch : p.children)
+    out.children.push_back(clonePred(ch));
+  return out;
+}
+
+static DocPredicate clonePred(const DocPredicate &p) {
+  DocPredicate out;
+  out.kind = p.kind;
+  out.field = p.field;
+  out.op = p.op;
+  out.rhs = p.rhs ? p.rhs->clone() : nullptr;
+  for (const auto &ch : p.children)
+    out.children.push_back(clonePred(ch));
+  return out;
+}
+
+static std::unique_ptr<Value> I(int64_t v) {
+  return ValueFactory::createInteger(v);
+}
+static std::unique_ptr<Value> F(double v) {
+  return ValueFactory::createFloat(v);
+}
+static std::unique_ptr<Value> S(const std::string &v) {
+  return ValueFactory::createString(v);
+}
+
+// One line per row, cells separated by '|'
+static std::string flatten(const ResultSet &rs) {
+  std::string out;
+  for (const auto &row : rs) {
+    for (const auto &cell : row.values())
+      out += (cell ? cell->toString() : "null") + "|";
+    out += "\n";
+  }
+  return out;
+}
+
+static std::string rows(RelationalStorage &st, const std::string &table,
+                        const Predicate &p) {
+  std::optional<Predicate> where;
+  where.emplace(clonePred(p));
+  auto res = st.select(table, {}, where);
+  assert(res.hasValue());
+  return flatten(res.value());
+}
+
+static std::vector<Predicate> tablePredicates() {
+  std::vector<Predicate> out;
+  out.push_back(cmp("ward", Op::Eq, S("w3")));
+  out.push_back(cmp("ward", Op::Ne, S("w3")));
+  out.push_back(cmp("ward", Op::Eq, S("w9")));
+  out.push_back(cmp("ward", Op::Lt, S("w1")));
+  out.push_back(cmp("ward", Op::Eq, I(3)));
+  out.push_back(cmp("acuity", Op::Eq, I(2)));
+  out.push_back(cmp("acuity", Op::Eq, F(2.0)));
+  out.push_back(cmp("acuity", Op::Eq, F(2.5)));
+  out.push_back(cmp("acuity", Op::Gt, I(2)));
+  out.push_back(cmp("acuity", Op::Le, F(0.5)));
+  out.push_back(And(list<Predicate>(cmp("ward", Op::Eq, S("w3")),
+                                    cmp("acuity", Op::Eq, I(1)))));
+  out.push_back(And(list<Predicate>(cmp("ward", Op::Eq, S("w3")),
+                                    cmp("id", Op::Lt, I(1000)))));
+  out.push_back(Or(list<Predicate>(cmp("ward", Op::Eq, S("w1")),
+                                   cmp("acuity", Op::Eq, I(3)))));
+  out.push_back(Or(list<Predicate>(cmp("ward", Op::Eq, S("w1")),
+                                   cmp("id", Op::Eq, I(7)))));
+  out.push_back(Not(cmp("ward", Op::Ne, S("w2"))));
+  out.push_back(And(list<Predicate>(Not(cmp("ward", Op::Eq, S("w2"))),
+                                    cmp("acuity", Op::Ge, I(3)))));
+  out.push_back(Not(Or(list<Predicate>(cmp("ward", Op::Lt, S("w6")),
+                                       cmp("acuity", Op::Lt, I(3))))));
+  out.push_back(Not(And(list<Predicate>(cmp("id", Op::Gt, I(5)),
+                                        cmp("ward", Op::Eq, S("w0"))))));
+  return out;
+}
+
+static std::vector<DocPredicate> docPredicates() {
+  std::vector<DocPredicate> out;
+  out.push_back(dcmp("kind", DOp::Eq, S("lab")));
+  out.push_back(dcmp("kind", DOp::Ne, S("lab")));
+  out.push_back(dcmp("kind", DOp::Ge, S("note")));
+  out.push_back(dcmp("level", DOp::Eq, I(2)));
+  out.push_back(dcmp("level", DOp::Eq, F(2.0)));
+  out.push_back(dcmp("level", DOp::Ne, I(2)));
+  out.push_back(dcmp("level", DOp::Lt, I(2)));
+  out.push_back(dcmp("level", DOp::Eq, S("high")));
+  out.push_back(dcmp("level", DOp::Eq, ValueFactory::createNull()));
+  out.push_back(And(list<DocPredicate>(dcmp("kind", DOp::Eq, S("lab")),
+                                       dcmp("level", DOp::Ge, I(3)))));
+  out.push_back(Or(list<DocPredicate>(dcmp("kind", DOp::Eq, S("vital")),
+                                      dcmp("level", DOp::Eq, I(0)))));
+  out.push_back(Not(dcmp("kind", DOp::Eq, S("lab"))));
+  out.push_back(And(list<DocPredicate>(Not(dcmp("kind", DOp::Ne, S("note"))),
+                                       dcmp("seq", DOp::Lt, I(50)))));
+  out.push_back(Not(Or(list<DocPredicate>(dcmp("kind", DOp::Eq, S("lab")),
+                                          dcmp("level", DOp::Gt, I(1))))));
+  return out;
+}
+
+static std::vector<std::string> keys(DocumentStorage &ds, const std::string &c,
+                                     const DocPredicate &p) {
+  std::optional<DocPredicate> where;
+  where.emplace(clonePred(p));
+  auto res = ds.query(c, {}, where);
+  assert(res.hasValue());
+  std::vector<std::string> out;
+  for (const auto &kv : res.value())
+    out.push_back(kv.first);
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+int main() {
+  std::cout << "=== Bitmap Index Tests ===" << std::endl;
+
+  std::cout << "Test 1: roaring bitmaps match std::set..." << std::endl;
+  {
+    std::mt19937 rng(7);
+    for (int round = 0; round < 6; ++round) {
+      // Sparse, dense and mixed containers across several high keys
+      RoaringBitmap a, b;
+      std::set<uint32_t> sa, sb;
+      const uint32_t span = round % 2 ? 3 * 65536 : 40000;
+      const int count = round < 2 ? 300 : 30000;
+      for (int i = 0; i < count; ++i) {
+        const uint32_t x = rng() % span, y = rng() % span;
+        a.add(x);
+        sa.insert(x);
+        b.add(y);
+        sb.insert(y);
+      }
+      assert(a.cardinality() == sa.size() && a.toVector() == sorted(sa));
+      for (int i = 0; i < 1000; ++i) {
+        const uint32_t x = rng() % span;
+        assert(a.contains(x) == (sa.count(x) == 1));
+      }
+      std::set<uint32_t> both, any, diff;
+      std::set_intersection(sa.begin(), sa.end(), sb.begin(), sb.end(),
+                            std::inserter(both, both.end()));
+      std::set_union(sa.begin(), sa.end(), sb.begin(), sb.end(),
+                     std::inserter(any, any.end()));
+      std::set_difference(sa.begin(), sa.end(), sb.begin(), sb.end(),
+                          std::inserter(diff, diff.end()));
+      RoaringBitmap x = a, y = a, z = a;
+      x &= b;
+      y |= b;
+      z -= b;
+      assert(x.toVector() == sorted(both) && x.cardinality() == both.size());
+      assert(y.toVector() == sorted(any) && y.cardinality() == any.size());
+      assert(z.toVector() == sorted(diff) && z.cardinality() == diff.size());
+
+      // Removing most values turns bitmap containers back into arrays
+      for (int i = 0; i < count; ++i) {
+        const uint32_t v = rng() % span;
+        assert(a.remove(v) == (sa.erase(v) == 1));
+      }
+      assert(a.toVector() == sorted(sa));
+    }
+    RoaringBitmap r = RoaringBitmap::range(65530, 140000);
+    assert(r.cardinality() == 140000 - 65530);
+    assert(!r.contains(65529) && r.contains(65530) && r.contains(139999) &&
+           !r.contains(140000));
+    r -= RoaringBitmap::range(0, 100000);
+    assert(r.cardinality() == 40000 && r.toVector().front() == 100000);
+    r -= r;
+    assert(r.empty() && RoaringBitmap::range(5, 5).empty());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: document ordinals are reused..." << std::endl;
+  {
+    const std::string k1 = "a", k2 = "b", k3 = "c";
+    DocOrdinals ords;
+    assert(ords.assign(&k1) == 0 && ords.assign(&k2) == 1);
+    assert(ords.assign(&k1) == 0 && ords.of(&k2) == 1);
+    ords.release(&k1);
+    assert(ords.all().cardinality() == 1 && !ords.all().contains(0));
+    assert(ords.assign(&k3) == 0 && ords.key(0) == &k3);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: bitmap-indexed tables match full scans..."
+            << std::endl;
+  {
+    const TableSchema schema(
+        {Column{"id", ColumnType::Integer, false, false, {}},
+         Column{"ward", ColumnType::String, true, false, {}},
+         Column{"acuity", ColumnType::Integer, true, false, {}}});
+    InMemoryRelationalStorage st;
+    assert(st.createTable("ix", schema).ok());
+    assert(st.createTable("scan", schema).ok());
+    std::mt19937 rng(11);
+    std::vector<Row> batch;
+    for (int64_t i = 0; i < 40000; ++i) {
+      Row r(3);
+      r.set(0, I(i));
+      if (i % 13)
+        r.set(1, S("w" + std::to_string(rng() % 8)));
+      r.set(2, I(rng() % 4));
+      batch.push_back(std::move(r));
+    }
+    assert(st.insertRows("ix", batch).ok());
+    assert(st.insertRows("scan", batch).ok());
+    // Built over existing rows
+    assert(st.createIndex("ix", "ward", IndexType::Bitmap).ok());
+    assert(st.createIndex("ix", "acuity", IndexType::Bitmap).ok());
+    assert(st.createIndex("ix", "acuity", IndexType::Hash).code() ==
+           StatusCode::AlreadyExists);
+
+    const auto preds = tablePredicates();
+    for (const auto &p : preds)
+      assert(rows(st, "ix", p) == rows(st, "scan", p));
+
+    auto access = [&](const Predicate &p) {
+      std::optional<Predicate> where;
+      where.emplace(clonePred(p));
+      return st.explainAccess("ix", where);
+    };
+    // Conjunctions, disjunctions and negations resolve from the bitmaps
+    assert(access(preds[10]).find("bitmap index on ") == 0);
+    assert(access(preds[15]).find("bitmap index on ") == 0);
+    assert(access(preds[16]).find("bitmap index on ") == 0);
+    // Too many rows for a lookup to pay off
+    assert(access(preds[1]) == "full scan");
+    // An AND narrows by its bitmap children, re-checking the rest
+    assert(access(preds[11]).find("bitmap index on ") == 0);
+
+    // Updates, deletes and compaction keep the bitmaps in step
+    auto rewrite = [](Row &row, const TableSchema &) {
+      row.set(1, S("w2"));
+      return Status::OK();
+    };
+    for (const char *t : {"ix", "scan"}) {
+      std::optional<Predicate> where;
+      where.emplace(cmp("acuity", Op::Eq, I(3)));
+      assert(st.updateRowsWith(t, rewrite, where).hasValue());
+      where.emplace(cmp("id", Op::Lt, I(25000)));
+      assert(st.deleteRows(t, where).hasValue());
+    }
+    for (const auto &p : preds)
+      assert(rows(st, "ix", p) == rows(st, "scan", p));
+    st.setScanThreads(4);
+    for (const auto &p : preds)
+      assert(rows(st, "ix", p) == rows(st, "scan", p));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: bitmap-indexed collections match full scans..."
+            << std::endl;
+  {
+    InMemoryDocumentStorage ds;
+    assert(ds.createCollection("ix", std::nullopt).ok());
+    assert(ds.createCollection("scan", std::nullopt).ok());
+    assert(ds.createIndex("ix", "kind", IndexType::Bitmap).ok());
+
+    std::mt19937 rng(5);
+    const char *kinds[] = {"lab", "note", "vital", "order", "image"};
+    auto randomDoc = [&](int i) {
+      Document d;
+      d["seq"] = I(i);
+      d["kind"] = S(kinds[rng() % 5]);
+      switch (rng() % 8) {
+      case 0:
+        break; // missing
+      case 1:
+        d["level"] = ValueFactory::createNull();
+        break;
+      case 2:
+        d["level"] = F(static_cast<double>(rng() % 4));
+        break;
+      default:
+        d["level"] = I(rng() % 4);
+      }
+      return d;
+    };
+    for (int i = 0; i < 400; ++i) {
+      Document d = randomDoc(i);
+      for (const char *c : {"ix", "scan"})
+        assert(ds.put(c, "k" + std::to_string(i), d).ok());
+    }
+    assert(ds.createIndex("ix", "level", IndexType::Bitmap).ok());
+    const auto preds = docPredicates();
+    for (const auto &p : preds)
+      assert(keys(ds, "ix", p) == keys(ds, "scan", p));
+
+    // Replacements and erases recycle document numbers
+    for (int step = 0; step < 3000; ++step) {
+      const int i = static_cast<int>(rng() % 500);
+      const std::string k = "k" + std::to_string(i);
+      if (rng() % 3 == 0) {
+        assert(ds.erase("ix", k).code() == ds.erase("scan", k).code());
+      } else {
+        Document d = randomDoc(i);
+        for (const char *c : {"ix", "scan"})
+          assert(ds.put(c, k, d).ok());
+      }
+      if (step % 500 == 0)
+        for (const auto &p : preds)
+          assert(keys(ds, "ix", p) == keys(ds, "scan", p));
+    }
+    for (const auto &p : preds)
+      assert(keys(ds, "ix", p) == keys(ds, "scan", p));
+
+    // A bitmap-resolved query reads only its candidates
+    auto scanned = [&](const std::string &c, const DocPredicate &p) {
+      metrics::OperationScope probe(metrics::Operation::KadeqlExecute);
+      keys(ds, c, p);
+      return probe.rowsScanned();
+    };
+    const auto lab = And(list<DocPredicate>(dcmp("kind", DOp::Eq, S("lab")),
+                                            dcmp("level", DOp::Eq, I(1))));
+    const size_t matches = keys(ds, "scan", lab).size();
+    assert(scanned("ix", lab) == matches);
+    assert(scanned("scan", lab) > 4 * matches);
+
+    // A string among the numbers stops range lookups, not equality
+    Document odd;
+    odd["kind"] = S("lab");
+    odd["level"] = S("high");
+    for (const char *c : {"ix", "scan"})
+      assert(ds.put(c, "odd", odd).ok());
+    for (const auto &p : preds)
+      assert(keys(ds, "ix", p) == keys(ds, "scan", p));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "All bitmap index tests passed." << std::endl;
+  return 0;
+}
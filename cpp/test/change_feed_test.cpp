@@ -0,0 +1,271 @@
+#include "kadedb/change_feed.h"
+#include "kadedb/logged_storage.h"
+#include "kadedb/predicate_builder.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace kadedb;
+
+using Kind = ChangeEvent::Kind;
+
+// (id INTEGER primary key, hr INTEGER)
+static TableSchema vitalsSchema() {
+  return TableSchema({Column{"id", ColumnType::Integer, false, true, {}},
+                      Column{"hr", ColumnType::Integer, true, false, {}}},
+                     "id");
+}
+
+static Row vitals(int64_t id, int64_t hr) {
+  Row r(2);
+  r.set(0, ValueFactory::createInteger(id));
+  r.set(1, ValueFactory::createInteger(hr));
+  return r;
+}
+
+static int64_t cell(const std::optional<InlineRow> &row, size_t column) {
+  assert(row);
+  return row->values()[column].asInt();
+}
+
+static ChangeSubscription::Events drain(ChangeSubscription &sub) {
+  auto res = sub.poll(0);
+  assert(res.hasValue());
+  return std::move(res.value());
+}
+
+int main() {
+  std::cout << "=== Change Data Capture Tests ===" << std::endl;
+
+  std::cout << "Test 1: the ring and its cursors..." << std::endl;
+  {
+    auto feed = std::make_shared<ChangeFeed>(4);
+    auto all = feed->subscribe("");
+    auto onlyA = feed->subscribe("a");
+    for (int i = 0; i < 3; ++i) {
+      ChangeEvent e;
+      e.target = i == 1 ? "b" : "a";
+      feed->publish(std::move(e));
+    }
+    assert(feed->lastSeq() == 3 && all->lag() == 3);
+
+    // Batches of at most maxEvents, in seq order
+    auto first = all->poll(2);
+    assert(first.hasValue() && first.value().size() == 2);
+    assert(first.value()[0]->seq == 1 && first.value()[1]->seq == 2);
+    assert(all->position() == 2 && all->lag() == 1);
+    auto a = drain(*onlyA);
+    assert(a.size() == 2 && a[0]->seq == 1 && a[1]->seq == 3);
+    assert(onlyA->position() == 3);
+
+    // Nothing new: an empty batch, after the wait
+    auto t0 = std::chrono::steady_clock::now();
+    auto none = onlyA->poll(0, std::chrono::milliseconds(20));
+    assert(none.hasValue() && none.value().empty());
+    assert(std::chrono::steady_clock::now() - t0 >=
+           std::chrono::milliseconds(20));
+
+    // A slow subscriber is told once events it missed are evicted; the
+    // others keep going
+    for (int i = 0; i < 4; ++i) {
+      ChangeEvent e;
+      e.target = "a";
+      feed->publish(std::move(e));
+    }
+    auto lagged = all->poll(0);
+    assert(!lagged.hasValue());
+    assert(lagged.status().code() == StatusCode::ResourceExhausted);
+    assert(drain(*onlyA).size() == 4);
+
+    // A waiting poll wakes for a publish from another thread
+    std::thread writer([&] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      ChangeEvent e;
+      e.target = "a";
+      feed->publish(std::move(e));
+    });
+    auto woken = onlyA->poll(0, std::chrono::seconds(10));
+    writer.join();
+    assert(woken.hasValue() && woken.value().size() == 1);
+    assert(woken.value()[0]->seq == 8);
+
+    // cancel() ends a blocked poll
+    std::thread canceller([&] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      onlyA->cancel();
+    });
+    auto cancelled = onlyA->poll(0, std::chrono::seconds(10));
+    canceller.join();
+    assert(cancelled.status().code() == StatusCode::Cancelled);
+    assert(std::string(changeKindName(Kind::Truncate)) == "TRUNCATE");
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: relational inserts, updates and deletes..."
+            << std::endl;
+  {
+    InMemoryRelationalStorage rs;
+    assert(rs.createTable("v", vitalsSchema()).ok());
+    assert(rs.subscribeChanges("v").status().code() ==
+           StatusCode::FailedPrecondition);
+    assert(rs.insertRow("v", vitals(1, 80)).ok());
+    rs.enableChangeCapture(1024);
+    assert(rs.subscribeChanges("nope").status().code() ==
+           StatusCode::NotFound);
+
+    auto all = std::move(rs.subscribeChanges("v").value());
+    std::optional<Predicate> high(
+        cmp("hr", Predicate::Op::Gt, ValueFactory::createInteger(100)));
+    auto tachy = std::move(rs.subscribeChanges("v", high).value());
+
+    assert(rs.insertRows("v", {vitals(2, 70), vitals(3, 120)}).ok());
+    std::unordered_map<std::string, AssignmentValue> set;
+    set["hr"].constant = ValueFactory::createInteger(130);
+    std::optional<Predicate> one(
+        cmp("id", Predicate::Op::Eq, ValueFactory::createInteger(1)));
+    assert(rs.updateRows("v", set, one).value() == 1);
+    std::optional<Predicate> two(
+        cmp("id", Predicate::Op::Eq, ValueFactory::createInteger(2)));
+    assert(rs.deleteRows("v", two).value() == 1);
+    // Failed writes publish nothing
+    assert(!rs.insertRow("v", vitals(3, 1)).ok());
+
+    auto events = drain(*all);
+    assert(events.size() == 4);
+    assert(events[0]->kind == Kind::Insert && events[0]->target == "v");
+    assert(!events[0]->before && cell(events[0]->after, 0) == 2);
+    assert(events[1]->kind == Kind::Insert);
+    assert(cell(events[1]->after, 1) == 120);
+    assert(events[2]->kind == Kind::Update);
+    assert(cell(events[2]->before, 1) == 80);
+    assert(cell(events[2]->after, 1) == 130);
+    assert(events[3]->kind == Kind::Delete && !events[3]->after);
+    assert(cell(events[3]->before, 0) == 2);
+    for (size_t i = 1; i < events.size(); ++i)
+      assert(events[i]->seq == events[i - 1]->seq + 1);
+
+    // The filter keeps the rows with hr > 100, before or after
+    auto high_events = drain(*tachy);
+    assert(high_events.size() == 2);
+    assert(high_events[0]->kind == Kind::Insert);
+    assert(cell(high_events[0]->after, 0) == 3);
+    assert(high_events[1]->kind == Kind::Update);
+
+    // Truncate, then the drop ends the subscription
+    assert(rs.truncateTable("v").ok());
+    assert(rs.dropTable("v").ok());
+    events = drain(*all);
+    assert(events.size() == 2 && events[0]->kind == Kind::Truncate);
+    assert(events[1]->kind == Kind::Drop);
+    assert(all->poll(0).status().code() == StatusCode::NotFound);
+    events = drain(*tachy);
+    assert(events.size() == 2 && events[1]->kind == Kind::Drop);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: partitioned tables and the write-ahead log wrapper..."
+            << std::endl;
+  {
+    InMemoryRelationalStorage rs;
+    rs.enableChangeCapture();
+    assert(rs.createPartitionedTable("p", vitalsSchema(), 4).ok());
+    auto sub = std::move(rs.subscribeChanges("p").value());
+    std::vector<Row> rows;
+    for (int64_t id = 0; id < 100; ++id)
+      rows.push_back(vitals(id, id));
+    assert(rs.insertRows("p", rows).ok());
+    auto events = drain(*sub);
+    assert(events.size() == 100);
+    std::vector<bool> seen(100, false);
+    for (const auto &e : events) {
+      assert(e->kind == Kind::Insert && e->target == "p");
+      seen[static_cast<size_t>(cell(e->after, 0))] = true;
+    }
+    for (bool s : seen)
+      assert(s);
+    // One Truncate for the table, not one per partition
+    assert(rs.deleteRows("p", std::nullopt).value() == 100);
+    events = drain(*sub);
+    assert(events.size() == 1 && events[0]->kind == Kind::Truncate);
+
+    // Writes through a LoggedRelationalStorage are captured by its base
+    const std::string path = "change_feed_test.wal";
+    std::remove(path.c_str());
+    auto wal = WriteAheadLog::open(path);
+    assert(wal.hasValue());
+    LoggedRelationalStorage logged(rs, *wal.value());
+    auto viaLog = std::move(logged.subscribeChanges("p").value());
+    assert(logged.insertRow("p", vitals(7, 7)).ok());
+    events = drain(*viaLog);
+    assert(events.size() == 1 && cell(events[0]->after, 0) == 7);
+    wal.value().reset();
+    std::remove(path.c_str());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: documents and time series..." << std::endl;
+  {
+    InMemoryDocumentStorage ds;
+    assert(ds.createCollection("beds", std::nullopt).ok());
+    ds.enableChangeCapture();
+    auto beds = std::move(ds.subscribeChanges("beds").value());
+    Document doc;
+    doc["ward"] = ValueFactory::createString("icu");
+    assert(ds.put("beds", "b1", doc).ok());
+    doc["ward"] = ValueFactory::createString("er");
+    assert(ds.put("beds", "b1", doc).ok());
+    assert(ds.erase("beds", "b1").ok());
+    assert(ds.dropCollection("beds").ok());
+    auto events = drain(*beds);
+    assert(events.size() == 4);
+    assert(events[0]->kind == Kind::Insert && events[0]->key == "b1");
+    assert(!events[0]->beforeDoc);
+    assert(events[0]->afterDoc->at("ward")->asString() == "icu");
+    assert(events[1]->kind == Kind::Update);
+    assert(events[1]->beforeDoc->at("ward")->asString() == "icu");
+    assert(events[1]->afterDoc->at("ward")->asString() == "er");
+    assert(events[2]->kind == Kind::Delete && !events[2]->afterDoc);
+    assert(events[3]->kind == Kind::Drop);
+
+    InMemoryTimeSeriesStorage ts;
+    TimeSeriesSchema schema("timestamp", TimeGranularity::Seconds);
+    schema.addValueColumn(Column{"hr", ColumnType::Integer, true, false, {}});
+    assert(ts.createSeries("hr", schema, TimePartition::Hourly).ok());
+    ts.enableChangeCapture(8);
+    std::optional<Predicate> high(
+        cmp("hr", Predicate::Op::Gt, ValueFactory::createInteger(100)));
+    auto alarms = std::move(ts.subscribeChanges("hr", high).value());
+    auto every = std::move(ts.subscribeChanges("hr").value());
+    std::vector<Row> samples;
+    for (int64_t t = 0; t < 6; ++t)
+      samples.push_back(vitals(t, 90 + 5 * t));
+    assert(ts.appendBatch("hr", samples).ok());
+    events = drain(*alarms);
+    assert(events.size() == 3 && cell(events[0]->after, 1) == 105);
+    assert(drain(*every).size() == 6);
+    // More appends than the ring holds overrun a subscriber that stopped
+    // reading
+    samples.clear();
+    for (int64_t t = 6; t < 16; ++t)
+      samples.push_back(vitals(t, 0));
+    assert(ts.appendBatch("hr", samples).ok());
+    assert(every->poll(0).status().code() == StatusCode::ResourceExhausted);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll change data capture tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,349 @@
+#include "kadedb/checkpoint.h"
+#include "kadedb/logged_storage.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+#include "kadedb/wal.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+
+static std::string tempPath(const char *name) {
+  auto p = std::filesystem::temp_directory_path() /
+           ("kadedb_checkpoint_test_" + std::string(name));
+  std::filesystem::remove(p);
+  return p.string();
+}
+
+static Predicate cmp(const std::string &column, Predicate::Op op,
+                     std::unique_ptr<Value> rhs) {
+  Predicate p;
+  p.column = column;
+  p.op = op;
+  p.rhs = std::move(rhs);
+  return p;
+}
+
+static std::optional<Predicate> where(Predicate p) {
+  std::optional<Predicate> w;
+  w.emplace(std::move(p));
+  return w;
+}
+
+static TableSchema readingsSchema() {
+  std::vector<Column> cols{
+      Column{"id", ColumnType::Integer, false, true, {}},
+      Column{"note", ColumnType::String, true, false, {}},
+      Column{"value", ColumnType::Float, true, false, {}},
+      Column{"flag", ColumnType::Boolean, true, false, {}},
+  };
+  return TableSchema(cols, std::string("id"));
+}
+
+// Every third note spills past the inline capacity; nulls every 7th row
+static Row readingRow(int64_t id) {
+  Row r(4);
+  r.set(0, ValueFactory::createInteger(id));
+  if (id % 7 != 0)
+    r.set(1, ValueFactory::createString(
+                 id % 3 ? "n" + std::to_string(id)
+                        : "a longer note for row " + std::to_string(id)));
+  r.set(2, ValueFactory::createFloat(id * 0.5));
+  r.set(3, ValueFactory::createBoolean(id % 2 == 0));
+  return r;
+}
+
+static std::string rowsOf(const ResultSet &rs) {
+  std::string out;
+  for (const auto &row : rs) {
+    out += "\n ";
+    for (const auto &v : row.values())
+      out += " " + (v ? v->toString() : "null");
+  }
+  return out;
+}
+
+static std::string dump(RelationalStorage &rel) {
+  const std::vector<std::string> all;
+  std::string out;
+  auto tables = rel.listTables();
+  std::sort(tables.begin(), tables.end());
+  for (const auto &t : tables)
+    out += t + rowsOf(rel.select(t, all, std::nullopt).value()) + "\n";
+  return out;
+}
+
+static std::unique_ptr<CheckpointStorage> openCheckpoint(const std::string &p) {
+  auto res = CheckpointStorage::open(p);
+  assert(res.hasValue());
+  return res.takeValue();
+}
+
+static void flipByte(const std::string &path, uint64_t offset) {
+  std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+  f.seekg(static_cast<std::streamoff>(offset));
+  char c = 0;
+  f.read(&c, 1);
+  c = static_cast<char>(c ^ 0x5A);
+  f.seekp(static_cast<std::streamoff>(offset));
+  f.write(&c, 1);
+}
+
+static void testRoundTrip() {
+  std::cout << "Test 1: Mapped tables answer like the source storage"
+            << std::endl;
+  const std::string path = tempPath("roundtrip.ckpt");
+  // Three row groups, the last one partial
+  const int64_t n = 2 * static_cast<int64_t>(kCheckpointGroupRows) + 1234;
+  InMemoryRelationalStorage src;
+  assert(src.createTable("readings", readingsSchema()).ok());
+  for (int64_t i = 0; i < n; ++i)
+    assert(src.insertRow("readings", readingRow(i)).ok());
+  std::vector<Column> one{Column{"k", ColumnType::String, true, false, {}}};
+  assert(src.createTable("empty", TableSchema(one)).ok());
+  assert(writeCheckpoint(path, src, 42).ok());
+
+  auto ck = openCheckpoint(path);
+  assert(ck->walLsn() == 42);
+  auto names = ck->listTables();
+  std::sort(names.begin(), names.end());
+  assert((names == std::vector<std::string>{"empty", "readings"}));
+  assert(ck->estimateRowCount("readings") == static_cast<size_t>(n));
+  assert(ck->getTableSchema("readings").value().primaryKey() ==
+         std::optional<std::string>("id"));
+  assert(ck->explainAccess("readings", std::nullopt) == "checkpoint scan");
+  assert(dump(*ck) == dump(src));
+
+  // Projections and predicates over cells of every type
+  const std::vector<std::string> proj{"flag", "note"};
+  auto w = where(cmp("value", Predicate::Op::Ge,
+                     ValueFactory::createFloat(65000.0)));
+  assert(rowsOf(ck->select("readings", proj, w).value()) ==
+         rowsOf(src.select("readings", proj, w).value()));
+  auto longNote = where(cmp("note", Predicate::Op::Eq,
+                            ValueFactory::createString(
+                                "a longer note for row 131073")));
+  auto found = ck->select("readings", proj, longNote).takeValue();
+  assert(found.rowCount() == 1 && found.row(0).at(0).asBool() == false);
+
+  // Batches cross group boundaries, and the sink can stop the scan
+  size_t batches = 0, rows = 0;
+  assert(ck->scan("readings", {}, std::nullopt,
+                  [&](RowBatch &b) {
+                    ++batches;
+                    rows += b.rows.size();
+                    assert(b.columnNames.size() == 4);
+                    return true;
+                  },
+                  5000)
+             .ok());
+  assert(rows == static_cast<size_t>(n) && batches == (rows + 4999) / 5000);
+  batches = 0;
+  assert(ck->scan("readings", {}, std::nullopt,
+                  [&](RowBatch &) { return ++batches < 2; }, 100)
+             .ok());
+  assert(batches == 2);
+  batches = 0;
+  assert(ck->scan("empty", {}, std::nullopt,
+                  [&](RowBatch &b) {
+                    ++batches;
+                    assert(b.rows.empty() && b.columnNames[0] == "k");
+                    return true;
+                  },
+                  100)
+             .ok());
+  assert(batches == 1);
+
+  const std::vector<std::string> bad{"nope"};
+  assert(ck->select("readings", bad, std::nullopt).status().code() ==
+         StatusCode::InvalidArgument);
+  assert(ck->select("missing", proj, std::nullopt).status().code() ==
+         StatusCode::NotFound);
+  std::filesystem::remove(path);
+  std::cout << "  PASSED" << std::endl;
+}
+
+static void testCopyOnWrite() {
+  std::cout << "Test 2: Writes move a table into memory" << std::endl;
+  const std::string path = tempPath("cow.ckpt");
+  InMemoryRelationalStorage src;
+  for (const char *t : {"a", "b", "c", "d"}) {
+    assert(src.createTable(t, readingsSchema()).ok());
+    for (int64_t i = 0; i < 100; ++i)
+      assert(src.insertRow(t, readingRow(i)).ok());
+  }
+  assert(writeCheckpoint(path, src).ok());
+  auto ck = openCheckpoint(path);
+  assert(ck->mappedTables().size() == 4);
+
+  // Constraints hold across the move: id 5 is already in "a"
+  assert(ck->insertRow("a", readingRow(5)).code() ==
+         StatusCode::FailedPrecondition);
+  assert(ck->insertRow("a", readingRow(100)).ok());
+  assert(ck->deleteRows("b", where(cmp("id", Predicate::Op::Lt,
+                                       ValueFactory::createInteger(10))))
+             .value() == 10);
+  assert(ck->truncateTable("c").ok());
+  assert(ck->createTable("d", readingsSchema()).code() ==
+         StatusCode::AlreadyExists);
+  assert(ck->dropTable("d").ok());
+  assert(ck->dropTable("d").code() == StatusCode::NotFound);
+  assert(ck->createTable("d", readingsSchema()).ok());
+  assert(ck->createTable("e", readingsSchema()).ok());
+  assert(ck->mappedTables().empty());
+
+  assert(ck->estimateRowCount("a") == 101u);
+  assert(ck->select("b", {}, std::nullopt).value().rowCount() == 90);
+  assert(ck->select("c", {}, std::nullopt).value().rowCount() == 0);
+  assert(ck->select("d", {}, std::nullopt).value().rowCount() == 0);
+  assert(ck->listTables().size() == 5);
+  std::filesystem::remove(path);
+  std::cout << "  PASSED" << std::endl;
+}
+
+static void testRestartFromCheckpointAndLog() {
+  std::cout << "Test 3: Restart maps the checkpoint and replays the log tail"
+            << std::endl;
+  const std::string ckpt = tempPath("restart.ckpt");
+  const std::string log = tempPath("restart.log");
+  InMemoryRelationalStorage live;
+  uint64_t lsn = 0;
+  {
+    WalOptions fast;
+    fast.commitDelay = std::chrono::microseconds(0);
+    fast.sync = false;
+    auto wal = WriteAheadLog::open(log, fast).takeValue();
+    LoggedRelationalStorage rel(live, *wal);
+    for (int t = 0; t < 8; ++t) {
+      const std::string name = "t" + std::to_string(t);
+      assert(rel.createTable(name, readingsSchema()).ok());
+      for (int64_t i = 0; i < 500; ++i)
+        assert(rel.insertRow(name, readingRow(i)).ok());
+    }
+    // Writers paused: the checkpoint covers every record so far
+    lsn = wal->lastLsn();
+    assert(writeCheckpoint(ckpt, live, lsn).ok());
+
+    // The tail touches two of the eight tables and adds one
+    assert(rel.insertRow("t1", readingRow(1000)).ok());
+    assert(rel.deleteRows("t2", where(cmp("flag", Predicate::Op::Eq,
+                                          ValueFactory::createBoolean(true))))
+               .hasValue());
+    assert(rel.createTable("t8", readingsSchema()).ok());
+    assert(rel.insertRow("t8", readingRow(1)).ok());
+  }
+
+  auto ck = openCheckpoint(ckpt);
+  assert(ck->walLsn() == lsn);
+  WalTargets targets;
+  targets.relational = ck.get();
+  auto replayed = replayWal(log, targets, 4, ck->walLsn());
+  assert(replayed.hasValue() && replayed.value() == 4);
+  assert(dump(*ck) == dump(live));
+  auto mapped = ck->mappedTables();
+  assert(mapped.size() == 6);
+  assert(std::find(mapped.begin(), mapped.end(), "t1") == mapped.end());
+  assert(std::find(mapped.begin(), mapped.end(), "t2") == mapped.end());
+  std::filesystem::remove(ckpt);
+  std::filesystem::remove(log);
+  std::cout << "  PASSED" << std::endl;
+}
+
+static void testCorruption() {
+  std::cout << "Test 4: Damaged checkpoints are reported" << std::endl;
+  const std::string path = tempPath("corrupt.ckpt");
+  assert(CheckpointStorage::open(path).status().code() ==
+         StatusCode::NotFound);
+
+  InMemoryRelationalStorage src;
+  assert(src.createTable("readings", readingsSchema()).ok());
+  for (int64_t i = 0; i < 1000; ++i)
+    assert(src.insertRow("readings", readingRow(i)).ok());
+  assert(writeCheckpoint(path, src).ok());
+
+  // A damaged block opens fine and fails only once it is read
+  flipByte(path, kCheckpointPageBytes + 100);
+  {
+    auto ck = openCheckpoint(path);
+    assert(ck->estimateRowCount("readings") == 1000u);
+    assert(ck->select("readings", {}, std::nullopt).status().code() ==
+           StatusCode::Internal);
+    assert(ck->insertRow("readings", readingRow(2000)).code() ==
+           StatusCode::Internal);
+    assert(ck->mappedTables().size() == 1);
+  }
+  flipByte(path, kCheckpointPageBytes + 100);
+  assert(openCheckpoint(path)->select("readings", {}, std::nullopt).hasValue());
+
+  // Header and directory damage fail the open
+  flipByte(path, 9);
+  assert(CheckpointStorage::open(path).status().code() ==
+         StatusCode::InvalidArgument);
+  flipByte(path, 9);
+  flipByte(path, std::filesystem::file_size(path) - 3);
+  assert(CheckpointStorage::open(path).status().code() ==
+         StatusCode::InvalidArgument);
+  {
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f << std::string(8192, 'x');
+  }
+  assert(CheckpointStorage::open(path).status().code() ==
+         StatusCode::InvalidArgument);
+  std::filesystem::remove(path);
+  std::cout << "  PASSED" << std::endl;
+}
+
+static void testCompressed() {
+  std::cout << "Test 5: Compressed checkpoints" << std::endl;
+  const std::string plainPath = tempPath("plain.ckpt");
+  const std::string path = tempPath("compressed.ckpt");
+  const int64_t n = static_cast<int64_t>(kCheckpointGroupRows) + 500;
+  InMemoryRelationalStorage src;
+  assert(src.createTable("readings", readingsSchema()).ok());
+  for (int64_t i = 0; i < n; ++i)
+    assert(src.insertRow("readings", readingRow(i)).ok());
+  assert(writeCheckpoint(plainPath, src).ok());
+  for (Codec codec : {Codec::Lz4, Codec::Lz4High}) {
+    assert(writeCheckpoint(path, src, 7, codec).ok());
+    assert(std::filesystem::file_size(path) * 2 <
+           std::filesystem::file_size(plainPath));
+    auto ck = openCheckpoint(path);
+    assert(ck->walLsn() == 7);
+    assert(dump(*ck) == dump(src));
+    const std::vector<std::string> proj{"note"};
+    auto w = where(
+        cmp("id", Predicate::Op::Lt, ValueFactory::createInteger(10)));
+    assert(rowsOf(ck->select("readings", proj, w).value()) ==
+           rowsOf(src.select("readings", proj, w).value()));
+    // Moving the table into memory decodes every block
+    assert(ck->insertRow("readings", readingRow(n)).ok());
+    assert(ck->mappedTables().empty());
+    assert(ck->estimateRowCount("readings") == static_cast<size_t>(n) + 1);
+  }
+
+  // Damage to a compressed block fails its checksum
+  flipByte(path, kCheckpointPageBytes + 40);
+  assert(openCheckpoint(path)->select("readings", {}, std::nullopt)
+             .status()
+             .code() == StatusCode::Internal);
+  std::filesystem::remove(plainPath);
+  std::filesystem::remove(path);
+  std::cout << "  PASSED" << std::endl;
+}
+
+int main() {
+  testRoundTrip();
+  testCopyOnWrite();
+  testRestartFromCheckpointAndLog();
+  testCorruption();
+  testCompressed();
+  std::cout << "All checkpoint tests passed!" << std::endl;
+  return 0;
+}
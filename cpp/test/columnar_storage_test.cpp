@@ -0,0 +1,259 @@
+#include "kadedb/columnar_storage.h"
+#include "kadedb/kadeql.h"
+#include "kadedb/predicate_builder.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/schema.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <optional>
+#include <string>
+
+using namespace kadedb;
+
+static TableSchema makeSchema() {
+  std::vector<Column> cols;
+  cols.push_back(Column{"id", ColumnType::Integer, false, true, {}});
+  cols.push_back(Column{"name", ColumnType::String, false, false, {}});
+  cols.push_back(Column{"score", ColumnType::Float, true, false, {}});
+  cols.push_back(Column{"active", ColumnType::Boolean, true, false, {}});
+  return TableSchema(cols, std::optional<std::string>("id"));
+}
+
+static Row makeRow(int64_t id, const std::string &name,
+                   std::optional<double> score, bool active) {
+  Row r(4);
+  r.set(0, ValueFactory::createInteger(id));
+  r.set(1, ValueFactory::createString(name));
+  if (score)
+    r.set(2, ValueFactory::createFloat(*score));
+  r.set(3, ValueFactory::createBoolean(active));
+  return r;
+}
+
+static std::optional<Predicate> where(Predicate p) {
+  std::optional<Predicate> w;
+  w.emplace(std::move(p));
+  return w;
+}
+
+int main() {
+  ColumnarRelationalStorage rs;
+  auto schema = makeSchema();
+
+  assert(rs.createTable("t", schema).ok());
+  assert(rs.createTable("t", schema).code() == StatusCode::AlreadyExists);
+  assert(rs.insertRow("missing", makeRow(1, "a", 1.0, true)).code() ==
+         StatusCode::NotFound);
+
+  for (int64_t i = 0; i < 100; ++i) {
+    std::optional<double> score;
+    if (i % 10 != 0)
+      score = static_cast<double>(i) / 2.0;
+    auto st = rs.insertRow("t", makeRow(i, "n" + std::to_string(i), score,
+                                        i % 2 == 0));
+    assert(st.ok());
+  }
+
+  // Uniqueness and schema validation
+  assert(rs.insertRow("t", makeRow(5, "dup", 1.0, true)).code() ==
+         StatusCode::FailedPrecondition);
+  {
+    Row bad(4);
+    bad.set(0, ValueFactory::createInteger(1000));
+    assert(rs.insertRow("t", bad).code() == StatusCode::InvalidArgument);
+  }
+
+  // Batches are all or nothing: a conflict in row 3 keeps rows 1 and 2 out
+  {
+    std::vector<Row> batch;
+    batch.push_back(makeRow(200, "b0", 1.0, true));
+    batch.push_back(makeRow(201, "b1", 1.0, true));
+    batch.push_back(makeRow(5, "b2", 1.0, true));
+    assert(rs.insertRows("t", batch).code() == StatusCode::FailedPrecondition);
+    batch[2] = makeRow(200, "b2", 1.0, true);
+    assert(rs.insertRows("t", batch).code() == StatusCode::FailedPrecondition);
+    batch[2] = Row(4);
+    assert(rs.insertRows("t", batch).code() == StatusCode::InvalidArgument);
+    assert(rs.estimateRowCount("t").value() == 100);
+  }
+
+  // Select * round-trips typed values and nulls
+  {
+    auto res = rs.select("t", {}, std::nullopt);
+    assert(res.hasValue());
+    const auto &set = res.value();
+    assert(set.rowCount() == 100);
+    assert(set.columnCount() == 4);
+    assert(set.at(7, "id").asInt() == 7);
+    assert(set.at(7, "name").asString() == "n7");
+    assert(set.at(7, "score").asFloat() == 3.5);
+    assert(set.at(7, "active").asBool() == false);
+    assert(set.row(10).values()[2] == nullptr);
+  }
+
+  // Projection + comparison predicates on each column type
+  {
+    auto res = rs.select("t", {"name"},
+                         where(cmp("id", Predicate::Op::Ge,
+                                   ValueFactory::createInteger(95))));
+    assert(res.hasValue());
+    assert(res.value().rowCount() == 5);
+    assert(res.value().columnNames().size() == 1);
+    assert(res.value().at(0, 0).asString() == "n95");
+  }
+  {
+    auto res = rs.select("t", {"id"},
+                         where(cmp("name", Predicate::Op::Eq,
+                                   ValueFactory::createString("n42"))));
+    assert(res.hasValue() && res.value().rowCount() == 1);
+    assert(res.value().at(0, 0).asInt() == 42);
+  }
+  {
+    // Null scores never match a comparison
+    auto res = rs.select("t", {"id"},
+                         where(cmp("score", Predicate::Op::Lt,
+                                   ValueFactory::createInteger(5))));
+    assert(res.hasValue());
+    // scores 0.5..4.5 for ids 1..9 (id 0 is null)
+    assert(res.value().rowCount() == 9);
+  }
+  {
+    std::vector<Predicate> kids;
+    kids.push_back(
+        cmp("active", Predicate::Op::Eq, ValueFactory::createBoolean(true)));
+    kids.push_back(
+        Not(cmp("id", Predicate::Op::Lt, ValueFactory::createInteger(90))));
+    auto res = rs.select("t", {"id"}, where(And(std::move(kids))));
+    assert(res.hasValue());
+    assert(res.value().rowCount() == 5); // 90,92,94,96,98
+  }
+  assert(rs.select("t", {"nope"}, std::nullopt).status().code() ==
+         StatusCode::InvalidArgument);
+
+  // Update with constant assignments
+  {
+    std::unordered_map<std::string, AssignmentValue> asg;
+    AssignmentValue av;
+    av.kind = AssignmentValue::Kind::Constant;
+    av.constant = ValueFactory::createString("updated");
+    asg.emplace("name", std::move(av));
+    auto res = rs.updateRows("t", asg,
+                             where(cmp("id", Predicate::Op::Lt,
+                                       ValueFactory::createInteger(3))));
+    assert(res.hasValue() && res.value() == 3);
+    auto sel = rs.select("t", {"name"},
+                         where(cmp("name", Predicate::Op::Eq,
+                                   ValueFactory::createString("updated"))));
+    assert(sel.value().rowCount() == 3);
+  }
+  {
+    // Updating a unique column into a duplicate fails atomically
+    std::unordered_map<std::string, AssignmentValue> asg;
+    AssignmentValue av;
+    av.kind = AssignmentValue::Kind::Constant;
+    av.constant = ValueFactory::createInteger(50);
+    asg.emplace("id", std::move(av));
+    auto res = rs.updateRows("t", asg,
+                             where(cmp("id", Predicate::Op::Eq,
+                                       ValueFactory::createInteger(49))));
+    assert(!res.hasValue());
+    assert(res.status().code() == StatusCode::FailedPrecondition);
+    auto sel = rs.select("t", {"id"},
+                         where(cmp("id", Predicate::Op::Eq,
+                                   ValueFactory::createInteger(49))));
+    assert(sel.value().rowCount() == 1);
+  }
+
+  // Delete compacts columns and frees unique keys
+  {
+    auto del = rs.deleteRows("t", where(cmp("id", Predicate::Op::Ge,
+                                            ValueFactory::createInteger(50))));
+    assert(del.hasValue() && del.value() == 50);
+    auto all = rs.select("t", {}, std::nullopt);
+    assert(all.value().rowCount() == 50);
+    assert(all.value().at(49, "name").asString() == "n49");
+    assert(all.value().at(49, "score").asFloat() == 24.5);
+    assert(rs.insertRow("t", makeRow(75, "again", 1.0, false)).ok());
+  }
+
+  // KadeQL executor runs unchanged on the columnar engine
+  {
+    kadeql::QueryExecutor exec(rs);
+    auto stmt = kadeql::parseQuery("SELECT name FROM t WHERE id = 75");
+    auto res = exec.execute(*stmt);
+    assert(res.hasValue() && res.value().rowCount() == 1);
+    assert(res.value().at(0, 0).asString() == "again");
+  }
+
+  // In-place string updates: shorter values reuse their bytes, longer ones
+  // move to the end of the arena; neighbours are unaffected
+  {
+    auto setName = [&](int64_t id, const std::string &name) {
+      std::unordered_map<std::string, AssignmentValue> asg;
+      AssignmentValue av;
+      av.kind = AssignmentValue::Kind::Constant;
+      av.constant = ValueFactory::createString(name);
+      asg.emplace("name", std::move(av));
+      auto res = rs.updateRows("t", asg,
+                               where(cmp("id", Predicate::Op::Eq,
+                                         ValueFactory::createInteger(id))));
+      assert(res.hasValue() && res.value() == 1);
+    };
+    for (int k = 0; k < 200; ++k) {
+      setName(10, "x");
+      setName(11, std::string(static_cast<size_t>(20 + k % 7), 'y'));
+    }
+    auto all = rs.select("t", {}, std::nullopt);
+    assert(all.value().rowCount() == 51);
+    assert(all.value().at(10, "name").asString() == "x");
+    assert(all.value().at(11, "name").asString() == std::string(23, 'y'));
+    assert(all.value().at(12, "name").asString() == "n12");
+  }
+
+  // Unique keys can move between matched rows in one statement
+  {
+    std::vector<Predicate> kids;
+    kids.push_back(
+        cmp("id", Predicate::Op::Eq, ValueFactory::createInteger(20)));
+    kids.push_back(
+        cmp("id", Predicate::Op::Eq, ValueFactory::createInteger(21)));
+    auto res = rs.updateRowsWith(
+        "t",
+        [](Row &row, const TableSchema &) {
+          row.set(0, ValueFactory::createInteger(41 - row.at(0).asInt()));
+          return Status::OK();
+        },
+        where(Or(std::move(kids))));
+    assert(res.hasValue() && res.value() == 2);
+    auto sel = rs.select("t", {"name"},
+                         where(cmp("id", Predicate::Op::Eq,
+                                   ValueFactory::createInteger(21))));
+    assert(sel.value().at(0, 0).asString() == "n20");
+    assert(rs.insertRow("t", makeRow(20, "dup", 1.0, true)).code() ==
+           StatusCode::FailedPrecondition);
+  }
+
+  // A few deletes only tombstone rows; results skip them throughout
+  {
+    auto del = rs.deleteRows("t", where(cmp("id", Predicate::Op::Lt,
+                                            ValueFactory::createInteger(5))));
+    assert(del.hasValue() && del.value() == 5);
+    auto all = rs.select("t", {"id"}, std::nullopt);
+    assert(all.value().rowCount() == 46);
+    assert(all.value().at(0, 0).asInt() == 5);
+    auto neg = rs.select("t", {"id"},
+                         where(Not(cmp("id", Predicate::Op::Ge,
+                                       ValueFactory::createInteger(10)))));
+    assert(neg.value().rowCount() == 5);
+    assert(rs.insertRow("t", makeRow(3, "back", 1.0, true)).ok());
+    assert(rs.deleteRows("t", std::nullopt).value() == 47);
+    assert(rs.insertRow("t", makeRow(3, "fresh", 1.0, true)).ok());
+  }
+
+  assert(rs.truncateTable("t").ok());
+  assert(rs.select("t", {}, std::nullopt).value().rowCount() == 0);
+  assert(rs.dropTable("t").ok());
+  assert(rs.listTables().empty());
+  return 0;
+}
@@ -0,0 +1,170 @@
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+
+// (id INTEGER not null, ward STRING oneOf icu/er/ward, name STRING 2..8,
+//  hr INTEGER 20..250, temp FLOAT >= 30, ok BOOLEAN, note STRING)
+static std::vector<Column> vitalsColumns() {
+  Column id{"id", ColumnType::Integer, false, false, {}};
+  Column ward{"ward", ColumnType::String, false, false, {}};
+  ward.constraints.oneOf = {"icu", "er", "ward"};
+  Column name{"name", ColumnType::String, true, false, {}};
+  name.constraints.minLength = 2;
+  name.constraints.maxLength = 8;
+  Column hr{"hr", ColumnType::Integer, true, false, {}};
+  hr.constraints.minValue = 20;
+  hr.constraints.maxValue = 250;
+  Column temp{"temp", ColumnType::Float, true, false, {}};
+  temp.constraints.minValue = 30;
+  Column ok{"ok", ColumnType::Boolean, true, false, {}};
+  Column note{"note", ColumnType::String, true, false, {}};
+  return {id, ward, name, hr, temp, ok, note};
+}
+
+// A value of a random type, often valid for `col`, sometimes null
+static std::unique_ptr<Value> randomValue(std::mt19937 &rng,
+                                          const Column &col) {
+  static const char *words[] = {"icu", "er", "ward", "x", "nurse",
+                                "waytoolongname", "", "IC"};
+  switch (rng() % 8) {
+  case 0:
+    return nullptr;
+  case 1:
+    return ValueFactory::createString(words[rng() % 8]);
+  case 2:
+    return ValueFactory::createInteger(static_cast<int64_t>(rng() % 300) -
+                                       20);
+  case 3:
+    return ValueFactory::createFloat(static_cast<double>(rng() % 600) / 10);
+  case 4:
+    return ValueFactory::createBoolean(rng() % 2 == 0);
+  case 5:
+    return ValueFactory::createNull();
+  default:
+    switch (col.type) {
+    case ColumnType::String:
+      return ValueFactory::createString(words[rng() % 4]);
+    case ColumnType::Integer:
+      return ValueFactory::createInteger(static_cast<int64_t>(rng() % 260));
+    case ColumnType::Float:
+      return ValueFactory::createFloat(30.0 + rng() % 100);
+    case ColumnType::Boolean:
+      return ValueFactory::createBoolean(true);
+    case ColumnType::Null:
+      return ValueFactory::createNull();
+    }
+  }
+  return nullptr;
+}
+
+int main() {
+  std::cout << "=== Compiled Validator Tests ===" << std::endl;
+  const auto cols = vitalsColumns();
+  const TableSchema table(cols, "id");
+  DocumentSchema docs;
+  for (const auto &c : cols)
+    docs.addField(c);
+  const CompiledValidator rowCheck(table);
+  const CompiledValidator docCheck(docs);
+
+  std::cout << "Test 1: rows match SchemaValidator..." << std::endl;
+  {
+    std::mt19937 rng(7);
+    size_t accepted = 0;
+    for (int n = 0; n < 20000; ++n) {
+      Row row(cols.size() + (n % 97 == 0 ? 1 : 0));
+      for (size_t i = 0; i < cols.size(); ++i)
+        row.set(i, randomValue(rng, cols[i]));
+      const std::string want = SchemaValidator::validateRow(table, row);
+      assert(rowCheck.validateRow(row) == want);
+      const InlineRow inl = InlineRow::fromRow(row);
+      assert(rowCheck.validateRow(inl) ==
+             SchemaValidator::validateRow(table, inl));
+      accepted += want.empty();
+    }
+    // Both outcomes were exercised
+    assert(accepted > 0 && accepted < 20000);
+
+    Row ok(cols.size());
+    ok.set(0, ValueFactory::createInteger(1));
+    ok.set(1, ValueFactory::createString("icu"));
+    assert(rowCheck.validateRow(ok).empty());
+    ok.set(1, ValueFactory::createString("lab"));
+    assert(rowCheck.validateRow(ok) ==
+           "Value not in allowed set for 'ward'");
+    ok.set(1, ValueFactory::createString("er"));
+    ok.set(3, ValueFactory::createInteger(251));
+    assert(rowCheck.validateRow(ok) ==
+           "Numeric value above maxValue for 'hr'");
+    ok.set(3, ValueFactory::createFloat(80));
+    assert(rowCheck.validateRow(ok) ==
+           "Value type does not match column 'hr'");
+    // A default validator accepts anything
+    assert(CompiledValidator().validateRow(Row(3)).empty());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: documents match SchemaValidator..." << std::endl;
+  {
+    std::mt19937 rng(11);
+    for (int n = 0; n < 20000; ++n) {
+      Document doc;
+      for (const auto &c : cols)
+        if (rng() % 5)
+          doc.emplace(c.name, randomValue(rng, c));
+      doc.emplace("extra", ValueFactory::createInteger(n));
+      assert(docCheck.validateDocument(doc) ==
+             SchemaValidator::validateDocument(docs, doc));
+    }
+    Document missing;
+    missing.emplace("id", ValueFactory::createInteger(1));
+    assert(docCheck.validateDocument(missing) ==
+           "Missing required field 'ward'");
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: storages validate with their compiled schemas..."
+            << std::endl;
+  {
+    InMemoryRelationalStorage rs;
+    assert(rs.createTable("v", table).ok());
+    assert(rs.createPartitionedTable("p", table, 2).ok());
+    Row row(cols.size());
+    row.set(0, ValueFactory::createInteger(1));
+    row.set(1, ValueFactory::createString("lab"));
+    for (const char *t : {"v", "p"}) {
+      auto st = rs.insertRow(t, row);
+      assert(st.code() == StatusCode::InvalidArgument);
+      assert(st.message() == "Value not in allowed set for 'ward'");
+    }
+    row.set(1, ValueFactory::createString("icu"));
+    assert(rs.insertRow("v", row).ok());
+    assert(rs.insertRows("p", {row}).ok());
+
+    InMemoryDocumentStorage ds;
+    assert(ds.createCollection("beds", docs).ok());
+    Document doc;
+    doc.emplace("id", ValueFactory::createInteger(1));
+    doc.emplace("ward", ValueFactory::createString("er"));
+    doc.emplace("hr", ValueFactory::createInteger(5));
+    auto st = ds.put("beds", "b1", doc);
+    assert(st.code() == StatusCode::InvalidArgument);
+    assert(st.message() == "Numeric value below minValue for 'hr'");
+    doc["hr"] = ValueFactory::createInteger(60);
+    assert(ds.put("beds", "b1", doc).ok());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll compiled validator tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,300 @@
+#include "kadedb/compression.h"
+#include "kadedb/logged_storage.h"
+#include "kadedb/serialization.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+#include "kadedb/wal.h"
+
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+
+static std::string tempPath(const char *name) {
+  auto p = std::filesystem::temp_directory_path() /
+           ("kadedb_compression_test_" + std::string(name));
+  std::filesystem::remove(p);
+  return p.string();
+}
+
+static std::string compressed(Codec codec, const std::string &in,
+                              std::string_view dict = {}) {
+  std::string out;
+  codec::compress(codec, in.data(), in.size(), out, dict);
+  assert(out.size() <= codec::compressBound(in.size()));
+  return out;
+}
+
+static bool roundTrips(Codec codec, const std::string &in,
+                       std::string_view dict = {}) {
+  const std::string packed = compressed(codec, in, dict);
+  std::string back(in.size(), '\0');
+  return codec::decompress(packed.data(), packed.size(), &back[0], in.size(),
+                           dict) &&
+         back == in;
+}
+
+static std::string ward(int i) { return "ward-" + std::to_string(i % 7); }
+
+static std::string note(int i) {
+  return "Patient " + std::to_string(i % 40) + " admitted to " + ward(i) +
+         " for observation";
+}
+
+// Inputs from empty to incompressible, around the codec's minimum match
+// and end-of-block limits
+static std::vector<std::string> inputs() {
+  std::mt19937_64 rng(7);
+  std::vector<std::string> in{"", "a", "abcd", "abcdabcdabcdabcd",
+                              std::string(100000, 'x')};
+  for (size_t len = 0; len < 80; ++len) {
+    std::string s;
+    for (size_t i = 0; i < len; ++i)
+      s.push_back("abc"[rng() % 3]);
+    in.push_back(s);
+  }
+  std::string noise;
+  for (int i = 0; i < 70000; ++i)
+    noise.push_back(static_cast<char>(rng()));
+  in.push_back(noise);
+  std::string text;
+  for (int i = 0; i < 5000; ++i)
+    text += note(static_cast<int>(rng() % 1000)) + "\n";
+  in.push_back(text);
+  return in;
+}
+
+static void testRoundTrip() {
+  std::cout << "Test 1: every codec round-trips" << std::endl;
+  for (Codec c : {Codec::Lz4, Codec::Lz4High})
+    for (const auto &in : inputs())
+      assert(roundTrips(c, in));
+
+  // Text compresses, and the chained search beats the greedy one
+  const std::string text = inputs().back();
+  assert(compressed(Codec::None, text) == text);
+  const size_t fast = compressed(Codec::Lz4, text).size();
+  const size_t high = compressed(Codec::Lz4High, text).size();
+  assert(fast * 3 < text.size() && high < fast);
+  std::cout << "  PASSED" << std::endl;
+}
+
+static void testDictionary() {
+  std::cout << "Test 2: trained dictionaries shrink small payloads"
+            << std::endl;
+  std::vector<std::string> samples;
+  for (int i = 0; i < 500; ++i)
+    samples.push_back(note(i));
+  const std::string dict = codec::trainDictionary(samples, 4096);
+  assert(!dict.empty() && dict.size() <= 4096);
+  assert(codec::trainDictionary({}).empty());
+  assert(codec::trainDictionary({"ab", "cd"}).empty());
+
+  size_t plain = 0, withDict = 0;
+  for (Codec c : {Codec::Lz4, Codec::Lz4High}) {
+    for (int i = 0; i < 100; ++i) {
+      const std::string s = note(i * 13 + 5);
+      assert(roundTrips(c, s, dict));
+      plain += compressed(c, s).size();
+      withDict += compressed(c, s, dict).size();
+    }
+    for (const auto &in : inputs())
+      assert(roundTrips(c, in, dict));
+  }
+  assert(withDict * 3 < plain * 2);
+
+  // Decoding needs the dictionary the data was written with
+  const std::string s = note(3);
+  const std::string packed = compressed(Codec::Lz4, s, dict);
+  std::string back(s.size(), '\0');
+  assert(!codec::decompress(packed.data(), packed.size(), &back[0], s.size()) ||
+         back != s);
+  std::cout << "  PASSED" << std::endl;
+}
+
+static void testCorruption() {
+  std::cout << "Test 3: corrupt input is rejected" << std::endl;
+  const std::string text = inputs().back();
+  const std::string packed = compressed(Codec::Lz4, text);
+  std::string back(text.size(), '\0');
+  // Wrong sizes and truncation fail
+  assert(!codec::decompress(packed.data(), packed.size(), &back[0],
+                            text.size() - 1));
+  assert(!codec::decompress(packed.data(), packed.size() - 1, &back[0],
+                            text.size()));
+  assert(!codec::decompress(packed.data(), 0, &back[0], text.size()));
+  // Damage anywhere decodes in bounds (checked by the sanitizers), even
+  // if it goes unnoticed
+  std::mt19937 rng(3);
+  for (int i = 0; i < 2000; ++i) {
+    std::string bad = packed;
+    bad[rng() % bad.size()] ^= static_cast<char>(1 + rng() % 255);
+    codec::decompress(bad.data(), bad.size(), &back[0], text.size());
+  }
+  std::cout << "  PASSED" << std::endl;
+}
+
+static void testRowBatches() {
+  std::cout << "Test 4: compressed row batches" << std::endl;
+  std::vector<Row> rows;
+  for (int i = 0; i < 2000; ++i) {
+    Row r(3);
+    r.set(0, ValueFactory::createInteger(i));
+    if (i % 9)
+      r.set(1, ValueFactory::createString(note(i)));
+    r.set(2, ValueFactory::createFloat(i * 0.5));
+    rows.push_back(std::move(r));
+  }
+  std::string plain;
+  bin::writeRowBatch(rows, plain);
+  const std::string dict =
+      codec::trainDictionary({note(1), note(2), note(3), note(4)});
+  for (Codec c : {Codec::None, Codec::Lz4, Codec::Lz4High}) {
+    std::string buf;
+    bin::writeRowBatch(rows, buf, c, dict);
+    const size_t first = buf.size();
+    assert(c == Codec::None ? buf == plain : first * 2 < plain.size());
+    bin::writeRowBatch(rows, buf); // a plain batch after it
+    size_t used = 0;
+    auto back = bin::readRowBatch(buf.data(), buf.size(), &used, dict);
+    assert(used == first && back.size() == rows.size());
+    for (size_t r = 0; r < rows.size(); ++r)
+      for (size_t col = 0; col < 3; ++col) {
+        const Value *want = rows[r].values()[col].get();
+        const Value *got = back[r].values()[col].get();
+        assert((want == nullptr) == (got == nullptr));
+        assert(!want || want->equals(*got));
+      }
+    assert(bin::readRowBatch(buf.data() + used, buf.size() - used).size() ==
+           rows.size());
+    if (c == Codec::None)
+      continue;
+    // Truncation, a bad codec and a missing dictionary throw
+    bool threw = false;
+    try {
+      bin::readRowBatch(buf.data(), first - 1, nullptr, dict);
+    } catch (const SerializationError &) {
+      threw = true;
+    }
+    assert(threw);
+    std::string bad = buf.substr(0, first);
+    bad[4] = 9;
+    threw = false;
+    try {
+      bin::readRowBatch(bad.data(), bad.size(), nullptr, dict);
+    } catch (const SerializationError &) {
+      threw = true;
+    }
+    assert(threw);
+  }
+  std::cout << "  PASSED" << std::endl;
+}
+
+static TableSchema notesSchema() {
+  std::vector<Column> cols{
+      Column{"id", ColumnType::Integer, false, true, {}},
+      Column{"note", ColumnType::String, true, false, {}},
+  };
+  return TableSchema(cols, std::string("id"));
+}
+
+static Row noteRow(int64_t id) {
+  Row r(2);
+  r.set(0, ValueFactory::createInteger(id));
+  r.set(1, ValueFactory::createString(note(static_cast<int>(id))));
+  return r;
+}
+
+static std::string tableOf(InMemoryRelationalStorage &rel) {
+  std::string out;
+  const auto rs = rel.select("notes", {}, std::nullopt).takeValue();
+  for (const auto &row : rs)
+    out += row.values()[0]->toString() + row.values()[1]->toString() + "\n";
+  return out;
+}
+
+// Log `rows` inserts into a fresh log at `path` with `options` and check
+// that a replay gives back the table
+static void logNotes(const std::string &path, WalOptions options,
+                     InMemoryRelationalStorage &rel, int64_t from,
+                     int64_t to) {
+  auto wal = WriteAheadLog::open(path, std::move(options)).takeValue();
+  LoggedRelationalStorage logged(rel, *wal);
+  if (from == 0)
+    assert(logged.createTable("notes", notesSchema()).ok());
+  for (int64_t id = from; id < to; ++id)
+    assert(logged.insertRow("notes", noteRow(id)).ok());
+}
+
+static void testWal() {
+  std::cout << "Test 5: compressed write-ahead logs" << std::endl;
+  const std::string plainPath = tempPath("plain.wal");
+  const std::string path = tempPath("lz4.wal");
+  WalOptions fast;
+  fast.commitDelay = std::chrono::microseconds(0);
+  fast.sync = false;
+  InMemoryRelationalStorage plainRel;
+  logNotes(plainPath, fast, plainRel, 0, 2000);
+
+  // Trained on record bodies like those the log will hold
+  std::vector<std::string> samples;
+  for (int i = 0; i < 200; ++i)
+    samples.push_back(walRecord::insertRow("notes", noteRow(i)).body);
+  WalOptions packed = fast;
+  packed.compression = Codec::Lz4;
+  packed.dictionary = codec::trainDictionary(samples);
+  InMemoryRelationalStorage rel;
+  logNotes(path, packed, rel, 0, 1000);
+  // Reopening with the same dictionary writes none; a new one applies to
+  // the frames after it
+  logNotes(path, packed, rel, 1000, 1500);
+  packed.dictionary = ward(1) + ward(2);
+  logNotes(path, packed, rel, 1500, 1800);
+  // Uncompressed frames may follow compressed ones
+  logNotes(path, fast, rel, 1800, 2000);
+  assert(tableOf(rel) == tableOf(plainRel));
+  assert(std::filesystem::file_size(path) * 4 <
+         std::filesystem::file_size(plainPath) * 3);
+
+  InMemoryRelationalStorage replayed;
+  WalTargets targets;
+  targets.relational = &replayed;
+  assert(replayWal(path, targets).value() == 2001);
+  assert(tableOf(replayed) == tableOf(plainRel));
+  assert(WriteAheadLog::open(path, fast).takeValue()->lastLsn() == 2001);
+
+  // A damaged compressed frame ends the log like any other
+  {
+    const auto at =
+        static_cast<std::streamoff>(std::filesystem::file_size(path) / 2);
+    std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekg(at);
+    const char c = static_cast<char>(f.get() ^ 0x5A);
+    f.seekp(at);
+    f.put(c);
+  }
+  InMemoryRelationalStorage torn;
+  targets.relational = &torn;
+  const uint64_t applied = replayWal(path, targets).value();
+  assert(applied > 1 && applied < 2001);
+  assert(replayWalFile(path, targets).status().code() ==
+         StatusCode::InvalidArgument);
+  std::filesystem::remove(plainPath);
+  std::filesystem::remove(path);
+  std::cout << "  PASSED" << std::endl;
+}
+
+int main() {
+  testRoundTrip();
+  testDictionary();
+  testCorruption();
+  testRowBatches();
+  testWal();
+  std::cout << "All compression tests passed!" << std::endl;
+  return 0;
+}
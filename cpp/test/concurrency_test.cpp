@@ -81,5 +81,67 @@ int main() {
   assert(c.hasValue());
   assert(c.value() == static_cast<size_t>(M));
 
+  // Locks are per table and shared for reads: while a view holds table "t",
+  // other threads may still read "t" and write to a different table
+  assert(rs.createTable("u", schema).ok());
+  {
+    auto view = rs.selectView("t", {});
+    assert(view.hasValue());
+    std::thread other([&]() {
+      for (int i = 0; i < N; ++i) {
+        Row r(schema.columns().size());
+        r.set(0, ValueFactory::createInteger(i));
+        r.set(1, ValueFactory::createString("u" + std::to_string(i)));
+        assert(rs.insertRow("u", r).ok());
+      }
+      assert(rs.select("t", {}, std::nullopt).value().rowCount() ==
+             static_cast<size_t>(N));
+      assert(rs.selectView("t", {"id"}).hasValue());
+    });
+    other.join();
+    assert(view.value().rowCount() == static_cast<size_t>(N));
+  }
+  assert(rs.select("u", {}, std::nullopt).value().rowCount() ==
+         static_cast<size_t>(N));
+
+  // A view keeps its table alive across a concurrent drop
+  {
+    auto view = rs.selectView("u", {"name"});
+    assert(view.hasValue());
+    std::thread dropper([&]() { assert(rs.dropTable("u").ok()); });
+    dropper.join();
+    assert(view.value().rowCount() == static_cast<size_t>(N));
+    assert(view.value().cell(0, 0).asString() == "u0");
+  }
+  assert(rs.select("u", {}, std::nullopt).status().code() ==
+         StatusCode::NotFound);
+
+  // Many writers on distinct tables plus readers on all of them
+  const int T = 4;
+  for (int t = 0; t < T; ++t)
+    assert(rs.createTable("p" + std::to_string(t), schema).ok());
+  std::vector<std::thread> workers;
+  for (int t = 0; t < T; ++t) {
+    workers.emplace_back([&, t]() {
+      for (int i = 0; i < N; ++i) {
+        Row r(schema.columns().size());
+        r.set(0, ValueFactory::createInteger(i));
+        r.set(1, ValueFactory::createString("p"));
+        assert(rs.insertRow("p" + std::to_string(t), r).ok());
+      }
+    });
+    workers.emplace_back([&, t]() {
+      for (int k = 0; k < N; ++k)
+        assert(rs.select("p" + std::to_string(t), {"id"}, std::nullopt)
+                   .hasValue());
+    });
+  }
+  for (auto &w : workers)
+    w.join();
+  for (int t = 0; t < T; ++t)
+    assert(rs.select("p" + std::to_string(t), {}, std::nullopt)
+               .value()
+               .rowCount() == static_cast<size_t>(N));
+
   return 0;
 }
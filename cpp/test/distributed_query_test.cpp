@@ -0,0 +1,220 @@
+#include "kadedb/distributed.h"
+#include "kadedb/kadeql.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+
+// vitals(id PK, ward, hr, ts); every 11th hr is null
+static TableSchema vitalsSchema() {
+  return TableSchema({Column{"id", ColumnType::Integer, false, false, {}},
+                      Column{"ward", ColumnType::String, true, false, {}},
+                      Column{"hr", ColumnType::Integer, true, false, {}},
+                      Column{"ts", ColumnType::Integer, true, false, {}}},
+                     "id");
+}
+
+static Row vitalsRow(int64_t id) {
+  Row r(4);
+  r.set(0, ValueFactory::createInteger(id));
+  r.set(1, ValueFactory::createString("w" + std::to_string(id % 7)));
+  if (id % 11 != 0)
+    r.set(2, ValueFactory::createInteger(60 + id * 37 % 50));
+  r.set(3, ValueFactory::createInteger(1000 + id * 3));
+  return r;
+}
+
+// One table held whole, and split by id across three nodes
+struct Cluster {
+  InMemoryRelationalStorage whole;
+  InMemoryRelationalStorage nodes[3];
+
+  Cluster() {
+    assert(whole.createTable("vitals", vitalsSchema()).ok());
+    for (auto &n : nodes)
+      assert(n.createTable("vitals", vitalsSchema()).ok());
+    for (int64_t id = 0; id < 600; ++id) {
+      assert(whole.insertRow("vitals", vitalsRow(id)).ok());
+      assert(nodes[id % 3].insertRow("vitals", vitalsRow(id)).ok());
+    }
+  }
+
+  std::vector<FragmentRunner> runners() {
+    std::vector<FragmentRunner> out;
+    for (auto &n : nodes)
+      out.push_back([&n](const std::string &fragment) {
+        QueryExecutor exec(n);
+        return executeFragment(exec, fragment, Codec::Lz4);
+      });
+    return out;
+  }
+};
+
+static std::vector<std::string> rowStrings(const ResultSet &rs) {
+  std::vector<std::string> out;
+  for (const ResultRow &row : rs) {
+    std::string s;
+    for (const auto &v : row.values())
+      s += (v ? v->toString() : std::string("null")) + "|";
+    out.push_back(std::move(s));
+  }
+  return out;
+}
+
+static ResultSet local(Cluster &c, const std::string &q) {
+  QueryExecutor exec(c.whole);
+  auto res = exec.execute(*parseQuery(q));
+  assert(res.hasValue());
+  return res.takeValue();
+}
+
+static ResultSet distributed(Cluster &c, const std::string &q) {
+  auto plan = DistributedQuery::plan(q);
+  assert(plan.hasValue());
+  auto res = plan.value()->execute(c.runners());
+  assert(res.hasValue());
+  return res.takeValue();
+}
+
+// The distributed result equals the single-node one: in order when the
+// query orders its rows, else as a set
+static void same(Cluster &c, const std::string &q, bool ordered) {
+  ResultSet want = local(c, q);
+  ResultSet got = distributed(c, q);
+  assert(got.columnNames() == want.columnNames());
+  auto w = rowStrings(want), g = rowStrings(got);
+  if (!ordered) {
+    std::sort(w.begin(), w.end());
+    std::sort(g.begin(), g.end());
+  }
+  assert(!w.empty() && g == w);
+}
+
+int main() {
+  std::cout << "=== Distributed Query Tests ===" << std::endl;
+  Cluster cluster;
+
+  std::cout << "Test 1: partial aggregates merge to the single-node result..."
+            << std::endl;
+  {
+    same(cluster,
+         "SELECT ward, COUNT(*) AS n, COUNT(hr) AS readings, SUM(hr) AS "
+         "total, MIN(hr), MAX(hr) AS top, AVG(hr) AS mean FROM vitals GROUP "
+         "BY ward",
+         false);
+    same(cluster, "SELECT COUNT(*), AVG(hr), MAX(ts) FROM vitals", false);
+    same(cluster,
+         "SELECT ward, AVG(hr) AS mean FROM vitals WHERE ts > 1200 GROUP BY "
+         "ward HAVING COUNT(*) > 10 AND mean > 80 ORDER BY ward DESC LIMIT 3 "
+         "OFFSET 1",
+         true);
+    same(cluster,
+         "SELECT TIME_BUCKET(ts, 100) AS b, FIRST(hr, ts) AS f, LAST(hr, ts) "
+         "AS l, COUNT(*) AS n FROM vitals GROUP BY b",
+         true);
+
+    auto plan = DistributedQuery::plan(
+        "SELECT ward, AVG(hr) FROM vitals GROUP BY ward ORDER BY ward");
+    assert(plan.hasValue());
+    const std::string &fragment = plan.value()->fragment();
+    assert(fragment.find("SUM(hr)") != std::string::npos);
+    assert(fragment.find("COUNT(hr)") != std::string::npos);
+    assert(fragment.find("GROUP BY") != std::string::npos);
+    assert(fragment.find("ORDER BY") == std::string::npos);
+    assert(plan.value()->mergeStages().size() == 2);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: nodes keep LIMIT + OFFSET rows for a top-K merge..."
+            << std::endl;
+  {
+    same(cluster,
+         "SELECT id, hr FROM vitals WHERE ward != 'w3' ORDER BY id DESC LIMIT "
+         "5 OFFSET 2",
+         true);
+    same(cluster,
+         "SELECT id, hr * 2 AS double_hr FROM vitals WHERE hr > 0 "
+         "ORDER BY double_hr DESC, id LIMIT 4",
+         true);
+    same(cluster, "SELECT * FROM vitals ORDER BY ts LIMIT 10", true);
+    same(cluster, "SELECT id FROM vitals ORDER BY hr, id LIMIT 6", true);
+    same(cluster, "SELECT id, ward FROM vitals WHERE hr BETWEEN 60 AND 65",
+         false);
+
+    auto plan = DistributedQuery::plan(
+        "SELECT id FROM vitals ORDER BY id LIMIT 5 OFFSET 2");
+    assert(plan.hasValue());
+    assert(plan.value()->fragment().find("LIMIT 7") != std::string::npos);
+    plan = DistributedQuery::plan("SELECT id FROM vitals WHERE hr > 100");
+    assert(plan.hasValue() && plan.value()->mergeStages().empty());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: queries that cannot be distributed are refused..."
+            << std::endl;
+  {
+    for (const char *q :
+         {"SELECT a.id FROM vitals a JOIN vitals b ON a.id = b.id",
+          "SELECT id FROM vitals WHERE hr > $1",
+          "SELECT FIRST(hr) FROM vitals",
+          "SELECT id, hr + 1 AS h FROM vitals ORDER BY ts",
+          "INSERT INTO vitals (id) VALUES (1)", "SELECT FROM"}) {
+      auto plan = DistributedQuery::plan(q);
+      assert(!plan.hasValue());
+      assert(plan.status().code() == StatusCode::InvalidArgument);
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: node failures and malformed results surface..."
+            << std::endl;
+  {
+    auto plan = DistributedQuery::plan(
+        "SELECT ward, COUNT(*) AS n FROM vitals GROUP BY ward");
+    assert(plan.hasValue());
+    auto runners = cluster.runners();
+    runners.push_back([](const std::string &) {
+      return Result<std::string>::err(Status::Cancelled("node down"));
+    });
+    auto res = plan.value()->execute(runners);
+    assert(!res.hasValue() && res.status().code() == StatusCode::Cancelled);
+
+    QueryExecutor exec(cluster.nodes[0]);
+    auto part = executeFragment(exec, plan.value()->fragment());
+    assert(part.hasValue());
+    std::string truncated = part.value().substr(0, part.value().size() - 1);
+    res = plan.value()->merge({part.value(), truncated});
+    assert(res.status().code() == StatusCode::InvalidArgument);
+    res = plan.value()->merge({"garbage"});
+    assert(res.status().code() == StatusCode::InvalidArgument);
+    assert(!plan.value()->merge({}).hasValue());
+
+    // A node without the table fails with the executor's error
+    InMemoryRelationalStorage empty;
+    QueryExecutor none(empty);
+    assert(!executeFragment(none, plan.value()->fragment()).hasValue());
+    assert(executeFragment(none, "DELETE FROM vitals").status().code() ==
+           StatusCode::InvalidArgument);
+
+    // One node's result alone merges like the node's own query
+    res = plan.value()->merge({part.value()});
+    assert(res.hasValue());
+    assert(res.value().columnNames() ==
+           (std::vector<std::string>{"ward", "n"}));
+    assert(res.value().rowCount() == 7);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll distributed query tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,208 @@
+#include "kadedb/predicate_builder.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace kadedb;
+
+using Op = DocPredicate::Op;
+
+static DocPredicate clonePred(const DocPredicate &p) {
+  DocPredicate out;
+  out.kind = p.kind;
+  out.field = p.field;
+  out.op = p.op;
+  out.rhs = p.rhs ? p.rhs->clone() : nullptr;
+  for (const auto &ch : p.children)
+    out.children.push_back(clonePred(ch));
+  return out;
+}
+
+static std::vector<std::string> keys(DocumentStorage &ds, const std::string &c,
+                                     const DocPredicate &p) {
+  std::optional<DocPredicate> where;
+  where.emplace(clonePred(p));
+  auto res = ds.query(c, {}, where);
+  assert(res.hasValue());
+  std::vector<std::string> out;
+  for (const auto &kv : res.value())
+    out.push_back(kv.first);
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+// Indexed collection "ix" must answer every predicate like "scan"
+static void expectSame(DocumentStorage &ds, const DocPredicate &p) {
+  assert(keys(ds, "ix", p) == keys(ds, "scan", p));
+}
+
+static std::unique_ptr<Value> I(int64_t v) {
+  return ValueFactory::createInteger(v);
+}
+static std::unique_ptr<Value> F(double v) {
+  return ValueFactory::createFloat(v);
+}
+static std::unique_ptr<Value> S(const std::string &v) {
+  return ValueFactory::createString(v);
+}
+
+// The variadic And/Or overloads are ambiguous between predicate kinds
+template <typename... Ps> static std::vector<DocPredicate> list(Ps &&...ps) {
+  std::vector<DocPredicate> out;
+  (out.push_back(std::forward<Ps>(ps)), ...);
+  return out;
+}
+
+static std::vector<DocPredicate> predicates() {
+  std::vector<DocPredicate> preds;
+  preds.push_back(dcmp("mrn", Op::Eq, S("MRN-00042")));
+  preds.push_back(dcmp("mrn", Op::Eq, S("MRN-99999")));
+  preds.push_back(dcmp("mrn", Op::Ge, S("MRN-00190")));
+  preds.push_back(dcmp("mrn", Op::Lt, I(3)));
+  preds.push_back(dcmp("age", Op::Eq, I(40)));
+  preds.push_back(dcmp("age", Op::Eq, F(40.0)));
+  preds.push_back(dcmp("age", Op::Eq, F(40.5)));
+  preds.push_back(dcmp("age", Op::Lt, F(10.5)));
+  preds.push_back(dcmp("age", Op::Ge, I(80)));
+  preds.push_back(dcmp("age", Op::Gt, S("80")));
+  preds.push_back(dcmp("age", Op::Eq, ValueFactory::createNull()));
+  preds.push_back(dcmp("age", Op::Le, F(std::nan(""))));
+  preds.push_back(dcmp("ward", Op::Eq, S("w3")));
+  preds.push_back(dcmp("ward", Op::Gt, S("w3")));
+  preds.push_back(dcmp("ward", Op::Ne, S("w3")));
+  preds.push_back(And(list(dcmp("age", Op::Gt, I(50)),
+                           dcmp("age", Op::Lt, I(60)),
+                           dcmp("ward", Op::Ne, S("w1")))));
+  preds.push_back(And(list(dcmp("ward", Op::Eq, S("w2")),
+                           dcmp("mrn", Op::Ge, S("MRN-00100")))));
+  preds.push_back(Or(list(dcmp("mrn", Op::Eq, S("MRN-00001")),
+                          dcmp("ward", Op::Eq, S("w4")))));
+  preds.push_back(Or(list(dcmp("mrn", Op::Eq, S("MRN-00001")),
+                          dcmp("age", Op::Ne, I(3)))));
+  preds.push_back(Not(dcmp("age", Op::Lt, I(50))));
+  preds.push_back(And(std::vector<DocPredicate>{}));
+  preds.push_back(Or(std::vector<DocPredicate>{}));
+  return preds;
+}
+
+int main() {
+  std::cout << "Running document index tests..." << std::endl;
+
+  std::cout << "Test 1: index errors" << std::endl;
+  {
+    InMemoryDocumentStorage ds;
+    DocumentSchema schema;
+    schema.addField(Column{"mrn", ColumnType::String, false, false, {}});
+    assert(ds.createCollection("typed", schema).ok());
+    assert(ds.createIndex("nope", "mrn", IndexType::Hash).code() ==
+           StatusCode::NotFound);
+    assert(ds.createIndex("typed", "other", IndexType::Hash).code() ==
+           StatusCode::InvalidArgument);
+    assert(ds.createIndex("typed", "mrn", IndexType::Hash).ok());
+    assert(ds.createIndex("typed", "mrn", IndexType::Ordered).code() ==
+           StatusCode::AlreadyExists);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: indexed queries match full scans under churn"
+            << std::endl;
+  {
+    InMemoryDocumentStorage ds;
+    assert(ds.createCollection("ix", std::nullopt).ok());
+    assert(ds.createCollection("scan", std::nullopt).ok());
+    assert(ds.createIndex("ix", "mrn", IndexType::Hash).ok());
+    assert(ds.createIndex("ix", "ward", IndexType::Ordered).ok());
+
+    std::mt19937 rng(41);
+    auto randomDoc = [&](int i) {
+      Document d;
+      d["mrn"] = S("MRN-" + std::string(5 - std::to_string(i).size(), '0') +
+                   std::to_string(i));
+      d["ward"] = S("w" + std::to_string(rng() % 6));
+      if (rng() % 9)
+        d["age"] = rng() % 2 ? I(rng() % 100)
+                             : F(static_cast<double>(rng() % 200) / 2.0);
+      return d;
+    };
+    for (int i = 0; i < 300; ++i) {
+      Document d = randomDoc(i);
+      for (const char *c : {"ix", "scan"})
+        assert(ds.put(c, "k" + std::to_string(i), d).ok());
+    }
+    // Built over existing documents
+    assert(ds.createIndex("ix", "age", IndexType::Ordered).ok());
+    const auto preds = predicates();
+    for (const auto &p : preds)
+      expectSame(ds, p);
+
+    // Replacements and erases keep the indexes in step
+    for (int step = 0; step < 2000; ++step) {
+      const int i = static_cast<int>(rng() % 400);
+      const std::string k = "k" + std::to_string(i);
+      if (rng() % 4 == 0) {
+        assert(ds.erase("ix", k).code() == ds.erase("scan", k).code());
+      } else {
+        Document d = randomDoc(i);
+        for (const char *c : {"ix", "scan"})
+          assert(ds.put(c, k, d).ok());
+      }
+      if (step % 250 == 0)
+        for (const auto &p : preds)
+          expectSame(ds, p);
+    }
+    for (const auto &p : preds)
+      expectSame(ds, p);
+    assert(keys(ds, "ix", dcmp("mrn", Op::Eq, S("MRN-00042"))).size() <= 1);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: mixed-type fields fall back to scans" << std::endl;
+  {
+    // Cross-type comparisons order by type, so a stray string, null or NaN
+    // must not hide documents from range lookups
+    InMemoryDocumentStorage ds;
+    assert(ds.createCollection("ix", std::nullopt).ok());
+    assert(ds.createCollection("scan", std::nullopt).ok());
+    assert(ds.createIndex("ix", "age", IndexType::Ordered).ok());
+    std::vector<std::unique_ptr<Value>> odd;
+    odd.push_back(S("unknown"));
+    odd.push_back(ValueFactory::createNull());
+    odd.push_back(F(std::nan("")));
+    odd.push_back(ValueFactory::createBoolean(true));
+    for (int i = 0; i < 50; ++i) {
+      Document d;
+      d["age"] = I(i);
+      for (const char *c : {"ix", "scan"})
+        assert(ds.put(c, "k" + std::to_string(i), d).ok());
+    }
+    const auto preds = predicates();
+    for (size_t n = 0; n < odd.size(); ++n) {
+      Document d;
+      d["age"] = odd[n]->clone();
+      for (const char *c : {"ix", "scan"})
+        assert(ds.put(c, "odd", d).ok());
+      for (const auto &p : preds)
+        expectSame(ds, p);
+    }
+    // Once the odd value is gone, ranges use the index again
+    for (const char *c : {"ix", "scan"})
+      assert(ds.erase(c, "odd").ok());
+    for (const auto &p : preds)
+      expectSame(ds, p);
+    assert(keys(ds, "ix", dcmp("age", Op::Lt, I(5))).size() == 5);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll document index tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,196 @@
+#include "kadedb/predicate_builder.h"
+#include "kadedb/storage.h"
+#include "kadedb/stored_document.h"
+#include "kadedb/value.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+
+using Op = DocPredicate::Op;
+
+static bool sameValue(const Value *a, const Value *b) {
+  if (!a || !b)
+    return a == b;
+  return a->type() == b->type() && a->toString() == b->toString();
+}
+
+static bool sameDocument(const Document &a, const Document &b) {
+  if (a.size() != b.size())
+    return false;
+  for (const auto &kv : a) {
+    auto it = b.find(kv.first);
+    if (it == b.end() || !sameValue(kv.second.get(), it->second.get()))
+      return false;
+  }
+  return true;
+}
+
+using Rows = std::vector<std::pair<std::string, Document>>;
+
+static Rows query(DocumentStorage &ds, const std::vector<std::string> &fields,
+                  std::optional<DocPredicate> where) {
+  auto res = ds.query("c", fields, where);
+  assert(res.hasValue());
+  Rows rows = std::move(res.value());
+  std::sort(rows.begin(), rows.end(),
+            [](const auto &a, const auto &b) { return a.first < b.first; });
+  return rows;
+}
+
+static bool sameRows(const Rows &a, const Rows &b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); ++i)
+    if (a[i].first != b[i].first || !sameDocument(a[i].second, b[i].second))
+      return false;
+  return true;
+}
+
+static std::optional<DocPredicate> where(DocPredicate p) {
+  std::optional<DocPredicate> w;
+  w.emplace(std::move(p));
+  return w;
+}
+
+static constexpr size_t kPredicates = 5;
+
+static std::optional<DocPredicate> predicate(size_t n) {
+  auto I = [](int64_t v) { return ValueFactory::createInteger(v); };
+  auto S = [](const std::string &v) { return ValueFactory::createString(v); };
+  switch (n) {
+  case 0:
+    return std::nullopt;
+  case 1:
+    return where(dcmp("age", Op::Ge, I(50)));
+  case 2:
+    return where(dcmp("ward", Op::Eq, S("w2")));
+  case 3:
+    return where(dcmp("note", Op::Ne, S("")));
+  default:
+    return where(Not(dcmp("age", Op::Lt, ValueFactory::createFloat(30.5))));
+  }
+}
+
+int main() {
+  std::cout << "Running document layout tests..." << std::endl;
+
+  std::cout << "Test 1: shapes are shared and slots read back" << std::endl;
+  {
+    ShapeTable shapes(2);
+    Document a;
+    a["name"] = ValueFactory::createString("a patient name past the inline");
+    a["age"] = ValueFactory::createInteger(41);
+    a["gone"] = nullptr;
+    Document b;
+    b["gone"] = ValueFactory::createNull();
+    b["name"] = ValueFactory::createString("b");
+    b["age"] = ValueFactory::createFloat(2.5);
+    assert(shapes.intern(a) && shapes.intern(a) == shapes.intern(b));
+
+    StoredDocument sa = StoredDocument::make(a, &shapes);
+    assert(sa.shaped() && sameDocument(sa.toDocument(), a));
+    auto age = ValueFactory::createInteger(41);
+    assert(sa.field("age").hasValue() && sa.field("age").compare(*age) == 0);
+    assert(sa.field("gone").found() && !sa.field("gone").hasValue());
+    assert(!sa.field("missing").found());
+
+    // Past the cap new shapes stay maps; known ones are still shared
+    Document c;
+    c["x"] = ValueFactory::createBoolean(true);
+    Document d;
+    d["y"] = ValueFactory::createBoolean(false);
+    assert(shapes.intern(c) && !shapes.intern(d) && shapes.size() == 2);
+    StoredDocument sd = StoredDocument::make(d, &shapes);
+    assert(!sd.shaped() && sameDocument(sd.toDocument(), d));
+    assert(StoredDocument::make(b, &shapes).shaped());
+    assert(!StoredDocument::make(b, nullptr).shaped());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: shaped storage behaves like the map layout"
+            << std::endl;
+  {
+    InMemoryDocumentStorage maps;
+    InMemoryDocumentStorage shaped(DocumentLayout::Shaped);
+    assert(shaped.layout() == DocumentLayout::Shaped);
+    DocumentSchema schema;
+    schema.addField(Column{"mrn", ColumnType::String, false, true, {}});
+    schema.addField(Column{"age", ColumnType::Integer, true, false, {}});
+    schema.addField(Column{"ward", ColumnType::String, true, false, {}});
+    schema.addField(Column{"note", ColumnType::String, true, false, {}});
+    for (InMemoryDocumentStorage *ds : {&maps, &shaped}) {
+      assert(ds->createCollection("c", schema).ok());
+      assert(ds->createIndex("c", "ward", IndexType::Ordered).ok());
+    }
+
+    std::mt19937 rng(43);
+    for (int step = 0; step < 3000; ++step) {
+      const int i = static_cast<int>(rng() % 300);
+      const std::string key = "k" + std::to_string(i);
+      if (rng() % 5 == 0) {
+        assert(maps.erase("c", key).code() == shaped.erase("c", key).code());
+        continue;
+      }
+      Document d;
+      // Mostly one shape, with a few optional fields
+      d["mrn"] =
+          ValueFactory::createString("MRN-" + std::to_string(rng() % 400));
+      d["ward"] = ValueFactory::createString("w" + std::to_string(rng() % 5));
+      if (rng() % 3)
+        d["age"] = ValueFactory::createInteger(rng() % 100);
+      if (rng() % 7 == 0)
+        d["note"] = rng() % 2 ? ValueFactory::createString(
+                                    "a note longer than the inline buffer")
+                              : nullptr;
+      // Uniqueness on mrn fails the same way in both
+      assert(maps.put("c", key, d).code() == shaped.put("c", key, d).code());
+    }
+
+    assert(maps.count("c").value() == shaped.count("c").value());
+    for (int i = 0; i < 300; ++i) {
+      const std::string key = "k" + std::to_string(i);
+      auto a = maps.get("c", key);
+      auto b = shaped.get("c", key);
+      assert(a.hasValue() == b.hasValue());
+      if (a.hasValue())
+        assert(sameDocument(a.value(), b.value()));
+    }
+
+    for (size_t n = 0; n < kPredicates; ++n)
+      assert(sameRows(query(maps, {}, predicate(n)),
+                      query(shaped, {}, predicate(n))));
+    assert(sameRows(query(maps, {"age", "note"}, std::nullopt),
+                    query(shaped, {"age", "note"}, std::nullopt)));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: irregular collections fall back to maps" << std::endl;
+  {
+    InMemoryDocumentStorage ds(DocumentLayout::Shaped);
+    for (int i = 0; i < 1500; ++i) {
+      Document d;
+      d["f" + std::to_string(i)] = ValueFactory::createInteger(i);
+      d["common"] = ValueFactory::createInteger(i % 10);
+      assert(ds.put("c", "k" + std::to_string(i), d).ok());
+    }
+    auto rows = query(ds, {}, where(dcmp("common", Op::Eq,
+                                         ValueFactory::createInteger(3))));
+    assert(rows.size() == 150);
+    for (const auto &row : rows) {
+      const int i = std::stoi(row.first.substr(1));
+      assert(row.second.size() == 2);
+      assert(row.second.at("f" + std::to_string(i))->asInt() == i);
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll document layout tests passed!" << std::endl;
+  return 0;
+}
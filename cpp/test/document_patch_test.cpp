@@ -0,0 +1,377 @@
+#include "kadedb/change_feed.h"
+#include "kadedb/predicate_builder.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+
+using Op = DocPredicate::Op;
+using U = DocUpdate::Op;
+
+static DocUpdate update(U op, const std::string &field,
+                        std::unique_ptr<Value> value = nullptr) {
+  DocUpdate u;
+  u.op = op;
+  u.field = field;
+  u.value = std::move(value);
+  return u;
+}
+
+static std::vector<DocUpdate> ops(DocUpdate a) {
+  std::vector<DocUpdate> v;
+  v.push_back(std::move(a));
+  return v;
+}
+
+static std::vector<DocUpdate> ops(DocUpdate a, DocUpdate b) {
+  std::vector<DocUpdate> v;
+  v.push_back(std::move(a));
+  v.push_back(std::move(b));
+  return v;
+}
+
+static bool sameValue(const Value *a, const Value *b) {
+  if (!a || !b)
+    return a == b;
+  return a->type() == b->type() && a->toString() == b->toString();
+}
+
+static bool sameDocument(const Document &a, const Document &b) {
+  if (a.size() != b.size())
+    return false;
+  for (const auto &kv : a) {
+    auto it = b.find(kv.first);
+    if (it == b.end() || !sameValue(kv.second.get(), it->second.get()))
+      return false;
+  }
+  return true;
+}
+
+static std::optional<DocPredicate> where(DocPredicate p) {
+  std::optional<DocPredicate> w;
+  w.emplace(std::move(p));
+  return w;
+}
+
+static std::vector<std::string> keys(DocumentStorage &ds,
+                                     std::optional<DocPredicate> w) {
+  auto res = ds.query("c", {}, w);
+  assert(res.hasValue());
+  std::vector<std::string> out;
+  for (const auto &kv : res.value())
+    out.push_back(kv.first);
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+// Random operations over a few fields, some of which fail
+static std::vector<DocUpdate> randomOps(std::mt19937_64 &rng) {
+  static const char *fields[] = {"a", "b", "c", "name", "extra"};
+  std::vector<DocUpdate> out;
+  const size_t n = 1 + rng() % 3;
+  for (size_t i = 0; i < n; ++i) {
+    const std::string f = fields[rng() % 5];
+    switch (rng() % 6) {
+    case 0:
+      out.push_back(update(U::Unset, f));
+      break;
+    case 1:
+      out.push_back(update(U::Set, f, ValueFactory::createString("s")));
+      break;
+    case 2:
+      out.push_back(update(U::Set, f));
+      break;
+    case 3:
+      out.push_back(update(U::Inc, f, ValueFactory::createFloat(0.5)));
+      break;
+    default:
+      out.push_back(update(
+          U::Inc, f,
+          ValueFactory::createInteger(static_cast<int64_t>(rng() % 7) - 3)));
+    }
+  }
+  return out;
+}
+
+// Forwards everything but patch() and updateWhere(), to test the defaults
+class Forwarding final : public DocumentStorage {
+public:
+  explicit Forwarding(DocumentStorage &base) : base_(base) {}
+  Status createCollection(const std::string &c,
+                          const std::optional<DocumentSchema> &s) override {
+    return base_.createCollection(c, s);
+  }
+  Status dropCollection(const std::string &c) override {
+    return base_.dropCollection(c);
+  }
+  std::vector<std::string> listCollections() const override {
+    return base_.listCollections();
+  }
+  Status put(const std::string &c, const std::string &k,
+             const Document &d) override {
+    return base_.put(c, k, d);
+  }
+  Result<Document> get(const std::string &c, const std::string &k) override {
+    return base_.get(c, k);
+  }
+  Status erase(const std::string &c, const std::string &k) override {
+    return base_.erase(c, k);
+  }
+  Result<size_t> count(const std::string &c) const override {
+    return base_.count(c);
+  }
+  Result<std::vector<std::pair<std::string, Document>>>
+  query(const std::string &c, const std::vector<std::string> &f,
+        const std::optional<DocPredicate> &w) override {
+    return base_.query(c, f, w);
+  }
+  Status createIndex(const std::string &c, const std::string &f,
+                     IndexType t) override {
+    return base_.createIndex(c, f, t);
+  }
+
+private:
+  DocumentStorage &base_;
+};
+
+int main() {
+  std::cout << "=== Document Patch Tests ===" << std::endl;
+
+  std::cout << "Test 1: $set, $unset and $inc..." << std::endl;
+  {
+    Document doc;
+    doc["n"] = ValueFactory::createInteger(40);
+    doc["f"] = ValueFactory::createFloat(1.5);
+    doc["s"] = ValueFactory::createString("x");
+    auto v = ops(update(U::Inc, "n", ValueFactory::createInteger(2)),
+                 update(U::Inc, "f", ValueFactory::createInteger(1)));
+    v.push_back(update(U::Inc, "new", ValueFactory::createInteger(5)));
+    v.push_back(update(U::Set, "s", ValueFactory::createString("y")));
+    v.push_back(update(U::Unset, "gone"));
+    v.push_back(update(U::Inc, "new", ValueFactory::createFloat(0.5)));
+    assert(applyDocUpdates(doc, v).ok());
+    assert(doc.at("n")->type() == ValueType::Integer &&
+           doc.at("n")->asInt() == 42);
+    assert(doc.at("f")->type() == ValueType::Float &&
+           doc.at("f")->asFloat() == 2.5);
+    assert(doc.at("new")->type() == ValueType::Float &&
+           doc.at("new")->asFloat() == 5.5);
+    assert(doc.at("s")->asString() == "y" && doc.size() == 4);
+
+    // Failures leave the document as it was
+    auto bad = ops(update(U::Unset, "n"),
+                   update(U::Inc, "s", ValueFactory::createInteger(1)));
+    assert(applyDocUpdates(doc, bad).code() == StatusCode::InvalidArgument);
+    assert(doc.at("n")->asInt() == 42);
+    bad = ops(update(U::Inc, "n", ValueFactory::createString("1")));
+    assert(applyDocUpdates(doc, bad).code() == StatusCode::InvalidArgument);
+    bad = ops(update(U::Inc, "n"));
+    assert(applyDocUpdates(doc, bad).code() == StatusCode::InvalidArgument);
+    bad = ops(update(U::Set, "", ValueFactory::createInteger(1)));
+    assert(applyDocUpdates(doc, bad).code() == StatusCode::InvalidArgument);
+    doc["n"] = ValueFactory::createInteger(std::numeric_limits<int64_t>::max());
+    bad = ops(update(U::Inc, "n", ValueFactory::createInteger(1)));
+    assert(applyDocUpdates(doc, bad).code() == StatusCode::InvalidArgument);
+    // Unset then increment starts again from the increment
+    auto reset = ops(update(U::Unset, "n"),
+                     update(U::Inc, "n", ValueFactory::createInteger(1)));
+    assert(applyDocUpdates(doc, reset).ok() && doc.at("n")->asInt() == 1);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: in-place patches match get/apply/put..." << std::endl;
+  for (DocumentLayout layout : {DocumentLayout::Map, DocumentLayout::Shaped}) {
+    InMemoryDocumentStorage ds(layout), ref(layout);
+    assert(ds.createCollection("c", std::nullopt).ok());
+    assert(ref.createCollection("c", std::nullopt).ok());
+    std::mt19937_64 rng(3);
+    for (int i = 0; i < 50; ++i) {
+      Document doc;
+      doc["a"] = ValueFactory::createInteger(i);
+      if (i % 3)
+        doc["b"] = ValueFactory::createFloat(i / 4.0);
+      doc["name"] = ValueFactory::createString(std::string(i % 40, 'n'));
+      assert(ds.put("c", "k" + std::to_string(i), doc).ok());
+      assert(ref.put("c", "k" + std::to_string(i), std::move(doc)).ok());
+    }
+    assert(ds.patch("c", "nope", randomOps(rng)).code() ==
+           StatusCode::NotFound);
+    assert(ds.patch("none", "k1", randomOps(rng)).code() ==
+           StatusCode::NotFound);
+    for (int n = 0; n < 2000; ++n) {
+      const std::string key = "k" + std::to_string(rng() % 50);
+      auto v = randomOps(rng);
+      Document want = ref.get("c", key).takeValue();
+      const bool ok = applyDocUpdates(want, v).ok();
+      assert(ds.patch("c", key, v).ok() == ok);
+      if (ok)
+        assert(ref.put("c", key, std::move(want)).ok());
+      assert(sameDocument(ds.get("c", key).value(),
+                          ref.get("c", key).value()));
+    }
+    // Byte accounting follows the patches
+    assert(ds.memoryUsage("c").value() == ref.memoryUsage("c").value());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: touched fields are validated and unique..."
+            << std::endl;
+  {
+    DocumentSchema schema;
+    schema.addField(Column{"id", ColumnType::String, false, true, {}});
+    Column age{"age", ColumnType::Integer, false, false, {}};
+    age.constraints.minValue = 0;
+    schema.addField(age);
+    schema.addField(Column{"note", ColumnType::String, true, false, {}});
+    InMemoryDocumentStorage ds;
+    assert(ds.createCollection("c", schema).ok());
+    for (int i = 0; i < 3; ++i) {
+      Document doc;
+      doc["id"] = ValueFactory::createString("id" + std::to_string(i));
+      doc["age"] = ValueFactory::createInteger(10 * i);
+      assert(ds.put("c", "k" + std::to_string(i), std::move(doc)).ok());
+    }
+    auto check = [&](std::vector<DocUpdate> v, StatusCode code) {
+      Document before = ds.get("c", "k1").takeValue();
+      assert(ds.patch("c", "k1", v).code() == code);
+      assert(sameDocument(before, ds.get("c", "k1").value()));
+    };
+    check(ops(update(U::Inc, "age", ValueFactory::createInteger(-11))),
+          StatusCode::InvalidArgument);
+    check(ops(update(U::Unset, "age")), StatusCode::InvalidArgument);
+    check(ops(update(U::Set, "note", ValueFactory::createInteger(1))),
+          StatusCode::InvalidArgument);
+    check(ops(update(U::Set, "note", ValueFactory::createString("ok")),
+              update(U::Set, "id", ValueFactory::createString("id2"))),
+          StatusCode::FailedPrecondition);
+    // A document keeps its own unique value; a freed one can be taken
+    auto setId = [&](const std::string &key, const std::string &id) {
+      auto v = ValueFactory::createString(id);
+      return ds.patch("c", key, ops(update(U::Set, "id", std::move(v))));
+    };
+    assert(setId("k1", "id1").ok());
+    assert(setId("k2", "x").ok());
+    assert(setId("k1", "id2").ok());
+    Document other;
+    other["id"] = ValueFactory::createString("id1");
+    other["age"] = ValueFactory::createInteger(1);
+    assert(ds.put("c", "k3", std::move(other)).ok());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: indexes, budgets and change events..." << std::endl;
+  for (IndexType type : {IndexType::Hash, IndexType::Ordered,
+                         IndexType::Bitmap}) {
+    InMemoryDocumentStorage ds(DocumentLayout::Shaped);
+    assert(ds.createCollection("c", std::nullopt).ok());
+    ds.enableChangeCapture();
+    for (int i = 0; i < 20; ++i) {
+      Document doc;
+      doc["hits"] = ValueFactory::createInteger(i % 4);
+      assert(ds.put("c", "k" + std::to_string(i), std::move(doc)).ok());
+    }
+    assert(ds.createIndex("c", "hits", type).ok());
+    auto sub = std::move(ds.subscribeChanges("c").value());
+    auto hits = [](int64_t n) {
+      return where(dcmp("hits", Op::Eq, ValueFactory::createInteger(n)));
+    };
+    for (int i = 0; i < 20; i += 3)
+      assert(ds.patch("c", "k" + std::to_string(i),
+                      ops(update(U::Inc, "hits",
+                                 ValueFactory::createInteger(10))))
+                 .ok());
+    assert(ds.patch("c", "k1", ops(update(U::Unset, "hits"))).ok());
+    assert(keys(ds, hits(10)) == (std::vector<std::string>{"k0", "k12"}));
+    assert(keys(ds, hits(13)) == (std::vector<std::string>{"k15", "k3"}));
+    assert(keys(ds, hits(1)) ==
+           (std::vector<std::string>{"k13", "k17", "k5"}));
+    auto res = sub->poll(0);
+    assert(res.hasValue() && res.value().size() == 8);
+    const auto &last = res.value().back();
+    assert(last->kind == ChangeEvent::Kind::Update && last->key == "k1");
+    assert(last->beforeDoc->at("hits")->asInt() == 1 &&
+           last->afterDoc->empty());
+
+    // updateWhere() patches every match, through the index
+    auto n = ds.updateWhere(
+        "c", hits(10),
+        ops(update(U::Set, "hits", ValueFactory::createInteger(2))));
+    assert(n.hasValue() && n.value() == 2);
+    assert(keys(ds, hits(10)).empty() && keys(ds, hits(2)).size() == 5);
+    assert(sub->poll(0).value().size() == 2);
+
+    // A patch beyond the budget changes nothing
+    const size_t used = ds.memoryUsage("c").value();
+    assert(ds.setMemoryBudget("c", used + 64).ok());
+    auto grow = ops(update(U::Set, "blob",
+                           ValueFactory::createString(std::string(200, 'b'))));
+    assert(ds.patch("c", "k0", grow).code() == StatusCode::ResourceExhausted);
+    assert(ds.updateWhere("c", hits(2), grow).status().code() ==
+           StatusCode::ResourceExhausted);
+    assert(ds.memoryUsage("c").value() == used);
+    assert(keys(ds, hits(2)).size() == 5);
+    assert(ds.get("c", "k0").value().size() == 1);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 5: updateWhere is all or nothing..." << std::endl;
+  {
+    DocumentSchema schema;
+    schema.addField(Column{"slot", ColumnType::Integer, true, true, {}});
+    schema.addField(Column{"g", ColumnType::String, true, false, {}});
+    InMemoryDocumentStorage ds;
+    assert(ds.createCollection("c", schema).ok());
+    for (int i = 0; i < 6; ++i) {
+      Document doc;
+      doc["slot"] = ValueFactory::createInteger(i);
+      doc["g"] = ValueFactory::createString(i < 3 ? "a" : "b");
+      assert(ds.put("c", "k" + std::to_string(i), std::move(doc)).ok());
+    }
+    auto inA = where(dcmp("g", Op::Eq, ValueFactory::createString("a")));
+    // Shifting slots by 3 collides with the "b" documents
+    auto shift = ops(update(U::Inc, "slot", ValueFactory::createInteger(3)));
+    assert(ds.updateWhere("c", inA, shift).status().code() ==
+           StatusCode::FailedPrecondition);
+    for (int i = 0; i < 6; ++i)
+      assert(ds.get("c", "k" + std::to_string(i)).value().at("slot")->asInt() ==
+             i);
+    auto bump = ops(update(U::Inc, "slot", ValueFactory::createInteger(10)));
+    assert(ds.updateWhere("c", inA, bump).value() == 3);
+    assert(ds.updateWhere("c", std::nullopt, bump).value() == 6);
+    assert(ds.get("c", "k0").value().at("slot")->asInt() == 20);
+    assert(ds.get("c", "k5").value().at("slot")->asInt() == 15);
+    auto unknown = where(dcmp("zz", Op::Eq, ValueFactory::createInteger(1)));
+    assert(ds.updateWhere("c", unknown, bump).status().code() ==
+           StatusCode::InvalidArgument);
+    assert(ds.updateWhere("none", std::nullopt, bump).status().code() ==
+           StatusCode::NotFound);
+
+    // The defaults go through get() and put()
+    Forwarding fw(ds);
+    assert(fw.patch("c", "k0",
+                    ops(update(U::Set, "g", ValueFactory::createString("c"))))
+               .ok());
+    assert(fw.patch("c", "k0", ops(update(U::Unset, "slot"),
+                                   update(U::Set, "g",
+                                          ValueFactory::createInteger(1))))
+               .code() == StatusCode::InvalidArgument);
+    assert(fw.patch("c", "nope", bump).code() == StatusCode::NotFound);
+    auto inC = where(dcmp("g", Op::Eq, ValueFactory::createString("c")));
+    assert(fw.updateWhere("c", inC, bump).value() == 1);
+    assert(ds.get("c", "k0").value().at("slot")->asInt() == 30);
+    assert(ds.get("c", "k0").value().at("g")->asString() == "c");
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll document patch tests passed!" << std::endl;
+  return 0;
+}
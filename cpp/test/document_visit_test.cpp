@@ -0,0 +1,172 @@
+#include "kadedb/predicate_builder.h"
+#include "kadedb/storage.h"
+#include "kadedb/stored_document.h"
+#include "kadedb/value.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+
+using Op = DocPredicate::Op;
+
+static std::optional<DocPredicate> where(DocPredicate p) {
+  std::optional<DocPredicate> w;
+  w.emplace(std::move(p));
+  return w;
+}
+
+static Document patient(int i) {
+  Document d;
+  d["mrn"] = ValueFactory::createString("MRN-" + std::to_string(i));
+  d["age"] = ValueFactory::createInteger(20 + i % 60);
+  d["weight"] = ValueFactory::createFloat(50.0 + i % 40);
+  d["active"] = ValueFactory::createBoolean(i % 2 == 0);
+  if (i % 5 == 0)
+    d["note"] = nullptr;
+  return d;
+}
+
+// Key -> "field=value;..." over the visited views, fields sorted
+using Flat = std::map<std::string, std::string>;
+
+static Flat visit(DocumentStorage &ds, const std::vector<std::string> &fields,
+                  std::optional<DocPredicate> w, bool base = false) {
+  Flat out;
+  auto fn = [&](const std::string &key, const DocumentView &doc) {
+    std::map<std::string, std::string> cells;
+    doc.forEachField([&](const std::string &name, FieldRef f) {
+      cells[name] = f.hasValue() ? f.toString() : "<none>";
+    });
+    std::string flat;
+    for (const auto &kv : cells)
+      flat += kv.first + "=" + kv.second + ";";
+    assert(out.emplace(key, flat).second);
+    return true;
+  };
+  Status st = base ? ds.DocumentStorage::queryVisit("c", fields, w, fn)
+                   : ds.queryVisit("c", fields, w, fn);
+  assert(st.ok());
+  return out;
+}
+
+int main() {
+  std::cout << "Running document visitor tests..." << std::endl;
+
+  for (DocumentLayout layout : {DocumentLayout::Map, DocumentLayout::Shaped}) {
+    InMemoryDocumentStorage ds(layout);
+    DocumentSchema schema;
+    schema.addField(Column{"mrn", ColumnType::String, false, true, {}});
+    schema.addField(Column{"age", ColumnType::Integer, false, false, {}});
+    schema.addField(Column{"weight", ColumnType::Float, false, false, {}});
+    schema.addField(Column{"active", ColumnType::Boolean, false, false, {}});
+    schema.addField(Column{"note", ColumnType::String, true, false, {}});
+    assert(ds.createCollection("c", schema).ok());
+
+    std::cout << "Test 1: move-taking put stores the document" << std::endl;
+    {
+      for (int i = 0; i < 200; ++i)
+        assert(ds.put("c", "k" + std::to_string(i), patient(i)).ok());
+      // Replacing through either overload keeps uniqueness and indexes
+      assert(ds.createIndex("c", "age", IndexType::Ordered).ok());
+      Document d = patient(7);
+      assert(ds.put("c", "k7", std::move(d)).ok());
+      Document dup = patient(8);
+      assert(ds.put("c", "k9", std::move(dup)).code() ==
+             StatusCode::FailedPrecondition);
+      Document bad = patient(9);
+      bad["age"] = ValueFactory::createString("old");
+      assert(ds.put("c", "k9", std::move(bad)).code() ==
+             StatusCode::InvalidArgument);
+      assert(ds.count("c").value() == 200);
+      auto k9 = ds.get("c", "k9");
+      assert(k9.hasValue() && k9.value().at("age")->asInt() == 29);
+
+      // The base overload copies through put(const Document &)
+      Document again = patient(300);
+      assert(ds.DocumentStorage::put("c", "k300", std::move(again)).ok());
+      auto k300 = ds.get("c", "k300");
+      assert(k300.value().at("mrn")->asString() == "MRN-300");
+      assert(ds.erase("c", "k300").ok());
+    }
+    std::cout << "  PASSED" << std::endl;
+
+    std::cout << "Test 2: views match query results" << std::endl;
+    {
+      auto w = [] {
+        return where(dcmp("age", Op::Ge, ValueFactory::createInteger(60)));
+      };
+      auto res = ds.query("c", {}, w());
+      assert(res.hasValue());
+      Flat viaQuery;
+      for (const auto &kv : res.value()) {
+        std::map<std::string, std::string> cells;
+        for (const auto &f : kv.second)
+          cells[f.first] = f.second ? f.second->toString() : "<none>";
+        std::string flat;
+        for (const auto &c : cells)
+          flat += c.first + "=" + c.second + ";";
+        viaQuery.emplace(kv.first, flat);
+      }
+      assert(!viaQuery.empty() && visit(ds, {}, w()) == viaQuery);
+      assert(visit(ds, {}, w(), true) == viaQuery);
+      assert(visit(ds, {}, std::nullopt).size() == 200);
+
+      // Projection: listed fields only, in the view and its copies
+      auto projected = visit(ds, {"note", "mrn"}, std::nullopt);
+      assert(projected.at("k5") == "mrn=\"MRN-5\";note=<none>;");
+      assert(projected.at("k6") == "mrn=\"MRN-6\";");
+      assert(visit(ds, {"note", "mrn"}, std::nullopt, true) == projected);
+      auto onlyMrn = [](const std::string &, const DocumentView &doc) {
+        assert(!doc.field("age").found());
+        FieldRef mrn = doc.field("mrn");
+        assert(mrn.hasValue() && mrn.asString().rfind("MRN-", 0) == 0);
+        assert(doc.toDocument().size() == 1);
+        return true;
+      };
+      assert(ds.queryVisit("c", {"mrn"}, std::nullopt, onlyMrn).ok());
+
+      // Typed reads straight from the stored values
+      auto typed = [](const std::string &key, const DocumentView &doc) {
+        const int i = std::stoi(key.substr(1));
+        assert(doc.field("age").asInt() == 20 + i % 60);
+        assert(doc.field("weight").asFloat() == 50.0 + i % 40);
+        assert(doc.field("active").asBool() == (i % 2 == 0));
+        return true;
+      };
+      assert(ds.queryVisit("c", {}, std::nullopt, typed).ok());
+    }
+    std::cout << "  PASSED" << std::endl;
+
+    std::cout << "Test 3: early stop and errors" << std::endl;
+    {
+      size_t seen = 0;
+      auto stopAt3 = [&](const std::string &, const DocumentView &) {
+        return ++seen < 3;
+      };
+      assert(ds.queryVisit("c", {}, std::nullopt, stopAt3).ok() && seen == 3);
+      auto never = [](const std::string &, const DocumentView &) {
+        assert(false);
+        return true;
+      };
+      assert(ds.queryVisit("nope", {}, std::nullopt, never).code() ==
+             StatusCode::NotFound);
+      assert(ds.queryVisit("c", {"bogus"}, std::nullopt, never).code() ==
+             StatusCode::InvalidArgument);
+      assert(ds.queryVisit("c", {},
+                           where(dcmp("bogus", Op::Eq,
+                                      ValueFactory::createInteger(1))),
+                           never)
+                 .code() == StatusCode::InvalidArgument);
+    }
+    std::cout << "  PASSED" << std::endl;
+  }
+
+  std::cout << "\nAll document visitor tests passed!" << std::endl;
+  return 0;
+}
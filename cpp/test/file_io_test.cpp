@@ -0,0 +1,240 @@
+#include "kadedb/checkpoint.h"
+#include "kadedb/file_io.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+#include "kadedb/wal.h"
+
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace kadedb;
+
+static std::string tempPath(const char *name) {
+  auto p = std::filesystem::temp_directory_path() /
+           ("kadedb_file_io_test_" + std::string(name));
+  std::filesystem::remove(p);
+  return p.string();
+}
+
+static int openRw(const std::string &path) {
+#ifdef _WIN32
+  return ::_open(path.c_str(), _O_RDWR | _O_CREAT | _O_BINARY,
+                 _S_IREAD | _S_IWRITE);
+#else
+  return ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+#endif
+}
+
+static void closeFd(int fd) {
+#ifdef _WIN32
+  ::_close(fd);
+#else
+  ::close(fd);
+#endif
+}
+
+static std::string slurp(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+static std::vector<IoBackend> backends() {
+  return {IoBackend::Auto, IoBackend::Uring, IoBackend::Threads};
+}
+
+static Row row(int64_t id) {
+  Row r(2);
+  r.set(0, ValueFactory::createInteger(id));
+  r.set(1, ValueFactory::createString("row " + std::to_string(id)));
+  return r;
+}
+
+static TableSchema schema() {
+  return TableSchema({Column{"id", ColumnType::Integer, false, true, {}},
+                      Column{"name", ColumnType::String, true, false, {}}},
+                     std::string("id"));
+}
+
+int main() {
+  std::cout << "=== File I/O Tests ===" << std::endl;
+
+  std::cout << "Test 1: batches of writes, syncs and reads..." << std::endl;
+  {
+    for (IoBackend backend : backends()) {
+      IoQueue io(backend, 4);
+      assert(io.backend() != IoBackend::Auto);
+      if (backend == IoBackend::Threads)
+        assert(io.backend() == IoBackend::Threads);
+      const std::string path = tempPath("batch");
+      const int fd = openRw(path);
+      assert(fd >= 0);
+
+      // 40 writes of 1000 bytes through a queue of depth 4, then a sync
+      std::string data(40000, '\0');
+      for (size_t i = 0; i < data.size(); ++i)
+        data[i] = static_cast<char>('a' + (i * 7) % 26);
+      std::vector<IoOp> ops;
+      for (size_t off = 0; off < data.size(); off += 1000)
+        ops.push_back(IoOp::write(fd, data.data() + off, 1000, off));
+      ops.push_back(IoOp::sync(fd));
+      assert(io.run(ops, path).ok());
+      assert(slurp(path) == data);
+
+      // Appends with a sync each, several batches in flight at once
+      std::vector<uint64_t> tickets;
+      for (size_t i = 0; i < 8; ++i)
+        tickets.push_back(io.submit({IoOp::write(fd, "0123456789", 10,
+                                                 data.size() + 10 * i),
+                                     IoOp::sync(fd)},
+                                    path));
+      for (size_t i = tickets.size(); i-- > 0;)
+        assert(io.wait(tickets[i]).ok());
+      assert(slurp(path).size() == data.size() + 80);
+      assert(io.wait(tickets[0]).code() == StatusCode::InvalidArgument);
+      assert(io.run({}, path).ok());
+
+      // Recovery reads in small concurrent chunks
+      std::string back;
+      assert(fileio::readFile(io, fd, data.size(), path, back, 999).ok());
+      assert(back == data);
+      closeFd(fd);
+      std::filesystem::remove(path);
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: errors name the file and fail the batch..."
+            << std::endl;
+  {
+    for (IoBackend backend : backends()) {
+      IoQueue io(backend);
+      const std::string path = tempPath("errors");
+      const int fd = openRw(path);
+      assert(fd >= 0);
+      assert(io.run({IoOp::write(fd, "abc", 3, 0)}, path).ok());
+
+      char buf[8];
+      Status st = io.run({IoOp::read(fd, buf, 8, 0)}, path);
+      assert(st.code() == StatusCode::Internal);
+      assert(st.message().find("cannot read " + path) == 0);
+      assert(st.message().find("end of file") != std::string::npos);
+
+      // Nothing after a failed op runs
+      st = io.run({IoOp::write(-1, "x", 1, 0), IoOp::sync(fd),
+                   IoOp::write(fd, "zzz", 3, 0)},
+                  path);
+      assert(st.code() == StatusCode::Internal);
+      assert(st.message().find("cannot write " + path) == 0);
+      assert(slurp(path) == "abc");
+      st = io.run({IoOp::write(fd, "x", 1, 3), IoOp::sync(-1)}, path);
+      assert(st.message().find("cannot sync " + path) == 0);
+      assert(io.run({IoOp::read(fd, buf, 4, 0)}, path).ok());
+      assert(std::string(buf, 4) == "abcx");
+      closeFd(fd);
+      std::filesystem::remove(path);
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: the WAL on each backend..." << std::endl;
+  {
+    for (IoBackend backend : backends()) {
+      const std::string path = tempPath("wal");
+      WalOptions options;
+      options.io = backend;
+      options.commitDelay = std::chrono::microseconds(0);
+      {
+        auto wal = WriteAheadLog::open(path, options).takeValue();
+        assert(wal->commit(walRecord::createTable("t", schema())).ok());
+        std::vector<std::thread> writers;
+        for (int w = 0; w < 4; ++w)
+          writers.emplace_back([&, w] {
+            for (int64_t i = 0; i < 250; ++i)
+              assert(wal->commit(walRecord::insertRow("t", row(w * 1000 + i)))
+                         .ok());
+          });
+        for (auto &t : writers)
+          t.join();
+        assert(wal->durableLsn() == 1001);
+      }
+      {
+        // Reopening reads the log back and appends after it
+        auto wal = WriteAheadLog::open(path, options).takeValue();
+        assert(wal->lastLsn() == 1001);
+        assert(wal->commit(walRecord::insertRow("t", row(99999))).ok());
+      }
+      InMemoryRelationalStorage rel;
+      WalTargets targets;
+      targets.relational = &rel;
+      assert(replayWal(path, targets).value() == 1002);
+      assert(rel.estimateRowCount("t").value() == 1001);
+      std::filesystem::remove(path);
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: checkpoints through staged direct writes..."
+            << std::endl;
+  {
+    // openDirect() creates or truncates, with or without O_DIRECT
+    const std::string probe = tempPath("probe");
+    std::ofstream(probe) << "stale";
+    bool direct = false;
+    const int fd = fileio::openDirect(probe, &direct);
+    assert(fd >= 0);
+    closeFd(fd);
+    assert(std::filesystem::file_size(probe) == 0);
+    std::filesystem::remove(probe);
+
+    // Several 2 MiB chunks and an unaligned tail
+    InMemoryRelationalStorage rel;
+    assert(rel.createTable("t", schema()).ok());
+    for (int64_t i = 0; i < 150000; ++i)
+      assert(rel.insertRow("t", row(i)).ok());
+    const std::string path = tempPath("checkpoint");
+    assert(writeCheckpoint(path, rel, 7).ok());
+    // Cut back to the directory's end after the padded last chunk
+    const auto size = std::filesystem::file_size(path);
+    assert(size > (size_t{2} << 20) && size % fileio::kDirectAlign != 0);
+    assert(!std::filesystem::exists(path + ".tmp"));
+
+    auto cp = CheckpointStorage::open(path).takeValue();
+    assert(cp->walLsn() == 7);
+    auto all = cp->select("t", {}, std::nullopt);
+    assert(all.hasValue() && all.value().rowCount() == 150000);
+    auto orig = rel.select("t", {}, std::nullopt);
+    for (size_t r = 0; r < 150000; r += 1237) {
+      assert(all.value().at(r, 0).asInt() == orig.value().at(r, 0).asInt());
+      assert(all.value().at(r, 1).asString() ==
+             orig.value().at(r, 1).asString());
+    }
+    cp.reset();
+
+    // Rewriting over an existing checkpoint replaces it
+    assert(rel.truncateTable("t").ok());
+    assert(rel.insertRow("t", row(5)).ok());
+    assert(writeCheckpoint(path, rel, 8).ok());
+    assert(std::filesystem::file_size(path) < (size_t{1} << 20));
+    cp = CheckpointStorage::open(path).takeValue();
+    assert(cp->walLsn() == 8);
+    assert(cp->select("t", {}, std::nullopt).value().rowCount() == 1);
+    cp.reset();
+    std::filesystem::remove(path);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll file I/O tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,249 @@
+#include "kadedb/graph/csr.h"
+#include "kadedb/graph/storage.h"
+#include "kadedb/wal.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+
+static Node node(NodeId id) {
+  Node n;
+  n.id = id;
+  n.labels = {id % 2 ? "Odd" : "Even"};
+  n.properties["rank"] = ValueFactory::createInteger(id % 10);
+  return n;
+}
+
+static Edge edge(EdgeId id, NodeId from, NodeId to) {
+  Edge e;
+  e.id = id;
+  e.from = from;
+  e.to = to;
+  e.type = "LINK";
+  e.properties["w"] = ValueFactory::createInteger(id % 5);
+  return e;
+}
+
+// Random graph of `n` nodes and `m` edges, with ids 1000 apart so the
+// snapshot is not contiguous
+static void randomGraph(size_t n, size_t m, uint32_t seed,
+                        std::vector<Node> &nodes, std::vector<Edge> &edges) {
+  std::mt19937 rng(seed);
+  nodes.clear();
+  edges.clear();
+  for (size_t i = 0; i < n; ++i)
+    nodes.push_back(node(static_cast<NodeId>(i * 1000)));
+  for (size_t e = 0; e < m; ++e)
+    edges.push_back(edge(static_cast<EdgeId>(e), nodes[rng() % n].id,
+                         nodes[rng() % n].id));
+}
+
+// Same adjacency, in the same order, and the same byte count
+static void assertSame(const InMemoryGraphStorage &a,
+                       const InMemoryGraphStorage &b,
+                       const std::vector<Node> &nodes) {
+  for (const Node &n : nodes) {
+    assert(a.getNode("g", n.id).hasValue() == b.getNode("g", n.id).hasValue());
+    if (!a.getNode("g", n.id).hasValue())
+      continue;
+    assert(a.edgeIdsOut("g", n.id).value() == b.edgeIdsOut("g", n.id).value());
+    assert(a.edgeIdsIn("g", n.id).value() == b.edgeIdsIn("g", n.id).value());
+    assert(a.neighborsOut("g", n.id).value() ==
+           b.neighborsOut("g", n.id).value());
+  }
+  assert(a.memoryUsage("g").value() == b.memoryUsage("g").value());
+  auto ca = a.contents("g").value(), cb = b.contents("g").value();
+  assert(ca.nodes.size() == cb.nodes.size());
+  assert(ca.edges.size() == cb.edges.size());
+  for (size_t i = 0; i < ca.edges.size(); ++i)
+    assert(ca.edges[i].id == cb.edges[i].id &&
+           ca.edges[i].from == cb.edges[i].from &&
+           ca.edges[i].to == cb.edges[i].to);
+}
+
+int main() {
+  std::cout << "=== Graph Bulk Load Tests ===" << std::endl;
+
+  std::cout << "Test 1: batches match one put at a time..." << std::endl;
+  {
+    std::vector<Node> nodes;
+    std::vector<Edge> edges;
+    randomGraph(2000, 40000, 1, nodes, edges);
+    InMemoryGraphStorage one, batch;
+    assert(one.createGraph("g").ok() && batch.createGraph("g").ok());
+    assert(one.createEdgeIndex("g", "w", IndexType::Hash).ok());
+    assert(batch.createEdgeIndex("g", "w", IndexType::Hash).ok());
+    for (const Node &n : nodes)
+      assert(one.putNode("g", n).ok());
+    for (const Edge &e : edges)
+      assert(one.putEdge("g", e).ok());
+    assert(batch.putNodes("g", nodes).ok());
+    assert(batch.putEdges("g", edges).ok());
+    assertSame(one, batch, nodes);
+    assert(batch.nodesWithLabel("g", "Odd").value() ==
+           one.nodesWithLabel("g", "Odd").value());
+    assert(batch.findEdges("g", "w", *ValueFactory::createInteger(3))
+               .value() ==
+           one.findEdges("g", "w", *ValueFactory::createInteger(3)).value());
+    assert(batch.bfs("g", 0, 0).value() == one.bfs("g", 0, 0).value());
+    assert(batch.parallelBfs("g", 0).value() ==
+           one.parallelBfs("g", 0).value());
+
+    // A second batch into the loaded graph: new edges, replacements, and an
+    // id repeated within the batch
+    std::vector<Edge> more;
+    for (EdgeId e = 39990; e < 40100; ++e)
+      more.push_back(edge(e, nodes[e % 7].id, nodes[e % 11].id));
+    more.push_back(edge(40050, nodes[3].id, nodes[4].id));
+    for (const Edge &e : more)
+      assert(one.putEdge("g", e).ok());
+    assert(batch.putEdges("g", more).ok());
+    assertSame(one, batch, nodes);
+    assert(batch.getEdge("g", 40050).value().from == nodes[3].id);
+    assert(batch.snapshot("g").value()->edgeCount() == 40100);
+
+    // Erases after a bulk load keep the adjacency index and slots coherent
+    for (EdgeId e = 0; e < 40100; e += 3) {
+      assert(one.eraseEdge("g", e).ok());
+      assert(batch.eraseEdge("g", e).ok());
+    }
+    assert(one.eraseNode("g", nodes[5].id).ok());
+    assert(batch.eraseNode("g", nodes[5].id).ok());
+    assertSame(one, batch, nodes);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: a bulk load builds the snapshot directly..."
+            << std::endl;
+  {
+    std::vector<Node> nodes;
+    std::vector<Edge> edges;
+    randomGraph(500, 5000, 2, nodes, edges);
+    InMemoryGraphStorage gs;
+    assert(gs.createGraph("g").ok());
+    assert(gs.putNodes("g", nodes).ok());
+    // Repeated ids keep their last copy
+    edges.push_back(edge(7, nodes[1].id, nodes[2].id));
+    assert(gs.putEdges("g", edges).ok());
+    auto snap = gs.snapshot("g").value();
+    assert(snap->nodeCount() == 500 && snap->edgeCount() == 5000);
+    // Up to date: the next call returns the same copy
+    assert(gs.snapshot("g").value() == snap);
+    auto built = CsrGraph::build(std::vector<NodeId>{}, edges);
+    assert(built.nodeCount() == 0 && built.edgeCount() == 0);
+    for (const Node &n : nodes) {
+      const CsrGraph::Index i = snap->indexOf(n.id);
+      assert(i != CsrGraph::npos);
+      auto out = gs.edgeIdsOut("g", n.id).value();
+      assert(std::vector<EdgeId>(snap->outEdges(i),
+                                 snap->outEdges(i) + snap->outDegree(i)) ==
+             out);
+      auto in = gs.edgeIdsIn("g", n.id).value();
+      assert(std::vector<EdgeId>(snap->inEdges(i),
+                                 snap->inEdges(i) + snap->inDegree(i)) == in);
+    }
+    auto outOf1 = gs.edgeIdsOut("g", nodes[1].id).value();
+    assert(outOf1.back() == 7);
+
+    // The edge-list build has the neighbors of the adjacency-index build;
+    // the order differs where separate puts moved edges on replacing 7
+    auto sorted = [](CsrGraph::Neighbors nb) {
+      std::vector<CsrGraph::Index> v(nb.begin(), nb.end());
+      std::sort(v.begin(), v.end());
+      return v;
+    };
+    InMemoryGraphStorage ref;
+    assert(ref.createGraph("g").ok());
+    for (const Node &n : nodes)
+      assert(ref.putNode("g", n).ok());
+    for (const Edge &e : edges)
+      assert(ref.putEdge("g", e).ok());
+    auto refSnap = ref.snapshot("g").value();
+    assert(refSnap->edgeCount() == snap->edgeCount());
+    for (CsrGraph::Index i = 0; i < snap->nodeCount(); ++i) {
+      assert(snap->id(i) == refSnap->id(i));
+      assert(sorted(snap->out(i)) == sorted(refSnap->out(i)));
+      assert(sorted(snap->in(i)) == sorted(refSnap->in(i)));
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: failed batches store nothing..." << std::endl;
+  {
+    InMemoryGraphStorage gs;
+    assert(gs.createGraph("g").ok());
+    assert(gs.putNodes("missing", {node(1)}).code() == StatusCode::NotFound);
+    assert(gs.putNodes("g", {node(1), node(2), node(3)}).ok());
+    const size_t before = gs.memoryUsage("g").value();
+    auto st = gs.putEdges("g", {edge(1, 1, 2), edge(2, 2, 9), edge(3, 3, 1)});
+    assert(st.code() == StatusCode::InvalidArgument);
+    assert(st.message().find("edge 2") != std::string::npos);
+    assert(gs.getEdge("g", 1).status().code() == StatusCode::NotFound);
+    assert(gs.edgeIdsOut("g", 1).value().empty());
+    assert(gs.memoryUsage("g").value() == before);
+
+    assert(gs.setMemoryBudget("g", before + 10).ok());
+    assert(gs.putEdges("g", {edge(1, 1, 2), edge(2, 2, 3)}).code() ==
+           StatusCode::ResourceExhausted);
+    assert(gs.putNodes("g", {node(4), node(5)}).code() ==
+           StatusCode::ResourceExhausted);
+    assert(gs.getNode("g", 4).status().code() == StatusCode::NotFound);
+    assert(gs.memoryUsage("g").value() == before);
+    assert(gs.setMemoryBudget("g", 0).ok());
+    assert(gs.putEdges("g", {}).ok() && gs.putNodes("g", {}).ok());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: log replay applies puts in batches..." << std::endl;
+  {
+    std::vector<Node> nodes;
+    std::vector<Edge> edges;
+    randomGraph(300, 3000, 3, nodes, edges);
+    std::vector<WalRecord> log{walRecord::createGraph("g")};
+    for (const Node &n : nodes)
+      log.push_back(walRecord::putNode("g", n));
+    for (const Edge &e : edges)
+      log.push_back(walRecord::putEdge("g", e));
+    log.push_back(walRecord::eraseEdge("g", 11));
+    log.push_back(walRecord::putEdge("g", edge(11, nodes[0].id, nodes[1].id)));
+
+    InMemoryGraphStorage replayed, ref;
+    WalTargets targets;
+    targets.graph = &replayed;
+    auto applied = applyWalRecords(log, targets);
+    assert(applied.hasValue() && applied.value() == log.size());
+    assert(ref.createGraph("g").ok());
+    for (const Node &n : nodes)
+      assert(ref.putNode("g", n).ok());
+    for (const Edge &e : edges)
+      assert(ref.putEdge("g", e).ok());
+    assert(ref.eraseEdge("g", 11).ok());
+    assert(ref.putEdge("g", edge(11, nodes[0].id, nodes[1].id)).ok());
+    assertSame(replayed, ref, nodes);
+
+    // A bad record inside a run is still reported by its own number, after
+    // the records before it
+    std::vector<WalRecord> bad{walRecord::createGraph("g")};
+    bad.push_back(walRecord::putNode("g", node(1)));
+    bad.push_back(walRecord::putNode("g", node(2)));
+    bad.push_back(walRecord::putEdge("g", edge(1, 1, 2)));
+    bad.push_back(walRecord::putEdge("g", edge(2, 2, 99)));
+    bad.push_back(walRecord::putEdge("g", edge(3, 2, 1)));
+    InMemoryGraphStorage partial;
+    targets.graph = &partial;
+    auto res = applyWalRecords(bad, targets, 1, 100);
+    assert(res.status().code() == StatusCode::InvalidArgument);
+    assert(res.status().message().find("Log record 105") != std::string::npos);
+    assert(partial.getEdge("g", 1).hasValue());
+    assert(partial.getEdge("g", 3).status().code() == StatusCode::NotFound);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll graph bulk load tests passed!" << std::endl;
+  return 0;
+}
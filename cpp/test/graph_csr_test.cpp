@@ -0,0 +1,270 @@
+#include "kadedb/graph/csr.h"
+#include "kadedb/graph/storage.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <unordered_set>
+#include <vector>
+
+using namespace kadedb;
+
+static Edge edge(EdgeId id, NodeId from, NodeId to) {
+  Edge e;
+  e.id = id;
+  e.from = from;
+  e.to = to;
+  e.type = "LINK";
+  return e;
+}
+
+static std::vector<NodeId> ids(const CsrGraph &g, CsrGraph::Neighbors nb) {
+  std::vector<NodeId> out;
+  for (CsrGraph::Index j : nb)
+    out.push_back(g.id(j));
+  return out;
+}
+
+// Neighbors straight from the adjacency index, bypassing the snapshot
+static std::vector<NodeId> reference(const InMemoryGraphStorage &gs,
+                                     NodeId id, bool outgoing) {
+  auto eids = outgoing ? gs.edgeIdsOut("g", id) : gs.edgeIdsIn("g", id);
+  assert(eids.hasValue());
+  std::vector<NodeId> out;
+  for (EdgeId e : eids.value()) {
+    auto ed = gs.getEdge("g", e);
+    assert(ed.hasValue());
+    out.push_back(outgoing ? ed.value().to : ed.value().from);
+  }
+  return out;
+}
+
+static std::vector<NodeId> referenceBfs(const InMemoryGraphStorage &gs,
+                                        NodeId start) {
+  std::vector<NodeId> order{start};
+  std::unordered_set<NodeId> seen{start};
+  for (size_t head = 0; head < order.size(); ++head)
+    for (NodeId n : reference(gs, order[head], true))
+      if (seen.insert(n).second)
+        order.push_back(n);
+  return order;
+}
+
+static std::vector<NodeId> referenceDfs(const InMemoryGraphStorage &gs,
+                                        NodeId start) {
+  std::vector<NodeId> order, stack{start};
+  std::unordered_set<NodeId> seen;
+  while (!stack.empty()) {
+    NodeId cur = stack.back();
+    stack.pop_back();
+    if (!seen.insert(cur).second)
+      continue;
+    order.push_back(cur);
+    auto nb = reference(gs, cur, true);
+    for (auto it = nb.rbegin(); it != nb.rend(); ++it)
+      if (!seen.count(*it))
+        stack.push_back(*it);
+  }
+  return order;
+}
+
+int main() {
+  std::cout << "Running graph CSR tests..." << std::endl;
+
+  std::cout << "Test 1: CSR layout keeps adjacency order" << std::endl;
+  {
+    std::unordered_map<EdgeId, Edge> edges;
+    AdjacencyIndex out, in;
+    auto add = [&](EdgeId id, NodeId from, NodeId to) {
+      edges[id] = edge(id, from, to);
+      out[from].push_back(id);
+      in[to].push_back(id);
+    };
+    add(1, 10, 12);
+    add(2, 10, 11);
+    add(3, 11, 12);
+    add(4, 12, 99); // 99 is not a node: skipped
+    out[11].push_back(77); // dangling edge id: skipped
+
+    auto g = CsrGraph::build({12, 10, 11}, edges, out, in);
+    assert(g.nodeCount() == 3 && g.edgeCount() == 3);
+    assert(g.indexOf(10) == 0 && g.indexOf(12) == 2);
+    assert(g.indexOf(9) == CsrGraph::npos && g.indexOf(13) == CsrGraph::npos);
+    assert(ids(g, g.out(0)) == (std::vector<NodeId>{12, 11}));
+    assert(g.outEdges(0)[0] == 1 && g.outEdges(0)[1] == 2);
+    assert(g.outDegree(1) == 1 && g.outDegree(2) == 0);
+    assert(ids(g, g.in(2)) == (std::vector<NodeId>{10, 11}));
+    assert(g.inEdges(2)[1] == 3 && g.inDegree(0) == 0);
+
+    // Sparse ids are found by binary search
+    auto s = CsrGraph::build({1000, 5, 70}, edges, out, in);
+    assert(s.nodeCount() == 3 && s.edgeCount() == 0);
+    assert(s.indexOf(5) == 0 && s.indexOf(70) == 1 && s.indexOf(1000) == 2);
+    assert(s.indexOf(6) == CsrGraph::npos);
+    assert(s.out(1).empty() && s.memoryBytes() > 0);
+
+    CsrGraph empty;
+    assert(empty.nodeCount() == 0 && empty.indexOf(0) == CsrGraph::npos);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: traversals match the adjacency index under writes"
+            << std::endl;
+  {
+    // Rarely rebuilt (the overlay answers) and rebuilt on every traversal
+    for (size_t threshold : {size_t{1} << 30, size_t{0}}) {
+      InMemoryGraphStorage gs(threshold);
+      assert(gs.createGraph("g").ok());
+      std::mt19937 rng(7);
+      const NodeId kNodes = 200;
+      for (NodeId n = 0; n < kNodes; n += 2) {
+        Node node;
+        node.id = n;
+        assert(gs.putNode("g", node).ok());
+      }
+      EdgeId nextEdge = 1;
+      std::vector<EdgeId> live;
+      for (int step = 0; step < 3000; ++step) {
+        const int op = static_cast<int>(rng() % 10);
+        const NodeId a = static_cast<NodeId>(rng() % kNodes);
+        const NodeId b = static_cast<NodeId>(rng() % kNodes);
+        if (op < 5) {
+          Status st = gs.putEdge("g", edge(nextEdge, a, b));
+          if (st.ok())
+            live.push_back(nextEdge++);
+        } else if (op < 7 && !live.empty()) {
+          const size_t k = rng() % live.size();
+          (void)gs.eraseEdge("g", live[k]);
+          live[k] = live.back();
+          live.pop_back();
+        } else if (op < 8 && !live.empty()) {
+          // Re-point an edge: it moves to the back of its lists
+          (void)gs.putEdge("g", edge(live[rng() % live.size()], a, b));
+        } else if (op < 9) {
+          Node node;
+          node.id = a;
+          assert(gs.putNode("g", node).ok());
+        } else if (gs.getNode("g", a).hasValue() && a % 7 == 0) {
+          assert(gs.eraseNode("g", a).ok());
+        }
+
+        if (step % 50 != 0)
+          continue;
+        for (NodeId n = 0; n < kNodes; n += 5) {
+          if (!gs.getNode("g", n).hasValue()) {
+            assert(gs.bfs("g", n, 0).status().code() == StatusCode::NotFound);
+            continue;
+          }
+          assert(gs.neighborsOut("g", n).value() == reference(gs, n, true));
+          assert(gs.neighborsIn("g", n).value() == reference(gs, n, false));
+          assert(gs.bfs("g", n, 0).value() == referenceBfs(gs, n));
+          assert(gs.dfs("g", n, 0).value() == referenceDfs(gs, n));
+          auto full = referenceBfs(gs, n);
+          auto capped = gs.bfs("g", n, 3).value();
+          assert(capped.size() == std::min<size_t>(3, full.size()));
+          assert(std::equal(capped.begin(), capped.end(), full.begin()));
+        }
+      }
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: snapshot() reflects every write" << std::endl;
+  {
+    InMemoryGraphStorage gs;
+    assert(gs.createGraph("g").ok());
+    for (NodeId n = 1; n <= 3; ++n) {
+      Node node;
+      node.id = n;
+      assert(gs.putNode("g", node).ok());
+    }
+    assert(gs.putEdge("g", edge(1, 1, 2)).ok());
+    auto a = gs.snapshot("g");
+    assert(a.hasValue() && a.value()->edgeCount() == 1);
+    // Unchanged graphs share a snapshot
+    assert(gs.snapshot("g").value().get() == a.value().get());
+
+    assert(gs.putEdge("g", edge(2, 2, 3)).ok());
+    assert(gs.neighborsOut("g", 2).value() == std::vector<NodeId>{3});
+    auto b = gs.snapshot("g").value();
+    assert(b->edgeCount() == 2 && b.get() != a.value().get());
+    assert(a.value()->edgeCount() == 1); // earlier snapshots are immutable
+    const auto i = b->indexOf(2);
+    assert(ids(*b, b->out(i)) == std::vector<NodeId>{3});
+
+    assert(gs.eraseNode("g", 2).ok());
+    auto c = gs.snapshot("g").value();
+    assert(c->nodeCount() == 2 && c->edgeCount() == 0);
+
+    assert(gs.snapshot("missing").status().code() == StatusCode::NotFound);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: erases keep adjacency lists exact" << std::endl;
+  {
+    InMemoryGraphStorage gs;
+    assert(gs.createGraph("g").ok());
+    const NodeId kNodes = 50;
+    for (NodeId n = 0; n < kNodes; ++n) {
+      Node node;
+      node.id = n;
+      assert(gs.putNode("g", node).ok());
+    }
+    std::mt19937 rng(21);
+    std::unordered_map<EdgeId, Edge> live;
+    for (int step = 0; step < 4000; ++step) {
+      const EdgeId id = static_cast<EdgeId>(rng() % 600);
+      if (rng() % 3 == 0) {
+        if (gs.eraseEdge("g", id).ok())
+          live.erase(id);
+        continue;
+      }
+      Edge e = edge(id, static_cast<NodeId>(rng() % kNodes),
+                    static_cast<NodeId>(rng() % kNodes));
+      assert(gs.putEdge("g", e).ok());
+      live[id] = e;
+    }
+    for (NodeId n = 0; n < kNodes; ++n) {
+      std::vector<EdgeId> out, in;
+      for (const auto &kv : live) {
+        if (kv.second.from == n)
+          out.push_back(kv.first);
+        if (kv.second.to == n)
+          in.push_back(kv.first);
+      }
+      auto gotOut = gs.edgeIdsOut("g", n).value();
+      auto gotIn = gs.edgeIdsIn("g", n).value();
+      std::sort(out.begin(), out.end());
+      std::sort(in.begin(), in.end());
+      std::sort(gotOut.begin(), gotOut.end());
+      std::sort(gotIn.begin(), gotIn.end());
+      assert(gotOut == out && gotIn == in);
+    }
+
+    // A hub with 100k edges each way goes in one linear pass
+    Node hub;
+    hub.id = 1000;
+    assert(gs.putNode("g", hub).ok());
+    EdgeId next = 10000;
+    for (int k = 0; k < 100000; ++k) {
+      const NodeId other = static_cast<NodeId>(k % kNodes);
+      assert(gs.putEdge("g", edge(next++, hub.id, other)).ok());
+      assert(gs.putEdge("g", edge(next++, other, hub.id)).ok());
+    }
+    assert(gs.eraseNode("g", hub.id).ok());
+    for (NodeId n = 0; n < kNodes; ++n) {
+      auto out = gs.edgeIdsOut("g", n);
+      auto in = gs.edgeIdsIn("g", n);
+      for (EdgeId e : out.value())
+        assert(live.count(e));
+      for (EdgeId e : in.value())
+        assert(live.count(e));
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll graph CSR tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,283 @@
+#include "kadedb/graph/query.h"
+#include "kadedb/graph/storage.h"
+#include "kadedb/value.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+
+static Node node(NodeId id, std::initializer_list<std::string> labels) {
+  Node n;
+  n.id = id;
+  n.labels = labels;
+  return n;
+}
+
+static Edge edge(EdgeId id, NodeId from, NodeId to, const std::string &type) {
+  Edge e;
+  e.id = id;
+  e.from = from;
+  e.to = to;
+  e.type = type;
+  return e;
+}
+
+// Ids whose `property` satisfies `match`, found by asking for every node
+template <typename Match>
+static std::vector<NodeId> scan(const InMemoryGraphStorage &gs, NodeId nodes,
+                                const std::string &property,
+                                const Match &match) {
+  std::vector<NodeId> out;
+  for (NodeId id = 0; id < nodes; ++id) {
+    auto n = gs.getNode("g", id);
+    if (!n.hasValue())
+      continue;
+    auto it = n.value().properties.find(property);
+    if (match(it == n.value().properties.end() ? nullptr : it->second.get()))
+      out.push_back(id);
+  }
+  return out;
+}
+
+int main() {
+  std::cout << "Running graph index tests..." << std::endl;
+
+  std::cout << "Test 1: label postings follow node writes" << std::endl;
+  {
+    InMemoryGraphStorage gs;
+    assert(gs.createGraph("g").ok());
+    assert(gs.putNode("g", node(3, {"Patient"})).ok());
+    assert(gs.putNode("g", node(1, {"Patient", "Adult"})).ok());
+    assert(gs.putNode("g", node(2, {"Doctor"})).ok());
+    assert(gs.nodesWithLabel("g", "Patient").value() ==
+           (std::vector<NodeId>{1, 3}));
+
+    // Replacing a node moves it between labels
+    assert(gs.putNode("g", node(3, {"Doctor"})).ok());
+    assert(gs.nodesWithLabel("g", "Patient").value() ==
+           std::vector<NodeId>{1});
+    assert(gs.nodesWithLabel("g", "Doctor").value() ==
+           (std::vector<NodeId>{2, 3}));
+
+    assert(gs.eraseNode("g", 1).ok());
+    assert(gs.nodesWithLabel("g", "Patient").value().empty());
+    assert(gs.nodesWithLabel("g", "Adult").value().empty());
+    assert(gs.nodesWithLabel("nope", "Patient").status().code() ==
+           StatusCode::NotFound);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: property indexes agree with scans" << std::endl;
+  {
+    for (IndexType type : {IndexType::Hash, IndexType::Ordered}) {
+      InMemoryGraphStorage gs;
+      assert(gs.createGraph("g").ok());
+      const NodeId kNodes = 400;
+      std::mt19937 rng(13);
+      auto randomNode = [&](NodeId id) {
+        Node n = node(id, {});
+        switch (rng() % 6) {
+        case 0:
+          n.properties["age"] = ValueFactory::createInteger(rng() % 50);
+          break;
+        case 1:
+          n.properties["age"] = ValueFactory::createFloat((rng() % 100) / 2.0);
+          break;
+        case 2:
+          n.properties["age"] =
+              ValueFactory::createString(std::to_string(rng() % 5));
+          break;
+        case 3:
+          n.properties["age"] = ValueFactory::createNull();
+          break;
+        case 4:
+          n.properties["age"] = ValueFactory::createFloat(
+              std::numeric_limits<double>::quiet_NaN());
+          break;
+        default:
+          break; // no property
+        }
+        return n;
+      };
+      for (NodeId id = 0; id < kNodes / 2; ++id)
+        assert(gs.putNode("g", randomNode(id)).ok());
+      // Built over existing nodes, then maintained by writes
+      assert(gs.createNodeIndex("g", "age", type).ok());
+      assert(gs.createNodeIndex("g", "age", type).code() ==
+             StatusCode::AlreadyExists);
+      for (int step = 0; step < 600; ++step) {
+        const NodeId id = static_cast<NodeId>(rng() % kNodes);
+        if (rng() % 4 == 0)
+          (void)gs.eraseNode("g", id);
+        else
+          assert(gs.putNode("g", randomNode(id)).ok());
+      }
+
+      const auto seven = ValueFactory::createInteger(7);
+      const auto sevenF = ValueFactory::createFloat(7.0);
+      const auto three = ValueFactory::createString("3");
+      const auto nan =
+          ValueFactory::createFloat(std::numeric_limits<double>::quiet_NaN());
+      for (const Value *v : {seven.get(), sevenF.get(), three.get()}) {
+        auto want = scan(gs, kNodes, "age", [&](const Value *p) {
+          return p && p->type() != ValueType::Null &&
+                 !(p->type() == ValueType::Float && std::isnan(p->asFloat())) &&
+                 (p->type() == ValueType::String) ==
+                     (v->type() == ValueType::String) &&
+                 p->compare(*v) == 0;
+        });
+        assert(!want.empty());
+        assert(gs.findNodes("g", "age", *v).value() == want);
+      }
+      // 7 and 7.0 are the same key
+      assert(gs.findNodes("g", "age", *seven).value() ==
+             gs.findNodes("g", "age", *sevenF).value());
+      assert(gs.findNodes("g", "age", *nan).value().empty());
+      assert(gs.findNodes("g", "age", *ValueFactory::createNull())
+                 .value()
+                 .empty());
+
+      const auto lo = ValueFactory::createInteger(10);
+      const auto hi = ValueFactory::createFloat(20.5);
+      auto numeric = [](const Value *p) {
+        return p &&
+               (p->type() == ValueType::Integer ||
+                p->type() == ValueType::Float) &&
+               !std::isnan(p->asFloat());
+      };
+      auto between = gs.findNodesInRange("g", "age", lo.get(), hi.get());
+      assert(between.value() == scan(gs, kNodes, "age", [&](const Value *p) {
+               return numeric(p) && p->asFloat() >= 10 && p->asFloat() <= 20.5;
+             }));
+      auto below = gs.findNodesInRange("g", "age", nullptr, lo.get());
+      assert(below.value() == scan(gs, kNodes, "age", [&](const Value *p) {
+               return numeric(p) && p->asFloat() <= 10;
+             }));
+      auto strings = gs.findNodesInRange("g", "age", three.get(), nullptr);
+      assert(strings.value() == scan(gs, kNodes, "age", [&](const Value *p) {
+               return p && p->type() == ValueType::String &&
+                      p->asString() >= "3";
+             }));
+      assert(gs.findNodesInRange("g", "age", lo.get(), three.get())
+                 .value()
+                 .empty());
+
+      // Dropping the index falls back to scans with the same answers
+      auto indexed = gs.findNodes("g", "age", *seven).value();
+      assert(gs.dropNodeIndex("g", "age").ok());
+      assert(gs.dropNodeIndex("g", "age").code() == StatusCode::NotFound);
+      assert(gs.findNodes("g", "age", *seven).value() == indexed);
+      assert(gs.findNodesInRange("g", "age", lo.get(), hi.get()).value() ==
+             between.value());
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: edge indexes follow edge and node writes" << std::endl;
+  {
+    InMemoryGraphStorage gs;
+    assert(gs.createGraph("g").ok());
+    for (NodeId id = 1; id <= 4; ++id)
+      assert(gs.putNode("g", node(id, {})).ok());
+    assert(gs.createEdgeIndex("g", "dose", IndexType::Ordered).ok());
+    auto dosed = [&](EdgeId id, NodeId from, NodeId to, double dose) {
+      Edge e = edge(id, from, to, "PRESCRIBED");
+      e.properties["dose"] = ValueFactory::createFloat(dose);
+      return e;
+    };
+    assert(gs.putEdge("g", dosed(1, 1, 2, 5)).ok());
+    assert(gs.putEdge("g", dosed(2, 1, 3, 10)).ok());
+    assert(gs.putEdge("g", dosed(3, 2, 4, 10)).ok());
+    const auto ten = ValueFactory::createInteger(10);
+    assert(gs.findEdges("g", "dose", *ten).value() ==
+           (std::vector<EdgeId>{2, 3}));
+
+    assert(gs.putEdge("g", dosed(2, 1, 3, 2.5)).ok());
+    assert(gs.findEdges("g", "dose", *ten).value() == std::vector<EdgeId>{3});
+    // Erasing a node drops its edges from the index
+    assert(gs.eraseNode("g", 4).ok());
+    assert(gs.findEdges("g", "dose", *ten).value().empty());
+    const auto six = ValueFactory::createInteger(6);
+    assert(gs.findEdgesInRange("g", "dose", nullptr, six.get()).value() ==
+           (std::vector<EdgeId>{1, 2}));
+    assert(gs.eraseEdge("g", 1).ok());
+    assert(gs.findEdgesInRange("g", "dose", nullptr, six.get()).value() ==
+           std::vector<EdgeId>{2});
+    assert(gs.dropEdgeIndex("g", "dose").ok());
+    assert(gs.findEdgesInRange("g", "dose", nullptr, six.get()).value() ==
+           std::vector<EdgeId>{2});
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: MATCH starts from labels and property conditions"
+            << std::endl;
+  {
+    InMemoryGraphStorage gs;
+    assert(gs.createGraph("g").ok());
+    auto person = [](NodeId id, const std::string &label,
+                     const std::string &name) {
+      Node n = node(id, {label});
+      n.properties["name"] = ValueFactory::createString(name);
+      return n;
+    };
+    assert(gs.putNode("g", person(1, "Patient", "Ann")).ok());
+    assert(gs.putNode("g", person(2, "Patient", "Bob")).ok());
+    assert(gs.putNode("g", person(3, "Doctor", "Cy")).ok());
+    assert(gs.putNode("g", person(10, "Drug", "Aspirin")).ok());
+    assert(gs.putNode("g", person(11, "Drug", "Mary Jane")).ok());
+    assert(gs.putEdge("g", edge(1, 1, 10, "PRESCRIBED")).ok());
+    assert(gs.putEdge("g", edge(2, 2, 11, "PRESCRIBED")).ok());
+    assert(gs.putEdge("g", edge(3, 3, 10, "PRESCRIBED")).ok());
+    assert(gs.putEdge("g", edge(4, 2, 3, "SEES")).ok());
+    assert(gs.createNodeIndex("g", "name", IndexType::Hash).ok());
+
+    auto res = executeGraphQuery(
+        gs, "MATCH g (a:Patient)-[:PRESCRIBED]->(b) RETURN a, b");
+    assert(res.hasValue());
+    const auto &rs = res.value();
+    assert(rs.columnCount() == 2 && rs.columnNames()[0] == "a");
+    assert(rs.rowCount() == 2);
+    assert(rs.at(0, 0).asInt() == 1 && rs.at(0, 1).asInt() == 10);
+    assert(rs.at(1, 0).asInt() == 2 && rs.at(1, 1).asInt() == 11);
+
+    // Only b is constrained: the search starts from b's side
+    auto who = executeGraphQuery(
+        gs, "MATCH g (a)-[:PRESCRIBED]->(b:Drug) WHERE b.name = 'Aspirin' "
+            "RETURN a");
+    assert(who.hasValue() && who.value().rowCount() == 2);
+    assert(who.value().columnNames()[0] == "node_id");
+    assert(who.value().at(0, 0).asInt() == 1 &&
+           who.value().at(1, 0).asInt() == 3);
+
+    auto quoted = executeGraphQuery(
+        gs, "MATCH g (a:Patient)-[]->(b) WHERE b.name = \"Mary Jane\" AND "
+            "a = 2 RETURN a,b");
+    assert(quoted.hasValue() && quoted.value().rowCount() == 1);
+    assert(quoted.value().at(0, 1).asInt() == 11);
+
+    auto none = executeGraphQuery(
+        gs, "MATCH g (a:Doctor)-[:PRESCRIBED]->(b) WHERE a.name = 'Ann' "
+            "RETURN b");
+    assert(none.hasValue() && none.value().rowCount() == 0);
+
+    auto unseeded = executeGraphQuery(gs, "MATCH g (a)-[:SEES]->(b) RETURN b");
+    assert(unseeded.status().code() == StatusCode::InvalidArgument);
+    assert(!executeGraphQuery(gs, "MATCH g (a:Patient)-[:SEES]->(b) WHERE "
+                                  "c = 1 RETURN b")
+                .hasValue());
+    assert(!executeGraphQuery(gs, "MATCH g (a:Patient)-[:SEES]->(b) RETURN c")
+                .hasValue());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll graph index tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,163 @@
+#include "kadedb/graph/csr.h"
+#include "kadedb/graph/query.h"
+#include "kadedb/graph/storage.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+using namespace kadedb;
+
+static Edge edge(EdgeId id, NodeId from, NodeId to) {
+  Edge e;
+  e.id = id;
+  e.from = from;
+  e.to = to;
+  e.type = "REFERS";
+  return e;
+}
+
+// Random graph of `nodes` nodes with `degree` out-edges per node on average
+static void randomGraph(InMemoryGraphStorage &gs, NodeId nodes,
+                        size_t degree, uint32_t seed) {
+  assert(gs.createGraph("g").ok());
+  for (NodeId n = 0; n < nodes; ++n) {
+    Node node;
+    node.id = n;
+    assert(gs.putNode("g", node).ok());
+  }
+  std::mt19937 rng(seed);
+  const EdgeId edges = static_cast<EdgeId>(nodes) * degree;
+  for (EdgeId e = 0; e < edges; ++e)
+    assert(gs.putEdge("g", edge(e, static_cast<NodeId>(rng() % nodes),
+                                static_cast<NodeId>(rng() % nodes)))
+               .ok());
+}
+
+// bfs() with each depth sorted by id
+static std::vector<NodeId> levelOrder(const InMemoryGraphStorage &gs,
+                                      NodeId start) {
+  std::unordered_map<NodeId, size_t> depth{{start, 0}};
+  auto order = gs.bfs("g", start, 0).value();
+  for (NodeId n : order) {
+    auto nb = gs.neighborsOut("g", n);
+    for (NodeId m : nb.value())
+      depth.emplace(m, depth[n] + 1);
+  }
+  std::stable_sort(order.begin(), order.end(), [&](NodeId a, NodeId b) {
+    return depth[a] != depth[b] ? depth[a] < depth[b] : a < b;
+  });
+  return order;
+}
+
+int main() {
+  std::cout << "Running graph parallel BFS tests..." << std::endl;
+
+  std::cout << "Test 1: every thread count matches the serial BFS levels"
+            << std::endl;
+  {
+    InMemoryGraphStorage gs;
+    randomGraph(gs, 20000, 6, 3);
+    for (NodeId start : {NodeId{0}, NodeId{4711}}) {
+      const auto want = levelOrder(gs, start);
+      assert(want.size() > 10000);
+      for (size_t threads : {1, 2, 4, 0}) {
+        auto got = gs.parallelBfs("g", start, 0, threads);
+        assert(got.hasValue() && got.value() == want);
+      }
+      // The base-class version agrees
+      assert(gs.GraphStorage::parallelBfs("g", start, 0, 1).value() == want);
+      auto capped = gs.parallelBfs("g", start, 100, 4).value();
+      assert(capped.size() == 100 &&
+             std::equal(capped.begin(), capped.end(), want.begin()));
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: dense frontiers switch to bottom-up steps"
+            << std::endl;
+  {
+    InMemoryGraphStorage gs;
+    randomGraph(gs, 20000, 16, 5);
+    auto csr = gs.snapshot("g").value();
+    CsrGraph::BfsStats stats;
+    auto order = csr->breadthFirst(csr->indexOf(0), 0, 4, &stats);
+    assert(stats.bottomUpSteps > 0 && stats.topDownSteps > 0);
+    assert(stats.levels == stats.bottomUpSteps + stats.topDownSteps);
+    std::vector<NodeId> ids;
+    for (auto i : order)
+      ids.push_back(csr->id(i));
+    assert(ids == levelOrder(gs, 0));
+
+    // A long path never has a dense frontier
+    CsrGraph::BfsStats pathStats;
+    InMemoryGraphStorage path;
+    assert(path.createGraph("g").ok());
+    for (NodeId n = 0; n < 5000; ++n) {
+      Node node;
+      node.id = n;
+      assert(path.putNode("g", node).ok());
+      if (n > 0)
+        assert(path.putEdge("g", edge(n, n - 1, n)).ok());
+    }
+    auto p = path.snapshot("g").value();
+    assert(p->breadthFirst(0, 0, 4, &pathStats).size() == 5000);
+    assert(pathStats.bottomUpSteps == 0 && pathStats.levels == 5000);
+    assert(p->breadthFirst(CsrGraph::npos).empty());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: writes are visible to the next traversal"
+            << std::endl;
+  {
+    InMemoryGraphStorage gs;
+    randomGraph(gs, 2000, 1, 9);
+    Node island;
+    island.id = 5000;
+    assert(gs.putNode("g", island).ok());
+    auto before = gs.parallelBfs("g", 0, 0, 2).value();
+    assert(std::find(before.begin(), before.end(), 5000) == before.end());
+    assert(gs.putEdge("g", edge(900000, 0, 5000)).ok());
+    auto after = gs.parallelBfs("g", 0, 0, 2).value();
+    assert(after.size() == before.size() + 1);
+    assert(std::find(after.begin(), after.end(), 5000) != after.end());
+    assert(after == levelOrder(gs, 0));
+
+    assert(gs.parallelBfs("g", 123456).status().code() ==
+           StatusCode::NotFound);
+    assert(gs.parallelBfs("nope", 0).status().code() == StatusCode::NotFound);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: TRAVERSE ... BFS lists nodes by depth" << std::endl;
+  {
+    InMemoryGraphStorage gs;
+    assert(gs.createGraph("g").ok());
+    for (NodeId n = 1; n <= 5; ++n) {
+      Node node;
+      node.id = n;
+      assert(gs.putNode("g", node).ok());
+    }
+    assert(gs.putEdge("g", edge(1, 1, 4)).ok());
+    assert(gs.putEdge("g", edge(2, 1, 2)).ok());
+    assert(gs.putEdge("g", edge(3, 2, 5)).ok());
+    assert(gs.putEdge("g", edge(4, 4, 3)).ok());
+    auto res = executeGraphQuery(gs, "TRAVERSE g FROM 1 BFS");
+    assert(res.hasValue());
+    const auto &rs = res.value();
+    const int64_t want[] = {1, 2, 4, 3, 5};
+    assert(rs.rowCount() == 5);
+    for (size_t r = 0; r < rs.rowCount(); ++r)
+      assert(rs.at(r, 0).asInt() == want[r]);
+    auto capped = executeGraphQuery(gs, "TRAVERSE g FROM 1 BFS LIMIT 2");
+    assert(capped.hasValue() && capped.value().rowCount() == 2);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll graph parallel BFS tests passed!" << std::endl;
+  return 0;
+}
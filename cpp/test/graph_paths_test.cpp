@@ -0,0 +1,263 @@
+#include "kadedb/graph/csr.h"
+#include "kadedb/graph/query.h"
+#include "kadedb/graph/storage.h"
+#include "kadedb/value.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace kadedb;
+
+static Edge edge(EdgeId id, NodeId from, NodeId to, double weight = 1.0) {
+  Edge e;
+  e.id = id;
+  e.from = from;
+  e.to = to;
+  e.type = "REFERS";
+  e.properties["w"] = ValueFactory::createFloat(weight);
+  return e;
+}
+
+static void addNodes(InMemoryGraphStorage &gs, NodeId n) {
+  for (NodeId i = 0; i < n; ++i) {
+    Node node;
+    node.id = i;
+    assert(gs.putNode("g", node).ok());
+  }
+}
+
+// Forwards to an in-memory graph, counting the nodes whose edges are read
+class CountingGraph final : public GraphStorage {
+public:
+  explicit CountingGraph(const InMemoryGraphStorage &inner) : inner_(inner) {}
+  mutable size_t expanded = 0;
+
+  Status createGraph(const std::string &) override {
+    return Status::FailedPrecondition("read only");
+  }
+  Status dropGraph(const std::string &) override {
+    return Status::FailedPrecondition("read only");
+  }
+  std::vector<std::string> listGraphs() const override {
+    return inner_.listGraphs();
+  }
+  Result<Node> getNode(const std::string &g, NodeId id) const override {
+    return inner_.getNode(g, id);
+  }
+  Status putNode(const std::string &, const Node &) override {
+    return Status::FailedPrecondition("read only");
+  }
+  Status eraseNode(const std::string &, NodeId) override {
+    return Status::FailedPrecondition("read only");
+  }
+  Result<Edge> getEdge(const std::string &g, EdgeId id) const override {
+    return inner_.getEdge(g, id);
+  }
+  Status putEdge(const std::string &, const Edge &) override {
+    return Status::FailedPrecondition("read only");
+  }
+  Status eraseEdge(const std::string &, EdgeId) override {
+    return Status::FailedPrecondition("read only");
+  }
+  Result<std::vector<EdgeId>> edgeIdsOut(const std::string &g,
+                                         NodeId n) const override {
+    return inner_.edgeIdsOut(g, n);
+  }
+  Result<std::vector<EdgeId>> edgeIdsIn(const std::string &g,
+                                        NodeId n) const override {
+    return inner_.edgeIdsIn(g, n);
+  }
+  Result<std::vector<NodeId>> neighborsOut(const std::string &g,
+                                           NodeId n) const override {
+    ++expanded;
+    return inner_.neighborsOut(g, n);
+  }
+  Result<std::vector<NodeId>> neighborsIn(const std::string &g,
+                                          NodeId n) const override {
+    ++expanded;
+    return inner_.neighborsIn(g, n);
+  }
+  Result<std::vector<NodeId>> bfs(const std::string &g, NodeId start,
+                                  size_t maxNodes) const override {
+    return inner_.bfs(g, start, maxNodes);
+  }
+  Result<std::vector<NodeId>> dfs(const std::string &g, NodeId start,
+                                  size_t maxNodes) const override {
+    return inner_.dfs(g, start, maxNodes);
+  }
+
+private:
+  const InMemoryGraphStorage &inner_;
+};
+
+// Hops from `start` to every reachable node
+static std::unordered_map<NodeId, size_t>
+depths(const InMemoryGraphStorage &gs, NodeId start) {
+  std::unordered_map<NodeId, size_t> depth{{start, 0}};
+  auto order = gs.bfs("g", start, 0);
+  for (NodeId n : order.value()) {
+    auto nb = gs.neighborsOut("g", n);
+    for (NodeId m : nb.value())
+      depth.emplace(m, depth[n] + 1);
+  }
+  return depth;
+}
+
+static bool isPath(const InMemoryGraphStorage &gs,
+                   const std::vector<NodeId> &path) {
+  for (size_t i = 0; i + 1 < path.size(); ++i) {
+    auto nb = gs.neighborsOut("g", path[i]).value();
+    if (std::find(nb.begin(), nb.end(), path[i + 1]) == nb.end())
+      return false;
+  }
+  return true;
+}
+
+int main() {
+  std::cout << "Running graph path tests..." << std::endl;
+
+  InMemoryGraphStorage gs;
+  assert(gs.createGraph("g").ok());
+  const NodeId kNodes = 20000;
+  addNodes(gs, kNodes);
+  std::mt19937 rng(11);
+  for (EdgeId e = 0; e < 8 * kNodes; ++e)
+    assert(gs.putEdge("g", edge(e, static_cast<NodeId>(rng() % kNodes),
+                                static_cast<NodeId>(rng() % kNodes)))
+               .ok());
+
+  std::cout << "Test 1: bidirectional search finds shortest paths"
+            << std::endl;
+  {
+    for (NodeId start : {NodeId{0}, NodeId{77}, NodeId{4242}}) {
+      auto depth = depths(gs, start);
+      for (NodeId goal = 0; goal < kNodes; goal += 997) {
+        auto path = gs.shortestPath("g", start, goal);
+        assert(path.hasValue());
+        auto it = depth.find(goal);
+        if (it == depth.end()) {
+          assert(path.value().empty());
+          continue;
+        }
+        assert(path.value().size() == it->second + 1);
+        assert(path.value().front() == start && path.value().back() == goal);
+        assert(isPath(gs, path.value()));
+      }
+    }
+    assert(gs.shortestPath("g", 5, 5).value() == std::vector<NodeId>{5});
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: it expands far fewer nodes than a one-sided BFS"
+            << std::endl;
+  {
+    auto order = gs.bfs("g", 0, 0).value();
+    const NodeId far = order.back();
+    CountingGraph counting(gs);
+    auto path = counting.shortestPath("g", 0, far);
+    assert(path.hasValue() && !path.value().empty());
+    // A one-sided BFS expands nearly every node before reaching `far`
+    assert(counting.expanded * 10 < order.size());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: component labels agree with searching" << std::endl;
+  {
+    InMemoryGraphStorage small;
+    assert(small.createGraph("g").ok());
+    addNodes(small, 300);
+    std::mt19937 r(5);
+    for (EdgeId e = 0; e < 330; ++e)
+      assert(small.putEdge("g", edge(e, static_cast<NodeId>(r() % 300),
+                                     static_cast<NodeId>(r() % 300)))
+                 .ok());
+    CountingGraph search(small);
+    for (int round = 0; round < 2; ++round) {
+      (void)small.snapshot("g"); // current again: labels answer
+      for (NodeId a = 0; a < 300; a += 7)
+        for (NodeId b = 0; b < 300; b += 3)
+          assert(small.reachable("g", a, b).value() ==
+                 search.reachable("g", a, b).value());
+      // After a write the snapshot is stale and reachable() searches
+      assert(small.putEdge("g", edge(1000, 299, 0)).ok());
+      assert(small.reachable("g", 299, 0).value());
+    }
+    assert(!small.reachable("g", 0, 12345).value());
+    assert(small.reachable("nope", 0, 1).status().code() ==
+           StatusCode::NotFound);
+
+    // 0 <-> 1 -> 2, 3 alone
+    InMemoryGraphStorage tiny;
+    assert(tiny.createGraph("g").ok());
+    addNodes(tiny, 4);
+    assert(tiny.putEdge("g", edge(1, 0, 1)).ok());
+    assert(tiny.putEdge("g", edge(2, 1, 0)).ok());
+    assert(tiny.putEdge("g", edge(3, 1, 2)).ok());
+    auto csr = tiny.snapshot("g").value();
+    auto weak = csr->weakComponents();
+    auto strong = csr->strongComponents();
+    assert((weak == std::vector<CsrGraph::Index>{0, 0, 0, 3}));
+    assert(strong[0] == strong[1] && strong[1] != strong[2] &&
+           strong[2] != strong[3] && strong[0] != strong[3]);
+    assert(tiny.reachable("g", 0, 2).value());
+    assert(!tiny.reachable("g", 2, 0).value());
+    assert(!tiny.reachable("g", 0, 3).value());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: SHORTEST_PATH ... WEIGHT runs Dijkstra" << std::endl;
+  {
+    InMemoryGraphStorage w;
+    assert(w.createGraph("g").ok());
+    addNodes(w, 5);
+    // 0 -> 4 directly costs 10; 0 -> 1 -> 2 -> 4 costs 4
+    assert(w.putEdge("g", edge(1, 0, 4, 10)).ok());
+    assert(w.putEdge("g", edge(2, 0, 1, 1)).ok());
+    assert(w.putEdge("g", edge(3, 1, 2, 1.5)).ok());
+    assert(w.putEdge("g", edge(4, 2, 4, 1.5)).ok());
+    assert(w.putEdge("g", edge(5, 1, 4, 5)).ok());
+
+    auto hops = executeGraphQuery(w, "SHORTEST_PATH g FROM 0 TO 4");
+    assert(hops.hasValue() && hops.value().rowCount() == 2);
+
+    auto res = executeGraphQuery(w, "SHORTEST_PATH g FROM 0 TO 4 WEIGHT w");
+    assert(res.hasValue());
+    const auto &rs = res.value();
+    assert(rs.columnCount() == 3 && rs.columnNames()[2] == "distance");
+    const int64_t nodes[] = {0, 1, 2, 4};
+    const double dist[] = {0, 1, 2.5, 4};
+    assert(rs.rowCount() == 4);
+    for (size_t i = 0; i < 4; ++i) {
+      assert(rs.at(i, 0).asInt() == static_cast<int64_t>(i));
+      assert(rs.at(i, 1).asInt() == nodes[i]);
+      assert(std::fabs(rs.at(i, 2).asFloat() - dist[i]) < 1e-12);
+    }
+
+    auto none = executeGraphQuery(w, "SHORTEST_PATH g FROM 4 TO 0 WEIGHT w");
+    assert(none.hasValue() && none.value().rowCount() == 0);
+    auto bad = executeGraphQuery(w, "SHORTEST_PATH g FROM 0 TO 4 WEIGHT x");
+    assert(!bad.hasValue() &&
+           bad.status().code() == StatusCode::InvalidArgument);
+    assert(w.putEdge("g", edge(6, 0, 3, -1)).ok());
+    assert(!executeGraphQuery(w, "SHORTEST_PATH g FROM 0 TO 4 WEIGHT w")
+                .hasValue());
+    assert(!executeGraphQuery(w, "SHORTEST_PATH g FROM 0 TO 4 COST w")
+                .hasValue());
+
+    auto yes = executeGraphQuery(w, "CONNECTED g FROM 0 TO 2");
+    assert(yes.hasValue() && yes.value().at(0, 0).asBool());
+    auto no = executeGraphQuery(w, "CONNECTED g FROM 4 TO 0");
+    assert(no.hasValue() && !no.value().at(0, 0).asBool());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll graph path tests passed!" << std::endl;
+  return 0;
+}
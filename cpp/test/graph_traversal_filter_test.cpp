@@ -0,0 +1,254 @@
+#include "kadedb/graph/compact.h"
+#include "kadedb/graph/query.h"
+#include "kadedb/graph/storage.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+
+using Filter = GraphStorage::TraversalFilter;
+
+static const char *kTypes[] = {"PRESCRIBED", "TREATS", "CITES"};
+static const char *kLabels[] = {"Drug", "Patient", "Paper"};
+
+static Node node(NodeId id) {
+  Node n;
+  n.id = id;
+  n.labels = {kLabels[id % 3]};
+  return n;
+}
+
+static Edge edge(EdgeId id, NodeId from, NodeId to, const std::string &type) {
+  Edge e;
+  e.id = id;
+  e.from = from;
+  e.to = to;
+  e.type = type;
+  return e;
+}
+
+// `n` nodes and `m` edges of random types
+static void randomGraph(GraphStorage &gs, size_t n, size_t m, uint32_t seed) {
+  std::mt19937 rng(seed);
+  assert(gs.createGraph("g").ok());
+  for (size_t i = 0; i < n; ++i)
+    assert(gs.putNode("g", node(static_cast<NodeId>(i))).ok());
+  for (size_t e = 0; e < m; ++e)
+    assert(gs.putEdge("g", edge(static_cast<EdgeId>(e),
+                                static_cast<NodeId>(rng() % n),
+                                static_cast<NodeId>(rng() % n),
+                                kTypes[rng() % 3]))
+               .ok());
+}
+
+static Filter filter(std::vector<std::string> types,
+                     std::vector<std::string> labels, size_t depth,
+                     GraphStorage::Direction dir =
+                         GraphStorage::Direction::Out) {
+  Filter f;
+  f.edgeTypes = std::move(types);
+  f.nodeLabels = std::move(labels);
+  f.maxDepth = depth;
+  f.direction = dir;
+  return f;
+}
+
+static std::vector<Filter> filters() {
+  return {filter({}, {}, 0),
+          filter({"prescribed"}, {}, 0),
+          filter({"PRESCRIBED", "Cites"}, {}, 2),
+          filter({}, {"Drug", "Patient"}, 0),
+          filter({"TREATS"}, {"Patient"}, 3),
+          filter({}, {}, 1, GraphStorage::Direction::In),
+          filter({"CITES"}, {"Paper", "Drug"}, 2,
+                 GraphStorage::Direction::In),
+          filter({"MISSING"}, {}, 0)};
+}
+
+// The overrides match the defaults, which read forEachEdge() and withNode()
+static void assertMatchesDefaults(const GraphStorage &gs, size_t n) {
+  for (const Filter &f : filters()) {
+    for (NodeId s = 0; s < static_cast<NodeId>(n); s += 7) {
+      for (size_t limit : {0, 5}) {
+        assert(gs.filteredBfs("g", s, f, limit).value() ==
+               gs.GraphStorage::filteredBfs("g", s, f, limit).value());
+        assert(gs.filteredDfs("g", s, f, limit).value() ==
+               gs.GraphStorage::filteredDfs("g", s, f, limit).value());
+      }
+    }
+  }
+}
+
+static std::vector<int64_t> column(const ResultSet &rs, size_t c) {
+  std::vector<int64_t> out;
+  for (size_t r = 0; r < rs.rowCount(); ++r)
+    out.push_back(rs.at(r, c).asInt());
+  return out;
+}
+
+int main() {
+  std::cout << "=== Graph Traversal Filter Tests ===" << std::endl;
+
+  std::cout << "Test 1: filters apply while expanding..." << std::endl;
+  {
+    // 1 -PRESCRIBED-> 2 -PRESCRIBED-> 3 -PRESCRIBED-> 4, 1 -CITES-> 5,
+    // 2 -TREATS-> 6, 5 -PRESCRIBED-> 7
+    InMemoryGraphStorage gs;
+    assert(gs.createGraph("g").ok());
+    for (NodeId id = 1; id <= 7; ++id)
+      assert(gs.putNode("g", node(id)).ok());
+    assert(gs.putEdge("g", edge(1, 1, 2, "PRESCRIBED")).ok());
+    assert(gs.putEdge("g", edge(2, 2, 3, "PRESCRIBED")).ok());
+    assert(gs.putEdge("g", edge(3, 3, 4, "PRESCRIBED")).ok());
+    assert(gs.putEdge("g", edge(4, 1, 5, "CITES")).ok());
+    assert(gs.putEdge("g", edge(5, 2, 6, "TREATS")).ok());
+    assert(gs.putEdge("g", edge(6, 5, 7, "PRESCRIBED")).ok());
+
+    using V = std::vector<NodeId>;
+    assert(gs.filteredBfs("g", 1, filter({"PRESCRIBED"}, {}, 2)).value() ==
+           V({1, 2, 3}));
+    assert(gs.filteredBfs("g", 1, filter({"prescribed"}, {}, 0)).value() ==
+           V({1, 2, 3, 4}));
+    assert(gs.filteredBfs("g", 1, filter({}, {}, 1)).value() == V({1, 2, 5}));
+    // Patients (4 and 7) are never entered
+    assert(gs.filteredBfs("g", 1, filter({}, {"Paper", "Drug"}, 0))
+               .value() == V({1, 2, 5, 3, 6}));
+    assert(gs.filteredDfs("g", 1, filter({}, {}, 2)).value() ==
+           V({1, 2, 3, 6, 5, 7}));
+    assert(gs.filteredBfs("g", 4,
+                          filter({"PRESCRIBED"}, {}, 2,
+                                 GraphStorage::Direction::In))
+               .value() == V({4, 3, 2}));
+    assert(gs.filteredBfs("g", 1, filter({}, {}, 0), 3).value() ==
+           V({1, 2, 5}));
+    assert(gs.filteredBfs("g", 9, filter({}, {}, 0)).status().code() ==
+           StatusCode::NotFound);
+    assert(gs.filteredDfs("h", 1, filter({}, {}, 0)).status().code() ==
+           StatusCode::NotFound);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: snapshot, overlay and defaults agree..." << std::endl;
+  {
+    InMemoryGraphStorage gs(/*snapshotRebuildWrites=*/1u << 20);
+    randomGraph(gs, 300, 1200, 1);
+    // Without filters the traversals are the unfiltered ones
+    assert(gs.filteredBfs("g", 0, Filter{}).value() ==
+           gs.parallelBfs("g", 0).value());
+    assert(gs.filteredDfs("g", 0, Filter{}).value() ==
+           gs.dfs("g", 0, 0).value());
+    assertMatchesDefaults(gs, 300);
+
+    // Writes since the snapshot: retyped, erased and added edges and a new
+    // node are read from the adjacency index
+    for (EdgeId e = 0; e < 1200; e += 13)
+      assert(gs.putEdge("g", edge(e, static_cast<NodeId>(e % 300),
+                                  static_cast<NodeId>((e * 7) % 300),
+                                  kTypes[(e + 1) % 3]))
+                 .ok());
+    for (EdgeId e = 5; e < 1200; e += 17)
+      assert(gs.eraseEdge("g", e).ok());
+    assert(gs.putNode("g", node(300)).ok());
+    assert(gs.putEdge("g", edge(5000, 0, 300, "TREATS")).ok());
+    assert(gs.putEdge("g", edge(5001, 300, 1, "PRESCRIBED")).ok());
+    assertMatchesDefaults(gs, 301);
+
+    // Storages without a snapshot use the defaults
+    CompactGraphStorage cg;
+    randomGraph(cg, 300, 1200, 1);
+    InMemoryGraphStorage ref;
+    randomGraph(ref, 300, 1200, 1);
+    for (const Filter &f : filters())
+      assert(cg.filteredBfs("g", 3, f).value() ==
+             ref.filteredBfs("g", 3, f).value());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: k-hop neighborhoods of many starts..." << std::endl;
+  {
+    InMemoryGraphStorage gs;
+    randomGraph(gs, 2000, 8000, 2);
+    std::vector<NodeId> starts;
+    for (NodeId s = 0; s < 2000; s += 3)
+      starts.push_back(s);
+    starts.push_back(0);
+    for (const Filter &f : filters()) {
+      Filter k = f;
+      k.maxDepth = std::max<size_t>(k.maxDepth, 2);
+      auto all = gs.neighborhoods("g", starts, k).value();
+      assert(all == gs.neighborhoods("g", starts, k, 1).value());
+      assert(all == gs.GraphStorage::neighborhoods("g", starts, k).value());
+      assert(all.size() == starts.size());
+      for (size_t s = 0; s < starts.size(); s += 50) {
+        auto want = gs.filteredBfs("g", starts[s], k).value();
+        want.erase(want.begin());
+        std::sort(want.begin(), want.end());
+        assert(all[s] == want);
+      }
+    }
+    assert(gs.neighborhoods("g", {1, 2}, Filter{}).value().size() == 2);
+    assert(gs.neighborhoods("g", {}, Filter{}).value().empty());
+    assert(gs.neighborhoods("g", {1, 99999}, Filter{}).status().code() ==
+           StatusCode::NotFound);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: KadeQL filtered TRAVERSE and NEIGHBORHOOD..."
+            << std::endl;
+  {
+    InMemoryGraphStorage gs;
+    assert(gs.createGraph("g").ok());
+    for (NodeId id = 1; id <= 7; ++id)
+      assert(gs.putNode("g", node(id)).ok());
+    assert(gs.putEdge("g", edge(1, 1, 2, "PRESCRIBED")).ok());
+    assert(gs.putEdge("g", edge(2, 2, 3, "PRESCRIBED")).ok());
+    assert(gs.putEdge("g", edge(3, 3, 4, "PRESCRIBED")).ok());
+    assert(gs.putEdge("g", edge(4, 1, 5, "CITES")).ok());
+    assert(gs.putEdge("g", edge(5, 2, 6, "TREATS")).ok());
+
+    using V = std::vector<int64_t>;
+    auto run = [&](const std::string &q) {
+      auto res = executeGraphQuery(gs, q);
+      assert(res.hasValue());
+      return res.takeValue();
+    };
+    assert(column(run("TRAVERSE g FROM 1 BFS VIA PRESCRIBED DEPTH 2"), 0) ==
+           V({1, 2, 3}));
+    assert(column(run("TRAVERSE g FROM 1 DFS VIA prescribed, TREATS"), 0) ==
+           V({1, 2, 3, 4, 6}));
+    assert(column(run("TRAVERSE g FROM 1 BFS LABEL Paper,Drug LIMIT 3"),
+                  0) == V({1, 2, 5}));
+    assert(column(run("TRAVERSE g FROM 3 BFS IN DEPTH 1"), 0) == V({3, 2}));
+    assert(column(run("TRAVERSE g FROM 1 BFS LIMIT 2"), 0) == V({1, 2}));
+
+    auto rs = run("NEIGHBORHOOD g FROM 1, 3,2 VIA PRESCRIBED DEPTH 2");
+    assert(column(rs, 0) == V({1, 1, 3, 2, 2}));
+    assert(column(rs, 1) == V({2, 3, 4, 3, 4}));
+    assert(run("NEIGHBORHOOD g FROM 4").rowCount() == 0);
+
+    auto bad = [&](const std::string &q) {
+      return executeGraphQuery(gs, q).status().code();
+    };
+    assert(bad("TRAVERSE g FROM 1 BFS DEPTH -1") ==
+           StatusCode::InvalidArgument);
+    assert(bad("TRAVERSE g FROM 1 BFS VIA") == StatusCode::InvalidArgument);
+    assert(bad("TRAVERSE g FROM 1 BFS VIA A,,B") ==
+           StatusCode::InvalidArgument);
+    assert(bad("TRAVERSE g FROM 1 BFS SIDEWAYS") ==
+           StatusCode::InvalidArgument);
+    assert(bad("NEIGHBORHOOD g FROM") == StatusCode::InvalidArgument);
+    assert(bad("NEIGHBORHOOD g FROM 1 LIMIT 3") ==
+           StatusCode::InvalidArgument);
+    assert(bad("NEIGHBORHOOD g FROM 1, x") == StatusCode::InvalidArgument);
+    assert(bad("NEIGHBORHOOD g FROM 1, 42") == StatusCode::NotFound);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll graph traversal filter tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,140 @@
+#include "kadedb/graph/query.h"
+#include "kadedb/graph/storage.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace kadedb;
+
+using Direction = GraphStorage::Direction;
+
+static Edge edge(EdgeId id, NodeId from, NodeId to) {
+  Edge e;
+  e.id = id;
+  e.from = from;
+  e.to = to;
+  e.type = "LINK";
+  e.properties["w"] = ValueFactory::createInteger(id % 3);
+  return e;
+}
+
+int main() {
+  std::cout << "Running graph visitor tests..." << std::endl;
+
+  InMemoryGraphStorage gs;
+  assert(gs.createGraph("g").ok());
+  const NodeId kNodes = 300;
+  for (NodeId n = 0; n < kNodes; ++n) {
+    Node node;
+    node.id = n;
+    node.labels = {"Item"};
+    node.properties["name"] = ValueFactory::createString("n" +
+                                                         std::to_string(n));
+    assert(gs.putNode("g", node).ok());
+  }
+  std::mt19937 rng(17);
+  for (EdgeId e = 0; e < 1500; ++e)
+    assert(gs.putEdge("g", edge(e, static_cast<NodeId>(rng() % kNodes),
+                                static_cast<NodeId>(rng() % kNodes)))
+               .ok());
+
+  std::cout << "Test 1: visitors see stored objects in place" << std::endl;
+  {
+    const Node *first = nullptr;
+    const Node *second = nullptr;
+    assert(gs.withNode("g", 7, [&](const Node &n) { first = &n; }).ok());
+    assert(gs.withNode("g", 7, [&](const Node &n) {
+               second = &n;
+               assert(n.id == 7 && n.labels.count("Item"));
+               assert(n.properties.at("name")->asString() == "n7");
+             })
+               .ok());
+    assert(first && first == second); // no copy per call
+
+    EdgeId seen = -1;
+    assert(gs.withEdge("g", 42, [&](const Edge &e) { seen = e.id; }).ok());
+    assert(seen == 42);
+
+    bool called = false;
+    auto mark = [&](const Node &) { called = true; };
+    assert(gs.withNode("g", 9999, mark).code() == StatusCode::NotFound);
+    assert(gs.withNode("nope", 1, mark).code() == StatusCode::NotFound);
+    assert(gs.withEdge("g", 99999, [&](const Edge &) { called = true; })
+               .code() == StatusCode::NotFound);
+    assert(!called);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: neighbor and edge visits match the copying lookups"
+            << std::endl;
+  {
+    // Writes after the snapshot leave some nodes on the overlay
+    (void)gs.snapshot("g");
+    for (EdgeId e = 1500; e < 1600; ++e)
+      assert(gs.putEdge("g", edge(e, static_cast<NodeId>(rng() % kNodes),
+                                  static_cast<NodeId>(rng() % kNodes)))
+                 .ok());
+    for (NodeId n = 0; n < kNodes; n += 3) {
+      for (Direction dir : {Direction::Out, Direction::In}) {
+        const bool out = dir == Direction::Out;
+        std::vector<NodeId> nb, base;
+        assert(gs.forEachNeighbor(
+                     "g", n, [&](NodeId m) { nb.push_back(m); }, dir)
+                   .ok());
+        assert(nb == (out ? gs.neighborsOut("g", n) : gs.neighborsIn("g", n))
+                         .value());
+        assert(gs.GraphStorage::forEachNeighbor(
+                     "g", n, [&](NodeId m) { base.push_back(m); }, dir)
+                   .ok());
+        assert(base == nb);
+
+        std::vector<EdgeId> eids, baseEids;
+        assert(gs.forEachEdge(
+                     "g", n, [&](const Edge &e) { eids.push_back(e.id); }, dir)
+                   .ok());
+        assert(eids == (out ? gs.edgeIdsOut("g", n) : gs.edgeIdsIn("g", n))
+                           .value());
+        assert(gs.GraphStorage::forEachEdge(
+                     "g", n, [&](const Edge &e) { baseEids.push_back(e.id); },
+                     dir)
+                   .ok());
+        assert(baseEids == eids);
+      }
+    }
+    auto none = [](NodeId) { assert(false); };
+    assert(gs.forEachNeighbor("g", 9999, none).code() == StatusCode::NotFound);
+    assert(gs.forEachNeighbor("nope", 0, none).code() == StatusCode::NotFound);
+    assert(gs.forEachEdge("g", 9999, [](const Edge &) {
+               assert(false);
+             }).code() == StatusCode::NotFound);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: queries over the visitors" << std::endl;
+  {
+    auto match = executeGraphQuery(gs, "MATCH g (a)-[:LINK]->(b) WHERE a = 5 "
+                                       "RETURN b");
+    assert(match.hasValue());
+    auto want = gs.neighborsOut("g", 5).value();
+    assert(match.value().rowCount() == want.size());
+    for (size_t r = 0; r < want.size(); ++r)
+      assert(match.value().at(r, 0).asInt() == want[r]);
+
+    auto path = gs.bfs("g", 0, 0).value();
+    const NodeId far = path.back();
+    auto weighted = executeGraphQuery(
+        gs, "SHORTEST_PATH g FROM 0 TO " + std::to_string(far) + " WEIGHT w");
+    assert(weighted.hasValue() && weighted.value().rowCount() >= 2);
+    auto hops = gs.GraphStorage::shortestPath("g", 0, far);
+    assert(hops.hasValue() && hops.value() == gs.shortestPath("g", 0, far)
+                                                  .value());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll graph visitor tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,130 @@
+#include "kadedb/result.h"
+#include "kadedb/schema.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace kadedb;
+
+static void testScalarsAndCompare() {
+  static_assert(sizeof(InlineValue) == 16, "compact layout");
+
+  InlineValue empty;
+  assert(empty.empty());
+  assert(empty.toValue() == nullptr);
+
+  auto n = InlineValue::null();
+  auto i = InlineValue::integer(42);
+  auto f = InlineValue::floating(42.0);
+  auto b = InlineValue::boolean(true);
+  assert(n.type() == ValueType::Null && n.toString() == "null");
+  assert(i.asInt() == 42 && i.toString() == "42");
+  assert(f.asFloat() == 42.0);
+  assert(b.asBool() && b.asInt() == 1);
+
+  // Numeric cross-type semantics match the Value hierarchy
+  assert(i.equals(f) && f.equals(i));
+  assert(i.compare(InlineValue::floating(42.5)) < 0);
+  assert(n.compare(i) < 0);
+  assert(i.compare(n) > 0);
+  assert(InlineValue::string("a").compare(i) ==
+         ValueFactory::createString("a")->compare(IntegerValue(42)));
+  assert(b.compare(InlineValue::boolean(false)) > 0);
+
+  bool threw = false;
+  try {
+    (void)f.asInt();
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+}
+
+static void testStrings() {
+  auto shortStr = InlineValue::string("short");
+  assert(shortStr.isInlineString());
+  assert(shortStr.asString() == "short");
+  assert(shortStr.toString() == "\"short\"");
+
+  std::string longText(100, 'x');
+  auto longStr = InlineValue::string(longText);
+  assert(!longStr.isInlineString());
+  assert(longStr.asString() == longText);
+
+  // Copies are deep; moves leave the source empty
+  InlineValue copy = longStr;
+  assert(copy.asString() == longText);
+  assert(copy.stringData() != longStr.stringData());
+  InlineValue moved = std::move(copy);
+  assert(copy.empty());
+  assert(moved.equals(longStr));
+
+  auto exact = InlineValue::string(std::string(14, 'y'));
+  assert(exact.isInlineString());
+  assert(InlineValue::string("abc").compare(InlineValue::string("abd")) < 0);
+  assert(InlineValue::string("ab").compare(InlineValue::string("abc")) < 0);
+  StringValue sv("abd");
+  assert(InlineValue::string("abc").compare(sv) < 0);
+}
+
+static void testConverters() {
+  std::vector<std::unique_ptr<Value>> vals;
+  vals.push_back(ValueFactory::createNull());
+  vals.push_back(ValueFactory::createInteger(-7));
+  vals.push_back(ValueFactory::createFloat(1.25));
+  vals.push_back(ValueFactory::createString("a string longer than sso"));
+  vals.push_back(ValueFactory::createBoolean(false));
+  for (const auto &v : vals) {
+    auto iv = InlineValue::fromValue(v.get());
+    assert(iv.type() == v->type());
+    assert(iv.toString() == v->toString());
+    assert(iv.compare(*v) == 0);
+    auto back = iv.toValue();
+    assert(back && back->equals(*v));
+  }
+  assert(InlineValue::fromValue(nullptr).empty());
+}
+
+static void testInlineRow() {
+  Row r(3);
+  r.set(0, ValueFactory::createInteger(1));
+  r.set(2, ValueFactory::createString("z"));
+  InlineRow ir = InlineRow::fromRow(r);
+  assert(ir.size() == 3);
+  assert(ir.at(0).asInt() == 1);
+  assert(ir.at(1).empty());
+  Row back = ir.toRow();
+  assert(back.values()[1] == nullptr);
+  assert(back.at(2).asString() == "z");
+
+  ResultRow rr(ir.values());
+  assert(rr.size() == 3);
+  assert(rr.values()[1] == nullptr);
+  assert(rr.at(0).asInt() == 1);
+
+  std::vector<Column> cols;
+  cols.push_back(Column{"id", ColumnType::Integer, false, true, {}});
+  cols.push_back(Column{"opt", ColumnType::Float, true, false, {}});
+  cols.push_back(Column{"s", ColumnType::String, false, false, {}});
+  cols[2].constraints.maxLength = 3;
+  TableSchema schema(cols);
+  assert(SchemaValidator::validateRow(schema, ir).empty());
+  ir.set(2, InlineValue::string("toolong"));
+  assert(!SchemaValidator::validateRow(schema, ir).empty());
+  ir.set(2, InlineValue::string("ok"));
+  std::vector<InlineRow> rows{ir, ir};
+  assert(!SchemaValidator::validateUnique(schema, rows).empty());
+  rows[1].set(0, InlineValue::integer(2));
+  assert(SchemaValidator::validateUnique(schema, rows).empty());
+}
+
+int main() {
+  testScalarsAndCompare();
+  testStrings();
+  testConverters();
+  testInlineRow();
+  return 0;
+}
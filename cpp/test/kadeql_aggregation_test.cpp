@@ -198,6 +198,48 @@ int main() {
     std::cout << "  PASSED" << std::endl;
   }
 
+  // Test 9: COUNT/SUM/MIN/MAX/AVG per bucket
+  std::cout << "Test 9: COUNT/SUM/MIN/MAX/AVG with TIME_BUCKET..." << std::endl;
+  {
+    auto stmt = parseQuery("SELECT TIME_BUCKET(timestamp, 20) AS bucket, "
+                           "COUNT(*) AS n, SUM(value) AS total, "
+                           "MIN(value) AS lo, MAX(value) AS hi, "
+                           "AVG(value) AS mean FROM metrics");
+    auto res = exec.execute(*stmt);
+    assert(res.hasValue());
+    const auto &rs = res.value();
+    assert(rs.rowCount() == 2);
+    // Bucket 100: values 10..40; bucket 120: values 50, 60
+    assert(rs.at(0, 0).asInt() == 100);
+    assert(rs.at(0, 1).asInt() == 4);
+    assert(rs.at(0, 2).asInt() == 100);
+    assert(rs.at(0, 3).asInt() == 10);
+    assert(rs.at(0, 4).asInt() == 40);
+    assert(rs.at(0, 5).asFloat() == 25.0);
+    assert(rs.at(1, 1).asInt() == 2);
+    assert(rs.at(1, 2).asInt() == 110);
+    assert(rs.at(1, 5).asFloat() == 55.0);
+    std::cout << "  PASSED" << std::endl;
+  }
+
+  // Test 10: whole-table aggregates honour WHERE; bad arity is rejected
+  std::cout << "Test 10: Aggregates without TIME_BUCKET..." << std::endl;
+  {
+    auto stmt = parseQuery(
+        "SELECT COUNT(value), SUM(value) FROM metrics WHERE value > 25");
+    auto res = exec.execute(*stmt);
+    assert(res.hasValue());
+    assert(res.value().rowCount() == 1);
+    assert(res.value().at(0, 0).asInt() == 4);
+    assert(res.value().at(0, 1).asInt() == 180);
+
+    auto bad = parseQuery("SELECT SUM(value, timestamp) FROM metrics");
+    auto badRes = exec.execute(*bad);
+    assert(!badRes.hasValue());
+    assert(badRes.status().code() == StatusCode::InvalidArgument);
+    std::cout << "  PASSED" << std::endl;
+  }
+
   std::cout << "\nAll KadeQL Aggregation tests passed!" << std::endl;
   return 0;
 }
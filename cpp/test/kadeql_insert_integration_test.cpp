@@ -109,6 +109,19 @@ int main() {
     printStatus(res.status());
   }
 
+  // 8) A multi-row INSERT is one batch: a conflict in any row (here between
+  // the rows themselves) inserts none of them
+  {
+    auto stmt = parseQuery(
+        "INSERT INTO users (name, age, email) VALUES ('Fay', 51, 'f@x'),"
+        "('Gus', 52, 'g@x'), ('Hal', 51, 'h@x')");
+    auto res = exec.execute(*stmt);
+    assert(!res.hasValue());
+    assert(res.status().code() == StatusCode::FailedPrecondition);
+    auto all = exec.execute(*parseQuery("SELECT * FROM users"));
+    assert(all.hasValue() && all.value().rowCount() == 4);
+  }
+
   std::cout << "KadeQL INSERT integration tests passed" << std::endl;
   return 0;
 }
@@ -0,0 +1,155 @@
+#include "kadedb/kadeql.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+
+static ResultSet run(QueryExecutor &exec, const std::string &q) {
+  auto stmt = parseQuery(q);
+  auto res = exec.execute(*stmt);
+  assert(res.hasValue());
+  return res.takeValue();
+}
+
+static std::vector<int64_t> ints(const ResultSet &rs, size_t col) {
+  std::vector<int64_t> out;
+  for (size_t i = 0; i < rs.rowCount(); ++i)
+    out.push_back(rs.at(i, col).asInt());
+  return out;
+}
+
+static bool parses(const std::string &q) {
+  try {
+    parseQuery(q);
+    return true;
+  } catch (const ParseError &) {
+    return false;
+  }
+}
+
+int main() {
+  std::cout << "=== KadeQL ORDER BY / LIMIT Tests ===" << std::endl;
+
+  InMemoryRelationalStorage storage;
+  TableSchema readings({
+      Column{"ts", ColumnType::Integer, /*nullable=*/false, false, {}},
+      Column{"sensor", ColumnType::Integer, /*nullable=*/false, false, {}},
+      Column{"value", ColumnType::Integer, /*nullable=*/true, false, {}},
+  });
+  assert(storage.createTable("readings", readings).ok());
+
+  // ts 0..199 inserted out of order; value is null for every 50th row
+  constexpr int64_t kRows = 200;
+  for (int64_t i = 0; i < kRows; ++i) {
+    int64_t ts = (i * 37) % kRows;
+    Row r(3);
+    r.set(0, ValueFactory::createInteger(ts));
+    r.set(1, ValueFactory::createInteger(ts % 3));
+    if (ts % 50 != 0)
+      r.set(2, ValueFactory::createInteger((ts * 7) % 11));
+    assert(storage.insertRow("readings", r).ok());
+  }
+  QueryExecutor exec(storage);
+
+  std::cout << "Test 1: parsing and round trip..." << std::endl;
+  {
+    auto stmt = parseQuery("select * from readings order by ts desc, sensor "
+                           "limit 5 offset 10;");
+    const auto &sel = static_cast<const SelectStatement &>(*stmt);
+    assert(sel.getOrderBy().size() == 2);
+    assert(sel.getOrderBy()[0].descending && !sel.getOrderBy()[1].descending);
+    assert(sel.getLimit() && *sel.getLimit() == 5 && sel.getOffset() == 10);
+    assert(sel.toString() ==
+           "SELECT * FROM readings ORDER BY ts DESC, sensor LIMIT 5 OFFSET 10");
+    assert(!parses("SELECT * FROM readings ORDER ts"));
+    assert(!parses("SELECT * FROM readings LIMIT -1"));
+    assert(!parses("SELECT * FROM readings LIMIT 2.5"));
+    assert(!parses("SELECT * FROM readings LIMIT n"));
+    assert(!parses("SELECT * FROM readings LIMIT 1 ORDER BY ts"));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: latest page via top-K..." << std::endl;
+  {
+    auto rs = run(exec, "SELECT ts, value FROM readings ORDER BY ts DESC "
+                        "LIMIT 5 OFFSET 2");
+    assert((ints(rs, 0) == std::vector<int64_t>{197, 196, 195, 194, 193}));
+    // Past the end / zero limit
+    assert(run(exec, "SELECT * FROM readings ORDER BY ts LIMIT 10 OFFSET 195")
+               .rowCount() == 5);
+    assert(run(exec, "SELECT * FROM readings ORDER BY ts LIMIT 0").rowCount() ==
+           0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: top-K matches a full sort..." << std::endl;
+  {
+    // Multi-key with ties: sensor asc, value desc (nulls last), ts asc
+    auto full = run(exec, "SELECT sensor, value, ts FROM readings WHERE ts > 3 "
+                          "ORDER BY sensor, value DESC, ts");
+    for (size_t k : {1u, 7u, 64u, 150u, 500u}) {
+      for (size_t off : {0u, 3u}) {
+        auto page = run(exec, "SELECT sensor, value, ts FROM readings WHERE "
+                              "ts > 3 ORDER BY sensor, value DESC, ts LIMIT " +
+                                  std::to_string(k) + " OFFSET " +
+                                  std::to_string(off));
+        size_t expect = std::min(k, full.rowCount() - off);
+        assert(page.rowCount() == expect);
+        for (size_t i = 0; i < expect; ++i)
+          assert(page.at(i, 2).asInt() == full.at(i + off, 2).asInt());
+      }
+    }
+    // Descending puts nulls last; ascending puts them first
+    auto asc = run(exec, "SELECT ts FROM readings ORDER BY value, ts LIMIT 4");
+    assert((ints(asc, 0) == std::vector<int64_t>{0, 50, 100, 150}));
+    auto desc = run(exec, "SELECT value FROM readings ORDER BY value DESC");
+    assert(desc.row(desc.rowCount() - 1).values()[0] == nullptr);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: sort key outside the projection..." << std::endl;
+  {
+    auto rs = run(exec, "SELECT sensor FROM readings ORDER BY ts DESC LIMIT 3");
+    assert(rs.columnCount() == 1 && rs.columnNames()[0] == "sensor");
+    assert((ints(rs, 0) == std::vector<int64_t>{199 % 3, 198 % 3, 197 % 3}));
+    auto bad = exec.execute(*parseQuery("SELECT * FROM readings ORDER BY x"));
+    assert(!bad.hasValue() &&
+           bad.status().code() == StatusCode::InvalidArgument);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 5: LIMIT/OFFSET without ORDER BY..." << std::endl;
+  {
+    auto all = run(exec, "SELECT ts FROM readings");
+    auto page = run(exec, "SELECT ts FROM readings LIMIT 4 OFFSET 6");
+    assert(page.rowCount() == 4);
+    for (size_t i = 0; i < 4; ++i)
+      assert(page.at(i, 0).asInt() == all.at(i + 6, 0).asInt());
+    assert(run(exec, "SELECT ts FROM readings OFFSET 198").rowCount() == 2);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 6: expression mode orders by output columns..."
+            << std::endl;
+  {
+    auto rs = run(exec, "SELECT TIME_BUCKET(ts, 50) AS bucket, COUNT(*) AS n "
+                        "FROM readings ORDER BY bucket DESC LIMIT 2");
+    assert((ints(rs, 0) == std::vector<int64_t>{150, 100}));
+    assert((ints(rs, 1) == std::vector<int64_t>{50, 50}));
+    auto proj = run(exec, "SELECT ts AS t FROM readings ORDER BY t LIMIT 2");
+    assert((ints(proj, 0) == std::vector<int64_t>{0, 1}));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll KadeQL ORDER BY / LIMIT tests passed!" << std::endl;
+  return 0;
+}
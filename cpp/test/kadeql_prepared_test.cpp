@@ -0,0 +1,164 @@
+#include "kadedb/kadeql.h"
+#include "kadedb/prepared_statement.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+
+using Params = std::vector<std::unique_ptr<Value>>;
+
+template <typename... V> static Params params(V... vals) {
+  Params out;
+  (out.push_back(std::move(vals)), ...);
+  return out;
+}
+
+static bool parses(const std::string &q) {
+  try {
+    parseQuery(q);
+    return true;
+  } catch (const ParseError &) {
+    return false;
+  }
+}
+
+int main() {
+  std::cout << "=== KadeQL Prepared Statement Tests ===" << std::endl;
+
+  InMemoryRelationalStorage storage;
+  TableSchema readings({
+      Column{"ts", ColumnType::Integer, /*nullable=*/false, false, {}},
+      Column{"sensor", ColumnType::String, /*nullable=*/false, false, {}},
+      Column{"value", ColumnType::Float, /*nullable=*/true, false, {}},
+  });
+  assert(storage.createTable("readings", readings).ok());
+  QueryExecutor exec(storage);
+
+  std::cout << "Test 1: placeholders parse as parameters..." << std::endl;
+  {
+    KadeQLParser parser;
+    auto stmt = parser.parse("SELECT * FROM readings WHERE ts > ? AND ts < ?");
+    assert(parser.parameters().size() == 2);
+    assert(parser.parameters()[1]->getIndex() == 1);
+    assert(stmt->toString().find("ts < $2") != std::string::npos);
+
+    auto numbered =
+        PreparedStatement::prepare("SELECT * FROM readings WHERE ts >= $2 "
+                                   "AND ts < $2 + $1");
+    assert(numbered.hasValue() && numbered.value()->parameterCount() == 2);
+
+    assert(!parses("SELECT * FROM readings WHERE ts = ? OR ts = $1"));
+    assert(!parses("SELECT * FROM readings WHERE ts = $0"));
+    assert(!parses("SELECT * FROM readings WHERE ts = $"));
+    assert(!parses("SELECT * FROM readings WHERE ts = $99999999"));
+    auto bad = PreparedStatement::prepare("SELECT * FROM");
+    assert(!bad.hasValue() &&
+           bad.status().code() == StatusCode::InvalidArgument);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: INSERT, SELECT and UPDATE with bound values..."
+            << std::endl;
+  {
+    auto ins = PreparedStatement::prepare(
+                   "INSERT INTO readings (ts, sensor, value) VALUES (?, ?, ?)")
+                   .takeValue();
+    assert(ins->parameterCount() == 3);
+    for (int64_t ts = 0; ts < 20; ++ts) {
+      auto res = ins->execute(
+          exec, params(ValueFactory::createInteger(ts),
+                       ValueFactory::createString(ts % 2 ? "odd" : "even"),
+                       ValueFactory::createFloat(ts * 0.5)));
+      assert(res.hasValue());
+    }
+
+    auto sel = PreparedStatement::prepare(
+                   "SELECT ts FROM readings WHERE sensor = $1 AND ts >= $2 "
+                   "ORDER BY ts LIMIT 3")
+                   .takeValue();
+    auto a = sel->execute(exec, params(ValueFactory::createString("odd"),
+                                       ValueFactory::createInteger(10)));
+    assert(a.hasValue() && a.value().rowCount() == 3);
+    assert(a.value().at(0, 0).asInt() == 11);
+    // Same handle, new values: nothing from the previous binding leaks
+    auto b = sel->execute(exec, params(ValueFactory::createString("even"),
+                                       ValueFactory::createInteger(0)));
+    assert(b.hasValue() && b.value().at(2, 0).asInt() == 4);
+
+    auto upd = PreparedStatement::prepare(
+                   "UPDATE readings SET value = ? WHERE ts = ?")
+                   .takeValue();
+    auto u = upd->execute(exec, params(ValueFactory::createFloat(99.5),
+                                       ValueFactory::createInteger(7)));
+    assert(u.hasValue() && u.value().at(0, 0).asInt() == 1);
+    auto check = exec.execute(
+        *parseQuery("SELECT value FROM readings WHERE value > 50"));
+    assert(check.hasValue() && check.value().rowCount() == 1);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: invalid bindings are rejected..." << std::endl;
+  {
+    auto sel = PreparedStatement::prepare(
+                   "SELECT * FROM readings WHERE ts = ?")
+                   .takeValue();
+    auto none = sel->execute(exec, {});
+    assert(!none.hasValue() &&
+           none.status().code() == StatusCode::InvalidArgument);
+    auto flag = sel->execute(exec, params(ValueFactory::createBoolean(true)));
+    assert(flag.status().code() == StatusCode::InvalidArgument);
+    Params nullParam;
+    nullParam.push_back(nullptr);
+    assert(sel->execute(exec, nullParam).status().code() ==
+           StatusCode::InvalidArgument);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: normalization..." << std::endl;
+  {
+    assert(normalizeQuery("  SELECT *\n\tFROM  t ;; ") == "SELECT * FROM t");
+    assert(normalizeQuery("SELECT * FROM t WHERE s = 'a  b'") ==
+           "SELECT * FROM t WHERE s = 'a  b'");
+    assert(normalizeQuery("WHERE s = 'it\\'s  ;'  ;") ==
+           "WHERE s = 'it\\'s  ;'");
+    assert(normalizeQuery("select x") != normalizeQuery("SELECT x"));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 5: LRU statement cache..." << std::endl;
+  {
+    StatementCache cache(2);
+    auto a1 = cache.prepare("SELECT * FROM readings WHERE ts = 1").takeValue();
+    auto a2 =
+        cache.prepare("SELECT *  FROM readings\nWHERE ts = 1;").takeValue();
+    assert(a1 == a2 && cache.hits() == 1 && cache.misses() == 1);
+
+    auto b = cache.prepare("SELECT * FROM readings WHERE ts = 2").takeValue();
+    // Touch a, then insert c: b is the least recently used and is evicted
+    assert(cache.prepare("SELECT * FROM readings WHERE ts = 1").value() == a1);
+    cache.prepare("SELECT * FROM readings WHERE ts = 3");
+    assert(cache.size() == 2);
+    auto b2 = cache.prepare("SELECT * FROM readings WHERE ts = 2").takeValue();
+    assert(b2 != b && cache.misses() == 4);
+    // Evicted handles stay usable
+    assert(b->execute(exec, {}).value().rowCount() == 1);
+
+    assert(!cache.prepare("SELECT FROM").hasValue());
+    assert(cache.size() == 2);
+    cache.clear();
+    assert(cache.size() == 0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll KadeQL prepared statement tests passed!" << std::endl;
+  return 0;
+}
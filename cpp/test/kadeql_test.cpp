@@ -1,5 +1,6 @@
 #include "kadedb/kadeql.h"
 #include <cassert>
+#include <cctype>
 #include <iostream>
 #include <memory>
 
@@ -35,6 +36,113 @@ void testTokenizer() {
   std::cout << "Tokenizer tests passed!" << std::endl;
 }
 
+void testTokenizerViews() {
+  std::cout << "Testing Tokenizer views and keywords..." << std::endl;
+
+  // Keywords in any case; near misses stay identifiers
+  assert(Tokenizer::keywordType("select") == TokenType::SELECT);
+  assert(Tokenizer::keywordType("ExPlAiN") == TokenType::EXPLAIN);
+  assert(Tokenizer::keywordType("delete") == TokenType::DELETE_);
+  assert(Tokenizer::keywordType("on") == TokenType::ON);
+  assert(Tokenizer::keywordType("selects") == TokenType::IDENTIFIER);
+  assert(Tokenizer::keywordType("sel") == TokenType::IDENTIFIER);
+  assert(Tokenizer::keywordType("orx") == TokenType::IDENTIFIER);
+  assert(Tokenizer::keywordType("o") == TokenType::IDENTIFIER);
+  assert(Tokenizer::keywordType("analyzer") == TokenType::IDENTIFIER);
+  const char *all[] = {"SELECT", "FROM",   "WHERE",   "INSERT",  "INTO",
+                       "VALUES", "UPDATE", "DELETE",  "SET",     "NOT",
+                       "AND",    "OR",     "BETWEEN", "AS",      "ORDER",
+                       "BY",     "ASC",    "DESC",    "LIMIT",   "OFFSET",
+                       "JOIN",   "INNER",  "LEFT",    "OUTER",   "ON",
+                       "GROUP",  "HAVING", "EXPLAIN", "ANALYZE"};
+  for (const char *kw : all) {
+    std::string lower(kw);
+    for (char &c : lower)
+      c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    assert(Tokenizer::keywordType(kw) != TokenType::IDENTIFIER);
+    assert(Tokenizer::keywordType(lower) == Tokenizer::keywordType(kw));
+  }
+
+  // Tokens view the query text where they start
+  std::string query = "select t.a, $12 from t where b >= 'x' and c != 2";
+  Tokenizer tokenizer(query);
+  std::vector<Token> tokens;
+  for (Token t = tokenizer.next(); t.type != TokenType::END_OF_INPUT;
+       t = tokenizer.next())
+    tokens.push_back(t);
+  assert(tokens.size() == 14);
+  for (const Token &t : tokens) {
+    if (t.type != TokenType::STRING_LITERAL)
+      assert(t.value.data() == query.data() + t.position);
+  }
+  assert(tokens[0].type == TokenType::SELECT);
+  assert(tokens[1].value == "t.a");
+  assert(tokens[3].type == TokenType::PARAMETER && tokens[3].value == "$12");
+  assert(tokens[8].type == TokenType::GREATER_EQUAL);
+  assert(tokens[8].position == 31 && tokens[8].column == 32);
+  assert(tokens[9].value == "x" && !tokens[9].decoded);
+  assert(tokens[9].value.data() == query.data() + 35);
+
+  // Escaped literals own their text, so they outlive the tokenizer
+  Token escaped;
+  {
+    std::string text = "'it\\'s\\n'";
+    Tokenizer t(text);
+    escaped = t.next();
+  }
+  assert(escaped.type == TokenType::STRING_LITERAL);
+  assert(escaped.decoded && escaped.value == "it's\n");
+
+  std::cout << "Tokenizer view tests passed!" << std::endl;
+}
+
+void testAstArena() {
+  std::cout << "Testing AST arena..." << std::endl;
+
+  // Parsed nodes come from the statement's arena; names are interned
+  std::unique_ptr<Statement> stmt;
+  {
+    KadeQLParser parser;
+    stmt = parser.parse("SELECT a FROM t WHERE a > 1 AND b = a OR UPPER(b)");
+  }
+  const AstArena *arena = stmt->arena();
+  assert(arena != nullptr && arena->bytesAllocated() > 0);
+  assert(arena->internedCount() == 3); // a, b, UPPER
+  auto *select = dynamic_cast<SelectStatement *>(stmt.get());
+  using Bin = BinaryExpression;
+  auto *orExpr = dynamic_cast<const Bin *>(select->getWhereClause());
+  auto *andExpr = dynamic_cast<const Bin *>(orExpr->getLeft());
+  auto *gt = dynamic_cast<const Bin *>(andExpr->getLeft());
+  auto *eq = dynamic_cast<const Bin *>(andExpr->getRight());
+  auto *a1 = dynamic_cast<const IdentifierExpression *>(gt->getLeft());
+  auto *a2 = dynamic_cast<const IdentifierExpression *>(eq->getRight());
+  assert(a1 && a2 && &a1->getName() == &a2->getName());
+  assert(select->toString().find("UPPER(b)") != std::string::npos);
+
+  // Outside a scope nodes are heap objects with their own names
+  std::unique_ptr<Expression> heap =
+      std::make_unique<IdentifierExpression>("x");
+  assert(heap->toString() == "x");
+
+  // A scope routes nodes to its arena, including in nested scopes
+  auto mine = std::make_shared<AstArena>();
+  {
+    AstArena::Scope scope(mine);
+    auto lit = std::make_unique<LiteralExpression>(int64_t{7});
+    {
+      AstArena::Scope inner(std::make_shared<AstArena>());
+      auto other = std::make_unique<IdentifierExpression>("y");
+    }
+    auto id = std::make_unique<IdentifierExpression>("z");
+    auto call = std::make_unique<FunctionCallExpression>(
+        "f", std::vector<std::unique_ptr<Expression>>{});
+    assert(mine->internedCount() == 2 && lit->toString() == "7");
+  }
+  assert(mine->bytesAllocated() > 0);
+
+  std::cout << "AST arena tests passed!" << std::endl;
+}
+
 void testSelectParser() {
   std::cout << "Testing SELECT Parser..." << std::endl;
 
@@ -162,6 +270,12 @@ int main() {
     testTokenizer();
     std::cout << std::endl;
 
+    testTokenizerViews();
+    std::cout << std::endl;
+
+    testAstArena();
+    std::cout << std::endl;
+
     testSelectParser();
     std::cout << std::endl;
 
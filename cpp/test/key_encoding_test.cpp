@@ -0,0 +1,251 @@
+#include "kadedb/kadeql.h"
+#include "kadedb/key_encoding.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+
+static constexpr int64_t kMax = std::numeric_limits<int64_t>::max();
+static constexpr int64_t kMin = std::numeric_limits<int64_t>::min();
+
+// Values whose Value::compare() order is total: integers of any size, and
+// doubles only among integers they can represent exactly
+static std::unique_ptr<Value> randomValue(std::mt19937_64 &rng) {
+  static const int64_t wide[] = {kMin,
+                                 kMin + 1,
+                                 -(int64_t{1} << 53) - 1,
+                                 (int64_t{1} << 53) + 1,
+                                 (int64_t{1} << 62) - 1,
+                                 int64_t{1} << 62,
+                                 (int64_t{1} << 62) + 1,
+                                 kMax - 1,
+                                 kMax};
+  switch (rng() % 7) {
+  case 0:
+    return ValueFactory::createInteger(static_cast<int64_t>(rng() % 41) - 20);
+  case 1:
+    return ValueFactory::createFloat(static_cast<double>(rng() % 400) / 8 -
+                                     25);
+  case 2:
+    return ValueFactory::createInteger(static_cast<int64_t>(rng()));
+  case 3:
+    return ValueFactory::createInteger(wide[rng() % 9] +
+                                       static_cast<int64_t>(rng() % 3) - 1);
+  case 4: {
+    static const char *words[] = {"", "a", "a\0b", "ab", "b", "\xFF"};
+    size_t w = rng() % 6;
+    return ValueFactory::createString(w == 2 ? std::string("a\0b", 3)
+                                             : words[w]);
+  }
+  case 5:
+    return ValueFactory::createBoolean(rng() % 2 == 0);
+  default:
+    return ValueFactory::createNull();
+  }
+}
+
+static std::string key(const Value *v) {
+  std::string out;
+  keycode::appendValue(out, v);
+  return out;
+}
+
+static std::string sortKey(const Value *v, bool descending = false) {
+  std::string out;
+  keycode::appendSortKey(out, v, descending);
+  return out;
+}
+
+static ResultSet run(QueryExecutor &exec, const std::string &q) {
+  auto stmt = parseQuery(q);
+  auto res = exec.execute(*stmt);
+  assert(res.hasValue());
+  return res.takeValue();
+}
+
+int main() {
+  std::cout << "=== Key Encoding Tests ===" << std::endl;
+
+  std::cout << "Test 1: keys order like Value::compare()..." << std::endl;
+  {
+    std::mt19937_64 rng(7);
+    for (int n = 0; n < 50000; ++n) {
+      auto a = randomValue(rng), b = randomValue(rng);
+      // Wide integers against doubles are outside the total order
+      const bool wideA = a->type() == ValueType::Integer &&
+                         std::abs(a->asFloat()) > 9007199254740992.0;
+      const bool wideB = b->type() == ValueType::Integer &&
+                         std::abs(b->asFloat()) > 9007199254740992.0;
+      if ((wideA && b->type() == ValueType::Float) ||
+          (wideB && a->type() == ValueType::Float))
+        continue;
+      const std::string ka = key(a.get()), kb = key(b.get());
+      const int c = a->compare(*b);
+      assert((ka < kb) == (c < 0) && (ka == kb) == (c == 0));
+    }
+    // Equal numbers share a key; integers next to each other beyond 2^53
+    // do not
+    auto two = ValueFactory::createInteger(2);
+    auto twoF = ValueFactory::createFloat(2.0);
+    assert(key(two.get()) == key(twoF.get()));
+    auto zero = ValueFactory::createFloat(0.0);
+    auto negZero = ValueFactory::createFloat(-0.0);
+    assert(key(zero.get()) == key(negZero.get()));
+    for (int64_t base : {int64_t{1} << 53, int64_t{1} << 60, kMax - 3}) {
+      std::string last;
+      for (int64_t i = base; i < base + 3; ++i) {
+        auto v = ValueFactory::createInteger(i);
+        assert(key(v.get()) > last);
+        last = key(v.get());
+      }
+    }
+    auto min = ValueFactory::createInteger(kMin);
+    auto max = ValueFactory::createInteger(kMax);
+    auto negInf = ValueFactory::createFloat(-HUGE_VAL);
+    auto inf = ValueFactory::createFloat(HUGE_VAL);
+    auto nan = ValueFactory::createFloat(std::nan(""));
+    auto negNan = ValueFactory::createFloat(-std::nan(""));
+    assert(key(negInf.get()) < key(min.get()));
+    assert(key(max.get()) < key(inf.get()));
+    assert(key(inf.get()) < key(nan.get()));
+    assert(key(nan.get()) == key(negNan.get()));
+    // Absent before NullValue before every value
+    auto null = ValueFactory::createNull();
+    assert(key(nullptr) < key(null.get()) && key(null.get()) < key(min.get()));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: sort keys, nulls and descending order..."
+            << std::endl;
+  {
+    auto null = ValueFactory::createNull();
+    auto neg = ValueFactory::createInteger(-5);
+    auto str = ValueFactory::createString("z");
+    assert(sortKey(nullptr) == sortKey(null.get()));
+    assert(sortKey(null.get()) < sortKey(neg.get()));
+    assert(sortKey(null.get(), true) > sortKey(str.get(), true));
+    std::mt19937_64 rng(11);
+    for (int n = 0; n < 20000; ++n) {
+      auto a = randomValue(rng), b = randomValue(rng);
+      if (a->type() == ValueType::Float || b->type() == ValueType::Float)
+        continue;
+      const std::string ka = sortKey(a.get()), kb = sortKey(b.get());
+      const std::string da = sortKey(a.get(), true),
+                        db = sortKey(b.get(), true);
+      assert((ka < kb) == (db < da) && (ka == kb) == (da == db));
+    }
+    // Composite keys sort field by field, whatever the fields' lengths
+    auto a = ValueFactory::createString("a");
+    auto ab = ValueFactory::createString("ab");
+    std::string k1 = sortKey(a.get(), true) + sortKey(neg.get());
+    std::string k2 = sortKey(ab.get(), true) + sortKey(null.get());
+    assert(k2 < k1);
+    k1 = sortKey(a.get()) + sortKey(str.get());
+    k2 = sortKey(a.get()) + sortKey(neg.get());
+    assert(k2 < k1);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: range bounds cover equal numbers..." << std::endl;
+  {
+    const int64_t wide = (int64_t{1} << 60) + 1;
+    auto i = ValueFactory::createInteger(wide);
+    auto f = ValueFactory::createFloat(static_cast<double>(wide));
+    assert(i->compare(*f) == 0 && key(i.get()) != key(f.get()));
+    for (const Value *rhs : {static_cast<const Value *>(i.get()),
+                             static_cast<const Value *>(f.get())}) {
+      std::string bound;
+      keycode::appendBound(bound, rhs);
+      assert(bound.size() == keycode::kNumberPrefixBytes);
+      const std::string end = keycode::prefixEnd(bound);
+      for (const Value *v : {static_cast<const Value *>(i.get()),
+                             static_cast<const Value *>(f.get())})
+        assert(bound <= key(v) && key(v) < end);
+    }
+    auto s = ValueFactory::createString("x");
+    std::string bound;
+    keycode::appendBound(bound, s.get());
+    assert(bound == key(s.get()));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: ORDER BY and GROUP BY on normalized keys..."
+            << std::endl;
+  {
+    InMemoryRelationalStorage storage;
+    TableSchema t({Column{"id", ColumnType::Integer, false, false, {}},
+                   Column{"n", ColumnType::Integer, true, false, {}},
+                   Column{"s", ColumnType::String, true, false, {}}});
+    assert(storage.createTable("t", t).ok());
+    std::mt19937_64 rng(5);
+    const int64_t ns[] = {kMin, -3, 0, 7, (int64_t{1} << 60) + 1,
+                          int64_t{1} << 60, kMax};
+    const char *ss[] = {"", "a", "b", "ab"};
+    struct Ref {
+      int64_t id;
+      std::optional<int64_t> n;
+      std::optional<std::string> s;
+    };
+    std::vector<Ref> ref;
+    for (int64_t id = 0; id < 400; ++id) {
+      Row r(3);
+      Ref e{id, std::nullopt, std::nullopt};
+      r.set(0, ValueFactory::createInteger(id));
+      if (rng() % 6) {
+        e.n = ns[rng() % 7];
+        r.set(1, ValueFactory::createInteger(*e.n));
+      }
+      if (rng() % 5) {
+        e.s = ss[rng() % 4];
+        r.set(2, ValueFactory::createString(*e.s));
+      }
+      assert(storage.insertRow("t", r).ok());
+      ref.push_back(e);
+    }
+    QueryExecutor exec(storage);
+
+    // n DESC puts nulls last; s ascending puts them first; id is stable
+    auto rs = run(exec, "SELECT id FROM t ORDER BY n DESC, s");
+    std::vector<Ref> want = ref;
+    std::stable_sort(want.begin(), want.end(),
+                     [](const Ref &x, const Ref &y) {
+                       if (x.n != y.n)
+                         return !x.n ? false : !y.n ? true : *x.n > *y.n;
+                       return x.s != y.s && (!x.s || (y.s && *x.s < *y.s));
+                     });
+    assert(rs.rowCount() == want.size());
+    for (size_t r = 0; r < want.size(); ++r)
+      assert(rs.at(r, 0).asInt() == want[r].id);
+
+    rs = run(exec, "SELECT n, COUNT(*) AS c FROM t GROUP BY n");
+    std::map<std::optional<int64_t>, int64_t> counts;
+    for (const auto &e : ref)
+      ++counts[e.n];
+    assert(rs.rowCount() == counts.size());
+    for (size_t r = 0; r < rs.rowCount(); ++r) {
+      const Value *cell = rs.row(r).values()[0].get();
+      std::optional<int64_t> n;
+      if (cell && cell->type() != ValueType::Null)
+        n = cell->asInt();
+      assert(rs.at(r, 1).asInt() == counts.at(n));
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll key encoding tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,210 @@
+#include "kadedb/kadeql.h"
+#include "kadedb/metrics.h"
+#include "kadedb/prepared_statement.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+
+// events(id PK, bucket NOT NULL, score NOT NULL, note nullable)
+static void makeTable(InMemoryRelationalStorage &st, int rows) {
+  TableSchema t({Column{"id", ColumnType::Integer, false, false, {}},
+                 Column{"bucket", ColumnType::Integer, false, false, {}},
+                 Column{"score", ColumnType::Integer, false, false, {}},
+                 Column{"note", ColumnType::String, true, false, {}}},
+                std::string("id"));
+  assert(st.createTable("events", t).ok());
+  for (int id = 0; id < rows; ++id) {
+    Row r(4);
+    r.set(0, ValueFactory::createInteger(id));
+    r.set(1, ValueFactory::createInteger(id % 7));
+    r.set(2, ValueFactory::createInteger((id * 37) % 101));
+    assert(st.insertRow("events", r).ok());
+  }
+}
+
+static ResultSet run(QueryExecutor &exec, const std::string &q) {
+  auto stmt = parseQuery(q);
+  auto res = exec.execute(*stmt);
+  assert(res.hasValue());
+  return res.takeValue();
+}
+
+// First column of every row of `q`, fetched `pageSize` rows at a time
+static std::vector<int64_t> pages(QueryExecutor &exec, const std::string &q,
+                                  size_t pageSize, size_t *count = nullptr) {
+  auto stmt = parseQuery(q);
+  const auto &select = static_cast<const SelectStatement &>(*stmt);
+  std::vector<int64_t> ids;
+  std::string token;
+  size_t n = 0;
+  do {
+    auto page = exec.executePage(select, pageSize, token);
+    assert(page.hasValue());
+    const ResultSet &rows = page.value().rows;
+    assert(rows.rowCount() <= pageSize);
+    for (size_t r = 0; r < rows.rowCount(); ++r)
+      ids.push_back(rows.at(r, 0).asInt());
+    token = page.value().nextToken;
+    ++n;
+  } while (!token.empty());
+  if (count)
+    *count = n;
+  return ids;
+}
+
+static std::vector<int64_t> column(const ResultSet &rs) {
+  std::vector<int64_t> out;
+  for (size_t r = 0; r < rs.rowCount(); ++r)
+    out.push_back(rs.at(r, 0).asInt());
+  return out;
+}
+
+int main() {
+  std::cout << "=== Keyset Pagination Tests ===" << std::endl;
+
+  std::cout << "Test 1: pages match the full ordered result..." << std::endl;
+  {
+    InMemoryRelationalStorage st;
+    makeTable(st, 1000);
+    assert(st.createIndex("events", "score", IndexType::Ordered).ok());
+    QueryExecutor exec(st);
+    for (const char *q :
+         {"SELECT id FROM events ORDER BY id",
+          "SELECT id FROM events ORDER BY score DESC",
+          "SELECT id, score FROM events ORDER BY score, bucket DESC",
+          "SELECT id FROM events WHERE bucket = 3 ORDER BY score",
+          "SELECT * FROM events WHERE score > 50 ORDER BY bucket, id DESC"}) {
+      std::string full = q;
+      full += ", id";
+      const auto want = column(run(exec, full));
+      for (size_t size : {1, 7, 100, 5000}) {
+        size_t count = 0;
+        assert(pages(exec, q, size, &count) == want);
+        // Only a short page ends the pagination
+        assert(count == want.size() / size + 1);
+      }
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: pages seek the ordered index..." << std::endl;
+  {
+    InMemoryRelationalStorage st;
+    makeTable(st, 5000);
+    assert(st.createIndex("events", "score", IndexType::Ordered).ok());
+    QueryExecutor exec(st);
+    auto stmt = parseQuery("SELECT id FROM events ORDER BY score, id");
+    const auto &select = static_cast<const SelectStatement &>(*stmt);
+    std::string token;
+    for (int p = 0; p < 20; ++p) {
+      metrics::OperationScope probe(metrics::Operation::KadeqlExecute);
+      auto page = exec.executePage(select, 10, token);
+      assert(page.hasValue() && page.value().rows.rowCount() == 10);
+      token = page.value().nextToken;
+      // The page's rows and the rest of its last score, not the rows before
+      assert(probe.rowsScanned() < 150);
+    }
+
+    // LIMIT queries walk the index too
+    auto rs = run(exec, "EXPLAIN SELECT id FROM events ORDER BY score DESC "
+                        "LIMIT 5");
+    bool ordered = false;
+    for (size_t r = 0; r < rs.rowCount(); ++r)
+      ordered |= rs.at(r, "detail").toString().find(
+                     "ordered index on score descending, first 5 rows") !=
+                 std::string::npos;
+    assert(ordered);
+    rs = run(exec, "SELECT id, score FROM events ORDER BY score DESC, id "
+                   "LIMIT 12 OFFSET 3");
+    const auto all =
+        column(run(exec, "SELECT id, score FROM events ORDER BY score DESC, "
+                         "id"));
+    assert(column(rs) == std::vector<int64_t>(all.begin() + 3,
+                                              all.begin() + 15));
+    {
+      metrics::OperationScope probe(metrics::Operation::KadeqlExecute);
+      run(exec, "SELECT id FROM events ORDER BY score LIMIT 3");
+      assert(probe.rowsScanned() < 150);
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: writes between pages..." << std::endl;
+  {
+    InMemoryRelationalStorage st;
+    makeTable(st, 100);
+    QueryExecutor exec(st);
+    auto stmt = parseQuery("SELECT id FROM events ORDER BY id");
+    const auto &select = static_cast<const SelectStatement &>(*stmt);
+    auto first = exec.executePage(select, 10);
+    assert(first.hasValue());
+    // Rows before the page boundary neither shift nor repeat the next page
+    assert(run(exec, "DELETE FROM events WHERE id < 5").rowCount() == 1);
+    auto second = exec.executePage(select, 10, first.value().nextToken);
+    assert(second.hasValue());
+    assert(column(second.value().rows) ==
+           std::vector<int64_t>({10, 11, 12, 13, 14, 15, 16, 17, 18, 19}));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: rejected queries and tokens..." << std::endl;
+  {
+    InMemoryRelationalStorage st;
+    makeTable(st, 50);
+    TableSchema nopk({Column{"id", ColumnType::Integer, false, false, {}}});
+    assert(st.createTable("nopk", nopk).ok());
+    QueryExecutor exec(st);
+    auto page = [&](const std::string &q, const std::string &token = {}) {
+      auto stmt = parseQuery(q);
+      return exec
+          .executePage(static_cast<const SelectStatement &>(*stmt), 5, token)
+          .status()
+          .code();
+    };
+    const auto bad = StatusCode::InvalidArgument;
+    assert(page("SELECT id FROM events") == bad);
+    assert(page("SELECT id FROM events ORDER BY id LIMIT 3") == bad);
+    assert(page("SELECT id FROM events ORDER BY id OFFSET 3") == bad);
+    assert(page("SELECT COUNT(*) FROM events ORDER BY id") == bad);
+    assert(page("SELECT id FROM events ORDER BY note") == bad);
+    assert(page("SELECT id FROM nopk ORDER BY id") == bad);
+    assert(page("SELECT id FROM events ORDER BY id", "zz") == bad);
+    assert(page("SELECT id FROM events ORDER BY id", "0a0b") == bad);
+
+    // A token of another query's keys
+    auto stmt = parseQuery("SELECT id FROM events ORDER BY score");
+    auto first =
+        exec.executePage(static_cast<const SelectStatement &>(*stmt), 5);
+    assert(first.hasValue() && !first.value().nextToken.empty());
+    assert(page("SELECT id FROM events ORDER BY id",
+                first.value().nextToken) == bad);
+    assert(page("SELECT id FROM events ORDER BY bucket",
+                first.value().nextToken) == StatusCode::Ok);
+
+    // Prepared statements bind their parameters for each page
+    auto ps = PreparedStatement::prepare(
+        "SELECT id FROM events WHERE bucket = ? ORDER BY id");
+    assert(ps.hasValue());
+    std::vector<std::unique_ptr<Value>> params;
+    params.push_back(ValueFactory::createInteger(2));
+    auto p1 = ps.value()->executePage(exec, params, 3, "");
+    assert(p1.hasValue());
+    auto p2 = ps.value()->executePage(exec, params, 3, p1.value().nextToken);
+    assert(p2.hasValue());
+    assert(column(p1.value().rows) == std::vector<int64_t>({2, 9, 16}));
+    assert(column(p2.value().rows) == std::vector<int64_t>({23, 30, 37}));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll keyset pagination tests passed!" << std::endl;
+  return 0;
+}
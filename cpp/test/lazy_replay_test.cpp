@@ -0,0 +1,275 @@
+#include "kadedb/graph/storage.h"
+#include "kadedb/lazy_storage.h"
+#include "kadedb/logged_storage.h"
+#include "kadedb/storage.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/value.h"
+#include "kadedb/wal.h"
+
+#include <algorithm>
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace kadedb;
+
+static std::string logPath(const char *name) {
+  auto p = std::filesystem::temp_directory_path() /
+           ("kadedb_lazy_replay_test_" + std::string(name) + ".log");
+  std::filesystem::remove(p);
+  return p.string();
+}
+
+static TableSchema schema() {
+  return TableSchema({Column{"id", ColumnType::Integer, false, true, {}},
+                      Column{"name", ColumnType::String, true, false, {}}},
+                     std::string("id"));
+}
+
+static Row row(int64_t id) {
+  Row r(2);
+  r.set(0, ValueFactory::createInteger(id));
+  r.set(1, ValueFactory::createString("row " + std::to_string(id)));
+  return r;
+}
+
+static std::string table(int i) { return "t" + std::to_string(i); }
+
+static size_t rows(RelationalStorage &st, const std::string &name) {
+  auto rs = st.select(name, {}, std::nullopt);
+  assert(rs.hasValue());
+  return rs.value().rowCount();
+}
+
+static bool has(std::vector<std::string> names, const std::string &name) {
+  return std::find(names.begin(), names.end(), name) != names.end();
+}
+
+// Eight tables of 100 * (i + 1) rows, a dropped table, a collection and a
+// graph
+static void writeLog(const std::string &path) {
+  InMemoryRelationalStorage rel;
+  InMemoryDocumentStorage doc;
+  InMemoryGraphStorage graph;
+  auto wal = WriteAheadLog::open(path).takeValue();
+  LoggedRelationalStorage lrel(rel, *wal);
+  LoggedDocumentStorage ldoc(doc, *wal);
+  LoggedGraphStorage lgraph(graph, *wal);
+  for (int i = 0; i < 8; ++i)
+    assert(lrel.createTable(table(i), schema()).ok());
+  for (int64_t r = 0; r < 800; ++r)
+    for (int i = 0; i < 8; ++i)
+      if (r < 100 * (i + 1))
+        assert(lrel.insertRow(table(i), row(r)).ok());
+  assert(lrel.createTable("gone", schema()).ok());
+  assert(lrel.insertRow("gone", row(1)).ok());
+  assert(lrel.dropTable("gone").ok());
+
+  assert(ldoc.createCollection("notes").ok());
+  for (int i = 0; i < 20; ++i) {
+    Document d;
+    d["n"] = ValueFactory::createInteger(i);
+    assert(ldoc.put("notes", "k" + std::to_string(i), d).ok());
+  }
+  assert(lgraph.createGraph("g").ok());
+  for (NodeId id = 0; id < 10; ++id) {
+    Node n;
+    n.id = id;
+    assert(lgraph.putNode("g", n).ok());
+  }
+  for (EdgeId id = 0; id < 9; ++id) {
+    Edge e;
+    e.id = id;
+    e.from = id;
+    e.to = id + 1;
+    assert(lgraph.putEdge("g", e).ok());
+  }
+}
+
+int main() {
+  std::cout << "=== Lazy Replay Tests ===" << std::endl;
+
+  const std::string path = logPath("tables");
+  writeLog(path);
+
+  std::cout << "Test 1: targets load on first use..." << std::endl;
+  {
+    InMemoryRelationalStorage rel;
+    InMemoryDocumentStorage doc;
+    InMemoryGraphStorage graph;
+    WalTargets targets;
+    targets.relational = &rel;
+    targets.document = &doc;
+    targets.graph = &graph;
+    LazyReplayOptions options;
+    options.background = false;
+    auto replay = LazyReplay::open(path, targets, 0, options).takeValue();
+    LazyRelationalStorage lrel(rel, *replay);
+    LazyDocumentStorage ldoc(doc, *replay);
+    LazyGraphStorage lgraph(graph, *replay);
+
+    // Listed at once, nothing applied yet
+    assert(replay->applied() == 0);
+    assert(rel.listTables().empty());
+    std::vector<std::string> tables = lrel.listTables();
+    assert(tables.size() == 8 && has(tables, "t7") && !has(tables, "gone"));
+    assert(ldoc.listCollections() == std::vector<std::string>{"notes"});
+    assert(lgraph.listGraphs() == std::vector<std::string>{"g"});
+    assert(replay->pendingTargets(WalEngine::Relational).size() == 9);
+
+    // Only the table used is replayed
+    assert(rows(lrel, "t3") == 400);
+    assert(replay->applied() == 401);
+    assert(!has(replay->pendingTargets(WalEngine::Relational), "t3"));
+    assert(rel.listTables() == std::vector<std::string>{"t3"});
+    assert(lrel.listTables().size() == 8);
+    assert(lrel.estimateRowCount("t0").value() == 100);
+    assert(ldoc.count("notes").value() == 20);
+    assert(lgraph.neighborsOut("g", 4).value() == std::vector<NodeId>{5});
+
+    // Targets without records pass straight through
+    assert(lrel.createTable("fresh", schema()).ok());
+    assert(lrel.insertRow("fresh", row(1)).ok());
+    assert(has(lrel.listTables(), "fresh"));
+
+    assert(replay->wait().ok());
+    assert(replay->pendingTargets(WalEngine::Relational).empty());
+    for (int i = 0; i < 8; ++i)
+      assert(rows(rel, table(i)) == static_cast<size_t>(100 * (i + 1)));
+    assert(!has(rel.listTables(), "gone"));
+
+    auto counts = replay->accessCounts();
+    assert((counts[{WalEngine::Relational, "t3"}]) == 1);
+    assert((counts[{WalEngine::Relational, "t5"}]) == 0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: concurrent first uses and background loaders..."
+            << std::endl;
+  {
+    for (bool background : {false, true}) {
+      InMemoryRelationalStorage rel;
+      InMemoryDocumentStorage doc;
+      InMemoryGraphStorage graph;
+      WalTargets targets;
+      targets.relational = &rel;
+      targets.document = &doc;
+      targets.graph = &graph;
+      LazyReplayOptions options;
+      options.background = background;
+      options.threads = 2;
+      options.hints[{WalEngine::Relational, "t7"}] = 100;
+      auto replay = LazyReplay::open(path, targets, 0, options).takeValue();
+      LazyRelationalStorage lrel(rel, *replay);
+
+      // Every reader of a table sees all of its rows
+      std::vector<std::thread> readers;
+      for (int w = 0; w < 16; ++w)
+        readers.emplace_back([&, w] {
+          const int i = w % 8;
+          assert(rows(lrel, table(i)) == static_cast<size_t>(100 * (i + 1)));
+        });
+      for (auto &t : readers)
+        t.join();
+      assert(replay->wait().ok());
+      assert(doc.count("notes").value() == 20);
+      assert(replay->applied() == 3600 + 3 + 8 + 21 + 20);
+    }
+
+    // Destroying the replay stops its loaders
+    InMemoryRelationalStorage rel;
+    InMemoryDocumentStorage doc;
+    InMemoryGraphStorage graph;
+    WalTargets targets;
+    targets.relational = &rel;
+    targets.document = &doc;
+    targets.graph = &graph;
+    LazyReplay::open(path, targets).takeValue().reset();
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: failed targets report their record..." << std::endl;
+  {
+    // The graph has no storage, and "orphan" is never created
+    const std::string bad = logPath("bad");
+    {
+      auto wal = WriteAheadLog::open(bad).takeValue();
+      assert(wal->commit(walRecord::createTable("ok", schema())).ok());
+      assert(wal->commit(walRecord::insertRow("orphan", row(1))).ok());
+      assert(wal->commit(walRecord::insertRow("ok", row(1))).ok());
+      assert(wal->commit(walRecord::createGraph("g")).ok());
+    }
+    InMemoryRelationalStorage rel;
+    WalTargets targets;
+    targets.relational = &rel;
+    auto replay = LazyReplay::open(bad, targets).takeValue();
+    LazyRelationalStorage lrel(rel, *replay);
+    assert(rows(lrel, "ok") == 1);
+    for (int i = 0; i < 2; ++i) {
+      auto rs = lrel.select("orphan", {}, std::nullopt);
+      assert(!rs.hasValue());
+      assert(rs.status().message().find("Log record 2: ") == 0);
+      assert(!lrel.estimateRowCount("orphan").has_value());
+    }
+    Status st = replay->wait();
+    assert(st.message().find("Log record 2: ") == 0);
+    assert(!replay->loadAll(WalEngine::Graph).ok());
+    assert(replay->loadAll(WalEngine::Document).ok());
+    std::filesystem::remove(bad);
+
+    // A file that is not a log fails open()
+    const std::string junk = logPath("junk");
+    {
+      auto wal = WriteAheadLog::open(junk).takeValue();
+    }
+    std::filesystem::resize_file(junk, 3);
+    assert(LazyReplay::open(junk, targets).hasValue());
+    std::ofstream(junk) << "not a write-ahead log";
+    assert(!LazyReplay::open(junk, targets).hasValue());
+    std::filesystem::remove(junk);
+    assert(LazyReplay::open(junk, targets).value()->wait().ok());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: logging resumes over lazy storages..." << std::endl;
+  {
+    {
+      InMemoryRelationalStorage rel;
+      InMemoryDocumentStorage doc;
+      InMemoryGraphStorage graph;
+      WalTargets targets;
+      targets.relational = &rel;
+      targets.document = &doc;
+      targets.graph = &graph;
+      auto replay = LazyReplay::open(path, targets).takeValue();
+      LazyRelationalStorage lrel(rel, *replay);
+      auto wal = WriteAheadLog::open(path).takeValue();
+      LoggedRelationalStorage logged(lrel, *wal);
+      // New rows land after the replayed ones
+      assert(logged.insertRow("t0", row(5000)).ok());
+      assert(!logged.insertRow("t1", row(5)).ok());
+      assert(logged.dropTable("t2").ok());
+      assert(replay->wait().ok());
+    }
+    InMemoryRelationalStorage rel;
+    InMemoryDocumentStorage doc;
+    InMemoryGraphStorage graph;
+    WalTargets targets;
+    targets.relational = &rel;
+    targets.document = &doc;
+    targets.graph = &graph;
+    assert(replayWal(path, targets).hasValue());
+    assert(rows(rel, "t0") == 101);
+    assert(rows(rel, "t1") == 200);
+    assert(!has(rel.listTables(), "t2"));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::filesystem::remove(path);
+  std::cout << "\nAll lazy replay tests passed!" << std::endl;
+  return 0;
+}
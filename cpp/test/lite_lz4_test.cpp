@@ -0,0 +1,94 @@
+#include "kadedb/compression.h"
+
+extern "C" {
+#include "kadedb_lite_internal.h"
+}
+
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+
+static std::string core(const std::string &in) {
+  std::string out;
+  codec::compress(Codec::Lz4, in.data(), in.size(), out);
+  return out;
+}
+
+static std::string lite(const std::string &in) {
+  std::string out(kadedb_lite_lz4_bound(in.size()), '\0');
+  const size_t n = kadedb_lite_lz4_compress(in.data(), in.size(), &out[0]);
+  assert(n > 0 && n <= out.size());
+  out.resize(n);
+  return out;
+}
+
+// Inputs of every shape the sync deltas and log frames produce
+static std::vector<std::string> inputs() {
+  std::vector<std::string> out = {"", "a", "abcdefghijkl", "abcdefghijklm",
+                                  std::string(10000, 'x')};
+  std::mt19937 rng(7);
+  for (size_t size : {size_t{13}, size_t{100}, size_t{1000}, size_t{5000},
+                      size_t{70000}, size_t{300000}}) {
+    // Random bytes, repeated records and text with near misses
+    std::string noise(size, '\0');
+    for (auto &c : noise)
+      c = static_cast<char>(rng());
+    out.push_back(noise);
+    std::string records;
+    while (records.size() < size)
+      records += "key:" + std::to_string(rng() % 50) + "=value " +
+                 std::to_string(rng() % 1000) + ";";
+    out.push_back(records.substr(0, size));
+    std::string text;
+    while (text.size() < size)
+      text += rng() % 4 ? "the quick brown fox " : "the quick brown cat ";
+    out.push_back(text.substr(0, size));
+  }
+  return out;
+}
+
+int main() {
+  std::cout << "=== Lite LZ4 Tests ===" << std::endl;
+
+  std::cout << "Test 1: both encoders write the same bytes..." << std::endl;
+  {
+    for (const std::string &in : inputs()) {
+      const std::string a = core(in);
+      assert(lite(in) == a);
+      assert(a.size() <= codec::compressBound(in.size()));
+      assert(kadedb_lite_lz4_bound(in.size()) ==
+             codec::compressBound(in.size()));
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: each decodes the other's output..." << std::endl;
+  {
+    for (const std::string &in : inputs()) {
+      const std::string packed = core(in);
+      std::string back(in.size(), '\0');
+      assert(kadedb_lite_lz4_decompress(packed.data(), packed.size(),
+                                        &back[0], in.size()) == 0);
+      assert(back == in);
+      std::string again(in.size(), '\0');
+      assert(codec::decompress(packed.data(), packed.size(), &again[0],
+                               in.size()));
+      assert(again == in);
+      // Truncated input fails in both
+      if (!packed.empty()) {
+        assert(kadedb_lite_lz4_decompress(packed.data(), packed.size() - 1,
+                                          &back[0], in.size()) != 0);
+        assert(!codec::decompress(packed.data(), packed.size() - 1,
+                                  &again[0], in.size()));
+      }
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll lite LZ4 tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,218 @@
+#include "kadedb/graph/storage.h"
+#include "kadedb/memory.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace kadedb;
+
+static size_t usage(const Result<size_t> &r) {
+  assert(r.hasValue());
+  return r.value();
+}
+
+static Row makeRow(int64_t id, const std::string &name) {
+  Row r(2);
+  r.set(0, ValueFactory::createInteger(id));
+  r.set(1, ValueFactory::createString(name));
+  return r;
+}
+
+static Predicate idBelow(int64_t n) {
+  Predicate p;
+  p.kind = Predicate::Kind::Comparison;
+  p.column = "id";
+  p.op = Predicate::Op::Lt;
+  p.rhs = ValueFactory::createInteger(n);
+  return p;
+}
+
+int main() {
+  std::cout << "=== Memory Budget Tests ===" << std::endl;
+
+  std::cout << "Test 1: estimates..." << std::endl;
+  {
+    InlineRow small = InlineRow::fromRow(makeRow(1, "a"));
+    InlineRow large = InlineRow::fromRow(makeRow(1, std::string(100, 'x')));
+    assert(memory::rowBytes(small) == 2 * sizeof(InlineValue));
+    assert(memory::rowBytes(large) >= memory::rowBytes(small) + 100);
+    Document d;
+    d["k"] = ValueFactory::createString(std::string(50, 'y'));
+    assert(memory::documentBytes(d) > 50);
+    assert(memory::documentBytes(Document()) == 0);
+
+    MemoryAccount a;
+    assert(a.fits(1'000'000) && !a.over());
+    a.setBudget(100);
+    a.add(60);
+    assert(a.fits(40) && !a.fits(41));
+    a.sub(60);
+    assert(a.bytes() == 0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: relational tables..." << std::endl;
+  {
+    InMemoryRelationalStorage st;
+    TableSchema t({Column{"id", ColumnType::Integer, false, false, {}},
+                   Column{"name", ColumnType::String, true, false, {}}});
+    assert(st.createTable("t", t).ok());
+    assert(usage(st.memoryUsage("t")) == 0);
+    assert(!st.memoryUsage("nope").hasValue());
+    assert(!st.setMemoryBudget("nope", 1).ok());
+
+    for (int64_t i = 0; i < 10; ++i)
+      assert(st.insertRow("t", makeRow(i, "short")).ok());
+    const size_t ten = usage(st.memoryUsage("t"));
+    assert(ten > 0 && ten % 10 == 0);
+    const size_t perRow = ten / 10;
+
+    // Long strings are charged; updates replace what they end
+    std::unordered_map<std::string, AssignmentValue> set;
+    AssignmentValue av;
+    av.kind = AssignmentValue::Kind::Constant;
+    av.constant = ValueFactory::createString(std::string(200, 'z'));
+    set.emplace("name", std::move(av));
+    auto upd = st.updateRows("t", set, idBelow(1));
+    assert(upd.hasValue() && upd.value() == 1);
+    const size_t grown = usage(st.memoryUsage("t"));
+    assert(grown >= ten + 200);
+    assert(st.deleteRows("t", idBelow(1)).hasValue());
+    assert(usage(st.memoryUsage("t")) == 9 * perRow);
+
+    // Room for two more rows, not three
+    assert(st.setMemoryBudget("t", 11 * perRow).ok());
+    assert(st.insertRow("t", makeRow(100, "short")).ok());
+    assert(st.insertRow("t", makeRow(101, "short")).ok());
+    Status full = st.insertRow("t", makeRow(102, "short"));
+    assert(full.code() == StatusCode::ResourceExhausted);
+    assert(full.message().find("'t'") != std::string::npos);
+    assert(usage(st.memoryUsage("t")) == 11 * perRow);
+    // Batches and growing updates are refused whole; deletes make room
+    assert(st.insertRows("t", {makeRow(103, "a")}).code() ==
+           StatusCode::ResourceExhausted);
+    upd = st.updateRows("t", set, idBelow(5));
+    assert(!upd.hasValue() &&
+           upd.status().code() == StatusCode::ResourceExhausted);
+    assert(st.deleteRows("t", idBelow(3)).hasValue());
+    assert(st.insertRow("t", makeRow(103, "short")).ok());
+    assert(st.truncateTable("t").ok());
+    assert(usage(st.memoryUsage("t")) == 0);
+    assert(st.setMemoryBudget("t", 0).ok());
+    assert(st.insertRow("t", makeRow(1, std::string(5000, 'q'))).ok());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: document collections..." << std::endl;
+  {
+    for (auto layout : {DocumentLayout::Map, DocumentLayout::Shaped}) {
+      InMemoryDocumentStorage ds(layout);
+      Document d;
+      d["n"] = ValueFactory::createInteger(1);
+      assert(ds.put("c", "a", d).ok());
+      const size_t one = usage(ds.memoryUsage("c"));
+      assert(one > 0);
+      assert(ds.put("c", "b", d).ok());
+      assert(usage(ds.memoryUsage("c")) == 2 * one);
+      // Replacing a document charges only the difference
+      Document big;
+      big["n"] = ValueFactory::createString(std::string(300, 'b'));
+      assert(ds.put("c", "b", big).ok());
+      const size_t withBig = usage(ds.memoryUsage("c"));
+      assert(withBig >= 2 * one + 300);
+      assert(ds.setMemoryBudget("c", withBig).ok());
+      assert(ds.put("c", "c", d).code() == StatusCode::ResourceExhausted);
+      assert(!ds.get("c", "c").hasValue());
+      assert(ds.put("c", "b", d).ok());
+      assert(ds.put("c", "c", d).ok());
+      assert(ds.erase("c", "a").ok());
+      assert(ds.erase("c", "b").ok());
+      assert(ds.erase("c", "c").ok());
+      assert(usage(ds.memoryUsage("c")) == 0);
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: graphs..." << std::endl;
+  {
+    InMemoryGraphStorage gs;
+    assert(gs.createGraph("g").ok());
+    Node a, b;
+    a.id = 1;
+    a.labels = {"Patient"};
+    a.properties["name"] = ValueFactory::createString("Ada");
+    b.id = 2;
+    assert(gs.putNode("g", a).ok() && gs.putNode("g", b).ok());
+    const size_t nodes = usage(gs.memoryUsage("g"));
+    Edge e;
+    e.id = 10;
+    e.from = 1;
+    e.to = 2;
+    e.type = "SEES";
+    assert(gs.putEdge("g", e).ok());
+    const size_t withEdge = usage(gs.memoryUsage("g"));
+    assert(withEdge > nodes);
+    assert(gs.setMemoryBudget("g", withEdge).ok());
+    Node c;
+    c.id = 3;
+    assert(gs.putNode("g", c).code() == StatusCode::ResourceExhausted);
+    // Erasing a node takes its edges with it
+    assert(gs.eraseNode("g", 2).ok());
+    assert(usage(gs.memoryUsage("g")) < nodes);
+    assert(gs.putNode("g", c).ok());
+    assert(gs.eraseNode("g", 1).ok() && gs.eraseNode("g", 3).ok());
+    assert(usage(gs.memoryUsage("g")) == 0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 5: time series..." << std::endl;
+  {
+    TimeSeriesSchema schema("ts", TimeGranularity::Seconds);
+    schema.addValueColumn(Column{"v", ColumnType::Float, false, false, {}});
+    auto sample = [](int64_t ts) {
+      Row r(2);
+      r.set(0, ValueFactory::createInteger(ts));
+      r.set(1, ValueFactory::createFloat(1.5));
+      return r;
+    };
+    InMemoryTimeSeriesStorage ts;
+    assert(ts.createSeries("s", schema, TimePartition::Hourly).ok());
+    assert(!ts.setMemoryBudget("nope", 1).ok());
+    assert(usage(ts.memoryUsage("s")) == 0);
+    // Six hours of a sample a minute; earlier hours are sealed
+    for (int64_t t = 0; t < 6 * 3600; t += 60)
+      assert(ts.append("s", sample(t)).ok());
+    const size_t six = usage(ts.memoryUsage("s"));
+    assert(six > 0);
+
+    assert(ts.setMemoryBudget("s", six).ok());
+    Status full = ts.append("s", sample(6 * 3600));
+    assert(full.code() == StatusCode::ResourceExhausted);
+    assert(usage(ts.memoryUsage("s")) == six);
+
+    // Evicting: the oldest hours go, the series keeps its newest rows
+    const size_t budget = six * 3 / 4;
+    assert(ts.setMemoryBudget("s", budget, BudgetPolicy::EvictOldest).ok());
+    assert(usage(ts.memoryUsage("s")) <= budget);
+    auto left = ts.rangeQuery("s", {}, 0, INT64_MAX, std::nullopt);
+    assert(left.hasValue() && left.value().rowCount() < 6 * 60);
+    assert(left.value().at(0, 0).asInt() % 3600 == 0);
+    for (int64_t t = 6 * 3600; t < 12 * 3600; t += 60)
+      assert(ts.append("s", sample(t)).ok());
+    assert(usage(ts.memoryUsage("s")) <= budget);
+    left = ts.rangeQuery("s", {}, 11 * 3600, INT64_MAX, std::nullopt);
+    assert(left.hasValue() && left.value().rowCount() == 60);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "All memory budget tests passed." << std::endl;
+  return 0;
+}
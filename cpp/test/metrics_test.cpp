@@ -0,0 +1,233 @@
+#include "kadedb/metrics.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::metrics;
+
+static OperationMetrics metricsOf(Operation op) {
+  return snapshot()[static_cast<size_t>(op)];
+}
+
+// Always contended: try_lock fails and lock() blocks for 10 ms
+struct SlowMutex {
+  bool try_lock() { return false; }
+  void lock() { std::this_thread::sleep_for(std::chrono::milliseconds(10)); }
+  void unlock() {}
+};
+
+static TableSchema makeSchema() {
+  Column id;
+  id.name = "id";
+  id.type = ColumnType::Integer;
+  id.nullable = false;
+  id.unique = true;
+  return TableSchema({id}, std::optional<std::string>("id"));
+}
+
+static Row makeRow(int64_t id) {
+  Row r(1);
+  r.set(0, ValueFactory::createInteger(id));
+  return r;
+}
+
+int main() {
+  std::cout << "=== Metrics Tests ===" << std::endl;
+
+  std::cout << "Test 1: latency buckets..." << std::endl;
+  {
+    // Small values are exact, large ones within 1/16
+    for (uint64_t v = 0; v < 32; ++v)
+      assert(LatencyBuckets::highestIn(LatencyBuckets::bucketOf(v)) == v);
+    size_t last = 0;
+    for (uint64_t v : {uint64_t{33}, uint64_t{1000}, uint64_t{123456789},
+                       uint64_t{1} << 40, ~uint64_t{0}}) {
+      const size_t b = LatencyBuckets::bucketOf(v);
+      assert(b > last && b < LatencyBuckets::kCount);
+      last = b;
+      const uint64_t hi = LatencyBuckets::highestIn(b);
+      assert(hi >= v && hi - v <= v / 16);
+      assert(LatencyBuckets::bucketOf(hi) == b);
+      if (hi != ~uint64_t{0})
+        assert(LatencyBuckets::bucketOf(hi + 1) == b + 1);
+    }
+    assert(LatencyBuckets::bucketOf(~uint64_t{0}) ==
+           LatencyBuckets::kCount - 1);
+
+    // The benchmarks' finer buckets: within 1/64, in 3776 buckets
+    using Fine = LogBuckets<7>;
+    static_assert(Fine::kCount == 3776, "bucket count");
+    for (uint64_t v : {uint64_t{127}, uint64_t{128}, uint64_t{1000},
+                       uint64_t{123456789}, ~uint64_t{0}}) {
+      const uint64_t hi = Fine::highestIn(Fine::bucketOf(v));
+      assert(hi >= v && hi - v <= v / 64);
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: storage operations..." << std::endl;
+  {
+    reset();
+    InMemoryRelationalStorage rs;
+    assert(rs.createTable("t", makeSchema()).ok());
+    for (int64_t i = 0; i < 50; ++i)
+      assert(rs.insertRow("t", makeRow(i)).ok());
+    assert(!rs.insertRow("t", makeRow(0)).ok());
+    assert(!rs.insertRow("missing", makeRow(0)).ok());
+    Predicate p;
+    p.kind = Predicate::Kind::Comparison;
+    p.column = "id";
+    p.op = Predicate::Op::Lt;
+    p.rhs = ValueFactory::createInteger(5);
+    auto sel = rs.select("t", {}, std::move(p));
+    assert(sel.hasValue() && sel.value().rowCount() == 5);
+
+    const OperationMetrics ins = metricsOf(Operation::RelationalInsert);
+    assert(ins.calls == 52 && ins.errors == 2 && ins.rowsReturned == 50);
+    assert(ins.latency.count() == 52 && ins.latency.sumNs() > 0);
+    assert(ins.latency.percentileNs(50) <= ins.latency.percentileNs(99));
+    assert(ins.latency.percentileNs(99) <= ins.latency.maxNs());
+    assert(ins.bytesAllocated > 0);
+    const OperationMetrics selm = metricsOf(Operation::RelationalSelect);
+    assert(selm.calls == 1 && selm.errors == 0);
+    assert(selm.rowsReturned == 5 && selm.rowsScanned >= 5);
+
+    InMemoryDocumentStorage ds;
+    Document d;
+    d["id"] = ValueFactory::createInteger(1);
+    assert(ds.put("c", "k", d).ok());
+    assert(ds.get("c", "k").hasValue());
+    assert(!ds.get("c", "nope").hasValue());
+    assert(metricsOf(Operation::DocumentPut).calls == 1);
+    const OperationMetrics get = metricsOf(Operation::DocumentGet);
+    assert(get.calls == 2 && get.errors == 1 && get.rowsReturned == 1);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: nested scopes and disabling..." << std::endl;
+  {
+    reset();
+    {
+      OperationScope outer(Operation::KadeqlExecute);
+      {
+        OperationScope inner(Operation::GraphRead);
+        OperationScope::addRows(3, 2);
+        inner.fail();
+      }
+      OperationScope::addRows(7, 1);
+    }
+    // Helpers outside any scope are ignored
+    OperationScope::addRows(100, 100);
+    const OperationMetrics inner = metricsOf(Operation::GraphRead);
+    const OperationMetrics outer = metricsOf(Operation::KadeqlExecute);
+    assert(inner.calls == 1 && inner.errors == 1);
+    assert(inner.rowsScanned == 3 && inner.rowsReturned == 2);
+    assert(outer.calls == 1 && outer.errors == 0);
+    // Rows scanned add up through the scopes; rows returned do not
+    assert(outer.rowsScanned == 10 && outer.rowsReturned == 1);
+    assert(outer.latency.sumNs() >= inner.latency.sumNs());
+
+    setEnabled(false);
+    assert(!enabled());
+    { OperationScope s(Operation::GraphRead); }
+    setEnabled(true);
+    assert(metricsOf(Operation::GraphRead).calls == 1);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: threads and lock waits..." << std::endl;
+  {
+    reset();
+    // Counts of threads that have exited are kept
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+      threads.emplace_back([] {
+        for (int i = 0; i < 1000; ++i)
+          OperationScope s(Operation::TimeSeriesAppend);
+      });
+    for (auto &th : threads)
+      th.join();
+    assert(metricsOf(Operation::TimeSeriesAppend).calls == 4000);
+
+    // A blocked TimedLock charges its wait to the open scope
+    {
+      OperationScope s(Operation::GraphWrite);
+      SlowMutex m;
+      TimedLock<SlowMutex> lk(m);
+    }
+    assert(metricsOf(Operation::GraphWrite).lockWaitNs >= 10'000'000);
+
+    reset();
+    assert(metricsOf(Operation::TimeSeriesAppend).calls == 0);
+    assert(metricsOf(Operation::GraphWrite).lockWaitNs == 0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 5: Prometheus text..." << std::endl;
+  {
+    reset();
+    { OperationScope s(Operation::DocumentQuery); }
+    const std::string text = toPrometheus();
+    assert(text.find("# TYPE kadedb_operations_total counter\n") !=
+           std::string::npos);
+    assert(text.find("kadedb_operations_total{storage=\"document\","
+                     "operation=\"query\"} 1\n") != std::string::npos);
+    assert(text.find("kadedb_operation_duration_seconds{storage=\"document\","
+                     "operation=\"query\",quantile=\"0.99\"} ") !=
+           std::string::npos);
+    assert(text.find("kadedb_operation_duration_seconds_count{storage="
+                     "\"graph\",operation=\"read\"} 0\n") !=
+           std::string::npos);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 6: lock sites..." << std::endl;
+  {
+    reset();
+    InMemoryRelationalStorage rs;
+    assert(rs.createTable("t", makeSchema()).ok());
+    for (int64_t i = 0; i < 10; ++i)
+      assert(rs.insertRow("t", makeRow(i)).ok());
+    ProfiledMutex<std::shared_mutex> m(LockSite::GraphData);
+    {
+      std::lock_guard lk(m);
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    { std::shared_lock lk(m); }
+
+    const std::vector<LockSiteMetrics> sites = lockSnapshot();
+    const std::string text = toPrometheus();
+    if (!kLockProfiling) {
+      assert(sites.empty());
+      assert(text.find("kadedb_lock_site_") == std::string::npos);
+    } else {
+      assert(sites.size() == kLockSiteCount);
+      const auto &write =
+          sites[static_cast<size_t>(LockSite::RelationalTableWrite)];
+      assert(write.acquisitions >= 10 && write.sharedAcquisitions == 0);
+      const auto &graph = sites[static_cast<size_t>(LockSite::GraphData)];
+      assert(graph.acquisitions == 2 && graph.sharedAcquisitions == 1);
+      assert(graph.contended == 0 && graph.waitNs == 0);
+      assert(graph.holdNs >= 5'000'000 && graph.maxHoldNs >= 5'000'000);
+      assert(text.find("kadedb_lock_site_acquisitions_total{site="
+                       "\"graph_data\"} 2\n") != std::string::npos);
+      reset();
+      assert(lockSnapshot()[static_cast<size_t>(LockSite::GraphData)]
+                 .acquisitions == 0);
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "All metrics tests passed." << std::endl;
+  return 0;
+}
@@ -0,0 +1,145 @@
+#include "kadedb/columnar_storage.h"
+#include "kadedb/graph/storage.h"
+#include "kadedb/page_allocator.h"
+#include "kadedb/predicate_builder.h"
+#include "kadedb/thread_pool.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+using namespace kadedb;
+
+int main() {
+  std::cout << "=== Page Allocator Tests ===" << std::endl;
+
+  std::cout << "Test 1: large blocks are mapped and aligned..." << std::endl;
+  {
+    const size_t before = memory::mappedBytes();
+    void *small = memory::allocatePages(4096);
+    assert(memory::mappedBytes() == before);
+    memory::releasePages(small, 4096);
+
+    const size_t bytes = memory::kPageBlockBytes * 3 + 100;
+    char *big = static_cast<char *>(memory::allocatePages(bytes));
+    assert(reinterpret_cast<uintptr_t>(big) % memory::kPageBlockBytes == 0);
+    assert(memory::mappedBytes() == before + 4 * memory::kPageBlockBytes);
+    std::memset(big, 0x5a, bytes);
+    assert(big[bytes - 1] == 0x5a);
+    memory::releasePages(big, bytes);
+    assert(memory::mappedBytes() == before);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: every policy gives usable storage..." << std::endl;
+  {
+    const PagePolicy saved = memory::pagePolicy();
+    for (HugePages huge :
+         {HugePages::Off, HugePages::Transparent, HugePages::Explicit}) {
+      for (NumaPlacement placement :
+           {NumaPlacement::FirstTouch, NumaPlacement::Interleave}) {
+        PagePolicy policy;
+        policy.hugePages = huge;
+        policy.placement = placement;
+        memory::setPagePolicy(policy);
+        assert(memory::pagePolicy().hugePages == huge);
+        assert(memory::pagePolicy().placement == placement);
+
+        // Growth moves a vector between heap blocks and mappings
+        PageVector<int64_t> v;
+        for (int64_t i = 0; i < 1000000; ++i)
+          v.push_back(i * 3);
+        assert(memory::mappedBytes() >= v.capacity() * sizeof(int64_t));
+        assert(memory::hugePageBytes() <= memory::mappedBytes());
+        for (int64_t i = 0; i < 1000000; i += 997)
+          assert(v[static_cast<size_t>(i)] == i * 3);
+        PageVector<int64_t> copy = v;
+        v.clear();
+        v.shrink_to_fit();
+        assert(copy.back() == 999999 * 3);
+      }
+    }
+    memory::setPagePolicy(saved);
+    assert(memory::hugePageBytes() == 0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: topology and the node shares of parallelFor..."
+            << std::endl;
+  {
+    const size_t nodes = memory::numaNodes();
+    assert(nodes >= 1);
+    assert(memory::currentNumaNode() < nodes);
+    size_t cpus = 0;
+    for (size_t n = 0; n < nodes; ++n)
+      cpus += memory::numaCpus(n).size();
+    assert(cpus >= 1);
+    assert(memory::numaCpus(nodes).empty());
+    assert(!memory::bindThreadToNode(nodes));
+
+    // Every morsel runs exactly once whatever the split
+    for (size_t n : {1, 7, 1000, 100003}) {
+      std::vector<std::atomic<int>> hits(n);
+      ThreadPool::shared().parallelFor(n, 64, 0,
+                                       [&](size_t, size_t lo, size_t hi) {
+                                         for (size_t i = lo; i < hi; ++i)
+                                           hits[i].fetch_add(1);
+                                       });
+      for (auto &h : hits)
+        assert(h.load() == 1);
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: storage arrays follow the policy..." << std::endl;
+  {
+    const size_t before = memory::mappedBytes();
+    {
+      ColumnarRelationalStorage st;
+      TableSchema schema({Column{"id", ColumnType::Integer, false, false, {}},
+                          Column{"x", ColumnType::Float, true, false, {}}});
+      assert(st.createTable("t", schema).ok());
+      for (int64_t i = 0; i < 400000; ++i) {
+        Row r(2);
+        r.set(0, ValueFactory::createInteger(i));
+        if (i % 5)
+          r.set(1, ValueFactory::createFloat(static_cast<double>(i) / 2));
+        assert(st.insertRow("t", r).ok());
+      }
+      assert(memory::mappedBytes() > before);
+      std::optional<Predicate> where;
+      where.emplace(cmp("x", Predicate::Op::Gt,
+                        ValueFactory::createFloat(199990.0)));
+      auto rs = st.select("t", {"id"}, where);
+      assert(rs.hasValue() && rs.value().rowCount() == 16);
+
+      InMemoryGraphStorage gs;
+      assert(gs.createGraph("g").ok());
+      std::vector<Node> nodes(200000);
+      std::vector<Edge> edges(400000);
+      for (size_t i = 0; i < nodes.size(); ++i)
+        nodes[i].id = static_cast<NodeId>(i);
+      for (size_t e = 0; e < edges.size(); ++e) {
+        edges[e].id = static_cast<EdgeId>(e);
+        edges[e].from = static_cast<NodeId>(e % nodes.size());
+        edges[e].to = static_cast<NodeId>((e * 31 + 1) % nodes.size());
+      }
+      assert(gs.putNodes("g", nodes).ok());
+      const size_t rows = memory::mappedBytes();
+      assert(gs.putEdges("g", edges).ok());
+      assert(gs.snapshot("g").value()->edgeCount() == edges.size());
+      assert(memory::mappedBytes() > rows);
+      assert(gs.parallelBfs("g", 0, 10).value().size() == 10);
+    }
+    // Dropping the storages unmaps their arrays
+    assert(memory::mappedBytes() == before);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll page allocator tests passed!" << std::endl;
+  return 0;
+}
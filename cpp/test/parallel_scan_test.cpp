@@ -0,0 +1,270 @@
+#include "kadedb/predicate_builder.h"
+#include "kadedb/storage.h"
+#include "kadedb/thread_pool.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/value.h"
+
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace kadedb;
+
+using Op = Predicate::Op;
+
+static std::optional<Predicate> where(Predicate p) {
+  std::optional<Predicate> w;
+  w.emplace(std::move(p));
+  return w;
+}
+
+// One line per row, cells separated by '|'
+static std::string flatten(const ResultSet &rs) {
+  std::string out;
+  for (const auto &row : rs) {
+    for (const auto &cell : row.values())
+      out += (cell ? cell->toString() : "null") + "|";
+    out += "\n";
+  }
+  return out;
+}
+
+static void testThreadPool() {
+  std::cout << "Test 1: morsels run once each on the shared pool"
+            << std::endl;
+  ThreadPool &pool = ThreadPool::shared();
+  for (size_t n : {size_t{0}, size_t{1}, size_t{999}, size_t{100000}}) {
+    std::vector<std::atomic<int>> seen(n);
+    pool.parallelFor(n, 1000, 4, [&](size_t m, size_t lo, size_t hi) {
+      assert(lo == m * 1000 && hi <= n && lo < hi);
+      for (size_t i = lo; i < hi; ++i)
+        seen[i].fetch_add(1);
+    });
+    for (const auto &s : seen)
+      assert(s.load() == 1);
+  }
+  assert(pool.workers() >= 3);
+
+  // Nested and concurrent calls finish even with every worker busy
+  std::atomic<size_t> total{0};
+  std::vector<std::thread> callers;
+  for (int t = 0; t < 4; ++t)
+    callers.emplace_back([&] {
+      pool.parallelFor(16, 1, 0, [&](size_t, size_t, size_t) {
+        pool.parallelFor(100, 10, 8, [&](size_t, size_t lo, size_t hi) {
+          total.fetch_add(hi - lo);
+        });
+      });
+    });
+  for (auto &th : callers)
+    th.join();
+  assert(total.load() == 4 * 16 * 100);
+
+  // A private pool joins its workers on destruction
+  {
+    ThreadPool own;
+    std::atomic<size_t> sum{0};
+    own.parallelFor(10, 1, 3, [&](size_t m, size_t, size_t) { sum += m; });
+    assert(sum.load() == 45 && own.workers() == 2);
+  }
+  assert(ThreadPool::resolve(3) == 3 && ThreadPool::resolve(0) >= 1);
+  std::cout << "  PASSED" << std::endl;
+}
+
+static void testRelational() {
+  std::cout << "Test 2: parallel table scans match serial ones" << std::endl;
+  std::vector<Column> cols{
+      Column{"id", ColumnType::Integer, false, true, {}},
+      Column{"ward", ColumnType::String, true, false, {}},
+      Column{"score", ColumnType::Float, true, false, {}},
+  };
+  InMemoryRelationalStorage rel;
+  assert(rel.createTable("t", TableSchema(cols, std::string("id"))).ok());
+  std::vector<Row> rows;
+  const int64_t kRows = 4 * ThreadPool::kMorselRows + 123;
+  for (int64_t i = 0; i < kRows; ++i) {
+    Row r(3);
+    r.set(0, ValueFactory::createInteger(i));
+    if (i % 11)
+      r.set(1, ValueFactory::createString("ward-" + std::to_string(i % 7)));
+    r.set(2, ValueFactory::createFloat(static_cast<double>(i % 1000)));
+    rows.push_back(std::move(r));
+  }
+  assert(rel.insertRows("t", rows).ok());
+  // Dead versions in the first morsel, new ones at the end
+  std::unordered_map<std::string, std::unique_ptr<Value>> set;
+  set["score"] = ValueFactory::createFloat(-1);
+  assert(rel.updateRows("t", set,
+                        where(cmp("id", Op::Lt,
+                                  ValueFactory::createInteger(5000))))
+             .ok());
+
+  std::vector<std::optional<Predicate>> preds;
+  preds.push_back(std::nullopt);
+  preds.push_back(where(cmp("score", Op::Ge, ValueFactory::createFloat(900))));
+  preds.push_back(
+      where(cmp("ward", Op::Eq, ValueFactory::createString("ward-3"))));
+  // Index candidates on the primary key
+  preds.push_back(where(cmp("id", Op::Gt, ValueFactory::createInteger(1000))));
+  for (const auto &p : preds) {
+    rel.setScanThreads(1);
+    const std::string serial =
+        flatten(rel.select("t", {"id", "score"}, p).takeValue());
+    std::vector<size_t> serialBatches;
+    assert(rel.scan("t", {}, p,
+                    [&](const RowBatch &b) {
+                      serialBatches.push_back(b.rows.size());
+                      return true;
+                    },
+                    10000)
+               .ok());
+
+    for (size_t threads : {size_t{4}, size_t{0}}) {
+      rel.setScanThreads(threads);
+      assert(rel.scanThreads() == threads);
+      assert(flatten(rel.select("t", {"id", "score"}, p).takeValue()) ==
+             serial);
+      // Same batches, and the rows arrive in the same order
+      std::vector<std::unique_ptr<Value>> ids;
+      std::vector<size_t> batches;
+      assert(rel.scan("t", {"id", "score"}, p,
+                      [&](const RowBatch &b) {
+                        assert(b.columnNames.size() == 2);
+                        batches.push_back(b.rows.size());
+                        for (const auto &r : b.rows)
+                          ids.push_back(r[0]->clone());
+                        return true;
+                      },
+                      10000)
+                 .ok());
+      assert(batches == serialBatches);
+      ResultSet again(std::vector<std::string>{"id"},
+                      std::vector<ColumnType>{ColumnType::Integer});
+      for (auto &id : ids) {
+        std::vector<std::unique_ptr<Value>> cells;
+        cells.push_back(std::move(id));
+        again.addRow(ResultRow(std::move(cells)));
+      }
+      auto serialIds = rel.select("t", {"id"}, p).takeValue();
+      assert(flatten(again) == flatten(serialIds));
+    }
+  }
+
+  // A sink that stops early sees no more batches
+  rel.setScanThreads(4);
+  size_t seen = 0;
+  assert(rel.scan("t", {"id"}, std::nullopt,
+                  [&](const RowBatch &) { return ++seen < 3; }, 1000)
+             .ok());
+  assert(seen == 3);
+  // An empty result still delivers the metadata once
+  seen = 0;
+  assert(
+      rel.scan("t", {"id"},
+               where(cmp("score", Op::Gt, ValueFactory::createFloat(5000))),
+               [&](const RowBatch &b) {
+                 assert(b.rows.empty() && b.columnNames.size() == 1);
+                 return ++seen > 0;
+               },
+               1000)
+          .ok());
+  assert(seen == 1);
+  std::cout << "  PASSED" << std::endl;
+}
+
+static void testDocuments() {
+  std::cout << "Test 3: parallel document queries keep the serial order"
+            << std::endl;
+  InMemoryDocumentStorage ds(DocumentLayout::Shaped);
+  assert(ds.createCollection("c", std::nullopt).ok());
+  for (int i = 0; i < 20000; ++i) {
+    Document d;
+    d["n"] = ValueFactory::createInteger(i);
+    d["ward"] = ValueFactory::createString("ward-" + std::to_string(i % 5));
+    assert(ds.put("c", "k" + std::to_string(i), d).ok());
+  }
+  auto flat = [](const std::vector<std::pair<std::string, Document>> &docs) {
+    std::string out;
+    for (const auto &kv : docs) {
+      out += kv.first;
+      for (const auto &f : kv.second)
+        out += ";" + f.first + "=" + (f.second ? f.second->toString() : "");
+      out += "\n";
+    }
+    return out;
+  };
+  std::vector<std::optional<DocPredicate>> preds;
+  preds.push_back(std::nullopt);
+  preds.emplace_back(
+      dcmp("ward", DocPredicate::Op::Eq, ValueFactory::createString("ward-2")));
+  for (const auto &p : preds) {
+    ds.setScanThreads(1);
+    const std::string serial = flat(ds.query("c", {"n"}, p).takeValue());
+    ds.setScanThreads(4);
+    assert(flat(ds.query("c", {"n"}, p).takeValue()) == serial);
+  }
+  ds.setScanThreads(4);
+  assert(ds.query("missing", {}, std::nullopt).status().code() ==
+         StatusCode::NotFound);
+  std::cout << "  PASSED" << std::endl;
+}
+
+static void testTimeSeries() {
+  std::cout << "Test 4: time partitions are read in parallel" << std::endl;
+  TimeSeriesSchema schema("timestamp", TimeGranularity::Seconds);
+  schema.addTagColumn(Column{"bed", ColumnType::String, true, false, {}});
+  schema.addValueColumn(Column{"hr", ColumnType::Float, true, false, {}});
+  InMemoryTimeSeriesStorage ts;
+  assert(ts.createSeries("v", schema, TimePartition::Hourly).ok());
+  std::vector<Row> rows;
+  for (int64_t t = 0; t < 12 * 3600; t += 3) {
+    Row r(3);
+    r.set(0, ValueFactory::createInteger(t));
+    r.set(1, ValueFactory::createString("bed-" + std::to_string(t % 4)));
+    r.set(2, ValueFactory::createFloat(60 + static_cast<double>(t % 50)));
+    rows.push_back(std::move(r));
+  }
+  assert(ts.appendBatch("v", rows).ok());
+
+  std::vector<std::optional<Predicate>> preds;
+  preds.push_back(std::nullopt);
+  preds.push_back(
+      where(cmp("bed", Op::Eq, ValueFactory::createString("bed-1"))));
+  for (const auto &p : preds) {
+    ts.setScanThreads(1);
+    const std::string serial =
+        flatten(ts.rangeQuery("v", {}, 1000, 40000, p).takeValue());
+    auto serialAgg = ts.aggregate("v", "hr", TimeAggregation::Avg, 1000,
+                                  40000, 1800, TimeGranularity::Seconds, p)
+                         .takeValue();
+    ts.setScanThreads(4);
+    assert(flatten(ts.rangeQuery("v", {}, 1000, 40000, p).takeValue()) ==
+           serial);
+    auto agg = ts.aggregate("v", "hr", TimeAggregation::Avg, 1000, 40000,
+                            1800, TimeGranularity::Seconds, p)
+                   .takeValue();
+    assert(agg.rowCount() == serialAgg.rowCount() && agg.rowCount() > 10);
+    for (size_t r = 0; r < agg.rowCount(); ++r) {
+      assert(agg.at(r, 0).toString() == serialAgg.at(r, 0).toString());
+      const double a = agg.at(r, 1).asFloat();
+      const double b = serialAgg.at(r, 1).asFloat();
+      assert(std::fabs(a - b) < 1e-9 * std::fabs(b));
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+}
+
+int main() {
+  testThreadPool();
+  testRelational();
+  testDocuments();
+  testTimeSeries();
+  std::cout << "All parallel scan tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,312 @@
+#include "kadedb/kadeql.h"
+#include "kadedb/predicate_builder.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+
+using Op = Predicate::Op;
+
+// vitals(id PK, ward, hr)
+static TableSchema vitalsSchema() {
+  return TableSchema({Column{"id", ColumnType::Integer, false, false, {}},
+                      Column{"ward", ColumnType::String, true, false, {}},
+                      Column{"hr", ColumnType::Integer, true, false, {}}},
+                     "id");
+}
+
+static Row vitalsRow(int64_t id) {
+  Row r(3);
+  r.set(0, ValueFactory::createInteger(id));
+  r.set(1, ValueFactory::createString("w" + std::to_string(id % 7)));
+  r.set(2, ValueFactory::createInteger(60 + id % 50));
+  return r;
+}
+
+// Rows of `rs` as sorted strings, to compare regardless of order
+static std::vector<std::string> rowsOf(const ResultSet &rs) {
+  std::vector<std::string> out;
+  for (const auto &row : rs.toStringMatrix()) {
+    std::string s;
+    for (const auto &cell : row)
+      s += cell + "|";
+    out.push_back(std::move(s));
+  }
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+static size_t count(RelationalStorage &st, const std::string &table,
+                    const std::optional<Predicate> &where = std::nullopt) {
+  auto rs = st.select(table, {}, where);
+  assert(rs.hasValue());
+  return rs.value().rowCount();
+}
+
+static ResultSet run(QueryExecutor &exec, const std::string &q) {
+  auto res = exec.execute(*parseQuery(q));
+  assert(res.hasValue());
+  return res.takeValue();
+}
+
+int main() {
+  std::cout << "=== Partitioned Table Tests ===" << std::endl;
+
+  std::cout << "Test 1: creation and concurrent routed inserts..."
+            << std::endl;
+  {
+    InMemoryRelationalStorage st;
+    TableSchema noKey({Column{"a", ColumnType::Integer, true, false, {}}});
+    assert(st.createPartitionedTable("t", noKey, 4).code() ==
+           StatusCode::InvalidArgument);
+    TableSchema otherUnique = vitalsSchema();
+    Column ward;
+    assert(otherUnique.getColumn("ward", ward));
+    ward.unique = true;
+    otherUnique.updateColumn(ward);
+    assert(st.createPartitionedTable("t", otherUnique, 4).code() ==
+           StatusCode::InvalidArgument);
+
+    assert(st.createPartitionedTable("vitals", vitalsSchema(), 4).ok());
+    assert(st.createPartitionedTable("vitals", vitalsSchema(), 4).code() ==
+           StatusCode::AlreadyExists);
+    assert(st.createTable("vitals", vitalsSchema()).code() ==
+           StatusCode::AlreadyExists);
+    assert(st.partitionCount("vitals") == 4u);
+    assert(!st.partitionCount("missing"));
+    assert(st.listTables() == std::vector<std::string>{"vitals"});
+    // The key is unique and non-null
+    auto schema = st.getTableSchema("vitals");
+    assert(schema.hasValue());
+    assert(schema.value().columns()[0].unique);
+    assert(!schema.value().columns()[0].nullable);
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 8; ++t)
+      writers.emplace_back([&st, t] {
+        for (int64_t i = t; i < 4000; i += 8)
+          assert(st.insertRow("vitals", vitalsRow(i)).ok());
+      });
+    for (auto &w : writers)
+      w.join();
+    assert(count(st, "vitals") == 4000);
+    assert(st.estimateRowCount("vitals") == 4000u);
+    assert(st.getTableStatistics("vitals")->rowCount == 4000);
+
+    // Duplicate keys meet in one partition
+    assert(st.insertRow("vitals", vitalsRow(17)).code() ==
+           StatusCode::FailedPrecondition);
+    Row nullKey = vitalsRow(5000);
+    nullKey.set(0, nullptr);
+    assert(st.insertRow("vitals", nullKey).code() ==
+           StatusCode::InvalidArgument);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: reads match an unpartitioned table..." << std::endl;
+  InMemoryRelationalStorage st;
+  assert(st.createPartitionedTable("vitals", vitalsSchema(), 4).ok());
+  assert(st.createTable("flat", vitalsSchema()).ok());
+  {
+    std::vector<Row> rows;
+    for (int64_t i = 0; i < 3000; ++i)
+      rows.push_back(vitalsRow(i));
+    assert(st.insertRows("vitals", rows).ok());
+    assert(st.insertRows("flat", rows).ok());
+    assert(st.createIndex("vitals", "ward", IndexType::Hash).ok());
+    assert(st.createIndex("flat", "ward", IndexType::Hash).ok());
+
+    auto same = [&](const std::optional<Predicate> &where) {
+      auto a = st.select("vitals", {"id", "hr"}, where);
+      auto b = st.select("flat", {"id", "hr"}, where);
+      assert(a.hasValue() && b.hasValue());
+      assert(a.value().columnNames() == b.value().columnNames());
+      assert(rowsOf(a.value()) == rowsOf(b.value()));
+      return a.value().rowCount();
+    };
+    assert(same(std::nullopt) == 3000);
+    assert(same(cmp("id", Op::Eq, ValueFactory::createInteger(42))) == 1);
+    assert(same(cmp("hr", Op::Ge, ValueFactory::createInteger(105))) == 300);
+    assert(same(cmp("ward", Op::Eq, ValueFactory::createString("w3"))) ==
+           429);
+    // A float equal to a key does not pin a partition, but still matches
+    assert(same(cmp("id", Op::Eq, ValueFactory::createFloat(42.0))) == 1);
+
+    // Point reads go to one partition; the rest fan out
+    const std::string point =
+        st.explainAccess("vitals", cmp("id", Op::Eq,
+                                       ValueFactory::createInteger(42)));
+    assert(point.rfind("partition ", 0) == 0);
+    assert(point.find(" of 4, index on id = 42") != std::string::npos);
+    assert(st.explainAccess("vitals", std::nullopt) ==
+           "4 partitions in parallel, each full scan");
+    assert(st.estimateScanCost(
+               "vitals", cmp("id", Op::Eq, ValueFactory::createInteger(42))) ==
+           1u);
+
+    // Streaming scans deliver every row once, and stop when asked
+    size_t scanned = 0, batches = 0;
+    assert(st.scan("vitals", {"id"}, std::nullopt,
+                   [&](RowBatch &b) {
+                     scanned += b.rows.size();
+                     ++batches;
+                     return true;
+                   },
+                   500)
+               .ok());
+    assert(scanned == 3000 && batches >= 6);
+    batches = 0;
+    assert(st.scan("vitals", {"id"}, std::nullopt,
+                   [&](RowBatch &) { return ++batches < 2; }, 500)
+               .ok());
+    assert(batches == 2);
+    // An empty result still reports its columns
+    bool called = false;
+    assert(st.scan("vitals", {"hr"},
+                   cmp("hr", Op::Gt, ValueFactory::createInteger(1000)),
+                   [&](RowBatch &b) {
+                     called = true;
+                     assert(b.rows.empty());
+                     assert(b.columnNames == std::vector<std::string>{"hr"});
+                     return true;
+                   },
+                   500)
+               .ok());
+    assert(called);
+
+    // Views borrow one partition's store
+    auto view = st.selectView(
+        "vitals", {"hr"}, cmp("id", Op::Eq, ValueFactory::createInteger(7)));
+    assert(view.hasValue() && view.value().rowCount() == 1);
+    assert(st.selectView("vitals", {"hr"}).status().code() ==
+           StatusCode::FailedPrecondition);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: writes across partitions..." << std::endl;
+  {
+    const auto before = st.tableVersion("vitals");
+    // A conflict in one partition undoes the rows of the others
+    std::vector<Row> batch;
+    for (int64_t i = 5000; i < 5100; ++i)
+      batch.push_back(vitalsRow(i));
+    batch.push_back(vitalsRow(10));
+    assert(st.insertRows("vitals", batch).code() ==
+           StatusCode::FailedPrecondition);
+    assert(count(st, "vitals") == 3000);
+    assert(count(st, "vitals",
+                  cmp("id", Op::Ge, ValueFactory::createInteger(5000))) == 0);
+    batch.pop_back();
+    assert(st.insertRows("vitals", batch).ok());
+    assert(count(st, "vitals") == 3100);
+    assert(st.tableVersion("vitals") != before);
+
+    std::unordered_map<std::string, AssignmentValue> set;
+    AssignmentValue hr;
+    hr.constant = ValueFactory::createInteger(0);
+    set.emplace("hr", std::move(hr));
+    auto updated = st.updateRows(
+        "vitals", set, cmp("ward", Op::Eq, ValueFactory::createString("w1")));
+    assert(updated.hasValue() && updated.value() == 443);
+    assert(count(st, "vitals",
+                  cmp("hr", Op::Eq, ValueFactory::createInteger(0))) == 443);
+
+    std::unordered_map<std::string, AssignmentValue> setKey;
+    AssignmentValue id;
+    id.constant = ValueFactory::createInteger(-1);
+    setKey.emplace("id", std::move(id));
+    assert(st.updateRows("vitals", setKey, std::nullopt).status().code() ==
+           StatusCode::InvalidArgument);
+    auto moved = st.updateRowsWith(
+        "vitals",
+        [](Row &row, const TableSchema &) {
+          row.set(0, ValueFactory::createInteger(row.at(0).asInt() + 1));
+          return Status::OK();
+        },
+        cmp("id", Op::Eq, ValueFactory::createInteger(3)));
+    assert(moved.status().code() == StatusCode::InvalidArgument);
+
+    size_t visited = 0;
+    auto bumped = st.updateRowsWith(
+        "vitals",
+        [&](Row &row, const TableSchema &) {
+          ++visited; // partitions are updated one at a time
+          row.set(2, ValueFactory::createInteger(1));
+          return Status::OK();
+        },
+        cmp("id", Op::Lt, ValueFactory::createInteger(100)));
+    assert(bumped.hasValue() && bumped.value() == 100 && visited == 100);
+
+    auto deleted = st.deleteRows(
+        "vitals", cmp("id", Op::Ge, ValueFactory::createInteger(5000)));
+    assert(deleted.hasValue() && deleted.value() == 100);
+    auto one = st.deleteRows("vitals",
+                             cmp("id", Op::Eq, ValueFactory::createInteger(9)));
+    assert(one.hasValue() && one.value() == 1);
+    assert(count(st, "vitals") == 2999);
+    assert(st.memoryUsage("vitals").value() > 0);
+    assert(st.collectGarbage() > 0);
+    assert(count(st, "vitals") == 2999);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: KadeQL over partitioned tables..." << std::endl;
+  {
+    assert(st.deleteRows("flat", cmp("id", Op::Eq,
+                                      ValueFactory::createInteger(9)))
+               .hasValue());
+    std::unordered_map<std::string, AssignmentValue> set;
+    AssignmentValue hr;
+    hr.constant = ValueFactory::createInteger(0);
+    set.emplace("hr", std::move(hr));
+    assert(st.updateRows("flat", set,
+                         cmp("ward", Op::Eq, ValueFactory::createString("w1")))
+               .hasValue());
+    AssignmentValue one;
+    one.constant = ValueFactory::createInteger(1);
+    std::unordered_map<std::string, AssignmentValue> setOne;
+    setOne.emplace("hr", std::move(one));
+    assert(st.updateRows("flat", setOne,
+                         cmp("id", Op::Lt, ValueFactory::createInteger(100)))
+               .hasValue());
+
+    QueryExecutor exec(st);
+    for (const char *q :
+         {"SELECT ward, COUNT(*) AS n, SUM(hr) AS s FROM %s GROUP BY ward",
+          "SELECT id, hr FROM %s WHERE id = 1234",
+          "SELECT id FROM %s WHERE hr > 100 AND ward = 'w2'",
+          "SELECT a.id, b.hr FROM %s a JOIN flat b ON a.id = b.id WHERE "
+          "a.hr > 105"}) {
+      std::string text = q;
+      const size_t at = text.find("%s");
+      std::string onParts = text, onFlat = text;
+      onParts.replace(at, 2, "vitals");
+      onFlat.replace(at, 2, "flat");
+      assert(rowsOf(run(exec, onParts)) == rowsOf(run(exec, onFlat)));
+    }
+    auto plan = run(exec, "EXPLAIN SELECT hr FROM vitals WHERE id = 77");
+    assert(plan.at(0, 2).asString().find("partition ") != std::string::npos);
+
+    assert(st.truncateTable("vitals").ok());
+    assert(count(st, "vitals") == 0);
+    assert(st.dropTable("vitals").ok());
+    assert(!st.partitionCount("vitals"));
+    assert(st.createTable("vitals", vitalsSchema()).ok());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll partitioned table tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,211 @@
+#include "kadedb/columnar_storage.h"
+#include "kadedb/physical_plan.h"
+#include "kadedb/predicate_builder.h"
+#include "kadedb/storage.h"
+
+#include <cassert>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+
+static TableSchema makeSchema() {
+  std::vector<Column> cols;
+  cols.push_back(Column{"id", ColumnType::Integer, false, true, {}});
+  cols.push_back(Column{"grp", ColumnType::Integer, true, false, {}});
+  return TableSchema(cols, std::optional<std::string>("id"));
+}
+
+static void fill(RelationalStorage &rs, int64_t n) {
+  assert(rs.createTable("t", makeSchema()).ok());
+  for (int64_t i = 0; i < n; ++i) {
+    Row r(2);
+    r.set(0, ValueFactory::createInteger(i));
+    if (i % 10 != 0)
+      r.set(1, ValueFactory::createInteger(i % 4));
+    assert(rs.insertRow("t", r).ok());
+  }
+}
+
+static std::optional<Predicate> where(Predicate p) {
+  std::optional<Predicate> w;
+  w.emplace(std::move(p));
+  return w;
+}
+
+// scan() delivers bounded batches, always reports metadata, stops on request
+static void testScan(RelationalStorage &rs) {
+  size_t calls = 0, rows = 0;
+  auto st = rs.scan(
+      "t", {"id"}, std::nullopt,
+      [&](RowBatch &b) {
+        ++calls;
+        assert(b.rows.size() <= 64);
+        assert(b.columnNames.size() == 1 && b.columnNames[0] == "id");
+        rows += b.rows.size();
+        return true;
+      },
+      64);
+  assert(st.ok() && rows == 1000 && calls == 16);
+
+  calls = 0;
+  st = rs.scan(
+      "t", {},
+      where(cmp("id", Predicate::Op::Lt, ValueFactory::createInteger(0))),
+      [&](RowBatch &b) {
+        ++calls;
+        assert(b.rows.empty() && b.columnNames.size() == 2);
+        return true;
+      },
+      64);
+  assert(st.ok() && calls == 1);
+
+  calls = 0;
+  st = rs.scan(
+      "t", {}, std::nullopt,
+      [&](RowBatch &) {
+        ++calls;
+        return false;
+      },
+      64);
+  assert(st.ok() && calls == 1);
+
+  auto noop = [](RowBatch &) { return true; };
+  assert(rs.scan("missing", {}, std::nullopt, noop, 64).code() ==
+         StatusCode::NotFound);
+  assert(rs.scan("t", {"nope"}, std::nullopt, noop, 64).code() ==
+         StatusCode::InvalidArgument);
+}
+
+// Counts the batches reaching it, to observe early termination
+class CountingOperator final : public PhysicalOperator {
+public:
+  explicit CountingOperator(size_t &pushes) : pushes_(pushes) {}
+  Status open(const std::vector<std::string> &names,
+              const std::vector<ColumnType> &types) override {
+    return next_->open(names, types);
+  }
+  Status push(std::vector<Cells> &rows) override {
+    ++pushes_;
+    return next_->push(rows);
+  }
+
+private:
+  size_t &pushes_;
+};
+
+static void testOperators(RelationalStorage &rs) {
+  // Filter -> Sort (grp desc, nulls last when descending, then id asc)
+  {
+    Predicate pred =
+        cmp("id", Predicate::Op::Lt, ValueFactory::createInteger(12));
+    PhysicalPlan plan(rs, "t", {}, std::nullopt);
+    plan.add<FilterOperator>(pred);
+    plan.add<SortOperator>(std::vector<SortOperator::Key>{{"grp", true},
+                                                          {"id", false}});
+    auto res = plan.execute();
+    assert(res.hasValue());
+    const auto &set = res.value();
+    assert(set.rowCount() == 12);
+    std::vector<int64_t> ids;
+    for (size_t i = 0; i < set.rowCount(); ++i)
+      ids.push_back(set.at(i, 0).asInt());
+    assert((ids == std::vector<int64_t>{3, 7, 11, 2, 6, 1, 5, 9, 4, 8, 0,
+                                        10}));
+  }
+  // Limit with offset stops the scan after the batches it needs
+  {
+    size_t pushes = 0;
+    PhysicalPlan plan(rs, "t", {"id"}, std::nullopt);
+    plan.setBatchRows(10);
+    plan.add<CountingOperator>(pushes);
+    plan.add<LimitOperator>(std::optional<size_t>(15), 5);
+    auto res = plan.execute();
+    assert(res.hasValue() && res.value().rowCount() == 15);
+    assert(res.value().at(0, 0).asInt() == 5);
+    assert(res.value().at(14, 0).asInt() == 19);
+    assert(pushes == 2);
+  }
+  // Project evaluates expressions through the supplied evaluator
+  {
+    IdentifierExpression idExpr("id");
+    PhysicalPlan plan(rs, "t", {},
+                      where(cmp("id", Predicate::Op::Ge,
+                                ValueFactory::createInteger(998))));
+    ExprEvaluator eval = [](const Expression *e, const TableSchema &schema,
+                            const Cells &row) {
+      const auto *id = static_cast<const IdentifierExpression *>(e);
+      size_t idx = schema.findColumn(id->getName());
+      return Result<std::unique_ptr<Value>>::ok(
+          ValueFactory::createInteger(row[idx]->asInt() * 2));
+    };
+    plan.add<ProjectOperator>(
+        std::vector<ProjectOperator::Item>{{&idExpr, "twice"}}, eval);
+    auto res = plan.execute();
+    assert(res.hasValue() && res.value().rowCount() == 2);
+    assert(res.value().columnNames()[0] == "twice");
+    assert(res.value().at(1, 0).asInt() == 1998);
+  }
+  // A sink receives batches as they are produced and can stop the scan
+  {
+    size_t pushes = 0, batches = 0, rows = 0;
+    PhysicalPlan plan(rs, "t", {"id"}, std::nullopt);
+    plan.setBatchRows(10);
+    plan.add<CountingOperator>(pushes);
+    RelationalStorage::BatchSink sink = [&](RowBatch &b) {
+      assert(b.columnNames.size() == 1 && b.columnNames[0] == "id");
+      assert(b.rows.front()[0]->asInt() == static_cast<int64_t>(rows));
+      rows += b.rows.size();
+      return ++batches < 3;
+    };
+    assert(plan.execute(sink).ok());
+    assert(batches == 3 && rows == 30 && pushes == 3);
+  }
+  // ... including the output of blocking operators, and an empty result as
+  // one batch of metadata
+  {
+    size_t batches = 0, rows = 0;
+    PhysicalPlan plan(rs, "t", {}, std::nullopt);
+    plan.add<SortOperator>(std::vector<SortOperator::Key>{{"id", true}});
+    RelationalStorage::BatchSink sink = [&](RowBatch &b) {
+      assert(b.rows.front()[0]->asInt() == static_cast<int64_t>(999 - rows));
+      rows += b.rows.size();
+      ++batches;
+      return true;
+    };
+    assert(plan.execute(sink).ok() && rows == 1000 && batches > 0);
+    batches = 0;
+    PhysicalPlan empty(rs, "t", {},
+                       where(cmp("id", Predicate::Op::Lt,
+                                 ValueFactory::createInteger(0))));
+    empty.add<LimitOperator>(std::optional<size_t>(5), 0);
+    RelationalStorage::BatchSink meta = [&](RowBatch &b) {
+      assert(b.rows.empty() && b.columnNames.size() == 2);
+      ++batches;
+      return true;
+    };
+    assert(empty.execute(meta).ok() && batches == 1);
+  }
+  // Operator errors surface from execute()
+  {
+    PhysicalPlan plan(rs, "t", {}, std::nullopt);
+    plan.add<SortOperator>(std::vector<SortOperator::Key>{{"nope", false}});
+    assert(plan.execute().status().code() == StatusCode::InvalidArgument);
+  }
+}
+
+int main() {
+  // Row store streams from a snapshot; the columnar engine uses the default
+  // scan() built on select()
+  InMemoryRelationalStorage row;
+  ColumnarRelationalStorage col;
+  fill(row, 1000);
+  fill(col, 1000);
+  testScan(row);
+  testScan(col);
+  testOperators(row);
+  testOperators(col);
+  return 0;
+}
@@ -0,0 +1,282 @@
+#include "kadedb/kadeql.h"
+#include "kadedb/prepared_statement.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/result_cache.h"
+#include "kadedb/schema.h"
+#include "kadedb/slow_query_log.h"
+#include "kadedb/storage.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+
+static Row makeRow(int64_t id, const std::string &name, double score) {
+  Row r(3);
+  r.set(0, ValueFactory::createInteger(id));
+  r.set(1, ValueFactory::createString(name));
+  r.set(2, ValueFactory::createFloat(score));
+  return r;
+}
+
+static TableSchema peopleSchema() {
+  return TableSchema({Column{"id", ColumnType::Integer, false, false, {}},
+                      Column{"name", ColumnType::String, true, false, {}},
+                      Column{"score", ColumnType::Float, true, false, {}}});
+}
+
+// Rows rendered as "a|b|c" in result order
+static std::vector<std::string> render(const ResultSet &rs) {
+  std::vector<std::string> out;
+  for (size_t i = 0; i < rs.rowCount(); ++i) {
+    std::string line;
+    for (const auto &v : rs.row(i).values())
+      line += (v ? v->toString() : "null") + "|";
+    out.push_back(line);
+  }
+  return out;
+}
+
+static std::vector<std::string> rows(QueryExecutor &exec,
+                                     const std::string &q) {
+  auto res = exec.execute(*parseQuery(q));
+  assert(res.hasValue());
+  return render(res.value());
+}
+
+static ResultSet oneColumn(int64_t n) {
+  ResultSet rs({"n"}, {ColumnType::Integer});
+  for (int64_t i = 0; i < n; ++i)
+    rs.addRow(ResultRow(std::vector<InlineValue>{InlineValue::integer(i)}));
+  return rs;
+}
+
+static ResultSource tableSource(const std::string &name, uint64_t version) {
+  ResultSource s;
+  s.name = name;
+  s.version = version;
+  return s;
+}
+
+int main() {
+  std::cout << "=== Result Cache Tests ===" << std::endl;
+
+  std::cout << "Test 1: version-checked LRU..." << std::endl;
+  {
+    ResultCache cache(4096);
+    uint64_t version = 7;
+    auto versionOf = [&](const ResultSource &) {
+      return std::optional<uint64_t>(version);
+    };
+    assert(!cache.lookup("q", versionOf));
+    cache.insert("q", {tableSource("t", 7)}, oneColumn(3));
+    auto hit = cache.lookup("q", versionOf);
+    assert(hit && hit->rowCount() == 3 && hit->at(2, 0).asInt() == 2);
+    assert(hit->columnNames()[0] == "n");
+    assert(cache.hits() == 1 && cache.misses() == 1 && cache.size() == 1);
+
+    // A changed source drops the entry
+    version = 8;
+    assert(!cache.lookup("q", versionOf));
+    assert(cache.invalidations() == 1 && cache.size() == 0);
+    assert(cache.bytes() == 0);
+
+    // Byte bound: the least recently used entries make room
+    cache.insert("a", {tableSource("t", 8)}, oneColumn(50));
+    const size_t one = cache.bytes();
+    assert(one > 50 * sizeof(InlineValue) && one * 2 <= 4096);
+    cache.insert("b", {tableSource("t", 8)}, oneColumn(50));
+    assert(cache.lookup("a", versionOf));
+    while (cache.evictions() == 0)
+      cache.insert("c" + std::to_string(cache.size()),
+                   {tableSource("t", 8)}, oneColumn(50));
+    assert(!cache.lookup("b", versionOf) && cache.lookup("a", versionOf));
+    assert(cache.bytes() <= cache.capacity());
+    // Larger than the whole cache: not kept
+    const size_t before = cache.size();
+    cache.insert("huge", {tableSource("t", 8)}, oneColumn(1000));
+    assert(!cache.lookup("huge", versionOf) && cache.size() == before);
+    cache.clear();
+    assert(cache.size() == 0 && cache.bytes() == 0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  InMemoryRelationalStorage st;
+  assert(st.createTable("people", peopleSchema()).ok());
+  assert(st.createTable("other", peopleSchema()).ok());
+  for (int64_t i = 0; i < 100; ++i) {
+    assert(st.insertRow("people", makeRow(i, "p" + std::to_string(i % 10),
+                                          i * 0.25))
+               .ok());
+    assert(st.insertRow("other", makeRow(i, "o", 1.0)).ok());
+  }
+  QueryExecutor plain(st);
+
+  std::cout << "Test 2: repeated SELECTs..." << std::endl;
+  {
+    ResultCache cache;
+    QueryExecutor exec(st);
+    exec.setResultCache(cache);
+    const std::string q = "SELECT name, COUNT(*), SUM(score) FROM people "
+                          "WHERE id > 10 GROUP BY name ORDER BY name";
+    const auto expected = rows(plain, q);
+    assert(rows(exec, q) == expected);
+    assert(cache.misses() == 1 && cache.size() == 1);
+    for (int i = 0; i < 5; ++i)
+      assert(rows(exec, q) == expected);
+    assert(cache.hits() == 5);
+
+    // Literals are keyed exactly, not by their rounded text
+    const auto a = rows(exec, "SELECT id FROM people WHERE score > 10.1234567");
+    const auto b = rows(exec, "SELECT id FROM people WHERE score > 10.1234568");
+    assert(a == b && cache.size() == 3);
+
+    // EXPLAIN is never answered from the cache
+    auto explained = exec.execute(*parseQuery("EXPLAIN " + q));
+    assert(explained.hasValue() &&
+           explained.value().columnNames()[0] == "step");
+
+    // A hit is delivered to a sink as one batch
+    size_t streamed = 0;
+    Status s = exec.execute(*parseQuery(q), [&](RowBatch &batch) {
+      streamed += batch.rows.size();
+      return true;
+    });
+    assert(s.ok() && streamed == expected.size());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: writes invalidate their own tables..." << std::endl;
+  {
+    ResultCache cache;
+    QueryExecutor exec(st);
+    exec.setResultCache(cache);
+    const std::string people = "SELECT COUNT(*), SUM(score) FROM people";
+    const std::string other = "SELECT COUNT(*) FROM other";
+    const std::string joined =
+        "SELECT p.id, o.name FROM people p JOIN other o ON p.id = o.id "
+        "WHERE p.id < 5 ORDER BY p.id";
+    rows(exec, people);
+    rows(exec, other);
+    rows(exec, joined);
+    const auto check = [&] {
+      for (const auto &q : {people, other, joined})
+        assert(rows(exec, q) == rows(plain, q));
+    };
+
+    // Each write makes only the entries reading `people` stale
+    for (const std::string w :
+         {"INSERT INTO people (id, name, score) VALUES (1000, 'new', 2.5)",
+          "UPDATE people SET score = 99.5 WHERE id = 3",
+          "DELETE FROM people WHERE id = 1000"}) {
+      const uint64_t invalidations = cache.invalidations();
+      const uint64_t hits = cache.hits();
+      assert(exec.execute(*parseQuery(w)).hasValue());
+      check();
+      assert(cache.invalidations() == invalidations + 2);
+      assert(cache.hits() == hits + 1);
+    }
+    // A write that changes no row leaves the cache alone
+    const uint64_t invalidations = cache.invalidations();
+    assert(exec.execute(*parseQuery("DELETE FROM people WHERE id = 5000"))
+               .hasValue());
+    check();
+    assert(cache.invalidations() == invalidations);
+
+    // Writes straight to the storage, truncation and re-creation too
+    assert(st.insertRow("other", makeRow(100, "o", 1.0)).ok());
+    check();
+    assert(st.truncateTable("other").ok());
+    check();
+    assert(st.dropTable("other").ok());
+    assert(st.createTable("other", peopleSchema()).ok());
+    check();
+    for (int64_t i = 0; i < 100; ++i)
+      assert(st.insertRow("other", makeRow(i, "o", 1.0)).ok());
+    check();
+
+    // A missing table is an error, and stays one
+    assert(!exec.execute(*parseQuery("SELECT * FROM missing")).hasValue());
+    assert(!exec.execute(*parseQuery("SELECT * FROM missing")).hasValue());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: bound parameters..." << std::endl;
+  {
+    ResultCache cache;
+    QueryExecutor exec(st);
+    exec.setResultCache(cache);
+    auto stmt =
+        PreparedStatement::prepare("SELECT id FROM people WHERE id < $1")
+            .takeValue();
+    auto run = [&](int64_t n) {
+      std::vector<std::unique_ptr<Value>> params;
+      params.push_back(ValueFactory::createInteger(n));
+      auto res = stmt->execute(exec, params);
+      assert(res.hasValue());
+      return res.value().rowCount();
+    };
+    assert(run(3) == 3 && run(7) == 7 && run(3) == 3 && run(7) == 7);
+    assert(cache.size() == 2 && cache.hits() == 2);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 5: time series and system tables..." << std::endl;
+  {
+    TimeSeriesSchema schema("ts", TimeGranularity::Seconds);
+    schema.addValueColumn(Column{"v", ColumnType::Float, false, false, {}});
+    InMemoryTimeSeriesStorage ts;
+    assert(ts.createSeries("vitals", schema, TimePartition::Hourly).ok());
+    auto sample = [](int64_t t) {
+      Row r(2);
+      r.set(0, ValueFactory::createInteger(t));
+      r.set(1, ValueFactory::createFloat(1.5));
+      return r;
+    };
+    for (int64_t t = 0; t < 600; t += 60)
+      assert(ts.append("vitals", sample(t)).ok());
+
+    InMemoryRelationalStorage rel;
+    ResultCache cache;
+    QueryExecutor exec(rel, ts);
+    exec.setResultCache(cache);
+    const std::string q = "SELECT COUNT(*) FROM vitals WHERE ts >= 0";
+    assert(rows(exec, q) == std::vector<std::string>{"10|"});
+    assert(rows(exec, q) == std::vector<std::string>{"10|"});
+    assert(cache.hits() == 1);
+    assert(ts.append("vitals", sample(600)).ok());
+    assert(rows(exec, q) == std::vector<std::string>{"11|"});
+    assert(cache.invalidations() == 1);
+    assert(rows(exec, q) == std::vector<std::string>{"11|"});
+    assert(cache.hits() == 2);
+    // A table of the same name takes over from the series
+    assert(rel.createTable("vitals", TableSchema({Column{
+                                         "ts", ColumnType::Integer, false,
+                                         false, {}}}))
+               .ok());
+    QueryExecutor tableOnly(rel);
+    assert(rows(exec, q) == rows(tableOnly, q));
+    assert(rel.dropTable("vitals").ok());
+    assert(rows(exec, q) == std::vector<std::string>{"11|"});
+
+    // The slow query log has no data version: never cached
+    SlowQueryLog log;
+    exec.setSlowQueryLog(log);
+    const size_t before = cache.size();
+    rows(exec, std::string("SELECT * FROM ") + SlowQueryLog::kTableName);
+    rows(exec, std::string("SELECT * FROM ") + SlowQueryLog::kTableName);
+    assert(cache.size() == before);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "All result cache tests passed." << std::endl;
+  return 0;
+}
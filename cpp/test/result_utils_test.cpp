@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cassert>
 #include <memory>
 #include <string>
@@ -43,6 +44,66 @@ int main() {
   assert(json.back() == ']');
   assert(json.find("\"name\":\"alice\"") != std::string::npos);
 
+  // Streaming writers hand over the same text in chunks
+  {
+    ResultSet big({"id", "name", "score"},
+                  {ColumnType::Integer, ColumnType::String, ColumnType::Float});
+    for (int i = 0; i < 20000; ++i) {
+      std::vector<std::unique_ptr<Value>> vals;
+      vals.emplace_back(std::make_unique<IntegerValue>(i));
+      vals.emplace_back(
+          std::make_unique<StringValue>("n;\"" + std::to_string(i) + "\n"));
+      vals.emplace_back(std::make_unique<FloatValue>(i / 3.0));
+      big.addRow(ResultRow(std::move(vals)));
+    }
+    std::string streamed;
+    size_t chunks = 0, largest = 0;
+    const OutputSink sink = [&](const char *data, size_t size) {
+      streamed.append(data, size);
+      ++chunks;
+      largest = std::max(largest, size);
+    };
+    big.writeCSV(sink, ';', true, false, '"');
+    assert(streamed == big.toCSV(';', true, false, '"'));
+    assert(chunks > 1 && largest < 2 * kOutputChunkBytes);
+    for (bool meta : {false, true})
+      for (int indent : {0, 2}) {
+        streamed.clear();
+        big.writeJSON(sink, meta, indent);
+        assert(streamed == big.toJSON(meta, indent));
+      }
+    // Compact metadata has no stray bytes between array entries
+    assert(big.toJSON(true).find("[\"id\",\"name\",\"score\"]") !=
+           std::string::npos);
+  }
+
+  // Rows from elsewhere, converted one at a time; null cells are allowed
+  {
+    const std::vector<std::string> names{"k", "v"};
+    const std::vector<ColumnType> types{ColumnType::String,
+                                        ColumnType::Integer};
+    ResultRow scratch;
+    const RowSource rowAt = [&](size_t i) -> const ResultRow & {
+      std::vector<std::unique_ptr<Value>> vals;
+      vals.emplace_back(std::make_unique<StringValue>("k" + std::to_string(i)));
+      if (i % 2)
+        vals.emplace_back(std::make_unique<IntegerValue>(i));
+      else
+        vals.emplace_back(nullptr);
+      scratch = ResultRow(std::move(vals));
+      return scratch;
+    };
+    std::string out;
+    const OutputSink sink = [&](const char *data, size_t size) {
+      out.append(data, size);
+    };
+    writeCSV(names, types, 3, rowAt, sink);
+    assert(out == "k,v\nk0,\nk1,1\nk2,\n");
+    out.clear();
+    writeJSON(names, types, 2, rowAt, sink);
+    assert(out == "[{\"k\":\"k0\",\"v\":null},{\"k\":\"k1\",\"v\":1}]");
+  }
+
   // Pagination
   rs.setPageSize(1);
   assert(rs.totalPages() == 2);
@@ -0,0 +1,507 @@
+#include "kadedb/kv_store.h"
+#include "kadedb/predicate_builder.h"
+#include "kadedb/rocksdb_storage.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace kadedb;
+
+// (id INTEGER primary key, ward STRING, hr INTEGER, mrn STRING unique)
+static TableSchema vitalsSchema() {
+  return TableSchema({Column{"id", ColumnType::Integer, false, false, {}},
+                      Column{"ward", ColumnType::String, true, false, {}},
+                      Column{"hr", ColumnType::Integer, true, false, {}},
+                      Column{"mrn", ColumnType::String, true, true, {}}},
+                     "id");
+}
+
+static Row vitals(int64_t id, const std::string &ward, int64_t hr) {
+  Row r(4);
+  r.set(0, ValueFactory::createInteger(id));
+  r.set(1, ValueFactory::createString(ward));
+  if (hr >= 0)
+    r.set(2, ValueFactory::createInteger(hr));
+  r.set(3, ValueFactory::createString("m" + std::to_string(id)));
+  return r;
+}
+
+// Rows of `rs` as sorted strings, to compare results regardless of order
+static std::vector<std::string> rowsOf(const ResultSet &rs) {
+  std::vector<std::string> out;
+  for (size_t i = 0; i < rs.rowCount(); ++i) {
+    std::string line;
+    for (const auto &v : rs.row(i).values())
+      line += (v ? v->toString() : "null") + "|";
+    out.push_back(line);
+  }
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+static std::vector<std::string> selectAll(RelationalStorage &s,
+                                          const std::optional<Predicate> &p) {
+  auto res = s.select("v", {}, p);
+  assert(res.hasValue());
+  return rowsOf(res.value());
+}
+
+static std::unique_ptr<Value> randomScalar(std::mt19937 &rng) {
+  switch (rng() % 6) {
+  case 0:
+    return ValueFactory::createInteger(static_cast<int64_t>(rng() % 41) - 20);
+  case 1:
+    return ValueFactory::createFloat(static_cast<double>(rng() % 400) / 10 -
+                                     20);
+  case 2: {
+    static const char *words[] = {"", "a", "a\0b", "ab", "b", "icu"};
+    size_t w = rng() % 6;
+    return ValueFactory::createString(w == 2 ? std::string("a\0b", 3)
+                                             : words[w]);
+  }
+  case 3:
+    return ValueFactory::createBoolean(rng() % 2 == 0);
+  case 4:
+    return ValueFactory::createNull();
+  default:
+    return ValueFactory::createInteger(static_cast<int64_t>(rng()) -
+                                       static_cast<int64_t>(1u << 31));
+  }
+}
+
+static Predicate randomPredicate(std::mt19937 &rng, int depth) {
+  static const char *cols[] = {"id", "hr", "ward"};
+  static const Predicate::Op ops[] = {Predicate::Op::Eq, Predicate::Op::Ne,
+                                      Predicate::Op::Lt, Predicate::Op::Le,
+                                      Predicate::Op::Gt, Predicate::Op::Ge};
+  if (depth > 0 && rng() % 3 == 0) {
+    Predicate p;
+    p.kind = rng() % 2 ? Predicate::Kind::And : Predicate::Kind::Or;
+    p.children.push_back(randomPredicate(rng, depth - 1));
+    p.children.push_back(randomPredicate(rng, depth - 1));
+    return p;
+  }
+  const std::string col = cols[rng() % 3];
+  std::unique_ptr<Value> rhs;
+  if (col == "ward" && rng() % 2)
+    rhs = ValueFactory::createString(rng() % 2 ? "er" : "icu");
+  else if (rng() % 3)
+    rhs = ValueFactory::createInteger(static_cast<int64_t>(rng() % 140));
+  else
+    rhs = randomScalar(rng);
+  return cmp(col, ops[rng() % 6], std::move(rhs));
+}
+
+int main() {
+  std::cout << "=== RocksDB Storage Tests ===" << std::endl;
+
+  std::cout << "Test 1: key encoding preserves value order..." << std::endl;
+  {
+    std::mt19937 rng(3);
+    for (int n = 0; n < 20000; ++n) {
+      auto a = randomScalar(rng), b = randomScalar(rng);
+      std::string ka, kb;
+      keycode::appendValue(ka, a.get());
+      keycode::appendValue(kb, b.get());
+      const int c = a->compare(*b);
+      assert((ka < kb) == (c < 0) && (ka == kb) == (c == 0));
+    }
+    // Absent sorts first; composite keys sort by their first field
+    std::string absent, empty, ab, b;
+    keycode::appendValue(absent, nullptr);
+    auto emptyStr = ValueFactory::createString("");
+    keycode::appendValue(empty, emptyStr.get());
+    assert(absent < empty);
+    keycode::appendString(ab, "a");
+    ab += "zzz";
+    keycode::appendString(b, "ab");
+    assert(ab < b);
+    assert(keycode::prefixEnd("a\xFF") == "b");
+    assert(keycode::prefixEnd("\xFF").empty());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: the in-memory key-value store..." << std::endl;
+  {
+    InMemoryKeyValueStore kv;
+    assert(kv.createFamily("f").ok() && kv.createFamily("f").ok());
+    WriteBatch batch;
+    batch.put("f", "b", "2");
+    batch.put("f", "a", "1");
+    batch.put("f", "c", "3");
+    batch.erase("f", "c");
+    assert(kv.write(batch).ok());
+    // A batch naming a missing family writes nothing
+    WriteBatch bad;
+    bad.put("f", "z", "26");
+    bad.put("nope", "k", "v");
+    assert(kv.write(bad).code() == StatusCode::NotFound);
+    assert(kv.get("f", "z").status().code() == StatusCode::NotFound);
+    assert(kv.get("f", "b").value() == "2");
+
+    auto it = std::move(kv.newIterator("f").value());
+    it->seek("");
+    std::string seen;
+    for (; it->valid(); it->next())
+      seen += std::string(it->key()) + std::string(it->value());
+    assert(seen == "a1b2");
+    it->seek("aa");
+    assert(it->valid() && it->key() == "b");
+    assert(kv.dropFamily("f").ok());
+    assert(kv.newIterator("f").status().code() == StatusCode::NotFound);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: tables answer like InMemoryRelationalStorage..."
+            << std::endl;
+  {
+    auto kv = std::make_shared<InMemoryKeyValueStore>();
+    auto opened = RocksDbRelationalStorage::open(kv);
+    assert(opened.hasValue());
+    auto &rs = *opened.value();
+    InMemoryRelationalStorage mem;
+    for (RelationalStorage *s :
+         std::initializer_list<RelationalStorage *>{&rs, &mem}) {
+      assert(s->createTable("v", vitalsSchema()).ok());
+      assert(s->createTable("v", vitalsSchema()).code() ==
+             StatusCode::AlreadyExists);
+      std::vector<Row> rows;
+      for (int64_t id = 0; id < 300; ++id)
+        rows.push_back(vitals(id % 150 - 40, id % 3 ? "er" : "icu",
+                              id % 7 ? (id * 37) % 140 : -1));
+      // Duplicate primary keys are allowed, as in memory; the unique mrn
+      // column is not, so give the repeats their own
+      for (size_t i = 150; i < rows.size(); ++i)
+        rows[i].set(3, ValueFactory::createString("d" + std::to_string(i)));
+      assert(s->insertRows("v", rows).ok());
+    }
+    assert(rs.createIndex("v", "hr", IndexType::Hash).ok());
+    assert(mem.createIndex("v", "hr", IndexType::Ordered).ok());
+    assert(rs.createIndex("v", "hr", IndexType::Ordered).code() ==
+           StatusCode::AlreadyExists);
+    assert(rs.createIndex("v", "id", IndexType::Ordered).code() ==
+           StatusCode::AlreadyExists);
+    assert(rs.createIndex("v", "nope", IndexType::Ordered).code() ==
+           StatusCode::InvalidArgument);
+    assert(rs.estimateRowCount("v") == size_t{300});
+
+    std::mt19937 rng(5);
+    for (int n = 0; n < 400; ++n) {
+      std::optional<Predicate> p(randomPredicate(rng, 2));
+      assert(selectAll(rs, p) == selectAll(mem, p));
+    }
+    assert(selectAll(rs, std::nullopt) == selectAll(mem, std::nullopt));
+
+    // Primary key and index ranges, projections and batches
+    std::vector<Predicate> bounds;
+    bounds.push_back(
+        cmp("id", Predicate::Op::Ge, ValueFactory::createInteger(10)));
+    bounds.push_back(
+        cmp("id", Predicate::Op::Lt, ValueFactory::createInteger(20)));
+    std::optional<Predicate> idRange(And(std::move(bounds)));
+    assert(rs.explainAccess("v", idRange) == "primary key range on id");
+    std::optional<Predicate> hot(
+        cmp("hr", Predicate::Op::Gt, ValueFactory::createInteger(120)));
+    assert(rs.explainAccess("v", hot) == "index range on hr");
+    std::optional<Predicate> icu(
+        cmp("ward", Predicate::Op::Eq, ValueFactory::createString("icu")));
+    assert(rs.explainAccess("v", icu) == "full scan");
+    auto proj = rs.select("v", {"hr", "id", "hr"}, idRange);
+    assert(proj.hasValue() && proj.value().columnCount() == 3);
+    assert(proj.value().rowCount() == 20);
+    // In primary key order
+    for (size_t i = 1; i < proj.value().rowCount(); ++i)
+      assert(proj.value().row(i - 1).at(1).asInt() <=
+             proj.value().row(i).at(1).asInt());
+    size_t batches = 0, scanned = 0;
+    assert(rs.scan("v", {"id"}, std::nullopt,
+                   [&](RowBatch &b) {
+                     ++batches;
+                     scanned += b.rows.size();
+                     return true;
+                   },
+                   64)
+               .ok());
+    assert(batches == 5 && scanned == 300);
+    assert(rs.select("v", {"nope"}, std::nullopt).status().code() ==
+           StatusCode::InvalidArgument);
+    assert(rs.select("nope", {}, std::nullopt).status().code() ==
+           StatusCode::NotFound);
+
+    // Writes: the same outcomes, and the same rows after them
+    for (int n = 0; n < 60; ++n) {
+      std::optional<Predicate> p(randomPredicate(rng, 1));
+      switch (n % 3) {
+      case 0: {
+        auto a = rs.deleteRows("v", p), b = mem.deleteRows("v", p);
+        assert(a.hasValue() && b.hasValue() && a.value() == b.value());
+        break;
+      }
+      case 1: {
+        std::unordered_map<std::string, AssignmentValue> set;
+        set["hr"].constant = ValueFactory::createInteger(n);
+        auto a = rs.updateRows("v", set, p), b = mem.updateRows("v", set, p);
+        assert(a.hasValue() && b.hasValue() && a.value() == b.value());
+        break;
+      }
+      default: {
+        Row r = vitals(1000 + n, "er", n);
+        assert(rs.insertRow("v", r).ok() && mem.insertRow("v", r).ok());
+      }
+      }
+      assert(selectAll(rs, std::nullopt) == selectAll(mem, std::nullopt));
+      std::optional<Predicate> q(randomPredicate(rng, 2));
+      assert(selectAll(rs, q) == selectAll(mem, q));
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: unique columns, key moves and reopening..."
+            << std::endl;
+  {
+    auto kv = std::make_shared<InMemoryKeyValueStore>();
+    {
+      auto rs = std::move(RocksDbRelationalStorage::open(kv).value());
+      assert(rs->createTable("v", vitalsSchema()).ok());
+      assert(rs->insertRows("v", {vitals(1, "er", 80), vitals(2, "icu", 90)})
+                 .ok());
+      // A duplicate in the batch or against the table inserts nothing
+      Row dup = vitals(3, "er", 70);
+      dup.set(3, ValueFactory::createString("m1"));
+      auto st = rs->insertRows("v", {vitals(4, "er", 1), dup});
+      assert(st.code() == StatusCode::FailedPrecondition);
+      assert(st.message() == "Duplicate value for unique column 'mrn'");
+      assert(rs->estimateRowCount("v") == size_t{2});
+      Row bad = vitals(5, "er", 1);
+      bad.set(2, ValueFactory::createString("fast"));
+      assert(rs->insertRow("v", bad).code() == StatusCode::InvalidArgument);
+
+      // Swapping unique values between rewritten rows is fine
+      auto swapped = rs->updateRowsWith(
+          "v",
+          [](Row &r, const TableSchema &) {
+            const int64_t id = r.values()[0]->asInt();
+            r.set(3, ValueFactory::createString(id == 1 ? "m2" : "m1"));
+            r.set(0, ValueFactory::createInteger(id + 10));
+            return Status::OK();
+          },
+          std::nullopt);
+      assert(swapped.hasValue() && swapped.value() == 2);
+      std::unordered_map<std::string, AssignmentValue> set;
+      set["mrn"].constant = ValueFactory::createString("same");
+      assert(rs->updateRows("v", set, std::nullopt).status().code() ==
+             StatusCode::FailedPrecondition);
+      assert(rs->createIndex("v", "ward", IndexType::Ordered).ok());
+      assert(rs->createTable("w", vitalsSchema()).ok());
+      assert(rs->dropTable("w").ok());
+    }
+
+    // Reopened over the same store: tables, rows, counters and indexes
+    auto rs = std::move(RocksDbRelationalStorage::open(kv).value());
+    assert(rs->listTables() == std::vector<std::string>{"v"});
+    assert(rs->estimateRowCount("v") == size_t{2});
+    std::optional<Predicate> moved(
+        cmp("id", Predicate::Op::Eq, ValueFactory::createInteger(11)));
+    auto row = rs->select("v", {"mrn"}, moved);
+    assert(row.hasValue() && row.value().rowCount() == 1);
+    assert(row.value().row(0).at(0).asString() == "m2");
+    std::optional<Predicate> er(
+        cmp("ward", Predicate::Op::Eq, ValueFactory::createString("er")));
+    assert(rs->explainAccess("v", er) == "index range on ward");
+    assert(rs->select("v", {}, er).value().rowCount() == 1);
+    // Unique values survive reopening; row ids keep counting
+    assert(rs->insertRow("v", vitals(3, "er", 60)).ok());
+    Row taken = vitals(4, "er", 60);
+    taken.set(3, ValueFactory::createString("m1"));
+    assert(rs->insertRow("v", taken).code() == StatusCode::FailedPrecondition);
+    assert(rs->select("v", {}, er).value().rowCount() == 2);
+    assert(rs->truncateTable("v").ok());
+    assert(rs->estimateRowCount("v") == size_t{0});
+    assert(rs->insertRow("v", vitals(1, "er", 60)).ok());
+    assert(rs->dropTable("v").ok());
+    assert(rs->dropTable("v").code() == StatusCode::NotFound);
+    assert(RocksDbRelationalStorage::open(kv).value()->listTables().empty());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 5: collections answer like InMemoryDocumentStorage..."
+            << std::endl;
+  {
+    auto kv = std::make_shared<InMemoryKeyValueStore>();
+    auto ds = std::move(RocksDbDocumentStorage::open(kv).value());
+    InMemoryDocumentStorage mem;
+    DocumentSchema schema;
+    schema.addField(Column{"ward", ColumnType::String, false, false, {}});
+    schema.addField(Column{"bed", ColumnType::Integer, true, true, {}});
+    schema.addField(Column{"hr", ColumnType::Float, true, false, {}});
+    for (DocumentStorage *s :
+         std::initializer_list<DocumentStorage *>{ds.get(), &mem}) {
+      assert(s->createCollection("beds", schema).ok());
+      assert(s->createIndex("beds", "hr", IndexType::Ordered).ok());
+      for (int i = 0; i < 200; ++i) {
+        Document doc;
+        doc.emplace("ward", ValueFactory::createString(i % 4 ? "er" : "icu"));
+        if (i % 5)
+          doc.emplace("bed", ValueFactory::createInteger(i));
+        if (i % 3 == 0)
+          doc.emplace("hr", ValueFactory::createFloat(60 + i % 50 + 0.5));
+        else if (i % 3 == 1)
+          doc.emplace("hr", ValueFactory::createInteger(60 + i % 50));
+        assert(s->put("beds", "k" + std::to_string(i), doc).ok());
+      }
+      Document dup;
+      dup.emplace("ward", ValueFactory::createString("er"));
+      dup.emplace("bed", ValueFactory::createInteger(1));
+      assert(s->put("beds", "other", dup).code() ==
+             StatusCode::FailedPrecondition);
+      // Replacing a document keeps its own unique value
+      assert(s->put("beds", "k1", dup).ok());
+    }
+    assert(ds->count("beds").value() == 200);
+    assert(ds->createIndex("beds", "nope", IndexType::Ordered).code() ==
+           StatusCode::InvalidArgument);
+
+    auto keysOf = [](DocumentStorage &s, const std::optional<DocPredicate> &p) {
+      auto res = s.query("beds", {"bed"}, p);
+      assert(res.hasValue());
+      std::vector<std::string> keys;
+      for (const auto &kv : res.value()) {
+        assert(kv.second.size() <= 1);
+        keys.push_back(kv.first);
+      }
+      std::sort(keys.begin(), keys.end());
+      return keys;
+    };
+    std::mt19937 rng(9);
+    static const DocPredicate::Op ops[] = {
+        DocPredicate::Op::Eq, DocPredicate::Op::Ne, DocPredicate::Op::Lt,
+        DocPredicate::Op::Le, DocPredicate::Op::Gt, DocPredicate::Op::Ge};
+    for (int n = 0; n < 300; ++n) {
+      DocPredicate p;
+      p.field = rng() % 3 ? "hr" : "bed";
+      p.op = ops[rng() % 6];
+      p.rhs = rng() % 2 ? ValueFactory::createFloat(60 + rng() % 50 + 0.5)
+                        : randomScalar(rng);
+      std::optional<DocPredicate> where;
+      if (rng() % 2) {
+        DocPredicate both;
+        both.kind = DocPredicate::Kind::And;
+        both.children.push_back(std::move(p));
+        DocPredicate icu;
+        icu.field = "ward";
+        icu.rhs = ValueFactory::createString("icu");
+        both.children.push_back(std::move(icu));
+        where = std::move(both);
+      } else {
+        where = std::move(p);
+      }
+      assert(keysOf(*ds, where) == keysOf(mem, where));
+    }
+    std::optional<DocPredicate> unknown(
+        dcmp("nope", DocPredicate::Op::Eq, ValueFactory::createInteger(1)));
+    assert(ds->query("beds", {}, unknown).status().code() ==
+           StatusCode::InvalidArgument);
+
+    assert(ds->erase("beds", "k2").ok());
+    assert(ds->erase("beds", "k2").code() == StatusCode::NotFound);
+    // Reopened: documents, counts, schema, unique values and indexes
+    ds.reset();
+    ds = std::move(RocksDbDocumentStorage::open(kv).value());
+    assert(ds->count("beds").value() == 199);
+    assert(ds->getCollectionSchema("beds").value()->hasField("bed"));
+    auto got = ds->get("beds", "k1");
+    assert(got.hasValue() && got.value().at("bed")->asInt() == 1);
+    assert(ds->get("beds", "k2").status().code() == StatusCode::NotFound);
+    assert(ds->createIndex("beds", "hr", IndexType::Ordered).code() ==
+           StatusCode::AlreadyExists);
+    Document taken;
+    taken.emplace("ward", ValueFactory::createString("er"));
+    taken.emplace("bed", ValueFactory::createInteger(3));
+    assert(ds->put("beds", "new", taken).code() ==
+           StatusCode::FailedPrecondition);
+    DocPredicate hr;
+    hr.field = "hr";
+    hr.op = DocPredicate::Op::Ge;
+    hr.rhs = ValueFactory::createInteger(100);
+    std::optional<DocPredicate> high(std::move(hr));
+    assert(mem.erase("beds", "k2").ok());
+    assert(keysOf(*ds, high) == keysOf(mem, high));
+
+    // Schemaless collections are created on first put
+    Document loose;
+    loose.emplace("x", ValueFactory::createNull());
+    assert(ds->put("misc", "a", loose).ok());
+    assert(ds->listCollections().size() == 2);
+    assert(ds->dropCollection("misc").ok());
+    assert(ds->get("misc", "a").status().code() == StatusCode::NotFound);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 6: comparisons against NaN scan every row..."
+            << std::endl;
+  {
+    // NaN compares equal to every number, so no key range bounds it
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    auto kv = std::make_shared<InMemoryKeyValueStore>();
+    auto rs = std::move(RocksDbRelationalStorage::open(kv).value());
+    InMemoryRelationalStorage mem;
+    for (RelationalStorage *s :
+         std::initializer_list<RelationalStorage *>{rs.get(), &mem}) {
+      assert(s->createTable("v", vitalsSchema()).ok());
+      for (int64_t id = 0; id < 13; ++id)
+        assert(s->insertRow("v", vitals(id - 6, "er", 70)).ok());
+    }
+    for (Predicate::Op op : {Predicate::Op::Eq, Predicate::Op::Lt,
+                             Predicate::Op::Le, Predicate::Op::Gt,
+                             Predicate::Op::Ge}) {
+      std::optional<Predicate> where(
+          cmp("id", op, ValueFactory::createFloat(nan)));
+      assert(selectAll(*rs, where) == selectAll(mem, where));
+    }
+    std::unordered_map<std::string, AssignmentValue> set;
+    set["hr"].constant = ValueFactory::createInteger(80);
+    std::optional<Predicate> eq(
+        cmp("id", Predicate::Op::Eq, ValueFactory::createFloat(nan)));
+    assert(rs->updateRows("v", set, eq).value() ==
+           mem.updateRows("v", set, eq).value());
+    assert(selectAll(*rs, std::nullopt) == selectAll(mem, std::nullopt));
+
+    auto ds = std::move(RocksDbDocumentStorage::open(kv).value());
+    InMemoryDocumentStorage dmem;
+    for (DocumentStorage *s :
+         std::initializer_list<DocumentStorage *>{ds.get(), &dmem}) {
+      assert(s->createCollection("beds").ok());
+      assert(s->createIndex("beds", "hr", IndexType::Ordered).ok());
+      for (int i = 0; i < 10; ++i) {
+        Document doc;
+        doc.emplace("hr", ValueFactory::createFloat(60 + i * 1.5));
+        assert(s->put("beds", "k" + std::to_string(i), doc).ok());
+      }
+    }
+    for (DocPredicate::Op op : {DocPredicate::Op::Eq, DocPredicate::Op::Lt,
+                                DocPredicate::Op::Gt}) {
+      std::optional<DocPredicate> where(
+          dcmp("hr", op, ValueFactory::createFloat(nan)));
+      auto got = ds->query("beds", {}, where);
+      auto want = dmem.query("beds", {}, where);
+      assert(got.hasValue() && want.hasValue());
+      assert(got.value().size() == want.value().size());
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll RocksDB storage tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,356 @@
+#include "kadedb/columnar_storage.h"
+#include "kadedb/gpu.h"
+#include "kadedb/predicate_builder.h"
+#include "kadedb/scan_kernels.h"
+#include "kadedb/storage.h"
+
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace kadedb;
+using scan::CompareOp;
+
+static bool expected(int c, CompareOp op) {
+  switch (op) {
+  case CompareOp::Eq:
+    return c == 0;
+  case CompareOp::Ne:
+    return c != 0;
+  case CompareOp::Lt:
+    return c < 0;
+  case CompareOp::Le:
+    return c <= 0;
+  case CompareOp::Gt:
+    return c > 0;
+  case CompareOp::Ge:
+    return c >= 0;
+  }
+  return false;
+}
+
+static bool bitAt(const std::vector<uint64_t> &bits, size_t i) {
+  return (bits[i / 64] >> (i % 64)) & 1u;
+}
+
+// Kernels agree with Value::compare() semantics on every row, including NaN
+// cells and partial trailing words, and leave bits past n cleared
+static void testKernels() {
+  const CompareOp ops[] = {CompareOp::Eq, CompareOp::Ne, CompareOp::Lt,
+                           CompareOp::Le, CompareOp::Gt, CompareOp::Ge};
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  for (size_t n : {0u, 1u, 63u, 64u, 65u, 200u, 1024u}) {
+    std::vector<int64_t> ints(n);
+    std::vector<double> floats(n);
+    for (size_t i = 0; i < n; ++i) {
+      ints[i] = static_cast<int64_t>((i * 7919) % 41) - 20;
+      floats[i] = (i % 17 == 0) ? nan : static_cast<double>(ints[i]) / 2.0;
+    }
+    if (n > 3)
+      ints[3] = std::numeric_limits<int64_t>::min();
+    for (CompareOp op : ops) {
+      std::vector<uint64_t> a((n + 63) / 64 + 1, ~uint64_t{0});
+      std::vector<uint64_t> b(a), c(a);
+      scan::compareInt64(ints.data(), n, op, 3, a.data());
+      scan::compareDouble(floats.data(), n, op, 1.5, b.data());
+      scan::compareInt64AsDouble(ints.data(), n, op, -2.5, c.data());
+      for (size_t i = 0; i < n; ++i) {
+        assert(bitAt(a, i) == expected(compareNumeric(ints[i], 3), op));
+        assert(bitAt(b, i) == expected(compareNumeric(floats[i], 1.5), op));
+        assert(bitAt(c, i) ==
+               expected(compareNumeric(static_cast<double>(ints[i]), -2.5),
+                        op));
+      }
+      for (size_t i = n; i < ((n + 63) / 64) * 64; ++i)
+        assert(!bitAt(a, i) && !bitAt(b, i) && !bitAt(c, i));
+      // Words past the output are untouched
+      assert(a.back() == ~uint64_t{0});
+    }
+  }
+  const std::string isa = scan::kernelIsa();
+  assert(isa == "avx2" || isa == "neon" || isa == "scalar");
+
+  std::vector<uint64_t> bits = {0x8000000000000001ull, 0, 0x10};
+  std::vector<size_t> seen;
+  scan::forEachSetBit(bits.data(), bits.size(),
+                      [&](size_t i) { seen.push_back(i); });
+  assert((seen == std::vector<size_t>{0, 63, 132}));
+}
+
+// The bucket kernel matches a row-at-a-time fold, over runs long and short,
+// NaN and invalid values, and buckets before the origin
+static void testBucketKernel() {
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  for (size_t n : {0u, 1u, 7u, 64u, 130u, 5000u}) {
+    std::vector<int64_t> ts(n);
+    std::vector<double> vals(n);
+    std::vector<uint64_t> valid((n + 63) / 64, 0);
+    for (size_t i = 0; i < n; ++i) {
+      ts[i] = static_cast<int64_t>(i * 3 + i % 2) - 400;
+      vals[i] = (i % 101 == 5) ? nan : static_cast<double>(i % 23) / 2.0;
+      if (i % 9 != 4)
+        valid[i / 64] |= uint64_t{1} << (i % 64);
+    }
+    for (int64_t width : {1, 5, 60, 1000}) {
+      for (bool useValidity : {false, true}) {
+        std::vector<scan::BucketAggregate> got;
+        scan::bucketAggregate(ts.data(), vals.data(),
+                              useValidity ? valid.data() : nullptr, n, 10,
+                              width, got);
+        std::vector<scan::BucketAggregate> want;
+        for (size_t i = 0; i < n; ++i) {
+          int64_t q = (ts[i] - 10) / width;
+          if ((ts[i] - 10) % width != 0 && ts[i] < 10)
+            --q;
+          if (want.empty() || want.back().bucketStart != 10 + q * width) {
+            want.emplace_back();
+            want.back().bucketStart = 10 + q * width;
+          }
+          auto &b = want.back();
+          ++b.rows;
+          if (useValidity && !((valid[i / 64] >> (i % 64)) & 1u))
+            continue;
+          ++b.values;
+          b.sum += vals[i];
+          if (vals[i] < b.min)
+            b.min = vals[i];
+          if (vals[i] > b.max)
+            b.max = vals[i];
+        }
+        assert(got.size() == want.size());
+        for (size_t b = 0; b < got.size(); ++b) {
+          assert(got[b].bucketStart == want[b].bucketStart);
+          assert(got[b].rows == want[b].rows);
+          assert(got[b].values == want[b].values);
+          assert(got[b].min == want[b].min && got[b].max == want[b].max);
+          assert(std::isnan(want[b].sum) ? std::isnan(got[b].sum)
+                                         : got[b].sum == want[b].sum);
+        }
+      }
+    }
+    std::vector<scan::BucketAggregate> rows;
+    scan::bucketAggregate(ts.data(), nullptr, nullptr, n, 0, 100, rows);
+    int64_t total = 0;
+    for (const auto &b : rows)
+      total += b.rows;
+    assert(total == static_cast<int64_t>(n));
+  }
+
+  // Sorted and shuffled timestamps bucket alike
+  std::vector<int64_t> ts;
+  std::vector<double> vals;
+  for (int64_t t = 0; t < 10000; ++t) {
+    ts.push_back(t);
+    vals.push_back(static_cast<double>(t % 7));
+  }
+  GpuTimeBucketAggSpec spec;
+  spec.timestamps = ts.data();
+  spec.values = vals.data();
+  spec.count = ts.size();
+  spec.startInclusive = 150;
+  spec.endExclusive = 9050;
+  spec.bucketWidth = 300;
+  GpuTimeBucketAggResult sorted = gpuTimeBucketSumCount(spec);
+  std::reverse(ts.begin(), ts.end());
+  std::reverse(vals.begin(), vals.end());
+  GpuTimeBucketAggResult hashed = gpuTimeBucketSumCount(spec);
+  assert(sorted.bucketStart.size() == 30);
+  assert(sorted.bucketStart == hashed.bucketStart);
+  assert(sorted.sum == hashed.sum && sorted.count == hashed.count);
+  assert(sorted.bucketStart[0] == 150 && sorted.count.back() == 200);
+}
+
+// The offload model weighs the transfer against the CPU scan, and the filter
+// returns the same rows on either side
+static void testGpuOffload() {
+  assert(!gpuOffloadPays(1000, 8));
+  GpuOffloadModel slowCpu;
+  slowCpu.cpuBytesPerSecond = 1e6;
+  assert(gpuOffloadPays(size_t{1} << 20, 8, slowCpu));
+  GpuOffloadModel slowBus;
+  slowBus.busBytesPerSecond = 1e6;
+  assert(!gpuOffloadPays(size_t{1} << 24, 8, slowBus));
+  if (!gpuStatus().available)
+    assert(!gpuShouldOffload(size_t{1} << 30, 8));
+
+  std::vector<int64_t> col(3000);
+  for (size_t i = 0; i < col.size(); ++i)
+    col[i] = static_cast<int64_t>(i % 17);
+  GpuScanSpec spec;
+  spec.column = col.data();
+  spec.count = col.size();
+  spec.op = GpuScanSpec::Op::Ge;
+  spec.rhs = 15;
+  std::vector<size_t> hits = gpuScanFilterInt64(spec);
+  assert(hits.size() == 2 * (3000 / 17));
+  for (size_t i : hits)
+    assert(col[i] >= 15);
+  std::vector<uint64_t> bits((col.size() + 63) / 64);
+  Status st = gpuCompareInt64(spec, bits.data());
+  if (st.ok()) {
+    size_t set = 0;
+    scan::forEachSetBit(bits.data(), bits.size(), [&](size_t) { ++set; });
+    assert(set == hits.size());
+  } else {
+    assert(st.code() == StatusCode::FailedPrecondition);
+  }
+}
+
+static std::optional<Predicate> where(Predicate p) {
+  std::optional<Predicate> w;
+  w.emplace(std::move(p));
+  return w;
+}
+
+// Batched columnar scans spanning several batches return the same rows as
+// the row store
+static void testColumnarMatchesRowStore() {
+  std::vector<Column> cols;
+  cols.push_back(Column{"id", ColumnType::Integer, false, true, {}});
+  cols.push_back(Column{"x", ColumnType::Float, true, false, {}});
+  cols.push_back(Column{"flag", ColumnType::Boolean, true, false, {}});
+  TableSchema schema(cols, std::optional<std::string>("id"));
+  ColumnarRelationalStorage col;
+  InMemoryRelationalStorage row;
+  assert(col.createTable("t", schema).ok());
+  assert(row.createTable("t", schema).ok());
+  for (int64_t i = 0; i < 3000; ++i) {
+    Row r(3);
+    r.set(0, ValueFactory::createInteger(i));
+    if (i % 13 != 0)
+      r.set(1, ValueFactory::createFloat(static_cast<double>(i % 97)));
+    if (i % 5 != 0)
+      r.set(2, ValueFactory::createBoolean(i % 3 == 0));
+    assert(col.insertRow("t", r).ok());
+    assert(row.insertRow("t", r).ok());
+  }
+  assert(col.deleteRows("t", where(cmp("id", Predicate::Op::Lt,
+                                       ValueFactory::createInteger(100))))
+             .value() == 100);
+  assert(row.deleteRows("t", where(cmp("id", Predicate::Op::Lt,
+                                       ValueFactory::createInteger(100))))
+             .value() == 100);
+
+  using Op = Predicate::Op;
+  std::vector<std::optional<Predicate>> preds;
+  auto add = [&](Predicate p) { preds.push_back(where(std::move(p))); };
+  add(cmp("x", Op::Ge, ValueFactory::createInteger(50)));
+  add(cmp("x", Op::Lt, ValueFactory::createFloat(10.5)));
+  add(cmp("id", Op::Gt, ValueFactory::createFloat(2500.5)));
+  add(cmp("flag", Op::Le, ValueFactory::createBoolean(false)));
+  add(Not(cmp("flag", Op::Eq, ValueFactory::createBoolean(true))));
+  add(cmp("id", Op::Eq, ValueFactory::createString("1")));
+  {
+    std::vector<Predicate> kids;
+    kids.push_back(cmp("id", Op::Ge, ValueFactory::createInteger(1000)));
+    kids.push_back(cmp("x", Op::Ne, ValueFactory::createFloat(3.0)));
+    std::vector<Predicate> alt;
+    alt.push_back(And(std::move(kids)));
+    alt.push_back(cmp("flag", Op::Eq, ValueFactory::createBoolean(true)));
+    add(Or(std::move(alt)));
+  }
+  for (const auto &p : preds) {
+    auto a = col.select("t", {"id"}, p);
+    auto b = row.select("t", {"id"}, p);
+    assert(a.hasValue() && b.hasValue());
+    assert(a.value().rowCount() == b.value().rowCount());
+    for (size_t i = 0; i < a.value().rowCount(); ++i)
+      assert(a.value().at(i, 0).asInt() == b.value().at(i, 0).asInt());
+  }
+}
+
+// Low-cardinality string columns are kept as dictionary codes and match the
+// row store through updates, deletes and compaction; a column with too many
+// distinct values moves to the arena form
+static void testDictionaryStrings() {
+  const uint32_t codes[] = {2, 0, 1, 2, 2, 1, 0};
+  const uint8_t hits[] = {0, 1, 1};
+  std::vector<uint64_t> bits(1, ~uint64_t{0});
+  scan::lookupCodes(codes, 7, hits, bits.data());
+  assert(bits[0] == 0x3Dull);
+
+  std::vector<Column> cols;
+  cols.push_back(Column{"id", ColumnType::Integer, false, true, {}});
+  cols.push_back(Column{"ward", ColumnType::String, true, false, {}});
+  TableSchema schema(cols, std::optional<std::string>("id"));
+  ColumnarRelationalStorage col;
+  InMemoryRelationalStorage row;
+  assert(col.createTable("t", schema).ok());
+  assert(row.createTable("t", schema).ok());
+  const char *wards[] = {"east", "north", "south", "west", "icu"};
+  for (int64_t i = 0; i < 3000; ++i) {
+    Row r(2);
+    r.set(0, ValueFactory::createInteger(i));
+    if (i % 11 != 0)
+      r.set(1, ValueFactory::createString(wards[i % 5]));
+    assert(col.insertRow("t", r).ok());
+    assert(row.insertRow("t", r).ok());
+  }
+  using Op = Predicate::Op;
+  for (RelationalStorage *s : {static_cast<RelationalStorage *>(&col),
+                               static_cast<RelationalStorage *>(&row)}) {
+    std::unordered_map<std::string, std::unique_ptr<Value>> set;
+    set["ward"] = ValueFactory::createString("recovery");
+    assert(s->updateRows("t", set,
+                         where(cmp("ward", Op::Eq,
+                                   ValueFactory::createString("icu"))))
+               .ok());
+    assert(s->deleteRows("t", where(cmp("id", Op::Lt,
+                                        ValueFactory::createInteger(1600))))
+               .value() == 1600);
+  }
+
+  std::vector<std::optional<Predicate>> preds;
+  auto add = [&](Predicate p) { preds.push_back(where(std::move(p))); };
+  add(cmp("ward", Op::Eq, ValueFactory::createString("north")));
+  add(cmp("ward", Op::Ne, ValueFactory::createString("north")));
+  add(cmp("ward", Op::Eq, ValueFactory::createString("icu")));
+  add(cmp("ward", Op::Eq, ValueFactory::createString("nowhere")));
+  add(cmp("ward", Op::Lt, ValueFactory::createString("recovery")));
+  add(cmp("ward", Op::Ge, ValueFactory::createString("south")));
+  add(Not(cmp("ward", Op::Eq, ValueFactory::createString("west"))));
+  // Updated rows move in the row store: compare (id, ward) sets
+  auto pairs = [](RelationalStorage &s, const std::optional<Predicate> &p) {
+    std::vector<std::pair<int64_t, std::string>> out;
+    for (const auto &r : s.select("t", {}, p).takeValue()) {
+      const Value *w = r.values()[1].get();
+      out.emplace_back(r.values()[0]->asInt(), w ? w->asString() : "<null>");
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+  };
+  for (const auto &p : preds)
+    assert(pairs(col, p) == pairs(row, p));
+
+  using Vec = ColumnarRelationalStorage::ColumnVector;
+  Vec v;
+  v.type = ColumnType::String;
+  for (size_t i = 0; i < Vec::kMaxDictionaryEntries; ++i) {
+    auto s = ValueFactory::createString("k" + std::to_string(i));
+    v.append(s.get());
+    assert(v.strDictEncoded);
+  }
+  v.append(nullptr); // interns "", one entry too many
+  assert(!v.strDictEncoded && v.strDict.empty());
+  auto last = ValueFactory::createString("last");
+  v.append(last.get());
+  assert(v.size == Vec::kMaxDictionaryEntries + 2);
+  assert(v.get(7)->asString() == "k7" && !v.get(v.size - 2));
+  assert(v.get(v.size - 1)->asString() == "last");
+}
+
+int main() {
+  testKernels();
+  testBucketKernel();
+  testGpuOffload();
+  testColumnarMatchesRowStore();
+  testDictionaryStrings();
+  return 0;
+}
@@ -71,6 +71,130 @@ TEST(Serialization, SchemaRoundTripBinary) {
   EXPECT_EQ(ts2.primaryKey().value(), "id");
 }
 
+static std::string rowBytes(const Row &row) {
+  std::ostringstream os(std::ios::binary);
+  bin::writeRow(row, os);
+  return os.str();
+}
+
+static Row fromBytes(const std::string &bytes) {
+  std::istringstream is(bytes, std::ios::binary);
+  return bin::readRow(is);
+}
+
+TEST(Serialization, CompactIntegersAndBooleans) {
+  // Small integers take a tag and one varint byte; booleans only a tag
+  for (int64_t x : std::vector<int64_t>{0, 1, -1, 63, -64}) {
+    std::ostringstream os(std::ios::binary);
+    bin::writeValue(*ValueFactory::createInteger(x), os);
+    EXPECT_EQ(os.str().size(), 2u) << x;
+  }
+  for (int64_t x :
+       std::vector<int64_t>{INT64_MIN, INT64_MAX, -1000000, 1LL << 40}) {
+    std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+    bin::writeValue(*ValueFactory::createInteger(x), ss);
+    EXPECT_EQ(bin::readValue(ss)->asInt(), x);
+  }
+  for (bool b : {false, true}) {
+    std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+    bin::writeValue(*ValueFactory::createBoolean(b), ss);
+    EXPECT_EQ(ss.str().size(), 1u);
+    EXPECT_EQ(bin::readValue(ss)->asBool(), b);
+  }
+
+  // A row of ten small counters: header, counts, one type run, payloads
+  Row counters(10);
+  for (size_t i = 0; i < 10; ++i)
+    counters.set(i, ValueFactory::createInteger(static_cast<int64_t>(i)));
+  EXPECT_EQ(rowBytes(counters).size(), 5u + 2 + 2 + 10);
+  // Booleans pack eight to a byte
+  Row flags(16);
+  for (size_t i = 0; i < 16; ++i)
+    flags.set(i, ValueFactory::createBoolean(i % 3 == 0));
+  EXPECT_EQ(rowBytes(flags).size(), 5u + 2 + 2 + 2);
+}
+
+TEST(Serialization, RowAndDocumentVersion2RoundTrip) {
+  Row row(9);
+  row.set(0, ValueFactory::createInteger(-5));
+  row.set(1, ValueFactory::createBoolean(true));
+  row.set(2, ValueFactory::createBoolean(false));
+  row.set(4, ValueFactory::createString(std::string(300, 's')));
+  row.set(5, ValueFactory::createFloat(2.5));
+  row.set(6, ValueFactory::createNull());
+  row.set(7, ValueFactory::createBoolean(true));
+  row.set(8, ValueFactory::createInteger(INT64_MIN));
+  const std::string bytes = rowBytes(row);
+  EXPECT_EQ(static_cast<uint8_t>(bytes[4]), serialization_constants::VERSION);
+  Row back = fromBytes(bytes);
+  ASSERT_EQ(back.size(), row.size());
+  for (size_t i = 0; i < row.size(); ++i) {
+    const Value *want = row.values()[i].get();
+    const Value *got = back.values()[i].get();
+    ASSERT_EQ(want == nullptr, got == nullptr) << i;
+    if (want) {
+      EXPECT_EQ(want->type(), got->type()) << i;
+      EXPECT_TRUE(want->type() == ValueType::Null || want->equals(*got)) << i;
+    }
+  }
+  EXPECT_EQ(fromBytes(rowBytes(Row(0))).size(), 0u);
+
+  Document doc;
+  doc["n"] = ValueFactory::createInteger(300);
+  doc["ok"] = ValueFactory::createBoolean(true);
+  doc["name"] = ValueFactory::createString("x");
+  doc["none"] = nullptr;
+  std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+  bin::writeDocument(doc, ss);
+  Document d2 = bin::readDocument(ss);
+  ASSERT_EQ(d2.size(), 4u);
+  EXPECT_EQ(d2.at("n")->asInt(), 300);
+  EXPECT_TRUE(d2.at("ok")->asBool());
+  EXPECT_EQ(d2.at("name")->asString(), "x");
+  EXPECT_EQ(d2.at("none"), nullptr);
+
+  // Truncation and runs that do not cover the row are rejected
+  EXPECT_THROW(fromBytes(bytes.substr(0, bytes.size() - 1)),
+               SerializationError);
+  std::string bad = bytes;
+  bad[6] = 12; // more runs than cells
+  EXPECT_THROW(fromBytes(bad), SerializationError);
+}
+
+TEST(Serialization, ReadsVersion1) {
+  // Written by version 1: [magic][1][u32 n] then per cell a null flag and
+  // a tagged value with fixed-width payloads
+  std::string v1;
+  auto put = [&](const void *p, size_t n) {
+    v1.append(static_cast<const char *>(p), n);
+  };
+  const uint32_t magic = serialization_constants::MAGIC;
+  const uint8_t version = 1;
+  const uint32_t cells = 3;
+  const int64_t x = 42;
+  put(&magic, 4);
+  put(&version, 1);
+  put(&cells, 4);
+  v1 += '\0';
+  v1 += static_cast<char>(ValueType::Integer);
+  put(&x, 8);
+  v1 += '\1'; // nullptr
+  v1 += '\0';
+  v1 += static_cast<char>(ValueType::Boolean);
+  v1 += '\1';
+  Row row = fromBytes(v1);
+  ASSERT_EQ(row.size(), 3u);
+  EXPECT_EQ(row.at(0).asInt(), 42);
+  EXPECT_EQ(row.values()[1], nullptr);
+  EXPECT_TRUE(row.at(2).asBool());
+
+  std::istringstream value(v1.substr(10, 9), std::ios::binary);
+  EXPECT_EQ(bin::readValue(value, 1)->asInt(), 42);
+  std::string future = v1;
+  future[4] = static_cast<char>(serialization_constants::VERSION + 1);
+  EXPECT_THROW(fromBytes(future), SerializationError);
+}
+
 TEST(Serialization, ValueRoundTripJSON) {
   auto v = ValueFactory::createString("json");
   auto s = json::toJson(*v);
@@ -91,3 +215,103 @@ TEST(Serialization, RowRoundTripJSON) {
   EXPECT_EQ(r2.at(1).type(), ValueType::Null);
   EXPECT_EQ(static_cast<const BooleanValue &>(r2.at(2)).value(), false);
 }
+
+TEST(Serialization, RowBatchRoundTripBinary) {
+  // Typed columns with nullptr gaps, a column mixing integers and floats,
+  // one holding Null values and one with no cells at all
+  std::vector<Row> rows;
+  for (int i = 0; i < 100; ++i) {
+    Row r(6);
+    r.set(0, ValueFactory::createInteger(i * 1000003LL));
+    if (i % 3)
+      r.set(1, ValueFactory::createString(std::string(i % 40, 'a' + i % 26)));
+    r.set(2, ValueFactory::createBoolean(i % 2 == 0));
+    if (i % 2)
+      r.set(3, ValueFactory::createFloat(i * 0.25));
+    else
+      r.set(3, ValueFactory::createInteger(-i));
+    r.set(4, ValueFactory::createNull());
+    rows.push_back(std::move(r));
+  }
+  std::string buf;
+  bin::writeRowBatch(rows, buf);
+  const size_t first = buf.size();
+  bin::writeRowBatch({}, buf);
+
+  size_t used = 0;
+  std::vector<Row> back = bin::readRowBatch(buf.data(), buf.size(), &used);
+  ASSERT_EQ(used, first);
+  ASSERT_EQ(back.size(), rows.size());
+  for (size_t r = 0; r < rows.size(); ++r) {
+    ASSERT_EQ(back[r].size(), 6u);
+    for (size_t c = 0; c < 6; ++c) {
+      const Value *want = rows[r].values()[c].get();
+      const Value *got = back[r].values()[c].get();
+      ASSERT_EQ(want == nullptr, got == nullptr) << r << "," << c;
+      if (want) {
+        EXPECT_EQ(want->type(), got->type());
+        EXPECT_TRUE(want->type() == ValueType::Null || want->equals(*got));
+      }
+    }
+  }
+  EXPECT_TRUE(
+      bin::readRowBatch(buf.data() + used, buf.size() - used).empty());
+
+  // Truncated input and ragged rows are rejected
+  EXPECT_THROW(bin::readRowBatch(buf.data(), first - 1), SerializationError);
+  std::vector<Row> ragged;
+  ragged.emplace_back(2);
+  ragged.emplace_back(3);
+  std::string out;
+  EXPECT_THROW(bin::writeRowBatch(ragged, out), SerializationError);
+}
+
+TEST(Serialization, DocumentRoundTripJSON) {
+  Document doc;
+  doc["name"] = ValueFactory::createString("quote \" slash \\ tab\t bell\a");
+  doc["caf\xC3\xA9"] = ValueFactory::createString("\xE2\x82\xAC 5");
+  doc["ratio"] = ValueFactory::createFloat(0.1 + 0.2);
+  doc["count"] = ValueFactory::createInteger(-9007199254740993LL);
+  doc["ok"] = ValueFactory::createBoolean(true);
+  doc["none"] = nullptr;
+
+  // One buffer reused across documents
+  std::string buf;
+  json::appendJson(doc, buf);
+  EXPECT_EQ(buf, json::toJson(doc));
+  Document back = json::documentFromJson(buf);
+  ASSERT_EQ(back.size(), doc.size());
+  for (const auto &kv : doc) {
+    auto it = back.find(kv.first);
+    ASSERT_NE(it, back.end()) << kv.first;
+    ASSERT_EQ(kv.second == nullptr, it->second == nullptr);
+    if (kv.second)
+      EXPECT_TRUE(kv.second->equals(*it->second)) << kv.first;
+  }
+  buf.clear();
+  json::appendJson(Document{}, buf);
+  EXPECT_EQ(buf, "{}");
+}
+
+TEST(Serialization, JSONParserAcceptsStandardForms) {
+  // Whitespace, key order, escapes and unknown fields
+  auto doc = json::documentFromJson(
+      " { \"a\" : { \"v\" : \"x\\u00e9\\ud83d\\ude00\\/\" , \"t\" : "
+      "\"string\" } ,\n \"b\" : {\"t\":\"float\",\"x\":[1,{\"y\":2}],"
+      "\"v\":2.5e3} , \"c\": null } ");
+  EXPECT_EQ(doc.at("a")->asString(), "x\xC3\xA9\xF0\x9F\x98\x80/");
+  EXPECT_EQ(doc.at("b")->asFloat(), 2500.0);
+  EXPECT_EQ(doc.at("c"), nullptr);
+
+  Row row = json::rowFromJson("{\"version\":1,\"values\":[null,"
+                              "{\"t\":\"int\",\"v\":7}]}");
+  ASSERT_EQ(row.size(), 2u);
+  EXPECT_EQ(row.values()[0], nullptr);
+  EXPECT_EQ(row.at(1).asInt(), 7);
+
+  EXPECT_THROW(json::documentFromJson("{\"a\":"), SerializationError);
+  EXPECT_THROW(json::documentFromJson("{\"a\":{\"t\":\"int\",\"v\":\"7\"}}"),
+               SerializationError);
+  EXPECT_THROW(json::fromJson("{\"t\":\"int\",\"v\":1} x"),
+               SerializationError);
+}
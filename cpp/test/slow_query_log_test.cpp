@@ -0,0 +1,172 @@
+#include "kadedb/kadeql.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/schema.h"
+#include "kadedb/slow_query_log.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+
+static ResultSet run(QueryExecutor &exec, const std::string &q) {
+  auto res = exec.execute(*parseQuery(q));
+  assert(res.hasValue());
+  return res.takeValue();
+}
+
+static bool contains(const std::string &s, const std::string &part) {
+  return s.find(part) != std::string::npos;
+}
+
+static SlowQueryEntry entry(uint64_t durationUs) {
+  SlowQueryEntry e;
+  e.durationUs = durationUs;
+  return e;
+}
+
+// p(id, ward): 40 patients, every fourth in "icu"
+static void fill(RelationalStorage &st) {
+  TableSchema p({Column{"id", ColumnType::Integer, false, false, {}},
+                 Column{"ward", ColumnType::String, true, false, {}}});
+  assert(st.createTable("p", p).ok());
+  for (int64_t i = 0; i < 40; ++i) {
+    Row r(2);
+    r.set(0, ValueFactory::createInteger(i));
+    r.set(1, ValueFactory::createString(i % 4 ? "gen" : "icu"));
+    assert(st.insertRow("p", r).ok());
+  }
+}
+
+int main() {
+  std::cout << "=== Slow Query Log Tests ===" << std::endl;
+
+  std::cout << "Test 1: fingerprints..." << std::endl;
+  {
+    const std::string a =
+        SlowQueryLog::fingerprint("SELECT id FROM p WHERE ward = 'icu' AND "
+                                  "hr > -12.5 AND c2 = $1");
+    assert(a == "SELECT id FROM p WHERE ward = ? AND hr > ? AND c2 = $1");
+    assert(SlowQueryLog::fingerprint("INSERT INTO p VALUES (1, 'a', 3.0)") ==
+           "INSERT INTO p VALUES (?)");
+    assert(SlowQueryLog::fingerprint("INSERT INTO p VALUES (7, 'it\\'s')") ==
+           SlowQueryLog::fingerprint("INSERT INTO p VALUES (8, 'b')"));
+    assert(SlowQueryLog::fingerprintHash("x") ==
+           SlowQueryLog::fingerprintHash("x"));
+    assert(SlowQueryLog::fingerprintHash("x") !=
+           SlowQueryLog::fingerprintHash("y"));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: ring buffer..." << std::endl;
+  {
+    SlowQueryLog log(3);
+    assert(!log.enabled() && !log.isSlow(1'000'000));
+    log.setThreshold(std::chrono::microseconds(100));
+    assert(log.enabled() && log.isSlow(100) && !log.isSlow(99));
+    for (uint64_t d = 1; d <= 5; ++d)
+      log.record(entry(d));
+    auto es = log.entries();
+    assert(es.size() == 3);
+    assert(es[0].id == 3 && es[1].id == 4 && es[2].id == 5);
+    assert(es[0].durationUs == 3 && es[2].durationUs == 5);
+    // Shrinking keeps the newest, growing keeps them all
+    log.setCapacity(2);
+    es = log.entries();
+    assert(es.size() == 2 && es[0].id == 4 && es[1].id == 5);
+    log.setCapacity(4);
+    log.record(entry(6));
+    es = log.entries();
+    assert(es.size() == 3 && es[2].id == 6);
+    log.clear();
+    assert(log.entries().empty());
+    log.disable();
+    assert(!log.enabled());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: executor logging..." << std::endl;
+  {
+    InMemoryRelationalStorage st;
+    fill(st);
+    SlowQueryLog log;
+    QueryExecutor exec(st);
+    exec.setSlowQueryLog(log);
+
+    // Off: nothing is logged
+    run(exec, "SELECT id FROM p WHERE ward = 'icu'");
+    assert(log.entries().empty());
+
+    log.setThreshold(std::chrono::microseconds(0));
+    auto rs = run(exec, "SELECT id FROM p WHERE ward = 'icu'");
+    assert(rs.rowCount() == 10);
+    run(exec, "UPDATE p SET ward = 'icu' WHERE id = 1");
+    assert(!exec.execute(*parseQuery("SELECT nope FROM p")).hasValue());
+    run(exec, "EXPLAIN SELECT id FROM p");
+
+    const auto es = log.entries();
+    assert(es.size() == 4);
+    const SlowQueryEntry &sel = es[0];
+    assert(contains(sel.query, "SELECT") && contains(sel.query, "icu"));
+    assert(!contains(sel.fingerprint, "icu") && contains(sel.fingerprint, "?"));
+    assert(sel.fingerprintHash ==
+           SlowQueryLog::fingerprintHash(sel.fingerprint));
+    assert(contains(sel.plan, "Scan") && contains(sel.plan, "ward"));
+    assert(sel.rowsScanned >= 10 && sel.rowsReturned == 10);
+    assert(sel.allocations > 0 && sel.bytesAllocated > 0);
+    assert(sel.status == "OK" && sel.startedAtUs > 0);
+
+    const SlowQueryEntry &upd = es[1];
+    assert(contains(upd.query, "UPDATE") && upd.rowsReturned == 1);
+    assert(!upd.plan.empty());
+    assert(es[2].status != "OK");
+    // EXPLAIN is one statement, not two
+    assert(contains(es[3].query, "EXPLAIN"));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: system table..." << std::endl;
+  {
+    InMemoryRelationalStorage st;
+    fill(st);
+    SlowQueryLog log;
+    QueryExecutor exec(st);
+    exec.setSlowQueryLog(log);
+    log.setThreshold(std::chrono::microseconds(0));
+    run(exec, "SELECT id FROM p WHERE id < 5");
+    run(exec, "SELECT id FROM p WHERE id < 7");
+    run(exec, "SELECT ward FROM p");
+
+    auto all = run(exec, "SELECT * FROM kadedb_slow_queries");
+    assert(all.columnCount() == 12 && all.rowCount() == 3);
+    assert(all.at(0, all.findColumn("id")).asInt() == 1);
+    assert(all.at(1, all.findColumn("rows_returned")).asInt() == 7);
+    // The first two share a fingerprint
+    const size_t fp = all.findColumn("fingerprint_hash");
+    assert(all.at(0, fp).asString() == all.at(1, fp).asString());
+    assert(all.at(0, fp).asString() != all.at(2, fp).asString());
+    assert(all.at(0, fp).asString().size() == 16);
+
+    auto some = run(exec, "SELECT query, rows_returned FROM "
+                          "kadedb_slow_queries WHERE rows_returned > 10");
+    assert(some.columnCount() == 2 && some.rowCount() == 1);
+    assert(contains(some.at(0, 0).asString(), "ward"));
+    assert(some.at(0, 1).asInt() == 40);
+
+    assert(!exec.execute(*parseQuery("SELECT nope FROM kadedb_slow_queries"))
+                .hasValue());
+    // A user table of the same name takes precedence
+    TableSchema own({Column{"x", ColumnType::Integer, false, false, {}}});
+    assert(st.createTable(SlowQueryLog::kTableName, own).ok());
+    assert(run(exec, "SELECT * FROM kadedb_slow_queries").rowCount() == 0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "All slow query log tests passed." << std::endl;
+  return 0;
+}
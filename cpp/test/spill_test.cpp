@@ -0,0 +1,222 @@
+#include "kadedb/kadeql.h"
+#include "kadedb/physical_plan.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+
+// o(id, cust, amt): 3000 orders over 500 customers, every 11th amount null;
+// c(cust, region): customers c0..c539, of which c500.. have no orders, and
+// one with a null name
+static void fill(RelationalStorage &st) {
+  TableSchema o({Column{"id", ColumnType::Integer, false, false, {}},
+                 Column{"cust", ColumnType::String, true, false, {}},
+                 Column{"amt", ColumnType::Integer, true, false, {}}});
+  assert(st.createTable("o", o).ok());
+  for (int64_t i = 0; i < 3000; ++i) {
+    Row r(3);
+    r.set(0, ValueFactory::createInteger(i));
+    r.set(1, ValueFactory::createString("c" + std::to_string(i * 7919 % 500)));
+    if (i % 11 != 0)
+      r.set(2, ValueFactory::createInteger(i % 37));
+    assert(st.insertRow("o", r).ok());
+  }
+  TableSchema c({Column{"cust", ColumnType::String, true, false, {}},
+                 Column{"region", ColumnType::String, true, false, {}}});
+  assert(st.createTable("c", c).ok());
+  for (int64_t i = 0; i <= 540; ++i) {
+    Row r(2);
+    if (i < 540)
+      r.set(0, ValueFactory::createString("c" + std::to_string(i)));
+    r.set(1, ValueFactory::createString("region-" + std::to_string(i % 7)));
+    assert(st.insertRow("c", r).ok());
+  }
+}
+
+// Rows rendered as "a|b|c" in result order
+static std::vector<std::string> rows(QueryExecutor &exec,
+                                     const std::string &q) {
+  auto res = exec.execute(*parseQuery(q));
+  assert(res.hasValue());
+  const ResultSet &rs = res.value();
+  std::vector<std::string> out;
+  for (size_t i = 0; i < rs.rowCount(); ++i) {
+    std::string line;
+    for (const auto &v : rs.row(i).values())
+      line += (v ? v->toString() : "null") + "|";
+    out.push_back(line);
+  }
+  return out;
+}
+
+static std::vector<std::string> sorted(std::vector<std::string> v) {
+  std::sort(v.begin(), v.end());
+  return v;
+}
+
+// EXPLAIN ANALYZE detail of the stage named `op`
+static std::string analyzed(QueryExecutor &exec, const std::string &q,
+                            const std::string &op) {
+  auto res = exec.execute(*parseQuery("EXPLAIN ANALYZE " + q));
+  assert(res.hasValue());
+  const ResultSet &rs = res.value();
+  for (size_t i = 0; i < rs.rowCount(); ++i)
+    if (rs.row(i).values()[1]->asString() == op)
+      return rs.row(i).values()[2]->asString();
+  return "";
+}
+
+static SpillOptions budget(size_t bytes, std::string directory = {}) {
+  SpillOptions options;
+  options.memoryBudget = bytes;
+  options.directory = std::move(directory);
+  options.partitions = 4;
+  return options;
+}
+
+int main() {
+  std::cout << "=== Spill Tests ===" << std::endl;
+
+  InMemoryRelationalStorage st;
+  fill(st);
+  QueryExecutor plain(st);
+  QueryExecutor spilling(st);
+  spilling.setSpillOptions(budget(16 * 1024));
+  QueryExecutor tiny(st);
+  tiny.setSpillOptions(budget(1));
+
+  std::cout << "Test 1: spill files..." << std::endl;
+  {
+    auto created = SpillFile::create("");
+    assert(created.hasValue());
+    auto file = created.takeValue();
+    for (int64_t i = 0; i < 600; ++i) {
+      Cells row;
+      row.push_back(ValueFactory::createInteger(i));
+      row.push_back(i % 3 == 0 ? nullptr
+                               : ValueFactory::createString(
+                                     std::string(static_cast<size_t>(i % 50),
+                                                 'x')));
+      assert(file->append(std::move(row)).ok());
+    }
+    assert(file->rows() == 600);
+    std::vector<Cells> batch;
+    int64_t next = 0;
+    for (assert(file->read(batch).ok()); !batch.empty();
+         assert(file->read(batch).ok())) {
+      assert(batch.size() <= SpillFile::kBatchRows);
+      for (const auto &row : batch) {
+        assert(row[0]->asInt() == next);
+        assert((next % 3 == 0) == !row[1]);
+        if (row[1])
+          assert(row[1]->asString().size() == static_cast<size_t>(next % 50));
+        ++next;
+      }
+    }
+    assert(next == 600 && file->bytes() > 0);
+    Cells late;
+    late.push_back(ValueFactory::createInteger(1));
+    assert(!file->append(std::move(late)).ok());
+    assert(!SpillFile::create("/nonexistent/kadedb-spill").hasValue());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: external merge sort..." << std::endl;
+  {
+    // Many ties: the merge has to keep the input order among them
+    const std::string q = "SELECT id, cust, amt FROM o ORDER BY amt DESC, cust";
+    const auto expected = rows(plain, q);
+    assert(expected.size() == 3000);
+    assert(rows(spilling, q) == expected);
+    // One row per run: the runs are merged in levels
+    assert(rows(tiny, q) == expected);
+    const std::string detail = analyzed(spilling, q, "Sort");
+    assert(detail.find("spilled ") != std::string::npos);
+    // Top-K keeps its bounded heap
+    const std::string top = q + " LIMIT 5";
+    assert(rows(tiny, top) == rows(plain, top));
+    assert(analyzed(tiny, top, "Sort").find("spilled") == std::string::npos);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: partitioned aggregation..." << std::endl;
+  {
+    for (const std::string q :
+         {"SELECT cust, COUNT(*), SUM(amt), MIN(id), MAX(amt), AVG(amt) "
+          "FROM o GROUP BY cust",
+          "SELECT amt, COUNT(*) FROM o GROUP BY amt",
+          "SELECT cust, COUNT(*) FROM o WHERE id > 100 GROUP BY cust "
+          "HAVING COUNT(*) > 5 ORDER BY cust"}) {
+      const auto expected = rows(plain, q);
+      assert(!expected.empty());
+      // Same groups in the same order as without a budget
+      assert(rows(spilling, q) == expected);
+      assert(rows(tiny, q) == expected);
+    }
+    const std::string detail = analyzed(
+        spilling, "SELECT cust, COUNT(*) FROM o GROUP BY cust",
+        "HashAggregate");
+    assert(detail.find("spilled ") != std::string::npos);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: grace hash join..." << std::endl;
+  {
+    for (const std::string q :
+         {"SELECT o.id, c.region FROM o JOIN c ON o.cust = c.cust",
+          "SELECT o.id, c.region FROM o LEFT JOIN c ON o.cust = c.cust",
+          "SELECT c.cust, o.id FROM c LEFT JOIN o ON c.cust = o.cust"}) {
+      const auto expected = sorted(rows(plain, q));
+      assert(sorted(rows(spilling, q)) == expected);
+      assert(sorted(rows(tiny, q)) == expected);
+    }
+    // Unmatched customers, the null one included, are kept once
+    const auto left =
+        rows(tiny, "SELECT c.cust, o.id FROM c LEFT JOIN o ON c.cust = o.cust");
+    assert(std::count(left.begin(), left.end(), "null|null|") == 1);
+    assert(left.size() == 3000 + 41);
+    // With ORDER BY the output is the same as in memory
+    const std::string ordered =
+        "SELECT o.id, c.region FROM o JOIN c ON o.cust = c.cust ORDER BY o.id";
+    assert(rows(spilling, ordered) == rows(plain, ordered));
+    const std::string detail = analyzed(
+        spilling, "SELECT o.id, c.region FROM o JOIN c ON o.cust = c.cust",
+        "HashJoin");
+    assert(detail.find("spilled to ") != std::string::npos);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 5: spill directory..." << std::endl;
+  {
+    const auto dir =
+        std::filesystem::temp_directory_path() / "kadedb_spill_test";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    QueryExecutor exec(st);
+    exec.setSpillOptions(budget(8 * 1024, dir.string()));
+    const std::string q = "SELECT cust, COUNT(*) FROM o GROUP BY cust ORDER "
+                          "BY cust DESC";
+    assert(rows(exec, q) == rows(plain, q));
+    // Every file is gone once the query ends
+    assert(std::filesystem::is_empty(dir));
+    exec.setSpillOptions(budget(8 * 1024, (dir / "missing").string()));
+    auto res = exec.execute(*parseQuery(q));
+    assert(!res.hasValue() && res.status().code() == StatusCode::Internal);
+    std::filesystem::remove_all(dir);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "All spill tests passed." << std::endl;
+  return 0;
+}
@@ -0,0 +1,183 @@
+#include "kadedb/predicate_builder.h"
+#include "kadedb/storage.h"
+
+#include <cassert>
+#include <cmath>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+
+static TableSchema makeSchema(bool withPk) {
+  std::vector<Column> cols;
+  cols.push_back(Column{"id", ColumnType::Integer, false, true, {}});
+  cols.push_back(Column{"name", ColumnType::String, false, false, {}});
+  cols.push_back(Column{"score", ColumnType::Float, true, false, {}});
+  if (withPk)
+    return TableSchema(cols, std::optional<std::string>("id"));
+  return TableSchema(cols);
+}
+
+static Row makeRow(int64_t id, const std::string &name,
+                   std::optional<double> score) {
+  Row r(3);
+  r.set(0, ValueFactory::createInteger(id));
+  r.set(1, ValueFactory::createString(name));
+  if (score)
+    r.set(2, ValueFactory::createFloat(*score));
+  return r;
+}
+
+static std::optional<Predicate> where(Predicate p) {
+  std::optional<Predicate> w;
+  w.emplace(std::move(p));
+  return w;
+}
+
+static Predicate clonePred(const Predicate &p) {
+  Predicate out;
+  out.kind = p.kind;
+  out.column = p.column;
+  out.op = p.op;
+  out.rhs = p.rhs ? p.rhs->clone() : nullptr;
+  for (const auto &ch : p.children)
+    out.children.push_back(clonePred(ch));
+  return out;
+}
+
+static std::vector<int64_t> ids(RelationalStorage &rs, const std::string &t,
+                                const Predicate &p) {
+  auto res = rs.select(t, {"id"}, where(clonePred(p)));
+  assert(res.hasValue());
+  std::vector<int64_t> out;
+  for (size_t i = 0; i < res.value().rowCount(); ++i)
+    out.push_back(res.value().at(i, 0).asInt());
+  return out;
+}
+
+// Indexed table "ix" must answer every predicate exactly like table "scan"
+static void expectSame(RelationalStorage &rs, const Predicate &p) {
+  assert(ids(rs, "ix", p) == ids(rs, "scan", p));
+}
+
+int main() {
+  InMemoryRelationalStorage rs;
+  assert(rs.createTable("ix", makeSchema(true)).ok());
+  assert(rs.createTable("scan", makeSchema(false)).ok());
+  assert(rs.createIndex("ix", "name", IndexType::Hash).ok());
+  assert(rs.createIndex("ix", "score", IndexType::Ordered).ok());
+
+  // Error semantics
+  assert(rs.createIndex("nope", "id", IndexType::Hash).code() ==
+         StatusCode::NotFound);
+  assert(rs.createIndex("ix", "nope", IndexType::Hash).code() ==
+         StatusCode::InvalidArgument);
+  // Primary key is indexed automatically
+  assert(rs.createIndex("ix", "id", IndexType::Hash).code() ==
+         StatusCode::AlreadyExists);
+
+  for (int64_t i = 0; i < 200; ++i) {
+    std::optional<double> score;
+    if (i % 7 != 0)
+      score = static_cast<double>(i % 50) / 2.0;
+    for (const char *t : {"ix", "scan"})
+      assert(rs.insertRow(t, makeRow(i, "n" + std::to_string(i % 40), score))
+                 .ok());
+  }
+
+  auto I = [](int64_t v) { return ValueFactory::createInteger(v); };
+  auto F = [](double v) { return ValueFactory::createFloat(v); };
+  auto S = [](const std::string &v) { return ValueFactory::createString(v); };
+  using Op = Predicate::Op;
+
+  std::vector<Predicate> preds;
+  preds.push_back(cmp("id", Op::Eq, I(42)));
+  preds.push_back(cmp("id", Op::Eq, I(4242)));
+  preds.push_back(cmp("id", Op::Eq, F(42.0)));
+  preds.push_back(cmp("id", Op::Eq, F(42.5)));
+  preds.push_back(cmp("id", Op::Lt, F(10.5)));
+  preds.push_back(cmp("id", Op::Ge, I(190)));
+  preds.push_back(cmp("id", Op::Gt, I(190)));
+  preds.push_back(cmp("id", Op::Le, I(3)));
+  preds.push_back(cmp("id", Op::Eq, S("42")));
+  preds.push_back(cmp("id", Op::Lt, S("42")));
+  preds.push_back(cmp("name", Op::Eq, S("n7")));
+  preds.push_back(cmp("name", Op::Gt, S("n7")));
+  preds.push_back(cmp("score", Op::Eq, I(12)));
+  preds.push_back(cmp("score", Op::Le, F(1.0)));
+  preds.push_back(cmp("score", Op::Gt, I(20)));
+  {
+    std::vector<Predicate> kids;
+    kids.push_back(cmp("id", Op::Gt, I(50)));
+    kids.push_back(cmp("id", Op::Lt, I(60)));
+    kids.push_back(cmp("name", Op::Ne, S("n55")));
+    preds.push_back(And(std::move(kids)));
+  }
+  {
+    std::vector<Predicate> kids;
+    kids.push_back(cmp("name", Op::Eq, S("n3")));
+    kids.push_back(cmp("id", Op::Ge, I(150)));
+    preds.push_back(And(std::move(kids)));
+  }
+  {
+    std::vector<Predicate> kids;
+    kids.push_back(cmp("id", Op::Eq, I(1)));
+    kids.push_back(cmp("name", Op::Eq, S("n2")));
+    preds.push_back(Or(std::move(kids)));
+  }
+  {
+    std::vector<Predicate> kids;
+    kids.push_back(cmp("id", Op::Eq, I(1)));
+    kids.push_back(cmp("score", Op::Ne, I(3)));
+    preds.push_back(Or(std::move(kids)));
+  }
+  preds.push_back(Not(cmp("id", Op::Lt, I(100))));
+  preds.push_back(And(std::vector<Predicate>{}));
+  preds.push_back(Or(std::vector<Predicate>{}));
+
+  for (const auto &p : preds)
+    expectSame(rs, p);
+  assert(ids(rs, "ix", cmp("id", Op::Eq, I(42))) ==
+         std::vector<int64_t>({42}));
+
+  // Mutations keep indexes in sync with row positions
+  for (const char *t : {"ix", "scan"}) {
+    auto del = rs.deleteRows(t, where(cmp("id", Op::Lt, I(25))));
+    assert(del.hasValue() && del.value() == 25);
+    std::unordered_map<std::string, AssignmentValue> asg;
+    AssignmentValue av;
+    av.kind = AssignmentValue::Kind::Constant;
+    av.constant = S("renamed");
+    asg.emplace("name", std::move(av));
+    auto upd = rs.updateRows(t, asg, where(cmp("id", Op::Ge, I(180))));
+    assert(upd.hasValue() && upd.value() == 20);
+    auto updWith = rs.updateRowsWith(
+        t,
+        [](Row &row, const TableSchema &) {
+          row.set(2, ValueFactory::createFloat(-1.0));
+          return Status::OK();
+        },
+        where(cmp("name", Op::Eq, S("n30"))));
+    assert(updWith.hasValue());
+    assert(rs.insertRow(t, makeRow(7, "n7", 3.0)).ok());
+  }
+  for (const auto &p : preds)
+    expectSame(rs, p);
+  assert(ids(rs, "ix", cmp("name", Op::Eq, S("renamed"))).size() == 20);
+  assert(ids(rs, "ix", cmp("id", Op::Eq, I(7))) == std::vector<int64_t>({7}));
+
+  // NaN cells make an index decline so results still match the scan
+  for (const char *t : {"ix", "scan"})
+    assert(rs.insertRow(t, makeRow(1000, "nan", std::nan(""))).ok());
+  for (const auto &p : preds)
+    expectSame(rs, p);
+
+  for (const char *t : {"ix", "scan"})
+    assert(rs.truncateTable(t).ok());
+  assert(ids(rs, "ix", cmp("id", Op::Eq, I(42))).empty());
+  assert(rs.insertRow("ix", makeRow(42, "again", 1.0)).ok());
+  assert(ids(rs, "ix", cmp("id", Op::Eq, I(42))) ==
+         std::vector<int64_t>({42}));
+  return 0;
+}
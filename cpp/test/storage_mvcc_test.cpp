@@ -0,0 +1,199 @@
+#include "kadedb/predicate_builder.h"
+#include "kadedb/storage.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace kadedb;
+
+static std::optional<Predicate> where(Predicate p) {
+  std::optional<Predicate> w;
+  w.emplace(std::move(p));
+  return w;
+}
+
+static TableSchema makeSchema() {
+  std::vector<Column> cols;
+  cols.push_back(Column{"id", ColumnType::Integer, false, true, {}});
+  cols.push_back(Column{"bal", ColumnType::Integer, false, false, {}});
+  return TableSchema(cols, std::optional<std::string>("id"));
+}
+
+static Row makeRow(int64_t id, int64_t bal) {
+  Row r(2);
+  r.set(0, ValueFactory::createInteger(id));
+  r.set(1, ValueFactory::createInteger(bal));
+  return r;
+}
+
+static std::unordered_map<std::string, AssignmentValue> setBal(int64_t v) {
+  std::unordered_map<std::string, AssignmentValue> asg;
+  AssignmentValue av;
+  av.kind = AssignmentValue::Kind::Constant;
+  av.constant = ValueFactory::createInteger(v);
+  asg.emplace("bal", std::move(av));
+  return asg;
+}
+
+static int64_t sumBal(InMemoryRelationalStorage &rs) {
+  auto res = rs.select("acct", {"bal"}, std::nullopt);
+  assert(res.hasValue());
+  int64_t sum = 0;
+  for (size_t i = 0; i < res.value().rowCount(); ++i)
+    sum += res.value().at(i, 0).asInt();
+  return sum;
+}
+
+// A view keeps reading the snapshot it was taken at
+static void testSnapshotIsolation() {
+  InMemoryRelationalStorage rs;
+  assert(rs.createTable("acct", makeSchema()).ok());
+  for (int64_t i = 0; i < 10; ++i)
+    assert(rs.insertRow("acct", makeRow(i, 100)).ok());
+
+  auto res = rs.selectView("acct", {"id", "bal"});
+  assert(res.hasValue());
+  ResultView before = res.takeValue();
+
+  using Op = Predicate::Op;
+  auto one = where(cmp("id", Op::Eq, ValueFactory::createInteger(3)));
+  assert(rs.updateRows("acct", setBal(7), one).value() == 1);
+  assert(rs.deleteRows("acct", where(cmp("id", Op::Lt,
+                                         ValueFactory::createInteger(2))))
+             .value() == 2);
+  assert(rs.insertRow("acct", makeRow(50, 1)).ok());
+
+  assert(before.rowCount() == 10);
+  for (size_t r = 0; r < before.rowCount(); ++r)
+    assert(before.cell(r, 1).asInt() == 100);
+
+  auto after = rs.select("acct", {}, std::nullopt);
+  assert(after.value().rowCount() == 9);
+  assert(sumBal(rs) == 100 * 7 + 7 + 1);
+  auto three = rs.select("acct", {"bal"}, one);
+  assert(three.value().rowCount() == 1 && three.value().at(0, 0).asInt() == 7);
+
+  // Truncate and drop leave existing views intact
+  assert(rs.truncateTable("acct").ok());
+  assert(rs.dropTable("acct").ok());
+  assert(before.rowCount() == 10 && before.cell(9, 0).asInt() == 9);
+}
+
+// Dead versions are reclaimed without changing query results
+static void testGarbageCollection() {
+  InMemoryRelationalStorage rs;
+  assert(rs.createTable("acct", makeSchema()).ok());
+  assert(rs.createIndex("acct", "bal", IndexType::Hash).ok());
+  for (int64_t i = 0; i < 100; ++i)
+    assert(rs.insertRow("acct", makeRow(i, i)).ok());
+
+  using Op = Predicate::Op;
+  for (int64_t k = 0; k < 5; ++k) {
+    auto w = where(cmp("id", Op::Lt, ValueFactory::createInteger(10)));
+    assert(rs.updateRows("acct", setBal(1000 + k), w).value() == 10);
+  }
+  assert(rs.collectGarbage() == 50);
+  assert(rs.collectGarbage() == 0);
+  auto hits = rs.select(
+      "acct", {"id"},
+      where(cmp("bal", Op::Eq, ValueFactory::createInteger(1004))));
+  assert(hits.value().rowCount() == 10);
+  assert(rs.select("acct", {}, std::nullopt).value().rowCount() == 100);
+
+  // Many single-row updates trigger automatic compaction; the unique key
+  // sets and the primary key index keep working throughout
+  auto w = where(cmp("id", Op::Eq, ValueFactory::createInteger(42)));
+  for (int64_t k = 0; k < 5000; ++k)
+    assert(rs.updateRows("acct", setBal(k), w).value() == 1);
+  assert(rs.collectGarbage() < RowVersionStore::kChunkRows);
+  assert(rs.select("acct", {"bal"}, w).value().at(0, 0).asInt() == 4999);
+  assert(rs.insertRow("acct", makeRow(42, 0)).code() ==
+         StatusCode::FailedPrecondition);
+
+  // Background collection can be started, restarted and stopped
+  rs.startBackgroundGc(std::chrono::milliseconds(1));
+  rs.startBackgroundGc(std::chrono::milliseconds(1));
+  for (int64_t k = 0; k < 100; ++k)
+    assert(rs.updateRows("acct", setBal(k), w).value() == 1);
+  rs.stopBackgroundGc();
+  rs.stopBackgroundGc();
+  assert(rs.select("acct", {"bal"}, w).value().at(0, 0).asInt() == 99);
+}
+
+// Readers always observe a committed state: concurrent transfers between
+// accounts (one statement each) never change the total balance
+static void testConsistentReaders() {
+  InMemoryRelationalStorage rs;
+  assert(rs.createTable("acct", makeSchema()).ok());
+  const int64_t kAccounts = 50;
+  for (int64_t i = 0; i < kAccounts; ++i)
+    assert(rs.insertRow("acct", makeRow(i, 100)).ok());
+  rs.startBackgroundGc(std::chrono::milliseconds(1));
+
+  std::atomic<bool> done{false};
+  std::thread writer([&]() {
+    using Op = Predicate::Op;
+    for (int64_t k = 0; k < 2000; ++k) {
+      int64_t from = k % kAccounts, to = (k * 7 + 1) % kAccounts;
+      if (from == to)
+        continue;
+      std::vector<Predicate> kids;
+      kids.push_back(cmp("id", Op::Eq, ValueFactory::createInteger(from)));
+      kids.push_back(cmp("id", Op::Eq, ValueFactory::createInteger(to)));
+      auto res = rs.updateRowsWith(
+          "acct",
+          [&](Row &row, const TableSchema &) {
+            int64_t d = row.at(0).asInt() == from ? -1 : 1;
+            row.set(1, ValueFactory::createInteger(row.at(1).asInt() + d));
+            return Status::OK();
+          },
+          where(Or(std::move(kids))));
+      assert(res.hasValue() && res.value() == 2);
+    }
+    done = true;
+  });
+  std::thread reader([&]() {
+    while (!done) {
+      assert(sumBal(rs) == kAccounts * 100);
+      auto view = rs.selectView("acct", {"bal"});
+      int64_t sum = 0;
+      for (size_t i = 0; i < view.value().rowCount(); ++i)
+        sum += view.value().cell(i, 0).asInt();
+      assert(sum == kAccounts * 100);
+    }
+  });
+  writer.join();
+  reader.join();
+  rs.stopBackgroundGc();
+  assert(sumBal(rs) == kAccounts * 100);
+}
+
+// Batches that overflow a partly filled chunk get every chunk they need
+static void testBatchGrowth() {
+  InMemoryRelationalStorage rs;
+  assert(rs.createTable("acct", makeSchema()).ok());
+  int64_t id = 0;
+  for (size_t n : {size_t{1500}, size_t{2000}, size_t{5000}}) {
+    std::vector<Row> batch;
+    for (size_t i = 0; i < n; ++i, ++id)
+      batch.push_back(makeRow(id, 1));
+    assert(rs.insertRows("acct", batch).ok());
+  }
+  assert(sumBal(rs) == id);
+  assert(rs.updateRows("acct", setBal(2), std::nullopt).value() ==
+         static_cast<size_t>(id));
+  assert(sumBal(rs) == 2 * id);
+}
+
+int main() {
+  testSnapshotIsolation();
+  testGarbageCollection();
+  testConsistentReaders();
+  testBatchGrowth();
+  return 0;
+}
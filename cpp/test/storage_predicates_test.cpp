@@ -198,5 +198,38 @@ int main() {
     assert(s.rowCount() == 2);
   }
 
+  // Bound predicates resolve columns once and match like the unbound form
+  {
+    TableSchema schema = makePersonSchema();
+    std::vector<Predicate> kids;
+    kids.emplace_back(
+        cmp("age", Predicate::Op::Ge, ValueFactory::createInteger(30)));
+    kids.emplace_back(Not(
+        cmp("name", Predicate::Op::Eq, ValueFactory::createString("Bob"))));
+    Predicate p = And(std::move(kids));
+    BoundPredicate b = BoundPredicate::bind(p, schema);
+    assert(b.children.size() == 2 && b.children[0].column == 2);
+    assert(b.children[1].children[0].column == 1);
+
+    Row row(3);
+    row.set(0, ValueFactory::createInteger(1));
+    row.set(1, ValueFactory::createString("Alice"));
+    row.set(2, ValueFactory::createFloat(30.0));
+    assert(b.matches(row) && b.matches(InlineRow::fromRow(row)));
+    row.set(1, ValueFactory::createString("Bob"));
+    assert(!b.matches(row) && !b.matches(InlineRow::fromRow(row)));
+    row.set(1, ValueFactory::createString("Carol"));
+    row.set(2, nullptr); // absent cells never match
+    assert(!b.matches(row) && !b.matches(InlineRow::fromRow(row)));
+
+    Predicate unknown =
+        cmp("nope", Predicate::Op::Ne, ValueFactory::createInteger(0));
+    BoundPredicate u = BoundPredicate::bind(unknown, schema);
+    assert(u.column == TableSchema::npos && !u.matches(row));
+    BoundPredicate notUnknown = BoundPredicate::bind(Not(std::move(unknown)),
+                                                     schema);
+    assert(notUnknown.matches(row));
+  }
+
   return 0;
 }
@@ -0,0 +1,164 @@
+#include "kadedb/predicate_builder.h"
+#include "kadedb/storage.h"
+
+#include <cassert>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+
+static std::optional<Predicate> where(Predicate p) {
+  std::optional<Predicate> w;
+  w.emplace(std::move(p));
+  return w;
+}
+
+static Row makeRow(std::optional<int64_t> id, const std::string &email) {
+  Row r(2);
+  if (id)
+    r.set(0, ValueFactory::createInteger(*id));
+  r.set(1, ValueFactory::createString(email));
+  return r;
+}
+
+static void testRelational() {
+  std::vector<Column> cols;
+  cols.push_back(Column{"id", ColumnType::Integer, true, true, {}});
+  cols.push_back(Column{"email", ColumnType::String, false, true, {}});
+  InMemoryRelationalStorage rs;
+  assert(rs.createTable("p", TableSchema(cols)).ok());
+
+  for (int64_t i = 0; i < 1000; ++i)
+    assert(rs.insertRow("p", makeRow(i, "u" + std::to_string(i))).ok());
+  assert(rs.insertRow("p", makeRow(5, "fresh")).code() ==
+         StatusCode::FailedPrecondition);
+  assert(rs.insertRow("p", makeRow(5000, "u5")).code() ==
+         StatusCode::FailedPrecondition);
+  // Null ids are exempt from uniqueness
+  assert(rs.insertRow("p", makeRow(std::nullopt, "n1")).ok());
+  assert(rs.insertRow("p", makeRow(std::nullopt, "n2")).ok());
+
+  // A conflicting update leaves the table and its key sets untouched
+  {
+    std::unordered_map<std::string, AssignmentValue> asg;
+    AssignmentValue av;
+    av.kind = AssignmentValue::Kind::Constant;
+    av.constant = ValueFactory::createString("same");
+    asg.emplace("email", std::move(av));
+    auto res = rs.updateRows(
+        "p", asg,
+        where(cmp("id", Predicate::Op::Lt, ValueFactory::createInteger(2))));
+    assert(res.status().code() == StatusCode::FailedPrecondition);
+    assert(rs.insertRow("p", makeRow(2000, "u0")).code() ==
+           StatusCode::FailedPrecondition);
+    assert(rs.insertRow("p", makeRow(2000, "same")).ok());
+  }
+  // Updating a row to its own value, and swapping in a freed value, succeed
+  {
+    auto res = rs.updateRowsWith(
+        "p",
+        [](Row &row, const TableSchema &) {
+          row.set(1, ValueFactory::createString(
+                         "v" + std::to_string(row.at(0).asInt())));
+          return Status::OK();
+        },
+        where(cmp("id", Predicate::Op::Lt, ValueFactory::createInteger(10))));
+    assert(res.hasValue() && res.value() == 10);
+    assert(rs.insertRow("p", makeRow(3000, "u3")).ok());
+    assert(rs.insertRow("p", makeRow(3001, "v3")).code() ==
+           StatusCode::FailedPrecondition);
+  }
+  // Deletes free keys
+  {
+    auto res = rs.deleteRows(
+        "p",
+        where(cmp("id", Predicate::Op::Eq, ValueFactory::createInteger(500))));
+    assert(res.hasValue() && res.value() == 1);
+    assert(rs.insertRow("p", makeRow(500, "u500")).ok());
+  }
+  assert(rs.truncateTable("p").ok());
+  assert(rs.insertRow("p", makeRow(1, "u1")).ok());
+}
+
+static size_t rowCount(RelationalStorage &rs, const std::string &table) {
+  return rs.select(table, {}, std::nullopt).value().rowCount();
+}
+
+// In-memory batches are all or nothing
+static void testBatchInsert() {
+  std::vector<Column> cols;
+  cols.push_back(Column{"id", ColumnType::Integer, true, true, {}});
+  cols.push_back(Column{"email", ColumnType::String, false, true, {}});
+  InMemoryRelationalStorage rs;
+  assert(rs.createTable("p", TableSchema(cols)).ok());
+
+  std::vector<Row> batch;
+  for (int64_t i = 0; i < 500; ++i)
+    batch.push_back(makeRow(i, "u" + std::to_string(i)));
+  assert(rs.insertRows("p", batch).ok());
+  assert(rs.insertRows("p", {}).ok());
+  assert(rowCount(rs, "p") == 500);
+
+  // A conflict with the table, within the batch, or an invalid row rejects
+  // the whole batch and leaves the key sets untouched
+  std::vector<Row> clash;
+  clash.push_back(makeRow(1000, "fresh"));
+  clash.push_back(makeRow(7, "other"));
+  assert(rs.insertRows("p", clash).code() == StatusCode::FailedPrecondition);
+  std::vector<Row> twice;
+  twice.push_back(makeRow(1001, "dup"));
+  twice.push_back(makeRow(1002, "dup"));
+  assert(rs.insertRows("p", twice).code() == StatusCode::FailedPrecondition);
+  std::vector<Row> invalid;
+  invalid.push_back(makeRow(1003, "ok"));
+  invalid.push_back(Row(1));
+  assert(rs.insertRows("p", invalid).code() == StatusCode::InvalidArgument);
+  assert(rs.insertRows("missing", batch).code() == StatusCode::NotFound);
+  assert(rowCount(rs, "p") == 500);
+  assert(rs.insertRow("p", makeRow(1000, "fresh")).ok());
+  assert(rs.insertRow("p", makeRow(1001, "dup")).ok());
+  assert(rs.insertRow("p", makeRow(1003, "ok")).ok());
+}
+
+static void testDocuments() {
+  DocumentSchema ds;
+  Column c;
+  c.name = "mrn";
+  c.type = ColumnType::String;
+  c.nullable = true;
+  c.unique = true;
+  ds.addField(c);
+  InMemoryDocumentStorage st;
+  assert(st.createCollection("pat", ds).ok());
+
+  auto doc = [](const std::string &mrn) {
+    Document d;
+    d.emplace("mrn", ValueFactory::createString(mrn));
+    return d;
+  };
+  for (int i = 0; i < 1000; ++i)
+    assert(st.put("pat", "k" + std::to_string(i),
+                  doc("m" + std::to_string(i)))
+               .ok());
+  assert(st.put("pat", "other", doc("m7")).code() ==
+         StatusCode::FailedPrecondition);
+  // Replacing a document under the same key keeps or moves its value
+  assert(st.put("pat", "k7", doc("m7")).ok());
+  assert(st.put("pat", "k7", doc("m7b")).ok());
+  assert(st.put("pat", "other", doc("m7")).ok());
+  // Missing/null values are exempt
+  assert(st.put("pat", "nul1", Document{}).ok());
+  assert(st.put("pat", "nul2", Document{}).ok());
+  // Erase frees the value
+  assert(st.erase("pat", "k8").ok());
+  assert(st.put("pat", "again", doc("m8")).ok());
+  assert(st.count("pat").value() == 1003);
+}
+
+int main() {
+  testRelational();
+  testBatchInsert();
+  testDocuments();
+  return 0;
+}
@@ -0,0 +1,98 @@
+#include "kadedb/predicate_builder.h"
+#include "kadedb/storage.h"
+
+#include <cassert>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+
+static std::optional<Predicate> where(Predicate p) {
+  std::optional<Predicate> w;
+  w.emplace(std::move(p));
+  return w;
+}
+
+int main() {
+  InMemoryRelationalStorage rs;
+  std::vector<Column> cols;
+  cols.push_back(Column{"id", ColumnType::Integer, false, true, {}});
+  cols.push_back(Column{"name", ColumnType::String, true, false, {}});
+  assert(
+      rs.createTable("t", TableSchema(cols, std::optional<std::string>("id")))
+          .ok());
+  for (int64_t i = 0; i < 100; ++i) {
+    Row r(2);
+    r.set(0, ValueFactory::createInteger(i));
+    if (i % 10 != 0)
+      r.set(1, ValueFactory::createString("a fairly long name #" +
+                                          std::to_string(i)));
+    assert(rs.insertRow("t", r).ok());
+  }
+
+  // Errors mirror select()
+  assert(rs.selectView("missing", {}).status().code() == StatusCode::NotFound);
+  assert(rs.selectView("t", {"nope"}).status().code() ==
+         StatusCode::InvalidArgument);
+
+  {
+    auto res = rs.selectView(
+        "t", {"name", "id"},
+        where(cmp("id", Predicate::Op::Ge, ValueFactory::createInteger(90))));
+    assert(res.hasValue());
+    ResultView view = res.takeValue();
+    assert(view.rowCount() == 10);
+    assert(view.columnCount() == 2);
+    assert(view.findColumn("id") == 1);
+    assert(view.columnTypes()[0] == ColumnType::String);
+
+    // Borrowed cells reference storage; nulls are empty
+    assert(view.cell(0, 0).empty());
+    assert(view.cell(1, 1).asInt() == 91);
+    assert(view.cell(1, 0).asString() == "a fairly long name #91");
+    assert(view.value(0, 0) == nullptr);
+    assert(view.value(1, 1)->asInt() == 91);
+
+    size_t seen = 0;
+    while (view.next()) {
+      assert(view.current(1).asInt() == static_cast<int64_t>(90 + seen));
+      ++seen;
+    }
+    assert(seen == 10);
+    view.reset();
+    assert(view.next() && view.current(1).asInt() == 90);
+
+    // Materialization matches select()
+    ResultSet owned = view.toResultSet();
+    assert(owned.rowCount() == 10);
+    assert(owned.columnNames() == view.columnNames());
+    assert(owned.at(1, "name").asString() == "a fairly long name #91");
+    assert(owned.row(0).values()[0] == nullptr);
+  }
+
+  // The view released the storage lock on destruction
+  {
+    Row r(2);
+    r.set(0, ValueFactory::createInteger(1000));
+    assert(rs.insertRow("t", r).ok());
+  }
+  {
+    auto all = rs.selectView("t", {});
+    assert(all.hasValue() && all.value().rowCount() == 101);
+    auto expected = all.value().toResultSet();
+    ResultView moved = all.takeValue();
+    assert(moved.rowCount() == 101);
+    auto again = moved.toResultSet();
+    for (size_t r = 0; r < expected.rowCount(); ++r) {
+      for (size_t c = 0; c < expected.columnCount(); ++c) {
+        const auto &a = expected.row(r).values()[c];
+        const auto &b = again.row(r).values()[c];
+        assert((a == nullptr) == (b == nullptr));
+        assert(!a || a->equals(*b));
+      }
+    }
+  }
+  assert(rs.select("t", {}, std::nullopt).value().rowCount() == 101);
+  return 0;
+}
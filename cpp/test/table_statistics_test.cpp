@@ -0,0 +1,371 @@
+#include "kadedb/columnar_storage.h"
+#include "kadedb/kadeql.h"
+#include "kadedb/predicate_builder.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/statistics.h"
+#include "kadedb/storage.h"
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+using Op = Predicate::Op;
+
+static bool near(double actual, double expected, double tolerance) {
+  return std::fabs(actual - expected) <= tolerance;
+}
+
+static uint64_t hashOf(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xFF51AFD7ED558CCDull;
+  x ^= x >> 33;
+  x *= 0xC4CEB9FE1A85EC53ull;
+  return x ^ (x >> 33);
+}
+
+static Predicate clonePred(const Predicate &p) {
+  Predicate out;
+  out.kind = p.kind;
+  out.column = p.column;
+  out.op = p.op;
+  out.rhs = p.rhs ? p.rhs->clone() : nullptr;
+  for (const auto &ch : p.children)
+    out.children.push_back(clonePred(ch));
+  return out;
+}
+
+// Forwards to an in-memory store and records the tables and predicates
+// each read or write was handed
+class RecordingStorage final : public RelationalStorage {
+public:
+  Status createTable(const std::string &table,
+                     const TableSchema &schema) override {
+    return inner.createTable(table, schema);
+  }
+  Status insertRow(const std::string &table, const Row &row) override {
+    return inner.insertRow(table, row);
+  }
+  Result<ResultSet> select(const std::string &table,
+                           const std::vector<std::string> &columns,
+                           const std::optional<Predicate> &where) override {
+    record(table, where);
+    return inner.select(table, columns, where);
+  }
+  Status scan(const std::string &table, const std::vector<std::string> &columns,
+              const std::optional<Predicate> &where, const BatchSink &sink,
+              size_t batchRows) override {
+    record(table, where);
+    return inner.scan(table, columns, where, sink, batchRows);
+  }
+  std::vector<std::string> listTables() const override {
+    return inner.listTables();
+  }
+  Result<TableSchema> getTableSchema(const std::string &table) override {
+    return inner.getTableSchema(table);
+  }
+  std::optional<size_t>
+  estimateRowCount(const std::string &table) const override {
+    return inner.estimateRowCount(table);
+  }
+  std::shared_ptr<const TableStatistics>
+  getTableStatistics(const std::string &table) const override {
+    return withStats ? inner.getTableStatistics(table) : nullptr;
+  }
+  Status dropTable(const std::string &table) override {
+    return inner.dropTable(table);
+  }
+  Result<size_t> deleteRows(const std::string &table,
+                            const std::optional<Predicate> &where) override {
+    record(table, where);
+    return inner.deleteRows(table, where);
+  }
+  Result<size_t> updateRows(
+      const std::string &table,
+      const std::unordered_map<std::string, AssignmentValue> &assignments,
+      const std::optional<Predicate> &where) override {
+    record(table, where);
+    return inner.updateRows(table, assignments, where);
+  }
+  Result<size_t>
+  updateRowsWith(const std::string &table, const RowUpdater &updater,
+                 const std::optional<Predicate> &where) override {
+    record(table, where);
+    return inner.updateRowsWith(table, updater, where);
+  }
+  Status
+  updateRows(const std::string &table,
+             const std::unordered_map<std::string, std::unique_ptr<Value>>
+                 &assignments,
+             const std::optional<Predicate> &where) override {
+    record(table, where);
+    return inner.updateRows(table, assignments, where);
+  }
+  Status truncateTable(const std::string &table) override {
+    return inner.truncateTable(table);
+  }
+  Status createIndex(const std::string &table, const std::string &column,
+                     IndexType type) override {
+    return inner.createIndex(table, column, type);
+  }
+
+  InMemoryRelationalStorage inner;
+  bool withStats = true;
+  std::vector<std::string> tables; // in call order
+  std::optional<Predicate> lastWhere;
+
+private:
+  void record(const std::string &table, const std::optional<Predicate> &w) {
+    tables.push_back(table);
+    lastWhere.reset();
+    if (w)
+      lastWhere.emplace(clonePred(*w));
+  }
+};
+
+// patients: id 0..999 (unique), ward alternates icu/er, age = id % 100,
+// score is null for every fourth row
+static void fill(RelationalStorage &st, int64_t rows) {
+  TableSchema patients({Column{"id", ColumnType::Integer, false, true, {}},
+                        Column{"ward", ColumnType::String, false, false, {}},
+                        Column{"age", ColumnType::Integer, false, false, {}},
+                        Column{"score", ColumnType::Float, true, false, {}}});
+  assert(st.createTable("patients", patients).ok());
+  for (int64_t i = 0; i < rows; ++i) {
+    Row r(4);
+    r.set(0, ValueFactory::createInteger(i));
+    r.set(1, ValueFactory::createString(i % 2 ? "er" : "icu"));
+    r.set(2, ValueFactory::createInteger(i % 100));
+    if (i % 4 != 3)
+      r.set(3, ValueFactory::createFloat(static_cast<double>(i) / 10));
+    assert(st.insertRow("patients", r).ok());
+  }
+}
+
+static std::unique_ptr<Value> I(int64_t v) {
+  return ValueFactory::createInteger(v);
+}
+static std::unique_ptr<Value> S(const char *v) {
+  return ValueFactory::createString(v);
+}
+
+static double sel(const TableStatistics &stats, Predicate p) {
+  return stats.selectivity(p);
+}
+
+static Predicate both(Predicate a, Predicate b) {
+  std::vector<Predicate> kids;
+  kids.push_back(std::move(a));
+  kids.push_back(std::move(b));
+  return And(std::move(kids));
+}
+
+static Predicate either(Predicate a, Predicate b) {
+  std::vector<Predicate> kids;
+  kids.push_back(std::move(a));
+  kids.push_back(std::move(b));
+  return Or(std::move(kids));
+}
+
+static void testMaintained(RelationalStorage &st) {
+  fill(st, 1000);
+  auto stats = st.getTableStatistics("patients");
+  assert(stats && stats->rowCount == 1000 && stats->columns.size() == 4);
+  const ColumnStatistics *id = stats->column("id");
+  const ColumnStatistics *age = stats->column("age");
+  const ColumnStatistics *score = stats->column("score");
+  assert(id && age && score && !stats->column("nope"));
+  assert(id->min->asInt() == 0 && id->max->asInt() == 999);
+  assert(near(id->distinct, 1000, 50) && near(age->distinct, 100, 5));
+  assert(near(stats->column("ward")->distinct, 2, 0.1));
+  assert(score->nonNull == 750 && !score->histogram.empty());
+
+  // Selectivity estimates
+  assert(near(sel(*stats, cmp("id", Op::Eq, I(5))), 0.001, 0.0002));
+  assert(sel(*stats, cmp("id", Op::Eq, I(5000))) == 0);
+  assert(near(sel(*stats, cmp("id", Op::Lt, I(250))), 0.25, 0.05));
+  assert(sel(*stats, cmp("id", Op::Ge, I(0))) == 1);
+  assert(near(sel(*stats, cmp("ward", Op::Eq, S("er"))), 0.5, 0.05));
+  // Null cells never match
+  assert(near(sel(*stats, cmp("score", Op::Ge, ValueFactory::createFloat(0))),
+              0.75, 0.01));
+  assert(near(sel(*stats, both(cmp("ward", Op::Eq, S("icu")),
+                               cmp("age", Op::Lt, I(10)))),
+              0.05, 0.02));
+  assert(near(sel(*stats, either(cmp("id", Op::Lt, I(500)),
+                                 cmp("id", Op::Ge, I(500)))),
+              0.75, 0.05));
+  assert(stats->estimateRows(std::nullopt) == 1000);
+
+  // Writes keep the counts exact
+  auto upd = st.updateRowsWith(
+      "patients",
+      [](Row &row, const TableSchema &) {
+        row.set(3, nullptr);
+        return Status::OK();
+      },
+      cmp("id", Op::Lt, I(200)));
+  assert(upd.hasValue() && upd.value() == 200);
+  auto del = st.deleteRows("patients", cmp("id", Op::Ge, I(600)));
+  assert(del.hasValue() && del.value() == 400);
+  stats = st.getTableStatistics("patients");
+  assert(stats->rowCount == 600);
+  // 0..599 minus every fourth, minus 0..199
+  assert(stats->column("score")->nonNull == 300);
+  assert(st.truncateTable("patients").ok());
+  assert(st.getTableStatistics("patients")->rowCount == 0);
+  assert(!st.getTableStatistics("missing"));
+}
+
+int main() {
+  std::cout << "=== Table Statistics Tests ===" << std::endl;
+
+  std::cout << "Test 1: HyperLogLog..." << std::endl;
+  {
+    HyperLogLog a, b;
+    assert(a.estimate() == 0);
+    for (uint64_t i = 0; i < 10; ++i)
+      a.add(hashOf(i));
+    assert(near(a.estimate(), 10, 0.5));
+    for (uint64_t i = 0; i < 100000; ++i) {
+      a.add(hashOf(i));
+      b.add(hashOf(i + 50000));
+    }
+    assert(near(a.estimate(), 100000, 5000));
+    // Duplicates do not count; merging is a union
+    b.merge(a);
+    assert(near(b.estimate(), 150000, 7500));
+    b.clear();
+    assert(b.estimate() == 0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: equi-depth histograms..." << std::endl;
+  {
+    std::vector<double> uniform;
+    for (int i = 0; i < 1000; ++i)
+      uniform.push_back(999 - i);
+    auto h = EquiDepthHistogram::build(uniform, 10);
+    assert(h.bucketCount() == 10 && h.bounds().front() == 0 &&
+           h.bounds().back() == 999);
+    assert(near(h.fractionBelow(250, false), 0.25, 0.01));
+    assert(h.fractionBelow(-1, true) == 0 && h.fractionBelow(999, true) == 1);
+
+    // Skewed: half the values are 7
+    std::vector<double> skewed;
+    for (int i = 0; i < 1000; ++i)
+      skewed.push_back(i % 2 ? 7 : i);
+    auto s = EquiDepthHistogram::build(skewed, 20);
+    const double share = s.fractionBelow(7, true) - s.fractionBelow(7, false);
+    assert(near(share, 0.5, 0.1));
+    assert(EquiDepthHistogram::build({}, 8).empty());
+    assert(EquiDepthHistogram::build({1, 2}, 8).bucketCount() == 2);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: statistics maintained by the row store..."
+            << std::endl;
+  {
+    InMemoryRelationalStorage st;
+    testMaintained(st);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: statistics maintained by the columnar store..."
+            << std::endl;
+  {
+    ColumnarRelationalStorage st;
+    testMaintained(st);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 5: conjuncts ordered by selectivity and cost..."
+            << std::endl;
+  {
+    RecordingStorage st;
+    fill(st, 1000);
+    QueryExecutor exec(st);
+    auto run = [&](const std::string &q) {
+      auto res = exec.execute(*parseQuery(q));
+      assert(res.hasValue());
+      return res.takeValue();
+    };
+    // The unique id test rejects nearly every row, so it runs first
+    auto rs = run("SELECT id FROM patients WHERE ward = 'icu' AND age < 50 "
+                  "AND id = 42");
+    assert(rs.rowCount() == 1);
+    assert(st.lastWhere->children.size() == 3);
+    assert(st.lastWhere->children[0].column == "id");
+    assert(st.lastWhere->children[2].column == "ward");
+    // OR: the test most likely to pass runs first
+    run("SELECT id FROM patients WHERE id = 42 OR age < 90");
+    assert(st.lastWhere->children[0].column == "age");
+    run("DELETE FROM patients WHERE ward = 'er' AND id = 7");
+    assert(st.lastWhere->children[0].column == "id");
+    // Without statistics the canonical order stays
+    st.withStats = false;
+    run("SELECT id FROM patients WHERE id = 42 AND age < 50");
+    assert(st.lastWhere->children[0].column == "age");
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 6: join build side from filtered estimates..."
+            << std::endl;
+  {
+    RecordingStorage st;
+    fill(st, 1000);
+    TableSchema wards({Column{"name", ColumnType::String, false, false, {}},
+                       Column{"floor", ColumnType::Integer, false, false, {}}});
+    assert(st.createTable("wards", wards).ok());
+    for (int64_t i = 0; i < 20; ++i) {
+      Row r(2);
+      std::string name = "w" + std::to_string(i);
+      if (i < 2)
+        name = i == 0 ? "icu" : "er";
+      r.set(0, ValueFactory::createString(name));
+      r.set(1, ValueFactory::createInteger(i));
+      assert(st.insertRow("wards", r).ok());
+    }
+    QueryExecutor exec(st);
+    // The probe side is scanned first, the build side once it opens
+    auto firstScan = [&](const std::string &q) {
+      st.tables.clear();
+      auto res = exec.execute(*parseQuery(q));
+      assert(res.hasValue());
+      return st.tables.at(0);
+    };
+    const std::string join = "SELECT p.id, w.floor FROM patients p JOIN wards "
+                             "w ON p.ward = w.name";
+    // Unfiltered: the 20 wards are hashed and the patients probe
+    assert(firstScan(join) == "patients");
+    // One patient left after its filter: it is hashed instead
+    assert(firstScan(join + " WHERE p.id = 5") == "wards");
+    st.withStats = false;
+    assert(firstScan(join + " WHERE p.id = 5") == "patients");
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 7: indexes are used only when selective..." << std::endl;
+  {
+    InMemoryRelationalStorage st;
+    fill(st, 2000);
+    assert(st.createIndex("patients", "ward", IndexType::Hash).ok());
+    assert(st.createIndex("patients", "age", IndexType::Ordered).ok());
+    // Same answers whether the index or a scan serves them
+    auto narrow = st.select("patients", {"id"},
+                            both(cmp("ward", Op::Eq, S("icu")),
+                                 cmp("age", Op::Eq, I(4))));
+    assert(narrow.value().rowCount() == 20);
+    auto broad = st.select("patients", {"id"}, cmp("age", Op::Ge, I(1)));
+    assert(broad.value().rowCount() == 1980);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll table statistics tests passed!" << std::endl;
+  return 0;
+}
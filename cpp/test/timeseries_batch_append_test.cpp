@@ -0,0 +1,219 @@
+#include "kadedb/timeseries/storage.h"
+
+#include "kadedb/schema.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+
+// Delegates the required calls to an in-memory store, keeping the default
+// appendBatch() and appendColumns()
+class DefaultBatchSeries final : public TimeSeriesStorage {
+public:
+  Status createSeries(const std::string &series, const TimeSeriesSchema &schema,
+                      TimePartition partition) override {
+    return impl.createSeries(series, schema, partition);
+  }
+  Status dropSeries(const std::string &series) override {
+    return impl.dropSeries(series);
+  }
+  std::vector<std::string> listSeries() const override {
+    return impl.listSeries();
+  }
+  Status append(const std::string &series, const Row &row) override {
+    ++appends;
+    return impl.append(series, row);
+  }
+  Result<ResultSet> rangeQuery(const std::string &series,
+                               const std::vector<std::string> &columns,
+                               int64_t startInclusive, int64_t endExclusive,
+                               const std::optional<Predicate> &where) override {
+    return impl.rangeQuery(series, columns, startInclusive, endExclusive,
+                           where);
+  }
+  Result<TimeSeriesSchema>
+  getSeriesSchema(const std::string &series) const override {
+    return impl.getSeriesSchema(series);
+  }
+  Result<ResultSet> aggregate(const std::string &series,
+                              const std::string &valueColumn,
+                              TimeAggregation agg, int64_t startInclusive,
+                              int64_t endExclusive, int64_t bucketWidth,
+                              TimeGranularity bucketGranularity,
+                              const std::optional<Predicate> &where,
+                              double quantile) override {
+    return impl.aggregate(series, valueColumn, agg, startInclusive,
+                          endExclusive, bucketWidth, bucketGranularity, where,
+                          quantile);
+  }
+
+  InMemoryTimeSeriesStorage impl;
+  size_t appends = 0;
+};
+
+// (timestamp, bed STRING nullable, hr FLOAT, spo2 FLOAT)
+static TimeSeriesSchema vitalsSchema() {
+  TimeSeriesSchema schema("timestamp", TimeGranularity::Seconds);
+  schema.addTagColumn(Column{"bed", ColumnType::String, true, false, {}});
+  schema.addValueColumn(Column{"hr", ColumnType::Float, true, false, {}});
+  schema.addValueColumn(Column{"spo2", ColumnType::Float, true, false, {}});
+  return schema;
+}
+
+static Row vital(int64_t ts, const std::string &bed, double hr, double spo2) {
+  Row r(4);
+  r.set(0, ValueFactory::createInteger(ts));
+  r.set(1, ValueFactory::createString(bed));
+  r.set(2, ValueFactory::createFloat(hr));
+  r.set(3, ValueFactory::createFloat(spo2));
+  return r;
+}
+
+static ResultSet all(TimeSeriesStorage &ts, const std::string &series) {
+  auto rs = ts.rangeQuery(series, {}, -1000000, 1000000, std::nullopt);
+  assert(rs.hasValue());
+  return rs.takeValue();
+}
+
+static bool sameRows(const ResultSet &a, const ResultSet &b) {
+  if (a.rowCount() != b.rowCount() || a.columnCount() != b.columnCount())
+    return false;
+  for (size_t r = 0; r < a.rowCount(); ++r)
+    for (size_t c = 0; c < a.columnCount(); ++c)
+      if (a.at(r, c).toString() != b.at(r, c).toString())
+        return false;
+  return true;
+}
+
+int main() {
+  std::cout << "=== Time-Series Batch Append Tests ===" << std::endl;
+
+  std::cout << "Test 1: a batch stores what row-by-row appends store..."
+            << std::endl;
+  {
+    RetentionPolicy rp;
+    rp.maxRows = 5000;
+    TimeSeriesSchema schema = vitalsSchema();
+    schema.setRetentionPolicy(rp);
+    InMemoryTimeSeriesStorage ts;
+    assert(ts.createSeries("rows", schema, TimePartition::Hourly).ok());
+    assert(ts.createSeries("batch", schema, TimePartition::Hourly).ok());
+    // Three hours at 1 Hz with a late sample every 100 rows
+    std::vector<Row> rows;
+    for (int64_t t = 0; t < 3 * 3600; ++t) {
+      rows.push_back(vital(t, t % 2 ? "b1" : "b2", 60.0 + t % 30, 97.0));
+      if (t % 100 == 99)
+        rows.push_back(vital(t - 3000, "late", 1.0, 2.0));
+    }
+    for (const auto &row : rows)
+      assert(ts.append("rows", row).ok());
+    // Several flushes, the way a collector sends them
+    const size_t flush = 2500;
+    for (size_t i = 0; i < rows.size(); i += flush) {
+      std::vector<Row> part;
+      for (size_t j = i; j < rows.size() && j < i + flush; ++j)
+        part.push_back(rows[j].clone());
+      assert(ts.appendBatch("batch", part).ok());
+    }
+    ResultSet a = all(ts, "rows"), b = all(ts, "batch");
+    assert(a.rowCount() == 5000);
+    assert(sameRows(a, b));
+    assert(ts.appendBatch("batch", {}).ok());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: an invalid row rejects the whole batch..." << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    assert(ts.createSeries("v", vitalsSchema(), TimePartition::Hourly).ok());
+    std::vector<Row> rows;
+    for (int64_t t = 0; t < 5; ++t)
+      rows.push_back(vital(t, "b1", 70.0, 98.0));
+    rows[3].set(2, ValueFactory::createString("fast"));
+    auto st = ts.appendBatch("v", rows);
+    assert(!st.ok() && st.code() == StatusCode::InvalidArgument);
+    assert(st.message() == "Row 3: Value type does not match column 'hr'");
+    assert(all(ts, "v").rowCount() == 0);
+    // A single append reports the bare message
+    auto one = ts.append("v", rows[3]);
+    assert(one.message() == "Value type does not match column 'hr'");
+    assert(ts.appendBatch("nope", rows).code() == StatusCode::NotFound);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: columnar samples..." << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    assert(ts.createSeries("v", vitalsSchema(), TimePartition::Hourly).ok());
+    const size_t n = 10000;
+    std::vector<int64_t> times(n);
+    std::vector<double> hr(n), spo2(n);
+    for (size_t i = 0; i < n; ++i) {
+      times[i] = static_cast<int64_t>(i) * 2;
+      hr[i] = 60.0 + static_cast<double>(i % 40);
+      spo2[i] = 95.0 + static_cast<double>(i % 5);
+    }
+    const double *values[] = {hr.data(), spo2.data()};
+    assert(ts.appendColumns("v", times.data(), values, n).ok());
+    ResultSet rs = all(ts, "v");
+    assert(rs.rowCount() == n);
+    assert(rs.at(4321, 0).asInt() == 8642);
+    assert(rs.row(4321).values()[1] == nullptr);
+    assert(rs.at(4321, 2).asFloat() == 60.0 + 4321 % 40);
+    assert(rs.at(4321, 3).asFloat() == 95.0 + 4321 % 5);
+    auto avg = ts.aggregate("v", "spo2", TimeAggregation::Avg, 0, 20000,
+                            20000, TimeGranularity::Seconds, std::nullopt);
+    assert(avg.value().at(0, 1).asFloat() == 97.0);
+
+    assert(ts.appendColumns("v", nullptr, nullptr, 0).ok());
+    assert(!ts.appendColumns("v", times.data(), nullptr, n).ok());
+    const double *partial[] = {hr.data(), nullptr};
+    assert(!ts.appendColumns("v", times.data(), partial, n).ok());
+    assert(ts.appendColumns("nope", times.data(), values, n).code() ==
+           StatusCode::NotFound);
+
+    // Tags must be nullable, values Float
+    TimeSeriesSchema tagged("timestamp", TimeGranularity::Seconds);
+    tagged.addTagColumn(Column{"bed", ColumnType::String, false, false, {}});
+    tagged.addValueColumn(Column{"hr", ColumnType::Float, true, false, {}});
+    assert(ts.createSeries("tagged", tagged, TimePartition::Hourly).ok());
+    auto st = ts.appendColumns("tagged", times.data(), values, n);
+    assert(st.code() == StatusCode::InvalidArgument);
+    TimeSeriesSchema counts("timestamp", TimeGranularity::Seconds);
+    counts.addValueColumn(Column{"steps", ColumnType::Integer, true, false,
+                                 {}});
+    assert(ts.createSeries("counts", counts, TimePartition::Hourly).ok());
+    assert(ts.appendColumns("counts", times.data(), values, n).code() ==
+           StatusCode::InvalidArgument);
+    assert(all(ts, "tagged").rowCount() == 0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: default implementations append row by row..."
+            << std::endl;
+  {
+    DefaultBatchSeries ts;
+    assert(ts.createSeries("v", vitalsSchema(), TimePartition::Hourly).ok());
+    std::vector<Row> rows;
+    for (int64_t t = 0; t < 4; ++t)
+      rows.push_back(vital(t, "b1", 70.0, 98.0));
+    assert(ts.appendBatch("v", rows).ok() && ts.appends == 4);
+    const int64_t times[] = {10, 11};
+    const double hr[] = {71.0, 72.0}, spo2[] = {96.0, 95.0};
+    const double *values[] = {hr, spo2};
+    assert(ts.appendColumns("v", times, values, 2).ok() && ts.appends == 6);
+    ResultSet rs = all(ts, "v");
+    assert(rs.rowCount() == 6 && rs.at(5, 2).asFloat() == 72.0);
+    assert(ts.appendColumns("nope", times, values, 2).code() ==
+           StatusCode::NotFound);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll time-series batch append tests passed!" << std::endl;
+  return 0;
+}
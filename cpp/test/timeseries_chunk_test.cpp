@@ -0,0 +1,343 @@
+#include "kadedb/timeseries/chunk.h"
+#include "kadedb/timeseries/storage.h"
+
+#include "kadedb/schema.h"
+#include "kadedb/value.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+
+static uint64_t g_rng = 0x2545F4914F6CDD1Dull;
+static uint64_t nextRandom() {
+  g_rng ^= g_rng << 13;
+  g_rng ^= g_rng >> 7;
+  g_rng ^= g_rng << 17;
+  return g_rng;
+}
+
+// Cells equal, floats by bit pattern (NaN, -0.0)
+static bool sameCell(const InlineValue &a, const InlineValue &b) {
+  if (a.empty() || b.empty())
+    return a.empty() == b.empty();
+  if (a.type() != b.type())
+    return false;
+  if (a.type() == ValueType::Float) {
+    double x = a.asFloat(), y = b.asFloat();
+    return std::memcmp(&x, &y, sizeof x) == 0;
+  }
+  return a.equals(b);
+}
+
+static void roundTrip(const std::vector<ColumnType> &types,
+                      const std::vector<InlineRow> &rows) {
+  TimeSeriesChunk chunk = TimeSeriesChunk::encode(types, rows);
+  assert(chunk.rowCount() == rows.size());
+  std::vector<InlineRow> out;
+  chunk.decode(out);
+  assert(out.size() == rows.size());
+  for (size_t r = 0; r < rows.size(); ++r)
+    for (size_t c = 0; c < types.size(); ++c)
+      assert(sameCell(out[r].at(c), rows[r].at(c)));
+}
+
+static TimeSeriesSchema vitalsSchema() {
+  TimeSeriesSchema schema("timestamp", TimeGranularity::Seconds);
+  schema.addTagColumn(Column{"bed", ColumnType::String, false, false, {}});
+  schema.addValueColumn(Column{"hr", ColumnType::Float, true, false, {}});
+  return schema;
+}
+
+static Row vital(int64_t ts, const std::string &bed, double hr) {
+  Row r(3);
+  r.set(0, ValueFactory::createInteger(ts));
+  r.set(1, ValueFactory::createString(bed));
+  r.set(2, ValueFactory::createFloat(hr));
+  return r;
+}
+
+static std::vector<int64_t> timestamps(const ResultSet &rs) {
+  std::vector<int64_t> out;
+  const size_t col = rs.findColumn("timestamp");
+  for (size_t r = 0; r < rs.rowCount(); ++r)
+    out.push_back(rs.at(r, col).asInt());
+  return out;
+}
+
+int main() {
+  std::cout << "=== Time-Series Chunk Tests ===" << std::endl;
+
+  std::cout << "Test 1: integer and float streams round-trip..." << std::endl;
+  {
+    const int64_t lo = std::numeric_limits<int64_t>::min();
+    const int64_t hi = std::numeric_limits<int64_t>::max();
+    std::vector<int64_t> ints = {0, 1, 2, 3, 5, 1000, -1000, lo, hi, lo,
+                                 0,  0, 7, 7, -3};
+    for (int i = 0; i < 500; ++i)
+      ints.push_back(static_cast<int64_t>(nextRandom() >> (i % 64)) *
+                     (i % 2 ? 1 : -1));
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const double inf = std::numeric_limits<double>::infinity();
+    std::vector<double> floats = {0.0, -0.0, 1.5, 1.5, 1.5000001, -inf,
+                                  inf, nan, 1e-300, 72.0, 72.5};
+    while (floats.size() < ints.size())
+      floats.push_back(static_cast<double>(nextRandom() % 1000) / 8.0);
+    std::vector<InlineRow> rows;
+    for (size_t i = 0; i < ints.size(); ++i) {
+      InlineRow row(2);
+      row.set(0, InlineValue::integer(ints[i]));
+      row.set(1, InlineValue::floating(floats[i]));
+      rows.push_back(std::move(row));
+    }
+    roundTrip({ColumnType::Integer, ColumnType::Float}, rows);
+    std::vector<InlineValue> col;
+    TimeSeriesChunk::encode({ColumnType::Integer, ColumnType::Float}, rows)
+        .decodeColumn(0, col);
+    assert(col.size() == ints.size() && col[7].asInt() == lo);
+    roundTrip({ColumnType::Integer}, {});
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: dictionaries, booleans, nulls and mixed cells..."
+            << std::endl;
+  {
+    const std::vector<std::string> beds = {
+        "icu-1", "icu-2", "a bed name longer than the inline buffer", ""};
+    std::vector<InlineRow> rows;
+    for (int i = 0; i < 300; ++i) {
+      InlineRow row(5);
+      if (i % 5 != 0)
+        row.set(0, InlineValue::string(beds[i % beds.size()]));
+      if (i % 3 != 0)
+        row.set(1, InlineValue::boolean(i % 2 == 0));
+      if (i % 7 != 0)
+        row.set(2, InlineValue::floating(60.0 + i % 11));
+      // Integer cells of a Float column are kept as written
+      row.set(3, i % 4 ? InlineValue::floating(i * 0.5)
+                       : InlineValue::integer(i));
+      // Column 4 stays null in every row
+      rows.push_back(std::move(row));
+    }
+    roundTrip({ColumnType::String, ColumnType::Boolean, ColumnType::Float,
+               ColumnType::Float, ColumnType::String},
+              rows);
+    std::vector<InlineValue> col;
+    TimeSeriesChunk::encode({ColumnType::String, ColumnType::Boolean,
+                             ColumnType::Float, ColumnType::Float,
+                             ColumnType::String},
+                            rows)
+        .decodeColumn(3, col);
+    assert(col[4].type() == ValueType::Integer && col[4].asInt() == 4);
+    assert(col[5].type() == ValueType::Float && col[5].asFloat() == 2.5);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: regular samples compress to a few bytes a row..."
+            << std::endl;
+  {
+    std::vector<InlineRow> rows;
+    for (int64_t i = 0; i < 3600; ++i) {
+      InlineRow row(3);
+      row.set(0, InlineValue::integer(1700000000 + i));
+      row.set(1, InlineValue::string(i % 2 ? "bed-1" : "bed-2"));
+      row.set(2, InlineValue::floating(72.0 + static_cast<double>(i % 4)));
+      rows.push_back(std::move(row));
+    }
+    auto chunk = TimeSeriesChunk::encode(
+        {ColumnType::Integer, ColumnType::String, ColumnType::Float}, rows);
+    // One bit per timestamp and tag, a few bits per value
+    assert(chunk.memoryBytes() < rows.size() * 3);
+    roundTrip({ColumnType::Integer, ColumnType::String, ColumnType::Float},
+              rows);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: sealed partitions in the storage..." << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    assert(ts.createSeries("vitals", vitalsSchema(), TimePartition::Hourly)
+               .ok());
+    // Ten hours at 1 Hz, two beds: nine sealed hours and a head hour
+    const int64_t n = 36000;
+    for (int64_t t = 0; t < n; ++t)
+      assert(ts.append("vitals", vital(t, t % 2 ? "b1" : "b2",
+                                       70.0 + static_cast<double>(t % 5)))
+                 .ok());
+    const size_t bytes = ts.memoryUsage("vitals").value();
+    // A deep Row costs ~100 bytes per sample; the head hour dominates
+    assert(bytes < static_cast<size_t>(n) * 12);
+    assert(!ts.memoryUsage("nope").hasValue());
+
+    auto all = ts.rangeQuery("vitals", {}, 0, n, std::nullopt);
+    assert(all.hasValue() && all.value().rowCount() == static_cast<size_t>(n));
+    const ResultSet &rs = all.value();
+    for (size_t r = 0; r < rs.rowCount(); r += 997) {
+      assert(rs.at(r, 0).asInt() == static_cast<int64_t>(r));
+      assert(rs.at(r, 1).asString() == (r % 2 ? "b1" : "b2"));
+      assert(rs.at(r, 2).asFloat() == 70.0 + static_cast<double>(r % 5));
+    }
+
+    std::optional<Predicate> bed(Predicate{});
+    bed->kind = Predicate::Kind::Comparison;
+    bed->column = "bed";
+    bed->op = Predicate::Op::Eq;
+    bed->rhs = ValueFactory::createString("b1");
+    auto part = ts.rangeQuery("vitals", {"hr"}, 3590, 3610, bed);
+    assert(part.hasValue() && part.value().rowCount() == 10);
+    auto avg = ts.aggregate("vitals", "hr", TimeAggregation::Avg, 0, 7200,
+                            3600, TimeGranularity::Seconds, std::nullopt);
+    assert(avg.hasValue() && avg.value().rowCount() == 2);
+    assert(avg.value().at(0, 1).asFloat() == 72.0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 5: late rows and retention over sealed data..."
+            << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    assert(ts.createSeries("late", vitalsSchema(), TimePartition::Hourly)
+               .ok());
+    for (int64_t t = 0; t < 7200; t += 60)
+      assert(ts.append("late", vital(t, "b1", 1.0)).ok());
+    // Late rows for the sealed first hour, more than one seal's worth
+    const size_t late = InMemoryTimeSeriesStorage::kLateRowsPerSeal + 10;
+    for (size_t i = 0; i < late; ++i)
+      assert(ts.append("late", vital(30, "b2", 2.0)).ok());
+    auto first = ts.rangeQuery("late", {}, 0, 3600, std::nullopt).takeValue();
+    assert(first.rowCount() == 60 + late);
+    // Timestamp order within the partition, equal timestamps as appended
+    std::vector<int64_t> seen = timestamps(first);
+    assert(seen[0] == 0 && seen[1] == 30 && seen[late] == 30);
+    assert(seen[late + 1] == 60 && seen.back() == 3540);
+
+    RetentionPolicy rp;
+    rp.ttlSeconds = 3000;
+    TimeSeriesSchema schema = vitalsSchema();
+    schema.setRetentionPolicy(rp);
+    assert(ts.createSeries("ttl", schema, TimePartition::Hourly).ok());
+    for (int64_t t = 0; t <= 7200; t += 60)
+      assert(ts.append("ttl", vital(t, "b1", 1.0)).ok());
+    auto kept = timestamps(ts.rangeQuery("ttl", {}, 0, 10000, {}).takeValue());
+    assert(kept.size() == 51 && kept.front() == 4200 && kept.back() == 7200);
+
+    rp.ttlSeconds = 0;
+    rp.maxRows = 100;
+    rp.dropOldest = true;
+    schema.setRetentionPolicy(rp);
+    assert(ts.createSeries("capped", schema, TimePartition::Hourly).ok());
+    for (int64_t t = 0; t < 3 * 3600; t += 30)
+      assert(ts.append("capped", vital(t, "b1", 1.0)).ok());
+    auto capped =
+        timestamps(ts.rangeQuery("capped", {}, 0, 100000, {}).takeValue());
+    assert(capped.size() == 100 && capped.front() == 3 * 3600 - 100 * 30);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 6: retention keeps up with long-lived series..."
+            << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    RetentionPolicy rp;
+    rp.ttlSeconds = 1800;
+    TimeSeriesSchema schema = vitalsSchema();
+    schema.setRetentionPolicy(rp);
+    assert(ts.createSeries("ttl", schema, TimePartition::Hourly).ok());
+    // A day at 1 Hz: the window slides through sealed and head rows alike
+    const int64_t n = 86400;
+    for (int64_t t = 0; t < n; ++t) {
+      assert(ts.append("ttl", vital(t, "b1", 1.0)).ok());
+      if (t % 4001 == 0) {
+        auto live = timestamps(
+            ts.rangeQuery("ttl", {}, 0, n, std::nullopt).takeValue());
+        const int64_t oldest = std::max<int64_t>(0, t - 1800);
+        assert(live.size() == static_cast<size_t>(t - oldest + 1));
+        assert(live.front() == oldest && live.back() == t);
+      }
+    }
+    // Late rows: kept while live, never resurrected once expired
+    assert(ts.append("ttl", vital(n - 100, "b2", 2.0)).ok());
+    assert(ts.append("ttl", vital(n - 5000, "b2", 2.0)).ok());
+    auto tail = timestamps(
+        ts.rangeQuery("ttl", {}, 0, n, std::nullopt).takeValue());
+    assert(tail.size() == 1802 && tail.front() == n - 1801);
+    assert(tail[1701] == n - 100 && tail[1702] == n - 100);
+    // The retained rows, not the day of history, bound the memory use:
+    // the head hour, buffered uncompressed
+    assert(ts.memoryUsage("ttl").value() < 3600 * 128);
+
+    rp.ttlSeconds = 0;
+    rp.maxRows = 500;
+    rp.dropOldest = true;
+    schema.setRetentionPolicy(rp);
+    assert(ts.createSeries("capped", schema, TimePartition::Hourly).ok());
+    for (int64_t t = 0; t < 4 * 3600; ++t) {
+      assert(ts.append("capped", vital(t, "b1", 1.0)).ok());
+      // Late rows interleave with the sealed rows of the oldest partition
+      if (t % 700 == 0 && t >= 3600)
+        assert(ts.append("capped", vital(t - 400, "b2", 2.0)).ok());
+    }
+    auto capped = ts.rangeQuery("capped", {}, 0, 100000, std::nullopt)
+                      .takeValue();
+    std::vector<int64_t> kept = timestamps(capped);
+    assert(kept.size() == 500 && kept.back() == 4 * 3600 - 1);
+    for (size_t i = 1; i < kept.size(); ++i)
+      assert(kept[i - 1] <= kept[i]);
+    // The newest 500 rows: 4 * 3600 - 500 is 13900, the late row for
+    // 13600 - 400 is older
+    assert(kept.front() == 4 * 3600 - 500);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 7: a lateness window keeps recent partitions open..."
+            << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    TimeSeriesSchema schema = vitalsSchema();
+    schema.setLatenessSeconds(60);
+    assert(ts.createSeries("open", schema, TimePartition::Hourly).ok());
+    assert(ts.createSeries("eager", vitalsSchema(), TimePartition::Hourly)
+               .ok());
+    for (const char *series : {"open", "eager"}) {
+      for (int64_t t = 0; t < 3630; ++t)
+        assert(ts.append(series, vital(t, "b1", 1.0)).ok());
+      // A gateway burst of the last 30 seconds of the hour, under a minute
+      // late
+      for (int64_t t = 3570; t < 3600; ++t)
+        assert(ts.append(series, vital(t, "b2", 2.0)).ok());
+    }
+    // The first hour is still buffered in place where the window is open,
+    // and sealed with a late-row buffer where it is not
+    const size_t openBytes = ts.memoryUsage("open").value();
+    assert(openBytes > ts.memoryUsage("eager").value());
+    for (const char *series : {"open", "eager"}) {
+      auto rs = ts.rangeQuery(series, {}, 3560, 3640, std::nullopt)
+                    .takeValue();
+      std::vector<int64_t> seen = timestamps(rs);
+      assert(seen.size() == 70 + 30 && seen.front() == 3560);
+      for (size_t i = 1; i < seen.size(); ++i)
+        assert(seen[i - 1] <= seen[i]);
+      // Equal timestamps keep their append order
+      assert(rs.at(10, 1).asString() == "b1" &&
+             rs.at(11, 1).asString() == "b2");
+    }
+    // Once the newest row is a minute past the hour, it is sealed
+    for (int64_t t = 3630; t < 3700; ++t)
+      assert(ts.append("open", vital(t, "b1", 1.0)).ok());
+    assert(ts.memoryUsage("open").value() * 4 < openBytes);
+    assert(ts.rangeQuery("open", {}, 0, 3600, std::nullopt)
+               .value()
+               .rowCount() == 3600 + 30);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll time-series chunk tests passed!" << std::endl;
+  return 0;
+}
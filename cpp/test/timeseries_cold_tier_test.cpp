@@ -0,0 +1,314 @@
+#include "kadedb/predicate_builder.h"
+#include "kadedb/schema.h"
+#include "kadedb/serialization.h"
+#include "kadedb/storage.h"
+#include "kadedb/timeseries/chunk.h"
+#include "kadedb/timeseries/cold.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+namespace fs = std::filesystem;
+
+// (timestamp, bed STRING nullable, hr FLOAT, steps INTEGER nullable)
+static TimeSeriesSchema vitalsSchema(RetentionPolicy rp = {}) {
+  TimeSeriesSchema schema("timestamp", TimeGranularity::Seconds);
+  schema.addTagColumn(Column{"bed", ColumnType::String, true, false, {}});
+  schema.addValueColumn(Column{"hr", ColumnType::Float, false, false, {}});
+  schema.addValueColumn(Column{"steps", ColumnType::Integer, true, false, {}});
+  schema.setRetentionPolicy(rp);
+  return schema;
+}
+
+static Row vital(int64_t ts) {
+  Row r(4);
+  r.set(0, ValueFactory::createInteger(ts));
+  r.set(1, ValueFactory::createString(ts % 3 ? "b1" : "b2"));
+  r.set(2, ValueFactory::createFloat(60.0 + static_cast<double>(ts % 37)));
+  if (ts % 7)
+    r.set(3, ValueFactory::createInteger(ts % 11));
+  return r;
+}
+
+static std::vector<std::string> lines(const ResultSet &rs) {
+  std::vector<std::string> out;
+  for (size_t r = 0; r < rs.rowCount(); ++r) {
+    std::string line;
+    for (size_t c = 0; c < rs.columnCount(); ++c) {
+      const auto &cell = rs.row(r).values()[c];
+      line += (cell ? cell->toString() : "null") + ",";
+    }
+    out.push_back(line);
+  }
+  return out;
+}
+
+static std::vector<std::string>
+range(TimeSeriesStorage &ts, const std::string &series, int64_t start,
+      int64_t end, const std::optional<Predicate> &where = std::nullopt) {
+  auto res = ts.rangeQuery(series, {}, start, end, where);
+  assert(res.hasValue());
+  return lines(res.value());
+}
+
+static std::vector<std::string>
+agg(TimeSeriesStorage &ts, const std::string &series, TimeAggregation a,
+    int64_t start, int64_t end, int64_t width,
+    const std::optional<Predicate> &where = std::nullopt) {
+  auto res = ts.aggregate(series, "hr", a, start, end, width,
+                          TimeGranularity::Seconds, where);
+  assert(res.hasValue());
+  return lines(res.value());
+}
+
+static size_t filesIn(const fs::path &dir) {
+  size_t n = 0;
+  for (const auto &entry : fs::directory_iterator(dir)) {
+    (void)entry;
+    ++n;
+  }
+  return n;
+}
+
+// Both storages answer every query alike
+static void sameAnswers(InMemoryTimeSeriesStorage &hot,
+                        InMemoryTimeSeriesStorage &tiered, int64_t end) {
+  std::optional<Predicate> b2(
+      cmp("bed", Predicate::Op::Eq, ValueFactory::createString("b2")));
+  std::optional<Predicate> fast(
+      cmp("hr", Predicate::Op::Gt, ValueFactory::createFloat(90.0)));
+  for (int64_t start : {int64_t{0}, int64_t{5000}, end - 4000}) {
+    assert(range(tiered, "s", start, end) == range(hot, "s", start, end));
+    assert(range(tiered, "s", start, start + 7300, b2) ==
+           range(hot, "s", start, start + 7300, b2));
+    for (auto a : {TimeAggregation::Avg, TimeAggregation::Count,
+                   TimeAggregation::Max})
+      assert(agg(tiered, "s", a, start, end, 1800) ==
+             agg(hot, "s", a, start, end, 1800));
+    assert(agg(tiered, "s", TimeAggregation::Sum, start, end, 3600, fast) ==
+           agg(hot, "s", TimeAggregation::Sum, start, end, 3600, fast));
+  }
+}
+
+int main() {
+  std::cout << "=== Time-Series Cold Tier Tests ===" << std::endl;
+
+  const fs::path dir = fs::temp_directory_path() / "kadedb_cold_tier_test";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+
+  std::cout << "Test 1: chunks round-trip through serialize()..." << std::endl;
+  {
+    const std::vector<ColumnType> types = {
+        ColumnType::Integer, ColumnType::String, ColumnType::Float,
+        ColumnType::Integer};
+    std::vector<InlineRow> rows;
+    for (int64_t t = 0; t < 500; ++t) {
+      InlineRow r = InlineRow::fromRow(vital(t * 10));
+      // Integer cells make the Float column plain
+      if (t == 17)
+        r.set(2, InlineValue::integer(70));
+      rows.push_back(std::move(r));
+    }
+    TimeSeriesChunk chunk = TimeSeriesChunk::encode(types, rows);
+    std::string bytes;
+    chunk.serialize(bytes);
+    TimeSeriesChunk back = TimeSeriesChunk::deserialize(bytes.data(),
+                                                        bytes.size());
+    std::vector<InlineRow> decoded;
+    back.decode(decoded);
+    assert(decoded.size() == rows.size());
+    for (size_t i = 0; i < rows.size(); ++i)
+      for (size_t c = 0; c < types.size(); ++c)
+        assert(decoded[i].values()[c] == rows[i].values()[c]);
+    bool threw = false;
+    try {
+      TimeSeriesChunk::deserialize(bytes.data(), bytes.size() - 3);
+    } catch (const SerializationError &) {
+      threw = true;
+    }
+    assert(threw);
+
+    // Chunk files are removed with their ColdChunk
+    auto cache = std::make_shared<ColdChunkCache>();
+    std::string path;
+    {
+      auto file = ColdChunk::write(dir.string(), chunk, cache);
+      assert(file.hasValue() && file.value()->rowCount() == 500);
+      path = file.value()->path();
+      assert(fs::exists(path) && fs::file_size(path) < bytes.size());
+      auto loaded = file.value()->load();
+      assert(loaded.hasValue() && loaded.value()->rowCount() == 500);
+      assert(cache->misses() == 1 && cache->bytes() > 0);
+      assert(file.value()->load().hasValue() && cache->hits() == 1);
+    }
+    assert(!fs::exists(path) && cache->bytes() == 0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  // One sample every 10 s over 3 days; the last 6 hours stay in memory
+  constexpr int64_t kEnd = 3 * 86400;
+  std::vector<Row> samples;
+  for (int64_t t = 0; t < kEnd; t += 10)
+    samples.push_back(vital(t));
+
+  std::cout << "Test 2: cold partitions answer like hot ones..." << std::endl;
+  {
+    InMemoryTimeSeriesStorage hot, tiered;
+    assert(hot.createSeries("s", vitalsSchema(), TimePartition::Hourly).ok());
+    assert(
+        tiered.createSeries("s", vitalsSchema(), TimePartition::Hourly).ok());
+    assert(tiered.setColdTier("nope", dir.string(), 0).code() ==
+           StatusCode::NotFound);
+    assert(tiered.setColdTier("s", dir.string(), 6 * 3600).ok());
+    for (size_t i = 0; i < samples.size(); i += 1000) {
+      std::vector<Row> batch;
+      for (size_t j = i; j < std::min(samples.size(), i + 1000); ++j)
+        batch.push_back(samples[j].clone());
+      assert(hot.appendBatch("s", batch).ok());
+      assert(tiered.appendBatch("s", batch).ok());
+    }
+    auto stats = tiered.coldTierStats("s");
+    assert(stats.hasValue() && stats.value().lastError.empty());
+    // Every partition ending 6 hours before the newest row went out
+    assert(stats.value().coldPartitions == 72 - 7);
+    assert(stats.value().coldRows == 65 * 360);
+    assert(filesIn(dir) == stats.value().coldPartitions);
+    assert(tiered.memoryUsage("s").value() * 2 <
+           hot.memoryUsage("s").value());
+    sameAnswers(hot, tiered, kEnd);
+
+    // A small cache misses more, a large one hits
+    tiered.setColdCacheBytes(0);
+    const uint64_t misses = tiered.coldCache().misses();
+    assert(range(tiered, "s", 0, 7200).size() == 720);
+    assert(tiered.coldCache().misses() == misses + 2);
+    tiered.setColdCacheBytes(ColdChunkCache::kDefaultCapacityBytes);
+    range(tiered, "s", 0, 7200);
+    const uint64_t hits = tiered.coldCache().hits();
+    range(tiered, "s", 0, 7200);
+    assert(tiered.coldCache().hits() == hits + 2);
+
+    // A late row reads its partition back; it goes out again once sealed
+    Row late = vital(3605);
+    assert(hot.append("s", late).ok() && tiered.append("s", late).ok());
+    assert(tiered.coldTierStats("s").value().coldPartitions == 64);
+    sameAnswers(hot, tiered, kEnd);
+    for (int64_t t = kEnd; t < kEnd + 3600; t += 10) {
+      assert(hot.append("s", vital(t)).ok());
+      assert(tiered.append("s", vital(t)).ok());
+    }
+    stats = tiered.coldTierStats("s");
+    assert(stats.value().coldPartitions == 66);
+    assert(stats.value().coldRows == 66 * 360 + 1);
+    sameAnswers(hot, tiered, kEnd + 3600);
+
+    // Continuous aggregates backfill from cold partitions too
+    assert(tiered.createContinuousAggregate("s", "hr", 3600,
+                                            TimeGranularity::Seconds)
+               .ok());
+    assert(hot.createContinuousAggregate("s", "hr", 3600,
+                                         TimeGranularity::Seconds)
+               .ok());
+    assert(agg(tiered, "s", TimeAggregation::Avg, 0, kEnd, 3600) ==
+           agg(hot, "s", TimeAggregation::Avg, 0, kEnd, 3600));
+
+    // Turning the tier off reads everything back and removes the files
+    assert(tiered.setColdTier("s", "", 0).ok());
+    assert(tiered.coldTierStats("s").value().coldPartitions == 0);
+    assert(filesIn(dir) == 0);
+    sameAnswers(hot, tiered, kEnd + 3600);
+    assert(tiered.setColdTier("s", dir.string(), 3600).ok());
+    assert(filesIn(dir) > 0);
+    assert(tiered.dropSeries("s").ok());
+    assert(filesIn(dir) == 0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: retention over cold partitions..." << std::endl;
+  {
+    RetentionPolicy rp;
+    rp.ttlSeconds = 2 * 86400;
+    InMemoryTimeSeriesStorage hot, tiered;
+    assert(
+        hot.createSeries("s", vitalsSchema(rp), TimePartition::Hourly).ok());
+    assert(tiered.createSeries("s", vitalsSchema(rp), TimePartition::Hourly)
+               .ok());
+    assert(tiered.setColdTier("s", dir.string(), 3600).ok());
+    for (const auto &row : samples) {
+      assert(hot.append("s", row).ok());
+      assert(tiered.append("s", row).ok());
+    }
+    sameAnswers(hot, tiered, kEnd);
+    // Expired partitions took their files along; the oldest one left,
+    // which retention trims, stays in memory
+    auto stats = tiered.coldTierStats("s");
+    assert(stats.value().lastError.empty());
+    assert(filesIn(dir) == stats.value().coldPartitions);
+    assert(stats.value().coldPartitions == 46);
+
+    RetentionPolicy rows;
+    rows.maxRows = 5000;
+    rows.dropOldest = true;
+    InMemoryTimeSeriesStorage capped, cappedHot;
+    assert(capped.createSeries("s", vitalsSchema(rows), TimePartition::Hourly)
+               .ok());
+    assert(cappedHot
+               .createSeries("s", vitalsSchema(rows), TimePartition::Hourly)
+               .ok());
+    assert(capped.setColdTier("s", dir.string(), 0).ok());
+    for (size_t i = 0; i < 9000; ++i) {
+      assert(capped.append("s", samples[i]).ok());
+      assert(cappedHot.append("s", samples[i]).ok());
+    }
+    assert(range(capped, "s", 0, kEnd) == range(cappedHot, "s", 0, kEnd));
+  }
+  assert(filesIn(dir) == 0);
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: unreadable chunk files..." << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    ts.setColdCacheBytes(0);
+    assert(ts.createSeries("s", vitalsSchema(), TimePartition::Daily).ok());
+    assert(ts.setColdTier("s", dir.string(), 0).ok());
+    std::vector<Row> batch;
+    for (const auto &row : samples)
+      batch.push_back(row.clone());
+    assert(ts.appendBatch("s", batch).ok());
+    assert(ts.coldTierStats("s").value().coldPartitions == 2);
+    for (const auto &entry : fs::directory_iterator(dir)) {
+      std::fstream f(entry.path(), std::ios::in | std::ios::out |
+                                       std::ios::binary);
+      f.seekp(30);
+      f.write("garbage", 7);
+    }
+    auto res = ts.rangeQuery("s", {}, 0, 86400, std::nullopt);
+    assert(res.status().code() == StatusCode::Internal);
+    assert(ts.aggregate("s", "hr", TimeAggregation::Avg, 0, 86400, 3600,
+                        TimeGranularity::Seconds, std::nullopt)
+               .status()
+               .code() == StatusCode::Internal);
+    // The hot partition still answers; a late row for a cold one fails
+    // without changing the series
+    assert(range(ts, "s", 2 * 86400, kEnd).size() == 8640);
+    assert(ts.append("s", vital(50)).code() == StatusCode::Internal);
+    assert(ts.setColdTier("s", "", 0).code() == StatusCode::Internal);
+    assert(ts.coldTierStats("s").value().coldPartitions == 2);
+  }
+  assert(filesIn(dir) == 0);
+  std::cout << "  PASSED" << std::endl;
+
+  fs::remove_all(dir);
+  std::cout << "\nAll time-series cold tier tests passed!" << std::endl;
+  return 0;
+}
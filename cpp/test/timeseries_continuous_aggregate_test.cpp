@@ -0,0 +1,276 @@
+#include "kadedb/kadeql.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+
+// (timestamp, bed STRING nullable, hr FLOAT nullable, steps INTEGER)
+static TimeSeriesSchema vitalsSchema(RetentionPolicy rp = {}) {
+  TimeSeriesSchema schema("timestamp", TimeGranularity::Seconds);
+  schema.addTagColumn(Column{"bed", ColumnType::String, true, false, {}});
+  schema.addValueColumn(Column{"hr", ColumnType::Float, true, false, {}});
+  schema.addValueColumn(Column{"steps", ColumnType::Integer, true, false, {}});
+  schema.setRetentionPolicy(rp);
+  return schema;
+}
+
+static Row vital(int64_t ts) {
+  Row r(4);
+  r.set(0, ValueFactory::createInteger(ts));
+  r.set(1, ValueFactory::createString(ts % 2 ? "b1" : "b2"));
+  // Every 50th heart rate is missing
+  if (ts % 50 != 7)
+    r.set(2, ValueFactory::createFloat(60.0 + static_cast<double>(ts % 37)));
+  r.set(3, ValueFactory::createInteger(ts % 11));
+  return r;
+}
+
+// 1 Hz samples over [from, to), with a late sample every 97 rows
+static void fill(TimeSeriesStorage &ts, const std::string &series,
+                 int64_t from, int64_t to) {
+  for (int64_t t = from; t < to; ++t) {
+    assert(ts.append(series, vital(t)).ok());
+    if (t % 97 == 96 && t - 2000 >= 0)
+      assert(ts.append(series, vital(t - 2000)).ok());
+  }
+}
+
+static std::string text(const ResultSet &rs) {
+  std::string out;
+  for (size_t r = 0; r < rs.rowCount(); ++r) {
+    for (size_t c = 0; c < rs.columnCount(); ++c) {
+      const auto &cell = rs.row(r).values()[c];
+      out += (cell ? cell->toString() : "null") + ",";
+    }
+    out += "\n";
+  }
+  return out;
+}
+
+// The same aggregate on the series with rollups and on the one without
+static void sameAggregate(TimeSeriesStorage &ts, TimeAggregation agg,
+                          int64_t start, int64_t end, int64_t width) {
+  auto a = ts.aggregate("rolled", "hr", agg, start, end, width,
+                        TimeGranularity::Seconds, std::nullopt);
+  auto b = ts.aggregate("raw", "hr", agg, start, end, width,
+                        TimeGranularity::Seconds, std::nullopt);
+  assert(a.hasValue() && b.hasValue());
+  assert(a.value().rowCount() > 0);
+  assert(text(a.value()) == text(b.value()));
+}
+
+static ResultSet run(QueryExecutor &exec, const std::string &q) {
+  auto res = exec.execute(*parseQuery(q));
+  assert(res.hasValue());
+  return res.takeValue();
+}
+
+int main() {
+  std::cout << "=== Time-Series Continuous Aggregate Tests ===" << std::endl;
+
+  std::cout << "Test 1: creating and dropping..." << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    assert(ts.createSeries("v", vitalsSchema(), TimePartition::Hourly).ok());
+    const auto S = TimeGranularity::Seconds;
+    assert(ts.createContinuousAggregate("v", "hr", 1, TimeGranularity::Minutes)
+               .ok());
+    assert(ts.createContinuousAggregate("v", "hr", 60, S).code() ==
+           StatusCode::AlreadyExists);
+    assert(ts.createContinuousAggregate("v", "steps", 60, S).ok());
+    assert(ts.createContinuousAggregate("v", "bed", 60, S).code() ==
+           StatusCode::InvalidArgument);
+    assert(ts.createContinuousAggregate("v", "nope", 60, S).code() ==
+           StatusCode::InvalidArgument);
+    assert(ts.createContinuousAggregate("v", "hr", 0, S).code() ==
+           StatusCode::InvalidArgument);
+    assert(ts.createContinuousAggregate("nope", "hr", 60, S).code() ==
+           StatusCode::NotFound);
+
+    // Buckets tiled by the 60s rollup only
+    assert(ts.continuousAggregate("v", "hr", 300, 0, 600).hasValue());
+    assert(ts.continuousAggregate("v", "hr", 90, 0, 900).status().code() ==
+           StatusCode::NotFound);
+    assert(ts.continuousAggregate("v", "hr", 300, 30, 600).status().code() ==
+           StatusCode::NotFound);
+    assert(ts.continuousAggregate("nope", "hr", 60, 0, 60).status().code() ==
+           StatusCode::NotFound);
+
+    assert(ts.dropContinuousAggregate("v", "hr", 60, S).ok());
+    assert(ts.dropContinuousAggregate("v", "hr", 60, S).code() ==
+           StatusCode::NotFound);
+    assert(ts.continuousAggregate("v", "hr", 60, 0, 60).status().code() ==
+           StatusCode::NotFound);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: rollups answer what the rows answer..." << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    assert(
+        ts.createSeries("rolled", vitalsSchema(), TimePartition::Hourly).ok());
+    assert(ts.createSeries("raw", vitalsSchema(), TimePartition::Hourly).ok());
+    // Half the rows exist before the rollup, half arrive after it
+    fill(ts, "rolled", 0, 3 * 3600);
+    fill(ts, "raw", 0, 3 * 3600);
+    assert(ts.createContinuousAggregate("rolled", "hr", 60,
+                                        TimeGranularity::Seconds)
+               .ok());
+    fill(ts, "rolled", 3 * 3600, 6 * 3600);
+    fill(ts, "raw", 3 * 3600, 6 * 3600);
+
+    for (auto agg : {TimeAggregation::Avg, TimeAggregation::Min,
+                     TimeAggregation::Max, TimeAggregation::Sum,
+                     TimeAggregation::Count}) {
+      sameAggregate(ts, agg, 0, 6 * 3600, 300);
+      sameAggregate(ts, agg, 1200, 4800, 3600);
+      // Past the newest row the range end need not be aligned
+      sameAggregate(ts, agg, 3600, 6 * 3600 + 17, 600);
+      // Unaligned requests read the rows
+      sameAggregate(ts, agg, 30, 7230, 300);
+    }
+
+    auto hours = ts.continuousAggregate("rolled", "hr", 3600, 0, 2 * 3600);
+    assert(hours.hasValue() && hours.value().size() == 2);
+    const TimeBucketStats &h = hours.value()[1];
+    // The late copies of [1600, 5600) land an hour or less back
+    int64_t rows = 0, values = 0;
+    double sum = 0;
+    for (int64_t t = 0; t < 6 * 3600; ++t) {
+      std::vector<int64_t> times{t};
+      if (t % 97 == 96 && t - 2000 >= 0)
+        times.push_back(t - 2000);
+      for (int64_t s : times) {
+        if (s < 3600 || s >= 7200)
+          continue;
+        ++rows;
+        if (s % 50 != 7) {
+          ++values;
+          sum += 60.0 + static_cast<double>(s % 37);
+        }
+      }
+    }
+    assert(h.bucketStart == 3600 && h.rows == rows && h.values == values);
+    assert(h.sum == sum && h.min == 60.0 && h.max == 96.0);
+    assert(h.firstTs == 3600 && h.lastTs == 7199 && h.allFloat);
+    assert(h.first.asFloat() == 60.0 + 3600 % 37);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: retention evicts rolled-up rows..." << std::endl;
+  {
+    for (int bound = 0; bound < 2; ++bound) {
+      RetentionPolicy rp;
+      if (bound == 0)
+        rp.ttlSeconds = 5000;
+      else
+        rp.maxRows = 4321;
+      InMemoryTimeSeriesStorage ts;
+      assert(ts.createSeries("rolled", vitalsSchema(rp), TimePartition::Hourly)
+                 .ok());
+      assert(
+          ts.createSeries("raw", vitalsSchema(rp), TimePartition::Hourly).ok());
+      assert(ts.createContinuousAggregate("rolled", "hr", 60,
+                                          TimeGranularity::Seconds)
+                 .ok());
+      fill(ts, "rolled", 0, 5 * 3600);
+      fill(ts, "raw", 0, 5 * 3600);
+      for (auto agg : {TimeAggregation::Avg, TimeAggregation::Min,
+                       TimeAggregation::Sum, TimeAggregation::Count})
+        sameAggregate(ts, agg, 0, 5 * 3600, 300);
+      // Evicted buckets are gone, the one holding the oldest row is partial
+      auto minutes = ts.continuousAggregate("rolled", "hr", 60, 0, 5 * 3600);
+      auto oldest = ts.aggregate("raw", "hr", TimeAggregation::Count, 0,
+                                 5 * 3600, 60, TimeGranularity::Seconds,
+                                 std::nullopt);
+      assert(minutes.value().size() == oldest.value().rowCount());
+      assert(minutes.value()[0].bucketStart == oldest.value().at(0, 0).asInt());
+      assert(minutes.value()[0].rows == oldest.value().at(0, 1).asInt());
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: KadeQL TIME_BUCKET queries read the rollups..."
+            << std::endl;
+  {
+    InMemoryRelationalStorage st;
+    InMemoryTimeSeriesStorage ts;
+    assert(
+        ts.createSeries("rolled", vitalsSchema(), TimePartition::Hourly).ok());
+    assert(ts.createSeries("raw", vitalsSchema(), TimePartition::Hourly).ok());
+    assert(ts.createContinuousAggregate("rolled", "hr", 300,
+                                        TimeGranularity::Seconds)
+               .ok());
+    fill(ts, "rolled", 0, 4 * 3600);
+    fill(ts, "raw", 0, 4 * 3600);
+    QueryExecutor exec(st, ts);
+
+    const std::string items =
+        "SELECT TIME_BUCKET(timestamp, 900) AS b, COUNT(*) AS n, "
+        "COUNT(hr) AS c, SUM(hr) AS s, AVG(hr) AS a, MIN(hr), MAX(hr), "
+        "FIRST(hr), LAST(hr, timestamp) FROM ";
+    for (const std::string &rest :
+         {std::string(" GROUP BY b"),
+          std::string(" WHERE timestamp >= 1800 AND timestamp < 9000 GROUP "
+                      "BY b ORDER BY b DESC LIMIT 3"),
+          std::string(" WHERE timestamp < 3600 GROUP BY TIME_BUCKET("
+                      "timestamp, 900)")}) {
+      auto a = run(exec, items + "rolled" + rest);
+      auto b = run(exec, items + "raw" + rest);
+      assert(a.columnNames() == b.columnNames());
+      assert(a.columnTypes() == b.columnTypes());
+      assert(a.rowCount() > 0 && text(a) == text(b));
+    }
+
+    auto plan = run(exec, "EXPLAIN " + items + "rolled WHERE timestamp >= "
+                                               "1800 GROUP BY b ORDER BY b");
+    assert(plan.rowCount() == 2 && plan.at(1, 1).asString() == "Sort");
+    assert(plan.at(0, 2).asString() ==
+           "continuous aggregate of hr in 900s buckets, series rolled time "
+           "range [1800, +inf)");
+
+    // Folded from the rows by the series: unaligned ranges and buckets,
+    // other filters
+    for (std::string q :
+         {"SELECT TIME_BUCKET(timestamp, 900) AS b, AVG(hr) FROM rolled "
+          "WHERE timestamp >= 1801 GROUP BY b",
+          "SELECT TIME_BUCKET(timestamp, 450) AS b, AVG(hr) FROM rolled "
+          "GROUP BY b",
+          "SELECT TIME_BUCKET(timestamp, 900) AS b, AVG(hr) FROM rolled "
+          "WHERE hr > 70 GROUP BY b"}) {
+      auto explained = run(exec, "EXPLAIN " + q);
+      assert(explained.rowCount() == 1);
+      assert(explained.at(0, 2).asString().rfind("bucket statistics of hr",
+                                                 0) == 0);
+      assert(run(exec, q).rowCount() > 0);
+    }
+
+    // Aggregated from the rows: other group keys, Integer columns, HAVING
+    for (std::string q :
+         {"SELECT TIME_BUCKET(timestamp, 900) AS b, bed, AVG(hr) FROM rolled "
+          "GROUP BY b, bed",
+          "SELECT TIME_BUCKET(timestamp, 900) AS b, SUM(steps) FROM rolled "
+          "GROUP BY b",
+          "SELECT TIME_BUCKET(timestamp, 900) AS b, AVG(hr) AS a FROM rolled "
+          "GROUP BY b HAVING a > 70"}) {
+      auto explained = run(exec, "EXPLAIN " + q);
+      assert(explained.at(1, 1).asString() == "HashAggregate");
+      assert(run(exec, q).rowCount() > 0);
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll time-series continuous aggregate tests passed!"
+            << std::endl;
+  return 0;
+}
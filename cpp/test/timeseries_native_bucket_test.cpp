@@ -0,0 +1,306 @@
+#include "kadedb/kadeql.h"
+#include "kadedb/metrics.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/value.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+
+// (timestamp in ms, tag STRING nullable, x FLOAT nullable, y FLOAT)
+static TimeSeriesSchema meterSchema() {
+  TimeSeriesSchema schema("timestamp", TimeGranularity::Milliseconds);
+  schema.addTagColumn(Column{"tag", ColumnType::String, true, false, {}});
+  schema.addValueColumn(Column{"x", ColumnType::Float, true, false, {}});
+  schema.addValueColumn(Column{"y", ColumnType::Float, true, false, {}});
+  return schema;
+}
+
+// Quarters, so sums are exact in any order
+static Row meter(int64_t i) {
+  Row r(4);
+  r.set(0, ValueFactory::createInteger(i * 997));
+  r.set(1, ValueFactory::createString(i % 3 ? "a" : "b"));
+  if (i % 41 != 5)
+    r.set(2, ValueFactory::createFloat(static_cast<double>(i % 53) / 4));
+  r.set(3, ValueFactory::createFloat(static_cast<double>(i % 17) - 8));
+  return r;
+}
+
+// The rows of `meter` for i in [from, to) in a series, appended out of
+// order, and in a table in timestamp order
+static void fill(InMemoryTimeSeriesStorage &ts, InMemoryRelationalStorage &st,
+                 int64_t from, int64_t to) {
+  assert(ts.createSeries("m", meterSchema(), TimePartition::Hourly).ok());
+  TableSchema t({Column{"timestamp", ColumnType::Integer, false, false, {}},
+                 Column{"tag", ColumnType::String, true, false, {}},
+                 Column{"x", ColumnType::Float, true, false, {}},
+                 Column{"y", ColumnType::Float, true, false, {}}});
+  assert(st.createTable("t", t).ok());
+  std::vector<int64_t> order;
+  for (int64_t i = from; i < to; ++i) {
+    assert(st.insertRow("t", meter(i)).ok());
+    order.push_back(i);
+  }
+  std::shuffle(order.begin(), order.end(), std::mt19937(3));
+  for (int64_t i : order)
+    assert(ts.append("m", meter(i)).ok());
+}
+
+static ResultSet run(QueryExecutor &exec, const std::string &q) {
+  auto stmt = parseQuery(q);
+  auto res = exec.execute(*stmt);
+  assert(res.hasValue());
+  return res.takeValue();
+}
+
+static std::string text(const ResultSet &rs) {
+  std::string out;
+  for (size_t r = 0; r < rs.rowCount(); ++r) {
+    for (size_t c = 0; c < rs.columnCount(); ++c) {
+      const auto &cell = rs.row(r).values()[c];
+      out += (cell ? cell->toString() : "null") + ",";
+    }
+    out += "\n";
+  }
+  return out;
+}
+
+// Stage details of EXPLAIN `q`
+static std::vector<std::string> explain(QueryExecutor &exec,
+                                        const std::string &q) {
+  auto rs = run(exec, "EXPLAIN " + q);
+  std::vector<std::string> out;
+  for (size_t r = 0; r < rs.rowCount(); ++r)
+    out.push_back(rs.at(r, 1).asString() + ": " + rs.at(r, 2).asString());
+  return out;
+}
+
+// The same query on the series and on the table, whose rows are
+// aggregated one by one
+static void assertSameAnswer(QueryExecutor &exec, const std::string &items,
+                             const std::string &rest) {
+  auto a = run(exec, items + " FROM m" + rest);
+  auto b = run(exec, items + " FROM t" + rest);
+  assert(a.columnNames() == b.columnNames());
+  assert(a.columnTypes() == b.columnTypes());
+  assert(a.rowCount() > 0 && text(a) == text(b));
+}
+
+// Every call but bucketStats() goes to `base`, so the default
+// implementation answers it
+class ForwardingStorage final : public TimeSeriesStorage {
+public:
+  explicit ForwardingStorage(TimeSeriesStorage &base) : base_(base) {}
+  Status createSeries(const std::string &series,
+                      const TimeSeriesSchema &schema,
+                      TimePartition partition) override {
+    return base_.createSeries(series, schema, partition);
+  }
+  Status dropSeries(const std::string &series) override {
+    return base_.dropSeries(series);
+  }
+  std::vector<std::string> listSeries() const override {
+    return base_.listSeries();
+  }
+  Status append(const std::string &series, const Row &row) override {
+    return base_.append(series, row);
+  }
+  Result<ResultSet> rangeQuery(const std::string &series,
+                               const std::vector<std::string> &columns,
+                               int64_t startInclusive, int64_t endExclusive,
+                               const std::optional<Predicate> &where) override {
+    return base_.rangeQuery(series, columns, startInclusive, endExclusive,
+                            where);
+  }
+  Result<TimeSeriesSchema>
+  getSeriesSchema(const std::string &series) const override {
+    return base_.getSeriesSchema(series);
+  }
+  Result<ResultSet> aggregate(const std::string &series,
+                              const std::string &valueColumn,
+                              TimeAggregation agg, int64_t startInclusive,
+                              int64_t endExclusive, int64_t bucketWidth,
+                              TimeGranularity bucketGranularity,
+                              const std::optional<Predicate> &where,
+                              double quantile) override {
+    return base_.aggregate(series, valueColumn, agg, startInclusive,
+                           endExclusive, bucketWidth, bucketGranularity,
+                           where, quantile);
+  }
+
+private:
+  TimeSeriesStorage &base_;
+};
+
+int main() {
+  std::cout << "=== Time-Series Native Bucket Tests ===" << std::endl;
+
+  std::cout << "Test 1: TIME_BUCKET queries match the row aggregation..."
+            << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    InMemoryRelationalStorage st;
+    // About -33 minutes to +3.3 hours, over five partitions
+    fill(ts, st, -2000, 12000);
+    QueryExecutor exec(st, ts);
+
+    const std::string items =
+        "SELECT TIME_BUCKET(timestamp, 600000) AS b, COUNT(*) AS n, "
+        "COUNT(x) AS c, SUM(x) AS s, AVG(x) AS a, MIN(x), MAX(y), "
+        "FIRST(x), LAST(y, timestamp)";
+    const std::vector<std::string> rests = {
+        " GROUP BY b",
+        " WHERE timestamp >= 700000 AND timestamp < 5400001 GROUP BY b "
+        "ORDER BY b DESC LIMIT 4",
+        " WHERE tag = 'a' AND y > -3.0 GROUP BY TIME_BUCKET(timestamp, "
+        "600000)",
+        " WHERE timestamp > 3600000 AND x >= 10.0 GROUP BY b ORDER BY s"};
+    for (size_t threads : {1, 4}) {
+      ts.setScanThreads(threads);
+      for (const auto &rest : rests)
+        assertSameAnswer(exec, items, rest);
+      // Buckets of other widths, down to single rows
+      assertSameAnswer(exec, "SELECT TIME_BUCKET(timestamp, 997) AS b, "
+                             "SUM(y), FIRST(x)",
+                       " WHERE timestamp < 100000 GROUP BY b");
+      assertSameAnswer(exec, "SELECT TIME_BUCKET(timestamp, 7777777) AS b, "
+                             "AVG(y), LAST(x)",
+                       " GROUP BY b");
+    }
+
+    // The series answers in a single stage, reading only the partitions
+    // in range
+    auto stages = explain(exec, items + " FROM m" + rests[1]);
+    assert(stages.size() == 3);
+    assert(stages[0] ==
+           "Scan: bucket statistics of x, y per TIME_BUCKET(timestamp, "
+           "600000), series m time range [700000, 5400001) filtered by "
+           "(timestamp < 5400001 AND timestamp >= 700000)");
+    assert(stages[1].rfind("Sort", 0) == 0);
+    assert(explain(exec, items + " FROM t" + rests[1])[1].rfind(
+               "HashAggregate", 0) == 0);
+    {
+      metrics::OperationScope probe(metrics::Operation::KadeqlExecute);
+      run(exec, items + " FROM m WHERE timestamp >= 0 AND timestamp < "
+                        "600000 GROUP BY b");
+      assert(probe.rowsScanned() < 3700);
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: Integer cells keep the types of the rows..."
+            << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    InMemoryRelationalStorage st;
+    fill(ts, st, 0, 3000);
+    QueryExecutor exec(st, ts);
+    // A Float column takes Integer cells: their SUM is an Integer, and
+    // MIN and MAX pass them through
+    for (int64_t i = 3000; i < 3200; ++i) {
+      Row r = meter(i);
+      r.set(2, ValueFactory::createInteger(i % 7));
+      assert(ts.append("m", r).ok());
+      assert(st.insertRow("t", r).ok());
+    }
+    const std::string items = "SELECT TIME_BUCKET(timestamp, 100000) AS b, "
+                              "SUM(x) AS s, MIN(x), MAX(x), AVG(x), "
+                              "FIRST(x)";
+    assertSameAnswer(exec, items, " GROUP BY b");
+    auto rs = run(exec, items + " FROM m WHERE timestamp >= 3000000 GROUP "
+                                "BY b");
+    assert(rs.at(0, 1).type() == ValueType::Integer);
+    assert(rs.at(0, 2).type() == ValueType::Integer);
+    // COUNT, AVG, FIRST and LAST do not depend on the cell types
+    assertSameAnswer(exec, "SELECT TIME_BUCKET(timestamp, 100000) AS b, "
+                           "COUNT(x), AVG(x), LAST(x)",
+                     " GROUP BY b");
+    // Integer columns, residual conditions and other keys aggregate rows
+    TimeSeriesSchema counts("timestamp", TimeGranularity::Seconds);
+    counts.addValueColumn(Column{"n", ColumnType::Integer, true, false, {}});
+    assert(ts.createSeries("counts", counts, TimePartition::Hourly).ok());
+    for (const std::string &q :
+         {std::string("SELECT TIME_BUCKET(timestamp, 60) AS b, SUM(n) FROM "
+                      "counts GROUP BY b"),
+          std::string("SELECT TIME_BUCKET(timestamp, 60) AS b, tag, SUM(x) "
+                      "FROM m GROUP BY b, tag"),
+          std::string("SELECT TIME_BUCKET(timestamp, 60) AS b, SUM(x) AS s "
+                      "FROM m GROUP BY b HAVING s > 1")})
+      assert(explain(exec, q)[1].rfind("HashAggregate", 0) == 0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: bucketStats() and its default implementation..."
+            << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    InMemoryRelationalStorage st;
+    fill(ts, st, -500, 4500);
+    ts.setScanThreads(3);
+    ForwardingStorage fwd(ts);
+    Predicate where;
+    where.kind = Predicate::Kind::Comparison;
+    where.column = "tag";
+    where.op = Predicate::Op::Eq;
+    where.rhs = ValueFactory::createString("a");
+    for (const std::optional<Predicate> &w :
+         {std::optional<Predicate>(), std::optional<Predicate>(
+                                          copyPredicate(where))}) {
+      auto native = ts.bucketStats("m", {"y", "x"}, -199400, 4000000, 250000,
+                                   w, true);
+      auto folded = fwd.bucketStats("m", {"y", "x"}, -199400, 4000000,
+                                    250000, w, true);
+      assert(native.hasValue() && folded.hasValue());
+      const auto &a = native.value();
+      const auto &b = folded.value();
+      assert(a.size() == 2 && b.size() == 2);
+      // Truncated toward zero: the bucket at 0 spans (-250000, 250000)
+      assert(a[0].size() == 16 && a[0][0].bucketStart == 0);
+      assert(a[0][1].bucketStart == 250000);
+      for (size_t c = 0; c < 2; ++c) {
+        assert(a[c].size() == b[c].size());
+        for (size_t r = 0; r < a[c].size(); ++r) {
+          const TimeBucketStats &x = a[c][r], &y = b[c][r];
+          assert(x.bucketStart == y.bucketStart && x.rows == y.rows);
+          assert(x.values == y.values && x.sum == y.sum);
+          assert(x.min == y.min && x.max == y.max);
+          assert(x.firstTs == y.firstTs && x.lastTs == y.lastTs);
+          assert(x.first.empty() == y.first.empty() &&
+                 x.last.empty() == y.last.empty());
+          assert(x.first.empty() ||
+                 x.first.toValue()->compare(*y.first.toValue()) == 0);
+          assert(x.distinct && x.digest && y.distinct && y.digest);
+        }
+      }
+      int64_t rows = 0;
+      for (const auto &bucket : a[1])
+        rows += bucket.rows;
+      assert(rows == (w ? 2809 : 4213));
+    }
+
+    const auto bad = StatusCode::InvalidArgument;
+    for (TimeSeriesStorage *s : {static_cast<TimeSeriesStorage *>(&ts),
+                                 static_cast<TimeSeriesStorage *>(&fwd)}) {
+      assert(s->bucketStats("m", {"z"}, 0, 10, 5).status().code() == bad);
+      assert(s->bucketStats("m", {"x"}, 0, 10, 0).status().code() == bad);
+      assert(s->bucketStats("missing", {"x"}, 0, 10, 5).status().code() ==
+             StatusCode::NotFound);
+      assert(s->bucketStats("m", {}, 0, 10, 5).value().empty());
+    }
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll time-series native bucket tests passed!" << std::endl;
+  return 0;
+}
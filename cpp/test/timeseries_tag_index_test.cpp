@@ -0,0 +1,347 @@
+#include "kadedb/memory.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+
+static const int64_t kMin = std::numeric_limits<int64_t>::min();
+static const int64_t kMax = std::numeric_limits<int64_t>::max();
+
+// (timestamp, ward STRING, kind STRING, hr FLOAT nullable)
+static TimeSeriesSchema vitalsSchema(RetentionPolicy rp = {}) {
+  TimeSeriesSchema schema("timestamp", TimeGranularity::Seconds);
+  schema.addTagColumn(Column{"ward", ColumnType::String, true, false, {}});
+  schema.addTagColumn(Column{"kind", ColumnType::String, true, false, {}});
+  schema.addValueColumn(Column{"hr", ColumnType::Float, true, false, {}});
+  schema.setRetentionPolicy(rp);
+  return schema;
+}
+
+static Row vital(int64_t ts, const std::string &ward, const std::string &kind,
+                 int64_t patient) {
+  Row r(4);
+  r.set(0, ValueFactory::createInteger(ts));
+  r.set(1, ValueFactory::createString(ward));
+  r.set(2, ValueFactory::createString(kind));
+  // Every 13th reading is missing
+  if ((ts / 60 + patient) % 13 != 0)
+    r.set(3, ValueFactory::createFloat(
+                 60.0 + static_cast<double>((ts / 60 * 7 + patient) % 41)));
+  return r;
+}
+
+static std::string patient(int i) { return "p" + std::to_string(100 + i); }
+static std::string wardOf(int i) { return "w" + std::to_string(i % 5); }
+static std::string kindOf(int i) { return i % 2 ? "hr" : "spo2"; }
+
+// 60 patients, a reading a minute for three hours each
+static void fill(TimeSeriesStorage &ts) {
+  for (int i = 0; i < 60; ++i) {
+    assert(ts.createSeries(patient(i), vitalsSchema(), TimePartition::Hourly)
+               .ok());
+    std::vector<Row> rows;
+    for (int64_t t = 0; t < 3 * 3600; t += 60)
+      rows.push_back(vital(t, wardOf(i), kindOf(i), i));
+    assert(ts.appendBatch(patient(i), rows).ok());
+  }
+}
+
+static std::string text(const ResultSet &rs) {
+  std::string out;
+  for (const auto &name : rs.columnNames())
+    out += name + ",";
+  out += "\n";
+  for (size_t r = 0; r < rs.rowCount(); ++r) {
+    for (size_t c = 0; c < rs.columnCount(); ++c) {
+      const auto &cell = rs.row(r).values()[c];
+      out += (cell ? cell->toString() : "null") + ",";
+    }
+    out += "\n";
+  }
+  return out;
+}
+
+static std::vector<std::string> found(const TimeSeriesStorage &ts,
+                                      const TagFilter &tags) {
+  auto res = ts.findSeriesByTags(tags);
+  assert(res.hasValue());
+  return res.value();
+}
+
+// Every row of the series carrying `tags`
+static Result<ResultSet> allRows(TimeSeriesStorage &ts, const TagFilter &tags,
+                                 const std::vector<std::string> &columns) {
+  return ts.rangeQueryByTags(tags, columns, kMin, kMax, std::nullopt);
+}
+
+static Predicate hrAbove(double v) {
+  Predicate p;
+  p.column = "hr";
+  p.op = Predicate::Op::Gt;
+  p.rhs = ValueFactory::createFloat(v);
+  return p;
+}
+
+// Only the required calls, so the by-tag queries use the defaults
+class PlainSeries final : public TimeSeriesStorage {
+public:
+  explicit PlainSeries(InMemoryTimeSeriesStorage &base) : base_(base) {}
+
+  Status createSeries(const std::string &series, const TimeSeriesSchema &schema,
+                      TimePartition partition) override {
+    return base_.createSeries(series, schema, partition);
+  }
+  Status dropSeries(const std::string &series) override {
+    return base_.dropSeries(series);
+  }
+  std::vector<std::string> listSeries() const override {
+    return base_.listSeries();
+  }
+  Status append(const std::string &series, const Row &row) override {
+    return base_.append(series, row);
+  }
+  Result<ResultSet> rangeQuery(const std::string &series,
+                               const std::vector<std::string> &columns,
+                               int64_t startInclusive, int64_t endExclusive,
+                               const std::optional<Predicate> &where) override {
+    return base_.rangeQuery(series, columns, startInclusive, endExclusive,
+                            where);
+  }
+  Result<TimeSeriesSchema>
+  getSeriesSchema(const std::string &series) const override {
+    return base_.getSeriesSchema(series);
+  }
+  Result<ResultSet> aggregate(const std::string &series,
+                              const std::string &valueColumn,
+                              TimeAggregation agg, int64_t startInclusive,
+                              int64_t endExclusive, int64_t bucketWidth,
+                              TimeGranularity bucketGranularity,
+                              const std::optional<Predicate> &where,
+                              double quantile) override {
+    return base_.aggregate(series, valueColumn, agg, startInclusive,
+                           endExclusive, bucketWidth, bucketGranularity,
+                           where, quantile);
+  }
+
+private:
+  InMemoryTimeSeriesStorage &base_;
+};
+
+int main() {
+  std::cout << "=== Time-Series Tag Index Tests ===" << std::endl;
+
+  std::cout << "Test 1: series are found by their tag values..." << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    fill(ts);
+    std::vector<std::string> want;
+    for (int i = 0; i < 60; ++i)
+      if (wardOf(i) == "w3" && kindOf(i) == "hr")
+        want.push_back(patient(i));
+    assert(want.size() == 6);
+    assert(found(ts, {{"ward", "w3"}, {"kind", "hr"}}) == want);
+    assert(found(ts, {{"ward", "w3"}}).size() == 12);
+    assert(found(ts, {{"ward", "w9"}}).empty());
+    assert(found(ts, {{"bed", "w3"}}).empty());
+    assert(ts.findSeriesByTags({}).status().code() ==
+           StatusCode::InvalidArgument);
+
+    // A patient moved to another ward is listed under both
+    assert(ts.append(patient(0), vital(4 * 3600, "w9", "spo2", 0)).ok());
+    assert(found(ts, {{"ward", "w9"}}) ==
+           std::vector<std::string>{patient(0)});
+    assert(found(ts, {{"ward", "w0"}, {"kind", "spo2"}}).front() ==
+           patient(0));
+
+    // The defaults find the same series by querying each one
+    PlainSeries plain(ts);
+    assert(plain.findSeriesByTags({{"ward", "w3"}, {"kind", "hr"}}).value() ==
+           want);
+    assert(plain.findSeriesByTags({{"ward", "w9"}}).value() ==
+           std::vector<std::string>{patient(0)});
+
+    // Dropped series leave the index
+    assert(ts.dropSeries(patient(0)).ok());
+    assert(found(ts, {{"ward", "w9"}}).empty());
+    assert(ts.createSeries(patient(0), vitalsSchema(), TimePartition::Hourly)
+               .ok());
+    assert(found(ts, {{"ward", "w0"}, {"kind", "spo2"}}).front() !=
+           patient(0));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: range queries fan out over the matching series..."
+            << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    fill(ts);
+    const TagFilter tags{{"ward", "w2"}, {"kind", "spo2"}};
+    const std::optional<Predicate> where = hrAbove(80.0);
+
+    // The same rows as a query per series, led by the series name
+    std::string want = "series,timestamp,hr,\n";
+    for (const auto &name : found(ts, tags)) {
+      auto rs = ts.rangeQuery(name, {"timestamp", "hr"}, 600, 9000, where);
+      assert(rs.hasValue());
+      std::string rows = text(rs.value());
+      rows.erase(0, rows.find('\n') + 1);
+      size_t at = 0;
+      while (at < rows.size()) {
+        want += "\"" + name + "\"," + rows.substr(at, rows.find('\n', at) - at);
+        want += "\n";
+        at = rows.find('\n', at) + 1;
+      }
+    }
+    auto serial = ts.rangeQueryByTags(tags, {"timestamp", "hr"}, 600, 9000,
+                                      where);
+    assert(serial.hasValue() && serial.value().rowCount() > 100);
+    assert(text(serial.value()) == want);
+    ts.setScanThreads(4);
+    auto parallel = ts.rangeQueryByTags(tags, {"timestamp", "hr"}, 600, 9000,
+                                        where);
+    assert(parallel.hasValue() && text(parallel.value()) == want);
+    PlainSeries plain(ts);
+    auto byDefault = plain.rangeQueryByTags(tags, {"timestamp", "hr"}, 600,
+                                            9000, where);
+    assert(byDefault.hasValue() && text(byDefault.value()) == want);
+
+    // Rows keep to the tag values even where a series holds others
+    assert(ts.append(patient(2), vital(3 * 3600, "w4", "spo2", 2)).ok());
+    auto moved = allRows(ts, {{"ward", "w4"}}, {"ward"});
+    assert(moved.hasValue());
+    for (const auto &row : moved.value())
+      assert(row.values()[1]->asString() == "w4");
+    assert(moved.value().rowCount() == 12 * 180 + 1);
+
+    // Nothing matches: the requested columns and no rows
+    auto none = allRows(ts, {{"ward", "w9"}}, {"hr"});
+    assert(none.hasValue() && none.value().rowCount() == 0);
+    assert(none.value().columnNames() ==
+           (std::vector<std::string>{"series", "hr"}));
+
+    // Series with other columns only agree on the ones asked for
+    TimeSeriesSchema wide = vitalsSchema();
+    wide.addValueColumn(Column{"spo2", ColumnType::Float, true, false, {}});
+    assert(ts.createSeries("wide", wide, TimePartition::Hourly).ok());
+    Row r(5);
+    r.set(0, ValueFactory::createInteger(60));
+    r.set(1, ValueFactory::createString("w2"));
+    r.set(2, ValueFactory::createString("spo2"));
+    assert(ts.append("wide", r).ok());
+    assert(allRows(ts, tags, {}).status().code() ==
+           StatusCode::InvalidArgument);
+    auto narrow = allRows(ts, tags, {"timestamp"});
+    assert(narrow.hasValue());
+    assert(allRows(ts, tags, {"nope"}).status().code() ==
+           StatusCode::InvalidArgument);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: aggregates merge the buckets of every series..."
+            << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    fill(ts);
+    const TagFilter tags{{"kind", "hr"}, {"ward", "w1"}};
+    // One series holding the rows of all matching ones
+    InMemoryTimeSeriesStorage one;
+    assert(one.createSeries("all", vitalsSchema(), TimePartition::Hourly).ok());
+    for (int i = 0; i < 60; ++i)
+      if (wardOf(i) == "w1" && kindOf(i) == "hr")
+        for (int64_t t = 0; t < 3 * 3600; t += 60)
+          assert(one.append("all", vital(t, "w1", "hr", i)).ok());
+
+    for (TimeAggregation agg :
+         {TimeAggregation::Avg, TimeAggregation::Min, TimeAggregation::Max,
+          TimeAggregation::Sum, TimeAggregation::Count}) {
+      const std::optional<Predicate> filters[] = {std::nullopt, hrAbove(75)};
+      for (const auto &where : filters) {
+        auto want = one.aggregate("all", "hr", agg, 300, 10500, 15,
+                                  TimeGranularity::Minutes, where);
+        assert(want.hasValue() && want.value().rowCount() == 12);
+        ts.setScanThreads(1);
+        auto serial = ts.aggregateByTags(tags, "hr", agg, 300, 10500, 15,
+                                         TimeGranularity::Minutes, where);
+        assert(serial.hasValue());
+        assert(text(serial.value()) == text(want.value()));
+        ts.setScanThreads(4);
+        auto parallel = ts.aggregateByTags(tags, "hr", agg, 300, 10500, 15,
+                                           TimeGranularity::Minutes, where);
+        assert(parallel.hasValue());
+        assert(text(parallel.value()) == text(want.value()));
+      }
+    }
+
+    assert(ts.aggregateByTags(tags, "nope", TimeAggregation::Sum, 0, 100, 10,
+                              TimeGranularity::Seconds, std::nullopt)
+               .status()
+               .code() == StatusCode::InvalidArgument);
+    auto none = ts.aggregateByTags({{"ward", "w9"}}, "hr", TimeAggregation::Sum,
+                                   0, 100, 10, TimeGranularity::Seconds,
+                                   std::nullopt);
+    assert(none.hasValue() && none.value().rowCount() == 0);
+    PlainSeries plain(ts);
+    assert(plain
+               .aggregateByTags(tags, "hr", TimeAggregation::Sum, 0, 100, 10,
+                                TimeGranularity::Seconds, std::nullopt)
+               .status()
+               .code() == StatusCode::FailedPrecondition);
+
+    // Series of another granularity do not share buckets
+    TimeSeriesSchema ms = vitalsSchema();
+    ms.setGranularity(TimeGranularity::Milliseconds);
+    assert(ts.createSeries("ms", ms, TimePartition::Hourly).ok());
+    assert(ts.append("ms", vital(1000, "w1", "hr", 0)).ok());
+    assert(ts.aggregateByTags(tags, "hr", TimeAggregation::Sum, 0, 10800, 60,
+                              TimeGranularity::Seconds, std::nullopt)
+               .status()
+               .code() == StatusCode::InvalidArgument);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: retention keeps the index to the rows held..."
+            << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    RetentionPolicy rp;
+    rp.ttlSeconds = 2 * 3600;
+    assert(ts.createSeries("bed7", vitalsSchema(rp), TimePartition::Hourly)
+               .ok());
+    // A ward per hour: w0 for the first, w1 for the second, ...
+    for (int64_t t = 0; t < 3 * 3600; t += 60)
+      assert(ts.append("bed7", vital(t, wardOf(static_cast<int>(t / 3600)),
+                                     "hr", 7))
+                 .ok());
+    assert(found(ts, {{"ward", "w0"}}).size() == 1);
+    auto hour = allRows(ts, {{"ward", "w1"}}, {"timestamp"});
+    assert(hour.hasValue() && hour.value().rowCount() == 60);
+    assert(hour.value().row(0).values()[1]->asInt() == 3600);
+
+    // The first hour expires: w0 is gone, the others stay
+    assert(ts.append("bed7", vital(4 * 3600, "w4", "hr", 7)).ok());
+    assert(found(ts, {{"ward", "w0"}}).empty());
+    assert(found(ts, {{"ward", "w1"}}).empty());
+    assert(found(ts, {{"ward", "w2"}}).size() == 1);
+    assert(found(ts, {{"ward", "w4"}, {"kind", "hr"}}).size() == 1);
+    auto gone = allRows(ts, {{"ward", "w0"}}, {});
+    assert(gone.hasValue() && gone.value().rowCount() == 0);
+
+    // Eviction under a memory budget unindexes too
+    assert(ts.setMemoryBudget("bed7", 1, BudgetPolicy::EvictOldest).ok());
+    assert(found(ts, {{"ward", "w2"}}).empty());
+    assert(found(ts, {{"ward", "w4"}}).size() == 1);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll time-series tag index tests passed!" << std::endl;
+  return 0;
+}
@@ -5,6 +5,7 @@
 
 #include <cassert>
 #include <iostream>
+#include <limits>
 
 using namespace kadedb;
 
@@ -215,6 +216,55 @@ int main() {
     ts.dropSeries("disk");
   }
 
+  // Sparse series over a wide range: partitions in range are found
+  // directly, and the boundary partitions are cut at the range edges
+  {
+    auto schema = makeSchema(TimeGranularity::Milliseconds);
+    assert(ts.createSeries("sparse", schema, TimePartition::Hourly).ok());
+    TableSchema table(schema.allColumns());
+
+    // One burst of 1 Hz samples a few times a year, plus a late sample
+    const int64_t hour = 3600LL * 1000;
+    const int64_t starts[] = {0, 2000 * hour, 5000 * hour, 8000 * hour};
+    for (int64_t start : starts)
+      for (int64_t i = 0; i < 7200; ++i)
+        assert(ts.append("sparse", makeRow(table, start + i * 1000, 1, i))
+                   .ok());
+    assert(ts.append("sparse", makeRow(table, 2000 * hour + 500, 2, -1)).ok());
+
+    auto res = ts.rangeQuery("sparse", {"timestamp", "value"},
+                             2000 * hour + 1000, 5000 * hour + 3000,
+                             std::nullopt);
+    assert(res.hasValue());
+    const ResultSet &rs = res.value();
+    // The burst at hour 2000 less its first sample, then 3 samples
+    assert(rs.rowCount() == 7199 + 3);
+    assert(rs.at(0, 0).asInt() == 2000 * hour + 1000);
+    assert(rs.at(rs.rowCount() - 1, 0).asInt() == 5000 * hour + 2000);
+    for (size_t i = 1; i < rs.rowCount(); ++i)
+      assert(rs.at(i - 1, 0).asInt() < rs.at(i, 0).asInt());
+
+    // Whole-year buckets; open-ended and empty ranges
+    auto agg = ts.aggregate("sparse", "value", TimeAggregation::Count, 0,
+                            9000 * hour, 9000, TimeGranularity::Hours,
+                            std::nullopt);
+    assert(agg.hasValue() && agg.value().rowCount() == 1);
+    assert(agg.value().at(0, 1).asInt() == 4 * 7200 + 1);
+    auto open = ts.rangeQuery("sparse", {"value"},
+                              std::numeric_limits<int64_t>::min(),
+                              std::numeric_limits<int64_t>::max(),
+                              std::nullopt);
+    assert(open.hasValue() && open.value().rowCount() == 4 * 7200 + 1);
+    auto gap = ts.rangeQuery("sparse", {}, 3000 * hour, 4000 * hour,
+                             std::nullopt);
+    assert(gap.hasValue() && gap.value().rowCount() == 0);
+    auto half = ts.rangeQuery("sparse", {}, 2000 * hour + 1, 2000 * hour + 2,
+                              std::nullopt);
+    assert(half.hasValue() && half.value().rowCount() == 0);
+
+    ts.dropSeries("sparse");
+  }
+
   std::cout << "timeseries_test passed\n";
   return 0;
 }
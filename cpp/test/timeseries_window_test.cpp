@@ -0,0 +1,304 @@
+#include "kadedb/distributed.h"
+#include "kadedb/kadeql.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/timeseries/window.h"
+#include "kadedb/value.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+
+// (timestamp ms, bed STRING, hr FLOAT nullable, steps INTEGER)
+static TimeSeriesSchema vitalsSchema() {
+  TimeSeriesSchema schema("timestamp", TimeGranularity::Milliseconds);
+  schema.addTagColumn(Column{"bed", ColumnType::String, true, false, {}});
+  schema.addValueColumn(Column{"hr", ColumnType::Float, true, false, {}});
+  schema.addValueColumn(Column{"steps", ColumnType::Integer, true, false, {}});
+  return schema;
+}
+
+// Irregular samples: 700 to 1300 ms apart, every 13th heart rate missing
+static std::vector<std::pair<int64_t, std::optional<double>>> samples() {
+  std::vector<std::pair<int64_t, std::optional<double>>> out;
+  int64_t ts = 0;
+  for (int i = 0; i < 3000; ++i) {
+    ts += 700 + (i * 37) % 601;
+    std::optional<double> hr;
+    if (i % 13 != 5)
+      hr = 60.0 + 20.0 * std::sin(i / 50.0) + (i % 7);
+    out.emplace_back(ts, hr);
+  }
+  return out;
+}
+
+static void fill(TimeSeriesStorage &ts, const std::string &series) {
+  int i = 0;
+  for (const auto &[t, hr] : samples()) {
+    Row r(4);
+    r.set(0, ValueFactory::createInteger(t));
+    r.set(1, ValueFactory::createString(i % 2 ? "b1" : "b2"));
+    if (hr)
+      r.set(2, ValueFactory::createFloat(*hr));
+    r.set(3, ValueFactory::createInteger(i++ % 11));
+    assert(ts.append(series, r).ok());
+  }
+}
+
+// The function at each sample, computed from the whole history
+static std::vector<std::optional<double>>
+reference(TimeWindowFunction fn, int64_t width) {
+  auto all = samples();
+  std::vector<std::optional<double>> out;
+  std::optional<double> ewma;
+  int64_t lastTs = 0;
+  for (size_t i = 0; i < all.size(); ++i) {
+    const auto &[t, hr] = all[i];
+    if (!hr) {
+      out.push_back(std::nullopt);
+      continue;
+    }
+    if (fn == TimeWindowFunction::Ewma) {
+      if (!ewma)
+        ewma = *hr;
+      else
+        *ewma += (1.0 - std::exp(-static_cast<double>(t - lastTs) /
+                                 static_cast<double>(width))) *
+                 (*hr - *ewma);
+      lastTs = t;
+      out.push_back(ewma);
+      continue;
+    }
+    double sum = 0;
+    size_t n = 0;
+    std::optional<std::pair<int64_t, double>> oldest;
+    for (size_t j = 0; j <= i; ++j) {
+      const auto &[u, x] = all[j];
+      if (!x || u <= t - width)
+        continue;
+      sum += *x;
+      ++n;
+      if (!oldest)
+        oldest.emplace(u, *x);
+    }
+    if (fn == TimeWindowFunction::MovingAvg)
+      out.push_back(sum / static_cast<double>(n));
+    else if (oldest->first == t)
+      out.push_back(std::nullopt);
+    else if (fn == TimeWindowFunction::Delta)
+      out.push_back(*hr - oldest->second);
+    else
+      out.push_back((*hr - oldest->second) /
+                    (static_cast<double>(t - oldest->first) / 1000.0));
+  }
+  return out;
+}
+
+static bool near(const Value &v, std::optional<double> want) {
+  if (!want)
+    return v.type() == ValueType::Null;
+  return v.type() == ValueType::Float &&
+         std::abs(v.asFloat() - *want) <= 1e-9 * (1.0 + std::abs(*want));
+}
+
+static ResultSet run(QueryExecutor &exec, const std::string &q) {
+  auto res = exec.execute(*parseQuery(q));
+  assert(res.hasValue());
+  return res.takeValue();
+}
+
+static StatusCode fails(QueryExecutor &exec, const std::string &q) {
+  auto res = exec.execute(*parseQuery(q));
+  assert(!res.hasValue());
+  return res.status().code();
+}
+
+int main() {
+  std::cout << "=== Time-Series Window Function Tests ===" << std::endl;
+
+  std::cout << "Test 1: one window over a few samples..." << std::endl;
+  {
+    TimeWindow avg(TimeWindowFunction::MovingAvg, 10, 1.0);
+    assert(*avg.add(0, 2.0) == 2.0);
+    assert(*avg.add(5, 4.0) == 3.0);
+    assert(*avg.add(10, 9.0) == 6.5); // 0 has left (10 - 10, 10]
+    assert(*avg.add(30, 1.0) == 1.0);
+
+    TimeWindow delta(TimeWindowFunction::Delta, 10, 1.0);
+    assert(!delta.add(0, 2.0));
+    assert(*delta.add(4, 5.0) == 3.0);
+    assert(!delta.add(20, 1.0)); // alone in its window
+    TimeWindow rate(TimeWindowFunction::Rate, 10, 0.5);
+    assert(!rate.add(0, 2.0));
+    assert(*rate.add(4, 6.0) == 2.0); // 4 units of half a second
+    assert(!rate.add(14, 1.0)); // 0 and 4 have left
+
+    TimeWindow ewma(TimeWindowFunction::Ewma, 10, 1.0);
+    assert(*ewma.add(0, 10.0) == 10.0);
+    assert(*ewma.add(0, 0.0) == 10.0); // no time passed, no weight
+    double e = *ewma.add(10, 0.0);
+    assert(std::abs(e - 10.0 * std::exp(-1.0)) < 1e-12);
+
+    assert(parseTimeWindowFunction("MOVING_AVG") ==
+           TimeWindowFunction::MovingAvg);
+    assert(!parseTimeWindowFunction("AVG"));
+    assert(timeUnitSeconds(TimeGranularity::Milliseconds) == 1e-3);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: TimeSeriesStorage::window..." << std::endl;
+  {
+    InMemoryTimeSeriesStorage ts;
+    assert(ts.createSeries("v", vitalsSchema(), TimePartition::Hourly).ok());
+    fill(ts, "v");
+    const auto all = samples();
+    const int64_t end = INT64_MAX;
+
+    // 30 s windows given in seconds and in milliseconds
+    for (auto fn : {TimeWindowFunction::MovingAvg, TimeWindowFunction::Rate,
+                    TimeWindowFunction::Delta, TimeWindowFunction::Ewma}) {
+      auto want = reference(fn, 30000);
+      for (auto [width, g] : {std::pair{int64_t{30}, TimeGranularity::Seconds},
+                              std::pair{int64_t{30000},
+                                        TimeGranularity::Milliseconds}}) {
+        auto got = ts.window("v", "hr", fn, 0, end, width, g, std::nullopt);
+        assert(got.hasValue());
+        const ResultSet &rs = got.value();
+        assert(rs.columnNames() ==
+               (std::vector<std::string>{"timestamp", "value"}));
+        assert(rs.rowCount() == all.size());
+        for (size_t i = 0; i < all.size(); ++i) {
+          assert(rs.at(i, 0).asInt() == all[i].first);
+          assert(near(rs.at(i, 1), want[i]));
+        }
+      }
+    }
+
+    // Windows see only the rows in range and matching the predicate
+    Predicate even;
+    even.column = "bed";
+    even.op = Predicate::Op::Eq;
+    even.rhs = ValueFactory::createString("b2");
+    std::optional<Predicate> where(std::move(even));
+    const int64_t from = 100000, to = 200000;
+    auto part = ts.window("v", "steps", TimeWindowFunction::MovingAvg, from,
+                          to, 1, TimeGranularity::Minutes, where);
+    std::vector<size_t> picked;
+    for (size_t i = 0; i < all.size(); ++i)
+      if (i % 2 == 0 && all[i].first >= from && all[i].first < to)
+        picked.push_back(i);
+    assert(part.hasValue() && part.value().rowCount() == picked.size());
+    for (size_t r = 0; r < picked.size(); ++r) {
+      const int64_t t = all[picked[r]].first;
+      double sum = 0;
+      int n = 0;
+      for (size_t k = 0; k <= r; ++k)
+        if (all[picked[k]].first > t - 60000) {
+          sum += static_cast<double>(picked[k] % 11);
+          ++n;
+        }
+      assert(near(part.value().at(r, 1), sum / n));
+    }
+
+    const auto S = TimeGranularity::Seconds;
+    const auto Ms = TimeGranularity::Milliseconds;
+    const auto Avg = TimeWindowFunction::MovingAvg;
+    assert(ts.window("v", "bed", Avg, 0, end, 1, S).status().code() ==
+           StatusCode::InvalidArgument);
+    assert(ts.window("v", "nope", Avg, 0, end, 1, S).status().code() ==
+           StatusCode::InvalidArgument);
+    assert(ts.window("v", "hr", Avg, 0, end, 0, S).status().code() ==
+           StatusCode::InvalidArgument);
+    assert(ts.window("v", "hr", Avg, 0, end, 1, TimeGranularity::Nanoseconds)
+               .status()
+               .code() == StatusCode::InvalidArgument);
+    assert(ts.window("v", "hr", Avg, 0, end, 1, Ms).hasValue());
+    assert(ts.window("nope", "hr", Avg, 0, end, 1, S).status().code() ==
+           StatusCode::NotFound);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: KadeQL window functions..." << std::endl;
+  {
+    InMemoryRelationalStorage st;
+    InMemoryTimeSeriesStorage ts;
+    assert(ts.createSeries("v", vitalsSchema(), TimePartition::Hourly).ok());
+    fill(ts, "v");
+    QueryExecutor exec(st, ts);
+    const auto all = samples();
+
+    auto rs = run(exec, "SELECT hr, MOVING_AVG(hr, 30000) AS m, "
+                        "RATE(hr, 30000) AS r, DELTA(hr, 30000), "
+                        "hr - EWMA(hr, 30000) AS dev FROM v");
+    assert(rs.columnNames() ==
+           (std::vector<std::string>{"hr", "m", "r", "delta", "dev"}));
+    assert(rs.rowCount() == all.size());
+    auto avg = reference(TimeWindowFunction::MovingAvg, 30000);
+    auto rate = reference(TimeWindowFunction::Rate, 30000);
+    auto delta = reference(TimeWindowFunction::Delta, 30000);
+    auto ewma = reference(TimeWindowFunction::Ewma, 30000);
+    for (size_t i = 0; i < all.size(); ++i) {
+      assert(near(rs.at(i, 1), avg[i]));
+      assert(near(rs.at(i, 2), rate[i]));
+      assert(near(rs.at(i, 3), delta[i]));
+      if (all[i].second)
+        assert(near(rs.at(i, 4), *all[i].second - *ewma[i]));
+    }
+
+    // The window runs before ORDER BY and LIMIT, over the filtered rows
+    const int64_t from = 1000000;
+    const std::string range =
+        " FROM v WHERE timestamp >= " + std::to_string(from);
+    auto top = run(exec, "SELECT timestamp, MOVING_AVG(steps, 5000) AS m" +
+                             range + " ORDER BY m DESC LIMIT 3");
+    auto whole = ts.window("v", "steps", TimeWindowFunction::MovingAvg, from,
+                           INT64_MAX, 5000, TimeGranularity::Milliseconds,
+                           std::nullopt);
+    double best = 0;
+    for (size_t i = 0; i < whole.value().rowCount(); ++i)
+      best = std::max(best, whole.value().at(i, 1).asFloat());
+    assert(top.rowCount() == 3 && top.at(0, 1).asFloat() == best);
+
+    auto plan = run(exec, "EXPLAIN SELECT MOVING_AVG(hr, 60000) FROM v");
+    bool window = false;
+    for (size_t i = 0; i < plan.rowCount(); ++i)
+      window = window || plan.at(i, 1).asString() == "TimeWindow";
+    assert(window);
+
+    assert(st.createTable("t", TableSchema({Column{"x", ColumnType::Integer,
+                                                   true, false, {}}}))
+               .ok());
+    assert(fails(exec, "SELECT MOVING_AVG(x, 10) FROM t") ==
+           StatusCode::InvalidArgument);
+    assert(fails(exec, "SELECT AVG(hr), RATE(hr, 10) FROM v") ==
+           StatusCode::InvalidArgument);
+    assert(fails(exec, "SELECT DELTA(hr) FROM v") ==
+           StatusCode::InvalidArgument);
+    assert(fails(exec, "SELECT DELTA(hr, 0) FROM v") ==
+           StatusCode::InvalidArgument);
+    assert(fails(exec, "SELECT EWMA(hr, steps) FROM v") ==
+           StatusCode::InvalidArgument);
+    assert(fails(exec, "SELECT EWMA(bed, 10) FROM v") ==
+           StatusCode::InvalidArgument);
+
+    auto distributed = DistributedQuery::plan(
+        "SELECT timestamp, MOVING_AVG(hr, 60000) FROM v");
+    assert(distributed.status().code() == StatusCode::InvalidArgument);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll time-series window function tests passed!"
+            << std::endl;
+  return 0;
+}
@@ -0,0 +1,206 @@
+#include "kadedb/async_executor.h"
+#include "kadedb/kadeql.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/schema.h"
+#include "kadedb/storage.h"
+#include "kadedb/tracing.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+using namespace kadedb::tracing;
+
+static std::mutex g_mtx;
+static std::vector<SpanRecord> g_spans;
+
+static void collect() {
+  {
+    std::lock_guard lk(g_mtx);
+    g_spans.clear();
+  }
+  setExporter([](const SpanRecord &r) {
+    std::lock_guard lk(g_mtx);
+    g_spans.push_back(r);
+  });
+}
+
+static std::vector<SpanRecord> spans() {
+  std::lock_guard lk(g_mtx);
+  return g_spans;
+}
+
+static const SpanRecord *find(const std::vector<SpanRecord> &all,
+                              const std::string &name) {
+  for (const auto &r : all)
+    if (r.name == name)
+      return &r;
+  return nullptr;
+}
+
+static std::string attribute(const SpanRecord &r, const std::string &key) {
+  for (const auto &kv : r.attributes)
+    if (kv.first == key)
+      return kv.second;
+  return "";
+}
+
+// t(id, grp): 20 rows in 4 groups
+static void fill(RelationalStorage &st) {
+  TableSchema t({Column{"id", ColumnType::Integer, false, false, {}},
+                 Column{"grp", ColumnType::Integer, true, false, {}}});
+  assert(st.createTable("t", t).ok());
+  for (int64_t i = 0; i < 20; ++i) {
+    Row r(2);
+    r.set(0, ValueFactory::createInteger(i));
+    r.set(1, ValueFactory::createInteger(i % 4));
+    assert(st.insertRow("t", r).ok());
+  }
+}
+
+static const std::string kParent =
+    "00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01";
+
+int main() {
+  std::cout << "=== Tracing Tests ===" << std::endl;
+
+  std::cout << "Test 1: traceparent..." << std::endl;
+  {
+    auto ctx = parseTraceparent(kParent);
+    assert(ctx && ctx->valid() && ctx->sampled);
+    assert(ctx->traceIdHigh == 0x0af7651916cd43ddull);
+    assert(ctx->traceIdLow == 0x8448eb211c80319cull);
+    assert(ctx->spanId == 0xb7ad6b7169203331ull);
+    assert(formatTraceparent(*ctx) == kParent);
+    auto unsampled = parseTraceparent(
+        "00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-00");
+    assert(unsampled && !unsampled->sampled);
+    for (const char *bad :
+         {"", "00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331",
+          "01-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01",
+          "00-0AF7651916CD43DD8448EB211C80319C-b7ad6b7169203331-01",
+          "00-00000000000000000000000000000000-b7ad6b7169203331-01",
+          "00-0af7651916cd43dd8448eb211c80319c-0000000000000000-01"})
+      assert(!parseTraceparent(bad));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: no exporter..." << std::endl;
+  {
+    setExporter(nullptr);
+    assert(!active());
+    Span s("idle");
+    assert(!s.recording() && !s.context().valid());
+    assert(!current().valid());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: query spans..." << std::endl;
+  {
+    InMemoryRelationalStorage st;
+    fill(st);
+    QueryExecutor exec(st);
+    collect();
+    {
+      ContextScope remote(*parseTraceparent(kParent));
+      auto stmt = parseQuery("SELECT grp, COUNT(*) FROM t WHERE id < 10 "
+                             "GROUP BY grp");
+      auto res = exec.execute(*stmt);
+      assert(res.hasValue() && res.value().rowCount() == 4);
+    }
+    assert(!current().valid());
+    const auto all = spans();
+    const SpanRecord *parse = find(all, "kadeql.parse");
+    const SpanRecord *execute = find(all, "kadeql.execute");
+    const SpanRecord *plan = find(all, "kadeql.plan");
+    const SpanRecord *scan = find(all, "storage.relational.scan");
+    const SpanRecord *agg = find(all, "kadeql.aggregate");
+    assert(parse && execute && plan && scan && agg);
+    for (const auto &r : all) {
+      assert(r.context.traceIdHigh == 0x0af7651916cd43ddull);
+      assert(r.context.traceIdLow == 0x8448eb211c80319cull);
+      assert(r.context.sampled && !r.error && r.startUnixNs > 0);
+    }
+    assert(parse->parentSpanId == 0xb7ad6b7169203331ull);
+    assert(execute->parentSpanId == 0xb7ad6b7169203331ull);
+    assert(plan->parentSpanId == execute->context.spanId);
+    assert(scan->parentSpanId == execute->context.spanId);
+    assert(agg->parentSpanId == scan->context.spanId);
+    assert(attribute(*execute, "db.operation") == "SELECT");
+    assert(attribute(*scan, "kadedb.table") == "t");
+    assert(attribute(*agg, "kadedb.groups") == "4");
+    assert(attribute(*plan, "kadedb.plan").find("HashAggregate") !=
+           std::string::npos);
+    assert(execute->durationNs >= scan->durationNs);
+
+    // A failing statement marks its span
+    collect();
+    assert(!exec.execute(*parseQuery("SELECT id FROM missing")).hasValue());
+    const auto failed = spans();
+    const SpanRecord *root = find(failed, "kadeql.execute");
+    assert(root && root->error && root->parentSpanId == 0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: sampling..." << std::endl;
+  {
+    collect();
+    setSampleRatio(0.0);
+    assert(sampleRatio() == 0.0);
+    {
+      Span root("root");
+      assert(!root.recording() && root.context().valid());
+      // Children follow the root's decision
+      Span child("child");
+      assert(!child.recording());
+      assert(child.context().traceIdLow == root.context().traceIdLow);
+    }
+    {
+      // A sampled remote parent is traced whatever the ratio
+      ContextScope remote(*parseTraceparent(kParent));
+      Span s("remote");
+      assert(s.recording());
+    }
+    setSampleRatio(1.0);
+    {
+      Span s("sampled");
+      assert(s.recording());
+      Span detached("detached", Span::Mode::Detached);
+      assert(current().spanId == s.context().spanId);
+    }
+    const auto all = spans();
+    assert(all.size() == 3);
+    assert(all[0].name == "remote" && all[1].name == "detached");
+    assert(all[2].name == "sampled" && all[2].parentSpanId == 0);
+    assert(all[1].parentSpanId == all[2].context.spanId);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 5: async queries..." << std::endl;
+  {
+    InMemoryRelationalStorage st;
+    fill(st);
+    AsyncQueryExecutor async(st);
+    collect();
+    {
+      ContextScope remote(*parseTraceparent(kParent));
+      auto res = async.executeAsync("SELECT id FROM t WHERE id > 15").get();
+      assert(res.hasValue() && res.value().rowCount() == 4);
+    }
+    const auto all = spans();
+    const SpanRecord *execute = find(all, "kadeql.execute");
+    assert(execute && execute->parentSpanId == 0xb7ad6b7169203331ull);
+    assert(execute->context.traceIdLow == 0x8448eb211c80319cull);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  setExporter(nullptr);
+  std::cout << "All tracing tests passed." << std::endl;
+  return 0;
+}
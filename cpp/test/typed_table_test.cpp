@@ -0,0 +1,216 @@
+#include "kadedb/columnar_storage.h"
+#include "kadedb/kadeql.h"
+#include "kadedb/predicate_builder.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/typed_table.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+
+struct Trade {
+  static constexpr auto columns =
+      typed::columns(typed::column<int64_t>("id").primaryKey(),
+                     typed::column<std::string>("symbol"),
+                     typed::column<double>("price"),
+                     typed::column<std::optional<double>>("fee"),
+                     typed::column<bool>("buy"));
+};
+using Trades = TypedTable<Trade>;
+
+constexpr size_t kId = Trades::index("id");
+constexpr size_t kSymbol = Trades::index("symbol");
+constexpr size_t kPrice = Trades::index("price");
+constexpr size_t kFee = Trades::index("fee");
+constexpr size_t kBuy = Trades::index("buy");
+static_assert(kId == 0 && kBuy == 4, "positions resolve at compile time");
+static_assert(Trades::index("missing") == Trades::npos, "unknown column");
+static_assert(std::is_same_v<Trades::CellType<kFee>, std::optional<double>>,
+              "column types resolve at compile time");
+
+static const char *kSymbols[] = {"ABC", "DEFGHIJKLMNOPQRSTU", "XY"};
+
+static Trades::Row trade(int64_t i) {
+  std::optional<double> fee;
+  if (i % 4)
+    fee = static_cast<double>(i) / 100;
+  return Trades::Row{i, kSymbols[i % 3], 10.0 + static_cast<double>(i % 50),
+                     fee, i % 2 == 0};
+}
+
+static ResultSet run(kadeql::QueryExecutor &exec, const std::string &q) {
+  auto res = exec.execute(*kadeql::parseQuery(q));
+  assert(res.hasValue());
+  return res.takeValue();
+}
+
+int main() {
+  std::cout << "=== Typed Table Tests ===" << std::endl;
+
+  std::cout << "Test 1: schemas, create and open..." << std::endl;
+  {
+    TableSchema schema = Trades::schema();
+    assert(schema.columns().size() == 5);
+    assert(schema.primaryKey() == std::optional<std::string>("id"));
+    assert(schema.columns()[kId].unique && !schema.columns()[kId].nullable);
+    assert(schema.columns()[kSymbol].type == ColumnType::String);
+    assert(schema.columns()[kFee].type == ColumnType::Float);
+    assert(schema.columns()[kFee].nullable);
+    assert(schema.columns()[kBuy].type == ColumnType::Boolean);
+
+    ColumnarRelationalStorage st;
+    assert(Trades::create(st, "trades").hasValue());
+    assert(Trades::create(st, "trades").status().code() ==
+           StatusCode::AlreadyExists);
+    assert(Trades::open(st, "trades").value().name() == "trades");
+    assert(Trades::open(st, "none").status().code() == StatusCode::NotFound);
+
+    // A nullable column needs a std::optional type
+    std::vector<Column> cols = schema.columns();
+    cols[kPrice].nullable = true;
+    assert(st.createTable("loose", TableSchema(cols)).ok());
+    assert(Trades::open(st, "loose").status().code() ==
+           StatusCode::FailedPrecondition);
+    cols = schema.columns();
+    std::swap(cols[kSymbol], cols[kPrice]);
+    assert(st.createTable("shuffled", TableSchema(cols)).ok());
+    assert(!Trades::open(st, "shuffled").hasValue());
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: typed inserts and scans..." << std::endl;
+  {
+    ColumnarRelationalStorage st;
+    Trades trades = Trades::create(st, "trades").takeValue();
+    std::vector<Trades::Row> rows;
+    for (int64_t i = 0; i < 5000; ++i)
+      rows.push_back(trade(i));
+    assert(trades.insert(rows).ok());
+    assert(trades.insert(5, [](size_t i) {
+                   return trade(5000 + static_cast<int64_t>(i));
+                 })
+               .ok());
+    assert(trades.insert(trade(6000)).ok());
+    assert(st.estimateRowCount("trades").value() == 5006);
+    assert(trades.count().value() == 5006);
+
+    // Every row reads back as inserted, strings longer than an inline
+    // cell included
+    auto all = trades.select().takeValue();
+    assert(all.size() == 5006);
+    assert(all[0] == trade(0) && all[4999] == trade(4999));
+    assert(all[5005] == trade(6000));
+
+    // Typed predicates agree with the engine's own
+    auto where = typed::gt<kPrice>(50) && typed::eq<kSymbol>("XY") &&
+                 !typed::isNull<kFee>();
+    size_t typedCount = 0;
+    double feeSum = 0;
+    assert(trades
+               .scan(where,
+                     [&](const Trades::Ref &r) {
+                       assert(r.get<kSymbol>() == "XY");
+                       assert(r.get<kPrice>() > 50);
+                       feeSum += *r.get<kFee>();
+                       ++typedCount;
+                     })
+               .ok());
+    std::vector<Predicate> parts;
+    parts.push_back(
+        cmp("price", Predicate::Op::Gt, ValueFactory::createFloat(50)));
+    parts.push_back(
+        cmp("symbol", Predicate::Op::Eq, ValueFactory::createString("XY")));
+    parts.push_back(
+        cmp("fee", Predicate::Op::Ge, ValueFactory::createFloat(-1)));
+    std::optional<Predicate> pred;
+    pred.emplace(And(std::move(parts)));
+    auto rs = st.select("trades", {"fee"}, pred);
+    assert(rs.hasValue() && rs.value().rowCount() == typedCount);
+    double engineSum = 0;
+    for (size_t r = 0; r < rs.value().rowCount(); ++r)
+      engineSum += rs.value().at(r, 0).asFloat();
+    assert(typedCount > 0 && feeSum == engineSum);
+
+    assert(trades.count(typed::isNull<kFee>()).value() == 1253);
+    assert(trades.count(typed::eq<kBuy>(true) ||
+                        typed::lt<kId>(int64_t{10}))
+               .value() == 2509);
+    assert(trades.count(typed::ge<kFee>(0.0)).value() == 5006 - 1253);
+
+    // Returning false stops a scan
+    size_t seen = 0;
+    assert(trades.scan([&](const Trades::Ref &) { return ++seen < 7; }).ok());
+    assert(seen == 7);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: constraints and deleted rows..." << std::endl;
+  {
+    ColumnarRelationalStorage st;
+    Trades trades = Trades::create(st, "trades").takeValue();
+    assert(trades.insert({trade(1), trade(2)}).ok());
+
+    // A duplicate key fails the whole batch, within it or against the table
+    Status dup = trades.insert({trade(3), trade(3)});
+    assert(dup.code() == StatusCode::FailedPrecondition);
+    assert(trades.insert({trade(4), trade(1)}).code() ==
+           StatusCode::FailedPrecondition);
+    assert(trades.count().value() == 2);
+
+    // Deletes through the RelationalStorage API hide rows from scans
+    std::optional<Predicate> one;
+    one.emplace(cmp("id", Predicate::Op::Eq, ValueFactory::createInteger(1)));
+    assert(st.deleteRows("trades", one).value() == 1);
+    auto left = trades.select().takeValue();
+    assert(left.size() == 1 && std::get<kId>(left[0]) == 2);
+    assert(trades.insert(trade(1)).ok());
+    assert(trades.count().value() == 2);
+
+    assert(st.dropTable("trades").ok());
+    assert(trades.count().status().code() == StatusCode::NotFound);
+    assert(trades.insert(trade(9)).code() == StatusCode::NotFound);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: KadeQL over typed tables..." << std::endl;
+  {
+    ColumnarRelationalStorage st;
+    Trades trades = Trades::create(st, "trades").takeValue();
+    for (int64_t i = 0; i < 100; ++i)
+      assert(trades.insert(trade(i)).ok());
+    kadeql::QueryExecutor exec(st);
+
+    // Rows written by KadeQL are read by typed scans, and the other way
+    run(exec, "UPDATE trades SET symbol = 'KQL', price = 99.5 "
+              "WHERE id = 50");
+    auto kql = trades.select(typed::eq<kSymbol>("KQL")).takeValue();
+    assert(kql.size() == 1);
+    assert(kql[0] == (Trades::Row{50, "KQL", 99.5, 0.5, true}));
+
+    auto rs = run(exec, "SELECT buy, fee, price, symbol, id FROM trades "
+                        "WHERE id < 8");
+    auto decoded = Trades::fromResultSet(rs).takeValue();
+    assert(decoded.size() == 8);
+    for (const auto &row : decoded)
+      assert(row == trade(std::get<kId>(row)));
+
+    auto partial = run(exec, "SELECT id, price FROM trades");
+    assert(Trades::fromResultSet(partial).status().code() ==
+           StatusCode::InvalidArgument);
+    auto renamed = run(exec, "SELECT id, price AS symbol, price, fee, buy "
+                             "FROM trades");
+    Status bad = Trades::fromResultSet(renamed).status();
+    assert(bad.code() == StatusCode::InvalidArgument);
+    assert(bad.message().find("'symbol'") != std::string::npos);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll typed table tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,347 @@
+#include "kadedb/change_feed.h"
+#include "kadedb/kadeql.h"
+#include "kadedb/predicate_builder.h"
+#include "kadedb/query_executor.h"
+#include "kadedb/storage.h"
+#include "kadedb/value.h"
+
+#include <cassert>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace kadedb;
+using namespace kadedb::kadeql;
+
+static TableSchema schema() {
+  Column email{"email", ColumnType::String, true, true, {}};
+  return TableSchema({Column{"id", ColumnType::Integer, false, false, {}},
+                      Column{"name", ColumnType::String, true, false, {}},
+                      Column{"n", ColumnType::Integer, true, false, {}}, email},
+                     std::string("id"));
+}
+
+static Row row(int64_t id, const std::string &name, int64_t n,
+               std::optional<std::string> email = std::nullopt) {
+  Row r(4);
+  r.set(0, ValueFactory::createInteger(id));
+  r.set(1, ValueFactory::createString(name));
+  r.set(2, ValueFactory::createInteger(n));
+  if (email)
+    r.set(3, ValueFactory::createString(*email));
+  return r;
+}
+
+struct Entry {
+  std::string name;
+  int64_t n;
+  std::string email; // "" for null
+};
+
+// id -> the row's other cells
+static std::map<int64_t, Entry> contents(RelationalStorage &rs,
+                                         const std::string &table) {
+  auto res = rs.select(table, {}, std::nullopt);
+  assert(res.hasValue());
+  std::map<int64_t, Entry> out;
+  const auto &set = res.value();
+  for (size_t r = 0; r < set.rowCount(); ++r) {
+    const Value *email = set.row(r).values()[3].get();
+    out[set.at(r, 0).asInt()] = {
+        set.at(r, 1).asString(), set.at(r, 2).asInt(),
+        email && email->type() == ValueType::String ? email->asString() : ""};
+  }
+  return out;
+}
+
+// Adds the proposed n to the stored one
+static Status addN(Row &current, const Row &proposed, const TableSchema &) {
+  current.set(2, ValueFactory::createInteger(current.at(2).asInt() +
+                                             proposed.at(2).asInt()));
+  return Status::OK();
+}
+
+static ResultSet run(QueryExecutor &exec, const std::string &q) {
+  auto stmt = parseQuery(q);
+  auto res = exec.execute(*stmt);
+  assert(res.hasValue());
+  return res.takeValue();
+}
+
+// Leaves every relational operation to `base`, so that upsertRows() runs
+// the RelationalStorage default
+class Forwarding final : public RelationalStorage {
+public:
+  explicit Forwarding(RelationalStorage &base) : base_(base) {}
+  Status createTable(const std::string &t, const TableSchema &s) override {
+    return base_.createTable(t, s);
+  }
+  Status insertRow(const std::string &t, const Row &r) override {
+    return base_.insertRow(t, r);
+  }
+  Result<ResultSet> select(const std::string &t,
+                           const std::vector<std::string> &c,
+                           const std::optional<Predicate> &w) override {
+    return base_.select(t, c, w);
+  }
+  std::vector<std::string> listTables() const override {
+    return base_.listTables();
+  }
+  Result<TableSchema> getTableSchema(const std::string &t) override {
+    return base_.getTableSchema(t);
+  }
+  Status dropTable(const std::string &t) override { return base_.dropTable(t); }
+  Result<size_t> deleteRows(const std::string &t,
+                            const std::optional<Predicate> &w) override {
+    return base_.deleteRows(t, w);
+  }
+  Result<size_t>
+  updateRows(const std::string &t,
+             const std::unordered_map<std::string, AssignmentValue> &a,
+             const std::optional<Predicate> &w) override {
+    return base_.updateRows(t, a, w);
+  }
+  Result<size_t> updateRowsWith(const std::string &t, const RowUpdater &u,
+                                const std::optional<Predicate> &w) override {
+    return base_.updateRowsWith(t, u, w);
+  }
+  Status updateRows(
+      const std::string &t,
+      const std::unordered_map<std::string, std::unique_ptr<Value>> &a,
+      const std::optional<Predicate> &w) override {
+    return base_.updateRows(t, a, w);
+  }
+  Status truncateTable(const std::string &t) override {
+    return base_.truncateTable(t);
+  }
+  Status createIndex(const std::string &t, const std::string &c,
+                     IndexType type) override {
+    return base_.createIndex(t, c, type);
+  }
+
+private:
+  RelationalStorage &base_;
+};
+
+int main() {
+  std::cout << "=== Upsert Tests ===" << std::endl;
+
+  std::cout << "Test 1: inserts, updates and no-op updates..." << std::endl;
+  {
+    InMemoryRelationalStorage rs;
+    assert(rs.createTable("t", schema()).ok());
+    assert(rs.insertRows("t", {row(1, "a", 1), row(2, "b", 2)}).ok());
+    std::vector<Row> rows;
+    rows.push_back(row(2, "b2", 20)); // update
+    rows.push_back(row(3, "c", 3));   // insert
+    rows.push_back(row(1, "a", 1));   // unchanged
+    rows.push_back(row(3, "c2", 30)); // updates the row inserted above
+    auto res = rs.upsertRows("t", rows);
+    assert(res.hasValue());
+    assert(res.value().inserted == 1 && res.value().updated == 1);
+    auto c = contents(rs, "t");
+    assert(c.size() == 3);
+    assert(c[1].name == "a" && c[2].name == "b2" && c[2].n == 20);
+    assert(c[3].name == "c2" && c[3].n == 30);
+
+    // A merge sees the version the batch wrote before it
+    res = rs.upsertRows("t", {row(1, "", 5), row(1, "", 6), row(4, "d", 7)},
+                        addN);
+    assert(res.value().inserted == 1 && res.value().updated == 1);
+    c = contents(rs, "t");
+    assert(c[1].n == 12 && c[1].name == "a" && c[4].n == 7);
+    assert(rs.upsertRows("t", {}).value().inserted == 0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: errors leave the table as it was..." << std::endl;
+  {
+    InMemoryRelationalStorage rs;
+    assert(rs.createTable("t", schema()).ok());
+    assert(rs.insertRows("t", {row(1, "a", 1, "x"), row(2, "b", 2, "y")})
+               .ok());
+    const auto before = contents(rs, "t");
+    auto unchanged = [&] {
+      auto now = contents(rs, "t");
+      assert(now.size() == before.size());
+      for (const auto &kv : before)
+        assert(now[kv.first].n == kv.second.n &&
+               now[kv.first].email == kv.second.email);
+    };
+
+    auto moveKey = [](Row &current, const Row &, const TableSchema &) {
+      current.set(0, ValueFactory::createInteger(99));
+      return Status::OK();
+    };
+    auto res = rs.upsertRows("t", {row(3, "c", 3), row(1, "", 0)}, moveKey);
+    assert(res.status().code() == StatusCode::InvalidArgument);
+    unchanged();
+
+    auto refuse = [](Row &, const Row &, const TableSchema &) {
+      return Status::FailedPrecondition("no");
+    };
+    res = rs.upsertRows("t", {row(3, "c", 3), row(2, "", 0)}, refuse);
+    assert(res.status().code() == StatusCode::FailedPrecondition);
+    unchanged();
+
+    Row nullKey = row(5, "e", 5);
+    nullKey.set(0, ValueFactory::createNull());
+    res = rs.upsertRows("t", {row(3, "c", 3), nullKey});
+    assert(res.status().code() == StatusCode::InvalidArgument);
+    unchanged();
+
+    // Unique conflicts with rows kept, inserted or updated
+    res = rs.upsertRows("t", {row(3, "c", 3, "x")});
+    assert(res.status().code() == StatusCode::FailedPrecondition);
+    res = rs.upsertRows("t", {row(2, "b", 2, "z"), row(3, "c", 3, "z")});
+    assert(res.status().code() == StatusCode::FailedPrecondition);
+    res = rs.upsertRows("t", {row(3, "c", 3), row(2, "b", 2, "x")});
+    assert(res.status().code() == StatusCode::FailedPrecondition);
+    unchanged();
+    // An update may take a value another row of the batch gives up
+    res = rs.upsertRows("t", {row(1, "a", 1, "w"), row(2, "b", 2, "x")});
+    assert(res.hasValue() && res.value().updated == 2);
+    auto c = contents(rs, "t");
+    assert(c[1].email == "w" && c[2].email == "x");
+
+    assert(rs.upsertRows("none", {row(1, "a", 1)}).status().code() ==
+           StatusCode::NotFound);
+    TableSchema nokey({Column{"id", ColumnType::Integer, true, false, {}}});
+    assert(rs.createTable("nokey", nokey).ok());
+    Row one(1);
+    one.set(0, ValueFactory::createInteger(1));
+    assert(rs.upsertRows("nokey", {one}).status().code() ==
+           StatusCode::InvalidArgument);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: change events and partitioned tables..." << std::endl;
+  {
+    InMemoryRelationalStorage rs;
+    rs.enableChangeCapture();
+    assert(rs.createTable("t", schema()).ok());
+    assert(rs.insertRow("t", row(1, "a", 1)).ok());
+    auto sub = rs.subscribeChanges("t");
+    assert(sub.hasValue());
+    assert(rs.upsertRows("t", {row(1, "a", 1), row(1, "a2", 1),
+                               row(2, "b", 2)})
+               .hasValue());
+    auto events = sub.value()->poll(16);
+    assert(events.hasValue() && events.value().size() == 2);
+    std::map<ChangeEvent::Kind, const ChangeEvent *> byKind;
+    for (const auto &e : events.value())
+      byKind[e->kind] = e.get();
+    assert(byKind.count(ChangeEvent::Kind::Update) &&
+           byKind.count(ChangeEvent::Kind::Insert));
+    const ChangeEvent *upd = byKind[ChangeEvent::Kind::Update];
+    assert(upd->before && upd->after);
+
+    TableSchema ps({Column{"id", ColumnType::Integer, false, false, {}},
+                    Column{"name", ColumnType::String, true, false, {}},
+                    Column{"n", ColumnType::Integer, true, false, {}},
+                    Column{"email", ColumnType::String, true, false, {}}},
+                   std::string("id"));
+    assert(rs.createPartitionedTable("p", ps, 4).ok());
+    std::vector<Row> rows;
+    for (int64_t id = 0; id < 40; ++id)
+      rows.push_back(row(id % 25, "p", 1));
+    auto res = rs.upsertRows("p", rows, addN);
+    // Rows merged into ones the batch inserted count as inserted
+    assert(res.value().inserted == 25 && res.value().updated == 0);
+    res = rs.upsertRows("p", rows, addN);
+    assert(res.value().inserted == 0 && res.value().updated == 25);
+    auto c = contents(rs, "p");
+    assert(c.size() == 25);
+    for (const auto &kv : c)
+      assert(kv.second.n == (kv.first < 15 ? 4 : 2));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: the default matches the in-memory upsert..."
+            << std::endl;
+  {
+    InMemoryRelationalStorage direct, base;
+    Forwarding fw(base);
+    assert(direct.createTable("t", schema()).ok());
+    assert(fw.createTable("t", schema()).ok());
+    std::mt19937_64 rng(3);
+    for (int round = 0; round < 60; ++round) {
+      std::vector<Row> rows;
+      const size_t n = rng() % 6;
+      for (size_t i = 0; i < n; ++i)
+        rows.push_back(row(static_cast<int64_t>(rng() % 12),
+                           std::string(1, static_cast<char>('a' + rng() % 3)),
+                           static_cast<int64_t>(rng() % 3)));
+      RelationalStorage::UpsertMerger merge;
+      if (rng() % 2)
+        merge = addN;
+      auto a = direct.upsertRows("t", rows, merge);
+      auto b = fw.upsertRows("t", rows, merge);
+      assert(a.hasValue() && b.hasValue());
+      assert(a.value().inserted == b.value().inserted &&
+             a.value().updated == b.value().updated);
+    }
+    auto a = contents(direct, "t"), b = contents(base, "t");
+    assert(a.size() == b.size());
+    for (const auto &kv : a)
+      assert(b[kv.first].name == kv.second.name &&
+             b[kv.first].n == kv.second.n);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 5: INSERT ... ON CONFLICT..." << std::endl;
+  {
+    InMemoryRelationalStorage rs;
+    assert(rs.createTable("t", schema()).ok());
+    QueryExecutor exec(rs);
+    run(exec, "INSERT INTO t VALUES (1, 'a', 1, 'a@'), (2, 'b', 2, 'b@')");
+
+    const std::string q =
+        "INSERT INTO t VALUES (1, 'x', 10, 'x@'), (3, 'c', 3, 'c@') "
+        "ON CONFLICT (id) DO UPDATE SET n = n + excluded.n, "
+        "name = excluded.name";
+    auto stmt = parseQuery(q);
+    assert(stmt->toString() == parseQuery(stmt->toString())->toString());
+    auto res = run(exec, q);
+    assert(res.at(0, 0).asInt() == 2 && res.at(0, 1).asInt() == 1 &&
+           res.at(0, 2).asInt() == 1);
+    auto c = contents(rs, "t");
+    assert(c[1].n == 11 && c[1].name == "x" && c[3].n == 3);
+
+    res = run(exec, "insert into t values (2, 'z', 0, 'z@'), "
+                    "(4, 'd', 4, 'd@') on conflict (id) do nothing");
+    assert(res.at(0, 1).asInt() == 1 && res.at(0, 2).asInt() == 0);
+    c = contents(rs, "t");
+    assert(c[2].name == "b" && c[4].name == "d");
+
+    // Assignments all read the stored row
+    run(exec, "INSERT INTO t VALUES (4, 'q', 0, 'q@') ON CONFLICT (id) "
+              "DO UPDATE SET n = n + 1, name = name");
+    assert(contents(rs, "t")[4].n == 5);
+
+    for (const char *bad :
+         {"INSERT INTO t VALUES (1, 'a', 1, 'a@') ON CONFLICT (n) "
+          "DO NOTHING",
+          "INSERT INTO t VALUES (1, 'a', 1, 'a@') ON CONFLICT (id) "
+          "DO UPDATE SET missing = 1"}) {
+      auto bs = parseQuery(bad);
+      assert(exec.execute(*bs).status().code() == StatusCode::InvalidArgument);
+    }
+    bool threw = false;
+    try {
+      parseQuery("INSERT INTO t (id) VALUES (1) ON CONFLICT (id) DO");
+    } catch (const ParseError &) {
+      threw = true;
+    }
+    assert(threw);
+    // Contextual words remain usable as names
+    assert(parseQuery("SELECT nothing FROM conflict"));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll upsert tests passed!" << std::endl;
+  return 0;
+}
@@ -2,6 +2,8 @@
 #include <cassert>
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace kadedb;
 
@@ -56,5 +58,63 @@ int main() {
   assert(c->type() == ValueType::Integer);
   assert(static_cast<IntegerValue &>(*c).asInt() == 10);
 
+  // Arena: values made in a scope sit side by side and outlive it, and may
+  // be freed on any thread
+  assert(!ValueArena::active());
+  std::vector<std::unique_ptr<Value>> kept;
+  {
+    ValueArena::Scope arena;
+    assert(ValueArena::active());
+    {
+      ValueArena::Scope inner;
+      kept.push_back(ValueFactory::createInteger(1));
+    }
+    assert(ValueArena::active());
+    kept.push_back(ValueFactory::createString(std::string(100, 's')));
+    for (int i = 0; i < 10000; ++i) {
+      auto tmp = ValueFactory::createFloat(i);
+      if (i % 1000 == 0)
+        kept.push_back(std::move(tmp));
+    }
+    auto a = reinterpret_cast<uintptr_t>(kept[0].get());
+    auto b = reinterpret_cast<uintptr_t>(kept[1].get());
+    assert(b > a && b - a <= 64);
+  }
+  assert(!ValueArena::active());
+  assert(kept[0]->asInt() == 1 && kept[1]->asString().size() == 100);
+  assert(kept.back()->asFloat() == 9000.0);
+  std::thread([&kept] { kept.clear(); }).join();
+
+  // Values made and freed on different threads, with threads coming and
+  // going (remote frees and hand-over of the slab pools)
+  for (int round = 0; round < 4; ++round) {
+    std::vector<std::unique_ptr<Value>> made;
+    std::thread([&made] {
+      for (int i = 0; i < 5000; ++i)
+        made.push_back(i % 2 ? ValueFactory::createInteger(i)
+                             : ValueFactory::createString(std::to_string(i)));
+    }).join();
+    std::thread([&made] {
+      for (size_t i = 0; i < made.size(); i += 2)
+        made[i].reset();
+    }).join();
+    for (size_t i = 1; i < made.size(); i += 2)
+      assert(made[i]->asInt() == static_cast<int64_t>(i));
+  }
+
+#if defined(KADEDB_MEM_DEBUG) || defined(KADEDB_ENABLE_SMALL_OBJECT_POOL)
+  // Counters see every type, on every thread
+  const size_t ints = memdebug::allocCountInteger();
+  const size_t strings = memdebug::allocCountString();
+  std::thread([] {
+    auto a = ValueFactory::createInteger(1);
+    auto b = ValueFactory::createString("x");
+    auto f = ValueFactory::createFloat(1.0);
+  }).join();
+  assert(memdebug::allocCountInteger() == ints + 1);
+  assert(memdebug::allocCountString() == strings + 1);
+  assert(memdebug::allocCountFloat() == memdebug::freeCountFloat() + 1);
+#endif
+
   return 0;
 }
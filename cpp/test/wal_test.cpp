@@ -0,0 +1,466 @@
+#include "kadedb/graph/storage.h"
+#include "kadedb/logged_storage.h"
+#include "kadedb/storage.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/value.h"
+#include "kadedb/wal.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace kadedb;
+
+static std::string logPath(const char *name) {
+  auto p = std::filesystem::temp_directory_path() /
+           ("kadedb_wal_test_" + std::string(name) + ".log");
+  std::filesystem::remove(p);
+  return p.string();
+}
+
+static std::unique_ptr<WriteAheadLog> openLog(const std::string &path,
+                                              WalOptions options = {}) {
+  auto res = WriteAheadLog::open(path, options);
+  assert(res.hasValue());
+  return res.takeValue();
+}
+
+static Predicate cmp(const std::string &column, Predicate::Op op,
+                     std::unique_ptr<Value> rhs) {
+  Predicate p;
+  p.column = column;
+  p.op = op;
+  p.rhs = std::move(rhs);
+  return p;
+}
+
+static std::optional<Predicate> where(Predicate p) {
+  std::optional<Predicate> w;
+  w.emplace(std::move(p));
+  return w;
+}
+
+static Row patientRow(int64_t id, const std::string &ward, int64_t age) {
+  Row r(3);
+  r.set(0, ValueFactory::createInteger(id));
+  r.set(1, ValueFactory::createString(ward));
+  r.set(2, ValueFactory::createInteger(age));
+  return r;
+}
+
+static TimeSeriesSchema vitalsSchema() {
+  TimeSeriesSchema schema("ts", TimeGranularity::Seconds);
+  schema.addTagColumn(Column{"bed", ColumnType::String, true, false, {}});
+  schema.addValueColumn(Column{"hr", ColumnType::Float, true, false, {}});
+  RetentionPolicy retention;
+  retention.maxRows = 500;
+  schema.setRetentionPolicy(retention);
+  return schema;
+}
+
+struct Storages {
+  InMemoryRelationalStorage rel;
+  InMemoryDocumentStorage doc;
+  InMemoryTimeSeriesStorage ts;
+  InMemoryGraphStorage graph;
+
+  WalTargets targets() { return {&rel, &doc, &ts, &graph}; }
+};
+
+static std::string rowsOf(const ResultSet &rs) {
+  std::string out;
+  for (const auto &row : rs) {
+    out += "\n ";
+    for (const auto &v : row.values())
+      out += " " + (v ? v->toString() : "null");
+  }
+  return out;
+}
+
+// Every engine's observable state, for comparing a replay with the
+// storages that wrote the log
+static std::string dump(Storages &s) {
+  const std::vector<std::string> all;
+  std::string out;
+  auto tables = s.rel.listTables();
+  std::sort(tables.begin(), tables.end());
+  for (const auto &t : tables)
+    out += t + rowsOf(s.rel.select(t, all, std::nullopt).value()) + "\n";
+  auto collections = s.doc.listCollections();
+  std::sort(collections.begin(), collections.end());
+  for (const auto &c : collections) {
+    auto docs = s.doc.query(c, all, std::nullopt).takeValue();
+    std::vector<std::string> lines;
+    for (const auto &kv : docs) {
+      std::vector<std::string> fields;
+      for (const auto &f : kv.second)
+        fields.push_back(f.first + "=" +
+                         (f.second ? f.second->toString() : "<none>"));
+      std::sort(fields.begin(), fields.end());
+      std::string line = kv.first;
+      for (const auto &f : fields)
+        line += " " + f;
+      lines.push_back(line);
+    }
+    std::sort(lines.begin(), lines.end());
+    out += c + "\n";
+    for (const auto &l : lines)
+      out += "  " + l + "\n";
+  }
+  auto series = s.ts.listSeries();
+  std::sort(series.begin(), series.end());
+  for (const auto &name : series) {
+    auto rs = s.ts.rangeQuery(name, all, INT64_MIN, INT64_MAX,
+                                std::nullopt);
+    out += name + rowsOf(rs.value()) + "\n";
+  }
+  auto graphs = s.graph.listGraphs();
+  std::sort(graphs.begin(), graphs.end());
+  for (const auto &g : graphs) {
+    out += g + "\n";
+    for (NodeId id = 0; id < 100; ++id) {
+      auto n = s.graph.getNode(g, id);
+      if (!n.hasValue())
+        continue;
+      std::vector<std::string> labels(n.value().labels.begin(),
+                                      n.value().labels.end());
+      std::sort(labels.begin(), labels.end());
+      out += "  node " + std::to_string(id);
+      for (const auto &l : labels)
+        out += " :" + l;
+      auto name = n.value().properties.find("name");
+      if (name != n.value().properties.end())
+        out += " " + name->second->toString();
+      auto outs = s.graph.neighborsOut(g, id).takeValue();
+      std::sort(outs.begin(), outs.end());
+      for (NodeId to : outs)
+        out += " ->" + std::to_string(to);
+      out += "\n";
+    }
+    for (EdgeId id = 0; id < 100; ++id) {
+      auto e = s.graph.getEdge(g, id);
+      if (e.hasValue())
+        out += "  edge " + std::to_string(id) + " " + e.value().type + "\n";
+    }
+  }
+  return out;
+}
+
+// Mutations of every kind through the Logged* wrappers
+static void writeWorkload(Storages &s, WriteAheadLog &wal) {
+  LoggedRelationalStorage rel(s.rel, wal);
+  LoggedDocumentStorage doc(s.doc, wal);
+  LoggedTimeSeriesStorage ts(s.ts, wal);
+  LoggedGraphStorage graph(s.graph, wal);
+
+  TableSchema patients({Column{"id", ColumnType::Integer, false, true, {}},
+                        Column{"ward", ColumnType::String, false, false, {}},
+                        Column{"age", ColumnType::Integer, true, false, {}}},
+                       "id");
+  assert(rel.createTable("patients", patients).ok());
+  assert(rel.createIndex("patients", "ward", IndexType::Hash).ok());
+  for (int64_t i = 0; i < 60; ++i)
+    assert(rel.insertRow("patients",
+                         patientRow(i, "w" + std::to_string(i % 4), 20 + i))
+               .ok());
+  // Failures are not logged
+  const uint64_t before = wal.lastLsn();
+  assert(rel.insertRow("patients", patientRow(3, "w0", 1)).code() ==
+         StatusCode::FailedPrecondition);
+  assert(rel.insertRow("nope", patientRow(3, "w0", 1)).code() ==
+         StatusCode::NotFound);
+  assert(wal.lastLsn() == before);
+
+  assert(rel.deleteRows("patients", where(cmp("age", Predicate::Op::Gt,
+                                              ValueFactory::createInteger(70))))
+             .value() == 9);
+  std::unordered_map<std::string, AssignmentValue> assignments;
+  assignments["ward"].constant = ValueFactory::createString("icu");
+  assert(rel.updateRows("patients", assignments,
+                        where(cmp("id", Predicate::Op::Lt,
+                                  ValueFactory::createInteger(5))))
+             .value() == 5);
+  std::unordered_map<std::string, std::unique_ptr<Value>> legacy;
+  legacy["age"] = nullptr;
+  assert(rel.updateRows("patients", legacy,
+                        where(cmp("ward", Predicate::Op::Eq,
+                                  ValueFactory::createString("w3"))))
+             .ok());
+  auto older = [](Row &row, const TableSchema &) {
+    if (row.values()[2])
+      row.set(2, ValueFactory::createInteger(row.at(2).asInt() * 2));
+    return Status::OK();
+  };
+  assert(rel.updateRowsWith("patients", older,
+                            where(cmp("ward", Predicate::Op::Ne,
+                                      ValueFactory::createString("w1"))))
+             .hasValue());
+  assert(rel.createTable("scratch", patients).ok());
+  assert(rel.insertRow("scratch", patientRow(1, "w0", 1)).ok());
+  assert(rel.truncateTable("scratch").ok());
+  assert(rel.createTable("gone", patients).ok());
+  assert(rel.dropTable("gone").ok());
+
+  DocumentSchema notes;
+  notes.addField(Column{"text", ColumnType::String, false, false, {}});
+  assert(doc.createCollection("notes", notes).ok());
+  assert(doc.createCollection("free").ok());
+  assert(doc.createIndex("notes", "text", IndexType::Ordered).ok());
+  for (int i = 0; i < 40; ++i) {
+    Document d;
+    d["text"] = ValueFactory::createString("note " + std::to_string(i));
+    d["n"] = ValueFactory::createInteger(i);
+    d["void"] = nullptr;
+    if (i % 2)
+      assert(doc.put("notes", "k" + std::to_string(i), d).ok());
+    else
+      assert(doc.put("notes", "k" + std::to_string(i), std::move(d)).ok());
+  }
+  for (int i = 0; i < 40; i += 3)
+    assert(doc.erase("notes", "k" + std::to_string(i)).ok());
+  Document bad;
+  bad["text"] = ValueFactory::createInteger(1);
+  assert(!doc.put("notes", "bad", bad).ok());
+  Document f;
+  f["any"] = ValueFactory::createBoolean(true);
+  assert(doc.put("free", "x", f).ok());
+  assert(doc.createCollection("tmp").ok());
+  assert(doc.dropCollection("tmp").ok());
+
+  assert(ts.createSeries("vitals", vitalsSchema(), TimePartition::Daily).ok());
+  assert(ts.createContinuousAggregate("vitals", "hr", 60,
+                                      TimeGranularity::Seconds)
+             .ok());
+  assert(ts.createContinuousAggregate("vitals", "hr", 600,
+                                      TimeGranularity::Seconds)
+             .ok());
+  assert(ts.dropContinuousAggregate("vitals", "hr", 600,
+                                    TimeGranularity::Seconds)
+             .ok());
+  for (int64_t i = 0; i < 100; ++i) {
+    Row r(3);
+    r.set(0, ValueFactory::createInteger(1000 + i * 7));
+    r.set(1, ValueFactory::createString("bed-" + std::to_string(i % 3)));
+    r.set(2, ValueFactory::createFloat(60.0 + static_cast<double>(i % 30)));
+    assert(ts.append("vitals", r).ok());
+  }
+  std::vector<Row> batch;
+  for (int64_t i = 0; i < 50; ++i) {
+    Row r(3);
+    r.set(0, ValueFactory::createInteger(2000 + i));
+    r.set(2, ValueFactory::createFloat(static_cast<double>(i)));
+    batch.push_back(std::move(r));
+  }
+  assert(ts.appendBatch("vitals", batch).ok());
+  std::vector<int64_t> stamps;
+  std::vector<double> hr;
+  for (int64_t i = 0; i < 400; ++i) {
+    stamps.push_back(3000 + i);
+    hr.push_back(80.0 + static_cast<double>(i % 9) / 4.0);
+  }
+  const double *cols[] = {hr.data()};
+  assert(ts.appendColumns("vitals", stamps.data(), cols, stamps.size()).ok());
+  assert(ts.createSeries("old", vitalsSchema()).ok());
+  assert(ts.dropSeries("old").ok());
+
+  assert(graph.createGraph("care").ok());
+  assert(graph.createNodeIndex("care", "name", IndexType::Hash).ok());
+  assert(graph.createEdgeIndex("care", "since", IndexType::Ordered).ok());
+  for (NodeId id = 0; id < 30; ++id) {
+    Node n;
+    n.id = id;
+    n.labels = {id % 2 ? "Patient" : "Doctor"};
+    n.properties["name"] = ValueFactory::createString("n" + std::to_string(id));
+    assert(graph.putNode("care", n).ok());
+  }
+  for (EdgeId id = 0; id < 40; ++id) {
+    Edge e;
+    e.id = id;
+    e.from = id % 30;
+    e.to = (id * 7 + 1) % 30;
+    e.type = id % 3 ? "TREATS" : "REFERS";
+    e.labels = {"care"};
+    e.properties["since"] = ValueFactory::createInteger(id);
+    assert(graph.putEdge("care", e).ok());
+  }
+  assert(graph.eraseEdge("care", 5).ok());
+  assert(graph.eraseNode("care", 29).ok());
+  assert(graph.dropEdgeIndex("care", "since").ok());
+  assert(graph.dropNodeIndex("care", "name").ok());
+  assert(graph.createGraph("tmp").ok());
+  assert(graph.dropGraph("tmp").ok());
+}
+
+int main() {
+  std::cout << "Running write-ahead log tests..." << std::endl;
+
+  std::cout << "Test 1: every engine replays to the logged state"
+            << std::endl;
+  {
+    const std::string path = logPath("replay");
+    Storages live;
+    {
+      auto wal = openLog(path);
+      writeWorkload(live, *wal);
+      assert(wal->durableLsn() == wal->lastLsn() && wal->lastLsn() == 318);
+    }
+    const std::string expected = dump(live);
+    for (size_t threads : {1, 4}) {
+      Storages replayed;
+      auto applied = replayWal(path, replayed.targets(), threads);
+      assert(applied.hasValue());
+      auto reopened = openLog(path);
+      assert(applied.value() == reopened->lastLsn());
+      assert(dump(replayed) == expected);
+    }
+    // Replay needs a storage for each engine in the log
+    InMemoryRelationalStorage relOnly;
+    WalTargets partial;
+    partial.relational = &relOnly;
+    assert(replayWal(path, partial).status().code() ==
+           StatusCode::FailedPrecondition);
+    std::filesystem::remove(path);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 2: torn tails are dropped" << std::endl;
+  {
+    const std::string path = logPath("torn");
+    {
+      auto wal = openLog(path);
+      for (int i = 0; i < 10; ++i)
+        assert(wal->commit(walRecord::createGraph("g" + std::to_string(i)))
+                   .ok());
+    }
+    const auto full = std::filesystem::file_size(path);
+    // Cut the last frame short, then append garbage after it
+    std::filesystem::resize_file(path, full - 3);
+    {
+      std::ofstream os(path, std::ios::binary | std::ios::app);
+      os << "garbage";
+    }
+    InMemoryGraphStorage g;
+    WalTargets targets;
+    targets.graph = &g;
+    assert(replayWal(path, targets).value() == 9);
+    {
+      auto wal = openLog(path);
+      assert(wal->lastLsn() == 9);
+      assert(wal->commit(walRecord::createGraph("g9")).ok());
+      assert(wal->lastLsn() == 10);
+    }
+    InMemoryGraphStorage again;
+    targets.graph = &again;
+    assert(replayWal(path, targets).value() == 10);
+    assert(again.listGraphs().size() == 10);
+
+    // A flipped byte ends the log at the damaged frame
+    {
+      std::fstream io(path, std::ios::binary | std::ios::in | std::ios::out);
+      io.seekp(static_cast<std::streamoff>(full / 2));
+      io.put('\x7f');
+    }
+    InMemoryGraphStorage damaged;
+    targets.graph = &damaged;
+    const uint64_t kept = replayWal(path, targets).value();
+    assert(kept > 0 && kept < 10);
+
+    // Not a log; a missing log is empty
+    {
+      std::ofstream os(path, std::ios::binary | std::ios::trunc);
+      os << "not a write-ahead log";
+    }
+    assert(WriteAheadLog::open(path).status().code() ==
+           StatusCode::InvalidArgument);
+    assert(replayWal(path, targets).status().code() ==
+           StatusCode::InvalidArgument);
+    std::filesystem::remove(path);
+    assert(replayWal(path, targets).value() == 0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: concurrent writers share syncs" << std::endl;
+  {
+    const std::string path = logPath("group");
+    WalOptions options;
+    options.commitDelay = std::chrono::milliseconds(2);
+    constexpr int kThreads = 8;
+    constexpr int kPerThread = 100;
+    InMemoryDocumentStorage docs;
+    {
+      auto wal = openLog(path, options);
+      LoggedDocumentStorage logged(docs, *wal);
+      for (int t = 0; t < kThreads; ++t)
+        assert(logged.createCollection("c" + std::to_string(t)).ok());
+      std::vector<std::thread> writers;
+      for (int t = 0; t < kThreads; ++t)
+        writers.emplace_back([&, t] {
+          for (int i = 0; i < kPerThread; ++i) {
+            Document d;
+            d["i"] = ValueFactory::createInteger(i);
+            assert(logged.put("c" + std::to_string(t), "k" + std::to_string(i),
+                              d)
+                       .ok());
+          }
+        });
+      for (auto &w : writers)
+        w.join();
+      const uint64_t records = kThreads * (kPerThread + 1);
+      assert(wal->lastLsn() == records && wal->durableLsn() == records);
+      // One sync per record would be `records` batches
+      assert(wal->batches() * 4 < records);
+    }
+    InMemoryDocumentStorage replayed;
+    WalTargets targets;
+    targets.document = &replayed;
+    assert(replayWal(path, targets, 3).value() ==
+           kThreads * (kPerThread + 1));
+    for (int t = 0; t < kThreads; ++t)
+      assert(replayed.count("c" + std::to_string(t)).value() == kPerThread);
+    std::filesystem::remove(path);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: batch inserts are all or nothing" << std::endl;
+  {
+    const std::string path = logPath("batch");
+    TableSchema schema({Column{"id", ColumnType::Integer, false, true, {}},
+                        Column{"ward", ColumnType::String, false, false, {}},
+                        Column{"age", ColumnType::Integer, true, false, {}}},
+                       "id");
+    {
+      InMemoryRelationalStorage rel;
+      auto wal = openLog(path);
+      LoggedRelationalStorage logged(rel, *wal);
+      assert(logged.createTable("t", schema).ok());
+      assert(logged.insertRow("t", patientRow(1, "a", 30)).ok());
+      // A duplicate key fails the batch; neither row is applied or logged
+      assert(!logged.insertRows("t", {patientRow(2, "a", 31),
+                                      patientRow(1, "b", 32)})
+                  .ok());
+      assert(rel.estimateRowCount("t").value() == 1);
+      assert(wal->lastLsn() == 2);
+      assert(logged.insertRows("t", {patientRow(2, "a", 31),
+                                     patientRow(3, "b", 32)})
+                 .ok());
+      assert(wal->lastLsn() == 3);
+    }
+    InMemoryRelationalStorage replayed;
+    WalTargets targets;
+    targets.relational = &replayed;
+    assert(replayWal(path, targets).value() == 3);
+    auto rs = replayed.select("t", {"id"}, std::nullopt);
+    assert(rs.hasValue() && rs.value().rowCount() == 3);
+    std::filesystem::remove(path);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "\nAll write-ahead log tests passed!" << std::endl;
+  return 0;
+}
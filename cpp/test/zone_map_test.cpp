@@ -0,0 +1,342 @@
+#include "kadedb/cancellation.h"
+#include "kadedb/columnar_storage.h"
+#include "kadedb/predicate_builder.h"
+#include "kadedb/storage.h"
+#include "kadedb/timeseries/storage.h"
+#include "kadedb/value.h"
+#include "kadedb/zone_map.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace kadedb;
+
+using Op = Predicate::Op;
+
+static std::optional<Predicate> where(Predicate p) {
+  std::optional<Predicate> w;
+  w.emplace(std::move(p));
+  return w;
+}
+
+// One line per row, cells separated by '|'
+static std::string flatten(const ResultSet &rs) {
+  std::string out;
+  for (const auto &row : rs) {
+    for (const auto &cell : row.values())
+      out += (cell ? cell->toString() : "null") + "|";
+    out += "\n";
+  }
+  return out;
+}
+
+// The rows of `all` matching `pred`, in order
+static std::string filtered(const ResultSet &all, const TableSchema &schema,
+                            const Predicate &pred) {
+  const BoundPredicate bound = BoundPredicate::bind(pred, schema);
+  std::string out;
+  for (const auto &row : all) {
+    if (!bound.matches(row.values()))
+      continue;
+    for (const auto &cell : row.values())
+      out += (cell ? cell->toString() : "null") + "|";
+    out += "\n";
+  }
+  return out;
+}
+
+static Predicate both(Predicate a, Predicate b) {
+  std::vector<Predicate> cs;
+  cs.push_back(std::move(a));
+  cs.push_back(std::move(b));
+  return And(std::move(cs));
+}
+
+static Predicate either(Predicate a, Predicate b) {
+  std::vector<Predicate> cs;
+  cs.push_back(std::move(a));
+  cs.push_back(std::move(b));
+  return Or(std::move(cs));
+}
+
+static TableSchema vitalsSchema() {
+  return TableSchema({Column{"id", ColumnType::Integer, false, false, {}},
+                      Column{"value", ColumnType::Float, true, false, {}},
+                      Column{"ward", ColumnType::String, true, false, {}}});
+}
+
+// Readings rising from 60 to 185 over n rows, every 7th one missing
+static Row reading(int64_t i, int64_t n) {
+  Row r(3);
+  r.set(0, ValueFactory::createInteger(i));
+  if (i % 7 != 3)
+    r.set(1, ValueFactory::createFloat(60.0 + 125.0 * i / n));
+  r.set(2, ValueFactory::createString("ward-" + std::to_string(i % 5)));
+  return r;
+}
+
+static std::vector<Predicate> predicates() {
+  std::vector<Predicate> out;
+  out.push_back(cmp("value", Op::Gt, ValueFactory::createFloat(180)));
+  out.push_back(cmp("value", Op::Le, ValueFactory::createInteger(61)));
+  out.push_back(cmp("value", Op::Eq, ValueFactory::createFloat(500)));
+  out.push_back(cmp("value", Op::Ne, ValueFactory::createFloat(100)));
+  out.push_back(cmp("id", Op::Ge, ValueFactory::createInteger(99990)));
+  out.push_back(both(cmp("value", Op::Gt, ValueFactory::createFloat(120)),
+                     cmp("id", Op::Lt, ValueFactory::createInteger(50000))));
+  out.push_back(either(cmp("id", Op::Lt, ValueFactory::createInteger(5)),
+                       cmp("value", Op::Ge, ValueFactory::createFloat(184.9))));
+  out.push_back(Not(cmp("value", Op::Le, ValueFactory::createFloat(180))));
+  out.push_back(cmp("ward", Op::Eq, ValueFactory::createString("ward-9")));
+  out.push_back(cmp("ward", Op::Lt, ValueFactory::createString("ward-1")));
+  // Cross-type: every present cell is below any string
+  out.push_back(cmp("value", Op::Lt, ValueFactory::createString("x")));
+  out.push_back(cmp("missing", Op::Eq, ValueFactory::createInteger(1)));
+  return out;
+}
+
+static void checkAll(RelationalStorage &st, const std::string &table) {
+  const TableSchema schema = st.getTableSchema(table).value();
+  auto all = st.select(table, {}, std::nullopt);
+  assert(all.hasValue());
+  for (auto &p : predicates()) {
+    const std::string expected = filtered(all.value(), schema, p);
+    auto got = st.select(table, {}, where(std::move(p)));
+    assert(got.hasValue());
+    assert(flatten(got.value()) == expected);
+  }
+}
+
+int main() {
+  std::cout << "=== Zone Map Tests ===" << std::endl;
+
+  std::cout << "Test 1: column zones..." << std::endl;
+  {
+    ColumnZone z;
+    int lo = 0, hi = 0;
+    assert(!z.compareRange(InlineValue::integer(1), lo, hi));
+    z.add(InlineValue());
+    for (int64_t v : {5, -3, 12})
+      z.add(InlineValue::integer(v));
+    assert(z.present == 3 && z.absent == 1 && z.ordered);
+    assert(z.min.asInt() == -3 && z.max.asInt() == 12);
+    assert(z.compareRange(InlineValue::integer(20), lo, hi) && lo == -1 &&
+           hi == -1);
+    assert(z.compareRange(InlineValue::floating(-3.0), lo, hi) && lo == 0 &&
+           hi == 1);
+    // Integers and floats mix while every integer is exact as a double
+    z.add(InlineValue::floating(0.5));
+    assert(z.ordered);
+    z.add(InlineValue::integer(int64_t{1} << 60));
+    assert(!z.ordered);
+
+    ColumnZone wide;
+    wide.add(InlineValue::integer(int64_t{1} << 60));
+    wide.add(InlineValue::integer(std::numeric_limits<int64_t>::min()));
+    assert(wide.ordered);
+    assert(wide.compareRange(InlineValue::integer(0), lo, hi) && lo == -1 &&
+           hi == 1);
+
+    ColumnZone nan;
+    nan.add(InlineValue::floating(1.0));
+    nan.add(InlineValue::floating(std::nan("")));
+    assert(!nan.ordered && !nan.compareRange(InlineValue::floating(0), lo, hi));
+
+    ColumnZone mixed;
+    mixed.add(InlineValue::string("a"));
+    mixed.add(InlineValue::integer(1));
+    assert(!mixed.ordered);
+
+    ZoneMap map;
+    Row r(2);
+    r.set(0, ValueFactory::createInteger(4));
+    map.add(InlineRow::fromRow(r));
+    assert(map.columns.size() == 2 && map.columns[1].absent == 1);
+    const TableSchema schema(
+        {Column{"a", ColumnType::Integer, true, false, {}},
+         Column{"b", ColumnType::Integer, true, false, {}}});
+    auto mayMatch = [&](Predicate p) {
+      return BoundPredicate::bind(p, schema).mayMatch(map);
+    };
+    assert(mayMatch(cmp("a", Op::Eq, ValueFactory::createInteger(4))));
+    assert(!mayMatch(cmp("a", Op::Gt, ValueFactory::createInteger(4))));
+    // Absent cells never match
+    assert(!mayMatch(cmp("b", Op::Ne, ValueFactory::createInteger(4))));
+    assert(mayMatch(Not(cmp("a", Op::Eq, ValueFactory::createInteger(4)))));
+    assert(!mayMatch(both(cmp("a", Op::Eq, ValueFactory::createInteger(4)),
+                          cmp("a", Op::Lt, ValueFactory::createInteger(0)))));
+    assert(mayMatch(either(cmp("a", Op::Lt, ValueFactory::createInteger(0)),
+                           cmp("a", Op::Ge, ValueFactory::createInteger(4)))));
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  const int64_t n = 100000;
+
+  std::cout << "Test 2: row store scans skip chunks..." << std::endl;
+  {
+    InMemoryRelationalStorage st;
+    assert(st.createTable("vitals", vitalsSchema()).ok());
+    std::vector<Row> rows;
+    for (int64_t i = 0; i < n; ++i)
+      rows.push_back(reading(i, n));
+    assert(st.insertRows("vitals", rows).ok());
+    checkAll(st, "vitals");
+    st.setScanThreads(4);
+    checkAll(st, "vitals");
+    st.setScanThreads(1);
+
+    // Interrupt checks come every 4096 positions visited: far fewer once
+    // the chunks holding no reading above 180 are skipped
+    auto checksFor = [&](std::optional<Predicate> w) {
+      size_t checks = 0, matched = 0;
+      InterruptScope counting([&] {
+        ++checks;
+        return Status::OK();
+      });
+      Status s = st.scan(
+          "vitals", {"id"}, w,
+          [&](RowBatch &batch) {
+            matched += batch.rows.size();
+            return true;
+          },
+          RelationalStorage::kDefaultBatchRows);
+      assert(s.ok());
+      return std::make_pair(checks, matched);
+    };
+    const auto full = checksFor(std::nullopt);
+    const auto high =
+        checksFor(where(cmp("value", Op::Gt, ValueFactory::createFloat(180))));
+    assert(full.first >= 20 && full.second == static_cast<size_t>(n));
+    assert(high.first <= 1 && high.second > 0);
+
+    // Writes land in new versions, which the zones cover
+    assert(st.updateRowsWith("vitals",
+                             [](Row &row, const TableSchema &) {
+                               row.set(1, ValueFactory::createFloat(500));
+                               return Status::OK();
+                             },
+                             where(cmp("id", Op::Eq,
+                                       ValueFactory::createInteger(10))))
+               .hasValue());
+    assert(st.deleteRows("vitals", where(cmp("id", Op::Lt,
+                                              ValueFactory::createInteger(
+                                                  60000))))
+               .hasValue());
+    checkAll(st, "vitals");
+    auto hot = st.select("vitals", {"id"},
+                         where(cmp("value", Op::Eq,
+                                   ValueFactory::createFloat(500))));
+    assert(hot.hasValue() && hot.value().rowCount() == 0);
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 3: columnar scans skip zones..." << std::endl;
+  {
+    ColumnarRelationalStorage st;
+    assert(st.createTable("vitals", vitalsSchema()).ok());
+    for (int64_t i = 0; i < n; ++i)
+      assert(st.insertRow("vitals", reading(i, n)).ok());
+    checkAll(st, "vitals");
+
+    // An overwrite widens its zone
+    assert(st.updateRowsWith("vitals",
+                             [](Row &row, const TableSchema &) {
+                               row.set(1, ValueFactory::createFloat(500));
+                               return Status::OK();
+                             },
+                             where(cmp("id", Op::Eq,
+                                       ValueFactory::createInteger(10))))
+               .hasValue());
+    auto hot = st.select("vitals", {"id"},
+                         where(cmp("value", Op::Gt,
+                                   ValueFactory::createFloat(400))));
+    assert(hot.hasValue() && hot.value().rowCount() == 1);
+    checkAll(st, "vitals");
+
+    // Compaction rebuilds the zones of the rows kept
+    assert(st.deleteRows("vitals", where(cmp("id", Op::Lt,
+                                              ValueFactory::createInteger(
+                                                  70000))))
+               .hasValue());
+    checkAll(st, "vitals");
+    for (int64_t i = n; i < n + 5000; ++i)
+      assert(st.insertRow("vitals", reading(i - n, n)).ok());
+    checkAll(st, "vitals");
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "Test 4: time series partitions..." << std::endl;
+  {
+    TimeSeriesSchema schema("ts", TimeGranularity::Seconds);
+    schema.addValueColumn(Column{"value", ColumnType::Float, true, false, {}});
+    InMemoryTimeSeriesStorage ts;
+    assert(ts.createSeries("vitals", schema, TimePartition::Hourly).ok());
+    // 48 hourly partitions; the last two hold readings above 180
+    for (int64_t t = 0; t < 48 * 3600; t += 60) {
+      Row r(2);
+      r.set(0, ValueFactory::createInteger(t));
+      r.set(1, ValueFactory::createFloat(60.0 + 2.6 * (t / 3600) +
+                                         (t % 3600) / 3600.0));
+      assert(ts.append("vitals", r).ok());
+    }
+    const int64_t end = 48 * 3600;
+    const TableSchema tableSchema(
+        {Column{"ts", ColumnType::Integer, false, false, {}},
+         Column{"value", ColumnType::Float, true, false, {}}});
+    auto all = ts.rangeQuery("vitals", {}, 0, end, std::nullopt);
+    assert(all.hasValue());
+
+    auto checks = [&](std::optional<Predicate> w, std::string &rows) {
+      size_t n = 0;
+      InterruptScope counting([&] {
+        ++n;
+        return Status::OK();
+      });
+      auto res = ts.rangeQuery("vitals", {}, 0, end, w);
+      assert(res.hasValue());
+      rows = flatten(res.value());
+      return n;
+    };
+    std::string rows;
+    assert(checks(std::nullopt, rows) == 48);
+    auto high = cmp("value", Op::Gt, ValueFactory::createFloat(180));
+    assert(checks(where(cmp("value", Op::Gt, ValueFactory::createFloat(180))),
+                  rows) == 2);
+    assert(!rows.empty() && rows == filtered(all.value(), tableSchema, high));
+    for (auto &p : predicates()) {
+      const std::string expected = filtered(all.value(), tableSchema, p);
+      checks(where(std::move(p)), rows);
+      assert(rows == expected);
+    }
+
+    // Aggregates with a predicate skip the same partitions
+    auto agg = ts.aggregate("vitals", "value", TimeAggregation::Count, 0, end,
+                            1, TimeGranularity::Hours,
+                            where(cmp("value", Op::Gt,
+                                      ValueFactory::createFloat(180))));
+    assert(agg.hasValue() && agg.value().rowCount() == 2);
+
+    // A late row widens an old partition's zone
+    Row late(2);
+    late.set(0, ValueFactory::createInteger(30));
+    late.set(1, ValueFactory::createFloat(300));
+    assert(ts.append("vitals", late).ok());
+    assert(checks(where(cmp("value", Op::Gt, ValueFactory::createFloat(180))),
+                  rows) == 3);
+    auto hot = ts.rangeQuery("vitals", {"ts"}, 0, end,
+                             where(cmp("value", Op::Gt,
+                                       ValueFactory::createFloat(200))));
+    assert(hot.hasValue() && flatten(hot.value()) == "30|\n");
+  }
+  std::cout << "  PASSED" << std::endl;
+
+  std::cout << "All zone map tests passed." << std::endl;
+  return 0;
+}
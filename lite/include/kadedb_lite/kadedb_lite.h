@@ -21,6 +21,25 @@ typedef enum kadedb_lite_compression_t {
   KADEDB_LITE_COMPRESSION_ZSTD = 6
 } kadedb_lite_compression_t;
 
+typedef enum kadedb_lite_compaction_style_t {
+  // Fewer, sorted levels: least space and read amplification
+  KADEDB_LITE_COMPACTION_LEVEL = 0,
+  // Merges whole sorted runs: least write amplification
+  KADEDB_LITE_COMPACTION_UNIVERSAL = 1
+} kadedb_lite_compaction_style_t;
+
+// Presets for the tuning options below
+typedef enum kadedb_lite_profile_t {
+  // Options as created: 10-bit bloom filters, nothing else changed
+  KADEDB_LITE_PROFILE_DEFAULT = 0,
+  // Small devices: 8 MiB cache holding index and filter blocks, 4 MiB
+  // memtables, 128 open files, level compaction to spare flash space
+  KADEDB_LITE_PROFILE_MOBILE = 1,
+  // Large hosts: 512 MiB cache, partitioned index and filters, 64 MiB
+  // memtables, unlimited open files, background work on 4 threads
+  KADEDB_LITE_PROFILE_SERVER = 2
+} kadedb_lite_profile_t;
+
 kadedb_lite_options_t *kadedb_lite_options_create(void);
 void kadedb_lite_options_destroy(kadedb_lite_options_t *opts);
 
@@ -36,6 +55,24 @@ void kadedb_lite_options_set_write_buffer_size_bytes(
     kadedb_lite_options_t *opts, size_t write_buffer_size_bytes);
 void kadedb_lite_options_set_max_open_files(kadedb_lite_options_t *opts,
                                             int max_open_files);
+// Bloom filter bits per key; point lookups of missing keys skip SST files
+// whose filter rules the key out. 0 disables the filter.
+void kadedb_lite_options_set_bloom_filter_bits_per_key(
+    kadedb_lite_options_t *opts, double bits_per_key);
+// Split index and filter blocks into partitions loaded on demand
+void kadedb_lite_options_set_partitioned_index_filters(
+    kadedb_lite_options_t *opts, int enabled);
+// Keep index and filter blocks in the block cache, so they count against
+// its size, pinning those of level 0 (or the top-level partition index)
+void kadedb_lite_options_set_cache_index_and_filter_blocks(
+    kadedb_lite_options_t *opts, int enabled);
+void kadedb_lite_options_set_compaction_style(
+    kadedb_lite_options_t *opts, kadedb_lite_compaction_style_t style);
+// Reset cache, memtable, open-file, filter, index and compaction options to
+// `profile`'s values (compression is kept); setters called afterwards
+// override single options
+void kadedb_lite_options_set_profile(kadedb_lite_options_t *opts,
+                                     kadedb_lite_profile_t profile);
 
 kadedb_lite_t *kadedb_lite_open(const char *path);
 kadedb_lite_t *kadedb_lite_open_with_options(const char *path,
@@ -49,6 +86,104 @@ int kadedb_lite_get(kadedb_lite_t *db, const char *key, char **value_out,
 int kadedb_lite_delete(kadedb_lite_t *db, const char *key);
 void kadedb_lite_free(char *p);
 
+// Value read in place: the handle keeps the storage's copy alive, so no
+// buffer is allocated or filled for the caller. NULL if `key` is missing
+// or the read fails.
+typedef struct kadedb_lite_pinned_t kadedb_lite_pinned_t;
+
+kadedb_lite_pinned_t *kadedb_lite_get_pinned(kadedb_lite_t *db,
+                                             const char *key);
+// The value's bytes, valid until the handle is destroyed; not
+// NUL-terminated
+const char *kadedb_lite_pinned_value(const kadedb_lite_pinned_t *pinned,
+                                     size_t *len);
+void kadedb_lite_pinned_destroy(kadedb_lite_pinned_t *pinned);
+
+// Read `count` keys in one call. values_out[i] is NULL for a missing key,
+// otherwise a buffer of value_lens_out[i] bytes (not NUL-terminated) to
+// release with kadedb_lite_free. Returns the number of keys found, or -1
+// if the read fails, in which case every values_out[i] is NULL.
+int kadedb_lite_multi_get(kadedb_lite_t *db, size_t count,
+                          const char *const *keys, char **values_out,
+                          size_t *value_lens_out);
+
+// Puts and deletes that kadedb_lite_batch_commit applies atomically in one
+// write, instead of one write per key. Operations are buffered in the batch
+// until then and are applied in the order they were added. A batch is not
+// tied to a database and may be reused after it is committed.
+typedef struct kadedb_lite_batch_t kadedb_lite_batch_t;
+
+kadedb_lite_batch_t *kadedb_lite_batch_create(void);
+void kadedb_lite_batch_destroy(kadedb_lite_batch_t *batch);
+
+int kadedb_lite_batch_put(kadedb_lite_batch_t *batch, const char *key,
+                          const char *value, size_t value_len);
+int kadedb_lite_batch_delete(kadedb_lite_batch_t *batch, const char *key);
+// Operations buffered since the batch was created, committed or cleared
+size_t kadedb_lite_batch_count(const kadedb_lite_batch_t *batch);
+void kadedb_lite_batch_clear(kadedb_lite_batch_t *batch);
+// Apply every buffered operation or none; the batch is empty on success and
+// unchanged on failure
+int kadedb_lite_batch_commit(kadedb_lite_t *db, kadedb_lite_batch_t *batch);
+
+// Bulk loading for initial provisioning. Pairs added in ascending key order
+// are written straight to SST files, which kadedb_lite_loader_finish
+// ingests in one step, bypassing the memtable and write-ahead log. Loaded
+// values replace existing ones. Like kadedb_lite_sync_apply_delta, a load
+// is not logged for sync push. Nothing is visible before finish, and a
+// loader destroyed unfinished loads nothing.
+typedef struct kadedb_lite_loader_t kadedb_lite_loader_t;
+
+// Files are staged in the database directory, each up to `max_file_bytes`
+// (0 for 64 MiB). The loader must not outlive its database.
+kadedb_lite_loader_t *kadedb_lite_loader_create(kadedb_lite_t *db,
+                                                size_t max_file_bytes);
+void kadedb_lite_loader_destroy(kadedb_lite_loader_t *loader);
+
+// Fails unless `key` sorts strictly after the previous key; the loader
+// stays usable
+int kadedb_lite_loader_add(kadedb_lite_loader_t *loader, const char *key,
+                           const char *value, size_t value_len);
+// Pairs added so far
+size_t kadedb_lite_loader_count(const kadedb_lite_loader_t *loader);
+// Ingest everything added, atomically. The loader accepts no more pairs
+// afterwards, whether or not the ingestion succeeded.
+int kadedb_lite_loader_finish(kadedb_lite_loader_t *loader);
+
+// Ingest SST files built elsewhere, e.g. by the server with RocksDB's
+// SstFileWriter and the default bytewise comparator, atomically. The files
+// are moved into the database (linked when they share its file system);
+// do not use `paths` afterwards.
+int kadedb_lite_ingest_files(kadedb_lite_t *db, const char *const *paths,
+                             size_t count);
+
+// Cursor over keys in ascending byte order. Bounds are copied, so the
+// caller's strings need not outlive the iterator; the iterator must not
+// outlive its database. Key and value pointers stay valid until the next
+// call on the iterator.
+typedef struct kadedb_lite_iter_t kadedb_lite_iter_t;
+
+// Keys in [lower, upper); a NULL bound is open. `upper_len`/`lower_len`
+// count bytes, so a bound may contain NUL (e.g. "k\0" is just above "k").
+kadedb_lite_iter_t *kadedb_lite_iter_create(kadedb_lite_t *db,
+                                            const char *lower,
+                                            size_t lower_len,
+                                            const char *upper,
+                                            size_t upper_len);
+// Keys starting with `prefix`. A "table:" prefix uses the table prefix
+// extractor, so only that table's keys are read.
+kadedb_lite_iter_t *kadedb_lite_iter_create_prefix(kadedb_lite_t *db,
+                                                   const char *prefix);
+void kadedb_lite_iter_destroy(kadedb_lite_iter_t *it);
+
+// 1 while the iterator is on a key, 0 at the end or after an error
+int kadedb_lite_iter_valid(const kadedb_lite_iter_t *it);
+void kadedb_lite_iter_next(kadedb_lite_iter_t *it);
+const char *kadedb_lite_iter_key(const kadedb_lite_iter_t *it, size_t *len);
+const char *kadedb_lite_iter_value(const kadedb_lite_iter_t *it, size_t *len);
+// 0, or -1 if iteration stopped because of a read error
+int kadedb_lite_iter_status(const kadedb_lite_iter_t *it);
+
 #ifdef __cplusplus
 }
 #endif
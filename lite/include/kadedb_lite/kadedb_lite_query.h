@@ -12,6 +12,10 @@ extern "C" {
 typedef enum kadedb_lite_query_type_t {
   KADEDB_LITE_QUERY_SELECT = 0,
   KADEDB_LITE_QUERY_INSERT = 1,
+  // CREATE TABLE [IF NOT EXISTS] t (id TYPE, col TYPE, ...)
+  KADEDB_LITE_QUERY_CREATE_TABLE = 2,
+  // CREATE INDEX [IF NOT EXISTS] [name] ON t (col)
+  KADEDB_LITE_QUERY_CREATE_INDEX = 3,
   KADEDB_LITE_QUERY_UNKNOWN = -1
 } kadedb_lite_query_type_t;
 
@@ -38,6 +42,15 @@ typedef struct kadedb_lite_parsed_query_t {
   char **values;
   size_t value_count;
   kadedb_lite_condition_t *condition;
+  // INSERT tuples; `values` holds them row after row, value_count /
+  // row_count values each
+  size_t row_count;
+  // SELECT ... LIMIT n
+  int has_limit;
+  size_t limit;
+  // CREATE ... IF NOT EXISTS; CREATE TABLE keeps the column types in
+  // `values`, one per column
+  int if_not_exists;
 } kadedb_lite_parsed_query_t;
 
 typedef struct kadedb_lite_row_t {
@@ -54,6 +67,15 @@ typedef struct kadedb_lite_result_t {
   char *error_message;
 } kadedb_lite_result_t;
 
+// Tables are untyped (id, value) string pairs unless created with CREATE
+// TABLE. A created table has typed columns INTEGER, FLOAT, TEXT or
+// BOOLEAN, one of them named id; rows are stored under "table:id" in the
+// core library's binary row format, and columns left out of an INSERT are
+// missing (NULL in results). CREATE INDEX keeps "idx:table:col:value:id"
+// entries in the same writes as the rows, in value order, so WHERE with
+// =, <, <=, > or >= on an indexed column reads only the matching entries;
+// other conditions scan the table. Rows written with kadedb_lite_put()
+// bypass the indexes.
 kadedb_lite_parsed_query_t *kadedb_lite_parse_query(const char *query);
 
 void kadedb_lite_parsed_query_free(kadedb_lite_parsed_query_t *parsed);
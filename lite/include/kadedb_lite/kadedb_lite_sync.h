@@ -7,20 +7,106 @@ extern "C" {
 
 #include "kadedb_lite.h"
 
+#include <stdint.h>
+
+// How deltas reach the server and come back (see Incremental sync below)
+typedef struct kadedb_lite_sync_transport_t {
+  void *user_data;
+  // Send one delta; 0 once the server stored it
+  int (*push)(void *user_data, const char *delta, size_t delta_len);
+  // Fetch the server's changes after `since_seq` as one delta allocated
+  // with malloc(), or NULL when there are none; 0 on success
+  int (*pull)(void *user_data, uint64_t since_seq, char **delta_out,
+              size_t *delta_len_out);
+} kadedb_lite_sync_transport_t;
+
 typedef struct kadedb_lite_sync_config_t {
   const char *remote_url;
   const char *auth_token;
   int sync_interval_seconds;
+  // Background worker of kadedb_lite_sync_start(): pushes and pulls
+  // through `transport` every interval, or as soon as changes are logged
+  // when the interval is 0. The callbacks run on the worker thread and
+  // user_data must outlive it. NULL leaves sync to the calls below.
+  const kadedb_lite_sync_transport_t *transport;
+  // Budget of one upload: log entries (0 for 1024) and delta bytes (0 for
+  // 256 KiB); a delta over the byte budget is rebuilt from half as many
+  // entries
+  size_t max_batch_changes;
+  size_t max_batch_bytes;
+  // Delay before retrying a failed round, doubling from 250 ms up to this
+  // (0 for 60)
+  int max_backoff_seconds;
 } kadedb_lite_sync_config_t;
 
+// Also turns on the change log below, resuming from the sequence numbers
+// stored in the database. Writes made before init are not logged. Fails
+// while the worker runs.
 int kadedb_lite_sync_init(kadedb_lite_t *db, kadedb_lite_sync_config_t *config);
 
+// Start the worker when a transport is configured. Writes only log their
+// changes; the worker uploads them later, so they never wait on the
+// network. Repeated writes of a key between two rounds go out once.
 int kadedb_lite_sync_start(kadedb_lite_t *db);
 
+// Stop the worker after the round in progress; kadedb_lite_close() stops it
+// too
 int kadedb_lite_sync_stop(kadedb_lite_t *db);
 
+// State, configuration and the worker's statistics: queue_depth (changes
+// not yet acknowledged), bytes_sent, deltas_sent, last_latency_ms (of the
+// last push), failures and backoff_ms
 int kadedb_lite_sync_status(kadedb_lite_t *db, char **status_out);
 
+// Incremental sync
+//
+// Once sync is initialized, every put, delete and committed batch is logged
+// under a sequence number in the same atomic write as the data, so the log
+// survives crashes exactly as the data does. A delta carries the keys
+// changed in a range of sequence numbers with their current values (or a
+// delete), each key once however often it changed, LZ4 compressed when
+// that makes it smaller. Keys starting with "__kadedb_sync:" are reserved
+// for the log and its state.
+//
+// A round pushes kadedb_lite_sync_build_delta() until it returns no delta,
+// acknowledging each one the server stored, then applies the server's
+// deltas after kadedb_lite_sync_pulled_seq(). The transport is up to the
+// application; kadedb_lite_sync_run_once() drives a round over callbacks.
+
+// Newest change the server acknowledged and newest change logged; the
+// difference is what is left to push
+int kadedb_lite_sync_pending(kadedb_lite_t *db, uint64_t *acked_seq_out,
+                             uint64_t *latest_seq_out);
+
+// Encode the changes after the acknowledged sequence, reading at most
+// `max_changes` log entries (0 for all). *to_seq_out is the last sequence
+// included, to acknowledge once the server stored the delta. Free the
+// delta with kadedb_lite_free(); it is NULL when nothing is pending.
+int kadedb_lite_sync_build_delta(kadedb_lite_t *db, size_t max_changes,
+                                 char **delta_out, size_t *delta_len_out,
+                                 uint64_t *to_seq_out);
+
+// Drop the changes up to `seq` from the log; acknowledging an older
+// sequence again does nothing
+int kadedb_lite_sync_ack(kadedb_lite_t *db, uint64_t seq);
+
+// Newest server sequence applied, to pull the changes after
+int kadedb_lite_sync_pulled_seq(kadedb_lite_t *db, uint64_t *seq_out);
+
+// Apply a delta from the server in one atomic write, without logging its
+// changes for push. Fails on a malformed delta and on one starting after
+// kadedb_lite_sync_pulled_seq(), which would leave a gap.
+int kadedb_lite_sync_apply_delta(kadedb_lite_t *db, const char *delta,
+                                 size_t delta_len);
+
+// One round over `transport`: push every pending change in deltas of at
+// most `batch_changes` log entries (0 for one delta), then pull and apply
+// until the server has nothing newer. The changes pushed before a failure
+// stay acknowledged.
+int kadedb_lite_sync_run_once(kadedb_lite_t *db,
+                              const kadedb_lite_sync_transport_t *transport,
+                              size_t batch_changes);
+
 #ifdef __cplusplus
 }
 #endif
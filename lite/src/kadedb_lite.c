@@ -2,6 +2,7 @@
 
 #include "kadedb_lite_internal.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -16,6 +17,7 @@ kadedb_lite_options_t *kadedb_lite_options_create(void) {
   opts->cache_size_bytes = 0;
   opts->write_buffer_size_bytes = 0;
   opts->max_open_files = 0;
+  kadedb_lite_options_set_profile(opts, KADEDB_LITE_PROFILE_DEFAULT);
   return opts;
 }
 
@@ -63,6 +65,66 @@ void kadedb_lite_options_set_max_open_files(kadedb_lite_options_t *opts,
   opts->max_open_files = max_open_files;
 }
 
+void kadedb_lite_options_set_bloom_filter_bits_per_key(
+    kadedb_lite_options_t *opts, double bits_per_key) {
+  if (!opts)
+    return;
+  opts->bloom_bits_per_key = bits_per_key > 0 ? bits_per_key : 0;
+}
+
+void kadedb_lite_options_set_partitioned_index_filters(
+    kadedb_lite_options_t *opts, int enabled) {
+  if (!opts)
+    return;
+  opts->partitioned_index_filters = enabled ? 1 : 0;
+}
+
+void kadedb_lite_options_set_cache_index_and_filter_blocks(
+    kadedb_lite_options_t *opts, int enabled) {
+  if (!opts)
+    return;
+  opts->cache_index_and_filter_blocks = enabled ? 1 : 0;
+}
+
+void kadedb_lite_options_set_compaction_style(
+    kadedb_lite_options_t *opts, kadedb_lite_compaction_style_t style) {
+  if (!opts)
+    return;
+  opts->compaction_style = style;
+}
+
+void kadedb_lite_options_set_profile(kadedb_lite_options_t *opts,
+                                     kadedb_lite_profile_t profile) {
+  if (!opts)
+    return;
+  opts->cache_size_bytes = 0;
+  opts->write_buffer_size_bytes = 0;
+  opts->max_open_files = 0;
+  opts->bloom_bits_per_key = 10;
+  opts->partitioned_index_filters = 0;
+  opts->cache_index_and_filter_blocks = 0;
+  opts->compaction_style = KADEDB_LITE_COMPACTION_LEVEL;
+  opts->background_jobs = 0;
+  switch (profile) {
+  case KADEDB_LITE_PROFILE_MOBILE:
+    opts->cache_size_bytes = (size_t)8 << 20;
+    opts->write_buffer_size_bytes = (size_t)4 << 20;
+    opts->max_open_files = 128;
+    opts->cache_index_and_filter_blocks = 1;
+    break;
+  case KADEDB_LITE_PROFILE_SERVER:
+    opts->cache_size_bytes = (size_t)512 << 20;
+    opts->write_buffer_size_bytes = (size_t)64 << 20;
+    opts->max_open_files = -1;
+    opts->partitioned_index_filters = 1;
+    opts->cache_index_and_filter_blocks = 1;
+    opts->background_jobs = 4;
+    break;
+  default:
+    break;
+  }
+}
+
 #ifdef KADEDB_LITE_HAS_ROCKSDB
 static rocksdb_compression_type
 kadedb_lite_map_compression(kadedb_lite_compression_t compression) {
@@ -85,6 +147,66 @@ kadedb_lite_map_compression(kadedb_lite_compression_t compression) {
     return rocksdb_no_compression;
   }
 }
+
+// Block cache, filter and index settings of `opts` for SST files
+static void
+kadedb_lite_apply_table_options(rocksdb_block_based_table_options_t *bbt,
+                                rocksdb_cache_t *cache,
+                                const kadedb_lite_options_t *opts) {
+  if (cache)
+    rocksdb_block_based_options_set_block_cache(bbt, cache);
+  if (opts->bloom_bits_per_key > 0) {
+    // Owned by the table options from here on
+    rocksdb_block_based_options_set_filter_policy(
+        bbt, rocksdb_filterpolicy_create_bloom_full(opts->bloom_bits_per_key));
+  }
+  if (opts->partitioned_index_filters) {
+    // Partitioned filters need the two-level index and full filters
+    rocksdb_block_based_options_set_index_type(
+        bbt, rocksdb_block_based_table_index_type_two_level_index_search);
+    rocksdb_block_based_options_set_partition_filters(bbt, 1);
+  }
+  if (opts->cache_index_and_filter_blocks) {
+    rocksdb_block_based_options_set_cache_index_and_filter_blocks(bbt, 1);
+    if (opts->partitioned_index_filters)
+      rocksdb_block_based_options_set_pin_top_level_index_and_filter(bbt, 1);
+    else
+      rocksdb_block_based_options_set_pin_l0_filter_and_index_blocks_in_cache(
+          bbt, 1);
+  }
+}
+
+// Prefix extractor for "table:id" keys: everything up to and including the
+// first ':', so prefix seeks stay within one table
+static char *kadedb_lite_table_prefix(void *state, const char *key,
+                                      size_t length, size_t *dst_length) {
+  (void)state;
+  const char *colon = (const char *)memchr(key, ':', length);
+  *dst_length = (size_t)(colon - key) + 1;
+  return (char *)key;
+}
+
+static unsigned char kadedb_lite_table_prefix_in_domain(void *state,
+                                                        const char *key,
+                                                        size_t length) {
+  (void)state;
+  return memchr(key, ':', length) != NULL;
+}
+
+static unsigned char kadedb_lite_table_prefix_in_range(void *state,
+                                                       const char *key,
+                                                       size_t length) {
+  (void)state;
+  return length > 0 && key[length - 1] == ':' &&
+         memchr(key, ':', length) == key + length - 1;
+}
+
+static const char *kadedb_lite_table_prefix_name(void *state) {
+  (void)state;
+  return "kadedb_lite.TablePrefix";
+}
+
+static void kadedb_lite_table_prefix_destroy(void *state) { (void)state; }
 #endif
 
 kadedb_lite_t *kadedb_lite_open(const char *path) {
@@ -104,6 +226,13 @@ kadedb_lite_open_with_options(const char *path,
     free(h);
     return NULL;
   }
+  // Owned by the options from here on
+  rocksdb_options_set_prefix_extractor(
+      h->options,
+      rocksdb_slicetransform_create(
+          NULL, kadedb_lite_table_prefix_destroy, kadedb_lite_table_prefix,
+          kadedb_lite_table_prefix_in_domain,
+          kadedb_lite_table_prefix_in_range, kadedb_lite_table_prefix_name));
   if (opts) {
     rocksdb_options_set_create_if_missing(h->options, opts->create_if_missing);
     rocksdb_options_set_error_if_exists(h->options, opts->error_if_exists);
@@ -116,6 +245,14 @@ kadedb_lite_open_with_options(const char *path,
     if (opts->max_open_files != 0) {
       rocksdb_options_set_max_open_files(h->options, opts->max_open_files);
     }
+    rocksdb_options_set_compaction_style(
+        h->options, opts->compaction_style == KADEDB_LITE_COMPACTION_UNIVERSAL
+                        ? rocksdb_universal_compaction
+                        : rocksdb_level_compaction);
+    if (opts->background_jobs > 0) {
+      rocksdb_options_set_max_background_jobs(h->options,
+                                              opts->background_jobs);
+    }
     if (opts->cache_size_bytes > 0) {
       h->cache = rocksdb_cache_create_lru(opts->cache_size_bytes);
       if (!h->cache) {
@@ -123,14 +260,19 @@ kadedb_lite_open_with_options(const char *path,
         free(h);
         return NULL;
       }
+    }
+    if (h->cache || opts->bloom_bits_per_key > 0 ||
+        opts->partitioned_index_filters ||
+        opts->cache_index_and_filter_blocks) {
       h->bbt_opts = rocksdb_block_based_options_create();
       if (!h->bbt_opts) {
-        rocksdb_cache_destroy(h->cache);
+        if (h->cache)
+          rocksdb_cache_destroy(h->cache);
         rocksdb_options_destroy(h->options);
         free(h);
         return NULL;
       }
-      rocksdb_block_based_options_set_block_cache(h->bbt_opts, h->cache);
+      kadedb_lite_apply_table_options(h->bbt_opts, h->cache, opts);
       rocksdb_options_set_block_based_table_factory(h->options, h->bbt_opts);
     }
   } else {
@@ -151,7 +293,9 @@ kadedb_lite_open_with_options(const char *path,
   }
   h->ropts = rocksdb_readoptions_create();
   h->wopts = rocksdb_writeoptions_create();
-  if (!h->ropts || !h->wopts) {
+  h->path = (char *)malloc(strlen(path) + 1);
+  if (!h->ropts || !h->wopts || !h->path) {
+    free(h->path);
     if (h->ropts)
       rocksdb_readoptions_destroy(h->ropts);
     if (h->wopts)
@@ -165,12 +309,18 @@ kadedb_lite_open_with_options(const char *path,
     free(h);
     return NULL;
   }
+  memcpy(h->path, path, strlen(path) + 1);
 
   h->sync_initialized = 0;
   h->sync_running = 0;
   h->sync_interval_seconds = 0;
   h->sync_remote_url = NULL;
   h->sync_auth_token = NULL;
+  h->sync_tracking = 0;
+  h->sync_last_seq = 0;
+  h->sync_acked_seq = 0;
+  h->sync_pulled_seq = 0;
+  h->sync_worker = NULL;
 
   return h;
 #else
@@ -186,6 +336,14 @@ kadedb_lite_open_with_options(const char *path,
     db->sync_interval_seconds = 0;
     db->sync_remote_url = NULL;
     db->sync_auth_token = NULL;
+    db->sync_tracking = 0;
+    db->sync_last_seq = 0;
+    db->sync_acked_seq = 0;
+    db->sync_pulled_seq = 0;
+    db->sync_worker = NULL;
+    db->sync_log_keys = NULL;
+    db->sync_log_len = 0;
+    db->sync_log_cap = 0;
   }
 
   return db;
@@ -204,6 +362,7 @@ void kadedb_lite_close(kadedb_lite_t *db) {
     free(db->sync_auth_token);
     db->sync_auth_token = NULL;
   }
+  kadedb_lite_sync_release(db);
 
 #ifdef KADEDB_LITE_HAS_ROCKSDB
   if (db->ropts)
@@ -218,14 +377,33 @@ void kadedb_lite_close(kadedb_lite_t *db) {
     rocksdb_cache_destroy(db->cache);
   if (db->options)
     rocksdb_options_destroy(db->options);
+  free(db->path);
   free(db);
 #else
   free(db);
 #endif
 }
 
+// A put (or a delete when value is NULL) as a batch of one, so the sync
+// change log records it in the same write
+static int kadedb_lite_write_logged(kadedb_lite_t *db, const char *key,
+                                    const char *value, size_t value_len) {
+  kadedb_lite_batch_t *batch = kadedb_lite_batch_create();
+  if (!batch)
+    return -1;
+  int rc = value ? kadedb_lite_batch_put(batch, key, value, value_len)
+                 : kadedb_lite_batch_delete(batch, key);
+  if (rc == 0)
+    rc = kadedb_lite_batch_commit(db, batch);
+  kadedb_lite_batch_destroy(batch);
+  return rc;
+}
+
 int kadedb_lite_put(kadedb_lite_t *db, const char *key, const char *value,
                     size_t value_len) {
+  if (db && db->sync_tracking)
+    return key && value ? kadedb_lite_write_logged(db, key, value, value_len)
+                        : -1;
 #ifdef KADEDB_LITE_HAS_ROCKSDB
   if (!db || !db->db || !key || !value)
     return -1;
@@ -292,6 +470,8 @@ int kadedb_lite_get(kadedb_lite_t *db, const char *key, char **value_out,
 }
 
 int kadedb_lite_delete(kadedb_lite_t *db, const char *key) {
+  if (db && db->sync_tracking)
+    return key ? kadedb_lite_write_logged(db, key, NULL, 0) : -1;
 #ifdef KADEDB_LITE_HAS_ROCKSDB
   if (!db || !db->db || !key)
     return -1;
@@ -309,6 +489,661 @@ int kadedb_lite_delete(kadedb_lite_t *db, const char *key) {
 #endif
 }
 
+kadedb_lite_pinned_t *kadedb_lite_get_pinned(kadedb_lite_t *db,
+                                             const char *key) {
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  if (!db || !db->db || !key)
+    return NULL;
+  char *err = NULL;
+  rocksdb_pinnableslice_t *slice =
+      rocksdb_get_pinned(db->db, db->ropts, key, strlen(key), &err);
+  if (err != NULL) {
+    rocksdb_free(err);
+    return NULL;
+  }
+  if (slice == NULL) {
+    // Not found
+    return NULL;
+  }
+  kadedb_lite_pinned_t *pinned =
+      (kadedb_lite_pinned_t *)malloc(sizeof(kadedb_lite_pinned_t));
+  if (!pinned) {
+    rocksdb_pinnableslice_destroy(slice);
+    return NULL;
+  }
+  pinned->slice = slice;
+  return pinned;
+#else
+  if (!db || !key)
+    return NULL;
+  return (kadedb_lite_pinned_t *)calloc(1, sizeof(kadedb_lite_pinned_t));
+#endif
+}
+
+const char *kadedb_lite_pinned_value(const kadedb_lite_pinned_t *pinned,
+                                     size_t *len) {
+  if (!pinned) {
+    if (len)
+      *len = 0;
+    return NULL;
+  }
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  size_t n = 0;
+  const char *value = rocksdb_pinnableslice_value(pinned->slice, &n);
+  if (len)
+    *len = n;
+  return value;
+#else
+  static const char msg[] = "stub";
+  if (len)
+    *len = sizeof(msg) - 1;
+  return msg;
+#endif
+}
+
+void kadedb_lite_pinned_destroy(kadedb_lite_pinned_t *pinned) {
+  if (!pinned)
+    return;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  rocksdb_pinnableslice_destroy(pinned->slice);
+#endif
+  free(pinned);
+}
+
+int kadedb_lite_multi_get(kadedb_lite_t *db, size_t count,
+                          const char *const *keys, char **values_out,
+                          size_t *value_lens_out) {
+  if (!db || (count > 0 && (!keys || !values_out || !value_lens_out)))
+    return -1;
+  for (size_t i = 0; i < count; i++) {
+    values_out[i] = NULL;
+    value_lens_out[i] = 0;
+    if (!keys[i])
+      return -1;
+  }
+  if (count == 0)
+    return 0;
+
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  if (!db->db)
+    return -1;
+  size_t *key_lens = (size_t *)malloc(count * sizeof(size_t));
+  char **errs = (char **)calloc(count, sizeof(char *));
+  if (!key_lens || !errs) {
+    free(key_lens);
+    free(errs);
+    return -1;
+  }
+  for (size_t i = 0; i < count; i++)
+    key_lens[i] = strlen(keys[i]);
+  // Values come back malloc'ed by RocksDB and are handed over as they are
+  rocksdb_multi_get(db->db, db->ropts, count, keys, key_lens, values_out,
+                    value_lens_out, errs);
+  free(key_lens);
+
+  int found = 0;
+  int failed = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (errs[i] != NULL) {
+      rocksdb_free(errs[i]);
+      failed = 1;
+    }
+    if (values_out[i] != NULL)
+      found++;
+  }
+  free(errs);
+  if (failed) {
+    for (size_t i = 0; i < count; i++) {
+      rocksdb_free(values_out[i]);
+      values_out[i] = NULL;
+      value_lens_out[i] = 0;
+    }
+    return -1;
+  }
+  return found;
+#else
+  // Stub: every key holds "stub", like kadedb_lite_get
+  for (size_t i = 0; i < count; i++) {
+    char *buf = (char *)malloc(4);
+    if (!buf) {
+      for (size_t j = 0; j < i; j++) {
+        free(values_out[j]);
+        values_out[j] = NULL;
+        value_lens_out[j] = 0;
+      }
+      return -1;
+    }
+    memcpy(buf, "stub", 4);
+    values_out[i] = buf;
+    value_lens_out[i] = 4;
+  }
+  return (int)count;
+#endif
+}
+
+kadedb_lite_batch_t *kadedb_lite_batch_create(void) {
+  kadedb_lite_batch_t *batch =
+      (kadedb_lite_batch_t *)calloc(1, sizeof(kadedb_lite_batch_t));
+  if (!batch)
+    return NULL;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  batch->wb = rocksdb_writebatch_create();
+  if (!batch->wb) {
+    free(batch);
+    return NULL;
+  }
+#endif
+  return batch;
+}
+
+#ifndef KADEDB_LITE_HAS_ROCKSDB
+// Remember `key` as the next operation of a stub batch
+static int kadedb_lite_batch_add_key(kadedb_lite_batch_t *batch,
+                                     const char *key) {
+  if (batch->count == batch->cap) {
+    size_t cap = batch->cap ? batch->cap * 2 : 8;
+    char **keys = (char **)realloc(batch->keys, cap * sizeof(char *));
+    if (!keys)
+      return -1;
+    batch->keys = keys;
+    batch->cap = cap;
+  }
+  size_t n = strlen(key);
+  char *copy = (char *)malloc(n + 1);
+  if (!copy)
+    return -1;
+  memcpy(copy, key, n + 1);
+  batch->keys[batch->count++] = copy;
+  return 0;
+}
+#endif
+
+void kadedb_lite_batch_destroy(kadedb_lite_batch_t *batch) {
+  if (!batch)
+    return;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  if (batch->wb)
+    rocksdb_writebatch_destroy(batch->wb);
+#else
+  kadedb_lite_batch_clear(batch);
+  free(batch->keys);
+#endif
+  free(batch);
+}
+
+int kadedb_lite_batch_put(kadedb_lite_batch_t *batch, const char *key,
+                          const char *value, size_t value_len) {
+  if (!batch || !key || !value)
+    return -1;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  rocksdb_writebatch_put(batch->wb, key, strlen(key), value, value_len);
+  return 0;
+#else
+  (void)value_len;
+  return kadedb_lite_batch_add_key(batch, key);
+#endif
+}
+
+int kadedb_lite_batch_delete(kadedb_lite_batch_t *batch, const char *key) {
+  if (!batch || !key)
+    return -1;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  rocksdb_writebatch_delete(batch->wb, key, strlen(key));
+  return 0;
+#else
+  return kadedb_lite_batch_add_key(batch, key);
+#endif
+}
+
+size_t kadedb_lite_batch_count(const kadedb_lite_batch_t *batch) {
+  if (!batch)
+    return 0;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  // The C API takes a mutable batch although counting does not change it
+  return (size_t)rocksdb_writebatch_count((rocksdb_writebatch_t *)batch->wb);
+#else
+  return batch->count;
+#endif
+}
+
+void kadedb_lite_batch_clear(kadedb_lite_batch_t *batch) {
+  if (!batch)
+    return;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  rocksdb_writebatch_clear(batch->wb);
+#else
+  for (size_t i = 0; i < batch->count; i++)
+    free(batch->keys[i]);
+  batch->count = 0;
+#endif
+}
+
+int kadedb_lite_batch_write(kadedb_lite_t *db, kadedb_lite_batch_t *batch) {
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  if (!db || !db->db || !batch)
+    return -1;
+  char *err = NULL;
+  rocksdb_write(db->db, db->wopts, batch->wb, &err);
+  if (err != NULL) {
+    rocksdb_free(err);
+    return -1;
+  }
+  return 0;
+#else
+  if (!db || !batch)
+    return -1;
+  // Stub success
+  return 0;
+#endif
+}
+
+int kadedb_lite_batch_commit(kadedb_lite_t *db, kadedb_lite_batch_t *batch) {
+  if (!db || !batch)
+    return -1;
+  int rc = db->sync_tracking ? kadedb_lite_sync_commit(db, batch)
+                             : kadedb_lite_batch_write(db, batch);
+  if (rc == 0)
+    kadedb_lite_batch_clear(batch);
+  return rc;
+}
+
+// Default size cap of a bulk load's SST files
+#define KADEDB_LITE_LOADER_FILE_BYTES ((size_t)64 << 20)
+
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+// Ingest `paths` in one atomic step, moving rather than copying them
+static int kadedb_lite_ingest(kadedb_lite_t *db, const char *const *paths,
+                              size_t count) {
+  rocksdb_ingestexternalfileoptions_t *opts =
+      rocksdb_ingestexternalfileoptions_create();
+  if (!opts)
+    return -1;
+  rocksdb_ingestexternalfileoptions_set_move_files(opts, 1);
+  char *err = NULL;
+  rocksdb_ingest_external_file(db->db, paths, count, opts, &err);
+  rocksdb_ingestexternalfileoptions_destroy(opts);
+  if (err != NULL) {
+    rocksdb_free(err);
+    return -1;
+  }
+  return 0;
+}
+
+// Finish the file being written, if any
+static int kadedb_lite_loader_close_file(kadedb_lite_loader_t *loader) {
+  if (!loader->writer)
+    return 0;
+  char *err = NULL;
+  rocksdb_sstfilewriter_finish(loader->writer, &err);
+  rocksdb_sstfilewriter_destroy(loader->writer);
+  loader->writer = NULL;
+  if (err != NULL) {
+    rocksdb_free(err);
+    return -1;
+  }
+  return 0;
+}
+
+// Start the next file; named after the loader, so loaders never collide
+static int kadedb_lite_loader_open_file(kadedb_lite_loader_t *loader) {
+  if (loader->file_count == loader->file_cap) {
+    size_t cap = loader->file_cap ? loader->file_cap * 2 : 8;
+    char **files = (char **)realloc(loader->files, cap * sizeof(char *));
+    if (!files)
+      return -1;
+    loader->files = files;
+    loader->file_cap = cap;
+  }
+  size_t n = strlen(loader->db->path) + 64;
+  char *path = (char *)malloc(n);
+  if (!path)
+    return -1;
+  snprintf(path, n, "%s/kadedb_lite_bulk_%p_%lu.sst", loader->db->path,
+           (void *)loader, (unsigned long)loader->file_count);
+  rocksdb_sstfilewriter_t *writer =
+      rocksdb_sstfilewriter_create(loader->env, loader->db->options);
+  if (!writer) {
+    free(path);
+    return -1;
+  }
+  char *err = NULL;
+  rocksdb_sstfilewriter_open(writer, path, &err);
+  if (err != NULL) {
+    rocksdb_free(err);
+    rocksdb_sstfilewriter_destroy(writer);
+    free(path);
+    return -1;
+  }
+  loader->files[loader->file_count++] = path;
+  loader->writer = writer;
+  return 0;
+}
+#endif
+
+kadedb_lite_loader_t *kadedb_lite_loader_create(kadedb_lite_t *db,
+                                                size_t max_file_bytes) {
+  if (!db)
+    return NULL;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  if (!db->db)
+    return NULL;
+#endif
+  kadedb_lite_loader_t *loader =
+      (kadedb_lite_loader_t *)calloc(1, sizeof(kadedb_lite_loader_t));
+  if (!loader)
+    return NULL;
+  loader->db = db;
+  loader->max_file_bytes =
+      max_file_bytes ? max_file_bytes : KADEDB_LITE_LOADER_FILE_BYTES;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  loader->env = rocksdb_envoptions_create();
+  if (!loader->env) {
+    free(loader);
+    return NULL;
+  }
+#endif
+  return loader;
+}
+
+void kadedb_lite_loader_destroy(kadedb_lite_loader_t *loader) {
+  if (!loader)
+    return;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  if (loader->writer)
+    rocksdb_sstfilewriter_destroy(loader->writer);
+  // Ingested files were moved into the database already; this removes
+  // the files of an unfinished or failed load
+  for (size_t i = 0; i < loader->file_count; i++) {
+    remove(loader->files[i]);
+    free(loader->files[i]);
+  }
+  free(loader->files);
+  if (loader->env)
+    rocksdb_envoptions_destroy(loader->env);
+#endif
+  free(loader->last_key);
+  free(loader);
+}
+
+int kadedb_lite_loader_add(kadedb_lite_loader_t *loader, const char *key,
+                           const char *value, size_t value_len) {
+  if (!loader || loader->finished || !key || !value)
+    return -1;
+  size_t key_len = strlen(key);
+  if (loader->count > 0) {
+    size_t n = key_len < loader->last_len ? key_len : loader->last_len;
+    int c = memcmp(key, loader->last_key, n);
+    if (c < 0 || (c == 0 && key_len <= loader->last_len))
+      return -1;
+  }
+  size_t need = key_len ? key_len : 1;
+  if (need > loader->last_cap) {
+    size_t cap = loader->last_cap * 2 > need ? loader->last_cap * 2 : need;
+    char *last = (char *)realloc(loader->last_key, cap);
+    if (!last)
+      return -1;
+    loader->last_key = last;
+    loader->last_cap = cap;
+  }
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  if (!loader->writer && kadedb_lite_loader_open_file(loader) != 0)
+    return -1;
+  char *err = NULL;
+  rocksdb_sstfilewriter_put(loader->writer, key, key_len, value, value_len,
+                            &err);
+  uint64_t size = 0;
+  if (err == NULL)
+    rocksdb_sstfilewriter_file_size(loader->writer, &size);
+  if (err != NULL || (size >= loader->max_file_bytes &&
+                      kadedb_lite_loader_close_file(loader) != 0)) {
+    // The file may hold part of the pair: give up on the load
+    rocksdb_free(err);
+    loader->finished = 1;
+    return -1;
+  }
+#else
+  (void)value_len;
+#endif
+  memcpy(loader->last_key, key, key_len);
+  loader->last_len = key_len;
+  loader->count++;
+  return 0;
+}
+
+size_t kadedb_lite_loader_count(const kadedb_lite_loader_t *loader) {
+  return loader ? loader->count : 0;
+}
+
+int kadedb_lite_loader_finish(kadedb_lite_loader_t *loader) {
+  if (!loader || loader->finished)
+    return -1;
+  loader->finished = 1;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  if (kadedb_lite_loader_close_file(loader) != 0)
+    return -1;
+  if (loader->file_count == 0)
+    return 0;
+  return kadedb_lite_ingest(loader->db, (const char *const *)loader->files,
+                            loader->file_count);
+#else
+  // Stub success
+  return 0;
+#endif
+}
+
+int kadedb_lite_ingest_files(kadedb_lite_t *db, const char *const *paths,
+                             size_t count) {
+  if (!db || (count > 0 && !paths))
+    return -1;
+  for (size_t i = 0; i < count; i++)
+    if (!paths[i])
+      return -1;
+  if (count == 0)
+    return 0;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  if (!db->db)
+    return -1;
+  return kadedb_lite_ingest(db, paths, count);
+#else
+  // Stub success
+  return 0;
+#endif
+}
+
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+static char *kadedb_lite_copy_bound(const char *bound, size_t len) {
+  char *copy = (char *)malloc(len ? len : 1);
+  if (copy)
+    memcpy(copy, bound, len);
+  return copy;
+}
+
+// Open an iterator over [lower, upper); `prefix_seek` confines it to the
+// prefix of `lower` under the table prefix extractor
+static kadedb_lite_iter_t *kadedb_lite_iter_open(kadedb_lite_t *db,
+                                                 const char *lower,
+                                                 size_t lower_len,
+                                                 const char *upper,
+                                                 size_t upper_len,
+                                                 int prefix_seek) {
+  if (!db || !db->db)
+    return NULL;
+  kadedb_lite_iter_t *it =
+      (kadedb_lite_iter_t *)calloc(1, sizeof(kadedb_lite_iter_t));
+  if (!it)
+    return NULL;
+  it->ropts = rocksdb_readoptions_create();
+  if (!it->ropts) {
+    free(it);
+    return NULL;
+  }
+  if (prefix_seek)
+    rocksdb_readoptions_set_prefix_same_as_start(it->ropts, 1);
+  else
+    rocksdb_readoptions_set_total_order_seek(it->ropts, 1);
+  if (lower) {
+    it->lower = kadedb_lite_copy_bound(lower, lower_len);
+    if (!it->lower) {
+      kadedb_lite_iter_destroy(it);
+      return NULL;
+    }
+    rocksdb_readoptions_set_iterate_lower_bound(it->ropts, it->lower,
+                                                lower_len);
+  }
+  if (upper) {
+    it->upper = kadedb_lite_copy_bound(upper, upper_len);
+    if (!it->upper) {
+      kadedb_lite_iter_destroy(it);
+      return NULL;
+    }
+    rocksdb_readoptions_set_iterate_upper_bound(it->ropts, it->upper,
+                                                upper_len);
+  }
+  it->it = rocksdb_create_iterator(db->db, it->ropts);
+  if (!it->it) {
+    kadedb_lite_iter_destroy(it);
+    return NULL;
+  }
+  if (lower)
+    rocksdb_iter_seek(it->it, it->lower, lower_len);
+  else
+    rocksdb_iter_seek_to_first(it->it);
+  return it;
+}
+#endif
+
+kadedb_lite_iter_t *kadedb_lite_iter_create(kadedb_lite_t *db,
+                                            const char *lower,
+                                            size_t lower_len,
+                                            const char *upper,
+                                            size_t upper_len) {
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  return kadedb_lite_iter_open(db, lower, lower_len, upper, upper_len, 0);
+#else
+  (void)lower;
+  (void)lower_len;
+  (void)upper;
+  (void)upper_len;
+  if (!db)
+    return NULL;
+  // Stub: an iterator that is already at the end
+  return (kadedb_lite_iter_t *)calloc(1, sizeof(kadedb_lite_iter_t));
+#endif
+}
+
+kadedb_lite_iter_t *kadedb_lite_iter_create_prefix(kadedb_lite_t *db,
+                                                   const char *prefix) {
+  if (!prefix)
+    return NULL;
+  size_t len = strlen(prefix);
+  // The first key above every key with the prefix: drop trailing 0xff bytes
+  // and increment the last remaining one; none left means no upper bound
+  char *upper = (char *)malloc(len ? len : 1);
+  if (!upper)
+    return NULL;
+  memcpy(upper, prefix, len);
+  size_t upper_len = len;
+  while (upper_len > 0 && (unsigned char)upper[upper_len - 1] == 0xff)
+    upper_len--;
+  if (upper_len > 0)
+    upper[upper_len - 1] = (char)((unsigned char)upper[upper_len - 1] + 1);
+
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  // Only a whole "table:" prefix is a prefix of the extractor
+  const char *colon = (const char *)memchr(prefix, ':', len);
+  int prefix_seek = colon != NULL && colon == prefix + len - 1;
+  kadedb_lite_iter_t *it =
+      kadedb_lite_iter_open(db, len ? prefix : NULL, len,
+                            upper_len ? upper : NULL, upper_len, prefix_seek);
+#else
+  kadedb_lite_iter_t *it = kadedb_lite_iter_create(
+      db, len ? prefix : NULL, len, upper_len ? upper : NULL, upper_len);
+#endif
+  free(upper);
+  return it;
+}
+
+void kadedb_lite_iter_destroy(kadedb_lite_iter_t *it) {
+  if (!it)
+    return;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  if (it->it)
+    rocksdb_iter_destroy(it->it);
+  if (it->ropts)
+    rocksdb_readoptions_destroy(it->ropts);
+  free(it->lower);
+  free(it->upper);
+#endif
+  free(it);
+}
+
+int kadedb_lite_iter_valid(const kadedb_lite_iter_t *it) {
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  return it && it->it && rocksdb_iter_valid(it->it) ? 1 : 0;
+#else
+  (void)it;
+  return 0;
+#endif
+}
+
+void kadedb_lite_iter_next(kadedb_lite_iter_t *it) {
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  if (kadedb_lite_iter_valid(it))
+    rocksdb_iter_next(it->it);
+#else
+  (void)it;
+#endif
+}
+
+const char *kadedb_lite_iter_key(const kadedb_lite_iter_t *it, size_t *len) {
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  if (kadedb_lite_iter_valid(it)) {
+    size_t n = 0;
+    const char *key = rocksdb_iter_key(it->it, &n);
+    if (len)
+      *len = n;
+    return key;
+  }
+#else
+  (void)it;
+#endif
+  if (len)
+    *len = 0;
+  return NULL;
+}
+
+const char *kadedb_lite_iter_value(const kadedb_lite_iter_t *it,
+                                   size_t *len) {
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  if (kadedb_lite_iter_valid(it)) {
+    size_t n = 0;
+    const char *value = rocksdb_iter_value(it->it, &n);
+    if (len)
+      *len = n;
+    return value;
+  }
+#else
+  (void)it;
+#endif
+  if (len)
+    *len = 0;
+  return NULL;
+}
+
+int kadedb_lite_iter_status(const kadedb_lite_iter_t *it) {
+  if (!it)
+    return -1;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  char *err = NULL;
+  rocksdb_iter_get_error(it->it, &err);
+  if (err != NULL) {
+    rocksdb_free(err);
+    return -1;
+  }
+#endif
+  return 0;
+}
+
 void kadedb_lite_free(char *p) {
 #ifdef KADEDB_LITE_HAS_ROCKSDB
   // We allocate with malloc before returning to callers; free with free()
@@ -3,6 +3,8 @@
 
 #include "kadedb_lite/kadedb_lite.h"
 
+#include <stdint.h>
+
 #ifdef KADEDB_LITE_HAS_ROCKSDB
 #include <rocksdb/c.h>
 #endif
@@ -14,11 +16,18 @@ struct kadedb_lite_options_t {
   size_t cache_size_bytes;
   size_t write_buffer_size_bytes;
   int max_open_files;
+  double bloom_bits_per_key;
+  int partitioned_index_filters;
+  int cache_index_and_filter_blocks;
+  kadedb_lite_compaction_style_t compaction_style;
+  // Background flush and compaction threads; 0 keeps RocksDB's default
+  int background_jobs;
 };
 
 struct kadedb_lite_t {
 #ifdef KADEDB_LITE_HAS_ROCKSDB
   rocksdb_t *db;
+  char *path; // database directory, where bulk loads stage their files
   rocksdb_options_t *options;
   rocksdb_readoptions_t *ropts;
   rocksdb_writeoptions_t *wopts;
@@ -33,6 +42,120 @@ struct kadedb_lite_t {
   int sync_interval_seconds;
   char *sync_remote_url;
   char *sync_auth_token;
+
+  // Change log for incremental sync; writes are logged once sync_init
+  // turned it on
+  int sync_tracking;
+  uint64_t sync_last_seq;   // newest change logged
+  uint64_t sync_acked_seq;  // newest change the server has
+  uint64_t sync_pulled_seq; // newest server change applied
+  // Lock of the fields above, worker thread and statistics; created by
+  // sync_init
+  struct kadedb_lite_sync_worker_t *sync_worker;
+#ifndef KADEDB_LITE_HAS_ROCKSDB
+  // The stub keeps the log in memory: the keys changed after
+  // sync_acked_seq, entry i numbered sync_acked_seq + 1 + i
+  char **sync_log_keys;
+  size_t sync_log_len;
+  size_t sync_log_cap;
+#endif
+};
+
+struct kadedb_lite_pinned_t {
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  rocksdb_pinnableslice_t *slice;
+#else
+  int placeholder;
+#endif
+};
+
+struct kadedb_lite_batch_t {
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  rocksdb_writebatch_t *wb;
+#else
+  size_t count;
+  // Keys of the buffered operations, for the sync change log
+  char **keys;
+  size_t cap;
+#endif
 };
 
+struct kadedb_lite_loader_t {
+  kadedb_lite_t *db;
+  size_t max_file_bytes;
+  size_t count;
+  int finished;
+  // Previous key, to check the order
+  char *last_key;
+  size_t last_len;
+  size_t last_cap;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  rocksdb_envoptions_t *env;
+  // File being written; NULL until the next pair starts one
+  rocksdb_sstfilewriter_t *writer;
+  // Paths of the files written or being written
+  char **files;
+  size_t file_count;
+  size_t file_cap;
+#endif
+};
+
+struct kadedb_lite_iter_t {
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  rocksdb_iterator_t *it;
+  // Owns the bounds, which RocksDB reads for the iterator's whole life
+  rocksdb_readoptions_t *ropts;
+  char *lower;
+  char *upper;
+#else
+  int placeholder;
+#endif
+};
+
+// Write `batch` without logging it for sync
+int kadedb_lite_batch_write(kadedb_lite_t *db, kadedb_lite_batch_t *batch);
+
+// Write `batch` and its change log entries atomically (kadedb_lite_sync.c)
+int kadedb_lite_sync_commit(kadedb_lite_t *db, kadedb_lite_batch_t *batch);
+// Release the in-memory state of the change log
+void kadedb_lite_sync_release(kadedb_lite_t *db);
+
+// LZ4 block format, compatible with the core library's codec
+// (kadedb_lite_lz4.c). compress() writes at most lz4_bound(n) bytes and
+// returns how many, 0 when out of memory; decompress() fails unless the
+// input decodes to exactly `raw_size` bytes.
+size_t kadedb_lite_lz4_bound(size_t n);
+size_t kadedb_lite_lz4_compress(const char *src, size_t n, char *dst);
+int kadedb_lite_lz4_decompress(const char *src, size_t n, char *dst,
+                               size_t raw_size);
+
+// Cell types of typed tables, numbered as the core library's ValueType
+typedef enum kadedb_lite_type_t {
+  KADEDB_LITE_TYPE_NULL = 0,
+  KADEDB_LITE_TYPE_INTEGER = 1,
+  KADEDB_LITE_TYPE_FLOAT = 2,
+  KADEDB_LITE_TYPE_STRING = 3,
+  KADEDB_LITE_TYPE_BOOLEAN = 4
+} kadedb_lite_type_t;
+
+typedef struct kadedb_lite_cell_t {
+  // 0 for a missing cell (a nullptr cell of the core library's Row)
+  int present;
+  kadedb_lite_type_t type;
+  int64_t i;
+  double f;
+  int b;
+  // Not owned; a decoded string points into the encoded row
+  const char *s;
+  size_t len;
+} kadedb_lite_cell_t;
+
+// Rows in the core library's bin::writeRow format (kadedb_lite_row.c).
+// encode() allocates *out with malloc(); decode() fails unless the row has
+// exactly `count` cells.
+int kadedb_lite_row_encode(const kadedb_lite_cell_t *cells, size_t count,
+                           char **out, size_t *out_len);
+int kadedb_lite_row_decode(const char *data, size_t len,
+                           kadedb_lite_cell_t *cells, size_t count);
+
 #endif // KADEDB_LITE_INTERNAL_H
@@ -0,0 +1,173 @@
+#include "kadedb_lite_internal.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// LZ4 block format, as written by the core library's codec::compress
+// (Codec::Lz4), so either side decodes the other's payloads. Lite stays a
+// C library with no C++ runtime to link, so it carries this port of the
+// encoder rather than the core's; it makes the same choices (hash table
+// size, skip step, match extension), so both write the same bytes for the
+// same input, which kadedb_lite_lz4_test checks.
+//
+// Sequences of [token][literal length bytes][literals][u16 offset][match
+// length bytes]: the token holds 4 bits of literal length and 4 bits of
+// match length - 4, 15 meaning more bytes follow (255 each until a smaller
+// one). The last sequence is literals only. Matches start at least 12
+// bytes before the end and the last 5 bytes are always literals.
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MF_LIMIT 12
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_MIN_HASH_LOG 10
+#define LZ4_MAX_HASH_LOG 16
+#define LZ4_EMPTY UINT32_MAX
+
+static uint32_t lz4_read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static uint32_t lz4_hash4(uint32_t v, int hash_log) {
+  return (v * 2654435761u) >> (32 - hash_log);
+}
+
+// Table bits for `n` bytes: one slot per byte, within [2^10, 2^16]
+static int lz4_hash_log(size_t n) {
+  int log = LZ4_MIN_HASH_LOG;
+  while (log < LZ4_MAX_HASH_LOG && ((size_t)1 << log) < n)
+    log++;
+  return log;
+}
+
+static size_t lz4_put_length(uint8_t *op, size_t extra) {
+  size_t n = 0;
+  for (; extra >= 255; extra -= 255)
+    op[n++] = 0xFF;
+  op[n++] = (uint8_t)extra;
+  return n;
+}
+
+// One sequence at `op`; match_len 0 ends the block with literals only.
+// Returns the bytes written.
+static size_t lz4_emit(uint8_t *op, const uint8_t *lit, size_t lit_len,
+                       size_t offset, size_t match_len) {
+  size_t ml = match_len ? match_len - LZ4_MIN_MATCH : 0;
+  size_t n = 0;
+  op[n++] = (uint8_t)(((lit_len < 15 ? lit_len : 15) << 4) |
+                      (ml < 15 ? ml : 15));
+  if (lit_len >= 15)
+    n += lz4_put_length(op + n, lit_len - 15);
+  memcpy(op + n, lit, lit_len);
+  n += lit_len;
+  if (!match_len)
+    return n;
+  op[n++] = (uint8_t)(offset & 0xFF);
+  op[n++] = (uint8_t)(offset >> 8);
+  if (ml >= 15)
+    n += lz4_put_length(op + n, ml - 15);
+  return n;
+}
+
+size_t kadedb_lite_lz4_bound(size_t n) { return n + n / 255 + 16; }
+
+size_t kadedb_lite_lz4_compress(const char *src, size_t n, char *dst) {
+  const uint8_t *in = (const uint8_t *)src;
+  uint8_t *out = (uint8_t *)dst;
+  size_t written = 0;
+  size_t anchor = 0;
+
+  if (n > LZ4_MF_LIMIT) {
+    // The last position seen per hash of 4 bytes
+    const int hash_log = lz4_hash_log(n);
+    uint32_t *table = (uint32_t *)malloc(sizeof(uint32_t) << hash_log);
+    if (!table)
+      return 0;
+    memset(table, 0xFF, sizeof(uint32_t) << hash_log);
+    const size_t match_limit = n - LZ4_LAST_LITERALS;
+    const size_t mf_limit = n - LZ4_MF_LIMIT;
+    size_t ip = 0;
+    while (ip <= mf_limit) {
+      const uint32_t v = lz4_read32(in + ip);
+      uint32_t *slot = &table[lz4_hash4(v, hash_log)];
+      const uint32_t cand = *slot;
+      *slot = (uint32_t)ip;
+      if (cand == LZ4_EMPTY || ip - cand > LZ4_MAX_OFFSET ||
+          lz4_read32(in + cand) != v) {
+        // Skip ahead faster through data that does not match
+        ip += 1 + ((ip - anchor) >> 6);
+        continue;
+      }
+      size_t ref = cand;
+      size_t len = LZ4_MIN_MATCH;
+      while (ip + len < match_limit && in[ip + len] == in[ref + len])
+        len++;
+      while (ip > anchor && ref > 0 && in[ip - 1] == in[ref - 1]) {
+        ip--;
+        ref--;
+        len++;
+      }
+      written += lz4_emit(out + written, in + anchor, ip - anchor, ip - ref,
+                          len);
+      ip += len;
+      anchor = ip;
+      table[lz4_hash4(lz4_read32(in + ip - 2), hash_log)] = (uint32_t)(ip - 2);
+    }
+    free(table);
+  }
+  written += lz4_emit(out + written, in + anchor, n - anchor, 0, 0);
+  return written;
+}
+
+// Add length bytes after a token nibble of 15; 0 if the input ends first
+static int lz4_read_length(const uint8_t **ip, const uint8_t *iend,
+                           size_t *len) {
+  uint8_t b;
+  do {
+    if (*ip == iend)
+      return 0;
+    b = *(*ip)++;
+    *len += b;
+  } while (b == 255);
+  return 1;
+}
+
+int kadedb_lite_lz4_decompress(const char *src, size_t n, char *dst,
+                               size_t raw_size) {
+  const uint8_t *ip = (const uint8_t *)src;
+  const uint8_t *const iend = ip + n;
+  size_t op = 0;
+  for (;;) {
+    if (ip == iend)
+      return -1;
+    const uint8_t token = *ip++;
+    size_t lit = token >> 4;
+    if (lit == 15 && !lz4_read_length(&ip, iend, &lit))
+      return -1;
+    if (lit > (size_t)(iend - ip) || lit > raw_size - op)
+      return -1;
+    memcpy(dst + op, ip, lit);
+    ip += lit;
+    op += lit;
+    if (ip == iend)
+      break; // the last sequence has no match
+    if (iend - ip < 2)
+      return -1;
+    const size_t offset = ip[0] | ((size_t)ip[1] << 8);
+    ip += 2;
+    size_t len = token & 15;
+    if (len == 15 && !lz4_read_length(&ip, iend, &len))
+      return -1;
+    len += LZ4_MIN_MATCH;
+    if (offset == 0 || offset > op || len > raw_size - op)
+      return -1;
+    // Byte by byte: an overlapping match repeats a run
+    for (size_t i = 0; i < len; i++)
+      dst[op + i] = dst[op + i - offset];
+    op += len;
+  }
+  return op == raw_size ? 0 : -1;
+}
@@ -1,5 +1,11 @@
 #include "kadedb_lite/kadedb_lite_query.h"
+
+#include "kadedb_lite_internal.h"
+
 #include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -85,14 +91,39 @@ static char *read_string_literal(tokenizer_t *t) {
   return str;
 }
 
+// A number such as -12, 3.5 or 1e-3, unvalidated
+static char *read_number(tokenizer_t *t) {
+  size_t start = t->pos;
+  if (t->input[t->pos] == '-' || t->input[t->pos] == '+')
+    t->pos++;
+  while (t->pos < t->len) {
+    char c = t->input[t->pos];
+    int exp_sign = (c == '-' || c == '+') && t->pos > start &&
+                   (t->input[t->pos - 1] == 'e' || t->input[t->pos - 1] == 'E');
+    if (!is_identifier_char(c) && c != '.' && !exp_sign)
+      break;
+    t->pos++;
+  }
+  size_t len = t->pos - start;
+  char *num = (char *)malloc(len + 1);
+  if (!num)
+    return NULL;
+  memcpy(num, t->input + start, len);
+  num[len] = '\0';
+  return num;
+}
+
 static char *read_value(tokenizer_t *t) {
   skip_whitespace(t);
   if (t->pos >= t->len)
     return NULL;
 
-  if (t->input[t->pos] == '\'' || t->input[t->pos] == '"') {
+  char c = t->input[t->pos];
+  if (c == '\'' || c == '"') {
     return read_string_literal(t);
   }
+  if (c == '-' || c == '+' || c == '.' || isdigit((unsigned char)c))
+    return read_number(t);
 
   return read_identifier(t);
 }
@@ -262,17 +293,71 @@ static kadedb_lite_parsed_query_t *parse_select(tokenizer_t *t) {
     return NULL;
   }
 
-  char *where_kw = read_identifier(t);
-  if (where_kw && str_case_eq(where_kw, "WHERE")) {
-    free(where_kw);
+  char *kw = read_identifier(t);
+  if (kw && str_case_eq(kw, "WHERE")) {
+    free(kw);
     q->condition = parse_condition(t);
+    // Without this a malformed WHERE would read the whole table
+    if (!q->condition) {
+      kadedb_lite_parsed_query_free(q);
+      return NULL;
+    }
+    kw = read_identifier(t);
+  }
+
+  if (kw && str_case_eq(kw, "LIMIT")) {
+    free(kw);
+    char *count = read_identifier(t);
+    char *end = NULL;
+    unsigned long long n =
+        count && isdigit((unsigned char)count[0]) ? strtoull(count, &end, 10)
+                                                  : 0;
+    if (!end || *end != '\0') {
+      free(count);
+      kadedb_lite_parsed_query_free(q);
+      return NULL;
+    }
+    free(count);
+    q->has_limit = 1;
+    q->limit = (size_t)n;
   } else {
-    free(where_kw);
+    free(kw);
   }
 
   return q;
 }
 
+// Append the values of one `(v1, v2, ...)` tuple to q->values; 0 if the
+// tuple is malformed
+static int read_value_tuple(tokenizer_t *t, kadedb_lite_parsed_query_t *q,
+                            size_t *val_cap) {
+  if (!expect_char(t, '('))
+    return 0;
+
+  while (1) {
+    char *val = read_value(t);
+    if (!val)
+      break;
+
+    if (q->value_count >= *val_cap) {
+      size_t new_cap = *val_cap * 2;
+      char **new_vals = (char **)realloc(q->values, new_cap * sizeof(char *));
+      if (!new_vals) {
+        free(val);
+        return 0;
+      }
+      q->values = new_vals;
+      *val_cap = new_cap;
+    }
+    q->values[q->value_count++] = val;
+
+    if (!expect_char(t, ','))
+      break;
+  }
+
+  return expect_char(t, ')');
+}
+
 static kadedb_lite_parsed_query_t *parse_insert(tokenizer_t *t) {
   char *into_kw = read_identifier(t);
   if (!into_kw || !str_case_eq(into_kw, "INTO")) {
@@ -346,13 +431,6 @@ static kadedb_lite_parsed_query_t *parse_insert(tokenizer_t *t) {
   }
   free(values_kw);
 
-  if (!expect_char(t, '(')) {
-    free_string_array(q->columns, q->column_count);
-    free(q->table);
-    free(q);
-    return NULL;
-  }
-
   size_t val_cap = 8;
   q->values = (char **)malloc(val_cap * sizeof(char *));
   if (!q->values) {
@@ -363,34 +441,129 @@ static kadedb_lite_parsed_query_t *parse_insert(tokenizer_t *t) {
   }
   q->value_count = 0;
 
-  while (1) {
-    char *val = read_value(t);
-    if (!val)
-      break;
+  // One or more tuples, all as wide as the first
+  size_t width = 0;
+  do {
+    size_t before = q->value_count;
+    if (!read_value_tuple(t, q, &val_cap) ||
+        (q->row_count > 0 && q->value_count - before != width)) {
+      kadedb_lite_parsed_query_free(q);
+      return NULL;
+    }
+    width = q->value_count - before;
+    q->row_count++;
+  } while (expect_char(t, ','));
 
-    if (q->value_count >= val_cap) {
-      val_cap *= 2;
-      char **new_vals = (char **)realloc(q->values, val_cap * sizeof(char *));
-      if (!new_vals) {
-        free(val);
-        break;
+  return q;
+}
+
+// Read `IF NOT EXISTS` if it comes next; 0 if it is incomplete
+static int read_if_not_exists(tokenizer_t *t, kadedb_lite_parsed_query_t *q) {
+  size_t start = t->pos;
+  char *kw = read_identifier(t);
+  if (!kw || !str_case_eq(kw, "IF")) {
+    free(kw);
+    t->pos = start;
+    return 1;
+  }
+  free(kw);
+  char *not_kw = read_identifier(t);
+  char *exists_kw = read_identifier(t);
+  int ok = str_case_eq(not_kw, "NOT") && str_case_eq(exists_kw, "EXISTS");
+  free(not_kw);
+  free(exists_kw);
+  q->if_not_exists = ok;
+  return ok;
+}
+
+static kadedb_lite_parsed_query_t *parse_create_table(tokenizer_t *t) {
+  kadedb_lite_parsed_query_t *q = (kadedb_lite_parsed_query_t *)calloc(
+      1, sizeof(kadedb_lite_parsed_query_t));
+  if (!q)
+    return NULL;
+  q->type = KADEDB_LITE_QUERY_CREATE_TABLE;
+  if (!read_if_not_exists(t, q) || !(q->table = read_identifier(t)) ||
+      !expect_char(t, '(')) {
+    kadedb_lite_parsed_query_free(q);
+    return NULL;
+  }
+
+  // `name TYPE` pairs; columns and values grow together
+  size_t cap = 0;
+  do {
+    char *name = read_identifier(t);
+    char *type = name ? read_identifier(t) : NULL;
+    if (!type) {
+      free(name);
+      kadedb_lite_parsed_query_free(q);
+      return NULL;
+    }
+    if (q->column_count == cap) {
+      cap = cap ? cap * 2 : 8;
+      char **cols = (char **)realloc(q->columns, cap * sizeof(char *));
+      if (cols)
+        q->columns = cols;
+      char **types = cols ? (char **)realloc(q->values, cap * sizeof(char *))
+                          : NULL;
+      if (types)
+        q->values = types;
+      if (!cols || !types) {
+        free(name);
+        free(type);
+        kadedb_lite_parsed_query_free(q);
+        return NULL;
       }
-      q->values = new_vals;
     }
-    q->values[q->value_count++] = val;
+    q->columns[q->column_count++] = name;
+    q->values[q->value_count++] = type;
+  } while (expect_char(t, ','));
 
-    if (!expect_char(t, ','))
-      break;
+  if (!expect_char(t, ')')) {
+    kadedb_lite_parsed_query_free(q);
+    return NULL;
   }
+  return q;
+}
 
-  if (!expect_char(t, ')')) {
-    free_string_array(q->values, q->value_count);
-    free_string_array(q->columns, q->column_count);
-    free(q->table);
-    free(q);
+static kadedb_lite_parsed_query_t *parse_create_index(tokenizer_t *t) {
+  kadedb_lite_parsed_query_t *q = (kadedb_lite_parsed_query_t *)calloc(
+      1, sizeof(kadedb_lite_parsed_query_t));
+  if (!q)
+    return NULL;
+  q->type = KADEDB_LITE_QUERY_CREATE_INDEX;
+  q->columns = (char **)malloc(sizeof(char *));
+  if (!q->columns || !read_if_not_exists(t, q)) {
+    kadedb_lite_parsed_query_free(q);
     return NULL;
   }
 
+  // The index name is optional and not kept
+  char *kw = read_identifier(t);
+  if (kw && !str_case_eq(kw, "ON")) {
+    free(kw);
+    kw = read_identifier(t);
+  }
+  int ok = kw && str_case_eq(kw, "ON");
+  free(kw);
+  if (ok && (q->table = read_identifier(t)) != NULL && expect_char(t, '(')) {
+    q->columns[0] = read_identifier(t);
+    q->column_count = q->columns[0] ? 1 : 0;
+  }
+  if (q->column_count != 1 || !expect_char(t, ')')) {
+    kadedb_lite_parsed_query_free(q);
+    return NULL;
+  }
+  return q;
+}
+
+static kadedb_lite_parsed_query_t *parse_create(tokenizer_t *t) {
+  char *kw = read_identifier(t);
+  kadedb_lite_parsed_query_t *q = NULL;
+  if (str_case_eq(kw, "TABLE"))
+    q = parse_create_table(t);
+  else if (str_case_eq(kw, "INDEX"))
+    q = parse_create_index(t);
+  free(kw);
   return q;
 }
 
@@ -411,6 +584,8 @@ kadedb_lite_parsed_query_t *kadedb_lite_parse_query(const char *query) {
     result = parse_select(&t);
   } else if (str_case_eq(keyword, "INSERT")) {
     result = parse_insert(&t);
+  } else if (str_case_eq(keyword, "CREATE")) {
+    result = parse_create(&t);
   }
 
   free(keyword);
@@ -466,23 +641,85 @@ static char *build_key(const char *table, const char *id) {
   return key;
 }
 
-static kadedb_lite_result_t *
-execute_select(kadedb_lite_t *db, kadedb_lite_parsed_query_t *parsed) {
-  if (!parsed->condition) {
-    return create_error_result(
-        "SELECT without WHERE clause not supported in Lite");
-  }
+// Set the (id, value) columns every SELECT returns; 0 if out of memory
+static int set_kv_columns(kadedb_lite_result_t *result) {
+  result->column_names = (char **)calloc(2, sizeof(char *));
+  if (!result->column_names)
+    return 0;
+  result->column_count = 2;
+  result->column_names[0] = (char *)malloc(3);
+  result->column_names[1] = (char *)malloc(6);
+  if (!result->column_names[0] || !result->column_names[1])
+    return 0;
+  strcpy(result->column_names[0], "id");
+  strcpy(result->column_names[1], "value");
+  return 1;
+}
 
-  if (!str_case_eq(parsed->condition->column, "id") &&
-      !str_case_eq(parsed->condition->column, "key")) {
-    return create_error_result(
-        "SELECT condition must be on 'id' or 'key' column");
+static char *copy_bytes(const char *p, size_t len) {
+  char *out = (char *)malloc(len + 1);
+  if (!out)
+    return NULL;
+  memcpy(out, p, len);
+  out[len] = '\0';
+  return out;
+}
+
+// Append an (id, value) row, growing result->rows through *cap; 0 if out
+// of memory
+static int add_kv_row(kadedb_lite_result_t *result, size_t *cap,
+                      const char *id, size_t id_len, const char *value,
+                      size_t value_len) {
+  if (result->row_count >= *cap) {
+    size_t new_cap = *cap ? *cap * 2 : 16;
+    kadedb_lite_row_t *rows = (kadedb_lite_row_t *)realloc(
+        result->rows, new_cap * sizeof(kadedb_lite_row_t));
+    if (!rows)
+      return 0;
+    result->rows = rows;
+    *cap = new_cap;
   }
+  kadedb_lite_row_t *row = &result->rows[result->row_count];
+  row->values = (char **)calloc(2, sizeof(char *));
+  if (!row->values)
+    return 0;
+  row->value_count = 2;
+  result->row_count++;
+  row->values[0] = copy_bytes(id, id_len);
+  row->values[1] = copy_bytes(value, value_len);
+  return row->values[0] && row->values[1];
+}
 
-  if (parsed->condition->op != KADEDB_LITE_OP_EQ) {
-    return create_error_result("Only equality conditions supported");
+// strcmp-style comparison of a byte string with a C string
+static int compare_bytes(const char *a, size_t a_len, const char *b) {
+  size_t b_len = strlen(b);
+  int c = memcmp(a, b, a_len < b_len ? a_len : b_len);
+  if (c != 0)
+    return c;
+  return a_len < b_len ? -1 : (a_len > b_len ? 1 : 0);
+}
+
+static int condition_holds(kadedb_lite_condition_op_t op, int cmp) {
+  switch (op) {
+  case KADEDB_LITE_OP_EQ:
+    return cmp == 0;
+  case KADEDB_LITE_OP_NE:
+    return cmp != 0;
+  case KADEDB_LITE_OP_LT:
+    return cmp < 0;
+  case KADEDB_LITE_OP_LE:
+    return cmp <= 0;
+  case KADEDB_LITE_OP_GT:
+    return cmp > 0;
+  case KADEDB_LITE_OP_GE:
+    return cmp >= 0;
   }
+  return 0;
+}
 
+// Point lookup of `table:id`
+static kadedb_lite_result_t *select_by_key(kadedb_lite_t *db,
+                                           kadedb_lite_parsed_query_t *parsed) {
   char *key = build_key(parsed->table, parsed->condition->value);
   if (!key) {
     return create_error_result("Memory allocation failed");
@@ -500,69 +737,983 @@ execute_select(kadedb_lite_t *db, kadedb_lite_parsed_query_t *parsed) {
     return NULL;
   }
 
-  if (rc != 0 || !value) {
-    result->row_count = 0;
-    result->column_count = 2;
-    result->column_names = (char **)malloc(2 * sizeof(char *));
-    if (result->column_names) {
-      result->column_names[0] = (char *)malloc(3);
-      result->column_names[1] = (char *)malloc(6);
-      if (result->column_names[0])
-        strcpy(result->column_names[0], "id");
-      if (result->column_names[1])
-        strcpy(result->column_names[1], "value");
-    }
-    return result;
+  size_t cap = 0;
+  const char *id = parsed->condition->value;
+  if (!set_kv_columns(result) ||
+      (rc == 0 && value && (!parsed->has_limit || parsed->limit > 0) &&
+       !add_kv_row(result, &cap, id, strlen(id), value, value_len))) {
+    if (value)
+      kadedb_lite_free(value);
+    kadedb_lite_result_free(result);
+    return create_error_result("Memory allocation failed");
   }
 
-  result->column_count = 2;
-  result->column_names = (char **)malloc(2 * sizeof(char *));
-  if (!result->column_names) {
+  if (value)
     kadedb_lite_free(value);
-    kadedb_lite_result_free(result);
+  return result;
+}
+
+// Scan the table's keys in order, narrowed to the id range of the
+// condition, and keep the rows that match it up to the LIMIT
+static kadedb_lite_result_t *select_scan(kadedb_lite_t *db,
+                                         kadedb_lite_parsed_query_t *parsed,
+                                         int on_id) {
+  const kadedb_lite_condition_t *cond = parsed->condition;
+  char *prefix = build_key(parsed->table, "");
+  char *bound = cond && on_id ? build_key(parsed->table, cond->value) : NULL;
+  if (!prefix || (cond && on_id && !bound)) {
+    free(prefix);
+    free(bound);
     return create_error_result("Memory allocation failed");
   }
-  result->column_names[0] = (char *)malloc(3);
-  result->column_names[1] = (char *)malloc(6);
-  if (result->column_names[0])
-    strcpy(result->column_names[0], "id");
-  if (result->column_names[1])
-    strcpy(result->column_names[1], "value");
-
-  result->row_count = 1;
-  result->rows = (kadedb_lite_row_t *)malloc(sizeof(kadedb_lite_row_t));
-  if (!result->rows) {
-    kadedb_lite_free(value);
+  size_t prefix_len = strlen(prefix);
+
+  kadedb_lite_iter_t *it = NULL;
+  if (bound && cond->op != KADEDB_LITE_OP_NE) {
+    // "table:v\0" is the first key above "table:v"; the NUL is the string
+    // terminator, so it is part of the buffer already
+    size_t bound_len = strlen(bound);
+    char *upper = build_key(parsed->table, "");
+    if (upper)
+      upper[prefix_len - 1] = ':' + 1;
+    switch (cond->op) {
+    case KADEDB_LITE_OP_LT:
+      it = kadedb_lite_iter_create(db, prefix, prefix_len, bound, bound_len);
+      break;
+    case KADEDB_LITE_OP_LE:
+      it = kadedb_lite_iter_create(db, prefix, prefix_len, bound,
+                                   bound_len + 1);
+      break;
+    case KADEDB_LITE_OP_GT:
+      it = upper ? kadedb_lite_iter_create(db, bound, bound_len + 1, upper,
+                                           prefix_len)
+                 : NULL;
+      break;
+    default: // GE; EQ is a point lookup
+      it = upper ? kadedb_lite_iter_create(db, bound, bound_len, upper,
+                                           prefix_len)
+                 : NULL;
+      break;
+    }
+    free(upper);
+  } else {
+    it = kadedb_lite_iter_create_prefix(db, prefix);
+  }
+  free(bound);
+  if (!it) {
+    free(prefix);
+    return create_error_result("Failed to open iterator");
+  }
+
+  kadedb_lite_result_t *result = create_result();
+  if (!result || !set_kv_columns(result)) {
+    kadedb_lite_iter_destroy(it);
+    free(prefix);
     kadedb_lite_result_free(result);
     return create_error_result("Memory allocation failed");
   }
 
-  result->rows[0].value_count = 2;
-  result->rows[0].values = (char **)malloc(2 * sizeof(char *));
-  if (!result->rows[0].values) {
-    kadedb_lite_free(value);
+  size_t cap = 0;
+  for (; kadedb_lite_iter_valid(it); kadedb_lite_iter_next(it)) {
+    if (parsed->has_limit && result->row_count >= parsed->limit)
+      break;
+    size_t key_len = 0, value_len = 0;
+    const char *key = kadedb_lite_iter_key(it, &key_len);
+    const char *value = kadedb_lite_iter_value(it, &value_len);
+    const char *id = key + prefix_len;
+    size_t id_len = key_len - prefix_len;
+    if (cond) {
+      int cmp = on_id ? compare_bytes(id, id_len, cond->value)
+                      : compare_bytes(value, value_len, cond->value);
+      if (!condition_holds(cond->op, cmp))
+        continue;
+    }
+    if (!add_kv_row(result, &cap, id, id_len, value, value_len)) {
+      kadedb_lite_iter_destroy(it);
+      free(prefix);
+      kadedb_lite_result_free(result);
+      return create_error_result("Memory allocation failed");
+    }
+  }
+
+  int status = kadedb_lite_iter_status(it);
+  kadedb_lite_iter_destroy(it);
+  free(prefix);
+  if (status != 0) {
     kadedb_lite_result_free(result);
-    return create_error_result("Memory allocation failed");
+    return create_error_result("Failed to read table");
   }
+  return result;
+}
+
+// Typed tables
+
+// Schema of a table made with CREATE TABLE, stored under SCHEMA_PREFIX
+// as SCHEMA_MAGIC and a "\n<name> <TYPE> <indexed>" line per column
+#define SCHEMA_PREFIX "__kadedb_schema"
+#define SCHEMA_MAGIC "KDLT1"
+#define INDEX_PREFIX "idx"
+
+typedef struct table_schema_t {
+  size_t count;
+  char **names;
+  kadedb_lite_type_t *types;
+  int *indexed;
+  size_t id_col;
+} table_schema_t;
+
+static void schema_free(table_schema_t *schema) {
+  free_string_array(schema->names, schema->count);
+  free(schema->types);
+  free(schema->indexed);
+  memset(schema, 0, sizeof(*schema));
+}
+
+static int schema_alloc(table_schema_t *schema, size_t count) {
+  memset(schema, 0, sizeof(*schema));
+  schema->names = (char **)calloc(count ? count : 1, sizeof(char *));
+  schema->types = (kadedb_lite_type_t *)calloc(count ? count : 1,
+                                               sizeof(kadedb_lite_type_t));
+  schema->indexed = (int *)calloc(count ? count : 1, sizeof(int));
+  if (!schema->names || !schema->types || !schema->indexed) {
+    schema_free(schema);
+    return 0;
+  }
+  schema->count = count;
+  return 1;
+}
+
+static int parse_type_name(const char *name, kadedb_lite_type_t *type) {
+  if (str_case_eq(name, "INTEGER") || str_case_eq(name, "INT") ||
+      str_case_eq(name, "BIGINT"))
+    *type = KADEDB_LITE_TYPE_INTEGER;
+  else if (str_case_eq(name, "FLOAT") || str_case_eq(name, "REAL") ||
+           str_case_eq(name, "DOUBLE"))
+    *type = KADEDB_LITE_TYPE_FLOAT;
+  else if (str_case_eq(name, "TEXT") || str_case_eq(name, "STRING") ||
+           str_case_eq(name, "VARCHAR"))
+    *type = KADEDB_LITE_TYPE_STRING;
+  else if (str_case_eq(name, "BOOLEAN") || str_case_eq(name, "BOOL"))
+    *type = KADEDB_LITE_TYPE_BOOLEAN;
+  else
+    return 0;
+  return 1;
+}
 
-  size_t id_len = strlen(parsed->condition->value);
-  result->rows[0].values[0] = (char *)malloc(id_len + 1);
-  if (result->rows[0].values[0]) {
-    strcpy(result->rows[0].values[0], parsed->condition->value);
+static const char *type_label(kadedb_lite_type_t type) {
+  switch (type) {
+  case KADEDB_LITE_TYPE_INTEGER:
+    return "INTEGER";
+  case KADEDB_LITE_TYPE_FLOAT:
+    return "FLOAT";
+  case KADEDB_LITE_TYPE_STRING:
+    return "TEXT";
+  case KADEDB_LITE_TYPE_BOOLEAN:
+    return "BOOLEAN";
+  case KADEDB_LITE_TYPE_NULL:
+    break;
   }
+  return "NULL";
+}
+
+// Position of column `name` (or of the id column for "key"), or -1
+static int schema_column(const table_schema_t *schema, const char *name) {
+  for (size_t i = 0; i < schema->count; i++) {
+    if (str_case_eq(schema->names[i], name))
+      return (int)i;
+  }
+  if (str_case_eq(name, "key"))
+    return (int)schema->id_col;
+  return -1;
+}
 
-  result->rows[0].values[1] = (char *)malloc(value_len + 1);
-  if (result->rows[0].values[1]) {
-    memcpy(result->rows[0].values[1], value, value_len);
-    result->rows[0].values[1][value_len] = '\0';
+static char *schema_serialize(const table_schema_t *schema) {
+  size_t total = strlen(SCHEMA_MAGIC) + 1;
+  for (size_t i = 0; i < schema->count; i++)
+    total += 1 + strlen(schema->names[i]) + 1 + 7 + 2;
+  char *out = (char *)malloc(total);
+  if (!out)
+    return NULL;
+  size_t n = (size_t)sprintf(out, "%s", SCHEMA_MAGIC);
+  for (size_t i = 0; i < schema->count; i++)
+    n += (size_t)sprintf(out + n, "\n%s %s %d", schema->names[i],
+                         type_label(schema->types[i]),
+                         schema->indexed[i] ? 1 : 0);
+  return out;
+}
+
+static int schema_parse(const char *text, size_t len, table_schema_t *out) {
+  const size_t magic_len = strlen(SCHEMA_MAGIC);
+  size_t count = 0;
+  for (size_t i = 0; i < len; i++)
+    count += text[i] == '\n';
+  if (count == 0 || !schema_alloc(out, count))
+    return -1;
+  const char *p = text + magic_len;
+  const char *end = text + len;
+  int id_seen = 0;
+  for (size_t c = 0; c < count; c++) {
+    // p is at the '\n' before the column
+    const char *line = p + 1;
+    const char *eol = (const char *)memchr(line, '\n', (size_t)(end - line));
+    if (!eol)
+      eol = end;
+    const char *sp1 = (const char *)memchr(line, ' ', (size_t)(eol - line));
+    const char *sp2 =
+        sp1 ? (const char *)memchr(sp1 + 1, ' ', (size_t)(eol - sp1 - 1))
+            : NULL;
+    char type[16];
+    if (!sp2 || (size_t)(sp2 - sp1 - 1) >= sizeof(type) || eol - sp2 != 2) {
+      schema_free(out);
+      return -1;
+    }
+    out->names[c] = copy_bytes(line, (size_t)(sp1 - line));
+    memcpy(type, sp1 + 1, (size_t)(sp2 - sp1 - 1));
+    type[sp2 - sp1 - 1] = '\0';
+    if (!out->names[c] || !parse_type_name(type, &out->types[c])) {
+      schema_free(out);
+      return -1;
+    }
+    out->indexed[c] = sp2[1] == '1';
+    if (str_case_eq(out->names[c], "id")) {
+      out->id_col = c;
+      id_seen = 1;
+    }
+    p = eol;
+  }
+  if (!id_seen) {
+    schema_free(out);
+    return -1;
   }
+  return 0;
+}
 
+// 1 with *out filled for a table made with CREATE TABLE, 0 for an untyped
+// one, -1 for a schema that does not parse
+static int load_schema(kadedb_lite_t *db, const char *table,
+                       table_schema_t *out) {
+  char *key = build_key(SCHEMA_PREFIX, table);
+  if (!key)
+    return -1;
+  char *value = NULL;
+  size_t len = 0;
+  int rc = kadedb_lite_get(db, key, &value, &len);
+  free(key);
+  if (rc != 0 || !value)
+    return 0;
+  // Anything else (such as the stub's placeholder) is no schema
+  const size_t magic_len = strlen(SCHEMA_MAGIC);
+  int typed = len > magic_len && memcmp(value, SCHEMA_MAGIC, magic_len) == 0;
+  if (typed && schema_parse(value, len, out) != 0)
+    typed = -1;
   kadedb_lite_free(value);
+  return typed;
+}
+
+static int store_schema(kadedb_lite_batch_t *batch, const char *table,
+                        const table_schema_t *schema) {
+  char *key = build_key(SCHEMA_PREFIX, table);
+  char *text = schema_serialize(schema);
+  int rc = key && text ? kadedb_lite_batch_put(batch, key, text, strlen(text))
+                       : -1;
+  free(key);
+  free(text);
+  return rc;
+}
+
+// Convert a literal to a cell of `type`; 0 if it is not one. A string
+// cell points into `text`.
+static int parse_cell(const char *text, kadedb_lite_type_t type,
+                      kadedb_lite_cell_t *cell) {
+  memset(cell, 0, sizeof(*cell));
+  cell->present = 1;
+  cell->type = type;
+  char *end = NULL;
+  errno = 0;
+  switch (type) {
+  case KADEDB_LITE_TYPE_INTEGER:
+    cell->i = (int64_t)strtoll(text, &end, 10);
+    return end != text && *end == '\0' && errno == 0;
+  case KADEDB_LITE_TYPE_FLOAT:
+    cell->f = strtod(text, &end);
+    return end != text && *end == '\0' && errno == 0;
+  case KADEDB_LITE_TYPE_STRING:
+    cell->s = text;
+    cell->len = strlen(text);
+    return 1;
+  case KADEDB_LITE_TYPE_BOOLEAN:
+    if (str_case_eq(text, "true") || strcmp(text, "1") == 0)
+      cell->b = 1;
+    else if (!str_case_eq(text, "false") && strcmp(text, "0") != 0)
+      return 0;
+    return 1;
+  case KADEDB_LITE_TYPE_NULL:
+    break;
+  }
+  return 0;
+}
+
+// Text of a cell, NULL for a missing one (or when out of memory)
+static char *format_cell(const kadedb_lite_cell_t *cell) {
+  char buf[40];
+  if (!cell->present)
+    return NULL;
+  switch (cell->type) {
+  case KADEDB_LITE_TYPE_INTEGER:
+    snprintf(buf, sizeof(buf), "%" PRId64, cell->i);
+    break;
+  case KADEDB_LITE_TYPE_FLOAT:
+    // The shortest precision that reads back the same double
+    for (int prec = 15; prec <= 17; prec++) {
+      snprintf(buf, sizeof(buf), "%.*g", prec, cell->f);
+      if (strtod(buf, NULL) == cell->f)
+        break;
+    }
+    break;
+  case KADEDB_LITE_TYPE_STRING:
+    return copy_bytes(cell->s, cell->len);
+  case KADEDB_LITE_TYPE_BOOLEAN:
+    strcpy(buf, cell->b ? "true" : "false");
+    break;
+  case KADEDB_LITE_TYPE_NULL:
+    return NULL;
+  }
+  return copy_bytes(buf, strlen(buf));
+}
+
+// strcmp-style comparison of two present cells of the same type
+static int compare_cells(const kadedb_lite_cell_t *a,
+                         const kadedb_lite_cell_t *b) {
+  switch (a->type) {
+  case KADEDB_LITE_TYPE_INTEGER:
+    return a->i < b->i ? -1 : (a->i > b->i ? 1 : 0);
+  case KADEDB_LITE_TYPE_FLOAT:
+    return a->f < b->f ? -1 : (a->f > b->f ? 1 : 0);
+  case KADEDB_LITE_TYPE_STRING: {
+    int c = memcmp(a->s, b->s, a->len < b->len ? a->len : b->len);
+    if (c != 0)
+      return c;
+    return a->len < b->len ? -1 : (a->len > b->len ? 1 : 0);
+  }
+  case KADEDB_LITE_TYPE_BOOLEAN:
+    return a->b - b->b;
+  case KADEDB_LITE_TYPE_NULL:
+    break;
+  }
+  return 0;
+}
+
+// Order-preserving text of a cell for index keys: the bytes of its
+// sortable form as the letters 'a' to 'p', one per nibble. They all sort
+// after the ':' that ends the value, so a value sorts before its
+// extensions.
+static char *index_value(const kadedb_lite_cell_t *cell) {
+  unsigned char word[8];
+  const unsigned char *bytes = word;
+  size_t n = 8;
+  uint64_t u = 0;
+  switch (cell->type) {
+  case KADEDB_LITE_TYPE_INTEGER:
+    u = (uint64_t)cell->i ^ ((uint64_t)1 << 63);
+    break;
+  case KADEDB_LITE_TYPE_FLOAT: {
+    // -0.0 indexes as 0.0; negative numbers sort by inverted bits
+    double f = cell->f == 0 ? 0.0 : cell->f;
+    memcpy(&u, &f, 8);
+    u = (u >> 63) ? ~u : u | ((uint64_t)1 << 63);
+    break;
+  }
+  case KADEDB_LITE_TYPE_BOOLEAN:
+    word[0] = (unsigned char)(cell->b ? 1 : 0);
+    n = 1;
+    break;
+  case KADEDB_LITE_TYPE_STRING:
+    bytes = (const unsigned char *)cell->s;
+    n = cell->len;
+    break;
+  case KADEDB_LITE_TYPE_NULL:
+    return NULL;
+  }
+  if (cell->type == KADEDB_LITE_TYPE_INTEGER ||
+      cell->type == KADEDB_LITE_TYPE_FLOAT) {
+    for (int i = 0; i < 8; i++)
+      word[i] = (unsigned char)(u >> (56 - 8 * i));
+  }
+  char *out = (char *)malloc(2 * n + 1);
+  if (!out)
+    return NULL;
+  for (size_t i = 0; i < n; i++) {
+    out[2 * i] = (char)('a' + (bytes[i] >> 4));
+    out[2 * i + 1] = (char)('a' + (bytes[i] & 15));
+  }
+  out[2 * n] = '\0';
+  return out;
+}
+
+// The parts joined into one string
+static char *concat(const char *const *parts, size_t count) {
+  size_t total = 1;
+  for (size_t i = 0; i < count; i++)
+    total += strlen(parts[i]);
+  char *out = (char *)malloc(total);
+  if (!out)
+    return NULL;
+  size_t n = 0;
+  for (size_t i = 0; i < count; i++) {
+    size_t len = strlen(parts[i]);
+    memcpy(out + n, parts[i], len);
+    n += len;
+  }
+  out[n] = '\0';
+  return out;
+}
+
+// "idx:table:col:"
+static char *index_prefix(const char *table, const char *column) {
+  const char *parts[] = {INDEX_PREFIX ":", table, ":", column, ":"};
+  return concat(parts, 5);
+}
+
+// Add (or with `remove`, delete) the index entries "idx:table:col:value:
+// id" -> id of a row, for every indexed column or only column `only`
+static int batch_index_entries(kadedb_lite_batch_t *batch, const char *table,
+                               const table_schema_t *schema,
+                               const kadedb_lite_cell_t *cells,
+                               const char *id, int only, int remove) {
+  for (size_t c = 0; c < schema->count; c++) {
+    if (!schema->indexed[c] || !cells[c].present ||
+        (only >= 0 && (size_t)only != c))
+      continue;
+    char *value = index_value(&cells[c]);
+    char *prefix = value ? index_prefix(table, schema->names[c]) : NULL;
+    const char *parts[] = {prefix, value, ":", id};
+    char *key = prefix ? concat(parts, 4) : NULL;
+    int rc = !key ? -1
+             : remove ? kadedb_lite_batch_delete(batch, key)
+                      : kadedb_lite_batch_put(batch, key, id, strlen(id));
+    free(value);
+    free(prefix);
+    free(key);
+    if (rc != 0)
+      return -1;
+  }
+  return 0;
+}
+
+static kadedb_lite_result_t *ok_result(int affected_rows) {
+  kadedb_lite_result_t *result = create_result();
+  if (result)
+    result->affected_rows = affected_rows;
   return result;
 }
 
+static kadedb_lite_result_t *
+execute_create_table(kadedb_lite_t *db, kadedb_lite_parsed_query_t *parsed) {
+  // "idx:" holds the indexes and "__kadedb" keys are internal
+  if (str_case_eq(parsed->table, INDEX_PREFIX) ||
+      strncmp(parsed->table, "__kadedb", 8) == 0)
+    return create_error_result("Reserved table name");
+
+  table_schema_t schema;
+  if (!schema_alloc(&schema, parsed->column_count))
+    return create_error_result("Memory allocation failed");
+  int ids = 0;
+  for (size_t i = 0; i < parsed->column_count; i++) {
+    for (size_t j = 0; j < i; j++) {
+      if (str_case_eq(parsed->columns[i], parsed->columns[j])) {
+        schema_free(&schema);
+        return create_error_result("Duplicate column name");
+      }
+    }
+    schema.names[i] = copy_bytes(parsed->columns[i],
+                                 strlen(parsed->columns[i]));
+    if (!schema.names[i] ||
+        !parse_type_name(parsed->values[i], &schema.types[i])) {
+      schema_free(&schema);
+      return create_error_result(
+          "Column types are INTEGER, FLOAT, TEXT or BOOLEAN");
+    }
+    if (str_case_eq(parsed->columns[i], "id")) {
+      schema.id_col = i;
+      ids++;
+    }
+  }
+  if (ids != 1) {
+    schema_free(&schema);
+    return create_error_result("CREATE TABLE requires an 'id' column");
+  }
+
+  table_schema_t existing;
+  int typed = load_schema(db, parsed->table, &existing);
+  if (typed != 0) {
+    schema_free(&schema);
+    if (typed < 0)
+      return create_error_result("Corrupt table schema");
+    schema_free(&existing);
+    return parsed->if_not_exists ? ok_result(0)
+                                 : create_error_result("Table already exists");
+  }
+
+  kadedb_lite_batch_t *batch = kadedb_lite_batch_create();
+  int rc = batch ? store_schema(batch, parsed->table, &schema) : -1;
+  if (rc == 0)
+    rc = kadedb_lite_batch_commit(db, batch);
+  kadedb_lite_batch_destroy(batch);
+  schema_free(&schema);
+  return rc == 0 ? ok_result(0) : create_error_result("Failed to create table");
+}
+
+// Decode the row stored under `key`; 1 when found, 0 when missing, -1 if
+// it does not decode. *raw keeps the bytes the cells point into.
+static int read_typed_row(kadedb_lite_t *db, const char *key,
+                          const table_schema_t *schema,
+                          kadedb_lite_cell_t *cells, char **raw) {
+  size_t len = 0;
+  *raw = NULL;
+  if (kadedb_lite_get(db, key, raw, &len) != 0 || !*raw)
+    return 0;
+  if (kadedb_lite_row_decode(*raw, len, cells, schema->count) != 0) {
+    kadedb_lite_free(*raw);
+    *raw = NULL;
+    return -1;
+  }
+  return 1;
+}
+
+static kadedb_lite_result_t *
+execute_create_index(kadedb_lite_t *db, kadedb_lite_parsed_query_t *parsed) {
+  table_schema_t schema;
+  int typed = load_schema(db, parsed->table, &schema);
+  if (typed <= 0)
+    return create_error_result(typed < 0 ? "Corrupt table schema"
+                                         : "CREATE INDEX requires a table "
+                                           "made with CREATE TABLE");
+  int col = schema_column(&schema, parsed->columns[0]);
+  const char *error = NULL;
+  if (col < 0)
+    error = "Unknown column";
+  else if ((size_t)col == schema.id_col)
+    error = "The id column is the table key";
+  if (error || schema.indexed[col]) {
+    schema_free(&schema);
+    if (error)
+      return create_error_result(error);
+    return parsed->if_not_exists ? ok_result(0)
+                                 : create_error_result("Index already exists");
+  }
+  schema.indexed[col] = 1;
+
+  // The schema and the entries of the rows already stored, in one write
+  kadedb_lite_batch_t *batch = kadedb_lite_batch_create();
+  char *prefix = build_key(parsed->table, "");
+  kadedb_lite_iter_t *it =
+      prefix ? kadedb_lite_iter_create_prefix(db, prefix) : NULL;
+  kadedb_lite_cell_t *cells = (kadedb_lite_cell_t *)calloc(
+      schema.count, sizeof(kadedb_lite_cell_t));
+  int rc = batch && it && cells ? store_schema(batch, parsed->table, &schema)
+                                : -1;
+  int rows = 0;
+  for (; rc == 0 && kadedb_lite_iter_valid(it); kadedb_lite_iter_next(it)) {
+    size_t len = 0;
+    const char *value = kadedb_lite_iter_value(it, &len);
+    if (kadedb_lite_row_decode(value, len, cells, schema.count) != 0)
+      continue;
+    char *id = format_cell(&cells[schema.id_col]);
+    rc = id ? batch_index_entries(batch, parsed->table, &schema, cells, id,
+                                  col, 0)
+            : -1;
+    free(id);
+    rows++;
+  }
+  if (rc == 0 && kadedb_lite_iter_status(it) != 0)
+    rc = -1;
+  if (it)
+    kadedb_lite_iter_destroy(it);
+  if (rc == 0)
+    rc = kadedb_lite_batch_commit(db, batch);
+  kadedb_lite_batch_destroy(batch);
+  free(cells);
+  free(prefix);
+  schema_free(&schema);
+  return rc == 0 ? ok_result(rows)
+                 : create_error_result("Failed to create index");
+}
+
+static kadedb_lite_result_t *insert_typed(kadedb_lite_t *db,
+                                          kadedb_lite_parsed_query_t *parsed,
+                                          const table_schema_t *schema) {
+  const size_t width = parsed->value_count / parsed->row_count;
+  if (parsed->column_count != width)
+    return create_error_result("Column/value count mismatch");
+
+  // The INSERT column of each schema column, or -1 to leave it missing
+  int *from = (int *)malloc(schema->count * sizeof(int));
+  kadedb_lite_cell_t *cells = (kadedb_lite_cell_t *)calloc(
+      schema->count, sizeof(kadedb_lite_cell_t));
+  kadedb_lite_cell_t *old = (kadedb_lite_cell_t *)calloc(
+      schema->count, sizeof(kadedb_lite_cell_t));
+  char **keys = (char **)calloc(parsed->row_count, sizeof(char *));
+  kadedb_lite_batch_t *batch = kadedb_lite_batch_create();
+  char message[160];
+  const char *error = NULL;
+  if (!from || !cells || !old || !keys || !batch) {
+    error = "Memory allocation failed";
+    goto done;
+  }
+  for (size_t c = 0; c < schema->count; c++)
+    from[c] = -1;
+  for (size_t i = 0; i < parsed->column_count && !error; i++) {
+    int c = schema_column(schema, parsed->columns[i]);
+    if (c < 0) {
+      snprintf(message, sizeof(message), "Unknown column '%s'",
+               parsed->columns[i]);
+      error = message;
+    } else if (from[c] >= 0) {
+      error = "Duplicate column in INSERT";
+    } else {
+      from[c] = (int)i;
+    }
+  }
+  if (!error && from[schema->id_col] < 0)
+    error = "INSERT must include the 'id' column";
+
+  // Every row, the entries of the rows it replaces and its own entries go
+  // into one batch, so rows and indexes change together
+  for (size_t r = 0; r < parsed->row_count && !error; r++) {
+    char **row = parsed->values + r * width;
+    for (size_t c = 0; c < schema->count && !error; c++) {
+      memset(&cells[c], 0, sizeof(cells[c]));
+      if (from[c] >= 0 &&
+          !parse_cell(row[from[c]], schema->types[c], &cells[c])) {
+        snprintf(message, sizeof(message), "Invalid %s value for column '%s'",
+                 type_label(schema->types[c]), schema->names[c]);
+        error = message;
+      }
+    }
+    if (error)
+      break;
+    char *id = format_cell(&cells[schema->id_col]);
+    keys[r] = id ? build_key(parsed->table, id) : NULL;
+    if (!keys[r]) {
+      free(id);
+      error = "Memory allocation failed";
+      break;
+    }
+    for (size_t p = 0; p < r; p++) {
+      if (strcmp(keys[p], keys[r]) == 0)
+        error = "Duplicate id in INSERT";
+    }
+    char *raw = NULL;
+    int found = error ? 0 : read_typed_row(db, keys[r], schema, old, &raw);
+    char *encoded = NULL;
+    size_t encoded_len = 0;
+    if (!error &&
+        ((found > 0 && batch_index_entries(batch, parsed->table, schema, old,
+                                           id, -1, 1) != 0) ||
+         kadedb_lite_row_encode(cells, schema->count, &encoded,
+                                &encoded_len) != 0 ||
+         kadedb_lite_batch_put(batch, keys[r], encoded, encoded_len) != 0 ||
+         batch_index_entries(batch, parsed->table, schema, cells, id, -1,
+                             0) != 0))
+      error = "Failed to insert data";
+    free(encoded);
+    if (raw)
+      kadedb_lite_free(raw);
+    free(id);
+  }
+  if (!error && kadedb_lite_batch_commit(db, batch) != 0)
+    error = "Failed to insert data";
+
+done:
+  kadedb_lite_batch_destroy(batch);
+  if (keys)
+    free_string_array(keys, parsed->row_count);
+  free(old);
+  free(cells);
+  free(from);
+  return error ? create_error_result(error) : ok_result((int)parsed->row_count);
+}
+
+// State of a typed SELECT: the output columns and its condition
+typedef struct typed_select_t {
+  kadedb_lite_parsed_query_t *parsed;
+  const table_schema_t *schema;
+  size_t *projection;
+  size_t width;
+  int cond_col;
+  kadedb_lite_cell_t literal;
+  kadedb_lite_cell_t *cells;
+  kadedb_lite_result_t *result;
+  size_t cap;
+} typed_select_t;
+
+// Add the decoded row in sel->cells when it matches; 0 if out of memory
+static int emit_typed_row(typed_select_t *sel) {
+  const kadedb_lite_condition_t *cond = sel->parsed->condition;
+  if (cond) {
+    const kadedb_lite_cell_t *cell = &sel->cells[sel->cond_col];
+    // A missing cell matches no condition
+    if (!cell->present || cell->type != sel->literal.type ||
+        !condition_holds(cond->op, compare_cells(cell, &sel->literal)))
+      return 1;
+  }
+  kadedb_lite_result_t *result = sel->result;
+  if (result->row_count >= sel->cap) {
+    size_t cap = sel->cap ? sel->cap * 2 : 16;
+    kadedb_lite_row_t *rows = (kadedb_lite_row_t *)realloc(
+        result->rows, cap * sizeof(kadedb_lite_row_t));
+    if (!rows)
+      return 0;
+    result->rows = rows;
+    sel->cap = cap;
+  }
+  kadedb_lite_row_t *row = &result->rows[result->row_count];
+  row->values = (char **)calloc(sel->width ? sel->width : 1, sizeof(char *));
+  if (!row->values)
+    return 0;
+  row->value_count = sel->width;
+  result->row_count++;
+  for (size_t i = 0; i < sel->width; i++) {
+    const kadedb_lite_cell_t *cell = &sel->cells[sel->projection[i]];
+    row->values[i] = format_cell(cell);
+    if (cell->present && !row->values[i])
+      return 0;
+  }
+  return 1;
+}
+
+static int typed_select_full(const typed_select_t *sel) {
+  return sel->parsed->has_limit && sel->result->row_count >= sel->parsed->limit;
+}
+
+// Fetch and emit the row with id `id`; -1 on error
+static int emit_typed_id(kadedb_lite_t *db, typed_select_t *sel,
+                         const char *id, size_t id_len) {
+  char *id_copy = copy_bytes(id, id_len);
+  char *key = id_copy ? build_key(sel->parsed->table, id_copy) : NULL;
+  free(id_copy);
+  if (!key)
+    return -1;
+  char *raw = NULL;
+  int found = read_typed_row(db, key, sel->schema, sel->cells, &raw);
+  free(key);
+  int rc = found < 0 ? -1 : 0;
+  if (found > 0 && !emit_typed_row(sel))
+    rc = -1;
+  if (raw)
+    kadedb_lite_free(raw);
+  return rc;
+}
+
+// The index entries matching the condition on indexed column sel->cond_col
+static kadedb_lite_iter_t *open_index_range(kadedb_lite_t *db,
+                                            const typed_select_t *sel) {
+  const table_schema_t *schema = sel->schema;
+  char *prefix =
+      index_prefix(sel->parsed->table, schema->names[sel->cond_col]);
+  char *value = prefix ? index_value(&sel->literal) : NULL;
+  if (!value) {
+    free(prefix);
+    return NULL;
+  }
+  // "P" + value + ";" is above every entry of the value itself, and
+  // "P" with its last ':' raised to ';' above every entry of the column
+  const char *at_parts[] = {prefix, value};
+  const char *eq_parts[] = {prefix, value, ":"};
+  const char *past_parts[] = {prefix, value, ";"};
+  char *at = concat(at_parts, 2);
+  char *eq = concat(eq_parts, 3);
+  char *past = concat(past_parts, 3);
+  char *end = copy_bytes(prefix, strlen(prefix));
+  kadedb_lite_iter_t *it = NULL;
+  if (at && eq && past && end) {
+    size_t plen = strlen(prefix);
+    end[plen - 1] = ';';
+    switch (sel->parsed->condition->op) {
+    case KADEDB_LITE_OP_EQ:
+      it = kadedb_lite_iter_create_prefix(db, eq);
+      break;
+    case KADEDB_LITE_OP_LT:
+      it = kadedb_lite_iter_create(db, prefix, plen, at, strlen(at));
+      break;
+    case KADEDB_LITE_OP_LE:
+      it = kadedb_lite_iter_create(db, prefix, plen, past, strlen(past));
+      break;
+    case KADEDB_LITE_OP_GT:
+      it = kadedb_lite_iter_create(db, past, strlen(past), end, plen);
+      break;
+    case KADEDB_LITE_OP_GE:
+      it = kadedb_lite_iter_create(db, at, strlen(at), end, plen);
+      break;
+    case KADEDB_LITE_OP_NE:
+      break;
+    }
+  }
+  free(prefix);
+  free(value);
+  free(at);
+  free(eq);
+  free(past);
+  free(end);
+  return it;
+}
+
+static kadedb_lite_result_t *select_typed(kadedb_lite_t *db,
+                                          kadedb_lite_parsed_query_t *parsed,
+                                          const table_schema_t *schema) {
+  typed_select_t sel;
+  memset(&sel, 0, sizeof(sel));
+  sel.parsed = parsed;
+  sel.schema = schema;
+  sel.cond_col = -1;
+  int all = parsed->column_count == 1 && strcmp(parsed->columns[0], "*") == 0;
+  sel.width = all ? schema->count : parsed->column_count;
+  sel.projection = (size_t *)calloc(sel.width ? sel.width : 1, sizeof(size_t));
+  sel.cells = (kadedb_lite_cell_t *)calloc(schema->count,
+                                           sizeof(kadedb_lite_cell_t));
+  sel.result = create_result();
+  char message[160];
+  const char *error = NULL;
+  if (!sel.projection || !sel.cells || !sel.result) {
+    error = "Memory allocation failed";
+    goto done;
+  }
+  sel.result->column_names =
+      (char **)calloc(sel.width ? sel.width : 1, sizeof(char *));
+  if (!sel.result->column_names) {
+    error = "Memory allocation failed";
+    goto done;
+  }
+  sel.result->column_count = sel.width;
+  for (size_t i = 0; i < sel.width && !error; i++) {
+    int c = all ? (int)i : schema_column(schema, parsed->columns[i]);
+    if (c < 0) {
+      snprintf(message, sizeof(message), "Unknown column '%s'",
+               parsed->columns[i]);
+      error = message;
+      break;
+    }
+    sel.projection[i] = (size_t)c;
+    const char *name = schema->names[c];
+    sel.result->column_names[i] = copy_bytes(name, strlen(name));
+    if (!sel.result->column_names[i])
+      error = "Memory allocation failed";
+  }
+
+  const kadedb_lite_condition_t *cond = parsed->condition;
+  if (!error && cond) {
+    sel.cond_col = schema_column(schema, cond->column);
+    if (sel.cond_col < 0) {
+      snprintf(message, sizeof(message), "Unknown column '%s'",
+               cond->column);
+      error = message;
+    } else if (!parse_cell(cond->value, schema->types[sel.cond_col],
+                           &sel.literal)) {
+      snprintf(message, sizeof(message), "Invalid %s value for column '%s'",
+               type_label(schema->types[sel.cond_col]),
+               schema->names[sel.cond_col]);
+      error = message;
+    }
+  }
+  if (error || (parsed->has_limit && parsed->limit == 0))
+    goto done;
+
+  if (cond && (size_t)sel.cond_col == schema->id_col &&
+      cond->op == KADEDB_LITE_OP_EQ) {
+    // Point lookup of the canonical id
+    char *id = format_cell(&sel.literal);
+    if (!id || emit_typed_id(db, &sel, id, strlen(id)) != 0)
+      error = "Failed to read table";
+    free(id);
+    goto done;
+  }
+
+  kadedb_lite_iter_t *it = NULL;
+  int by_index = cond && schema->indexed[sel.cond_col] &&
+                 cond->op != KADEDB_LITE_OP_NE;
+  char *prefix = NULL;
+  if (by_index) {
+    it = open_index_range(db, &sel);
+  } else {
+    prefix = build_key(parsed->table, "");
+    it = prefix ? kadedb_lite_iter_create_prefix(db, prefix) : NULL;
+  }
+  free(prefix);
+  if (!it) {
+    error = "Failed to open iterator";
+    goto done;
+  }
+  for (; !error && !typed_select_full(&sel) && kadedb_lite_iter_valid(it);
+       kadedb_lite_iter_next(it)) {
+    size_t len = 0;
+    const char *value = kadedb_lite_iter_value(it, &len);
+    if (by_index) {
+      // The entry names the row; its condition is checked again on the
+      // row, which a raw put may have changed
+      if (emit_typed_id(db, &sel, value, len) != 0)
+        error = "Failed to read table";
+    } else if (kadedb_lite_row_decode(value, len, sel.cells, schema->count) ==
+               0) {
+      if (!emit_typed_row(&sel))
+        error = "Memory allocation failed";
+    }
+  }
+  if (!error && kadedb_lite_iter_status(it) != 0)
+    error = "Failed to read table";
+  kadedb_lite_iter_destroy(it);
+
+done:
+  free(sel.projection);
+  free(sel.cells);
+  if (error) {
+    kadedb_lite_result_free(sel.result);
+    return create_error_result(error);
+  }
+  return sel.result ? sel.result
+                    : create_error_result("Memory allocation failed");
+}
+
+static kadedb_lite_result_t *
+execute_select(kadedb_lite_t *db, kadedb_lite_parsed_query_t *parsed) {
+  table_schema_t schema;
+  int typed = load_schema(db, parsed->table, &schema);
+  if (typed < 0)
+    return create_error_result("Corrupt table schema");
+  if (typed) {
+    kadedb_lite_result_t *result = select_typed(db, parsed, &schema);
+    schema_free(&schema);
+    return result;
+  }
+
+  const kadedb_lite_condition_t *cond = parsed->condition;
+  if (!cond)
+    return select_scan(db, parsed, 0);
+
+  if (str_case_eq(cond->column, "id") || str_case_eq(cond->column, "key")) {
+    if (cond->op == KADEDB_LITE_OP_EQ)
+      return select_by_key(db, parsed);
+    return select_scan(db, parsed, 1);
+  }
+
+  if (str_case_eq(cond->column, "value") || str_case_eq(cond->column, "data"))
+    return select_scan(db, parsed, 0);
+
+  return create_error_result(
+      "SELECT condition must be on 'id', 'key', 'value' or 'data' column");
+}
+
 static kadedb_lite_result_t *
 execute_insert(kadedb_lite_t *db, kadedb_lite_parsed_query_t *parsed) {
+  table_schema_t schema;
+  int typed = load_schema(db, parsed->table, &schema);
+  if (typed < 0)
+    return create_error_result("Corrupt table schema");
+  if (typed) {
+    kadedb_lite_result_t *result = insert_typed(db, parsed, &schema);
+    schema_free(&schema);
+    return result;
+  }
+
   if (parsed->column_count < 2 || parsed->value_count < 2) {
     return create_error_result(
         "INSERT requires at least 'id' and 'value' columns");
@@ -585,21 +1736,36 @@ execute_insert(kadedb_lite_t *db, kadedb_lite_parsed_query_t *parsed) {
     return create_error_result("INSERT must include 'id' and 'value' columns");
   }
 
-  if ((size_t)id_idx >= parsed->value_count ||
-      (size_t)value_idx >= parsed->value_count) {
+  size_t width = parsed->value_count / parsed->row_count;
+  if ((size_t)id_idx >= width || (size_t)value_idx >= width) {
     return create_error_result("Column/value count mismatch");
   }
 
-  char *key = build_key(parsed->table, parsed->values[id_idx]);
-  if (!key) {
+  // Every row goes into one write batch, so the rows land together or not
+  // at all
+  kadedb_lite_batch_t *batch = kadedb_lite_batch_create();
+  if (!batch) {
     return create_error_result("Memory allocation failed");
   }
 
-  const char *val = parsed->values[value_idx];
-  size_t val_len = strlen(val);
+  for (size_t r = 0; r < parsed->row_count; r++) {
+    char **row = parsed->values + r * width;
+    char *key = build_key(parsed->table, row[id_idx]);
+    if (!key) {
+      kadedb_lite_batch_destroy(batch);
+      return create_error_result("Memory allocation failed");
+    }
+    const char *val = row[value_idx];
+    int rc = kadedb_lite_batch_put(batch, key, val, strlen(val));
+    free(key);
+    if (rc != 0) {
+      kadedb_lite_batch_destroy(batch);
+      return create_error_result("Failed to insert data");
+    }
+  }
 
-  int rc = kadedb_lite_put(db, key, val, val_len);
-  free(key);
+  int rc = kadedb_lite_batch_commit(db, batch);
+  kadedb_lite_batch_destroy(batch);
 
   if (rc != 0) {
     return create_error_result("Failed to insert data");
@@ -609,7 +1775,7 @@ execute_insert(kadedb_lite_t *db, kadedb_lite_parsed_query_t *parsed) {
   if (!result)
     return NULL;
 
-  result->affected_rows = 1;
+  result->affected_rows = (int)parsed->row_count;
   return result;
 }
 
@@ -633,6 +1799,12 @@ kadedb_lite_result_t *kadedb_lite_execute_query(kadedb_lite_t *db,
   case KADEDB_LITE_QUERY_INSERT:
     result = execute_insert(db, parsed);
     break;
+  case KADEDB_LITE_QUERY_CREATE_TABLE:
+    result = execute_create_table(db, parsed);
+    break;
+  case KADEDB_LITE_QUERY_CREATE_INDEX:
+    result = execute_create_index(db, parsed);
+    break;
   default:
     result = create_error_result("Unsupported query type");
     break;
@@ -0,0 +1,220 @@
+#include "kadedb_lite_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Rows in the core library's binary row format (bin::writeRow, version 2),
+// so typed Lite rows decode on the server as they are:
+//
+//   [u32 magic 'KDBV'][u8 version 2][varint cell count][varint run count]
+//   runs of [u8 kind][varint length], then the payloads of the integer
+//   (zigzag varint), float (8 bytes) and string (varint length, bytes)
+//   cells in order, then one bit per boolean cell.
+//
+// A kind is the ValueType, 0xFF for a missing cell. The magic and floats
+// are in host byte order, as the core library writes them.
+
+#define ROW_MAGIC 0x4B444256u
+#define ROW_VERSION 2
+#define ROW_ABSENT 0xFF
+
+typedef struct row_buf_t {
+  char *data;
+  size_t len;
+  size_t cap;
+  int failed;
+} row_buf_t;
+
+static void row_append(row_buf_t *b, const void *p, size_t n) {
+  if (b->failed)
+    return;
+  if (b->len + n > b->cap) {
+    size_t cap = b->cap ? b->cap : 64;
+    while (cap < b->len + n)
+      cap *= 2;
+    char *data = (char *)realloc(b->data, cap);
+    if (!data) {
+      b->failed = 1;
+      return;
+    }
+    b->data = data;
+    b->cap = cap;
+  }
+  memcpy(b->data + b->len, p, n);
+  b->len += n;
+}
+
+static void row_append_varint(row_buf_t *b, uint64_t v) {
+  unsigned char buf[10];
+  size_t n = 0;
+  for (; v >= 0x80; v >>= 7)
+    buf[n++] = (unsigned char)(v | 0x80);
+  buf[n++] = (unsigned char)v;
+  row_append(b, buf, n);
+}
+
+static int row_read_varint(const char **p, const char *end, uint64_t *v) {
+  *v = 0;
+  for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+    const unsigned char b = (unsigned char)*(*p)++;
+    *v |= (uint64_t)(b & 0x7F) << shift;
+    if (!(b & 0x80))
+      return 0;
+  }
+  return -1;
+}
+
+static unsigned char row_kind(const kadedb_lite_cell_t *c) {
+  return c->present ? (unsigned char)c->type : ROW_ABSENT;
+}
+
+int kadedb_lite_row_encode(const kadedb_lite_cell_t *cells, size_t count,
+                           char **out, size_t *out_len) {
+  row_buf_t b;
+  memset(&b, 0, sizeof(b));
+  const uint32_t magic = ROW_MAGIC;
+  const unsigned char version = ROW_VERSION;
+  row_append(&b, &magic, 4);
+  row_append(&b, &version, 1);
+  row_append_varint(&b, count);
+
+  size_t runs = 0;
+  size_t bools = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (i == 0 || row_kind(&cells[i]) != row_kind(&cells[i - 1]))
+      runs++;
+    if (cells[i].present && cells[i].type == KADEDB_LITE_TYPE_BOOLEAN)
+      bools++;
+  }
+  row_append_varint(&b, runs);
+  for (size_t i = 0; i < count;) {
+    const unsigned char kind = row_kind(&cells[i]);
+    size_t j = i + 1;
+    while (j < count && row_kind(&cells[j]) == kind)
+      j++;
+    row_append(&b, &kind, 1);
+    row_append_varint(&b, j - i);
+    i = j;
+  }
+
+  unsigned char *bits = (unsigned char *)calloc((bools + 7) / 8 + 1, 1);
+  if (!bits) {
+    free(b.data);
+    return -1;
+  }
+  size_t bit = 0;
+  for (size_t i = 0; i < count; i++) {
+    const kadedb_lite_cell_t *c = &cells[i];
+    if (!c->present)
+      continue;
+    switch (c->type) {
+    case KADEDB_LITE_TYPE_INTEGER:
+      row_append_varint(&b, ((uint64_t)c->i << 1) ^ (uint64_t)(c->i >> 63));
+      break;
+    case KADEDB_LITE_TYPE_FLOAT:
+      row_append(&b, &c->f, 8);
+      break;
+    case KADEDB_LITE_TYPE_STRING:
+      row_append_varint(&b, c->len);
+      row_append(&b, c->s, c->len);
+      break;
+    case KADEDB_LITE_TYPE_BOOLEAN:
+      if (c->b)
+        bits[bit / 8] |= (unsigned char)(1u << (bit % 8));
+      bit++;
+      break;
+    case KADEDB_LITE_TYPE_NULL:
+      break;
+    }
+  }
+  row_append(&b, bits, (bools + 7) / 8);
+  free(bits);
+  if (b.failed) {
+    free(b.data);
+    return -1;
+  }
+  *out = b.data;
+  *out_len = b.len;
+  return 0;
+}
+
+int kadedb_lite_row_decode(const char *data, size_t len,
+                           kadedb_lite_cell_t *cells, size_t count) {
+  const char *p = data;
+  const char *end = data + len;
+  uint32_t magic = 0;
+  if (len < 5)
+    return -1;
+  memcpy(&magic, p, 4);
+  if (magic != ROW_MAGIC || (unsigned char)p[4] != ROW_VERSION)
+    return -1;
+  p += 5;
+
+  uint64_t n = 0;
+  uint64_t runs = 0;
+  if (row_read_varint(&p, end, &n) != 0 || n != count ||
+      row_read_varint(&p, end, &runs) != 0 || runs > n)
+    return -1;
+  size_t i = 0;
+  for (uint64_t r = 0; r < runs; r++) {
+    uint64_t run = 0;
+    if (p == end)
+      return -1;
+    const unsigned char kind = (unsigned char)*p++;
+    if (row_read_varint(&p, end, &run) != 0 || run == 0 || run > n - i ||
+        (kind != ROW_ABSENT && kind > KADEDB_LITE_TYPE_BOOLEAN))
+      return -1;
+    for (; run > 0; run--, i++) {
+      memset(&cells[i], 0, sizeof(cells[i]));
+      cells[i].present = kind != ROW_ABSENT;
+      cells[i].type = kind == ROW_ABSENT ? KADEDB_LITE_TYPE_NULL
+                                         : (kadedb_lite_type_t)kind;
+    }
+  }
+  if (i != n)
+    return -1;
+
+  size_t bools = 0;
+  for (i = 0; i < count; i++) {
+    kadedb_lite_cell_t *c = &cells[i];
+    if (!c->present)
+      continue;
+    uint64_t v = 0;
+    switch (c->type) {
+    case KADEDB_LITE_TYPE_INTEGER:
+      if (row_read_varint(&p, end, &v) != 0)
+        return -1;
+      c->i = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+      break;
+    case KADEDB_LITE_TYPE_FLOAT:
+      if (end - p < 8)
+        return -1;
+      memcpy(&c->f, p, 8);
+      p += 8;
+      break;
+    case KADEDB_LITE_TYPE_STRING:
+      if (row_read_varint(&p, end, &v) != 0 || v > (uint64_t)(end - p))
+        return -1;
+      c->s = p;
+      c->len = (size_t)v;
+      p += v;
+      break;
+    case KADEDB_LITE_TYPE_BOOLEAN:
+      bools++;
+      break;
+    case KADEDB_LITE_TYPE_NULL:
+      break;
+    }
+  }
+  if ((size_t)(end - p) != (bools + 7) / 8)
+    return -1;
+  size_t bit = 0;
+  for (i = 0; i < count; i++) {
+    kadedb_lite_cell_t *c = &cells[i];
+    if (c->present && c->type == KADEDB_LITE_TYPE_BOOLEAN) {
+      c->b = ((unsigned char)p[bit / 8] >> (bit % 8)) & 1;
+      bit++;
+    }
+  }
+  return 0;
+}
@@ -1,11 +1,105 @@
+// clock_gettime() for the worker's waits
+#define _POSIX_C_SOURCE 200809L
+
 #include "kadedb_lite/kadedb_lite_sync.h"
 
 #include "kadedb_lite_internal.h"
+#include "kadedb_lite_thread.h"
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Reserved keys of the change log and its state
+#define SYNC_PREFIX "__kadedb_sync:"
+#define SYNC_LOG_PREFIX SYNC_PREFIX "log:"
+// Just past every log key
+#define SYNC_LOG_END SYNC_PREFIX "log;"
+#define SYNC_SEQ_KEY SYNC_PREFIX "seq"
+#define SYNC_ACKED_KEY SYNC_PREFIX "acked"
+#define SYNC_PULLED_KEY SYNC_PREFIX "pulled"
+// Log key: prefix and 16 hex digits, so keys sort by sequence
+#define SYNC_LOG_KEY_SIZE (sizeof(SYNC_LOG_PREFIX) + 16)
+
+// Delta: magic, version, flags, raw body size (u32), then the body, LZ4
+// compressed when flags has SYNC_DELTA_LZ4. Body: from_seq and to_seq
+// (u64), record count (u32), then per key an op byte, the key (u32 length
+// and bytes) and for a put the value the same way. Little endian.
+#define SYNC_DELTA_MAGIC "KDLS"
+#define SYNC_DELTA_VERSION 1
+#define SYNC_DELTA_LZ4 0x01
+#define SYNC_DELTA_HEADER 10
+#define SYNC_OP_PUT 'P'
+#define SYNC_OP_DELETE 'D'
+// Smaller bodies are not worth compressing
+#define SYNC_COMPRESS_MIN 64
+
+// Worker defaults
+#define SYNC_MAX_BATCH_CHANGES 1024
+#define SYNC_MAX_BATCH_BYTES (256 * 1024)
+#define SYNC_MIN_BACKOFF_MS 250
+#define SYNC_MAX_BACKOFF_SECONDS 60
+
+struct kadedb_lite_sync_worker_t {
+  // Guards the change log state of the handle and everything below
+  kadedb_lite_mutex_t mtx;
+  // Wakes the worker on stop and on newly logged changes
+  kadedb_lite_cond_t cv;
+  kadedb_lite_thread_t thread;
+  int thread_started;
+  int stop;
+  // Changes were logged since the worker last looked
+  int kicked;
+  kadedb_lite_t *db;
+
+  kadedb_lite_sync_transport_t transport;
+  int has_transport;
+  size_t max_batch_changes;
+  size_t max_batch_bytes;
+  uint64_t max_backoff_ms;
+  // Entries per delta, halved while deltas exceed the byte budget and
+  // doubled back after small ones
+  size_t batch_changes;
+
+  uint64_t bytes_sent;
+  uint64_t deltas_sent;
+  uint64_t failures;
+  uint64_t last_latency_ms;
+  uint64_t backoff_ms;
+};
+
+static int kadedb_lite_sync_track(kadedb_lite_t *db);
+static void kadedb_lite_sync_stop_worker(kadedb_lite_t *db);
+static void kadedb_lite_sync_worker_main(void *arg);
+
+static void kadedb_lite_sync_lock(kadedb_lite_t *db) {
+  kadedb_lite_mutex_lock(&db->sync_worker->mtx);
+}
+
+static void kadedb_lite_sync_unlock(kadedb_lite_t *db) {
+  kadedb_lite_mutex_unlock(&db->sync_worker->mtx);
+}
+
+static struct kadedb_lite_sync_worker_t *
+kadedb_lite_sync_worker_create(kadedb_lite_t *db) {
+  struct kadedb_lite_sync_worker_t *w =
+      (struct kadedb_lite_sync_worker_t *)calloc(1, sizeof(*w));
+  if (!w)
+    return NULL;
+  if (kadedb_lite_mutex_init(&w->mtx) != 0) {
+    free(w);
+    return NULL;
+  }
+  if (kadedb_lite_cond_init(&w->cv) != 0) {
+    kadedb_lite_mutex_destroy(&w->mtx);
+    free(w);
+    return NULL;
+  }
+  w->db = db;
+  return w;
+}
+
 static char *kadedb_lite_sync_strdup(const char *s) {
   if (!s)
     return NULL;
@@ -22,9 +116,32 @@ int kadedb_lite_sync_init(kadedb_lite_t *db,
   if (!db || !config)
     return -1;
 
-  if (config->sync_interval_seconds < 0)
+  if (config->sync_interval_seconds < 0 || config->max_backoff_seconds < 0)
+    return -1;
+  if (db->sync_worker && db->sync_worker->thread_started)
+    return -1;
+
+  if (!db->sync_worker) {
+    db->sync_worker = kadedb_lite_sync_worker_create(db);
+    if (!db->sync_worker)
+      return -1;
+  }
+  if (!db->sync_tracking && kadedb_lite_sync_track(db) != 0)
     return -1;
 
+  struct kadedb_lite_sync_worker_t *w = db->sync_worker;
+  w->has_transport = config->transport != NULL;
+  if (config->transport)
+    w->transport = *config->transport;
+  w->max_batch_changes = config->max_batch_changes ? config->max_batch_changes
+                                                   : SYNC_MAX_BATCH_CHANGES;
+  w->max_batch_bytes =
+      config->max_batch_bytes ? config->max_batch_bytes : SYNC_MAX_BATCH_BYTES;
+  w->max_backoff_ms = 1000u * (uint64_t)(config->max_backoff_seconds
+                                             ? config->max_backoff_seconds
+                                             : SYNC_MAX_BACKOFF_SECONDS);
+  w->batch_changes = w->max_batch_changes;
+
   if (db->sync_remote_url) {
     free(db->sync_remote_url);
     db->sync_remote_url = NULL;
@@ -56,6 +173,16 @@ int kadedb_lite_sync_start(kadedb_lite_t *db) {
     return -1;
   if (!db->sync_initialized)
     return -1;
+  struct kadedb_lite_sync_worker_t *w = db->sync_worker;
+  if (w->has_transport && !w->thread_started) {
+    w->stop = 0;
+    w->kicked = 0;
+    w->backoff_ms = 0;
+    if (kadedb_lite_thread_create(&w->thread, kadedb_lite_sync_worker_main,
+                                  w) != 0)
+      return -1;
+    w->thread_started = 1;
+  }
   db->sync_running = 1;
   return 0;
 }
@@ -65,6 +192,7 @@ int kadedb_lite_sync_stop(kadedb_lite_t *db) {
     return -1;
   if (!db->sync_initialized)
     return -1;
+  kadedb_lite_sync_stop_worker(db);
   db->sync_running = 0;
   return 0;
 }
@@ -96,9 +224,27 @@ int kadedb_lite_sync_status(kadedb_lite_t *db, char **status_out) {
   const char *k_token = " auth_token=";
   const char *k_interval = " interval_seconds=";
 
+  char stats_buf[256];
+  stats_buf[0] = '\0';
+  if (db->sync_worker) {
+    struct kadedb_lite_sync_worker_t *w = db->sync_worker;
+    kadedb_lite_sync_lock(db);
+    int n = snprintf(stats_buf, sizeof(stats_buf),
+                     " queue_depth=%" PRIu64 " bytes_sent=%" PRIu64
+                     " deltas_sent=%" PRIu64 " last_latency_ms=%" PRIu64
+                     " failures=%" PRIu64 " backoff_ms=%" PRIu64,
+                     db->sync_last_seq - db->sync_acked_seq, w->bytes_sent,
+                     w->deltas_sent, w->last_latency_ms, w->failures,
+                     w->backoff_ms);
+    kadedb_lite_sync_unlock(db);
+    if (n < 0)
+      stats_buf[0] = '\0';
+  }
+
   size_t total = strlen(prefix) + strlen(k_state) + strlen(state) +
                  strlen(k_remote) + strlen(remote) + strlen(k_token) +
-                 strlen(token) + strlen(k_interval) + strlen(interval_buf) + 1;
+                 strlen(token) + strlen(k_interval) + strlen(interval_buf) +
+                 strlen(stats_buf) + 1;
 
   char *buf = (char *)malloc(total);
   if (!buf)
@@ -113,7 +259,770 @@ int kadedb_lite_sync_status(kadedb_lite_t *db, char **status_out) {
   strcat(buf, token);
   strcat(buf, k_interval);
   strcat(buf, interval_buf);
+  strcat(buf, stats_buf);
 
   *status_out = buf;
   return 0;
 }
+
+// Change log
+
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+static void kadedb_lite_sync_log_key(uint64_t seq,
+                                     char out[SYNC_LOG_KEY_SIZE]) {
+  snprintf(out, SYNC_LOG_KEY_SIZE, SYNC_LOG_PREFIX "%016" PRIx64, seq);
+}
+
+// A stored sequence number; 0 when it was never written
+static int kadedb_lite_sync_read_seq(kadedb_lite_t *db, const char *key,
+                                     uint64_t *out) {
+  char *err = NULL;
+  size_t len = 0;
+  char *val = rocksdb_get(db->db, db->ropts, key, strlen(key), &len, &err);
+  if (err != NULL) {
+    rocksdb_free(err);
+    return -1;
+  }
+  *out = 0;
+  if (!val)
+    return 0;
+  char buf[32];
+  int rc = -1;
+  if (len < sizeof(buf)) {
+    memcpy(buf, val, len);
+    buf[len] = '\0';
+    *out = strtoull(buf, NULL, 10);
+    rc = 0;
+  }
+  rocksdb_free(val);
+  return rc;
+}
+
+static void kadedb_lite_sync_put_seq(rocksdb_writebatch_t *wb,
+                                     const char *key, uint64_t seq) {
+  char buf[32];
+  int n = snprintf(buf, sizeof(buf), "%" PRIu64, seq);
+  rocksdb_writebatch_put(wb, key, strlen(key), buf, (size_t)n);
+}
+
+typedef struct kadedb_lite_sync_capture_t {
+  rocksdb_writebatch_t *wb;
+  uint64_t seq;
+} kadedb_lite_sync_capture_t;
+
+static void kadedb_lite_sync_capture_log(kadedb_lite_sync_capture_t *cap,
+                                         const char *key, size_t key_len) {
+  char log_key[SYNC_LOG_KEY_SIZE];
+  kadedb_lite_sync_log_key(++cap->seq, log_key);
+  rocksdb_writebatch_put(cap->wb, log_key, strlen(log_key), key, key_len);
+}
+
+static void kadedb_lite_sync_capture_put(void *state, const char *key,
+                                         size_t key_len, const char *value,
+                                         size_t value_len) {
+  kadedb_lite_sync_capture_t *cap = (kadedb_lite_sync_capture_t *)state;
+  rocksdb_writebatch_put(cap->wb, key, key_len, value, value_len);
+  kadedb_lite_sync_capture_log(cap, key, key_len);
+}
+
+static void kadedb_lite_sync_capture_delete(void *state, const char *key,
+                                            size_t key_len) {
+  kadedb_lite_sync_capture_t *cap = (kadedb_lite_sync_capture_t *)state;
+  rocksdb_writebatch_delete(cap->wb, key, key_len);
+  kadedb_lite_sync_capture_log(cap, key, key_len);
+}
+#endif
+
+static int kadedb_lite_sync_commit_locked(kadedb_lite_t *db,
+                                          kadedb_lite_batch_t *batch) {
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  // A copy of the batch with a log entry after each operation, so the data
+  // and the log land in one write and the caller's batch stays as it was
+  // if the write fails
+  kadedb_lite_sync_capture_t cap;
+  cap.wb = rocksdb_writebatch_create();
+  cap.seq = db->sync_last_seq;
+  if (!cap.wb)
+    return -1;
+  rocksdb_writebatch_iterate(batch->wb, &cap, kadedb_lite_sync_capture_put,
+                             kadedb_lite_sync_capture_delete);
+  kadedb_lite_sync_put_seq(cap.wb, SYNC_SEQ_KEY, cap.seq);
+  char *err = NULL;
+  rocksdb_write(db->db, db->wopts, cap.wb, &err);
+  rocksdb_writebatch_destroy(cap.wb);
+  if (err != NULL) {
+    rocksdb_free(err);
+    return -1;
+  }
+  db->sync_last_seq = cap.seq;
+  return 0;
+#else
+  size_t need = db->sync_log_len + batch->count;
+  if (need > db->sync_log_cap) {
+    size_t cap = db->sync_log_cap ? db->sync_log_cap : 16;
+    while (cap < need)
+      cap *= 2;
+    char **keys = (char **)realloc(db->sync_log_keys, cap * sizeof(char *));
+    if (!keys)
+      return -1;
+    db->sync_log_keys = keys;
+    db->sync_log_cap = cap;
+  }
+  for (size_t i = 0; i < batch->count; i++) {
+    char *copy = kadedb_lite_sync_strdup(batch->keys[i]);
+    if (!copy) {
+      // Nothing was logged unless everything was
+      while (i-- > 0)
+        free(db->sync_log_keys[db->sync_log_len + i]);
+      return -1;
+    }
+    db->sync_log_keys[db->sync_log_len + i] = copy;
+  }
+  db->sync_log_len = need;
+  db->sync_last_seq += batch->count;
+  return 0;
+#endif
+}
+
+int kadedb_lite_sync_commit(kadedb_lite_t *db, kadedb_lite_batch_t *batch) {
+  struct kadedb_lite_sync_worker_t *w = db->sync_worker;
+  kadedb_lite_sync_lock(db);
+  int rc = kadedb_lite_sync_commit_locked(db, batch);
+  if (rc == 0 && kadedb_lite_batch_count(batch) > 0) {
+    w->kicked = 1;
+    kadedb_lite_cond_signal(&w->cv);
+  }
+  kadedb_lite_sync_unlock(db);
+  return rc;
+}
+
+void kadedb_lite_sync_release(kadedb_lite_t *db) {
+  if (db->sync_worker) {
+    kadedb_lite_sync_stop_worker(db);
+    kadedb_lite_cond_destroy(&db->sync_worker->cv);
+    kadedb_lite_mutex_destroy(&db->sync_worker->mtx);
+    free(db->sync_worker);
+    db->sync_worker = NULL;
+  }
+#ifndef KADEDB_LITE_HAS_ROCKSDB
+  for (size_t i = 0; i < db->sync_log_len; i++)
+    free(db->sync_log_keys[i]);
+  free(db->sync_log_keys);
+  db->sync_log_keys = NULL;
+  db->sync_log_len = 0;
+  db->sync_log_cap = 0;
+#endif
+}
+
+// Resume the log from the stored sequence numbers and log from now on
+static int kadedb_lite_sync_track(kadedb_lite_t *db) {
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  if (kadedb_lite_sync_read_seq(db, SYNC_SEQ_KEY, &db->sync_last_seq) != 0 ||
+      kadedb_lite_sync_read_seq(db, SYNC_ACKED_KEY, &db->sync_acked_seq) !=
+          0 ||
+      kadedb_lite_sync_read_seq(db, SYNC_PULLED_KEY, &db->sync_pulled_seq) !=
+          0)
+    return -1;
+#endif
+  // The stub's log lives in the handle, which already holds its state
+  db->sync_tracking = 1;
+  return 0;
+}
+
+int kadedb_lite_sync_pending(kadedb_lite_t *db, uint64_t *acked_seq_out,
+                             uint64_t *latest_seq_out) {
+  if (!db || !db->sync_tracking)
+    return -1;
+  kadedb_lite_sync_lock(db);
+  if (acked_seq_out)
+    *acked_seq_out = db->sync_acked_seq;
+  if (latest_seq_out)
+    *latest_seq_out = db->sync_last_seq;
+  kadedb_lite_sync_unlock(db);
+  return 0;
+}
+
+int kadedb_lite_sync_pulled_seq(kadedb_lite_t *db, uint64_t *seq_out) {
+  if (!db || !db->sync_tracking || !seq_out)
+    return -1;
+  kadedb_lite_sync_lock(db);
+  *seq_out = db->sync_pulled_seq;
+  kadedb_lite_sync_unlock(db);
+  return 0;
+}
+
+static int kadedb_lite_sync_ack_locked(kadedb_lite_t *db, uint64_t seq) {
+  if (seq > db->sync_last_seq)
+    return -1;
+  if (seq <= db->sync_acked_seq)
+    return 0;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  char begin[SYNC_LOG_KEY_SIZE];
+  char end[SYNC_LOG_KEY_SIZE];
+  kadedb_lite_sync_log_key(db->sync_acked_seq + 1, begin);
+  kadedb_lite_sync_log_key(seq + 1, end);
+  rocksdb_writebatch_t *wb = rocksdb_writebatch_create();
+  if (!wb)
+    return -1;
+  rocksdb_writebatch_delete_range(wb, begin, strlen(begin), end, strlen(end));
+  kadedb_lite_sync_put_seq(wb, SYNC_ACKED_KEY, seq);
+  char *err = NULL;
+  rocksdb_write(db->db, db->wopts, wb, &err);
+  rocksdb_writebatch_destroy(wb);
+  if (err != NULL) {
+    rocksdb_free(err);
+    return -1;
+  }
+#else
+  size_t dropped = (size_t)(seq - db->sync_acked_seq);
+  for (size_t i = 0; i < dropped; i++)
+    free(db->sync_log_keys[i]);
+  memmove(db->sync_log_keys, db->sync_log_keys + dropped,
+          (db->sync_log_len - dropped) * sizeof(char *));
+  db->sync_log_len -= dropped;
+#endif
+  db->sync_acked_seq = seq;
+  return 0;
+}
+
+int kadedb_lite_sync_ack(kadedb_lite_t *db, uint64_t seq) {
+  if (!db || !db->sync_tracking)
+    return -1;
+  kadedb_lite_sync_lock(db);
+  int rc = kadedb_lite_sync_ack_locked(db, seq);
+  kadedb_lite_sync_unlock(db);
+  return rc;
+}
+
+// Deltas
+
+typedef struct kadedb_lite_sync_buf_t {
+  char *data;
+  size_t len;
+  size_t cap;
+  int failed;
+} kadedb_lite_sync_buf_t;
+
+static void kadedb_lite_sync_append(kadedb_lite_sync_buf_t *buf,
+                                    const void *bytes, size_t n) {
+  if (buf->failed)
+    return;
+  if (buf->len + n > buf->cap) {
+    size_t cap = buf->cap ? buf->cap : 256;
+    while (cap < buf->len + n)
+      cap *= 2;
+    char *data = (char *)realloc(buf->data, cap);
+    if (!data) {
+      buf->failed = 1;
+      return;
+    }
+    buf->data = data;
+    buf->cap = cap;
+  }
+  memcpy(buf->data + buf->len, bytes, n);
+  buf->len += n;
+}
+
+static void kadedb_lite_sync_append_u32(kadedb_lite_sync_buf_t *buf,
+                                        uint32_t v) {
+  unsigned char b[4];
+  for (int i = 0; i < 4; i++)
+    b[i] = (unsigned char)(v >> (8 * i));
+  kadedb_lite_sync_append(buf, b, 4);
+}
+
+static void kadedb_lite_sync_append_u64(kadedb_lite_sync_buf_t *buf,
+                                        uint64_t v) {
+  unsigned char b[8];
+  for (int i = 0; i < 8; i++)
+    b[i] = (unsigned char)(v >> (8 * i));
+  kadedb_lite_sync_append(buf, b, 8);
+}
+
+static uint64_t kadedb_lite_sync_load(const char *p, int bytes) {
+  uint64_t v = 0;
+  for (int i = bytes - 1; i >= 0; i--)
+    v = (v << 8) | (unsigned char)p[i];
+  return v;
+}
+
+typedef struct kadedb_lite_sync_change_t {
+  char *key;
+  size_t len;
+} kadedb_lite_sync_change_t;
+
+static int kadedb_lite_sync_compare_changes(const void *a, const void *b) {
+  const kadedb_lite_sync_change_t *x = (const kadedb_lite_sync_change_t *)a;
+  const kadedb_lite_sync_change_t *y = (const kadedb_lite_sync_change_t *)b;
+  size_t n = x->len < y->len ? x->len : y->len;
+  int c = memcmp(x->key, y->key, n);
+  if (c != 0)
+    return c;
+  return x->len < y->len ? -1 : (x->len > y->len ? 1 : 0);
+}
+
+static void kadedb_lite_sync_free_changes(kadedb_lite_sync_change_t *changes,
+                                          size_t count) {
+  for (size_t i = 0; i < count; i++)
+    free(changes[i].key);
+  free(changes);
+}
+
+// Copy the keys of the first `max_changes` pending log entries; *to_seq is
+// the last one's sequence
+static int kadedb_lite_sync_collect(kadedb_lite_t *db, size_t max_changes,
+                                    kadedb_lite_sync_change_t **out,
+                                    size_t *count, uint64_t *to_seq) {
+  uint64_t pending = db->sync_last_seq - db->sync_acked_seq;
+  size_t want = (size_t)pending;
+  if (max_changes && max_changes < want)
+    want = max_changes;
+  *out = NULL;
+  *count = 0;
+  *to_seq = db->sync_acked_seq;
+  if (want == 0)
+    return 0;
+  kadedb_lite_sync_change_t *changes = (kadedb_lite_sync_change_t *)calloc(
+      want, sizeof(kadedb_lite_sync_change_t));
+  if (!changes)
+    return -1;
+  size_t n = 0;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  char lower[SYNC_LOG_KEY_SIZE];
+  kadedb_lite_sync_log_key(db->sync_acked_seq + 1, lower);
+  kadedb_lite_iter_t *it =
+      kadedb_lite_iter_create(db, lower, strlen(lower), SYNC_LOG_END,
+                              strlen(SYNC_LOG_END));
+  if (!it) {
+    free(changes);
+    return -1;
+  }
+  for (; n < want && kadedb_lite_iter_valid(it); kadedb_lite_iter_next(it)) {
+    size_t key_len = 0;
+    size_t len = 0;
+    const char *log_key = kadedb_lite_iter_key(it, &key_len);
+    const char *key = kadedb_lite_iter_value(it, &len);
+    char *copy = (char *)malloc(len ? len : 1);
+    if (!copy)
+      break;
+    memcpy(copy, key, len);
+    changes[n].key = copy;
+    changes[n].len = len;
+    n++;
+    char hex[17];
+    size_t digits = key_len - (sizeof(SYNC_LOG_PREFIX) - 1);
+    memcpy(hex, log_key + sizeof(SYNC_LOG_PREFIX) - 1, digits < 16 ? digits
+                                                                   : 16);
+    hex[digits < 16 ? digits : 16] = '\0';
+    *to_seq = strtoull(hex, NULL, 16);
+  }
+  int failed = n < want || kadedb_lite_iter_status(it) != 0;
+  kadedb_lite_iter_destroy(it);
+  if (failed) {
+    kadedb_lite_sync_free_changes(changes, n);
+    *to_seq = db->sync_acked_seq;
+    return -1;
+  }
+#else
+  for (; n < want; n++) {
+    changes[n].key = kadedb_lite_sync_strdup(db->sync_log_keys[n]);
+    if (!changes[n].key) {
+      kadedb_lite_sync_free_changes(changes, n);
+      return -1;
+    }
+    changes[n].len = strlen(changes[n].key);
+  }
+  *to_seq = db->sync_acked_seq + n;
+#endif
+  *out = changes;
+  *count = n;
+  return 0;
+}
+
+// Current value of a changed key; *found is 0 once it was deleted
+static int kadedb_lite_sync_current(kadedb_lite_t *db,
+                                    const kadedb_lite_sync_change_t *change,
+                                    char **value, size_t *len, int *found) {
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  char *err = NULL;
+  *value = rocksdb_get(db->db, db->ropts, change->key, change->len, len,
+                       &err);
+  if (err != NULL) {
+    rocksdb_free(err);
+    return -1;
+  }
+  *found = *value != NULL;
+  return 0;
+#else
+  *found = 1;
+  return kadedb_lite_get(db, change->key, value, len);
+#endif
+}
+
+static void kadedb_lite_sync_free_value(char *value) {
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  rocksdb_free(value);
+#else
+  free(value);
+#endif
+}
+
+// Header and body, compressed when that is smaller
+static int kadedb_lite_sync_frame(const kadedb_lite_sync_buf_t *body,
+                                  char **out, size_t *out_len) {
+  if (body->len > UINT32_MAX)
+    return -1;
+  size_t bound = body->len >= SYNC_COMPRESS_MIN
+                     ? kadedb_lite_lz4_bound(body->len)
+                     : body->len;
+  if (bound < body->len)
+    bound = body->len;
+  char *frame = (char *)malloc(SYNC_DELTA_HEADER + bound);
+  if (!frame)
+    return -1;
+  unsigned char flags = 0;
+  size_t payload = body->len;
+  if (body->len >= SYNC_COMPRESS_MIN) {
+    size_t packed = kadedb_lite_lz4_compress(body->data, body->len,
+                                             frame + SYNC_DELTA_HEADER);
+    if (packed != 0 && packed < body->len) {
+      flags = SYNC_DELTA_LZ4;
+      payload = packed;
+    }
+  }
+  if (!flags)
+    memcpy(frame + SYNC_DELTA_HEADER, body->data, body->len);
+  memcpy(frame, SYNC_DELTA_MAGIC, 4);
+  frame[4] = SYNC_DELTA_VERSION;
+  frame[5] = (char)flags;
+  for (int i = 0; i < 4; i++)
+    frame[6 + i] = (char)((uint32_t)body->len >> (8 * i));
+  *out = frame;
+  *out_len = SYNC_DELTA_HEADER + payload;
+  return 0;
+}
+
+static int kadedb_lite_sync_build_locked(kadedb_lite_t *db,
+                                         size_t max_changes, char **delta_out,
+                                         size_t *delta_len_out,
+                                         uint64_t *to_seq_out) {
+  *delta_out = NULL;
+  *delta_len_out = 0;
+  *to_seq_out = db->sync_acked_seq;
+
+  kadedb_lite_sync_change_t *changes = NULL;
+  size_t count = 0;
+  uint64_t to_seq = 0;
+  if (kadedb_lite_sync_collect(db, max_changes, &changes, &count, &to_seq) !=
+      0)
+    return -1;
+  if (count == 0)
+    return 0;
+
+  // Each key once: sorting groups the entries of a key together
+  qsort(changes, count, sizeof(*changes), kadedb_lite_sync_compare_changes);
+  size_t unique = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (unique > 0 &&
+        kadedb_lite_sync_compare_changes(&changes[unique - 1], &changes[i]) ==
+            0) {
+      free(changes[i].key);
+      continue;
+    }
+    changes[unique++] = changes[i];
+  }
+
+  kadedb_lite_sync_buf_t body;
+  memset(&body, 0, sizeof(body));
+  kadedb_lite_sync_append_u64(&body, db->sync_acked_seq);
+  kadedb_lite_sync_append_u64(&body, to_seq);
+  kadedb_lite_sync_append_u32(&body, (uint32_t)unique);
+  int rc = 0;
+  for (size_t i = 0; i < unique && rc == 0; i++) {
+    char *value = NULL;
+    size_t len = 0;
+    int found = 0;
+    rc = kadedb_lite_sync_current(db, &changes[i], &value, &len, &found);
+    if (rc != 0)
+      break;
+    char op = found ? SYNC_OP_PUT : SYNC_OP_DELETE;
+    kadedb_lite_sync_append(&body, &op, 1);
+    kadedb_lite_sync_append_u32(&body, (uint32_t)changes[i].len);
+    kadedb_lite_sync_append(&body, changes[i].key, changes[i].len);
+    if (found) {
+      kadedb_lite_sync_append_u32(&body, (uint32_t)len);
+      kadedb_lite_sync_append(&body, value, len);
+      kadedb_lite_sync_free_value(value);
+    }
+  }
+  kadedb_lite_sync_free_changes(changes, unique);
+  if (rc == 0 && !body.failed)
+    rc = kadedb_lite_sync_frame(&body, delta_out, delta_len_out);
+  else
+    rc = -1;
+  free(body.data);
+  if (rc == 0)
+    *to_seq_out = to_seq;
+  return rc;
+}
+
+int kadedb_lite_sync_build_delta(kadedb_lite_t *db, size_t max_changes,
+                                 char **delta_out, size_t *delta_len_out,
+                                 uint64_t *to_seq_out) {
+  if (!db || !db->sync_tracking || !delta_out || !delta_len_out ||
+      !to_seq_out)
+    return -1;
+  kadedb_lite_sync_lock(db);
+  int rc = kadedb_lite_sync_build_locked(db, max_changes, delta_out,
+                                         delta_len_out, to_seq_out);
+  kadedb_lite_sync_unlock(db);
+  return rc;
+}
+
+static int kadedb_lite_sync_apply_locked(kadedb_lite_t *db, const char *delta,
+                                         size_t delta_len) {
+  if (delta_len < SYNC_DELTA_HEADER ||
+      memcmp(delta, SYNC_DELTA_MAGIC, 4) != 0 ||
+      delta[4] != SYNC_DELTA_VERSION)
+    return -1;
+  const unsigned char flags = (unsigned char)delta[5];
+  const size_t raw_len = (size_t)kadedb_lite_sync_load(delta + 6, 4);
+  const char *payload = delta + SYNC_DELTA_HEADER;
+  const size_t payload_len = delta_len - SYNC_DELTA_HEADER;
+
+  char *raw = NULL;
+  const char *body = payload;
+  if (flags & SYNC_DELTA_LZ4) {
+    raw = (char *)malloc(raw_len ? raw_len : 1);
+    if (!raw ||
+        kadedb_lite_lz4_decompress(payload, payload_len, raw, raw_len) != 0) {
+      free(raw);
+      return -1;
+    }
+    body = raw;
+  } else if (payload_len != raw_len) {
+    return -1;
+  }
+
+  int rc = -1;
+  const char *p = body;
+  const char *end = body + raw_len;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  rocksdb_writebatch_t *wb = rocksdb_writebatch_create();
+  if (!wb) {
+    free(raw);
+    return -1;
+  }
+#endif
+  if (end - p < 20)
+    goto done;
+  const uint64_t from_seq = kadedb_lite_sync_load(p, 8);
+  const uint64_t to_seq = kadedb_lite_sync_load(p + 8, 8);
+  uint32_t count = (uint32_t)kadedb_lite_sync_load(p + 16, 4);
+  p += 20;
+  // A delta starting later would skip server changes
+  if (from_seq > db->sync_pulled_seq || to_seq < from_seq)
+    goto done;
+  for (; count > 0; count--) {
+    if (end - p < 5)
+      goto done;
+    const char op = p[0];
+    const size_t key_len = (size_t)kadedb_lite_sync_load(p + 1, 4);
+    p += 5;
+    if ((size_t)(end - p) < key_len)
+      goto done;
+    const char *key = p;
+    p += key_len;
+    const size_t reserved = sizeof(SYNC_PREFIX) - 1;
+    if (key_len >= reserved && memcmp(key, SYNC_PREFIX, reserved) == 0)
+      goto done;
+    if (op == SYNC_OP_PUT) {
+      if (end - p < 4)
+        goto done;
+      const size_t value_len = (size_t)kadedb_lite_sync_load(p, 4);
+      p += 4;
+      if ((size_t)(end - p) < value_len)
+        goto done;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+      rocksdb_writebatch_put(wb, key, key_len, p, value_len);
+#endif
+      p += value_len;
+    } else if (op == SYNC_OP_DELETE) {
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+      rocksdb_writebatch_delete(wb, key, key_len);
+#endif
+    } else {
+      goto done;
+    }
+  }
+  if (p != end)
+    goto done;
+  {
+    const uint64_t pulled =
+        to_seq > db->sync_pulled_seq ? to_seq : db->sync_pulled_seq;
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+    kadedb_lite_sync_put_seq(wb, SYNC_PULLED_KEY, pulled);
+    char *err = NULL;
+    rocksdb_write(db->db, db->wopts, wb, &err);
+    if (err != NULL) {
+      rocksdb_free(err);
+      goto done;
+    }
+#endif
+    db->sync_pulled_seq = pulled;
+    rc = 0;
+  }
+done:
+#ifdef KADEDB_LITE_HAS_ROCKSDB
+  rocksdb_writebatch_destroy(wb);
+#endif
+  free(raw);
+  return rc;
+}
+
+int kadedb_lite_sync_apply_delta(kadedb_lite_t *db, const char *delta,
+                                 size_t delta_len) {
+  if (!db || !db->sync_tracking || !delta)
+    return -1;
+  kadedb_lite_sync_lock(db);
+  int rc = kadedb_lite_sync_apply_locked(db, delta, delta_len);
+  kadedb_lite_sync_unlock(db);
+  return rc;
+}
+
+// Rounds
+
+// Push until nothing is pending, starting from *batch_changes entries per
+// delta. With a byte budget (0 for none), a delta over it is rebuilt from
+// half the entries, and the count grows back to max_changes after deltas
+// under half the budget. The network calls run without the lock.
+static int kadedb_lite_sync_push_all(kadedb_lite_t *db,
+                                     const kadedb_lite_sync_transport_t *t,
+                                     size_t *batch_changes,
+                                     size_t max_changes, size_t max_bytes) {
+  struct kadedb_lite_sync_worker_t *w = db->sync_worker;
+  for (;;) {
+    char *delta = NULL;
+    size_t len = 0;
+    uint64_t to_seq = 0;
+    if (kadedb_lite_sync_build_delta(db, *batch_changes, &delta, &len,
+                                     &to_seq) != 0)
+      return -1;
+    if (!delta)
+      return 0;
+    if (max_bytes && len > max_bytes && *batch_changes > 1) {
+      kadedb_lite_free(delta);
+      *batch_changes /= 2;
+      continue;
+    }
+    const uint64_t started = kadedb_lite_now_ms();
+    int rc = t->push(t->user_data, delta, len);
+    const uint64_t latency = kadedb_lite_now_ms() - started;
+    kadedb_lite_free(delta);
+    if (rc != 0 || kadedb_lite_sync_ack(db, to_seq) != 0)
+      return -1;
+    kadedb_lite_sync_lock(db);
+    w->bytes_sent += len;
+    w->deltas_sent++;
+    w->last_latency_ms = latency;
+    kadedb_lite_sync_unlock(db);
+    if (max_bytes && len <= max_bytes / 2 && *batch_changes &&
+        *batch_changes < max_changes)
+      *batch_changes = *batch_changes * 2 < max_changes ? *batch_changes * 2
+                                                        : max_changes;
+  }
+}
+
+// Apply server deltas until the server has nothing newer
+static int kadedb_lite_sync_pull_all(kadedb_lite_t *db,
+                                     const kadedb_lite_sync_transport_t *t) {
+  for (;;) {
+    uint64_t since = 0;
+    if (kadedb_lite_sync_pulled_seq(db, &since) != 0)
+      return -1;
+    char *delta = NULL;
+    size_t len = 0;
+    if (t->pull(t->user_data, since, &delta, &len) != 0)
+      return -1;
+    if (!delta)
+      return 0;
+    int rc = kadedb_lite_sync_apply_delta(db, delta, len);
+    free(delta);
+    uint64_t now = 0;
+    if (rc != 0 || kadedb_lite_sync_pulled_seq(db, &now) != 0)
+      return -1;
+    // A server repeating itself has nothing newer
+    if (now == since)
+      return 0;
+  }
+}
+
+int kadedb_lite_sync_run_once(kadedb_lite_t *db,
+                              const kadedb_lite_sync_transport_t *transport,
+                              size_t batch_changes) {
+  if (!db || !db->sync_tracking || !transport || !transport->push ||
+      !transport->pull)
+    return -1;
+  if (kadedb_lite_sync_push_all(db, transport, &batch_changes, batch_changes,
+                                0) != 0)
+    return -1;
+  return kadedb_lite_sync_pull_all(db, transport);
+}
+
+static void kadedb_lite_sync_worker_main(void *arg) {
+  struct kadedb_lite_sync_worker_t *w =
+      (struct kadedb_lite_sync_worker_t *)arg;
+  kadedb_lite_t *db = w->db;
+  const uint64_t interval_ms = 1000u * (uint64_t)db->sync_interval_seconds;
+  kadedb_lite_mutex_lock(&w->mtx);
+  // The first round starts right away
+  int skip_wait = 1;
+  while (!w->stop) {
+    if (!skip_wait && (w->backoff_ms || interval_ms)) {
+      // The backoff after a failure, else the interval; changes logged
+      // meanwhile go out together
+      const uint64_t wait_ms = w->backoff_ms ? w->backoff_ms : interval_ms;
+      const uint64_t deadline = kadedb_lite_now_ms() + wait_ms;
+      for (uint64_t now; !w->stop && (now = kadedb_lite_now_ms()) < deadline;)
+        kadedb_lite_cond_wait_ms(&w->cv, &w->mtx, deadline - now);
+    } else if (!skip_wait) {
+      // No interval: the next logged change
+      while (!w->stop && !w->kicked)
+        kadedb_lite_cond_wait_ms(&w->cv, &w->mtx, 1000);
+    }
+    skip_wait = 0;
+    if (w->stop)
+      break;
+    w->kicked = 0;
+    kadedb_lite_mutex_unlock(&w->mtx);
+
+    int rc = kadedb_lite_sync_push_all(db, &w->transport, &w->batch_changes,
+                                       w->max_batch_changes,
+                                       w->max_batch_bytes);
+    if (rc == 0)
+      rc = kadedb_lite_sync_pull_all(db, &w->transport);
+
+    kadedb_lite_mutex_lock(&w->mtx);
+    if (rc == 0) {
+      w->backoff_ms = 0;
+    } else {
+      w->failures++;
+      w->backoff_ms = w->backoff_ms ? w->backoff_ms * 2 : SYNC_MIN_BACKOFF_MS;
+      if (w->backoff_ms > w->max_backoff_ms)
+        w->backoff_ms = w->max_backoff_ms;
+    }
+  }
+  kadedb_lite_mutex_unlock(&w->mtx);
+}
+
+static void kadedb_lite_sync_stop_worker(kadedb_lite_t *db) {
+  struct kadedb_lite_sync_worker_t *w = db->sync_worker;
+  if (!w || !w->thread_started)
+    return;
+  kadedb_lite_mutex_lock(&w->mtx);
+  w->stop = 1;
+  kadedb_lite_cond_signal(&w->cv);
+  kadedb_lite_mutex_unlock(&w->mtx);
+  kadedb_lite_thread_join(w->thread);
+  w->thread_started = 0;
+}
@@ -0,0 +1,168 @@
+#ifndef KADEDB_LITE_THREAD_H
+#define KADEDB_LITE_THREAD_H
+
+// The few threading primitives the sync worker needs, over Win32 or
+// pthreads. Sources including this must define _POSIX_C_SOURCE first.
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef SRWLOCK kadedb_lite_mutex_t;
+typedef CONDITION_VARIABLE kadedb_lite_cond_t;
+typedef HANDLE kadedb_lite_thread_t;
+
+static inline int kadedb_lite_mutex_init(kadedb_lite_mutex_t *m) {
+  InitializeSRWLock(m);
+  return 0;
+}
+static inline void kadedb_lite_mutex_destroy(kadedb_lite_mutex_t *m) {
+  (void)m;
+}
+static inline void kadedb_lite_mutex_lock(kadedb_lite_mutex_t *m) {
+  AcquireSRWLockExclusive(m);
+}
+static inline void kadedb_lite_mutex_unlock(kadedb_lite_mutex_t *m) {
+  ReleaseSRWLockExclusive(m);
+}
+
+static inline int kadedb_lite_cond_init(kadedb_lite_cond_t *c) {
+  InitializeConditionVariable(c);
+  return 0;
+}
+static inline void kadedb_lite_cond_destroy(kadedb_lite_cond_t *c) {
+  (void)c;
+}
+static inline void kadedb_lite_cond_signal(kadedb_lite_cond_t *c) {
+  WakeConditionVariable(c);
+}
+// Wait for a signal or at most `ms` milliseconds; may wake early
+static inline void kadedb_lite_cond_wait_ms(kadedb_lite_cond_t *c,
+                                            kadedb_lite_mutex_t *m,
+                                            uint64_t ms) {
+  SleepConditionVariableSRW(c, m, ms > 0x7FFFFFFF ? 0x7FFFFFFF : (DWORD)ms,
+                            0);
+}
+
+typedef struct kadedb_lite_thread_start_t {
+  void (*fn)(void *);
+  void *arg;
+} kadedb_lite_thread_start_t;
+
+static DWORD WINAPI kadedb_lite_thread_main(LPVOID p) {
+  kadedb_lite_thread_start_t start = *(kadedb_lite_thread_start_t *)p;
+  HeapFree(GetProcessHeap(), 0, p);
+  start.fn(start.arg);
+  return 0;
+}
+
+static inline int kadedb_lite_thread_create(kadedb_lite_thread_t *t,
+                                            void (*fn)(void *), void *arg) {
+  kadedb_lite_thread_start_t *start = (kadedb_lite_thread_start_t *)HeapAlloc(
+      GetProcessHeap(), 0, sizeof(*start));
+  if (!start)
+    return -1;
+  start->fn = fn;
+  start->arg = arg;
+  *t = CreateThread(NULL, 0, kadedb_lite_thread_main, start, 0, NULL);
+  if (!*t) {
+    HeapFree(GetProcessHeap(), 0, start);
+    return -1;
+  }
+  return 0;
+}
+static inline void kadedb_lite_thread_join(kadedb_lite_thread_t t) {
+  WaitForSingleObject(t, INFINITE);
+  CloseHandle(t);
+}
+
+// Milliseconds of a monotonic clock
+static inline uint64_t kadedb_lite_now_ms(void) { return GetTickCount64(); }
+
+#else
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef pthread_mutex_t kadedb_lite_mutex_t;
+typedef pthread_cond_t kadedb_lite_cond_t;
+typedef pthread_t kadedb_lite_thread_t;
+
+static inline int kadedb_lite_mutex_init(kadedb_lite_mutex_t *m) {
+  return pthread_mutex_init(m, NULL) == 0 ? 0 : -1;
+}
+static inline void kadedb_lite_mutex_destroy(kadedb_lite_mutex_t *m) {
+  pthread_mutex_destroy(m);
+}
+static inline void kadedb_lite_mutex_lock(kadedb_lite_mutex_t *m) {
+  pthread_mutex_lock(m);
+}
+static inline void kadedb_lite_mutex_unlock(kadedb_lite_mutex_t *m) {
+  pthread_mutex_unlock(m);
+}
+
+static inline int kadedb_lite_cond_init(kadedb_lite_cond_t *c) {
+  return pthread_cond_init(c, NULL) == 0 ? 0 : -1;
+}
+static inline void kadedb_lite_cond_destroy(kadedb_lite_cond_t *c) {
+  pthread_cond_destroy(c);
+}
+static inline void kadedb_lite_cond_signal(kadedb_lite_cond_t *c) {
+  pthread_cond_signal(c);
+}
+// Wait for a signal or at most `ms` milliseconds; may wake early
+static inline void kadedb_lite_cond_wait_ms(kadedb_lite_cond_t *c,
+                                            kadedb_lite_mutex_t *m,
+                                            uint64_t ms) {
+  // The condition waits against the realtime clock
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += (time_t)(ms / 1000);
+  ts.tv_nsec += (long)(ms % 1000) * 1000000L;
+  if (ts.tv_nsec >= 1000000000L) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
+  pthread_cond_timedwait(c, m, &ts);
+}
+
+typedef struct kadedb_lite_thread_start_t {
+  void (*fn)(void *);
+  void *arg;
+} kadedb_lite_thread_start_t;
+
+static void *kadedb_lite_thread_main(void *p) {
+  kadedb_lite_thread_start_t start = *(kadedb_lite_thread_start_t *)p;
+  free(p);
+  start.fn(start.arg);
+  return NULL;
+}
+
+static inline int kadedb_lite_thread_create(kadedb_lite_thread_t *t,
+                                            void (*fn)(void *), void *arg) {
+  kadedb_lite_thread_start_t *start =
+      (kadedb_lite_thread_start_t *)malloc(sizeof(*start));
+  if (!start)
+    return -1;
+  start->fn = fn;
+  start->arg = arg;
+  if (pthread_create(t, NULL, kadedb_lite_thread_main, start) != 0) {
+    free(start);
+    return -1;
+  }
+  return 0;
+}
+static inline void kadedb_lite_thread_join(kadedb_lite_thread_t t) {
+  pthread_join(t, NULL);
+}
+
+// Milliseconds of a monotonic clock
+static inline uint64_t kadedb_lite_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+#endif
+
+#endif // KADEDB_LITE_THREAD_H
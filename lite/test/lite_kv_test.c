@@ -139,6 +139,230 @@ int main(void) {
     return 10;
   }
 
+  // Pinned reads see the stored bytes without a copy
+  if (kadedb_lite_put(db, "p1", "pinned", 6) != 0) {
+    fprintf(stderr, "put p1 failed\n");
+    kadedb_lite_close(db);
+    return 23;
+  }
+  kadedb_lite_pinned_t *pinned = kadedb_lite_get_pinned(db, "p1");
+  size_t pinned_len = 0;
+  const char *pinned_val = kadedb_lite_pinned_value(pinned, &pinned_len);
+  if (!pinned || !pinned_val ||
+      (!allow_stub &&
+       (pinned_len != 6 || memcmp(pinned_val, "pinned", 6) != 0))) {
+    fprintf(stderr, "get_pinned p1 mismatch\n");
+    kadedb_lite_pinned_destroy(pinned);
+    kadedb_lite_close(db);
+    return 24;
+  }
+  kadedb_lite_pinned_destroy(pinned);
+  kadedb_lite_pinned_destroy(NULL);
+  if ((!allow_stub && kadedb_lite_get_pinned(db, "definitely_missing")) ||
+      kadedb_lite_get_pinned(NULL, "p1") != NULL ||
+      kadedb_lite_pinned_value(NULL, &pinned_len) != NULL || pinned_len != 0) {
+    fprintf(stderr, "get_pinned missing/argument checks failed\n");
+    kadedb_lite_close(db);
+    return 25;
+  }
+
+  // One call reads many keys; missing ones come back NULL
+  {
+    const char *keys[] = {"p1", "definitely_missing", "empty_val"};
+    char *vals[3];
+    size_t lens[3];
+    int found = kadedb_lite_multi_get(db, 3, keys, vals, lens);
+    int ok = found == (allow_stub ? 3 : 2);
+    if (ok && !allow_stub)
+      ok = vals[0] && lens[0] == 6 && memcmp(vals[0], "pinned", 6) == 0 &&
+           vals[1] == NULL && lens[1] == 0 && vals[2] && lens[2] == 0;
+    for (size_t i = 0; i < 3; i++)
+      kadedb_lite_free(vals[i]);
+    if (!ok || kadedb_lite_multi_get(db, 0, NULL, NULL, NULL) != 0 ||
+        kadedb_lite_multi_get(NULL, 3, keys, vals, lens) != -1 ||
+        kadedb_lite_multi_get(db, 3, keys, NULL, lens) != -1) {
+      fprintf(stderr, "multi_get mismatch\n");
+      kadedb_lite_close(db);
+      return 26;
+    }
+  }
+
+  // Batched writes land together on commit, in the order they were added
+  kadedb_lite_batch_t *batch = kadedb_lite_batch_create();
+  if (!batch) {
+    fprintf(stderr, "kadedb_lite_batch_create failed\n");
+    kadedb_lite_close(db);
+    return 11;
+  }
+  if (kadedb_lite_batch_put(batch, "b1", "one", 3) != 0 ||
+      kadedb_lite_batch_put(batch, "b2", "two", 3) != 0 ||
+      kadedb_lite_batch_put(batch, "b3", "three", 5) != 0 ||
+      kadedb_lite_batch_delete(batch, "b2") != 0 ||
+      kadedb_lite_batch_count(batch) != 4) {
+    fprintf(stderr, "batch put/delete failed\n");
+    kadedb_lite_batch_destroy(batch);
+    kadedb_lite_close(db);
+    return 12;
+  }
+  if (!allow_stub && !expect_get_not_found(db, "b1", allow_stub)) {
+    fprintf(stderr, "batched write visible before commit\n");
+    kadedb_lite_batch_destroy(batch);
+    kadedb_lite_close(db);
+    return 13;
+  }
+  if (kadedb_lite_batch_commit(db, batch) != 0 ||
+      kadedb_lite_batch_count(batch) != 0) {
+    fprintf(stderr, "batch commit failed\n");
+    kadedb_lite_batch_destroy(batch);
+    kadedb_lite_close(db);
+    return 14;
+  }
+  if (!expect_get_ok(db, "b1", "one", allow_stub) ||
+      !expect_get_ok(db, "b3", "three", allow_stub) ||
+      !expect_get_not_found(db, "b2", allow_stub)) {
+    fprintf(stderr, "batch contents mismatch after commit\n");
+    kadedb_lite_batch_destroy(batch);
+    kadedb_lite_close(db);
+    return 15;
+  }
+
+  // A cleared batch writes nothing, and bad arguments are rejected
+  if (kadedb_lite_batch_put(batch, "b4", "four", 4) != 0) {
+    fprintf(stderr, "batch reuse failed\n");
+    kadedb_lite_batch_destroy(batch);
+    kadedb_lite_close(db);
+    return 16;
+  }
+  kadedb_lite_batch_clear(batch);
+  if (kadedb_lite_batch_count(batch) != 0 ||
+      kadedb_lite_batch_commit(db, batch) != 0 ||
+      !expect_get_not_found(db, "b4", allow_stub) ||
+      kadedb_lite_batch_put(batch, NULL, "x", 1) == 0 ||
+      kadedb_lite_batch_put(NULL, "k", "x", 1) == 0 ||
+      kadedb_lite_batch_delete(batch, NULL) == 0 ||
+      kadedb_lite_batch_commit(NULL, batch) == 0 ||
+      kadedb_lite_batch_commit(db, NULL) == 0 ||
+      kadedb_lite_batch_count(NULL) != 0) {
+    fprintf(stderr, "batch clear/argument checks failed\n");
+    kadedb_lite_batch_destroy(batch);
+    kadedb_lite_close(db);
+    return 17;
+  }
+  kadedb_lite_batch_destroy(batch);
+  kadedb_lite_batch_destroy(NULL);
+
+  // Prefix iteration visits one table's keys in order, and no others
+  kadedb_lite_put(db, "t:2", "two", 3);
+  kadedb_lite_put(db, "t:1", "one", 3);
+  kadedb_lite_put(db, "t:3", "three", 5);
+  kadedb_lite_put(db, "u:1", "other", 5);
+  kadedb_lite_iter_t *it = kadedb_lite_iter_create_prefix(db, "t:");
+  if (!it) {
+    fprintf(stderr, "kadedb_lite_iter_create_prefix failed\n");
+    kadedb_lite_close(db);
+    return 18;
+  }
+  const char *want[] = {"t:1", "t:2", "t:3"};
+  size_t seen = 0;
+  for (; kadedb_lite_iter_valid(it); kadedb_lite_iter_next(it)) {
+    size_t key_len = 0, value_len = 0;
+    const char *key = kadedb_lite_iter_key(it, &key_len);
+    kadedb_lite_iter_value(it, &value_len);
+    if (seen >= 3 || key_len != 3 || memcmp(key, want[seen], 3) != 0) {
+      fprintf(stderr, "prefix iteration out of order\n");
+      kadedb_lite_iter_destroy(it);
+      kadedb_lite_close(db);
+      return 19;
+    }
+    seen++;
+  }
+  if ((!allow_stub && seen != 3) || kadedb_lite_iter_status(it) != 0 ||
+      kadedb_lite_iter_key(it, NULL) != NULL) {
+    fprintf(stderr, "prefix iteration incomplete\n");
+    kadedb_lite_iter_destroy(it);
+    kadedb_lite_close(db);
+    return 20;
+  }
+  kadedb_lite_iter_destroy(it);
+
+  // Bounded iteration over [t:2, u:1) excludes the upper bound
+  it = kadedb_lite_iter_create(db, "t:2", 3, "u:1", 3);
+  seen = 0;
+  for (; kadedb_lite_iter_valid(it); kadedb_lite_iter_next(it))
+    seen++;
+  if (!it || (!allow_stub && seen != 2)) {
+    fprintf(stderr, "bounded iteration mismatch\n");
+    kadedb_lite_iter_destroy(it);
+    kadedb_lite_close(db);
+    return 21;
+  }
+  kadedb_lite_iter_destroy(it);
+  kadedb_lite_iter_destroy(NULL);
+  if (kadedb_lite_iter_create_prefix(NULL, "t:") != NULL ||
+      kadedb_lite_iter_valid(NULL) != 0) {
+    fprintf(stderr, "iterator argument checks failed\n");
+    kadedb_lite_close(db);
+    return 22;
+  }
+
+  // Bulk loads take ascending keys and show up together on finish; a
+  // 1-byte file cap puts every pair in a file of its own
+  kadedb_lite_loader_t *loader = kadedb_lite_loader_create(db, 1);
+  if (!loader || kadedb_lite_loader_add(loader, "bulk:1", "one", 3) != 0 ||
+      kadedb_lite_loader_add(loader, "bulk:2", "two", 3) != 0 ||
+      kadedb_lite_loader_add(loader, "bulk:2", "dup", 3) == 0 ||
+      kadedb_lite_loader_add(loader, "bulk:0", "back", 4) == 0 ||
+      kadedb_lite_loader_add(loader, "bulk:3", "three", 5) != 0 ||
+      kadedb_lite_loader_add(loader, "t:1", "uno", 3) != 0 ||
+      kadedb_lite_loader_count(loader) != 4) {
+    fprintf(stderr, "bulk loader add failed\n");
+    kadedb_lite_loader_destroy(loader);
+    kadedb_lite_close(db);
+    return 27;
+  }
+  if (!allow_stub && !expect_get_not_found(db, "bulk:1", allow_stub)) {
+    fprintf(stderr, "bulk load visible before finish\n");
+    kadedb_lite_loader_destroy(loader);
+    kadedb_lite_close(db);
+    return 28;
+  }
+  if (kadedb_lite_loader_finish(loader) != 0 ||
+      kadedb_lite_loader_finish(loader) == 0 ||
+      kadedb_lite_loader_add(loader, "bulk:4", "four", 4) == 0 ||
+      !expect_get_ok(db, "bulk:1", "one", allow_stub) ||
+      !expect_get_ok(db, "bulk:2", "two", allow_stub) ||
+      !expect_get_ok(db, "bulk:3", "three", allow_stub) ||
+      !expect_get_ok(db, "t:1", "uno", allow_stub)) {
+    fprintf(stderr, "bulk load contents mismatch after finish\n");
+    kadedb_lite_loader_destroy(loader);
+    kadedb_lite_close(db);
+    return 29;
+  }
+  kadedb_lite_loader_destroy(loader);
+
+  // An unfinished load leaves nothing behind
+  loader = kadedb_lite_loader_create(db, 0);
+  if (!loader || kadedb_lite_loader_add(loader, "bulk:5", "five", 4) != 0) {
+    fprintf(stderr, "bulk loader reuse failed\n");
+    kadedb_lite_loader_destroy(loader);
+    kadedb_lite_close(db);
+    return 30;
+  }
+  kadedb_lite_loader_destroy(loader);
+  kadedb_lite_loader_destroy(NULL);
+  if (!expect_get_not_found(db, "bulk:5", allow_stub) ||
+      kadedb_lite_loader_create(NULL, 0) != NULL ||
+      kadedb_lite_loader_add(NULL, "k", "v", 1) == 0 ||
+      kadedb_lite_loader_finish(NULL) == 0 ||
+      kadedb_lite_loader_count(NULL) != 0 ||
+      kadedb_lite_ingest_files(db, NULL, 0) != 0 ||
+      kadedb_lite_ingest_files(NULL, NULL, 0) == 0 ||
+      kadedb_lite_ingest_files(db, NULL, 1) == 0) {
+    fprintf(stderr, "bulk load argument checks failed\n");
+    kadedb_lite_close(db);
+    return 31;
+  }
+
   kadedb_lite_close(db);
   return 0;
 }
@@ -199,6 +199,95 @@ static int test_parse_insert(void) {
   return 1;
 }
 
+static int test_parse_insert_multi_row(void) {
+  TEST("parse multi-row INSERT");
+
+  kadedb_lite_parsed_query_t *q =
+      kadedb_lite_parse_query("INSERT INTO users (id, value) VALUES "
+                              "('u1', 'd1'), ('u2', 'd2'),('u3', 'd3')");
+  if (!q) {
+    FAIL("parse returned NULL");
+    return 0;
+  }
+
+  if (q->row_count != 3 || q->value_count != 6) {
+    FAIL("wrong row or value count");
+    kadedb_lite_parsed_query_free(q);
+    return 0;
+  }
+
+  if (strcmp(q->values[2], "u2") != 0 || strcmp(q->values[5], "d3") != 0) {
+    FAIL("wrong values");
+    kadedb_lite_parsed_query_free(q);
+    return 0;
+  }
+  kadedb_lite_parsed_query_free(q);
+
+  kadedb_lite_parsed_query_t *ragged = kadedb_lite_parse_query(
+      "INSERT INTO users (id, value) VALUES ('u1', 'd1'), ('u2')");
+  if (ragged) {
+    FAIL("tuples of different widths should return NULL");
+    kadedb_lite_parsed_query_free(ragged);
+    return 0;
+  }
+
+  kadedb_lite_parsed_query_t *dangling = kadedb_lite_parse_query(
+      "INSERT INTO users (id, value) VALUES ('u1', 'd1'),");
+  if (dangling) {
+    FAIL("trailing comma should return NULL");
+    kadedb_lite_parsed_query_free(dangling);
+    return 0;
+  }
+
+  PASS();
+  return 1;
+}
+
+static int test_parse_select_limit(void) {
+  TEST("parse SELECT with LIMIT");
+
+  kadedb_lite_parsed_query_t *q =
+      kadedb_lite_parse_query("SELECT * FROM t WHERE id >= 'a' LIMIT 25");
+  if (!q || !q->condition || q->condition->op != KADEDB_LITE_OP_GE ||
+      !q->has_limit || q->limit != 25) {
+    FAIL("WHERE ... LIMIT not parsed correctly");
+    kadedb_lite_parsed_query_free(q);
+    return 0;
+  }
+  kadedb_lite_parsed_query_free(q);
+
+  q = kadedb_lite_parse_query("SELECT * FROM t limit 0");
+  if (!q || q->condition || !q->has_limit || q->limit != 0) {
+    FAIL("LIMIT without WHERE not parsed correctly");
+    kadedb_lite_parsed_query_free(q);
+    return 0;
+  }
+  kadedb_lite_parsed_query_free(q);
+
+  q = kadedb_lite_parse_query("SELECT * FROM t");
+  if (!q || q->has_limit) {
+    FAIL("SELECT without LIMIT should have no limit");
+    kadedb_lite_parsed_query_free(q);
+    return 0;
+  }
+  kadedb_lite_parsed_query_free(q);
+
+  const char *bad[] = {"SELECT * FROM t LIMIT", "SELECT * FROM t LIMIT x1",
+                       "SELECT * FROM t LIMIT 5x", "SELECT * FROM t WHERE",
+                       "SELECT * FROM t WHERE id ="};
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    q = kadedb_lite_parse_query(bad[i]);
+    if (q) {
+      printf("FAIL: should not parse: %s\n", bad[i]);
+      kadedb_lite_parsed_query_free(q);
+      return 0;
+    }
+  }
+
+  PASS();
+  return 1;
+}
+
 static int test_parse_invalid(void) {
   TEST("parse invalid query returns NULL");
 
@@ -296,6 +385,123 @@ static int test_execute_insert_and_select(kadedb_lite_t *db) {
   return 1;
 }
 
+static int test_execute_multi_row_insert(kadedb_lite_t *db) {
+  TEST("execute multi-row INSERT");
+
+  kadedb_lite_result_t *insert_result = kadedb_lite_execute_query(
+      db, "INSERT INTO multi (id, value) VALUES ('m1', 'a'), ('m2', 'b'), "
+          "('m3', 'c')");
+  if (!insert_result || kadedb_lite_result_error(insert_result)) {
+    FAIL("multi-row INSERT failed");
+    kadedb_lite_result_free(insert_result);
+    return 0;
+  }
+
+  if (kadedb_lite_result_affected_rows(insert_result) != 3) {
+    FAIL("INSERT should affect 3 rows");
+    kadedb_lite_result_free(insert_result);
+    return 0;
+  }
+  kadedb_lite_result_free(insert_result);
+
+  kadedb_lite_result_t *select_result =
+      kadedb_lite_execute_query(db, "SELECT * FROM multi WHERE id = 'm2'");
+  if (!select_result || kadedb_lite_result_row_count(select_result) != 1) {
+    FAIL("SELECT should return 1 row");
+    kadedb_lite_result_free(select_result);
+    return 0;
+  }
+
+  const char *val = kadedb_lite_result_value(select_result, 0, 1);
+  if (!(stub_mode && is_stub_value(val)) && (!val || strcmp(val, "b") != 0)) {
+    FAIL("SELECT returned wrong value");
+    kadedb_lite_result_free(select_result);
+    return 0;
+  }
+
+  kadedb_lite_result_free(select_result);
+  PASS();
+  return 1;
+}
+
+// Run `query`, expecting the ids in `expected` in order (any rows at all in
+// stub mode, which stores nothing)
+static int expect_ids(kadedb_lite_t *db, const char *query,
+                      const char **expected, size_t count) {
+  kadedb_lite_result_t *r = kadedb_lite_execute_query(db, query);
+  if (!r || kadedb_lite_result_error(r) ||
+      kadedb_lite_result_column_count(r) != 2) {
+    printf("FAIL: %s: %s\n", query,
+           r && kadedb_lite_result_error(r) ? kadedb_lite_result_error(r)
+                                            : "bad result");
+    kadedb_lite_result_free(r);
+    return 0;
+  }
+  if (stub_mode) {
+    kadedb_lite_result_free(r);
+    return 1;
+  }
+  if (kadedb_lite_result_row_count(r) != count) {
+    printf("FAIL: %s: %zu rows, expected %zu\n", query,
+           kadedb_lite_result_row_count(r), count);
+    kadedb_lite_result_free(r);
+    return 0;
+  }
+  for (size_t i = 0; i < count; i++) {
+    const char *id = kadedb_lite_result_value(r, i, 0);
+    if (!id || strcmp(id, expected[i]) != 0) {
+      printf("FAIL: %s: row %zu is %s, expected %s\n", query, i,
+             id ? id : "NULL", expected[i]);
+      kadedb_lite_result_free(r);
+      return 0;
+    }
+  }
+  kadedb_lite_result_free(r);
+  return 1;
+}
+
+static int test_execute_scans(kadedb_lite_t *db) {
+  TEST("execute table and id-range scans");
+
+  kadedb_lite_result_t *ins = kadedb_lite_execute_query(
+      db, "INSERT INTO scan (id, value) VALUES ('c', 'v3'), ('a', 'v1'), "
+          "('b', 'v2'), ('d', 'v2'), ('bb', 'v5')");
+  if (!ins || kadedb_lite_result_error(ins)) {
+    FAIL("INSERT failed");
+    kadedb_lite_result_free(ins);
+    return 0;
+  }
+  kadedb_lite_result_free(ins);
+  // Neighbouring tables sort right before and after "scan:"
+  kadedb_lite_put(db, "sca:z", "x", 1);
+  kadedb_lite_put(db, "scan;", "x", 1);
+  kadedb_lite_put(db, "scan_more:a", "x", 1);
+
+  const char *all[] = {"a", "b", "bb", "c", "d"};
+  const char *after_b[] = {"bb", "c", "d"};
+  const char *upto_b[] = {"a", "b"};
+  const char *not_c[] = {"a", "b", "bb", "d"};
+  const char *v2[] = {"b", "d"};
+  if (!expect_ids(db, "SELECT * FROM scan", all, 5) ||
+      !expect_ids(db, "SELECT * FROM scan LIMIT 2", all, 2) ||
+      !expect_ids(db, "SELECT * FROM scan LIMIT 0", all, 0) ||
+      !expect_ids(db, "SELECT * FROM scan WHERE id > 'b'", after_b, 3) ||
+      !expect_ids(db, "SELECT * FROM scan WHERE id >= 'bb'", after_b, 3) ||
+      !expect_ids(db, "SELECT * FROM scan WHERE id <= 'b'", upto_b, 2) ||
+      !expect_ids(db, "SELECT * FROM scan WHERE id < 'bb'", upto_b, 2) ||
+      !expect_ids(db, "SELECT * FROM scan WHERE id < 'bb' LIMIT 1", upto_b,
+                  1) ||
+      !expect_ids(db, "SELECT * FROM scan WHERE id != 'c'", not_c, 4) ||
+      !expect_ids(db, "SELECT * FROM scan WHERE value = 'v2'", v2, 2) ||
+      !expect_ids(db, "SELECT * FROM scan WHERE id > 'z'", all, 0) ||
+      !expect_ids(db, "SELECT * FROM scan_empty", all, 0)) {
+    return 0;
+  }
+
+  PASS();
+  return 1;
+}
+
 static int test_execute_select_not_found(kadedb_lite_t *db) {
   TEST("execute SELECT for non-existent key");
 
@@ -343,9 +549,9 @@ static int test_execute_error_handling(kadedb_lite_t *db) {
   kadedb_lite_result_free(r1);
 
   kadedb_lite_result_t *r2 =
-      kadedb_lite_execute_query(db, "SELECT * FROM table");
+      kadedb_lite_execute_query(db, "SELECT * FROM table WHERE other = 'x'");
   if (!r2 || !kadedb_lite_result_error(r2)) {
-    FAIL("SELECT without WHERE should return error");
+    FAIL("SELECT on an unknown column should return error");
     if (r2)
       kadedb_lite_result_free(r2);
     return 0;
@@ -438,6 +644,200 @@ static int test_result_accessors(kadedb_lite_t *db) {
   return 1;
 }
 
+static int test_parse_create(void) {
+  TEST("parse CREATE TABLE and CREATE INDEX");
+
+  kadedb_lite_parsed_query_t *q = kadedb_lite_parse_query(
+      "CREATE TABLE IF NOT EXISTS t (id INTEGER, name TEXT)");
+  if (!q || q->type != KADEDB_LITE_QUERY_CREATE_TABLE || !q->if_not_exists ||
+      strcmp(q->table, "t") != 0 || q->column_count != 2 ||
+      q->value_count != 2 || strcmp(q->columns[1], "name") != 0 ||
+      strcmp(q->values[0], "INTEGER") != 0) {
+    FAIL("CREATE TABLE parsed wrong");
+    kadedb_lite_parsed_query_free(q);
+    return 0;
+  }
+  kadedb_lite_parsed_query_free(q);
+
+  q = kadedb_lite_parse_query("CREATE INDEX by_name ON t (name)");
+  if (!q || q->type != KADEDB_LITE_QUERY_CREATE_INDEX || q->if_not_exists ||
+      strcmp(q->table, "t") != 0 || q->column_count != 1 ||
+      strcmp(q->columns[0], "name") != 0) {
+    FAIL("CREATE INDEX parsed wrong");
+    kadedb_lite_parsed_query_free(q);
+    return 0;
+  }
+  kadedb_lite_parsed_query_free(q);
+
+  const char *invalid[] = {"CREATE TABLE t ()", "CREATE TABLE t (id)",
+                           "CREATE INDEX ON t", "CREATE VIEW v"};
+  for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+    q = kadedb_lite_parse_query(invalid[i]);
+    if (q) {
+      FAIL(invalid[i]);
+      kadedb_lite_parsed_query_free(q);
+      return 0;
+    }
+  }
+
+  PASS();
+  return 1;
+}
+
+// Like expect_ids, for typed tables: checks the first column of any width
+static int expect_first(kadedb_lite_t *db, const char *query,
+                        const char **expected, size_t count) {
+  kadedb_lite_result_t *r = kadedb_lite_execute_query(db, query);
+  if (!r || kadedb_lite_result_error(r)) {
+    printf("FAIL: %s: %s\n", query,
+           r && kadedb_lite_result_error(r) ? kadedb_lite_result_error(r)
+                                            : "bad result");
+    kadedb_lite_result_free(r);
+    return 0;
+  }
+  int ok = kadedb_lite_result_row_count(r) == count;
+  if (!ok)
+    printf("FAIL: %s: %zu rows, expected %zu\n", query,
+           kadedb_lite_result_row_count(r), count);
+  for (size_t i = 0; ok && i < count; i++) {
+    const char *v = kadedb_lite_result_value(r, i, 0);
+    if (!v || strcmp(v, expected[i]) != 0) {
+      printf("FAIL: %s: row %zu is %s, expected %s\n", query, i,
+             v ? v : "NULL", expected[i]);
+      ok = 0;
+    }
+  }
+  kadedb_lite_result_free(r);
+  return ok;
+}
+
+// Runs `query`; 1 when its success matches `should_succeed`
+static int run_query(kadedb_lite_t *db, const char *query,
+                     int should_succeed) {
+  kadedb_lite_result_t *r = kadedb_lite_execute_query(db, query);
+  int ok = r && (kadedb_lite_result_error(r) == NULL) == should_succeed;
+  if (!ok)
+    printf("FAIL: %s: %s\n", query,
+           r && kadedb_lite_result_error(r) ? kadedb_lite_result_error(r)
+                                            : "unexpected success");
+  kadedb_lite_result_free(r);
+  return ok;
+}
+
+static int test_execute_typed_tables(kadedb_lite_t *db) {
+  TEST("execute typed tables and secondary indexes");
+
+  const char *create = "CREATE TABLE IF NOT EXISTS people (id INTEGER, "
+                       "name TEXT, age INTEGER, score FLOAT, active BOOLEAN)";
+  if (!run_query(db, create, 1) ||
+      !run_query(db, "CREATE TABLE bad (name TEXT)", 0) ||
+      !run_query(db, "CREATE TABLE bad (id INTEGER, x BLOB)", 0)) {
+    return 0;
+  }
+  if (stub_mode) {
+    // Nothing is stored, so every table stays untyped
+    PASS();
+    return 1;
+  }
+
+  if (!run_query(db, "CREATE TABLE people (id INTEGER)", 0) ||
+      !run_query(db,
+                 "INSERT INTO people (id, name, age, score, active) VALUES "
+                 "(3, 'carol', 41, 2.5, true), (1, 'alice', 30, -1.25, false),"
+                 " (2, 'bob', 25, 0.1, 1), (10, 'dave', -5, 1e3, FALSE)",
+                 1) ||
+      !run_query(db, "INSERT INTO people (id, name) VALUES (4, 'erin')", 1)) {
+    return 0;
+  }
+
+  // Rows sort by their key text; missing cells read as NULL
+  const char *all[] = {"1", "10", "2", "3", "4"};
+  const char *bob[] = {"bob", "25", "0.1", "true"};
+  const char *older[] = {"1", "3"};
+  const char *active[] = {"2", "3"};
+  const char *not41[] = {"1", "10", "2"};
+  if (!expect_first(db, "SELECT * FROM people", all, 5) ||
+      !expect_first(db, "SELECT id FROM people WHERE age > 26", older, 2) ||
+      !expect_first(db, "SELECT id FROM people WHERE active = true", active,
+                    2) ||
+      !expect_first(db, "SELECT * FROM people WHERE age != 41", not41, 3)) {
+    return 0;
+  }
+  kadedb_lite_result_t *r = kadedb_lite_execute_query(
+      db, "SELECT name, age, score, active, id FROM people WHERE id = 2");
+  int ok = r && !kadedb_lite_result_error(r) &&
+           kadedb_lite_result_row_count(r) == 1 &&
+           kadedb_lite_result_column_count(r) == 5;
+  for (size_t i = 0; ok && i < 4; i++) {
+    const char *v = kadedb_lite_result_value(r, 0, i);
+    ok = v && strcmp(v, bob[i]) == 0;
+  }
+  kadedb_lite_result_free(r);
+  r = kadedb_lite_execute_query(db, "SELECT age FROM people WHERE id = 4");
+  ok = ok && r && kadedb_lite_result_row_count(r) == 1 &&
+       kadedb_lite_result_value(r, 0, 0) == NULL;
+  kadedb_lite_result_free(r);
+  if (!ok) {
+    FAIL("typed values read back wrong");
+    return 0;
+  }
+
+  // Index scans come back in value order
+  const char *young[] = {"10", "2"};
+  const char *at41[] = {"3"};
+  const char *first[] = {"10"};
+  if (!run_query(db, "CREATE INDEX ON people (age)", 1) ||
+      !run_query(db, "CREATE INDEX ON people (age)", 0) ||
+      !run_query(db, "CREATE INDEX IF NOT EXISTS ON people (age)", 1) ||
+      !run_query(db, "CREATE INDEX ON people (nope)", 0) ||
+      !expect_first(db, "SELECT id FROM people WHERE age > 26", older, 2) ||
+      !expect_first(db, "SELECT id FROM people WHERE age >= 30", older, 2) ||
+      !expect_first(db, "SELECT id FROM people WHERE age < 26", young, 2) ||
+      !expect_first(db, "SELECT id FROM people WHERE age <= 25", young, 2) ||
+      !expect_first(db, "SELECT id FROM people WHERE age = 41", at41, 1) ||
+      !expect_first(db, "SELECT id FROM people WHERE age < 99 LIMIT 1", first,
+                    1) ||
+      !expect_first(db, "SELECT * FROM people WHERE age != 41", not41, 3)) {
+    return 0;
+  }
+
+  // Replacing a row moves its index entries
+  const char *over26[] = {"1"};
+  const char *at20[] = {"3"};
+  const char *negative[] = {"1"};
+  const char *positive[] = {"2", "10"};
+  const char *from_bob[] = {"2", "3", "10", "4"};
+  if (!run_query(db, "INSERT INTO people (id, name, age) VALUES (3, 'carol', "
+                     "20)",
+                 1) ||
+      !expect_first(db, "SELECT id FROM people WHERE age > 26", over26, 1) ||
+      !expect_first(db, "SELECT id FROM people WHERE age = 20", at20, 1) ||
+      !expect_first(db, "SELECT id FROM people WHERE age = 41", at20, 0) ||
+      !run_query(db, "CREATE INDEX ON people (score)", 1) ||
+      !run_query(db, "CREATE INDEX ON people (name)", 1) ||
+      !expect_first(db, "SELECT id FROM people WHERE score < 0", negative,
+                    1) ||
+      !expect_first(db, "SELECT id FROM people WHERE score >= 0.1", positive,
+                    2) ||
+      !expect_first(db, "SELECT id FROM people WHERE name >= 'bob'", from_bob,
+                    4)) {
+    return 0;
+  }
+
+  if (!run_query(db, "INSERT INTO people (id, age) VALUES (5, 'old')", 0) ||
+      !run_query(db, "INSERT INTO people (name) VALUES ('x')", 0) ||
+      !run_query(db, "INSERT INTO people (id, x) VALUES (5, 1)", 0) ||
+      !run_query(db, "INSERT INTO people (id) VALUES (5), (5)", 0) ||
+      !run_query(db, "SELECT bogus FROM people", 0) ||
+      !run_query(db, "SELECT * FROM people WHERE age = 'x'", 0) ||
+      !expect_first(db, "SELECT id FROM people WHERE id = 5", all, 0)) {
+    return 0;
+  }
+
+  PASS();
+  return 1;
+}
+
 static int test_operators(void) {
   TEST("parse different operators");
 
@@ -484,8 +884,11 @@ int main(void) {
   test_parse_select_columns();
   test_parse_select_where();
   test_parse_insert();
+  test_parse_insert_multi_row();
+  test_parse_select_limit();
   test_parse_invalid();
   test_operators();
+  test_parse_create();
 
   printf("\nExecution Tests:\n");
 
@@ -520,9 +923,12 @@ int main(void) {
   }
 
   test_execute_insert_and_select(db);
+  test_execute_multi_row_insert(db);
+  test_execute_scans(db);
   test_execute_select_not_found(db);
   test_execute_error_handling(db);
   test_result_accessors(db);
+  test_execute_typed_tables(db);
 
   kadedb_lite_close(db);
 
@@ -75,5 +75,53 @@ int main(void) {
     kadedb_lite_free(out);
 
   kadedb_lite_close(db);
+
+  // Every profile, and single options set on top of one, opens a usable db
+  const kadedb_lite_profile_t profiles[] = {KADEDB_LITE_PROFILE_DEFAULT,
+                                            KADEDB_LITE_PROFILE_MOBILE,
+                                            KADEDB_LITE_PROFILE_SERVER};
+  for (size_t i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++) {
+    opts = kadedb_lite_options_create();
+    if (!opts) {
+      fprintf(stderr, "kadedb_lite_options_create failed\n");
+      return 7;
+    }
+    kadedb_lite_options_set_profile(opts, profiles[i]);
+    if (profiles[i] == KADEDB_LITE_PROFILE_MOBILE) {
+      kadedb_lite_options_set_compaction_style(
+          opts, KADEDB_LITE_COMPACTION_UNIVERSAL);
+      kadedb_lite_options_set_bloom_filter_bits_per_key(opts, 6.5);
+    } else if (profiles[i] == KADEDB_LITE_PROFILE_DEFAULT) {
+      kadedb_lite_options_set_bloom_filter_bits_per_key(opts, 0);
+      kadedb_lite_options_set_cache_index_and_filter_blocks(opts, 1);
+      kadedb_lite_options_set_partitioned_index_filters(opts, 1);
+    }
+    db = kadedb_lite_open_with_options(path, opts);
+    kadedb_lite_options_destroy(opts);
+    if (!db) {
+      fprintf(stderr, "kadedb_lite_open with profile %d failed\n",
+              (int)profiles[i]);
+      return 8;
+    }
+    out = NULL;
+    if (kadedb_lite_put(db, key, val, strlen(val)) != 0 ||
+        kadedb_lite_get(db, key, &out, &out_len) != 0 || !out ||
+        (!allow_stub && strcmp(out, val) != 0)) {
+      fprintf(stderr, "round trip with profile %d failed\n",
+              (int)profiles[i]);
+      kadedb_lite_free(out);
+      kadedb_lite_close(db);
+      return 9;
+    }
+    kadedb_lite_free(out);
+    kadedb_lite_delete(db, key);
+    kadedb_lite_close(db);
+  }
+
+  // Setters ignore a NULL options handle
+  kadedb_lite_options_set_profile(NULL, KADEDB_LITE_PROFILE_SERVER);
+  kadedb_lite_options_set_bloom_filter_bits_per_key(NULL, 10);
+  kadedb_lite_options_set_compaction_style(NULL,
+                                           KADEDB_LITE_COMPACTION_LEVEL);
   return 0;
 }
@@ -1,6 +1,6 @@
 use axum::{
     extract::State,
-    http::StatusCode,
+    http::{header, StatusCode},
     middleware,
     response::IntoResponse,
     routing::{get, post},
@@ -28,6 +28,7 @@ pub fn router(auth_cfg: AuthConfig) -> Router {
 
     Router::new()
         .route("/health", get(health))
+        .route("/metrics", get(metrics))
         .merge(protected_read)
         .merge(protected_write)
 }
@@ -69,6 +70,26 @@ async fn health() -> Json<HealthResponse> {
     Json(HealthResponse { status: "ok" })
 }
 
+const PROMETHEUS_CONTENT_TYPE: &str = "text/plain; version=0.0.4; charset=utf-8";
+
+// Unauthenticated, like /health, so that scrapers need no token
+#[cfg(feature = "engine-metrics")]
+async fn metrics() -> impl IntoResponse {
+    (
+        [(header::CONTENT_TYPE, PROMETHEUS_CONTENT_TYPE)],
+        kadedb_services_ffi::metrics_prometheus(),
+    )
+}
+
+#[cfg(not(feature = "engine-metrics"))]
+async fn metrics() -> impl IntoResponse {
+    (
+        StatusCode::SERVICE_UNAVAILABLE,
+        [(header::CONTENT_TYPE, PROMETHEUS_CONTENT_TYPE)],
+        "# engine metrics unavailable: built without the engine-metrics feature\n",
+    )
+}
+
 #[derive(Debug, Deserialize)]
 struct QueryRequest {
     query: String,
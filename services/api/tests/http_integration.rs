@@ -57,3 +57,41 @@ async fn query_endpoint_requires_auth_when_enabled() {
 
     server.abort();
 }
+
+#[tokio::test]
+async fn metrics_endpoint_serves_prometheus_text_without_auth() {
+    let listener = tokio::net::TcpListener::bind("127.0.0.1:0")
+        .await
+        .expect("bind");
+    let addr = listener.local_addr().expect("local_addr");
+
+    let server = tokio::spawn(async move {
+        api::serve(
+            listener,
+            AuthConfig {
+                enabled: true,
+                jwt_secret: Some("secret".to_string()),
+            },
+        )
+        .await;
+    });
+
+    let url = format!("http://{addr}/metrics");
+    let res = reqwest::get(url).await.expect("http get");
+    let content_type = res
+        .headers()
+        .get(reqwest::header::CONTENT_TYPE)
+        .and_then(|v| v.to_str().ok())
+        .unwrap_or_default()
+        .to_string();
+    assert!(content_type.starts_with("text/plain; version=0.0.4"));
+    if cfg!(feature = "engine-metrics") {
+        assert!(res.status().is_success());
+        let body = res.text().await.expect("body");
+        assert!(body.contains("# TYPE kadedb_operations_total counter"));
+    } else {
+        assert_eq!(res.status(), reqwest::StatusCode::SERVICE_UNAVAILABLE);
+    }
+
+    server.abort();
+}
@@ -70,7 +70,10 @@ async fn main() {
                 .await
                 .expect("connect");
 
-            let mut req = tonic::Request::new(QueryRequest { query });
+            let mut req = tonic::Request::new(QueryRequest {
+                query,
+                ..Default::default()
+            });
             if let Some(token) = token {
                 req.metadata_mut().insert(
                     "authorization",
@@ -1,5 +1,7 @@
-use std::ffi::{CStr, CString};
+use std::ffi::{c_void, CStr, CString};
 use std::ptr::NonNull;
+use std::sync::Arc;
+use std::time::Duration;
 
 #[derive(Debug, thiserror::Error)]
 pub enum FfiError {
@@ -9,6 +11,18 @@ pub enum FfiError {
     #[error("query returned null result set")]
     ExecuteQueryFailed,
 
+    #[error("query failed: {0}")]
+    QueryFailed(String),
+
+    #[error("replication failed: {0}")]
+    Replication(String),
+
+    #[error("distributed query failed: {0}")]
+    Distributed(String),
+
+    #[error("change capture failed: {0}")]
+    ChangeCapture(String),
+
     #[error("invalid utf8")]
     Utf8(#[from] std::str::Utf8Error),
 }
@@ -33,6 +47,69 @@ mod sys {
         _private: [u8; 0],
     }
 
+    #[repr(C)]
+    pub struct KadeDB_Query {
+        _private: [u8; 0],
+    }
+
+    #[repr(C)]
+    pub struct KadeDB_CancelToken {
+        _private: [u8; 0],
+    }
+
+    #[repr(C)]
+    pub struct KadeDB_Span {
+        _private: [u8; 0],
+    }
+
+    #[repr(C)]
+    pub struct KadeDB_WalShipper {
+        _private: [u8; 0],
+    }
+
+    #[repr(C)]
+    pub struct KadeDB_Replica {
+        _private: [u8; 0],
+    }
+
+    #[repr(C)]
+    pub struct KadeDB_DistributedQuery {
+        _private: [u8; 0],
+    }
+
+    #[repr(C)]
+    pub struct KadeDB_Subscription {
+        _private: [u8; 0],
+    }
+
+    #[repr(C)]
+    #[derive(Clone, Copy)]
+    pub union KDB_ValueData {
+        pub i64: i64,
+        pub f64: f64,
+        pub str: *const i8,
+        pub boolean: i32,
+    }
+
+    #[repr(C)]
+    pub struct KDB_Value {
+        pub ty: i32,
+        pub data: KDB_ValueData,
+    }
+
+    #[repr(C)]
+    pub struct KDB_Predicate {
+        pub column: *const i8,
+        pub op: i32,
+        pub rhs: KDB_Value,
+    }
+
+    pub type KadeDB_QueryCallback = extern "C" fn(
+        user_data: *mut std::ffi::c_void,
+        rs: *mut KadeDB_ResultSet,
+        error: *const i8,
+    );
+
     extern "C" {
         pub fn KadeDB_CreateStorage() -> *mut KadeDB_Storage;
         pub fn KadeDB_DestroyStorage(storage: *mut KadeDB_Storage);
@@ -42,11 +119,167 @@ mod sys {
             query: *const i8,
         ) -> *mut KadeDB_ResultSet;
 
+        pub fn KadeDB_ExecuteQueryAsync(
+            storage: *mut KadeDB_Storage,
+            query: *const i8,
+            token: *mut KadeDB_CancelToken,
+            callback: KadeDB_QueryCallback,
+            user_data: *mut std::ffi::c_void,
+        ) -> i32;
+
         pub fn KadeDB_ResultSet_NextRow(rs: *mut KadeDB_ResultSet) -> i32;
         pub fn KadeDB_ResultSet_ColumnCount(rs: *mut KadeDB_ResultSet) -> i32;
         pub fn KadeDB_ResultSet_GetString(rs: *mut KadeDB_ResultSet, column: i32) -> *const i8;
+        pub fn KadeDB_ResultSet_GetColumnName(rs: *mut KadeDB_ResultSet, column: i32)
+            -> *const i8;
 
         pub fn KadeDB_DestroyResultSet(rs: *mut KadeDB_ResultSet);
+
+        pub fn KadeDB_Query_Open(
+            storage: *mut KadeDB_Storage,
+            query: *const i8,
+            batch_rows: u64,
+        ) -> *mut KadeDB_Query;
+        pub fn KadeDB_Query_FetchBatch(query: *mut KadeDB_Query) -> *mut KadeDB_ResultSet;
+        pub fn KadeDB_Query_GetLastError(query: *mut KadeDB_Query) -> *const i8;
+        pub fn KadeDB_Query_Close(query: *mut KadeDB_Query);
+
+        pub fn KadeDB_Metrics_ToPrometheus(
+            out_buf: *mut i8,
+            out_buf_len: u64,
+            out_required_len: *mut u64,
+        ) -> i32;
+
+        pub fn KadeDB_Trace_SetParent(traceparent: *const i8) -> i32;
+        pub fn KadeDB_Trace_StartSpan(name: *const i8) -> *mut KadeDB_Span;
+        pub fn KadeDB_Trace_EndSpan(span: *mut KadeDB_Span);
+
+        pub fn KadeDB_WalShipper_Open(
+            wal_path: *const i8,
+            after_lsn: u64,
+            max_segment_bytes: u64,
+            compress: i32,
+        ) -> *mut KadeDB_WalShipper;
+        pub fn KadeDB_WalShipper_Next(
+            shipper: *mut KadeDB_WalShipper,
+            out_data: *mut *const u8,
+            out_len: *mut u64,
+            out_first_lsn: *mut u64,
+            out_last_lsn: *mut u64,
+            out_tail: *mut i32,
+        ) -> i32;
+        pub fn KadeDB_WalShipper_GetLastError(shipper: *mut KadeDB_WalShipper) -> *const i8;
+        pub fn KadeDB_WalShipper_Close(shipper: *mut KadeDB_WalShipper);
+
+        pub fn KadeDB_Replica_Create(
+            storage: *mut KadeDB_Storage,
+            applied_lsn: u64,
+        ) -> *mut KadeDB_Replica;
+        pub fn KadeDB_Replica_Apply(
+            replica: *mut KadeDB_Replica,
+            data: *const u8,
+            len: u64,
+            first_lsn: u64,
+            last_lsn: u64,
+            tail: i32,
+        ) -> i32;
+        pub fn KadeDB_Replica_AppliedLsn(replica: *mut KadeDB_Replica) -> u64;
+        pub fn KadeDB_Replica_StalenessMillis(replica: *mut KadeDB_Replica) -> i64;
+        pub fn KadeDB_Replica_ExecuteQuery(
+            replica: *mut KadeDB_Replica,
+            query: *const i8,
+            max_staleness_ms: u64,
+        ) -> *mut KadeDB_ResultSet;
+        pub fn KadeDB_Replica_GetLastError(replica: *mut KadeDB_Replica) -> *const i8;
+        pub fn KadeDB_Replica_Destroy(replica: *mut KadeDB_Replica);
+
+        pub fn KadeDB_DistributedQuery_Plan(query: *const i8) -> *mut KadeDB_DistributedQuery;
+        pub fn KadeDB_DistributedQuery_Fragment(query: *const KadeDB_DistributedQuery)
+            -> *const i8;
+        pub fn KadeDB_DistributedQuery_Merge(
+            query: *mut KadeDB_DistributedQuery,
+            results: *const *const u8,
+            lens: *const u64,
+            count: u64,
+        ) -> *mut KadeDB_ResultSet;
+        pub fn KadeDB_DistributedQuery_Execute(
+            query: *mut KadeDB_DistributedQuery,
+            nodes: *const *mut KadeDB_Storage,
+            count: u64,
+        ) -> *mut KadeDB_ResultSet;
+        pub fn KadeDB_DistributedQuery_GetLastError(
+            query: *mut KadeDB_DistributedQuery,
+        ) -> *const i8;
+        pub fn KadeDB_DistributedQuery_Destroy(query: *mut KadeDB_DistributedQuery);
+        pub fn KadeDB_ResultSet_EncodeFragment(
+            rs: *mut KadeDB_ResultSet,
+            compress: i32,
+            out_data: *mut *const u8,
+            out_len: *mut u64,
+        ) -> i32;
+
+        pub fn KadeDB_EnableChangeCapture(storage: *mut KadeDB_Storage, capacity: u64) -> i32;
+        pub fn KadeDB_Subscribe(
+            storage: *mut KadeDB_Storage,
+            table: *const i8,
+            where_predicate: *const KDB_Predicate,
+        ) -> *mut KadeDB_Subscription;
+        pub fn KadeDB_Subscription_Poll(
+            sub: *mut KadeDB_Subscription,
+            max_changes: u64,
+            wait_ms: u64,
+        ) -> *mut KadeDB_ResultSet;
+        pub fn KadeDB_Subscription_Position(sub: *mut KadeDB_Subscription) -> u64;
+        pub fn KadeDB_Subscription_Lag(sub: *mut KadeDB_Subscription) -> u64;
+        pub fn KadeDB_Subscription_GetLastError(sub: *mut KadeDB_Subscription) -> *const i8;
+        pub fn KadeDB_Subscription_Cancel(sub: *mut KadeDB_Subscription);
+        pub fn KadeDB_Subscription_Close(sub: *mut KadeDB_Subscription);
+    }
+}
+
+/// The engine's operation counters and latency histograms in the Prometheus
+/// text exposition format (version 0.0.4).
+pub fn metrics_prometheus() -> String {
+    let mut buf: Vec<u8> = Vec::new();
+    loop {
+        let mut need: u64 = 0;
+        unsafe {
+            sys::KadeDB_Metrics_ToPrometheus(
+                buf.as_mut_ptr() as *mut i8,
+                buf.len() as u64,
+                &mut need,
+            )
+        };
+        // Operations recorded between calls may lengthen the text
+        if !buf.is_empty() && need as usize <= buf.len() {
+            buf.truncate(need as usize - 1);
+            return String::from_utf8_lossy(&buf).into_owned();
+        }
+        buf = vec![0u8; need as usize + 1024];
+    }
+}
+
+/// Make the W3C `traceparent` header value the parent of the engine spans
+/// this thread starts, until it is replaced or cleared with `None`.
+/// Returns false for a malformed value, which clears the parent.
+pub fn set_trace_parent(traceparent: Option<&str>) -> bool {
+    let c = traceparent.and_then(|t| CString::new(t).ok());
+    let ptr = c.as_ref().map_or(std::ptr::null(), |c| c.as_ptr());
+    unsafe { sys::KadeDB_Trace_SetParent(ptr) != 0 }
+}
+
+// Engine span around a piece of work on this thread; ends when dropped
+struct TraceSpan(*mut sys::KadeDB_Span);
+
+impl TraceSpan {
+    fn start(name: &'static [u8]) -> Self {
+        Self(unsafe { sys::KadeDB_Trace_StartSpan(name.as_ptr() as *const i8) })
+    }
+}
+
+impl Drop for TraceSpan {
+    fn drop(&mut self) {
+        unsafe { sys::KadeDB_Trace_EndSpan(self.0) };
     }
 }
 
@@ -75,7 +308,42 @@ impl Storage {
         &self,
         query: String,
     ) -> Result<Vec<Vec<String>>, FfiError> {
-        // This is a blocking FFI call; run in a blocking task.
+        self.execute_query_rows_as_strings_traced(query, None).await
+    }
+
+    /// Same as `execute_query_rows_as_strings`, with the engine's spans
+    /// continuing the trace of `traceparent` (a W3C header value).
+    pub async fn execute_query_rows_as_strings_traced(
+        &self,
+        query: String,
+        traceparent: Option<String>,
+    ) -> Result<Vec<Vec<String>>, FfiError> {
+        let c_query = CString::new(query.as_str()).expect("query contains NUL");
+        // SELECTs run on the native pool and complete through a callback, so
+        // no runtime thread blocks while they execute
+        let (tx, rx) = tokio::sync::oneshot::channel::<RowsResult>();
+        let tx = Box::into_raw(Box::new(tx));
+        // The query takes the parent when queued; nothing awaits in between,
+        // so no other task sees it on this runtime thread
+        set_trace_parent(traceparent.as_deref());
+        let queued = unsafe {
+            sys::KadeDB_ExecuteQueryAsync(
+                self.raw.as_ptr(),
+                c_query.as_ptr(),
+                std::ptr::null_mut(),
+                on_rows_done,
+                tx as *mut c_void,
+            )
+        };
+        set_trace_parent(None);
+        if queued != 0 {
+            // The storage waits for the callback before it is destroyed
+            return rx.await.expect("query callback");
+        }
+        // Not queued, so the callback never runs: reclaim the sender
+        drop(unsafe { Box::from_raw(tx) });
+
+        // Other statements take the blocking call on a blocking task.
         // IMPORTANT: do not move `NonNull` across threads; move a raw pointer instead.
         // Also, do not drop/destroy the storage from the blocking thread.
         let storage = StorageRaw(self.raw.as_ptr() as usize);
@@ -84,16 +352,94 @@ impl Storage {
             let c_query = CString::new(query).expect("query contains NUL");
 
             let storage_ptr = storage.0 as *mut sys::KadeDB_Storage;
+            set_trace_parent(traceparent.as_deref());
             let rs = sys::KadeDB_ExecuteQuery(storage_ptr, c_query.as_ptr());
-            let rs = NonNull::new(rs).ok_or(FfiError::ExecuteQueryFailed)?;
-            let mut rs = ResultSet { raw: rs };
-            rs.all_rows_as_strings()
+            let out = NonNull::new(rs)
+                .ok_or(FfiError::ExecuteQueryFailed)
+                .and_then(|raw| ResultSet { raw }.all_rows_as_strings());
+            set_trace_parent(None);
+            out
         })
         .await
         .expect("spawn_blocking")
     }
 }
 
+type RowsResult = Result<Vec<Vec<String>>, FfiError>;
+
+// Completion of KadeDB_ExecuteQueryAsync; `user_data` is the boxed sender
+extern "C" fn on_rows_done(
+    user_data: *mut c_void,
+    rs: *mut sys::KadeDB_ResultSet,
+    error: *const i8,
+) {
+    let tx = unsafe { Box::from_raw(user_data as *mut tokio::sync::oneshot::Sender<RowsResult>) };
+    let out = match NonNull::new(rs) {
+        Some(raw) => ResultSet { raw }.all_rows_as_strings(),
+        None if error.is_null() => Err(FfiError::ExecuteQueryFailed),
+        None => {
+            let msg = unsafe { CStr::from_ptr(error) };
+            Err(FfiError::QueryFailed(msg.to_string_lossy().into_owned()))
+        }
+    };
+    // The receiver may have been dropped with its future
+    let _ = tx.send(out);
+}
+
+impl Storage {
+    /// Capture every write to the storage's tables from now on, in a ring of
+    /// `capacity` changes (0: the engine's default). No effect once enabled.
+    pub fn enable_change_capture(&self, capacity: u64) -> Result<(), FfiError> {
+        if unsafe { sys::KadeDB_EnableChangeCapture(self.raw.as_ptr(), capacity) } == 0 {
+            return Err(FfiError::ChangeCapture(
+                "cannot enable change capture".to_string(),
+            ));
+        }
+        Ok(())
+    }
+
+    /// Subscribe to the changes of `table` from now on, only to the rows
+    /// matching `filter` when set (an update when its old or new row does).
+    pub fn subscribe(
+        &self,
+        table: &str,
+        filter: Option<&RowFilter>,
+    ) -> Result<Subscription, FfiError> {
+        let c_table = CString::new(table).expect("table contains NUL");
+        let c_column;
+        let c_text;
+        let mut predicate = None;
+        if let Some(f) = filter {
+            c_column = CString::new(f.column.as_str()).expect("column contains NUL");
+            let (ty, data) = match &f.value {
+                FilterValue::Null => (0, sys::KDB_ValueData { i64: 0 }),
+                FilterValue::Integer(v) => (1, sys::KDB_ValueData { i64: *v }),
+                FilterValue::Float(v) => (2, sys::KDB_ValueData { f64: *v }),
+                FilterValue::String(v) => {
+                    c_text = CString::new(v.as_str()).expect("value contains NUL");
+                    (3, sys::KDB_ValueData { str: c_text.as_ptr() })
+                }
+                FilterValue::Boolean(v) => (4, sys::KDB_ValueData { boolean: *v as i32 }),
+            };
+            predicate = Some(sys::KDB_Predicate {
+                column: c_column.as_ptr(),
+                op: f.op as i32,
+                rhs: sys::KDB_Value { ty, data },
+            });
+        }
+        let where_ptr = predicate
+            .as_ref()
+            .map_or(std::ptr::null(), |p| p as *const sys::KDB_Predicate);
+        let raw = unsafe { sys::KadeDB_Subscribe(self.raw.as_ptr(), c_table.as_ptr(), where_ptr) };
+        let raw = NonNull::new(raw).ok_or_else(|| {
+            FfiError::ChangeCapture(format!(
+                "cannot subscribe to {table}: no such table or capture disabled"
+            ))
+        })?;
+        Ok(Subscription { raw })
+    }
+}
+
 impl Drop for Storage {
     fn drop(&mut self) {
         unsafe { sys::KadeDB_DestroyStorage(self.raw.as_ptr()) };
@@ -115,6 +461,12 @@ impl ResultSet {
         unsafe { sys::KadeDB_ResultSet_NextRow(self.raw.as_ptr()) != 0 }
     }
 
+    pub fn column_name(&self, column: i32) -> Option<String> {
+        let ptr = unsafe { sys::KadeDB_ResultSet_GetColumnName(self.raw.as_ptr(), column) };
+        let ptr = NonNull::new(ptr as *mut i8)?;
+        Some(unsafe { CStr::from_ptr(ptr.as_ptr()) }.to_string_lossy().into_owned())
+    }
+
     pub fn get_string(&self, column: i32) -> Option<String> {
         let ptr = unsafe { sys::KadeDB_ResultSet_GetString(self.raw.as_ptr(), column) };
         let ptr = NonNull::new(ptr as *mut i8)?;
@@ -122,7 +474,28 @@ impl ResultSet {
         Some(s.to_str().ok()?.to_string())
     }
 
+    /// All rows as a node's encoded fragment result (see
+    /// `DistributedQuery::merge`), LZ4-compressed when `compress` is set.
+    pub fn encode_fragment(&self, compress: bool) -> Result<Vec<u8>, FfiError> {
+        let mut data: *const u8 = std::ptr::null();
+        let mut len = 0u64;
+        let ok = unsafe {
+            sys::KadeDB_ResultSet_EncodeFragment(
+                self.raw.as_ptr(),
+                compress as i32,
+                &mut data,
+                &mut len,
+            )
+        };
+        if ok == 0 {
+            return Err(FfiError::Distributed("cannot encode result".to_string()));
+        }
+        // The bytes belong to the result set until its next call
+        Ok(unsafe { std::slice::from_raw_parts(data, len as usize) }.to_vec())
+    }
+
     pub fn all_rows_as_strings(&mut self) -> Result<Vec<Vec<String>>, FfiError> {
+        let _span = TraceSpan::start(b"ffi.serialize\0");
         let cols = self.column_count();
         if cols < 0 {
             return Ok(vec![]);
@@ -145,3 +518,392 @@ impl Drop for ResultSet {
         unsafe { sys::KadeDB_DestroyResultSet(self.raw.as_ptr()) };
     }
 }
+
+/// A running SELECT whose rows arrive in batches as the engine produces
+/// them; see `Query::open`. Dropping it stops the scan.
+pub struct Query {
+    raw: NonNull<sys::KadeDB_Query>,
+    // Queries must close before their storage is destroyed
+    _storage: Arc<Storage>,
+}
+
+// The native cursor may move between threads but is used by one at a time
+unsafe impl Send for Query {}
+
+impl Query {
+    /// Start `query`, a SELECT, producing batches of `batch_rows` rows (0:
+    /// the engine's default). Blocks until the first batch is ready; fails
+    /// on a syntax error, another statement or an error before that batch.
+    pub fn open(storage: Arc<Storage>, query: &str, batch_rows: u64) -> Result<Self, FfiError> {
+        let c_query = CString::new(query).expect("query contains NUL");
+        let raw =
+            unsafe { sys::KadeDB_Query_Open(storage.raw.as_ptr(), c_query.as_ptr(), batch_rows) };
+        let raw = NonNull::new(raw).ok_or(FfiError::ExecuteQueryFailed)?;
+        Ok(Self {
+            raw,
+            _storage: storage,
+        })
+    }
+
+    /// The next batch, blocking until it is ready; `None` once the query is
+    /// exhausted. A query without rows yields one empty batch.
+    pub fn fetch_batch(&mut self) -> Result<Option<ResultSet>, FfiError> {
+        let rs = unsafe { sys::KadeDB_Query_FetchBatch(self.raw.as_ptr()) };
+        if let Some(raw) = NonNull::new(rs) {
+            return Ok(Some(ResultSet { raw }));
+        }
+        let err = unsafe { sys::KadeDB_Query_GetLastError(self.raw.as_ptr()) };
+        if err.is_null() {
+            return Ok(None);
+        }
+        Err(FfiError::QueryFailed(last_error(err, "query failed")))
+    }
+}
+
+impl Drop for Query {
+    fn drop(&mut self) {
+        unsafe { sys::KadeDB_Query_Close(self.raw.as_ptr()) };
+    }
+}
+
+// Owned copy of a NUL-terminated error message, if any
+fn last_error(ptr: *const i8, fallback: &str) -> String {
+    if ptr.is_null() {
+        return fallback.to_string();
+    }
+    unsafe { CStr::from_ptr(ptr) }.to_string_lossy().into_owned()
+}
+
+/// Records `first_lsn..=last_lsn` of a leader's write-ahead log as one
+/// binary blob, or a heartbeat without records (`first_lsn == last_lsn + 1`).
+/// `tail` is set when the leader had no later record.
+#[derive(Clone, Debug, Default, PartialEq, Eq)]
+pub struct WalSegment {
+    pub data: Vec<u8>,
+    pub first_lsn: u64,
+    pub last_lsn: u64,
+    pub tail: bool,
+}
+
+impl WalSegment {
+    pub fn records(&self) -> u64 {
+        self.last_lsn + 1 - self.first_lsn
+    }
+}
+
+/// Leader side of one replication stream: cuts the write-ahead log file at
+/// a path into segments for a follower. Calls do file I/O, so async callers
+/// make them on a blocking task.
+pub struct WalShipper {
+    raw: NonNull<sys::KadeDB_WalShipper>,
+}
+
+// A shipper is used by one thread at a time
+unsafe impl Send for WalShipper {}
+
+impl WalShipper {
+    /// Ship the log at `wal_path` from the record after `after_lsn`, in
+    /// segments of about `max_segment_bytes` (0: 1 MiB).
+    pub fn open(
+        wal_path: &str,
+        after_lsn: u64,
+        max_segment_bytes: u64,
+        compress: bool,
+    ) -> Result<Self, FfiError> {
+        let c_path = CString::new(wal_path).expect("path contains NUL");
+        let raw = unsafe {
+            sys::KadeDB_WalShipper_Open(
+                c_path.as_ptr(),
+                after_lsn,
+                max_segment_bytes,
+                compress as i32,
+            )
+        };
+        let raw = NonNull::new(raw)
+            .ok_or_else(|| FfiError::Replication(format!("cannot open {wal_path}")))?;
+        Ok(Self { raw })
+    }
+
+    /// The records written since the previous segment, or a heartbeat.
+    pub fn next_segment(&mut self) -> Result<WalSegment, FfiError> {
+        let mut data: *const u8 = std::ptr::null();
+        let (mut len, mut first_lsn, mut last_lsn, mut tail) = (0u64, 0u64, 0u64, 0i32);
+        let ok = unsafe {
+            sys::KadeDB_WalShipper_Next(
+                self.raw.as_ptr(),
+                &mut data,
+                &mut len,
+                &mut first_lsn,
+                &mut last_lsn,
+                &mut tail,
+            )
+        };
+        if ok == 0 {
+            let err = unsafe { sys::KadeDB_WalShipper_GetLastError(self.raw.as_ptr()) };
+            return Err(FfiError::Replication(last_error(err, "segment failed")));
+        }
+        // The bytes belong to the shipper until the next call
+        let data = unsafe { std::slice::from_raw_parts(data, len as usize) }.to_vec();
+        Ok(WalSegment {
+            data,
+            first_lsn,
+            last_lsn,
+            tail: tail != 0,
+        })
+    }
+}
+
+impl Drop for WalShipper {
+    fn drop(&mut self) {
+        unsafe { sys::KadeDB_WalShipper_Close(self.raw.as_ptr()) };
+    }
+}
+
+/// Follower side: applies a leader's segments to a storage and serves
+/// reads from it within a staleness bound.
+pub struct Replica {
+    raw: NonNull<sys::KadeDB_Replica>,
+    // The replica writes to the storage, which must outlive it
+    storage: Arc<Storage>,
+}
+
+// The native replica serializes applies and guards its state
+unsafe impl Send for Replica {}
+unsafe impl Sync for Replica {}
+
+impl Replica {
+    /// Replicate into `storage`, which already holds the log records up to
+    /// `applied_lsn` (0 for an empty storage) and is not written otherwise.
+    pub fn new(storage: Arc<Storage>, applied_lsn: u64) -> Result<Self, FfiError> {
+        let raw = unsafe { sys::KadeDB_Replica_Create(storage.raw.as_ptr(), applied_lsn) };
+        let raw = NonNull::new(raw)
+            .ok_or_else(|| FfiError::Replication("cannot create replica".to_string()))?;
+        Ok(Self { raw, storage })
+    }
+
+    pub fn storage(&self) -> &Arc<Storage> {
+        &self.storage
+    }
+
+    /// Apply a segment; it must follow `applied_lsn()`.
+    pub fn apply(&self, segment: &WalSegment) -> Result<(), FfiError> {
+        let ok = unsafe {
+            sys::KadeDB_Replica_Apply(
+                self.raw.as_ptr(),
+                segment.data.as_ptr(),
+                segment.data.len() as u64,
+                segment.first_lsn,
+                segment.last_lsn,
+                segment.tail as i32,
+            )
+        };
+        if ok == 0 {
+            return Err(FfiError::Replication(self.error("apply failed")));
+        }
+        Ok(())
+    }
+
+    pub fn applied_lsn(&self) -> u64 {
+        unsafe { sys::KadeDB_Replica_AppliedLsn(self.raw.as_ptr()) }
+    }
+
+    /// Time since the replica last held every record of its leader; `None`
+    /// before it first caught up.
+    pub fn staleness(&self) -> Option<Duration> {
+        let ms = unsafe { sys::KadeDB_Replica_StalenessMillis(self.raw.as_ptr()) };
+        (ms >= 0).then(|| Duration::from_millis(ms as u64))
+    }
+
+    /// Run a KadeQL SELECT on the replica, refused with
+    /// `FfiError::QueryFailed` when it is further than `max_staleness`
+    /// behind its leader.
+    pub fn query_rows_as_strings(
+        &self,
+        query: &str,
+        max_staleness: Duration,
+    ) -> Result<Vec<Vec<String>>, FfiError> {
+        let c_query = CString::new(query).expect("query contains NUL");
+        let rs = unsafe {
+            sys::KadeDB_Replica_ExecuteQuery(
+                self.raw.as_ptr(),
+                c_query.as_ptr(),
+                max_staleness.as_millis() as u64,
+            )
+        };
+        match NonNull::new(rs) {
+            Some(raw) => ResultSet { raw }.all_rows_as_strings(),
+            None => Err(FfiError::QueryFailed(self.error("query failed"))),
+        }
+    }
+
+    fn error(&self, fallback: &str) -> String {
+        last_error(
+            unsafe { sys::KadeDB_Replica_GetLastError(self.raw.as_ptr()) },
+            fallback,
+        )
+    }
+}
+
+impl Drop for Replica {
+    fn drop(&mut self) {
+        unsafe { sys::KadeDB_Replica_Destroy(self.raw.as_ptr()) };
+    }
+}
+
+/// A SELECT planned for scatter-gather over a table split across nodes:
+/// each node runs `fragment()` on its share (e.g. through
+/// `Storage::execute_query` and `ResultSet::encode_fragment`) and the
+/// coordinator merges the encoded results.
+pub struct DistributedQuery {
+    raw: NonNull<sys::KadeDB_DistributedQuery>,
+}
+
+// The native plan is immutable; its error message is guarded
+unsafe impl Send for DistributedQuery {}
+unsafe impl Sync for DistributedQuery {}
+
+impl DistributedQuery {
+    /// Plan `query`, a single-table SELECT; refused when it does not parse
+    /// or cannot be distributed.
+    pub fn plan(query: &str) -> Result<Self, FfiError> {
+        let c_query = CString::new(query).expect("query contains NUL");
+        let raw = unsafe { sys::KadeDB_DistributedQuery_Plan(c_query.as_ptr()) };
+        let raw = NonNull::new(raw)
+            .ok_or_else(|| FfiError::Distributed("cannot distribute query".to_string()))?;
+        Ok(Self { raw })
+    }
+
+    /// The KadeQL every node runs.
+    pub fn fragment(&self) -> String {
+        let ptr = unsafe { sys::KadeDB_DistributedQuery_Fragment(self.raw.as_ptr()) };
+        unsafe { CStr::from_ptr(ptr) }.to_string_lossy().into_owned()
+    }
+
+    /// Merge the nodes' encoded fragment results into the query's result.
+    pub fn merge(&self, results: &[Vec<u8>]) -> Result<ResultSet, FfiError> {
+        let ptrs: Vec<*const u8> = results.iter().map(|r| r.as_ptr()).collect();
+        let lens: Vec<u64> = results.iter().map(|r| r.len() as u64).collect();
+        let rs = unsafe {
+            sys::KadeDB_DistributedQuery_Merge(
+                self.raw.as_ptr(),
+                ptrs.as_ptr(),
+                lens.as_ptr(),
+                results.len() as u64,
+            )
+        };
+        self.result(rs, "merge failed")
+    }
+
+    /// Run the query with local storages as the nodes, in parallel.
+    pub fn execute(&self, nodes: &[&Storage]) -> Result<ResultSet, FfiError> {
+        let raws: Vec<*mut sys::KadeDB_Storage> = nodes.iter().map(|s| s.raw.as_ptr()).collect();
+        let rs = unsafe {
+            sys::KadeDB_DistributedQuery_Execute(
+                self.raw.as_ptr(),
+                raws.as_ptr(),
+                raws.len() as u64,
+            )
+        };
+        self.result(rs, "execute failed")
+    }
+
+    fn result(
+        &self,
+        rs: *mut sys::KadeDB_ResultSet,
+        fallback: &str,
+    ) -> Result<ResultSet, FfiError> {
+        match NonNull::new(rs) {
+            Some(raw) => Ok(ResultSet { raw }),
+            None => Err(FfiError::Distributed(last_error(
+                unsafe { sys::KadeDB_DistributedQuery_GetLastError(self.raw.as_ptr()) },
+                fallback,
+            ))),
+        }
+    }
+}
+
+impl Drop for DistributedQuery {
+    fn drop(&mut self) {
+        unsafe { sys::KadeDB_DistributedQuery_Destroy(self.raw.as_ptr()) };
+    }
+}
+
+/// Comparison operators of a `RowFilter`.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum CompareOp {
+    Eq = 0,
+    Ne = 1,
+    Lt = 2,
+    Le = 3,
+    Gt = 4,
+    Ge = 5,
+}
+
+#[derive(Clone, Debug, PartialEq)]
+pub enum FilterValue {
+    Null,
+    Integer(i64),
+    Float(f64),
+    String(String),
+    Boolean(bool),
+}
+
+/// `column op value`, e.g. the rows a `Subscription` reports.
+#[derive(Clone, Debug, PartialEq)]
+pub struct RowFilter {
+    pub column: String,
+    pub op: CompareOp,
+    pub value: FilterValue,
+}
+
+/// The changes to one table, read in order through the subscription's own
+/// cursor; see `Storage::subscribe`. Writers never wait for it: once it
+/// falls more than the capture ring behind, `poll` fails and the reader must
+/// read the table again and resubscribe.
+pub struct Subscription {
+    raw: NonNull<sys::KadeDB_Subscription>,
+}
+
+// The native cursor may move between threads but is used by one at a time
+unsafe impl Send for Subscription {}
+
+impl Subscription {
+    /// The next changes, at most `max_changes` (0: no limit), waiting up to
+    /// `wait` while there are none: columns `seq` and `change` (INSERT,
+    /// UPDATE, DELETE, TRUNCATE or DROP), then the table's columns. An empty
+    /// result set means nothing changed in time; an error, that the
+    /// subscription ended (dropped table, fell behind or cancelled).
+    pub fn poll(&mut self, max_changes: u64, wait: Duration) -> Result<ResultSet, FfiError> {
+        let rs = unsafe {
+            sys::KadeDB_Subscription_Poll(self.raw.as_ptr(), max_changes, wait.as_millis() as u64)
+        };
+        match NonNull::new(rs) {
+            Some(raw) => Ok(ResultSet { raw }),
+            None => Err(FfiError::ChangeCapture(last_error(
+                unsafe { sys::KadeDB_Subscription_GetLastError(self.raw.as_ptr()) },
+                "subscription ended",
+            ))),
+        }
+    }
+
+    /// Seq of the last change considered.
+    pub fn position(&self) -> u64 {
+        unsafe { sys::KadeDB_Subscription_Position(self.raw.as_ptr()) }
+    }
+
+    /// Changes published after `position()`.
+    pub fn lag(&self) -> u64 {
+        unsafe { sys::KadeDB_Subscription_Lag(self.raw.as_ptr()) }
+    }
+
+    /// End the subscription; later polls fail.
+    pub fn cancel(&self) {
+        unsafe { sys::KadeDB_Subscription_Cancel(self.raw.as_ptr()) };
+    }
+}
+
+impl Drop for Subscription {
+    fn drop(&mut self) {
+        unsafe { sys::KadeDB_Subscription_Close(self.raw.as_ptr()) };
+    }
+}
@@ -0,0 +1,71 @@
+//! `QueryService::QueryBatches` over a storage: the rows come from the
+//! engine's streaming cursor a batch at a time and go out in the binary
+//! format the engine encodes them in, so no row is formatted as JSON.
+
+use std::pin::Pin;
+use std::sync::Arc;
+
+use kadedb_services_ffi::{Query, Storage};
+use tokio::sync::mpsc;
+use tokio_stream::wrappers::ReceiverStream;
+use tonic::Status;
+
+use crate::kadedb::RowBatch;
+
+/// Rows per batch when the request does not ask for a size
+pub const DEFAULT_BATCH_ROWS: u32 = 4096;
+/// Most rows per batch the server sends, whatever the request asks for
+pub const MAX_BATCH_ROWS: u32 = 65536;
+// Batches buffered per stream before fetching pauses for the client
+const BUFFERED_BATCHES: usize = 4;
+
+pub type RowBatchStream =
+    Pin<Box<dyn tokio_stream::Stream<Item = Result<RowBatch, Status>> + Send>>;
+
+/// Rows per batch for a request asking for `requested` (0: the default).
+pub fn negotiate(requested: u32) -> u32 {
+    match requested {
+        0 => DEFAULT_BATCH_ROWS,
+        n => n.min(MAX_BATCH_ROWS),
+    }
+}
+
+/// Run `query` on `storage` and stream its rows in batches of
+/// `negotiate(batch_rows)` rows. Fails before the stream starts when the
+/// query does not run; an error after the first batch ends the stream.
+pub async fn stream(
+    storage: Arc<Storage>,
+    query: String,
+    batch_rows: u32,
+    compress: bool,
+) -> Result<RowBatchStream, Status> {
+    let batch_rows = negotiate(batch_rows);
+    // Opening waits for the first batch and fetching blocks on the engine;
+    // keep both off the runtime
+    let mut cursor =
+        tokio::task::spawn_blocking(move || Query::open(storage, &query, batch_rows as u64))
+            .await
+            .map_err(|e| Status::internal(e.to_string()))?
+            .map_err(|e| Status::invalid_argument(e.to_string()))?;
+
+    // The bounded channel is the backpressure: a slow client pauses the
+    // fetches, and with them the scan
+    let (tx, rx) = mpsc::channel(BUFFERED_BATCHES);
+    tokio::task::spawn_blocking(move || loop {
+        let batch = match cursor.fetch_batch() {
+            Ok(Some(rs)) => rs
+                .encode_fragment(compress)
+                .map(|data| RowBatch { data, batch_rows })
+                .map_err(|e| Status::internal(e.to_string())),
+            Ok(None) => return,
+            Err(e) => Err(Status::aborted(e.to_string())),
+        };
+        let failed = batch.is_err();
+        // A client gone away drops the cursor, which stops the scan
+        if tx.blocking_send(batch).is_err() || failed {
+            return;
+        }
+    });
+
+    Ok(Box::pin(ReceiverStream::new(rx)))
+}
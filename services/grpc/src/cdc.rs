@@ -0,0 +1,273 @@
+//! Change data capture over gRPC. `ChangeService` streams the rows written
+//! to a table as they commit; `StorageQueryService` runs KadeQL on the same
+//! storage, so writes made through it reach the subscribers.
+
+use std::pin::Pin;
+use std::sync::Arc;
+use std::time::Duration;
+
+use kadedb_services_auth::AuthConfig;
+use kadedb_services_ffi::{CompareOp, FilterValue, ResultSet, RowFilter, Storage, Subscription};
+use tokio::sync::mpsc;
+use tokio_stream::wrappers::{ReceiverStream, TcpListenerStream};
+use tonic::{transport::Server, Request, Response, Status};
+
+use crate::authorize;
+use crate::batches::{self, RowBatchStream};
+use crate::kadedb::change_service_server::{ChangeService, ChangeServiceServer};
+use crate::kadedb::query_service_server::{QueryService, QueryServiceServer};
+use crate::kadedb::{
+    Change, ChangeBatch, QueryBatchesRequest, QueryRequest, QueryRow, SubscribeRequest,
+};
+
+/// Change stream settings.
+#[derive(Clone, Debug)]
+pub struct ChangeConfig {
+    /// Changes the storage keeps for subscribers that fell behind; one
+    /// further behind fails (0: the engine's default)
+    pub capacity: u64,
+    /// Changes per batch unless the request asks for fewer
+    pub max_batch: u32,
+    /// How long a poll waits for changes; also how soon a stream notices
+    /// its client went away while the table is idle
+    pub poll_wait: Duration,
+    /// Batches buffered per stream before polling pauses for the client
+    pub buffered_batches: usize,
+}
+
+impl Default for ChangeConfig {
+    fn default() -> Self {
+        Self {
+            capacity: 0,
+            max_batch: 1024,
+            poll_wait: Duration::from_millis(200),
+            buffered_batches: 4,
+        }
+    }
+}
+
+pub struct ChangeServiceImpl {
+    storage: Arc<Storage>,
+    cfg: ChangeConfig,
+}
+
+impl ChangeServiceImpl {
+    /// Serve the changes of `storage`, enabling its change capture.
+    pub fn new(storage: Arc<Storage>, cfg: ChangeConfig) -> Result<Self, Status> {
+        storage
+            .enable_change_capture(cfg.capacity)
+            .map_err(|e| Status::internal(e.to_string()))?;
+        Ok(Self { storage, cfg })
+    }
+}
+
+#[tonic::async_trait]
+impl ChangeService for ChangeServiceImpl {
+    type SubscribeStream =
+        Pin<Box<dyn tokio_stream::Stream<Item = Result<ChangeBatch, Status>> + Send>>;
+
+    async fn subscribe(
+        &self,
+        request: Request<SubscribeRequest>,
+    ) -> Result<Response<Self::SubscribeStream>, Status> {
+        let req = request.into_inner();
+        let filter = parse_filter(&req)?;
+        let sub = self
+            .storage
+            .subscribe(&req.table, filter.as_ref())
+            .map_err(|e| Status::not_found(e.to_string()))?;
+        let max_batch = match req.max_batch {
+            0 => self.cfg.max_batch,
+            n => n.min(self.cfg.max_batch),
+        };
+
+        // The bounded channel is the backpressure: a slow client stops the
+        // poller, never the writers, and overruns only its own cursor
+        let (tx, rx) = mpsc::channel(self.cfg.buffered_batches.max(1));
+        let wait = self.cfg.poll_wait;
+        // Polls block on the engine; keep them off the runtime
+        tokio::task::spawn_blocking(move || stream_changes(sub, max_batch, wait, tx));
+
+        Ok(Response::new(
+            Box::pin(ReceiverStream::new(rx)) as Self::SubscribeStream
+        ))
+    }
+}
+
+// Poll `sub` into `tx` until the table is dropped, the subscription fails
+// or the client goes away
+fn stream_changes(
+    mut sub: Subscription,
+    max_batch: u32,
+    wait: Duration,
+    tx: mpsc::Sender<Result<ChangeBatch, Status>>,
+) {
+    loop {
+        let batch = match sub.poll(max_batch as u64, wait) {
+            Ok(mut rs) => to_batch(&mut rs),
+            Err(e) => {
+                let _ = tx.blocking_send(Err(Status::aborted(e.to_string())));
+                return;
+            }
+        };
+        if batch.changes.is_empty() {
+            if tx.is_closed() {
+                return;
+            }
+            continue;
+        }
+        let dropped = batch.changes.last().is_some_and(|c| c.kind == "DROP");
+        if tx.blocking_send(Ok(batch)).is_err() || dropped {
+            return;
+        }
+    }
+}
+
+// Columns seq and change, then the table's, as in Subscription::poll
+fn to_batch(rs: &mut ResultSet) -> ChangeBatch {
+    let cols = rs.column_count().max(0);
+    let columns = (2..cols)
+        .map(|i| rs.column_name(i).unwrap_or_default())
+        .collect();
+    let mut changes = Vec::new();
+    while rs.next_row() {
+        let seq = rs
+            .get_string(0)
+            .and_then(|s| s.parse().ok())
+            .unwrap_or_default();
+        let kind = rs.get_string(1).unwrap_or_default();
+        let row: Vec<String> = (2..cols)
+            .map(|i| rs.get_string(i).unwrap_or_default())
+            .collect();
+        changes.push(Change {
+            seq,
+            // Strings come back as literals
+            kind: kind.trim_matches('"').to_string(),
+            row: serde_json::json!(row).to_string(),
+        });
+    }
+    ChangeBatch { columns, changes }
+}
+
+fn parse_filter(req: &SubscribeRequest) -> Result<Option<RowFilter>, Status> {
+    if req.filter_column.is_empty() {
+        return Ok(None);
+    }
+    let op = match req.filter_op.as_str() {
+        "=" => CompareOp::Eq,
+        "!=" => CompareOp::Ne,
+        "<" => CompareOp::Lt,
+        "<=" => CompareOp::Le,
+        ">" => CompareOp::Gt,
+        ">=" => CompareOp::Ge,
+        other => {
+            return Err(Status::invalid_argument(format!(
+                "unknown operator {other}"
+            )))
+        }
+    };
+    let value = match serde_json::from_str(&req.filter_value) {
+        Ok(serde_json::Value::Null) => FilterValue::Null,
+        Ok(serde_json::Value::Bool(b)) => FilterValue::Boolean(b),
+        Ok(serde_json::Value::Number(n)) => match n.as_i64() {
+            Some(i) => FilterValue::Integer(i),
+            None => FilterValue::Float(n.as_f64().unwrap_or_default()),
+        },
+        Ok(serde_json::Value::String(s)) => FilterValue::String(s),
+        _ => {
+            return Err(Status::invalid_argument(
+                "filter_value must be a JSON scalar",
+            ))
+        }
+    };
+    Ok(Some(RowFilter {
+        column: req.filter_column.clone(),
+        op,
+        value,
+    }))
+}
+
+/// `QueryService` over a storage: runs each KadeQL statement and streams
+/// the rows as JSON arrays of the column values, or as binary row batches
+/// (see `batches::stream`).
+pub struct StorageQueryService {
+    storage: Arc<Storage>,
+}
+
+impl StorageQueryService {
+    pub fn new(storage: Arc<Storage>) -> Self {
+        Self { storage }
+    }
+}
+
+#[tonic::async_trait]
+impl QueryService for StorageQueryService {
+    type QueryStream = Pin<Box<dyn tokio_stream::Stream<Item = Result<QueryRow, Status>> + Send>>;
+
+    async fn query(
+        &self,
+        request: Request<QueryRequest>,
+    ) -> Result<Response<Self::QueryStream>, Status> {
+        let rows = self
+            .storage
+            .execute_query_rows_as_strings(request.into_inner().query)
+            .await
+            .map_err(|e| Status::invalid_argument(e.to_string()))?;
+
+        let (tx, rx) = mpsc::channel(8);
+        tokio::spawn(async move {
+            for row in rows {
+                let json = serde_json::json!(row).to_string();
+                if tx.send(Ok(QueryRow { json })).await.is_err() {
+                    break;
+                }
+            }
+        });
+
+        Ok(Response::new(
+            Box::pin(ReceiverStream::new(rx)) as Self::QueryStream
+        ))
+    }
+
+    type QueryBatchesStream = RowBatchStream;
+
+    async fn query_batches(
+        &self,
+        request: Request<QueryBatchesRequest>,
+    ) -> Result<Response<Self::QueryBatchesStream>, Status> {
+        let req = request.into_inner();
+        let stream = batches::stream(
+            self.storage.clone(),
+            req.query,
+            req.batch_rows,
+            req.compress,
+        )
+        .await?;
+        Ok(Response::new(stream))
+    }
+}
+
+/// Serve queries on `storage` and the changes they make.
+pub async fn serve_with_listener(
+    listener: tokio::net::TcpListener,
+    auth_cfg: AuthConfig,
+    storage: Arc<Storage>,
+    cfg: ChangeConfig,
+) {
+    let changes = ChangeServiceImpl::new(storage.clone(), cfg).expect("change capture");
+    let query_auth = auth_cfg.clone();
+    let query = QueryServiceServer::with_interceptor(
+        StorageQueryService::new(storage),
+        move |req: Request<()>| authorize(&query_auth, req),
+    );
+    let changes = ChangeServiceServer::with_interceptor(changes, move |req: Request<()>| {
+        authorize(&auth_cfg, req)
+    });
+
+    Server::builder()
+        .add_service(query)
+        .add_service(changes)
+        .serve_with_incoming(TcpListenerStream::new(listener))
+        .await
+        .expect("serve");
+}
@@ -0,0 +1,207 @@
+//! Scatter-gather queries over gRPC. Every node serves `FragmentService`:
+//! it runs the fragments a coordinator sends on its share of the table and
+//! returns the rows as one binary batch. The coordinator answers
+//! `QueryService` by planning each query with `DistributedQuery`, sending
+//! its fragment to all nodes at once and merging their batches.
+
+use std::pin::Pin;
+use std::sync::Arc;
+
+use kadedb_services_auth::AuthConfig;
+use kadedb_services_ffi::{DistributedQuery, Storage};
+use tokio::sync::mpsc;
+use tokio_stream::wrappers::{ReceiverStream, TcpListenerStream};
+use tonic::{transport::Server, Request, Response, Status};
+
+use crate::authorize;
+use crate::kadedb::fragment_service_client::FragmentServiceClient;
+use crate::kadedb::fragment_service_server::{FragmentService, FragmentServiceServer};
+use crate::kadedb::query_service_server::{QueryService, QueryServiceServer};
+use crate::kadedb::{
+    FragmentRequest, FragmentResult, QueryBatchesRequest, QueryRequest, QueryRow, RowBatch,
+};
+use crate::QueryServiceImpl;
+
+/// `FragmentService` of a node: runs fragments on its storage and returns
+/// their rows LZ4-compressed.
+pub struct FragmentServiceImpl {
+    storage: Arc<Storage>,
+}
+
+impl FragmentServiceImpl {
+    pub fn new(storage: Arc<Storage>) -> Self {
+        Self { storage }
+    }
+}
+
+#[tonic::async_trait]
+impl FragmentService for FragmentServiceImpl {
+    async fn execute_fragment(
+        &self,
+        request: Request<FragmentRequest>,
+    ) -> Result<Response<FragmentResult>, Status> {
+        let query = request.into_inner().query;
+        let storage = self.storage.clone();
+        // The scan runs on the engine; keep it off the runtime
+        let batch = tokio::task::spawn_blocking(move || {
+            storage
+                .execute_query(&query)
+                .and_then(|rs| rs.encode_fragment(true))
+        })
+        .await
+        .map_err(|e| Status::internal(e.to_string()))?
+        .map_err(|e| Status::invalid_argument(e.to_string()))?;
+        Ok(Response::new(FragmentResult { batch }))
+    }
+}
+
+/// Coordinator settings.
+#[derive(Clone, Debug)]
+pub struct CoordinatorConfig {
+    /// The nodes' endpoints (e.g. "http://10.0.0.1:50051"); each holds a
+    /// share of every distributed table
+    pub nodes: Vec<String>,
+    /// Bearer token presented to the nodes
+    pub token: Option<String>,
+}
+
+/// `QueryService` of a coordinator: runs each query across the nodes and
+/// streams the merged rows as JSON arrays of the column values. A query
+/// fails when any node does.
+pub struct CoordinatorQueryService {
+    cfg: CoordinatorConfig,
+}
+
+impl CoordinatorQueryService {
+    pub fn new(cfg: CoordinatorConfig) -> Self {
+        Self { cfg }
+    }
+}
+
+#[tonic::async_trait]
+impl QueryService for CoordinatorQueryService {
+    type QueryStream = Pin<Box<dyn tokio_stream::Stream<Item = Result<QueryRow, Status>> + Send>>;
+
+    async fn query(
+        &self,
+        request: Request<QueryRequest>,
+    ) -> Result<Response<Self::QueryStream>, Status> {
+        let plan = DistributedQuery::plan(&request.into_inner().query)
+            .map_err(|e| Status::invalid_argument(e.to_string()))?;
+        let fragment = plan.fragment();
+
+        // Fan out: every node runs the fragment at the same time
+        let calls: Vec<_> = self
+            .cfg
+            .nodes
+            .iter()
+            .map(|node| {
+                tokio::spawn(execute_fragment(
+                    node.clone(),
+                    fragment.clone(),
+                    self.cfg.token.clone(),
+                ))
+            })
+            .collect();
+        let mut batches = Vec::with_capacity(calls.len());
+        for call in calls {
+            batches.push(call.await.map_err(|e| Status::internal(e.to_string()))??);
+        }
+
+        // The merge runs the final stages on the engine
+        let rows = tokio::task::spawn_blocking(move || {
+            plan.merge(&batches).and_then(|mut rs| rs.all_rows_as_strings())
+        })
+        .await
+        .map_err(|e| Status::internal(e.to_string()))?
+        .map_err(|e| Status::internal(e.to_string()))?;
+
+        let (tx, rx) = mpsc::channel(8);
+        tokio::spawn(async move {
+            for row in rows {
+                let json = serde_json::json!(row).to_string();
+                if tx.send(Ok(QueryRow { json })).await.is_err() {
+                    break;
+                }
+            }
+        });
+
+        Ok(Response::new(
+            Box::pin(ReceiverStream::new(rx)) as Self::QueryStream
+        ))
+    }
+
+    type QueryBatchesStream =
+        Pin<Box<dyn tokio_stream::Stream<Item = Result<RowBatch, Status>> + Send>>;
+
+    async fn query_batches(
+        &self,
+        _request: Request<QueryBatchesRequest>,
+    ) -> Result<Response<Self::QueryBatchesStream>, Status> {
+        // The merged result is one result set, not a cursor to batch
+        Err(Status::unimplemented(
+            "row batches are not served by a coordinator",
+        ))
+    }
+}
+
+// Run `fragment` on the node at `endpoint` and return its batch
+async fn execute_fragment(
+    endpoint: String,
+    fragment: String,
+    token: Option<String>,
+) -> Result<Vec<u8>, Status> {
+    let mut client = FragmentServiceClient::connect(endpoint.clone())
+        .await
+        .map_err(|e| Status::unavailable(format!("{endpoint}: {e}")))?;
+
+    let mut req = Request::new(FragmentRequest { query: fragment });
+    if let Some(token) = token {
+        let value = format!("Bearer {token}")
+            .parse()
+            .map_err(|_| Status::invalid_argument("malformed token"))?;
+        req.metadata_mut().insert("authorization", value);
+    }
+    Ok(client.execute_fragment(req).await?.into_inner().batch)
+}
+
+/// Serve a node: the query service and the fragments of `storage`.
+pub async fn serve_node_with_listener(
+    listener: tokio::net::TcpListener,
+    auth_cfg: AuthConfig,
+    storage: Arc<Storage>,
+) {
+    let query_auth = auth_cfg.clone();
+    let query = QueryServiceServer::with_interceptor(QueryServiceImpl, move |req: Request<()>| {
+        authorize(&query_auth, req)
+    });
+    let fragments = FragmentServiceServer::with_interceptor(
+        FragmentServiceImpl::new(storage),
+        move |req: Request<()>| authorize(&auth_cfg, req),
+    );
+
+    Server::builder()
+        .add_service(query)
+        .add_service(fragments)
+        .serve_with_incoming(TcpListenerStream::new(listener))
+        .await
+        .expect("serve");
+}
+
+/// Serve a coordinator's queries across `coordinator.nodes`.
+pub async fn serve_coordinator_with_listener(
+    listener: tokio::net::TcpListener,
+    auth_cfg: AuthConfig,
+    coordinator: CoordinatorConfig,
+) {
+    let svc = QueryServiceServer::with_interceptor(
+        CoordinatorQueryService::new(coordinator),
+        move |req: Request<()>| authorize(&auth_cfg, req),
+    );
+
+    Server::builder()
+        .add_service(svc)
+        .serve_with_incoming(TcpListenerStream::new(listener))
+        .await
+        .expect("serve");
+}
@@ -9,6 +9,18 @@ pub mod kadedb {
     tonic::include_proto!("kadedb");
 }
 
+#[cfg(feature = "replication")]
+pub mod replication;
+
+#[cfg(feature = "distributed")]
+pub mod distributed;
+
+#[cfg(feature = "cdc")]
+pub mod cdc;
+
+#[cfg(any(feature = "replication", feature = "cdc"))]
+pub mod batches;
+
 fn map_auth_error(err: AuthError) -> Status {
     match err {
         AuthError::Forbidden => Status::permission_denied("forbidden"),
@@ -17,7 +29,7 @@ fn map_auth_error(err: AuthError) -> Status {
 }
 
 use kadedb::query_service_server::{QueryService, QueryServiceServer};
-use kadedb::{QueryRequest, QueryRow};
+use kadedb::{QueryBatchesRequest, QueryRequest, QueryRow, RowBatch};
 
 #[derive(Default)]
 pub struct QueryServiceImpl;
@@ -52,6 +64,19 @@ impl QueryService for QueryServiceImpl {
             Box::pin(ReceiverStream::new(rx)) as Self::QueryStream
         ))
     }
+
+    type QueryBatchesStream =
+        Pin<Box<dyn tokio_stream::Stream<Item = Result<RowBatch, Status>> + Send>>;
+
+    async fn query_batches(
+        &self,
+        _request: Request<QueryBatchesRequest>,
+    ) -> Result<Response<Self::QueryBatchesStream>, Status> {
+        // Echoed rows have no engine to encode them
+        Err(Status::unimplemented(
+            "row batches need a storage-backed server",
+        ))
+    }
 }
 
 pub async fn serve(addr: std::net::SocketAddr, auth_cfg: AuthConfig) {
@@ -60,22 +85,9 @@ pub async fn serve(addr: std::net::SocketAddr, auth_cfg: AuthConfig) {
 }
 
 pub async fn serve_with_listener(listener: tokio::net::TcpListener, auth_cfg: AuthConfig) {
-    let interceptor = move |req: Request<()>| -> Result<Request<()>, Status> {
-        if !auth_cfg.enabled {
-            return Ok(req);
-        }
-
-        let header = req
-            .metadata()
-            .get("authorization")
-            .and_then(|v| v.to_str().ok());
-
-        authorize_bearer_header(&auth_cfg, header, Permission::Read)
-            .map(|_| req)
-            .map_err(map_auth_error)
-    };
-
-    let svc = QueryServiceServer::with_interceptor(QueryServiceImpl, interceptor);
+    let svc = QueryServiceServer::with_interceptor(QueryServiceImpl, move |req: Request<()>| {
+        authorize(&auth_cfg, req)
+    });
 
     Server::builder()
         .add_service(svc)
@@ -83,3 +95,19 @@ pub async fn serve_with_listener(listener: tokio::net::TcpListener, auth_cfg: Au
         .await
         .expect("serve");
 }
+
+// Interceptor of every service: the bearer token must grant reads
+pub(crate) fn authorize(auth_cfg: &AuthConfig, req: Request<()>) -> Result<Request<()>, Status> {
+    if !auth_cfg.enabled {
+        return Ok(req);
+    }
+
+    let header = req
+        .metadata()
+        .get("authorization")
+        .and_then(|v| v.to_str().ok());
+
+    authorize_bearer_header(auth_cfg, header, Permission::Read)
+        .map(|_| req)
+        .map_err(map_auth_error)
+}
@@ -13,5 +13,145 @@ async fn main() {
 
     tracing::info!("gRPC listening on {addr}");
 
+    #[cfg(feature = "replication")]
+    {
+        if replication::serve(addr, auth_cfg.clone()).await {
+            return;
+        }
+    }
+
+    #[cfg(feature = "distributed")]
+    {
+        if distributed::serve(addr, auth_cfg.clone()).await {
+            return;
+        }
+    }
+
+    #[cfg(feature = "cdc")]
+    {
+        if cdc::serve(addr, auth_cfg.clone()).await {
+            return;
+        }
+    }
+
     kadedb_services_grpc::serve(addr, auth_cfg).await;
 }
+
+#[cfg(feature = "replication")]
+mod replication {
+    use std::sync::Arc;
+    use std::time::Duration;
+
+    use kadedb_services_auth::AuthConfig;
+    use kadedb_services_ffi::{Replica, Storage};
+    use kadedb_services_grpc::replication::{
+        follow, serve_leader_with_listener, serve_replica_with_listener, LeaderConfig,
+    };
+
+    // Serve as a leader when KADEDB_REPLICATION_WAL names the engine's log,
+    // or as a follower of KADEDB_REPLICATION_LEADER; false for neither
+    pub async fn serve(addr: std::net::SocketAddr, auth_cfg: AuthConfig) -> bool {
+        if let Ok(wal_path) = std::env::var("KADEDB_REPLICATION_WAL") {
+            tracing::info!("shipping {wal_path} to followers");
+            let listener = tokio::net::TcpListener::bind(addr).await.expect("bind");
+            serve_leader_with_listener(listener, auth_cfg, LeaderConfig::new(wal_path)).await;
+            return true;
+        }
+        let Ok(leader) = std::env::var("KADEDB_REPLICATION_LEADER") else {
+            return false;
+        };
+        let max_staleness = std::env::var("KADEDB_REPLICA_MAX_STALENESS_MS")
+            .ok()
+            .and_then(|v| v.parse().ok())
+            .map_or(Duration::from_secs(1), Duration::from_millis);
+        let token = std::env::var("KADEDB_REPLICATION_TOKEN").ok();
+
+        let storage = Arc::new(Storage::new().expect("storage"));
+        let replica = Arc::new(Replica::new(storage, 0).expect("replica"));
+        tracing::info!("following {leader}");
+        let follower = replica.clone();
+        tokio::spawn(async move {
+            loop {
+                if let Err(e) = follow(leader.clone(), follower.clone(), token.clone()).await {
+                    tracing::warn!("replication stream from {leader} ended: {e}");
+                }
+                tokio::time::sleep(Duration::from_secs(1)).await;
+            }
+        });
+
+        let listener = tokio::net::TcpListener::bind(addr).await.expect("bind");
+        serve_replica_with_listener(listener, auth_cfg, replica, max_staleness).await;
+        true
+    }
+}
+
+#[cfg(feature = "distributed")]
+mod distributed {
+    use std::sync::Arc;
+
+    use kadedb_services_auth::AuthConfig;
+    use kadedb_services_ffi::Storage;
+    use kadedb_services_grpc::distributed::{
+        serve_coordinator_with_listener, serve_node_with_listener, CoordinatorConfig,
+    };
+
+    // Coordinate the nodes listed (comma-separated) in KADEDB_DISTRIBUTED_NODES,
+    // or serve fragments as a node when KADEDB_DISTRIBUTED_NODE is set; false
+    // for neither
+    pub async fn serve(addr: std::net::SocketAddr, auth_cfg: AuthConfig) -> bool {
+        if let Ok(nodes) = std::env::var("KADEDB_DISTRIBUTED_NODES") {
+            let nodes: Vec<String> = nodes
+                .split(',')
+                .map(str::trim)
+                .filter(|n| !n.is_empty())
+                .map(String::from)
+                .collect();
+            tracing::info!("coordinating {} nodes", nodes.len());
+            let coordinator = CoordinatorConfig {
+                nodes,
+                token: std::env::var("KADEDB_DISTRIBUTED_TOKEN").ok(),
+            };
+            let listener = tokio::net::TcpListener::bind(addr).await.expect("bind");
+            serve_coordinator_with_listener(listener, auth_cfg, coordinator).await;
+            return true;
+        }
+        if std::env::var_os("KADEDB_DISTRIBUTED_NODE").is_none() {
+            return false;
+        }
+        tracing::info!("serving query fragments");
+        let storage = Arc::new(Storage::new().expect("storage"));
+        let listener = tokio::net::TcpListener::bind(addr).await.expect("bind");
+        serve_node_with_listener(listener, auth_cfg, storage).await;
+        true
+    }
+}
+
+#[cfg(feature = "cdc")]
+mod cdc {
+    use std::sync::Arc;
+
+    use kadedb_services_auth::AuthConfig;
+    use kadedb_services_ffi::Storage;
+    use kadedb_services_grpc::cdc::{serve_with_listener, ChangeConfig};
+
+    // Serve queries and change streams on one storage when KADEDB_CDC is
+    // set, keeping KADEDB_CDC_CAPACITY changes for slow subscribers; false
+    // otherwise
+    pub async fn serve(addr: std::net::SocketAddr, auth_cfg: AuthConfig) -> bool {
+        if std::env::var_os("KADEDB_CDC").is_none() {
+            return false;
+        }
+        let mut cfg = ChangeConfig::default();
+        if let Some(capacity) = std::env::var("KADEDB_CDC_CAPACITY")
+            .ok()
+            .and_then(|v| v.parse().ok())
+        {
+            cfg.capacity = capacity;
+        }
+        tracing::info!("serving change streams");
+        let storage = Arc::new(Storage::new().expect("storage"));
+        let listener = tokio::net::TcpListener::bind(addr).await.expect("bind");
+        serve_with_listener(listener, auth_cfg, storage, cfg).await;
+        true
+    }
+}
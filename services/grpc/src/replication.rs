@@ -0,0 +1,292 @@
+//! Log shipping over gRPC. A leader streams the write-ahead log its engine
+//! writes to followers (`ReplicationService`); each follower applies it to
+//! a local engine through a `Replica` and answers queries from it, within a
+//! staleness bound, with `ReplicaQueryService`.
+
+use std::path::PathBuf;
+use std::pin::Pin;
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+use kadedb_services_auth::AuthConfig;
+use kadedb_services_ffi::{Replica, WalShipper};
+use tokio::sync::mpsc;
+use tokio_stream::wrappers::{ReceiverStream, TcpListenerStream};
+use tonic::{transport::Server, Request, Response, Status};
+
+use crate::authorize;
+use crate::batches::{self, RowBatchStream};
+use crate::kadedb::query_service_server::{QueryService, QueryServiceServer};
+use crate::kadedb::replication_service_client::ReplicationServiceClient;
+use crate::kadedb::replication_service_server::{ReplicationService, ReplicationServiceServer};
+use crate::kadedb::{QueryBatchesRequest, QueryRequest, QueryRow, WalSegment, WalStreamRequest};
+use crate::QueryServiceImpl;
+
+/// Leader settings.
+#[derive(Clone, Debug)]
+pub struct LeaderConfig {
+    /// The write-ahead log the engine writes
+    pub wal_path: PathBuf,
+    /// How often an idle stream looks for new records
+    pub poll_interval: Duration,
+    /// Idle followers get a heartbeat this often; it renews their staleness
+    /// bound, so keep it well below the bound readers ask for
+    pub heartbeat_interval: Duration,
+    /// Segments end after the record that reaches this size
+    pub max_segment_bytes: u64,
+    /// LZ4-compress segments
+    pub compress: bool,
+}
+
+impl LeaderConfig {
+    pub fn new(wal_path: impl Into<PathBuf>) -> Self {
+        Self {
+            wal_path: wal_path.into(),
+            poll_interval: Duration::from_millis(20),
+            heartbeat_interval: Duration::from_millis(200),
+            max_segment_bytes: 1 << 20,
+            compress: true,
+        }
+    }
+}
+
+pub struct ReplicationServiceImpl {
+    cfg: LeaderConfig,
+}
+
+impl ReplicationServiceImpl {
+    pub fn new(cfg: LeaderConfig) -> Self {
+        Self { cfg }
+    }
+}
+
+#[tonic::async_trait]
+impl ReplicationService for ReplicationServiceImpl {
+    type StreamWalStream =
+        Pin<Box<dyn tokio_stream::Stream<Item = Result<WalSegment, Status>> + Send>>;
+
+    async fn stream_wal(
+        &self,
+        request: Request<WalStreamRequest>,
+    ) -> Result<Response<Self::StreamWalStream>, Status> {
+        let after_lsn = request.into_inner().after_lsn;
+        let cfg = self.cfg.clone();
+        let path = cfg
+            .wal_path
+            .to_str()
+            .ok_or_else(|| Status::internal("log path is not UTF-8"))?;
+        let shipper = WalShipper::open(path, after_lsn, cfg.max_segment_bytes, cfg.compress)
+            .map_err(|e| Status::internal(e.to_string()))?;
+
+        let (tx, rx) = mpsc::channel(4);
+        // The shipper reads the log file, so it gets a blocking thread
+        tokio::task::spawn_blocking(move || ship(shipper, &cfg, &tx));
+
+        Ok(Response::new(
+            Box::pin(ReceiverStream::new(rx)) as Self::StreamWalStream
+        ))
+    }
+}
+
+// Send segments until the follower goes away: new records as soon as they
+// are found, and a heartbeat per interval while there are none
+fn ship(
+    mut shipper: WalShipper,
+    cfg: &LeaderConfig,
+    tx: &mpsc::Sender<Result<WalSegment, Status>>,
+) {
+    let mut last_sent: Option<Instant> = None;
+    loop {
+        let seg = match shipper.next_segment() {
+            Ok(seg) => seg,
+            Err(e) => {
+                let _ = tx.blocking_send(Err(Status::internal(e.to_string())));
+                return;
+            }
+        };
+        let idle = seg.records() == 0;
+        if !idle || last_sent.map_or(true, |t| t.elapsed() >= cfg.heartbeat_interval) {
+            let seg = WalSegment {
+                data: seg.data,
+                first_lsn: seg.first_lsn,
+                last_lsn: seg.last_lsn,
+                tail: seg.tail,
+            };
+            if tx.blocking_send(Ok(seg)).is_err() {
+                return;
+            }
+            last_sent = Some(Instant::now());
+        }
+        if idle {
+            if tx.is_closed() {
+                return;
+            }
+            std::thread::sleep(cfg.poll_interval);
+        }
+    }
+}
+
+/// Apply the log of the leader at `endpoint` (e.g. "http://10.0.0.1:50051")
+/// to `replica`, from its last applied record on, until the stream ends or
+/// fails; callers reconnect by calling it again.
+pub async fn follow(
+    endpoint: String,
+    replica: Arc<Replica>,
+    token: Option<String>,
+) -> Result<(), Status> {
+    let mut client = ReplicationServiceClient::connect(endpoint)
+        .await
+        .map_err(|e| Status::unavailable(e.to_string()))?;
+
+    let mut req = Request::new(WalStreamRequest {
+        after_lsn: replica.applied_lsn(),
+    });
+    if let Some(token) = token {
+        let value = format!("Bearer {token}")
+            .parse()
+            .map_err(|_| Status::invalid_argument("malformed token"))?;
+        req.metadata_mut().insert("authorization", value);
+    }
+
+    let mut stream = client.stream_wal(req).await?.into_inner();
+    while let Some(seg) = stream.message().await? {
+        let seg = kadedb_services_ffi::WalSegment {
+            data: seg.data,
+            first_lsn: seg.first_lsn,
+            last_lsn: seg.last_lsn,
+            tail: seg.tail,
+        };
+        let replica = replica.clone();
+        // Applying a segment writes to the engine; keep it off the runtime
+        tokio::task::spawn_blocking(move || replica.apply(&seg))
+            .await
+            .map_err(|e| Status::internal(e.to_string()))?
+            .map_err(|e| Status::internal(e.to_string()))?;
+    }
+    Ok(())
+}
+
+/// `QueryService` of a follower: runs queries on its replica, refusing them
+/// with UNAVAILABLE while the replica lags its leader by more than the
+/// request's `max_staleness_ms` (or the default bound). Rows are JSON
+/// arrays of the column values, or binary row batches.
+pub struct ReplicaQueryService {
+    replica: Arc<Replica>,
+    default_max_staleness: Duration,
+}
+
+impl ReplicaQueryService {
+    pub fn new(replica: Arc<Replica>, default_max_staleness: Duration) -> Self {
+        Self {
+            replica,
+            default_max_staleness,
+        }
+    }
+
+    // The staleness bound of a request asking for `max_staleness_ms` (0:
+    // the default); UNAVAILABLE while the replica lags by more
+    fn check_staleness(&self, max_staleness_ms: u64) -> Result<Duration, Status> {
+        let bound = match max_staleness_ms {
+            0 => self.default_max_staleness,
+            ms => Duration::from_millis(ms),
+        };
+        match self.replica.staleness() {
+            Some(lag) if lag <= bound => Ok(bound),
+            Some(lag) => Err(Status::unavailable(format!(
+                "replica is {} ms behind its leader",
+                lag.as_millis()
+            ))),
+            None => Err(Status::unavailable("replica has not caught up yet")),
+        }
+    }
+}
+
+#[tonic::async_trait]
+impl QueryService for ReplicaQueryService {
+    type QueryStream = Pin<Box<dyn tokio_stream::Stream<Item = Result<QueryRow, Status>> + Send>>;
+
+    async fn query(
+        &self,
+        request: Request<QueryRequest>,
+    ) -> Result<Response<Self::QueryStream>, Status> {
+        let req = request.into_inner();
+        let bound = self.check_staleness(req.max_staleness_ms)?;
+
+        let replica = self.replica.clone();
+        let rows = tokio::task::spawn_blocking(move || {
+            replica.query_rows_as_strings(&req.query, bound)
+        })
+        .await
+        .map_err(|e| Status::internal(e.to_string()))?
+        .map_err(|e| Status::invalid_argument(e.to_string()))?;
+
+        let (tx, rx) = mpsc::channel(8);
+        tokio::spawn(async move {
+            for row in rows {
+                let json = serde_json::json!(row).to_string();
+                if tx.send(Ok(QueryRow { json })).await.is_err() {
+                    break;
+                }
+            }
+        });
+
+        Ok(Response::new(
+            Box::pin(ReceiverStream::new(rx)) as Self::QueryStream
+        ))
+    }
+
+    type QueryBatchesStream = RowBatchStream;
+
+    async fn query_batches(
+        &self,
+        request: Request<QueryBatchesRequest>,
+    ) -> Result<Response<Self::QueryBatchesStream>, Status> {
+        let req = request.into_inner();
+        self.check_staleness(req.max_staleness_ms)?;
+        let storage = self.replica.storage().clone();
+        let stream = batches::stream(storage, req.query, req.batch_rows, req.compress).await?;
+        Ok(Response::new(stream))
+    }
+}
+
+/// Serve a leader: the query service and the log of `leader`.
+pub async fn serve_leader_with_listener(
+    listener: tokio::net::TcpListener,
+    auth_cfg: AuthConfig,
+    leader: LeaderConfig,
+) {
+    let query_auth = auth_cfg.clone();
+    let query = QueryServiceServer::with_interceptor(QueryServiceImpl, move |req: Request<()>| {
+        authorize(&query_auth, req)
+    });
+    let replication = ReplicationServiceServer::with_interceptor(
+        ReplicationServiceImpl::new(leader),
+        move |req: Request<()>| authorize(&auth_cfg, req),
+    );
+
+    Server::builder()
+        .add_service(query)
+        .add_service(replication)
+        .serve_with_incoming(TcpListenerStream::new(listener))
+        .await
+        .expect("serve");
+}
+
+/// Serve a follower's queries from `replica`.
+pub async fn serve_replica_with_listener(
+    listener: tokio::net::TcpListener,
+    auth_cfg: AuthConfig,
+    replica: Arc<Replica>,
+    default_max_staleness: Duration,
+) {
+    let svc = QueryServiceServer::with_interceptor(
+        ReplicaQueryService::new(replica, default_max_staleness),
+        move |req: Request<()>| authorize(&auth_cfg, req),
+    );
+
+    Server::builder()
+        .add_service(svc)
+        .serve_with_incoming(TcpListenerStream::new(listener))
+        .await
+        .expect("serve");
+}
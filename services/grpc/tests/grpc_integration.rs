@@ -29,6 +29,7 @@ async fn grpc_query_streams_rows() {
     let mut stream = client
         .query(QueryRequest {
             query: "SELECT 1".to_string(),
+            ..Default::default()
         })
         .await
         .expect("query")